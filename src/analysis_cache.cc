@@ -0,0 +1,171 @@
+#include "analysis_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "position_db.h"
+#include "search.h"
+
+namespace {
+// Mixed into the keys of Chess960 boards.
+constexpr uint64_t chess960_key = 0x9d39247e33776d41;
+
+std::string results_path(const std::string& path) {
+  return path + ".results";
+}
+}  // namespace.
+
+AnalysisCache::AnalysisCache(const std::string& path)
+    : path_(path),
+      records_(new KeyedRecords(path, results_path(path),
+                                sizeof(AnalysisRecord))) {}
+
+uint64_t AnalysisCache::cache_key(const Board& board) {
+  return board.key_ ^ (board.is_chess960_ ? chess960_key : 0);
+}
+
+const AnalysisRecord* AnalysisCache::find_record(uint64_t key) const {
+  const auto it = added_.find(key);
+  if (it != added_.end()) {
+    return &it->second;
+  }
+  return reinterpret_cast<const AnalysisRecord*>(records_->find(key));
+}
+
+absl::optional<AnalysisRecord> AnalysisCache::find(const Board& board) const {
+  AnalysisRecord res;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const AnalysisRecord* const record = find_record(cache_key(board));
+    if (!record) {
+      return absl::nullopt;
+    }
+    std::memcpy(&res, record, sizeof(res));
+  }
+  if (res.chess960_ != board.is_chess960_ || res.depth_ == 0) {
+    return absl::nullopt;
+  }
+  Board after = board;
+  uint8_t pv_length = 0;
+  for (; pv_length < res.pv_length_ && pv_length < res.pv_.size();
+       ++pv_length) {
+    const MoveList moves = after.legal_moves();
+    const Move move = res.pv_[pv_length];
+    if (std::find(moves.begin(), moves.end(), move) == moves.end()) {
+      break;
+    }
+    UndoInfo undo;
+    after.do_move(move, &undo);
+  }
+  if (pv_length == 0) {
+    return absl::nullopt;
+  }
+  res.pv_length_ = pv_length;
+  return res;
+}
+
+void AnalysisCache::add(const Board& board, const SearchResult& result) {
+  if (!result.best_move_ || result.depth_ < 1) {
+    return;
+  }
+  AnalysisRecord record = {};
+  record.depth_ = static_cast<uint8_t>(std::min(result.depth_, 255));
+  record.chess960_ = board.is_chess960_;
+  record.pv_length_ = static_cast<uint8_t>(
+      std::min(result.pv_.size(), record.pv_.size()));
+  record.score_ = result.score_;
+  record.nodes_ = result.nodes_;
+  std::copy(result.pv_.begin(), result.pv_.begin() + record.pv_length_,
+            record.pv_.begin());
+  const uint64_t key = cache_key(board);
+  std::lock_guard<std::shared_mutex> lock(mutex_);
+  const AnalysisRecord* const stored = find_record(key);
+  if (stored && stored->depth_ >= record.depth_) {
+    return;
+  }
+  added_[key] = record;
+}
+
+bool AnalysisCache::flush() {
+  std::lock_guard<std::shared_mutex> lock(mutex_);
+  if (added_.empty()) {
+    return true;
+  }
+  std::vector<std::pair<uint64_t, const AnalysisRecord*>> added;
+  added.reserve(added_.size());
+  for (const auto& key_and_record : added_) {
+    added.emplace_back(key_and_record.first, &key_and_record.second);
+  }
+  std::sort(added.begin(), added.end());
+  // Both sorted by key, merged into the new files, the results added
+  // replacing those of the same key.
+  const std::string new_path = path_ + ".new";
+  KeyedRecordsWriter writer(new_path, results_path(new_path));
+  const KeyedRecords& records = *records_;
+  size_t idx = 0;
+  for (const auto& key_and_record : added) {
+    for (; idx < records.size() && records.key(idx) < key_and_record.first;
+         ++idx) {
+      writer.write(records.key(idx), records.record(idx),
+                   sizeof(AnalysisRecord));
+    }
+    if (idx < records.size() && records.key(idx) == key_and_record.first) {
+      ++idx;
+    }
+    writer.write(key_and_record.first, key_and_record.second,
+                 sizeof(AnalysisRecord));
+  }
+  for (; idx < records.size(); ++idx) {
+    writer.write(records.key(idx), records.record(idx),
+                 sizeof(AnalysisRecord));
+  }
+  // Mapped files stay readable once renamed over, so the old ones are only
+  // let go of after the new ones are in place.
+  if (!writer.close() ||
+      std::rename(results_path(new_path).c_str(),
+                  results_path(path_).c_str()) != 0 ||
+      std::rename((new_path + ".keys").c_str(),
+                  (path_ + ".keys").c_str()) != 0) {
+    return false;
+  }
+  records_ = std::make_unique<KeyedRecords>(path_, results_path(path_),
+                                            sizeof(AnalysisRecord));
+  added_.clear();
+  return records_->is_open();
+}
+
+size_t AnalysisCache::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  size_t res = records_->size();
+  for (const auto& key_and_record : added_) {
+    if (!records_->find(key_and_record.first)) {
+      ++res;
+    }
+  }
+  return res;
+}
+
+SearchResult record_to_search_result(const AnalysisRecord& record) {
+  std::vector<Move> pv(record.pv_.begin(),
+                       record.pv_.begin() + record.pv_length_);
+  SearchResult res = {pv.empty() ? absl::nullopt : absl::optional<Move>(pv[0]),
+                      record.score_,
+                      record.depth_,
+                      pv,
+                      record.nodes_,
+                      record.depth_,
+                      0,
+                      {{record.score_, pv}}};
+  return res;
+}
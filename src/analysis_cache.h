@@ -0,0 +1,94 @@
+#ifndef ANALYSIS_CACHE_H
+#define ANALYSIS_CACHE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "position_db.h"
+#include "search.h"
+
+// The deepest completed search of a position.
+struct AnalysisRecord {
+  // The depth of the search.
+  uint8_t depth_;
+  // 1 for a Chess960 board, 0 for standard chess.
+  uint8_t chess960_;
+  // The moves of `pv_` that are used.
+  uint8_t pv_length_;
+  uint8_t unused_;
+  int32_t score_;
+  // The positions the search visited.
+  uint64_t nodes_;
+  // The start of the principal variation.
+  std::array<Move, 12> pv_;
+};
+
+static_assert(sizeof(AnalysisRecord) == 64, "AnalysisRecord layout changed.");
+static_assert(std::is_trivially_copyable<AnalysisRecord>::value,
+              "AnalysisRecords are read and written as bytes.");
+
+// The results of the searches of an analysis service, kept from one run to
+// the next, for positions that are asked for again and again at different
+// depths. For each position and rule variant it keeps the deepest search
+// completed, with its score, node count and principal variation. A request
+// for a depth no deeper is served from it, and a deeper one starts from its
+// principal variation (see AnalysisServer).
+//
+// The results are a database in the layout of position_db.h, with records of
+// AnalysisRecord in <path>.results, mapped read-only, and the results added
+// since it was written, in memory. `flush` merges the two into new files
+// that are renamed over the old ones, so that no reader ever maps them half
+// written, and maps those. Lookups share a lock, so any number of threads
+// look up at once, while adding and flushing take it alone.
+//
+// The positions are keyed by their Zobrist keys, with a fixed key of the
+// variant mixed into those of Chess960 boards. A key that collides gives the
+// result of another position, whose line stops being used at its first move
+// that is illegal on this one.
+class AnalysisCache {
+ public:
+  // Opens the database at `path`, or starts an empty one if there is none or
+  // it can't be read.
+  explicit AnalysisCache(const std::string& path);
+  AnalysisCache(const AnalysisCache&) = delete;
+  AnalysisCache& operator=(const AnalysisCache&) = delete;
+
+  // The deepest search stored for `board`, its principal variation cut
+  // before its first illegal move, or nullopt if there is none with a legal
+  // first move.
+  absl::optional<AnalysisRecord> find(const Board& board) const;
+  // Keeps `result`, of a completed search of `board`, unless a search as
+  // deep is kept already. Results without a best move are ignored.
+  void add(const Board& board, const SearchResult& result);
+  // Writes every result to the files, unless none was added since they were
+  // written, and maps them. Returns false, keeping the results in memory, if
+  // they couldn't be written.
+  bool flush();
+  // The number of positions with a result.
+  size_t size() const;
+
+ private:
+  // The key of `board` in the database.
+  static uint64_t cache_key(const Board& board);
+  // `find` with the lock held.
+  const AnalysisRecord* find_record(uint64_t key) const;
+
+  const std::string path_;
+  // Guards everything below.
+  mutable std::shared_mutex mutex_;
+  std::unique_ptr<KeyedRecords> records_;
+  absl::flat_hash_map<uint64_t, AnalysisRecord> added_;
+};
+
+// The result of a search that `record` stands for, with its one line.
+SearchResult record_to_search_result(const AnalysisRecord& record);
+
+#endif
@@ -0,0 +1,126 @@
+#include "analysis_cache.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "search.h"
+
+namespace {
+// A result of `depth` on `board` with the line of UCI `moves`.
+SearchResult result_of(const Board& board, int depth,
+                       const std::vector<const char*>& moves) {
+  SearchResult res = {absl::nullopt, 10 * depth, depth, {}, 1000u * depth,
+                      depth,         0,          {}};
+  Board after = board;
+  for (const char* move_str : moves) {
+    const absl::optional<Move> move = parse_uci_move(after, move_str);
+    EXPECT_TRUE(move) << move_str;
+    res.pv_.push_back(*move);
+    after.do_move(*move);
+  }
+  res.best_move_ = res.pv_[0];
+  res.lines_ = {{res.score_, res.pv_}};
+  return res;
+}
+
+// A path for a new cache, without the files of an earlier run.
+std::string new_path(const std::string& name) {
+  const std::string path = testing::TempDir() + name;
+  std::remove((path + ".keys").c_str());
+  std::remove((path + ".results").c_str());
+  return path;
+}
+}  // namespace.
+
+TEST(AnalysisCache, KeepsTheDeepestResult) {
+  AnalysisCache cache(new_path("analysis_cache_deepest"));
+  const Board board;
+  EXPECT_FALSE(cache.find(board));
+  cache.add(board, result_of(board, 8, {"e2e4", "e7e5"}));
+  cache.add(board, result_of(board, 5, {"d2d4"}));
+  absl::optional<AnalysisRecord> record = cache.find(board);
+  ASSERT_TRUE(record);
+  EXPECT_EQ(record->depth_, 8);
+  EXPECT_EQ(record->score_, 80);
+  EXPECT_EQ(record->nodes_, 8000u);
+  EXPECT_EQ(record->pv_length_, 2);
+
+  cache.add(board, result_of(board, 9, {"g1f3"}));
+  record = cache.find(board);
+  ASSERT_TRUE(record);
+  const SearchResult result = record_to_search_result(*record);
+  EXPECT_EQ(result.depth_, 9);
+  EXPECT_EQ(result.best_move_->to_uci_str(), "g1f3");
+  ASSERT_EQ(result.lines_.size(), 1);
+  EXPECT_EQ(result.lines_[0].pv_, result.pv_);
+  EXPECT_EQ(cache.size(), 1);
+
+  // Results without a best move are ignored.
+  const Board mated =
+      *parse_fen("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq -");
+  cache.add(mated, {absl::nullopt, 0, 20, {}, 0, 0, 0, {}});
+  EXPECT_FALSE(cache.find(mated));
+}
+
+TEST(AnalysisCache, FlushesAndReopens) {
+  const std::string path = new_path("analysis_cache_reopen");
+  const Board start;
+  const Board kiwipete = *parse_fen(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -");
+  {
+    AnalysisCache cache(path);
+    EXPECT_TRUE(cache.flush());
+    cache.add(start, result_of(start, 6, {"e2e4"}));
+    ASSERT_TRUE(cache.flush());
+    // Merged with the results already written.
+    cache.add(kiwipete, result_of(kiwipete, 4, {"e2a6", "b4c3"}));
+    cache.add(start, result_of(start, 7, {"d2d4"}));
+    ASSERT_TRUE(cache.flush());
+    EXPECT_EQ(cache.size(), 2);
+  }
+  const AnalysisCache cache(path);
+  EXPECT_EQ(cache.size(), 2);
+  const absl::optional<AnalysisRecord> start_record = cache.find(start);
+  ASSERT_TRUE(start_record);
+  EXPECT_EQ(start_record->depth_, 7);
+  EXPECT_EQ(start_record->pv_[0].to_uci_str(), "d2d4");
+  const absl::optional<AnalysisRecord> kiwipete_record = cache.find(kiwipete);
+  ASSERT_TRUE(kiwipete_record);
+  EXPECT_EQ(kiwipete_record->depth_, 4);
+  EXPECT_EQ(kiwipete_record->pv_length_, 2);
+}
+
+TEST(AnalysisCache, KeysTheVariant) {
+  AnalysisCache cache(new_path("analysis_cache_variant"));
+  const Board standard;
+  const Board chess960 =
+      *parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                 nullptr, true);
+  cache.add(standard, result_of(standard, 6, {"e2e4"}));
+  EXPECT_FALSE(cache.find(chess960));
+  cache.add(chess960, result_of(chess960, 3, {"d2d4"}));
+  EXPECT_EQ(cache.find(standard)->depth_, 6);
+  EXPECT_EQ(cache.find(chess960)->depth_, 3);
+}
+
+TEST(AnalysisCache, CutsTheLineAtAnIllegalMove) {
+  AnalysisCache cache(new_path("analysis_cache_illegal"));
+  const Board board;
+  SearchResult result = result_of(board, 6, {"e2e4", "e7e5", "g1f3"});
+  const Move black_move = result.pv_[1];
+  // As if the key had collided with that of another position.
+  result.pv_[1] = result.pv_[2];
+  cache.add(board, result);
+  const absl::optional<AnalysisRecord> record = cache.find(board);
+  ASSERT_TRUE(record);
+  EXPECT_EQ(record->pv_length_, 1);
+
+  result.pv_[0] = black_move;
+  result.depth_ = 7;
+  cache.add(board, result);
+  EXPECT_FALSE(cache.find(board));
+}
@@ -0,0 +1,399 @@
+#include "analysis_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "analysis_cache.h"
+#include "board.h"
+#include "repetition.h"
+#include "search.h"
+#include "time_manager.h"
+#include "transposition_table.h"
+
+namespace {
+// The CPU time the calling thread has used, in microseconds, or 0 where it
+// can't be read.
+int64_t thread_cpu_time_us() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  timespec time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+    return int64_t{time.tv_sec} * 1000000 + time.tv_nsec / 1000;
+  }
+#endif
+  return 0;
+}
+}  // namespace.
+
+AnalysisServer::AnalysisServer(ThreadPool* pool, const NnueNetwork* network,
+                               AnalysisCache* cache)
+    : pool_(pool),
+      network_(network),
+      cache_(cache),
+      next_session_id_(1),
+      next_request_id_(1),
+      last_served_(0),
+      num_runners_(0),
+      num_requests_(0) {}
+
+AnalysisServer::~AnalysisServer() {
+  std::vector<SessionId> sessions;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& id_and_session : sessions_) {
+      sessions.push_back(id_and_session.first);
+    }
+  }
+  for (SessionId session : sessions) {
+    close_session(session);
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return num_runners_ == 0; });
+}
+
+AnalysisServer::SessionId AnalysisServer::open_session(
+    size_t hash_mb, AnalysisPriority priority) {
+  // Allocating and clearing the table is the slow part, so it is done before
+  // taking the lock.
+  std::unique_ptr<TranspositionTable> table =
+      std::make_unique<TranspositionTable>(hash_mb);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const SessionId id = next_session_id_++;
+  Session& session = sessions_[id];
+  session.table_ = std::move(table);
+  session.running_ = nullptr;
+  session.closed_ = false;
+  session.priority_ = priority;
+  session.stats_ = {};
+  return id;
+}
+
+bool AnalysisServer::close_session(SessionId session_id) {
+  std::deque<std::unique_ptr<Request>> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = sessions_.find(session_id);
+    if (it == sessions_.end() || it->second.closed_) {
+      return false;
+    }
+    Session& session = it->second;
+    session.closed_ = true;
+    cancelled.swap(session.queue_);
+    num_requests_ -= cancelled.size();
+    if (session.running_) {
+      // The worker erases the session when the request ends.
+      session.running_->stop_.store(true, std::memory_order_relaxed);
+      session.running_->preempted_ = false;
+    } else {
+      sessions_.erase(it);
+    }
+  }
+  for (const std::unique_ptr<Request>& request : cancelled) {
+    cancel_queued(request.get());
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (num_requests_ == 0) {
+    idle_.notify_all();
+  }
+  return true;
+}
+
+AnalysisServer::RequestId AnalysisServer::submit(SessionId session_id,
+                                                 const Board& board,
+                                                 const AnalysisLimits& limits,
+                                                 AnalysisCallback callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = sessions_.find(session_id);
+  if (it == sessions_.end() || it->second.closed_) {
+    return 0;
+  }
+  std::unique_ptr<Request> request = std::make_unique<Request>();
+  request->id_ = next_request_id_++;
+  request->board_ = board;
+  request->limits_ = limits;
+  request->callback_ = std::move(callback);
+  request->stop_.store(false, std::memory_order_relaxed);
+  request->done_ = {absl::nullopt, 0, 0, {}, 0, 0, 0, {}};
+  request->elapsed_ms_ = 0;
+  request->preempted_ = false;
+  const RequestId id = request->id_;
+  it->second.queue_.push_back(std::move(request));
+  ++num_requests_;
+  if (num_runners_ < pool_->num_threads()) {
+    ++num_runners_;
+    pool_->submit([this] { run(); });
+  }
+  if (it->second.priority_ == AnalysisPriority::interactive) {
+    preempt_background();
+  }
+  return id;
+}
+
+bool AnalysisServer::cancel(RequestId request_id) {
+  std::unique_ptr<Request> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& id_and_session : sessions_) {
+      Session& session = id_and_session.second;
+      if (session.running_ && session.running_->id_ == request_id) {
+        session.running_->stop_.store(true, std::memory_order_relaxed);
+        session.running_->preempted_ = false;
+        return true;
+      }
+      for (auto it = session.queue_.begin(); it != session.queue_.end();
+           ++it) {
+        if ((*it)->id_ == request_id) {
+          cancelled = std::move(*it);
+          session.queue_.erase(it);
+          --num_requests_;
+          break;
+        }
+      }
+      if (cancelled) {
+        break;
+      }
+    }
+  }
+  if (!cancelled) {
+    return false;
+  }
+  cancel_queued(cancelled.get());
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (num_requests_ == 0) {
+    idle_.notify_all();
+  }
+  return true;
+}
+
+void AnalysisServer::wait_idle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return num_requests_ == 0; });
+}
+
+absl::optional<AnalysisSessionStats> AnalysisServer::session_stats(
+    SessionId session_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = sessions_.find(session_id);
+  if (it == sessions_.end()) {
+    return absl::nullopt;
+  }
+  return it->second.stats_;
+}
+
+void AnalysisServer::cancel_queued(Request* request) {
+  // Empty unless the request was preempted.
+  request->callback_(request->done_, true);
+}
+
+void AnalysisServer::preempt_background() {
+  size_t num_busy = 0;
+  size_t num_waiting = 0;
+  for (const auto& id_and_session : sessions_) {
+    const Session& session = id_and_session.second;
+    if (session.running_) {
+      num_busy += !session.running_->preempted_;
+    } else if (session.priority_ == AnalysisPriority::interactive &&
+               !session.queue_.empty()) {
+      ++num_waiting;
+    }
+  }
+  while (num_busy + num_waiting > pool_->num_threads()) {
+    // The one that came last has likely done the least.
+    Request* victim = nullptr;
+    for (const auto& id_and_session : sessions_) {
+      const Session& session = id_and_session.second;
+      Request* const request = session.running_;
+      if (request && session.priority_ == AnalysisPriority::background &&
+          !request->preempted_ && !request->limits_.deterministic_ &&
+          !session.closed_ && (!victim || request->id_ > victim->id_)) {
+        victim = request;
+      }
+    }
+    if (!victim) {
+      return;
+    }
+    victim->preempted_ = true;
+    victim->stop_.store(true, std::memory_order_relaxed);
+    --num_busy;
+  }
+}
+
+std::unique_ptr<AnalysisServer::Request> AnalysisServer::take_request(
+    SessionId* session_id) {
+  if (sessions_.empty()) {
+    return nullptr;
+  }
+  // The interactive sessions first. Within a priority, the sessions after
+  // the last one served, then the others from the start, that last one
+  // included.
+  for (AnalysisPriority priority :
+       {AnalysisPriority::interactive, AnalysisPriority::background}) {
+    auto it = sessions_.upper_bound(last_served_);
+    for (size_t i = 0; i < sessions_.size(); ++i, ++it) {
+      if (it == sessions_.end()) {
+        it = sessions_.begin();
+      }
+      Session& session = it->second;
+      if (!session.running_ && !session.queue_.empty() &&
+          session.priority_ == priority) {
+        std::unique_ptr<Request> res = std::move(session.queue_.front());
+        session.queue_.pop_front();
+        session.running_ = res.get();
+        last_served_ = it->first;
+        *session_id = it->first;
+        return res;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void AnalysisServer::end_request(SessionId session_id) {
+  --num_requests_;
+  const auto it = sessions_.find(session_id);
+  it->second.running_ = nullptr;
+  ++it->second.stats_.num_requests_;
+  if (it->second.closed_) {
+    sessions_.erase(it);
+  }
+  if (num_requests_ == 0) {
+    idle_.notify_all();
+  }
+}
+
+void AnalysisServer::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_ptr<Searcher> searcher;
+  if (!idle_searchers_.empty()) {
+    searcher = std::move(idle_searchers_.back());
+    idle_searchers_.pop_back();
+  }
+  SessionId session_id = 0;
+  while (std::unique_ptr<Request> request = take_request(&session_id)) {
+    TranspositionTable* const table = sessions_[session_id].table_.get();
+    lock.unlock();
+
+    if (!searcher) {
+      searcher = std::make_unique<Searcher>(table);
+      searcher->set_network(network_);
+    }
+    const int64_t cpu_start = thread_cpu_time_us();
+    const SearchResult res =
+        search_request(request.get(), searcher.get(), table);
+    const int64_t cpu_time = thread_cpu_time_us() - cpu_start;
+
+    lock.lock();
+    Session& session = sessions_[session_id];
+    session.stats_.cpu_time_us_ += cpu_time;
+    if (request->preempted_) {
+      ++session.stats_.num_preemptions_;
+      request->preempted_ = false;
+      request->stop_.store(false, std::memory_order_relaxed);
+      session.queue_.push_front(std::move(request));
+      session.running_ = nullptr;
+      continue;
+    }
+    lock.unlock();
+    if (cache_) {
+      cache_->add(request->board_, res);
+    }
+    request->callback_(res, true);
+
+    lock.lock();
+    end_request(session_id);
+  }
+  if (searcher) {
+    idle_searchers_.push_back(std::move(searcher));
+  }
+  --num_runners_;
+  idle_.notify_all();
+}
+
+SearchResult AnalysisServer::search_request(Request* request,
+                                            Searcher* searcher,
+                                            TranspositionTable* table) {
+  const AnalysisLimits& limits = request->limits_;
+  SearchResult& done = request->done_;
+  // A preempted request resumes after its last completed iteration.
+  const int first_depth = done.depth_ + 1;
+  absl::optional<AnalysisRecord> cached;
+  if (cache_ && !limits.deterministic_ && first_depth == 1) {
+    cached = cache_->find(request->board_);
+  }
+  if (cached && cached->depth_ >= limits.max_depth_ &&
+      limits.num_lines_ == 1) {
+    const SearchResult res = record_to_search_result(*cached);
+    request->callback_(res, false);
+    return res;
+  }
+  // What is left of the limits after the earlier runs.
+  uint64_t max_nodes = limits.max_nodes_;
+  int64_t move_time = limits.move_time_;
+  if (first_depth > 1) {
+    if (first_depth > limits.max_depth_ ||
+        (max_nodes > 0 && done.nodes_ >= max_nodes) ||
+        (move_time > 0 && request->elapsed_ms_ >= move_time)) {
+      return done;
+    }
+    max_nodes -= max_nodes > 0 ? done.nodes_ : 0;
+    move_time -= move_time > 0 ? request->elapsed_ms_ : 0;
+  }
+
+  searcher->set_table(table);
+  searcher->set_multi_pv(limits.num_lines_);
+  searcher->set_game_history(KeyHistory());
+  // Only this request uses the table now, as a session runs one at a time.
+  if (limits.deterministic_) {
+    table->clear();
+    searcher->clear();
+  }
+  if (first_depth > 1) {
+    searcher->set_first_pv(done.pv_);
+  } else if (cached) {
+    searcher->set_first_pv(std::vector<Move>(
+        cached->pv_.begin(), cached->pv_.begin() + cached->pv_length_));
+  }
+  table->new_search();
+  std::unique_ptr<TimeManager> time_manager;
+  if (move_time > 0 && !limits.deterministic_) {
+    TimeControl time_control = {};
+    time_control.move_time_ = move_time;
+    time_manager = std::make_unique<TimeManager>(
+        time_control,
+        request->board_.is_whites_move_ ? Color::white : Color::black);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t earlier_nodes = done.nodes_;
+  SearchResult res = searcher->search_iterations(
+      request->board_, first_depth,
+      {limits.max_depth_, max_nodes, &request->stop_, time_manager.get()},
+      [request, earlier_nodes](const SearchResult& iteration) {
+        if (earlier_nodes == 0) {
+          request->callback_(iteration, false);
+          return;
+        }
+        SearchResult with_earlier = iteration;
+        with_earlier.nodes_ += earlier_nodes;
+        request->callback_(with_earlier, false);
+      });
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  request->elapsed_ms_ +=
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+  res.nodes_ += earlier_nodes;
+  res.tablebase_hits_ += done.tablebase_hits_;
+  if (res.depth_ == 0) {
+    // Stopped before an iteration completed, which keeps the earlier ones.
+    done.nodes_ = res.nodes_;
+    done.tablebase_hits_ = res.tablebase_hits_;
+    return done;
+  }
+  done = res;
+  return res;
+}
@@ -0,0 +1,199 @@
+#ifndef ANALYSIS_SERVER_H
+#define ANALYSIS_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "analysis_cache.h"
+#include "board.h"
+#include "nnue.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// The budget of an analysis request. The search ends at whichever limit it
+// reaches first, and always completes its first iteration.
+struct AnalysisLimits {
+  // At least 1 and less than `max_search_ply`.
+  int max_depth_ = max_search_ply - 1;
+  // No limit if 0.
+  uint64_t max_nodes_ = 0;
+  // In milliseconds, no limit if 0.
+  int64_t move_time_ = 0;
+  size_t num_lines_ = 1;
+  // Searches from a cleared table and searcher, with no time limit, so that
+  // the same position and limits always give the same result, which a cache
+  // of results can then serve. It costs the request what the session's
+  // earlier requests stored, and the session's later requests what this one
+  // didn't.
+  bool deterministic_ = false;
+};
+
+// How the requests of a session compete for the workers.
+enum class AnalysisPriority {
+  // Requests a client waits for, which start before any background request
+  // and take the worker of one if none is free.
+  interactive,
+  // Bulk jobs such as annotating games or labeling positions, which soak up
+  // the workers the interactive requests leave idle.
+  background
+};
+
+// What the requests of a session have cost, since it was opened.
+struct AnalysisSessionStats {
+  // The CPU time of the workers while they ran the session's requests, in
+  // microseconds.
+  int64_t cpu_time_us_;
+  // The requests that ended while they were running.
+  uint64_t num_requests_;
+  // The times its requests were stopped for an interactive request.
+  uint64_t num_preemptions_;
+};
+
+// Called with the result of every completed iteration of a request, then once
+// more with `final` set and the result the request ended with. A request that
+// was cancelled before it started, or stopped before its first iteration
+// completed, ends with an empty result, without a best move. The calls of one
+// request come from one thread at a time, in order.
+typedef std::function<void(const SearchResult& result, bool final)>
+    AnalysisCallback;
+
+// Serves many concurrent analysis requests in one process, on the workers of
+// a thread pool, rather than an engine process per request.
+//
+// Requests belong to sessions, and each session has a transposition table of
+// its own, which its requests share one after the other, so that a client
+// analysing related positions gets the benefit of what its earlier requests
+// stored. A session runs one request at a time, in the order they came, and
+// the sessions with requests waiting take turns for the workers, so that a
+// client with a long queue doesn't hold the others up (round-robin fair
+// queueing). Each request runs single-threaded on one worker; the workers
+// keep their searchers from one request to the next.
+//
+// Interactive sessions are served before background ones. When an
+// interactive request is waiting and every worker is busy, the background
+// request that came last is stopped, at once, through its stop flag, and
+// queued again at the front of its session. It later resumes from its last
+// completed iteration, with what is left of its node and time limits, so
+// that it loses only the iteration in progress. Deterministic requests are
+// never preempted, since resuming them would change their result. The CPU
+// time of the requests is accounted to their sessions, so that a front end
+// can bill its tenants or share the workers out between them.
+//
+// With a cache of results (see analysis_cache.h), shared by every session,
+// a request that isn't deterministic and looks for one line is answered
+// from the cache, without searching, if it holds a search at least as deep
+// as the request's maximum depth. Otherwise the search starts from the
+// cached principal variation, if any. The results of completed searches
+// are added to the cache.
+class AnalysisServer {
+ public:
+  typedef uint64_t SessionId;
+  typedef uint64_t RequestId;
+
+  // Runs at most as many requests at once as `pool` has workers. None of
+  // `pool`, `network`, which may be null for the classical evaluation, and
+  // `cache`, which may be null for none, is owned, and all must outlive the
+  // server.
+  explicit AnalysisServer(ThreadPool* pool,
+                          const NnueNetwork* network = nullptr,
+                          AnalysisCache* cache = nullptr);
+  AnalysisServer(const AnalysisServer&) = delete;
+  AnalysisServer& operator=(const AnalysisServer&) = delete;
+  // Cancels every request and waits for the running ones to end.
+  ~AnalysisServer();
+
+  // Opens a session with a table of `hash_mb` megabytes.
+  SessionId open_session(
+      size_t hash_mb,
+      AnalysisPriority priority = AnalysisPriority::interactive);
+  // Cancels the requests of `session` and frees its table once its running
+  // request, if any, has ended. Returns false if there is no such session.
+  bool close_session(SessionId session);
+  // Queues the analysis of `board`, which must have legal moves, and returns
+  // the id of the request, or 0 if there is no such session.
+  RequestId submit(SessionId session, const Board& board,
+                   const AnalysisLimits& limits, AnalysisCallback callback);
+  // Removes the request from its queue, or stops it if it is running, and
+  // returns false if it has ended already.
+  bool cancel(RequestId request);
+  // Blocks until no request is waiting or running.
+  void wait_idle();
+  // What the requests of `session` have cost so far, or nullopt if there is
+  // no such session.
+  absl::optional<AnalysisSessionStats> session_stats(SessionId session) const;
+
+ private:
+  struct Request {
+    RequestId id_;
+    Board board_;
+    AnalysisLimits limits_;
+    AnalysisCallback callback_;
+    std::atomic<bool> stop_;
+    // The last iteration completed before the request was preempted, with
+    // the nodes of every run of it, or an empty result.
+    SearchResult done_;
+    // The wall time of the runs so far, in milliseconds.
+    int64_t elapsed_ms_;
+    // Set with `stop_` when the request is stopped for an interactive one,
+    // and cleared if it is then cancelled. Guarded by the mutex.
+    bool preempted_;
+  };
+  struct Session {
+    std::unique_ptr<TranspositionTable> table_;
+    std::deque<std::unique_ptr<Request>> queue_;
+    // The request the session is running, or null.
+    Request* running_;
+    bool closed_;
+    AnalysisPriority priority_;
+    AnalysisSessionStats stats_;
+  };
+
+  // Runs requests on a worker until none can start.
+  void run();
+  // Runs `request`, or its rest if it was preempted, on `searcher` with
+  // `table`, and returns its result.
+  SearchResult search_request(Request* request, Searcher* searcher,
+                              TranspositionTable* table);
+  // Takes the next request to start, or returns null, and sets `*session_id`
+  // to its session. The mutex must be held.
+  std::unique_ptr<Request> take_request(SessionId* session_id);
+  // Preempts background requests until the workers that are free, or
+  // being freed, are as many as the interactive sessions with a request
+  // that can start. The mutex must be held.
+  void preempt_background();
+  // Frees the session of a request that ended, and erases it if it was
+  // closed. The mutex must be held.
+  void end_request(SessionId session_id);
+  // Ends `request` with an empty result.
+  static void cancel_queued(Request* request);
+
+  ThreadPool* const pool_;
+  const NnueNetwork* const network_;
+  AnalysisCache* const cache_;
+  // Guards everything below.
+  mutable std::mutex mutex_;
+  std::condition_variable idle_;
+  std::map<SessionId, Session> sessions_;
+  SessionId next_session_id_;
+  RequestId next_request_id_;
+  // The session the last request started from, where the next turn starts
+  // looking.
+  SessionId last_served_;
+  // The workers running `run`, and the requests queued or running.
+  size_t num_runners_;
+  size_t num_requests_;
+  // The searchers of the workers that are between requests.
+  std::vector<std::unique_ptr<Searcher>> idle_searchers_;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "analysis_cache.h"
+#include "analysis_server.h"
+#include "board.h"
+#include "nnue.h"
+#include "numa.h"
+#include "search.h"
+#include "thread_pool.h"
+
+// Usage: analysis_server [--threads <n>] [--cpus <list>]
+//                        [--eval-file <network>] [--cache <path>]
+//
+// Serves analysis requests (see analysis_server.h) read from stdin, one per
+// line, on a pool of --threads workers, one per hardware thread by default,
+// pinned to the CPUs of --cpus if given. A front end that speaks HTTP or RPC
+// to its clients runs it and forwards their requests. With --cache, results
+// are kept from one run to the next in the database at <path> (see
+// analysis_cache.h), which is written at the end and on "flush".
+//
+//   session <hash_mb> [background]
+//                                Opens a session, answered by
+//                                "session <id>". A background session's
+//                                requests only get the workers the
+//                                others leave idle (see AnalysisPriority).
+//   analyze <session> [depth <n>] [nodes <n>] [movetime <ms>]
+//           [multipv <n>] [deterministic] fen <fen>
+//                                Queues a request, answered by
+//                                "request <id>", or "error ..." if the
+//                                session or position is bad.
+//                                With "deterministic", the request
+//                                searches from a cleared table, without
+//                                its time limit, so that its result only
+//                                depends on the position and limits.
+//   cancel <request>             Cancels a request.
+//   close <session>              Closes a session.
+//   stats <session>              Answered by "stats <session> cputime <us>
+//                                requests <n> preemptions <n>", what the
+//                                session's requests have cost so far.
+//   flush                        Writes the cache, answered by "flushed",
+//                                or "error ..." if it can't be written.
+//   quit                         Cancels everything and exits. The end of
+//                                input instead waits for the requests.
+//
+// As a request runs, each completed iteration writes a line
+// "info <request> depth <n> multipv <n> score <n> nodes <n> pv <moves>" per
+// principal variation, with scores as the search has them (see
+// `mate_score`), and the request ends with "bestmove <request> <move>", or
+// with the move "0000" if it was cancelled or stopped before its first
+// iteration.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--threads <n>] [--cpus <list>] [--eval-file <network>]"
+               " [--cache <path>]\n";
+  return 1;
+}
+
+// Writes whole lines to stdout, from whichever thread.
+class Output {
+ public:
+  void write_line(const std::string& line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << line << std::endl;
+  }
+
+ private:
+  std::mutex mutex_;
+};
+
+// Returns the request `args`, which start with "analyze", asks for, or writes
+// what is wrong to `*error`.
+absl::optional<AnalysisServer::RequestId> analyze(
+    const std::vector<absl::string_view>& args, AnalysisServer* server,
+    Output* output, std::string* error) {
+  AnalysisServer::SessionId session = 0;
+  if (args.size() < 2 || !absl::SimpleAtoi(args[1], &session)) {
+    *error = "missing session";
+    return absl::nullopt;
+  }
+  AnalysisLimits limits;
+  size_t idx = 2;
+  for (; idx < args.size() && args[idx] != "fen"; ++idx) {
+    const absl::string_view name = args[idx];
+    if (name == "deterministic") {
+      limits.deterministic_ = true;
+      continue;
+    }
+    const absl::string_view value = ++idx < args.size() ? args[idx] : "";
+    bool is_valid = false;
+    if (name == "depth") {
+      is_valid = absl::SimpleAtoi(value, &limits.max_depth_) &&
+                 limits.max_depth_ >= 1 && limits.max_depth_ < max_search_ply;
+    } else if (name == "nodes") {
+      is_valid = absl::SimpleAtoi(value, &limits.max_nodes_);
+    } else if (name == "movetime") {
+      is_valid =
+          absl::SimpleAtoi(value, &limits.move_time_) && limits.move_time_ >= 0;
+    } else if (name == "multipv") {
+      is_valid =
+          absl::SimpleAtoi(value, &limits.num_lines_) && limits.num_lines_ >= 1;
+    }
+    if (!is_valid) {
+      *error = absl::StrCat("bad limit ", name);
+      return absl::nullopt;
+    }
+  }
+  if (idx >= args.size() || args[idx] != "fen") {
+    *error = "missing fen";
+    return absl::nullopt;
+  }
+  const std::vector<absl::string_view> fen_fields(args.begin() + idx + 1,
+                                                  args.end());
+  const char* fen_error = nullptr;
+  const absl::optional<Board> board =
+      parse_fen(absl::StrJoin(fen_fields, " "), &fen_error);
+  if (!board) {
+    *error = fen_error;
+    return absl::nullopt;
+  }
+  if (board->legal_moves().empty()) {
+    *error = "no legal moves";
+    return absl::nullopt;
+  }
+
+  // The id is only known once `submit` returns, after which the callback may
+  // already run, so it waits for it behind a shared cell.
+  struct Id {
+    std::mutex mutex_;
+    AnalysisServer::RequestId value_ = 0;
+  };
+  const auto id = std::make_shared<Id>();
+  std::unique_lock<std::mutex> lock(id->mutex_);
+  id->value_ = server->submit(
+      session, *board, limits,
+      [id, output](const SearchResult& result, bool final) {
+        std::lock_guard<std::mutex> callback_lock(id->mutex_);
+        if (final) {
+          output->write_line(absl::StrCat(
+              "bestmove ", id->value_, " ",
+              result.best_move_ ? result.best_move_->to_uci_str() : "0000"));
+          return;
+        }
+        for (size_t i = 0; i < result.lines_.size(); ++i) {
+          std::string line = absl::StrCat(
+              "info ", id->value_, " depth ", result.depth_, " multipv ",
+              i + 1, " score ", result.lines_[i].score_, " nodes ",
+              result.nodes_, " pv");
+          for (const Move& move : result.lines_[i].pv_) {
+            absl::StrAppend(&line, " ", move.to_uci_str());
+          }
+          output->write_line(line);
+        }
+      });
+  if (id->value_ == 0) {
+    *error = "no such session";
+    return absl::nullopt;
+  }
+  // Announced before the lock is released and the callback can write.
+  output->write_line(absl::StrCat("request ", id->value_));
+  return id->value_;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  size_t num_threads = 0;
+  ThreadAffinity affinity;
+  const char* eval_file = nullptr;
+  const char* cache_path = nullptr;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const char* const flag = argv[arg_idx];
+    if (arg_idx + 1 == argc) {
+      return usage(argv[0]);
+    }
+    const char* const value = argv[++arg_idx];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &num_threads);
+    } else if (std::strcmp(flag, "--cpus") == 0) {
+      affinity.cpus_ = parse_cpu_list(value);
+      is_valid = !affinity.cpus_.empty();
+    } else if (std::strcmp(flag, "--eval-file") == 0) {
+      eval_file = value;
+      is_valid = true;
+    } else if (std::strcmp(flag, "--cache") == 0) {
+      cache_path = value;
+      is_valid = true;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+
+  NetworkPtr network;
+  if (eval_file) {
+    std::string error;
+    network = load_network(eval_file, &error);
+    if (!network) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+  }
+  std::unique_ptr<AnalysisCache> cache;
+  if (cache_path) {
+    cache = std::make_unique<AnalysisCache>(cache_path);
+  }
+  ThreadPool pool(num_threads, affinity);
+  Output output;
+  // Reset before the cache is written, and before the pool goes.
+  auto server =
+      std::make_unique<AnalysisServer>(&pool, network.get(), cache.get());
+
+  bool quit = false;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    const std::vector<absl::string_view> args =
+        absl::StrSplit(line, ' ', absl::SkipWhitespace());
+    if (args.empty()) {
+      continue;
+    }
+    std::string error;
+    if (args[0] == "session") {
+      size_t hash_mb = 0;
+      const bool is_background = args.size() == 3 && args[2] == "background";
+      if ((args.size() == 2 || is_background) &&
+          absl::SimpleAtoi(args[1], &hash_mb) && hash_mb > 0) {
+        output.write_line(absl::StrCat(
+            "session ",
+            server->open_session(hash_mb,
+                                 is_background
+                                     ? AnalysisPriority::background
+                                     : AnalysisPriority::interactive)));
+      } else {
+        error = "bad hash size";
+      }
+    } else if (args[0] == "analyze") {
+      analyze(args, server.get(), &output, &error);
+    } else if (args[0] == "cancel") {
+      AnalysisServer::RequestId request = 0;
+      if (args.size() != 2 || !absl::SimpleAtoi(args[1], &request)) {
+        error = "bad request";
+      } else {
+        server->cancel(request);
+      }
+    } else if (args[0] == "close") {
+      AnalysisServer::SessionId session = 0;
+      if (args.size() != 2 || !absl::SimpleAtoi(args[1], &session) ||
+          !server->close_session(session)) {
+        error = "no such session";
+      }
+    } else if (args[0] == "stats") {
+      AnalysisServer::SessionId session = 0;
+      absl::optional<AnalysisSessionStats> stats;
+      if (args.size() == 2 && absl::SimpleAtoi(args[1], &session)) {
+        stats = server->session_stats(session);
+      }
+      if (stats) {
+        output.write_line(absl::StrCat(
+            "stats ", session, " cputime ", stats->cpu_time_us_, " requests ",
+            stats->num_requests_, " preemptions ", stats->num_preemptions_));
+      } else {
+        error = "no such session";
+      }
+    } else if (args[0] == "flush") {
+      if (!cache || !cache->flush()) {
+        error = "can't write the cache";
+      } else {
+        output.write_line("flushed");
+      }
+    } else if (args[0] == "quit") {
+      quit = true;
+      break;
+    } else {
+      error = "unknown command";
+    }
+    if (!error.empty()) {
+      output.write_line(absl::StrCat("error ", error));
+    }
+  }
+  if (!quit) {
+    server->wait_idle();
+  }
+  server.reset();
+  if (cache && !cache->flush()) {
+    std::cerr << "Can't write the cache to " << cache_path << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include "analysis_server.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "analysis_cache.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "search.h"
+#include "thread_pool.h"
+
+namespace {
+// Records the callbacks of the requests of a test.
+struct Recorder {
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  // The ids of the requests in the order they ended.
+  std::vector<int> ended_;
+  std::vector<SearchResult> finals_;
+  int num_iterations_ = 0;
+
+  AnalysisCallback callback(int id) {
+    return [this, id](const SearchResult& result, bool final) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (final) {
+        ended_.push_back(id);
+        finals_.push_back(result);
+      } else {
+        ++num_iterations_;
+      }
+      changed_.notify_all();
+    };
+  }
+
+  // Blocks until `done`, called with the mutex held, returns true.
+  template <typename Predicate>
+  void wait_until(Predicate done) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, done);
+  }
+};
+
+AnalysisLimits depth_limit(int depth) {
+  AnalysisLimits res;
+  res.max_depth_ = depth;
+  return res;
+}
+}  // namespace.
+
+TEST(AnalysisServer, StreamsIterationsThenTheResult) {
+  ThreadPool pool(2);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId session = server.open_session(1);
+  Recorder recorder;
+  EXPECT_NE(server.submit(session, Board(), depth_limit(4),
+                          recorder.callback(0)),
+            0);
+  server.wait_idle();
+  EXPECT_EQ(recorder.num_iterations_, 4);
+  ASSERT_EQ(recorder.finals_.size(), 1);
+  EXPECT_TRUE(recorder.finals_[0].best_move_);
+  EXPECT_EQ(recorder.finals_[0].depth_, 4);
+}
+
+TEST(AnalysisServer, SessionsTakeTurns) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId first = server.open_session(1);
+  const AnalysisServer::SessionId second = server.open_session(1);
+  Recorder recorder;
+  for (int i = 0; i < 3; ++i) {
+    server.submit(first, Board(), depth_limit(3), recorder.callback(i));
+  }
+  server.submit(second, Board(), depth_limit(3), recorder.callback(3));
+  server.wait_idle();
+  EXPECT_EQ(recorder.ended_, std::vector<int>({0, 3, 1, 2}));
+}
+
+TEST(AnalysisServer, SessionsKeepTheirTables) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId session = server.open_session(4);
+  Recorder recorder;
+  server.submit(session, Board(), depth_limit(7), recorder.callback(0));
+  server.submit(session, Board(), depth_limit(7), recorder.callback(1));
+  server.wait_idle();
+  ASSERT_EQ(recorder.finals_.size(), 2);
+  EXPECT_LT(recorder.finals_[1].nodes_, recorder.finals_[0].nodes_);
+}
+
+TEST(AnalysisServer, DeterministicRequestsRepeatTheirResults) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId session = server.open_session(1);
+  // Reached before the node limit, so that the node counts tell whether the
+  // searches started from the same state.
+  AnalysisLimits limits = depth_limit(6);
+  limits.max_nodes_ = 1000000;
+  limits.deterministic_ = true;
+  const Board board("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/"
+                    "R3K2R w KQkq - 0 1");
+  Recorder recorder;
+  server.submit(session, board, limits, recorder.callback(0));
+  server.submit(session, Board(), depth_limit(6), recorder.callback(1));
+  server.submit(session, board, limits, recorder.callback(2));
+  server.wait_idle();
+  ASSERT_EQ(recorder.finals_.size(), 3);
+  const SearchResult& first = recorder.finals_[0];
+  const SearchResult& second = recorder.finals_[2];
+  EXPECT_LT(second.nodes_, limits.max_nodes_);
+  EXPECT_EQ(second.nodes_, first.nodes_);
+  EXPECT_EQ(second.score_, first.score_);
+  EXPECT_EQ(second.pv_, first.pv_);
+}
+
+TEST(AnalysisServer, ServesFromTheCache) {
+  const std::string path = testing::TempDir() + "analysis_server_cache";
+  std::remove((path + ".keys").c_str());
+  std::remove((path + ".results").c_str());
+  AnalysisCache cache(path);
+  ThreadPool pool(1);
+  AnalysisServer server(&pool, nullptr, &cache);
+  const AnalysisServer::SessionId session = server.open_session(1);
+  Recorder recorder;
+  server.submit(session, Board(), depth_limit(6), recorder.callback(0));
+  server.wait_idle();
+  // A session of its own, whose table knows nothing.
+  const AnalysisServer::SessionId other = server.open_session(1);
+  server.submit(other, Board(), depth_limit(5), recorder.callback(1));
+  server.wait_idle();
+  ASSERT_EQ(recorder.finals_.size(), 2);
+  const SearchResult& searched = recorder.finals_[0];
+  const SearchResult& served = recorder.finals_[1];
+  EXPECT_EQ(recorder.num_iterations_, 7);
+  EXPECT_EQ(served.depth_, 6);
+  EXPECT_EQ(served.score_, searched.score_);
+  EXPECT_EQ(served.best_move_, searched.best_move_);
+  EXPECT_EQ(served.nodes_, searched.nodes_);
+
+  // Deeper, or with more lines, it searches, and keeps the deeper result.
+  AnalysisLimits limits = depth_limit(6);
+  limits.num_lines_ = 2;
+  server.submit(other, Board(), limits, recorder.callback(2));
+  server.submit(other, Board(), depth_limit(7), recorder.callback(3));
+  server.wait_idle();
+  ASSERT_EQ(recorder.finals_.size(), 4);
+  EXPECT_EQ(recorder.finals_[2].lines_.size(), 2);
+  EXPECT_EQ(recorder.finals_[3].depth_, 7);
+  EXPECT_EQ(cache.find(Board())->depth_, 7);
+}
+
+TEST(AnalysisServer, InteractiveSessionsGoFirst) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId first = server.open_session(1);
+  const AnalysisServer::SessionId background =
+      server.open_session(1, AnalysisPriority::background);
+  const AnalysisServer::SessionId second = server.open_session(1);
+  Recorder recorder;
+  // Not preempted, being interactive.
+  server.submit(first, Board(), depth_limit(7), recorder.callback(0));
+  server.submit(background, Board(), depth_limit(3), recorder.callback(1));
+  server.submit(second, Board(), depth_limit(3), recorder.callback(2));
+  server.wait_idle();
+  EXPECT_EQ(recorder.ended_, std::vector<int>({0, 2, 1}));
+  for (const SearchResult& result : recorder.finals_) {
+    EXPECT_TRUE(result.best_move_);
+  }
+}
+
+TEST(AnalysisServer, PreemptsBackgroundRequests) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId background =
+      server.open_session(1, AnalysisPriority::background);
+  const AnalysisServer::SessionId interactive = server.open_session(1);
+  Recorder recorder;
+  // No limit but cancelling.
+  const AnalysisServer::RequestId bulk = server.submit(
+      background, Board(), AnalysisLimits(), recorder.callback(0));
+  recorder.wait_until([&recorder] { return recorder.num_iterations_ > 0; });
+  server.submit(interactive, Board(), depth_limit(5), recorder.callback(1));
+  int num_iterations = 0;
+  recorder.wait_until([&recorder, &num_iterations] {
+    num_iterations = recorder.num_iterations_;
+    return !recorder.ended_.empty();
+  });
+  // Resumed once the interactive request ended.
+  recorder.wait_until([&recorder, num_iterations] {
+    return recorder.num_iterations_ > num_iterations;
+  });
+  EXPECT_TRUE(server.cancel(bulk));
+  server.wait_idle();
+  EXPECT_EQ(recorder.ended_, std::vector<int>({1, 0}));
+  ASSERT_EQ(recorder.finals_.size(), 2);
+  EXPECT_EQ(recorder.finals_[0].depth_, 5);
+  EXPECT_TRUE(recorder.finals_[1].best_move_);
+  EXPECT_GT(recorder.finals_[1].depth_, 1);
+
+  const absl::optional<AnalysisSessionStats> bulk_stats =
+      server.session_stats(background);
+  ASSERT_TRUE(bulk_stats);
+  EXPECT_EQ(bulk_stats->num_requests_, 1);
+  EXPECT_EQ(bulk_stats->num_preemptions_, 1);
+  const absl::optional<AnalysisSessionStats> interactive_stats =
+      server.session_stats(interactive);
+  ASSERT_TRUE(interactive_stats);
+  EXPECT_EQ(interactive_stats->num_requests_, 1);
+  EXPECT_EQ(interactive_stats->num_preemptions_, 0);
+  EXPECT_GT(interactive_stats->cpu_time_us_ + bulk_stats->cpu_time_us_, 0);
+  EXPECT_FALSE(server.session_stats(interactive + 1));
+}
+
+TEST(AnalysisServer, CancelsRequests) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId session = server.open_session(1);
+  Recorder recorder;
+  // No limit but cancelling.
+  const AnalysisServer::RequestId running =
+      server.submit(session, Board(), AnalysisLimits(), recorder.callback(0));
+  const AnalysisServer::RequestId queued =
+      server.submit(session, Board(), AnalysisLimits(), recorder.callback(1));
+  EXPECT_TRUE(server.cancel(queued));
+  EXPECT_TRUE(server.cancel(running));
+  server.wait_idle();
+  EXPECT_EQ(recorder.ended_, std::vector<int>({1, 0}));
+  EXPECT_FALSE(recorder.finals_[0].best_move_);
+  EXPECT_FALSE(server.cancel(running));
+}
+
+TEST(AnalysisServer, StopsAtTheTimeLimit) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId session = server.open_session(1);
+  Recorder recorder;
+  AnalysisLimits limits;
+  limits.move_time_ = 50;
+  limits.num_lines_ = 2;
+  server.submit(session, Board(), limits, recorder.callback(0));
+  server.wait_idle();
+  ASSERT_EQ(recorder.finals_.size(), 1);
+  EXPECT_TRUE(recorder.finals_[0].best_move_);
+  EXPECT_EQ(recorder.finals_[0].lines_.size(), 2);
+}
+
+TEST(AnalysisServer, ClosesSessions) {
+  ThreadPool pool(1);
+  AnalysisServer server(&pool);
+  const AnalysisServer::SessionId session = server.open_session(1);
+  Recorder recorder;
+  server.submit(session, Board(), AnalysisLimits(), recorder.callback(0));
+  server.submit(session, Board(), AnalysisLimits(), recorder.callback(1));
+  EXPECT_TRUE(server.close_session(session));
+  EXPECT_FALSE(server.close_session(session));
+  EXPECT_EQ(server.submit(session, Board(), AnalysisLimits(),
+                          recorder.callback(2)),
+            0);
+  server.wait_idle();
+  EXPECT_EQ(recorder.ended_.size(), 2);
+}
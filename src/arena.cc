@@ -0,0 +1,61 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "debug_check.h"
+
+Arena::Arena(size_t block_size)
+    : block_size_(block_size), block_idx_(0), used_(0) {}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+  DEBUG_CHECK(alignment > 0 && (alignment & (alignment - 1)) == 0,
+              "Alignments are powers of two.");
+  // Moves on through the blocks until one has room, making one at the end if
+  // none does. A block too small for this request is skipped and stays for
+  // later, smaller, ones after the arena is rewound.
+  while (true) {
+    if (block_idx_ < blocks_.size()) {
+      const Block& block = blocks_[block_idx_];
+      const uintptr_t start =
+          reinterpret_cast<uintptr_t>(block.data_.get()) + used_;
+      const size_t padding = (alignment - start % alignment) % alignment;
+      if (used_ + padding + size <= block.size_) {
+        used_ += padding + size;
+        return block.data_.get() + used_ - size;
+      }
+      if (block_idx_ + 1 < blocks_.size()) {
+        ++block_idx_;
+        used_ = 0;
+        continue;
+      }
+    }
+    const size_t new_size = std::max(block_size_, size + alignment);
+    blocks_.push_back({std::unique_ptr<char[]>(new char[new_size]), new_size});
+    block_idx_ = blocks_.size() - 1;
+    used_ = 0;
+  }
+}
+
+size_t Arena::bytes_used() const {
+  size_t res = used_;
+  for (size_t i = 0; i < block_idx_ && i < blocks_.size(); ++i) {
+    res += blocks_[i].size_;
+  }
+  return res;
+}
+
+size_t Arena::capacity() const {
+  size_t res = 0;
+  for (const Block& block : blocks_) {
+    res += block.size_;
+  }
+  return res;
+}
+
+Arena& thread_arena() {
+  thread_local Arena arena;
+  return arena;
+}
@@ -0,0 +1,117 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A bump allocator for scratch memory that lives as long as one search, one
+// batch item or one game: allocating moves a pointer through a block, and
+// nothing is freed one allocation at a time. Instead the whole arena is
+// rewound at once, to empty or to a mark, and keeps its blocks, so that once
+// it has grown to what a thread needs it never touches the heap again. Each
+// thread has an arena of its own (see `thread_arena`), so nothing is locked
+// and threads never contend for memory the way they do in the global heap.
+//
+// Only trivially destructible objects belong in an arena, since nothing runs
+// their destructors, or containers that use an `ArenaAllocator` and are gone
+// before the arena is rewound past their memory.
+class Arena {
+ public:
+  // A point to rewind to.
+  struct Mark {
+    size_t block_idx_;
+    size_t used_;
+  };
+
+  // Allocates blocks of `block_size` bytes, or larger for larger requests.
+  explicit Arena(size_t block_size = 64 * 1024);
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Returns `size` bytes aligned to `alignment`, a power of two.
+  void* allocate(size_t size, size_t alignment);
+  template <typename T>
+  T* allocate_array(size_t num_elements) {
+    return static_cast<T*>(allocate(num_elements * sizeof(T), alignof(T)));
+  }
+
+  Mark mark() const { return {block_idx_, used_}; }
+  // Frees everything allocated since `mark`.
+  void rewind(Mark mark) {
+    block_idx_ = mark.block_idx_;
+    used_ = mark.used_;
+  }
+  // Frees everything, keeping the blocks.
+  void reset() { rewind({0, 0}); }
+
+  // The bytes in use, counting those skipped for alignment or at the ends of
+  // blocks, and the bytes of all the blocks.
+  size_t bytes_used() const;
+  size_t capacity() const;
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data_;
+    size_t size_;
+  };
+
+  const size_t block_size_;
+  std::vector<Block> blocks_;
+  // The block allocations come from, and the bytes of it in use.
+  size_t block_idx_;
+  size_t used_;
+};
+
+// Returns the arena of the calling thread, made on first use.
+Arena& thread_arena();
+
+// Rewinds `arena` to where it was when the scope started, so that scopes nest
+// like the stack: a search can take memory in one and be sure that it is all
+// back when the search returns.
+class ArenaScope {
+ public:
+  explicit ArenaScope(Arena* arena) : arena_(arena), mark_(arena->mark()) {}
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+  ~ArenaScope() { arena_->rewind(mark_); }
+
+ private:
+  Arena* const arena_;
+  const Arena::Mark mark_;
+};
+
+// A standard allocator taking memory from an arena, for standard containers
+// of scratch data. Deallocation does nothing: the memory comes back when the
+// arena is rewound.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) { return arena_->allocate_array<T>(n); }
+  void deallocate(T*, size_t) {}
+  Arena* arena() const { return arena_; }
+
+ private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {
+  return lhs.arena() == rhs.arena();
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {
+  return lhs.arena() != rhs.arena();
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
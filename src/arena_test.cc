@@ -0,0 +1,90 @@
+#include "arena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+TEST(Arena, AlignsAllocations) {
+  Arena arena(256);
+  for (size_t alignment : {1, 2, 8, 16, 64}) {
+    arena.allocate(3, 1);
+    const void* const allocation = arena.allocate(5, alignment);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(allocation) % alignment, 0);
+  }
+  int64_t* const values = arena.allocate_array<int64_t>(4);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(values) % alignof(int64_t), 0);
+}
+
+TEST(Arena, ReusesMemoryAfterRewinding) {
+  Arena arena(256);
+  char* const first = static_cast<char*>(arena.allocate(100, 1));
+  const Arena::Mark mark = arena.mark();
+  char* const second = static_cast<char*>(arena.allocate(100, 1));
+  EXPECT_EQ(second, first + 100);
+  // Doesn't fit in the first block.
+  arena.allocate(100, 1);
+  const size_t capacity = arena.capacity();
+  EXPECT_EQ(capacity, 512);
+
+  arena.rewind(mark);
+  EXPECT_EQ(arena.bytes_used(), 100);
+  EXPECT_EQ(arena.allocate(100, 1), second);
+  arena.reset();
+  EXPECT_EQ(arena.bytes_used(), 0);
+  EXPECT_EQ(arena.allocate(100, 1), first);
+  for (int i = 0; i < 3; ++i) {
+    arena.allocate(100, 1);
+  }
+  EXPECT_EQ(arena.capacity(), capacity);
+}
+
+TEST(Arena, AllocatesMoreThanABlock) {
+  Arena arena(64);
+  arena.allocate(10, 1);
+  char* const allocation = static_cast<char*>(arena.allocate(1000, 16));
+  allocation[999] = 1;
+  EXPECT_GE(arena.capacity(), 1000);
+  // The large block is skipped, but kept, after rewinding.
+  arena.reset();
+  arena.allocate(10, 1);
+  EXPECT_EQ(arena.allocate(1000, 16), allocation);
+}
+
+TEST(ArenaScope, RewindsOnDestruction) {
+  Arena arena;
+  arena.allocate(10, 1);
+  {
+    const ArenaScope scope(&arena);
+    arena.allocate(20, 1);
+    {
+      const ArenaScope inner_scope(&arena);
+      arena.allocate(30, 1);
+      EXPECT_EQ(arena.bytes_used(), 60);
+    }
+    EXPECT_EQ(arena.bytes_used(), 30);
+  }
+  EXPECT_EQ(arena.bytes_used(), 10);
+}
+
+TEST(ArenaVector, GrowsInTheArena) {
+  Arena arena;
+  ArenaVector<int> values{ArenaAllocator<int>(&arena)};
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(i);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(values[i], i);
+  }
+  EXPECT_GE(arena.bytes_used(), 1000 * sizeof(int));
+  EXPECT_EQ(values.get_allocator(), ArenaAllocator<char>(&arena));
+}
+
+TEST(ThreadArena, IsPerThread) {
+  Arena* const arena = &thread_arena();
+  EXPECT_EQ(&thread_arena(), arena);
+  Arena* other_arena = nullptr;
+  std::thread([&other_arena] { other_arena = &thread_arena(); }).join();
+  EXPECT_NE(other_arena, arena);
+}
@@ -0,0 +1,428 @@
+#include "arrow_export.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "batch_features.h"
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+
+namespace {
+// Builds a flatbuffer front to back. A table is written before the tables,
+// vectors and strings its fields point to, and the offsets in those fields
+// are patched once their targets are written, so that every offset points
+// forward, as flatbuffers' unsigned offsets must. Each table is preceded by
+// its vtable. Fields are aligned to their size from the start of the buffer,
+// which the file keeps 8-byte aligned.
+class FlatBuffer {
+ public:
+  // A scalar field of a table: its id in the schema, its size in bytes and
+  // its value.
+  struct Scalar {
+    uint16_t id_;
+    uint8_t size_;
+    uint64_t value_;
+  };
+
+  // Starts with the offset of the root table, for `patch`.
+  FlatBuffer() { put<uint32_t>(0); }
+
+  static constexpr size_t root_slot = 0;
+
+  // Writes a table of `scalars` and of the offset fields `offset_ids`, and
+  // returns its position. `offset_slots[i]` is set to the position of the
+  // field of `offset_ids[i]`, to be patched.
+  size_t table(std::initializer_list<Scalar> scalars,
+               std::initializer_list<uint16_t> offset_ids,
+               size_t* offset_slots) {
+    struct Slot {
+      uint16_t id_;
+      uint8_t size_;
+      uint64_t value_;
+      bool is_offset_;
+      // In the table.
+      uint16_t position_;
+    };
+    std::vector<Slot> slots;
+    for (const Scalar& scalar : scalars) {
+      slots.push_back({scalar.id_, scalar.size_, scalar.value_, false, 0});
+    }
+    for (uint16_t id : offset_ids) {
+      slots.push_back({id, 4, 0, true, 0});
+    }
+    // The largest first, after the offset of the vtable, so that each lands
+    // aligned in a table that starts 8-byte aligned.
+    std::stable_sort(slots.begin(), slots.end(),
+                     [](const Slot& a, const Slot& b) {
+                       return a.size_ > b.size_;
+                     });
+    size_t table_size = 4;
+    uint16_t num_ids = 0;
+    for (Slot& slot : slots) {
+      table_size = (table_size + slot.size_ - 1) / slot.size_ * slot.size_;
+      slot.position_ = static_cast<uint16_t>(table_size);
+      table_size += slot.size_;
+      num_ids = std::max(num_ids, static_cast<uint16_t>(slot.id_ + 1));
+    }
+    table_size = (table_size + 3) / 4 * 4;
+
+    align(2);
+    const size_t vtable = buffer_.size();
+    std::vector<uint16_t> field_positions(num_ids, 0);
+    for (const Slot& slot : slots) {
+      field_positions[slot.id_] = slot.position_;
+    }
+    put<uint16_t>(static_cast<uint16_t>(4 + 2 * num_ids));
+    put<uint16_t>(static_cast<uint16_t>(table_size));
+    for (uint16_t position : field_positions) {
+      put<uint16_t>(position);
+    }
+    align(8);
+    const size_t res = buffer_.size();
+    buffer_.resize(res + table_size, '\0');
+    set<int32_t>(res, static_cast<int32_t>(res - vtable));
+    for (const Slot& slot : slots) {
+      if (slot.is_offset_) {
+        // In the order of `offset_ids`.
+        size_t idx = 0;
+        for (uint16_t id : offset_ids) {
+          if (id == slot.id_) {
+            break;
+          }
+          ++idx;
+        }
+        offset_slots[idx] = res + slot.position_;
+      } else {
+        std::memcpy(&buffer_[res + slot.position_], &slot.value_, slot.size_);
+      }
+    }
+    return res;
+  }
+
+  // Writes a vector of `count` structs of `size` bytes aligned to `alignment`
+  // and returns its position.
+  size_t struct_vector(const void* data, size_t count, size_t size,
+                       size_t alignment) {
+    align(4);
+    while ((buffer_.size() + 4) % alignment != 0) {
+      put<uint32_t>(0);
+    }
+    const size_t res = buffer_.size();
+    put<uint32_t>(static_cast<uint32_t>(count));
+    if (count > 0) {
+      buffer_.append(static_cast<const char*>(data), count * size);
+    }
+    return res;
+  }
+
+  // Writes a vector of `count` offsets and returns its position, with
+  // `slots[i]` set to that of the `i`th, to be patched.
+  size_t offset_vector(size_t count, size_t* slots) {
+    align(4);
+    const size_t res = buffer_.size();
+    put<uint32_t>(static_cast<uint32_t>(count));
+    for (size_t i = 0; i < count; ++i) {
+      slots[i] = buffer_.size();
+      put<uint32_t>(0);
+    }
+    return res;
+  }
+
+  size_t string(const char* str) {
+    align(4);
+    const size_t res = buffer_.size();
+    const size_t size = std::strlen(str);
+    put<uint32_t>(static_cast<uint32_t>(size));
+    buffer_.append(str, size + 1);
+    return res;
+  }
+
+  // Points the offset at `slot` to `target`.
+  void patch(size_t slot, size_t target) {
+    set<uint32_t>(slot, static_cast<uint32_t>(target - slot));
+  }
+
+  // The buffer, padded to a multiple of 8 bytes.
+  const std::string& finish() {
+    align(8);
+    return buffer_;
+  }
+
+ private:
+  template <typename T>
+  void put(T value) {
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  template <typename T>
+  void set(size_t position, T value) {
+    std::memcpy(&buffer_[position], &value, sizeof(value));
+  }
+  void align(size_t alignment) {
+    buffer_.resize((buffer_.size() + alignment - 1) / alignment * alignment,
+                   '\0');
+  }
+
+  std::string buffer_;
+};
+
+// From the Arrow format's Schema.fbs, Message.fbs and File.fbs.
+constexpr uint64_t metadata_version_v5 = 4;
+constexpr uint8_t type_int = 2;
+constexpr uint8_t type_bool = 6;
+constexpr uint8_t header_schema = 1;
+constexpr uint8_t header_record_batch = 3;
+constexpr char file_magic[8] = {'A', 'R', 'R', 'O', 'W', '1', '\0', '\0'};
+
+struct Column {
+  const char* name_;
+  // 0 for bool.
+  int bit_width_;
+  bool is_signed_;
+};
+
+constexpr std::array<Column, 11> columns = {{
+    {"white_to_move", 0, false},
+    {"fullmove", 16, false},
+    {"fifty_move_clock", 8, false},
+    {"num_pieces", 8, false},
+    {"material", 16, true},
+    {"white_mobility", 8, false},
+    {"black_mobility", 8, false},
+    {"legal_moves", 8, false},
+    {"in_check", 0, false},
+    {"score", 16, true},
+    {"result", 8, true},
+}};
+
+// Writes the Schema table of `columns` and returns its position.
+size_t write_schema(FlatBuffer* fb) {
+  size_t fields_slot;
+  const size_t res = fb->table({{0, 2, 0}}, {1}, &fields_slot);
+  std::array<size_t, columns.size()> field_slots;
+  fb->patch(fields_slot, fb->offset_vector(columns.size(),
+                                           field_slots.data()));
+  for (size_t i = 0; i < columns.size(); ++i) {
+    const Column& column = columns[i];
+    // The name, the type and the children.
+    size_t slots[3];
+    const uint8_t type = column.bit_width_ ? type_int : type_bool;
+    fb->patch(field_slots[i],
+              fb->table({{1, 1, 0}, {2, 1, type}}, {0, 3, 5}, slots));
+    fb->patch(slots[0], fb->string(column.name_));
+    if (column.bit_width_) {
+      fb->patch(slots[1],
+                fb->table({{0, 4, static_cast<uint64_t>(column.bit_width_)},
+                           {1, 1, column.is_signed_ ? 1u : 0u}},
+                          {}, nullptr));
+    } else {
+      fb->patch(slots[1], fb->table({}, {}, nullptr));
+    }
+    fb->patch(slots[2], fb->offset_vector(0, nullptr));
+  }
+  return res;
+}
+
+// Sets bit `i` of `bits` to `bytes[i]`, for `size` bytes of 0 or 1.
+void to_bitmap(const uint8_t* bytes, size_t size, uint8_t* bits) {
+  std::fill(bits, bits + (size + 7) / 8, 0);
+  for (size_t i = 0; i < size; ++i) {
+    bits[i / 8] |= static_cast<uint8_t>(bytes[i] << (i % 8));
+  }
+}
+
+// The material of each nibble of a packed position, negative for black.
+constexpr std::array<int, 16> nibble_material = {
+    100,  500,  325,  325,  975,  0, 0, 0,
+    -100, -500, -325, -325, -975, 0, 0, 0};
+
+constexpr size_t padded(size_t size) { return (size + 7) / 8 * 8; }
+}  // namespace.
+
+ArrowPositionWriter::ArrowPositionWriter(const std::string& path,
+                                         ThreadPool* pool,
+                                         size_t rows_per_batch)
+    : pool_(pool),
+      rows_per_batch_(std::max<size_t>(rows_per_batch, 1)),
+      out_(path, false),
+      is_closed_(false),
+      offset_(0),
+      num_rows_(0) {
+  out_.write(file_magic, sizeof(file_magic));
+  offset_ += sizeof(file_magic);
+  FlatBuffer fb;
+  size_t header_slot;
+  fb.patch(FlatBuffer::root_slot,
+           fb.table({{0, 2, metadata_version_v5}, {1, 1, header_schema},
+                     {3, 8, 0}},
+                    {2}, &header_slot));
+  fb.patch(header_slot, write_schema(&fb));
+  write_message(fb.finish());
+}
+
+ArrowPositionWriter::~ArrowPositionWriter() { close(); }
+
+void ArrowPositionWriter::write(const PackedPosition* positions,
+                                size_t num_positions) {
+  while (num_positions > 0) {
+    const size_t n =
+        std::min(num_positions, rows_per_batch_ - positions_.size());
+    positions_.insert(positions_.end(), positions, positions + n);
+    positions += n;
+    num_positions -= n;
+    if (positions_.size() == rows_per_batch_) {
+      write_batch();
+    }
+  }
+}
+
+size_t ArrowPositionWriter::write_message(const std::string& metadata) {
+  const uint32_t continuation = 0xFFFFFFFF;
+  const uint32_t size = static_cast<uint32_t>(metadata.size());
+  out_.write(&continuation, sizeof(continuation));
+  out_.write(&size, sizeof(size));
+  out_.write(metadata.data(), metadata.size());
+  offset_ += 8 + metadata.size();
+  return 8 + metadata.size();
+}
+
+void ArrowPositionWriter::write_batch() {
+  const size_t n = positions_.size();
+  white_to_move_.resize((n + 7) / 8);
+  fullmove_.resize(n);
+  fifty_move_clock_.resize(n);
+  num_pieces_.resize(n);
+  material_.resize(n);
+  white_mobility_.resize(n);
+  black_mobility_.resize(n);
+  legal_moves_.resize(n);
+  in_check_.resize((n + 7) / 8);
+  score_.resize(n);
+  result_.resize(n);
+  in_check_bytes_.resize(n);
+  attacks_.resize(2 * n);
+
+  compute_board_features(
+      positions_.data(), n,
+      {legal_moves_.data(), in_check_bytes_.data(), attacks_.data()}, pool_);
+  to_bitmap(in_check_bytes_.data(), n, in_check_.data());
+  std::fill(white_to_move_.begin(), white_to_move_.end(), 0);
+  for (size_t i = 0; i < n; ++i) {
+    const PackedPosition& packed = positions_[i];
+    white_to_move_[i / 8] |=
+        static_cast<uint8_t>((~packed.flags_ & 1) << (i % 8));
+    fullmove_[i] = packed.num_moves_;
+    fifty_move_clock_[i] = packed.fifty_move_clock_;
+    const int num_pieces = popcount(packed.occupancy_);
+    int material = 0;
+    for (int j = 0; j < num_pieces; ++j) {
+      material += nibble_material[(packed.pieces_[j / 2] >> (4 * (j % 2))) &
+                                  0xF];
+    }
+    num_pieces_[i] = static_cast<uint8_t>(num_pieces);
+    material_[i] = static_cast<int16_t>(material);
+    white_mobility_[i] = static_cast<uint8_t>(popcount(attacks_[2 * i]));
+    black_mobility_[i] = static_cast<uint8_t>(popcount(attacks_[2 * i + 1]));
+    score_[i] = packed.score_;
+    result_[i] = packed.result_;
+  }
+
+  // The data of each column, in the order of `columns`.
+  const std::array<std::pair<const void*, size_t>, columns.size()> data = {{
+      {white_to_move_.data(), white_to_move_.size()},
+      {fullmove_.data(), 2 * n},
+      {fifty_move_clock_.data(), n},
+      {num_pieces_.data(), n},
+      {material_.data(), 2 * n},
+      {white_mobility_.data(), n},
+      {black_mobility_.data(), n},
+      {legal_moves_.data(), n},
+      {in_check_.data(), in_check_.size()},
+      {score_.data(), 2 * n},
+      {result_.data(), n},
+  }};
+  // A node per column, its length and null count, and two buffers, its
+  // validity, empty as no column has nulls, and its data, each an offset in
+  // the body and a size.
+  std::array<uint64_t, 2 * columns.size()> nodes;
+  std::array<uint64_t, 4 * columns.size()> buffers;
+  uint64_t body_size = 0;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    nodes[2 * i] = n;
+    nodes[2 * i + 1] = 0;
+    buffers[4 * i] = body_size;
+    buffers[4 * i + 1] = 0;
+    buffers[4 * i + 2] = body_size;
+    buffers[4 * i + 3] = data[i].second;
+    body_size += padded(data[i].second);
+  }
+
+  FlatBuffer fb;
+  size_t header_slot;
+  fb.patch(FlatBuffer::root_slot,
+           fb.table({{0, 2, metadata_version_v5},
+                     {1, 1, header_record_batch},
+                     {3, 8, body_size}},
+                    {2}, &header_slot));
+  // The nodes and the buffers.
+  size_t slots[2];
+  fb.patch(header_slot, fb.table({{0, 8, n}}, {1, 2}, slots));
+  fb.patch(slots[0], fb.struct_vector(nodes.data(), columns.size(), 16, 8));
+  fb.patch(slots[1],
+           fb.struct_vector(buffers.data(), 2 * columns.size(), 16, 8));
+  const uint64_t offset = offset_;
+  const size_t metadata_size = write_message(fb.finish());
+  const char zeros[8] = {};
+  for (const auto& column : data) {
+    out_.write(column.first, column.second);
+    out_.write(zeros, padded(column.second) - column.second);
+  }
+  offset_ += body_size;
+  batches_.push_back(
+      {offset, static_cast<uint32_t>(metadata_size), body_size});
+  num_rows_ += n;
+  positions_.clear();
+}
+
+bool ArrowPositionWriter::close() {
+  if (is_closed_) {
+    return out_.close();
+  }
+  is_closed_ = true;
+  if (!positions_.empty()) {
+    write_batch();
+  }
+  // The end of the stream, then the footer.
+  const uint32_t end_of_stream[2] = {0xFFFFFFFF, 0};
+  out_.write(end_of_stream, sizeof(end_of_stream));
+
+  // A Block struct: the offset, the metadata size, padded, and the body size.
+  std::vector<uint64_t> blocks;
+  for (const BatchBlock& batch : batches_) {
+    blocks.push_back(batch.offset_);
+    blocks.push_back(batch.metadata_size_);
+    blocks.push_back(batch.body_size_);
+  }
+  FlatBuffer fb;
+  // The schema, the dictionaries and the record batches.
+  size_t slots[3];
+  fb.patch(FlatBuffer::root_slot,
+           fb.table({{0, 2, metadata_version_v5}}, {1, 2, 3}, slots));
+  fb.patch(slots[0], write_schema(&fb));
+  fb.patch(slots[1], fb.struct_vector(nullptr, 0, 24, 8));
+  fb.patch(slots[2],
+           fb.struct_vector(blocks.data(), batches_.size(), 24, 8));
+  const std::string& footer = fb.finish();
+  const uint32_t footer_size = static_cast<uint32_t>(footer.size());
+  out_.write(footer.data(), footer.size());
+  out_.write(&footer_size, sizeof(footer_size));
+  out_.write(file_magic, 6);
+  return out_.close();
+}
@@ -0,0 +1,100 @@
+#ifndef ARROW_EXPORT_H
+#define ARROW_EXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "bulk_io.h"
+#include "packed_position.h"
+#include "thread_pool.h"
+
+// Writes the features of positions as an Arrow IPC file, which columnar
+// engines such as DuckDB, Polars and pyarrow query as it is, with a row per
+// position and these columns:
+//
+//   white_to_move    bool
+//   fullmove         uint16  the fullmove number
+//   fifty_move_clock uint8
+//   num_pieces       uint8   kings included
+//   material         int16   white's minus black's, in the centipawns of
+//                            `see_piece_values`
+//   white_mobility   uint8   the squares white attacks
+//   black_mobility   uint8   the squares black attacks
+//   legal_moves      uint8
+//   in_check         bool    the side to move is
+//   score            int16   the position's score for the side to move
+//   result           int8    1 if white won the game, -1 if black did
+//
+// The positions are packed positions, as the replay of games and self-play
+// write them (see packed_position.h). A record batch of them at a time goes
+// through `compute_board_features` (see batch_features.h) straight into the
+// arrays of the columns, and the arrays are written out as the batch's
+// buffers, so no row is ever an object or a line of text.
+//
+// The Arrow metadata, flatbuffers, is built by hand for this one schema, so
+// the engine doesn't depend on the Arrow libraries.
+class ArrowPositionWriter {
+ public:
+  // Creates the file, or empties it. The features are computed on the
+  // workers of `pool`, which isn't owned, or on the calling thread if it is
+  // null.
+  explicit ArrowPositionWriter(const std::string& path,
+                               ThreadPool* pool = nullptr,
+                               size_t rows_per_batch = 65536);
+  ArrowPositionWriter(const ArrowPositionWriter&) = delete;
+  ArrowPositionWriter& operator=(const ArrowPositionWriter&) = delete;
+  // Closes the file if `close` wasn't called.
+  ~ArrowPositionWriter();
+
+  bool is_open() const { return out_.is_open(); }
+  void write(const PackedPosition* positions, size_t num_positions);
+  // Writes the last record batch and the footer, and closes the file.
+  // Returns false if a write failed.
+  bool close();
+
+  uint64_t num_rows() const { return num_rows_; }
+
+ private:
+  // Where each record batch is in the file, for the footer.
+  struct BatchBlock {
+    uint64_t offset_;
+    uint32_t metadata_size_;
+    uint64_t body_size_;
+  };
+
+  void write_batch();
+  // Writes an encapsulated message of `metadata`, followed by the body
+  // `write_batch` writes. Returns its size.
+  size_t write_message(const std::string& metadata);
+
+  ThreadPool* const pool_;
+  const size_t rows_per_batch_;
+  BulkFileWriter out_;
+  bool is_closed_;
+  uint64_t offset_;
+  uint64_t num_rows_;
+  std::vector<BatchBlock> batches_;
+  // The positions of the next record batch.
+  std::vector<PackedPosition> positions_;
+  // The columns of a batch, kept from one to the next so that they don't
+  // allocate. The bool columns are bitmaps.
+  std::vector<uint8_t> white_to_move_;
+  std::vector<uint16_t> fullmove_;
+  std::vector<uint8_t> fifty_move_clock_;
+  std::vector<uint8_t> num_pieces_;
+  std::vector<int16_t> material_;
+  std::vector<uint8_t> white_mobility_;
+  std::vector<uint8_t> black_mobility_;
+  std::vector<uint8_t> legal_moves_;
+  std::vector<uint8_t> in_check_;
+  std::vector<int16_t> score_;
+  std::vector<int8_t> result_;
+  // What `compute_board_features` gives before it is made into columns.
+  std::vector<uint8_t> in_check_bytes_;
+  std::vector<Bitboard> attacks_;
+};
+
+#endif
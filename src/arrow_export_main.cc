@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "arrow_export.h"
+#include "mapped_file.h"
+#include "packed_position.h"
+#include "position_blocks.h"
+#include "thread_pool.h"
+
+// Usage: arrow_export [--threads <n>] <positions> <out>
+//
+// Writes the features of the packed positions of <positions>, a file of them
+// or of blocks of them (see position_blocks.h), to <out> as an Arrow IPC file
+// (see arrow_export.h). The features are computed on --threads threads, one
+// per hardware thread by default.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0 << " [--threads <n>] <positions> <out>\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  size_t num_threads = 0;
+  int arg_idx = 1;
+  if (arg_idx + 1 < argc && std::strcmp(argv[arg_idx], "--threads") == 0) {
+    if (!absl::SimpleAtoi(argv[arg_idx + 1], &num_threads)) {
+      return usage(argv[0]);
+    }
+    arg_idx += 2;
+  }
+  if (arg_idx + 2 != argc) {
+    return usage(argv[0]);
+  }
+  const std::string in_path = argv[arg_idx];
+  const std::string out_path = argv[arg_idx + 1];
+  auto file = std::make_unique<MappedFile>(in_path);
+  if (!file->data()) {
+    std::cerr << "Can't read " << in_path << '\n';
+    return 1;
+  }
+  ThreadPool pool(num_threads);
+  ArrowPositionWriter writer(out_path, &pool);
+  if (!writer.is_open()) {
+    std::cerr << "Can't write " << out_path << '\n';
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  if (is_position_block_file(file->data(), file->size())) {
+    std::string error;
+    const std::unique_ptr<PositionBlockReader> blocks =
+        PositionBlockReader::open(std::move(file), &error);
+    if (!blocks) {
+      std::cerr << in_path << ": " << error << '\n';
+      return 1;
+    }
+    std::vector<PackedPosition> block;
+    for (size_t i = 0; i < blocks->num_blocks(); ++i) {
+      if (!blocks->read_block(i, &block)) {
+        std::cerr << in_path << ": block " << i << " is corrupt\n";
+        return 1;
+      }
+      writer.write(block.data(), block.size());
+    }
+  } else {
+    if (file->size() % sizeof(PackedPosition) != 0) {
+      std::cerr << in_path << " is not a file of packed positions\n";
+      return 1;
+    }
+    writer.write(reinterpret_cast<const PackedPosition*>(file->data()),
+                 file->size() / sizeof(PackedPosition));
+  }
+  if (!writer.close()) {
+    std::cerr << "Can't write " << out_path << '\n';
+    return 1;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << writer.num_rows() << " positions in " << elapsed.count()
+            << " s\n";
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include "arrow_export.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "perft.h"
+#include "thread_pool.h"
+
+namespace {
+// Reads the little endian `T` at `position` of `data`.
+template <typename T>
+T load(const std::string& data, size_t position) {
+  T res;
+  std::memcpy(&res, data.data() + position, sizeof(res));
+  return res;
+}
+
+// Follows the offset at `position` of a flatbuffer at `base`.
+size_t follow(const std::string& data, size_t base, size_t position) {
+  return position + load<uint32_t>(data, base + position);
+}
+
+// Returns the position of field `id` of the table at `table` of a flatbuffer
+// at `base`, or 0 if it isn't there.
+size_t field(const std::string& data, size_t base, size_t table,
+             uint16_t id) {
+  const size_t vtable = table - load<int32_t>(data, base + table);
+  if (4 + 2 * id >= load<uint16_t>(data, base + vtable)) {
+    return 0;
+  }
+  const uint16_t offset = load<uint16_t>(data, base + vtable + 4 + 2 * id);
+  return offset ? table + offset : 0;
+}
+
+// The positions of the games of the perft suite.
+std::vector<Board> test_boards(size_t num_boards) {
+  std::vector<Board> res;
+  for (size_t i = 0; res.size() < num_boards; ++i) {
+    Board board(perft_suite[i % perft_suite.size()].fen_);
+    for (int ply = 0; ply < 40 && res.size() < num_boards; ++ply) {
+      res.push_back(board);
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[(i + static_cast<size_t>(ply)) % moves.size()]);
+    }
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(ArrowPositionWriter, WritesTheColumnsOfEachBatch) {
+  const std::string path = testing::TempDir() + "arrow_export_test.arrow";
+  const std::vector<Board> boards = test_boards(250);
+  std::vector<PackedPosition> positions;
+  for (size_t i = 0; i < boards.size(); ++i) {
+    positions.push_back(pack_position(boards[i], static_cast<int>(i) - 100,
+                                      static_cast<int>(i % 3) - 1));
+  }
+  ThreadPool pool(2);
+  ArrowPositionWriter writer(path, &pool, 100);
+  ASSERT_TRUE(writer.is_open());
+  writer.write(positions.data(), 150);
+  writer.write(positions.data() + 150, 100);
+  ASSERT_TRUE(writer.close());
+  EXPECT_EQ(writer.num_rows(), boards.size());
+
+  std::ifstream in(path, std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  ASSERT_GT(data.size(), 20u);
+  EXPECT_EQ(data.substr(0, 8), std::string("ARROW1\0\0", 8));
+  EXPECT_EQ(data.substr(data.size() - 6), "ARROW1");
+  const size_t footer_size = load<uint32_t>(data, data.size() - 10);
+  const size_t footer = data.size() - 10 - footer_size;
+
+  // The schema: the name and the type of the columns.
+  const size_t schema =
+      follow(data, footer, field(data, footer, follow(data, footer, 0), 1));
+  const size_t fields = follow(data, footer, field(data, footer, schema, 1));
+  ASSERT_EQ(load<uint32_t>(data, footer + fields), 11u);
+  const size_t legal_moves_field = follow(data, footer, fields + 4 + 4 * 7);
+  const size_t name =
+      follow(data, footer, field(data, footer, legal_moves_field, 0));
+  EXPECT_EQ(data.substr(footer + name + 4,
+                        load<uint32_t>(data, footer + name)),
+            "legal_moves");
+  // Int, of 8 bits.
+  EXPECT_EQ(load<uint8_t>(data, footer + field(data, footer,
+                                               legal_moves_field, 2)),
+            2);
+
+  // The record batches.
+  const size_t blocks = follow(
+      data, footer, field(data, footer, follow(data, footer, 0), 3));
+  ASSERT_EQ(load<uint32_t>(data, footer + blocks), 3u);
+  size_t row = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    const size_t block = footer + blocks + 4 + 24 * i;
+    const size_t offset = load<uint64_t>(data, block);
+    const size_t metadata_size = load<uint32_t>(data, block + 8);
+    EXPECT_EQ(offset % 8, 0u);
+    EXPECT_EQ(load<uint32_t>(data, offset), 0xFFFFFFFF);
+    const size_t message = offset + 8;
+    const size_t body = offset + metadata_size;
+    const size_t batch = follow(
+        data, message, field(data, message, follow(data, message, 0), 2));
+    const size_t length =
+        load<uint64_t>(data, message + field(data, message, batch, 0));
+    EXPECT_EQ(length, i < 2 ? 100u : 50u);
+    const size_t buffers =
+        follow(data, message, field(data, message, batch, 2));
+    ASSERT_EQ(load<uint32_t>(data, message + buffers), 22u);
+    // The data buffer of column `column`.
+    const auto column_data = [&](size_t column) {
+      const size_t buffer = message + buffers + 4 + 16 * (2 * column + 1);
+      EXPECT_EQ(load<uint64_t>(data, buffer) % 8, 0u);
+      return body + load<uint64_t>(data, buffer);
+    };
+    for (size_t j = 0; j < length; ++j, ++row) {
+      const Board& board = boards[row];
+      const Color side = board.is_whites_move_ ? Color::white : Color::black;
+      int material = 0;
+      for (Piece piece : {Piece::pawn, Piece::rook, Piece::knight,
+                          Piece::bishop, Piece::queen}) {
+        material += see_value(piece) *
+                    (popcount(board.pieces_[0][static_cast<size_t>(piece)]) -
+                     popcount(board.pieces_[1][static_cast<size_t>(piece)]));
+      }
+      EXPECT_EQ((load<uint8_t>(data, column_data(0) + j / 8) >> (j % 8)) & 1,
+                board.is_whites_move_ ? 1 : 0);
+      EXPECT_EQ(load<uint8_t>(data, column_data(3) + j),
+                popcount(board.all_pieces()));
+      EXPECT_EQ(load<int16_t>(data, column_data(4) + 2 * j), material);
+      EXPECT_EQ(load<uint8_t>(data, column_data(7) + j),
+                board.legal_moves().size());
+      EXPECT_EQ((load<uint8_t>(data, column_data(8) + j / 8) >> (j % 8)) & 1,
+                board.is_king_attacked(side) ? 1 : 0);
+      EXPECT_EQ(load<int16_t>(data, column_data(9) + 2 * j),
+                static_cast<int>(row) - 100);
+      EXPECT_EQ(load<int8_t>(data, column_data(10) + j),
+                static_cast<int>(row % 3) - 1);
+    }
+  }
+  EXPECT_EQ(row, boards.size());
+}
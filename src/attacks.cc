@@ -0,0 +1,418 @@
+#include "attacks.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "debug_check.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    !defined(PAWN_GRABBER_SLIDER_FILLS)
+#define ATTACKS_HAVE_X86_DISPATCH 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define ATTACKS_HAVE_X86_DISPATCH 0
+#endif
+
+namespace {
+constexpr std::array<std::pair<int, int>, 4> rook_offsets = {
+    std::make_pair(0, 1), std::make_pair(0, -1), std::make_pair(1, 0),
+    std::make_pair(-1, 0)};
+constexpr std::array<std::pair<int, int>, 4> bishop_offsets = {
+    std::make_pair(1, 1), std::make_pair(1, -1), std::make_pair(-1, 1),
+    std::make_pair(-1, -1)};
+
+#ifndef PAWN_GRABBER_SLIDER_FILLS
+// Magics found by a search over sparse random numbers from a fixed seed. The
+// tables are laid out with them at compile time, and one that stops working,
+// e.g. after a change to the masks, fails the build (see `make_magics`).
+constexpr std::array<uint64_t, 64> known_rook_magics = {
+    0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL,
+    0x0880100008000480ULL, 0x4200100420080200ULL, 0x8100020100080400ULL,
+    0x0200040110886200ULL, 0x0200008040220411ULL, 0x0404800084400220ULL,
+    0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL,
+    0x0442000102105084ULL, 0x9080010020804100ULL, 0x0040404000201009ULL,
+    0x0000808010002009ULL, 0x2200090021D00100ULL, 0x0008008008040080ULL,
+    0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL,
+    0x1000100080080080ULL, 0x0442000A00049020ULL, 0x2100040080020080ULL,
+    0x0800120400900148ULL, 0x0010040A00128541ULL, 0x2800804000800030ULL,
+    0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+    0x0400802402800800ULL, 0xC100020080800400ULL, 0x0002000802000401ULL,
+    0x0182085882000401ULL, 0x0220204000808000ULL, 0x2860100040024022ULL,
+    0x0001002004110040ULL, 0x99101042000A0020ULL, 0x0004080004008080ULL,
+    0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL,
+    0x0801100280080480ULL, 0x0242009008200600ULL, 0x1002000489500200ULL,
+    0x0040800200010080ULL, 0x0091800041000080ULL, 0x0000209300488001ULL,
+    0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL,
+    0x4000002840840112ULL};
+constexpr std::array<uint64_t, 64> known_bishop_magics = {
+    0xA010041108003100ULL, 0x006082020A002900ULL, 0x6810010619200000ULL,
+    0x08281A0520000408ULL, 0x0001104001000400ULL, 0x0018901008048400ULL,
+    0x00040A0210245280ULL, 0x000200210808A402ULL, 0x9140048410821200ULL,
+    0x0800091010820041ULL, 0x20504804832202C0ULL, 0x0100091401081000ULL,
+    0x8021011140000012ULL, 0x0810020804450400ULL, 0x208B0542109008A2ULL,
+    0x0080084A08040204ULL, 0x0040E2A80811244CULL, 0x2505022008008108ULL,
+    0x0430220100420040ULL, 0x010A040420220040ULL, 0x1105000290400000ULL,
+    0x0093001200822120ULL, 0x4000A62048043004ULL, 0x280120048A015004ULL,
+    0x006090002A020814ULL, 0x44042000240800D0ULL, 0x01102800040A4400ULL,
+    0x1004080080220040ULL, 0x0001001011004024ULL, 0x0010044000805040ULL,
+    0x0914041200820100ULL, 0x0004821012821480ULL, 0x0024040500C05021ULL,
+    0x0088611002080200ULL, 0x0116080A00040020ULL, 0x4000020080080080ULL,
+    0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL,
+    0x8081110600002E00ULL, 0x2842101105000801ULL, 0x1100809008001025ULL,
+    0x00020202221C0400ULL, 0x0422014022009020ULL, 0x0210046102100C00ULL,
+    0xC004008082029102ULL, 0x00AA461801101200ULL, 0x0404080080201108ULL,
+    0x020542108C205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL,
+    0x0400200042021100ULL, 0x00004204850400C0ULL, 0x0200100410A42102ULL,
+    0x1040020801210102ULL, 0x0805040410420000ULL, 0x2884804130100200ULL,
+    0x800C262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+    0x0104000012A02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL,
+    0x0402020801010201ULL};
+
+#endif
+
+// Walks each ray from `idx` until it leaves the board or hits a piece in
+// `occupancy`. The blocking square is included. This is the slow reference
+// the tables are tested against.
+Bitboard ray_attacks(int idx, Bitboard occupancy,
+                     const std::array<std::pair<int, int>, 4>& offsets) {
+  Bitboard res = 0;
+  for (const auto& offset : offsets) {
+    for (int step = 1;; ++step) {
+      const Bitboard sq =
+          offset_square(idx, offset.first * step, offset.second * step);
+      res |= sq;
+      if (!sq || (sq & occupancy)) {
+        break;
+      }
+    }
+  }
+  return res;
+}
+
+#ifndef PAWN_GRABBER_SLIDER_FILLS
+// The squares whose occupancy can change the attacks of a rook, or a bishop
+// if `is_rook` is false, from `idx`. The last square of each ray never blocks
+// anything behind it, so it is left out.
+constexpr Bitboard relevant_occupancy_mask(int idx, bool is_rook) {
+  Bitboard res = 0;
+  for (Direction direction : all_directions) {
+    const bool is_straight = static_cast<size_t>(direction) <
+                             static_cast<size_t>(Direction::northeast);
+    const Bitboard ray =
+        rays[static_cast<size_t>(direction)][static_cast<size_t>(idx)];
+    if (is_straight != is_rook || !ray) {
+      continue;
+    }
+    res |= ray & ~(is_increasing_direction(direction) ? msb_square(ray)
+                                                      : lsb_square(ray));
+  }
+  return res;
+}
+
+// The same attacks as `ray_attacks`, from the ray tables: each ray is cut
+// behind its nearest occupied square. Cheap enough for the compiler to fill
+// every table with.
+constexpr Bitboard ray_table_attacks(int idx, Bitboard occupancy,
+                                     bool is_rook) {
+  Bitboard res = 0;
+  for (Direction direction : all_directions) {
+    const bool is_straight = static_cast<size_t>(direction) <
+                             static_cast<size_t>(Direction::northeast);
+    if (is_straight != is_rook) {
+      continue;
+    }
+    const size_t dir = static_cast<size_t>(direction);
+    const Bitboard ray = rays[dir][static_cast<size_t>(idx)];
+    const Bitboard blockers = ray & occupancy;
+    if (!blockers) {
+      res |= ray;
+      continue;
+    }
+    const Bitboard blocker = is_increasing_direction(direction)
+                                 ? lsb_square(blockers)
+                                 : msb_square(blockers);
+    res |= ray & ~rays[dir][static_cast<size_t>(square_idx(blocker))];
+  }
+  return res;
+}
+
+constexpr size_t slider_table_size(int idx, bool is_rook) {
+  return size_t{1} << popcount(relevant_occupancy_mask(idx, is_rook));
+}
+
+// The attacks from `idx` for every subset of its mask, in the order of their
+// pext index. The carry-rippler trick enumerates the subsets in increasing
+// order, which is the order of their pext indices.
+template <bool is_rook, int idx>
+constexpr std::array<Bitboard, slider_table_size(idx, is_rook)>
+make_pext_table() {
+  constexpr Bitboard mask = relevant_occupancy_mask(idx, is_rook);
+  std::array<Bitboard, slider_table_size(idx, is_rook)> res = {};
+  Bitboard subset = 0;
+  size_t i = 0;
+  do {
+    res[i++] = ray_table_attacks(idx, subset, is_rook);
+    subset = (subset - mask) & mask;
+  } while (subset);
+  return res;
+}
+
+template <bool is_rook, int idx>
+inline constexpr std::array<Bitboard, slider_table_size(idx, is_rook)>
+    pext_table = make_pext_table<is_rook, idx>();
+
+template <size_t size>
+struct MagicTable {
+  std::array<Bitboard, size> attacks_;
+  // False if two subsets with different attacks share an index.
+  bool is_magic_;
+};
+
+// The same attacks as `pext_table`, each at its magic index. No attack set is
+// empty, so 0 marks the indices that no subset has.
+template <bool is_rook, int idx>
+constexpr MagicTable<slider_table_size(idx, is_rook)> make_magic_table() {
+  constexpr Bitboard mask = relevant_occupancy_mask(idx, is_rook);
+  const Magic magic = {
+      mask,
+      (is_rook ? known_rook_magics : known_bishop_magics)[idx],
+      static_cast<unsigned>(64 - popcount(mask)), nullptr};
+  MagicTable<slider_table_size(idx, is_rook)> res = {{}, true};
+  Bitboard subset = 0;
+  size_t i = 0;
+  do {
+    Bitboard& entry = res.attacks_[magic.index(subset)];
+    const Bitboard attacks = pext_table<is_rook, idx>[i++];
+    res.is_magic_ = res.is_magic_ && (!entry || entry == attacks);
+    entry = attacks;
+    subset = (subset - mask) & mask;
+  } while (subset);
+  return res;
+}
+
+template <bool is_rook, int idx>
+inline constexpr MagicTable<slider_table_size(idx, is_rook)> magic_table =
+    make_magic_table<is_rook, idx>();
+
+template <bool is_rook, size_t... idx>
+constexpr std::array<Magic, 64> make_magics(std::index_sequence<idx...>) {
+  static_assert((magic_table<is_rook, idx>.is_magic_ && ...),
+                "A known magic doesn't work for its mask.");
+  return {{Magic{relevant_occupancy_mask(idx, is_rook),
+                 (is_rook ? known_rook_magics : known_bishop_magics)[idx],
+                 static_cast<unsigned>(
+                     64 - popcount(relevant_occupancy_mask(idx, is_rook))),
+                 magic_table<is_rook, idx>.attacks_.data()}...}};
+}
+
+template <bool is_rook, size_t... idx>
+constexpr std::array<const Bitboard*, 64> make_pext_tables(
+    std::index_sequence<idx...>) {
+  return {{pext_table<is_rook, idx>.data()...}};
+}
+
+// Each table is computed by the compiler, one square at a time to stay within
+// its limits on constant evaluation, and placed in read-only data, so that
+// nothing is built at startup and processes share the tables through the page
+// cache.
+constexpr std::array<Magic, 64> rook_magics =
+    make_magics<true>(std::make_index_sequence<64>());
+constexpr std::array<Magic, 64> bishop_magics =
+    make_magics<false>(std::make_index_sequence<64>());
+constexpr std::array<const Bitboard*, 64> rook_pext_attacks =
+    make_pext_tables<true>(std::make_index_sequence<64>());
+constexpr std::array<const Bitboard*, 64> bishop_pext_attacks =
+    make_pext_tables<false>(std::make_index_sequence<64>());
+
+// BMI2 is there but pext is only worth using if it's fast. AMD's Zen 1 and
+// Zen 2 (families 0x17 and older) run it in microcode, where it is slower than
+// a magic multiply.
+bool has_fast_pext() {
+#if ATTACKS_HAVE_X86_DISPATCH
+  if (!__builtin_cpu_supports("bmi2")) {
+    return false;
+  }
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  // "AuthenticAMD" starts with "Auth" in ebx.
+  const bool is_amd = ebx == 0x68747541;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  unsigned family = (eax >> 8) & 0xF;
+  if (family == 0xF) {
+    family += (eax >> 20) & 0xFF;
+  }
+  return !(is_amd && family < 0x19);
+#else
+  return false;
+#endif
+}
+
+#if ATTACKS_HAVE_X86_DISPATCH
+__attribute__((target("bmi2"))) Bitboard pext_lookup(const Bitboard* attacks,
+                                                     Bitboard mask,
+                                                     Bitboard occupancy) {
+  return attacks[_pext_u64(occupancy, mask)];
+}
+#endif
+
+// Picked once at static initialization. Lookups made by the static
+// initializers of other files before then see the zero-initialized value,
+// the magic backend, which works on every CPU.
+const SliderBackend backend =
+    has_fast_pext() ? SliderBackend::pext : SliderBackend::magic;
+#else
+const SliderBackend backend = SliderBackend::fills;
+#endif
+
+constexpr Bitboard not_a_file = ~a_file_mask;
+constexpr Bitboard not_h_file = ~h_file_mask;
+
+// Moves the squares of `bb` `shift` indices up, or down if it is negative.
+template <int shift>
+Bitboard shift_squares(Bitboard bb) {
+  if constexpr (shift > 0) {
+    return bb << shift;
+  } else {
+    return bb >> -shift;
+  }
+}
+
+// The squares attacked from `slider` along the ray that `shift` squares of
+// index make one step of, over the `empty` squares. `mask` has the squares
+// the step may land on without wrapping around the board. Kogge-Stone: the
+// slider spreads 1, 2 and then 4 steps over the empty squares, which shrink
+// to those with that many empty ones behind them.
+template <int shift>
+Bitboard fill_ray(Bitboard slider, Bitboard empty, Bitboard mask) {
+  empty &= mask;
+  slider |= empty & shift_squares<shift>(slider);
+  empty &= shift_squares<shift>(empty);
+  slider |= empty & shift_squares<2 * shift>(slider);
+  empty &= shift_squares<2 * shift>(empty);
+  slider |= empty & shift_squares<4 * shift>(slider);
+  return shift_squares<shift>(slider) & mask;
+}
+}  // namespace.
+
+SliderBackend slider_backend() { return backend; }
+
+Bitboard rook_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+#ifdef PAWN_GRABBER_SLIDER_FILLS
+  return fill_rook_attacks(sq_idx, occupancy);
+#else
+  const size_t idx = static_cast<size_t>(sq_idx);
+#if ATTACKS_HAVE_X86_DISPATCH
+  if (backend == SliderBackend::pext) {
+    return pext_lookup(rook_pext_attacks[idx], rook_magics[idx].mask_,
+                       occupancy);
+  }
+#endif
+  return rook_magics[idx].attacks(occupancy);
+#endif
+}
+
+Bitboard bishop_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+#ifdef PAWN_GRABBER_SLIDER_FILLS
+  return fill_bishop_attacks(sq_idx, occupancy);
+#else
+  const size_t idx = static_cast<size_t>(sq_idx);
+#if ATTACKS_HAVE_X86_DISPATCH
+  if (backend == SliderBackend::pext) {
+    return pext_lookup(bishop_pext_attacks[idx], bishop_magics[idx].mask_,
+                       occupancy);
+  }
+#endif
+  return bishop_magics[idx].attacks(occupancy);
+#endif
+}
+
+Bitboard magic_rook_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+#ifdef PAWN_GRABBER_SLIDER_FILLS
+  return fill_rook_attacks(sq_idx, occupancy);
+#else
+  return rook_magics[static_cast<size_t>(sq_idx)].attacks(occupancy);
+#endif
+}
+
+Bitboard magic_bishop_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+#ifdef PAWN_GRABBER_SLIDER_FILLS
+  return fill_bishop_attacks(sq_idx, occupancy);
+#else
+  return bishop_magics[static_cast<size_t>(sq_idx)].attacks(occupancy);
+#endif
+}
+
+// The square index is rank * 8 + 7 - file, so a step towards the a-file adds
+// one and lands on the h-file when it wraps.
+Bitboard fill_rook_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+  const Bitboard slider = lsb_bitboard << sq_idx;
+  const Bitboard empty = ~occupancy;
+  return fill_ray<8>(slider, empty, ~Bitboard{0}) |
+         fill_ray<-8>(slider, empty, ~Bitboard{0}) |
+         fill_ray<1>(slider, empty, not_h_file) |
+         fill_ray<-1>(slider, empty, not_a_file);
+}
+
+Bitboard fill_bishop_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+  const Bitboard slider = lsb_bitboard << sq_idx;
+  const Bitboard empty = ~occupancy;
+  return fill_ray<9>(slider, empty, not_h_file) |
+         fill_ray<7>(slider, empty, not_a_file) |
+         fill_ray<-7>(slider, empty, not_h_file) |
+         fill_ray<-9>(slider, empty, not_a_file);
+}
+
+Bitboard pext_rook_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+  DEBUG_CHECK(backend == SliderBackend::pext,
+              "PEXT backend not selected on this CPU.");
+#if ATTACKS_HAVE_X86_DISPATCH
+  const size_t idx = static_cast<size_t>(sq_idx);
+  return pext_lookup(rook_pext_attacks[idx], rook_magics[idx].mask_,
+                     occupancy);
+#else
+  return magic_rook_attacks(sq_idx, occupancy);
+#endif
+}
+
+Bitboard pext_bishop_attacks(int sq_idx, Bitboard occupancy) {
+  DEBUG_CHECK(0 <= sq_idx && sq_idx < 64, "Not a square index.");
+  DEBUG_CHECK(backend == SliderBackend::pext,
+              "PEXT backend not selected on this CPU.");
+#if ATTACKS_HAVE_X86_DISPATCH
+  const size_t idx = static_cast<size_t>(sq_idx);
+  return pext_lookup(bishop_pext_attacks[idx], bishop_magics[idx].mask_,
+                     occupancy);
+#else
+  return magic_bishop_attacks(sq_idx, occupancy);
+#endif
+}
+
+Bitboard queen_attacks(int sq_idx, Bitboard occupancy) {
+  return rook_attacks(sq_idx, occupancy) | bishop_attacks(sq_idx, occupancy);
+}
+
+Bitboard slow_rook_attacks(int sq_idx, Bitboard occupancy) {
+  return ray_attacks(sq_idx, occupancy, rook_offsets);
+}
+
+Bitboard slow_bishop_attacks(int sq_idx, Bitboard occupancy) {
+  return ray_attacks(sq_idx, occupancy, bishop_offsets);
+}
@@ -0,0 +1,246 @@
+#ifndef ATTACKS_H
+#define ATTACKS_H
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "board.h"
+
+// Attack tables for the pieces whose attacks don't depend on the occupancy of
+// the board, and the rays, lines and squares between two squares that pins,
+// evasions and x-rays need. Each table is indexed by `square_idx` and built at
+// compile time, so that a lookup replaces stepping through
+// `direction_to_function` one square at a time.
+
+// Returns the square `file_offset` files east and `rank_offset` ranks north of
+// the square with index `idx`, or 0 if that is off the board.
+constexpr Bitboard offset_square(int idx, int file_offset, int rank_offset) {
+  const int file = 7 - idx % 8 + file_offset;
+  const int rank = idx / 8 + rank_offset;
+  if (file < 0 || file >= board_size || rank < 0 || rank >= board_size) {
+    return 0;
+  }
+  return lsb_bitboard << (rank * 8 + (7 - file));
+}
+
+constexpr Bitboard knight_attacks_from(int idx) {
+  return offset_square(idx, 1, 2) | offset_square(idx, 2, 1) |
+         offset_square(idx, 2, -1) | offset_square(idx, 1, -2) |
+         offset_square(idx, -1, -2) | offset_square(idx, -2, -1) |
+         offset_square(idx, -2, 1) | offset_square(idx, -1, 2);
+}
+
+constexpr Bitboard king_attacks_from(int idx) {
+  return offset_square(idx, 0, 1) | offset_square(idx, 1, 1) |
+         offset_square(idx, 1, 0) | offset_square(idx, 1, -1) |
+         offset_square(idx, 0, -1) | offset_square(idx, -1, -1) |
+         offset_square(idx, -1, 0) | offset_square(idx, -1, 1);
+}
+
+constexpr Bitboard white_pawn_attacks_from(int idx) {
+  return offset_square(idx, -1, 1) | offset_square(idx, 1, 1);
+}
+
+constexpr Bitboard black_pawn_attacks_from(int idx) {
+  return offset_square(idx, -1, -1) | offset_square(idx, 1, -1);
+}
+
+constexpr std::array<Bitboard, 64> make_attack_table(
+    Bitboard (*attacks_from)(int)) {
+  std::array<Bitboard, 64> res = {};
+  for (int idx = 0; idx < 64; ++idx) {
+    res[static_cast<size_t>(idx)] = attacks_from(idx);
+  }
+  return res;
+}
+
+constexpr std::array<Bitboard, 64> knight_attacks =
+    make_attack_table(knight_attacks_from);
+constexpr std::array<Bitboard, 64> king_attacks =
+    make_attack_table(king_attacks_from);
+// The squares a pawn of the given color attacks, not the squares it moves to.
+constexpr std::array<Bitboard, 64> white_pawn_attacks =
+    make_attack_table(white_pawn_attacks_from);
+constexpr std::array<Bitboard, 64> black_pawn_attacks =
+    make_attack_table(black_pawn_attacks_from);
+
+// The (file, rank) step of each Direction, in the order of the enum, east
+// and north being positive.
+constexpr std::array<std::pair<int, int>, 8> direction_steps = {
+    {{0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}}};
+
+constexpr Direction opposite_direction(Direction direction) {
+  switch (direction) {
+    case Direction::north:
+      return Direction::south;
+    case Direction::south:
+      return Direction::north;
+    case Direction::east:
+      return Direction::west;
+    case Direction::west:
+      return Direction::east;
+    case Direction::northeast:
+      return Direction::southwest;
+    case Direction::northwest:
+      return Direction::southeast;
+    case Direction::southeast:
+      return Direction::northwest;
+    case Direction::southwest:
+      return Direction::northeast;
+  }
+  return direction;
+}
+
+// Returns true if the square indices grow along `direction`, so that the
+// nearest square of a ray is its lowest bit. The squares are numbered from h1
+// eastward to westward and rank by rank up the board.
+constexpr bool is_increasing_direction(Direction direction) {
+  return direction == Direction::north || direction == Direction::west ||
+         direction == Direction::northeast ||
+         direction == Direction::northwest;
+}
+
+// Returns the squares from the square with index `idx` to the edge of the
+// board in `direction`, not including it.
+constexpr Bitboard ray_from(int idx, Direction direction) {
+  const std::pair<int, int> step =
+      direction_steps[static_cast<size_t>(direction)];
+  Bitboard res = 0;
+  for (int distance = 1; distance < board_size; ++distance) {
+    res |= offset_square(idx, step.first * distance, step.second * distance);
+  }
+  return res;
+}
+
+constexpr std::array<std::array<Bitboard, 64>, 8> make_ray_table() {
+  std::array<std::array<Bitboard, 64>, 8> res = {};
+  for (Direction direction : all_directions) {
+    for (int idx = 0; idx < 64; ++idx) {
+      res[static_cast<size_t>(direction)][static_cast<size_t>(idx)] =
+          ray_from(idx, direction);
+    }
+  }
+  return res;
+}
+
+// The larger tables are inline variables, so that the program has one copy of
+// each rather than one per translation unit.
+//
+// rays[direction][idx] is `ray_from(idx, direction)`.
+inline constexpr std::array<std::array<Bitboard, 64>, 8> rays =
+    make_ray_table();
+
+// The table of `between_squares` if `is_line` is false, and otherwise of
+// `line_through`, from the rays: two squares share a line if one is on a ray
+// of the other.
+constexpr std::array<std::array<Bitboard, 64>, 64> make_line_table(
+    bool is_line) {
+  std::array<std::array<Bitboard, 64>, 64> res = {};
+  for (int a = 0; a < 64; ++a) {
+    for (int b = 0; b < 64; ++b) {
+      const Bitboard b_square = lsb_bitboard << b;
+      for (Direction direction : all_directions) {
+        const size_t dir = static_cast<size_t>(direction);
+        const size_t opposite =
+            static_cast<size_t>(opposite_direction(direction));
+        if (rays[dir][static_cast<size_t>(a)] & b_square) {
+          res[static_cast<size_t>(a)][static_cast<size_t>(b)] =
+              is_line ? rays[dir][static_cast<size_t>(a)] |
+                            rays[opposite][static_cast<size_t>(a)] |
+                            (lsb_bitboard << a)
+                      : rays[dir][static_cast<size_t>(a)] &
+                            ~rays[dir][static_cast<size_t>(b)] & ~b_square;
+        }
+      }
+    }
+  }
+  return res;
+}
+
+inline constexpr std::array<std::array<Bitboard, 64>, 64> between_table =
+    make_line_table(false);
+inline constexpr std::array<std::array<Bitboard, 64>, 64> line_table =
+    make_line_table(true);
+
+// Returns the squares strictly between the squares with indices `a` and `b` if
+// they share a rank, file or diagonal, or 0 otherwise.
+constexpr Bitboard between_squares(int a, int b) {
+  return between_table[static_cast<size_t>(a)][static_cast<size_t>(b)];
+}
+// Returns the full rank, file or diagonal through both squares, including
+// them, or 0 if they don't share one.
+constexpr Bitboard line_through(int a, int b) {
+  return line_table[static_cast<size_t>(a)][static_cast<size_t>(b)];
+}
+
+// The diagonal from a1 to h8 and the anti-diagonal from a8 to h1 that go
+// through the square with index `idx`, including it. See bitboard.h for the
+// ranks and files.
+constexpr Bitboard diagonal_mask(int idx) {
+  return rays[static_cast<size_t>(Direction::northeast)]
+             [static_cast<size_t>(idx)] |
+         rays[static_cast<size_t>(Direction::southwest)]
+             [static_cast<size_t>(idx)] |
+         (lsb_bitboard << idx);
+}
+constexpr Bitboard anti_diagonal_mask(int idx) {
+  return rays[static_cast<size_t>(Direction::northwest)]
+             [static_cast<size_t>(idx)] |
+         rays[static_cast<size_t>(Direction::southeast)]
+             [static_cast<size_t>(idx)] |
+         (lsb_bitboard << idx);
+}
+
+// Sliding attacks use magic bitboards. For a square, the occupied squares that
+// can block one of its rays are masked out and multiplied by a magic number
+// that maps every such subset to a distinct index in the top `64 - shift_`
+// bits, and the index selects a precomputed attack set. The tables are built
+// at compile time.
+struct Magic {
+  Bitboard mask_;
+  Bitboard magic_;
+  unsigned shift_;
+  const Bitboard* attacks_;
+  constexpr size_t index(Bitboard occupancy) const {
+    return static_cast<size_t>(((occupancy & mask_) * magic_) >> shift_);
+  }
+  constexpr Bitboard attacks(Bitboard occupancy) const {
+    return attacks_[index(occupancy)];
+  }
+};
+
+// On x86-64 hosts with fast BMI2 the tables are instead indexed with the pext
+// instruction, which needs no multiply and no magics. The backend is picked
+// from CPUID when the tables are built, so the same binary runs everywhere.
+//
+// Builds that must be small, such as those for browsers, define
+// PAWN_GRABBER_SLIDER_FILLS, and then have no tables at all: each ray is
+// filled from the slider with Kogge-Stone fills, three shifts that stop at the
+// first occupied square. That takes some 850 KB of tables out of the binary
+// for a few dozen ALU instructions a lookup.
+enum class SliderBackend { magic, pext, fills };
+SliderBackend slider_backend();
+
+// Returns the squares attacked by a slider on the square with index `sq_idx`
+// when the squares in `occupancy` are occupied. The first occupied square on
+// each ray is included, whatever color the piece on it is. These dispatch to
+// the backend given by `slider_backend()`.
+Bitboard rook_attacks(int sq_idx, Bitboard occupancy);
+Bitboard bishop_attacks(int sq_idx, Bitboard occupancy);
+Bitboard queen_attacks(int sq_idx, Bitboard occupancy);
+// The backends themselves. The pext ones may only be called when
+// `slider_backend()` is `SliderBackend::pext`. The magic ones fill in builds
+// without tables. The fills are in every build.
+Bitboard magic_rook_attacks(int sq_idx, Bitboard occupancy);
+Bitboard magic_bishop_attacks(int sq_idx, Bitboard occupancy);
+Bitboard pext_rook_attacks(int sq_idx, Bitboard occupancy);
+Bitboard pext_bishop_attacks(int sq_idx, Bitboard occupancy);
+Bitboard fill_rook_attacks(int sq_idx, Bitboard occupancy);
+Bitboard fill_bishop_attacks(int sq_idx, Bitboard occupancy);
+// The slider attacks computed by walking the rays. Used to build and test the
+// magic and pext tables.
+Bitboard slow_rook_attacks(int sq_idx, Bitboard occupancy);
+Bitboard slow_bishop_attacks(int sq_idx, Bitboard occupancy);
+
+#endif
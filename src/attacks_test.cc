@@ -0,0 +1,168 @@
+#include "attacks.h"
+
+#include <array>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+TEST(KnightAttacks, Corner) {
+  EXPECT_EQ(knight_attacks[square_idx(str_to_square("a1"))],
+            str_to_square("b3") | str_to_square("c2"));
+  EXPECT_EQ(knight_attacks[square_idx(str_to_square("h8"))],
+            str_to_square("g6") | str_to_square("f7"));
+}
+
+TEST(KnightAttacks, Center) {
+  EXPECT_EQ(knight_attacks[square_idx(str_to_square("d4"))],
+            str_to_square("c6") | str_to_square("e6") | str_to_square("f5") |
+                str_to_square("f3") | str_to_square("e2") |
+                str_to_square("c2") | str_to_square("b3") |
+                str_to_square("b5"));
+}
+
+TEST(KingAttacks, Corner) {
+  EXPECT_EQ(king_attacks[square_idx(str_to_square("h1"))],
+            str_to_square("g1") | str_to_square("g2") | str_to_square("h2"));
+  EXPECT_EQ(king_attacks[square_idx(str_to_square("a8"))],
+            str_to_square("b8") | str_to_square("b7") | str_to_square("a7"));
+}
+
+TEST(KingAttacks, Edge) {
+  EXPECT_EQ(king_attacks[square_idx(str_to_square("e1"))],
+            str_to_square("d1") | str_to_square("d2") | str_to_square("e2") |
+                str_to_square("f2") | str_to_square("f1"));
+}
+
+TEST(SlidingAttacks, MatchRayWalk) {
+  // A handful of occupancies, from empty to crowded, for every square.
+  const std::array<Bitboard, 5> occupancies = {
+      0x0, 0xFFFF00000000FFFF, 0x0000844221100800, 0x00FF00000000FF00,
+      0x1234567890ABCDEF};
+  for (int idx = 0; idx < 64; ++idx) {
+    for (Bitboard occupancy : occupancies) {
+      EXPECT_EQ(rook_attacks(idx, occupancy),
+                slow_rook_attacks(idx, occupancy));
+      EXPECT_EQ(bishop_attacks(idx, occupancy),
+                slow_bishop_attacks(idx, occupancy));
+      EXPECT_EQ(queen_attacks(idx, occupancy),
+                slow_rook_attacks(idx, occupancy) |
+                    slow_bishop_attacks(idx, occupancy));
+    }
+  }
+}
+
+TEST(SlidingAttacks, Blockers) {
+  const Bitboard occupancy = str_to_square("d6") | str_to_square("f4") |
+                             str_to_square("b2") | str_to_square("d1");
+  EXPECT_EQ(rook_attacks(square_idx(str_to_square("d4")), occupancy),
+            str_to_square("d5") | str_to_square("d6") | str_to_square("e4") |
+                str_to_square("f4") | str_to_square("d3") |
+                str_to_square("d2") | str_to_square("d1") |
+                str_to_square("c4") | str_to_square("b4") |
+                str_to_square("a4"));
+  EXPECT_EQ(bishop_attacks(square_idx(str_to_square("d4")), occupancy),
+            str_to_square("e5") | str_to_square("f6") | str_to_square("g7") |
+                str_to_square("h8") | str_to_square("e3") |
+                str_to_square("f2") | str_to_square("g1") |
+                str_to_square("c3") | str_to_square("b2") |
+                str_to_square("c5") | str_to_square("b6") |
+                str_to_square("a7"));
+}
+
+TEST(SlidingAttacks, BackendsAgree) {
+  const std::array<Bitboard, 3> occupancies = {0x0, 0x0000844221100800,
+                                               0x1234567890ABCDEF};
+  for (int idx = 0; idx < 64; ++idx) {
+    for (Bitboard occupancy : occupancies) {
+      EXPECT_EQ(magic_rook_attacks(idx, occupancy),
+                slow_rook_attacks(idx, occupancy));
+      EXPECT_EQ(magic_bishop_attacks(idx, occupancy),
+                slow_bishop_attacks(idx, occupancy));
+      EXPECT_EQ(fill_rook_attacks(idx, occupancy),
+                slow_rook_attacks(idx, occupancy));
+      EXPECT_EQ(fill_bishop_attacks(idx, occupancy),
+                slow_bishop_attacks(idx, occupancy));
+      if (slider_backend() == SliderBackend::pext) {
+        EXPECT_EQ(pext_rook_attacks(idx, occupancy),
+                  slow_rook_attacks(idx, occupancy));
+        EXPECT_EQ(pext_bishop_attacks(idx, occupancy),
+                  slow_bishop_attacks(idx, occupancy));
+      }
+    }
+  }
+}
+
+TEST(PawnAttacks, Simple) {
+  EXPECT_EQ(white_pawn_attacks[square_idx(str_to_square("e4"))],
+            str_to_square("d5") | str_to_square("f5"));
+  EXPECT_EQ(white_pawn_attacks[square_idx(str_to_square("a2"))],
+            str_to_square("b3"));
+  EXPECT_EQ(black_pawn_attacks[square_idx(str_to_square("h7"))],
+            str_to_square("g6"));
+  EXPECT_EQ(white_pawn_attacks[square_idx(str_to_square("c8"))], 0);
+}
+
+TEST(LineTables, BetweenAndLine) {
+  const int a1 = square_idx(str_to_square("a1"));
+  const int d4 = square_idx(str_to_square("d4"));
+  const int d1 = square_idx(str_to_square("d1"));
+  const int e2 = square_idx(str_to_square("e2"));
+  EXPECT_EQ(between_squares(a1, d4), str_to_square("b2") | str_to_square("c3"));
+  EXPECT_EQ(between_squares(d4, a1), str_to_square("b2") | str_to_square("c3"));
+  EXPECT_EQ(between_squares(a1, d1), str_to_square("b1") | str_to_square("c1"));
+  EXPECT_EQ(between_squares(a1, e2), 0);
+  EXPECT_EQ(line_through(d1, d4), 0x1010101010101010);
+  EXPECT_EQ(line_through(a1, d4), 0x0102040810204080);
+  EXPECT_EQ(line_through(a1, e2), 0);
+}
+
+TEST(LineTables, MatchRayWalk) {
+  for (int a = 0; a < 64; ++a) {
+    const auto ray = [a](Direction direction) {
+      return rays[static_cast<size_t>(direction)][static_cast<size_t>(a)];
+    };
+    EXPECT_EQ(ray(Direction::north) | ray(Direction::south) |
+                  ray(Direction::east) | ray(Direction::west),
+              slow_rook_attacks(a, 0));
+    EXPECT_EQ(ray(Direction::northeast) | ray(Direction::northwest) |
+                  ray(Direction::southeast) | ray(Direction::southwest),
+              slow_bishop_attacks(a, 0));
+    EXPECT_EQ(diagonal_mask(a) | anti_diagonal_mask(a),
+              slow_bishop_attacks(a, 0) | lsb_bitboard << a);
+    const Bitboard a_square = lsb_bitboard << a;
+    for (int b = 0; b < 64; ++b) {
+      const Bitboard b_square = lsb_bitboard << b;
+      Bitboard between = 0;
+      Bitboard line = 0;
+      for (auto slow_attacks : {&slow_rook_attacks, &slow_bishop_attacks}) {
+        if (a != b && (slow_attacks(a, 0) & b_square)) {
+          between = slow_attacks(a, b_square) & slow_attacks(b, a_square);
+          line = (slow_attacks(a, 0) & slow_attacks(b, 0)) | a_square |
+                 b_square;
+        }
+      }
+      EXPECT_EQ(between_squares(a, b), between) << a << " " << b;
+      EXPECT_EQ(line_through(a, b), line) << a << " " << b;
+    }
+  }
+  const int e4 = square_idx(str_to_square("e4"));
+  EXPECT_EQ(rays[static_cast<size_t>(Direction::east)][static_cast<size_t>(
+                e4)],
+            str_to_square("f4") | str_to_square("g4") | str_to_square("h4"));
+  EXPECT_EQ(diagonal_mask(square_idx(str_to_square("d4"))),
+            0x0102040810204080);
+  static_assert(between_squares(0, 7) == 0x7e,
+                "The tables are built at compile time.");
+}
+
+TEST(LineTables, IncreasingDirections) {
+  const int e4 = square_idx(str_to_square("e4"));
+  for (Direction direction : all_directions) {
+    const Bitboard ray =
+        rays[static_cast<size_t>(direction)][static_cast<size_t>(e4)];
+    const Bitboard nearest = is_increasing_direction(direction)
+                                 ? lsb_square(ray)
+                                 : msb_square(ray);
+    EXPECT_EQ(king_attacks[static_cast<size_t>(e4)] & ray, nearest);
+  }
+}
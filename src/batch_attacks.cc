@@ -0,0 +1,215 @@
+#include "batch_attacks.h"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+#include "bitboard.h"
+#include "board.h"
+
+#if defined(__x86_64__)
+#define PAWN_GRABBER_X86_ATTACKS 1
+#elif defined(__aarch64__) || defined(__wasm_simd128__)
+// NEON and WebAssembly's SIMD128 both have vectors of two bitboards.
+#define PAWN_GRABBER_128_BIT_ATTACKS 1
+#endif
+
+namespace {
+constexpr Bitboard not_a_file = ~a_file_mask;
+constexpr Bitboard not_h_file = ~h_file_mask;
+constexpr Bitboard not_ab_files = ~(a_file_mask | file_mask(1));
+constexpr Bitboard not_gh_files = ~(file_mask(6) | h_file_mask);
+
+// A ray of the sliders, as the shift that moves a square one step along it
+// and the squares that step may land on without wrapping around the board.
+struct Ray {
+  int shift_;
+  // Towards the higher square indices.
+  bool left_;
+  Bitboard mask_;
+  bool diagonal_;
+};
+
+// The square index is rank * 8 + 7 - file, so a step towards the a-file adds
+// one and lands on the h-file when it wraps.
+constexpr std::array<Ray, 8> rays = {{
+    {8, true, ~Bitboard{0}, false},  // North.
+    {8, false, ~Bitboard{0}, false},  // South.
+    {1, true, not_h_file, false},  // West.
+    {1, false, not_a_file, false},  // East.
+    {9, true, not_h_file, true},  // North-west.
+    {7, true, not_a_file, true},  // North-east.
+    {7, false, not_h_file, true},  // South-west.
+    {9, false, not_a_file, true},  // South-east.
+}};
+
+// Sets `attacks[idx, idx + lanes)` for the positions with those indices, where
+// `V` is either a Bitboard, for one position, or a vector of `lanes`
+// Bitboards. It is inlined into the functions below, so that it is compiled
+// for the instruction set of each, and never passes a vector to a function.
+template <typename V>
+inline __attribute__((always_inline)) void attack_lanes(
+    const PieceColumns& columns, Color side, size_t idx, Bitboard* attacks) {
+  V pieces[num_colors][num_piece_types];
+  V occupancy = {};
+  // Unrolled, so that the pieces stay in registers: AVX2 loads them in halves,
+  // and reading a whole vector back from memory after that stalls.
+#pragma GCC unroll 2
+  for (size_t color = 0; color < num_colors; ++color) {
+#pragma GCC unroll 6
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      std::memcpy(&pieces[color][piece], columns.pieces_[color][piece] + idx,
+                  sizeof(V));
+      occupancy |= pieces[color][piece];
+    }
+  }
+  const V* const own = pieces[static_cast<size_t>(side)];
+  const V pawns = own[static_cast<size_t>(Piece::pawn)];
+  V res = side == Color::white
+              ? ((pawns << 9) & not_h_file) | ((pawns << 7) & not_a_file)
+              : ((pawns >> 7) & not_h_file) | ((pawns >> 9) & not_a_file);
+
+  const V knights = own[static_cast<size_t>(Piece::knight)];
+  res |= ((knights << 17) | (knights >> 15)) & not_h_file;
+  res |= ((knights << 15) | (knights >> 17)) & not_a_file;
+  res |= ((knights << 10) | (knights >> 6)) & not_gh_files;
+  res |= ((knights << 6) | (knights >> 10)) & not_ab_files;
+
+  const V king = own[static_cast<size_t>(Piece::king)];
+  res |= (king << 8) | (king >> 8);
+  res |= ((king << 1) | (king << 9) | (king >> 7)) & not_h_file;
+  res |= ((king >> 1) | (king >> 9) | (king << 7)) & not_a_file;
+
+  const V queens = own[static_cast<size_t>(Piece::queen)];
+  const V rook_likes = own[static_cast<size_t>(Piece::rook)] | queens;
+  const V bishop_likes = own[static_cast<size_t>(Piece::bishop)] | queens;
+  const V empty = ~occupancy;
+#pragma GCC unroll 8
+  for (const Ray& ray : rays) {
+    // Kogge-Stone: `gen` spreads 1, 2 and then 4 steps over the empty squares
+    // `pro`, which shrinks to the squares with that many empty ones behind.
+    V gen = ray.diagonal_ ? bishop_likes : rook_likes;
+    V pro = empty & ray.mask_;
+    const int shift = ray.shift_;
+    if (ray.left_) {
+      gen |= pro & (gen << shift);
+      pro &= pro << shift;
+      gen |= pro & (gen << 2 * shift);
+      pro &= pro << 2 * shift;
+      gen |= pro & (gen << 4 * shift);
+      res |= (gen << shift) & ray.mask_;
+    } else {
+      gen |= pro & (gen >> shift);
+      pro &= pro >> shift;
+      gen |= pro & (gen >> 2 * shift);
+      pro &= pro >> 2 * shift;
+      gen |= pro & (gen >> 4 * shift);
+      res |= (gen >> shift) & ray.mask_;
+    }
+  }
+  std::memcpy(attacks + idx, &res, sizeof(V));
+}
+
+void attack_squares_scalar(const PieceColumns& columns, Color side,
+                           size_t num_positions, Bitboard* attacks) {
+  for (size_t i = 0; i < num_positions; ++i) {
+    attack_lanes<Bitboard>(columns, side, i, attacks);
+  }
+}
+
+#ifdef PAWN_GRABBER_X86_ATTACKS
+typedef Bitboard Bitboards4 __attribute__((vector_size(32)));
+typedef Bitboard Bitboards8 __attribute__((vector_size(64)));
+
+__attribute__((target("avx2"))) void attack_squares_avx2(
+    const PieceColumns& columns, Color side, size_t num_positions,
+    Bitboard* attacks) {
+  size_t i = 0;
+  for (; i + 4 <= num_positions; i += 4) {
+    attack_lanes<Bitboards4>(columns, side, i, attacks);
+  }
+  for (; i < num_positions; ++i) {
+    attack_lanes<Bitboard>(columns, side, i, attacks);
+  }
+}
+
+__attribute__((target("avx512f"))) void attack_squares_avx512(
+    const PieceColumns& columns, Color side, size_t num_positions,
+    Bitboard* attacks) {
+  size_t i = 0;
+  for (; i + 8 <= num_positions; i += 8) {
+    attack_lanes<Bitboards8>(columns, side, i, attacks);
+  }
+  for (; i < num_positions; ++i) {
+    attack_lanes<Bitboard>(columns, side, i, attacks);
+  }
+}
+
+bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+bool has_avx512() { return __builtin_cpu_supports("avx512f"); }
+#endif
+
+#ifdef PAWN_GRABBER_128_BIT_ATTACKS
+typedef Bitboard Bitboards2 __attribute__((vector_size(16)));
+
+void attack_squares_128_bit(const PieceColumns& columns, Color side,
+                            size_t num_positions, Bitboard* attacks) {
+  size_t i = 0;
+  for (; i + 2 <= num_positions; i += 2) {
+    attack_lanes<Bitboards2>(columns, side, i, attacks);
+  }
+  for (; i < num_positions; ++i) {
+    attack_lanes<Bitboard>(columns, side, i, attacks);
+  }
+}
+#endif
+}  // namespace.
+
+size_t batch_attack_lanes() {
+  static const size_t lanes = [] {
+#ifdef PAWN_GRABBER_X86_ATTACKS
+    if (has_avx512()) {
+      return size_t{8};
+    }
+    if (has_avx2()) {
+      return size_t{4};
+    }
+#endif
+#ifdef PAWN_GRABBER_128_BIT_ATTACKS
+    return size_t{2};
+#endif
+    return size_t{1};
+  }();
+  return lanes;
+}
+
+bool batch_attack_squares(const PieceColumns& columns, Color side,
+                          size_t num_positions, Bitboard* attacks,
+                          size_t lanes) {
+  switch (lanes == 0 ? batch_attack_lanes() : lanes) {
+    case 1:
+      attack_squares_scalar(columns, side, num_positions, attacks);
+      return true;
+#ifdef PAWN_GRABBER_128_BIT_ATTACKS
+    case 2:
+      attack_squares_128_bit(columns, side, num_positions, attacks);
+      return true;
+#endif
+#ifdef PAWN_GRABBER_X86_ATTACKS
+    case 4:
+      if (!has_avx2()) {
+        return false;
+      }
+      attack_squares_avx2(columns, side, num_positions, attacks);
+      return true;
+    case 8:
+      if (!has_avx512()) {
+        return false;
+      }
+      attack_squares_avx512(columns, side, num_positions, attacks);
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
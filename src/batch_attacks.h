@@ -0,0 +1,41 @@
+#ifndef BATCH_ATTACKS_H
+#define BATCH_ATTACKS_H
+
+#include <array>
+#include <cstddef>
+
+#include "bitboard.h"
+#include "board.h"
+
+// The squares one side attacks in many positions at once, for offline jobs
+// that want throughput rather than the latency of one position. Instead of
+// looking attacks up square by square as `Board::attack_squares` does, every
+// piece type is shifted as a whole bitboard, and the sliders are filled ray by
+// ray with Kogge-Stone fills, three shifts per ray. That has no table lookups
+// and no branches on the pieces, so the same instructions serve several
+// positions side by side in the lanes of a vector: 8 with AVX-512, 4 with
+// AVX2, 2 with NEON or WebAssembly's SIMD128. As with the kernels of
+// nnue_kernels.h, the x86 versions are compiled for their instruction sets
+// function by function, and the best one the CPU supports is picked at the
+// first call.
+
+// The bitboards of many positions, column by column: `pieces_[color][piece]`
+// points at the bitboard of that piece and color of every position, one after
+// another.
+struct PieceColumns {
+  std::array<std::array<const Bitboard*, num_piece_types>, num_colors>
+      pieces_;
+};
+
+// Returns the number of positions the best version handles at once.
+size_t batch_attack_lanes();
+
+// Sets `attacks[i]` to `Board::attack_squares(side)` of position `i` of
+// `columns`, for the first `num_positions` positions. `lanes` picks the
+// version, 0 for the best one. Returns false, and does nothing, if this build
+// or this CPU doesn't have the version asked for.
+bool batch_attack_squares(const PieceColumns& columns, Color side,
+                          size_t num_positions, Bitboard* attacks,
+                          size_t lanes = 0);
+
+#endif
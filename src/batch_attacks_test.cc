@@ -0,0 +1,75 @@
+#include "batch_attacks.h"
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "bitboard.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "perft.h"
+
+namespace {
+// The positions of random games from the perft suite, stored column by column.
+struct TestColumns {
+  std::vector<Board> boards_;
+  std::vector<Bitboard> bitboards_[num_colors][num_piece_types];
+  PieceColumns columns_;
+
+  explicit TestColumns(size_t num_positions) {
+    std::mt19937 rng(3);
+    while (boards_.size() < num_positions) {
+      Board board(perft_suite[boards_.size() % perft_suite.size()].fen_);
+      for (int ply = 0; ply < 80 && boards_.size() < num_positions; ++ply) {
+        boards_.push_back(board);
+        const MoveList moves = board.legal_moves();
+        if (moves.empty()) {
+          break;
+        }
+        board.do_move(moves[rng() % moves.size()]);
+      }
+    }
+    for (size_t color = 0; color < num_colors; ++color) {
+      for (size_t piece = 0; piece < num_piece_types; ++piece) {
+        for (const Board& board : boards_) {
+          bitboards_[color][piece].push_back(board.pieces_[color][piece]);
+        }
+        columns_.pieces_[color][piece] = bitboards_[color][piece].data();
+      }
+    }
+  }
+};
+}  // namespace.
+
+TEST(BatchAttackSquares, MatchesTheBoardForEveryVersion) {
+  // Not a multiple of any number of lanes, so the versions finish one
+  // position at a time.
+  const TestColumns test(1003);
+  int num_versions = 0;
+  for (size_t lanes : {0, 1, 2, 4, 8}) {
+    for (Color side : {Color::white, Color::black}) {
+      std::vector<Bitboard> attacks(test.boards_.size());
+      if (!batch_attack_squares(test.columns_, side, attacks.size(),
+                                attacks.data(), lanes)) {
+        continue;
+      }
+      ++num_versions;
+      for (size_t i = 0; i < attacks.size(); ++i) {
+        ASSERT_EQ(attacks[i], test.boards_[i].attack_squares(side))
+            << lanes << " lanes\n"
+            << test.boards_[i].to_pretty_str();
+      }
+    }
+  }
+  // The default and the scalar version, for both sides, at least.
+  EXPECT_GE(num_versions, 4);
+}
+
+TEST(BatchAttackSquares, RejectsUnknownVersions) {
+  const TestColumns test(1);
+  Bitboard attacks = 0;
+  EXPECT_FALSE(
+      batch_attack_squares(test.columns_, Color::white, 1, &attacks, 3));
+  EXPECT_EQ(attacks, 0);
+  EXPECT_GE(batch_attack_lanes(), 1);
+}
@@ -0,0 +1,130 @@
+#include "batch_c.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "batch_features.h"
+#include "board.h"
+#include "dataloader.h"
+#include "dataloader_c.h"
+#include "packed_position.h"
+#include "similar_positions.h"
+#include "thread_pool.h"
+
+struct PawnGrabberThreadPool {
+  explicit PawnGrabberThreadPool(size_t num_threads) : pool_(num_threads) {}
+
+  ThreadPool pool_;
+};
+
+namespace {
+// Packed positions are unpacked this many at a time, into a buffer on the
+// stack.
+constexpr size_t unpack_block_size = 32;
+
+ThreadPool* to_pool(PawnGrabberThreadPool* pool) {
+  return pool ? &pool->pool_ : nullptr;
+}
+
+// Runs `compute(first_idx, size)` over blocks of [0, num_items), on `pool`
+// if it isn't null.
+template <typename Fn>
+void for_each_block(size_t num_items, ThreadPool* pool, const Fn& compute) {
+  if (!pool || num_items <= batch_features_block_size) {
+    compute(size_t{0}, num_items);
+    return;
+  }
+  for (size_t start = 0; start < num_items;
+       start += batch_features_block_size) {
+    const size_t size = std::min(batch_features_block_size, num_items - start);
+    pool->submit([&compute, start, size] { compute(start, size); });
+  }
+  pool->wait();
+}
+}  // namespace.
+
+PawnGrabberThreadPool* pawn_grabber_create_thread_pool(size_t num_threads) {
+  return new PawnGrabberThreadPool(num_threads);
+}
+
+void pawn_grabber_destroy_thread_pool(PawnGrabberThreadPool* pool) {
+  delete pool;
+}
+
+size_t pawn_grabber_pack_fens(const char* fens, size_t fens_size,
+                              void* packed, size_t max_positions) {
+  PackedPosition* const out = static_cast<PackedPosition*>(packed);
+  absl::string_view rest(fens, fens_size);
+  size_t res = 0;
+  while (!rest.empty() && res < max_positions) {
+    const size_t end = std::min(rest.find('\n'), rest.size());
+    const absl::optional<Board> board = parse_fen(rest.substr(0, end));
+    if (!board || board->position_error()) {
+      break;
+    }
+    out[res++] = pack_position(*board, 0, 0);
+    rest.remove_prefix(std::min(end + 1, rest.size()));
+  }
+  return res;
+}
+
+void pawn_grabber_decode_positions(const void* positions,
+                                   size_t num_positions, uint64_t* bitboards,
+                                   PawnGrabberThreadPool* pool) {
+  const PackedPosition* const packed =
+      static_cast<const PackedPosition*>(positions);
+  for_each_block(num_positions, to_pool(pool),
+                 [packed, bitboards](size_t start, size_t size) {
+                   for (size_t i = start; i < start + size; ++i) {
+                     const PieceBitboards res = piece_bitboards(packed[i]);
+                     std::memcpy(bitboards + i * res.size(), res.data(),
+                                 sizeof(res));
+                   }
+                 });
+}
+
+void pawn_grabber_board_features(const void* positions, size_t num_positions,
+                                 uint8_t* num_legal_moves, uint8_t* in_check,
+                                 uint64_t* attacks,
+                                 PawnGrabberThreadPool* pool) {
+  compute_board_features(static_cast<const PackedPosition*>(positions),
+                         num_positions, {num_legal_moves, in_check, attacks},
+                         to_pool(pool));
+}
+
+void pawn_grabber_active_features(int feature_set, const void* positions,
+                                  size_t num_positions, int32_t* stm_features,
+                                  int32_t* nstm_features,
+                                  PawnGrabberThreadPool* pool) {
+  const FeatureSet features = feature_set == PAWN_GRABBER_HALF_KA
+                                  ? FeatureSet::half_ka
+                                  : FeatureSet::half_kp;
+  const size_t stride = max_active_features(features);
+  const PackedPosition* const packed =
+      static_cast<const PackedPosition*>(positions);
+  for_each_block(num_positions, to_pool(pool), [&](size_t start, size_t size) {
+    std::array<Board, unpack_block_size> boards;
+    for (size_t first = start; first < start + size;
+         first += unpack_block_size) {
+      const size_t num_boards =
+          std::min(unpack_block_size, start + size - first);
+      unpack_positions(packed + first, num_boards, boards.data());
+      for (size_t i = 0; i < num_boards; ++i) {
+        const Board& board = boards[i];
+        const Color side = board.is_whites_move_ ? Color::white : Color::black;
+        int32_t* const stm = stm_features + (first + i) * stride;
+        int32_t* const nstm = nstm_features + (first + i) * stride;
+        std::fill(stm + active_features(features, board, side, stm),
+                  stm + stride, -1);
+        std::fill(nstm + active_features(features, board, flip_color(side),
+                                         nstm),
+                  nstm + stride, -1);
+      }
+    }
+  });
+}
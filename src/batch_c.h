@@ -0,0 +1,74 @@
+#ifndef BATCH_C_H
+#define BATCH_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The batch APIs over packed positions (see packed_position.h) through a C
+// interface, in the pawn_grabber_dataloader shared library next to the
+// dataloader of dataloader_c.h, for Python and other callers that work on
+// whole arrays. Every function takes `num_positions` packed positions of 32
+// bytes each, and writes its results straight into arrays the caller owns,
+// row-major with one row per position, so that a NumPy array of packed
+// positions, which a file of them maps to as
+//
+//   positions = numpy.fromfile(path, dtype=numpy.uint64).reshape(-1, 4)
+//
+// is read and NumPy arrays of results are written without a copy, by passing
+// `array.ctypes.data` for each. The arrays must be C-contiguous. ctypes
+// releases the GIL for the length of each call, so that other Python threads
+// run while the positions are worked on, and the whole loop over them stays
+// in C++.
+//
+// A pool may be passed to spread the positions over its workers in blocks,
+// or null to work on the calling thread.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PawnGrabberThreadPool PawnGrabberThreadPool;
+
+// Starts a pool of `num_threads` workers, 0 for one per hardware thread, to
+// be kept for many calls.
+PawnGrabberThreadPool* pawn_grabber_create_thread_pool(size_t num_threads);
+void pawn_grabber_destroy_thread_pool(PawnGrabberThreadPool* pool);
+
+// Packs the positions of `fens`, `fens_size` bytes of FENs one per line, into
+// `packed`, which has room for `max_positions`, with a score and result of 0,
+// and returns the number packed. That is less than the number of lines if a
+// line isn't the FEN of a position that can be played from, and then the
+// line at that index is the first such one.
+size_t pawn_grabber_pack_fens(const char* fens, size_t fens_size,
+                              void* packed, size_t max_positions);
+
+// Writes the 12 bitboards of each position, white's pawns, knights, bishops,
+// rooks, queens and king, then black's, to `bitboards`. The other fields of
+// a packed position are read from it as they are.
+void pawn_grabber_decode_positions(const void* positions,
+                                   size_t num_positions, uint64_t* bitboards,
+                                   PawnGrabberThreadPool* pool);
+
+// As `compute_board_features` in batch_features.h: for each position the
+// number of legal moves, 1 if the side to move is in check and else 0, and
+// the squares white then black attack, two bitboards. Any array may be null,
+// and that result is then not computed.
+void pawn_grabber_board_features(const void* positions, size_t num_positions,
+                                 uint8_t* num_legal_moves, uint8_t* in_check,
+                                 uint64_t* attacks,
+                                 PawnGrabberThreadPool* pool);
+
+// The feature indices of each position, as the dataloader writes them, of
+// `feature_set`, PAWN_GRABBER_HALF_KP or PAWN_GRABBER_HALF_KA of
+// dataloader_c.h: `pawn_grabber_max_active_features(feature_set)` a position
+// for the side to move and as many for the other side, padded with -1.
+void pawn_grabber_active_features(int feature_set, const void* positions,
+                                  size_t num_positions, int32_t* stm_features,
+                                  int32_t* nstm_features,
+                                  PawnGrabberThreadPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
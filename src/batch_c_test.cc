@@ -0,0 +1,134 @@
+#include "batch_c.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "batch_features.h"
+#include "board.h"
+#include "dataloader.h"
+#include "dataloader_c.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "perft.h"
+
+namespace {
+// The FENs of the perft suite and of positions of games of moves picked all
+// over the move lists from them, one per line.
+std::string test_fens(size_t num_positions) {
+  std::string res;
+  size_t num_added = 0;
+  for (size_t i = 0; num_added < num_positions; ++i) {
+    Board board(perft_suite[i % perft_suite.size()].fen_);
+    for (size_t ply = 0; ply < 40 && num_added < num_positions; ++ply) {
+      res += board.to_fen() + "\n";
+      ++num_added;
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[(i * 7 + ply * 13) % moves.size()]);
+    }
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(BatchC, PacksFens) {
+  const std::string fens = test_fens(100);
+  std::vector<PackedPosition> positions(100);
+  EXPECT_EQ(pawn_grabber_pack_fens(fens.data(), fens.size(),
+                                   positions.data(), positions.size()),
+            100);
+  size_t line_start = 0;
+  for (const PackedPosition& position : positions) {
+    const size_t line_end = fens.find('\n', line_start);
+    EXPECT_EQ(unpack_position(position).to_fen() + "\n",
+              fens.substr(line_start, line_end + 1 - line_start));
+    line_start = line_end + 1;
+  }
+  // Stops at the room there is, and at the first line that isn't a
+  // position, without a newline at the end.
+  EXPECT_EQ(pawn_grabber_pack_fens(fens.data(), fens.size(),
+                                   positions.data(), 10),
+            10);
+  const std::string bad =
+      "8/8/8/8/8/8/8/K1k5 w - - 0 1\n8/8/8/8/8/8/8/K7 w - - 0 1\n" +
+      fens.substr(0, fens.find('\n'));
+  EXPECT_EQ(pawn_grabber_pack_fens(bad.data(), bad.size(), positions.data(),
+                                   positions.size()),
+            1);
+  const std::string last = fens.substr(0, fens.find('\n'));
+  EXPECT_EQ(pawn_grabber_pack_fens(last.data(), last.size(),
+                                   positions.data(), positions.size()),
+            1);
+}
+
+TEST(BatchC, ComputesAsTheBatchApis) {
+  const size_t num_positions = 3000;
+  const std::string fens = test_fens(num_positions);
+  std::vector<PackedPosition> positions(num_positions);
+  ASSERT_EQ(pawn_grabber_pack_fens(fens.data(), fens.size(),
+                                   positions.data(), positions.size()),
+            num_positions);
+  std::vector<uint8_t> expected_moves(num_positions);
+  std::vector<uint8_t> expected_checks(num_positions);
+  std::vector<uint64_t> expected_attacks(2 * num_positions);
+  compute_board_features(positions.data(), num_positions,
+                         {expected_moves.data(), expected_checks.data(),
+                          expected_attacks.data()});
+
+  PawnGrabberThreadPool* const pool = pawn_grabber_create_thread_pool(3);
+  for (PawnGrabberThreadPool* call_pool :
+       {static_cast<PawnGrabberThreadPool*>(nullptr), pool}) {
+    SCOPED_TRACE(call_pool != nullptr);
+    std::vector<uint64_t> bitboards(12 * num_positions);
+    pawn_grabber_decode_positions(positions.data(), num_positions,
+                                  bitboards.data(), call_pool);
+    for (size_t i = 0; i < num_positions; ++i) {
+      const Board board = unpack_position(positions[i]);
+      for (size_t color = 0; color < num_colors; ++color) {
+        for (size_t piece = 0; piece < num_piece_types; ++piece) {
+          ASSERT_EQ(bitboards[12 * i + color * num_piece_types + piece],
+                    board.pieces_[color][piece]);
+        }
+      }
+    }
+
+    std::vector<uint8_t> num_moves(num_positions);
+    std::vector<uint8_t> in_check(num_positions);
+    std::vector<uint64_t> attacks(2 * num_positions);
+    pawn_grabber_board_features(positions.data(), num_positions,
+                                num_moves.data(), in_check.data(),
+                                attacks.data(), call_pool);
+    EXPECT_EQ(num_moves, expected_moves);
+    EXPECT_EQ(in_check, expected_checks);
+    EXPECT_EQ(attacks, expected_attacks);
+
+    for (int feature_set : {PAWN_GRABBER_HALF_KP, PAWN_GRABBER_HALF_KA}) {
+      const FeatureSet features = feature_set == PAWN_GRABBER_HALF_KA
+                                      ? FeatureSet::half_ka
+                                      : FeatureSet::half_kp;
+      const size_t stride = pawn_grabber_max_active_features(feature_set);
+      std::vector<int32_t> stm(stride * num_positions);
+      std::vector<int32_t> nstm(stride * num_positions);
+      pawn_grabber_active_features(feature_set, positions.data(),
+                                   num_positions, stm.data(), nstm.data(),
+                                   call_pool);
+      for (size_t i = 0; i < num_positions; i += 7) {
+        const Board board = unpack_position(positions[i]);
+        const Color side =
+            board.is_whites_move_ ? Color::white : Color::black;
+        for (const Color perspective : {side, flip_color(side)}) {
+          std::vector<int32_t> expected(stride, -1);
+          active_features(features, board, perspective, expected.data());
+          const int32_t* const row =
+              (perspective == side ? stm : nstm).data() + i * stride;
+          EXPECT_EQ(std::vector<int32_t>(row, row + stride), expected);
+        }
+      }
+    }
+  }
+  pawn_grabber_destroy_thread_pool(pool);
+}
@@ -0,0 +1,94 @@
+#include "batch_features.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+#include "thread_pool.h"
+
+namespace {
+// How many boards ahead of the current one the loops prefetch.
+constexpr size_t prefetch_distance = 2;
+// Packed positions are unpacked this many at a time, into a buffer on the
+// stack.
+constexpr size_t unpack_block_size = 32;
+
+void prefetch_board(const Board& board) {
+  const char* const bytes = reinterpret_cast<const char*>(&board);
+  for (size_t offset = 0; offset < sizeof(Board); offset += 64) {
+    __builtin_prefetch(bytes + offset);
+  }
+}
+
+// Computes the features of `boards[0, num_boards)` into the elements of
+// `out` from `first_idx` on.
+void compute_block(const Board* boards, size_t num_boards,
+                   const BoardFeatureArrays& out, size_t first_idx) {
+  for (size_t i = 0; i < num_boards; ++i) {
+    if (i + prefetch_distance < num_boards) {
+      prefetch_board(boards[i + prefetch_distance]);
+    }
+    const Board& board = boards[i];
+    const size_t idx = first_idx + i;
+    if (out.num_legal_moves_) {
+      // A MoveList is stored inline, so this allocates nothing.
+      out.num_legal_moves_[idx] =
+          static_cast<uint8_t>(board.legal_moves().size());
+    }
+    if (out.in_check_) {
+      out.in_check_[idx] = board.is_king_attacked(
+          board.is_whites_move_ ? Color::white : Color::black);
+    }
+    if (out.attacks_) {
+      out.attacks_[2 * idx] = board.attack_squares(Color::white);
+      out.attacks_[2 * idx + 1] = board.attack_squares(Color::black);
+    }
+  }
+}
+
+void compute_packed_block(const PackedPosition* positions, size_t num_positions,
+                          const BoardFeatureArrays& out, size_t first_idx) {
+  std::array<Board, unpack_block_size> boards;
+  for (size_t start = 0; start < num_positions; start += unpack_block_size) {
+    const size_t size = std::min(unpack_block_size, num_positions - start);
+    unpack_positions(positions + start, size, boards.data());
+    compute_block(boards.data(), size, out, first_idx + start);
+  }
+}
+
+// Runs `compute(first_idx, size)` over the blocks of [0, num_items), on
+// `pool` if it isn't null.
+template <typename Fn>
+void for_each_block(size_t num_items, ThreadPool* pool, const Fn& compute) {
+  if (!pool || num_items <= batch_features_block_size) {
+    compute(size_t{0}, num_items);
+    return;
+  }
+  for (size_t start = 0; start < num_items;
+       start += batch_features_block_size) {
+    const size_t size = std::min(batch_features_block_size, num_items - start);
+    pool->submit([&compute, start, size] { compute(start, size); });
+  }
+  pool->wait();
+}
+}  // namespace.
+
+void compute_board_features(const Board* boards, size_t num_boards,
+                            const BoardFeatureArrays& out, ThreadPool* pool) {
+  for_each_block(num_boards, pool, [boards, &out](size_t start, size_t size) {
+    compute_block(boards + start, size, out, start);
+  });
+}
+
+void compute_board_features(const PackedPosition* positions,
+                            size_t num_positions,
+                            const BoardFeatureArrays& out, ThreadPool* pool) {
+  for_each_block(num_positions, pool,
+                 [positions, &out](size_t start, size_t size) {
+                   compute_packed_block(positions + start, size, out, start);
+                 });
+}
@@ -0,0 +1,47 @@
+#ifndef BATCH_FEATURES_H
+#define BATCH_FEATURES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+#include "thread_pool.h"
+
+// Per-position facts of many positions at once, for extracting features from
+// training data: the number of legal moves, whether the side to move is in
+// check and the squares each color attacks. The results go straight into
+// arrays the caller owns, one element per position, so that nothing is
+// allocated per position. The positions are split into blocks that the
+// workers of a thread pool take, and each loop fetches the next board into
+// cache while it works on the current one.
+
+// Where the results go. Any array may be null, and that result is then not
+// computed.
+struct BoardFeatureArrays {
+  // Fits, since no position has more than 218 legal moves.
+  uint8_t* num_legal_moves_;
+  // 1 if the side to move is in check, else 0.
+  uint8_t* in_check_;
+  // Two per position: the squares white attacks, then those black attacks.
+  Bitboard* attacks_;
+};
+
+// The number of positions in each task.
+constexpr size_t batch_features_block_size = 1024;
+
+// Computes the features of `num_boards` boards into `out`. With a `pool`, the
+// blocks are spread over its workers and this returns once they are all done;
+// it must not be called from a task of that pool. Without one, everything is
+// done on the calling thread.
+void compute_board_features(const Board* boards, size_t num_boards,
+                            const BoardFeatureArrays& out,
+                            ThreadPool* pool = nullptr);
+// The same for packed positions, which are unpacked a few at a time.
+void compute_board_features(const PackedPosition* positions,
+                            size_t num_positions,
+                            const BoardFeatureArrays& out,
+                            ThreadPool* pool = nullptr);
+
+#endif
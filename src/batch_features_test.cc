@@ -0,0 +1,102 @@
+#include "batch_features.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "perft.h"
+#include "thread_pool.h"
+
+namespace {
+// The positions of random games from the perft suite, more than fit in one
+// block.
+std::vector<Board> test_boards() {
+  std::mt19937 rng(17);
+  std::vector<Board> res;
+  while (res.size() < 3 * batch_features_block_size) {
+    Board board(perft_suite[res.size() % perft_suite.size()].fen_);
+    for (int ply = 0; ply < 60; ++ply) {
+      res.push_back(board);
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[rng() % moves.size()]);
+    }
+  }
+  return res;
+}
+
+struct Features {
+  std::vector<uint8_t> num_legal_moves_;
+  std::vector<uint8_t> in_check_;
+  std::vector<Bitboard> attacks_;
+
+  explicit Features(size_t num_positions)
+      : num_legal_moves_(num_positions),
+        in_check_(num_positions),
+        attacks_(2 * num_positions) {}
+  BoardFeatureArrays arrays() {
+    return {num_legal_moves_.data(), in_check_.data(), attacks_.data()};
+  }
+};
+
+void expect_features_of(const std::vector<Board>& boards,
+                        const Features& features) {
+  int num_in_check = 0;
+  for (size_t i = 0; i < boards.size(); ++i) {
+    const Board& board = boards[i];
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    EXPECT_EQ(features.num_legal_moves_[i], board.legal_moves().size());
+    EXPECT_EQ(features.in_check_[i], board.is_king_attacked(side));
+    EXPECT_EQ(features.attacks_[2 * i], board.attack_squares(Color::white));
+    EXPECT_EQ(features.attacks_[2 * i + 1],
+              board.attack_squares(Color::black));
+    num_in_check += features.in_check_[i];
+  }
+  EXPECT_GT(num_in_check, 0);
+}
+}  // namespace.
+
+TEST(BatchFeatures, MatchThoseOfEachBoard) {
+  const std::vector<Board> boards = test_boards();
+  Features features(boards.size());
+  compute_board_features(boards.data(), boards.size(), features.arrays());
+  expect_features_of(boards, features);
+}
+
+TEST(BatchFeatures, AreTheSameOnAPool) {
+  const std::vector<Board> boards = test_boards();
+  ThreadPool pool(3);
+  Features features(boards.size());
+  compute_board_features(boards.data(), boards.size(), features.arrays(),
+                         &pool);
+  expect_features_of(boards, features);
+}
+
+TEST(BatchFeatures, ComeFromPackedPositions) {
+  const std::vector<Board> boards = test_boards();
+  std::vector<PackedPosition> packed;
+  for (const Board& board : boards) {
+    packed.push_back(pack_position(board, 0, 0));
+  }
+  ThreadPool pool(2);
+  Features features(boards.size());
+  compute_board_features(packed.data(), packed.size(), features.arrays(),
+                         &pool);
+  expect_features_of(boards, features);
+}
+
+TEST(BatchFeatures, SkipArraysThatAreNull) {
+  const std::vector<Board> boards = test_boards();
+  std::vector<uint8_t> in_check(boards.size(), 2);
+  compute_board_features(boards.data(), boards.size(),
+                         {nullptr, in_check.data(), nullptr});
+  for (uint8_t value : in_check) {
+    EXPECT_LE(value, 1);
+  }
+}
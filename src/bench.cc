@@ -0,0 +1,128 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "board.h"
+#include "repetition.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+const char* const bench_fens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
+    "4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
+    "r3qbrk/6p1/2b2pPp/p3pP1Q/PpPpP2P/3P1B2/2PB3K/R5R1 w - - 16 42",
+    "6k1/1R3p2/6p1/2Bp3p/3P2q1/P7/1P2rQ1K/5R2 b - - 4 44",
+    "8/8/1p2k1p1/3p3p/1p1P1P1P/1P2PK2/8/8 w - - 3 54",
+    "r1bq1rk1/pp2b1pp/n1pp1n2/3P1p2/2P1p3/2N1P2N/PP2BPPP/R1BQ1RK1 b - - 2 10",
+    "2r4r/1p4k1/1Pnp4/3Qb1pq/8/4BpPp/5P2/2RR1BK1 w - - 0 42",
+    "r3kbbr/pp1n1p1P/3ppnp1/q5N1/1P1pP3/P1N1B3/2P1QP2/R3KB1R b KQkq b3 0 17",
+    "8/6pk/2b1Rp2/3r4/1R1B2PP/P5K1/8/2r5 b - - 16 42",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 80",
+};
+const size_t num_bench_fens = sizeof(bench_fens) / sizeof(bench_fens[0]);
+
+namespace {
+// Returns `value` with three decimals, as JSON takes it.
+std::string decimal(double value) {
+  return absl::StrCat(static_cast<double>(std::llround(value * 1000)) /
+                      1000);
+}
+}  // namespace.
+
+std::vector<size_t> doubling_thread_counts(size_t max_threads) {
+  std::vector<size_t> counts;
+  for (size_t count = 1; count < max_threads; count *= 2) {
+    counts.push_back(count);
+  }
+  counts.push_back(std::max<size_t>(max_threads, 1));
+  return counts;
+}
+
+std::vector<ThreadScalingRun> measure_thread_scaling(
+    const std::vector<Board>& positions, const ThreadScalingOptions& options,
+    const std::function<void(const ThreadScalingRun&)>& on_run) {
+  std::vector<ThreadScalingRun> runs;
+  TranspositionTable table(options.hash_mb_);
+  KeyHistory history;
+  for (size_t num_threads : options.thread_counts_) {
+    std::unique_ptr<ThreadPool> pool(
+        num_threads > 1 ? new ThreadPool(num_threads - 1) : nullptr);
+    ParallelSearcher searcher(pool.get(), &table);
+    searcher.set_smp_mode(options.smp_mode_);
+    ThreadScalingRun run = {};
+    run.num_threads_ = num_threads;
+    for (const Board& board : positions) {
+      table.clear();
+      history.reset(board);
+      searcher.set_game_history(history);
+      const auto start = std::chrono::steady_clock::now();
+      const SearchResult res =
+          searcher.search(board, {options.depth_, 0, nullptr, nullptr});
+      const int64_t time_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+      run.position_nodes_.push_back(res.nodes_);
+      run.position_time_us_.push_back(time_us);
+      run.nodes_ += res.nodes_;
+      run.time_us_ += time_us;
+    }
+    const int64_t time_us = std::max<int64_t>(run.time_us_, 1);
+    run.nodes_per_second_ =
+        run.nodes_ * 1000000 / static_cast<uint64_t>(time_us);
+    const ThreadScalingRun& baseline = runs.empty() ? run : runs[0];
+    run.nps_scaling_ = static_cast<double>(run.nodes_per_second_) /
+                       std::max<uint64_t>(baseline.nodes_per_second_, 1);
+    run.time_to_depth_speedup_ =
+        static_cast<double>(std::max<int64_t>(baseline.time_us_, 1)) /
+        time_us;
+    run.node_overhead_ = static_cast<double>(run.nodes_) /
+                             std::max<uint64_t>(baseline.nodes_, 1) -
+                         1.0;
+    runs.push_back(run);
+    if (on_run) {
+      on_run(runs.back());
+    }
+  }
+  return runs;
+}
+
+std::string thread_scaling_to_json(const ThreadScalingOptions& options,
+                                   const std::vector<ThreadScalingRun>& runs) {
+  std::string json = absl::StrCat(
+      "{\"depth\": ", options.depth_, ", \"smp_mode\": \"",
+      options.smp_mode_ == SmpMode::abdada ? "abdada" : "lazy",
+      "\", \"hash_mb\": ", options.hash_mb_, ", \"runs\": [");
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const ThreadScalingRun& run = runs[i];
+    absl::StrAppend(
+        &json, i == 0 ? "" : ", ", "{\"threads\": ", run.num_threads_,
+        ", \"nodes\": ", run.nodes_, ", \"time_us\": ", run.time_us_,
+        ", \"nps\": ", run.nodes_per_second_,
+        ", \"nps_scaling\": ", decimal(run.nps_scaling_),
+        ", \"time_to_depth_speedup\": ", decimal(run.time_to_depth_speedup_),
+        ", \"node_overhead\": ", decimal(run.node_overhead_),
+        ", \"position_nodes\": [", absl::StrJoin(run.position_nodes_, ", "),
+        "], \"position_time_us\": [",
+        absl::StrJoin(run.position_time_us_, ", "), "]}");
+  }
+  absl::StrAppend(&json, "]}");
+  return json;
+}
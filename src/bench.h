@@ -0,0 +1,60 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "search.h"
+
+// The positions of the UCI `bench` command and of the thread scaling
+// benchmark: openings, middlegames with and without queens, and endgames,
+// with castling, en passant and promotions among the moves.
+extern const char* const bench_fens[];
+extern const size_t num_bench_fens;
+
+// How a search of a fixed depth speeds up with threads, for sizing machines:
+// the same positions are searched to the same depth with each number of
+// threads, with a table of the same size cleared before each position.
+struct ThreadScalingOptions {
+  int depth_;
+  // The first is the baseline the others are compared with, normally 1.
+  std::vector<size_t> thread_counts_;
+  SmpMode smp_mode_;
+  size_t hash_mb_;
+};
+
+struct ThreadScalingRun {
+  size_t num_threads_;
+  // Per position, then in total.
+  std::vector<uint64_t> position_nodes_;
+  std::vector<int64_t> position_time_us_;
+  uint64_t nodes_;
+  int64_t time_us_;
+  uint64_t nodes_per_second_;
+  // Compared with the baseline: the ratio of the speeds, the baseline's time
+  // to depth over this one, and the fraction of nodes searched beyond the
+  // baseline's to reach the same depth, which is the work the threads
+  // duplicate, as Lazy SMP does by design.
+  double nps_scaling_;
+  double time_to_depth_speedup_;
+  double node_overhead_;
+};
+
+// Returns 1, 2, 4 and so on below `max_threads`, then `max_threads`.
+std::vector<size_t> doubling_thread_counts(size_t max_threads);
+
+// Searches `positions` with each number of threads of `options`, calling
+// `on_run` after each.
+std::vector<ThreadScalingRun> measure_thread_scaling(
+    const std::vector<Board>& positions, const ThreadScalingOptions& options,
+    const std::function<void(const ThreadScalingRun&)>& on_run = nullptr);
+
+// A JSON object with the options and a "runs" array of the runs.
+std::string thread_scaling_to_json(const ThreadScalingOptions& options,
+                                   const std::vector<ThreadScalingRun>& runs);
+
+#endif
@@ -0,0 +1,56 @@
+#include "bench.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "search.h"
+
+TEST(BenchFens, AreValidPositions) {
+  ASSERT_GT(num_bench_fens, 0);
+  for (size_t i = 0; i < num_bench_fens; ++i) {
+    EXPECT_FALSE(Board(bench_fens[i]).legal_moves().empty()) << bench_fens[i];
+  }
+}
+
+TEST(DoublingThreadCounts, EndsWithMaximum) {
+  EXPECT_EQ(doubling_thread_counts(1), std::vector<size_t>({1}));
+  EXPECT_EQ(doubling_thread_counts(4), std::vector<size_t>({1, 2, 4}));
+  EXPECT_EQ(doubling_thread_counts(6), std::vector<size_t>({1, 2, 4, 6}));
+}
+
+TEST(MeasureThreadScaling, ComparesWithFirstRun) {
+  const std::vector<Board> positions = {Board(bench_fens[0]),
+                                        Board(bench_fens[1])};
+  const ThreadScalingOptions options = {5, {1, 2}, SmpMode::lazy, 1};
+  size_t num_calls = 0;
+  const std::vector<ThreadScalingRun> runs = measure_thread_scaling(
+      positions, options,
+      [&num_calls](const ThreadScalingRun&) { ++num_calls; });
+  ASSERT_EQ(runs.size(), 2);
+  EXPECT_EQ(num_calls, 2);
+  EXPECT_EQ(runs[0].num_threads_, 1);
+  EXPECT_EQ(runs[1].num_threads_, 2);
+  EXPECT_DOUBLE_EQ(runs[0].nps_scaling_, 1.0);
+  EXPECT_DOUBLE_EQ(runs[0].time_to_depth_speedup_, 1.0);
+  EXPECT_DOUBLE_EQ(runs[0].node_overhead_, 0.0);
+  for (const ThreadScalingRun& run : runs) {
+    ASSERT_EQ(run.position_nodes_.size(), 2);
+    EXPECT_EQ(run.nodes_, run.position_nodes_[0] + run.position_nodes_[1]);
+    EXPECT_GT(run.nodes_, 0);
+  }
+  // The table is cleared before each position, so one thread searches the
+  // same tree every time.
+  const std::vector<ThreadScalingRun> again =
+      measure_thread_scaling(positions, {5, {1}, SmpMode::lazy, 1});
+  EXPECT_EQ(again[0].nodes_, runs[0].nodes_);
+
+  const std::string json = thread_scaling_to_json(options, runs);
+  EXPECT_TRUE(absl::StartsWith(json, "{\"depth\": 5, \"smp_mode\": \"lazy\""));
+  EXPECT_TRUE(absl::StrContains(json, "\"threads\": 2"));
+  EXPECT_TRUE(absl::StrContains(json, "\"node_overhead\": 0,"));
+  EXPECT_TRUE(absl::EndsWith(json, "]}]}"));
+}
@@ -0,0 +1,164 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "absl/strings/string_view.h"
+
+// Each bit of a Bitboard represents a square. The a8 square is the most
+// significant bit and the h1 square is the least significant bit. So the
+// unsigned 64 bit integer 10000000 00000000 00000000 00000000 00000000 00000000
+// 00000000 00000100 represents the board:
+
+// 8 | 1000 0000
+// 7 | 0000 0000
+// 6 | 0000 0000
+// 5 | 0000 0000
+// 4 | 0000 0000
+// 3 | 0000 0000
+// 2 | 0000 0000
+// 1 | 0000 0100
+//    -----------
+//     abcd efgh
+typedef uint64_t Bitboard;
+
+const int board_size = 8;
+// `lsb_bitboard is convenient for shift operations. The literal 1 has type int,
+// which has width 32 on x86, so `Bitboard bb = (1 << 50)` is undefined
+// behavior.
+constexpr Bitboard lsb_bitboard = 1;
+
+// Everything below is constexpr, so squares and masks spelled out in the code
+// are folded into constants instead of being computed when they are used.
+
+// Returns the square on `file` and `rank`, both counted from 0, so that a1 is
+// (0, 0) and h8 is (7, 7).
+constexpr Bitboard coordinates_to_square(int file, int rank) {
+  return lsb_bitboard << (rank * board_size + board_size - file - 1);
+}
+
+// Returns the square named by `algebraic_square`, e.g. "e4". The name is not
+// validated.
+constexpr Bitboard str_to_square(const absl::string_view algebraic_square) {
+  return coordinates_to_square(algebraic_square[0] - 'a',
+                               algebraic_square[1] - '1');
+}
+
+// Returns all squares on the rank or file with the given index, counted from
+// 0 as in `coordinates_to_square`.
+constexpr Bitboard rank_mask(int rank) {
+  return Bitboard{0xFF} << (rank * board_size);
+}
+
+constexpr Bitboard file_mask(int file) {
+  return Bitboard{0x0101010101010101} << (board_size - file - 1);
+}
+
+constexpr Bitboard a_file_mask = file_mask(0);
+constexpr Bitboard h_file_mask = file_mask(7);
+constexpr Bitboard first_rank_mask = rank_mask(0);
+constexpr Bitboard second_rank_mask = rank_mask(1);
+constexpr Bitboard third_rank_mask = rank_mask(2);
+constexpr Bitboard sixth_rank_mask = rank_mask(5);
+constexpr Bitboard seventh_rank_mask = rank_mask(6);
+constexpr Bitboard eighth_rank_mask = rank_mask(7);
+
+// Squares and square indices. A square's index is the index of its bit, so h1
+// is 0, a1 is 7 and a8 is 63. The indices are found with the bit scan
+// builtins, which compile to a single tzcnt or bsf instruction.
+
+constexpr bool is_square(Bitboard bb) { return bb && !(bb & (bb - 1)); }
+
+// Returns the index of `square`, which must not be 0. For a bitboard with more
+// than one square set this is the index of the least significant one.
+constexpr int square_idx(Bitboard square) { return __builtin_ctzll(square); }
+
+constexpr int rank_idx(Bitboard square) { return square_idx(square) / 8; }
+
+constexpr int file_idx(Bitboard square) { return 7 - square_idx(square) % 8; }
+
+constexpr int popcount(Bitboard bb) { return __builtin_popcountll(bb); }
+
+// Mirrors `bb` from top to bottom, moving the square with index i to i ^ 56.
+// Each rank is a byte, so this is a byte swap.
+constexpr Bitboard flip_ranks(Bitboard bb) { return __builtin_bswap64(bb); }
+
+// Returns the least significant square of `bb`, which must not be 0.
+constexpr Bitboard lsb_square(Bitboard bb) { return bb & (~bb + 1); }
+// Returns the most significant square of `bb`, which must not be 0.
+constexpr Bitboard msb_square(Bitboard bb) {
+  return lsb_bitboard << (63 - __builtin_clzll(bb));
+}
+
+// Iterates over the squares of a bitboard from the least significant bit up,
+// yielding each as a single-square Bitboard. Each step clears the lowest bit,
+// so nothing is allocated and the loop runs once per square:
+//
+//   for (Bitboard sq : bitboard_split(knights)) { ... }
+class SquareIterator {
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = Bitboard;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const Bitboard*;
+  using reference = Bitboard;
+
+  constexpr explicit SquareIterator(Bitboard bb) : bb_(bb) {}
+  constexpr Bitboard operator*() const { return lsb_square(bb_); }
+  constexpr SquareIterator& operator++() {
+    bb_ &= bb_ - 1;
+    return *this;
+  }
+  constexpr SquareIterator operator++(int) {
+    SquareIterator res = *this;
+    ++*this;
+    return res;
+  }
+  constexpr bool operator==(SquareIterator other) const {
+    return bb_ == other.bb_;
+  }
+  constexpr bool operator!=(SquareIterator other) const {
+    return bb_ != other.bb_;
+  }
+
+ private:
+  Bitboard bb_;
+};
+
+class SquareRange {
+ public:
+  constexpr explicit SquareRange(Bitboard bb) : bb_(bb) {}
+  constexpr SquareIterator begin() const { return SquareIterator(bb_); }
+  constexpr SquareIterator end() const { return SquareIterator(0); }
+  constexpr size_t size() const { return static_cast<size_t>(popcount(bb_)); }
+  constexpr bool empty() const { return bb_ == 0; }
+
+ private:
+  Bitboard bb_;
+};
+
+// Returns the squares of `bb` as a range, least significant first.
+constexpr SquareRange bitboard_split(Bitboard bb) { return SquareRange(bb); }
+
+constexpr bool on_a_file(Bitboard square) {
+  return (square & a_file_mask) != 0;
+}
+constexpr bool on_h_file(Bitboard square) {
+  return (square & h_file_mask) != 0;
+}
+constexpr bool on_first_rank(Bitboard square) {
+  return (square & first_rank_mask) != 0;
+}
+constexpr bool on_eigth_rank(Bitboard square) {
+  return (square & eighth_rank_mask) != 0;
+}
+
+static_assert(a_file_mask == 0x8080808080808080, "a file");
+static_assert(h_file_mask == 0x0101010101010101, "h file");
+static_assert(str_to_square("h1") == 1, "h1 is the least significant bit");
+static_assert(str_to_square("a8") == Bitboard{1} << 63,
+              "a8 is the most significant bit");
+
+#endif
@@ -0,0 +1,96 @@
+#include "bitboard.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(SquareUtils, IsSquare) {
+  EXPECT_FALSE(is_square(0));
+  EXPECT_TRUE(is_square(str_to_square("a1")));
+  EXPECT_FALSE(is_square(str_to_square("a1") | str_to_square("a2")));
+}
+
+TEST(SquareUtils, SquareIndex) {
+  EXPECT_EQ(square_idx(str_to_square("h1")), 0);
+  EXPECT_EQ(square_idx(str_to_square("a8")), 63);
+  EXPECT_EQ(square_idx(str_to_square("a1")), 7);
+}
+
+TEST(SquareUtils, RankIndex) {
+  EXPECT_EQ(rank_idx(str_to_square("h1")), 0);
+  EXPECT_EQ(rank_idx(str_to_square("h2")), 1);
+  EXPECT_EQ(rank_idx(str_to_square("a8")), 7);
+  EXPECT_EQ(rank_idx(str_to_square("e4")), 3);
+}
+
+TEST(SquareUtils, FileIndex) {
+  EXPECT_EQ(file_idx(str_to_square("h1")), 7);
+  EXPECT_EQ(file_idx(str_to_square("a8")), 0);
+  EXPECT_EQ(file_idx(str_to_square("e4")), 4);
+}
+
+TEST(SquareUtils, OnAFile) {
+  EXPECT_TRUE(on_a_file(str_to_square("a1")));
+  EXPECT_TRUE(on_a_file(str_to_square("a8")));
+  EXPECT_FALSE(on_a_file(str_to_square("b4")));
+  EXPECT_FALSE(on_a_file(str_to_square("e4")));
+  EXPECT_FALSE(on_a_file(str_to_square("h4")));
+}
+
+TEST(SquareUtils, OnHFile) {
+  EXPECT_TRUE(on_h_file(str_to_square("h1")));
+  EXPECT_TRUE(on_h_file(str_to_square("h8")));
+  EXPECT_FALSE(on_h_file(str_to_square("e4")));
+  EXPECT_FALSE(on_h_file(str_to_square("g4")));
+  EXPECT_FALSE(on_h_file(str_to_square("g8")));
+}
+
+TEST(SquareUtils, Popcount) {
+  EXPECT_EQ(popcount(0), 0);
+  EXPECT_EQ(popcount(str_to_square("e4")), 1);
+  EXPECT_EQ(popcount(a_file_mask | first_rank_mask), 15);
+  EXPECT_EQ(popcount(~Bitboard{0}), 64);
+}
+
+TEST(BitboardSplit, Empty) {
+  EXPECT_TRUE(bitboard_split(0).empty());
+  for (Bitboard sq : bitboard_split(0)) {
+    ADD_FAILURE() << "Unexpected square " << sq;
+  }
+}
+
+TEST(BitboardSplit, LeastSignificantFirst) {
+  const Bitboard bb =
+      str_to_square("a8") | str_to_square("e4") | str_to_square("h1");
+  std::vector<Bitboard> squares;
+  for (Bitboard sq : bitboard_split(bb)) {
+    squares.push_back(sq);
+  }
+  EXPECT_EQ(squares, std::vector<Bitboard>({str_to_square("h1"),
+                                            str_to_square("e4"),
+                                            str_to_square("a8")}));
+  EXPECT_EQ(bitboard_split(bb).size(), 3);
+}
+
+TEST(BitboardSplit, FullBoard) {
+  int idx = 0;
+  for (Bitboard sq : bitboard_split(~Bitboard{0})) {
+    EXPECT_EQ(square_idx(sq), idx);
+    ++idx;
+  }
+  EXPECT_EQ(idx, 64);
+}
+
+TEST(Masks, RanksAndFiles) {
+  EXPECT_EQ(rank_mask(0), 0xFF);
+  EXPECT_EQ(rank_mask(3), str_to_square("a4") | str_to_square("b4") |
+                              str_to_square("c4") | str_to_square("d4") |
+                              str_to_square("e4") | str_to_square("f4") |
+                              str_to_square("g4") | str_to_square("h4"));
+  EXPECT_EQ(file_mask(4), str_to_square("e1") | str_to_square("e2") |
+                              str_to_square("e3") | str_to_square("e4") |
+                              str_to_square("e5") | str_to_square("e6") |
+                              str_to_square("e7") | str_to_square("e8"));
+  EXPECT_EQ(second_rank_mask, 0xFF00);
+  EXPECT_EQ(seventh_rank_mask, 0x00FF000000000000);
+}
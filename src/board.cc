@@ -1,6 +1,8 @@
 #include "board.h"
 
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <utility>
@@ -11,6 +13,10 @@
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
+#include "attacks.h"
+#include "debug_check.h"
+#include "eval.h"
+#include "zobrist.h"
 
 namespace {
 const std::string& get_start_fen() {
@@ -19,77 +25,1099 @@ const std::string& get_start_fen() {
   return start_fen;
 }
 
-// TODO: Change these all to functions returning their static local varaibles to
-// avoid problems with global initialization.
-
-const Bitboard seventh_rank_mask = str_to_square("a7") | str_to_square("b7") |
-                                   str_to_square("c7") | str_to_square("d7") |
-                                   str_to_square("e7") | str_to_square("f7") |
-                                   str_to_square("g7") | str_to_square("h7");
-const Bitboard second_rank_mask = str_to_square("a2") | str_to_square("b2") |
-                                  str_to_square("c2") | str_to_square("d2") |
-                                  str_to_square("e2") | str_to_square("f2") |
-                                  str_to_square("g2") | str_to_square("h2");
-const Bitboard third_rank_mask = str_to_square("a3") | str_to_square("b3") |
-                                 str_to_square("c3") | str_to_square("d3") |
-                                 str_to_square("e3") | str_to_square("f3") |
-                                 str_to_square("g3") | str_to_square("h3");
-const Bitboard white_castle_kingside_mask =
-    str_to_square("f1") | str_to_square("g1");
-const Bitboard white_castle_queenside_mask =
-    str_to_square("d1") | str_to_square("c1");
-const Bitboard black_castle_kingside_mask =
-    str_to_square("f8") | str_to_square("g8");
-const Bitboard black_castle_queenside_mask =
-    str_to_square("d8") | str_to_square("c8");
+// Parsed once, so that a default constructed board is a copy.
+const Board& start_board() {
+  static const Board board(get_start_fen());
+  return board;
+}
+
+// Returns the field of `fen` at `*pos`, or an empty field at the end, and
+// moves `*pos` past it. Fields are separated by any number of spaces or tabs.
+absl::string_view next_fen_field(absl::string_view fen, size_t* pos) {
+  while (*pos < fen.size() && (fen[*pos] == ' ' || fen[*pos] == '\t')) {
+    ++*pos;
+  }
+  const size_t begin = *pos;
+  while (*pos < fen.size() && fen[*pos] != ' ' && fen[*pos] != '\t') {
+    ++*pos;
+  }
+  return fen.substr(begin, *pos - begin);
+}
+
+struct FenPiece {
+  Color color_;
+  Piece piece_;
+};
+
+// The piece of each character of the placement field, Piece::none for the
+// characters that aren't pieces.
+constexpr std::array<FenPiece, 256> fen_pieces = [] {
+  std::array<FenPiece, 256> res = {};
+  for (FenPiece& piece : res) {
+    piece = {Color::white, Piece::none};
+  }
+  res['P'] = {Color::white, Piece::pawn};
+  res['R'] = {Color::white, Piece::rook};
+  res['N'] = {Color::white, Piece::knight};
+  res['B'] = {Color::white, Piece::bishop};
+  res['Q'] = {Color::white, Piece::queen};
+  res['K'] = {Color::white, Piece::king};
+  res['p'] = {Color::black, Piece::pawn};
+  res['r'] = {Color::black, Piece::rook};
+  res['n'] = {Color::black, Piece::knight};
+  res['b'] = {Color::black, Piece::bishop};
+  res['q'] = {Color::black, Piece::queen};
+  res['k'] = {Color::black, Piece::king};
+  return res;
+}();
+
+// The squares on the back ranks that castling and castling rights refer to.
+constexpr Bitboard a1_square = str_to_square("a1");
+constexpr Bitboard b1_square = str_to_square("b1");
+constexpr Bitboard c1_square = str_to_square("c1");
+constexpr Bitboard d1_square = str_to_square("d1");
+constexpr Bitboard e1_square = str_to_square("e1");
+constexpr Bitboard f1_square = str_to_square("f1");
+constexpr Bitboard g1_square = str_to_square("g1");
+constexpr Bitboard h1_square = str_to_square("h1");
+constexpr Bitboard a8_square = str_to_square("a8");
+constexpr Bitboard b8_square = str_to_square("b8");
+constexpr Bitboard c8_square = str_to_square("c8");
+constexpr Bitboard d8_square = str_to_square("d8");
+constexpr Bitboard e8_square = str_to_square("e8");
+constexpr Bitboard f8_square = str_to_square("f8");
+constexpr Bitboard g8_square = str_to_square("g8");
+constexpr Bitboard h8_square = str_to_square("h8");
+
+// Indexed by color, then kingside before queenside.
+constexpr std::array<std::array<CastlingPath, 2>, num_colors> castling_paths =
+    {{{{{white_kingside_castling, f1_square | g1_square,
+         e1_square | f1_square | g1_square,
+         Move(e1_square, g1_square, Piece::king, MoveType::castle_kingside),
+         Move(h1_square, f1_square, Piece::rook, MoveType::simple), g1_square},
+        {white_queenside_castling, b1_square | c1_square | d1_square,
+         e1_square | d1_square | c1_square,
+         Move(e1_square, c1_square, Piece::king, MoveType::castle_queenside),
+         Move(a1_square, d1_square, Piece::rook, MoveType::simple),
+         c1_square}}},
+      {{{black_kingside_castling, f8_square | g8_square,
+         e8_square | f8_square | g8_square,
+         Move(e8_square, g8_square, Piece::king, MoveType::castle_kingside),
+         Move(h8_square, f8_square, Piece::rook, MoveType::simple), g8_square},
+        {black_queenside_castling, b8_square | c8_square | d8_square,
+         e8_square | d8_square | c8_square,
+         Move(e8_square, c8_square, Piece::king, MoveType::castle_queenside),
+         Move(a8_square, d8_square, Piece::rook, MoveType::simple),
+         c8_square}}}}};
+
+// Returns the standard chess path of the castling move of `side` with
+// `move_type`, which must be castle_kingside or castle_queenside.
+const CastlingPath& standard_castling_path(Color side, MoveType move_type) {
+  return castling_paths[static_cast<size_t>(side)]
+                       [move_type == MoveType::castle_kingside ? 0 : 1];
+}
+
+// The squares of `rank` from `file` to `other_file`, both included.
+constexpr Bitboard rank_span(int rank, int file, int other_file) {
+  Bitboard res = 0;
+  for (int f = std::min(file, other_file); f <= std::max(file, other_file);
+       ++f) {
+    res |= coordinates_to_square(f, rank);
+  }
+  return res;
+}
+
+// The Chess960 paths, indexed by color, kingside before queenside, then by
+// the files of the king and the rook. The king and the rook land where they
+// do in standard chess, and the squares they cross, the two ends included,
+// must be empty but for themselves. A rook on the king's file or on the other
+// side of it has no path.
+using Chess960CastlingPaths = std::array<
+    std::array<std::array<std::array<CastlingPath, board_size>, board_size>,
+               2>,
+    num_colors>;
+
+constexpr Chess960CastlingPaths make_chess960_castling_paths() {
+  Chess960CastlingPaths res = {};
+  for (int color = 0; color < static_cast<int>(num_colors); ++color) {
+    const int rank = color == 0 ? 0 : board_size - 1;
+    for (int wing = 0; wing < 2; ++wing) {
+      const bool is_kingside = wing == 0;
+      const int king_dst_file = is_kingside ? 6 : 2;
+      const int rook_dst_file = is_kingside ? 5 : 3;
+      for (int king_file = 0; king_file < board_size; ++king_file) {
+        for (int rook_file = 0; rook_file < board_size; ++rook_file) {
+          if (is_kingside ? rook_file <= king_file : rook_file >= king_file) {
+            continue;
+          }
+          const Bitboard king = coordinates_to_square(king_file, rank);
+          const Bitboard rook = coordinates_to_square(rook_file, rank);
+          CastlingPath& path =
+              res[static_cast<size_t>(color)][static_cast<size_t>(wing)]
+                 [static_cast<size_t>(king_file)]
+                 [static_cast<size_t>(rook_file)];
+          path.right_ = static_cast<CastlingRights>(1 << (color * 2 + wing));
+          path.king_path_ = rank_span(rank, king_file, king_dst_file);
+          path.empty_squares_ = (path.king_path_ |
+                                 rank_span(rank, rook_file, rook_dst_file)) &
+                                ~(king | rook);
+          path.king_move_ = Move(king, rook, Piece::king,
+                                 is_kingside ? MoveType::castle_kingside
+                                             : MoveType::castle_queenside);
+          path.rook_move_ =
+              Move(rook, coordinates_to_square(rook_dst_file, rank),
+                   Piece::rook, MoveType::simple);
+          path.king_dst_ = coordinates_to_square(king_dst_file, rank);
+        }
+      }
+    }
+  }
+  return res;
+}
+
+constexpr Chess960CastlingPaths chess960_castling_paths =
+    make_chess960_castling_paths();
+
+// Returns the path of `move`, a castling move of `side`, which is all the
+// move tells when the king has left its square: in Chess960 it goes from the
+// king's file onto the rook's.
+const CastlingPath& castling_path_of(Color side, Move move, bool is_chess960) {
+  const size_t wing = move.move_type_ == MoveType::castle_kingside ? 0 : 1;
+  if (!is_chess960) {
+    return castling_paths[static_cast<size_t>(side)][wing];
+  }
+  return chess960_castling_paths[static_cast<size_t>(side)][wing]
+                                [static_cast<size_t>(7 - move.src_idx_ % 8)]
+                                [static_cast<size_t>(7 - move.dst_idx_ % 8)];
+}
+
+// The rook files of the castling rights in standard chess.
+constexpr std::array<uint8_t, 4> standard_castling_rook_files = {{7, 0, 7, 0}};
+
+// For each square, the castling rights that survive a move from or to it.
+// Moving the king or a rook off its starting square, or capturing a rook on
+// it, loses the rights that need it there.
+constexpr std::array<uint8_t, 64> make_castling_rights_kept() {
+  std::array<uint8_t, 64> res = {};
+  for (uint8_t& rights : res) {
+    rights = all_castling;
+  }
+  const auto clear = [&res](Bitboard sq, uint8_t rights) {
+    res[static_cast<size_t>(square_idx(sq))] &=
+        static_cast<uint8_t>(~rights);
+  };
+  clear(e1_square, white_kingside_castling | white_queenside_castling);
+  clear(h1_square, white_kingside_castling);
+  clear(a1_square, white_queenside_castling);
+  clear(e8_square, black_kingside_castling | black_queenside_castling);
+  clear(h8_square, black_kingside_castling);
+  clear(a8_square, black_queenside_castling);
+  return res;
+}
+
+constexpr std::array<uint8_t, 64> castling_rights_kept =
+    make_castling_rights_kept();
+
+// The castling rights of `board` that survive `move` in Chess960, where the
+// squares that lose them depend on where the rooks started.
+uint8_t chess960_castling_rights_kept(const Board& board, Move move) {
+  uint8_t res = board.castling_rights_;
+  for (size_t i = 0; i < board.castling_rook_files_.size(); ++i) {
+    const Bitboard rook = coordinates_to_square(
+        board.castling_rook_files_[i], i < 2 ? 0 : board_size - 1);
+    if ((move.src_square() | move.dst_square()) & rook) {
+      res &= static_cast<uint8_t>(~(1 << i));
+    }
+  }
+  if (move.piece_moving_ == Piece::king) {
+    res &= board.is_whites_move_
+               ? black_kingside_castling | black_queenside_castling
+               : white_kingside_castling | white_queenside_castling;
+  }
+  return res;
+}
+
+// Returns true if the rook castling along `path` of `side` is all that
+// stands between the square the king lands on and an enemy rook or queen on
+// the back rank, which only happens in Chess960.
+bool is_castling_rook_shielding(const Board& board, const CastlingPath& path,
+                                Color side) {
+  const Color enemy = flip_color(side);
+  return (rook_attacks(square_idx(path.king_dst_),
+                       board.all_pieces() ^ path.rook_move_.src_square()) &
+          (board.pieces(enemy, Piece::rook) |
+           board.pieces(enemy, Piece::queen))) != 0;
+}
+
+// Shifts every square of `bb` by `shift` bits, left for positive `shift` and
+// right for negative. With h1 as bit 0, north is +8 and east is -1. The shift
+// is a template parameter so that the direction is picked at compile time.
+template <int shift>
+constexpr Bitboard shift_by(Bitboard bb) {
+  return shift > 0 ? bb << shift : bb >> -shift;
+}
+
+// The shifts that take a pawn of color `side` one square forward and one
+// square diagonally forward, and the ranks its moves depend on. After an east
+// shift the a file has to be masked off, since it can only be reached by
+// wrapping around the board, and the same for the h file after a west shift.
+template <Color side>
+struct PawnTraits;
+
+template <>
+struct PawnTraits<Color::white> {
+  static constexpr int push = 8;
+  static constexpr int east_capture = 7;
+  static constexpr int west_capture = 9;
+  static constexpr Bitboard two_step_rank = second_rank_mask;
+  static constexpr Bitboard promotion_rank = eighth_rank_mask;
+};
+
+template <>
+struct PawnTraits<Color::black> {
+  static constexpr int push = -8;
+  static constexpr int east_capture = -9;
+  static constexpr int west_capture = -7;
+  static constexpr Bitboard two_step_rank = seventh_rank_mask;
+  static constexpr Bitboard promotion_rank = first_rank_mask;
+};
+
+// Appends a move to every square of `dst_squares` from the square `shift`
+// bits behind it.
+template <int shift, typename Sink>
+void append_pawn_moves_by_shift(Bitboard dst_squares, MoveType move_type,
+                                Sink* res_ptr) {
+  for (Bitboard dst_square : bitboard_split(dst_squares)) {
+    res_ptr->emplace_back(shift_by<-shift>(dst_square), dst_square,
+                          Piece::pawn, move_type);
+  }
+}
+
+// Appends the four promotions to every square of `dst_squares`.
+template <int shift, typename Sink>
+void append_promotions_by_shift(Bitboard dst_squares, Sink* res_ptr) {
+  for (Bitboard dst_square : bitboard_split(dst_squares)) {
+    const Bitboard src_square = shift_by<-shift>(dst_square);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_rook);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_knight);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_bishop);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_queen);
+  }
+}
+
+// Appends the promotion to a queen to every square of `dst_squares`.
+template <int shift, typename Sink>
+void append_queen_promotions_by_shift(Bitboard dst_squares, Sink* res_ptr) {
+  append_pawn_moves_by_shift<shift>(dst_squares, MoveType::promotion_to_queen,
+                                    res_ptr);
+}
+
+// Appends the promotions to a rook, knight and bishop to every square of
+// `dst_squares`.
+template <int shift, typename Sink>
+void append_underpromotions_by_shift(Bitboard dst_squares, Sink* res_ptr) {
+  for (Bitboard dst_square : bitboard_split(dst_squares)) {
+    const Bitboard src_square = shift_by<-shift>(dst_square);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_rook);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_knight);
+    res_ptr->emplace_back(src_square, dst_square, Piece::pawn,
+                          MoveType::promotion_to_bishop);
+  }
+}
+
+// The pawn generators work on all pawns of `side` at once: shifting the pawn
+// bitboard gives every destination square, and each source square is
+// recovered by shifting back. They are instantiated once per color, so the
+// shifts and masks are constants, and the Board methods of the same names
+// pick the instantiation.
+
+template <Color side>
+Bitboard pawn_attacks_of(Bitboard pawns) {
+  using Traits = PawnTraits<side>;
+  return (shift_by<Traits::east_capture>(pawns) & ~a_file_mask) |
+         (shift_by<Traits::west_capture>(pawns) & ~h_file_mask);
+}
+
+// The squares two of `pawns` attack, one from each side.
+template <Color side>
+Bitboard pawn_double_attacks_of(Bitboard pawns) {
+  using Traits = PawnTraits<side>;
+  return shift_by<Traits::east_capture>(pawns) & ~a_file_mask &
+         shift_by<Traits::west_capture>(pawns) & ~h_file_mask;
+}
+
+template <Color side, typename Sink>
+void append_simple_pawn_moves(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard dst_squares =
+      shift_by<Traits::push>(board.pieces(side, Piece::pawn)) &
+      ~board.all_pieces() & ~Traits::promotion_rank;
+  append_pawn_moves_by_shift<Traits::push>(dst_squares, MoveType::simple,
+                                           res_ptr);
+}
+
+template <Color side, typename Sink>
+void append_two_step_pawn_moves(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard empty = ~board.all_pieces();
+  const Bitboard pawns =
+      board.pieces(side, Piece::pawn) & Traits::two_step_rank;
+  const Bitboard one_step = shift_by<Traits::push>(pawns) & empty;
+  const Bitboard dst_squares = shift_by<Traits::push>(one_step) & empty;
+  append_pawn_moves_by_shift<2 * Traits::push>(
+      dst_squares, MoveType::two_step_pawn, res_ptr);
+}
+
+template <Color side, typename Sink>
+void append_en_passant_moves(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard ep_square = board.en_passant_square_;
+  if (!ep_square) {
+    return;
+  }
+  const Bitboard pawns = board.pieces(side, Piece::pawn);
+  // The pawn west of the e.p. square captures east and the other way around.
+  const Bitboard west_pawn =
+      shift_by<-Traits::east_capture>(ep_square) & ~h_file_mask & pawns;
+  const Bitboard east_pawn =
+      shift_by<-Traits::west_capture>(ep_square) & ~a_file_mask & pawns;
+  if (west_pawn) {
+    res_ptr->emplace_back(west_pawn, ep_square, Piece::pawn,
+                          MoveType::en_passant);
+  }
+  if (east_pawn) {
+    res_ptr->emplace_back(east_pawn, ep_square, Piece::pawn,
+                          MoveType::en_passant);
+  }
+}
+
+template <Color side, typename Sink>
+void append_promotions(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard pawns = board.pieces(side, Piece::pawn);
+  const Bitboard targets = board.enemies(side) & Traits::promotion_rank;
+  append_promotions_by_shift<Traits::push>(
+      shift_by<Traits::push>(pawns) & ~board.all_pieces() &
+          Traits::promotion_rank,
+      res_ptr);
+  append_promotions_by_shift<Traits::east_capture>(
+      shift_by<Traits::east_capture>(pawns) & ~a_file_mask & targets, res_ptr);
+  append_promotions_by_shift<Traits::west_capture>(
+      shift_by<Traits::west_capture>(pawns) & ~h_file_mask & targets, res_ptr);
+}
+
+template <Color side, typename Sink>
+void append_pawn_captures(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard pawns = board.pieces(side, Piece::pawn);
+  const Bitboard targets = board.enemies(side) & ~Traits::promotion_rank;
+  append_pawn_moves_by_shift<Traits::east_capture>(
+      shift_by<Traits::east_capture>(pawns) & ~a_file_mask & targets,
+      MoveType::capture, res_ptr);
+  append_pawn_moves_by_shift<Traits::west_capture>(
+      shift_by<Traits::west_capture>(pawns) & ~h_file_mask & targets,
+      MoveType::capture, res_ptr);
+}
+
+template <Color side, typename Sink>
+void append_pawn_moves(const Board& board, Sink* res_ptr) {
+  append_simple_pawn_moves<side>(board, res_ptr);
+  append_two_step_pawn_moves<side>(board, res_ptr);
+  append_pawn_captures<side>(board, res_ptr);
+  append_en_passant_moves<side>(board, res_ptr);
+  append_promotions<side>(board, res_ptr);
+}
+
+// Returns true if `move` of the pawn on its source square is one of those
+// `append_pawn_moves` generates, from the masks the generators use rather
+// than by generating the moves.
+template <Color side>
+bool is_pawn_move_pseudolegal(const Board& board, Move move) {
+  using Traits = PawnTraits<side>;
+  const Bitboard src_square = move.src_square();
+  const Bitboard dst_square = move.dst_square();
+  const Bitboard empty = ~board.all_pieces();
+  const Bitboard push = shift_by<Traits::push>(src_square) & empty;
+  const Bitboard attacks = pawn_attacks_of<side>(src_square);
+  switch (move.move_type_) {
+    case MoveType::simple:
+      return dst_square & push & ~Traits::promotion_rank;
+    case MoveType::two_step_pawn:
+      return (src_square & Traits::two_step_rank) &&
+             (dst_square & shift_by<Traits::push>(push) & empty);
+    case MoveType::capture:
+      return dst_square & attacks & board.enemies(side) &
+             ~Traits::promotion_rank;
+    case MoveType::en_passant:
+      return dst_square & attacks & board.en_passant_square_;
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+    case MoveType::promotion_to_queen:
+      return dst_square & Traits::promotion_rank &
+             (push | (attacks & board.enemies(side)));
+    default:
+      return false;
+  }
+}
 
+// Appends a move from `src_square` to each of `dst_squares`, flagging the ones
+// that land on `enemies_mask` as captures.
+template <typename Sink>
+void append_moves_to(Bitboard src_square, Bitboard dst_squares,
+                     Bitboard enemies_mask, Piece piece_moving,
+                     Sink* res_ptr) {
+  for (Bitboard dst_square : bitboard_split(dst_squares)) {
+    const MoveType move_type =
+        dst_square & enemies_mask ? MoveType::capture : MoveType::simple;
+    res_ptr->emplace_back(src_square, dst_square, piece_moving, move_type);
+  }
+}
+
+// The pawn moves of `append_pseudolegal_captures`: captures, e.p. captures,
+// promotions with a capture and promotions to a queen.
+template <Color side, typename Sink>
+void append_pawn_capture_moves(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard pawns = board.pieces(side, Piece::pawn);
+  const Bitboard targets = board.enemies(side) & Traits::promotion_rank;
+  append_pawn_captures<side>(board, res_ptr);
+  append_en_passant_moves<side>(board, res_ptr);
+  append_promotions_by_shift<Traits::east_capture>(
+      shift_by<Traits::east_capture>(pawns) & ~a_file_mask & targets, res_ptr);
+  append_promotions_by_shift<Traits::west_capture>(
+      shift_by<Traits::west_capture>(pawns) & ~h_file_mask & targets, res_ptr);
+  append_queen_promotions_by_shift<Traits::push>(
+      shift_by<Traits::push>(pawns) & ~board.all_pieces() &
+          Traits::promotion_rank,
+      res_ptr);
+}
+
+// The pawn moves of `append_pseudolegal_quiet_moves`: pushes and
+// underpromotions without a capture.
+template <Color side, typename Sink>
+void append_pawn_quiet_moves(const Board& board, Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  append_simple_pawn_moves<side>(board, res_ptr);
+  append_two_step_pawn_moves<side>(board, res_ptr);
+  append_underpromotions_by_shift<Traits::push>(
+      shift_by<Traits::push>(board.pieces(side, Piece::pawn)) &
+          ~board.all_pieces() & Traits::promotion_rank,
+      res_ptr);
+}
+
+// Returns the squares a knight, bishop, rook, queen or king on `sq_idx`
+// attacks.
+Bitboard piece_attacks(Piece piece, int sq_idx, Bitboard occupancy) {
+  switch (piece) {
+    case Piece::knight:
+      return knight_attacks[static_cast<size_t>(sq_idx)];
+    case Piece::bishop:
+      return bishop_attacks(sq_idx, occupancy);
+    case Piece::rook:
+      return rook_attacks(sq_idx, occupancy);
+    case Piece::queen:
+      return queen_attacks(sq_idx, occupancy);
+    case Piece::king:
+      return king_attacks[static_cast<size_t>(sq_idx)];
+    case Piece::pawn:
+    case Piece::none:
+      break;
+  }
+  DEBUG_CHECK(false, "Pawns have no piece attacks.");
+  return 0;
+}
+
+// The pieces whose moves `piece_attacks` gives.
+constexpr std::array<Piece, 5> non_pawn_pieces = {
+    Piece::knight, Piece::bishop, Piece::rook, Piece::queen, Piece::king};
+
+// Appends the moves of the knights, bishops, rooks, queens and king of `side`
+// that land on `targets`, which must not contain pieces of `side`.
+template <typename Sink>
+void append_non_pawn_moves(const Board& board, Color side, Bitboard targets,
+                           Sink* res_ptr) {
+  const Bitboard occupancy = board.all_pieces();
+  const Bitboard enemies_mask = board.enemies(side);
+  for (Piece piece : non_pawn_pieces) {
+    for (Bitboard src_square : bitboard_split(board.pieces(side, piece))) {
+      append_moves_to(src_square,
+                      piece_attacks(piece, square_idx(src_square), occupancy) &
+                          targets,
+                      enemies_mask, piece, res_ptr);
+    }
+  }
+}
+
+// Returns true if the e.p. capture `move` by `side` doesn't leave its king
+// attacked. Both pawns leave their squares, so a slider can be uncovered along
+// the rank as well as along the capturing pawn's lines.
+bool is_en_passant_legal(const Board& board, Color side, Move move) {
+  const Bitboard captured = side == Color::white
+                                ? shift_by<-8>(move.dst_square())
+                                : shift_by<8>(move.dst_square());
+  const Bitboard occupancy =
+      board.all_pieces() ^ move.src_square() ^ move.dst_square() ^ captured;
+  return !(board.attackers_to(board.pieces(side, Piece::king), occupancy) &
+           board.enemies(side) & ~captured);
+}
+
+// Appends the pawn moves of `side` from `pawns` that land on `targets`, e.p.
+// captures left out.
+template <Color side, typename Sink>
+void append_pawn_moves_to(const Board& board, Bitboard pawns, Bitboard targets,
+                          Sink* res_ptr) {
+  using Traits = PawnTraits<side>;
+  const Bitboard empty = ~board.all_pieces();
+  const Bitboard one_step = shift_by<Traits::push>(pawns) & empty;
+  const Bitboard two_step =
+      shift_by<Traits::push>(one_step &
+                             shift_by<Traits::push>(Traits::two_step_rank)) &
+      empty;
+  const Bitboard captures = board.enemies(side) & targets;
+  const Bitboard east = shift_by<Traits::east_capture>(pawns) & ~a_file_mask;
+  const Bitboard west = shift_by<Traits::west_capture>(pawns) & ~h_file_mask;
+  const Bitboard no_promotion = ~Traits::promotion_rank;
+  append_pawn_moves_by_shift<Traits::push>(one_step & targets & no_promotion,
+                                           MoveType::simple, res_ptr);
+  append_pawn_moves_by_shift<2 * Traits::push>(
+      two_step & targets, MoveType::two_step_pawn, res_ptr);
+  append_pawn_moves_by_shift<Traits::east_capture>(
+      east & captures & no_promotion, MoveType::capture, res_ptr);
+  append_pawn_moves_by_shift<Traits::west_capture>(
+      west & captures & no_promotion, MoveType::capture, res_ptr);
+  append_promotions_by_shift<Traits::push>(
+      one_step & targets & Traits::promotion_rank, res_ptr);
+  append_promotions_by_shift<Traits::east_capture>(
+      east & captures & Traits::promotion_rank, res_ptr);
+  append_promotions_by_shift<Traits::west_capture>(
+      west & captures & Traits::promotion_rank, res_ptr);
+}
+
+// Appends the moves of the king of `side` to squares no enemy piece attacks,
+// taking the attacked squares from `maps`.
+template <typename Sink>
+void append_legal_king_moves(const Board& board, Color side, AttackMaps* maps,
+                             Sink* res_ptr) {
+  const Bitboard king = board.pieces(side, Piece::king);
+  const size_t king_idx = static_cast<size_t>(square_idx(king));
+  append_moves_to(king,
+                  king_attacks[king_idx] & ~board.friends(side) &
+                      ~maps->king_danger(side),
+                  board.enemies(side), Piece::king, res_ptr);
+}
+
+// Appends the legal moves of `side`, whose king is attacked by `checkers`.
+// Only the king can get out of a double check. Otherwise the other pieces
+// have to capture the checker or step between it and the king, which a pinned
+// piece never can, since it has to stay on the line through the king.
+template <typename Sink>
+void append_evasions(const Board& board, Color side, Bitboard checkers,
+                     AttackMaps* maps, Sink* res_ptr) {
+  append_legal_king_moves(board, side, maps, res_ptr);
+  if (!is_square(checkers)) {
+    return;
+  }
+  const int king_idx = square_idx(board.pieces(side, Piece::king));
+  const Bitboard targets =
+      checkers | between_squares(king_idx, square_idx(checkers));
+  const Bitboard unpinned = ~board.pinned_pieces(side);
+  const Bitboard occupancy = board.all_pieces();
+  const Bitboard enemies_mask = board.enemies(side);
+  for (Piece piece :
+       {Piece::knight, Piece::bishop, Piece::rook, Piece::queen}) {
+    for (Bitboard src_square :
+         bitboard_split(board.pieces(side, piece) & unpinned)) {
+      append_moves_to(src_square,
+                      piece_attacks(piece, square_idx(src_square), occupancy) &
+                          targets,
+                      enemies_mask, piece, res_ptr);
+    }
+  }
+  const Bitboard pawns = board.pieces(side, Piece::pawn) & unpinned;
+  MoveList en_passant_moves;
+  if (side == Color::white) {
+    append_pawn_moves_to<Color::white>(board, pawns, targets, res_ptr);
+    append_en_passant_moves<Color::white>(board, &en_passant_moves);
+  } else {
+    append_pawn_moves_to<Color::black>(board, pawns, targets, res_ptr);
+    append_en_passant_moves<Color::black>(board, &en_passant_moves);
+  }
+  // Whether an e.p. capture gets out of check depends on both the captured
+  // and the capturing pawn, so it is checked on its own.
+  for (Move move : en_passant_moves) {
+    if (is_en_passant_legal(board, side, move)) {
+      res_ptr->push_back(move);
+    }
+  }
+}
+
+// Passes the pawn moves it is given on to `sink` if they are legal, for a
+// side that isn't in check: e.p. captures if `is_en_passant_legal` says so,
+// and the other moves if they land on `targets` and, for a pinned pawn, stay
+// on the line through its king.
+template <typename Sink>
+class LegalPawnMoveFilter {
+ public:
+  LegalPawnMoveFilter(const Board& board, Color side, Bitboard targets,
+                      Bitboard pinned, Sink* sink)
+      : board_(board),
+        side_(side),
+        targets_(targets),
+        pinned_(pinned),
+        king_idx_(square_idx(board.pieces(side, Piece::king))),
+        sink_(sink) {}
+
+  void emplace_back(Bitboard src_square, Bitboard dst_square, Piece piece,
+                    MoveType move_type) {
+    if (move_type == MoveType::en_passant) {
+      if (is_en_passant_legal(board_, side_,
+                              Move(src_square, dst_square, piece, move_type))) {
+        sink_->emplace_back(src_square, dst_square, piece, move_type);
+      }
+    } else if (dst_square & targets_ &
+               (src_square & pinned_
+                    ? line_through(king_idx_, square_idx(src_square))
+                    : ~Bitboard{0})) {
+      sink_->emplace_back(src_square, dst_square, piece, move_type);
+    }
+  }
+
+ private:
+  const Board& board_;
+  const Color side_;
+  const Bitboard targets_;
+  const Bitboard pinned_;
+  const int king_idx_;
+  Sink* const sink_;
+};
+
+// Adds the squares of `targets` the pawns of `side` in `pawns` can move to,
+// e.p. captures left out, to the entries of their squares in `res`. The
+// moves are made set-wise, one shift for all the pawns, and shifted back to
+// find where they come from.
+template <Color side>
+void add_pawn_targets(const Board& board, Bitboard pawns, Bitboard targets,
+                      std::array<Bitboard, 64>* res_ptr) {
+  using Traits = PawnTraits<side>;
+  std::array<Bitboard, 64>& res = *res_ptr;
+  const Bitboard empty = ~board.all_pieces();
+  const Bitboard one_step = shift_by<Traits::push>(pawns) & empty;
+  const Bitboard two_step =
+      shift_by<Traits::push>(one_step &
+                             shift_by<Traits::push>(Traits::two_step_rank)) &
+      empty;
+  const Bitboard captures = board.enemies(side) & targets;
+  for (Bitboard dst : bitboard_split(one_step & targets)) {
+    res[static_cast<size_t>(square_idx(dst) - Traits::push)] |= dst;
+  }
+  for (Bitboard dst : bitboard_split(two_step & targets)) {
+    res[static_cast<size_t>(square_idx(dst) - 2 * Traits::push)] |= dst;
+  }
+  for (Bitboard dst : bitboard_split(shift_by<Traits::east_capture>(pawns) &
+                                     ~a_file_mask & captures)) {
+    res[static_cast<size_t>(square_idx(dst) - Traits::east_capture)] |= dst;
+  }
+  for (Bitboard dst : bitboard_split(shift_by<Traits::west_capture>(pawns) &
+                                     ~h_file_mask & captures)) {
+    res[static_cast<size_t>(square_idx(dst) - Traits::west_capture)] |= dst;
+  }
+}
+
+// Returns the squares of `targets` the pawns of `side` in `pawns` can move
+// to, e.p. captures left out.
+template <Color side>
+Bitboard pawn_targets(const Board& board, Bitboard pawns, Bitboard targets) {
+  using Traits = PawnTraits<side>;
+  const Bitboard empty = ~board.all_pieces();
+  const Bitboard one_step = shift_by<Traits::push>(pawns) & empty;
+  const Bitboard two_step =
+      shift_by<Traits::push>(one_step &
+                             shift_by<Traits::push>(Traits::two_step_rank)) &
+      empty;
+  const Bitboard captures =
+      (shift_by<Traits::east_capture>(pawns) & ~a_file_mask) |
+      (shift_by<Traits::west_capture>(pawns) & ~h_file_mask);
+  return ((one_step | two_step) | (captures & board.enemies(side))) & targets;
+}
+
+// Sets the entries of `res` of the pieces of the side to move in `sources`,
+// which must be 0, to the squares they can legally move to.
+void add_legal_targets(const Board& board, Bitboard sources,
+                       std::array<Bitboard, 64>* res_ptr) {
+  std::array<Bitboard, 64>& res = *res_ptr;
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  const Bitboard king = board.pieces(side, Piece::king);
+  const int king_idx = square_idx(king);
+  const Bitboard occupancy = board.all_pieces();
+  const Bitboard checkers =
+      board.attackers_to(king, occupancy) & board.enemies(side);
+  AttackMaps maps(board);
+  if (sources & king) {
+    res[static_cast<size_t>(king_idx)] =
+        king_attacks[static_cast<size_t>(king_idx)] & ~board.friends(side) &
+        ~maps.king_danger(side);
+    if (!checkers) {
+      for (MoveType wing :
+           {MoveType::castle_kingside, MoveType::castle_queenside}) {
+        const bool is_legal = wing == MoveType::castle_kingside
+                                  ? board.is_castle_kingside_legal(&maps)
+                                  : board.is_castle_queenside_legal(&maps);
+        if (is_legal) {
+          res[static_cast<size_t>(king_idx)] |=
+              board.castling_path(side, wing).king_move_.dst_square();
+        }
+      }
+    }
+  }
+  // Only the king can get out of a double check.
+  if (checkers && !is_square(checkers)) {
+    return;
+  }
+  const Bitboard targets =
+      ~board.friends(side) &
+      (checkers ? checkers | between_squares(king_idx, square_idx(checkers))
+                : ~Bitboard{0});
+  const Bitboard pinned = board.pinned_pieces(side);
+  for (Piece piece :
+       {Piece::knight, Piece::bishop, Piece::rook, Piece::queen}) {
+    for (Bitboard sq : bitboard_split(board.pieces(side, piece) & sources)) {
+      const int sq_idx = square_idx(sq);
+      res[static_cast<size_t>(sq_idx)] =
+          piece_attacks(piece, sq_idx, occupancy) & targets &
+          (sq & pinned ? line_through(king_idx, sq_idx) : ~Bitboard{0});
+    }
+  }
+  // A pinned pawn moves set-wise with the others and is cut back to its line
+  // afterwards.
+  const Bitboard pawns = board.pieces(side, Piece::pawn) & sources;
+  MoveList en_passant_moves;
+  if (side == Color::white) {
+    add_pawn_targets<Color::white>(board, pawns, targets, &res);
+    append_en_passant_moves<Color::white>(board, &en_passant_moves);
+  } else {
+    add_pawn_targets<Color::black>(board, pawns, targets, &res);
+    append_en_passant_moves<Color::black>(board, &en_passant_moves);
+  }
+  for (Bitboard sq : bitboard_split(pawns & pinned)) {
+    res[static_cast<size_t>(square_idx(sq))] &=
+        line_through(king_idx, square_idx(sq));
+  }
+  for (Move move : en_passant_moves) {
+    if ((move.src_square() & sources) &&
+        is_en_passant_legal(board, side, move)) {
+      res[move.src_idx_] |= move.dst_square();
+    }
+  }
+}
+
+// Returns the least valuable of `attackers`, which are pieces of `side`, and
+// sets `*piece` to its type. `attackers` must not be 0.
+Bitboard least_valuable_attacker(const Board& board, Color side,
+                                 Bitboard attackers, Piece* piece) {
+  for (Piece candidate : {Piece::pawn, Piece::knight, Piece::bishop,
+                          Piece::rook, Piece::queen, Piece::king}) {
+    const Bitboard candidates = attackers & board.pieces(side, candidate);
+    if (candidates) {
+      *piece = candidate;
+      return lsb_square(candidates);
+    }
+  }
+  DEBUG_CHECK(false, "There must be an attacker.");
+  *piece = Piece::none;
+  return 0;
+}
+
+// Returns the sliders of both colors that attack the square with index
+// `sq_idx` through the square a `moved` piece just left. Only lines the moved
+// piece attacked along can open up, so a knight or king uncovers nothing.
+Bitboard xray_attackers(const Board& board, Piece moved, int sq_idx,
+                        Bitboard occupancy) {
+  const Bitboard queens = board.pieces(Piece::queen);
+  Bitboard res = 0;
+  if (moved == Piece::pawn || moved == Piece::bishop ||
+      moved == Piece::queen) {
+    res |= bishop_attacks(sq_idx, occupancy) &
+           (board.pieces(Piece::bishop) | queens);
+  }
+  if (moved == Piece::rook || moved == Piece::queen) {
+    res |= rook_attacks(sq_idx, occupancy) &
+           (board.pieces(Piece::rook) | queens);
+  }
+  return res & occupancy;
+}
+
+// The start of an exchange: what the first capture wins, the value of the
+// piece it leaves on the square and the occupancy after it.
+struct ExchangeStart {
+  int captured_value_;
+  int on_square_value_;
+  Bitboard occupancy_;
+};
+
+ExchangeStart exchange_start(const Board& board, Move move) {
+  ExchangeStart start = {0, see_value(move.piece_moving_),
+                         board.all_pieces() ^ move.src_square()};
+  if (move.move_type_ == MoveType::en_passant) {
+    start.captured_value_ = see_value(Piece::pawn);
+    start.occupancy_ ^= board.is_whites_move_
+                            ? shift_by<-8>(move.dst_square())
+                            : shift_by<8>(move.dst_square());
+    return start;
+  }
+  const Piece victim = board.mailbox_[move.dst_idx_];
+  if (victim != Piece::none) {
+    start.captured_value_ = see_value(victim);
+  }
+  const MoveType move_type = move.move_type_;
+  if (move_type == MoveType::promotion_to_rook ||
+      move_type == MoveType::promotion_to_bishop ||
+      move_type == MoveType::promotion_to_knight ||
+      move_type == MoveType::promotion_to_queen) {
+    start.on_square_value_ = see_value(promotion_piece(move_type));
+    start.captured_value_ += start.on_square_value_ - see_value(Piece::pawn);
+  }
+  return start;
+}
+
+// Returns the pieces of `side` that are the only piece between `king` and a
+// slider of color `slider_side` on the same line. If `king` is the king of
+// `side` these are the pinned pieces, and if it is the enemy king the pieces
+// that give discovered check when they leave the line.
+Bitboard sole_blockers(const Board& board, Color side, Bitboard king,
+                       Color slider_side) {
+  const int king_idx = square_idx(king);
+  // Sliders that would attack the king if no piece of `side` were in the way.
+  const Bitboard others = board.enemies(side);
+  const Bitboard queens = board.pieces(slider_side, Piece::queen);
+  const Bitboard snipers =
+      (rook_attacks(king_idx, others) &
+       (board.pieces(slider_side, Piece::rook) | queens)) |
+      (bishop_attacks(king_idx, others) &
+       (board.pieces(slider_side, Piece::bishop) | queens));
+  const Bitboard occupancy = board.all_pieces();
+  Bitboard res = 0;
+  for (Bitboard sniper : bitboard_split(snipers)) {
+    const Bitboard blockers =
+        between_squares(king_idx, square_idx(sniper)) & occupancy;
+    if (is_square(blockers)) {
+      res |= blockers & board.friends(side);
+    }
+  }
+  return res;
+}
 }  // namespace.
 
-Board::Board() : Board(get_start_fen()) {}
+Board::Board() : Board(start_board()) {}
 
 Board::Board(absl::string_view fen) {
-  std::vector<absl::string_view> split_fen = absl::StrSplit(fen, " ");
-
-  init_bitboards(split_fen[0]);
-  init_is_whites_move(split_fen[1]);
-  init_castling_rights(split_fen[2]);
-  init_en_passant(split_fen[3]);
-  ABSL_RAW_CHECK(absl::SimpleAtoi(split_fen[4], &fifty_move_clock_),
-                 "FEN invalid: Fifty move clock not convertible to integer.");
-  ABSL_RAW_CHECK(absl::SimpleAtoi(split_fen[5], &num_moves_),
-                 "FEN invalid: Number of moves not convertible to integer.");
-}
-
-Board::Board(const Board& other)
-    : white_pawns_(other.white_pawns_),
-      white_rooks_(other.white_rooks_),
-      white_knights_(other.white_knights_),
-      white_bishops_(other.white_bishops_),
-      white_queens_(other.white_queens_),
-      white_king_(other.white_king_),
-      black_pawns_(other.black_pawns_),
-      black_rooks_(other.black_rooks_),
-      black_knights_(other.black_knights_),
-      black_bishops_(other.black_bishops_),
-      black_queens_(other.black_queens_),
-      black_king_(other.black_king_),
-      is_whites_move_(other.is_whites_move_),
-      en_passant_square_(other.en_passant_square_),
-      white_has_right_to_castle_kingside_(
-          other.white_has_right_to_castle_kingside_),
-      white_has_right_to_castle_queenside_(
-          other.white_has_right_to_castle_queenside_),
-      black_has_right_to_castle_kingside_(
-          other.black_has_right_to_castle_kingside_),
-      black_has_right_to_castle_queenside_(
-          other.black_has_right_to_castle_queenside_),
-      fifty_move_clock_(other.fifty_move_clock_),
-      num_moves_(other.num_moves_) {}
+  const char* const error = set_fen(fen);
+  ABSL_RAW_CHECK(error == nullptr, error);
+}
+
+const char* Board::set_fen(absl::string_view fen, bool chess960) {
+  size_t pos = 0;
+  zero_all_bitboards();
+  int rank = board_size - 1;
+  int file = 0;
+  for (char c : next_fen_field(fen, &pos)) {
+    if (c == '/') {
+      if (file != board_size || rank == 0) {
+        return "FEN invalid: A rank doesn't have 8 squares.";
+      }
+      --rank;
+      file = 0;
+    } else if (c >= '1' && c <= '8') {
+      file += c - '0';
+      if (file > board_size) {
+        return "FEN invalid: A rank doesn't have 8 squares.";
+      }
+    } else {
+      const FenPiece piece = fen_pieces[static_cast<unsigned char>(c)];
+      if (piece.piece_ == Piece::none) {
+        return "FEN invalid: Unknown piece.";
+      }
+      if (file == board_size) {
+        return "FEN invalid: A rank doesn't have 8 squares.";
+      }
+      *piece_bitboard(piece.color_, piece.piece_) |=
+          lsb_bitboard << (rank * board_size + board_size - file - 1);
+      ++file;
+    }
+  }
+  if (rank != 0 || file != board_size) {
+    return "FEN invalid: The board doesn't have 8 ranks.";
+  }
+  init_mailbox();
+  init_occupancy();
+
+  const absl::string_view side_to_move = next_fen_field(fen, &pos);
+  if (side_to_move != "w" && side_to_move != "b") {
+    return "FEN invalid: Side to move must be either w or b.";
+  }
+  is_whites_move_ = side_to_move == "w";
+
+  const absl::string_view castling = next_fen_field(fen, &pos);
+  castling_rights_ = no_castling;
+  is_chess960_ = chess960;
+  castling_rook_files_ = standard_castling_rook_files;
+  if (castling != "-") {
+    for (char c : castling) {
+      const bool is_white = c >= 'A' && c <= 'Z';
+      const Color color = is_white ? Color::white : Color::black;
+      const char upper = is_white ? c : static_cast<char>(c - 'a' + 'A');
+      const int back_rank = is_white ? 0 : board_size - 1;
+      const Bitboard king =
+          pieces(color, Piece::king) & rank_mask(back_rank);
+      bool is_kingside = upper == 'K';
+      int rook_file = is_kingside ? board_size - 1 : 0;
+      if (upper == 'K' || upper == 'Q') {
+        // The outermost rook on that side of the king.
+        const Bitboard rooks =
+            pieces(color, Piece::rook) & rank_mask(back_rank);
+        const int step = is_kingside ? -1 : 1;
+        while (chess960 && is_square(king) && rook_file != file_idx(king) &&
+               !(rooks & coordinates_to_square(rook_file, back_rank))) {
+          rook_file += step;
+        }
+      } else if (upper >= 'A' && upper <= 'H') {
+        if (!is_square(king)) {
+          return "FEN invalid: A castling file without a king on the back "
+                 "rank.";
+        }
+        is_chess960_ = true;
+        rook_file = upper - 'A';
+        is_kingside = rook_file > file_idx(king);
+      } else {
+        return "FEN invalid: Castling rights must be - or from KQkq, A-H and "
+               "a-h.";
+      }
+      const size_t right_idx =
+          static_cast<size_t>(color) * 2 + (is_kingside ? 0 : 1);
+      castling_rights_ |= static_cast<uint8_t>(1 << right_idx);
+      castling_rook_files_[right_idx] = static_cast<uint8_t>(rook_file);
+    }
+  }
+  if (castling.empty()) {
+    return "FEN invalid: Missing castling rights.";
+  }
+
+  const absl::string_view en_passant = next_fen_field(fen, &pos);
+  en_passant_square_ = 0;
+  if (en_passant != "-") {
+    if (en_passant.size() != 2 || en_passant[0] < 'a' ||
+        en_passant[0] > 'h' || en_passant[1] < '1' || en_passant[1] > '8') {
+      return "FEN invalid: Bad en passant square.";
+    }
+    en_passant_square_ = str_to_square(en_passant);
+  }
+
+  // The clocks are often left out, for a position with no history.
+  fifty_move_clock_ = 0;
+  num_moves_ = 1;
+  const absl::string_view fifty_move_clock = next_fen_field(fen, &pos);
+  if (!fifty_move_clock.empty() &&
+      (!absl::SimpleAtoi(fifty_move_clock, &fifty_move_clock_) ||
+       fifty_move_clock_ < 0)) {
+    return "FEN invalid: Fifty move clock not convertible to integer.";
+  }
+  const absl::string_view num_moves = next_fen_field(fen, &pos);
+  if (!num_moves.empty() &&
+      (!absl::SimpleAtoi(num_moves, &num_moves_) || num_moves_ < 0)) {
+    return "FEN invalid: Number of moves not convertible to integer.";
+  }
+  if (!next_fen_field(fen, &pos).empty()) {
+    return "FEN invalid: Too many fields.";
+  }
+
+  init_state();
+  return nullptr;
+}
+
+const char* Board::position_error() const {
+  if (!is_square(pieces(Color::white, Piece::king)) ||
+      !is_square(pieces(Color::black, Piece::king))) {
+    return "Position invalid: Each side needs one king.";
+  }
+  if (pieces(Piece::pawn) & (first_rank_mask | eighth_rank_mask)) {
+    return "Position invalid: A pawn is on the first or eighth rank.";
+  }
+  if (is_king_attacked(is_whites_move_ ? Color::black : Color::white)) {
+    return "Position invalid: The side not to move is in check.";
+  }
+  for (Color color : {Color::white, Color::black}) {
+    for (MoveType type :
+         {MoveType::castle_kingside, MoveType::castle_queenside}) {
+      const CastlingRights right = standard_castling_path(color, type).right_;
+      const CastlingPath& path = castling_path(color, type);
+      if (has_castling_rights(right) &&
+          (path.right_ != right ||
+           !(pieces(color, Piece::king) & path.king_move_.src_square()) ||
+           !(pieces(color, Piece::rook) & path.rook_move_.src_square()))) {
+        return "Position invalid: A castling right without its king and rook.";
+      }
+    }
+  }
+  if (en_passant_square_) {
+    // The square behind a pawn of the side that just moved, which it passed
+    // over from its starting square.
+    const Bitboard pawn = is_whites_move_ ? south_of(en_passant_square_)
+                                          : north_of(en_passant_square_);
+    const Bitboard start = is_whites_move_ ? north_of(en_passant_square_)
+                                           : south_of(en_passant_square_);
+    if (!(en_passant_square_ &
+          (is_whites_move_ ? sixth_rank_mask : third_rank_mask)) ||
+        !(pieces(is_whites_move_ ? Color::black : Color::white, Piece::pawn) &
+          pawn) ||
+        (occupancy_ & (en_passant_square_ | start))) {
+      return "Position invalid: No pawn just moved past the en passant "
+             "square.";
+    }
+  }
+  return nullptr;
+}
+
+absl::optional<Board> parse_fen(absl::string_view fen, const char** error,
+                                bool chess960) {
+  Board res;
+  const char* res_error = res.set_fen(fen, chess960);
+  if (!res_error) {
+    res_error = res.position_error();
+  }
+  if (error) {
+    *error = res_error;
+  }
+  if (res_error) {
+    return absl::nullopt;
+  }
+  return res;
+}
 
 std::array<Bitboard*, 12> Board::all_bitboards() {
-  return {&white_pawns_,   &white_rooks_,   &white_bishops_, &white_knights_,
-          &white_queens_,  &white_king_,    &black_pawns_,   &black_rooks_,
-          &black_bishops_, &black_knights_, &black_queens_,  &black_king_};
+  std::array<Bitboard*, 12> res;
+  for (size_t idx = 0; idx < res.size(); ++idx) {
+    res[idx] = &pieces_[idx / num_piece_types][idx % num_piece_types];
+  }
+  return res;
+}
+
+Bitboard* Board::piece_bitboard(Color side, Piece piece) {
+  DEBUG_CHECK(piece != Piece::none, "No bitboard for Piece::none.");
+  return &pieces_[static_cast<size_t>(side)][static_cast<size_t>(piece)];
+}
+
+absl::optional<Piece> Board::piece_on(Bitboard sq) const {
+  const Piece piece = mailbox_[static_cast<size_t>(square_idx(sq))];
+  if (piece == Piece::none) {
+    return absl::nullopt;
+  }
+  return piece;
 }
 
 std::string Board::to_pretty_str() const {
@@ -168,506 +1196,568 @@ std::string Board::to_pretty_str() const {
 }
 
 std::string Board::occupiers_unicode_symbol(int file, int rank) const {
-  Bitboard square = coordinates_to_square(file, rank);
-  if (square & white_pawns_) {
-    return "♙";  // U+2564
-  } else if (square & white_rooks_) {
-    return "♖";  // U+2656
-  } else if (square & white_knights_) {
-    return "♘";  // U+2658
-  } else if (square & white_bishops_) {
-    return "♗";  // U+2657
-  } else if (square & white_queens_) {
-    return "♕";  // U+2655
-  } else if (square & white_king_) {
-    return "♔";  // U+2654
-  } else if (square & black_pawns_) {
-    return "♟";  // U+265F
-  } else if (square & black_rooks_) {
-    return "♜";  // U+265C
-  } else if (square & black_knights_) {
-    return "♞";  // U+265E
-  } else if (square & black_bishops_) {
-    return "♝";  // U+265D
-  } else if (square & black_queens_) {
-    return "♛";  // U+265B
-  } else if (square & black_king_) {
-    return "♚";  // U+265A
-  } else {
+  const Bitboard square = coordinates_to_square(file, rank);
+  const Piece piece = mailbox_[static_cast<size_t>(square_idx(square))];
+  if (piece == Piece::none) {
     return " ";
   }
+  // Indexed by piece, in the order of the Piece enum.
+  const std::array<const char*, 6> white_symbols = {
+      "♙", "♖", "♘", "♗", "♕", "♔"};  // U+2659, U+2656 to U+2654
+  const std::array<const char*, 6> black_symbols = {
+      "♟", "♜", "♞", "♝", "♛", "♚"};  // U+265F, U+265C to U+265A
+  const size_t piece_idx = static_cast<size_t>(piece);
+  return square & white_pieces() ? white_symbols[piece_idx]
+                                 : black_symbols[piece_idx];
 }
 
-void PrintTo(const Board& board, std::ostream* os) {
-  *os << board.to_pretty_str();
+namespace {
+// Writes `value` in decimal to `buf` and returns the end of what it wrote.
+char* write_int(int value, char* buf) {
+  unsigned magnitude = static_cast<unsigned>(value);
+  if (value < 0) {
+    *buf++ = '-';
+    magnitude = 0u - magnitude;
+  }
+  char digits[10];
+  size_t num_digits = 0;
+  do {
+    digits[num_digits++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  while (num_digits != 0) {
+    *buf++ = digits[--num_digits];
+  }
+  return buf;
+}
+}  // namespace.
+
+size_t Board::to_fen(char* buf) const {
+  // Indexed by Piece.
+  constexpr char white_chars[] = "PRNBQK";
+  constexpr char black_chars[] = "prnbqk";
+  char* pos = buf;
+  for (int rank = 7; rank >= 0; --rank) {
+    int num_empty = 0;
+    for (int file = 0; file < 8; ++file) {
+      const int sq_idx = rank * 8 + 7 - file;
+      const Piece piece = mailbox_[static_cast<size_t>(sq_idx)];
+      if (piece == Piece::none) {
+        ++num_empty;
+        continue;
+      }
+      if (num_empty != 0) {
+        *pos++ = static_cast<char>('0' + num_empty);
+        num_empty = 0;
+      }
+      const size_t piece_idx = static_cast<size_t>(piece);
+      *pos++ = white_occupancy_ & (lsb_bitboard << sq_idx)
+                   ? white_chars[piece_idx]
+                   : black_chars[piece_idx];
+    }
+    if (num_empty != 0) {
+      *pos++ = static_cast<char>('0' + num_empty);
+    }
+    if (rank != 0) {
+      *pos++ = '/';
+    }
+  }
+  *pos++ = ' ';
+  *pos++ = is_whites_move_ ? 'w' : 'b';
+  *pos++ = ' ';
+  if (castling_rights_ == 0) {
+    *pos++ = '-';
+  }
+  // Chess960 rights are written as the files of their rooks, as in
+  // Shredder-FEN.
+  for (size_t i = 0; i < castling_rook_files_.size(); ++i) {
+    if (has_castling_rights(static_cast<uint8_t>(1 << i))) {
+      *pos++ = is_chess960_ ? static_cast<char>((i < 2 ? 'A' : 'a') +
+                                                castling_rook_files_[i])
+                            : "KQkq"[i];
+    }
+  }
+  *pos++ = ' ';
+  if (en_passant_square_) {
+    *pos++ = static_cast<char>('a' + file_idx(en_passant_square_));
+    *pos++ = static_cast<char>('1' + rank_idx(en_passant_square_));
+  } else {
+    *pos++ = '-';
+  }
+  *pos++ = ' ';
+  pos = write_int(fifty_move_clock_, pos);
+  *pos++ = ' ';
+  pos = write_int(num_moves_, pos);
+  *pos = '\0';
+  return static_cast<size_t>(pos - buf);
 }
 
-Bitboard Board::friends(Color side) const {
-  return side == Color::white ? white_pieces() : black_pieces();
+void Board::append_fen(std::string* out) const {
+  char buf[max_fen_size];
+  out->append(buf, to_fen(buf));
 }
 
-Bitboard Board::enemies(Color side) const {
-  return side == Color::white ? black_pieces() : white_pieces();
+std::string Board::to_fen() const {
+  std::string res;
+  append_fen(&res);
+  return res;
 }
-Bitboard Board::white_pieces() const {
-  return white_pawns_ | white_knights_ | white_bishops_ | white_rooks_ |
-         white_queens_ | white_king_;
+
+void PrintTo(const Board& board, std::ostream* os) {
+  *os << board.to_pretty_str();
 }
 
-Bitboard Board::black_pieces() const {
-  return black_pawns_ | black_knights_ | black_bishops_ | black_rooks_ |
-         black_queens_ | black_king_;
+Bitboard Board::pawn_attack_squares(Color side) const {
+  const Bitboard pawns = pieces(side, Piece::pawn);
+  return side == Color::white ? pawn_attacks_of<Color::white>(pawns)
+                              : pawn_attacks_of<Color::black>(pawns);
 }
 
-Bitboard Board::all_pieces() const { return white_pieces() | black_pieces(); }
+Bitboard Board::pawn_double_attack_squares(Color side) const {
+  const Bitboard pawns = pieces(side, Piece::pawn);
+  return side == Color::white ? pawn_double_attacks_of<Color::white>(pawns)
+                              : pawn_double_attacks_of<Color::black>(pawns);
+}
 
-Bitboard Board::pawn_attack_squares(Color side) const {
-  Bitboard res = 0;
-  if (side == Color::white) {
-    for (Bitboard single_pawn : bitboard_split(white_pawns_)) {
-      const Bitboard northeast_of_pawn = northeast_of(single_pawn);
-      res |= northeast_of_pawn;
-      const Bitboard northwest_of_pawn = northwest_of(single_pawn);
-      res |= northwest_of_pawn;
-    }
-  } else {
-    for (Bitboard single_pawn : bitboard_split(black_pawns_)) {
-      const Bitboard southeast_of_pawn = southeast_of(single_pawn);
-      res |= southeast_of_pawn;
-      const Bitboard southwest_of_pawn = southwest_of(single_pawn);
-      res |= southwest_of_pawn;
-    }
+Bitboard Board::attack_squares(Color side) const {
+  return attack_squares(side, all_pieces());
+}
+
+Bitboard Board::attack_squares(Color side, Bitboard occupancy) const {
+  Bitboard res = pawn_attack_squares(side);
+  for (Bitboard sq : bitboard_split(pieces(side, Piece::knight))) {
+    res |= knight_attacks[static_cast<size_t>(square_idx(sq))];
+  }
+  const Bitboard king = pieces(side, Piece::king);
+  if (king) {
+    res |= king_attacks[static_cast<size_t>(square_idx(king))];
+  }
+  const Bitboard queens = pieces(side, Piece::queen);
+  const Bitboard rook_likes = queens | pieces(side, Piece::rook);
+  for (Bitboard sq : bitboard_split(rook_likes)) {
+    res |= rook_attacks(square_idx(sq), occupancy);
+  }
+  const Bitboard bishop_likes = queens | pieces(side, Piece::bishop);
+  for (Bitboard sq : bitboard_split(bishop_likes)) {
+    res |= bishop_attacks(square_idx(sq), occupancy);
   }
   return res;
 }
 
-Bitboard Board::attack_squares(Color side) const {
-  std::vector<Move> moves = pseudolegal_moves(side);
-  const Bitboard without_pawns_attack_squares = absl::c_accumulate(
-      moves, uint64_t(0),
-      [](Bitboard acc, Move move) { return acc | move.dst_square_; });
-  return without_pawns_attack_squares | pawn_attack_squares(side);
+Bitboard Board::attackers_to(Bitboard square, Bitboard occupancy) const {
+  const int idx = square_idx(square);
+  const size_t table_idx = static_cast<size_t>(idx);
+  const Bitboard queens = pieces(Piece::queen);
+  const Bitboard rooks_and_queens = pieces(Piece::rook) | queens;
+  const Bitboard bishops_and_queens = pieces(Piece::bishop) | queens;
+  // A white pawn attacks `square` exactly when a black pawn on `square` would
+  // attack the white pawn, and the other way around.
+  return (black_pawn_attacks[table_idx] & pieces(Color::white, Piece::pawn)) |
+         (white_pawn_attacks[table_idx] & pieces(Color::black, Piece::pawn)) |
+         (knight_attacks[table_idx] & pieces(Piece::knight)) |
+         (king_attacks[table_idx] & pieces(Piece::king)) |
+         (rook_attacks(idx, occupancy) & rooks_and_queens) |
+         (bishop_attacks(idx, occupancy) & bishops_and_queens);
 }
 
 void Board::append_pseudolegal_sliding_moves(Direction direction, Color side,
                                              Bitboard src_square,
                                              Piece piece_moving,
-                                             std::vector<Move>* res_ptr) const {
-  std::vector<Move>& res = *res_ptr;
-  ABSL_RAW_CHECK(src_square & friends(side),
-                 "src_square must have a piece with the correct color on it.");
-
-  std::vector<Bitboard> dst_squares;
-  auto direction_fn = direction_to_function(direction);
-  Bitboard curr_square = direction_fn(src_square);
-  Bitboard all_pieces_mask = all_pieces();
-  while (curr_square && !(curr_square & all_pieces_mask)) {
-    res.emplace_back(src_square, curr_square, piece_moving, MoveType::simple,
-                     *this);
-    curr_square = direction_fn(curr_square);
+                                             MoveList* res_ptr) const {
+  MoveList& res = *res_ptr;
+  DEBUG_CHECK(src_square & friends(side),
+              "src_square must have a piece with the correct color on it.");
+
+  // The ray stops at its nearest occupied square, which is the lowest or the
+  // highest of them depending on the direction. The moves go out from the
+  // piece, the capture last.
+  const int src_idx = square_idx(src_square);
+  const Bitboard ray = rays[static_cast<size_t>(direction)]
+                           [static_cast<size_t>(src_idx)];
+  const Bitboard blockers = ray & all_pieces();
+  const bool is_increasing = is_increasing_direction(direction);
+  const Bitboard blocker = !blockers      ? 0
+                           : is_increasing ? lsb_square(blockers)
+                                           : msb_square(blockers);
+  const Bitboard empty_squares =
+      blocker ? between_squares(src_idx, square_idx(blocker)) : ray;
+  for (Bitboard rest = empty_squares; rest;) {
+    const Bitboard dst_square =
+        is_increasing ? lsb_square(rest) : msb_square(rest);
+    res.emplace_back(src_square, dst_square, piece_moving, MoveType::simple);
+    rest ^= dst_square;
   }
-  if (curr_square & enemies(side)) {
-    res.emplace_back(src_square, curr_square, piece_moving, MoveType::capture,
-                     *this);
+  if (blocker & enemies(side)) {
+    res.emplace_back(src_square, blocker, piece_moving, MoveType::capture);
   }
 }
 
 void Board::append_pseudolegal_bishop_moves(Color side,
-                                            std::vector<Move>* res_ptr) const {
-  Bitboard bishops = side == Color::white ? white_bishops_ : black_bishops_;
+                                            MoveList* res_ptr) const {
+  const Bitboard bishops =
+      pieces(side, Piece::bishop);
+  const Bitboard occupancy = all_pieces();
+  const Bitboard not_friends_mask = ~friends(side);
+  const Bitboard enemies_mask = enemies(side);
   for (Bitboard bishop_sq : bitboard_split(bishops)) {
-    append_pseudolegal_sliding_moves(Direction::northeast, side, bishop_sq,
-                                     Piece::bishop, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::northwest, side, bishop_sq,
-                                     Piece::bishop, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::southeast, side, bishop_sq,
-                                     Piece::bishop, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::southwest, side, bishop_sq,
-                                     Piece::bishop, res_ptr);
+    const Bitboard dst_squares =
+        bishop_attacks(square_idx(bishop_sq), occupancy) & not_friends_mask;
+    append_moves_to(bishop_sq, dst_squares, enemies_mask, Piece::bishop,
+                    res_ptr);
   }
 }
 
-void Board::append_pseudolegal_rook_moves(Color side,
-                                          std::vector<Move>* res_ptr) const {
-  Bitboard rooks = side == Color::white ? white_rooks_ : black_rooks_;
+void Board::append_pseudolegal_rook_moves(Color side, MoveList* res_ptr) const {
+  const Bitboard rooks = pieces(side, Piece::rook);
+  const Bitboard occupancy = all_pieces();
+  const Bitboard not_friends_mask = ~friends(side);
+  const Bitboard enemies_mask = enemies(side);
   for (Bitboard rook_sq : bitboard_split(rooks)) {
-    append_pseudolegal_sliding_moves(Direction::north, side, rook_sq,
-                                     Piece::rook, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::south, side, rook_sq,
-                                     Piece::rook, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::east, side, rook_sq,
-                                     Piece::rook, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::west, side, rook_sq,
-                                     Piece::rook, res_ptr);
+    const Bitboard dst_squares =
+        rook_attacks(square_idx(rook_sq), occupancy) & not_friends_mask;
+    append_moves_to(rook_sq, dst_squares, enemies_mask, Piece::rook, res_ptr);
   }
 }
 
 void Board::append_pseudolegal_queen_moves(Color side,
-                                           std::vector<Move>* res_ptr) const {
-  Bitboard queens = side == Color::white ? white_queens_ : black_queens_;
+                                           MoveList* res_ptr) const {
+  const Bitboard queens = pieces(side, Piece::queen);
+  const Bitboard occupancy = all_pieces();
+  const Bitboard not_friends_mask = ~friends(side);
+  const Bitboard enemies_mask = enemies(side);
   for (Bitboard queen_sq : bitboard_split(queens)) {
-    append_pseudolegal_sliding_moves(Direction::north, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::northeast, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::northwest, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::southeast, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::southwest, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::south, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::east, side, queen_sq,
-                                     Piece::queen, res_ptr);
-    append_pseudolegal_sliding_moves(Direction::west, side, queen_sq,
-                                     Piece::queen, res_ptr);
-  }
-}
-
-void Board::append_pseudolegal_simple_pawn_moves(
-    Color side, std::vector<Move>* res_ptr) const {
-  std::vector<Move>& res = *res_ptr;
+    const Bitboard dst_squares =
+        queen_attacks(square_idx(queen_sq), occupancy) & not_friends_mask;
+    append_moves_to(queen_sq, dst_squares, enemies_mask, Piece::queen,
+                    res_ptr);
+  }
+}
+
+void Board::append_pseudolegal_simple_pawn_moves(Color side,
+                                                 MoveList* res_ptr) const {
   if (side == Color::white) {
-    const Bitboard white_pawns_excluding_seventh =
-        white_pawns_ & (~seventh_rank_mask);
-    for (Bitboard single_pawn : bitboard_split(white_pawns_excluding_seventh)) {
-      const Bitboard north_of_pawn = north_of(single_pawn);
-      const bool blocked = all_pieces() & north_of_pawn;
-      if (!blocked) {
-        res.emplace_back(single_pawn, north_of_pawn, Piece::pawn,
-                         MoveType::simple, *this);
-      }
-    }
+    append_simple_pawn_moves<Color::white>(*this, res_ptr);
   } else {
-    const Bitboard black_pawns_excluding_second =
-        black_pawns_ & (~second_rank_mask);
-    for (Bitboard single_pawn : bitboard_split(black_pawns_excluding_second)) {
-      const Bitboard south_of_pawn = south_of(single_pawn);
-      const bool blocked = all_pieces() & south_of_pawn;
-      if (!blocked) {
-        res.emplace_back(single_pawn, south_of_pawn, Piece::pawn,
-                         MoveType::simple, *this);
-      }
-    }
+    append_simple_pawn_moves<Color::black>(*this, res_ptr);
   }
 }
 
-void Board::append_pseudolegal_two_step_pawn_moves(
-    Color side, std::vector<Move>* res_ptr) const {
-  std::vector<Move>& res = *res_ptr;
+void Board::append_pseudolegal_two_step_pawn_moves(Color side,
+                                                   MoveList* res_ptr) const {
   if (side == Color::white) {
-    const Bitboard white_pawns_on_second = white_pawns_ & second_rank_mask;
-    for (Bitboard single_pawn : bitboard_split(white_pawns_on_second)) {
-      const Bitboard north_of_pawn = north_of(single_pawn);
-      const Bitboard two_north_of_pawn = north_of(north_of_pawn);
-      const bool blocked =
-          (all_pieces() & north_of_pawn) || (all_pieces() & two_north_of_pawn);
-      if (!blocked) {
-        res.emplace_back(single_pawn, two_north_of_pawn, Piece::pawn,
-                         MoveType::two_step_pawn, *this);
-      }
-    }
+    append_two_step_pawn_moves<Color::white>(*this, res_ptr);
   } else {
-    const Bitboard black_pawns_on_seventh = black_pawns_ & seventh_rank_mask;
-    for (Bitboard single_pawn : bitboard_split(black_pawns_on_seventh)) {
-      const Bitboard south_of_pawn = south_of(single_pawn);
-      const Bitboard two_south_of_pawn = south_of(south_of_pawn);
-      const bool blocked =
-          (all_pieces() & south_of_pawn) || (all_pieces() & two_south_of_pawn);
-      if (!blocked) {
-        res.emplace_back(single_pawn, two_south_of_pawn, Piece::pawn,
-                         MoveType::two_step_pawn, *this);
-      }
-    }
+    append_two_step_pawn_moves<Color::black>(*this, res_ptr);
   }
 }
 
-void Board::append_pseudolegal_en_passant_moves(
-    Color side, std::vector<Move>* res_ptr) const {
-  std::vector<Move>& res = *res_ptr;
-  if (en_passant_square_) {
-    if (side == Color::white) {
-      Bitboard southeast_of_ep_square =
-          southeast_of(en_passant_square_.value());
-      Bitboard southwest_of_ep_square =
-          southwest_of(en_passant_square_.value());
-      if (southwest_of_ep_square & white_pawns_) {
-        res.emplace_back(southwest_of_ep_square, en_passant_square_.value(),
-                         Piece::pawn, MoveType::en_passant, *this);
-      }
-      if (southeast_of_ep_square & white_pawns_) {
-        res.emplace_back(southeast_of_ep_square, en_passant_square_.value(),
-                         Piece::pawn, MoveType::en_passant, *this);
-      }
-    } else {
-      Bitboard northeast_of_ep_square =
-          northeast_of(en_passant_square_.value());
-      Bitboard northwest_of_ep_square =
-          northwest_of(en_passant_square_.value());
-      if (northwest_of_ep_square & black_pawns_) {
-        res.emplace_back(northwest_of_ep_square, en_passant_square_.value(),
-                         Piece::pawn, MoveType::en_passant, *this);
-      }
-      if (northeast_of_ep_square & black_pawns_) {
-        res.emplace_back(northeast_of_ep_square, en_passant_square_.value(),
-                         Piece::pawn, MoveType::en_passant, *this);
-      }
-    }
+void Board::append_pseudolegal_en_passant_moves(Color side,
+                                                MoveList* res_ptr) const {
+  if (side == Color::white) {
+    append_en_passant_moves<Color::white>(*this, res_ptr);
+  } else {
+    append_en_passant_moves<Color::black>(*this, res_ptr);
   }
 }
 
-void Board::append_pseudolegal_promotions(Color side,
-                                          std::vector<Move>* res_ptr) const {
-  std::vector<Move>& res = *res_ptr;
+void Board::append_pseudolegal_promotions(Color side, MoveList* res_ptr) const {
   if (side == Color::white) {
-    const Bitboard white_pawns_on_seventh = white_pawns_ & seventh_rank_mask;
-    for (Bitboard single_pawn : bitboard_split(white_pawns_on_seventh)) {
-      const Bitboard north_of_pawn = north_of(single_pawn);
-      const bool blocked = all_pieces() & north_of_pawn;
-      if (!blocked) {
-        res.emplace_back(single_pawn, north_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_rook, *this);
-        res.emplace_back(single_pawn, north_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_knight, *this);
-        res.emplace_back(single_pawn, north_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_bishop, *this);
-        res.emplace_back(single_pawn, north_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_queen, *this);
-      }
-
-      const Bitboard northeast_of_pawn = northeast_of(single_pawn);
-      const bool black_piece_northeast = black_pieces() & northeast_of_pawn;
-      if (black_piece_northeast) {
-        res.emplace_back(single_pawn, northeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_rook, *this);
-        res.emplace_back(single_pawn, northeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_knight, *this);
-        res.emplace_back(single_pawn, northeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_bishop, *this);
-        res.emplace_back(single_pawn, northeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_queen, *this);
-      }
-
-      const Bitboard northwest_of_pawn = northwest_of(single_pawn);
-      const bool black_piece_northwest = black_pieces() & northwest_of_pawn;
-      if (black_piece_northwest) {
-        res.emplace_back(single_pawn, northwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_rook, *this);
-        res.emplace_back(single_pawn, northwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_knight, *this);
-        res.emplace_back(single_pawn, northwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_bishop, *this);
-        res.emplace_back(single_pawn, northwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_queen, *this);
-      }
-    }
+    append_promotions<Color::white>(*this, res_ptr);
   } else {
-    const Bitboard black_pawns_on_second = black_pawns_ & second_rank_mask;
-    for (Bitboard single_pawn : bitboard_split(black_pawns_on_second)) {
-      const Bitboard south_of_pawn = south_of(single_pawn);
-      const bool blocked = all_pieces() & south_of_pawn;
-      if (!blocked) {
-        res.emplace_back(single_pawn, south_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_rook, *this);
-        res.emplace_back(single_pawn, south_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_knight, *this);
-        res.emplace_back(single_pawn, south_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_bishop, *this);
-        res.emplace_back(single_pawn, south_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_queen, *this);
-      }
-
-      const Bitboard southeast_of_pawn = southeast_of(single_pawn);
-      const bool white_piece_southeast = white_pieces() & southeast_of_pawn;
-      if (white_piece_southeast) {
-        res.emplace_back(single_pawn, southeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_rook, *this);
-        res.emplace_back(single_pawn, southeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_knight, *this);
-        res.emplace_back(single_pawn, southeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_bishop, *this);
-        res.emplace_back(single_pawn, southeast_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_queen, *this);
-      }
-
-      const Bitboard southwest_of_pawn = southwest_of(single_pawn);
-      const bool white_piece_southwest = white_pieces() & southwest_of_pawn;
-      if (white_piece_southwest) {
-        res.emplace_back(single_pawn, southwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_rook, *this);
-        res.emplace_back(single_pawn, southwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_knight, *this);
-        res.emplace_back(single_pawn, southwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_bishop, *this);
-        res.emplace_back(single_pawn, southwest_of_pawn, Piece::pawn,
-                         MoveType::promotion_to_queen, *this);
-      }
-    }
+    append_promotions<Color::black>(*this, res_ptr);
   }
 }
 
 void Board::append_pseudolegal_pawn_captures(Color side,
-                                             std::vector<Move>* res_ptr) const {
-  std::vector<Move>& res = *res_ptr;
+                                             MoveList* res_ptr) const {
   if (side == Color::white) {
-    const Bitboard white_pawns_excluding_seventh =
-        white_pawns_ & (~seventh_rank_mask);
-    for (Bitboard single_pawn : bitboard_split(white_pawns_excluding_seventh)) {
-      const Bitboard northeast_of_pawn = northeast_of(single_pawn);
-      const bool can_capture_northeast = black_pieces() & northeast_of_pawn;
-      if (can_capture_northeast) {
-        res.emplace_back(single_pawn, northeast_of_pawn, Piece::pawn,
-                         MoveType::capture, *this);
-      }
-
-      const Bitboard northwest_of_pawn = northwest_of(single_pawn);
-      const bool can_capture_northwest = black_pieces() & northwest_of_pawn;
-      if (can_capture_northwest) {
-        res.emplace_back(single_pawn, northwest_of_pawn, Piece::pawn,
-                         MoveType::capture, *this);
-      }
-    }
+    append_pawn_captures<Color::white>(*this, res_ptr);
   } else {
-    const Bitboard black_pawns_excluding_seventh =
-        black_pawns_ & (~second_rank_mask);
-    for (Bitboard single_pawn : bitboard_split(black_pawns_excluding_seventh)) {
-      const Bitboard southeast_of_pawn = southeast_of(single_pawn);
-      const bool can_capture_southeast = white_pieces() & southeast_of_pawn;
-      if (can_capture_southeast) {
-        res.emplace_back(single_pawn, southeast_of_pawn, Piece::pawn,
-                         MoveType::capture, *this);
-      }
+    append_pawn_captures<Color::black>(*this, res_ptr);
+  }
+}
 
-      const Bitboard southwest_of_pawn = southwest_of(single_pawn);
-      const bool can_capture_southwest = white_pieces() & southwest_of_pawn;
-      if (can_capture_southwest) {
-        res.emplace_back(single_pawn, southwest_of_pawn, Piece::pawn,
-                         MoveType::capture, *this);
-      }
-    }
+void Board::append_pseudolegal_pawn_moves(Color side, MoveList* res_ptr) const {
+  if (side == Color::white) {
+    append_pawn_moves<Color::white>(*this, res_ptr);
+  } else {
+    append_pawn_moves<Color::black>(*this, res_ptr);
   }
 }
 
-void Board::append_pseudolegal_pawn_moves(Color side,
-                                          std::vector<Move>* res_ptr) const {
-  append_pseudolegal_simple_pawn_moves(side, res_ptr);
-  append_pseudolegal_two_step_pawn_moves(side, res_ptr);
-  append_pseudolegal_pawn_captures(side, res_ptr);
-  append_pseudolegal_en_passant_moves(side, res_ptr);
-  append_pseudolegal_promotions(side, res_ptr);
+void Board::append_pseudolegal_king_moves(Color side, MoveList* res_ptr) const {
+  const Bitboard king_sq = pieces(side, Piece::king);
+  const Bitboard dst_squares =
+      king_attacks[static_cast<size_t>(square_idx(king_sq))] & ~friends(side);
+  append_moves_to(king_sq, dst_squares, enemies(side), Piece::king, res_ptr);
 }
 
-void Board::append_pseudolegal_king_moves(Color side,
-                                          std::vector<Move>* res_ptr) const {
-  Bitboard king_sq = side == Color::white ? white_king_ : black_king_;
-  Bitboard friends_mask = friends(side);
+void Board::append_pseudolegal_knight_moves(Color side,
+                                            MoveList* res_ptr) const {
+  const Bitboard knights =
+      pieces(side, Piece::knight);
+  const Bitboard not_friends_mask = ~friends(side);
+  const Bitboard enemies_mask = enemies(side);
+  for (Bitboard knight_sq : bitboard_split(knights)) {
+    const Bitboard dst_squares =
+        knight_attacks[static_cast<size_t>(square_idx(knight_sq))] &
+        not_friends_mask;
+    append_moves_to(knight_sq, dst_squares, enemies_mask, Piece::knight,
+                    res_ptr);
+  }
+}
 
-  for (Direction dir : all_directions) {
-    auto dir_fn = direction_to_function(dir);
-    Bitboard dst_square = dir_fn(king_sq);
-    const bool friendly_piece_on_dst_square = dst_square & friends_mask;
-    if (dst_square && !friendly_piece_on_dst_square) {
-      const bool enemy_piece_on_dst_square = dst_square & enemies(side);
-      MoveType move_type =
-          enemy_piece_on_dst_square ? MoveType::capture : MoveType::simple;
-      res_ptr->emplace_back(king_sq, dst_square, Piece::king, move_type, *this);
+MoveList Board::pseudolegal_moves(Color side) const {
+  MoveList res;
+  generate_pseudolegal_moves(side, &res);
+  return res;
+}
+
+template <typename Sink>
+void Board::generate_pseudolegal_moves(Color side, Sink* res_ptr) const {
+  const Bitboard occupancy = all_pieces();
+  const Bitboard not_friends_mask = ~friends(side);
+  const Bitboard enemies_mask = enemies(side);
+  for (Piece piece : {Piece::bishop, Piece::rook, Piece::queen}) {
+    for (Bitboard src_square : bitboard_split(pieces(side, piece))) {
+      append_moves_to(src_square,
+                      piece_attacks(piece, square_idx(src_square), occupancy) &
+                          not_friends_mask,
+                      enemies_mask, piece, res_ptr);
+    }
+  }
+  if (side == Color::white) {
+    append_pawn_moves<Color::white>(*this, res_ptr);
+  } else {
+    append_pawn_moves<Color::black>(*this, res_ptr);
+  }
+  for (Piece piece : {Piece::king, Piece::knight}) {
+    for (Bitboard src_square : bitboard_split(pieces(side, piece))) {
+      append_moves_to(src_square,
+                      piece_attacks(piece, square_idx(src_square), occupancy) &
+                          not_friends_mask,
+                      enemies_mask, piece, res_ptr);
     }
   }
 }
 
-void Board::append_pseudolegal_knight_moves(Color side,
-                                            std::vector<Move>* res_ptr) const {
-  Bitboard knights = side == Color::white ? white_knights_ : black_knights_;
-  Bitboard friends_mask = friends(side);
+template void Board::generate_pseudolegal_moves(Color, MoveList*) const;
+template void Board::generate_pseudolegal_moves(Color, MoveCounter*) const;
+template void Board::generate_pseudolegal_moves(Color,
+                                                DestinationCollector*) const;
 
-  for (Bitboard knight_sq : bitboard_split(knights)) {
-    for (auto dir1_dir2 : knight_move_directions) {
-      auto dir1_fn = direction_to_function(dir1_dir2.first);
-      auto dir2_fn = direction_to_function(dir1_dir2.second);
-      Bitboard first_step = dir1_fn(knight_sq);
-      if (first_step) {
-        Bitboard dst_square = dir2_fn(first_step);
-        const bool friendly_piece_on_dst_square = dst_square & friends_mask;
-        if (dst_square && !friendly_piece_on_dst_square) {
-          const bool enemy_piece_on_dst_square = dst_square & enemies(side);
-          MoveType move_type =
-              enemy_piece_on_dst_square ? MoveType::capture : MoveType::simple;
-          res_ptr->emplace_back(knight_sq, dst_square, Piece::knight, move_type,
-                                *this);
-        }
+void Board::append_pseudolegal_captures(Color side, MoveList* res_ptr) const {
+  append_non_pawn_moves(*this, side, enemies(side), res_ptr);
+  if (side == Color::white) {
+    append_pawn_capture_moves<Color::white>(*this, res_ptr);
+  } else {
+    append_pawn_capture_moves<Color::black>(*this, res_ptr);
+  }
+}
+
+void Board::append_pseudolegal_quiet_moves(Color side,
+                                           MoveList* res_ptr) const {
+  append_non_pawn_moves(*this, side, ~all_pieces(), res_ptr);
+  if (side == Color::white) {
+    append_pawn_quiet_moves<Color::white>(*this, res_ptr);
+  } else {
+    append_pawn_quiet_moves<Color::black>(*this, res_ptr);
+  }
+  if (side == (is_whites_move_ ? Color::white : Color::black)) {
+    castling_moves(res_ptr);
+  }
+}
+
+void Board::append_pseudolegal_quiet_checks(Color side,
+                                            MoveList* res_ptr) const {
+  const Bitboard enemy_king = pieces(flip_color(side), Piece::king);
+  const int enemy_king_idx = square_idx(enemy_king);
+  const Bitboard occupancy = all_pieces();
+  const Bitboard empty = ~occupancy;
+  const Bitboard discoverers = discovered_check_candidates(side);
+  for (Piece piece : non_pawn_pieces) {
+    // The squares the piece checks the enemy king from. A king never does.
+    const Bitboard check_squares =
+        piece == Piece::king ? 0
+                             : piece_attacks(piece, enemy_king_idx, occupancy);
+    for (Bitboard src_square : bitboard_split(pieces(side, piece))) {
+      Bitboard targets = check_squares;
+      if (src_square & discoverers) {
+        targets |= ~line_through(enemy_king_idx, square_idx(src_square));
       }
+      append_moves_to(src_square,
+                      piece_attacks(piece, square_idx(src_square), occupancy) &
+                          empty & targets,
+                      0, piece, res_ptr);
+    }
+  }
+
+  // Pawn pushes move along a file, so instead of masking per pawn the pushes
+  // are generated and those that neither land on a check square nor uncover
+  // a check are dropped. Promotions are left out.
+  const Bitboard pawn_check_squares =
+      side == Color::white
+          ? pawn_attacks_of<Color::black>(enemy_king)
+          : pawn_attacks_of<Color::white>(enemy_king);
+  MoveList pushes;
+  append_pseudolegal_simple_pawn_moves(side, &pushes);
+  append_pseudolegal_two_step_pawn_moves(side, &pushes);
+  for (Move move : pushes) {
+    const Bitboard src_square = move.src_square();
+    if ((move.dst_square() & pawn_check_squares) ||
+        ((src_square & discoverers) &&
+         !(move.dst_square() &
+           line_through(enemy_king_idx, square_idx(src_square))))) {
+      res_ptr->push_back(move);
     }
   }
 }
 
-std::vector<Move> Board::pseudolegal_moves(Color side) const {
-  std::vector<Move> res;
-  append_pseudolegal_bishop_moves(side, &res);
-  append_pseudolegal_rook_moves(side, &res);
-  append_pseudolegal_queen_moves(side, &res);
-  append_pseudolegal_pawn_moves(side, &res);
-  append_pseudolegal_king_moves(side, &res);
-  append_pseudolegal_knight_moves(side, &res);
+MoveList Board::pseudolegal_captures(Color side) const {
+  MoveList res;
+  append_pseudolegal_captures(side, &res);
   return res;
 }
 
-bool Board::is_castle_kingside_legal() const {
-  bool has_right_to_castle = is_whites_move_
-                                 ? white_has_right_to_castle_kingside_
-                                 : black_has_right_to_castle_kingside_;
-  Color side_to_move = is_whites_move_ ? Color::white : Color::black;
-  if (!has_right_to_castle || is_king_attacked(side_to_move)) {
+MoveList Board::pseudolegal_quiet_moves(Color side) const {
+  MoveList res;
+  append_pseudolegal_quiet_moves(side, &res);
+  return res;
+}
+
+MoveList Board::pseudolegal_quiet_checks(Color side) const {
+  MoveList res;
+  append_pseudolegal_quiet_checks(side, &res);
+  return res;
+}
+
+bool Board::is_move_pseudolegal(Move move) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard src_square = move.src_square();
+  const Bitboard dst_square = move.dst_square();
+  if (!(src_square & friends(side)) ||
+      mailbox_[move.src_idx_] != move.piece_moving_) {
+    return false;
+  }
+  if (move.piece_moving_ == Piece::pawn) {
+    return side == Color::white
+               ? is_pawn_move_pseudolegal<Color::white>(*this, move)
+               : is_pawn_move_pseudolegal<Color::black>(*this, move);
+  }
+  // Castling has too many conditions to check by hand, so it is looked up
+  // among the generated castling moves, which is still cheap.
+  if (move.move_type_ == MoveType::castle_kingside ||
+      move.move_type_ == MoveType::castle_queenside) {
+    MoveList moves;
+    castling_moves(&moves);
+    return std::find(moves.begin(), moves.end(), move) != moves.end();
+  }
+  const Bitboard dst_squares =
+      piece_attacks(move.piece_moving_, move.src_idx_, all_pieces()) &
+      ~friends(side);
+  if (!(dst_square & dst_squares)) {
     return false;
   }
+  const MoveType move_type =
+      dst_square & enemies(side) ? MoveType::capture : MoveType::simple;
+  return move.move_type_ == move_type;
+}
 
-  Bitboard castle_squares =
-      is_whites_move_ ? white_castle_kingside_mask : black_castle_kingside_mask;
-  Bitboard enemy_attack_squares = attack_squares(flip_color(side_to_move));
-  const bool castle_squares_clear = !(castle_squares & all_pieces());
-  const bool castle_squares_attacked = castle_squares & enemy_attack_squares;
+// Castling without attack maps only asks about the king's path, usually two
+// or three squares, which is cheaper than computing everything the enemy
+// attacks.
 
-  return castle_squares_clear && !castle_squares_attacked;
+bool Board::is_castle_kingside_legal() const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const CastlingPath& path = castling_path(side, MoveType::castle_kingside);
+  return has_castling_rights(path.right_) &&
+         !(path.empty_squares_ & all_pieces()) &&
+         !is_any_square_attacked(path.king_path_, flip_color(side)) &&
+         !(is_chess960_ && is_castling_rook_shielding(*this, path, side));
 }
 
 bool Board::is_castle_queenside_legal() const {
-  const bool has_right_to_castle = is_whites_move_
-                                       ? white_has_right_to_castle_queenside_
-                                       : black_has_right_to_castle_queenside_;
-  Color side_to_move = is_whites_move_ ? Color::white : Color::black;
-  if (!has_right_to_castle || is_king_attacked(side_to_move)) {
-    return false;
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const CastlingPath& path = castling_path(side, MoveType::castle_queenside);
+  return has_castling_rights(path.right_) &&
+         !(path.empty_squares_ & all_pieces()) &&
+         !is_any_square_attacked(path.king_path_, flip_color(side)) &&
+         !(is_chess960_ && is_castling_rook_shielding(*this, path, side));
+}
+
+void Board::castling_moves(MoveList* res_ptr) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  if (is_castle_kingside_legal()) {
+    res_ptr->push_back(
+        castling_path(side, MoveType::castle_kingside).king_move_);
   }
+  if (is_castle_queenside_legal()) {
+    res_ptr->push_back(
+        castling_path(side, MoveType::castle_queenside).king_move_);
+  }
+}
 
-  const Bitboard castle_squares = is_whites_move_ ? white_castle_queenside_mask
-                                                  : black_castle_queenside_mask;
-  const Bitboard enemy_attack_squares = is_whites_move_
-                                            ? attack_squares(Color::black)
-                                            : attack_squares(Color::white);
-  const bool castle_squares_attacked = castle_squares & enemy_attack_squares;
-  // When castling queenside the square on the b file can be attacked but must
-  // not be occupied.
-  const Bitboard b_file_square =
-      is_whites_move_ ? str_to_square("b1") : str_to_square("b8");
-  const Bitboard castle_squares_with_b_file = castle_squares | b_file_square;
-  const bool castle_squares_blocked = castle_squares_with_b_file & all_pieces();
+// With attack maps the king's path is checked against the king danger map,
+// which the king moves of the same node have already computed. It only
+// differs from the enemy's attacks on squares behind the king, and a slider
+// that attacks those gives check, which rules out castling anyway.
 
-  return !castle_squares_blocked && !castle_squares_attacked;
+bool Board::is_castle_kingside_legal(AttackMaps* maps) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const CastlingPath& path = castling_path(side, MoveType::castle_kingside);
+  return has_castling_rights(path.right_) &&
+         !(path.empty_squares_ & all_pieces()) &&
+         !(path.king_path_ & maps->king_danger(side)) &&
+         !(is_chess960_ && is_castling_rook_shielding(*this, path, side));
 }
 
-void Board::castling_moves(std::vector<Move>* res_ptr) const {
-  Color side_to_move = is_whites_move_ ? Color::white : Color::black;
-  if (is_castle_kingside_legal()) {
-    res_ptr->push_back(castle_kingside_move(side_to_move, *this));
+bool Board::is_castle_queenside_legal(AttackMaps* maps) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const CastlingPath& path = castling_path(side, MoveType::castle_queenside);
+  return has_castling_rights(path.right_) &&
+         !(path.empty_squares_ & all_pieces()) &&
+         !(path.king_path_ & maps->king_danger(side)) &&
+         !(is_chess960_ && is_castling_rook_shielding(*this, path, side));
+}
+
+void Board::castling_moves(AttackMaps* maps, MoveList* res_ptr) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  if (is_castle_kingside_legal(maps)) {
+    res_ptr->push_back(
+        castling_path(side, MoveType::castle_kingside).king_move_);
   }
-  if (is_castle_queenside_legal()) {
-    res_ptr->push_back(castle_queenside_move(side_to_move, *this));
+  if (is_castle_queenside_legal(maps)) {
+    res_ptr->push_back(
+        castling_path(side, MoveType::castle_queenside).king_move_);
+  }
+}
+
+const CastlingPath& Board::castling_path(Color side,
+                                         MoveType move_type) const {
+  const size_t wing = move_type == MoveType::castle_kingside ? 0 : 1;
+  if (!is_chess960_) {
+    return castling_paths[static_cast<size_t>(side)][wing];
+  }
+  return chess960_castling_paths
+      [static_cast<size_t>(side)][wing]
+      [static_cast<size_t>(file_idx(pieces(side, Piece::king)))]
+      [castling_rook_files_[static_cast<size_t>(side) * 2 + wing]];
+}
+
+bool Board::is_any_square_attacked(Bitboard squares, Color side) const {
+  const Bitboard occupancy = all_pieces();
+  const Bitboard attackers_mask = friends(side);
+  for (Bitboard sq : bitboard_split(squares)) {
+    if (attackers_to(sq, occupancy) & attackers_mask) {
+      return true;
+    }
   }
+  return false;
 }
 
 bool Board::is_king_attacked(Color side) const {
-  const Bitboard king = side == Color::white ? white_king_ : black_king_;
-  return king & attack_squares(flip_color(side));
+  const Bitboard king = pieces(side, Piece::king);
+  return attackers_to(king, all_pieces()) & enemies(side);
 }
 
 bool Board::is_pseudolegal_move_legal(Move move) const {
@@ -677,198 +1767,970 @@ bool Board::is_pseudolegal_move_legal(Move move) const {
   return !this_copy.is_king_attacked(side_to_move);
 }
 
-std::vector<Move> Board::legal_moves() const {
-  Color side_to_move = is_whites_move_ ? Color::white : Color::black;
-  std::vector<Move> res = pseudolegal_moves(side_to_move);
-  Board this_copy(*this);
-  auto last_it = std::remove_if(res.begin(), res.end(), [this_copy](Move move) {
-    return !this_copy.is_pseudolegal_move_legal(move);
-  });
+CheckInfo Board::check_info() const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard enemy_king = pieces(flip_color(side), Piece::king);
+  const int enemy_king_idx = square_idx(enemy_king);
+  const Bitboard occupancy = all_pieces();
+  CheckInfo info;
+  info.checkers_ =
+      attackers_to(pieces(side, Piece::king), occupancy) & enemies(side);
+  info.pinned_ = pinned_pieces(side);
+  info.discoverers_ = discovered_check_candidates(side);
+  const Bitboard bishop_checks = bishop_attacks(enemy_king_idx, occupancy);
+  const Bitboard rook_checks = rook_attacks(enemy_king_idx, occupancy);
+  info.check_squares_ = {
+      side == Color::white ? pawn_attacks_of<Color::black>(enemy_king)
+                           : pawn_attacks_of<Color::white>(enemy_king),
+      rook_checks,
+      knight_attacks[static_cast<size_t>(enemy_king_idx)],
+      bishop_checks,
+      bishop_checks | rook_checks,
+      0};
+  return info;
+}
+
+int Board::see(Move move) const {
+  if (move.move_type_ == MoveType::castle_kingside ||
+      move.move_type_ == MoveType::castle_queenside) {
+    return 0;
+  }
+  const Bitboard dst_square = move.dst_square();
+  const ExchangeStart start = exchange_start(*this, move);
+  Bitboard occupancy = start.occupancy_;
+  Bitboard attackers = attackers_to(dst_square, occupancy) & occupancy;
+  // gains[i] is what the side making the i-th capture wins if the exchange
+  // stops after it. There are at most 32 pieces to capture with.
+  std::array<int, 32> gains;
+  gains[0] = start.captured_value_;
+  size_t depth = 0;
+  int on_square_value = start.on_square_value_;
+  Color side = is_whites_move_ ? Color::black : Color::white;
+  while (const Bitboard side_attackers = attackers & friends(side)) {
+    Piece piece;
+    const Bitboard attacker =
+        least_valuable_attacker(*this, side, side_attackers, &piece);
+    if (piece == Piece::king && (attackers & enemies(side))) {
+      // The king can't capture onto a defended square.
+      break;
+    }
+    ++depth;
+    gains[depth] = on_square_value - gains[depth - 1];
+    on_square_value = see_value(piece);
+    occupancy ^= attacker;
+    attackers = (attackers | xray_attackers(*this, piece, move.dst_idx_,
+                                            occupancy)) &
+                occupancy;
+    side = flip_color(side);
+  }
+  // Each side can stop capturing instead, so walk back picking the better of
+  // capturing and stopping.
+  for (; depth > 0; --depth) {
+    gains[depth - 1] = -std::max(-gains[depth - 1], gains[depth]);
+  }
+  return gains[0];
+}
 
-  res.erase(last_it, res.end());
-  castling_moves(&res);
+bool Board::see_ge(Move move, int threshold) const {
+  if (move.move_type_ == MoveType::castle_kingside ||
+      move.move_type_ == MoveType::castle_queenside) {
+    return threshold <= 0;
+  }
+  const ExchangeStart start = exchange_start(*this, move);
+  // `swap` is how far the side that just captured is above the threshold if
+  // the exchange stops here, negated on every capture.
+  int swap = start.captured_value_ - threshold;
+  if (swap < 0) {
+    return false;
+  }
+  swap = start.on_square_value_ - swap;
+  if (swap <= 0) {
+    return true;
+  }
+  Bitboard occupancy = start.occupancy_;
+  Bitboard attackers = attackers_to(move.dst_square(), occupancy) & occupancy;
+  Color side = is_whites_move_ ? Color::black : Color::white;
+  // Whether the side to move reaches the threshold if the exchange stops
+  // after the last capture.
+  bool res = true;
+  while (const Bitboard side_attackers = attackers & friends(side)) {
+    res = !res;
+    Piece piece;
+    const Bitboard attacker =
+        least_valuable_attacker(*this, side, side_attackers, &piece);
+    if (piece == Piece::king) {
+      // The king only captures if nothing can take it back.
+      return attackers & enemies(side) ? !res : res;
+    }
+    swap = see_value(piece) - swap;
+    if (swap < static_cast<int>(res)) {
+      break;
+    }
+    occupancy ^= attacker;
+    attackers = (attackers | xray_attackers(*this, piece, move.dst_idx_,
+                                            occupancy)) &
+                occupancy;
+    side = flip_color(side);
+  }
   return res;
 }
 
-// Remember to reset ep square and change castling rights after all of these.
-
-void Board::remove_piece_on(Bitboard sq) {
-  for (Bitboard* bb_ptr : all_bitboards()) {
-    if (sq & *bb_ptr) {
-      *bb_ptr ^= sq;
+bool Board::is_legal(Move move, const CheckInfo& info) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard src_square = move.src_square();
+  const Bitboard dst_square = move.dst_square();
+  switch (move.move_type_) {
+    case MoveType::castle_kingside:
+    case MoveType::castle_queenside:
+      // Castling moves are only generated when they are legal.
+      return true;
+    case MoveType::en_passant:
+      return is_en_passant_legal(*this, side, move);
+    default:
       break;
+  }
+  if (move.piece_moving_ == Piece::king) {
+    // The king is taken out of the occupancy so that it can't hide behind
+    // itself, and a piece it captures no longer attacks.
+    return !(attackers_to(dst_square, all_pieces() ^ src_square) &
+             enemies(side) & ~dst_square);
+  }
+  const int king_idx = square_idx(pieces(side, Piece::king));
+  if (info.checkers_) {
+    if (!is_square(info.checkers_)) {
+      return false;
+    }
+    const Bitboard targets =
+        info.checkers_ |
+        between_squares(king_idx, square_idx(info.checkers_));
+    if (!(dst_square & targets)) {
+      return false;
+    }
+  }
+  return !(src_square & info.pinned_) ||
+         (dst_square & line_through(king_idx, move.src_idx_));
+}
+
+bool Board::gives_check(Move move, const CheckInfo& info) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard enemy_king = pieces(flip_color(side), Piece::king);
+  const int enemy_king_idx = square_idx(enemy_king);
+  const Bitboard src_square = move.src_square();
+  const Bitboard dst_square = move.dst_square();
+  const Bitboard occupancy = all_pieces();
+
+  // The move doesn't need to be special to uncover a slider.
+  if ((src_square & info.discoverers_) &&
+      !(dst_square & line_through(enemy_king_idx, move.src_idx_))) {
+    return true;
+  }
+  switch (move.move_type_) {
+    case MoveType::simple:
+    case MoveType::capture:
+    case MoveType::two_step_pawn:
+      return (info.check_squares_[static_cast<size_t>(move.piece_moving_)] &
+              dst_square) != 0;
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+    case MoveType::promotion_to_queen:
+      // The promoted piece sees through the square the pawn left.
+      return (piece_attacks(promotion_piece(move.move_type_),
+                            move.dst_idx_, occupancy ^ src_square) &
+              enemy_king) != 0;
+    case MoveType::en_passant: {
+      if (info.check_squares_[static_cast<size_t>(Piece::pawn)] &
+          dst_square) {
+        return true;
+      }
+      // Removing the captured pawn can uncover a slider as well.
+      const Bitboard captured = side == Color::white ? shift_by<-8>(dst_square)
+                                                     : shift_by<8>(dst_square);
+      const Bitboard occupancy_after =
+          occupancy ^ src_square ^ dst_square ^ captured;
+      const Bitboard queens = pieces(side, Piece::queen);
+      return ((rook_attacks(enemy_king_idx, occupancy_after) &
+               (pieces(side, Piece::rook) | queens)) |
+              (bishop_attacks(enemy_king_idx, occupancy_after) &
+               (pieces(side, Piece::bishop) | queens))) != 0;
+    }
+    case MoveType::castle_kingside:
+    case MoveType::castle_queenside: {
+      const CastlingPath& path = castling_path_of(side, move, is_chess960_);
+      const Move rook_move = path.rook_move_;
+      const Bitboard occupancy_after =
+          (occupancy ^ src_square ^ rook_move.src_square()) | path.king_dst_ |
+          rook_move.dst_square();
+      return (rook_attacks(rook_move.dst_idx_, occupancy_after) &
+              enemy_king) != 0;
     }
   }
+  return false;
 }
 
-void Board::do_en_passant_move(Move move) {
-  ABSL_RAW_CHECK(en_passant_square_ == move.dst_square_,
-                 "Move type is en passant. But the e.p. square is not set.");
-  Bitboard enemy_pawn_square = move.dst_square_ & third_rank_mask
-                                   ? north_of(move.dst_square_)
-                                   : south_of(move.dst_square_);
-  remove_piece_on(enemy_pawn_square);
-  do_simple_move(Move(move.src_square_, move.dst_square_, Piece::pawn,
-                      MoveType::simple, *this));
+Bitboard Board::pinned_pieces(Color side) const {
+  return sole_blockers(*this, side, pieces(side, Piece::king),
+                       flip_color(side));
 }
 
-void Board::do_castle_move(Move move) {
-  do_simple_move(move);
+Bitboard Board::discovered_check_candidates(Color side) const {
+  return sole_blockers(*this, side, pieces(flip_color(side), Piece::king),
+                       side);
+}
+
+namespace {
+// Appends the moves of `Board::legal_moves`, taking the squares the enemy
+// attacks from `maps`.
+template <typename Sink>
+void append_legal_moves(const Board& board, AttackMaps* maps,
+                        Sink* res_ptr) {
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  const Bitboard king = board.pieces(side, Piece::king);
+  const int king_idx = square_idx(king);
+  const Bitboard occupancy = board.all_pieces();
+  const Bitboard friends_mask = board.friends(side);
+  const Bitboard enemies_mask = board.enemies(side);
+  const Bitboard checkers = board.attackers_to(king, occupancy) & enemies_mask;
+  if (checkers) {
+    append_evasions(board, side, checkers, maps, res_ptr);
+    return;
+  }
+
+  append_legal_king_moves(board, side, maps, res_ptr);
+  const Bitboard target = ~friends_mask;
+  const Bitboard pinned = board.pinned_pieces(side);
+  // Returns the squares the piece on `sq` may move to if it is pinned.
+  auto pin_mask = [=](Bitboard sq) {
+    return sq & pinned ? line_through(king_idx, square_idx(sq)) : ~Bitboard(0);
+  };
+
+  // A pinned knight can never move.
+  const Bitboard knights = board.pieces(side, Piece::knight);
+  for (Bitboard knight_sq : bitboard_split(knights & ~pinned)) {
+    append_moves_to(knight_sq,
+                    knight_attacks[static_cast<size_t>(square_idx(knight_sq))] &
+                        target,
+                    enemies_mask, Piece::knight, res_ptr);
+  }
+  const Bitboard bishops = board.pieces(side, Piece::bishop);
+  for (Bitboard bishop_sq : bitboard_split(bishops)) {
+    append_moves_to(bishop_sq,
+                    bishop_attacks(square_idx(bishop_sq), occupancy) & target &
+                        pin_mask(bishop_sq),
+                    enemies_mask, Piece::bishop, res_ptr);
+  }
+  const Bitboard rooks = board.pieces(side, Piece::rook);
+  for (Bitboard rook_sq : bitboard_split(rooks)) {
+    append_moves_to(rook_sq,
+                    rook_attacks(square_idx(rook_sq), occupancy) & target &
+                        pin_mask(rook_sq),
+                    enemies_mask, Piece::rook, res_ptr);
+  }
+  const Bitboard queens = board.pieces(side, Piece::queen);
+  for (Bitboard queen_sq : bitboard_split(queens)) {
+    append_moves_to(queen_sq,
+                    queen_attacks(square_idx(queen_sq), occupancy) & target &
+                        pin_mask(queen_sq),
+                    enemies_mask, Piece::queen, res_ptr);
+  }
+
+  LegalPawnMoveFilter<Sink> pawn_filter(board, side, target, pinned, res_ptr);
+  if (side == Color::white) {
+    append_pawn_moves<Color::white>(board, &pawn_filter);
+  } else {
+    append_pawn_moves<Color::black>(board, &pawn_filter);
+  }
+
+  if (board.is_castle_kingside_legal(maps)) {
+    res_ptr->push_back(
+        board.castling_path(side, MoveType::castle_kingside).king_move_);
+  }
+  if (board.is_castle_queenside_legal(maps)) {
+    res_ptr->push_back(
+        board.castling_path(side, MoveType::castle_queenside).king_move_);
+  }
+}
+
+}  // namespace.
+
+MoveList Board::legal_moves() const {
+  MoveList res;
+  generate_legal_moves(&res);
+  return res;
+}
+
+size_t Board::num_legal_moves() const {
+  MoveCounter counter;
+  generate_legal_moves(&counter);
+  return counter.num_moves_;
+}
+
+template <typename Sink>
+void Board::generate_legal_moves(Sink* res_ptr) const {
+  AttackMaps maps(*this);
+  append_legal_moves(*this, &maps, res_ptr);
+}
+
+template void Board::generate_legal_moves(MoveList*) const;
+template void Board::generate_legal_moves(MoveCounter*) const;
+template void Board::generate_legal_moves(DestinationCollector*) const;
+
+template <typename Sink>
+void Board::generate_legal_moves(const AttackInfo& info, Sink* res_ptr) const {
+  AttackMaps maps(*this, info);
+  append_legal_moves(*this, &maps, res_ptr);
+}
+
+template void Board::generate_legal_moves(const AttackInfo&, MoveList*) const;
+template void Board::generate_legal_moves(const AttackInfo&,
+                                          MoveCounter*) const;
+template void Board::generate_legal_moves(const AttackInfo&,
+                                          DestinationCollector*) const;
+
+template <typename Sink>
+void Board::generate_legal_moves(Piece piece, Bitboard targets,
+                                 Bitboard origins, Sink* res_ptr) const {
+  DEBUG_CHECK(piece != Piece::none, "Moves need a piece to move.");
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard sources = pieces(side, piece) & origins;
+  if (!sources) {
+    return;
+  }
+  const Bitboard king = pieces(side, Piece::king);
+  const int king_idx = square_idx(king);
+  const Bitboard occupancy = all_pieces();
+  const Bitboard enemies_mask = enemies(side);
+  const Bitboard checkers = attackers_to(king, occupancy) & enemies_mask;
+  if (piece == Piece::king) {
+    AttackMaps maps(*this);
+    append_moves_to(king,
+                    king_attacks[static_cast<size_t>(king_idx)] & targets &
+                        ~friends(side) & ~maps.king_danger(side),
+                    enemies_mask, Piece::king, res_ptr);
+    if (checkers) {
+      return;
+    }
+    for (MoveType wing :
+         {MoveType::castle_kingside, MoveType::castle_queenside}) {
+      const Move castle = castling_path(side, wing).king_move_;
+      if (!(castle.dst_square() & targets)) {
+        continue;
+      }
+      const bool is_legal = wing == MoveType::castle_kingside
+                                ? is_castle_kingside_legal(&maps)
+                                : is_castle_queenside_legal(&maps);
+      if (is_legal) {
+        res_ptr->push_back(castle);
+      }
+    }
+    return;
+  }
+  // Only the king can get out of a double check.
+  if (checkers && !is_square(checkers)) {
+    return;
+  }
+  // A pinned piece can't block a check or take the checker, as the line
+  // through its king only meets the checker's at the king.
+  const Bitboard dst_mask =
+      targets & ~friends(side) &
+      (checkers ? checkers | between_squares(king_idx, square_idx(checkers))
+                : ~Bitboard{0});
+  const Bitboard pinned = pinned_pieces(side);
+  if (piece != Piece::pawn) {
+    for (Bitboard src_square : bitboard_split(sources)) {
+      const int src_idx = square_idx(src_square);
+      append_moves_to(src_square,
+                      piece_attacks(piece, src_idx, occupancy) & dst_mask &
+                          (src_square & pinned ? line_through(king_idx, src_idx)
+                                               : ~Bitboard{0}),
+                      enemies_mask, piece, res_ptr);
+    }
+    return;
+  }
+  // The pawns that aren't pinned move set-wise, the pinned ones each along
+  // its line.
+  MoveList en_passant_moves;
+  if (side == Color::white) {
+    append_pawn_moves_to<Color::white>(*this, sources & ~pinned, dst_mask,
+                                       res_ptr);
+    for (Bitboard pawn : bitboard_split(sources & pinned)) {
+      append_pawn_moves_to<Color::white>(
+          *this, pawn, dst_mask & line_through(king_idx, square_idx(pawn)),
+          res_ptr);
+    }
+    if (en_passant_square_ & targets) {
+      append_en_passant_moves<Color::white>(*this, &en_passant_moves);
+    }
+  } else {
+    append_pawn_moves_to<Color::black>(*this, sources & ~pinned, dst_mask,
+                                       res_ptr);
+    for (Bitboard pawn : bitboard_split(sources & pinned)) {
+      append_pawn_moves_to<Color::black>(
+          *this, pawn, dst_mask & line_through(king_idx, square_idx(pawn)),
+          res_ptr);
+    }
+    if (en_passant_square_ & targets) {
+      append_en_passant_moves<Color::black>(*this, &en_passant_moves);
+    }
+  }
+  // An e.p. capture can take a checking pawn off a square outside the check
+  // mask, so it is checked on its own.
+  for (Move move : en_passant_moves) {
+    if ((move.src_square() & sources) &&
+        is_en_passant_legal(*this, side, move)) {
+      res_ptr->push_back(move);
+    }
+  }
+}
+
+template void Board::generate_legal_moves(Piece, Bitboard, Bitboard,
+                                          MoveList*) const;
+template void Board::generate_legal_moves(Piece, Bitboard, Bitboard,
+                                          MoveCounter*) const;
+template void Board::generate_legal_moves(Piece, Bitboard, Bitboard,
+                                          DestinationCollector*) const;
+
+MoveList Board::legal_moves(Piece piece, Bitboard targets,
+                            Bitboard origins) const {
+  MoveList res;
+  generate_legal_moves(piece, targets, origins, &res);
+  return res;
+}
+
+MoveList Board::legal_evasions() const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard checkers =
+      attackers_to(pieces(side, Piece::king), all_pieces()) & enemies(side);
+  DEBUG_CHECK(checkers, "The side to move must be in check.");
+  MoveList res;
+  AttackMaps maps(*this);
+  append_evasions(*this, side, checkers, &maps, &res);
+  return res;
+}
+
+bool Board::has_any_legal_move() const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard king = pieces(side, Piece::king);
+  const int king_idx = square_idx(king);
+  const Bitboard occupancy = all_pieces();
+  const Bitboard friends_mask = friends(side);
+  const Bitboard enemies_mask = enemies(side);
+  // The king is taken out of the occupancy so that it can't hide behind
+  // itself, and a piece it captures no longer attacks.
+  for (Bitboard dst_square : bitboard_split(
+           king_attacks[static_cast<size_t>(king_idx)] & ~friends_mask)) {
+    if (!(attackers_to(dst_square, occupancy ^ king) & enemies_mask &
+          ~dst_square)) {
+      return true;
+    }
+  }
+  const Bitboard checkers = attackers_to(king, occupancy) & enemies_mask;
+  if (checkers && !is_square(checkers)) {
+    return false;
+  }
+  const Bitboard targets =
+      ~friends_mask &
+      (checkers ? checkers | between_squares(king_idx, square_idx(checkers))
+                : ~Bitboard{0});
+  const Bitboard pinned = pinned_pieces(side);
+  // A pinned knight can never move.
+  for (Bitboard knight_sq :
+       bitboard_split(pieces(side, Piece::knight) & ~pinned)) {
+    if (knight_attacks[static_cast<size_t>(square_idx(knight_sq))] &
+        targets) {
+      return true;
+    }
+  }
+  // The pawns that aren't pinned move together, and each pinned one along
+  // its line.
+  const Bitboard pawns = pieces(side, Piece::pawn);
+  const auto pawn_targets_of = [this, side, targets](Bitboard from) {
+    return side == Color::white
+               ? pawn_targets<Color::white>(*this, from, targets)
+               : pawn_targets<Color::black>(*this, from, targets);
+  };
+  if (pawn_targets_of(pawns & ~pinned)) {
+    return true;
+  }
+  for (Bitboard pawn_sq : bitboard_split(pawns & pinned)) {
+    if (pawn_targets_of(pawn_sq) &
+        line_through(king_idx, square_idx(pawn_sq))) {
+      return true;
+    }
+  }
+  for (Piece piece : {Piece::bishop, Piece::rook, Piece::queen}) {
+    for (Bitboard sq : bitboard_split(pieces(side, piece))) {
+      const int sq_idx = square_idx(sq);
+      if (piece_attacks(piece, sq_idx, occupancy) & targets &
+          (sq & pinned ? line_through(king_idx, sq_idx) : ~Bitboard{0})) {
+        return true;
+      }
+    }
+  }
+  MoveList en_passant_moves;
+  if (side == Color::white) {
+    append_en_passant_moves<Color::white>(*this, &en_passant_moves);
+  } else {
+    append_en_passant_moves<Color::black>(*this, &en_passant_moves);
+  }
+  for (Move move : en_passant_moves) {
+    if (is_en_passant_legal(*this, side, move)) {
+      return true;
+    }
+  }
+  // A Chess960 king may castle without stepping off its square.
+  return !checkers &&
+         (is_castle_kingside_legal() || is_castle_queenside_legal());
+}
+
+void Board::legal_targets(std::array<Bitboard, 64>* res_ptr) const {
+  res_ptr->fill(0);
+  add_legal_targets(*this, all_pieces(), res_ptr);
+}
+
+Bitboard Board::legal_targets(Bitboard src_square) const {
+  std::array<Bitboard, 64> res;
+  res[static_cast<size_t>(square_idx(src_square))] = 0;
+  add_legal_targets(*this, src_square, &res);
+  return res[static_cast<size_t>(square_idx(src_square))];
+}
+
+namespace {
+// The pieces a move may capture, in the order the unmoves list them.
+constexpr std::array<Piece, 5> capturable_pieces = {
+    {Piece::queen, Piece::rook, Piece::bishop, Piece::knight, Piece::pawn}};
+
+MoveType promotion_move_type(Piece piece) {
+  switch (piece) {
+    case Piece::rook:
+      return MoveType::promotion_to_rook;
+    case Piece::bishop:
+      return MoveType::promotion_to_bishop;
+    case Piece::knight:
+      return MoveType::promotion_to_knight;
+    default:
+      return MoveType::promotion_to_queen;
+  }
+}
+
+// Appends `move` taken back once with each piece it may have captured on its
+// destination, pawns not on the first and eighth ranks.
+void append_uncaptures(Move move, uint8_t castling_rights,
+                       UnmoveList* res_ptr) {
+  const bool is_back_rank =
+      move.dst_square() & (first_rank_mask | eighth_rank_mask);
+  for (Piece captured : capturable_pieces) {
+    if (captured != Piece::pawn || !is_back_rank) {
+      res_ptr->push_back({move, captured, castling_rights});
+    }
+  }
+}
+}  // namespace.
+
+void Board::append_pseudolegal_unmoves(UnmoveList* res_ptr) const {
+  UnmoveList& res = *res_ptr;
+  const Color side = is_whites_move_ ? Color::black : Color::white;
+  const bool is_white = side == Color::white;
+  const Bitboard empty = ~all_pieces();
+  const Bitboard promotion_rank = is_white ? eighth_rank_mask : first_rank_mask;
+  // Where a pawn of `side` that attacks a square comes from.
+  const std::array<Bitboard, 64>& pawn_sources =
+      is_white ? black_pawn_attacks : white_pawn_attacks;
+  const auto back_of = [is_white](Bitboard sq) {
+    return is_white ? south_of(sq) : north_of(sq);
+  };
+  for (Piece piece : {Piece::king, Piece::queen, Piece::rook, Piece::bishop,
+                      Piece::knight}) {
+    for (Bitboard dst : bitboard_split(pieces(side, piece))) {
+      const int dst_idx = square_idx(dst);
+      const Bitboard attacks =
+          piece == Piece::king     ? king_attacks[dst_idx]
+          : piece == Piece::queen  ? queen_attacks(dst_idx, all_pieces())
+          : piece == Piece::rook   ? rook_attacks(dst_idx, all_pieces())
+          : piece == Piece::bishop ? bishop_attacks(dst_idx, all_pieces())
+                                   : knight_attacks[dst_idx];
+      for (Bitboard src : bitboard_split(attacks & empty)) {
+        res.push_back({Move(src, dst, piece, MoveType::simple), Piece::none,
+                       castling_rights_});
+        append_uncaptures(Move(src, dst, piece, MoveType::capture),
+                          castling_rights_, &res);
+      }
+      if (piece == Piece::king || !(dst & promotion_rank)) {
+        continue;
+      }
+      const MoveType promotion = promotion_move_type(piece);
+      if (back_of(dst) & empty) {
+        res.push_back({Move(back_of(dst), dst, Piece::pawn, promotion),
+                       Piece::none, castling_rights_});
+      }
+      for (Bitboard src : bitboard_split(pawn_sources[dst_idx] & empty)) {
+        append_uncaptures(Move(src, dst, Piece::pawn, promotion),
+                          castling_rights_, &res);
+      }
+    }
+  }
+  for (Bitboard dst : bitboard_split(pieces(side, Piece::pawn))) {
+    // The rank counted from the side's own first rank.
+    const int rank = is_white ? rank_idx(dst) : 7 - rank_idx(dst);
+    if (rank < 2) {
+      continue;
+    }
+    const Bitboard src = back_of(dst);
+    if (src & empty) {
+      res.push_back({Move(src, dst, Piece::pawn, MoveType::simple),
+                     Piece::none, castling_rights_});
+      if (rank == 3 && back_of(src) & empty) {
+        res.push_back(
+            {Move(back_of(src), dst, Piece::pawn, MoveType::two_step_pawn),
+             Piece::none, castling_rights_});
+      }
+    }
+    const Bitboard diagonal_srcs = pawn_sources[square_idx(dst)] & empty;
+    for (Bitboard diagonal_src : bitboard_split(diagonal_srcs)) {
+      append_uncaptures(Move(diagonal_src, dst, Piece::pawn, MoveType::capture),
+                        castling_rights_, &res);
+    }
+    // The pawn taken en passant stood behind `dst`, and came from the empty
+    // square in front of it.
+    const Bitboard ahead = is_white ? north_of(dst) : south_of(dst);
+    if (rank == 5 && src & empty && ahead & empty) {
+      for (Bitboard diagonal_src : bitboard_split(diagonal_srcs)) {
+        res.push_back(
+            {Move(diagonal_src, dst, Piece::pawn, MoveType::en_passant),
+             Piece::pawn, castling_rights_});
+      }
+    }
+  }
+  // Castling gives up both rights of the side.
+  const CastlingRights side_rights =
+      is_white ? CastlingRights(white_kingside_castling |
+                                white_queenside_castling)
+               : CastlingRights(black_kingside_castling |
+                                black_queenside_castling);
+  if (is_chess960_ || castling_rights_ & side_rights) {
+    return;
+  }
+  for (MoveType type :
+       {MoveType::castle_kingside, MoveType::castle_queenside}) {
+    const CastlingPath& path = standard_castling_path(side, type);
+    const Bitboard king = path.king_move_.dst_square();
+    const Bitboard rook = path.rook_move_.dst_square();
+    const Bitboard vacated = (path.empty_squares_ & ~(king | rook)) |
+                             path.king_move_.src_square() |
+                             path.rook_move_.src_square();
+    if (pieces(side, Piece::king) & king && pieces(side, Piece::rook) & rook &&
+        !(vacated & all_pieces())) {
+      res.push_back({path.king_move_, Piece::none,
+                     static_cast<uint8_t>(castling_rights_ | path.right_)});
+    }
+  }
+}
+
+UnmoveList Board::legal_unmoves() const {
+  UnmoveList candidates;
+  append_pseudolegal_unmoves(&candidates);
+  // The side to move here, which must not be left in check by the move.
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  UnmoveList res;
+  for (const Unmove& unmove : candidates) {
+    Board before(*this);
+    before.do_unmove(unmove);
+    if (before.is_king_attacked(side)) {
+      continue;
+    }
+    const Move move = unmove.move_;
+    const bool is_legal_before =
+        move.move_type_ == MoveType::castle_kingside
+            ? before.is_castle_kingside_legal()
+        : move.move_type_ == MoveType::castle_queenside
+            ? before.is_castle_queenside_legal()
+            : before.is_legal(move, before.check_info());
+    if (!is_legal_before) {
+      continue;
+    }
+    // The castling rights and en passant square the move leaves must be
+    // those of this position.
+    Board after(before);
+    after.do_move(move);
+    if (after.castling_rights_ == castling_rights_ &&
+        after.en_passant_square_ == en_passant_square_) {
+      res.push_back(unmove);
+    }
+  }
+  return res;
+}
+
+void Board::do_unmove(const Unmove& unmove) {
+  const Move move = unmove.move_;
+  const Color side = is_whites_move_ ? Color::black : Color::white;
+  if constexpr (board_keeps_key) {
+    if (en_passant_square_) {
+      key_ ^= zobrist_en_passant_key(en_passant_square_);
+    }
+    key_ ^= zobrist_castling_keys[castling_rights_ ^ unmove.castling_rights_];
+  }
+  castling_rights_ = unmove.castling_rights_;
+  const Move back(move.dst_square(), move.src_square(), move.piece_moving_,
+                  MoveType::simple);
   switch (move.move_type_) {
     case MoveType::castle_kingside:
-      if (is_whites_move_) {
-        // Using do_simple_move is a bit of a hack.
-        ABSL_RAW_CHECK(white_rooks_ & str_to_square("h1"), "No rook here.");
-        do_simple_move(Move(str_to_square("h1"), str_to_square("f1"),
-                            Piece::rook, MoveType::simple, *this));
-      } else {
-        ABSL_RAW_CHECK(black_rooks_ & str_to_square("h8"), "No rook here.");
-        do_simple_move(Move(str_to_square("h8"), str_to_square("f8"),
-                            Piece::rook, MoveType::simple, *this));
-      }
+    case MoveType::castle_queenside: {
+      const Move rook_move =
+          standard_castling_path(side, move.move_type_).rook_move_;
+      do_simple_move(back);
+      do_simple_move(Move(rook_move.dst_square(), rook_move.src_square(),
+                          Piece::rook, MoveType::simple));
       break;
-    case MoveType::castle_queenside:
-      if (is_whites_move_) {
-        ABSL_RAW_CHECK(white_rooks_ & str_to_square("a1"), "No rook here.");
-        do_simple_move(Move(str_to_square("a1"), str_to_square("d1"),
-                            Piece::rook, MoveType::simple, *this));
-      } else {
-        ABSL_RAW_CHECK(black_rooks_ & str_to_square("a8"), "No rook here.");
-        do_simple_move(Move(str_to_square("a8"), str_to_square("d8"),
-                            Piece::rook, MoveType::simple, *this));
-      }
+    }
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+    case MoveType::promotion_to_queen:
+      remove_piece_on(move.dst_square());
+      put_piece_on(side, Piece::pawn, move.src_square());
       break;
     default:
-      ABSL_RAW_CHECK(false, "Castle move has wrong move type.");
+      do_simple_move(back);
+  }
+  if (unmove.captured_piece_ != Piece::none) {
+    const Bitboard captured_square =
+        move.move_type_ != MoveType::en_passant ? move.dst_square()
+        : side == Color::white                  ? south_of(move.dst_square())
+                                                : north_of(move.dst_square());
+    put_piece_on(flip_color(side), unmove.captured_piece_, captured_square);
+  }
+  en_passant_square_ =
+      move.move_type_ == MoveType::en_passant ? move.dst_square() : 0;
+  if (board_keeps_key && en_passant_square_) {
+    key_ ^= zobrist_en_passant_key(en_passant_square_);
+  }
+  const bool resets_fifty_move_clock = move.piece_moving_ == Piece::pawn ||
+                                       unmove.captured_piece_ != Piece::none;
+  fifty_move_clock_ =
+      resets_fifty_move_clock ? 0 : std::max(fifty_move_clock_ - 1, 0);
+  if (side == Color::black) {
+    num_moves_ = std::max(num_moves_ - 1, 1);
+  }
+  is_whites_move_ = !is_whites_move_;
+  if constexpr (board_keeps_key) {
+    key_ ^= zobrist_keys.black_to_move_;
+  }
+#if PAWN_GRABBER_CHECK_LEVEL >= 2
+  ABSL_RAW_CHECK(has_consistent_state(),
+                 "Board is inconsistent after an unmove.");
+#endif
+}
+
+// Remember to reset ep square and change castling rights after all of these.
+
+void Board::toggle_occupancy(Color side, Bitboard squares) {
+  if (side == Color::white) {
+    white_occupancy_ ^= squares;
+  } else {
+    black_occupancy_ ^= squares;
+  }
+  occupancy_ ^= squares;
+}
+
+void Board::remove_piece_on(Bitboard sq) {
+  const size_t idx = static_cast<size_t>(square_idx(sq));
+  const Piece piece = mailbox_[idx];
+  if (piece != Piece::none) {
+    const Color color = sq & white_pieces() ? Color::white : Color::black;
+    *piece_bitboard(color, piece) ^= sq;
+    toggle_occupancy(color, sq);
+    if constexpr (board_keeps_key) {
+      key_ ^= zobrist_piece_key(color, piece, static_cast<int>(idx));
+    }
+    if constexpr (board_keeps_eval_state) {
+      if (piece == Piece::pawn) {
+        pawn_key_ ^= zobrist_piece_key(color, piece, static_cast<int>(idx));
+      }
+      material_key_ ^=
+          zobrist_piece_key(color, piece, popcount(pieces(color, piece)));
+      psqt_ -= psqt_score(color, piece, static_cast<int>(idx));
+    }
+    mailbox_[idx] = Piece::none;
+  }
+}
+
+void Board::put_piece_on(Color color, Piece piece, Bitboard sq) {
+  const int idx = square_idx(sq);
+  DEBUG_CHECK(mailbox_[static_cast<size_t>(idx)] == Piece::none,
+              "The square is taken.");
+  if constexpr (board_keeps_key) {
+    key_ ^= zobrist_piece_key(color, piece, idx);
+  }
+  if constexpr (board_keeps_eval_state) {
+    material_key_ ^=
+        zobrist_piece_key(color, piece, popcount(pieces(color, piece)));
+    if (piece == Piece::pawn) {
+      pawn_key_ ^= zobrist_piece_key(color, piece, idx);
+    }
+    psqt_ += psqt_score(color, piece, idx);
   }
+  *piece_bitboard(color, piece) |= sq;
+  toggle_occupancy(color, sq);
+  mailbox_[static_cast<size_t>(idx)] = piece;
 }
 
-void Board::do_promotion_move(Move move) {
-  // Ugly hack.
-  if (move.dst_square_ == str_to_square("a1")) {
-    white_has_right_to_castle_queenside_ = false;
-  }
-  if (move.dst_square_ == str_to_square("a8")) {
-    black_has_right_to_castle_queenside_ = false;
+void Board::do_en_passant_move(Move move) {
+  DEBUG_CHECK(en_passant_square_ == move.dst_square(),
+              "Move type is en passant. But the e.p. square is not set.");
+  Bitboard enemy_pawn_square = move.dst_square() & third_rank_mask
+                                   ? north_of(move.dst_square())
+                                   : south_of(move.dst_square());
+  remove_piece_on(enemy_pawn_square);
+  do_simple_move(Move(move.src_square(), move.dst_square(), Piece::pawn,
+                      MoveType::simple));
+}
+
+void Board::do_castle_move(Move move) {
+  if (move.move_type_ != MoveType::castle_kingside &&
+      move.move_type_ != MoveType::castle_queenside) {
+    ABSL_RAW_CHECK(false, "Castle move has wrong move type.");
   }
-  if (move.dst_square_ == str_to_square("h1")) {
-    white_has_right_to_castle_kingside_ = false;
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const CastlingPath& path = castling_path_of(side, move, is_chess960_);
+  const Move rook_move = path.rook_move_;
+  DEBUG_CHECK(pieces(side, Piece::rook) & rook_move.src_square(),
+              "No rook here.");
+  if (!is_chess960_) {
+    do_simple_move(move);
+    // Using do_simple_move is a bit of a hack.
+    do_simple_move(rook_move);
+    return;
   }
-  if (move.dst_square_ == str_to_square("h8")) {
-    black_has_right_to_castle_kingside_ = false;
+  // The king and the rook may land on each other's squares, or stay, so both
+  // leave before either lands.
+  remove_piece_on(move.src_square());
+  remove_piece_on(rook_move.src_square());
+  put_piece_on(side, Piece::king, path.king_dst_);
+  put_piece_on(side, Piece::rook, rook_move.dst_square());
+  en_passant_square_ = 0;
+}
+
+void Board::do_promotion_move(Move move) {
+  remove_piece_on(move.src_square());
+  remove_piece_on(move.dst_square());
+  const Color color = is_whites_move_ ? Color::white : Color::black;
+  const Piece piece = promotion_piece(move.move_type_);
+  if constexpr (board_keeps_key) {
+    key_ ^= zobrist_piece_key(color, piece, move.dst_idx_);
   }
-  remove_piece_on(move.src_square_);
-  remove_piece_on(move.dst_square_);
-  switch (move.move_type_) {
-    case MoveType::promotion_to_rook:
-      if (is_whites_move_) {
-        white_rooks_ |= move.dst_square_;
-      } else {
-        black_rooks_ |= move.dst_square_;
-      }
-      break;
-    case MoveType::promotion_to_bishop:
-      if (is_whites_move_) {
-        white_bishops_ |= move.dst_square_;
-      } else {
-        black_bishops_ |= move.dst_square_;
-      }
-      break;
-    case MoveType::promotion_to_knight:
-      if (is_whites_move_) {
-        white_knights_ |= move.dst_square_;
-      } else {
-        black_knights_ |= move.dst_square_;
-      }
-      break;
-    case MoveType::promotion_to_queen:
-      if (is_whites_move_) {
-        white_queens_ |= move.dst_square_;
-      } else {
-        black_queens_ |= move.dst_square_;
-      }
-      break;
-    default:
-      ABSL_RAW_CHECK(false, "Promotion move has wrong move type.");
+  if constexpr (board_keeps_eval_state) {
+    material_key_ ^=
+        zobrist_piece_key(color, piece, popcount(pieces(color, piece)));
+    psqt_ += psqt_score(color, piece, move.dst_idx_);
   }
-  en_passant_square_ = absl::nullopt;
+  mailbox_[move.dst_idx_] = piece;
+  toggle_occupancy(color, move.dst_square());
+  *piece_bitboard(color, piece) |= move.dst_square();
+  en_passant_square_ = 0;
 }
 
 void Board::do_capture_move(Move move) {
-  remove_piece_on(move.dst_square_);
+  remove_piece_on(move.dst_square());
   do_simple_move(move);
 }
 
 void Board::do_simple_move(Move move) {
-  // Ugly hack.
-  if (move.dst_square_ == str_to_square("a1")) {
-    white_has_right_to_castle_queenside_ = false;
-  }
-  if (move.dst_square_ == str_to_square("a8")) {
-    black_has_right_to_castle_queenside_ = false;
-  }
-  if (move.dst_square_ == str_to_square("h1")) {
-    white_has_right_to_castle_kingside_ = false;
-  }
-  if (move.dst_square_ == str_to_square("h8")) {
-    black_has_right_to_castle_kingside_ = false;
+  const Piece piece = mailbox_[move.src_idx_];
+  DEBUG_CHECK(piece != Piece::none, "Move not valid");
+  const Color color =
+      move.src_square() & white_pieces() ? Color::white : Color::black;
+  *piece_bitboard(color, piece) ^= move.src_square() | move.dst_square();
+  toggle_occupancy(color, move.src_square() | move.dst_square());
+  if constexpr (board_keeps_key) {
+    key_ ^= zobrist_piece_key(color, piece, move.src_idx_) ^
+            zobrist_piece_key(color, piece, move.dst_idx_);
   }
-  bool found = false;
-  for (Bitboard* bb_ptr : all_bitboards()) {
-    if (move.src_square_ & *bb_ptr) {
-      *bb_ptr ^= move.src_square_;
-      *bb_ptr |= move.dst_square_;
-      found = true;
-      break;
+  if constexpr (board_keeps_eval_state) {
+    if (piece == Piece::pawn) {
+      pawn_key_ ^= zobrist_piece_key(color, piece, move.src_idx_) ^
+                   zobrist_piece_key(color, piece, move.dst_idx_);
     }
+    psqt_ += psqt_score(color, piece, move.dst_idx_);
+    psqt_ -= psqt_score(color, piece, move.src_idx_);
   }
-  ABSL_RAW_CHECK(found, "Move not valid");
+  mailbox_[move.src_idx_] = Piece::none;
+  mailbox_[move.dst_idx_] = piece;
   if (move.move_type_ == MoveType::two_step_pawn) {
-    en_passant_square_ = move.src_square_ & second_rank_mask
-                             ? north_of(move.src_square_)
-                             : south_of(move.src_square_);
+    en_passant_square_ = move.src_square() & second_rank_mask
+                             ? north_of(move.src_square())
+                             : south_of(move.src_square());
   } else {
-    en_passant_square_ = absl::nullopt;
-  }
-  if (move.piece_moving_ == Piece::king) {
-    if (move.src_square_ == str_to_square("e1")) {
-      white_has_right_to_castle_kingside_ = false;
-      white_has_right_to_castle_queenside_ = false;
-    } else if (move.src_square_ == str_to_square("e8")) {
-      black_has_right_to_castle_kingside_ = false;
-      black_has_right_to_castle_queenside_ = false;
-    }
+    en_passant_square_ = 0;
   }
-  if (move.piece_moving_ == Piece::rook) {
-    if (move.src_square_ == str_to_square("a1")) {
-      white_has_right_to_castle_queenside_ = false;
-    } else if (move.src_square_ == str_to_square("h1")) {
-      white_has_right_to_castle_kingside_ = false;
-    } else if (move.src_square_ == str_to_square("a8")) {
-      black_has_right_to_castle_queenside_ = false;
-    } else if (move.src_square_ == str_to_square("h8")) {
-      black_has_right_to_castle_kingside_ = false;
+}
+
+DirtyPieces Board::dirty_pieces(Move move) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Color enemy = flip_color(side);
+  const int src = move.src_idx_;
+  const int dst = move.dst_idx_;
+  DirtyPieces res;
+  res.size_ = 0;
+  switch (move.move_type_) {
+    case MoveType::simple:
+    case MoveType::two_step_pawn:
+      res.pieces_[res.size_++] = {side, move.piece_moving_, src, dst};
+      break;
+    case MoveType::capture:
+      res.pieces_[res.size_++] = {side, move.piece_moving_, src, dst};
+      res.pieces_[res.size_++] = {enemy, mailbox_[move.dst_idx_], dst, -1};
+      break;
+    case MoveType::en_passant:
+      res.pieces_[res.size_++] = {side, Piece::pawn, src, dst};
+      // The captured pawn is on the square the capturing pawn passes.
+      res.pieces_[res.size_++] = {enemy, Piece::pawn,
+                                  side == Color::white ? dst - 8 : dst + 8,
+                                  -1};
+      break;
+    case MoveType::castle_kingside:
+    case MoveType::castle_queenside: {
+      // The path has the squares for Chess960 too, where the move goes onto
+      // the rook.
+      const CastlingPath& path = castling_path(side, move.move_type_);
+      res.pieces_[res.size_++] = {side, Piece::king, src,
+                                  square_idx(path.king_dst_)};
+      res.pieces_[res.size_++] = {side, Piece::rook, path.rook_move_.src_idx_,
+                                  path.rook_move_.dst_idx_};
+      break;
     }
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+    case MoveType::promotion_to_queen:
+      res.pieces_[res.size_++] = {side, Piece::pawn, src, -1};
+      res.pieces_[res.size_++] = {side, promotion_piece(move.move_type_), -1,
+                                  dst};
+      if (mailbox_[move.dst_idx_] != Piece::none) {
+        res.pieces_[res.size_++] = {enemy, mailbox_[move.dst_idx_], dst, -1};
+      }
+      break;
   }
+  return res;
 }
 
-void Board::undo_move(Move move) { *this = move.board_state_; }
-
 void Board::do_move(Move move) {
-  ABSL_RAW_CHECK(is_square(move.src_square_) && is_square(move.dst_square_),
-                 "Not a valid move.");
-  // Ugly hack.
-  if (move.dst_square_ == str_to_square("a1")) {
-    white_has_right_to_castle_queenside_ = false;
-  }
-  if (move.dst_square_ == str_to_square("a8")) {
-    black_has_right_to_castle_queenside_ = false;
-  }
-  if (move.dst_square_ == str_to_square("h1")) {
-    white_has_right_to_castle_kingside_ = false;
+  DEBUG_CHECK(is_square(move.src_square()) && is_square(move.dst_square()),
+              "Not a valid move.");
+  // Most moves keep the castling rights and neither find nor leave an en
+  // passant square, and then the key only changes by the pieces and the side
+  // to move.
+  const uint8_t castling_rights =
+      is_chess960_ ? chess960_castling_rights_kept(*this, move)
+                   : castling_rights_ & castling_rights_kept[move.src_idx_] &
+                         castling_rights_kept[move.dst_idx_];
+  if (castling_rights != castling_rights_) {
+    if constexpr (board_keeps_key) {
+      key_ ^= zobrist_castling_keys[castling_rights_ ^ castling_rights];
+    }
+    castling_rights_ = castling_rights;
   }
-  if (move.dst_square_ == str_to_square("h8")) {
-    black_has_right_to_castle_kingside_ = false;
+  if (board_keeps_key && en_passant_square_) {
+    key_ ^= zobrist_en_passant_key(en_passant_square_);
   }
   // std::string b = to_pretty_str();
   // b.append(is_whites_move_ ? "White to move\n" : "Black to move\n");
@@ -892,11 +2754,11 @@ void Board::do_move(Move move) {
     case MoveType::castle_queenside:
       // b.append(is_king_attacked(is_whites_move_ ? Color::white :
       // Color::black) ? "King is attacked\n" : "King is not attacked\n");
-      ABSL_RAW_CHECK(
+      DEBUG_CHECK(
           !is_king_attacked(is_whites_move_ ? Color::white : Color::black),
           "Castling while in check.");
       do_castle_move(move);
-      ABSL_RAW_CHECK(
+      DEBUG_CHECK(
           !is_king_attacked(is_whites_move_ ? Color::white : Color::black),
           "Castled into check");
       break;
@@ -907,194 +2769,354 @@ void Board::do_move(Move move) {
       do_promotion_move(move);
       break;
   }
+  const bool resets_fifty_move_clock = move.piece_moving_ == Piece::pawn ||
+                                       move.move_type_ == MoveType::capture;
+  fifty_move_clock_ = resets_fifty_move_clock ? 0 : fifty_move_clock_ + 1;
+  if (!is_whites_move_) {
+    num_moves_ += 1;
+  }
+  is_whites_move_ = !is_whites_move_;
+  if constexpr (board_keeps_key) {
+    if (en_passant_square_) {
+      key_ ^= zobrist_en_passant_key(en_passant_square_);
+    }
+    key_ ^= zobrist_keys.black_to_move_;
+  }
+#if PAWN_GRABBER_CHECK_LEVEL >= 2
+  ABSL_RAW_CHECK(has_consistent_state(),
+                 "Board is inconsistent after a move.");
+#endif
+}
+
+void Board::do_move(Move move, UndoInfo* undo) {
+  // A Chess960 castling move lands on the king's own rook.
+  undo->captured_piece_ =
+      move.move_type_ == MoveType::en_passant ? Piece::pawn
+      : move.move_type_ == MoveType::castle_kingside ||
+              move.move_type_ == MoveType::castle_queenside
+          ? absl::nullopt
+          : piece_on(move.dst_square());
+  undo->en_passant_square_ = en_passant_square_;
+  undo->castling_rights_ = castling_rights_;
+  undo->fifty_move_clock_ = fifty_move_clock_;
+  if constexpr (board_keeps_key) {
+    undo->key_ = key_;
+  }
+  if constexpr (board_keeps_eval_state) {
+    undo->pawn_key_ = pawn_key_;
+    undo->material_key_ = material_key_;
+    undo->psqt_ = psqt_;
+  }
+  do_move(move);
+}
+
+void Board::do_move(Move move, UndoInfo* undo, DirtyPieces* dirty) {
+  *dirty = dirty_pieces(move);
+  do_move(move, undo);
+}
+
+void Board::undo_move(Move move, const UndoInfo& undo) {
+  is_whites_move_ = !is_whites_move_;
+  if (!is_whites_move_) {
+    num_moves_ -= 1;
+  }
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  const Bitboard src_square = move.src_square();
+  const Bitboard dst_square = move.dst_square();
+
+  switch (move.move_type_) {
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+    case MoveType::promotion_to_queen:
+      *piece_bitboard(side, promotion_piece(move.move_type_)) ^= dst_square;
+      *piece_bitboard(side, Piece::pawn) ^= src_square;
+      toggle_occupancy(side, src_square | dst_square);
+      mailbox_[move.dst_idx_] = Piece::none;
+      mailbox_[move.src_idx_] = Piece::pawn;
+      break;
+    case MoveType::castle_kingside:
+    case MoveType::castle_queenside: {
+      // In Chess960 the king and the rook may have landed on each other's
+      // squares, or stayed, so both are lifted before either is put back,
+      // and the move's destination is the rook's square.
+      const CastlingPath& path = castling_path_of(side, move, is_chess960_);
+      const Bitboard rook_home = path.rook_move_.src_square();
+      const Bitboard rook_castled = path.rook_move_.dst_square();
+      *piece_bitboard(side, Piece::king) ^= path.king_dst_ ^ src_square;
+      *piece_bitboard(side, Piece::rook) ^= rook_castled ^ rook_home;
+      toggle_occupancy(side, (path.king_dst_ | rook_castled) ^
+                                 (src_square | rook_home));
+      mailbox_[static_cast<size_t>(square_idx(path.king_dst_))] = Piece::none;
+      mailbox_[static_cast<size_t>(square_idx(rook_castled))] = Piece::none;
+      mailbox_[move.src_idx_] = Piece::king;
+      mailbox_[static_cast<size_t>(square_idx(rook_home))] = Piece::rook;
+      break;
+    }
+    default:
+      *piece_bitboard(side, move.piece_moving_) ^= src_square | dst_square;
+      toggle_occupancy(side, src_square | dst_square);
+      mailbox_[move.dst_idx_] = Piece::none;
+      mailbox_[move.src_idx_] = move.piece_moving_;
+      break;
+  }
+
+  if (undo.captured_piece_) {
+    Bitboard captured_square = dst_square;
+    if (move.move_type_ == MoveType::en_passant) {
+      captured_square =
+          is_whites_move_ ? south_of(dst_square) : north_of(dst_square);
+    }
+    *piece_bitboard(flip_color(side), undo.captured_piece_.value()) |=
+        captured_square;
+    toggle_occupancy(flip_color(side), captured_square);
+    mailbox_[static_cast<size_t>(square_idx(captured_square))] =
+        undo.captured_piece_.value();
+  }
+
+  en_passant_square_ = undo.en_passant_square_;
+  castling_rights_ = undo.castling_rights_;
+  fifty_move_clock_ = undo.fifty_move_clock_;
+  if constexpr (board_keeps_key) {
+    key_ = undo.key_;
+  }
+  if constexpr (board_keeps_eval_state) {
+    pawn_key_ = undo.pawn_key_;
+    material_key_ = undo.material_key_;
+    psqt_ = undo.psqt_;
+  }
+#if PAWN_GRABBER_CHECK_LEVEL >= 2
+  ABSL_RAW_CHECK(has_consistent_state(),
+                 "Board is inconsistent after undoing a move.");
+#endif
+}
+
+void Board::do_null_move(UndoInfo* undo) {
+  DEBUG_CHECK(!is_king_attacked(is_whites_move_ ? Color::white : Color::black),
+              "Null move while in check.");
+  undo->captured_piece_ = absl::nullopt;
+  undo->en_passant_square_ = en_passant_square_;
+  undo->castling_rights_ = castling_rights_;
+  undo->fifty_move_clock_ = fifty_move_clock_;
+  if constexpr (board_keeps_key) {
+    undo->key_ = key_;
+  }
+  if constexpr (board_keeps_eval_state) {
+    undo->pawn_key_ = pawn_key_;
+    undo->material_key_ = material_key_;
+    undo->psqt_ = psqt_;
+  }
+  if (en_passant_square_) {
+    if constexpr (board_keeps_key) {
+      key_ ^= zobrist_en_passant_key(en_passant_square_);
+    }
+    en_passant_square_ = 0;
+  }
+  fifty_move_clock_ += 1;
+  if (!is_whites_move_) {
+    num_moves_ += 1;
+  }
   is_whites_move_ = !is_whites_move_;
+  if constexpr (board_keeps_key) {
+    key_ ^= zobrist_keys.black_to_move_;
+  }
+}
+
+void Board::undo_null_move(const UndoInfo& undo) {
+  is_whites_move_ = !is_whites_move_;
+  if (!is_whites_move_) {
+    num_moves_ -= 1;
+  }
+  en_passant_square_ = undo.en_passant_square_;
+  fifty_move_clock_ = undo.fifty_move_clock_;
+  if constexpr (board_keeps_key) {
+    key_ = undo.key_;
+  }
+}
+
+bool Board::has_consistent_state() const {
+  Bitboard seen = 0;
+  for (Color color : {Color::white, Color::black}) {
+    Bitboard color_occupancy = 0;
+    for (size_t piece_idx = 0; piece_idx < num_piece_types; ++piece_idx) {
+      const Piece piece = static_cast<Piece>(piece_idx);
+      const Bitboard bb = pieces(color, piece);
+      if (bb & seen) {
+        return false;
+      }
+      seen |= bb;
+      color_occupancy |= bb;
+      for (Bitboard sq : bitboard_split(bb)) {
+        if (mailbox_[static_cast<size_t>(square_idx(sq))] != piece) {
+          return false;
+        }
+      }
+    }
+    if (color_occupancy != friends(color)) {
+      return false;
+    }
+  }
+  for (Bitboard sq : bitboard_split(~seen)) {
+    if (mailbox_[static_cast<size_t>(square_idx(sq))] != Piece::none) {
+      return false;
+    }
+  }
+  const Bitboard ep_rank = is_whites_move_ ? rank_mask(5) : rank_mask(2);
+  Board computed(*this);
+  computed.init_state();
+  return seen == occupancy_ && (castling_rights_ & ~all_castling) == 0 &&
+         (is_chess960_ ||
+          castling_rook_files_ == standard_castling_rook_files) &&
+         (en_passant_square_ == 0 ||
+          (is_square(en_passant_square_) && (en_passant_square_ & ep_rank))) &&
+         key_ == computed.key_ && pawn_key_ == computed.pawn_key_ &&
+         material_key_ == computed.material_key_ && psqt_ == computed.psqt_;
 }
 
 void Board::zero_all_bitboards() {
-  white_pawns_ = 0;
-  white_rooks_ = 0;
-  white_knights_ = 0;
-  white_bishops_ = 0;
-  white_queens_ = 0;
-  white_king_ = 0;
-  black_pawns_ = 0;
-  black_rooks_ = 0;
-  black_knights_ = 0;
-  black_bishops_ = 0;
-  black_queens_ = 0;
-  black_king_ = 0;
-}
-
-void Board::init_bitboards(const absl::string_view pieces_fen) {
-  zero_all_bitboards();
-  int rank = board_size - 1;
-  int file = 0;
+  for (std::array<Bitboard, num_piece_types>& color_pieces : pieces_) {
+    color_pieces.fill(0);
+  }
+}
 
-  for (char c : pieces_fen) {
-    Bitboard square_mask{lsb_bitboard
-                         << (rank * board_size + board_size - file - 1)};
-    switch (c) {
-      // If the next characted is a number, skip that many files.
-      case '1':
-      case '2':
-      case '3':
-      case '4':
-      case '5':
-      case '6':
-      case '7':
-      case '8':
-        file += (c - '0');
-        break;
-      case '/':
-        rank -= 1;
-        file = 0;
-        break;
-      case 'P':
-        white_pawns_ |= square_mask;
-        file += 1;
-        break;
-      case 'R':
-        white_rooks_ |= square_mask;
-        file += 1;
-        break;
-      case 'N':
-        white_knights_ |= square_mask;
-        file += 1;
-        break;
-      case 'B':
-        white_bishops_ |= square_mask;
-        file += 1;
-        break;
-      case 'Q':
-        white_queens_ |= square_mask;
-        file += 1;
-        break;
-      case 'K':
-        white_king_ |= square_mask;
-        file += 1;
-        break;
-      case 'p':
-        black_pawns_ |= square_mask;
-        file += 1;
-        break;
-      case 'r':
-        black_rooks_ |= square_mask;
-        file += 1;
-        break;
-      case 'n':
-        black_knights_ |= square_mask;
-        file += 1;
-        break;
-      case 'b':
-        black_bishops_ |= square_mask;
-        file += 1;
-        break;
-      case 'q':
-        black_queens_ |= square_mask;
-        file += 1;
-        break;
-      case 'k':
-        black_king_ |= square_mask;
-        file += 1;
-        break;
-      default:
-        assert(false);
-        break;
+void Board::init_mailbox() {
+  mailbox_.fill(Piece::none);
+  for (Color color : {Color::white, Color::black}) {
+    for (Piece piece : {Piece::pawn, Piece::rook, Piece::knight, Piece::bishop,
+                        Piece::queen, Piece::king}) {
+      for (Bitboard sq : bitboard_split(*piece_bitboard(color, piece))) {
+        mailbox_[static_cast<size_t>(square_idx(sq))] = piece;
+      }
     }
   }
 }
 
-void Board::init_is_whites_move(const absl::string_view side_to_move) {
-  ABSL_RAW_CHECK(side_to_move == "w" || side_to_move == "b",
-                 "Invalid FEN. Side to move must be either w or b");
-  if (side_to_move == "w") {
-    is_whites_move_ = true;
-  } else if (side_to_move == "b") {
-    is_whites_move_ = false;
+void Board::init_occupancy() {
+  white_occupancy_ = 0;
+  black_occupancy_ = 0;
+  for (Bitboard bb : pieces_[static_cast<size_t>(Color::white)]) {
+    white_occupancy_ |= bb;
   }
+  for (Bitboard bb : pieces_[static_cast<size_t>(Color::black)]) {
+    black_occupancy_ |= bb;
+  }
+  occupancy_ = white_occupancy_ | black_occupancy_;
 }
 
-void Board::init_castling_rights(const absl::string_view castling_rights_fen) {
-  white_has_right_to_castle_kingside_ =
-      (castling_rights_fen.find('K') != std::string::npos);
-  white_has_right_to_castle_queenside_ =
-      (castling_rights_fen.find('Q') != std::string::npos);
-  black_has_right_to_castle_kingside_ =
-      (castling_rights_fen.find('k') != std::string::npos);
-  black_has_right_to_castle_queenside_ =
-      (castling_rights_fen.find('q') != std::string::npos);
+void Board::init_state() {
+  key_ = 0;
+  pawn_key_ = 0;
+  material_key_ = 0;
+  psqt_ = {0, 0};
+  if constexpr (board_keeps_key) {
+    key_ = compute_zobrist_key(*this);
+  }
+  if constexpr (board_keeps_eval_state) {
+    pawn_key_ = compute_pawn_key(*this);
+    material_key_ = compute_material_key(*this);
+    psqt_ = compute_psqt(*this);
+  }
 }
 
-void Board::init_en_passant(const absl::string_view algebraic_square) {
-  if (algebraic_square == "-") {
-    en_passant_square_ = absl::nullopt;
-  } else {
-    en_passant_square_ = str_to_square(algebraic_square);
+Board Board::flipped() const {
+  Board res;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      res.pieces_[color][piece] = flip_ranks(pieces_[1 - color][piece]);
+    }
+  }
+  for (size_t idx = 0; idx < mailbox_.size(); ++idx) {
+    res.mailbox_[idx ^ 56] = mailbox_[idx];
   }
+  res.white_occupancy_ = flip_ranks(black_occupancy_);
+  res.black_occupancy_ = flip_ranks(white_occupancy_);
+  res.occupancy_ = flip_ranks(occupancy_);
+  res.en_passant_square_ = flip_ranks(en_passant_square_);
+  res.key_ = board_keeps_key ? flipped_key() : 0;
+  res.pawn_key_ = 0;
+  res.material_key_ = 0;
+  res.psqt_ = {0, 0};
+  if constexpr (board_keeps_eval_state) {
+    res.pawn_key_ = swap_key_halves(pawn_key_);
+    res.material_key_ = compute_material_key(res);
+    res.psqt_ = compute_psqt(res);
+  }
+  res.fifty_move_clock_ = fifty_move_clock_;
+  res.num_moves_ = num_moves_;
+  res.is_whites_move_ = !is_whites_move_;
+  // The white and black flags of each wing trade places.
+  res.castling_rights_ = static_cast<uint8_t>((castling_rights_ & 3) << 2 |
+                                              castling_rights_ >> 2);
+  res.is_chess960_ = is_chess960_;
+  res.castling_rook_files_ = {castling_rook_files_[2], castling_rook_files_[3],
+                              castling_rook_files_[0], castling_rook_files_[1]};
+  return res;
+}
+
+uint64_t Board::flipped_key() const { return flipped_zobrist_key(key_); }
+
+uint64_t Board::canonical_key() const {
+  return std::min(key_, flipped_key());
 }
 
 bool operator==(const Board& lhs, const Board& rhs) {
-  return std::tie(lhs.white_pawns_, lhs.white_rooks_, lhs.white_knights_,
-                  lhs.white_bishops_, lhs.white_queens_, lhs.white_king_,
-                  lhs.black_pawns_, lhs.black_rooks_, lhs.black_knights_,
-                  lhs.black_bishops_, lhs.black_queens_, lhs.black_king_,
-                  lhs.is_whites_move_, lhs.en_passant_square_,
-                  lhs.white_has_right_to_castle_kingside_,
-                  lhs.white_has_right_to_castle_queenside_,
-                  lhs.black_has_right_to_castle_kingside_,
-                  lhs.black_has_right_to_castle_queenside_,
+  return std::tie(lhs.key_, lhs.pieces_, lhs.mailbox_, lhs.is_whites_move_,
+                  lhs.en_passant_square_, lhs.castling_rights_,
+                  lhs.is_chess960_, lhs.castling_rook_files_,
                   lhs.fifty_move_clock_, lhs.num_moves_) ==
-         std::tie(rhs.white_pawns_, rhs.white_rooks_, rhs.white_knights_,
-                  rhs.white_bishops_, rhs.white_queens_, rhs.white_king_,
-                  rhs.black_pawns_, rhs.black_rooks_, rhs.black_knights_,
-                  rhs.black_bishops_, rhs.black_queens_, rhs.black_king_,
-                  rhs.is_whites_move_, rhs.en_passant_square_,
-                  rhs.white_has_right_to_castle_kingside_,
-                  rhs.white_has_right_to_castle_queenside_,
-                  rhs.black_has_right_to_castle_kingside_,
-                  rhs.black_has_right_to_castle_queenside_,
+         std::tie(rhs.key_, rhs.pieces_, rhs.mailbox_, rhs.is_whites_move_,
+                  rhs.en_passant_square_, rhs.castling_rights_,
+                  rhs.is_chess960_, rhs.castling_rook_files_,
                   rhs.fifty_move_clock_, rhs.num_moves_);
 }
 
-Move::Move()
-    : src_square_(0),
-      dst_square_(0),
-      piece_moving_(Piece::pawn),
-      move_type_(MoveType::simple),
-      board_state_(Board()) {}
-
-Move::Move(Bitboard p_src_square, Bitboard p_dst_square, Piece p_piece_moving,
-           MoveType p_move_type, Board p_board_state)
-    : src_square_(p_src_square),
-      dst_square_(p_dst_square),
-      piece_moving_(p_piece_moving),
-      move_type_(p_move_type),
-      board_state_(p_board_state) {}
+namespace {
+// Writes the name of the square with index `sq_idx`, such as "e4", to `buf`.
+void write_square(int sq_idx, char* buf) {
+  buf[0] = static_cast<char>('a' + 7 - sq_idx % 8);
+  buf[1] = static_cast<char>('1' + sq_idx / 8);
+}
+}  // namespace.
 
 std::string Move::to_pretty_str() const {
-  // std::string promotion_str;
-  // Color side_to_move =
-  //     board_state_.is_whites_move_ ? Color::white : Color::black;
-  // switch (move_type_) {
-  //   case MoveType::promotion_to_rook:
-  //     promotion_str.append(get_unicode_symbol(side_to_move, Piece::rook));
-  //     break;
-  //   case MoveType::promotion_to_knight:
-  //     promotion_str.append(get_unicode_symbol(side_to_move, Piece::knight));
-  //     break;
-  //   case MoveType::promotion_to_bishop:
-  //     promotion_str.append(get_unicode_symbol(side_to_move, Piece::bishop));
-  //     break;
-  //   case MoveType::promotion_to_queen:
-  //     promotion_str.append(get_unicode_symbol(side_to_move, Piece::queen));
-  //     break;
-  //   default:
-  //     break;
-  // }
-  return absl::StrCat(square_to_str(src_square_), square_to_str(dst_square_));
-  // ,
-  //                     promotion_str,
-  //                     move_type_ == MoveType::capture ? "capture" : "");
+  // Without the promotion piece.
+  char buf[max_uci_size];
+  to_uci(buf);
+  return std::string(buf, 4);
+}
+
+std::string Move::to_uci_str() const {
+  char buf[max_uci_size];
+  return std::string(buf, to_uci(buf));
+}
+
+size_t Move::to_uci(char* buf) const {
+  write_square(src_idx_, buf);
+  write_square(dst_idx_, buf + 2);
+  size_t size = 4;
+  switch (move_type_) {
+    case MoveType::promotion_to_rook:
+      buf[size++] = 'r';
+      break;
+    case MoveType::promotion_to_bishop:
+      buf[size++] = 'b';
+      break;
+    case MoveType::promotion_to_knight:
+      buf[size++] = 'n';
+      break;
+    case MoveType::promotion_to_queen:
+      buf[size++] = 'q';
+      break;
+    default:
+      break;
+  }
+  buf[size] = '\0';
+  return size;
+}
+
+void Move::append_uci(std::string* out) const {
+  char buf[max_uci_size];
+  out->append(buf, to_uci(buf));
 }
 
 void PrintTo(const Move& move, std::ostream* os) {
@@ -1102,86 +3124,202 @@ void PrintTo(const Move& move, std::ostream* os) {
 }
 
 bool operator==(const Move& lhs, const Move& rhs) {
-  return std::tie(lhs.src_square_, lhs.dst_square_, lhs.piece_moving_,
-                  lhs.move_type_, lhs.board_state_) ==
-         std::tie(rhs.src_square_, rhs.dst_square_, rhs.piece_moving_,
-                  rhs.move_type_, rhs.board_state_);
+  return std::tie(lhs.src_idx_, lhs.dst_idx_, lhs.piece_moving_,
+                  lhs.move_type_) ==
+         std::tie(rhs.src_idx_, rhs.dst_idx_, rhs.piece_moving_,
+                  rhs.move_type_);
 }
 
-// Check that the bitboard has exactly one bit set.
-bool is_square(Bitboard square) {
-  const bool has_more_than_one_set_bit = (square & (square - 1));
-  return square && !has_more_than_one_set_bit;
+MoveList::MoveList(std::initializer_list<Move> moves) : size_(0) {
+  for (Move move : moves) {
+    push_back(move);
+  }
 }
 
-int square_idx(Bitboard square) {
-  // ABSL_RAW_CHECK(is_square(square), "Is not square.");
-  int res = -1;
-  while (square) {
-    square >>= 1;
-    res += 1;
-  }
-  return res;
+void MoveList::push_back(Move move) {
+  DEBUG_CHECK(size_ < max_moves, "MoveList is full.");
+  moves_[size_++] = move;
 }
 
-int rank_idx(Bitboard square) {
-  const int idx = square_idx(square);
-  return idx / 8;
+MoveList::iterator MoveList::erase(iterator first, iterator last) {
+  iterator new_end = std::move(last, end(), first);
+  size_ = static_cast<size_t>(new_end - begin());
+  return first;
 }
 
-int file_idx(Bitboard square) {
-  const int idx = square_idx(square);
-  return 7 - idx % 8;
+bool operator==(const MoveList& lhs, const MoveList& rhs) {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
+
+bool operator==(const Unmove& lhs, const Unmove& rhs) {
+  return lhs.move_ == rhs.move_ &&
+         lhs.captured_piece_ == rhs.captured_piece_ &&
+         lhs.castling_rights_ == rhs.castling_rights_;
+}
+
+void UnmoveList::push_back(const Unmove& unmove) {
+  DEBUG_CHECK(size_ < max_unmoves, "UnmoveList is full.");
+  unmoves_[size_++] = unmove;
 }
 
-bool on_a_file(Bitboard square) { return file_idx(square) == 0; }
+// Check that the bitboard has exactly one bit set.
+Piece promotion_piece(MoveType move_type) {
+  switch (move_type) {
+    case MoveType::promotion_to_rook:
+      return Piece::rook;
+    case MoveType::promotion_to_bishop:
+      return Piece::bishop;
+    case MoveType::promotion_to_knight:
+      return Piece::knight;
+    case MoveType::promotion_to_queen:
+      return Piece::queen;
+    default:
+      ABSL_RAW_CHECK(false, "Not a promotion.");
+      return Piece::pawn;
+  }
+}
 
-bool on_h_file(Bitboard square) { return file_idx(square) == 7; }
+absl::optional<Move> Board::legal_move(Bitboard src_square,
+                                       Bitboard dst_square,
+                                       Piece promotion) const {
+  const Color side = is_whites_move_ ? Color::white : Color::black;
+  if (!(src_square & friends(side))) {
+    return absl::nullopt;
+  }
+  const Piece piece = mailbox_[static_cast<size_t>(square_idx(src_square))];
+  MoveType move_type =
+      dst_square & enemies(side) ? MoveType::capture : MoveType::simple;
+  if (promotion != Piece::none) {
+    switch (promotion) {
+      case Piece::rook:
+        move_type = MoveType::promotion_to_rook;
+        break;
+      case Piece::bishop:
+        move_type = MoveType::promotion_to_bishop;
+        break;
+      case Piece::knight:
+        move_type = MoveType::promotion_to_knight;
+        break;
+      case Piece::queen:
+        move_type = MoveType::promotion_to_queen;
+        break;
+      default:
+        return absl::nullopt;
+    }
+  } else if (piece == Piece::pawn && dst_square == en_passant_square_) {
+    move_type = MoveType::en_passant;
+  } else if (piece == Piece::pawn &&
+             std::abs(square_idx(dst_square) - square_idx(src_square)) ==
+                 2 * board_size) {
+    move_type = MoveType::two_step_pawn;
+  } else if (piece == Piece::king) {
+    for (const CastlingPath& path :
+         {castling_path(side, MoveType::castle_kingside),
+          castling_path(side, MoveType::castle_queenside)}) {
+      // Without the right, the king move onto the square of the path is a
+      // plain one: in Chess960 the rook files are kept once the rights are
+      // lost, and an ordinary king step can land on them.
+      const Move castle = path.king_move_;
+      if (has_castling_rights(path.right_) &&
+          castle.src_idx_ == square_idx(src_square) &&
+          castle.dst_idx_ == square_idx(dst_square)) {
+        const bool is_legal = castle.move_type_ == MoveType::castle_kingside
+                                  ? is_castle_kingside_legal()
+                                  : is_castle_queenside_legal();
+        return is_legal ? absl::make_optional(castle) : absl::nullopt;
+      }
+    }
+  }
+  const Move move(src_square, dst_square, piece, move_type);
+  if (!is_move_pseudolegal(move)) {
+    return absl::nullopt;
+  }
+  // `is_legal` only reads the checkers and the pins, so the check squares
+  // and discoverers aren't computed.
+  CheckInfo info;
+  info.checkers_ =
+      attackers_to(pieces(side, Piece::king), all_pieces()) & enemies(side);
+  info.pinned_ = pinned_pieces(side);
+  if (!is_legal(move, info)) {
+    return absl::nullopt;
+  }
+  return move;
+}
 
-bool on_first_rank(Bitboard square) { return rank_idx(square) == 0; }
-bool on_eigth_rank(Bitboard square) { return rank_idx(square) == 7; }
+absl::optional<Move> parse_uci_move(const Board& board,
+                                    absl::string_view str) {
+  if (str.size() != 4 && str.size() != 5) {
+    return absl::nullopt;
+  }
+  for (size_t i = 0; i < 4; i += 2) {
+    if (str[i] < 'a' || str[i] > 'h' || str[i + 1] < '1' || str[i + 1] > '8') {
+      return absl::nullopt;
+    }
+  }
+  Piece promotion = Piece::none;
+  if (str.size() == 5) {
+    switch (str[4]) {
+      case 'r':
+        promotion = Piece::rook;
+        break;
+      case 'b':
+        promotion = Piece::bishop;
+        break;
+      case 'n':
+        promotion = Piece::knight;
+        break;
+      case 'q':
+        promotion = Piece::queen;
+        break;
+      default:
+        return absl::nullopt;
+    }
+  }
+  return board.legal_move(str_to_square(str.substr(0, 2)),
+                          str_to_square(str.substr(2, 2)), promotion);
+}
 
 Bitboard north_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   // TODO: Make sure right shifting off the end is not undefined behavior.
   return square << board_size;
 }
 
 Bitboard south_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   return square >> board_size;
 }
 
 Bitboard east_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   return on_h_file(square) ? 0 : square >> 1;
 }
 
 Bitboard west_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   return on_a_file(square) ? 0 : square << 1;
 }
 
 Bitboard northeast_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   const Bitboard north_square = north_of(square);
   return north_square ? east_of(north_square) : 0;
 }
 
 Bitboard northwest_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   const Bitboard north_square = north_of(square);
   return north_square ? west_of(north_square) : 0;
 }
 
 Bitboard southeast_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   const Bitboard south_square = south_of(square);
   return south_square ? east_of(south_square) : 0;
 }
 
 Bitboard southwest_of(Bitboard square) {
-  ABSL_RAW_CHECK(is_square(square), "Is not square.");
+  DEBUG_CHECK(is_square(square), "Is not square.");
   const Bitboard south_square = south_of(square);
   return south_square ? west_of(south_square) : 0;
 }
@@ -1207,48 +3345,10 @@ std::function<Bitboard(Bitboard)> direction_to_function(Direction direction) {
   }
 }
 
-Bitboard str_to_square(const absl::string_view algebraic_square) {
-  // std::cout << algebraic_square << std::endl;
-  const char file_char = algebraic_square[0];
-  const char rank_char = algebraic_square[1];
-  // ABSL_RAW_CHECK('a' <= file_char && file_char <= 'h', "Invalid file.");
-  // ABSL_RAW_CHECK('1' <= rank_char && rank_char <= '8', "Invalid rank.");
-  const int file = file_char - 'a';
-  const int rank = rank_char - '1';
-  // std::cout << "file " << file << std::endl;
-  // std::cout << "rank " << rank << std::endl;
-  // ABSL_RAW_CHECK(
-  //     0 <= file && file < board_size && 0 <= rank && rank < board_size,
-  //     "Oh no.");
-  return coordinates_to_square(file, rank);
-}
-
 std::string square_to_str(Bitboard sq) {
-  // ABSL_RAW_CHECK(is_square(sq), "Not a square.");
-  char rank = rank_idx(sq);
-  char file = file_idx(sq);
-  std::string res;
-  res.push_back('a' + file);
-  res.push_back('1' + rank);
-  return res;
-}
-
-Bitboard coordinates_to_square(int file, int rank) {
-  // std::cout << "rank " << file << std::endl;
-  // std::cout << "shift " << rank * board_size + board_size - file - 1;
-  // std::cout << "hello\n";
-  return lsb_bitboard << (rank * board_size + board_size - file - 1);
-}
-
-std::vector<Bitboard> bitboard_split(Bitboard bb) {
-  std::vector<Bitboard> res;
-  while (bb) {
-    const Bitboard bb_with_lsb_cleared = bb & bb - 1;
-    const Bitboard bb_with_only_lsb = bb ^ bb_with_lsb_cleared;
-    res.push_back(bb_with_only_lsb);
-    bb = bb_with_lsb_cleared;
-  }
-  return res;
+  char buf[2];
+  write_square(square_idx(sq), buf);
+  return std::string(buf, 2);
 }
 
 Color flip_color(Color color) {
@@ -1257,40 +3357,19 @@ Color flip_color(Color color) {
 
 std::string bb_to_pretty_str(Bitboard bb) {
   Board board;
-  board.white_pawns_ = 0;
-  board.white_rooks_ = 0;
-  board.white_knights_ = 0;
-  board.white_bishops_ = 0;
-  board.white_queens_ = 0;
-  board.white_king_ = 0;
-  board.black_pawns_ = 0;
-  board.black_rooks_ = 0;
-  board.black_knights_ = 0;
-  board.black_bishops_ = 0;
-  board.black_queens_ = 0;
-  board.black_king_ = 0;
-  board.black_pawns_ = bb;
+  board.zero_all_bitboards();
+  *board.piece_bitboard(Color::black, Piece::pawn) = bb;
+  board.init_mailbox();
+  board.init_occupancy();
   return board.to_pretty_str();
 }
 
-Move castle_kingside_move(Color color, Board board) {
-  if (color == Color::white) {
-    return Move(str_to_square("e1"), str_to_square("g1"), Piece::king,
-                MoveType::castle_kingside, board);
-  } else {
-    return Move(str_to_square("e8"), str_to_square("g8"), Piece::king,
-                MoveType::castle_kingside, board);
-  }
+Move castle_kingside_move(Color color) {
+  return standard_castling_path(color, MoveType::castle_kingside).king_move_;
 }
 
-Move castle_queenside_move(Color color, Board board) {
-  if (color == Color::white) {
-    return Move(str_to_square("e1"), str_to_square("c1"), Piece::king,
-                MoveType::castle_queenside, board);
-  } else {
-    return Move(str_to_square("e8"), str_to_square("c8"), Piece::king,
-                MoveType::castle_queenside, board);
-  }
+Move castle_queenside_move(Color color) {
+  return standard_castling_path(color, MoveType::castle_queenside).king_move_;
 }
 
 int number_of_moves(Board board, int half_move_depth) {
@@ -1298,11 +3377,131 @@ int number_of_moves(Board board, int half_move_depth) {
     return 1;
   }
   int res = 0;
-  std::vector<Move> moves = board.legal_moves();
+  MoveList moves = board.legal_moves();
+  UndoInfo undo;
   for (Move move : moves) {
-    board.do_move(move);
+    board.do_move(move, &undo);
     res += number_of_moves(board, half_move_depth - 1);
-    board.undo_move(move);
+    board.undo_move(move, undo);
+  }
+  return res;
+}
+
+Bitboard AttackMaps::attacks(Color side) {
+  absl::optional<Bitboard>& res = attacks_[static_cast<size_t>(side)];
+  if (!res) {
+    res = board_.attack_squares(side);
+  }
+  return *res;
+}
+
+Bitboard AttackMaps::king_danger(Color side) {
+  absl::optional<Bitboard>& res = king_danger_[static_cast<size_t>(side)];
+  if (res) {
+    return *res;
+  }
+  const absl::optional<Bitboard>& enemy_attacks =
+      attacks_[static_cast<size_t>(flip_color(side))];
+  if (!enemy_attacks) {
+    res = board_.attack_squares(
+        flip_color(side),
+        board_.all_pieces() ^ board_.pieces(side, Piece::king));
+    return *res;
+  }
+  // Taking the king off only lengthens the rays that end on it, those of the
+  // sliders that check it.
+  const Bitboard king = board_.pieces(side, Piece::king);
+  const Color enemy = flip_color(side);
+  const Bitboard sliders = board_.pieces(enemy, Piece::bishop) |
+                           board_.pieces(enemy, Piece::rook) |
+                           board_.pieces(enemy, Piece::queen);
+  const Bitboard occupancy = board_.all_pieces();
+  Bitboard through_king = 0;
+  for (Bitboard checker :
+       bitboard_split(board_.attackers_to(king, occupancy) & sliders)) {
+    const int checker_idx = square_idx(checker);
+    through_king |=
+        piece_attacks(board_.mailbox_[static_cast<size_t>(checker_idx)],
+                      checker_idx, occupancy ^ king);
+  }
+  res = *enemy_attacks | through_king;
+  return *res;
+}
+
+AttackInfo::AttackInfo(const Board& board) {
+  const Bitboard occupancy = board.all_pieces();
+  for (Color side : {Color::white, Color::black}) {
+    const size_t color = static_cast<size_t>(side);
+    by_piece_[color].fill(0);
+    const Bitboard pawn_attacks = board.pawn_attack_squares(side);
+    const Bitboard pawn_double_attacks =
+        board.pawn_double_attack_squares(side);
+    by_piece_[color][static_cast<size_t>(Piece::pawn)] = pawn_attacks;
+    // A square is attacked by two pawns at most.
+    count_bits_[color] = {pawn_attacks ^ pawn_double_attacks,
+                          pawn_double_attacks, 0};
+    mobility_[color].fill(0);
+  }
+  for (Color side : {Color::white, Color::black}) {
+    const size_t color = static_cast<size_t>(side);
+    std::array<Bitboard, num_count_bits>& bits = count_bits_[color];
+    const Bitboard mobility_area =
+        ~board.friends(side) &
+        ~by_piece_[1 - color][static_cast<size_t>(Piece::pawn)];
+    for (Piece piece : non_pawn_pieces) {
+      const size_t piece_idx = static_cast<size_t>(piece);
+      for (Bitboard sq : bitboard_split(board.pieces(side, piece))) {
+        const Bitboard attacks =
+            piece_attacks(piece, square_idx(sq), occupancy);
+        Bitboard carry = attacks;
+        for (Bitboard& bit : bits) {
+          const Bitboard next_carry = bit & carry;
+          bit ^= carry;
+          carry = next_carry;
+        }
+        // The counts that overflowed stay at the largest.
+        for (Bitboard& bit : bits) {
+          bit |= carry;
+        }
+        by_piece_[color][piece_idx] |= attacks;
+        if (piece != Piece::king) {
+          mobility_[color][piece_idx] += popcount(attacks & mobility_area);
+        }
+      }
+    }
+    all_[color] = attacked_at_least(side, 1);
+    double_[color] = attacked_at_least(side, 2);
+    king_zone_[color] =
+        board.pieces(side, Piece::king) |
+        by_piece_[color][static_cast<size_t>(Piece::king)];
+  }
+}
+
+int AttackInfo::attack_count(Color side, int sq_idx) const {
+  int res = 0;
+  for (size_t i = 0; i < num_count_bits; ++i) {
+    res |= static_cast<int>(
+               (count_bits_[static_cast<size_t>(side)][i] >> sq_idx) & 1)
+           << i;
   }
   return res;
 }
+
+Bitboard AttackInfo::attacked_at_least(Color side, int n) const {
+  // Compares the counts with `n` from the highest bit down: `greater` has
+  // the squares whose counts are found larger, `equal` those whose bits
+  // have matched so far.
+  const std::array<Bitboard, num_count_bits>& bits =
+      count_bits_[static_cast<size_t>(side)];
+  Bitboard greater = 0;
+  Bitboard equal = ~Bitboard{0};
+  for (size_t i = num_count_bits; i-- > 0;) {
+    if ((n >> i) & 1) {
+      equal &= bits[i];
+    } else {
+      greater |= equal & bits[i];
+      equal &= ~bits[i];
+    }
+  }
+  return greater | equal;
+}
@@ -2,36 +2,68 @@
 #define BOARD_H
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <initializer_list>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "bitboard.h"
 
-// Each bit of a Bitboard represents a square. The a8 square is the most
-// significant bit and the h1 square is the least significant bit. So the
-// unsigned 64 bit integer 10000000 00000000 00000000 00000000 00000000 00000000
-// 00000000 00000100 represents the board:
-
-// 8 | 1000 0000
-// 7 | 0000 0000
-// 6 | 0000 0000
-// 5 | 0000 0000
-// 4 | 0000 0000
-// 3 | 0000 0000
-// 2 | 0000 0000
-// 1 | 0000 0100
-//    -----------
-//     abcd efgh
-typedef uint64_t Bitboard;
+// How much state the moves keep up to date on top of the pieces is picked at
+// compile time with PAWN_GRABBER_BOARD_STATE, so that tools that only walk
+// the tree of moves don't pay for what only the search reads:
+//
+//   0: Nothing. `key_`, `pawn_key_`, `material_key_` and `psqt_` stay 0 and
+//      boards are hashed by their pieces.
+//   1: `key_` only, for perft's hash table and split counts.
+//   2: All of it. This is the default and what the engine needs.
+//
+// The CMake build has lean targets for perft, see CMakeLists.txt. The
+// accumulators of the neural evaluation aren't part of the board; the
+// searcher keeps them, see nnue.h.
+#ifndef PAWN_GRABBER_BOARD_STATE
+#define PAWN_GRABBER_BOARD_STATE 2
+#endif
+
+constexpr bool board_keeps_key = PAWN_GRABBER_BOARD_STATE >= 1;
+constexpr bool board_keeps_eval_state = PAWN_GRABBER_BOARD_STATE >= 2;
 
 enum class Color { white, black };
-enum class Piece { pawn, rook, knight, bishop, queen, king };
+// `none` marks an empty square in `Board::mailbox_` and is never the piece of
+// a move.
+enum class Piece : uint8_t { pawn, rook, knight, bishop, queen, king, none };
+const size_t num_colors = 2;
+// The number of pieces other than `none`.
+const size_t num_piece_types = 6;
+
+// Piece values in centipawns, indexed by Piece, used by the static exchange
+// evaluation. The king can never be captured, so its value only has to be
+// larger than anything else that can be won.
+constexpr std::array<int, num_piece_types> see_piece_values = {
+    100, 500, 325, 325, 975, 20000};
+
+constexpr int see_value(Piece piece) {
+  return see_piece_values[static_cast<size_t>(piece)];
+}
 
-enum class MoveType {
+// Castling rights are stored as a mask of these flags, one for each side and
+// wing.
+enum CastlingRights : uint8_t {
+  no_castling = 0,
+  white_kingside_castling = 1,
+  white_queenside_castling = 2,
+  black_kingside_castling = 4,
+  black_queenside_castling = 8,
+  all_castling = 15
+};
+
+enum class MoveType : uint8_t {
   simple,
   en_passant,
   castle_kingside,
@@ -55,12 +87,6 @@ enum class Direction {
   southwest
 };
 
-const int board_size = 8;
-// `lsb_bitboard is convenient for shift operations. The literal 1 has type int,
-// which has width 32 on x86, so `Bitboard bb = (1 << 50)` is undefined
-// behavior.
-constexpr Bitboard lsb_bitboard = 1;
-
 constexpr std::array<Direction, 8> all_directions = {
     Direction::north,     Direction::south,     Direction::east,
     Direction::west,      Direction::northeast, Direction::northwest,
@@ -77,10 +103,267 @@ constexpr std::array<std::pair<Direction, Direction>, 8>
         std::make_pair(Direction::south, Direction::southeast),
         std::make_pair(Direction::south, Direction::southwest)};
 
-struct Move;
+// A Move is packed into 32 bits: the square indices (see `square_idx`) of the
+// source and destination squares, the piece moving and the move type, which
+// also encodes the promotion piece. A Move carries no board state, so the state
+// needed to take a move back has to be kept by whoever does the move.
+struct Move {
+  uint8_t src_idx_;
+  uint8_t dst_idx_;
+  Piece piece_moving_;
+  MoveType move_type_;
+  // Left uninitialized so that a MoveList's slots cost nothing to create.
+  Move() = default;
+  // constexpr so that fixed moves, like castling, can be kept in tables.
+  constexpr Move(Bitboard p_src_square, Bitboard p_dst_square,
+                 Piece p_piece_moving, MoveType p_move_type)
+      : src_idx_(static_cast<uint8_t>(square_idx(p_src_square))),
+        dst_idx_(static_cast<uint8_t>(square_idx(p_dst_square))),
+        piece_moving_(p_piece_moving),
+        move_type_(p_move_type) {}
+  Bitboard src_square() const { return lsb_bitboard << src_idx_; }
+  Bitboard dst_square() const { return lsb_bitboard << dst_idx_; }
+  std::string to_pretty_str() const;
+  // Long algebraic notation as used by UCI, e.g. "e2e4" or "e7e8q".
+  std::string to_uci_str() const;
+  // The most characters `to_uci` writes, its null terminator included.
+  static constexpr size_t max_uci_size = 6;
+  // Writes the UCI string of the move to `buf`, which must have room for
+  // `max_uci_size` characters, null terminates it and returns its length.
+  size_t to_uci(char* buf) const;
+  // Appends the UCI string of the move to `out` without a temporary string.
+  void append_uci(std::string* out) const;
+  friend void PrintTo(const Move& move, std::ostream* os);
+};
+
+static_assert(sizeof(Move) == 4, "Move should pack into 32 bits.");
+
+bool operator==(const Move& lhs, const Move& rhs);
+
+// Lets absl containers and absl::Hash take moves as keys.
+template <typename H>
+H AbslHashValue(H h, const Move& move) {
+  return H::combine(std::move(h), move.src_idx_, move.dst_idx_,
+                    move.piece_moving_, move.move_type_);
+}
+
+// No legal chess position has more than 218 moves, and pseudolegal generation
+// stays under 256 as well.
+constexpr size_t max_moves = 256;
+
+// A fixed-capacity list of moves stored inline, so that move generation never
+// touches the heap. It has the parts of the std::vector interface the move
+// generators and tests use. Pushing past `max_moves` is a checked error.
+class MoveList {
+ public:
+  typedef Move value_type;
+  typedef Move* iterator;
+  typedef const Move* const_iterator;
+
+  MoveList() : size_(0) {}
+  MoveList(std::initializer_list<Move> moves);
+
+  iterator begin() { return moves_.data(); }
+  iterator end() { return moves_.data() + size_; }
+  const_iterator begin() const { return moves_.data(); }
+  const_iterator end() const { return moves_.data() + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  Move& operator[](size_t i) { return moves_[i]; }
+  const Move& operator[](size_t i) const { return moves_[i]; }
+
+  void push_back(Move move);
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    push_back(Move(std::forward<Args>(args)...));
+  }
+  // Removes the moves in [first, last), keeping the order of the rest.
+  iterator erase(iterator first, iterator last);
+  void clear() { size_ = 0; }
+
+ private:
+  std::array<Move, max_moves> moves_;
+  size_t size_;
+};
+
+bool operator==(const MoveList& lhs, const MoveList& rhs);
+
+// Sinks for the move generators that take one (see
+// `Board::generate_legal_moves`), for callers that only need to visit the
+// moves. A sink has the `push_back` and `emplace_back` of MoveList, which is
+// the sink that stores them.
+
+// Counts the moves.
+struct MoveCounter {
+  size_t num_moves_;
+
+  MoveCounter() : num_moves_(0) {}
+  void push_back(Move) { ++num_moves_; }
+  void emplace_back(Bitboard, Bitboard, Piece, MoveType) { ++num_moves_; }
+};
+
+// Collects the destination squares of the moves.
+struct DestinationCollector {
+  Bitboard squares_;
+
+  DestinationCollector() : squares_(0) {}
+  void push_back(Move move) { squares_ |= move.dst_square(); }
+  void emplace_back(Bitboard, Bitboard dst_square, Piece, MoveType) {
+    squares_ |= dst_square;
+  }
+};
+
+// A score with a middlegame and an endgame part, which the evaluation blends
+// by the game phase (see eval.h).
+struct TaperedScore {
+  int mg_;
+  int eg_;
+
+  constexpr TaperedScore& operator+=(TaperedScore rhs) {
+    mg_ += rhs.mg_;
+    eg_ += rhs.eg_;
+    return *this;
+  }
+  constexpr TaperedScore& operator-=(TaperedScore rhs) {
+    mg_ -= rhs.mg_;
+    eg_ -= rhs.eg_;
+    return *this;
+  }
+};
+
+constexpr bool operator==(TaperedScore lhs, TaperedScore rhs) {
+  return lhs.mg_ == rhs.mg_ && lhs.eg_ == rhs.eg_;
+}
+
+// A piece a move puts on, takes off or moves on the board.
+struct DirtyPiece {
+  Color color_;
+  Piece piece_;
+  // The square indices it leaves and lands on, -1 if it appears (a promoted
+  // piece) or disappears (a captured piece).
+  int from_idx_;
+  int to_idx_;
+};
+
+// Everything a move changes about the pieces, which is at most three of them:
+// the piece moved or promoted to, a captured piece or the promoted pawn, and
+// the rook when castling, or a captured piece and the promoted pawn.
+// `Board::do_move` hands it to the incremental state kept outside of the
+// board, such as the accumulators of nnue.h.
+struct DirtyPieces {
+  size_t size_;
+  std::array<DirtyPiece, 3> pieces_;
+};
+
+// The part of the board state that `Board::do_move` overwrites and that can't
+// be recovered from the move itself. Whoever calls `do_move` owns the record,
+// usually one per ply in a preallocated stack, and passes the same record back
+// to `Board::undo_move`.
+struct UndoInfo {
+  absl::optional<Piece> captured_piece_;
+  // 0 if there is no en passant square.
+  Bitboard en_passant_square_;
+  uint8_t castling_rights_;
+  int fifty_move_clock_;
+  uint64_t key_;
+  uint64_t pawn_key_;
+  uint64_t material_key_;
+  TaperedScore psqt_;
+};
+
+// A move taken back by retrograde generation (see `Board::legal_unmoves`):
+// the move the side not to move played last, and what the position before it
+// had that the move doesn't tell. A position has many possible pasts, so the
+// position before gets only what the move needs: an en passant square only
+// for an en passant capture, the castling rights of the position after plus
+// those a castling move gave up, and a fifty move clock one lower, or 0 for a
+// capture or pawn move.
+struct Unmove {
+  Move move_;
+  // The piece of the side to move that `move_` captured, a pawn for en
+  // passant, or Piece::none.
+  Piece captured_piece_;
+  // The castling rights of the position before.
+  uint8_t castling_rights_;
+};
+
+bool operator==(const Unmove& lhs, const Unmove& rhs);
+
+// Every piece of a side, taken back along each of its moves with each piece it
+// may have captured, stays under this.
+constexpr size_t max_unmoves = 2048;
+
+// A fixed-capacity list of unmoves, like MoveList. Pushing past `max_unmoves`
+// is a checked error.
+class UnmoveList {
+ public:
+  typedef Unmove value_type;
+  typedef Unmove* iterator;
+  typedef const Unmove* const_iterator;
+
+  UnmoveList() : size_(0) {}
+
+  iterator begin() { return unmoves_.data(); }
+  iterator end() { return unmoves_.data() + size_; }
+  const_iterator begin() const { return unmoves_.data(); }
+  const_iterator end() const { return unmoves_.data() + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const Unmove& operator[](size_t i) const { return unmoves_[i]; }
+
+  void push_back(const Unmove& unmove);
+  void clear() { size_ = 0; }
+
+ private:
+  std::array<Unmove, max_unmoves> unmoves_;
+  size_t size_;
+};
+
+// What `Board::is_legal` and `Board::gives_check` need to know about a
+// position, computed once by `Board::check_info` so that testing each move is
+// a few mask operations instead of doing the move on a copy of the board.
+struct CheckInfo {
+  // The enemy pieces that attack the king of the side to move.
+  Bitboard checkers_;
+  // The pieces of the side to move that are pinned to their king.
+  Bitboard pinned_;
+  // The pieces of the side to move that give check by leaving their line to
+  // the enemy king.
+  Bitboard discoverers_;
+  // The squares each piece of the side to move gives check from, indexed by
+  // Piece.
+  std::array<Bitboard, num_piece_types> check_squares_;
+};
+
+// Everything castling on one wing involves, so that castling code can look it
+// up instead of branching on the color and wing. In Chess960 the king and the
+// rook start on any files, the king on either side of the rook's, and end on
+// the squares they end on in standard chess.
+struct CastlingPath {
+  // no_castling for a king and rook that can't castle with each other.
+  CastlingRights right_;
+  // The squares the king and the rook cross or land on, but their own, which
+  // must be empty.
+  Bitboard empty_squares_;
+  // The squares the king starts on, crosses and lands on, which must not be
+  // attacked.
+  Bitboard king_path_;
+  // The move of the king, as generated: in standard chess to its square, g1
+  // or c1 for white, and in Chess960 onto its own rook, so that the move
+  // tells the rook apart when the king only moves one square or none.
+  Move king_move_;
+  Move rook_move_;
+  // The square the king lands on.
+  Bitboard king_dst_;
+};
+
+class AttackMaps;
+struct AttackInfo;
 
 // The Board struct stores the current board state. Each bitboard tracks all
-// places on the board there is a (piece, color) pair.
+// places on the board there is a (piece, color) pair. The bitboards are kept in
+// `pieces_`, indexed by color and then by piece, so that code can look up the
+// bitboard of either side instead of branching on the color.
 //
 // For example, the Bitboards of the following position
 //
@@ -105,54 +388,97 @@ struct Move;
 //
 // are:
 //
-// white_pawns_ == 0x0
-// white_rooks_ == 0x0
-// white_knights_ == 0x0
-// white_bishops_ == 0x0
-// white_queens_ == 0x0
-// white_king_ == 0x8
-// black_pawns_ == 0x0
-// black_rooks_ == 0x0
-// black_knights_ == 0x0
-// black_bishops_ == 0x0
-// black_queens_ == 0x0
-// black_king_ == 0x800000000000000.
+// pieces(Color::white, Piece::king) == 0x8
+// pieces(Color::black, Piece::king) == 0x800000000000000
+//
+// and 0x0 for the rest.
 //
 // The Board struct also tracks castling rights, the side to move, the move
 // number and the number of moves until the fifty move rule applies.
+//
+// Board holds no pointers and has the implicit copy operations, so it is
+// trivially copyable: copies compile to a memcpy and boards can be stored and
+// moved around as plain bytes.
 struct Board {
  public:
   // The default initializer intializes board to the starting position.
   Board();
+  // Aborts if `fen` isn't a FEN, see `parse_fen` for input that may not be.
+  // Positions that aren't legal are accepted, for tests.
   Board(absl::string_view fen);
-  Board(const Board& other);
-
-  Bitboard white_pawns_;
-  Bitboard white_rooks_;
-  Bitboard white_knights_;
-  Bitboard white_bishops_;
-  Bitboard white_queens_;
-  Bitboard white_king_;
-  Bitboard black_pawns_;
-  Bitboard black_rooks_;
-  Bitboard black_knights_;
-  Bitboard black_bishops_;
-  Bitboard black_queens_;
-  Bitboard black_king_;
-  bool is_whites_move_;
-  absl::optional<Bitboard> en_passant_square_;
-  bool white_has_right_to_castle_kingside_;
-  bool white_has_right_to_castle_queenside_;
-  bool black_has_right_to_castle_kingside_;
-  bool black_has_right_to_castle_queenside_;
+
+  std::array<std::array<Bitboard, num_piece_types>, num_colors> pieces_;
+  // The piece on each square, indexed by `square_idx`, or Piece::none. Kept in
+  // sync with the bitboards so that finding what is on a square takes one
+  // load instead of a scan over the twelve bitboards.
+  std::array<Piece, 64> mailbox_;
+  // The squares occupied by each color and by either, kept in sync with the
+  // bitboards so that the mask methods below are a single load.
+  Bitboard white_occupancy_;
+  Bitboard black_occupancy_;
+  Bitboard occupancy_;
+  // The square a pawn that just made a two-step move passed, or 0 if the last
+  // move wasn't one.
+  Bitboard en_passant_square_;
+  // The Zobrist key of the position (see zobrist.h), kept up to date by the
+  // do_*_move methods. This and the three below are 0 in builds that don't
+  // keep them, see PAWN_GRABBER_BOARD_STATE.
+  uint64_t key_;
+  // The key of the pawns alone (see `compute_pawn_key`), kept up to date the
+  // same way.
+  uint64_t pawn_key_;
+  // The key of the number of pieces of each kind (see
+  // `compute_material_key`), kept up to date the same way.
+  uint64_t material_key_;
+  // The material and piece-square table sums of the evaluation (see eval.h)
+  // from white's point of view, kept up to date like the key.
+  TaperedScore psqt_;
   int fifty_move_clock_;
   int num_moves_;
+  bool is_whites_move_;
+  // A mask of CastlingRights flags.
+  uint8_t castling_rights_;
+  // True if castling follows the Chess960 rules, where the kings and rooks
+  // start on any files, see `castling_rook_files_`.
+  bool is_chess960_;
+  // The file, 0 for the a-file, of the rook of each castling right, indexed
+  // by the index of its CastlingRights flag, so that one copy serves the
+  // whole game. Always 7, 0, 7, 0 in standard chess. They live in what would
+  // be the padding at the end of the board.
+  std::array<uint8_t, 4> castling_rook_files_;
 
   // Returns an array of all bitboards.
   std::array<Bitboard*, 12> all_bitboards();
+  // Returns the bitboard of the (piece, color) pair.
+  Bitboard* piece_bitboard(Color side, Piece piece);
+  Bitboard pieces(Color side, Piece piece) const {
+    return pieces_[static_cast<size_t>(side)][static_cast<size_t>(piece)];
+  }
+  // Returns true if any of the CastlingRights flags in `rights` is set.
+  bool has_castling_rights(uint8_t rights) const {
+    return (castling_rights_ & rights) != 0;
+  }
+  // Returns the bitboard of `piece` for both colors.
+  Bitboard pieces(Piece piece) const {
+    return pieces(Color::white, piece) | pieces(Color::black, piece);
+  }
+  // Returns the piece on `sq`, or nullopt if the square is empty.
+  absl::optional<Piece> piece_on(Bitboard sq) const;
 
   // Prints the board using unicode chess and line drawing symbols.
   std::string to_pretty_str() const;
+  // The most characters `to_fen` writes, its null terminator included: 71
+  // for the placement, 4 for the castling rights, 2 for the en passant
+  // square, 11 for each clock and 5 for the separators.
+  static constexpr size_t max_fen_size = 106;
+  // Writes the FEN of the board to `buf`, which must have room for
+  // `max_fen_size` characters, null terminates it and returns its length.
+  // Doesn't allocate, for writing out the FENs of many positions.
+  size_t to_fen(char* buf) const;
+  // Appends the FEN of the board to `out`, which only allocates if `out`
+  // has to grow, so a string reused across positions soon stops allocating.
+  void append_fen(std::string* out) const;
+  std::string to_fen() const;
   // Returns a unicode symbol for the piece on a given file and rank. Returns a
   // space if there is no piece on that square.
   std::string occupiers_unicode_symbol(int file, int rank) const;
@@ -162,19 +488,45 @@ struct Board {
   // Mask methods.
   //
   // Returns mask of all pieces with color `side`.
-  Bitboard friends(Color side) const;
+  Bitboard friends(Color side) const {
+    return side == Color::white ? white_occupancy_ : black_occupancy_;
+  }
   // Retuns a mask of all pieces that are the opposite color of `side`.
-  Bitboard enemies(Color side) const;
+  Bitboard enemies(Color side) const {
+    return side == Color::white ? black_occupancy_ : white_occupancy_;
+  }
   // Returns a mask of all white pieces.
-  Bitboard white_pieces() const;
+  Bitboard white_pieces() const { return white_occupancy_; }
   // Returns a mask of all black pieces.
-  Bitboard black_pieces() const;
+  Bitboard black_pieces() const { return black_occupancy_; }
   // Returns a mask of all pieces.
-  Bitboard all_pieces() const;
-  // Returns a mask of all squares attacked by pawns of color `side`.
+  Bitboard all_pieces() const { return occupancy_; }
+  // Returns a mask of all squares attacked by pawns of color `side`. Like
+  // the pawn move generators, it takes all the pawns at once, with a shift
+  // and a mask for each direction of capture.
   Bitboard pawn_attack_squares(Color side) const;
+  // Returns a mask of the squares attacked by two pawns of color `side`,
+  // which stay guarded by a pawn after one of them captures there.
+  Bitboard pawn_double_attack_squares(Color side) const;
   // Returns a mask of all squares attacked by `side`.
   Bitboard attack_squares(Color side) const;
+  // Same, with sliding attacks computed as if only `occupancy` were occupied.
+  Bitboard attack_squares(Color side, Bitboard occupancy) const;
+  // Returns a mask of the pieces of both colors that attack `square`, with
+  // sliding attacks computed as if only `occupancy` were occupied. Passing an
+  // occupancy without some piece lets callers see through it, e.g. the king
+  // when checking the squares it would move to.
+  Bitboard attackers_to(Bitboard square, Bitboard occupancy) const;
+  // Static exchange evaluation. Returns the material the side to move wins
+  // with `move`, in centipawns, if both sides then keep capturing on its
+  // destination square with their least valuable piece for as long as that
+  // pays off. Sliders lined up behind a capturing piece join in once it has
+  // moved. Pins, checks and recaptures that promote are ignored. Nothing is
+  // done on the board.
+  int see(Move move) const;
+  // Returns true if `see(move) >= threshold`, stopping as soon as the answer
+  // is known.
+  bool see_ge(Move move, int threshold) const;
 
   // Move generation methods.
   //
@@ -182,85 +534,374 @@ struct Board {
   // checking if the king is in check.
   void append_pseudolegal_sliding_moves(Direction direction, Color side,
                                         Bitboard src_square, Piece piece_moving,
-                                        std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_bishop_moves(Color side,
-                                       std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_rook_moves(Color side,
-                                     std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_queen_moves(Color side,
-                                      std::vector<Move>* res_ptr) const;
+                                        MoveList* res_ptr) const;
+  void append_pseudolegal_bishop_moves(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_rook_moves(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_queen_moves(Color side, MoveList* res_ptr) const;
   // "Simple" in this context means no two-step moves, no promotions, no en
   // passant and no captures.
   void append_pseudolegal_simple_pawn_moves(Color side,
-                                            std::vector<Move>* res_ptr) const;
+                                            MoveList* res_ptr) const;
   void append_pseudolegal_two_step_pawn_moves(Color side,
-                                              std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_en_passant_moves(Color side,
-                                           std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_promotions(Color side,
-                                     std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_pawn_captures(Color side,
-                                        std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_pawn_moves(Color side,
-                                     std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_king_moves(Color side,
-                                     std::vector<Move>* res_ptr) const;
-  void append_pseudolegal_knight_moves(Color side,
-                                       std::vector<Move>* res_ptr) const;
-  std::vector<Move> pseudolegal_moves(Color side) const;
+                                              MoveList* res_ptr) const;
+  void append_pseudolegal_en_passant_moves(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_promotions(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_pawn_captures(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_pawn_moves(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_king_moves(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_knight_moves(Color side, MoveList* res_ptr) const;
+  MoveList pseudolegal_moves(Color side) const;
+  // Hands the moves of `pseudolegal_moves` to `sink` in the same order,
+  // without storing them. Compiled for MoveList, MoveCounter and
+  // DestinationCollector.
+  template <typename Sink>
+  void generate_pseudolegal_moves(Color side, Sink* sink) const;
+  // Split the moves of `pseudolegal_moves` plus castling in two by masking
+  // the destination squares, so that a searcher can generate the moves it
+  // tries first without the rest, and a quiescence search only the first.
+  // The captures are the captures, e.p. captures and promotions to a queen.
+  // The quiet moves are everything else: moves to empty squares,
+  // underpromotions without a capture and the legal castling moves.
+  void append_pseudolegal_captures(Color side, MoveList* res_ptr) const;
+  void append_pseudolegal_quiet_moves(Color side, MoveList* res_ptr) const;
+  // The quiet moves other than castling and promotions that give check,
+  // directly or by uncovering a slider.
+  void append_pseudolegal_quiet_checks(Color side, MoveList* res_ptr) const;
+  MoveList pseudolegal_captures(Color side) const;
+  MoveList pseudolegal_quiet_moves(Color side) const;
+  MoveList pseudolegal_quiet_checks(Color side) const;
+  // Returns true if `move` is one of the moves the side to move could generate
+  // with the two methods above. Used to check moves that come from elsewhere,
+  // such as a hash table or a game being replayed, before doing them. Only
+  // castling generates moves to compare with.
+  bool is_move_pseudolegal(Move move) const;
   // Castling is not counted as a pseudolegal move. The castling_moves() method
   // uses is_castle_*_legal() methods to check if castling is legal.
   bool is_castle_kingside_legal() const;
   bool is_castle_queenside_legal() const;
-  void castling_moves(std::vector<Move>* res_ptr) const;
+  void castling_moves(MoveList* res_ptr) const;
+  // Same, taking the attacked squares from `maps`, which must belong to this
+  // position.
+  bool is_castle_kingside_legal(AttackMaps* maps) const;
+  bool is_castle_queenside_legal(AttackMaps* maps) const;
+  void castling_moves(AttackMaps* maps, MoveList* res_ptr) const;
+  // Returns the path of the castling move of `side` with `move_type`, which
+  // must be castle_kingside or castle_queenside, from the squares the king
+  // and the rook have in this position. Its right_ is no_castling if they
+  // can't castle on that wing.
+  const CastlingPath& castling_path(Color side, MoveType move_type) const;
+  // Returns true if any of `squares` is attacked by a piece of color `side`.
+  bool is_any_square_attacked(Bitboard squares, Color side) const;
   bool is_king_attacked(Color side) const;
   bool is_pseudolegal_move_legal(Move move) const;
-  std::vector<Move> legal_moves() const;
+  // Returns the CheckInfo of the position, for the side to move.
+  CheckInfo check_info() const;
+  // Returns true if the pseudolegal `move` of the side to move doesn't leave
+  // its king attacked. Same as `is_pseudolegal_move_legal`, but without doing
+  // the move. `info` must be the `check_info()` of this position.
+  bool is_legal(Move move, const CheckInfo& info) const;
+  // Returns the legal move of the side to move from `src_square` to
+  // `dst_square`, promoting to `promotion` unless it is Piece::none, or
+  // nullopt if there is none. Meant for checking moves that come in one at a
+  // time, as a game server does: the move is checked with a few attack table
+  // lookups and the checkers and pins of the position instead of generating
+  // every legal move. Castling is the king's move of `castling_path`.
+  absl::optional<Move> legal_move(Bitboard src_square, Bitboard dst_square,
+                                  Piece promotion = Piece::none) const;
+  // Returns true if `legal_move` finds a move.
+  bool is_legal(Bitboard src_square, Bitboard dst_square,
+                Piece promotion = Piece::none) const {
+    return legal_move(src_square, dst_square, promotion).has_value();
+  }
+  // Returns true if the pseudolegal `move` of the side to move attacks the
+  // enemy king, directly or by uncovering a slider, without doing the move.
+  bool gives_check(Move move, const CheckInfo& info) const;
+  // Returns the pieces of color `side` that are pinned to their own king.
+  Bitboard pinned_pieces(Color side) const;
+  // Returns the pieces of color `side` that are the only piece between one of
+  // its sliders and the enemy king, so moving them off the line gives check.
+  Bitboard discovered_check_candidates(Color side) const;
+  // Generates the legal moves directly: king moves are checked against the
+  // squares attacked with the king removed, and pinned pieces stay on the line
+  // through their king. In check the moves come from `legal_evasions`. Only
+  // en passant, whose discovered checks don't fit the pin masks, falls back
+  // to doing the move.
+  MoveList legal_moves() const;
+  // Hands the moves of `legal_moves` to `sink` in the same order, without
+  // storing them. The generator is compiled for each of MoveList, MoveCounter
+  // and DestinationCollector, so that counting the moves or collecting where
+  // they go costs the generation and nothing more.
+  template <typename Sink>
+  void generate_legal_moves(Sink* sink) const;
+  // The same, with the squares the enemy attacks taken from `info` rather
+  // than computed again, for a caller that has computed them for the
+  // evaluation.
+  template <typename Sink>
+  void generate_legal_moves(const AttackInfo& info, Sink* sink) const;
+  // The number of legal moves, counted by `generate_legal_moves`.
+  size_t num_legal_moves() const;
+  // Hands `sink` the legal moves of the side to move's `piece`s on `origins`
+  // that land on `targets`, for resolving a move from its notation or a click
+  // without generating the others. Only those pieces' attacks are looked up,
+  // masked by the check and pin masks of `legal_moves`, so asking for the
+  // moves to one square costs about as much as checking one move. The moves
+  // come in no particular order. Castling is the king's move to the
+  // destination of `castling_path`'s king move.
+  template <typename Sink>
+  void generate_legal_moves(Piece piece, Bitboard targets, Bitboard origins,
+                            Sink* sink) const;
+  MoveList legal_moves(Piece piece, Bitboard targets,
+                       Bitboard origins = ~Bitboard{0}) const;
+  // The legal moves of the side to move, which must be in check: king moves,
+  // and unless it is a double check, captures of the checker and moves onto
+  // the squares between it and the king by pieces that aren't pinned.
+  MoveList legal_evasions() const;
+  // Returns true if the side to move has a legal move, so that checkmate and
+  // stalemate are found without generating every move. Stops at the first
+  // piece with a legal move, trying the cheapest first: king steps against
+  // the attackers of each square, knights, pawns set-wise, then sliders.
+  bool has_any_legal_move() const;
+  // Sets `*res_ptr` to the squares each piece of the side to move can legally
+  // move to, by its square index, and 0 for the other squares: the legal
+  // moves as clients highlight them, filled straight from the attack tables
+  // with the pins and check masks of `legal_moves` instead of making a Move
+  // for each. Castling is the destination of the king's move of
+  // `castling_path`, and the four promotions to a square are that square.
+  void legal_targets(std::array<Bitboard, 64>* res_ptr) const;
+  // The squares the piece on `src_square` can legally move to, 0 if it isn't
+  // a piece of the side to move.
+  Bitboard legal_targets(Bitboard src_square) const;
+
+  // Retrograde move generation, for walking back from a position as
+  // tablebase generators and problem solvers do.
+  //
+  // Appends the last moves the side not to move may have played, taken back
+  // with the same attack tables the forward generator uses: each piece back
+  // to the empty squares it attacks, pawns one or two steps back or
+  // diagonally, with or without a capture of each piece of the side to move
+  // that can stand on the square, and promotions, en passant captures and
+  // castling. Only the squares are checked.
+  void append_pseudolegal_unmoves(UnmoveList* res_ptr) const;
+  // The pseudolegal unmoves after which the position before is legal, the
+  // move is legal in it and doing the move gives this position back, castling
+  // rights and en passant square included.
+  UnmoveList legal_unmoves() const;
+  // Takes back `unmove`, one of the `append_pseudolegal_unmoves` of this
+  // position, so that the board becomes the position before it.
+  void do_unmove(const Unmove& unmove);
 
   // Methods for performing moves.
+  //
+  // Flips `squares` in the occupancy of `side` and in the total occupancy.
+  void toggle_occupancy(Color side, Bitboard squares);
   void remove_piece_on(Bitboard sq);
+  // Puts `piece` of `color` on the empty square `sq`.
+  void put_piece_on(Color color, Piece piece, Bitboard sq);
   void do_en_passant_move(Move move);
   void do_castle_move(Move move);
   void do_promotion_move(Move move);
   void do_capture_move(Move move);
   void do_simple_move(Move move);
-  void undo_move(Move move);
+  // Returns the pieces `move` changes on this board, the board before the
+  // move.
+  DirtyPieces dirty_pieces(Move move) const;
   void do_move(Move move);
+  // Does `move` and saves what is needed to take it back in `undo`.
+  void do_move(Move move, UndoInfo* undo);
+  // As above, and writes the pieces the move changed to `dirty`, for the
+  // incremental state kept outside of the board.
+  void do_move(Move move, UndoInfo* undo, DirtyPieces* dirty);
+  // Takes back `move`, which must be the last move done on this board, using
+  // the record filled in by `do_move`. Only the bitboards the move touched are
+  // changed.
+  void undo_move(Move move, const UndoInfo& undo);
+  // Passes the turn to the other side without moving, for null move pruning.
+  // The side to move must not be in check.
+  void do_null_move(UndoInfo* undo);
+  void undo_null_move(const UndoInfo& undo);
+
+  // Returns the board with the colors swapped and the ranks mirrored, the
+  // same position seen from the other side, with the same clocks. The
+  // bitboards are byte swapped and the keys are carried over rather than
+  // computed again.
+  Board flipped() const;
+  // The key of `flipped()`, which follows from `key_` alone (see zobrist.h),
+  // so that it is kept up to date along with it.
+  uint64_t flipped_key() const;
+  // The smaller of `key_` and `flipped_key()`, which a position and its
+  // flipped twin share, for caches and deduplication that count them as one.
+  uint64_t canonical_key() const;
+
+  // Returns true if the redundant parts of the state agree with each other:
+  // the bitboards don't overlap and match the mailbox and occupancy, the
+  // castling rights and e.p. square are well formed, and `key_`, `pawn_key_`,
+  // `material_key_` and `psqt_` are what computing them from scratch gives.
+  // Slow, meant for tests and checked builds.
+  bool has_consistent_state() const;
 
   // Initialization helper methods.
   void zero_all_bitboards();
-  void init_bitboards(const absl::string_view pieces_fen);
-  void init_is_whites_move(const absl::string_view pieces_fen);
-  void init_castling_rights(const absl::string_view castling_rights_fen);
-  void init_en_passant(const absl::string_view algebraic_square);
+  // Fills `mailbox_` from the bitboards.
+  void init_mailbox();
+  // Computes the occupancy bitboards from the piece bitboards.
+  void init_occupancy();
+  // Computes `key_`, `pawn_key_`, `material_key_` and `psqt_` from the
+  // pieces, those the build keeps, and zeroes the others.
+  void init_state();
+  // Sets the board to `fen` and returns null, or returns what is wrong with
+  // the syntax of `fen` and leaves the board in an unspecified state. The
+  // position itself isn't checked, see `position_error`. With `chess960` the
+  // castling rights KQkq stand for the outermost rook on that side of the
+  // king, as in X-FEN. Rights given as rook files, A-H and a-h as in
+  // Shredder-FEN, make the board a Chess960 one in either case.
+  const char* set_fen(absl::string_view fen, bool chess960 = false);
+  // Returns what makes the position impossible to play from, or null: kings
+  // missing, pawns on the back ranks, the side not to move in check, castling
+  // rights without their king and rook on the back rank, the rook on the
+  // wrong side of the king, or an en passant square without the pawn that
+  // passed it.
+  const char* position_error() const;
 };
 
+static_assert(std::is_trivially_copyable<Board>::value,
+              "Board must be copyable with memcpy.");
+static_assert(std::is_standard_layout<Board>::value,
+              "Board must have a plain C layout.");
+static_assert(sizeof(Board) == 240 && alignof(Board) == 8,
+              "Board layout changed.");
+
+// Compares the keys first, so that boards of different positions, nearly
+// all of those a hash table compares, are told apart by one comparison.
 bool operator==(const Board& lhs, const Board& rhs);
 
-struct Move {
-  Bitboard src_square_;
-  Bitboard dst_square_;
-  Piece piece_moving_;
-  MoveType move_type_;
-  Board board_state_;
-  // TODO: Remove this default initializer?
-  Move();
-  Move(Bitboard p_src_square, Bitboard p_dst_square, Piece p_piece_moving,
-       MoveType p_move_type, Board p_board_state);
-  std::string to_pretty_str() const;
-  friend void PrintTo(const Move& move, std::ostream* os);
+// Hashes a board by its Zobrist key, which the moves keep up to date, so that
+// absl containers keyed by positions neither hash the whole board nor build
+// a FEN. Equal boards have equal keys; boards that differ only in their move
+// counters share a key and are told apart by `operator==`. Builds without the
+// key hash what it covers instead.
+template <typename H>
+H AbslHashValue(H h, const Board& board) {
+  if constexpr (board_keeps_key) {
+    return H::combine(std::move(h), board.key_);
+  } else {
+    return H::combine(std::move(h), board.pieces_, board.is_whites_move_,
+                      board.castling_rights_, board.en_passant_square_);
+  }
+}
+
+// Policies for walking the tree of moves below a board, for code templated on
+// how moves are taken back. `visit(board, move, f)` calls `f` with a pointer
+// to the position after `move`, and leaves `*board` as it was.
+//
+// Make/unmake does the move on the board itself, and takes it back from an
+// `UndoInfo` on the stack.
+struct MakeUnmake {
+  template <typename F>
+  static void visit(Board* board, Move move, F&& f) {
+    UndoInfo undo;
+    board->do_move(move, &undo);
+    f(board);
+    board->undo_move(move, undo);
+  }
 };
 
-bool operator==(const Move& lhs, const Move& rhs);
+// Copy-make does the move on a copy of the board, on the stack, so that the
+// copies along the current line make a stack of positions and taking a move
+// back is dropping its copy. It trades the reads and writes of undoing for a
+// copy of the whole board.
+struct CopyMake {
+  template <typename F>
+  static void visit(Board* board, Move move, F&& f) {
+    Board child(*board);
+    child.do_move(move);
+    f(&child);
+  }
+};
+
+// The squares attacked by each kind of piece of both sides, computed once
+// for a position in one pass over the pieces, for the terms of the
+// evaluation that come from the attacks (see `evaluate_attacks` in eval.h)
+// and for the legal move generator, which needs the squares the enemy
+// attacks. Pawns are taken set-wise, the other pieces one at a time.
+struct AttackInfo {
+  // The bits of the attack counts of `count_bits_`.
+  static constexpr size_t num_count_bits = 3;
+  static constexpr int max_attack_count = (1 << num_count_bits) - 1;
+
+  explicit AttackInfo(const Board& board);
+
+  // How many pieces of `side` attack the square with index `sq_idx`, up to
+  // `max_attack_count`, which stands for that many or more.
+  int attack_count(Color side, int sq_idx) const;
+  // The squares `side` attacks with `n` pieces or more, for `n` from 0 to
+  // `max_attack_count`.
+  Bitboard attacked_at_least(Color side, int n) const;
+
+  // Indexed by Color and then by Piece.
+  std::array<std::array<Bitboard, num_piece_types>, num_colors> by_piece_;
+  // The squares each side attacks, and those it attacks with two pieces or
+  // more, indexed by Color.
+  std::array<Bitboard, num_colors> all_;
+  std::array<Bitboard, num_colors> double_;
+  // The number of pieces of each side that attack each square, for all
+  // squares at once: bit `i` of the count of a square is its bit in
+  // `count_bits_[color][i]`. The attacks of the pieces are added with a
+  // ripple-carry adder on the bitboards, which stops at `max_attack_count`.
+  // Indexed by Color and then by the bit.
+  std::array<std::array<Bitboard, num_count_bits>, num_colors> count_bits_;
+  // The square of each side's king and the squares next to it, indexed by
+  // Color.
+  std::array<Bitboard, num_colors> king_zone_;
+  // The squares the pieces of each kind can move to that aren't taken by
+  // pieces of their own side or attacked by enemy pawns, added up over the
+  // pieces, indexed by Color and then by Piece. 0 for pawns and kings.
+  std::array<std::array<int, num_piece_types>, num_colors> mobility_;
+};
+
+// The squares each color attacks in one position, computed the first time
+// they are asked for and then kept. Castling legality, king moves and king
+// safety in the same node share one scan of the pieces instead of each
+// looking for attackers again. The maps keep a reference to the board, which
+// must not change while they are used.
+class AttackMaps {
+ public:
+  explicit AttackMaps(const Board& board) : board_(board) {}
+  // Takes the attacks of both sides from `info`.
+  AttackMaps(const Board& board, const AttackInfo& info)
+      : board_(board), attacks_{{info.all_[0], info.all_[1]}} {}
+
+  // Returns `board.attack_squares(side)`.
+  Bitboard attacks(Color side);
+  // Returns the squares the king of `side` must not move to: those the enemy
+  // attacks with that king taken off the board, so that it can't shelter
+  // behind itself from a slider that checks it. Once the enemy's attacks are
+  // known, only the attacks of the checking sliders are computed again.
+  Bitboard king_danger(Color side);
+
+ private:
+  const Board& board_;
+  std::array<absl::optional<Bitboard>, num_colors> attacks_;
+  std::array<absl::optional<Bitboard>, num_colors> king_danger_;
+};
+
+Piece promotion_piece(MoveType move_type);
+
+// Returns the legal move of the side to move of `board` whose UCI string is
+// `str`, or nullopt if there is none. The squares are read off the string and
+// the move checked by `Board::legal_move`, rather than comparing `str` with
+// the string of every legal move.
+absl::optional<Move> parse_uci_move(const Board& board, absl::string_view str);
 
-bool is_square(Bitboard);
-int square_idx(Bitboard square);
-int rank_idx(Bitboard square);
-int file_idx(Bitboard square);
-bool on_a_file(Bitboard square);
-bool on_h_file(Bitboard square);
-bool on_first_rank(Bitboard square);
-bool on_eigth_rank(Bitboard square);
+// Returns the position of `fen`, or nullopt if it isn't a FEN of a position
+// that can be played from (see `Board::position_error`), with
+// what is wrong in `*error` unless `error` is null. The fifty move clock and
+// move number may be left out, for 0 and 1, and fields may be separated by
+// any spaces or tabs. Parsing is a single pass that doesn't allocate, so it
+// suits bulk input where a bad line must not stop the rest. `chess960` is as
+// for `Board::set_fen`.
+absl::optional<Board> parse_fen(absl::string_view fen,
+                                const char** error = nullptr,
+                                bool chess960 = false);
 
 Bitboard north_of(Bitboard square);
 Bitboard south_of(Bitboard square);
@@ -272,15 +913,14 @@ Bitboard southeast_of(Bitboard square);
 Bitboard southwest_of(Bitboard square);
 std::function<Bitboard(Bitboard)> direction_to_function(Direction direction);
 
-Bitboard str_to_square(const absl::string_view alegbraic_square);
 std::string square_to_str(Bitboard sq);
-Bitboard coordinates_to_square(int file, int rank);
-std::vector<Bitboard> bitboard_split(Bitboard bb);
 Color flip_color(Color color);
 std::string bb_to_pretty_str(Bitboard bb);
 
-Move castle_kingside_move(Color color, Board board);
-Move castle_queenside_move(Color color, Board board);
+// The castling moves of standard chess. For a board that may be a Chess960
+// one, see `Board::castling_path`.
+Move castle_kingside_move(Color color);
+Move castle_queenside_move(Color color);
 
 int number_of_moves(Board board, int half_move_depth);
 
@@ -0,0 +1,222 @@
+#include "board_batch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "batch_attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "debug_check.h"
+#include "packed_position.h"
+
+namespace {
+constexpr uint8_t no_en_passant_idx = 64;
+constexpr unsigned black_nibble = 8;
+constexpr size_t line_size = 64;
+
+template <typename T>
+T clamp_to(int value) {
+  return static_cast<T>(std::min<int>(
+      std::max<int>(value, std::numeric_limits<T>::min()),
+      std::numeric_limits<T>::max()));
+}
+
+// Returns the number of cache lines of a column of `capacity` `T`s.
+template <typename T>
+size_t column_lines(size_t capacity) {
+  return (capacity * sizeof(T) + line_size - 1) / line_size;
+}
+}  // namespace.
+
+PieceColumns BoardBatchSlice::piece_columns() const {
+  PieceColumns res;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      res.pieces_[color][piece] = columns_.pieces_[color][piece];
+    }
+  }
+  return res;
+}
+
+Board BoardBatchSlice::board(size_t idx) const {
+  DEBUG_CHECK(idx < size_, "Position out of range.");
+  Board res;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      res.pieces_[color][piece] = columns_.pieces_[color][piece][idx];
+    }
+  }
+  res.init_mailbox();
+  res.init_occupancy();
+  const uint8_t flags = columns_.flags_[idx];
+  res.is_whites_move_ = !(flags & 1);
+  res.castling_rights_ = static_cast<uint8_t>((flags >> 1) & 0xF);
+  const uint8_t en_passant_idx = columns_.en_passant_idxs_[idx];
+  res.en_passant_square_ =
+      en_passant_idx < no_en_passant_idx ? lsb_bitboard << en_passant_idx : 0;
+  res.fifty_move_clock_ = columns_.fifty_move_clocks_[idx];
+  res.num_moves_ = columns_.num_moves_[idx];
+  res.init_state();
+  return res;
+}
+
+PackedPosition BoardBatchSlice::packed(size_t idx) const {
+  DEBUG_CHECK(idx < size_, "Position out of range.");
+  PackedPosition res = {};
+  // The nibble of each square, by square index, so that the nibbles can then
+  // be written in the order of the occupied squares.
+  std::array<uint8_t, 64> square_nibbles;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      const Bitboard squares = columns_.pieces_[color][piece][idx];
+      for (Bitboard sq : bitboard_split(squares)) {
+        square_nibbles[static_cast<size_t>(square_idx(sq))] =
+            static_cast<uint8_t>(piece | (color ? black_nibble : 0));
+      }
+      res.occupancy_ |= squares;
+    }
+  }
+  DEBUG_CHECK(popcount(res.occupancy_) <= 32, "Too many pieces to pack.");
+  size_t nibble_idx = 0;
+  for (Bitboard sq : bitboard_split(res.occupancy_)) {
+    res.pieces_[nibble_idx / 2] |= static_cast<uint8_t>(
+        square_nibbles[static_cast<size_t>(square_idx(sq))]
+        << (4 * (nibble_idx % 2)));
+    ++nibble_idx;
+  }
+  res.flags_ = columns_.flags_[idx];
+  res.en_passant_idx_ = columns_.en_passant_idxs_[idx];
+  res.fifty_move_clock_ = columns_.fifty_move_clocks_[idx];
+  res.result_ = columns_.results_[idx];
+  res.num_moves_ = columns_.num_moves_[idx];
+  res.score_ = columns_.scores_[idx];
+  return res;
+}
+
+void BoardBatchSlice::to_boards(Board* boards) const {
+  for (size_t i = 0; i < size_; ++i) {
+    boards[i] = board(i);
+  }
+}
+
+void BoardBatchSlice::to_packed(PackedPosition* packed_positions) const {
+  for (size_t i = 0; i < size_; ++i) {
+    packed_positions[i] = packed(i);
+  }
+}
+
+BoardBatchSlice BoardBatchSlice::slice(size_t begin, size_t size) const {
+  DEBUG_CHECK(begin <= size_ && size <= size_ - begin,
+              "Slice out of range.");
+  return BoardBatchSlice(offset_columns(begin), size);
+}
+
+BoardBatchSlice::Columns BoardBatchSlice::offset_columns(size_t offset) const {
+  Columns res = columns_;
+  for (auto& color_pieces : res.pieces_) {
+    for (Bitboard*& column : color_pieces) {
+      column += offset;
+    }
+  }
+  res.flags_ += offset;
+  res.en_passant_idxs_ += offset;
+  res.fifty_move_clocks_ += offset;
+  res.num_moves_ += offset;
+  res.scores_ += offset;
+  res.results_ += offset;
+  return res;
+}
+
+BoardBatch::BoardBatch(size_t capacity) : capacity_(capacity) {
+  const size_t padded_capacity =
+      (capacity + board_batch_alignment - 1) / board_batch_alignment *
+      board_batch_alignment;
+  const size_t num_lines =
+      num_colors * num_piece_types * column_lines<Bitboard>(padded_capacity) +
+      3 * column_lines<uint8_t>(padded_capacity) +
+      column_lines<uint16_t>(padded_capacity) +
+      column_lines<int16_t>(padded_capacity) +
+      column_lines<int8_t>(padded_capacity);
+  // Value initialized, which zeroes the padding.
+  lines_.reset(new Line[num_lines]());
+  Line* next_line = lines_.get();
+  // Returns the next column of `T`s.
+  const auto take_column = [padded_capacity, &next_line](auto* column) {
+    using T = typename std::remove_pointer<decltype(column)>::type;
+    column = reinterpret_cast<T*>(next_line);
+    next_line += column_lines<T>(padded_capacity);
+    return column;
+  };
+  for (auto& color_pieces : columns_.pieces_) {
+    for (Bitboard*& column : color_pieces) {
+      column = take_column(column);
+    }
+  }
+  columns_.flags_ = take_column(columns_.flags_);
+  columns_.en_passant_idxs_ = take_column(columns_.en_passant_idxs_);
+  columns_.fifty_move_clocks_ = take_column(columns_.fifty_move_clocks_);
+  columns_.num_moves_ = take_column(columns_.num_moves_);
+  columns_.scores_ = take_column(columns_.scores_);
+  columns_.results_ = take_column(columns_.results_);
+}
+
+void BoardBatch::clear() { size_ = 0; }
+
+void BoardBatch::push_back(const Board& board, int score, int result) {
+  DEBUG_CHECK(size_ < capacity_, "BoardBatch is full.");
+  DEBUG_CHECK(popcount(board.occupancy_) <= 32, "Too many pieces to pack.");
+  const size_t idx = size_++;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      columns_.pieces_[color][piece][idx] = board.pieces_[color][piece];
+    }
+  }
+  columns_.flags_[idx] = static_cast<uint8_t>(
+      (board.is_whites_move_ ? 0 : 1) | board.castling_rights_ << 1);
+  columns_.en_passant_idxs_[idx] =
+      board.en_passant_square_
+          ? static_cast<uint8_t>(square_idx(board.en_passant_square_))
+          : no_en_passant_idx;
+  columns_.fifty_move_clocks_[idx] =
+      clamp_to<uint8_t>(board.fifty_move_clock_);
+  columns_.num_moves_[idx] = clamp_to<uint16_t>(board.num_moves_);
+  columns_.scores_[idx] = clamp_to<int16_t>(score);
+  columns_.results_[idx] = clamp_to<int8_t>(result);
+}
+
+void BoardBatch::push_back(const PackedPosition& packed) {
+  DEBUG_CHECK(size_ < capacity_, "BoardBatch is full.");
+  const size_t idx = size_++;
+  // The bitboard of each nibble value, as in `unpack_position`.
+  std::array<Bitboard, 16> nibble_squares = {};
+  size_t nibble_idx = 0;
+  for (Bitboard sq : bitboard_split(packed.occupancy_)) {
+    const unsigned nibble =
+        (packed.pieces_[nibble_idx / 2] >> (4 * (nibble_idx % 2))) & 0xF;
+    DEBUG_CHECK((nibble & 7) < num_piece_types, "Not a packed piece.");
+    nibble_squares[nibble] |= sq;
+    ++nibble_idx;
+  }
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    columns_.pieces_[static_cast<size_t>(Color::white)][piece][idx] =
+        nibble_squares[piece];
+    columns_.pieces_[static_cast<size_t>(Color::black)][piece][idx] =
+        nibble_squares[piece | black_nibble];
+  }
+  columns_.flags_[idx] = packed.flags_;
+  columns_.en_passant_idxs_[idx] = packed.en_passant_idx_;
+  columns_.fifty_move_clocks_[idx] = packed.fifty_move_clock_;
+  columns_.num_moves_[idx] = packed.num_moves_;
+  columns_.scores_[idx] = packed.score_;
+  columns_.results_[idx] = packed.result_;
+}
+
+void count_legal_moves(BoardBatchSlice positions, uint16_t* counts) {
+  for (size_t i = 0; i < positions.size(); ++i) {
+    counts[i] = static_cast<uint16_t>(positions.board(i).legal_moves().size());
+  }
+}
@@ -0,0 +1,139 @@
+#ifndef BOARD_BATCH_H
+#define BOARD_BATCH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "batch_attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+
+// Many positions stored column by column, for kernels that work on a few
+// fields of many positions, such as those of batch_attacks.h: the white pawns
+// of every position one after another, then the white rooks, and so on, and
+// after the bitboards the rest of the state, a column per field. A kernel then
+// reads only the columns it needs, a whole cache line of each at a time, where
+// an array of `Board`s would bring in the mailbox, keys and sums of every
+// position with the few bitboards it wanted.
+//
+// The fields beside the bitboards are those of `PackedPosition`, with the
+// same encodings, score and result included, so that training data converts
+// either way field by field. The keys, sums and mailbox of a `Board` aren't
+// stored; they are computed when a board is taken out.
+
+// Every column starts on a cache line, and has room for a multiple of this
+// many positions, so that vectors of up to 8 bitboards can be loaded aligned,
+// and whole vectors can be loaded past the last position without reading out
+// of bounds. The room past the capacity stays zero.
+constexpr size_t board_batch_alignment = 8;
+
+// Consecutive positions of a `BoardBatch`, which must outlive the slice. A
+// slice is two words and a few pointers, and is passed by value. Its columns
+// are aligned as those of the batch if it starts at a multiple of
+// `board_batch_alignment`.
+class BoardBatchSlice {
+ public:
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const Bitboard* pieces(Color color, Piece piece) const {
+    return columns_.pieces_[static_cast<size_t>(color)]
+                           [static_cast<size_t>(piece)];
+  }
+  // The piece bitboards, as the kernels of batch_attacks.h take them.
+  PieceColumns piece_columns() const;
+  // Bit 0 is set with black to move, bits 1 to 4 are the CastlingRights.
+  const uint8_t* flags() const { return columns_.flags_; }
+  // The square index of the en passant square, or 64 for none.
+  const uint8_t* en_passant_idxs() const { return columns_.en_passant_idxs_; }
+  // Capped at 255.
+  const uint8_t* fifty_move_clocks() const {
+    return columns_.fifty_move_clocks_;
+  }
+  // Capped at 65535.
+  const uint16_t* num_moves() const { return columns_.num_moves_; }
+  // From the side to move's point of view.
+  const int16_t* scores() const { return columns_.scores_; }
+  // 1 if white won the game, -1 if black did and 0 for a draw.
+  const int8_t* results() const { return columns_.results_; }
+
+  // Returns position `idx` as a board, with its keys and sums computed.
+  Board board(size_t idx) const;
+  // Returns position `idx` packed, with its score and result.
+  PackedPosition packed(size_t idx) const;
+  // Writes every position to `boards[0, size())`.
+  void to_boards(Board* boards) const;
+  // Writes every position to `packed[0, size())`.
+  void to_packed(PackedPosition* packed) const;
+
+  // Returns positions [begin, begin + size) of this slice.
+  BoardBatchSlice slice(size_t begin, size_t size) const;
+
+ protected:
+  struct Columns {
+    std::array<std::array<Bitboard*, num_piece_types>, num_colors> pieces_;
+    uint8_t* flags_;
+    uint8_t* en_passant_idxs_;
+    uint8_t* fifty_move_clocks_;
+    uint16_t* num_moves_;
+    int16_t* scores_;
+    int8_t* results_;
+  };
+
+  BoardBatchSlice() = default;
+  BoardBatchSlice(const Columns& columns, size_t size)
+      : columns_(columns), size_(size) {}
+
+  // Returns the columns moved forward by `offset` positions.
+  Columns offset_columns(size_t offset) const;
+
+  Columns columns_ = {};
+  size_t size_ = 0;
+};
+
+// Owns the columns of up to `capacity()` positions, allocated once, and is a
+// slice of all the positions pushed so far. It can be moved, not copied, and a
+// batch moved from can only be destroyed or assigned to.
+class BoardBatch : public BoardBatchSlice {
+ public:
+  // Allocates room for `capacity` positions.
+  explicit BoardBatch(size_t capacity);
+  BoardBatch(const BoardBatch&) = delete;
+  BoardBatch& operator=(const BoardBatch&) = delete;
+  BoardBatch(BoardBatch&&) = default;
+  BoardBatch& operator=(BoardBatch&&) = default;
+
+  size_t capacity() const { return capacity_; }
+  bool full() const { return size_ == capacity_; }
+  // Removes every position, keeping the columns allocated.
+  void clear();
+
+  // Appends `board`, with `score` and the `result` of its game as
+  // `pack_position` stores them. The batch must not be full, and the board
+  // must be one `pack_position` takes.
+  void push_back(const Board& board, int score = 0, int result = 0);
+  // Appends `packed`, keeping all of its fields. The batch must not be full.
+  void push_back(const PackedPosition& packed);
+
+ private:
+  // A cache line. Columns are laid out in whole lines of one allocation.
+  struct alignas(64) Line {
+    std::array<uint8_t, 64> bytes_;
+  };
+
+  std::unique_ptr<Line[]> lines_;
+  size_t capacity_;
+};
+
+// Sets `counts[i]` to the number of legal moves of position `i` of
+// `positions`, for the last ply of a breadth-first perft (see `batch_perft`
+// in perft.h) and for labelling positions without moves in training data.
+// Each position only reads its own entries of the columns and writes its own
+// count, as a kernel of one thread per position would on a wide device; this
+// is the version for the CPU.
+void count_legal_moves(BoardBatchSlice positions, uint16_t* counts);
+
+#endif
@@ -0,0 +1,147 @@
+#include "board_batch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "batch_attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "perft.h"
+
+namespace {
+// The positions of random games from the perft suite.
+std::vector<Board> random_boards(size_t num_boards) {
+  std::mt19937 rng(5);
+  std::vector<Board> res;
+  while (res.size() < num_boards) {
+    Board board(perft_suite[res.size() % perft_suite.size()].fen_);
+    for (int ply = 0; ply < 80 && res.size() < num_boards; ++ply) {
+      res.push_back(board);
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[rng() % moves.size()]);
+    }
+  }
+  return res;
+}
+
+bool operator==(const PackedPosition& lhs, const PackedPosition& rhs) {
+  return lhs.occupancy_ == rhs.occupancy_ && lhs.pieces_ == rhs.pieces_ &&
+         lhs.flags_ == rhs.flags_ &&
+         lhs.en_passant_idx_ == rhs.en_passant_idx_ &&
+         lhs.fifty_move_clock_ == rhs.fifty_move_clock_ &&
+         lhs.result_ == rhs.result_ && lhs.num_moves_ == rhs.num_moves_ &&
+         lhs.score_ == rhs.score_;
+}
+}  // namespace.
+
+TEST(BoardBatch, PadsAndAlignsTheColumns) {
+  const BoardBatch batch(13);
+  EXPECT_EQ(batch.capacity(), 13);
+  EXPECT_TRUE(batch.empty());
+  for (Color color : {Color::white, Color::black}) {
+    for (Piece piece : {Piece::pawn, Piece::rook, Piece::knight,
+                        Piece::bishop, Piece::queen, Piece::king}) {
+      const Bitboard* const column = batch.pieces(color, piece);
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(column) % 64, 0);
+      for (size_t i = 0; i < 16; ++i) {
+        EXPECT_EQ(column[i], 0);
+      }
+    }
+  }
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(batch.flags()) % 64, 0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(batch.results()) % 64, 0);
+}
+
+TEST(BoardBatch, ConvertsBoards) {
+  const std::vector<Board> boards = random_boards(300);
+  BoardBatch batch(boards.size());
+  for (size_t i = 0; i < boards.size(); ++i) {
+    batch.push_back(boards[i], static_cast<int>(i) - 150,
+                    static_cast<int>(i % 3) - 1);
+  }
+  ASSERT_EQ(batch.size(), boards.size());
+  EXPECT_TRUE(batch.full());
+  std::vector<Board> unbatched(boards.size());
+  batch.to_boards(unbatched.data());
+  for (size_t i = 0; i < boards.size(); ++i) {
+    ASSERT_TRUE(unbatched[i] == boards[i]) << boards[i].to_fen();
+    EXPECT_TRUE(unbatched[i].has_consistent_state());
+    EXPECT_EQ(batch.pieces(Color::black, Piece::knight)[i],
+              boards[i].pieces_[static_cast<size_t>(Color::black)]
+                               [static_cast<size_t>(Piece::knight)]);
+    EXPECT_EQ(batch.scores()[i], static_cast<int>(i) - 150);
+    EXPECT_EQ(batch.results()[i], static_cast<int>(i % 3) - 1);
+  }
+}
+
+TEST(BoardBatch, ConvertsPackedPositions) {
+  const std::vector<Board> boards = random_boards(300);
+  std::vector<PackedPosition> packed;
+  for (size_t i = 0; i < boards.size(); ++i) {
+    packed.push_back(pack_position(boards[i], static_cast<int>(i) * 7,
+                                   static_cast<int>(i % 3) - 1));
+  }
+  BoardBatch batch(packed.size());
+  for (const PackedPosition& position : packed) {
+    batch.push_back(position);
+  }
+  std::vector<PackedPosition> repacked(packed.size());
+  batch.to_packed(repacked.data());
+  for (size_t i = 0; i < packed.size(); ++i) {
+    ASSERT_TRUE(repacked[i] == packed[i]) << boards[i].to_fen();
+    EXPECT_TRUE(batch.board(i) == unpack_position(packed[i]));
+  }
+}
+
+TEST(BoardBatch, SlicesAndClears) {
+  const std::vector<Board> boards = random_boards(40);
+  BoardBatch batch(boards.size());
+  for (const Board& board : boards) {
+    batch.push_back(board);
+  }
+  const BoardBatchSlice slice = batch.slice(8, 24).slice(8, 10);
+  ASSERT_EQ(slice.size(), 10);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(
+                slice.pieces(Color::white, Piece::pawn)) % 64,
+            0);
+  for (size_t i = 0; i < slice.size(); ++i) {
+    EXPECT_TRUE(slice.board(i) == boards[16 + i]);
+  }
+  std::vector<Bitboard> attacks(slice.size());
+  ASSERT_TRUE(batch_attack_squares(slice.piece_columns(), Color::black,
+                                   slice.size(), attacks.data()));
+  for (size_t i = 0; i < slice.size(); ++i) {
+    EXPECT_EQ(attacks[i], boards[16 + i].attack_squares(Color::black));
+  }
+
+  batch.clear();
+  EXPECT_TRUE(batch.empty());
+  batch.push_back(boards.back());
+  EXPECT_EQ(batch.size(), 1);
+  EXPECT_TRUE(batch.board(0) == boards.back());
+}
+
+TEST(CountLegalMoves, CountsEveryPosition) {
+  std::vector<Board> boards = random_boards(100);
+  // Mated, and stalemated.
+  boards.push_back(Board("R5k1/5ppp/8/8/8/8/8/6K1 b - - 1 1"));
+  boards.push_back(Board("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1"));
+  BoardBatch batch(boards.size());
+  for (const Board& board : boards) {
+    batch.push_back(board);
+  }
+  std::vector<uint16_t> counts(batch.size());
+  count_legal_moves(batch, counts.data());
+  for (size_t i = 0; i < boards.size(); ++i) {
+    EXPECT_EQ(counts[i], boards[i].legal_moves().size());
+  }
+  EXPECT_EQ(counts[boards.size() - 2], 0);
+  EXPECT_EQ(counts.back(), 0);
+}
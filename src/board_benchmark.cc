@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "batch_attacks.h"
+#include "benchmark/benchmark.h"
+#include "bitboard.h"
+#include "board.h"
+#include "perf_counters.h"
+#include "perft.h"
+#include "random_positions.h"
+
+// Microbenchmarks of the move generation primitives, each run over the same
+// positions, to put numbers on a change before and after it. Every benchmark
+// reports the positions it handled per second as items. With --counters each
+// also reports the hardware events of its loop per item (see
+// perf_counters.h), instructions, cycles, branch, cache and TLB misses, as
+// counters of the benchmark, where the system lets them be counted.
+//
+//   board_benchmark --benchmark_filter=LegalMoves
+//   board_benchmark --counters --benchmark_filter=Perft
+
+namespace {
+// Set by --counters.
+bool count_events = false;
+
+// The hardware events of a benchmark from where it is made, just before the
+// loop, with --counters.
+class EventCounter {
+ public:
+  EventCounter() : counters_(count_events ? new PerfCounters() : nullptr) {}
+
+  // Sets the items the benchmark processed, and with --counters its events
+  // per item.
+  void set_items_processed(benchmark::State& state, int64_t items) const {
+    state.SetItemsProcessed(items);
+    if (!counters_ || items <= 0) {
+      return;
+    }
+    const PerfCounts counts = counters_->read();
+    for (size_t i = 0; i < num_perf_events; ++i) {
+      if (counts.counts_[i]) {
+        state.counters[perf_event_name(static_cast<PerfEvent>(i))] =
+            static_cast<double>(*counts.counts_[i]) /
+            static_cast<double>(items);
+      }
+    }
+  }
+
+ private:
+  std::unique_ptr<PerfCounters> counters_;
+};
+
+// The usual perft positions: quiet, tactical, an endgame, promotions and
+// castling through checks.
+const char* const fens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+
+const std::vector<Board>& boards() {
+  static const std::vector<Board> res(std::begin(fens), std::end(fens));
+  return res;
+}
+
+Color side_to_move(const Board& board) {
+  return board.is_whites_move_ ? Color::white : Color::black;
+}
+
+void BM_LegalMoves(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : boards()) {
+      benchmark::DoNotOptimize(board.legal_moves());
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(boards().size()));
+}
+BENCHMARK(BM_LegalMoves);
+
+// Positions of random playouts and of random material, a fixed set of each,
+// for the middlegames and endgames that the perft positions miss.
+const std::vector<Board>& random_boards() {
+  static const std::vector<Board> res = [] {
+    std::vector<Board> boards;
+    std::mt19937_64 rng(1);
+    for (int i = 0; i < 100; ++i) {
+      boards.push_back(random_playout_position(10, 120, &rng));
+      boards.push_back(random_material_position(&rng));
+    }
+    return boards;
+  }();
+  return res;
+}
+
+void BM_LegalMovesRandomPositions(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : random_boards()) {
+      benchmark::DoNotOptimize(board.legal_moves());
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(random_boards().size()));
+}
+BENCHMARK(BM_LegalMovesRandomPositions);
+
+void BM_HasAnyLegalMoveRandomPositions(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : random_boards()) {
+      benchmark::DoNotOptimize(board.has_any_legal_move());
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(random_boards().size()));
+}
+BENCHMARK(BM_HasAnyLegalMoveRandomPositions);
+
+void BM_LegalTargetsRandomPositions(benchmark::State& state) {
+  std::array<Bitboard, 64> targets;
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : random_boards()) {
+      board.legal_targets(&targets);
+      benchmark::DoNotOptimize(targets);
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(random_boards().size()));
+}
+BENCHMARK(BM_LegalTargetsRandomPositions);
+
+// The legal moves of the random positions, each with its position, for
+// checking moves one at a time as a game server checks incoming moves.
+struct IncomingMove {
+  const Board* board_;
+  Move move_;
+  Piece promotion_;
+};
+
+const std::vector<IncomingMove>& incoming_moves() {
+  static const std::vector<IncomingMove> res = [] {
+    std::vector<IncomingMove> moves;
+    for (const Board& board : random_boards()) {
+      for (Move move : board.legal_moves()) {
+        const bool is_promotion =
+            move.move_type_ == MoveType::promotion_to_rook ||
+            move.move_type_ == MoveType::promotion_to_bishop ||
+            move.move_type_ == MoveType::promotion_to_knight ||
+            move.move_type_ == MoveType::promotion_to_queen;
+        moves.push_back({&board, move,
+                         is_promotion ? promotion_piece(move.move_type_)
+                                      : Piece::none});
+      }
+    }
+    return moves;
+  }();
+  return res;
+}
+
+// An item is a move, checked by its squares or by looking for it among the
+// generated legal moves.
+void BM_LegalMoveFromSquares(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const IncomingMove& incoming : incoming_moves()) {
+      benchmark::DoNotOptimize(incoming.board_->legal_move(
+          incoming.move_.src_square(), incoming.move_.dst_square(),
+          incoming.promotion_));
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() *
+             static_cast<int64_t>(incoming_moves().size()));
+}
+BENCHMARK(BM_LegalMoveFromSquares);
+
+void BM_FindInLegalMoves(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const IncomingMove& incoming : incoming_moves()) {
+      const MoveList legal = incoming.board_->legal_moves();
+      benchmark::DoNotOptimize(std::find(legal.begin(), legal.end(),
+                                         incoming.move_) != legal.end());
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() *
+             static_cast<int64_t>(incoming_moves().size()));
+}
+BENCHMARK(BM_FindInLegalMoves);
+
+void BM_PseudolegalMoves(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : boards()) {
+      benchmark::DoNotOptimize(board.pseudolegal_moves(side_to_move(board)));
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(boards().size()));
+}
+BENCHMARK(BM_PseudolegalMoves);
+
+// Does and undoes every legal move of every position, so an item is a move.
+void BM_DoUndoMove(benchmark::State& state) {
+  std::vector<Board> positions = boards();
+  std::vector<MoveList> moves;
+  int64_t num_moves = 0;
+  for (const Board& board : positions) {
+    moves.push_back(board.legal_moves());
+    num_moves += static_cast<int64_t>(moves.back().size());
+  }
+  const EventCounter events;
+  for (auto _ : state) {
+    for (size_t i = 0; i < positions.size(); ++i) {
+      for (Move move : moves[i]) {
+        UndoInfo undo;
+        positions[i].do_move(move, &undo);
+        benchmark::DoNotOptimize(positions[i].key_);
+        positions[i].undo_move(move, undo);
+      }
+    }
+  }
+  events.set_items_processed(state, state.iterations() * num_moves);
+}
+BENCHMARK(BM_DoUndoMove);
+
+// Perft to depth 3 of every position, walked by `MovePolicy`, so an item is
+// a leaf.
+template <typename MovePolicy>
+void BM_Perft(benchmark::State& state) {
+  std::vector<Board> positions = boards();
+  int64_t num_leaves = 0;
+  const EventCounter events;
+  for (auto _ : state) {
+    for (Board& board : positions) {
+      num_leaves += static_cast<int64_t>(perft<MovePolicy>(&board, 3));
+    }
+  }
+  events.set_items_processed(state, num_leaves);
+}
+BENCHMARK_TEMPLATE(BM_Perft, MakeUnmake);
+BENCHMARK_TEMPLATE(BM_Perft, CopyMake);
+
+void BM_AttackSquares(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : boards()) {
+      benchmark::DoNotOptimize(
+          board.attack_squares(flip_color(side_to_move(board))));
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(boards().size()));
+}
+BENCHMARK(BM_AttackSquares);
+
+// The same attacks, for both sides, of a batch made of copies of the
+// positions, with the version of `state.range(0)` lanes.
+void BM_BatchAttackSquares(benchmark::State& state) {
+  constexpr size_t num_copies = 256;
+  std::vector<Bitboard> bitboards[num_colors][num_piece_types];
+  PieceColumns columns;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      for (size_t i = 0; i < num_copies; ++i) {
+        for (const Board& board : boards()) {
+          bitboards[color][piece].push_back(board.pieces_[color][piece]);
+        }
+      }
+      columns.pieces_[color][piece] = bitboards[color][piece].data();
+    }
+  }
+  const size_t num_positions = bitboards[0][0].size();
+  std::vector<Bitboard> attacks(num_positions);
+  const size_t lanes = static_cast<size_t>(state.range(0));
+  const EventCounter events;
+  for (auto _ : state) {
+    for (Color side : {Color::white, Color::black}) {
+      if (!batch_attack_squares(columns, side, num_positions, attacks.data(),
+                                lanes)) {
+        state.SkipWithError("This version isn't available.");
+        return;
+      }
+      benchmark::DoNotOptimize(attacks.data());
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * 2 * static_cast<int64_t>(num_positions));
+}
+BENCHMARK(BM_BatchAttackSquares)->Arg(1)->Arg(4)->Arg(8);
+
+void BM_IsKingAttacked(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : boards()) {
+      benchmark::DoNotOptimize(board.is_king_attacked(side_to_move(board)));
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(boards().size()));
+}
+BENCHMARK(BM_IsKingAttacked);
+
+void BM_ParseFen(benchmark::State& state) {
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const char* fen : fens) {
+      benchmark::DoNotOptimize(parse_fen(fen));
+    }
+  }
+  events.set_items_processed(
+      state, state.iterations() * static_cast<int64_t>(boards().size()));
+}
+BENCHMARK(BM_ParseFen);
+
+// Splits the occupancy of every position, so an item is a square.
+void BM_BitboardSplit(benchmark::State& state) {
+  int64_t num_squares = 0;
+  for (const Board& board : boards()) {
+    num_squares += popcount(board.all_pieces());
+  }
+  const EventCounter events;
+  for (auto _ : state) {
+    for (const Board& board : boards()) {
+      for (Bitboard square : bitboard_split(board.all_pieces())) {
+        benchmark::DoNotOptimize(square);
+      }
+    }
+  }
+  events.set_items_processed(state, state.iterations() * num_squares);
+}
+BENCHMARK(BM_BitboardSplit);
+}  // namespace.
+
+int main(int argc, char** argv) {
+  // Takes --counters out of the flags before the library parses them.
+  int num_args = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--counters") == 0) {
+      count_events = true;
+    } else {
+      argv[num_args++] = argv[i];
+    }
+  }
+  argc = num_args;
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
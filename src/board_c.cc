@@ -0,0 +1,193 @@
+#include "board_c.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "book.h"
+#include "nnue.h"
+#include "packed_position.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+struct PawnGrabberBoard {
+  Board board_;
+};
+
+struct PawnGrabberAnalyzer {
+  PawnGrabberAnalyzer(size_t hash_mb, size_t num_threads)
+      : table_(hash_mb),
+        pool_(num_threads > 1 ? new ThreadPool(num_threads - 1) : nullptr),
+        searcher_(pool_.get(), &table_),
+        stop_(false) {}
+
+  TranspositionTable table_;
+  std::unique_ptr<ThreadPool> pool_;
+  ParallelSearcher searcher_;
+  NetworkPtr network_;
+  std::atomic<bool> stop_;
+};
+
+static_assert(std::is_trivially_copyable<PawnGrabberBoard>::value &&
+                  std::is_trivially_destructible<PawnGrabberBoard>::value,
+              "Boards are copied as bytes and freed without a destructor.");
+static_assert(PAWN_GRABBER_MAX_MOVES == max_moves &&
+                  PAWN_GRABBER_MAX_FEN_SIZE == Board::max_fen_size &&
+                  PAWN_GRABBER_PACKED_SIZE == sizeof(PackedPosition),
+              "The sizes of the C interface are those of the engine.");
+
+namespace {
+// The squares of the interface run from a1 to h1 first, so their files are
+// mirrored from those of `square_idx`.
+constexpr unsigned c_square(unsigned sq_idx) { return sq_idx ^ 7; }
+
+uint16_t encode_move(Move move) {
+  unsigned promotion = 0;
+  switch (move.move_type_) {
+    case MoveType::promotion_to_knight:
+      promotion = 1;
+      break;
+    case MoveType::promotion_to_bishop:
+      promotion = 2;
+      break;
+    case MoveType::promotion_to_rook:
+      promotion = 3;
+      break;
+    case MoveType::promotion_to_queen:
+      promotion = 4;
+      break;
+    default:
+      break;
+  }
+  return static_cast<uint16_t>(c_square(move.dst_idx_) |
+                               c_square(move.src_idx_) << 6 |
+                               promotion << 12);
+}
+}  // namespace.
+
+int pawn_grabber_abi_version(void) { return PAWN_GRABBER_ABI_VERSION; }
+
+size_t pawn_grabber_board_size(void) { return sizeof(PawnGrabberBoard); }
+
+size_t pawn_grabber_board_alignment(void) {
+  return alignof(PawnGrabberBoard);
+}
+
+PawnGrabberBoard* pawn_grabber_init_board(void* memory) {
+  return new (memory) PawnGrabberBoard();
+}
+
+void pawn_grabber_copy_board(PawnGrabberBoard* dst,
+                             const PawnGrabberBoard* src) {
+  *dst = *src;
+}
+
+int pawn_grabber_set_fen(PawnGrabberBoard* board, const char* fen,
+                         size_t fen_size) {
+  const absl::optional<Board> parsed =
+      parse_fen(absl::string_view(fen, fen_size));
+  if (!parsed || parsed->position_error()) {
+    return 0;
+  }
+  board->board_ = *parsed;
+  return 1;
+}
+
+size_t pawn_grabber_get_fen(const PawnGrabberBoard* board, char* fen) {
+  return board->board_.to_fen(fen);
+}
+
+void pawn_grabber_set_packed(PawnGrabberBoard* board, const void* packed) {
+  board->board_ =
+      unpack_position(*static_cast<const PackedPosition*>(packed));
+}
+
+void pawn_grabber_get_packed(const PawnGrabberBoard* board, void* packed) {
+  *static_cast<PackedPosition*>(packed) = pack_position(board->board_, 0, 0);
+}
+
+size_t pawn_grabber_legal_moves(const PawnGrabberBoard* board,
+                                uint16_t* moves) {
+  const MoveList legal = board->board_.legal_moves();
+  for (size_t i = 0; i < legal.size(); ++i) {
+    moves[i] = encode_move(legal[i]);
+  }
+  return legal.size();
+}
+
+int pawn_grabber_make_move(PawnGrabberBoard* board, uint16_t move) {
+  for (Move legal : board->board_.legal_moves()) {
+    if (encode_move(legal) == move) {
+      board->board_.do_move(legal);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int pawn_grabber_is_whites_move(const PawnGrabberBoard* board) {
+  return board->board_.is_whites_move_;
+}
+
+int pawn_grabber_in_check(const PawnGrabberBoard* board) {
+  const Board& b = board->board_;
+  return b.is_king_attacked(b.is_whites_move_ ? Color::white : Color::black);
+}
+
+uint64_t pawn_grabber_hash(const PawnGrabberBoard* board) {
+  return board->board_.key_;
+}
+
+uint64_t pawn_grabber_polyglot_hash(const PawnGrabberBoard* board) {
+  return polyglot_key(board->board_);
+}
+
+PawnGrabberAnalyzer* pawn_grabber_create_analyzer(size_t hash_mb,
+                                                  size_t num_threads) {
+  return new PawnGrabberAnalyzer(hash_mb, num_threads);
+}
+
+void pawn_grabber_destroy_analyzer(PawnGrabberAnalyzer* analyzer) {
+  delete analyzer;
+}
+
+int pawn_grabber_load_network(PawnGrabberAnalyzer* analyzer,
+                              const char* path) {
+  std::string error;
+  NetworkPtr network = load_network(path, &error);
+  if (!network) {
+    return 0;
+  }
+  analyzer->searcher_.set_network(network.get());
+  analyzer->network_ = std::move(network);
+  return 1;
+}
+
+int pawn_grabber_analyze(PawnGrabberAnalyzer* analyzer,
+                         const PawnGrabberBoard* board, int max_depth,
+                         uint64_t max_nodes, uint16_t* best_move, int* score) {
+  analyzer->stop_ = false;
+  const SearchResult res = analyzer->searcher_.search(
+      board->board_,
+      {std::min(std::max(max_depth, 1), max_search_ply - 1), max_nodes,
+       &analyzer->stop_, nullptr});
+  if (!res.best_move_) {
+    return 0;
+  }
+  *best_move = encode_move(*res.best_move_);
+  *score = res.score_;
+  return res.depth_;
+}
+
+void pawn_grabber_stop_analysis(PawnGrabberAnalyzer* analyzer) {
+  analyzer->stop_ = true;
+}
@@ -0,0 +1,121 @@
+#ifndef BOARD_C_H
+#define BOARD_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The board and move generator through a stable C interface, in the
+// pawngrabber shared library, for services in other languages that embed
+// the generator rather than talk UCI to an engine process.
+//
+// A board is an opaque handle to memory the caller provides, of
+// `pawn_grabber_board_size()` bytes aligned to
+// `pawn_grabber_board_alignment()`, and the board functions allocate nothing,
+// themselves or behind them: the results go into the caller's buffers,
+// the move generator works on the stack, and a board is plain data, so that
+// copying its bytes, with `pawn_grabber_copy_board` or the caller's own
+// memcpy, gives a board in the same position. A board is used by one thread
+// at a time; different boards need no locking.
+//
+// Moves are 16 bits: the destination square in bits 0-5, the source in bits
+// 6-11, with the squares numbered from a1 = 0, b1 = 1 to h8 = 63, and the
+// promotion piece in bits 12-14, 1 for a knight to 4 for a queen, else 0.
+// Castling is the king's move as UCI writes it.
+//
+// An analyzer searches boards, with a transposition table and threads of its
+// own. The same library built for WebAssembly (see CMakeLists.txt) runs the
+// generator and the search in a browser.
+//
+// The functions only change in ways old callers don't see, and
+// `PAWN_GRABBER_ABI_VERSION` goes up when one is added.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PAWN_GRABBER_ABI_VERSION 2
+// The room `pawn_grabber_legal_moves` needs, more than the moves of any
+// legal position.
+#define PAWN_GRABBER_MAX_MOVES 256
+// The room `pawn_grabber_get_fen` needs, its null terminator included.
+#define PAWN_GRABBER_MAX_FEN_SIZE 106
+// The size of a packed position, see packed_position.h.
+#define PAWN_GRABBER_PACKED_SIZE 32
+
+typedef struct PawnGrabberBoard PawnGrabberBoard;
+typedef struct PawnGrabberAnalyzer PawnGrabberAnalyzer;
+
+// The `PAWN_GRABBER_ABI_VERSION` the library was built with, which callers
+// can check against the header they were built with.
+int pawn_grabber_abi_version(void);
+
+size_t pawn_grabber_board_size(void);
+size_t pawn_grabber_board_alignment(void);
+
+// Makes a board in the start position in `memory`, and returns it. Nothing
+// needs to be done to a board before its memory is freed.
+PawnGrabberBoard* pawn_grabber_init_board(void* memory);
+void pawn_grabber_copy_board(PawnGrabberBoard* dst,
+                             const PawnGrabberBoard* src);
+
+// Sets `board` to the position of the `fen_size` bytes of `fen` and returns
+// 1, or returns 0 and leaves it unchanged if they aren't the FEN of a
+// position that can be played from.
+int pawn_grabber_set_fen(PawnGrabberBoard* board, const char* fen,
+                         size_t fen_size);
+// Writes the FEN of `board`, null terminated, to `fen`, which has room for
+// `PAWN_GRABBER_MAX_FEN_SIZE` bytes, and returns its length.
+size_t pawn_grabber_get_fen(const PawnGrabberBoard* board, char* fen);
+// The same with the `PAWN_GRABBER_PACKED_SIZE` bytes of a packed position.
+// Its score and result are ignored, and written as 0.
+void pawn_grabber_set_packed(PawnGrabberBoard* board, const void* packed);
+void pawn_grabber_get_packed(const PawnGrabberBoard* board, void* packed);
+
+// Writes the legal moves of `board` to `moves`, which has room for
+// `PAWN_GRABBER_MAX_MOVES`, and returns their number.
+size_t pawn_grabber_legal_moves(const PawnGrabberBoard* board,
+                                uint16_t* moves);
+// Makes `move` on `board` and returns 1, or returns 0 and leaves the board
+// unchanged if it isn't a legal move there.
+int pawn_grabber_make_move(PawnGrabberBoard* board, uint16_t move);
+
+// 1 if white is to move, else 0.
+int pawn_grabber_is_whites_move(const PawnGrabberBoard* board);
+// 1 if the side to move is in check, else 0.
+int pawn_grabber_in_check(const PawnGrabberBoard* board);
+// The engine's Zobrist key of the position.
+uint64_t pawn_grabber_hash(const PawnGrabberBoard* board);
+// The key of the position in Polyglot opening books.
+uint64_t pawn_grabber_polyglot_hash(const PawnGrabberBoard* board);
+
+// Makes an analyzer with a transposition table of `hash_mb` MB that searches
+// on `num_threads` threads, the calling one among them: 0 or 1 searches on
+// the calling thread alone, as a WebAssembly build without threads must.
+PawnGrabberAnalyzer* pawn_grabber_create_analyzer(size_t hash_mb,
+                                                  size_t num_threads);
+void pawn_grabber_destroy_analyzer(PawnGrabberAnalyzer* analyzer);
+// Makes the analyzer evaluate with the network file at `path`, which in a
+// browser is a file of Emscripten's file system, and returns 1, or returns 0
+// and leaves the evaluation as it was if it can't be loaded.
+int pawn_grabber_load_network(PawnGrabberAnalyzer* analyzer,
+                              const char* path);
+// Searches `board` to `max_depth` plies, at most 63, or until `max_nodes`
+// nodes have been visited unless it is 0, writes the best move to `best_move`
+// and its score to `score`, and returns the depth completed. Scores are in
+// centipawns for the side to move, or 30000 less the plies to a mate it gives
+// and -30000 plus those to one it gets. Returns 0 and writes nothing if the
+// side to move has no legal moves, or the search stopped before it completed
+// a ply. The positions before `board` are unknown to the search, so it only
+// sees repetitions after it.
+int pawn_grabber_analyze(PawnGrabberAnalyzer* analyzer,
+                         const PawnGrabberBoard* board, int max_depth,
+                         uint64_t max_nodes, uint16_t* best_move, int* score);
+// Makes the search of `pawn_grabber_analyze` that is in progress stop soon
+// with the result so far. Called from any thread.
+void pawn_grabber_stop_analysis(PawnGrabberAnalyzer* analyzer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
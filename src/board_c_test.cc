@@ -0,0 +1,172 @@
+#include "board_c.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "perft.h"
+#include "search.h"
+#include "transposition_table.h"
+
+namespace {
+// The move from `src` to `dst`, as UCI names the squares, encoded.
+uint16_t c_move(const char* src, const char* dst, unsigned promotion = 0) {
+  const auto sq = [](const char* name) {
+    return static_cast<unsigned>((name[0] - 'a') + 8 * (name[1] - '1'));
+  };
+  return static_cast<uint16_t>(sq(dst) | sq(src) << 6 | promotion << 12);
+}
+
+// A board in memory of the test's own, as a caller would have it.
+class TestBoard {
+ public:
+  TestBoard() : memory_(pawn_grabber_board_size() + 64) {
+    void* ptr = memory_.data();
+    size_t space = memory_.size();
+    board_ = pawn_grabber_init_board(
+        std::align(pawn_grabber_board_alignment(), pawn_grabber_board_size(),
+                   ptr, space));
+  }
+
+  PawnGrabberBoard* get() { return board_; }
+
+ private:
+  std::vector<char> memory_;
+  PawnGrabberBoard* board_;
+};
+
+std::string get_fen(const PawnGrabberBoard* board) {
+  char fen[PAWN_GRABBER_MAX_FEN_SIZE];
+  const size_t size = pawn_grabber_get_fen(board, fen);
+  EXPECT_EQ(std::strlen(fen), size);
+  return fen;
+}
+
+bool set_fen(PawnGrabberBoard* board, const std::string& fen) {
+  return pawn_grabber_set_fen(board, fen.data(), fen.size()) != 0;
+}
+}  // namespace.
+
+TEST(BoardC, PlaysMoves) {
+  EXPECT_EQ(pawn_grabber_abi_version(), PAWN_GRABBER_ABI_VERSION);
+  TestBoard board;
+  EXPECT_EQ(get_fen(board.get()), Board().to_fen());
+  EXPECT_EQ(pawn_grabber_polyglot_hash(board.get()), 0x463B96181691FC9C);
+  EXPECT_EQ(pawn_grabber_hash(board.get()), Board().key_);
+  uint16_t moves[PAWN_GRABBER_MAX_MOVES];
+  EXPECT_EQ(pawn_grabber_legal_moves(board.get(), moves), 20);
+
+  EXPECT_EQ(pawn_grabber_make_move(board.get(), c_move("e2", "e5")), 0);
+  EXPECT_EQ(get_fen(board.get()), Board().to_fen());
+  EXPECT_EQ(pawn_grabber_make_move(board.get(), c_move("e2", "e4")), 1);
+  // The Polyglot key of 1. e4.
+  EXPECT_EQ(pawn_grabber_polyglot_hash(board.get()), 0x823C9B50FD114196);
+  EXPECT_EQ(pawn_grabber_is_whites_move(board.get()), 0);
+
+  // Castling and promotion.
+  ASSERT_TRUE(set_fen(board.get(), "r3k3/6P1/8/8/8/8/8/4K2R w Kq - 0 1"));
+  EXPECT_EQ(pawn_grabber_make_move(board.get(), c_move("e1", "g1")), 1);
+  EXPECT_EQ(get_fen(board.get()), "r3k3/6P1/8/8/8/8/8/5RK1 b q - 1 1");
+  EXPECT_EQ(pawn_grabber_make_move(board.get(), c_move("e8", "c8")), 1);
+  EXPECT_EQ(pawn_grabber_make_move(board.get(), c_move("g7", "g8")), 0);
+  EXPECT_EQ(pawn_grabber_make_move(board.get(), c_move("g7", "g8", 2)), 1);
+  EXPECT_EQ(get_fen(board.get()), "2kr2B1/8/8/8/8/8/8/5RK1 b - - 0 2");
+  EXPECT_EQ(pawn_grabber_in_check(board.get()), 0);
+
+  const std::string fen = get_fen(board.get());
+  EXPECT_FALSE(set_fen(board.get(), "not a fen"));
+  // No black king.
+  EXPECT_FALSE(set_fen(board.get(), "8/8/8/8/8/8/8/K7 w - - 0 1"));
+  EXPECT_EQ(get_fen(board.get()), fen);
+}
+
+TEST(BoardC, MatchesTheBoard) {
+  TestBoard board;
+  TestBoard copy;
+  for (const PerftSuitePosition& position : perft_suite) {
+    SCOPED_TRACE(position.fen_);
+    ASSERT_TRUE(set_fen(board.get(), position.fen_));
+    Board expected(position.fen_);
+    for (size_t ply = 0; ply < 60; ++ply) {
+      ASSERT_EQ(get_fen(board.get()), expected.to_fen());
+      ASSERT_EQ(pawn_grabber_hash(board.get()), expected.key_);
+      ASSERT_EQ(pawn_grabber_in_check(board.get()) != 0,
+                expected.is_king_attacked(expected.is_whites_move_
+                                              ? Color::white
+                                              : Color::black));
+      uint8_t packed[PAWN_GRABBER_PACKED_SIZE];
+      pawn_grabber_get_packed(board.get(), packed);
+      pawn_grabber_init_board(copy.get());
+      pawn_grabber_set_packed(copy.get(), packed);
+      ASSERT_EQ(get_fen(copy.get()), expected.to_fen());
+
+      uint16_t moves[PAWN_GRABBER_MAX_MOVES];
+      const MoveList legal = expected.legal_moves();
+      ASSERT_EQ(pawn_grabber_legal_moves(board.get(), moves), legal.size());
+      if (legal.empty()) {
+        break;
+      }
+      const size_t idx = (ply * 13 + 5) % legal.size();
+      const std::string uci = legal[idx].to_uci_str();
+      EXPECT_EQ(moves[idx],
+                c_move(uci.c_str(), uci.c_str() + 2,
+                       uci.size() == 5
+                           ? static_cast<unsigned>(
+                                 std::string("nbrq").find(uci[4]) + 1)
+                           : 0));
+      // Through a copy, as a caller searching a tree would.
+      pawn_grabber_copy_board(copy.get(), board.get());
+      ASSERT_EQ(pawn_grabber_make_move(copy.get(), moves[idx]), 1);
+      pawn_grabber_copy_board(board.get(), copy.get());
+      expected.do_move(legal[idx]);
+    }
+  }
+}
+
+TEST(BoardC, Analyzes) {
+  TestBoard board;
+  // Mate in one, Rd8.
+  ASSERT_TRUE(set_fen(board.get(), "6k1/5ppp/8/8/8/8/8/3R2K1 w - - 0 1"));
+  for (size_t num_threads : {1, 3}) {
+    SCOPED_TRACE(num_threads);
+    PawnGrabberAnalyzer* const analyzer =
+        pawn_grabber_create_analyzer(1, num_threads);
+    EXPECT_EQ(pawn_grabber_load_network(analyzer, "/nonexistent"), 0);
+    uint16_t move = 0;
+    int score = 0;
+    EXPECT_EQ(pawn_grabber_analyze(analyzer, board.get(), 4, 0, &move, &score),
+              4);
+    EXPECT_EQ(move, c_move("d1", "d8"));
+    EXPECT_EQ(score, mate_score - 1);
+    pawn_grabber_destroy_analyzer(analyzer);
+  }
+
+  // The search of the engine, on the calling thread.
+  const std::string fen = perft_suite[1].fen_;
+  ASSERT_TRUE(set_fen(board.get(), fen));
+  PawnGrabberAnalyzer* const analyzer = pawn_grabber_create_analyzer(1, 0);
+  TranspositionTable table(1);
+  ParallelSearcher searcher(nullptr, &table);
+  const SearchResult expected =
+      searcher.search(Board(fen), {6, 20000, nullptr, nullptr});
+  uint16_t move = 0;
+  int score = 0;
+  EXPECT_EQ(
+      pawn_grabber_analyze(analyzer, board.get(), 6, 20000, &move, &score),
+      expected.depth_);
+  const std::string uci = expected.best_move_->to_uci_str();
+  EXPECT_EQ(move, c_move(uci.c_str(), uci.c_str() + 2));
+  EXPECT_EQ(score, expected.score_);
+
+  // Mated.
+  ASSERT_TRUE(set_fen(board.get(), "3R2k1/5ppp/8/8/8/8/8/6K1 b - - 1 1"));
+  EXPECT_EQ(pawn_grabber_analyze(analyzer, board.get(), 4, 0, &move, &score),
+            0);
+  pawn_grabber_destroy_analyzer(analyzer);
+}
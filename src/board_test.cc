@@ -3,55 +3,21 @@
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <optional>
+#include <random>
 #include <string>
 
 #include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
 #include "absl/strings/str_cat.h"
 #include "absl/types/optional.h"
+#include "attacks.h"
 #include "gtest/gtest.h"
-
-TEST(SquareUtils, IsSquare) {
-  EXPECT_FALSE(is_square(0));
-  EXPECT_TRUE(is_square(str_to_square("a1")));
-  EXPECT_FALSE(is_square(str_to_square("a1") | str_to_square("a2")));
-}
-
-TEST(SquareUtils, SquareIndex) {
-  EXPECT_EQ(square_idx(str_to_square("h1")), 0);
-  EXPECT_EQ(square_idx(str_to_square("a8")), 63);
-  EXPECT_EQ(square_idx(str_to_square("a1")), 7);
-}
-
-TEST(SquareUtils, RankIndex) {
-  EXPECT_EQ(rank_idx(str_to_square("h1")), 0);
-  EXPECT_EQ(rank_idx(str_to_square("h2")), 1);
-  EXPECT_EQ(rank_idx(str_to_square("a8")), 7);
-  EXPECT_EQ(rank_idx(str_to_square("e4")), 3);
-}
-
-TEST(SquareUtils, FileIndex) {
-  EXPECT_EQ(file_idx(str_to_square("h1")), 7);
-  EXPECT_EQ(file_idx(str_to_square("a8")), 0);
-  EXPECT_EQ(file_idx(str_to_square("e4")), 4);
-}
-
-TEST(SquareUtils, OnAFile) {
-  EXPECT_TRUE(on_a_file(str_to_square("a1")));
-  EXPECT_TRUE(on_a_file(str_to_square("a8")));
-  EXPECT_FALSE(on_a_file(str_to_square("b4")));
-  EXPECT_FALSE(on_a_file(str_to_square("e4")));
-  EXPECT_FALSE(on_a_file(str_to_square("h4")));
-}
-
-TEST(SquareUtils, OnHFile) {
-  EXPECT_TRUE(on_h_file(str_to_square("h1")));
-  EXPECT_TRUE(on_h_file(str_to_square("h8")));
-  EXPECT_FALSE(on_h_file(str_to_square("e4")));
-  EXPECT_FALSE(on_h_file(str_to_square("g4")));
-  EXPECT_FALSE(on_h_file(str_to_square("g8")));
-}
+#include "random_positions.h"
+#include "zobrist.h"
 
 TEST(SquareDirections, E4) {
   Bitboard e4 = str_to_square("e4");
@@ -115,24 +81,26 @@ TEST(SquareDirections, H8) {
 
 TEST(BoardConstructor, StartPosition) {
   Board start_board;
-  EXPECT_EQ(start_board.white_pawns_, 0xFF00);
-  EXPECT_EQ(start_board.white_rooks_, 0x81);
-  EXPECT_EQ(start_board.white_knights_, 0x42);
-  EXPECT_EQ(start_board.white_bishops_, 0x24);
-  EXPECT_EQ(start_board.white_queens_, 0x10);
-  EXPECT_EQ(start_board.white_king_, 0x8);
-  EXPECT_EQ(start_board.black_pawns_, 0xFF000000000000);
-  EXPECT_EQ(start_board.black_rooks_, 0x8100000000000000);
-  EXPECT_EQ(start_board.black_knights_, 0x4200000000000000);
-  EXPECT_EQ(start_board.black_bishops_, 0x2400000000000000);
-  EXPECT_EQ(start_board.black_queens_, 0x1000000000000000);
-  EXPECT_EQ(start_board.black_king_, 0x800000000000000);
+  EXPECT_EQ(start_board.pieces(Color::white, Piece::pawn), 0xFF00);
+  EXPECT_EQ(start_board.pieces(Color::white, Piece::rook), 0x81);
+  EXPECT_EQ(start_board.pieces(Color::white, Piece::knight), 0x42);
+  EXPECT_EQ(start_board.pieces(Color::white, Piece::bishop), 0x24);
+  EXPECT_EQ(start_board.pieces(Color::white, Piece::queen), 0x10);
+  EXPECT_EQ(start_board.pieces(Color::white, Piece::king), 0x8);
+  EXPECT_EQ(start_board.pieces(Color::black, Piece::pawn), 0xFF000000000000);
+  EXPECT_EQ(start_board.pieces(Color::black, Piece::rook), 0x8100000000000000);
+  EXPECT_EQ(start_board.pieces(Color::black, Piece::knight),
+            0x4200000000000000);
+  EXPECT_EQ(start_board.pieces(Color::black, Piece::bishop),
+            0x2400000000000000);
+  EXPECT_EQ(start_board.pieces(Color::black, Piece::queen), 0x1000000000000000);
+  EXPECT_EQ(start_board.pieces(Color::black, Piece::king), 0x800000000000000);
   EXPECT_TRUE(start_board.is_whites_move_);
-  EXPECT_EQ(start_board.en_passant_square_, absl::nullopt);
-  EXPECT_TRUE(start_board.white_has_right_to_castle_kingside_);
-  EXPECT_TRUE(start_board.white_has_right_to_castle_queenside_);
-  EXPECT_TRUE(start_board.black_has_right_to_castle_kingside_);
-  EXPECT_TRUE(start_board.black_has_right_to_castle_queenside_);
+  EXPECT_EQ(start_board.en_passant_square_, 0);
+  EXPECT_TRUE(start_board.has_castling_rights(white_kingside_castling));
+  EXPECT_TRUE(start_board.has_castling_rights(white_queenside_castling));
+  EXPECT_TRUE(start_board.has_castling_rights(black_kingside_castling));
+  EXPECT_TRUE(start_board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(start_board.fifty_move_clock_, 0);
   EXPECT_EQ(start_board.num_moves_, 1);
 }
@@ -162,25 +130,25 @@ TEST(PPrint, StartPosition) {
 
 TEST(BoardConstructor, KingsPawn) {
   Board board("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1");
-  EXPECT_EQ(board.white_pawns_, 0x800F700);
-  EXPECT_EQ(board.white_rooks_, 0x81);
-  EXPECT_EQ(board.white_knights_, 0x42);
-  EXPECT_EQ(board.white_bishops_, 0x24);
-  EXPECT_EQ(board.white_queens_, 0x10);
-  EXPECT_EQ(board.white_king_, 0x8);
-  EXPECT_EQ(board.black_pawns_, 0xFF000000000000);
-  EXPECT_EQ(board.black_rooks_, 0x8100000000000000);
-  EXPECT_EQ(board.black_knights_, 0x4200000000000000);
-  EXPECT_EQ(board.black_bishops_, 0x2400000000000000);
-  EXPECT_EQ(board.black_queens_, 0x1000000000000000);
-  EXPECT_EQ(board.black_king_, 0x800000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn), 0x800F700);
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook), 0x81);
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight), 0x42);
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0x24);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), 0x10);
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), 0x8);
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn), 0xFF000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook), 0x8100000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), 0x4200000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), 0x2400000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), 0x1000000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), 0x800000000000000);
   EXPECT_FALSE(board.is_whites_move_);
   const Bitboard e3 = (1ULL << (2 * board_size + 3));
   EXPECT_EQ(board.en_passant_square_, e3);
-  EXPECT_TRUE(board.white_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.white_has_right_to_castle_queenside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_queenside_);
+  EXPECT_TRUE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 0);
   EXPECT_EQ(board.num_moves_, 1);
 }
@@ -210,25 +178,25 @@ TEST(PPrint, KingsPawn) {
 
 TEST(BoardConstructor, Sicilian) {
   Board board("rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 2");
-  EXPECT_EQ(board.white_pawns_, 0x800F700);
-  EXPECT_EQ(board.white_rooks_, 0x81);
-  EXPECT_EQ(board.white_knights_, 0x42);
-  EXPECT_EQ(board.white_bishops_, 0x24);
-  EXPECT_EQ(board.white_queens_, 0x10);
-  EXPECT_EQ(board.white_king_, 0x8);
-  EXPECT_EQ(board.black_pawns_, 0xDF002000000000);
-  EXPECT_EQ(board.black_rooks_, 0x8100000000000000);
-  EXPECT_EQ(board.black_knights_, 0x4200000000000000);
-  EXPECT_EQ(board.black_bishops_, 0x2400000000000000);
-  EXPECT_EQ(board.black_queens_, 0x1000000000000000);
-  EXPECT_EQ(board.black_king_, 0x800000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn), 0x800F700);
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook), 0x81);
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight), 0x42);
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0x24);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), 0x10);
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), 0x8);
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn), 0xDF002000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook), 0x8100000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), 0x4200000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), 0x2400000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), 0x1000000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), 0x800000000000000);
   EXPECT_TRUE(board.is_whites_move_);
   const Bitboard c6 = (1ULL << (5 * board_size + 5));
   EXPECT_EQ(board.en_passant_square_, c6);
-  EXPECT_TRUE(board.white_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.white_has_right_to_castle_queenside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_queenside_);
+  EXPECT_TRUE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 0);
   EXPECT_EQ(board.num_moves_, 2);
 }
@@ -258,24 +226,24 @@ TEST(PPrint, Sicilian) {
 
 TEST(BoardConstructor, Nf3Sicilian) {
   Board board("rnbqkbnr/pp1ppppp/8/2p5/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 2");
-  EXPECT_EQ(board.white_pawns_, 0x800F700);
-  EXPECT_EQ(board.white_rooks_, 0x81);
-  EXPECT_EQ(board.white_knights_, 0x40040);
-  EXPECT_EQ(board.white_bishops_, 0x24);
-  EXPECT_EQ(board.white_queens_, 0x10);
-  EXPECT_EQ(board.white_king_, 0x8);
-  EXPECT_EQ(board.black_pawns_, 0xDF002000000000);
-  EXPECT_EQ(board.black_rooks_, 0x8100000000000000);
-  EXPECT_EQ(board.black_knights_, 0x4200000000000000);
-  EXPECT_EQ(board.black_bishops_, 0x2400000000000000);
-  EXPECT_EQ(board.black_queens_, 0x1000000000000000);
-  EXPECT_EQ(board.black_king_, 0x800000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn), 0x800F700);
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook), 0x81);
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight), 0x40040);
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0x24);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), 0x10);
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), 0x8);
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn), 0xDF002000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook), 0x8100000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), 0x4200000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), 0x2400000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), 0x1000000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), 0x800000000000000);
   EXPECT_FALSE(board.is_whites_move_);
-  EXPECT_EQ(board.en_passant_square_, absl::nullopt);
-  EXPECT_TRUE(board.white_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.white_has_right_to_castle_queenside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_queenside_);
+  EXPECT_EQ(board.en_passant_square_, 0);
+  EXPECT_TRUE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 1);
   EXPECT_EQ(board.num_moves_, 2);
 }
@@ -305,24 +273,24 @@ TEST(PPrint, Nf3Sicilian) {
 
 TEST(BoardConstructor, SicilianWith2Ke2) {
   Board board("rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPPKPPP/RNBQ1BNR b kq - 1 2");
-  EXPECT_EQ(board.white_pawns_, 0x800F700);
-  EXPECT_EQ(board.white_rooks_, 0x81);
-  EXPECT_EQ(board.white_knights_, 0x42);
-  EXPECT_EQ(board.white_bishops_, 0x24);
-  EXPECT_EQ(board.white_queens_, 0x10);
-  EXPECT_EQ(board.white_king_, 0x800);
-  EXPECT_EQ(board.black_pawns_, 0xDF002000000000);
-  EXPECT_EQ(board.black_rooks_, 0x8100000000000000);
-  EXPECT_EQ(board.black_knights_, 0x4200000000000000);
-  EXPECT_EQ(board.black_bishops_, 0x2400000000000000);
-  EXPECT_EQ(board.black_queens_, 0x1000000000000000);
-  EXPECT_EQ(board.black_king_, 0x800000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn), 0x800F700);
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook), 0x81);
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight), 0x42);
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0x24);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), 0x10);
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), 0x800);
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn), 0xDF002000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook), 0x8100000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), 0x4200000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), 0x2400000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), 0x1000000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), 0x800000000000000);
   EXPECT_FALSE(board.is_whites_move_);
-  EXPECT_EQ(board.en_passant_square_, absl::nullopt);
-  EXPECT_FALSE(board.white_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.white_has_right_to_castle_queenside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_kingside_);
-  EXPECT_TRUE(board.black_has_right_to_castle_queenside_);
+  EXPECT_EQ(board.en_passant_square_, 0);
+  EXPECT_FALSE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_TRUE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 1);
   EXPECT_EQ(board.num_moves_, 2);
 }
@@ -352,24 +320,24 @@ TEST(PPrint, SicilianWith2Ke2) {
 
 TEST(BoardConstructor, KingVsKing) {
   Board board("4k3/8/8/8/8/8/8/4K3 w - - 0 55");
-  EXPECT_EQ(board.white_pawns_, 0x0);
-  EXPECT_EQ(board.white_rooks_, 0x0);
-  EXPECT_EQ(board.white_knights_, 0x0);
-  EXPECT_EQ(board.white_bishops_, 0x0);
-  EXPECT_EQ(board.white_queens_, 0x0);
-  EXPECT_EQ(board.white_king_, 0x8);
-  EXPECT_EQ(board.black_pawns_, 0x0);
-  EXPECT_EQ(board.black_rooks_, 0x0);
-  EXPECT_EQ(board.black_knights_, 0x0);
-  EXPECT_EQ(board.black_bishops_, 0x0);
-  EXPECT_EQ(board.black_queens_, 0x0);
-  EXPECT_EQ(board.black_king_, 0x800000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), 0x8);
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), 0x800000000000000);
   EXPECT_TRUE(board.is_whites_move_);
-  EXPECT_EQ(board.en_passant_square_, absl::nullopt);
-  EXPECT_FALSE(board.white_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.white_has_right_to_castle_queenside_);
-  EXPECT_FALSE(board.black_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.black_has_right_to_castle_queenside_);
+  EXPECT_EQ(board.en_passant_square_, 0);
+  EXPECT_FALSE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_FALSE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 0);
   EXPECT_EQ(board.num_moves_, 55);
 }
@@ -399,24 +367,24 @@ TEST(PPrint, KingVsKing) {
 
 TEST(BoardConstructor, LucenaPosition) {
   Board board("1K1k4/1P6/8/8/8/8/r7/2R5 w - - 0 60");
-  EXPECT_EQ(board.white_pawns_, 0x40000000000000);
-  EXPECT_EQ(board.white_rooks_, 0x20);
-  EXPECT_EQ(board.white_knights_, 0x0);
-  EXPECT_EQ(board.white_bishops_, 0x0);
-  EXPECT_EQ(board.white_queens_, 0x0);
-  EXPECT_EQ(board.white_king_, 0x4000000000000000);
-  EXPECT_EQ(board.black_pawns_, 0x0);
-  EXPECT_EQ(board.black_rooks_, 0x8000);
-  EXPECT_EQ(board.black_knights_, 0x0);
-  EXPECT_EQ(board.black_bishops_, 0x0);
-  EXPECT_EQ(board.black_queens_, 0x0);
-  EXPECT_EQ(board.black_king_, 0x1000000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn), 0x40000000000000);
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook), 0x20);
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), 0x0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), 0x4000000000000000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook), 0x8000);
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), 0x0);
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), 0x1000000000000000);
   EXPECT_TRUE(board.is_whites_move_);
-  EXPECT_EQ(board.en_passant_square_, absl::nullopt);
-  EXPECT_FALSE(board.white_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.white_has_right_to_castle_queenside_);
-  EXPECT_FALSE(board.black_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.black_has_right_to_castle_queenside_);
+  EXPECT_EQ(board.en_passant_square_, 0);
+  EXPECT_FALSE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_FALSE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 0);
   EXPECT_EQ(board.num_moves_, 60);
 }
@@ -446,30 +414,33 @@ TEST(PPrint, LucenaPosition) {
 
 TEST(BoardConstructor, MiddleGame) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
-  EXPECT_EQ(board.white_pawns_, str_to_square("g2") | str_to_square("f2") |
-                                    str_to_square("b2") | str_to_square("a2") |
-                                    str_to_square("h3") | str_to_square("e3") |
-                                    str_to_square("d4"));
-  EXPECT_EQ(board.white_rooks_, str_to_square("a1") | str_to_square("f1"));
-  EXPECT_EQ(board.white_knights_, str_to_square("c3") | str_to_square("d2"));
-  EXPECT_EQ(board.white_bishops_, 0);
-  EXPECT_EQ(board.white_queens_, str_to_square("b3"));
-  EXPECT_EQ(board.white_king_, str_to_square("h1"));
-  EXPECT_EQ(board.black_pawns_, str_to_square("a7") | str_to_square("b7") |
-                                    str_to_square("c6") | str_to_square("e4") |
-                                    str_to_square("f7") | str_to_square("g7") |
-                                    str_to_square("h6"));
-  EXPECT_EQ(board.black_rooks_, str_to_square("a8") | str_to_square("f8"));
-  EXPECT_EQ(board.black_knights_, str_to_square("g4"));
-  EXPECT_EQ(board.black_bishops_, str_to_square("g6"));
-  EXPECT_EQ(board.black_queens_, str_to_square("h4"));
-  EXPECT_EQ(board.black_king_, str_to_square("g8"));
+  EXPECT_EQ(board.pieces(Color::white, Piece::pawn),
+            str_to_square("g2") | str_to_square("f2") | str_to_square("b2") |
+            str_to_square("a2") | str_to_square("h3") | str_to_square("e3") |
+            str_to_square("d4"));
+  EXPECT_EQ(board.pieces(Color::white, Piece::rook),
+            str_to_square("a1") | str_to_square("f1"));
+  EXPECT_EQ(board.pieces(Color::white, Piece::knight),
+            str_to_square("c3") | str_to_square("d2"));
+  EXPECT_EQ(board.pieces(Color::white, Piece::bishop), 0);
+  EXPECT_EQ(board.pieces(Color::white, Piece::queen), str_to_square("b3"));
+  EXPECT_EQ(board.pieces(Color::white, Piece::king), str_to_square("h1"));
+  EXPECT_EQ(board.pieces(Color::black, Piece::pawn),
+            str_to_square("a7") | str_to_square("b7") | str_to_square("c6") |
+            str_to_square("e4") | str_to_square("f7") | str_to_square("g7") |
+            str_to_square("h6"));
+  EXPECT_EQ(board.pieces(Color::black, Piece::rook),
+            str_to_square("a8") | str_to_square("f8"));
+  EXPECT_EQ(board.pieces(Color::black, Piece::knight), str_to_square("g4"));
+  EXPECT_EQ(board.pieces(Color::black, Piece::bishop), str_to_square("g6"));
+  EXPECT_EQ(board.pieces(Color::black, Piece::queen), str_to_square("h4"));
+  EXPECT_EQ(board.pieces(Color::black, Piece::king), str_to_square("g8"));
   EXPECT_TRUE(board.is_whites_move_);
-  EXPECT_EQ(board.en_passant_square_, absl::nullopt);
-  EXPECT_FALSE(board.white_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.white_has_right_to_castle_queenside_);
-  EXPECT_FALSE(board.black_has_right_to_castle_kingside_);
-  EXPECT_FALSE(board.black_has_right_to_castle_queenside_);
+  EXPECT_EQ(board.en_passant_square_, 0);
+  EXPECT_FALSE(board.has_castling_rights(white_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(white_queenside_castling));
+  EXPECT_FALSE(board.has_castling_rights(black_kingside_castling));
+  EXPECT_FALSE(board.has_castling_rights(black_queenside_castling));
   EXPECT_EQ(board.fifty_move_clock_, 1);
   EXPECT_EQ(board.num_moves_, 18);
 }
@@ -497,6 +468,155 @@ TEST(PPrint, MiddleGame) {
                          "    a   b   c   d   e   f   g   h\n"));
 }
 
+TEST(ParseFen, MatchesTheConstructor) {
+  const char* const fen =
+      "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 2";
+  const absl::optional<Board> board = parse_fen(fen);
+  ASSERT_TRUE(board);
+  EXPECT_EQ(board->key_, Board(fen).key_);
+  EXPECT_EQ(board->num_moves_, 2);
+}
+
+TEST(ParseFen, ClocksAreOptional) {
+  const absl::optional<Board> board =
+      parse_fen("4k3/8/8/8/8/8/8/4K3 b -  -");
+  ASSERT_TRUE(board);
+  EXPECT_FALSE(board->is_whites_move_);
+  EXPECT_EQ(board->fifty_move_clock_, 0);
+  EXPECT_EQ(board->num_moves_, 1);
+  const absl::optional<Board> spaced =
+      parse_fen("  4k3/8/8/8/8/8/8/4K3\tb - -\t 12 40 ");
+  ASSERT_TRUE(spaced);
+  EXPECT_EQ(spaced->fifty_move_clock_, 12);
+  EXPECT_EQ(spaced->num_moves_, 40);
+}
+
+TEST(ParseFen, RejectsInvalidInput) {
+  for (const char* fen : {
+           "",
+           "4k3/8/8/8/8/8/8/4K3",
+           "4k3/8/8/8/8/8/4K3 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4K2 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4K4 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4X3 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4K3 x - - 0 1",
+           "4k3/8/8/8/8/8/8/4K3 w X - 0 1",
+           "4k3/8/8/8/8/8/8/4K3 w - e9 0 1",
+           "4k3/8/8/8/8/8/8/4K3 w - - x 1",
+           "4k3/8/8/8/8/8/8/4K3 w - - -1 1",
+           "4k3/8/8/8/8/8/8/4K3 w - - 0 1 1",
+           // Not playable, though the constructor takes them.
+           "8/8/8/8/8/8/8/4K3 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4KK2 w - - 0 1",
+           "4k3/8/8/8/8/8/8/P3K3 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4Q1K1 w - - 0 1",
+           "4k3/8/8/8/8/8/8/4K3 w K - 0 1",
+           "4k2r/8/8/8/8/8/8/4K3 w q - 0 1",
+           "4k3/8/8/8/8/8/8/4K3 w - e6 0 1",
+           "4k3/8/8/8/4p3/8/8/4K3 w - e6 0 1",
+           "4k3/8/8/8/4p3/8/8/4K3 b - e3 0 1",
+       }) {
+    const char* error = nullptr;
+    EXPECT_FALSE(parse_fen(fen, &error)) << fen;
+    EXPECT_NE(error, nullptr) << fen;
+  }
+  EXPECT_TRUE(parse_fen("4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1"));
+  EXPECT_TRUE(parse_fen("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1"));
+}
+
+TEST(ToFen, RoundTrips) {
+  for (const char* fen : {
+           "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+           "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 2",
+           "r3k2r/8/8/8/8/8/8/R3K2R b Kq - 12 140",
+           "4k3/8/8/8/4p3/8/8/4K3 b - e3 0 1",
+           "8/8/8/8/8/8/8/k6K w - - 99 1234567",
+       }) {
+    char buf[Board::max_fen_size];
+    const size_t size = Board(fen).to_fen(buf);
+    EXPECT_EQ(std::string(buf, size), fen);
+    EXPECT_EQ(buf[size], '\0');
+    EXPECT_EQ(Board(fen).to_fen(), fen);
+  }
+}
+
+TEST(ToFen, Appends) {
+  std::string out = "fen: ";
+  Board().append_fen(&out);
+  EXPECT_EQ(out,
+            "fen: rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+}
+
+TEST(ToFen, FitsTheLongestFen) {
+  // No empty squares, every castling right and the longest clocks.
+  const std::string placement =
+      "rnbqkbnr/pppppppp/pppppppp/pppppppp/PPPPPPPP/PPPPPPPP/PPPPPPPP/RNBQKBNR";
+  Board board(placement + " w KQkq - 0 1");
+  board.en_passant_square_ = str_to_square("e6");
+  board.fifty_move_clock_ = std::numeric_limits<int>::min();
+  board.num_moves_ = std::numeric_limits<int>::min();
+  char buf[Board::max_fen_size];
+  EXPECT_EQ(board.to_fen(buf), Board::max_fen_size - 1);
+  EXPECT_EQ(std::string(buf),
+            placement + " w KQkq e6 -2147483648 -2147483648");
+}
+
+TEST(MoveToUci, WritesIntoABuffer) {
+  char buf[Move::max_uci_size];
+  const Move move(str_to_square("e7"), str_to_square("d8"), Piece::pawn,
+                  MoveType::promotion_to_knight);
+  EXPECT_EQ(move.to_uci(buf), 5);
+  EXPECT_EQ(std::string(buf), "e7d8n");
+  EXPECT_EQ(move.to_uci_str(), "e7d8n");
+  EXPECT_EQ(move.to_pretty_str(), "e7d8");
+  std::string out = "pv";
+  Move(str_to_square("a1"), str_to_square("h8"), Piece::bishop,
+       MoveType::simple)
+      .append_uci(&out);
+  EXPECT_EQ(out, "pva1h8");
+  EXPECT_EQ(square_to_str(str_to_square("c6")), "c6");
+}
+
+TEST(ParseUciMove, FindsLegalMoves) {
+  for (const char* fen : {
+           "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 b kq - 0 1",
+           "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+       }) {
+    const Board board(fen);
+    for (Move move : board.legal_moves()) {
+      EXPECT_EQ(parse_uci_move(board, move.to_uci_str()), move)
+          << fen << " " << move.to_uci_str();
+    }
+  }
+  // Chess960, where the king moves onto its rook to castle, and without the
+  // rights steps onto the square of a rook it could once have castled with.
+  for (const char* fen : {
+           "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+           "7k/8/8/8/8/8/8/1K6 w - - 0 1",
+           "4k3/8/8/8/8/8/8/6K1 w - - 0 1",
+           "1r4kr/8/8/8/8/8/8/1R4K1 w - - 0 1",
+       }) {
+    Board board;
+    board.set_fen(fen, true);
+    for (Move move : board.legal_moves()) {
+      EXPECT_EQ(parse_uci_move(board, move.to_uci_str()), move)
+          << fen << " " << move.to_uci_str();
+    }
+  }
+  const Board board;
+  EXPECT_FALSE(parse_uci_move(board, "e2e5"));
+  EXPECT_FALSE(parse_uci_move(board, "e7e5"));
+  EXPECT_FALSE(parse_uci_move(board, "e1g1"));
+  EXPECT_FALSE(parse_uci_move(board, "e2e4q"));
+  EXPECT_FALSE(parse_uci_move(board, "e2"));
+  EXPECT_FALSE(parse_uci_move(board, "i2i4"));
+  // Pinned.
+  EXPECT_FALSE(parse_uci_move(Board("4k3/4r3/8/8/8/8/4N3/4K3 w - - 0 1"),
+                              "e2c3"));
+}
+
 TEST(AllPieces, White) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
   const std::vector<std::string> white_squares = {"a1", "f1", "h1", "a2", "b2",
@@ -514,27 +634,27 @@ TEST(PseudoLegalMoves, A1Rook) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
   const Bitboard a1 = str_to_square("a1");
 
-  std::vector<Move> computed_north_moves;
+  MoveList computed_north_moves;
   board.append_pseudolegal_sliding_moves(Direction::north, Color::white, a1,
                                          Piece::rook, &computed_north_moves);
   EXPECT_TRUE(computed_north_moves.empty());
 
-  std::vector<Move> computed_west_moves;
+  MoveList computed_west_moves;
   board.append_pseudolegal_sliding_moves(Direction::west, Color::white, a1,
                                          Piece::rook, &computed_west_moves);
   EXPECT_TRUE(computed_west_moves.empty());
 
-  std::vector<Move> computed_south_moves;
+  MoveList computed_south_moves;
   board.append_pseudolegal_sliding_moves(Direction::south, Color::white, a1,
                                          Piece::rook, &computed_south_moves);
   EXPECT_TRUE(computed_south_moves.empty());
 
-  std::vector<Move> correct_east_moves = {
-      Move(a1, str_to_square("b1"), Piece::rook, MoveType::simple, board),
-      Move(a1, str_to_square("c1"), Piece::rook, MoveType::simple, board),
-      Move(a1, str_to_square("d1"), Piece::rook, MoveType::simple, board),
-      Move(a1, str_to_square("e1"), Piece::rook, MoveType::simple, board)};
-  std::vector<Move> computed_east_moves;
+  MoveList correct_east_moves = {
+      Move(a1, str_to_square("b1"), Piece::rook, MoveType::simple),
+      Move(a1, str_to_square("c1"), Piece::rook, MoveType::simple),
+      Move(a1, str_to_square("d1"), Piece::rook, MoveType::simple),
+      Move(a1, str_to_square("e1"), Piece::rook, MoveType::simple)};
+  MoveList computed_east_moves;
   board.append_pseudolegal_sliding_moves(Direction::east, Color::white, a1,
                                          Piece::rook, &computed_east_moves);
   EXPECT_EQ(computed_east_moves, correct_east_moves);
@@ -544,29 +664,29 @@ TEST(PseudoLegalMoves, F1Rook) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
   const Bitboard f1 = str_to_square("f1");
 
-  std::vector<Move> computer_north_moves;
+  MoveList computer_north_moves;
   board.append_pseudolegal_sliding_moves(Direction::north, Color::white, f1,
                                          Piece::rook, &computer_north_moves);
   EXPECT_TRUE(computer_north_moves.empty());
 
-  std::vector<Move> computer_south_moves;
+  MoveList computer_south_moves;
   board.append_pseudolegal_sliding_moves(Direction::south, Color::white, f1,
                                          Piece::rook, &computer_south_moves);
   EXPECT_TRUE(computer_south_moves.empty());
 
-  std::vector<Move> correct_east_moves = {
-      Move(f1, str_to_square("g1"), Piece::rook, MoveType::simple, board)};
-  std::vector<Move> computer_east_moves;
+  MoveList correct_east_moves = {
+      Move(f1, str_to_square("g1"), Piece::rook, MoveType::simple)};
+  MoveList computer_east_moves;
   board.append_pseudolegal_sliding_moves(Direction::east, Color::white, f1,
                                          Piece::rook, &computer_east_moves);
   EXPECT_EQ(computer_east_moves, correct_east_moves);
 
-  std::vector<Move> correct_west_moves = {
-      Move(f1, str_to_square("e1"), Piece::rook, MoveType::simple, board),
-      Move(f1, str_to_square("d1"), Piece::rook, MoveType::simple, board),
-      Move(f1, str_to_square("c1"), Piece::rook, MoveType::simple, board),
-      Move(f1, str_to_square("b1"), Piece::rook, MoveType::simple, board)};
-  std::vector<Move> computer_west_moves;
+  MoveList correct_west_moves = {
+      Move(f1, str_to_square("e1"), Piece::rook, MoveType::simple),
+      Move(f1, str_to_square("d1"), Piece::rook, MoveType::simple),
+      Move(f1, str_to_square("c1"), Piece::rook, MoveType::simple),
+      Move(f1, str_to_square("b1"), Piece::rook, MoveType::simple)};
+  MoveList computer_west_moves;
   board.append_pseudolegal_sliding_moves(Direction::west, Color::white, f1,
                                          Piece::rook, &computer_west_moves);
   EXPECT_EQ(computer_west_moves, correct_west_moves);
@@ -576,63 +696,63 @@ TEST(PseudoLegalMoves, B3Queen) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
   const Bitboard b3 = str_to_square("b3");
 
-  std::vector<Move> computed_east_moves;
+  MoveList computed_east_moves;
   board.append_pseudolegal_sliding_moves(Direction::east, Color::white, b3,
                                          Piece::queen, &computed_east_moves);
   EXPECT_TRUE(computed_east_moves.empty());
 
-  std::vector<Move> computed_southwest_moves;
+  MoveList computed_southwest_moves;
   board.append_pseudolegal_sliding_moves(Direction::southwest, Color::white, b3,
                                          Piece::queen,
                                          &computed_southwest_moves);
   EXPECT_TRUE(computed_southwest_moves.empty());
 
-  std::vector<Move> computed_south_moves;
+  MoveList computed_south_moves;
   board.append_pseudolegal_sliding_moves(Direction::south, Color::white, b3,
                                          Piece::queen, &computed_south_moves);
   EXPECT_TRUE(computed_south_moves.empty());
 
-  std::vector<Move> correct_north_moves = {
-      Move(b3, str_to_square("b4"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("b5"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("b6"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("b7"), Piece::queen, MoveType::capture, board)};
-  std::vector<Move> computed_north_moves;
+  MoveList correct_north_moves = {
+      Move(b3, str_to_square("b4"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("b5"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("b6"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("b7"), Piece::queen, MoveType::capture)};
+  MoveList computed_north_moves;
   board.append_pseudolegal_sliding_moves(Direction::north, Color::white, b3,
                                          Piece::queen, &computed_north_moves);
   EXPECT_EQ(computed_north_moves, correct_north_moves);
 
-  std::vector<Move> correct_northwest_moves = {
-      Move(b3, str_to_square("a4"), Piece::queen, MoveType::simple, board)};
-  std::vector<Move> computed_northwest_moves;
+  MoveList correct_northwest_moves = {
+      Move(b3, str_to_square("a4"), Piece::queen, MoveType::simple)};
+  MoveList computed_northwest_moves;
   board.append_pseudolegal_sliding_moves(Direction::northwest, Color::white, b3,
                                          Piece::queen,
                                          &computed_northwest_moves);
   EXPECT_EQ(computed_northwest_moves, correct_northwest_moves);
 
-  std::vector<Move> correct_northeast_moves = {
-      Move(b3, str_to_square("c4"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("d5"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("e6"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("f7"), Piece::queen, MoveType::capture, board)};
-  std::vector<Move> computed_northeast_moves;
+  MoveList correct_northeast_moves = {
+      Move(b3, str_to_square("c4"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("d5"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("e6"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("f7"), Piece::queen, MoveType::capture)};
+  MoveList computed_northeast_moves;
   board.append_pseudolegal_sliding_moves(Direction::northeast, Color::white, b3,
                                          Piece::queen,
                                          &computed_northeast_moves);
   EXPECT_EQ(computed_northeast_moves, correct_northeast_moves);
 
-  std::vector<Move> correct_west_moves = {
-      Move(b3, str_to_square("a3"), Piece::queen, MoveType::simple, board)};
-  std::vector<Move> computed_west_moves;
+  MoveList correct_west_moves = {
+      Move(b3, str_to_square("a3"), Piece::queen, MoveType::simple)};
+  MoveList computed_west_moves;
   board.append_pseudolegal_sliding_moves(Direction::west, Color::white, b3,
                                          Piece::queen, &computed_west_moves);
   EXPECT_EQ(computed_west_moves, correct_west_moves);
 
-  std::vector<Move> correct_southeast_moves = {
-      Move(b3, str_to_square("c2"), Piece::queen, MoveType::simple, board),
-      Move(b3, str_to_square("d1"), Piece::queen, MoveType::simple, board),
+  MoveList correct_southeast_moves = {
+      Move(b3, str_to_square("c2"), Piece::queen, MoveType::simple),
+      Move(b3, str_to_square("d1"), Piece::queen, MoveType::simple),
   };
-  std::vector<Move> computed_southeast_moves;
+  MoveList computed_southeast_moves;
   board.append_pseudolegal_sliding_moves(Direction::southeast, Color::white, b3,
                                          Piece::queen,
                                          &computed_southeast_moves);
@@ -643,27 +763,27 @@ TEST(PseudoLegalMoves, A8Rook) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
   const Bitboard a8 = str_to_square("a8");
 
-  std::vector<Move> computed_north_moves;
+  MoveList computed_north_moves;
   board.append_pseudolegal_sliding_moves(Direction::north, Color::black, a8,
                                          Piece::rook, &computed_north_moves);
   EXPECT_TRUE(computed_north_moves.empty());
 
-  std::vector<Move> computed_west_moves;
+  MoveList computed_west_moves;
   board.append_pseudolegal_sliding_moves(Direction::west, Color::black, a8,
                                          Piece::rook, &computed_west_moves);
   EXPECT_TRUE(computed_west_moves.empty());
 
-  std::vector<Move> computed_south_moves;
+  MoveList computed_south_moves;
   board.append_pseudolegal_sliding_moves(Direction::south, Color::black, a8,
                                          Piece::rook, &computed_south_moves);
   EXPECT_TRUE(computed_south_moves.empty());
 
-  std::vector<Move> correct_east_moves = {
-      Move(a8, str_to_square("b8"), Piece::rook, MoveType::simple, board),
-      Move(a8, str_to_square("c8"), Piece::rook, MoveType::simple, board),
-      Move(a8, str_to_square("d8"), Piece::rook, MoveType::simple, board),
-      Move(a8, str_to_square("e8"), Piece::rook, MoveType::simple, board)};
-  std::vector<Move> computed_east_moves;
+  MoveList correct_east_moves = {
+      Move(a8, str_to_square("b8"), Piece::rook, MoveType::simple),
+      Move(a8, str_to_square("c8"), Piece::rook, MoveType::simple),
+      Move(a8, str_to_square("d8"), Piece::rook, MoveType::simple),
+      Move(a8, str_to_square("e8"), Piece::rook, MoveType::simple)};
+  MoveList computed_east_moves;
   board.append_pseudolegal_sliding_moves(Direction::east, Color::black, a8,
                                          Piece::rook, &computed_east_moves);
   EXPECT_EQ(computed_east_moves, correct_east_moves);
@@ -673,27 +793,27 @@ TEST(PseudoLegalMoves, F8Rook) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
   const Bitboard f8 = str_to_square("f8");
 
-  std::vector<Move> computed_north_moves;
+  MoveList computed_north_moves;
   board.append_pseudolegal_sliding_moves(Direction::north, Color::black, f8,
                                          Piece::rook, &computed_north_moves);
   EXPECT_TRUE(computed_north_moves.empty());
 
-  std::vector<Move> computed_east_moves;
+  MoveList computed_east_moves;
   board.append_pseudolegal_sliding_moves(Direction::east, Color::black, f8,
                                          Piece::rook, &computed_east_moves);
   EXPECT_TRUE(computed_east_moves.empty());
 
-  std::vector<Move> computed_south_moves;
+  MoveList computed_south_moves;
   board.append_pseudolegal_sliding_moves(Direction::south, Color::black, f8,
                                          Piece::rook, &computed_south_moves);
   EXPECT_TRUE(computed_south_moves.empty());
 
-  std::vector<Move> correct_west_moves = {
-      Move(f8, str_to_square("e8"), Piece::rook, MoveType::simple, board),
-      Move(f8, str_to_square("d8"), Piece::rook, MoveType::simple, board),
-      Move(f8, str_to_square("c8"), Piece::rook, MoveType::simple, board),
-      Move(f8, str_to_square("b8"), Piece::rook, MoveType::simple, board)};
-  std::vector<Move> computed_west_moves;
+  MoveList correct_west_moves = {
+      Move(f8, str_to_square("e8"), Piece::rook, MoveType::simple),
+      Move(f8, str_to_square("d8"), Piece::rook, MoveType::simple),
+      Move(f8, str_to_square("c8"), Piece::rook, MoveType::simple),
+      Move(f8, str_to_square("b8"), Piece::rook, MoveType::simple)};
+  MoveList computed_west_moves;
   board.append_pseudolegal_sliding_moves(Direction::west, Color::black, f8,
                                          Piece::rook, &computed_west_moves);
   EXPECT_EQ(computed_west_moves, correct_west_moves);
@@ -703,31 +823,31 @@ TEST(PseudoLegalMoves, G6Bishop) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
   const Bitboard g6 = str_to_square("g6");
 
-  std::vector<Move> computed_northwest_moves;
+  MoveList computed_northwest_moves;
   board.append_pseudolegal_sliding_moves(Direction::northwest, Color::black, g6,
                                          Piece::bishop,
                                          &computed_northwest_moves);
   EXPECT_TRUE(computed_northwest_moves.empty());
 
-  std::vector<Move> northeast_moves = {
-      Move(g6, str_to_square("h7"), Piece::bishop, MoveType::simple, board)};
-  std::vector<Move> computed_northeast_moves;
+  MoveList northeast_moves = {
+      Move(g6, str_to_square("h7"), Piece::bishop, MoveType::simple)};
+  MoveList computed_northeast_moves;
   board.append_pseudolegal_sliding_moves(Direction::northeast, Color::black, g6,
                                          Piece::bishop,
                                          &computed_northeast_moves);
   EXPECT_EQ(computed_northeast_moves, northeast_moves);
 
-  std::vector<Move> southwest_moves = {
-      Move(g6, str_to_square("f5"), Piece::bishop, MoveType::simple, board)};
-  std::vector<Move> computed_southwest_moves;
+  MoveList southwest_moves = {
+      Move(g6, str_to_square("f5"), Piece::bishop, MoveType::simple)};
+  MoveList computed_southwest_moves;
   board.append_pseudolegal_sliding_moves(Direction::southwest, Color::black, g6,
                                          Piece::bishop,
                                          &computed_southwest_moves);
   EXPECT_EQ(computed_southwest_moves, southwest_moves);
 
-  std::vector<Move> southeast_moves = {
-      Move(g6, str_to_square("h5"), Piece::bishop, MoveType::simple, board)};
-  std::vector<Move> computed_southeast_moves;
+  MoveList southeast_moves = {
+      Move(g6, str_to_square("h5"), Piece::bishop, MoveType::simple)};
+  MoveList computed_southeast_moves;
   board.append_pseudolegal_sliding_moves(Direction::southeast, Color::black, g6,
                                          Piece::bishop,
                                          &computed_southeast_moves);
@@ -738,59 +858,59 @@ TEST(PseudoLegalMoves, H4Queen) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
   const Bitboard h4 = str_to_square("h4");
 
-  std::vector<Move> correct_north_moves = {
-      Move(h4, str_to_square("h5"), Piece::queen, MoveType::simple, board)};
-  std::vector<Move> computed_north_moves;
+  MoveList correct_north_moves = {
+      Move(h4, str_to_square("h5"), Piece::queen, MoveType::simple)};
+  MoveList computed_north_moves;
   board.append_pseudolegal_sliding_moves(Direction::north, Color::black, h4,
                                          Piece::queen, &computed_north_moves);
   EXPECT_EQ(computed_north_moves, correct_north_moves);
 
-  std::vector<Move> correct_south_moves = {
-      Move(h4, str_to_square("h3"), Piece::queen, MoveType::capture, board)};
-  std::vector<Move> computed_south_moves;
+  MoveList correct_south_moves = {
+      Move(h4, str_to_square("h3"), Piece::queen, MoveType::capture)};
+  MoveList computed_south_moves;
   board.append_pseudolegal_sliding_moves(Direction::south, Color::black, h4,
                                          Piece::queen, &computed_south_moves);
   EXPECT_EQ(computed_south_moves, correct_south_moves);
 
-  std::vector<Move> computed_west_moves;
+  MoveList computed_west_moves;
   board.append_pseudolegal_sliding_moves(Direction::west, Color::black, h4,
                                          Piece::queen, &computed_west_moves);
   EXPECT_TRUE(computed_west_moves.empty());
 
-  std::vector<Move> computed_east_moves;
+  MoveList computed_east_moves;
   board.append_pseudolegal_sliding_moves(Direction::east, Color::black, h4,
                                          Piece::queen, &computed_east_moves);
   EXPECT_TRUE(computed_east_moves.empty());
 
-  std::vector<Move> computed_northeast_moves;
+  MoveList computed_northeast_moves;
   board.append_pseudolegal_sliding_moves(Direction::northeast, Color::black, h4,
                                          Piece::queen,
                                          &computed_northeast_moves);
   EXPECT_TRUE(computed_northeast_moves.empty());
 
-  std::vector<Move> computed_southeast_moves;
+  MoveList computed_southeast_moves;
   board.append_pseudolegal_sliding_moves(Direction::southeast, Color::black, h4,
                                          Piece::queen,
                                          &computed_southeast_moves);
   EXPECT_TRUE(computed_southeast_moves.empty());
 
-  std::vector<Move> correct_northwest_moves = {
-      Move(h4, str_to_square("g5"), Piece::queen, MoveType::simple, board),
-      Move(h4, str_to_square("f6"), Piece::queen, MoveType::simple, board),
-      Move(h4, str_to_square("e7"), Piece::queen, MoveType::simple, board),
-      Move(h4, str_to_square("d8"), Piece::queen, MoveType::simple, board),
+  MoveList correct_northwest_moves = {
+      Move(h4, str_to_square("g5"), Piece::queen, MoveType::simple),
+      Move(h4, str_to_square("f6"), Piece::queen, MoveType::simple),
+      Move(h4, str_to_square("e7"), Piece::queen, MoveType::simple),
+      Move(h4, str_to_square("d8"), Piece::queen, MoveType::simple),
   };
-  std::vector<Move> computed_northwest_moves;
+  MoveList computed_northwest_moves;
   board.append_pseudolegal_sliding_moves(Direction::northwest, Color::black, h4,
                                          Piece::queen,
                                          &computed_northwest_moves);
   EXPECT_EQ(computed_northwest_moves, correct_northwest_moves);
 
-  std::vector<Move> correct_southwest_moves = {
-      Move(h4, str_to_square("g3"), Piece::queen, MoveType::simple, board),
-      Move(h4, str_to_square("f2"), Piece::queen, MoveType::capture, board),
+  MoveList correct_southwest_moves = {
+      Move(h4, str_to_square("g3"), Piece::queen, MoveType::simple),
+      Move(h4, str_to_square("f2"), Piece::queen, MoveType::capture),
   };
-  std::vector<Move> computed_southwest_moves;
+  MoveList computed_southwest_moves;
   board.append_pseudolegal_sliding_moves(Direction::southwest, Color::black, h4,
                                          Piece::queen,
                                          &computed_southwest_moves);
@@ -800,22 +920,22 @@ TEST(PseudoLegalMoves, H4Queen) {
 TEST(PseudoLegalMoves, BishopMovesWhite) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 w - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("d2"), str_to_square("c1"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("e3"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("f4"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("g5"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("e1"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("h6"), Piece::bishop,
-           MoveType::capture, board)
+           MoveType::capture)
 
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_bishop_moves(Color::white, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -825,18 +945,18 @@ TEST(PseudoLegalMoves, BishopMovesWhite) {
 TEST(PseudoLegalMoves, BishopMovesBlack) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 b - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("f8"), str_to_square("e7"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("d6"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("c5"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("b4"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("a3"), Piece::bishop,
-           MoveType::simple, board)};
-  std::vector<Move> computed_moves;
+           MoveType::simple)};
+  MoveList computed_moves;
   board.append_pseudolegal_bishop_moves(Color::black, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -846,32 +966,32 @@ TEST(PseudoLegalMoves, BishopMovesBlack) {
 TEST(PseudoLegalMoves, RookMovesWhite) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 w - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("a1"), str_to_square("a2"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("a3"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("b1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("c1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("a4"), Piece::rook,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("d1"), str_to_square("c1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("b1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("e1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("f1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("g1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("h1"), Piece::rook,
-           MoveType::simple, board)
+           MoveType::simple)
 
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_rook_moves(Color::white, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -881,31 +1001,31 @@ TEST(PseudoLegalMoves, RookMovesWhite) {
 TEST(PseudoLegalMoves, RookMovesBlack) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 b - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("a8"), str_to_square("a7"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("a6"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("a5"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("b8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("c8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("c8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("b8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("e8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("d7"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("d6"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("d5"), Piece::rook,
-           MoveType::capture, board),
+           MoveType::capture),
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_rook_moves(Color::black, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -915,42 +1035,42 @@ TEST(PseudoLegalMoves, RookMovesBlack) {
 TEST(PseudoLegalMoves, QueenMovesWhite) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 w - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("h4"), str_to_square("g3"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("f2"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("e1"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("g4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("f4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("e4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("d4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("c4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("b4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("a4"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("h4"), str_to_square("g5"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("f6"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("e7"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("d8"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("h4"), str_to_square("h5"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("h6"), Piece::queen,
-           MoveType::capture, board)
+           MoveType::capture)
 
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_queen_moves(Color::white, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -960,35 +1080,35 @@ TEST(PseudoLegalMoves, QueenMovesWhite) {
 TEST(PseudoLegalMoves, QueenMovesBlack) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 b - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("b3"), str_to_square("a2"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("a3"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b2"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b3"), str_to_square("c2"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("d1"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b3"), str_to_square("c3"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b3"), str_to_square("b4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b5"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b6"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b7"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b8"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("c4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("d5"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_queen_moves(Color::black, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -998,14 +1118,14 @@ TEST(PseudoLegalMoves, QueenMovesBlack) {
 TEST(PseudoLegalMoves, KingMovesWhite) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 w - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("h2"), str_to_square("h1"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h2"), str_to_square("g1"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h2"), str_to_square("g3"), Piece::king,
-           MoveType::simple, board)};
-  std::vector<Move> computed_moves;
+           MoveType::simple)};
+  MoveList computed_moves;
   board.append_pseudolegal_king_moves(Color::white, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -1017,13 +1137,13 @@ TEST(PseudoLegalMoves, KingMovesWhite) {
 TEST(PseudoLegalMoves, KingMovesBlack) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 b - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("h7"), str_to_square("h8"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h7"), str_to_square("g6"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_king_moves(Color::black, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -1033,23 +1153,23 @@ TEST(PseudoLegalMoves, KingMovesBlack) {
 TEST(PseudoLegalMoves, KnightMovesWhite) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 w - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("f5"), str_to_square("e7"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("g7"), Piece::knight,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("f5"), str_to_square("h6"), Piece::knight,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("f5"), str_to_square("g3"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("e3"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("d4"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("d6"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_knight_moves(Color::white, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -1061,13 +1181,13 @@ TEST(PseudoLegalMoves, KnightMovesWhite) {
 TEST(PseudoLegalMoves, KnightMovesBlack) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 b - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       Move(str_to_square("g8"), str_to_square("e7"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g8"), str_to_square("f6"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
   };
-  std::vector<Move> computed_moves;
+  MoveList computed_moves;
   board.append_pseudolegal_knight_moves(Color::black, &computed_moves);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -1077,109 +1197,109 @@ TEST(PseudoLegalMoves, KnightMovesBlack) {
 TEST(PseudoLegalMoves, White) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 w - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       // Bishop moves.
       Move(str_to_square("d2"), str_to_square("c1"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("e3"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("f4"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("g5"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("e1"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d2"), str_to_square("h6"), Piece::bishop,
-           MoveType::capture, board),
+           MoveType::capture),
       // Rook moves.
       Move(str_to_square("a1"), str_to_square("a2"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("a3"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("b1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("c1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a1"), str_to_square("a4"), Piece::rook,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("d1"), str_to_square("c1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("b1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("e1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("f1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("g1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d1"), str_to_square("h1"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       // Queen moves.
       Move(str_to_square("h4"), str_to_square("g3"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("f2"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("e1"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("g4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("f4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("e4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("d4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("c4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("b4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("a4"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("h4"), str_to_square("g5"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("f6"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("e7"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("d8"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("h4"), str_to_square("h5"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h4"), str_to_square("h6"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       // King moves.
       Move(str_to_square("h2"), str_to_square("h1"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h2"), str_to_square("g1"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h2"), str_to_square("g3"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       // Knight moves.
       Move(str_to_square("f5"), str_to_square("e7"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("g7"), Piece::knight,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("f5"), str_to_square("h6"), Piece::knight,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("f5"), str_to_square("g3"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("e3"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("d4"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f5"), str_to_square("d6"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       // Pawn moves.
       Move(str_to_square("c3"), str_to_square("c4"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d5"), str_to_square("d6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f3"), str_to_square("f4"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g2"), str_to_square("g3"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g2"), str_to_square("g4"), Piece::pawn,
-           MoveType::two_step_pawn, board)};
+           MoveType::two_step_pawn)};
   auto computed_moves = board.pseudolegal_moves(Color::white);
   EXPECT_EQ(computed_moves.size(), correct_moves.size());
   EXPECT_TRUE(std::is_permutation(computed_moves.begin(), computed_moves.end(),
@@ -1191,91 +1311,91 @@ TEST(PseudoLegalMoves, White) {
 TEST(PseudoLegalMoves, Black) {
   Board board("r2r1bn1/5ppk/7p/3PpN2/p6Q/1qP2P1P/1P1B2PK/R2R4 b - - 4 36");
 
-  std::vector<Move> correct_moves = {
+  MoveList correct_moves = {
       // Bishop moves.
       Move(str_to_square("f8"), str_to_square("e7"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("d6"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("c5"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("b4"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f8"), str_to_square("a3"), Piece::bishop,
-           MoveType::simple, board),
+           MoveType::simple),
       // Rook moves.
       Move(str_to_square("a8"), str_to_square("a7"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("a6"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("a5"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("b8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("a8"), str_to_square("c8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("c8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("b8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("e8"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("d7"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("d6"), Piece::rook,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("d8"), str_to_square("d5"), Piece::rook,
-           MoveType::capture, board),
+           MoveType::capture),
       // Queen moves.
       Move(str_to_square("b3"), str_to_square("a2"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("a3"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b2"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b3"), str_to_square("c2"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("d1"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b3"), str_to_square("c3"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b3"), str_to_square("b4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b5"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b6"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b7"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("b8"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("c4"), Piece::queen,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b3"), str_to_square("d5"), Piece::queen,
-           MoveType::capture, board),
+           MoveType::capture),
       // King moves.
       Move(str_to_square("h7"), str_to_square("h8"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h7"), str_to_square("g6"), Piece::king,
-           MoveType::simple, board),
+           MoveType::simple),
       // Knight moves.
       Move(str_to_square("g8"), str_to_square("e7"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g8"), str_to_square("f6"), Piece::knight,
-           MoveType::simple, board),
+           MoveType::simple),
       // Pawn moves.
       Move(str_to_square("a4"), str_to_square("a3"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("e5"), str_to_square("e4"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f7"), str_to_square("f6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g7"), str_to_square("g6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g7"), str_to_square("g5"), Piece::pawn,
-           MoveType::two_step_pawn, board),
+           MoveType::two_step_pawn),
       Move(str_to_square("h6"), str_to_square("h5"), Piece::pawn,
-           MoveType::simple, board)
+           MoveType::simple)
 
   };
   auto computed_moves = board.pseudolegal_moves(Color::black);
@@ -1287,13 +1407,24 @@ TEST(PseudoLegalMoves, Black) {
 TEST(AttackMoves, Simple) {
   Board board("4k3/8/8/8/4P3/8/8/2K5 w - - 0 1");
 
+  // The pawn's push to e5 is not an attack.
   Bitboard bb = str_to_square("b1") | str_to_square("d1") |
                 str_to_square("b2") | str_to_square("c2") |
-                str_to_square("d2") | str_to_square("e5") |
-                str_to_square("d5") | str_to_square("f5");
+                str_to_square("d2") | str_to_square("d5") | str_to_square("f5");
   EXPECT_EQ(board.attack_squares(Color::white), bb);
 }
 
+TEST(AttackMoves, DefendedPieces) {
+  Board board("4k3/8/8/8/8/8/3N4/R3K3 w - - 0 1");
+  const Bitboard attacks = board.attack_squares(Color::white);
+  // Squares occupied by white's own pieces count as attacked when another
+  // white piece defends them.
+  EXPECT_TRUE(attacks & str_to_square("e1"));
+  EXPECT_TRUE(attacks & str_to_square("d2"));
+  // The king blocks the rook from reaching g1.
+  EXPECT_FALSE(attacks & str_to_square("g1"));
+}
+
 TEST(SquareToStr, Simple) {
   EXPECT_EQ(square_to_str(str_to_square("a1")), "a1");
   EXPECT_EQ(square_to_str(str_to_square("e4")), "e4");
@@ -1306,15 +1437,15 @@ TEST(SquareToStr, Simple) {
 TEST(PseudoLegalMoves, SimplePawnMovesWhite) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
 
-  std::vector<Move> moves = {Move(str_to_square("g2"), str_to_square("g3"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("f2"), str_to_square("f3"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("a2"), str_to_square("a3"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("d4"), str_to_square("d5"),
-                                  Piece::pawn, MoveType::simple, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("g2"), str_to_square("g3"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("f2"), str_to_square("f3"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("a2"), str_to_square("a3"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("d4"), str_to_square("d5"),
+                         Piece::pawn, MoveType::simple)};
+  MoveList test_moves;
   board.append_pseudolegal_simple_pawn_moves(Color::white, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1322,17 +1453,17 @@ TEST(PseudoLegalMoves, SimplePawnMovesWhite) {
 TEST(PseudoLegalMoves, SimplePawnMovesBlack) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
 
-  std::vector<Move> moves = {Move(str_to_square("h6"), str_to_square("h5"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("c6"), str_to_square("c5"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("f7"), str_to_square("f6"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("b7"), str_to_square("b6"),
-                                  Piece::pawn, MoveType::simple, board),
-                             Move(str_to_square("a7"), str_to_square("a6"),
-                                  Piece::pawn, MoveType::simple, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("h6"), str_to_square("h5"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("c6"), str_to_square("c5"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("f7"), str_to_square("f6"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("b7"), str_to_square("b6"),
+                         Piece::pawn, MoveType::simple),
+                    Move(str_to_square("a7"), str_to_square("a6"),
+                         Piece::pawn, MoveType::simple)};
+  MoveList test_moves;
   board.append_pseudolegal_simple_pawn_moves(Color::black, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1340,11 +1471,11 @@ TEST(PseudoLegalMoves, SimplePawnMovesBlack) {
 TEST(PseudoLegalMoves, TwoStepPawnMovesWhite) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
 
-  std::vector<Move> moves = {Move(str_to_square("f2"), str_to_square("f4"),
-                                  Piece::pawn, MoveType::two_step_pawn, board),
-                             Move(str_to_square("a2"), str_to_square("a4"),
-                                  Piece::pawn, MoveType::two_step_pawn, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("f2"), str_to_square("f4"),
+                         Piece::pawn, MoveType::two_step_pawn),
+                    Move(str_to_square("a2"), str_to_square("a4"),
+                         Piece::pawn, MoveType::two_step_pawn)};
+  MoveList test_moves;
   board.append_pseudolegal_two_step_pawn_moves(Color::white, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1352,15 +1483,15 @@ TEST(PseudoLegalMoves, TwoStepPawnMovesWhite) {
 TEST(PseudoLegalMoves, TwoStepPawnMovesBlack) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
 
-  std::vector<Move> moves = {Move(str_to_square("f7"), str_to_square("f5"),
-                                  Piece::pawn, MoveType::two_step_pawn, board),
-                             Move(str_to_square("b7"), str_to_square("b5"),
-                                  Piece::pawn, MoveType::two_step_pawn, board),
-                             Move(str_to_square("a7"), str_to_square("a5"),
-                                  Piece::pawn, MoveType::two_step_pawn, board)
+  MoveList moves = {Move(str_to_square("f7"), str_to_square("f5"),
+                         Piece::pawn, MoveType::two_step_pawn),
+                    Move(str_to_square("b7"), str_to_square("b5"),
+                         Piece::pawn, MoveType::two_step_pawn),
+                    Move(str_to_square("a7"), str_to_square("a5"),
+                         Piece::pawn, MoveType::two_step_pawn)
 
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_two_step_pawn_moves(Color::black, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1368,7 +1499,7 @@ TEST(PseudoLegalMoves, TwoStepPawnMovesBlack) {
 TEST(PseudoLegalMoves, NoEnPassantMovesWhite) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K w - - 1 18");
 
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_en_passant_moves(Color::white, &test_moves);
   EXPECT_TRUE(test_moves.empty());
 }
@@ -1376,9 +1507,9 @@ TEST(PseudoLegalMoves, NoEnPassantMovesWhite) {
 TEST(PseudoLegalMoves, OneEnPassantMoveWhite) {
   Board board("rnbqkbnr/1pp1pppp/p7/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 3");
 
-  std::vector<Move> moves = {Move(str_to_square("e5"), str_to_square("d6"),
-                                  Piece::pawn, MoveType::en_passant, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("e5"), str_to_square("d6"),
+                         Piece::pawn, MoveType::en_passant)};
+  MoveList test_moves;
   board.append_pseudolegal_en_passant_moves(Color::white, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1386,11 +1517,11 @@ TEST(PseudoLegalMoves, OneEnPassantMoveWhite) {
 TEST(PseudoLegalMoves, TwoEnPassantMovesWhite) {
   Board board("rnbqkbnr/1pp1pppp/8/2PpP3/p7/8/PP1P1PPP/RNBQKBNR w KQkq d6 0 5");
 
-  std::vector<Move> moves = {Move(str_to_square("c5"), str_to_square("d6"),
-                                  Piece::pawn, MoveType::en_passant, board),
-                             Move(str_to_square("e5"), str_to_square("d6"),
-                                  Piece::pawn, MoveType::en_passant, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("c5"), str_to_square("d6"),
+                         Piece::pawn, MoveType::en_passant),
+                    Move(str_to_square("e5"), str_to_square("d6"),
+                         Piece::pawn, MoveType::en_passant)};
+  MoveList test_moves;
   board.append_pseudolegal_en_passant_moves(Color::white, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1398,7 +1529,7 @@ TEST(PseudoLegalMoves, TwoEnPassantMovesWhite) {
 TEST(PseudoLegalMoves, NoEnPassantMovesBlack) {
   Board board("r4rk1/pp3pp1/2p3bp/8/3Pp1nq/1QN1P2P/PP1N1PP1/R4R1K b - - 1 18");
 
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_en_passant_moves(Color::black, &test_moves);
   EXPECT_TRUE(test_moves.empty());
 }
@@ -1407,9 +1538,9 @@ TEST(PseudoLegalMoves, OneEnPassantMoveBlack) {
   Board board(
       "rnbqkbnr/ppp1p1pp/8/5p2/P2pP3/7P/1PPP1PP1/RNBQKBNR b KQkq e3 0 4");
 
-  std::vector<Move> moves = {Move(str_to_square("d4"), str_to_square("e3"),
-                                  Piece::pawn, MoveType::en_passant, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("d4"), str_to_square("e3"),
+                         Piece::pawn, MoveType::en_passant)};
+  MoveList test_moves;
   board.append_pseudolegal_en_passant_moves(Color::black, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1418,13 +1549,13 @@ TEST(PseudoLegalMoves, TwoEnPassantMovesBlack) {
   Board board(
       "rnbqkbnr/ppp1p1pp/8/P7/3pPp2/7P/1PPP1PP1/RNBQKBNR b KQkq e3 0 5");
 
-  std::vector<Move> moves = {Move(str_to_square("d4"), str_to_square("e3"),
-                                  Piece::pawn, MoveType::en_passant, board),
-                             Move(str_to_square("f4"), str_to_square("e3"),
-                                  Piece::pawn, MoveType::en_passant, board)
+  MoveList moves = {Move(str_to_square("d4"), str_to_square("e3"),
+                         Piece::pawn, MoveType::en_passant),
+                    Move(str_to_square("f4"), str_to_square("e3"),
+                         Piece::pawn, MoveType::en_passant)
 
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_en_passant_moves(Color::black, &test_moves);
   EXPECT_EQ(test_moves, moves);
 }
@@ -1432,65 +1563,65 @@ TEST(PseudoLegalMoves, TwoEnPassantMovesBlack) {
 TEST(PseudoLegalMoves, PromotionsWhite) {
   Board board("1Q1r1Q1q/PPP1PPPP/3P4/8/8/8/8/k2K4 w - - 0 1");
 
-  std::vector<Move> moves = {
+  MoveList moves = {
       Move(str_to_square("a7"), str_to_square("a8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("a7"), str_to_square("a8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("a7"), str_to_square("a8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("a7"), str_to_square("a8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("c7"), str_to_square("c8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("c7"), str_to_square("c8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("c7"), str_to_square("c8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("c7"), str_to_square("c8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("c7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("c7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("c7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("c7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("e7"), str_to_square("e8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("e7"), str_to_square("e8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("e7"), str_to_square("e8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("e7"), str_to_square("e8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("e7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("e7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("e7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("e7"), str_to_square("d8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("g7"), str_to_square("g8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("g7"), str_to_square("g8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("g7"), str_to_square("g8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("g7"), str_to_square("g8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("g7"), str_to_square("h8"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("g7"), str_to_square("h8"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("g7"), str_to_square("h8"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("g7"), str_to_square("h8"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_promotions(Color::white, &test_moves);
   EXPECT_EQ(test_moves.size(), moves.size());
   EXPECT_TRUE(
@@ -1500,65 +1631,65 @@ TEST(PseudoLegalMoves, PromotionsWhite) {
 TEST(PseudoLegalMoves, PromotionsBlack) {
   Board board("1K1k4/8/8/8/8/3p4/ppp1pppp/1q1R1q1Q b - - 0 1");
 
-  std::vector<Move> moves = {
+  MoveList moves = {
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("c2"), str_to_square("c1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("c2"), str_to_square("c1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("c2"), str_to_square("c1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("c2"), str_to_square("c1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("c2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("c2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("c2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("c2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("e2"), str_to_square("e1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("e2"), str_to_square("e1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("e2"), str_to_square("e1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("e2"), str_to_square("e1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("e2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("e2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("e2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("e2"), str_to_square("d1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("g2"), str_to_square("g1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("g2"), str_to_square("g1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("g2"), str_to_square("g1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("g2"), str_to_square("g1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("g2"), str_to_square("h1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("g2"), str_to_square("h1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("g2"), str_to_square("h1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("g2"), str_to_square("h1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_promotions(Color::black, &test_moves);
   EXPECT_EQ(test_moves.size(), moves.size());
   EXPECT_TRUE(
@@ -1569,77 +1700,81 @@ TEST(PseudoLegalMoves, PawnCapturesWhite) {
   Board board(
       "rn1qk2r/Pp2pp1p/2p5/1p1pbbpn/2PPPPPN/8/1P5P/RNBQK2R w KQkq - 1 13");
 
-  std::vector<Move> moves = {Move(str_to_square("g4"), str_to_square("h5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("g4"), str_to_square("f5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("f4"), str_to_square("g5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("f4"), str_to_square("e5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("e4"), str_to_square("f5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("e4"), str_to_square("d5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("d4"), str_to_square("e5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("c4"), str_to_square("d5"),
-                                  Piece::pawn, MoveType::capture, board),
-                             Move(str_to_square("c4"), str_to_square("b5"),
-                                  Piece::pawn, MoveType::capture, board)};
-  std::vector<Move> test_moves;
+  MoveList moves = {Move(str_to_square("g4"), str_to_square("h5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("g4"), str_to_square("f5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("f4"), str_to_square("g5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("f4"), str_to_square("e5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("e4"), str_to_square("f5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("e4"), str_to_square("d5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("d4"), str_to_square("e5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("c4"), str_to_square("d5"),
+                         Piece::pawn, MoveType::capture),
+                    Move(str_to_square("c4"), str_to_square("b5"),
+                         Piece::pawn, MoveType::capture)};
+  MoveList test_moves;
   board.append_pseudolegal_pawn_captures(Color::white, &test_moves);
-  EXPECT_EQ(test_moves, moves);
+  EXPECT_EQ(test_moves.size(), moves.size());
+  EXPECT_TRUE(
+      std::is_permutation(test_moves.begin(), test_moves.end(), moves.begin()));
 }
 
 TEST(PseudoLegalMoves, PawnCapturesBlack) {
   Board board(
       "rn1qk2r/Pp2pp1p/2p5/1p1pbbpn/2PPPPPN/8/1P5P/RNBQK2R b KQkq - 1 13");
 
-  std::vector<Move> moves = {
+  MoveList moves = {
       Move(str_to_square("g5"), str_to_square("h4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("g5"), str_to_square("f4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("d5"), str_to_square("e4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("d5"), str_to_square("c4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("b5"), str_to_square("c4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_pawn_captures(Color::black, &test_moves);
-  EXPECT_EQ(test_moves, moves);
+  EXPECT_EQ(test_moves.size(), moves.size());
+  EXPECT_TRUE(
+      std::is_permutation(test_moves.begin(), test_moves.end(), moves.begin()));
 }
 
 TEST(PseudoLegalMoves, PawnsWhite) {
   Board board(
       "1n1qkbnr/1p2pppp/r7/1Ppp3P/3PP3/2N2N2/pPP2PP1/1RBQKB1R w Kk - 6 12");
 
-  std::vector<Move> moves = {
+  MoveList moves = {
       Move(str_to_square("g2"), str_to_square("g3"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g2"), str_to_square("g4"), Piece::pawn,
-           MoveType::two_step_pawn, board),
+           MoveType::two_step_pawn),
       Move(str_to_square("b2"), str_to_square("b3"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b2"), str_to_square("b4"), Piece::pawn,
-           MoveType::two_step_pawn, board),
+           MoveType::two_step_pawn),
       Move(str_to_square("e4"), str_to_square("e5"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("e4"), str_to_square("d5"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("d4"), str_to_square("c5"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("h5"), str_to_square("h6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b5"), str_to_square("b6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("b5"), str_to_square("a6"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_pawn_moves(Color::white, &test_moves);
   EXPECT_EQ(test_moves.size(), moves.size());
   EXPECT_TRUE(
@@ -1650,53 +1785,74 @@ TEST(PseudoLegalMoves, PawnsBlack) {
   Board board(
       "1n1qkbnr/1p2pppp/r7/1Ppp3P/3PP3/2N2N2/pPP2PP1/1RBQKB1R b Kk - 6 12");
 
-  std::vector<Move> moves = {
+  MoveList moves = {
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("a2"), str_to_square("a1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("a2"), str_to_square("b1"), Piece::pawn,
-           MoveType::promotion_to_rook, board),
+           MoveType::promotion_to_rook),
       Move(str_to_square("a2"), str_to_square("b1"), Piece::pawn,
-           MoveType::promotion_to_knight, board),
+           MoveType::promotion_to_knight),
       Move(str_to_square("a2"), str_to_square("b1"), Piece::pawn,
-           MoveType::promotion_to_bishop, board),
+           MoveType::promotion_to_bishop),
       Move(str_to_square("a2"), str_to_square("b1"), Piece::pawn,
-           MoveType::promotion_to_queen, board),
+           MoveType::promotion_to_queen),
       Move(str_to_square("d5"), str_to_square("e4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("c5"), str_to_square("d4"), Piece::pawn,
-           MoveType::capture, board),
+           MoveType::capture),
       Move(str_to_square("c5"), str_to_square("c4"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("h7"), str_to_square("h6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g7"), str_to_square("g6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("g7"), str_to_square("g5"), Piece::pawn,
-           MoveType::two_step_pawn, board),
+           MoveType::two_step_pawn),
       Move(str_to_square("f7"), str_to_square("f6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("f7"), str_to_square("f5"), Piece::pawn,
-           MoveType::two_step_pawn, board),
+           MoveType::two_step_pawn),
       Move(str_to_square("e7"), str_to_square("e6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
       Move(str_to_square("e7"), str_to_square("e5"), Piece::pawn,
-           MoveType::two_step_pawn, board),
+           MoveType::two_step_pawn),
       Move(str_to_square("b7"), str_to_square("b6"), Piece::pawn,
-           MoveType::simple, board),
+           MoveType::simple),
   };
-  std::vector<Move> test_moves;
+  MoveList test_moves;
   board.append_pseudolegal_pawn_moves(Color::black, &test_moves);
   EXPECT_EQ(test_moves.size(), moves.size());
   EXPECT_TRUE(
       std::is_permutation(test_moves.begin(), test_moves.end(), moves.begin()));
 }
 
+TEST(AttackersTo, Simple) {
+  Board board("4k3/8/2n5/1B1r4/8/2N1P3/8/3R3K w - - 0 1");
+  EXPECT_EQ(board.attackers_to(str_to_square("d4"), board.all_pieces()),
+            str_to_square("c6") | str_to_square("d5") | str_to_square("e3") |
+                str_to_square("d1"));
+  // With d5 left out of the occupancy the rook on d1 sees through it.
+  EXPECT_EQ(board.attackers_to(str_to_square("d6"),
+                               board.all_pieces() & ~str_to_square("d5")),
+            str_to_square("d1") | str_to_square("d5"));
+  EXPECT_EQ(board.attackers_to(str_to_square("a8"), board.all_pieces()), 0);
+}
+
+TEST(PinnedPieces, Simple) {
+  // The knight on d2 and the pawn on f2 are pinned. The rook on e8 is shielded
+  // by two pieces, so neither of those is.
+  Board board("4r2k/8/8/b7/4R2b/8/3NPP2/4K3 w - - 0 1");
+  EXPECT_EQ(board.pinned_pieces(Color::white),
+            str_to_square("d2") | str_to_square("f2"));
+  EXPECT_EQ(board.pinned_pieces(Color::black), 0);
+}
+
 TEST(IsKingAttacked, Simple) {
   Board board_1 =
       Board("rnb1kbnr/pppp1ppp/4p3/8/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 0 1");
@@ -1765,61 +1921,1074 @@ TEST(CanCastle, Perft) {
   EXPECT_FALSE(board.is_castle_queenside_legal());
 }
 
-TEST(Perft, StartPosition) {
-  Board board = Board();
-  ASSERT_EQ(number_of_moves(board, 0), 1);
-  ASSERT_EQ(number_of_moves(board, 1), 20);
-  ASSERT_EQ(number_of_moves(board, 2), 400);
-  // ASSERT_EQ(number_of_moves(board, 3), 8902);
-  // ASSERT_EQ(number_of_moves(board, 4), 197281);
-}
-
-TEST(Perft, Kiwipete) {
+TEST(MoveList, PushBackAndErase) {
+  const Move a2a3 = Move(str_to_square("a2"), str_to_square("a3"), Piece::pawn,
+                         MoveType::simple);
+  const Move b2b3 = Move(str_to_square("b2"), str_to_square("b3"), Piece::pawn,
+                         MoveType::simple);
+  const Move c2c3 = Move(str_to_square("c2"), str_to_square("c3"), Piece::pawn,
+                         MoveType::simple);
+  MoveList moves;
+  EXPECT_TRUE(moves.empty());
+  moves.push_back(a2a3);
+  moves.emplace_back(str_to_square("b2"), str_to_square("b3"), Piece::pawn,
+                     MoveType::simple);
+  moves.push_back(c2c3);
+  EXPECT_EQ(moves.size(), 3);
+  EXPECT_EQ(moves, MoveList({a2a3, b2b3, c2c3}));
+
+  moves.erase(moves.begin() + 1, moves.begin() + 2);
+  EXPECT_EQ(moves, MoveList({a2a3, c2c3}));
+  EXPECT_FALSE(moves == MoveList({a2a3}));
+
+  moves.clear();
+  EXPECT_TRUE(moves.empty());
+}
+
+TEST(UndoMove, RoundTrip) {
+  // Between them these positions have en passant, castling, promotions and
+  // captures of rooks that still have castling rights.
+  const std::vector<std::string> fens = {
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+      "r3k2r/1pppppp1/8/8/8/8/1PPPPPP1/R3K2R b KQkq - 0 1"};
+  for (const std::string& fen : fens) {
+    Board board = Board(fen);
+    const Board original = board;
+    for (Move move : board.legal_moves()) {
+      Board expected = original;
+      expected.do_move(move);
+      UndoInfo undo;
+      board.do_move(move, &undo);
+      EXPECT_EQ(board, expected);
+      board.undo_move(move, undo);
+      EXPECT_EQ(board, original);
+    }
+  }
+}
+
+TEST(UndoMove, TwoPlies) {
   Board board = Board(
       "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
-  ASSERT_EQ(number_of_moves(board, 0), 1);
-  ASSERT_EQ(number_of_moves(board, 1), 48);
-  ASSERT_EQ(number_of_moves(board, 2), 2039);
-  // ASSERT_EQ(number_of_moves(board, 3), 97862);
-  // ASSERT_EQ(number_of_moves(board, 4), 4085603);
-}
-
-TEST(Perft, Pos3) {
-  Board board = Board("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1");
-  ASSERT_EQ(number_of_moves(board, 0), 1);
-  ASSERT_EQ(number_of_moves(board, 1), 14);
-  ASSERT_EQ(number_of_moves(board, 2), 191);
-  // ASSERT_EQ(number_of_moves(board, 3), 2812);
-  // ASSERT_EQ(number_of_moves(board, 4), 43238);
-}
-
-TEST(Perft, Pos4) {
-  Board board =
-      Board("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
-  ASSERT_EQ(number_of_moves(board, 0), 1);
-  ASSERT_EQ(number_of_moves(board, 1), 6);
-  ASSERT_EQ(number_of_moves(board, 2), 264);
-  // ASSERT_EQ(number_of_moves(board, 3), 9467);
-  // ASSERT_EQ(number_of_moves(board, 4), 422333);
-}
-
-TEST(Perft, Pos5) {
-  Board board =
-      Board("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8");
-  ASSERT_EQ(number_of_moves(board, 0), 1);
-  ASSERT_EQ(number_of_moves(board, 1), 44);
-  ASSERT_EQ(number_of_moves(board, 2), 1486);
-  // ASSERT_EQ(number_of_moves(board, 3), 62379);
-  // ASSERT_EQ(number_of_moves(board, 4), 2103487);
-}
-
-TEST(Perft, Pos6) {
+  const Board original = board;
+  UndoInfo undo_1;
+  UndoInfo undo_2;
+  for (Move move_1 : board.legal_moves()) {
+    board.do_move(move_1, &undo_1);
+    const Board after_move_1 = board;
+    for (Move move_2 : board.legal_moves()) {
+      board.do_move(move_2, &undo_2);
+      board.undo_move(move_2, undo_2);
+      EXPECT_EQ(board, after_move_1);
+    }
+    board.undo_move(move_1, undo_1);
+    EXPECT_EQ(board, original);
+  }
+}
+
+namespace {
+// Positions with castling, e.p., promotions, pins and discovered checks.
+const std::array<std::string, 5> generator_test_fens = {
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "4k3/8/8/1K1PpP1q/8/8/3B4/6R1 w - e6 0 1"};
+
+std::vector<std::string> sorted_uci_strs(const MoveList& moves) {
+  std::vector<std::string> res;
+  for (Move move : moves) {
+    res.push_back(move.to_uci_str());
+  }
+  std::sort(res.begin(), res.end());
+  return res;
+}
+
+// The positions of `generator_test_fens` and those one move after them.
+std::vector<Board> generator_test_boards() {
+  std::vector<Board> res;
+  for (const std::string& fen : generator_test_fens) {
+    const Board board(fen);
+    res.push_back(board);
+    for (Move move : board.legal_moves()) {
+      Board child = board;
+      child.do_move(move);
+      res.push_back(child);
+    }
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(PseudoLegalMoves, CapturesAndQuietMovesSplitAllMoves) {
+  for (const Board& board : generator_test_boards()) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    MoveList all_moves = board.pseudolegal_moves(side);
+    board.castling_moves(&all_moves);
+    MoveList split_moves = board.pseudolegal_captures(side);
+    for (Move move : split_moves) {
+      EXPECT_TRUE(move.dst_square() & board.enemies(side) ||
+                  move.move_type_ == MoveType::en_passant ||
+                  move.move_type_ == MoveType::promotion_to_queen)
+          << move.to_uci_str();
+    }
+    for (Move move : board.pseudolegal_quiet_moves(side)) {
+      EXPECT_FALSE(move.dst_square() & board.all_pieces())
+          << move.to_uci_str();
+      EXPECT_NE(move.move_type_, MoveType::promotion_to_queen);
+      split_moves.push_back(move);
+    }
+    EXPECT_EQ(sorted_uci_strs(split_moves), sorted_uci_strs(all_moves))
+        << board.to_pretty_str();
+  }
+}
+
+TEST(PseudoLegalMoves, QuietChecks) {
+  for (const Board& board : generator_test_boards()) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    // Compared only on the legal moves, since a king next to the enemy king
+    // "attacks" it as well.
+    MoveList expected;
+    for (Move move : board.pseudolegal_quiet_moves(side)) {
+      if (move.move_type_ != MoveType::simple &&
+          move.move_type_ != MoveType::two_step_pawn) {
+        continue;
+      }
+      Board child = board;
+      child.do_move(move);
+      if (child.is_king_attacked(flip_color(side)) &&
+          !child.is_king_attacked(side)) {
+        expected.push_back(move);
+      }
+    }
+    MoveList checks;
+    for (Move move : board.pseudolegal_quiet_checks(side)) {
+      if (board.is_pseudolegal_move_legal(move)) {
+        checks.push_back(move);
+      }
+    }
+    EXPECT_EQ(sorted_uci_strs(checks), sorted_uci_strs(expected))
+        << board.to_pretty_str();
+  }
+}
+
+TEST(LegalEvasions, MatchPseudolegalMovesThatGetOutOfCheck) {
+  int num_positions_in_check = 0;
+  for (const Board& parent : generator_test_boards()) {
+    for (Move parent_move : parent.legal_moves()) {
+      Board board = parent;
+      board.do_move(parent_move);
+      const Color side = board.is_whites_move_ ? Color::white : Color::black;
+      if (!board.is_king_attacked(side)) {
+        continue;
+      }
+      ++num_positions_in_check;
+      MoveList expected;
+      for (Move move : board.pseudolegal_moves(side)) {
+        if (board.is_pseudolegal_move_legal(move)) {
+          expected.push_back(move);
+        }
+      }
+      EXPECT_EQ(sorted_uci_strs(board.legal_evasions()),
+                sorted_uci_strs(expected))
+          << board.to_pretty_str();
+      EXPECT_EQ(board.legal_moves(), board.legal_evasions());
+    }
+  }
+  EXPECT_GT(num_positions_in_check, 100);
+}
+
+TEST(IsMovePseudolegal, MatchesGeneratedPawnMoves) {
+  const MoveType move_types[] = {
+      MoveType::simple,
+      MoveType::en_passant,
+      MoveType::capture,
+      MoveType::two_step_pawn,
+      MoveType::promotion_to_rook,
+      MoveType::promotion_to_bishop,
+      MoveType::promotion_to_knight,
+      MoveType::promotion_to_queen,
+  };
+  for (const Board& board : generator_test_boards()) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    const MoveList generated = board.pseudolegal_moves(side);
+    const Bitboard pawns = board.pieces_[static_cast<size_t>(side)]
+                                        [static_cast<size_t>(Piece::pawn)];
+    for (Bitboard src_square : bitboard_split(pawns)) {
+      for (int dst_idx = 0; dst_idx < 64; ++dst_idx) {
+        for (MoveType move_type : move_types) {
+          const Move move(src_square, lsb_bitboard << dst_idx, Piece::pawn,
+                          move_type);
+          EXPECT_EQ(board.is_move_pseudolegal(move),
+                    absl::c_linear_search(generated, move))
+              << move.to_uci_str() << "\n" << board.to_pretty_str();
+        }
+      }
+    }
+  }
+}
+
+TEST(LegalEvasions, DoubleCheckOnlyMovesTheKing) {
+  // The knight on f6 and the rook on e1 both check the king. The rook on a6
+  // could take the knight if it were the only checker.
+  const Board board("4k3/8/r4N2/8/8/8/8/4R1K1 b - - 0 1");
+  for (Move move : board.legal_evasions()) {
+    EXPECT_EQ(move.piece_moving_, Piece::king) << move.to_uci_str();
+  }
+  EXPECT_EQ(board.legal_evasions().size(), 3);
+}
+
+TEST(CheckInfo, IsLegalAndGivesCheckMatchDoingTheMove) {
+  for (const Board& board : generator_test_boards()) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    const CheckInfo info = board.check_info();
+    MoveList moves = board.pseudolegal_moves(side);
+    board.castling_moves(&moves);
+    for (Move move : moves) {
+      Board child = board;
+      child.do_move(move);
+      const bool is_legal = !child.is_king_attacked(side);
+      EXPECT_EQ(board.is_legal(move, info), is_legal)
+          << move.to_uci_str() << board.to_pretty_str();
+      if (is_legal) {
+        EXPECT_EQ(board.gives_check(move, info),
+                  child.is_king_attacked(flip_color(side)))
+            << move.to_uci_str() << board.to_pretty_str();
+      }
+    }
+  }
+}
+
+TEST(CheckInfo, GivesCheckBySpecialMoves) {
+  // Castling kingside puts the rook on f1 opposite the king on f8.
+  const Board castling("5k2/8/8/8/8/8/8/4K2R w K - 0 1");
+  EXPECT_TRUE(castling.gives_check(castle_kingside_move(Color::white),
+                                   castling.check_info()));
+  // Taking e.p. takes both pawns off the fifth rank between the rook and the
+  // king.
+  const Board en_passant("8/8/8/R2pP2k/8/8/8/4K3 w - d6 0 1");
+  EXPECT_TRUE(en_passant.gives_check(
+      Move(str_to_square("e5"), str_to_square("d6"), Piece::pawn,
+           MoveType::en_passant),
+      en_passant.check_info()));
+  // The new queen checks along the diagonal through the square the pawn left.
+  const Board promotion("2n5/3P4/4k3/8/8/8/8/4K3 w - - 0 1");
+  EXPECT_TRUE(promotion.gives_check(
+      Move(str_to_square("d7"), str_to_square("c8"), Piece::pawn,
+           MoveType::promotion_to_queen),
+      promotion.check_info()));
+  EXPECT_FALSE(promotion.gives_check(
+      Move(str_to_square("d7"), str_to_square("c8"), Piece::pawn,
+           MoveType::promotion_to_rook),
+      promotion.check_info()));
+}
+
+TEST(LegalMove, MatchesLegalMoves) {
+  for (const Board& board : generator_test_boards()) {
+    const MoveList legal = board.legal_moves();
+    size_t num_found = 0;
+    for (int src = 0; src < 64; ++src) {
+      for (int dst = 0; dst < 64; ++dst) {
+        for (Piece promotion : {Piece::none, Piece::queen, Piece::rook,
+                                Piece::bishop, Piece::knight, Piece::king}) {
+          const absl::optional<Move> move = board.legal_move(
+              lsb_bitboard << src, lsb_bitboard << dst, promotion);
+          if (move) {
+            ++num_found;
+            EXPECT_NE(std::find(legal.begin(), legal.end(), *move),
+                      legal.end())
+                << move->to_uci_str() << board.to_pretty_str();
+          }
+        }
+      }
+    }
+    EXPECT_EQ(num_found, legal.size()) << board.to_pretty_str();
+  }
+  const Board pinned("4k3/4r3/8/8/8/8/4N3/4K3 w - - 0 1");
+  EXPECT_FALSE(pinned.is_legal(str_to_square("e2"), str_to_square("c3")));
+  EXPECT_TRUE(pinned.is_legal(str_to_square("e1"), str_to_square("d1")));
+  const Board promotion("8/4P3/8/8/8/8/k7/4K3 w - - 0 1");
+  EXPECT_FALSE(promotion.is_legal(str_to_square("e7"), str_to_square("e8")));
+  EXPECT_TRUE(promotion.is_legal(str_to_square("e7"), str_to_square("e8"),
+                                 Piece::knight));
+}
+
+TEST(HasAnyLegalMove, MatchesLegalMoves) {
+  std::vector<Board> boards = generator_test_boards();
+  std::mt19937_64 rng(1);
+  for (int i = 0; i < 1000; ++i) {
+    boards.push_back(random_material_position(&rng));
+    boards.push_back(random_playout_position(0, 200, &rng));
+  }
+  for (const char* fen : {
+           // Checkmate and stalemate.
+           "7k/6Q1/6K1/8/8/8/8/8 b - - 0 1",
+           "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1",
+           // Only a pinned pawn can move, along its pin, and a pinned
+           // bishop can't.
+           "r6k/8/8/8/2n5/8/P2n4/K7 w - - 0 1",
+           "8/8/8/8/8/k7/8/KB5r w - - 0 1",
+           // An e.p. capture of the pawn that gives check.
+           "8/8/8/2k5/3Pp3/8/8/7K b - d3 0 1"}) {
+    boards.emplace_back(fen);
+  }
+  size_t num_without_moves = 0;
+  for (const Board& board : boards) {
+    const bool has_move = !board.legal_moves().empty();
+    EXPECT_EQ(board.has_any_legal_move(), has_move) << board.to_pretty_str();
+    num_without_moves += has_move ? 0 : 1;
+  }
+  EXPECT_GT(num_without_moves, 2u);
+}
+
+TEST(LegalTargets, MatchesLegalMoves) {
+  std::vector<Board> boards = generator_test_boards();
+  Board chess960;
+  chess960.set_fen(
+      "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+      true);
+  boards.push_back(chess960);
+  for (const Board& board : boards) {
+    std::array<Bitboard, 64> expected{};
+    for (Move move : board.legal_moves()) {
+      expected[move.src_idx_] |= move.dst_square();
+    }
+    std::array<Bitboard, 64> targets;
+    board.legal_targets(&targets);
+    for (int sq_idx = 0; sq_idx < 64; ++sq_idx) {
+      EXPECT_EQ(targets[sq_idx], expected[sq_idx])
+          << sq_idx << board.to_pretty_str();
+      EXPECT_EQ(board.legal_targets(lsb_bitboard << sq_idx), expected[sq_idx])
+          << sq_idx << board.to_pretty_str();
+    }
+  }
+}
+
+TEST(MoveSinks, MatchMoveLists) {
+  for (const Board& board : generator_test_boards()) {
+    const MoveList legal = board.legal_moves();
+    EXPECT_EQ(board.num_legal_moves(), legal.size()) << board.to_fen();
+    DestinationCollector legal_destinations;
+    board.generate_legal_moves(&legal_destinations);
+    Bitboard expected = 0;
+    for (Move move : legal) {
+      expected |= move.dst_square();
+    }
+    EXPECT_EQ(legal_destinations.squares_, expected) << board.to_fen();
+    for (Color side : {Color::white, Color::black}) {
+      const MoveList pseudolegal = board.pseudolegal_moves(side);
+      MoveCounter counter;
+      board.generate_pseudolegal_moves(side, &counter);
+      EXPECT_EQ(counter.num_moves_, pseudolegal.size()) << board.to_fen();
+      DestinationCollector destinations;
+      board.generate_pseudolegal_moves(side, &destinations);
+      expected = 0;
+      for (Move move : pseudolegal) {
+        expected |= move.dst_square();
+      }
+      EXPECT_EQ(destinations.squares_, expected) << board.to_fen();
+    }
+  }
+}
+
+TEST(FilteredMoves, MatchLegalMoves) {
+  std::vector<Board> boards = generator_test_boards();
+  // An e.p. capture of the checking pawn, and a pinned pawn that can take.
+  boards.emplace_back("8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1");
+  boards.emplace_back("4k3/8/8/8/8/2b5/3P4/4K3 w - - 0 1");
+  const Bitboard queenside = file_mask(0) | file_mask(1) | file_mask(2) |
+                             file_mask(3);
+  for (const Board& board : boards) {
+    const MoveList legal = board.legal_moves();
+    for (Piece piece : {Piece::pawn, Piece::knight, Piece::bishop,
+                        Piece::rook, Piece::queen, Piece::king}) {
+      for (Bitboard origins : {~Bitboard{0}, queenside}) {
+        MoveList expected;
+        for (Move move : legal) {
+          if (move.piece_moving_ == piece && (move.src_square() & origins)) {
+            expected.push_back(move);
+          }
+        }
+        EXPECT_EQ(sorted_uci_strs(board.legal_moves(piece, ~Bitboard{0},
+                                                    origins)),
+                  sorted_uci_strs(expected))
+            << board.to_fen();
+        for (int dst_idx = 0; dst_idx < 64; ++dst_idx) {
+          const Bitboard dst_square = Bitboard{1} << dst_idx;
+          MoveList to_square;
+          for (Move move : expected) {
+            if (move.dst_square() == dst_square) {
+              to_square.push_back(move);
+            }
+          }
+          EXPECT_EQ(sorted_uci_strs(board.legal_moves(piece, dst_square,
+                                                      origins)),
+                    sorted_uci_strs(to_square))
+              << board.to_fen() << " " << dst_idx;
+        }
+      }
+    }
+  }
+}
+
+TEST(PawnAttacks, MatchPerPawnTables) {
+  std::vector<Board> boards = generator_test_boards();
+  boards.emplace_back("8/8/8/2p1p3/3P4/8/1PPP1P1P/8 w - - 0 1");
+  for (const Board& board : boards) {
+    for (Color side : {Color::white, Color::black}) {
+      const std::array<Bitboard, 64>& table =
+          side == Color::white ? white_pawn_attacks : black_pawn_attacks;
+      Bitboard attacks = 0;
+      Bitboard double_attacks = 0;
+      for (Bitboard sq : bitboard_split(board.pieces(side, Piece::pawn))) {
+        const Bitboard pawn_attacks =
+            table[static_cast<size_t>(square_idx(sq))];
+        double_attacks |= attacks & pawn_attacks;
+        attacks |= pawn_attacks;
+      }
+      EXPECT_EQ(board.pawn_attack_squares(side), attacks) << board.to_fen();
+      EXPECT_EQ(board.pawn_double_attack_squares(side), double_attacks)
+          << board.to_fen();
+    }
+  }
+}
+
+TEST(See, Exchanges) {
+  // An undefended pawn.
+  const Board undefended("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1");
+  EXPECT_EQ(undefended.see(Move(str_to_square("e1"), str_to_square("e5"),
+                                Piece::rook, MoveType::capture)),
+            see_value(Piece::pawn));
+  // The knight takes a pawn and is lost, with the rest of the pieces on the
+  // e file staying put.
+  const Board defended(
+      "1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1");
+  EXPECT_EQ(defended.see(Move(str_to_square("d3"), str_to_square("e5"),
+                              Piece::knight, MoveType::capture)),
+            see_value(Piece::pawn) - see_value(Piece::knight));
+  // The rook on d1 backs up the one on d2 through it, so Rxd5 Rxd5 Rxd5 wins
+  // a pawn.
+  const Board x_ray("3r2k1/8/8/3p4/8/8/3R4/3R2K1 w - - 0 1");
+  EXPECT_EQ(x_ray.see(Move(str_to_square("d2"), str_to_square("d5"),
+                           Piece::rook, MoveType::capture)),
+            see_value(Piece::pawn));
+  // A quiet move to an attacked square loses the piece.
+  EXPECT_EQ(x_ray.see(Move(str_to_square("d2"), str_to_square("h2"),
+                           Piece::rook, MoveType::simple)),
+            0);
+  EXPECT_EQ(x_ray.see(Move(str_to_square("d2"), str_to_square("d4"),
+                           Piece::rook, MoveType::simple)),
+            0);
+  const Board attacked_square("3r2k1/8/8/8/8/8/2R5/6K1 w - - 0 1");
+  EXPECT_EQ(attacked_square.see(Move(str_to_square("c2"), str_to_square("d2"),
+                                     Piece::rook, MoveType::simple)),
+            -see_value(Piece::rook));
+  // The king can't take the pawn back on a defended square.
+  const Board king("8/8/8/8/8/2k1p3/3P4/4K3 b - - 0 1");
+  EXPECT_EQ(king.see(Move(str_to_square("e3"), str_to_square("d2"),
+                          Piece::pawn, MoveType::capture)),
+            see_value(Piece::pawn));
+}
+
+TEST(See, SeeGeMatchesSee) {
+  for (const Board& board : generator_test_boards()) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    MoveList moves = board.pseudolegal_moves(side);
+    board.castling_moves(&moves);
+    for (Move move : moves) {
+      const int see = board.see(move);
+      for (int threshold : {-see_value(Piece::queen), -see_value(Piece::rook),
+                            -see_value(Piece::pawn) - 1, 0, 1,
+                            see_value(Piece::pawn), see_value(Piece::rook),
+                            see + 1, see, see - 1}) {
+        EXPECT_EQ(board.see_ge(move, threshold), see >= threshold)
+            << move.to_uci_str() << " " << threshold << " "
+            << board.to_pretty_str();
+      }
+    }
+  }
+}
+
+TEST(AttackMaps, MatchAttackSquares) {
+  for (const Board& board : generator_test_boards()) {
+    AttackMaps maps(board);
+    for (Color side : {Color::white, Color::black}) {
+      EXPECT_EQ(maps.attacks(side), board.attack_squares(side));
+      // Asking again returns the kept map.
+      EXPECT_EQ(maps.attacks(side), board.attack_squares(side));
+    }
+  }
+}
+
+TEST(AttackMaps, KingDangerSeesThroughTheKing) {
+  // The rook checks the king along the fourth rank. The king hides f4 to h4
+  // from it only as long as it stands on e4.
+  const Board board("4k3/8/8/8/r3K3/8/8/8 w - - 0 1");
+  AttackMaps maps(board);
+  EXPECT_FALSE(maps.attacks(Color::black) & str_to_square("f4"));
+  EXPECT_TRUE(maps.king_danger(Color::white) & str_to_square("f4"));
+  const Bitboard behind_king =
+      str_to_square("f4") | str_to_square("g4") | str_to_square("h4");
+  EXPECT_EQ(maps.king_danger(Color::white),
+            maps.attacks(Color::black) | behind_king);
+}
+
+TEST(AttackInfo, MatchesThePieces) {
+  for (const Board& board : generator_test_boards()) {
+    const AttackInfo info(board);
+    for (Color side : {Color::white, Color::black}) {
+      const size_t color = static_cast<size_t>(side);
+      EXPECT_EQ(info.all_[color], board.attack_squares(side))
+          << board.to_fen();
+      // Each square attacked twice, counting every pawn and piece.
+      std::array<int, 64> num_attacks = {};
+      for (Bitboard sq : bitboard_split(board.friends(side))) {
+        const size_t sq_idx = static_cast<size_t>(square_idx(sq));
+        const Piece piece = board.mailbox_[sq_idx];
+        const int idx = static_cast<int>(sq_idx);
+        const Bitboard occupancy = board.all_pieces();
+        Bitboard attacks = 0;
+        switch (piece) {
+          case Piece::pawn:
+            attacks = (side == Color::white ? white_pawn_attacks
+                                            : black_pawn_attacks)[sq_idx];
+            break;
+          case Piece::knight:
+            attacks = knight_attacks[sq_idx];
+            break;
+          case Piece::bishop:
+            attacks = bishop_attacks(idx, occupancy);
+            break;
+          case Piece::rook:
+            attacks = rook_attacks(idx, occupancy);
+            break;
+          case Piece::queen:
+            attacks = queen_attacks(idx, occupancy);
+            break;
+          default:
+            attacks = king_attacks[sq_idx];
+        }
+        EXPECT_EQ(attacks & ~info.by_piece_[color][static_cast<size_t>(
+                                piece)],
+                  0u)
+            << board.to_fen();
+        for (Bitboard target : bitboard_split(attacks)) {
+          ++num_attacks[static_cast<size_t>(square_idx(target))];
+        }
+      }
+      Bitboard double_attacks = 0;
+      for (size_t idx = 0; idx < 64; ++idx) {
+        if (num_attacks[idx] >= 2) {
+          double_attacks |= Bitboard{1} << idx;
+        }
+        EXPECT_EQ(info.attack_count(side, static_cast<int>(idx)),
+                  std::min(num_attacks[idx], AttackInfo::max_attack_count))
+            << board.to_fen() << " " << idx;
+        for (int n = 0; n <= AttackInfo::max_attack_count; ++n) {
+          EXPECT_EQ((info.attacked_at_least(side, n) >> idx) & 1,
+                    num_attacks[idx] >= n ? 1u : 0u)
+              << board.to_fen() << " " << idx << " " << n;
+        }
+      }
+      EXPECT_EQ(info.double_[color], double_attacks) << board.to_fen();
+    }
+    // The generator gives the same moves with the attacks taken from `info`.
+    MoveList moves;
+    board.generate_legal_moves(info, &moves);
+    EXPECT_EQ(moves, board.legal_moves()) << board.to_fen();
+    AttackMaps maps(board);
+    AttackMaps maps_of_info(board, info);
+    for (Color side : {Color::white, Color::black}) {
+      EXPECT_EQ(maps_of_info.king_danger(side), maps.king_danger(side))
+          << board.to_fen();
+    }
+  }
+}
+
+TEST(AttackInfo, CountsStopAtTheLargest) {
+  // All eight queens attack e4.
+  const Board board("Q3Q3/7Q/3k4/8/Q6Q/8/8/KQ2Q2Q w - - 0 1");
+  const AttackInfo info(board);
+  const int e4 = square_idx(str_to_square("e4"));
+  EXPECT_EQ(info.attack_count(Color::white, e4),
+            AttackInfo::max_attack_count);
+  EXPECT_EQ(info.attacked_at_least(Color::white, AttackInfo::max_attack_count),
+            str_to_square("e4"));
+  EXPECT_EQ(info.attack_count(Color::black, e4), 0);
+  EXPECT_EQ(info.attacked_at_least(Color::white, 0), ~Bitboard{0});
+}
+
+TEST(CanCastle, AttackMapsAgreeWithTargetedQueries) {
+  for (const Board& board : generator_test_boards()) {
+    AttackMaps maps(board);
+    EXPECT_EQ(board.is_castle_kingside_legal(&maps),
+              board.is_castle_kingside_legal())
+        << board.to_pretty_str();
+    EXPECT_EQ(board.is_castle_queenside_legal(&maps),
+              board.is_castle_queenside_legal())
+        << board.to_pretty_str();
+  }
+}
+
+TEST(PinnedPieces, DiscoveredCheckCandidates) {
+  // The knight on e4 is the only piece between the rook and the black king,
+  // the pawn on d7 the only one between the bishop and the king. The queen's
+  // line to the king is blocked twice.
+  const Board board("4k3/3P4/2B5/8/Q3N3/8/8/4R1K1 w - - 0 1");
+  EXPECT_EQ(board.discovered_check_candidates(Color::white),
+            str_to_square("e4") | str_to_square("d7"));
+  EXPECT_EQ(board.discovered_check_candidates(Color::black), 0);
+  EXPECT_EQ(board.pinned_pieces(Color::black), 0);
+}
+
+TEST(Board, HasConsistentState) {
   Board board = Board(
-      "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
-      "10");
-  ASSERT_EQ(number_of_moves(board, 0), 1);
-  ASSERT_EQ(number_of_moves(board, 1), 46);
-  ASSERT_EQ(number_of_moves(board, 2), 2079);
-  // ASSERT_EQ(number_of_moves(board, 3), 89890);
-  // ASSERT_EQ(number_of_moves(board, 4), 3894594);
-}
\ No newline at end of file
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  EXPECT_TRUE(board.has_consistent_state());
+  UndoInfo undo_1;
+  UndoInfo undo_2;
+  for (Move move_1 : board.legal_moves()) {
+    board.do_move(move_1, &undo_1);
+    EXPECT_TRUE(board.has_consistent_state());
+    for (Move move_2 : board.legal_moves()) {
+      board.do_move(move_2, &undo_2);
+      EXPECT_TRUE(board.has_consistent_state());
+      board.undo_move(move_2, undo_2);
+    }
+    board.undo_move(move_1, undo_1);
+  }
+  EXPECT_TRUE(board.has_consistent_state());
+
+  Board overlapping = board;
+  overlapping.pieces_[0][1] |= str_to_square("e1");
+  EXPECT_FALSE(overlapping.has_consistent_state());
+  Board wrong_key = board;
+  wrong_key.key_ ^= 1;
+  EXPECT_FALSE(wrong_key.has_consistent_state());
+}
+
+TEST(Mailbox, MatchesBitboards) {
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  UndoInfo undo_1;
+  UndoInfo undo_2;
+  for (Move move_1 : board.legal_moves()) {
+    board.do_move(move_1, &undo_1);
+    for (Move move_2 : board.legal_moves()) {
+      board.do_move(move_2, &undo_2);
+      Board rebuilt = board;
+      rebuilt.init_mailbox();
+      EXPECT_EQ(board.mailbox_, rebuilt.mailbox_);
+      board.undo_move(move_2, undo_2);
+    }
+    board.undo_move(move_1, undo_1);
+  }
+}
+
+TEST(Occupancy, MatchesBitboards) {
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  UndoInfo undo_1;
+  UndoInfo undo_2;
+  for (Move move_1 : board.legal_moves()) {
+    board.do_move(move_1, &undo_1);
+    for (Move move_2 : board.legal_moves()) {
+      board.do_move(move_2, &undo_2);
+      Board rebuilt = board;
+      rebuilt.init_occupancy();
+      EXPECT_EQ(board.white_pieces(), rebuilt.white_pieces());
+      EXPECT_EQ(board.black_pieces(), rebuilt.black_pieces());
+      EXPECT_EQ(board.all_pieces(), rebuilt.all_pieces());
+      board.undo_move(move_2, undo_2);
+    }
+    board.undo_move(move_1, undo_1);
+  }
+}
+
+TEST(DoMove, CastlingRights) {
+  Board board = Board("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1");
+  board.do_move(Move(str_to_square("h1"), str_to_square("h2"), Piece::rook,
+                     MoveType::simple));
+  EXPECT_EQ(board.castling_rights_, white_queenside_castling |
+                                        black_kingside_castling |
+                                        black_queenside_castling);
+  board.do_move(Move(str_to_square("a8"), str_to_square("a1"), Piece::rook,
+                     MoveType::capture));
+  EXPECT_EQ(board.castling_rights_, black_kingside_castling);
+  board.do_move(Move(str_to_square("e1"), str_to_square("d1"), Piece::king,
+                     MoveType::simple));
+  EXPECT_EQ(board.castling_rights_, black_kingside_castling);
+  board.do_move(Move(str_to_square("e8"), str_to_square("f8"), Piece::king,
+                     MoveType::simple));
+  EXPECT_EQ(board.castling_rights_, no_castling);
+}
+
+TEST(DoMove, Clocks) {
+  Board board = Board("4k3/8/8/8/8/8/4P3/R3K3 w - - 5 10");
+  board.do_move(Move(str_to_square("a1"), str_to_square("a7"), Piece::rook,
+                     MoveType::simple));
+  EXPECT_EQ(board.fifty_move_clock_, 6);
+  EXPECT_EQ(board.num_moves_, 10);
+  board.do_move(Move(str_to_square("e8"), str_to_square("d8"), Piece::king,
+                     MoveType::simple));
+  EXPECT_EQ(board.fifty_move_clock_, 7);
+  EXPECT_EQ(board.num_moves_, 11);
+  board.do_move(Move(str_to_square("e2"), str_to_square("e3"), Piece::pawn,
+                     MoveType::simple));
+  EXPECT_EQ(board.fifty_move_clock_, 0);
+  EXPECT_EQ(board.num_moves_, 11);
+}
+
+TEST(DoMove, ReportsTheDirtyPieces) {
+  // Captures, en passant, promotions with and without a capture, castling,
+  // and Chess960 castling where the king and rook swap or stay.
+  const std::vector<std::string> fens = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 b kq - 0 1",
+      "1r2k1r1/1p4p1/8/8/8/8/8/1R2K1R1 w GBgb - 0 1",
+      "4k3/8/8/8/8/8/8/5RK1 w F - 0 1"};
+  for (const std::string& fen : fens) {
+    SCOPED_TRACE(fen);
+    const Board board(fen);
+    for (Move move : board.legal_moves()) {
+      SCOPED_TRACE(move.to_uci_str());
+      Board after = board;
+      UndoInfo undo;
+      DirtyPieces dirty;
+      after.do_move(move, &undo, &dirty);
+      // Every square whose piece changed is a square of the record, and the
+      // record's pieces are where it says before and after.
+      Bitboard squares = 0;
+      for (size_t i = 0; i < dirty.size_; ++i) {
+        const DirtyPiece& piece = dirty.pieces_[i];
+        if (piece.from_idx_ >= 0) {
+          const Bitboard sq = lsb_bitboard << piece.from_idx_;
+          EXPECT_TRUE(board.pieces(piece.color_, piece.piece_) & sq);
+          squares |= sq;
+        }
+        if (piece.to_idx_ >= 0) {
+          const Bitboard sq = lsb_bitboard << piece.to_idx_;
+          EXPECT_TRUE(after.pieces(piece.color_, piece.piece_) & sq);
+          squares |= sq;
+        }
+      }
+      for (size_t idx = 0; idx < 64; ++idx) {
+        const Bitboard sq = lsb_bitboard << idx;
+        if (board.mailbox_[idx] != after.mailbox_[idx] ||
+            (board.white_pieces() & sq) != (after.white_pieces() & sq)) {
+          EXPECT_TRUE(squares & sq) << idx;
+        }
+      }
+    }
+  }
+}
+
+TEST(Board, NullMove) {
+  for (const std::string& fen :
+       {std::string("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 "
+                    "1"),
+        std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w "
+                    "KQkq - 3 10")}) {
+    Board board(fen);
+    const Board before(board);
+    UndoInfo undo;
+    board.do_null_move(&undo);
+    EXPECT_NE(board.is_whites_move_, before.is_whites_move_);
+    EXPECT_EQ(board.en_passant_square_, 0);
+    EXPECT_EQ(board.fifty_move_clock_, before.fifty_move_clock_ + 1);
+    EXPECT_EQ(board.castling_rights_, before.castling_rights_);
+    EXPECT_EQ(board.key_, compute_zobrist_key(board));
+    EXPECT_TRUE(board.has_consistent_state());
+    board.undo_null_move(undo);
+    EXPECT_EQ(board, before);
+  }
+}
+
+TEST(Board, HashesByKey) {
+  // The same position reached in two orders is one key of the map, whatever
+  // order it is reached in.
+  absl::flat_hash_map<Board, int> positions;
+  for (const std::vector<const char*>& moves :
+       {std::vector<const char*>{"g1f3", "g8f6", "b1c3"},
+        std::vector<const char*>{"b1c3", "g8f6", "g1f3"},
+        std::vector<const char*>{"b1c3", "b8c6", "g1f3"}}) {
+    Board board;
+    for (const char* move : moves) {
+      board.do_move(*parse_uci_move(board, move));
+    }
+    ++positions[board];
+  }
+  ASSERT_EQ(positions.size(), 2u);
+  const Board board(
+      "r1bqkbnr/pppppppp/2n5/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 3 2");
+  EXPECT_EQ(positions[board], 1);
+  // Boards that differ in their move counters only share a key but not an
+  // entry.
+  Board reset = board;
+  reset.fifty_move_clock_ = 0;
+  EXPECT_EQ(absl::Hash<Board>()(reset), absl::Hash<Board>()(board));
+  EXPECT_EQ(positions.count(reset), 0u);
+
+  absl::flat_hash_map<Move, int> moves;
+  for (Move move : Board().legal_moves()) {
+    ++moves[move];
+  }
+  EXPECT_EQ(moves.size(), 20u);
+  EXPECT_EQ(moves.count(*parse_uci_move(Board(), "e2e4")), 1u);
+}
+
+TEST(Board, Flipped) {
+  {
+    const Board board(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R4K1R w kq - 3 10");
+    const Board flipped = board.flipped();
+    EXPECT_EQ(flipped.to_fen(),
+              "r4k1r/pppbbppp/2n2q1P/1P2p3/3pn3/BN2PNP1/P1PPQPB1/R3K2R b KQ - "
+              "3 10");
+    EXPECT_TRUE(flipped.has_consistent_state());
+    EXPECT_EQ(flipped.flipped(), board);
+  }
+
+  std::vector<Board> boards = generator_test_boards();
+  boards.emplace_back(
+      "nrbbqkrn/pppppppp/8/8/8/8/PPPPPPPP/NRBBQKRN w GBgb - 0 1");
+  for (Board& board : boards) {
+    const Board flipped = board.flipped();
+    EXPECT_TRUE(flipped.has_consistent_state()) << board.to_fen();
+    EXPECT_EQ(flipped.key_, board.flipped_key()) << board.to_fen();
+    EXPECT_EQ(flipped.canonical_key(), board.canonical_key())
+        << board.to_fen();
+    EXPECT_EQ(flipped.num_legal_moves(), board.num_legal_moves())
+        << board.to_fen();
+    EXPECT_EQ(flipped.flipped(), board) << board.to_fen();
+    // The flipped key follows the key through the moves.
+    for (Move move : board.legal_moves()) {
+      UndoInfo undo;
+      board.do_move(move, &undo);
+      EXPECT_EQ(board.flipped_key(), compute_zobrist_key(board.flipped()))
+          << board.to_fen();
+      board.undo_move(move, undo);
+    }
+  }
+}
+
+namespace {
+bool has_unmove(const UnmoveList& unmoves, const Unmove& unmove) {
+  return absl::c_linear_search(unmoves, unmove);
+}
+
+Move move_of(const char* src, const char* dst, Piece piece, MoveType type) {
+  return Move(str_to_square(src), str_to_square(dst), piece, type);
+}
+}  // namespace.
+
+TEST(Unmoves, TakeBackEveryLegalMove) {
+  for (const Board& board : generator_test_boards()) {
+    for (Move move : board.legal_moves()) {
+      const Piece captured = move.move_type_ == MoveType::en_passant
+                                 ? Piece::pawn
+                                 : board.mailbox_[move.dst_idx_];
+      Board child(board);
+      child.do_move(move);
+      const UnmoveList unmoves = child.legal_unmoves();
+      const auto it = absl::c_find_if(unmoves, [&](const Unmove& unmove) {
+        return unmove.move_ == move && unmove.captured_piece_ == captured;
+      });
+      ASSERT_NE(it, unmoves.end())
+          << board.to_fen() << " " << move.to_uci_str();
+      Board before(child);
+      before.do_unmove(*it);
+      EXPECT_EQ(before.mailbox_, board.mailbox_) << board.to_fen();
+      EXPECT_EQ(before.is_whites_move_, board.is_whites_move_);
+      EXPECT_TRUE(before.has_consistent_state());
+    }
+  }
+}
+
+TEST(Unmoves, LeadBackToThePosition) {
+  for (const Board& board : generator_test_boards()) {
+    for (const Unmove& unmove : board.legal_unmoves()) {
+      Board before(board);
+      before.do_unmove(unmove);
+      EXPECT_EQ(before.position_error(), nullptr) << before.to_fen();
+      EXPECT_TRUE(before.has_consistent_state());
+      const MoveList moves = before.legal_moves();
+      EXPECT_NE(absl::c_find(moves, unmove.move_), moves.end())
+          << before.to_fen() << " " << unmove.move_.to_uci_str();
+      before.do_move(unmove.move_);
+      EXPECT_EQ(before.key_, board.key_) << board.to_fen();
+      EXPECT_EQ(before.mailbox_, board.mailbox_);
+    }
+  }
+}
+
+TEST(Unmoves, StartPosition) {
+  // Only the knights can have moved, from a6, c6, f6 and h6, and may have
+  // captured anything but a pawn on the back rank.
+  const UnmoveList unmoves =
+      Board("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
+          .legal_unmoves();
+  EXPECT_EQ(unmoves.size(), 20);
+  EXPECT_TRUE(has_unmove(
+      unmoves, {move_of("c6", "b8", Piece::knight, MoveType::simple),
+                Piece::none, all_castling}));
+  EXPECT_FALSE(has_unmove(
+      unmoves, {move_of("c6", "b8", Piece::knight, MoveType::capture),
+                Piece::pawn, all_castling}));
+}
+
+TEST(Unmoves, SpecialMoves) {
+  // Castling brings back the right it gave up.
+  EXPECT_TRUE(has_unmove(
+      Board("r3k2r/8/8/8/8/8/8/R4RK1 b kq - 0 1").legal_unmoves(),
+      {move_of("e1", "g1", Piece::king, MoveType::castle_kingside), Piece::none,
+       white_kingside_castling | black_kingside_castling |
+           black_queenside_castling}));
+  // The pawn on d6 may have taken en passant.
+  const Board en_passant("4k3/8/3P4/8/8/8/8/4K3 b - - 0 1");
+  const UnmoveList unmoves = en_passant.legal_unmoves();
+  const Unmove from_e5 = {
+      move_of("e5", "d6", Piece::pawn, MoveType::en_passant), Piece::pawn,
+      no_castling};
+  EXPECT_TRUE(has_unmove(unmoves, from_e5));
+  Board before(en_passant);
+  before.do_unmove(from_e5);
+  EXPECT_EQ(before.to_fen(), "4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1");
+  // A queen on the eighth rank may have been a pawn, which took anything
+  // but a pawn.
+  const UnmoveList promotions =
+      Board("Q3k3/8/8/8/8/8/8/4K3 b - - 0 1").legal_unmoves();
+  EXPECT_TRUE(has_unmove(
+      promotions,
+      {move_of("a7", "a8", Piece::pawn, MoveType::promotion_to_queen),
+       Piece::none, no_castling}));
+  EXPECT_TRUE(has_unmove(
+      promotions,
+      {move_of("b7", "a8", Piece::pawn, MoveType::promotion_to_queen),
+       Piece::knight, no_castling}));
+  EXPECT_FALSE(has_unmove(
+      promotions,
+      {move_of("b7", "a8", Piece::pawn, MoveType::promotion_to_queen),
+       Piece::pawn, no_castling}));
+}
+
+TEST(Chess960, CastlingRightsInFens) {
+  // Shredder-FEN names the files of the rooks.
+  const Board shredder(
+      "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9");
+  EXPECT_TRUE(shredder.is_chess960_);
+  EXPECT_EQ(shredder.castling_rights_, all_castling);
+  EXPECT_EQ(shredder.castling_rook_files_,
+            (std::array<uint8_t, 4>{{7, 5, 7, 5}}));
+  EXPECT_EQ(shredder.to_fen(),
+            "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 "
+            "9");
+  EXPECT_EQ(shredder.position_error(), nullptr);
+  // X-FEN's KQkq stand for the outermost rooks.
+  const absl::optional<Board> x_fen = parse_fen(
+      "rr2k1r1/8/8/8/8/8/8/1R2KR1R w KQkq - 0 1", nullptr, true);
+  ASSERT_TRUE(x_fen);
+  EXPECT_EQ(x_fen->castling_rook_files_,
+            (std::array<uint8_t, 4>{{7, 1, 6, 0}}));
+  EXPECT_EQ(x_fen->to_fen(), "rr2k1r1/8/8/8/8/8/8/1R2KR1R w HBga - 0 1");
+  // Without Chess960 they stand for the corners.
+  const char* error = nullptr;
+  EXPECT_FALSE(
+      parse_fen("rr2k1r1/8/8/8/8/8/8/1R2KR1R w KQkq - 0 1", &error));
+  EXPECT_EQ(error, std::string("Position invalid: A castling right without "
+                               "its king and rook."));
+  // A right must have its rook on the side of the king it names.
+  EXPECT_FALSE(parse_fen("4k3/8/8/8/8/8/8/4KR2 w E - 0 1", &error));
+  EXPECT_FALSE(parse_fen("4k3/8/8/8/8/8/8/4KR2 w Q - 0 1", &error, true));
+}
+
+TEST(Chess960, CastlingMoves) {
+  // The king castles by taking its own rook: to g1 with the rook on g1 and
+  // to c1 with the rook from b1 to d1.
+  Board board("1r2k1r1/1p4p1/8/8/8/8/8/1R2K1R1 w GBgb - 0 1");
+  MoveList castling;
+  board.castling_moves(&castling);
+  EXPECT_EQ(sorted_uci_strs(castling),
+            (std::vector<std::string>{"e1b1", "e1g1"}));
+  const Move kingside = *parse_uci_move(board, "e1g1");
+  EXPECT_EQ(kingside.move_type_, MoveType::castle_kingside);
+  Board after_kingside = board;
+  after_kingside.do_move(kingside);
+  EXPECT_EQ(after_kingside.to_fen(),
+            "1r2k1r1/1p4p1/8/8/8/8/8/1R3RK1 b gb - 1 1");
+  EXPECT_TRUE(after_kingside.has_consistent_state());
+  Board after_queenside = board;
+  after_queenside.do_move(*parse_uci_move(board, "e1b1"));
+  EXPECT_EQ(after_queenside.to_fen(),
+            "1r2k1r1/1p4p1/8/8/8/8/8/2KR2R1 b gb - 1 1");
+  // Moving a rook loses only its own right.
+  Board after_rook = board;
+  after_rook.do_move(*parse_uci_move(board, "b1a1"));
+  EXPECT_EQ(after_rook.castling_rights_,
+            white_kingside_castling | black_kingside_castling |
+                black_queenside_castling);
+}
+
+TEST(Chess960, KingAndRookSwapSquares) {
+  // The king on f1 lands on g1 where the rook stood, and the rook on f1.
+  const Board board("4k3/8/8/8/8/8/8/5KR1 w G - 0 1");
+  const Move castle = *parse_uci_move(board, "f1g1");
+  Board after = board;
+  UndoInfo undo;
+  after.do_move(castle, &undo);
+  EXPECT_EQ(after.to_fen(), "4k3/8/8/8/8/8/8/5RK1 b - - 1 1");
+  EXPECT_TRUE(after.has_consistent_state());
+  after.undo_move(castle, undo);
+  EXPECT_EQ(after, board);
+  // The king on g1 stays and only the rook moves.
+  Board stays("4k3/8/8/8/8/8/8/6KR w H - 0 1");
+  stays.do_move(*parse_uci_move(stays, "g1h1"));
+  EXPECT_EQ(stays.to_fen(), "4k3/8/8/8/8/8/8/5RK1 b - - 1 1");
+}
+
+TEST(Chess960, CastlingRookShieldsTheKing) {
+  // The rook on b1 hides c1 from the rook on a1 until it castles to d1.
+  const Board shielded("4k3/8/8/8/8/8/8/rR3K2 w B - 0 1");
+  AttackMaps maps(shielded);
+  EXPECT_FALSE(shielded.is_castle_queenside_legal());
+  EXPECT_FALSE(shielded.is_castle_queenside_legal(&maps));
+  const Board open("4k3/8/8/8/8/8/8/nR3K2 w B - 0 1");
+  EXPECT_TRUE(open.is_castle_queenside_legal());
+}
+
+TEST(Chess960, DoUndoAndGivesCheck) {
+  const std::vector<std::string> fens = {
+      "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+      "1r2k1r1/1p4p1/8/8/8/8/8/1R2K1R1 w GBgb - 0 1",
+      "2r1k3/8/8/8/8/8/8/R5KR w HA - 0 1",
+      "1rk2r2/1p3p2/8/8/8/8/1P3P2/1RK2R2 b FBfb - 0 1"};
+  for (const std::string& fen : fens) {
+    Board board(fen);
+    const Board original = board;
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    const CheckInfo info = board.check_info();
+    AttackMaps maps(board);
+    EXPECT_EQ(board.is_castle_kingside_legal(&maps),
+              board.is_castle_kingside_legal());
+    EXPECT_EQ(board.is_castle_queenside_legal(&maps),
+              board.is_castle_queenside_legal());
+    for (Move move : board.legal_moves()) {
+      Board expected = original;
+      expected.do_move(move);
+      EXPECT_TRUE(expected.has_consistent_state()) << move.to_uci_str();
+      EXPECT_EQ(board.gives_check(move, info),
+                expected.is_king_attacked(flip_color(side)))
+          << move.to_uci_str();
+      UndoInfo undo;
+      board.do_move(move, &undo);
+      EXPECT_EQ(board, expected);
+      board.undo_move(move, undo);
+      EXPECT_EQ(board, original);
+    }
+  }
+}
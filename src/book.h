@@ -0,0 +1,97 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "mapped_file.h"
+
+// Opening books in the Polyglot format: a file of 16-byte entries sorted by
+// the Polyglot key of their position, each with a move and its weight, big
+// endian. The file is mapped into memory rather than read, so a lookup is a
+// binary search that only touches the pages it needs, however big the book.
+
+// Returns the Polyglot key of `board`, which differs from `Board::key_`: it
+// has its own random numbers and only counts the en passant square if a pawn
+// can take en passant.
+uint64_t polyglot_key(const Board& board);
+
+class OpeningBook {
+ public:
+  struct Entry {
+    Move move_;
+    int weight_;
+  };
+
+  // Maps the book at `path`. `is_open` tells whether that worked.
+  explicit OpeningBook(const std::string& path);
+
+  bool is_open() const { return file_->data() != nullptr; }
+  // The number of entries.
+  size_t size() const { return file_->size() / entry_size; }
+
+  // Returns the legal moves of `board` in the book, in the book's order.
+  // Entries whose move isn't legal are skipped.
+  std::vector<Entry> moves(const Board& board) const;
+  // Picks one of `moves(board)` at random, each with a chance proportional to
+  // its weight, from `random`, any 64-bit number. Returns nullopt if the book
+  // has no move with a weight for `board`.
+  absl::optional<Move> pick_move(const Board& board, uint64_t random) const;
+
+ private:
+  static constexpr size_t entry_size = 16;
+
+  // Returns the index of the first entry with a key of at least `key`.
+  size_t lower_bound(uint64_t key) const;
+  uint64_t entry_key(size_t idx) const;
+
+  std::unique_ptr<MappedFile> file_;
+};
+
+// Writes a Polyglot book of moves added in any order, which may be many more
+// than fit in memory: up to `memory_bytes` of them are kept, sorted and
+// written to a run file next to the book at a time, and the runs are merged
+// into the book at the end (an external sort). The same move of the same
+// position added more than once gets the sum of the weights. Within a
+// position the moves come out heaviest first.
+class BookBuilder {
+ public:
+  BookBuilder(const std::string& path, size_t memory_bytes);
+  BookBuilder(const BookBuilder&) = delete;
+  BookBuilder& operator=(const BookBuilder&) = delete;
+  // Removes any run files left.
+  ~BookBuilder();
+
+  // Adds `move` of `board` with `weight`, which is capped at 65535.
+  void add(const Board& board, Move move, int weight);
+  // Merges the runs into the book. Returns false if a file couldn't be
+  // written.
+  bool finish();
+  // The number of entries of the book written.
+  uint64_t num_entries() const { return num_entries_; }
+
+ private:
+  // An entry of a run, 16 bytes like those of the book, in native order.
+  struct Entry {
+    uint64_t key_;
+    uint16_t move_;
+    uint16_t weight_;
+    uint32_t learn_;
+  };
+
+  bool write_run();
+
+  std::string path_;
+  size_t max_entries_;
+  std::vector<Entry> entries_;
+  std::vector<std::string> run_paths_;
+  bool has_failed_;
+  uint64_t num_entries_;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "book.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+struct BookEntry {
+  uint64_t key_;
+  uint16_t move_;
+  uint16_t weight_;
+};
+
+// Writes `entries`, sorted by key, as a Polyglot book at `path`.
+void write_book(std::vector<BookEntry> entries, const std::string& path) {
+  std::sort(entries.begin(), entries.end(),
+            [](const BookEntry& a, const BookEntry& b) {
+              return a.key_ < b.key_;
+            });
+  std::ofstream out(path, std::ios::binary);
+  for (const BookEntry& entry : entries) {
+    char bytes[16] = {};
+    for (int i = 0; i < 8; ++i) {
+      bytes[i] = static_cast<char>(entry.key_ >> (56 - 8 * i));
+    }
+    bytes[8] = static_cast<char>(entry.move_ >> 8);
+    bytes[9] = static_cast<char>(entry.move_);
+    bytes[10] = static_cast<char>(entry.weight_ >> 8);
+    bytes[11] = static_cast<char>(entry.weight_);
+    out.write(bytes, sizeof(bytes));
+  }
+}
+
+// Returns the Polyglot encoding of the move from `src` to `dst`, such as "e2"
+// and "e4".
+uint16_t book_move(const std::string& src, const std::string& dst,
+                   int promotion = 0) {
+  const auto square = [](const std::string& sq) {
+    return (sq[1] - '1') * 8 + (sq[0] - 'a');
+  };
+  return static_cast<uint16_t>(square(dst) | square(src) << 6 |
+                               promotion << 12);
+}
+
+std::vector<std::string> uci_moves(
+    const std::vector<OpeningBook::Entry>& entries) {
+  std::vector<std::string> res;
+  for (const OpeningBook::Entry& entry : entries) {
+    res.push_back(entry.move_.to_uci_str());
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(PolyglotKey, MatchesTheFormat) {
+  // The examples of the Polyglot format's description: the start position,
+  // then e4 d5 e5 f5 Ke2 Kf7, and a4 b5 h4 b4 c4 bxc3 Ra3.
+  const std::vector<std::pair<std::string, uint64_t>> examples = {
+      {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+       0x463b96181691fc9c},
+      {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+       0x823c9b50fd114196},
+      {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2",
+       0x0756b94461c50fb0},
+      {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2",
+       0x662fafb965db29d4},
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+       0x22a48b5a8e47ff78},
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3",
+       0x652a607ca3f242c1},
+      {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4",
+       0x00fdd303c946bdd9},
+      {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3",
+       0x3c8123ea7b067637},
+      {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4",
+       0x5c3f9b829b279560}};
+  for (const auto& example : examples) {
+    EXPECT_EQ(polyglot_key(Board(example.first)), example.second)
+        << example.first;
+  }
+  // After moves, with the en passant square that Board keeps either way.
+  Board board;
+  for (absl::string_view move : {"e2e4", "d7d5", "e4e5", "f7f5"}) {
+    for (Move legal_move : board.legal_moves()) {
+      if (legal_move.to_uci_str() == move) {
+        board.do_move(legal_move);
+      }
+    }
+  }
+  EXPECT_EQ(polyglot_key(board), 0x22a48b5a8e47ff78);
+}
+
+TEST(OpeningBook, FindsWeightedMoves) {
+  const std::string path = testing::TempDir() + "book_test.bin";
+  const uint64_t start_key = polyglot_key(Board());
+  const Board castling("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1");
+  const Board promotion("8/1P2k3/8/8/8/8/8/4K3 w - - 0 1");
+  write_book({{start_key, book_move("e2", "e4"), 3},
+              {start_key, book_move("d2", "d4"), 1},
+              // Not legal, so skipped.
+              {start_key, book_move("e2", "e5"), 10},
+              {start_key, book_move("g1", "f3"), 0},
+              {start_key - 1, book_move("c2", "c4"), 5},
+              {start_key + 1, book_move("c2", "c4"), 5},
+              {polyglot_key(castling), book_move("e1", "h1"), 1},
+              {polyglot_key(castling), book_move("e1", "a1"), 1},
+              {polyglot_key(promotion), book_move("b7", "b8", 1), 1}},
+             path);
+  const OpeningBook book(path);
+  ASSERT_TRUE(book.is_open());
+  EXPECT_EQ(book.size(), 9);
+
+  EXPECT_EQ(uci_moves(book.moves(Board())),
+            std::vector<std::string>({"e2e4", "d2d4", "g1f3"}));
+  std::vector<std::string> picks;
+  for (uint64_t random = 0; random < 4; ++random) {
+    picks.push_back(book.pick_move(Board(), random)->to_uci_str());
+  }
+  EXPECT_EQ(picks,
+            std::vector<std::string>({"e2e4", "e2e4", "e2e4", "d2d4"}));
+
+  const std::vector<OpeningBook::Entry> castles = book.moves(castling);
+  ASSERT_EQ(castles.size(), 2);
+  EXPECT_EQ(castles[0].move_.move_type_, MoveType::castle_kingside);
+  EXPECT_EQ(castles[1].move_.move_type_, MoveType::castle_queenside);
+  EXPECT_EQ(uci_moves(book.moves(promotion)),
+            std::vector<std::string>({"b7b8n"}));
+
+  EXPECT_TRUE(book.moves(Board("4k3/8/8/8/8/8/8/4K3 w - - 0 1")).empty());
+  EXPECT_FALSE(book.pick_move(Board("4k3/8/8/8/8/8/8/4K3 w - - 0 1"), 0));
+  std::remove(path.c_str());
+}
+
+TEST(OpeningBook, MissingFileHasNoMoves) {
+  const OpeningBook book(testing::TempDir() + "no_such_book.bin");
+  EXPECT_FALSE(book.is_open());
+  EXPECT_EQ(book.size(), 0);
+  EXPECT_TRUE(book.moves(Board()).empty());
+}
+
+TEST(BookBuilder, SortsAndMergesTheMovesOnDisk) {
+  const std::string path = testing::TempDir() + "book_builder_test.bin";
+  const Board start;
+  Board e4 = start;
+  e4.do_move(*start.legal_move(str_to_square("e2"), str_to_square("e4")));
+  const auto move = [](const Board& board, const char* src, const char* dst) {
+    return *board.legal_move(str_to_square(src), str_to_square(dst));
+  };
+  {
+    // Room for three moves, so the moves go through several runs.
+    BookBuilder builder(path, 48);
+    builder.add(e4, move(e4, "c7", "c5"), 4);
+    builder.add(start, move(start, "d2", "d4"), 3);
+    builder.add(start, move(start, "e2", "e4"), 2);
+    builder.add(e4, move(e4, "e7", "e5"), 5);
+    builder.add(start, move(start, "e2", "e4"), 2);
+    builder.add(start, move(start, "g1", "f3"), 100000);
+    builder.add(start, move(start, "g1", "f3"), 1);
+    ASSERT_TRUE(builder.finish());
+    EXPECT_EQ(builder.num_entries(), 5);
+  }
+  EXPECT_EQ(std::fopen((path + ".run0").c_str(), "rb"), nullptr);
+  const OpeningBook book(path);
+  ASSERT_EQ(book.size(), 5);
+  const std::vector<OpeningBook::Entry> moves = book.moves(start);
+  EXPECT_EQ(uci_moves(moves),
+            std::vector<std::string>({"g1f3", "e2e4", "d2d4"}));
+  EXPECT_EQ(moves[0].weight_, 65535);
+  EXPECT_EQ(moves[1].weight_, 4);
+  EXPECT_EQ(moves[2].weight_, 3);
+  EXPECT_EQ(uci_moves(book.moves(e4)),
+            std::vector<std::string>({"e7e5", "c7c5"}));
+  std::remove(path.c_str());
+}
@@ -0,0 +1,106 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// A fixed-capacity queue that any number of threads push to and pop from
+// without locks, after Dmitry Vyukov's bounded MPMC queue. Each cell of the
+// ring carries a sequence number telling whether it is ready to be written or
+// read on the current lap, so a push or a pop is one compare-and-swap of a
+// position and one store of a sequence number, and producers and consumers
+// only contend with each other when the queue is almost empty or full.
+template <typename T>
+class BoundedQueue {
+ public:
+  // Rounds `capacity` up to a power of two.
+  explicit BoundedQueue(size_t capacity);
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  // Returns false, and leaves `value` alone, if the queue is full.
+  bool try_push(T&& value);
+  // Returns false if the queue is empty.
+  bool try_pop(T* value);
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence_;
+    T value_;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  // On cache lines of their own, so that pushing doesn't slow popping.
+  alignas(64) std::atomic<size_t> push_pos_;
+  alignas(64) std::atomic<size_t> pop_pos_;
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) : push_pos_(0), pop_pos_(0) {
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  cells_ = std::make_unique<Cell[]>(size);
+  mask_ = size - 1;
+  for (size_t i = 0; i < size; ++i) {
+    cells_[i].sequence_.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+bool BoundedQueue<T>::try_push(T&& value) {
+  size_t pos = push_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells_[pos & mask_];
+    const size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+    const intptr_t diff =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      // The cell is free on this lap; claim it unless another producer did.
+      if (push_pos_.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        cell.value_ = std::move(value);
+        cell.sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // The cell still holds the value of the last lap.
+      return false;
+    } else {
+      pos = push_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T>
+bool BoundedQueue<T>::try_pop(T* value) {
+  size_t pos = pop_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells_[pos & mask_];
+    const size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+    const intptr_t diff =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (pop_pos_.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+        *value = std::move(cell.value_);
+        // Free the cell for the next lap.
+        cell.sequence_.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // Nothing has been pushed to the cell on this lap yet.
+      return false;
+    } else {
+      pos = pop_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+#endif
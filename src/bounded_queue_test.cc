@@ -0,0 +1,67 @@
+#include "bounded_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(BoundedQueue, RoundsCapacityUp) {
+  EXPECT_EQ(BoundedQueue<int>(1).capacity(), 1);
+  EXPECT_EQ(BoundedQueue<int>(5).capacity(), 8);
+  EXPECT_EQ(BoundedQueue<int>(8).capacity(), 8);
+}
+
+TEST(BoundedQueue, IsFirstInFirstOut) {
+  BoundedQueue<int> queue(4);
+  int value = 0;
+  EXPECT_FALSE(queue.try_pop(&value));
+  // Several laps around the ring.
+  for (int lap = 0; lap < 3; ++lap) {
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_TRUE(queue.try_push(lap * 4 + i));
+    }
+    EXPECT_FALSE(queue.try_push(-1));
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(queue.try_pop(&value));
+      EXPECT_EQ(value, lap * 4 + i);
+    }
+    EXPECT_FALSE(queue.try_pop(&value));
+  }
+}
+
+TEST(BoundedQueue, PassesEveryValueBetweenThreads) {
+  constexpr int num_threads = 4;
+  constexpr int num_values = 20000;
+  BoundedQueue<int> queue(16);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int> num_popped(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&queue, t] {
+      for (int i = t; i < num_values; i += num_threads) {
+        int value = i;
+        while (!queue.try_push(std::move(value))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    threads.emplace_back([&queue, &sum, &num_popped] {
+      while (num_popped.load() < num_values) {
+        int value = 0;
+        if (queue.try_pop(&value)) {
+          sum.fetch_add(value);
+          num_popped.fetch_add(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_popped.load(), num_values);
+  EXPECT_EQ(sum.load(), int64_t{num_values} * (num_values - 1) / 2);
+}
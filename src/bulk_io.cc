@@ -0,0 +1,498 @@
+#include "bulk_io.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define BULK_IO_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#else
+#define BULK_IO_HAVE_IO_URING 0
+#endif
+
+namespace {
+// Reads or writes all `size` bytes at `offset`, as far as the file goes for
+// a read. Returns the bytes read or written, or -1 on an error.
+int64_t pread_all(int fd, char* data, size_t size, uint64_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t res = pread(fd, data + done, size - done,
+                              static_cast<off_t>(offset + done));
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res < 0) {
+      return -1;
+    }
+    if (res == 0) {
+      break;
+    }
+    done += static_cast<size_t>(res);
+  }
+  return static_cast<int64_t>(done);
+}
+
+bool pwrite_all(int fd, const char* data, size_t size, uint64_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t res = pwrite(fd, data + done, size - done,
+                               static_cast<off_t>(offset + done));
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(res);
+  }
+  return true;
+}
+}  // namespace.
+
+#if BULK_IO_HAVE_IO_URING
+// An io_uring set up with the raw system calls, which only needs the kernel's
+// header rather than liburing. Only one thread uses it, so it needs no more
+// than the acquire and release ordering of the ring's head and tail.
+class IoRing {
+ public:
+  // Returns null if the kernel doesn't allow io_uring. `num_buffers` buffers
+  // of `buffer_size` bytes, one after the other from `buffers`, are
+  // registered if the kernel lets them be, so that their reads and writes
+  // skip mapping them.
+  static std::unique_ptr<IoRing> create(size_t entries, char* buffers,
+                                        size_t buffer_size,
+                                        size_t num_buffers) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const int fd = static_cast<int>(
+        syscall(__NR_io_uring_setup, static_cast<unsigned>(entries), &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    std::unique_ptr<IoRing> ring(new IoRing(fd));
+    if (!ring->map(params)) {
+      return nullptr;
+    }
+    std::vector<iovec> iovecs(num_buffers);
+    for (size_t i = 0; i < num_buffers; ++i) {
+      iovecs[i].iov_base = buffers + i * buffer_size;
+      iovecs[i].iov_len = buffer_size;
+    }
+    ring->fixed_buffers_ =
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                iovecs.data(), static_cast<unsigned>(num_buffers)) == 0;
+    return ring;
+  }
+
+  ~IoRing() {
+    if (sqes_) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(fd_);
+  }
+
+  // Starts reading or writing `size` bytes of buffer `buffer_idx`, at `data`,
+  // at `offset` of `fd`. Returns false if the request couldn't be submitted.
+  bool submit(bool is_write, int fd, size_t buffer_idx, char* data,
+              size_t size, uint64_t offset) {
+    const unsigned tail = *sq_tail_;
+    const unsigned idx = tail & *sq_mask_;
+    io_uring_sqe* const sqe = &sqes_[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    if (fixed_buffers_) {
+      sqe->opcode = is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->buf_index = static_cast<uint16_t>(buffer_idx);
+    } else {
+      sqe->opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->off = offset;
+    sqe->user_data = buffer_idx;
+    sq_array_[idx] = idx;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (true) {
+      const long res = syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0);
+      if (res == 1) {
+        return true;
+      }
+      if (res < 0 && errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  // Waits for a request to complete, sets `*buffer_idx` to its buffer and
+  // returns its result: the bytes read or written, or minus an errno.
+  int32_t wait(size_t* buffer_idx) {
+    while (true) {
+      const unsigned head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        *buffer_idx = static_cast<size_t>(cqe.user_data);
+        const int32_t res = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return res;
+      }
+      const long res = syscall(__NR_io_uring_enter, fd_, 0, 1,
+                               IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (res < 0 && errno != EINTR) {
+        *buffer_idx = 0;
+        return -errno;
+      }
+    }
+  }
+
+ private:
+  explicit IoRing(int fd)
+      : fd_(fd),
+        sq_ring_(nullptr),
+        cq_ring_(nullptr),
+        sqes_(nullptr),
+        fixed_buffers_(false) {}
+
+  // Maps the queues, and finds the fields of the rings in them.
+  bool map(const io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = map_queue(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_) {
+      return false;
+    }
+    cq_ring_ =
+        single_mmap ? sq_ring_ : map_queue(cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!cq_ring_) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(
+        map_queue(sqes_size_, IORING_OFF_SQES));
+    if (!sqes_) {
+      return false;
+    }
+    char* const sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* const cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void* map_queue(size_t size, off_t offset) {
+    void* const res = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return res == MAP_FAILED ? nullptr : res;
+  }
+
+  const int fd_;
+  void* sq_ring_;
+  void* cq_ring_;
+  io_uring_sqe* sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  size_t sqes_size_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+  bool fixed_buffers_;
+};
+#else
+// Never made: `create` tells the files to use pread and pwrite.
+class IoRing {
+ public:
+  static std::unique_ptr<IoRing> create(size_t, char*, size_t, size_t) {
+    return nullptr;
+  }
+  bool submit(bool, int, size_t, char*, size_t, uint64_t) { return false; }
+  int32_t wait(size_t* buffer_idx) {
+    *buffer_idx = 0;
+    return -EIO;
+  }
+};
+#endif
+
+BulkFileReader::BulkFileReader(const std::string& path,
+                               const BulkIoOptions& options)
+    : options_(options),
+      fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC)),
+      size_(0),
+      failed_(false),
+      next_submit_offset_(0),
+      next_buffer_(0),
+      returned_buffer_(0),
+      has_returned_(false),
+      num_in_flight_(0) {
+  struct stat st;
+  if (fd_ < 0) {
+    return;
+  }
+  if (fstat(fd_, &st) != 0) {
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  size_ = static_cast<uint64_t>(st.st_size);
+  const size_t block = std::max<size_t>(options_.block_size_, 1);
+  size_t num_buffers = std::max<size_t>(options_.queue_depth_, 1);
+  memory_.reset(new char[block * num_buffers]);
+  if (options_.use_io_uring_) {
+    ring_ = IoRing::create(num_buffers, memory_.get(), block, num_buffers);
+  }
+  if (!ring_) {
+    num_buffers = 1;
+  }
+  buffers_.resize(num_buffers);
+  for (size_t i = 0; i < num_buffers; ++i) {
+    buffers_[i] = {memory_.get() + i * block, size_, false, 0};
+    submit(i);
+  }
+}
+
+BulkFileReader::~BulkFileReader() {
+  // The kernel may still write to the buffers of the reads in flight.
+  while (num_in_flight_ > 0) {
+    wait_for_read();
+  }
+  ring_.reset();
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+IoBackend BulkFileReader::backend() const {
+  return ring_ ? IoBackend::io_uring : IoBackend::pread;
+}
+
+size_t BulkFileReader::block_size(uint64_t offset) const {
+  return static_cast<size_t>(std::min<uint64_t>(
+      std::max<size_t>(options_.block_size_, 1), size_ - offset));
+}
+
+void BulkFileReader::submit(size_t buffer_idx) {
+  Buffer& buffer = buffers_[buffer_idx];
+  buffer.offset_ = next_submit_offset_;
+  if (buffer.offset_ >= size_) {
+    return;
+  }
+  next_submit_offset_ += block_size(buffer.offset_);
+  if (!ring_) {
+    return;
+  }
+  if (!ring_->submit(false, fd_, buffer_idx, buffer.data_,
+                     block_size(buffer.offset_), buffer.offset_)) {
+    failed_ = true;
+    return;
+  }
+  buffer.in_flight_ = true;
+  ++num_in_flight_;
+}
+
+void BulkFileReader::wait_for_read() {
+  size_t buffer_idx;
+  const int32_t res = ring_->wait(&buffer_idx);
+  if (buffer_idx >= buffers_.size() || !buffers_[buffer_idx].in_flight_) {
+    // The ring itself failed.
+    failed_ = true;
+    num_in_flight_ = 0;
+    return;
+  }
+  buffers_[buffer_idx].in_flight_ = false;
+  buffers_[buffer_idx].result_ = res;
+  --num_in_flight_;
+}
+
+bool BulkFileReader::next(absl::string_view* block) {
+  if (fd_ < 0 || failed_) {
+    return false;
+  }
+  if (has_returned_) {
+    has_returned_ = false;
+    submit(returned_buffer_);
+  }
+  Buffer& buffer = buffers_[next_buffer_];
+  if (buffer.offset_ >= size_) {
+    return false;
+  }
+  const size_t size = block_size(buffer.offset_);
+  if (ring_) {
+    while (buffer.in_flight_ && !failed_) {
+      wait_for_read();
+    }
+  } else {
+    buffer.result_ = static_cast<int32_t>(
+        pread_all(fd_, buffer.data_, size, buffer.offset_));
+  }
+  if (failed_ || buffer.result_ < 0) {
+    failed_ = true;
+    return false;
+  }
+  // A read may return part of the block, which isn't the end of the file,
+  // as that is known.
+  const size_t num_read = static_cast<size_t>(buffer.result_);
+  if (num_read < size &&
+      pread_all(fd_, buffer.data_ + num_read, size - num_read,
+                buffer.offset_ + num_read) !=
+          static_cast<int64_t>(size - num_read)) {
+    failed_ = true;
+    return false;
+  }
+  *block = absl::string_view(buffer.data_, size);
+  returned_buffer_ = next_buffer_;
+  has_returned_ = true;
+  next_buffer_ = (next_buffer_ + 1) % buffers_.size();
+  return true;
+}
+
+BulkFileWriter::BulkFileWriter(const std::string& path, bool append,
+                               const BulkIoOptions& options)
+    : options_(options),
+      fd_(open(path.c_str(),
+               O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC),
+               0644)),
+      offset_(0),
+      failed_(false),
+      current_(0),
+      num_in_flight_(0) {
+  struct stat st;
+  if (fd_ < 0) {
+    return;
+  }
+  // Writes go to explicit offsets, which O_APPEND would ignore.
+  if (fstat(fd_, &st) != 0) {
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  offset_ = static_cast<uint64_t>(st.st_size);
+  const size_t block = std::max<size_t>(options_.block_size_, 1);
+  size_t num_buffers = std::max<size_t>(options_.queue_depth_, 1);
+  memory_.reset(new char[block * num_buffers]);
+  if (options_.use_io_uring_) {
+    ring_ = IoRing::create(num_buffers, memory_.get(), block, num_buffers);
+  }
+  if (!ring_) {
+    num_buffers = 1;
+  }
+  buffers_.resize(num_buffers);
+  for (size_t i = 0; i < num_buffers; ++i) {
+    buffers_[i] = {memory_.get() + i * block, 0, 0, false};
+  }
+}
+
+BulkFileWriter::~BulkFileWriter() { close(); }
+
+IoBackend BulkFileWriter::backend() const {
+  return ring_ ? IoBackend::io_uring : IoBackend::pread;
+}
+
+void BulkFileWriter::write(const void* data, size_t size) {
+  if (fd_ < 0) {
+    return;
+  }
+  const size_t block = std::max<size_t>(options_.block_size_, 1);
+  const char* src = static_cast<const char*>(data);
+  while (size > 0) {
+    Buffer& buffer = buffers_[current_];
+    const size_t n = std::min(size, block - buffer.size_);
+    std::memcpy(buffer.data_ + buffer.size_, src, n);
+    buffer.size_ += n;
+    src += n;
+    size -= n;
+    if (buffer.size_ == block) {
+      flush_buffer();
+    }
+  }
+}
+
+void BulkFileWriter::flush_buffer() {
+  Buffer& buffer = buffers_[current_];
+  buffer.offset_ = offset_;
+  offset_ += buffer.size_;
+  if (!ring_) {
+    failed_ |= !pwrite_all(fd_, buffer.data_, buffer.size_, buffer.offset_);
+    buffer.size_ = 0;
+    return;
+  }
+  if (ring_->submit(true, fd_, current_, buffer.data_, buffer.size_,
+                    buffer.offset_)) {
+    buffer.in_flight_ = true;
+    ++num_in_flight_;
+  } else {
+    failed_ |= !pwrite_all(fd_, buffer.data_, buffer.size_, buffer.offset_);
+    buffer.size_ = 0;
+  }
+  current_ = (current_ + 1) % buffers_.size();
+  while (buffers_[current_].in_flight_ && num_in_flight_ > 0) {
+    wait_for_write();
+  }
+}
+
+void BulkFileWriter::wait_for_write() {
+  size_t buffer_idx;
+  const int32_t res = ring_->wait(&buffer_idx);
+  if (buffer_idx >= buffers_.size() || !buffers_[buffer_idx].in_flight_) {
+    // The ring itself failed, so what it was writing is lost.
+    failed_ = true;
+    for (Buffer& buffer : buffers_) {
+      buffer.in_flight_ = false;
+      buffer.size_ = 0;
+    }
+    num_in_flight_ = 0;
+    return;
+  }
+  Buffer& buffer = buffers_[buffer_idx];
+  if (res < 0) {
+    failed_ = true;
+  } else if (static_cast<size_t>(res) < buffer.size_) {
+    // The rest of a write that wrote part of the buffer.
+    failed_ |= !pwrite_all(fd_, buffer.data_ + res, buffer.size_ - res,
+                           buffer.offset_ + res);
+  }
+  buffer.in_flight_ = false;
+  buffer.size_ = 0;
+  --num_in_flight_;
+}
+
+bool BulkFileWriter::close() {
+  if (fd_ < 0) {
+    return !failed_;
+  }
+  if (buffers_[current_].size_ > 0) {
+    flush_buffer();
+  }
+  while (num_in_flight_ > 0) {
+    wait_for_write();
+  }
+  ring_.reset();
+  failed_ |= ::close(fd_) != 0;
+  fd_ = -1;
+  return !failed_;
+}
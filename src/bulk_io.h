@@ -0,0 +1,136 @@
+#ifndef BULK_IO_H
+#define BULK_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+// Sequential reading and writing of large files in blocks, for the stages of
+// batch jobs that are bound by storage rather than by the engine. On Linux
+// with io_uring, several blocks are read ahead or written behind at once, so
+// that an NVMe device has enough requests in flight to reach its bandwidth,
+// which a loop of blocking reads of one block at a time doesn't. The buffers
+// are registered with the ring, so the kernel doesn't map them for every
+// request. Elsewhere, or where the kernel doesn't allow io_uring, the blocks
+// are read and written one at a time with pread and pwrite.
+
+enum class IoBackend { io_uring, pread };
+
+struct BulkIoOptions {
+  size_t block_size_ = size_t{1} << 20;
+  // The most blocks in flight at once with io_uring, at least 1.
+  size_t queue_depth_ = 8;
+  // Uses pread and pwrite even where io_uring is available.
+  bool use_io_uring_ = true;
+};
+
+// The submission and completion queues of an io_uring, defined in
+// bulk_io.cc.
+class IoRing;
+
+// Reads a file from start to end a block at a time, with the blocks after
+// the one returned already being read.
+class BulkFileReader {
+ public:
+  explicit BulkFileReader(const std::string& path,
+                          const BulkIoOptions& options = {});
+  BulkFileReader(const BulkFileReader&) = delete;
+  BulkFileReader& operator=(const BulkFileReader&) = delete;
+  ~BulkFileReader();
+
+  bool is_open() const { return fd_ >= 0; }
+  IoBackend backend() const;
+  uint64_t size() const { return size_; }
+  // Sets `*block` to the next `block_size_` bytes of the file, or fewer at
+  // its end, and returns true, or returns false once the whole file has been
+  // returned or a read fails. The block stays valid until the next call.
+  bool next(absl::string_view* block);
+  bool failed() const { return failed_; }
+
+ private:
+  struct Buffer {
+    char* data_;
+    // The offset of the block in the buffer, past the end of the file once
+    // there are no blocks left for it.
+    uint64_t offset_;
+    bool in_flight_;
+    // What the read returned: the bytes read, or minus an errno.
+    int32_t result_;
+  };
+
+  // Starts reading the next block of the file into `buffers_[buffer_idx]`,
+  // if there is one left.
+  void submit(size_t buffer_idx);
+  // Waits for a read to complete.
+  void wait_for_read();
+  size_t block_size(uint64_t offset) const;
+
+  const BulkIoOptions options_;
+  int fd_;
+  uint64_t size_;
+  bool failed_;
+  std::unique_ptr<IoRing> ring_;
+  std::unique_ptr<char[]> memory_;
+  std::vector<Buffer> buffers_;
+  // The offset of the next block to submit, and the buffer of the next block
+  // to return.
+  uint64_t next_submit_offset_;
+  size_t next_buffer_;
+  // The buffer returned last, which is reused on the next call.
+  size_t returned_buffer_;
+  bool has_returned_;
+  size_t num_in_flight_;
+};
+
+// Writes a file from start to end, a block at a time once a block's worth
+// has been written to it, with the writes of the blocks before still in
+// flight.
+class BulkFileWriter {
+ public:
+  // Creates the file, or empties it, or with `append` writes after what it
+  // has.
+  BulkFileWriter(const std::string& path, bool append,
+                 const BulkIoOptions& options = {});
+  BulkFileWriter(const BulkFileWriter&) = delete;
+  BulkFileWriter& operator=(const BulkFileWriter&) = delete;
+  // Closes the file if `close` wasn't called.
+  ~BulkFileWriter();
+
+  bool is_open() const { return fd_ >= 0; }
+  IoBackend backend() const;
+  void write(const void* data, size_t size);
+  // Writes what is left, waits for the writes in flight and closes the file.
+  // Returns false if a write failed.
+  bool close();
+
+ private:
+  struct Buffer {
+    char* data_;
+    size_t size_;
+    // Where the buffer goes in the file, once it is written.
+    uint64_t offset_;
+    bool in_flight_;
+  };
+
+  // Starts writing the current buffer at the end of the file, and takes
+  // another.
+  void flush_buffer();
+  // Waits for a write to complete and frees its buffer.
+  void wait_for_write();
+
+  const BulkIoOptions options_;
+  int fd_;
+  uint64_t offset_;
+  bool failed_;
+  std::unique_ptr<IoRing> ring_;
+  std::unique_ptr<char[]> memory_;
+  std::vector<Buffer> buffers_;
+  size_t current_;
+  size_t num_in_flight_;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "bulk_io.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Some bytes that aren't a repeat of a block.
+std::string contents_of_size(size_t size) {
+  std::string res(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    res[i] = static_cast<char>(i * 7 + i / 251);
+  }
+  return res;
+}
+
+std::string read_with_std(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+// Small blocks, so that a few kilobytes span many with some in flight.
+BulkIoOptions small_blocks(bool use_io_uring) {
+  BulkIoOptions options;
+  options.block_size_ = 4096;
+  options.queue_depth_ = 4;
+  options.use_io_uring_ = use_io_uring;
+  return options;
+}
+}  // namespace.
+
+TEST(BulkIo, ReadsBackWhatWasWritten) {
+  for (bool use_io_uring : {true, false}) {
+    SCOPED_TRACE(use_io_uring);
+    const std::string path = testing::TempDir() + "bulk_io_test_round_trip";
+    const std::string contents = contents_of_size(10 * 4096 + 123);
+    BulkFileWriter writer(path, false, small_blocks(use_io_uring));
+    ASSERT_TRUE(writer.is_open());
+    // In pieces that don't line up with the blocks.
+    for (size_t i = 0; i < contents.size(); i += 1000) {
+      writer.write(contents.data() + i,
+                   std::min<size_t>(1000, contents.size() - i));
+    }
+    ASSERT_TRUE(writer.close());
+    EXPECT_EQ(read_with_std(path), contents);
+
+    BulkFileReader reader(path, small_blocks(use_io_uring));
+    ASSERT_TRUE(reader.is_open());
+    EXPECT_EQ(reader.size(), contents.size());
+    std::string read;
+    absl::string_view block;
+    size_t num_blocks = 0;
+    while (reader.next(&block)) {
+      EXPECT_LE(block.size(), 4096u);
+      read.append(block.data(), block.size());
+      ++num_blocks;
+    }
+    EXPECT_FALSE(reader.failed());
+    EXPECT_EQ(num_blocks, 11u);
+    EXPECT_EQ(read, contents);
+  }
+}
+
+TEST(BulkIo, AppendsAfterWhatTheFileHas) {
+  for (bool use_io_uring : {true, false}) {
+    SCOPED_TRACE(use_io_uring);
+    const std::string path = testing::TempDir() + "bulk_io_test_append";
+    std::ofstream(path, std::ios::binary) << "head";
+    const std::string contents = contents_of_size(5000);
+    BulkFileWriter writer(path, true, small_blocks(use_io_uring));
+    writer.write(contents.data(), contents.size());
+    ASSERT_TRUE(writer.close());
+    EXPECT_EQ(read_with_std(path), "head" + contents);
+
+    BulkFileWriter truncating(path, false, small_blocks(use_io_uring));
+    truncating.write("x", 1);
+    ASSERT_TRUE(truncating.close());
+    EXPECT_EQ(read_with_std(path), "x");
+  }
+}
+
+TEST(BulkIo, ReadsEmptyFiles) {
+  for (bool use_io_uring : {true, false}) {
+    SCOPED_TRACE(use_io_uring);
+    const std::string path = testing::TempDir() + "bulk_io_test_empty";
+    std::ofstream(path, std::ios::binary).flush();
+    BulkFileReader reader(path, small_blocks(use_io_uring));
+    ASSERT_TRUE(reader.is_open());
+    absl::string_view block;
+    EXPECT_FALSE(reader.next(&block));
+    EXPECT_FALSE(reader.failed());
+  }
+}
+
+TEST(BulkIo, FailsOnMissingFiles) {
+  for (bool use_io_uring : {true, false}) {
+    SCOPED_TRACE(use_io_uring);
+    BulkFileReader reader("/no/such/file", small_blocks(use_io_uring));
+    EXPECT_FALSE(reader.is_open());
+    absl::string_view block;
+    EXPECT_FALSE(reader.next(&block));
+    EXPECT_FALSE(BulkFileWriter("/no/such/dir/file", false,
+                                small_blocks(use_io_uring))
+                     .is_open());
+  }
+}
+
+TEST(BulkIo, FallsBackToPread) {
+  const std::string path = testing::TempDir() + "bulk_io_test_pread";
+  std::ofstream(path, std::ios::binary) << "abc";
+  EXPECT_EQ(BulkFileReader(path, small_blocks(false)).backend(),
+            IoBackend::pread);
+}
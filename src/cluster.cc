@@ -0,0 +1,784 @@
+#include "cluster.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "repetition.h"
+#include "search.h"
+#include "transposition_table.h"
+
+namespace {
+// Changes with the messages.
+constexpr uint32_t protocol_version = 1;
+
+enum MessageType : uint32_t {
+  // From a worker when it connects, and the coordinator's answer.
+  hello_message = 1,
+  welcome_message,
+  // From the coordinator.
+  search_message,
+  stop_message,
+  quit_message,
+  // From a worker.
+  result_message,
+  // From any node.
+  entries_message
+};
+
+// Every message starts with this, followed by `size_` bytes.
+struct MessageHeader {
+  uint32_t type_;
+  uint32_t size_;
+};
+
+// Larger messages are taken for a broken peer.
+constexpr uint32_t max_message_size = uint32_t{64} << 20;
+
+struct Hello {
+  uint32_t version_;
+  uint32_t board_size_;
+  uint64_t num_buckets_;
+};
+
+// Followed by `num_moves_` moves from `start_`.
+struct SearchRequest {
+  uint64_t id_;
+  uint64_t max_nodes_;
+  int32_t max_depth_;
+  uint32_t num_moves_;
+  Board start_;
+};
+
+// Followed by the `pv_length_` moves of the principal variation.
+struct SearchReport {
+  uint64_t id_;
+  uint64_t nodes_;
+  uint64_t tablebase_hits_;
+  int32_t score_;
+  int32_t depth_;
+  int32_t selective_depth_;
+  uint32_t is_final_;
+  uint32_t pv_length_;
+};
+
+// Followed by the entries, of a table of `num_buckets_` buckets.
+struct EntriesHeader {
+  uint64_t num_buckets_;
+};
+
+// How long a node waits for the other end of the handshake, the coordinator
+// for the final reports of the workers it stopped, and one that quits for
+// its last messages to go out.
+constexpr std::chrono::seconds handshake_timeout{10};
+constexpr std::chrono::seconds stop_timeout{2};
+constexpr std::chrono::seconds quit_timeout{1};
+
+template <typename T>
+void append_struct(const T& value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void append_moves(const std::vector<Move>& moves, std::string* out) {
+  out->append(reinterpret_cast<const char*>(moves.data()),
+              moves.size() * sizeof(Move));
+}
+
+std::vector<Move> read_moves(const char* data, size_t num_moves) {
+  std::vector<Move> moves(num_moves);
+  std::memcpy(moves.data(), data, num_moves * sizeof(Move));
+  return moves;
+}
+
+std::string message(uint32_t type, const std::string& payload) {
+  std::string res;
+  append_struct(MessageHeader{type, static_cast<uint32_t>(payload.size())},
+                &res);
+  res += payload;
+  return res;
+}
+
+// Blocking reads and writes of whole buffers, for the handshake.
+bool write_all(int fd, const std::string& data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    const ssize_t n =
+        ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n =
+        ::recv(fd, static_cast<char*>(data) + done, size - done, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Reads one message of `type` with a payload of type T.
+template <typename T>
+bool read_message(int fd, uint32_t type, T* payload) {
+  MessageHeader header;
+  return read_all(fd, &header, sizeof(header)) && header.type_ == type &&
+         header.size_ == sizeof(T) && read_all(fd, payload, sizeof(T));
+}
+
+void set_receive_timeout(int fd, std::chrono::microseconds timeout) {
+  timeval tv;
+  tv.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+  tv.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000000);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+Hello local_hello(const TranspositionTable& table) {
+  return {protocol_version, static_cast<uint32_t>(sizeof(Board)),
+          table.num_buckets()};
+}
+}  // namespace.
+
+ClusterNode::ClusterNode(TranspositionTable* table,
+                         const ClusterOptions& options)
+    : table_(table),
+      options_(options),
+      is_coordinator_(false),
+      port_(0),
+      wake_fds_{-1, -1},
+      quitting_(false),
+      search_id_(0),
+      stopped_id_(0),
+      stop_(false),
+      searching_(false),
+      next_bucket_(0),
+      num_entries_sent_(0),
+      num_entries_merged_(0) {}
+
+ClusterNode::~ClusterNode() {
+  if (communicator_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (is_coordinator_) {
+        broadcast(quit_message, "");
+      }
+      quitting_ = true;
+    }
+    wake();
+    communicator_.join();
+  }
+  for (const std::unique_ptr<Peer>& peer : peers_) {
+    close(peer->fd_);
+  }
+  for (int fd : wake_fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool ClusterNode::coordinate(uint16_t port, size_t num_workers,
+                             std::chrono::milliseconds timeout,
+                             std::string* error) {
+  const int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    *error = "can't open a socket";
+    return false;
+  }
+  const int one = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  socklen_t addr_size = sizeof(addr);
+  if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(listen_fd, static_cast<int>(num_workers)) != 0 ||
+      getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr),
+                  &addr_size) != 0) {
+    close(listen_fd);
+    *error = absl::StrCat("can't listen on port ", port);
+    return false;
+  }
+  port_.store(ntohs(addr.sin_port), std::memory_order_release);
+  const Hello hello = local_hello(*table_);
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::vector<int> fds;
+  size_t num_turned_away = 0;
+  while (fds.size() < num_workers) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    pollfd listening = {listen_fd, POLLIN, 0};
+    if (left.count() <= 0 ||
+        poll(&listening, 1, static_cast<int>(left.count())) <= 0) {
+      break;
+    }
+    const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    set_receive_timeout(fd, handshake_timeout);
+    Hello theirs;
+    const bool accepted = read_message(fd, hello_message, &theirs) &&
+                          std::memcmp(&theirs, &hello, sizeof(hello)) == 0;
+    std::string welcome;
+    append_struct(uint32_t{accepted}, &welcome);
+    if (write_all(fd, message(welcome_message, welcome)) && accepted) {
+      fds.push_back(fd);
+    } else {
+      close(fd);
+      ++num_turned_away;
+    }
+  }
+  close(listen_fd);
+  if (fds.size() < num_workers) {
+    for (int fd : fds) {
+      close(fd);
+    }
+    *error = absl::StrCat(fds.size(), " of ", num_workers,
+                          " workers connected, ", num_turned_away,
+                          " turned away");
+    return false;
+  }
+  is_coordinator_ = true;
+  start(std::move(fds));
+  return true;
+}
+
+bool ClusterNode::connect(const std::string& host, uint16_t port,
+                          std::string* error) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addrs = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                  &addrs) != 0) {
+    *error = absl::StrCat("can't resolve ", host);
+    return false;
+  }
+  int fd = -1;
+  for (const addrinfo* addr = addrs; addr && fd < 0; addr = addr->ai_next) {
+    fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC,
+                addr->ai_protocol);
+    if (fd >= 0 && ::connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addrs);
+  if (fd < 0) {
+    *error = absl::StrCat("can't connect to ", host, ":", port);
+    return false;
+  }
+  set_receive_timeout(fd, handshake_timeout);
+  std::string hello;
+  append_struct(local_hello(*table_), &hello);
+  uint32_t accepted = 0;
+  if (!write_all(fd, message(hello_message, hello)) ||
+      !read_message(fd, welcome_message, &accepted)) {
+    close(fd);
+    *error = absl::StrCat("no answer from ", host, ":", port);
+    return false;
+  }
+  if (!accepted) {
+    close(fd);
+    *error = "turned away, by another build or size of table";
+    return false;
+  }
+  start({fd});
+  return true;
+}
+
+void ClusterNode::start(std::vector<int> fds) {
+  for (int fd : fds) {
+    set_receive_timeout(fd, std::chrono::microseconds(0));
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    peers_.emplace_back(new Peer{fd, "", "", true, SearchResult{}, true});
+  }
+  if (pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+    wake_fds_[0] = wake_fds_[1] = -1;
+  }
+  communicator_ = std::thread([this] { communicate(); });
+}
+
+void ClusterNode::queue_message(Peer* peer, uint32_t type,
+                                const std::string& payload) {
+  if (peer->connected_) {
+    peer->outbox_ += message(type, payload);
+  }
+}
+
+void ClusterNode::broadcast(uint32_t type, const std::string& payload) {
+  for (const std::unique_ptr<Peer>& peer : peers_) {
+    queue_message(peer.get(), type, payload);
+  }
+}
+
+void ClusterNode::wake() {
+  const char byte = 0;
+  if (wake_fds_[1] >= 0 && write(wake_fds_[1], &byte, 1) < 0) {
+    // The pipe is full, so the thread wakes anyway.
+  }
+}
+
+void ClusterNode::disconnect(Peer* peer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  peer->connected_ = false;
+  peer->outbox_.clear();
+  peer->is_final_ = true;
+  if (!is_coordinator_) {
+    stop_.store(true, std::memory_order_relaxed);
+  }
+  changed_.notify_all();
+}
+
+SearchResult ClusterNode::search(
+    ParallelSearcher* searcher, const Board& start,
+    const std::vector<Move>& moves, const SearchLimits& limits,
+    const Searcher::IterationCallback& on_iteration) {
+  Board board = start;
+  KeyHistory history;
+  history.reset(board);
+  for (Move move : moves) {
+    board.do_move(move);
+    history.push(board);
+  }
+  searcher->set_game_history(history);
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = ++search_id_;
+    std::string request;
+    append_struct(SearchRequest{id, limits.max_nodes_,
+                                static_cast<int32_t>(limits.max_depth_),
+                                static_cast<uint32_t>(moves.size()), start},
+                  &request);
+    append_moves(moves, &request);
+    for (const std::unique_ptr<Peer>& peer : peers_) {
+      peer->result_ = SearchResult{};
+      peer->is_final_ = !peer->connected_;
+      queue_message(peer.get(), search_message, request);
+    }
+  }
+  wake();
+  const Searcher::IterationCallback with_workers =
+      [this, &on_iteration](const SearchResult& res) {
+        set_searching(true);
+        if (!on_iteration) {
+          return;
+        }
+        SearchResult all = res;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          for (const std::unique_ptr<Peer>& peer : peers_) {
+            all.nodes_ += peer->result_.nodes_;
+            all.tablebase_hits_ += peer->result_.tablebase_hits_;
+          }
+        }
+        on_iteration(all);
+      };
+  const SearchResult own = searcher->search(
+      board, limits, with_workers);
+  std::vector<SearchResult> results = {own};
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::string stop;
+    append_struct(id, &stop);
+    broadcast(stop_message, stop);
+    wake();
+    changed_.wait_for(lock, stop_timeout, [this] {
+      return std::all_of(
+          peers_.begin(), peers_.end(),
+          [](const std::unique_ptr<Peer>& peer) { return peer->is_final_; });
+    });
+    for (const std::unique_ptr<Peer>& peer : peers_) {
+      results.push_back(peer->result_);
+    }
+  }
+  set_searching(false);
+  return vote(results);
+}
+
+void ClusterNode::serve(ParallelSearcher* searcher) {
+  for (;;) {
+    std::unique_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this] {
+        return job_ != nullptr || peers_.empty() || !peers_[0]->connected_;
+      });
+      if (!job_) {
+        return;
+      }
+      job = std::move(job_);
+      search_id_ = job->id_;
+      stop_.store(stopped_id_ >= job->id_, std::memory_order_relaxed);
+    }
+    Board board = job->start_;
+    KeyHistory history;
+    history.reset(board);
+    for (Move move : job->moves_) {
+      board.do_move(move);
+      history.push(board);
+    }
+    searcher->set_game_history(history);
+    const uint64_t id = job->id_;
+    const SearchLimits limits = {job->max_depth_, job->max_nodes_, &stop_,
+                                 nullptr};
+    const SearchResult res =
+        searcher->search(board, limits,
+                         [this, id](const SearchResult& iteration) {
+                           set_searching(true);
+                           report(id, iteration, false);
+                         });
+    set_searching(false);
+    report(id, res, true);
+  }
+}
+
+void ClusterNode::set_searching(bool searching) {
+  std::lock_guard<std::mutex> lock(table_mutex_);
+  searching_ = searching;
+}
+
+void ClusterNode::report(uint64_t id, const SearchResult& res,
+                         bool is_final) {
+  std::string payload;
+  append_struct(
+      SearchReport{id, res.nodes_, res.tablebase_hits_, res.score_,
+                   res.depth_, res.selective_depth_, is_final,
+                   static_cast<uint32_t>(res.pv_.size())},
+      &payload);
+  append_moves(res.pv_, &payload);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_message(peers_[0].get(), result_message, payload);
+  }
+  wake();
+}
+
+void ClusterNode::communicate() {
+  auto next_exchange =
+      std::chrono::steady_clock::now() + options_.exchange_interval_;
+  absl::optional<std::chrono::steady_clock::time_point> quit_deadline;
+  std::vector<pollfd> fds;
+  for (;;) {
+    fds.assign(1, {wake_fds_[0], POLLIN, 0});
+    bool is_idle = true;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const std::unique_ptr<Peer>& peer : peers_) {
+        const bool has_output = peer->connected_ && !peer->outbox_.empty();
+        is_idle = is_idle && !has_output;
+        fds.push_back({peer->connected_ ? peer->fd_ : -1,
+                       static_cast<short>(POLLIN | (has_output ? POLLOUT : 0)),
+                       0});
+      }
+      if (quitting_ && !quit_deadline) {
+        quit_deadline = std::chrono::steady_clock::now() + quit_timeout;
+      }
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (quit_deadline && (is_idle || now >= *quit_deadline)) {
+      return;
+    }
+    const auto wait = quit_deadline
+                          ? *quit_deadline - now
+                          : std::max(next_exchange - now,
+                                     std::chrono::steady_clock::duration(0));
+    poll(fds.data(), fds.size(),
+         static_cast<int>(
+             std::chrono::duration_cast<std::chrono::milliseconds>(wait)
+                 .count()));
+    if (fds[0].revents & POLLIN) {
+      char buf[64];
+      while (read(wake_fds_[0], buf, sizeof(buf)) > 0) {
+      }
+    }
+    for (size_t i = 0; i < peers_.size(); ++i) {
+      Peer* const peer = peers_[i].get();
+      const short revents = fds[i + 1].revents;
+      if ((revents & (POLLIN | POLLHUP | POLLERR)) && !receive(peer)) {
+        disconnect(peer);
+        continue;
+      }
+      if (revents & POLLOUT) {
+        bool is_broken = false;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          const ssize_t n = ::send(peer->fd_, peer->outbox_.data(),
+                                   peer->outbox_.size(), MSG_NOSIGNAL);
+          if (n > 0) {
+            peer->outbox_.erase(0, static_cast<size_t>(n));
+          }
+          is_broken = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                      errno != EINTR;
+        }
+        if (is_broken) {
+          disconnect(peer);
+        }
+      }
+    }
+    if (std::chrono::steady_clock::now() >= next_exchange) {
+      exchange_entries();
+      next_exchange =
+          std::chrono::steady_clock::now() + options_.exchange_interval_;
+    }
+  }
+}
+
+bool ClusterNode::receive(Peer* peer) {
+  char buf[1 << 16];
+  for (;;) {
+    const ssize_t n = ::recv(peer->fd_, buf, sizeof(buf), 0);
+    if (n > 0) {
+      peer->inbox_.append(buf, static_cast<size_t>(n));
+      continue;
+    }
+    if (n == 0 ||
+        (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      return false;
+    }
+    if (errno != EINTR) {
+      break;
+    }
+  }
+  size_t done = 0;
+  while (peer->inbox_.size() - done >= sizeof(MessageHeader)) {
+    MessageHeader header;
+    std::memcpy(&header, peer->inbox_.data() + done, sizeof(header));
+    if (header.size_ > max_message_size) {
+      return false;
+    }
+    if (peer->inbox_.size() - done < sizeof(header) + header.size_) {
+      break;
+    }
+    if (header.type_ == quit_message) {
+      return false;
+    }
+    handle(peer, header.type_, peer->inbox_.data() + done + sizeof(header),
+           header.size_);
+    done += sizeof(header) + header.size_;
+  }
+  peer->inbox_.erase(0, done);
+  return true;
+}
+
+void ClusterNode::handle(Peer* peer, uint32_t type, const char* data,
+                         size_t size) {
+  if (type == entries_message) {
+    merge_entries(data, size);
+    if (is_coordinator_) {
+      // The workers get each other's entries through the coordinator.
+      const std::string payload(data, size);
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const std::unique_ptr<Peer>& other : peers_) {
+        if (other.get() != peer &&
+            other->outbox_.size() < options_.max_pending_bytes_) {
+          queue_message(other.get(), entries_message, payload);
+        }
+      }
+    }
+    return;
+  }
+  if (is_coordinator_ && type == result_message &&
+      size >= sizeof(SearchReport)) {
+    SearchReport report;
+    std::memcpy(&report, data, sizeof(report));
+    if (size != sizeof(report) + report.pv_length_ * sizeof(Move)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (report.id_ != search_id_) {
+      return;
+    }
+    SearchResult& res = peer->result_;
+    res.pv_ = read_moves(data + sizeof(report), report.pv_length_);
+    res.best_move_ = res.pv_.empty() ? absl::nullopt
+                                     : absl::optional<Move>(res.pv_[0]);
+    res.score_ = report.score_;
+    res.depth_ = report.depth_;
+    res.nodes_ = report.nodes_;
+    res.selective_depth_ = report.selective_depth_;
+    res.tablebase_hits_ = report.tablebase_hits_;
+    res.lines_ = {{res.score_, res.pv_}};
+    peer->is_final_ = report.is_final_ != 0;
+    changed_.notify_all();
+    return;
+  }
+  if (!is_coordinator_ && type == search_message &&
+      size >= sizeof(SearchRequest)) {
+    SearchRequest request;
+    std::memcpy(&request, data, sizeof(request));
+    if (size != sizeof(request) + request.num_moves_ * sizeof(Move)) {
+      return;
+    }
+    std::unique_ptr<Job> job(new Job{
+        request.id_, request.start_,
+        read_moves(data + sizeof(request), request.num_moves_),
+        std::min(std::max(request.max_depth_, 1), max_search_ply - 1),
+        request.max_nodes_});
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = std::move(job);
+    changed_.notify_all();
+    return;
+  }
+  if (!is_coordinator_ && type == stop_message && size == sizeof(uint64_t)) {
+    uint64_t id;
+    std::memcpy(&id, data, sizeof(id));
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_id_ = std::max(stopped_id_, id);
+    if (id == search_id_) {
+      stop_.store(true, std::memory_order_relaxed);
+    }
+  }
+}
+
+void ClusterNode::exchange_entries() {
+  std::string payload;
+  size_t num_entries;
+  {
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    if (!searching_) {
+      return;
+    }
+    if (next_bucket_ >= table_->num_buckets()) {
+      next_bucket_ = 0;
+    }
+    std::vector<TtRawEntry> entries;
+    table_->collect_entries(next_bucket_, options_.buckets_per_exchange_,
+                            options_.min_depth_, &entries);
+    next_bucket_ += options_.buckets_per_exchange_;
+    if (entries.empty()) {
+      return;
+    }
+    num_entries = entries.size();
+    append_struct(EntriesHeader{table_->num_buckets()}, &payload);
+    payload.append(reinterpret_cast<const char*>(entries.data()),
+                   entries.size() * sizeof(TtRawEntry));
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::unique_ptr<Peer>& peer : peers_) {
+    if (peer->connected_ &&
+        peer->outbox_.size() < options_.max_pending_bytes_) {
+      queue_message(peer.get(), entries_message, payload);
+      num_entries_sent_.fetch_add(num_entries, std::memory_order_relaxed);
+    }
+  }
+}
+
+void ClusterNode::merge_entries(const char* data, size_t size) {
+  if (size < sizeof(EntriesHeader) ||
+      (size - sizeof(EntriesHeader)) % sizeof(TtRawEntry) != 0) {
+    return;
+  }
+  EntriesHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  std::lock_guard<std::mutex> lock(table_mutex_);
+  if (!searching_ || header.num_buckets_ != table_->num_buckets()) {
+    return;
+  }
+  const size_t num_entries =
+      (size - sizeof(EntriesHeader)) / sizeof(TtRawEntry);
+  for (size_t i = 0; i < num_entries; ++i) {
+    TtRawEntry entry;
+    std::memcpy(&entry,
+                data + sizeof(EntriesHeader) + i * sizeof(TtRawEntry),
+                sizeof(entry));
+    table_->merge_entry(entry);
+  }
+  num_entries_merged_.fetch_add(num_entries, std::memory_order_relaxed);
+}
+
+SearchResult ClusterNode::vote(const std::vector<SearchResult>& results) {
+  int min_score = infinite_score;
+  for (const SearchResult& res : results) {
+    if (res.best_move_) {
+      min_score = std::min(min_score, res.score_);
+    }
+  }
+  // The votes of each move, in the order the moves first got one, so that
+  // a tie goes to the coordinator's move.
+  std::vector<std::pair<Move, int64_t>> votes;
+  for (const SearchResult& res : results) {
+    if (!res.best_move_) {
+      continue;
+    }
+    const int64_t weight =
+        int64_t{res.score_ - min_score + 20} * std::max(res.depth_, 1);
+    auto it = std::find_if(votes.begin(), votes.end(),
+                           [&res](const std::pair<Move, int64_t>& vote) {
+                             return vote.first == *res.best_move_;
+                           });
+    if (it == votes.end()) {
+      votes.emplace_back(*res.best_move_, weight);
+    } else {
+      it->second += weight;
+    }
+  }
+  SearchResult best = results[0];
+  if (!votes.empty()) {
+    const Move winner =
+        std::max_element(votes.begin(), votes.end(),
+                         [](const std::pair<Move, int64_t>& a,
+                            const std::pair<Move, int64_t>& b) {
+                           return a.second < b.second;
+                         })
+            ->first;
+    int best_depth = -1;
+    for (const SearchResult& res : results) {
+      if (res.best_move_ == winner && res.depth_ > best_depth) {
+        best = res;
+        best_depth = res.depth_;
+      }
+    }
+  }
+  best.nodes_ = 0;
+  best.tablebase_hits_ = 0;
+  best.selective_depth_ = 0;
+  for (const SearchResult& res : results) {
+    best.nodes_ += res.nodes_;
+    best.tablebase_hits_ += res.tablebase_hits_;
+    best.selective_depth_ = std::max(best.selective_depth_,
+                                     res.selective_depth_);
+  }
+  return best;
+}
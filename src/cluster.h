@@ -0,0 +1,194 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "search.h"
+#include "transposition_table.h"
+
+// How the nodes of a cluster share their tables.
+struct ClusterOptions {
+  // Entries shallower than this aren't sent: the deep ones save the most
+  // work for what they cost to send, and there are few of them.
+  int min_depth_ = 8;
+  // How often each node sends what its table gained.
+  std::chrono::milliseconds exchange_interval_{100};
+  // The most buckets an exchange looks through, so that the thread sending
+  // the entries takes little from the search threads. The table is looked
+  // through a slice at a time, from where the last exchange left off.
+  size_t buckets_per_exchange_ = size_t{1} << 16;
+  // Entries aren't sent to a node that has this many bytes waiting to be
+  // sent to it already, so that a slow link drops entries rather than
+  // holding anything up.
+  size_t max_pending_bytes_ = size_t{16} << 20;
+};
+
+// A node of a cluster of machines that search one position together over
+// TCP: a coordinator, which takes the position and the limits and returns the
+// result, and workers that connect to it.
+//
+// Every node searches the whole position with its own threads, in the SMP
+// mode of its ParallelSearcher, and the nodes share their tables the way the
+// threads of a Lazy SMP search do, only in batches: every
+// `exchange_interval_`, each node sends the entries of the current search
+// at `min_depth_` or deeper from the next slice of its table, which the
+// coordinator passes on to the other workers. The nodes merge them into
+// their tables (see `TranspositionTable::merge_entry`), which needs every
+// table to have as many buckets, so the coordinator turns away workers with
+// tables of another size.
+//
+// The workers report their iterations to the coordinator. Once its own
+// search ends, the coordinator stops the workers and picks the root move by
+// vote: every node votes for its best move with the weight of its depth
+// times its score above the lowest score of the nodes, and the result is
+// that of the deepest node that voted for the winner. This keeps a node that
+// got lucky on one move from overruling the others.
+//
+// The sockets are only read and written by a communication thread of each
+// node, which also looks through the table for entries to send, so the
+// search threads never wait on the network. The messages hold the structs
+// they send as they are in memory, so the nodes must run the same build on
+// the same architecture, which the handshake checks as far as it can.
+class ClusterNode {
+ public:
+  // Neither `table` nor the searchers passed to `search` and `serve` are
+  // owned. The table must outlive the node and keep its size while it is
+  // connected.
+  ClusterNode(TranspositionTable* table, const ClusterOptions& options);
+  ClusterNode(const ClusterNode&) = delete;
+  ClusterNode& operator=(const ClusterNode&) = delete;
+  // A coordinator tells its workers to quit.
+  ~ClusterNode();
+
+  // For the coordinator: listens on `port`, or on a port the system picks if
+  // it is 0, and waits up to `timeout` for `num_workers` workers to connect.
+  // Returns false and sets `*error` if they don't.
+  bool coordinate(uint16_t port, size_t num_workers,
+                  std::chrono::milliseconds timeout, std::string* error);
+  // The port the coordinator listens on, once it does, from another thread
+  // than the one waiting in `coordinate`.
+  uint16_t port() const { return port_.load(std::memory_order_acquire); }
+  // For the workers: connects to the coordinator at `host` and `port`.
+  // Returns false and sets `*error` if it can't, or is turned away.
+  bool connect(const std::string& host, uint16_t port, std::string* error);
+
+  // For the coordinator: searches the position after `moves` from `start`
+  // with the workers, in the way `ParallelSearcher::search` does with
+  // `searcher`, and sets the searcher's game history to those positions.
+  // The workers stop when the coordinator's search does, and only the node
+  // limit applies to them, to each on its own. `on_iteration` is called
+  // with the coordinator's result and the nodes of all nodes so far.
+  SearchResult search(ParallelSearcher* searcher, const Board& start,
+                      const std::vector<Move>& moves,
+                      const SearchLimits& limits,
+                      const Searcher::IterationCallback& on_iteration =
+                          nullptr);
+  // For the workers: runs the searches of the coordinator with `searcher`
+  // until it quits or the connection drops.
+  void serve(ParallelSearcher* searcher);
+
+  size_t num_workers() const { return peers_.size(); }
+  // The entries sent and merged so far.
+  uint64_t num_entries_sent() const {
+    return num_entries_sent_.load(std::memory_order_relaxed);
+  }
+  uint64_t num_entries_merged() const {
+    return num_entries_merged_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // A connection to another node, which only the communication thread
+  // reads, and whose `outbox_` is guarded by `mutex_`.
+  struct Peer {
+    int fd_;
+    std::string inbox_;
+    std::string outbox_;
+    bool connected_;
+    // The last result the worker reported for the current search, and
+    // whether it was its final one.
+    SearchResult result_;
+    bool is_final_;
+  };
+  // A search the coordinator asked a worker for.
+  struct Job {
+    uint64_t id_;
+    Board start_;
+    std::vector<Move> moves_;
+    int max_depth_;
+    uint64_t max_nodes_;
+  };
+
+  // Sets up the connections, which are made, and starts the communication
+  // thread.
+  void start(std::vector<int> fds);
+  // Queues a message for `peer`, with `mutex_` held.
+  void queue_message(Peer* peer, uint32_t type, const std::string& payload);
+  // Queues a message for every connected peer, with `mutex_` held.
+  void broadcast(uint32_t type, const std::string& payload);
+  // Wakes the communication thread.
+  void wake();
+  // Marks `peer` as gone, and so a worker's search as stopped.
+  void disconnect(Peer* peer);
+  // Lets the communication thread use the table, or stops it. Set from the
+  // first iteration of a search on, once the search has started its
+  // generation of the table.
+  void set_searching(bool searching);
+  // Sends the worker's result of search `id` to the coordinator.
+  void report(uint64_t id, const SearchResult& res, bool is_final);
+  // The loop of the communication thread.
+  void communicate();
+  // Reads what `peer` sent and handles its whole messages. Returns false
+  // once the connection is closed.
+  bool receive(Peer* peer);
+  void handle(Peer* peer, uint32_t type, const char* data, size_t size);
+  // Sends the entries of the next slice of the table, during a search.
+  void exchange_entries();
+  // Merges the entries of `data`, if a search is running.
+  void merge_entries(const char* data, size_t size);
+  // Picks the root move of the nodes' results, see above.
+  static SearchResult vote(const std::vector<SearchResult>& results);
+
+  TranspositionTable* const table_;
+  const ClusterOptions options_;
+  bool is_coordinator_;
+  std::atomic<uint16_t> port_;
+  std::vector<std::unique_ptr<Peer>> peers_;
+  // Wakes the communication thread when there is something to send, or it
+  // is to quit.
+  int wake_fds_[2];
+  std::thread communicator_;
+
+  // Guards the peers' outboxes and results, the jobs and the flags below.
+  std::mutex mutex_;
+  // Signalled when a worker reports, gets a job, or the connection drops.
+  std::condition_variable changed_;
+  bool quitting_;
+  // For the coordinator, the current search; for a worker, the next job and
+  // the last search the coordinator stopped.
+  uint64_t search_id_;
+  std::unique_ptr<Job> job_;
+  uint64_t stopped_id_;
+  // Set when the worker's current search is to stop.
+  std::atomic<bool> stop_;
+
+  // Held by the communication thread while it uses the table, which it only
+  // does while `searching_` is set, and so never while the table starts a
+  // generation or changes size.
+  std::mutex table_mutex_;
+  bool searching_;
+  size_t next_bucket_;
+  std::atomic<uint64_t> num_entries_sent_;
+  std::atomic<uint64_t> num_entries_merged_;
+};
+
+#endif
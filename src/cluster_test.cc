@@ -0,0 +1,124 @@
+#include "cluster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "search.h"
+#include "transposition_table.h"
+
+namespace {
+constexpr std::chrono::seconds timeout{10};
+
+// Returns once `coordinator` listens, whose `coordinate` runs on another
+// thread.
+uint16_t wait_for_port(const ClusterNode& coordinator) {
+  while (coordinator.port() == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return coordinator.port();
+}
+
+bool is_legal_move(const Board& board, Move move) {
+  const MoveList moves = board.legal_moves();
+  return std::find(moves.begin(), moves.end(), move) != moves.end();
+}
+
+// Sends every entry as soon as it can, so that even short searches do.
+ClusterOptions eager_options() {
+  ClusterOptions options;
+  options.min_depth_ = 1;
+  options.exchange_interval_ = std::chrono::milliseconds(1);
+  return options;
+}
+}  // namespace.
+
+TEST(ClusterNode, SearchesWithWorkers) {
+  TranspositionTable coordinator_table(1);
+  TranspositionTable worker_table(1);
+  ParallelSearcher coordinator_searcher(nullptr, &coordinator_table);
+  ParallelSearcher worker_searcher(nullptr, &worker_table);
+  std::unique_ptr<ClusterNode> coordinator(
+      new ClusterNode(&coordinator_table, eager_options()));
+  ClusterNode worker(&worker_table, eager_options());
+  bool coordinating = false;
+  std::string coordinator_error;
+  std::thread accepting([&] {
+    coordinating = coordinator->coordinate(0, 1, timeout, &coordinator_error);
+  });
+  std::string error;
+  ASSERT_TRUE(worker.connect("localhost", wait_for_port(*coordinator),
+                             &error))
+      << error;
+  accepting.join();
+  ASSERT_TRUE(coordinating) << coordinator_error;
+  EXPECT_EQ(coordinator->num_workers(), 1);
+  std::thread serving([&] { worker.serve(&worker_searcher); });
+
+  // After 1. e4 e5, so that the workers replay the moves.
+  const Board start;
+  const std::vector<Move> moves = {
+      *parse_uci_move(start, "e2e4"),
+      *parse_uci_move(Board("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b "
+                            "KQkq - 0 1"),
+                      "e7e5")};
+  uint64_t iteration_nodes = 0;
+  const SearchLimits limits = {7, 0, nullptr, nullptr};
+  const SearchResult res = coordinator->search(
+      &coordinator_searcher, start, moves, limits,
+      [&](const SearchResult& iteration) {
+        iteration_nodes = iteration.nodes_;
+      });
+  ASSERT_TRUE(res.best_move_.has_value());
+  Board board = start;
+  for (Move move : moves) {
+    board.do_move(move);
+  }
+  EXPECT_TRUE(is_legal_move(board, *res.best_move_));
+  EXPECT_EQ(res.pv_[0], *res.best_move_);
+  EXPECT_GE(res.depth_, 7);
+  EXPECT_GT(iteration_nodes, 0);
+  // The nodes of both.
+  EXPECT_GT(res.nodes_, coordinator_searcher.search(board, limits).nodes_);
+  EXPECT_GT(coordinator->num_entries_sent() + worker.num_entries_sent(), 0);
+
+  // The worker serves until the coordinator quits.
+  coordinator.reset();
+  serving.join();
+}
+
+TEST(ClusterNode, TurnsAwayTablesOfAnotherSize) {
+  TranspositionTable coordinator_table(1);
+  TranspositionTable worker_table(2);
+  ClusterNode coordinator(&coordinator_table, ClusterOptions());
+  ClusterNode worker(&worker_table, ClusterOptions());
+  std::string coordinator_error;
+  std::thread accepting([&] {
+    EXPECT_FALSE(coordinator.coordinate(0, 1, std::chrono::milliseconds(500),
+                                        &coordinator_error));
+  });
+  std::string error;
+  EXPECT_FALSE(worker.connect("localhost", wait_for_port(coordinator),
+                              &error));
+  EXPECT_EQ(error, "turned away, by another build or size of table");
+  accepting.join();
+  EXPECT_EQ(coordinator_error, "0 of 1 workers connected, 1 turned away");
+}
+
+TEST(ClusterNode, SearchesAloneWithoutWorkers) {
+  TranspositionTable table(1);
+  ParallelSearcher searcher(nullptr, &table);
+  ClusterNode coordinator(&table, ClusterOptions());
+  std::string error;
+  ASSERT_TRUE(coordinator.coordinate(0, 0, timeout, &error)) << error;
+  const SearchLimits limits = {5, 0, nullptr, nullptr};
+  const SearchResult res = coordinator.search(&searcher, Board(), {}, limits);
+  ASSERT_TRUE(res.best_move_.has_value());
+  EXPECT_EQ(res.depth_, 5);
+}
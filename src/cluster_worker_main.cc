@@ -0,0 +1,94 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/strings/numbers.h"
+#include "cluster.h"
+#include "nnue.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// Usage: cluster_worker --host <host> --port <n> [--threads <n>]
+//                       [--hash <mb>] [--eval-file <path>]
+//
+// Connects to an engine coordinating a cluster (see cluster.h), which the
+// UCI options ClusterPort and ClusterWorkers set up, and searches its
+// positions until it quits. The table must have the size of the
+// coordinator's, 16 MB or --hash megabytes, which is what the coordinator's
+// Hash must be set to; the worker is turned away otherwise. It searches with
+// one thread or --threads, and with the classical evaluation or the network
+// of --eval-file, which should be the coordinator's.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " --host <host> --port <n> [--threads <n>] [--hash <mb>]"
+               " [--eval-file <path>]\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  std::string host;
+  uint16_t port = 0;
+  size_t num_threads = 1;
+  size_t hash_mb = 16;
+  std::string eval_file;
+  for (int arg_idx = 1; arg_idx + 1 < argc; arg_idx += 2) {
+    const char* const flag = argv[arg_idx];
+    const char* const value = argv[arg_idx + 1];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--host") == 0) {
+      host = value;
+      is_valid = !host.empty();
+    } else if (std::strcmp(flag, "--port") == 0) {
+      uint32_t parsed;
+      is_valid = absl::SimpleAtoi(value, &parsed) && parsed > 0 &&
+                 parsed <= 65535;
+      port = static_cast<uint16_t>(parsed);
+    } else if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &num_threads) && num_threads >= 1;
+    } else if (std::strcmp(flag, "--hash") == 0) {
+      is_valid = absl::SimpleAtoi(value, &hash_mb) && hash_mb >= 1;
+    } else if (std::strcmp(flag, "--eval-file") == 0) {
+      eval_file = value;
+      is_valid = true;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (argc % 2 == 0 || host.empty() || port == 0) {
+    return usage(argv[0]);
+  }
+
+  NetworkPtr network;
+  if (!eval_file.empty()) {
+    std::string error;
+    network = load_network(eval_file, &error);
+    if (!network) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+  }
+  TranspositionTable table(hash_mb);
+  std::unique_ptr<ThreadPool> pool(
+      num_threads > 1 ? new ThreadPool(num_threads - 1) : nullptr);
+  ParallelSearcher searcher(pool.get(), &table);
+  searcher.set_network(network.get());
+  ClusterNode node(&table, ClusterOptions());
+  std::string error;
+  if (!node.connect(host, port, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  std::cerr << "Connected to " << host << ":" << port << "\n";
+  node.serve(&searcher);
+  std::cerr << "Sent " << node.num_entries_sent() << " entries, merged "
+            << node.num_entries_merged() << "\n";
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "nnue.h"
+
+// Usage: convert_network [--rows] <network> <out>
+//
+// Writes a network file in the mapped format (see `save_mapped_network` in
+// nnue.h), which engines map and use in place rather than load, or with
+// --rows back in the format of `save_network`, which every build reads.
+// Prints how long loading the network took, before and after.
+
+namespace {
+// Loads `path`, or returns null after saying why.
+NetworkPtr load(const std::string& path, double* seconds) {
+  const auto start = std::chrono::steady_clock::now();
+  std::string error;
+  NetworkPtr res = load_network(path, &error);
+  *seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+  if (!res) {
+    std::cerr << error << '\n';
+  }
+  return res;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  const bool rows = argc == 4 && std::strcmp(argv[1], "--rows") == 0;
+  if (argc != 3 && !rows) {
+    std::cerr << "Usage: " << argv[0] << " [--rows] <network> <out>\n";
+    return 1;
+  }
+  const std::string in_path = argv[argc - 2];
+  const std::string out_path = argv[argc - 1];
+  double in_seconds;
+  const NetworkPtr network = load(in_path, &in_seconds);
+  if (!network) {
+    return 1;
+  }
+  if (!(rows ? save_network(*network, out_path)
+             : save_mapped_network(*network, out_path))) {
+    std::cerr << "Can't write " << out_path << '\n';
+    return 1;
+  }
+  double out_seconds;
+  if (!load(out_path, &out_seconds)) {
+    return 1;
+  }
+  std::cout << "Loaded " << in_path << " in " << in_seconds * 1000
+            << " ms and " << out_path << " in " << out_seconds * 1000
+            << " ms\n";
+  return 0;
+}
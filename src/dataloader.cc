@@ -0,0 +1,297 @@
+#include "dataloader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "bitboard.h"
+#include "board.h"
+#include "mapped_file.h"
+#include "nnue.h"
+#include "packed_position.h"
+#include "position_blocks.h"
+
+namespace {
+// The workers take the file a chunk of this many positions at a time, which
+// they read in order, so that the kernel can read ahead.
+constexpr size_t chunk_size = 1024;
+
+bool has_safe_capture(const Board& board, Color side) {
+  MoveList captures;
+  board.append_pseudolegal_captures(side, &captures);
+  const CheckInfo info = board.check_info();
+  for (Move move : captures) {
+    if (board.is_legal(move, info) && board.see_ge(move, 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace.
+
+size_t half_ka_feature(Color perspective, int king_idx, Color color,
+                       Piece piece, int sq_idx) {
+  // As in `nnue_feature`, black sees the board upside down, with its own
+  // pieces first.
+  const int flip = perspective == Color::white ? 0 : 56;
+  const size_t piece_idx =
+      (color == perspective ? 0 : 6) + static_cast<size_t>(piece);
+  return (static_cast<size_t>(king_idx ^ flip) * 12 + piece_idx) * 64 +
+         static_cast<size_t>(sq_idx ^ flip);
+}
+
+size_t num_features(FeatureSet feature_set) {
+  return feature_set == FeatureSet::half_kp ? nnue_num_features
+                                            : half_ka_num_features;
+}
+
+size_t max_active_features(FeatureSet feature_set) {
+  return feature_set == FeatureSet::half_kp ? 30 : 32;
+}
+
+size_t active_features(FeatureSet feature_set, const Board& board,
+                       Color perspective, int32_t* features) {
+  const int king_idx = square_idx(
+      board.pieces_[static_cast<size_t>(perspective)]
+                   [static_cast<size_t>(Piece::king)]);
+  const size_t num_pieces =
+      feature_set == FeatureSet::half_kp ? num_piece_types - 1
+                                         : num_piece_types;
+  size_t res = 0;
+  for (Color color : {Color::white, Color::black}) {
+    // The king is the last piece, so HalfKP just stops before it.
+    for (size_t piece = 0; piece < num_pieces; ++piece) {
+      for (Bitboard sq : bitboard_split(
+               board.pieces_[static_cast<size_t>(color)][piece])) {
+        const size_t feature =
+            feature_set == FeatureSet::half_kp
+                ? nnue_feature(perspective, king_idx, color,
+                               static_cast<Piece>(piece), square_idx(sq))
+                : half_ka_feature(perspective, king_idx, color,
+                                  static_cast<Piece>(piece), square_idx(sq));
+        features[res++] = static_cast<int32_t>(feature);
+      }
+    }
+  }
+  return res;
+}
+
+Dataloader::Dataloader(std::unique_ptr<MappedFile> file,
+                       std::unique_ptr<PositionBlockReader> blocks,
+                       const DataloaderOptions& options,
+                       std::vector<TrainingBatch*> buffers)
+    : file_(std::move(file)),
+      blocks_(std::move(blocks)),
+      options_(options),
+      buffers_(std::move(buffers)),
+      num_positions_(file_ ? file_->size() / sizeof(PackedPosition)
+                           : blocks_->num_positions()),
+      num_chunks_(file_ ? (num_positions_ + chunk_size - 1) / chunk_size
+                        : blocks_->num_blocks()),
+      first_chunk_(options.cyclic_ && num_chunks_ > 0
+                       ? std::mt19937_64(options.seed_)() % num_chunks_
+                       : 0),
+      next_chunk_(0),
+      num_accepted_(0),
+      num_running_(options.num_threads_),
+      is_stopping_(false) {
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    free_buffers_.push_back(static_cast<int>(i));
+  }
+  for (size_t i = 0; i < options_.num_threads_; ++i) {
+    threads_.emplace_back(&Dataloader::run, this, i);
+  }
+}
+
+Dataloader::~Dataloader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopping_.store(true, std::memory_order_relaxed);
+  }
+  free_cv_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+int Dataloader::next() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_cv_.wait(lock,
+                 [this] { return !ready_buffers_.empty() || !num_running_; });
+  if (ready_buffers_.empty()) {
+    return -1;
+  }
+  const int res = ready_buffers_.front();
+  ready_buffers_.pop_front();
+  return res;
+}
+
+void Dataloader::release(int buffer_idx) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_buffers_.push_back(buffer_idx);
+  }
+  free_cv_.notify_one();
+}
+
+int Dataloader::take_free_buffer() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  free_cv_.wait(lock, [this] {
+    return !free_buffers_.empty() ||
+           is_stopping_.load(std::memory_order_relaxed);
+  });
+  if (is_stopping_.load(std::memory_order_relaxed)) {
+    return -1;
+  }
+  const int res = free_buffers_.front();
+  free_buffers_.pop_front();
+  return res;
+}
+
+void Dataloader::finish_buffer(int buffer_idx) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (buffers_[static_cast<size_t>(buffer_idx)]->size_ > 0) {
+      ready_buffers_.push_back(buffer_idx);
+    } else {
+      free_buffers_.push_back(buffer_idx);
+    }
+  }
+  ready_cv_.notify_one();
+  free_cv_.notify_one();
+}
+
+void Dataloader::run(size_t thread_idx) {
+  // The positions of the current chunk start at `positions`: the file's, or
+  // those of the block decompressed to `block`.
+  const PackedPosition* positions = nullptr;
+  std::vector<PackedPosition> block;
+  const size_t stride = max_active_features(options_.feature_set_);
+  std::mt19937_64 rng(options_.seed_ + thread_idx + 1);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  // The positions of the current chunk still to be read.
+  size_t pos = 0;
+  size_t end = 0;
+  size_t num_accepted = 0;
+  int buffer_idx = -1;
+  while (true) {
+    if (buffer_idx < 0) {
+      buffer_idx = take_free_buffer();
+      if (buffer_idx < 0) {
+        break;
+      }
+      buffers_[static_cast<size_t>(buffer_idx)]->size_ = 0;
+    }
+    if (pos == end) {
+      if (is_stopping_.load(std::memory_order_relaxed)) {
+        break;
+      }
+      num_accepted_.fetch_add(num_accepted, std::memory_order_relaxed);
+      num_accepted = 0;
+      const size_t chunk_idx =
+          next_chunk_.fetch_add(1, std::memory_order_relaxed);
+      // Once every chunk has been handed out twice without a position
+      // getting through, none will.
+      const bool is_done =
+          options_.cyclic_
+              ? chunk_idx >= 2 * num_chunks_ &&
+                    num_accepted_.load(std::memory_order_relaxed) == 0
+              : chunk_idx >= num_chunks_;
+      if (is_done) {
+        finish_buffer(buffer_idx);
+        break;
+      }
+      const size_t chunk = (first_chunk_ + chunk_idx) % num_chunks_;
+      if (file_) {
+        positions = reinterpret_cast<const PackedPosition*>(file_->data());
+        pos = chunk * chunk_size;
+        end = std::min(pos + chunk_size, num_positions_);
+      } else {
+        // A block that doesn't decompress is skipped, empty.
+        blocks_->read_block(chunk, &block);
+        positions = block.data();
+        pos = 0;
+        end = block.size();
+      }
+      continue;
+    }
+
+    const PackedPosition& packed = positions[pos++];
+    if (std::abs(packed.score_) > options_.max_abs_score_ ||
+        (options_.skip_probability_ > 0.0 &&
+         uniform(rng) < options_.skip_probability_)) {
+      continue;
+    }
+    const Board board = unpack_position(packed);
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    if ((options_.skip_in_check_ && board.is_king_attacked(side)) ||
+        (options_.skip_captures_ && has_safe_capture(board, side))) {
+      continue;
+    }
+
+    TrainingBatch& batch = *buffers_[static_cast<size_t>(buffer_idx)];
+    const size_t idx = batch.size_++;
+    int32_t* const stm_features = batch.stm_features_ + idx * stride;
+    int32_t* const nstm_features = batch.nstm_features_ + idx * stride;
+    const size_t num_stm = active_features(options_.feature_set_, board, side,
+                                           stm_features);
+    std::fill(stm_features + num_stm, stm_features + stride, -1);
+    const size_t num_nstm = active_features(
+        options_.feature_set_, board, flip_color(side), nstm_features);
+    std::fill(nstm_features + num_nstm, nstm_features + stride, -1);
+    batch.scores_[idx] = packed.score_;
+    batch.results_[idx] = static_cast<int8_t>(
+        side == Color::white ? packed.result_ : -packed.result_);
+    ++num_accepted;
+
+    if (batch.size_ == options_.batch_size_) {
+      finish_buffer(buffer_idx);
+      buffer_idx = -1;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --num_running_;
+  }
+  ready_cv_.notify_all();
+}
+
+std::unique_ptr<Dataloader> open_dataloader(
+    const std::string& path, const DataloaderOptions& options,
+    std::vector<TrainingBatch*> buffers, std::string* error) {
+  if (buffers.size() < 2 || options.batch_size_ == 0 ||
+      options.num_threads_ == 0) {
+    *error = "the dataloader needs two buffers, a batch size and a thread";
+    return nullptr;
+  }
+  auto file = std::make_unique<MappedFile>(path);
+  if (!file->data()) {
+    *error = absl::StrCat("can't read ", path);
+    return nullptr;
+  }
+  if (is_position_block_file(file->data(), file->size())) {
+    std::unique_ptr<PositionBlockReader> blocks =
+        PositionBlockReader::open(std::move(file), error);
+    if (!blocks) {
+      *error = absl::StrCat(path, ": ", *error);
+      return nullptr;
+    }
+    return std::make_unique<Dataloader>(nullptr, std::move(blocks), options,
+                                        std::move(buffers));
+  }
+  if (file->size() % sizeof(PackedPosition) != 0) {
+    *error = absl::StrCat(path, " is not a file of packed positions");
+    return nullptr;
+  }
+  return std::make_unique<Dataloader>(std::move(file), nullptr, options,
+                                      std::move(buffers));
+}
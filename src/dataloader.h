@@ -0,0 +1,153 @@
+#ifndef DATALOADER_H
+#define DATALOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "mapped_file.h"
+#include "position_blocks.h"
+
+// Turns files of packed positions (see packed_position.h) into batches of
+// sparse NNUE training inputs, so that the trainer spends its time training
+// rather than decoding positions. The file is mapped, not read, and worker
+// threads decode positions, drop those that make poor training targets and
+// write the indices of the active features of the rest straight into batch
+// buffers the trainer allocated, page-locked for the GPU if it likes. There
+// are at least two buffers: while the trainer uses one, the workers fill the
+// others, and a buffer goes back to the workers when the trainer releases it.
+// Files of blocks of compressed positions (see position_blocks.h) are read a
+// block at a time, each worker decompressing the blocks it takes. See
+// dataloader_c.h for the same through a C interface.
+
+enum class FeatureSet {
+  // The features of nnue.h: own king square, piece and square, for every piece
+  // but the kings.
+  half_kp,
+  // The same with the kings among the pieces.
+  half_ka
+};
+
+constexpr size_t half_ka_num_features = 64 * 12 * 64;
+
+// Returns the HalfKA feature of a `piece` of `color` on the square with index
+// `sq_idx`, as seen from `perspective` with its king on `king_idx`. Oriented
+// as `nnue_feature` is, with the kings after the other pieces of their color.
+size_t half_ka_feature(Color perspective, int king_idx, Color color,
+                       Piece piece, int sq_idx);
+
+size_t num_features(FeatureSet feature_set);
+// The most features a legal position has active for one perspective.
+size_t max_active_features(FeatureSet feature_set);
+
+// Writes the features active in `board` for `perspective` to `features` and
+// returns their number, at most `max_active_features`.
+size_t active_features(FeatureSet feature_set, const Board& board,
+                       Color perspective, int32_t* features);
+
+struct DataloaderOptions {
+  FeatureSet feature_set_ = FeatureSet::half_kp;
+  size_t batch_size_ = 8192;
+  size_t num_threads_ = 2;
+  // Skips positions with the side to move in check.
+  bool skip_in_check_ = true;
+  // Skips positions where the side to move has a capture that doesn't lose
+  // material by the static exchange evaluation. Their score is that of the
+  // capture more than of the position.
+  bool skip_captures_ = true;
+  // Skips positions whose absolute score is larger.
+  int max_abs_score_ = 32767;
+  // Skips each position that passes the filters with this probability, so
+  // that the positions of one game spread over more batches.
+  double skip_probability_ = 0.0;
+  uint64_t seed_ = 1;
+  // Reads the file over and over, starting at a random position, rather than
+  // once from the start.
+  bool cyclic_ = true;
+};
+
+// A batch buffer, allocated by the trainer. The arrays have room for
+// `batch_size_` positions of `DataloaderOptions`.
+struct TrainingBatch {
+  // `max_active_features` per position, the features of the side to move,
+  // and of the other side, padded with -1.
+  int32_t* stm_features_;
+  int32_t* nstm_features_;
+  // From the side to move's point of view, the score and the result of the
+  // game, 1 for a win, 0 for a draw and -1 for a loss.
+  int16_t* scores_;
+  int8_t* results_;
+  // Set by the dataloader. The batch size, but for the last batch of each
+  // worker from a file that isn't cyclic.
+  size_t size_;
+};
+
+class Dataloader {
+ public:
+  // Starts filling `buffers`, of which there must be at least two, from
+  // `file`, which must hold whole packed positions, or from `blocks` if
+  // `file` is null.
+  Dataloader(std::unique_ptr<MappedFile> file,
+             std::unique_ptr<PositionBlockReader> blocks,
+             const DataloaderOptions& options,
+             std::vector<TrainingBatch*> buffers);
+  Dataloader(const Dataloader&) = delete;
+  Dataloader& operator=(const Dataloader&) = delete;
+  // Stops and joins the workers. Buffers the trainer holds can be reused.
+  ~Dataloader();
+
+  // Blocks until a buffer is full and returns its index in `buffers`. It is
+  // then the trainer's until `release`. Returns -1 once a file that isn't
+  // cyclic is done, or if the file has no position that passes the filters.
+  int next();
+  void release(int buffer_idx);
+
+  size_t num_positions() const { return num_positions_; }
+
+ private:
+  void run(size_t thread_idx);
+  // Returns the index of a free buffer, or -1 to stop.
+  int take_free_buffer();
+  // Hands `buffer_idx` to the trainer, or back to the workers if it is empty.
+  void finish_buffer(int buffer_idx);
+
+  const std::unique_ptr<MappedFile> file_;
+  const std::unique_ptr<PositionBlockReader> blocks_;
+  const DataloaderOptions options_;
+  const std::vector<TrainingBatch*> buffers_;
+  const size_t num_positions_;
+  // The blocks of `blocks_`, or runs of `chunk_size` positions of `file_`.
+  const size_t num_chunks_;
+  const size_t first_chunk_;
+  // The chunks handed out so far, which may count past `num_chunks_`.
+  std::atomic<size_t> next_chunk_;
+  std::atomic<size_t> num_accepted_;
+
+  // Guards the members below.
+  std::mutex mutex_;
+  std::condition_variable free_cv_;
+  std::condition_variable ready_cv_;
+  std::deque<int> free_buffers_;
+  std::deque<int> ready_buffers_;
+  size_t num_running_;
+  // Also read without the lock, between chunks.
+  std::atomic<bool> is_stopping_;
+
+  std::vector<std::thread> threads_;
+};
+
+// Maps `path`, a file of packed positions or of blocks of them, and returns a
+// dataloader filling `buffers` from it, or sets `*error` and returns null.
+std::unique_ptr<Dataloader> open_dataloader(
+    const std::string& path, const DataloaderOptions& options,
+    std::vector<TrainingBatch*> buffers, std::string* error);
+
+#endif
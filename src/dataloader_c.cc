@@ -0,0 +1,106 @@
+#include "dataloader_c.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dataloader.h"
+
+struct PawnGrabberDataloader {
+  PawnGrabberBatch* c_buffers_;
+  // The same arrays, which the dataloader fills.
+  std::vector<TrainingBatch> buffers_;
+  std::unique_ptr<Dataloader> dataloader_;
+};
+
+namespace {
+DataloaderOptions to_options(const PawnGrabberDataloaderOptions& options) {
+  DataloaderOptions res;
+  res.feature_set_ = options.feature_set == PAWN_GRABBER_HALF_KA
+                         ? FeatureSet::half_ka
+                         : FeatureSet::half_kp;
+  res.batch_size_ = options.batch_size;
+  res.num_threads_ = options.num_threads;
+  res.skip_in_check_ = options.skip_in_check != 0;
+  res.skip_captures_ = options.skip_captures != 0;
+  res.max_abs_score_ = options.max_abs_score;
+  res.skip_probability_ = options.skip_probability;
+  res.seed_ = options.seed;
+  res.cyclic_ = options.cyclic != 0;
+  return res;
+}
+
+FeatureSet to_feature_set(int feature_set) {
+  return feature_set == PAWN_GRABBER_HALF_KA ? FeatureSet::half_ka
+                                             : FeatureSet::half_kp;
+}
+}  // namespace.
+
+void pawn_grabber_default_dataloader_options(
+    PawnGrabberDataloaderOptions* options) {
+  const DataloaderOptions defaults;
+  options->feature_set = defaults.feature_set_ == FeatureSet::half_ka
+                             ? PAWN_GRABBER_HALF_KA
+                             : PAWN_GRABBER_HALF_KP;
+  options->batch_size = defaults.batch_size_;
+  options->num_threads = defaults.num_threads_;
+  options->skip_in_check = defaults.skip_in_check_;
+  options->skip_captures = defaults.skip_captures_;
+  options->max_abs_score = defaults.max_abs_score_;
+  options->skip_probability = defaults.skip_probability_;
+  options->seed = defaults.seed_;
+  options->cyclic = defaults.cyclic_;
+}
+
+size_t pawn_grabber_num_features(int feature_set) {
+  return num_features(to_feature_set(feature_set));
+}
+
+size_t pawn_grabber_max_active_features(int feature_set) {
+  return max_active_features(to_feature_set(feature_set));
+}
+
+PawnGrabberDataloader* pawn_grabber_open_dataloader(
+    const char* path, const PawnGrabberDataloaderOptions* options,
+    PawnGrabberBatch* buffers, size_t num_buffers, char* error,
+    size_t error_size) {
+  auto res = std::make_unique<PawnGrabberDataloader>();
+  res->c_buffers_ = buffers;
+  for (size_t i = 0; i < num_buffers; ++i) {
+    res->buffers_.push_back({buffers[i].stm_features, buffers[i].nstm_features,
+                             buffers[i].scores, buffers[i].results, 0});
+  }
+  std::vector<TrainingBatch*> buffer_ptrs;
+  for (TrainingBatch& buffer : res->buffers_) {
+    buffer_ptrs.push_back(&buffer);
+  }
+  std::string error_str;
+  res->dataloader_ = open_dataloader(path, to_options(*options),
+                                     std::move(buffer_ptrs), &error_str);
+  if (!res->dataloader_) {
+    std::snprintf(error, error_size, "%s", error_str.c_str());
+    return nullptr;
+  }
+  return res.release();
+}
+
+int pawn_grabber_next_batch(PawnGrabberDataloader* dataloader) {
+  const int res = dataloader->dataloader_->next();
+  if (res >= 0) {
+    const size_t idx = static_cast<size_t>(res);
+    dataloader->c_buffers_[idx].size = dataloader->buffers_[idx].size_;
+  }
+  return res;
+}
+
+void pawn_grabber_release_batch(PawnGrabberDataloader* dataloader,
+                                int buffer_idx) {
+  dataloader->dataloader_->release(buffer_idx);
+}
+
+void pawn_grabber_close_dataloader(PawnGrabberDataloader* dataloader) {
+  delete dataloader;
+}
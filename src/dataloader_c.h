@@ -0,0 +1,64 @@
+#ifndef DATALOADER_C_H
+#define DATALOADER_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The dataloader of dataloader.h through a C interface, for trainers that
+// load the pawn_grabber_dataloader shared library, e.g. with Python's ctypes.
+// The batches are written straight into the buffers the trainer passes in,
+// nothing is copied out of the library.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PawnGrabberDataloader PawnGrabberDataloader;
+
+enum { PAWN_GRABBER_HALF_KP = 0, PAWN_GRABBER_HALF_KA = 1 };
+
+// The fields of `DataloaderOptions`, with ints for the bools.
+typedef struct {
+  int feature_set;
+  size_t batch_size;
+  size_t num_threads;
+  int skip_in_check;
+  int skip_captures;
+  int max_abs_score;
+  double skip_probability;
+  uint64_t seed;
+  int cyclic;
+} PawnGrabberDataloaderOptions;
+
+// The fields of `TrainingBatch`.
+typedef struct {
+  int32_t* stm_features;
+  int32_t* nstm_features;
+  int16_t* scores;
+  int8_t* results;
+  size_t size;
+} PawnGrabberBatch;
+
+void pawn_grabber_default_dataloader_options(
+    PawnGrabberDataloaderOptions* options);
+size_t pawn_grabber_num_features(int feature_set);
+size_t pawn_grabber_max_active_features(int feature_set);
+
+// Returns a dataloader filling `buffers`, which must stay valid until it is
+// closed, or writes the error to `error` and returns null. `error` has room
+// for `error_size` bytes.
+PawnGrabberDataloader* pawn_grabber_open_dataloader(
+    const char* path, const PawnGrabberDataloaderOptions* options,
+    PawnGrabberBatch* buffers, size_t num_buffers, char* error,
+    size_t error_size);
+// As `Dataloader::next` and `Dataloader::release`.
+int pawn_grabber_next_batch(PawnGrabberDataloader* dataloader);
+void pawn_grabber_release_batch(PawnGrabberDataloader* dataloader,
+                                int buffer_idx);
+void pawn_grabber_close_dataloader(PawnGrabberDataloader* dataloader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
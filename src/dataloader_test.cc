@@ -0,0 +1,366 @@
+#include "dataloader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "dataloader_c.h"
+#include "gtest/gtest.h"
+#include "nnue.h"
+#include "packed_position.h"
+#include "perft.h"
+#include "position_blocks.h"
+
+namespace {
+// Writes the positions of random games from the perft suite to `path`, with
+// the index of each position as its score, and returns their boards.
+std::vector<Board> write_positions(const std::string& path,
+                                   size_t num_positions) {
+  std::mt19937 rng(7);
+  std::vector<Board> res;
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  while (res.size() < num_positions) {
+    Board board(perft_suite[res.size() % perft_suite.size()].fen_);
+    for (int ply = 0; ply < 100 && res.size() < num_positions; ++ply) {
+      const PackedPosition packed = pack_position(
+          board, static_cast<int>(res.size()), board.is_whites_move_ ? 1 : -1);
+      out.write(reinterpret_cast<const char*>(&packed), sizeof(packed));
+      res.push_back(board);
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[rng() % moves.size()]);
+    }
+  }
+  return res;
+}
+
+// Batch buffers for `options`.
+struct TestBuffers {
+  std::vector<std::vector<int32_t>> stm_features_;
+  std::vector<std::vector<int32_t>> nstm_features_;
+  std::vector<std::vector<int16_t>> scores_;
+  std::vector<std::vector<int8_t>> results_;
+  std::vector<TrainingBatch> batches_;
+
+  TestBuffers(const DataloaderOptions& options, size_t num_buffers) {
+    const size_t num_features =
+        options.batch_size_ * max_active_features(options.feature_set_);
+    for (size_t i = 0; i < num_buffers; ++i) {
+      stm_features_.emplace_back(num_features);
+      nstm_features_.emplace_back(num_features);
+      scores_.emplace_back(options.batch_size_);
+      results_.emplace_back(options.batch_size_);
+    }
+    for (size_t i = 0; i < num_buffers; ++i) {
+      batches_.push_back({stm_features_[i].data(), nstm_features_[i].data(),
+                          scores_[i].data(), results_[i].data(), 0});
+    }
+  }
+
+  std::vector<TrainingBatch*> pointers() {
+    std::vector<TrainingBatch*> res;
+    for (TrainingBatch& batch : batches_) {
+      res.push_back(&batch);
+    }
+    return res;
+  }
+};
+
+// Checks position `idx` of `batch` against `board`.
+void expect_position(const TrainingBatch& batch, size_t idx,
+                     FeatureSet feature_set, const Board& board) {
+  const size_t stride = max_active_features(feature_set);
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  std::vector<int32_t> expected(stride, -1);
+  active_features(feature_set, board, side, expected.data());
+  EXPECT_EQ(std::vector<int32_t>(batch.stm_features_ + idx * stride,
+                                 batch.stm_features_ + (idx + 1) * stride),
+            expected);
+  std::fill(expected.begin(), expected.end(), -1);
+  active_features(feature_set, board, flip_color(side), expected.data());
+  EXPECT_EQ(std::vector<int32_t>(batch.nstm_features_ + idx * stride,
+                                 batch.nstm_features_ + (idx + 1) * stride),
+            expected);
+  // Every position was written as a win for its side to move.
+  EXPECT_EQ(batch.results_[idx], 1);
+}
+
+// Returns the scores, which are the indices of the positions, of every batch
+// `dataloader` gives until it is done.
+std::vector<int> drain(Dataloader* dataloader,
+                       const std::vector<TrainingBatch>& batches) {
+  std::vector<int> res;
+  for (int buffer_idx = dataloader->next(); buffer_idx >= 0;
+       buffer_idx = dataloader->next()) {
+    const TrainingBatch& batch = batches[static_cast<size_t>(buffer_idx)];
+    res.insert(res.end(), batch.scores_, batch.scores_ + batch.size_);
+    dataloader->release(buffer_idx);
+  }
+  std::sort(res.begin(), res.end());
+  return res;
+}
+}  // namespace.
+
+TEST(ActiveFeatures, CountsThePiecesOfBothSides) {
+  const Board board;
+  for (FeatureSet feature_set : {FeatureSet::half_kp, FeatureSet::half_ka}) {
+    for (Color perspective : {Color::white, Color::black}) {
+      std::vector<int32_t> features(max_active_features(feature_set));
+      ASSERT_EQ(active_features(feature_set, board, perspective,
+                                features.data()),
+                features.size());
+      std::sort(features.begin(), features.end());
+      EXPECT_EQ(std::unique(features.begin(), features.end()),
+                features.end());
+      EXPECT_GE(features.front(), 0);
+      EXPECT_LT(static_cast<size_t>(features.back()),
+                num_features(feature_set));
+    }
+  }
+  // The start position is symmetric, so both sides see the same.
+  std::vector<int32_t> white(32);
+  std::vector<int32_t> black(32);
+  active_features(FeatureSet::half_ka, board, Color::white, white.data());
+  active_features(FeatureSet::half_ka, board, Color::black, black.data());
+  std::sort(white.begin(), white.end());
+  std::sort(black.begin(), black.end());
+  EXPECT_EQ(white, black);
+}
+
+TEST(ActiveFeatures, HalfKpIsTheFeatureSetOfTheNetwork) {
+  const Board board("4k3/8/8/3q4/8/8/2P5/4K3 w - - 0 1");
+  std::vector<int32_t> features(30);
+  ASSERT_EQ(active_features(FeatureSet::half_kp, board, Color::black,
+                            features.data()),
+            2);
+  EXPECT_EQ(features[0],
+            static_cast<int32_t>(nnue_feature(
+                Color::black, 59, Color::white, Piece::pawn, 13)));
+  EXPECT_EQ(features[1],
+            static_cast<int32_t>(nnue_feature(
+                Color::black, 59, Color::black, Piece::queen, 36)));
+  EXPECT_EQ(half_ka_feature(Color::white, 3, Color::white, Piece::king, 3),
+            half_ka_feature(Color::black, 59, Color::black, Piece::king, 59));
+}
+
+TEST(Dataloader, ReadsEveryPositionOnceInOrder) {
+  const std::string path = testing::TempDir() + "dataloader_test.bin";
+  const std::vector<Board> boards = write_positions(path, 2500);
+  for (FeatureSet feature_set : {FeatureSet::half_kp, FeatureSet::half_ka}) {
+    DataloaderOptions options;
+    options.feature_set_ = feature_set;
+    options.batch_size_ = 300;
+    options.num_threads_ = 1;
+    options.skip_in_check_ = false;
+    options.skip_captures_ = false;
+    options.cyclic_ = false;
+    TestBuffers buffers(options, 2);
+    std::string error;
+    const auto dataloader =
+        open_dataloader(path, options, buffers.pointers(), &error);
+    ASSERT_NE(dataloader, nullptr) << error;
+    EXPECT_EQ(dataloader->num_positions(), boards.size());
+    size_t num_read = 0;
+    for (int buffer_idx = dataloader->next(); buffer_idx >= 0;
+         buffer_idx = dataloader->next()) {
+      const TrainingBatch& batch =
+          buffers.batches_[static_cast<size_t>(buffer_idx)];
+      EXPECT_EQ(batch.size_, std::min<size_t>(300, boards.size() - num_read));
+      for (size_t i = 0; i < batch.size_; ++i) {
+        ASSERT_EQ(batch.scores_[i], num_read);
+        expect_position(batch, i, feature_set, boards[num_read]);
+        ++num_read;
+      }
+      dataloader->release(buffer_idx);
+    }
+    EXPECT_EQ(num_read, boards.size());
+  }
+}
+
+TEST(Dataloader, FiltersWithManyThreads) {
+  const std::string path = testing::TempDir() + "dataloader_test.bin";
+  const std::vector<Board> boards = write_positions(path, 5000);
+  DataloaderOptions options;
+  options.batch_size_ = 128;
+  options.num_threads_ = 4;
+  options.max_abs_score_ = 4000;
+  options.cyclic_ = false;
+  std::vector<int> expected;
+  for (size_t i = 0; i <= 4000; ++i) {
+    const Board& board = boards[i];
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    bool has_safe_capture = false;
+    MoveList captures;
+    board.append_pseudolegal_captures(side, &captures);
+    for (Move move : captures) {
+      has_safe_capture |=
+          board.is_pseudolegal_move_legal(move) && board.see_ge(move, 0);
+    }
+    if (!board.is_king_attacked(side) && !has_safe_capture) {
+      expected.push_back(static_cast<int>(i));
+    }
+  }
+  ASSERT_GT(expected.size(), 100);
+  ASSERT_LT(expected.size(), 4000);
+
+  TestBuffers buffers(options, 3);
+  std::string error;
+  const auto dataloader =
+      open_dataloader(path, options, buffers.pointers(), &error);
+  ASSERT_NE(dataloader, nullptr) << error;
+  EXPECT_EQ(drain(dataloader.get(), buffers.batches_), expected);
+}
+
+TEST(Dataloader, ReadsBlockFiles) {
+  const std::string plain_path = testing::TempDir() + "dataloader_test.bin";
+  const std::vector<Board> boards = write_positions(plain_path, 2000);
+  std::vector<PackedPosition> positions(boards.size());
+  std::ifstream(plain_path, std::ios::binary)
+      .read(reinterpret_cast<char*>(positions.data()),
+            static_cast<std::streamsize>(positions.size() *
+                                         sizeof(PackedPosition)));
+  const std::string path = testing::TempDir() + "dataloader_test.blocks";
+  PositionBlockOptions block_options;
+  block_options.positions_per_block_ = 300;
+  PositionBlockWriter writer(path, block_options);
+  writer.write(positions.data(), positions.size());
+  ASSERT_TRUE(writer.close());
+
+  DataloaderOptions options;
+  options.batch_size_ = 128;
+  options.num_threads_ = 3;
+  options.skip_in_check_ = false;
+  options.skip_captures_ = false;
+  options.cyclic_ = false;
+  TestBuffers buffers(options, 3);
+  std::string error;
+  const auto dataloader =
+      open_dataloader(path, options, buffers.pointers(), &error);
+  ASSERT_NE(dataloader, nullptr) << error;
+  EXPECT_EQ(dataloader->num_positions(), boards.size());
+  const std::vector<int> scores = drain(dataloader.get(), buffers.batches_);
+  ASSERT_EQ(scores.size(), boards.size());
+  for (size_t i = 0; i < scores.size(); ++i) {
+    ASSERT_EQ(scores[i], static_cast<int>(i));
+  }
+}
+
+TEST(Dataloader, SamplesAndCycles) {
+  const std::string path = testing::TempDir() + "dataloader_test.bin";
+  const std::vector<Board> boards = write_positions(path, 3000);
+  DataloaderOptions options;
+  options.batch_size_ = 1000;
+  options.skip_in_check_ = false;
+  options.skip_captures_ = false;
+  options.skip_probability_ = 0.5;
+  TestBuffers buffers(options, 2);
+  std::string error;
+  auto dataloader = open_dataloader(path, options, buffers.pointers(), &error);
+  ASSERT_NE(dataloader, nullptr) << error;
+  // With half skipped, that is about two laps over the file.
+  std::vector<int> scores;
+  for (int i = 0; i < 3; ++i) {
+    const int buffer_idx = dataloader->next();
+    ASSERT_GE(buffer_idx, 0);
+    const TrainingBatch& batch =
+        buffers.batches_[static_cast<size_t>(buffer_idx)];
+    ASSERT_EQ(batch.size_, 1000);
+    scores.insert(scores.end(), batch.scores_, batch.scores_ + batch.size_);
+    dataloader->release(buffer_idx);
+  }
+  dataloader.reset();
+  std::sort(scores.begin(), scores.end());
+  // About a quarter of the positions is read neither time, and about a
+  // quarter both times.
+  const size_t num_distinct = static_cast<size_t>(
+      std::unique(scores.begin(), scores.end()) - scores.begin());
+  EXPECT_GT(num_distinct, 2000);
+  EXPECT_LT(num_distinct, 2500);
+}
+
+TEST(Dataloader, EndsWhenNothingPasses) {
+  const std::string path = testing::TempDir() + "dataloader_test.bin";
+  write_positions(path, 1500);
+  DataloaderOptions options;
+  options.max_abs_score_ = -1;
+  TestBuffers buffers(options, 2);
+  std::string error;
+  const auto dataloader =
+      open_dataloader(path, options, buffers.pointers(), &error);
+  ASSERT_NE(dataloader, nullptr) << error;
+  EXPECT_EQ(dataloader->next(), -1);
+}
+
+TEST(Dataloader, RejectsBadFiles) {
+  DataloaderOptions options;
+  TestBuffers buffers(options, 2);
+  std::string error;
+  EXPECT_EQ(open_dataloader(testing::TempDir() + "no_such_file.bin", options,
+                            buffers.pointers(), &error),
+            nullptr);
+  EXPECT_NE(error.find("can't read"), std::string::npos);
+
+  const std::string path = testing::TempDir() + "dataloader_test.bin";
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "not positions";
+  EXPECT_EQ(open_dataloader(path, options, buffers.pointers(), &error),
+            nullptr);
+  EXPECT_NE(error.find("not a file of packed positions"), std::string::npos);
+}
+
+TEST(DataloaderC, FillsTheBuffersOfTheCaller) {
+  const std::string path = testing::TempDir() + "dataloader_test.bin";
+  const std::vector<Board> boards = write_positions(path, 700);
+  PawnGrabberDataloaderOptions options;
+  pawn_grabber_default_dataloader_options(&options);
+  EXPECT_EQ(options.batch_size, DataloaderOptions().batch_size_);
+  options.feature_set = PAWN_GRABBER_HALF_KA;
+  options.batch_size = 256;
+  options.num_threads = 1;
+  options.skip_in_check = 0;
+  options.skip_captures = 0;
+  options.cyclic = 0;
+  EXPECT_EQ(pawn_grabber_max_active_features(PAWN_GRABBER_HALF_KA), 32);
+  EXPECT_EQ(pawn_grabber_num_features(PAWN_GRABBER_HALF_KP),
+            nnue_num_features);
+
+  std::vector<int32_t> features(2 * 2 * 256 * 32);
+  std::vector<int16_t> scores(2 * 256);
+  std::vector<int8_t> results(2 * 256);
+  PawnGrabberBatch batches[2];
+  for (size_t i = 0; i < 2; ++i) {
+    batches[i] = {features.data() + 2 * i * 256 * 32,
+                  features.data() + (2 * i + 1) * 256 * 32,
+                  scores.data() + i * 256, results.data() + i * 256, 0};
+  }
+  char error[100];
+  PawnGrabberDataloader* const dataloader = pawn_grabber_open_dataloader(
+      path.c_str(), &options, batches, 2, error, sizeof(error));
+  ASSERT_NE(dataloader, nullptr) << error;
+  size_t num_read = 0;
+  for (int buffer_idx = pawn_grabber_next_batch(dataloader); buffer_idx >= 0;
+       buffer_idx = pawn_grabber_next_batch(dataloader)) {
+    const PawnGrabberBatch& batch = batches[buffer_idx];
+    const TrainingBatch as_cc = {batch.stm_features, batch.nstm_features,
+                                 batch.scores, batch.results, batch.size};
+    for (size_t i = 0; i < batch.size; ++i) {
+      ASSERT_EQ(batch.scores[i], num_read);
+      expect_position(as_cc, i, FeatureSet::half_ka, boards[num_read]);
+      ++num_read;
+    }
+    pawn_grabber_release_batch(dataloader, buffer_idx);
+  }
+  EXPECT_EQ(num_read, boards.size());
+  pawn_grabber_close_dataloader(dataloader);
+
+  EXPECT_EQ(pawn_grabber_open_dataloader("", &options, batches, 2, error,
+                                         sizeof(error)),
+            nullptr);
+  EXPECT_STREQ(error, "can't read ");
+}
@@ -0,0 +1,30 @@
+#ifndef DEBUG_CHECK_H
+#define DEBUG_CHECK_H
+
+#include "absl/base/internal/raw_logging.h"
+
+// How much the move generator checks itself is picked at compile time with
+// PAWN_GRABBER_CHECK_LEVEL:
+//
+//   0: Only input such as FEN strings is validated. This is the default and
+//      what the perft tool is built with.
+//   1: DEBUG_CHECK assertions on arguments and internal state are enabled.
+//   2: As 1, and the whole board is validated after every move that is made
+//      or taken back.
+//
+// The CMake build has targets for each level, see CMakeLists.txt.
+#ifndef PAWN_GRABBER_CHECK_LEVEL
+#define PAWN_GRABBER_CHECK_LEVEL 0
+#endif
+
+// Same as ABSL_RAW_CHECK when PAWN_GRABBER_CHECK_LEVEL is at least 1. Below
+// that `condition` is still compiled, so it can't go stale, but it is never
+// evaluated and the check costs nothing.
+#if PAWN_GRABBER_CHECK_LEVEL >= 1
+#define DEBUG_CHECK(condition, message) ABSL_RAW_CHECK(condition, message)
+#else
+#define DEBUG_CHECK(condition, message) \
+  static_cast<void>(sizeof(static_cast<bool>(condition)))
+#endif
+
+#endif
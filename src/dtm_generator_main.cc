@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "dtm_tablebase.h"
+#include "endgame.h"
+#include "thread_pool.h"
+
+// Usage: dtm_generator [--threads <n>] [--dir <directory>] <material>...
+//
+// Generates the distance to mate table of each <material>, such as KRPvKR
+// (see dtm_tablebase.h), into the file <material>.dtm of --dir, the current
+// directory by default, on --threads threads, one per hardware thread by
+// default. The tables that captures and promotions lead to are read from the
+// directory, or generated and written there first.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--threads <n>] [--dir <directory>] <material>...\n";
+  return 1;
+}
+
+// Adds the table of `material` to `*tablebase`, from its file in `dir` or
+// else generated along with those it needs. Returns false and writes what
+// went wrong to stderr if it can't.
+bool add_table(const std::string& material, const std::string& dir,
+               ThreadPool* pool, DtmTablebase* tablebase) {
+  if (tablebase->find(material_key_of(material))) {
+    return true;
+  }
+  const std::string path = absl::StrCat(dir, "/", material, ".dtm");
+  std::string error;
+  std::unique_ptr<DtmTable> table = DtmTable::load(path, &error);
+  if (table) {
+    tablebase->add(std::move(table));
+    return true;
+  }
+  for (const std::string& dependency : dtm_material_dependencies(material)) {
+    if (!add_table(dependency, dir, pool, tablebase)) {
+      return false;
+    }
+  }
+  const auto start = std::chrono::steady_clock::now();
+  table = DtmTable::generate(material, *tablebase, pool, &error);
+  if (!table) {
+    std::cerr << error << '\n';
+    return false;
+  }
+  if (!table->save(path)) {
+    std::cerr << "Can't write " << path << '\n';
+    return false;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << material << ": " << table->file_size() << " bytes, "
+            << elapsed.count() << " s\n";
+  tablebase->add(std::move(table));
+  return true;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  int arg_idx = 1;
+  size_t num_threads = 0;
+  std::string dir = ".";
+  for (; arg_idx < argc && std::strncmp(argv[arg_idx], "--", 2) == 0;
+       ++arg_idx) {
+    if (std::strcmp(argv[arg_idx], "--threads") == 0 && arg_idx + 1 < argc &&
+        absl::SimpleAtoi(argv[arg_idx + 1], &num_threads)) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--dir") == 0 &&
+               arg_idx + 1 < argc) {
+      dir = argv[++arg_idx];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (arg_idx == argc) {
+    return usage(argv[0]);
+  }
+  ThreadPool pool(num_threads);
+  DtmTablebase tablebase;
+  for (; arg_idx < argc; ++arg_idx) {
+    std::string error;
+    const absl::optional<std::string> material =
+        parse_dtm_material(argv[arg_idx], &error);
+    if (!material) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+    if (!add_table(*material, dir, &pool, &tablebase)) {
+      return 1;
+    }
+  }
+  return 0;
+}
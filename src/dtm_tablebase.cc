@@ -0,0 +1,890 @@
+#include "dtm_tablebase.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "debug_check.h"
+#include "endgame.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+struct DtmLayout {
+  std::string material_;
+  uint64_t material_key_;
+  uint64_t flipped_material_key_;
+  int num_pieces_;
+  // In index order: the white king, the black king, then the other pieces of
+  // white and those of black, identical pieces next to each other.
+  std::array<Color, max_dtm_pieces> colors_;
+  std::array<Piece, max_dtm_pieces> pieces_;
+  bool has_pawns_;
+  // The number of indices.
+  size_t size_;
+};
+
+namespace {
+// The value of a position in the table: 0 for a draw, or a position not
+// settled yet while generating, else the plies to mate plus 1. The side to
+// move wins if those plies are odd and loses if they are even.
+constexpr uint16_t unknown_code = 0;
+// An index without a position of its own.
+constexpr uint16_t invalid_code = 0xFFFF;
+
+uint16_t code_of_plies(int plies) { return static_cast<uint16_t>(plies + 1); }
+
+DtmResult result_of_code(uint16_t code) {
+  if (code == unknown_code || code == invalid_code) {
+    return {Wdl::draw, 0};
+  }
+  const int plies = code - 1;
+  return {plies % 2 ? Wdl::win : Wdl::loss, plies};
+}
+
+// The file starts with a header, then has the offset of each block's runs
+// from the start of the file, and one more for the end of the last block.
+constexpr uint32_t dtm_file_magic = 0x4D544450;  // "PDTM".
+constexpr uint32_t dtm_file_version = 1;
+constexpr size_t block_size = 1024;
+
+struct FileHeader {
+  uint32_t magic_;
+  uint32_t version_;
+  // Null padded.
+  std::array<char, 16> material_;
+  uint64_t num_positions_;
+};
+
+static_assert(sizeof(FileHeader) == 32, "FileHeader layout changed.");
+
+struct Run {
+  uint16_t code_;
+  uint16_t length_;
+};
+
+static_assert(sizeof(Run) == 4, "Run layout changed.");
+
+size_t num_blocks(size_t num_positions) {
+  return (num_positions + block_size - 1) / block_size;
+}
+
+// Pieces in the order of the material strings.
+constexpr absl::string_view piece_chars = "KQRBNP";
+constexpr std::array<Piece, 6> pieces_by_char = {
+    {Piece::king, Piece::queen, Piece::rook, Piece::bishop, Piece::knight,
+     Piece::pawn}};
+
+Piece piece_of_char(char c) { return pieces_by_char[piece_chars.find(c)]; }
+
+bool is_before(char lhs, char rhs) {
+  return piece_chars.find(lhs) < piece_chars.find(rhs);
+}
+
+// Returns true if the pieces of `lhs` go before those of `rhs` in a
+// material: more pieces, or as many worth more, or the first in the order
+// KQRBNP.
+bool is_stronger(const std::string& lhs, const std::string& rhs) {
+  if (lhs.size() != rhs.size()) {
+    return lhs.size() > rhs.size();
+  }
+  int lhs_value = 0;
+  int rhs_value = 0;
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    lhs_value += see_value(piece_of_char(lhs[i]));
+    rhs_value += see_value(piece_of_char(rhs[i]));
+  }
+  if (lhs_value != rhs_value) {
+    return lhs_value > rhs_value;
+  }
+  return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(),
+                                      rhs.end(), &is_before);
+}
+
+std::array<std::string, num_colors> split_material(
+    absl::string_view material) {
+  const size_t split = material.find('v');
+  return {{std::string(material.substr(0, split)),
+           std::string(material.substr(split + 1))}};
+}
+
+std::unique_ptr<DtmLayout> make_layout(absl::string_view material,
+                                       std::string* error) {
+  const absl::optional<std::string> parsed =
+      parse_dtm_material(material, error);
+  if (!parsed) {
+    return nullptr;
+  }
+  std::unique_ptr<DtmLayout> res(new DtmLayout);
+  res->material_ = *parsed;
+  const std::array<std::string, num_colors> sides =
+      split_material(res->material_);
+  res->material_key_ = material_key_of(res->material_);
+  res->flipped_material_key_ =
+      material_key_of(absl::StrCat(sides[1], "v", sides[0]));
+  res->colors_[0] = Color::white;
+  res->pieces_[0] = Piece::king;
+  res->colors_[1] = Color::black;
+  res->pieces_[1] = Piece::king;
+  res->num_pieces_ = 2;
+  res->has_pawns_ = false;
+  for (Color color : {Color::white, Color::black}) {
+    const std::string& side = sides[static_cast<size_t>(color)];
+    for (size_t i = 1; i < side.size(); ++i) {
+      const size_t piece_idx = static_cast<size_t>(res->num_pieces_++);
+      res->colors_[piece_idx] = color;
+      res->pieces_[piece_idx] = piece_of_char(side[i]);
+      res->has_pawns_ |= side[i] == 'P';
+    }
+  }
+  res->size_ = (res->has_pawns_ ? 32 : 10) * 2;
+  for (int i = 1; i < res->num_pieces_; ++i) {
+    res->size_ *= 64;
+  }
+  return res;
+}
+
+// The squares of the pieces of a position, in the order of its layout.
+typedef std::array<int, max_dtm_pieces> Squares;
+
+int file_of(int idx) { return 7 - idx % 8; }
+int rank_of(int idx) { return idx / 8; }
+int transpose(int idx) { return file_of(idx) * 8 + 7 - rank_of(idx); }
+
+// The squares of the triangle a1-d1-d4, where the white king of a table
+// without pawns is, and the place of each square of the board in it.
+constexpr std::array<int, 10> triangle_squares = {
+    {7, 6, 5, 4, 14, 13, 12, 21, 20, 28}};
+
+constexpr std::array<int, 64> make_triangle_codes() {
+  std::array<int, 64> res = {};
+  for (size_t i = 0; i < res.size(); ++i) {
+    res[i] = -1;
+  }
+  for (size_t i = 0; i < triangle_squares.size(); ++i) {
+    res[static_cast<size_t>(triangle_squares[i])] = static_cast<int>(i);
+  }
+  return res;
+}
+
+constexpr std::array<int, 64> triangle_codes = make_triangle_codes();
+
+bool is_same_piece(const DtmLayout& layout, int lhs, int rhs) {
+  return layout.colors_[static_cast<size_t>(lhs)] ==
+             layout.colors_[static_cast<size_t>(rhs)] &&
+         layout.pieces_[static_cast<size_t>(lhs)] ==
+             layout.pieces_[static_cast<size_t>(rhs)];
+}
+
+// Mirrors `*squares` so that the white king is where the index has it, and
+// sorts the squares of identical pieces.
+void canonicalize(const DtmLayout& layout, Squares* squares) {
+  const int king = (*squares)[0];
+  const int mirror = (file_of(king) >= 4 ? 7 : 0) |
+                     (!layout.has_pawns_ && rank_of(king) >= 4 ? 56 : 0);
+  const bool is_transposed = !layout.has_pawns_ &&
+                             rank_of(king ^ mirror) > file_of(king ^ mirror);
+  for (int i = 0; i < layout.num_pieces_; ++i) {
+    int& sq = (*squares)[static_cast<size_t>(i)];
+    sq ^= mirror;
+    if (is_transposed) {
+      sq = transpose(sq);
+    }
+  }
+  // The kings are unique, so a run of identical pieces starts at 2 or later.
+  for (int i = 3; i < layout.num_pieces_; ++i) {
+    for (int j = i; j > 2 && is_same_piece(layout, j - 1, j) &&
+                    (*squares)[static_cast<size_t>(j - 1)] >
+                        (*squares)[static_cast<size_t>(j)];
+         --j) {
+      std::swap((*squares)[static_cast<size_t>(j - 1)],
+                (*squares)[static_cast<size_t>(j)]);
+    }
+  }
+}
+
+// Returns the index of the position, whose squares must be canonical.
+size_t index_of_squares(const DtmLayout& layout, const Squares& squares,
+                        bool white_to_move) {
+  const int king = squares[0];
+  size_t res = static_cast<size_t>(
+      layout.has_pawns_ ? rank_of(king) * 4 + file_of(king)
+                        : triangle_codes[static_cast<size_t>(king)]);
+  for (int i = 1; i < layout.num_pieces_; ++i) {
+    res = res * 64 + static_cast<size_t>(squares[static_cast<size_t>(i)]);
+  }
+  return res * 2 + (white_to_move ? 0 : 1);
+}
+
+// The inverse of `index_of_squares`, without checking anything.
+Squares squares_of_index(const DtmLayout& layout, size_t idx,
+                         bool* white_to_move) {
+  Squares res = {};
+  *white_to_move = idx % 2 == 0;
+  idx /= 2;
+  for (int i = layout.num_pieces_ - 1; i > 0; --i) {
+    res[static_cast<size_t>(i)] = static_cast<int>(idx % 64);
+    idx /= 64;
+  }
+  const int king = static_cast<int>(idx);
+  res[0] = layout.has_pawns_ ? king / 4 * 8 + 7 - king % 4
+                             : triangle_squares[static_cast<size_t>(king)];
+  return res;
+}
+
+// Returns the squares of the pieces of `board`, which are those of the
+// layout with the colors swapped if `flip`, in which case the board is also
+// mirrored from top to bottom.
+Squares squares_of_board(const DtmLayout& layout, const Board& board,
+                         bool flip) {
+  Squares res = {};
+  Bitboard left = 0;
+  for (int i = 0; i < layout.num_pieces_; ++i) {
+    const size_t piece_idx = static_cast<size_t>(i);
+    // Identical pieces take the squares of one bitboard in turn.
+    if (i == 0 || !is_same_piece(layout, i - 1, i)) {
+      const Color color = layout.colors_[piece_idx];
+      left = board.pieces(flip ? flip_color(color) : color,
+                          layout.pieces_[piece_idx]);
+    }
+    DEBUG_CHECK(left, "The board doesn't have the material of the table.");
+    res[piece_idx] = square_idx(left) ^ (flip ? 56 : 0);
+    left &= left - 1;
+  }
+  return res;
+}
+
+size_t index_of_board(const DtmLayout& layout, const Board& board, bool flip) {
+  Squares squares = squares_of_board(layout, board, flip);
+  canonicalize(layout, &squares);
+  return index_of_squares(layout, squares, board.is_whites_move_ != flip);
+}
+
+Board board_of_squares(const DtmLayout& layout, const Squares& squares,
+                       bool white_to_move) {
+  Board res;
+  res.zero_all_bitboards();
+  for (int i = 0; i < layout.num_pieces_; ++i) {
+    const size_t piece_idx = static_cast<size_t>(i);
+    *res.piece_bitboard(layout.colors_[piece_idx], layout.pieces_[piece_idx]) |=
+        lsb_bitboard << squares[piece_idx];
+  }
+  res.init_mailbox();
+  res.init_occupancy();
+  res.en_passant_square_ = 0;
+  res.castling_rights_ = no_castling;
+  res.fifty_move_clock_ = 0;
+  res.num_moves_ = 1;
+  res.is_whites_move_ = white_to_move;
+  res.init_state();
+  return res;
+}
+
+// Puts the images of `squares` under the mirrorings the index undoes in
+// `*images`, the identity first, and returns how many there are.
+int mirror_images(const DtmLayout& layout, const Squares& squares,
+                  std::array<Squares, 8>* images) {
+  int res = 0;
+  for (int mirror : {0, 7, 56, 63}) {
+    for (bool is_transposed : {false, true}) {
+      if (layout.has_pawns_ && (mirror & 56 || is_transposed)) {
+        continue;
+      }
+      Squares& image = (*images)[static_cast<size_t>(res++)];
+      for (int i = 0; i < layout.num_pieces_; ++i) {
+        const size_t piece_idx = static_cast<size_t>(i);
+        image[piece_idx] = squares[piece_idx] ^ mirror;
+        if (is_transposed) {
+          image[piece_idx] = transpose(image[piece_idx]);
+        }
+      }
+    }
+  }
+  return res;
+}
+
+// Calls `f(squares, white_to_move)` with each position from which the side
+// not to move in the position of `squares` reaches it with a quiet move,
+// whether or not that position is legal.
+template <typename F>
+void for_each_unmove(const DtmLayout& layout, const Squares& squares,
+                     bool white_to_move, F&& f) {
+  Bitboard occupancy = 0;
+  for (int i = 0; i < layout.num_pieces_; ++i) {
+    occupancy |= lsb_bitboard << squares[static_cast<size_t>(i)];
+  }
+  const Color mover = white_to_move ? Color::black : Color::white;
+  for (int i = 0; i < layout.num_pieces_; ++i) {
+    const size_t piece_idx = static_cast<size_t>(i);
+    if (layout.colors_[piece_idx] != mover) {
+      continue;
+    }
+    const int dst = squares[piece_idx];
+    const size_t dst_idx = static_cast<size_t>(dst);
+    Bitboard srcs = 0;
+    switch (layout.pieces_[piece_idx]) {
+      case Piece::king:
+        srcs = king_attacks[dst_idx];
+        break;
+      case Piece::knight:
+        srcs = knight_attacks[dst_idx];
+        break;
+      case Piece::bishop:
+        srcs = bishop_attacks(dst, occupancy);
+        break;
+      case Piece::rook:
+        srcs = rook_attacks(dst, occupancy);
+        break;
+      case Piece::queen:
+        srcs = queen_attacks(dst, occupancy);
+        break;
+      case Piece::pawn: {
+        // Pawns only come back from their second rank on.
+        const int forward = mover == Color::white ? 8 : -8;
+        const int relative_rank =
+            mover == Color::white ? rank_of(dst) : 7 - rank_of(dst);
+        if (relative_rank >= 2) {
+          srcs = lsb_bitboard << (dst - forward);
+          if (relative_rank == 3 && !(occupancy & srcs)) {
+            srcs |= lsb_bitboard << (dst - 2 * forward);
+          }
+        }
+        break;
+      }
+      case Piece::none:
+        break;
+    }
+    for (Bitboard src : bitboard_split(srcs & ~occupancy)) {
+      Squares res = squares;
+      res[piece_idx] = square_idx(src);
+      f(res, !white_to_move);
+    }
+  }
+}
+
+// Settles the positions of one table, see dtm_tablebase.h.
+class Generator {
+ public:
+  Generator(const DtmLayout& layout, const DtmTablebase& tablebase,
+            ThreadPool* pool)
+      : layout_(layout),
+        tablebase_(tablebase),
+        pool_(pool),
+        codes_(new std::atomic<uint16_t>[layout.size_]),
+        num_settled_(0) {}
+
+  void run();
+  // Returns the table file of the settled positions.
+  std::string image() const;
+
+ private:
+  // Positions to look at at a later ply, with that ply.
+  typedef std::vector<std::pair<int, uint32_t>> Deferred;
+
+  uint16_t code(size_t idx) const {
+    return codes_[idx].load(std::memory_order_relaxed);
+  }
+  // Sets `*board` to the position at `idx`, or returns false if it has no
+  // position of its own.
+  bool decode(size_t idx, Board* board) const;
+  // Runs `f(first, last, deferred)` on ranges of indices that cover the
+  // table, on the pool, and adds what they defer to `deferred_`.
+  template <typename F>
+  void for_each_range(F f);
+  // Sets the codes of [first, last), settles the checkmates, and defers the
+  // positions whose captures and promotions settle them.
+  void init(size_t first, size_t last, Deferred* deferred);
+  // Unmoves the positions of [first, last) settled at the ply before `ply`.
+  void unmove(int ply, size_t first, size_t last, Deferred* deferred);
+  // Returns the plies to mate of the position at `idx`, not settled yet, if
+  // all its moves lead to positions the other side is known to win, else 0.
+  int loss_plies(size_t idx) const;
+  // Settles the position at `idx` at `ply`, unless it already is.
+  void settle(size_t idx, int ply);
+
+  const DtmLayout& layout_;
+  const DtmTablebase& tablebase_;
+  ThreadPool* const pool_;
+  std::unique_ptr<std::atomic<uint16_t>[]> codes_;
+  // The positions deferred to each ply.
+  std::vector<std::vector<uint32_t>> deferred_;
+  // The positions settled at the current ply.
+  std::atomic<size_t> num_settled_;
+};
+
+bool Generator::decode(size_t idx, Board* board) const {
+  bool white_to_move = false;
+  const Squares squares = squares_of_index(layout_, idx, &white_to_move);
+  Bitboard occupancy = 0;
+  for (int i = 0; i < layout_.num_pieces_; ++i) {
+    const size_t piece_idx = static_cast<size_t>(i);
+    const int sq = squares[piece_idx];
+    if (occupancy & (lsb_bitboard << sq) ||
+        (layout_.pieces_[piece_idx] == Piece::pawn &&
+         (rank_of(sq) == 0 || rank_of(sq) == 7)) ||
+        (i > 2 && is_same_piece(layout_, i - 1, i) &&
+         squares[piece_idx - 1] > sq)) {
+      return false;
+    }
+    occupancy |= lsb_bitboard << sq;
+  }
+  *board = board_of_squares(layout_, squares, white_to_move);
+  // The side not to move can't be in check, which also keeps the kings apart.
+  return !board->is_king_attacked(white_to_move ? Color::black : Color::white);
+}
+
+template <typename F>
+void Generator::for_each_range(F f) {
+  constexpr size_t range_size = 1 << 16;
+  const size_t num_ranges = (layout_.size_ + range_size - 1) / range_size;
+  std::vector<Deferred> deferred(num_ranges);
+  for (size_t range = 0; range < num_ranges; ++range) {
+    pool_->submit([this, &f, &deferred, range] {
+      const size_t first = range * range_size;
+      f(first, std::min(layout_.size_, first + range_size), &deferred[range]);
+    });
+  }
+  pool_->wait();
+  for (const Deferred& range_deferred : deferred) {
+    for (const std::pair<int, uint32_t>& entry : range_deferred) {
+      const size_t ply = static_cast<size_t>(entry.first);
+      if (ply >= deferred_.size()) {
+        deferred_.resize(ply + 1);
+      }
+      deferred_[ply].push_back(entry.second);
+    }
+  }
+}
+
+void Generator::init(size_t first, size_t last, Deferred* deferred) {
+  Board board;
+  for (size_t idx = first; idx < last; ++idx) {
+    if (!decode(idx, &board)) {
+      codes_[idx].store(invalid_code, std::memory_order_relaxed);
+      continue;
+    }
+    codes_[idx].store(unknown_code, std::memory_order_relaxed);
+    const MoveList moves = board.legal_moves();
+    if (moves.empty()) {
+      if (board.is_king_attacked(board.is_whites_move_ ? Color::white
+                                                       : Color::black)) {
+        codes_[idx].store(code_of_plies(0), std::memory_order_relaxed);
+        ++num_settled_;
+      }
+      continue;
+    }
+    int win_plies = 0;
+    int loss_plies = 0;
+    bool is_lost = true;
+    for (Move move : moves) {
+      Board child(board);
+      child.do_move(move);
+      if (child.material_key_ == board.material_key_) {
+        is_lost = false;
+        continue;
+      }
+      // `generate` checked that the tables are there.
+      const DtmResult result = *tablebase_.probe(child);
+      if (result.wdl_ == Wdl::loss) {
+        win_plies = win_plies ? std::min(win_plies, result.plies_ + 1)
+                              : result.plies_ + 1;
+      } else if (result.wdl_ == Wdl::win) {
+        loss_plies = std::max(loss_plies, result.plies_ + 1);
+      } else {
+        is_lost = false;
+      }
+    }
+    if (win_plies) {
+      deferred->emplace_back(win_plies, static_cast<uint32_t>(idx));
+    } else if (is_lost) {
+      deferred->emplace_back(loss_plies, static_cast<uint32_t>(idx));
+    }
+  }
+}
+
+void Generator::unmove(int ply, size_t first, size_t last,
+                       Deferred* deferred) {
+  std::array<Squares, 8> images;
+  for (size_t idx = first; idx < last; ++idx) {
+    if (code(idx) != code_of_plies(ply - 1)) {
+      continue;
+    }
+    bool white_to_move = false;
+    const Squares squares = squares_of_index(layout_, idx, &white_to_move);
+    // A move may reach a mirror image of the position rather than the
+    // position itself.
+    const int num_images = mirror_images(layout_, squares, &images);
+    for (int image = 0; image < num_images; ++image) {
+      for_each_unmove(
+          layout_, images[static_cast<size_t>(image)], white_to_move,
+          [&](Squares parent, bool parent_white_to_move) {
+            canonicalize(layout_, &parent);
+            const size_t parent_idx =
+                index_of_squares(layout_, parent, parent_white_to_move);
+            // Illegal parents are invalid, so they are skipped too.
+            if (code(parent_idx) != unknown_code) {
+              return;
+            }
+            if (ply % 2) {
+              settle(parent_idx, ply);
+              return;
+            }
+            const int plies = loss_plies(parent_idx);
+            if (plies == ply) {
+              settle(parent_idx, ply);
+            } else if (plies > ply) {
+              // A capture or promotion holds out longer.
+              deferred->emplace_back(plies, static_cast<uint32_t>(parent_idx));
+            }
+          });
+    }
+  }
+}
+
+int Generator::loss_plies(size_t idx) const {
+  Board board;
+  decode(idx, &board);
+  const MoveList moves = board.legal_moves();
+  if (moves.empty()) {
+    return 0;
+  }
+  int res = 0;
+  // The moves that stay in the table first, as they are the ones that may
+  // not be settled yet.
+  for (bool is_exit_pass : {false, true}) {
+    for (Move move : moves) {
+      Board child(board);
+      child.do_move(move);
+      const bool is_exit = child.material_key_ != board.material_key_;
+      if (is_exit != is_exit_pass) {
+        continue;
+      }
+      const DtmResult result =
+          is_exit ? *tablebase_.probe(child)
+                  : result_of_code(code(index_of_board(layout_, child, false)));
+      if (result.wdl_ != Wdl::win) {
+        return 0;
+      }
+      res = std::max(res, result.plies_ + 1);
+    }
+  }
+  return res;
+}
+
+void Generator::settle(size_t idx, int ply) {
+  uint16_t expected = unknown_code;
+  if (codes_[idx].compare_exchange_strong(expected, code_of_plies(ply),
+                                          std::memory_order_relaxed)) {
+    ++num_settled_;
+  }
+}
+
+void Generator::run() {
+  for_each_range([this](size_t first, size_t last, Deferred* deferred) {
+    init(first, last, deferred);
+  });
+  // The checkmates are settled at ply 0.
+  size_t num_settled = num_settled_;
+  for (int ply = 1;
+       num_settled > 0 || static_cast<size_t>(ply) < deferred_.size(); ++ply) {
+    ABSL_RAW_CHECK(code_of_plies(ply) < invalid_code, "Mate too long.");
+    num_settled_ = 0;
+    if (static_cast<size_t>(ply) < deferred_.size()) {
+      for (uint32_t idx : deferred_[static_cast<size_t>(ply)]) {
+        // Wins are deferred to odd plies, losses to even ones.
+        if (code(idx) == unknown_code &&
+            (ply % 2 || loss_plies(idx) == ply)) {
+          settle(idx, ply);
+        }
+      }
+      deferred_[static_cast<size_t>(ply)].clear();
+    }
+    for_each_range([this, ply](size_t first, size_t last, Deferred* deferred) {
+      unmove(ply, first, last, deferred);
+    });
+    num_settled = num_settled_;
+  }
+}
+
+std::string Generator::image() const {
+  FileHeader header = {dtm_file_magic, dtm_file_version, {}, layout_.size_};
+  std::copy(layout_.material_.begin(), layout_.material_.end(),
+            header.material_.begin());
+  const size_t blocks = num_blocks(layout_.size_);
+  std::vector<uint64_t> offsets(blocks + 1);
+  const size_t runs_start = sizeof(header) + offsets.size() * sizeof(uint64_t);
+  std::vector<Run> runs;
+  for (size_t block = 0; block < blocks; ++block) {
+    offsets[block] = runs_start + runs.size() * sizeof(Run);
+    const size_t first = block * block_size;
+    const size_t last = std::min(layout_.size_, first + block_size);
+    // The block starts with the value of its first position, so that the
+    // indices without one before it join its run.
+    Run run = {unknown_code, 0};
+    for (size_t idx = first; idx < last; ++idx) {
+      if (code(idx) != invalid_code) {
+        run.code_ = code(idx);
+        break;
+      }
+    }
+    for (size_t idx = first; idx < last; ++idx) {
+      const uint16_t idx_code = code(idx);
+      if (idx_code == invalid_code || idx_code == run.code_) {
+        ++run.length_;
+      } else {
+        runs.push_back(run);
+        run = {idx_code, 1};
+      }
+    }
+    runs.push_back(run);
+  }
+  offsets[blocks] = runs_start + runs.size() * sizeof(Run);
+  std::string res(offsets[blocks], '\0');
+  std::memcpy(&res[0], &header, sizeof(header));
+  std::memcpy(&res[sizeof(header)], offsets.data(),
+              offsets.size() * sizeof(uint64_t));
+  std::memcpy(&res[runs_start], runs.data(), runs.size() * sizeof(Run));
+  return res;
+}
+}  // namespace.
+
+bool operator==(const DtmResult& lhs, const DtmResult& rhs) {
+  return lhs.wdl_ == rhs.wdl_ && lhs.plies_ == rhs.plies_;
+}
+
+absl::optional<std::string> parse_dtm_material(absl::string_view material,
+                                               std::string* error) {
+  const size_t split = material.find('v');
+  if (split == absl::string_view::npos) {
+    *error = absl::StrCat("bad material ", material);
+    return absl::nullopt;
+  }
+  std::array<std::string, num_colors> sides = split_material(material);
+  size_t num_pieces = 0;
+  for (std::string& side : sides) {
+    if (side.empty() || side[0] != 'K' ||
+        side.find_first_not_of("QRBNP", 1) != std::string::npos) {
+      *error = absl::StrCat("bad material ", material);
+      return absl::nullopt;
+    }
+    std::sort(side.begin() + 1, side.end(), &is_before);
+    num_pieces += side.size();
+  }
+  if (num_pieces < 3 || num_pieces > max_dtm_pieces) {
+    *error = absl::StrCat(material, " doesn't have 3 to ", max_dtm_pieces,
+                          " pieces");
+    return absl::nullopt;
+  }
+  if (is_stronger(sides[1], sides[0])) {
+    std::swap(sides[0], sides[1]);
+  }
+  return absl::StrCat(sides[0], "v", sides[1]);
+}
+
+std::vector<std::string> dtm_material_dependencies(
+    absl::string_view material) {
+  std::vector<std::string> res;
+  const std::array<std::string, num_colors> sides = split_material(material);
+  const auto add = [&res](const std::string& white, const std::string& black) {
+    if (white.size() + black.size() == 2) {
+      return;
+    }
+    std::string error;
+    const std::string dependency =
+        *parse_dtm_material(absl::StrCat(white, "v", black), &error);
+    if (std::find(res.begin(), res.end(), dependency) == res.end()) {
+      res.push_back(dependency);
+    }
+  };
+  for (size_t side = 0; side < num_colors; ++side) {
+    const std::string& own = sides[side];
+    // The other side as it is, and after each capture.
+    std::vector<std::string> others = {sides[1 - side]};
+    for (size_t i = 1; i < sides[1 - side].size(); ++i) {
+      others.push_back(sides[1 - side]);
+      others.back().erase(i, 1);
+    }
+    const auto add_sides = [&](const std::string& moved,
+                               const std::string& other) {
+      side == 0 ? add(moved, other) : add(other, moved);
+    };
+    for (size_t i = 1; i < others.size(); ++i) {
+      add_sides(own, others[i]);
+    }
+    for (size_t i = 1; i < own.size(); ++i) {
+      if (own[i] != 'P') {
+        continue;
+      }
+      for (char promotion : {'Q', 'R', 'B', 'N'}) {
+        std::string promoted = own;
+        promoted[i] = promotion;
+        for (const std::string& other : others) {
+          add_sides(promoted, other);
+        }
+      }
+    }
+  }
+  return res;
+}
+
+DtmTable::DtmTable(std::unique_ptr<const DtmLayout> layout)
+    : layout_(std::move(layout)), data_(nullptr), file_size_(0) {}
+
+DtmTable::~DtmTable() {}
+
+std::unique_ptr<DtmTable> DtmTable::generate(absl::string_view material,
+                                             const DtmTablebase& tablebase,
+                                             ThreadPool* pool,
+                                             std::string* error) {
+  std::unique_ptr<DtmLayout> layout = make_layout(material, error);
+  if (!layout) {
+    return nullptr;
+  }
+  for (const std::string& dependency :
+       dtm_material_dependencies(layout->material_)) {
+    if (!tablebase.find(material_key_of(dependency))) {
+      *error = absl::StrCat(layout->material_, " needs the table of ",
+                            dependency);
+      return nullptr;
+    }
+  }
+  std::string image;
+  {
+    Generator generator(*layout, tablebase, pool);
+    generator.run();
+    image = generator.image();
+  }
+  std::unique_ptr<DtmTable> res(new DtmTable(std::move(layout)));
+  res->image_ = std::move(image);
+  res->data_ = res->image_.data();
+  res->file_size_ = res->image_.size();
+  return res;
+}
+
+std::unique_ptr<DtmTable> DtmTable::load(const std::string& path,
+                                         std::string* error) {
+  std::unique_ptr<MappedFile> file(
+      new MappedFile(path, MemoryTag::tablebases));
+  if (!file->data()) {
+    *error = absl::StrCat("can't read ", path);
+    return nullptr;
+  }
+  FileHeader header;
+  if (file->size() < sizeof(header)) {
+    *error = absl::StrCat(path, " is not a DTM table");
+    return nullptr;
+  }
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (header.magic_ != dtm_file_magic || header.version_ != dtm_file_version) {
+    *error = absl::StrCat(path, " is not a DTM table");
+    return nullptr;
+  }
+  const std::string material(
+      header.material_.data(),
+      std::find(header.material_.begin(), header.material_.end(), '\0'));
+  std::unique_ptr<DtmLayout> layout = make_layout(material, error);
+  if (!layout) {
+    return nullptr;
+  }
+  // The offsets must go forward, from the end of the offsets to the end of
+  // the file.
+  const size_t blocks = num_blocks(layout->size_);
+  uint64_t offset = sizeof(header) + (blocks + 1) * sizeof(uint64_t);
+  bool is_valid = layout->material_ == material &&
+                  header.num_positions_ == layout->size_ &&
+                  file->size() >= offset;
+  for (size_t block = 0; is_valid && block <= blocks; ++block) {
+    uint64_t next = 0;
+    std::memcpy(&next, file->data() + sizeof(header) + block * sizeof(next),
+                sizeof(next));
+    is_valid = next >= offset && next <= file->size() &&
+               (block < blocks || next == file->size());
+    offset = next;
+  }
+  if (!is_valid) {
+    *error = absl::StrCat(path, " is corrupt");
+    return nullptr;
+  }
+  std::unique_ptr<DtmTable> res(new DtmTable(std::move(layout)));
+  res->data_ = file->data();
+  res->file_size_ = file->size();
+  res->file_ = std::move(file);
+  return res;
+}
+
+bool DtmTable::save(const std::string& path) const {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data_, static_cast<std::streamsize>(file_size_));
+  out.close();
+  return static_cast<bool>(out);
+}
+
+const std::string& DtmTable::material() const { return layout_->material_; }
+
+uint64_t DtmTable::material_key() const { return layout_->material_key_; }
+
+uint64_t DtmTable::flipped_material_key() const {
+  return layout_->flipped_material_key_;
+}
+
+DtmResult DtmTable::probe(const Board& board) const {
+  const bool flip = board.material_key_ != layout_->material_key_;
+  DEBUG_CHECK(!flip || board.material_key_ == layout_->flipped_material_key_,
+              "The board doesn't have the material of the table.");
+  return result_of_code(code(index_of_board(*layout_, board, flip)));
+}
+
+uint16_t DtmTable::code(size_t idx) const {
+  std::array<uint64_t, 2> offsets;
+  std::memcpy(offsets.data(),
+              data_ + sizeof(FileHeader) + idx / block_size * sizeof(uint64_t),
+              sizeof(offsets));
+  size_t position = idx % block_size;
+  for (uint64_t offset = offsets[0]; offset < offsets[1];
+       offset += sizeof(Run)) {
+    Run run;
+    std::memcpy(&run, data_ + offset, sizeof(run));
+    if (position < run.length_) {
+      return run.code_;
+    }
+    position -= run.length_;
+  }
+  return invalid_code;
+}
+
+void DtmTablebase::add(std::unique_ptr<DtmTable> table) {
+  DEBUG_CHECK(!find(table->material_key()), "The table is there already.");
+  by_material_key_[table->material_key()] = table.get();
+  by_material_key_[table->flipped_material_key()] = table.get();
+  tables_.push_back(std::move(table));
+}
+
+const DtmTable* DtmTablebase::find(uint64_t material_key) const {
+  const auto it = by_material_key_.find(material_key);
+  return it == by_material_key_.end() ? nullptr : it->second;
+}
+
+absl::optional<DtmResult> DtmTablebase::probe(const Board& board) const {
+  if (popcount(board.all_pieces()) == 2) {
+    return DtmResult{Wdl::draw, 0};
+  }
+  const DtmTable* table = find(board.material_key_);
+  if (!table) {
+    return absl::nullopt;
+  }
+  return table->probe(board);
+}
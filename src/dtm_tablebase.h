@@ -0,0 +1,139 @@
+#ifndef DTM_TABLEBASE_H
+#define DTM_TABLEBASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "mapped_file.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+
+// Distance to mate tables of three to five pieces, generated in-house by
+// retrograde analysis, for checking other tables and for rules that the
+// Syzygy tables of tablebase.h don't cover, where they can't be downloaded.
+//
+// A table holds, for every position of its material with either side to
+// move, whether the side to move wins, draws or loses with best play, and for
+// a win or a loss the number of plies to mate, where the winning side mates
+// as fast as it can and the losing side holds out as long as it can. Castling
+// rights, en passant captures and the fifty move rule are left out.
+//
+// A position is indexed by the squares of its pieces, white king first,
+// after mirroring the board so that the white king is on files a to d, and
+// without pawns also on the triangle a1-d1-d4. Illegal positions and those
+// that merely reorder identical pieces get no value of their own.
+//
+// Generation first settles the checkmates, and the positions whose captures
+// and promotions win or lose in tables generated before, then goes one ply at
+// a time. The positions settled at the last ply are unmoved: the side not to
+// move takes back each of its quiet moves, on every mirror image of the board,
+// which gives the positions that can reach them. At an odd ply those win at
+// once; at an even ply they lose if all their moves lead to positions won by
+// the other side, which is checked by doing their moves. Each ply splits the
+// indices into ranges that a thread pool runs. It takes two bytes a position
+// while it runs: up to 34 MB for four pieces, 2 GB for five with pawns.
+//
+// A table file is the values in blocks of 1024 consecutive indices, each a
+// list of runs of the same value, in which the indices without a value of
+// their own join the run they are in. The file is mapped into memory, and a
+// probe reads the offset of its block and walks the runs of that block.
+
+constexpr int max_dtm_pieces = 5;
+
+// A result with best play. `plies_` counts the plies to mate for a win or a
+// loss, 0 for a position that is mate already, and is 0 for a draw.
+struct DtmResult {
+  Wdl wdl_;
+  int plies_;
+};
+
+bool operator==(const DtmResult& lhs, const DtmResult& rhs);
+
+// Returns `material`, such as "KRvKP", with the stronger side first and the
+// pieces of each side in the order KQRBNP, or nullopt with what is wrong in
+// `*error` if it isn't the material of a table: a king a side, and three to
+// `max_dtm_pieces` pieces in all.
+absl::optional<std::string> parse_dtm_material(absl::string_view material,
+                                               std::string* error);
+// Returns the materials, as `parse_dtm_material` gives them, that a capture
+// or a promotion leads to from `material`, bare kings left out. Their tables
+// are needed to generate the table of `material`.
+std::vector<std::string> dtm_material_dependencies(absl::string_view material);
+
+class DtmTablebase;
+// The pieces of a table and how its positions are indexed, in the .cc file.
+struct DtmLayout;
+
+class DtmTable {
+ public:
+  // Generates the table of `material`, on `pool`, which must not be running
+  // it, looking up the positions after captures and promotions in
+  // `tablebase`. Returns null with what is wrong in `*error` if the material
+  // is bad or `tablebase` misses one of its `dtm_material_dependencies`.
+  static std::unique_ptr<DtmTable> generate(absl::string_view material,
+                                            const DtmTablebase& tablebase,
+                                            ThreadPool* pool,
+                                            std::string* error);
+  // Maps the table file written by `save` at `path`, or returns null with
+  // what is wrong in `*error`.
+  static std::unique_ptr<DtmTable> load(const std::string& path,
+                                        std::string* error);
+  DtmTable(const DtmTable&) = delete;
+  DtmTable& operator=(const DtmTable&) = delete;
+  ~DtmTable();
+
+  // Returns false if the file couldn't be written.
+  bool save(const std::string& path) const;
+
+  // As `parse_dtm_material` gives it.
+  const std::string& material() const;
+  // The material keys of the table, with white as in `material()` and with
+  // the colors swapped, the same if both sides have the same pieces.
+  uint64_t material_key() const;
+  uint64_t flipped_material_key() const;
+  // The size of the table file.
+  size_t file_size() const { return file_size_; }
+
+  // Returns the result of `board`, which must have the material of the table
+  // with either color.
+  DtmResult probe(const Board& board) const;
+
+ private:
+  explicit DtmTable(std::unique_ptr<const DtmLayout> layout);
+
+  // Returns the value stored for `idx`.
+  uint16_t code(size_t idx) const;
+
+  std::unique_ptr<const DtmLayout> layout_;
+  // The table file, generated into `image_` or mapped from `file_`.
+  std::string image_;
+  std::unique_ptr<MappedFile> file_;
+  const char* data_;
+  size_t file_size_;
+};
+
+// A set of tables, looked up by material.
+class DtmTablebase {
+ public:
+  // Adds `table`, whose material must not have a table yet.
+  void add(std::unique_ptr<DtmTable> table);
+  // Returns the table of the material with `material_key`, with either color,
+  // or null.
+  const DtmTable* find(uint64_t material_key) const;
+  // Returns the result of `board`, a draw for bare kings, or nullopt if there
+  // is no table of its material.
+  absl::optional<DtmResult> probe(const Board& board) const;
+
+ private:
+  std::vector<std::unique_ptr<DtmTable>> tables_;
+  absl::flat_hash_map<uint64_t, const DtmTable*> by_material_key_;
+};
+
+#endif
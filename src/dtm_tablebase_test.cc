@@ -0,0 +1,231 @@
+#include "dtm_tablebase.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+#include "endgame.h"
+#include "gtest/gtest.h"
+#include "thread_pool.h"
+
+namespace {
+struct PieceOf {
+  Color color_;
+  Piece piece_;
+};
+
+// Calls `f(board)` with every legal position of `pieces` and either side to
+// move.
+template <typename F>
+void for_each_position(const std::vector<PieceOf>& pieces, F f) {
+  std::vector<int> squares(pieces.size(), 0);
+  while (true) {
+    Board board;
+    board.zero_all_bitboards();
+    Bitboard occupancy = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      occupancy |= lsb_bitboard << squares[i];
+      *board.piece_bitboard(pieces[i].color_, pieces[i].piece_) |=
+          lsb_bitboard << squares[i];
+    }
+    if (popcount(occupancy) == static_cast<int>(pieces.size())) {
+      board.init_mailbox();
+      board.init_occupancy();
+      board.en_passant_square_ = 0;
+      board.castling_rights_ = no_castling;
+      for (bool white_to_move : {true, false}) {
+        board.is_whites_move_ = white_to_move;
+        const char* error = nullptr;
+        const absl::optional<Board> position =
+            parse_fen(board.to_fen(), &error);
+        if (position) {
+          f(*position);
+        }
+      }
+    }
+    size_t i = 0;
+    for (; i < squares.size() && squares[i] == 63; ++i) {
+      squares[i] = 0;
+    }
+    if (i == squares.size()) {
+      return;
+    }
+    ++squares[i];
+  }
+}
+
+// Returns the result of `board` from those of the positions after its moves.
+DtmResult best_play(const DtmTablebase& tablebase, const Board& board) {
+  const MoveList moves = board.legal_moves();
+  if (moves.empty()) {
+    const bool is_in_check = board.is_king_attacked(
+        board.is_whites_move_ ? Color::white : Color::black);
+    return {is_in_check ? Wdl::loss : Wdl::draw, 0};
+  }
+  DtmResult res = {Wdl::loss, 0};
+  for (Move move : moves) {
+    Board child(board);
+    child.do_move(move);
+    const DtmResult child_result = *tablebase.probe(child);
+    if (child_result.wdl_ == Wdl::loss) {
+      if (res.wdl_ != Wdl::win || child_result.plies_ + 1 < res.plies_) {
+        res = {Wdl::win, child_result.plies_ + 1};
+      }
+    } else if (child_result.wdl_ == Wdl::draw) {
+      if (res.wdl_ == Wdl::loss) {
+        res = {Wdl::draw, 0};
+      }
+    } else if (res.wdl_ == Wdl::loss) {
+      res.plies_ = std::max(res.plies_, child_result.plies_ + 1);
+    }
+  }
+  return res;
+}
+
+// KPvK and the tables it needs, generated once for the tests.
+const DtmTablebase& kpk_tablebase() {
+  static const DtmTablebase* tablebase = [] {
+    DtmTablebase* res = new DtmTablebase;
+    ThreadPool pool(2);
+    for (const char* material : {"KQvK", "KRvK", "KBvK", "KNvK", "KPvK"}) {
+      std::string error;
+      std::unique_ptr<DtmTable> table =
+          DtmTable::generate(material, *res, &pool, &error);
+      EXPECT_NE(table, nullptr) << error;
+      res->add(std::move(table));
+    }
+    return res;
+  }();
+  return *tablebase;
+}
+
+DtmResult probe(const std::string& fen) {
+  return *kpk_tablebase().probe(Board(fen));
+}
+}  // namespace.
+
+TEST(DtmTablebase, ParsesMaterials) {
+  std::string error;
+  EXPECT_EQ(parse_dtm_material("KRvKP", &error), std::string("KRvKP"));
+  EXPECT_EQ(parse_dtm_material("KPvKR", &error), std::string("KRvKP"));
+  EXPECT_EQ(parse_dtm_material("KPRvK", &error), std::string("KRPvK"));
+  EXPECT_EQ(parse_dtm_material("KNvKB", &error), std::string("KBvKN"));
+  EXPECT_EQ(parse_dtm_material("KBvKN", &error), std::string("KBvKN"));
+  for (const char* material : {"KQK", "QvK", "KvK", "KQRvKRB", "KXvK"}) {
+    EXPECT_EQ(parse_dtm_material(material, &error), absl::nullopt)
+        << material;
+  }
+}
+
+TEST(DtmTablebase, ListsDependencies) {
+  std::vector<std::string> dependencies = dtm_material_dependencies("KPvK");
+  std::sort(dependencies.begin(), dependencies.end());
+  EXPECT_EQ(dependencies, std::vector<std::string>(
+                              {"KBvK", "KNvK", "KQvK", "KRvK"}));
+  // The pawn can also promote by taking the rook.
+  dependencies = dtm_material_dependencies("KRvKP");
+  std::sort(dependencies.begin(), dependencies.end());
+  EXPECT_EQ(dependencies,
+            std::vector<std::string>({"KBvK", "KNvK", "KPvK", "KQvK",
+                                      "KQvKR", "KRvK", "KRvKB", "KRvKN",
+                                      "KRvKR"}));
+}
+
+TEST(DtmTablebase, NeedsItsDependencies) {
+  DtmTablebase tablebase;
+  ThreadPool pool(1);
+  std::string error;
+  EXPECT_EQ(DtmTable::generate("KPvK", tablebase, &pool, &error), nullptr);
+  EXPECT_EQ(error, "KPvK needs the table of KQvK");
+}
+
+TEST(DtmTablebase, ProbesPositions) {
+  EXPECT_EQ(probe("7k/8/6K1/8/8/8/8/1Q6 w - - 0 1"), (DtmResult{Wdl::win, 1}));
+  EXPECT_EQ(probe("Q6k/8/6K1/8/8/8/8/8 b - - 0 1"), (DtmResult{Wdl::loss, 0}));
+  EXPECT_EQ(probe("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1"), (DtmResult{Wdl::draw, 0}));
+  // Mate with the colors swapped.
+  EXPECT_EQ(probe("8/8/8/8/8/6k1/8/q6K w - - 0 1"), (DtmResult{Wdl::loss, 0}));
+  // Bare kings, or a lone knight or bishop, can't mate.
+  EXPECT_EQ(probe("8/8/8/4k3/8/8/8/1N2K3 w - - 0 1").wdl_, Wdl::draw);
+  EXPECT_EQ(probe("8/8/8/4k3/8/8/8/2B1K3 b - - 0 1").wdl_, Wdl::draw);
+  EXPECT_EQ(probe("8/8/8/8/8/6k1/8/7K b - - 0 1"), (DtmResult{Wdl::draw, 0}));
+  // The pawn is taken.
+  EXPECT_EQ(probe("8/8/8/8/8/8/3kP3/7K b - - 0 1").wdl_, Wdl::draw);
+}
+
+TEST(DtmTablebase, KnowsTheLongestMates) {
+  const DtmTablebase& tablebase = kpk_tablebase();
+  for (const auto& material_plies :
+       {std::make_pair(Piece::queen, 19), std::make_pair(Piece::rook, 31)}) {
+    int longest = 0;
+    for_each_position({{Color::white, Piece::king},
+                       {Color::black, Piece::king},
+                       {Color::white, material_plies.first}},
+                      [&](const Board& board) {
+                        const DtmResult result = *tablebase.probe(board);
+                        if (result.wdl_ == Wdl::win) {
+                          longest = std::max(longest, result.plies_);
+                        }
+                      });
+    EXPECT_EQ(longest, material_plies.second);
+  }
+}
+
+TEST(DtmTablebase, ResultsFollowFromTheMoves) {
+  const DtmTablebase& tablebase = kpk_tablebase();
+  size_t num_positions = 0;
+  for_each_position(
+      {{Color::white, Piece::king},
+       {Color::black, Piece::king},
+       {Color::white, Piece::pawn}},
+      [&](const Board& board) {
+        // A sample, which spreads over all the squares.
+        if (++num_positions % 7) {
+          return;
+        }
+        EXPECT_EQ(*tablebase.probe(board), best_play(tablebase, board))
+            << board.to_fen();
+      });
+}
+
+TEST(DtmTablebase, AgreesWithTheKpkBitbase) {
+  const DtmTablebase& tablebase = kpk_tablebase();
+  for_each_position({{Color::white, Piece::king},
+                     {Color::black, Piece::king},
+                     {Color::white, Piece::pawn}},
+                    [&](const Board& board) {
+                      const Endgame* endgame = find_endgame(board);
+                      const bool is_win =
+                          endgame->evaluate_(board, Color::white) != 0;
+                      const DtmResult result = *tablebase.probe(board);
+                      EXPECT_EQ(result.wdl_ == Wdl::win ||
+                                    result.wdl_ == Wdl::loss,
+                                is_win)
+                          << board.to_fen();
+                    });
+}
+
+TEST(DtmTablebase, SavesAndLoads) {
+  const DtmTable* table =
+      kpk_tablebase().find(material_key_of("KPvK"));
+  ASSERT_NE(table, nullptr);
+  const std::string path = testing::TempDir() + "dtm_tablebase_test.dtm";
+  ASSERT_TRUE(table->save(path));
+  std::string error;
+  const std::unique_ptr<DtmTable> loaded = DtmTable::load(path, &error);
+  ASSERT_NE(loaded, nullptr) << error;
+  EXPECT_EQ(loaded->material(), "KPvK");
+  EXPECT_EQ(loaded->file_size(), table->file_size());
+  for (const char* fen :
+       {"8/8/8/8/4k3/8/4P3/4K3 w - - 0 1", "8/8/8/8/4k3/8/4P3/4K3 b - - 0 1",
+        "8/4k3/8/8/8/8/3KP3/8 w - - 0 1", "8/8/8/8/8/k7/7p/7K b - - 0 1"}) {
+    const Board board(fen);
+    EXPECT_EQ(loaded->probe(board), table->probe(board)) << fen;
+  }
+  EXPECT_EQ(DtmTable::load(testing::TempDir() + "no_such_table.dtm", &error),
+            nullptr);
+}
@@ -0,0 +1,461 @@
+#include "endgame.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/strings/str_cat.h"
+#include "attacks.h"
+#include "board.h"
+#include "eval.h"
+#include "zobrist.h"
+
+namespace {
+// The helpers work on square indices rather than bitboards, since the
+// evaluators mostly measure distances between single pieces.
+int file_of(int idx) { return 7 - idx % 8; }
+int rank_of(int idx) { return idx / 8; }
+
+int distance(int a, int b) {
+  return std::max(std::abs(file_of(a) - file_of(b)),
+                  std::abs(rank_of(a) - rank_of(b)));
+}
+
+// Returns the square index as seen by `strong_side`, so that the evaluators
+// can pretend it is white and plays up the board. It is its own inverse.
+int relative_square(Color strong_side, int idx) {
+  return strong_side == Color::white ? idx : idx ^ 56;
+}
+
+bool is_dark_square(int idx) { return (file_of(idx) + rank_of(idx)) % 2 == 0; }
+
+int king_square(const Board& board, Color side) {
+  return square_idx(board.pieces(side, Piece::king));
+}
+
+int piece_value(Piece piece) {
+  return eval_internal::endgame_values[static_cast<size_t>(piece)];
+}
+
+// From 90 in the corners down to 28 in the centre, to drive a king to the edge.
+int push_to_edge(int idx) {
+  const int file = std::min(file_of(idx), 7 - file_of(idx));
+  const int rank = std::min(rank_of(idx), 7 - rank_of(idx));
+  return 90 - (7 * file * file / 2 + 7 * rank * rank / 2);
+}
+
+// Brings the kings together, which the mating side needs.
+int push_close(int a, int b) { return 140 - 20 * distance(a, b); }
+
+// From 7 in a1 and h8 down to 0 on the long diagonal between a8 and h1.
+int push_to_dark_corner(int idx) {
+  return std::abs(7 - rank_of(idx) - file_of(idx));
+}
+
+bool is_strong_to_move(const Board& board, Color strong_side) {
+  return board.is_whites_move_ == (strong_side == Color::white);
+}
+
+// KPK bitbase. Every position with white to move or black to move, the white
+// king, the black king, and the white pawn on files a to d and ranks 2 to 7 is
+// classified by retrograde analysis: first the positions that are won by
+// promoting at once, drawn by stalemate or by taking the pawn, or illegal, and
+// then over and over the positions all of whose moves lead to known results,
+// until nothing changes. Positions with a pawn on files e to h are mirrored.
+enum KpkResult : uint8_t { invalid = 0, unknown = 1, draw = 2, win = 4 };
+
+constexpr size_t kpk_size = 2 * 64 * 64 * 24;
+
+size_t kpk_index(bool white_to_move, int white_king, int black_king,
+                 int pawn) {
+  const size_t pawn_idx =
+      static_cast<size_t>((rank_of(pawn) - 1) * 4 + file_of(pawn));
+  return ((pawn_idx * 64 + static_cast<size_t>(white_king)) * 64 +
+          static_cast<size_t>(black_king)) *
+             2 +
+         (white_to_move ? 0 : 1);
+}
+
+uint8_t initial_kpk_result(bool white_to_move, int white_king, int black_king,
+                           int pawn) {
+  const Bitboard black_king_square = lsb_bitboard << black_king;
+  const Bitboard pawn_square = lsb_bitboard << pawn;
+  const size_t white_king_idx = static_cast<size_t>(white_king);
+  const size_t black_king_idx = static_cast<size_t>(black_king);
+  const size_t pawn_idx = static_cast<size_t>(pawn);
+  if (distance(white_king, black_king) <= 1 || white_king == pawn ||
+      black_king == pawn ||
+      (white_to_move && (white_pawn_attacks[pawn_idx] & black_king_square))) {
+    return invalid;
+  }
+  const int promotion = pawn + 8;
+  if (white_to_move && rank_of(pawn) == 6 && white_king != promotion &&
+      black_king != promotion &&
+      (distance(black_king, promotion) > 1 ||
+       distance(white_king, promotion) == 1)) {
+    return win;
+  }
+  const Bitboard guarded =
+      king_attacks[white_king_idx] | white_pawn_attacks[pawn_idx];
+  if (!white_to_move &&
+      ((king_attacks[black_king_idx] & ~guarded) == 0 ||
+       (king_attacks[black_king_idx] & pawn_square &
+        ~king_attacks[white_king_idx]))) {
+    return draw;
+  }
+  return unknown;
+}
+
+uint8_t classify_kpk(const std::vector<uint8_t>& results, bool white_to_move,
+                     int white_king, int black_king, int pawn) {
+  // The OR of the results of the moves. Illegal moves lead to positions that
+  // are invalid, which is 0.
+  uint8_t res = 0;
+  if (white_to_move) {
+    for (Bitboard sq :
+         bitboard_split(king_attacks[static_cast<size_t>(white_king)])) {
+      res |= results[kpk_index(false, square_idx(sq), black_king, pawn)];
+    }
+    // Promotions were dealt with by `initial_kpk_result`.
+    if (rank_of(pawn) < 6) {
+      const int push = pawn + 8;
+      res |= results[kpk_index(false, white_king, black_king, push)];
+      if (rank_of(pawn) == 1 && push != white_king && push != black_king) {
+        res |= results[kpk_index(false, white_king, black_king, push + 8)];
+      }
+    }
+    return res & win ? win : res & unknown ? unknown : draw;
+  }
+  for (Bitboard sq :
+       bitboard_split(king_attacks[static_cast<size_t>(black_king)])) {
+    res |= results[kpk_index(true, white_king, square_idx(sq), pawn)];
+  }
+  return res & draw ? draw : res & unknown ? unknown : win;
+}
+
+// Sets the pieces of the position at `idx` of the bitbase.
+void decode_kpk_index(size_t idx, bool* white_to_move, int* white_king,
+                      int* black_king, int* pawn) {
+  *white_to_move = idx % 2 == 0;
+  *black_king = static_cast<int>(idx / 2 % 64);
+  *white_king = static_cast<int>(idx / 128 % 64);
+  const int pawn_idx = static_cast<int>(idx / (128 * 64));
+  *pawn = (pawn_idx / 4 + 1) * 8 + 7 - pawn_idx % 4;
+}
+
+// The positions of the KPK bitbase that are won, a bit each, 24 KB.
+class KpkBitbase {
+ public:
+  // Classifies every position, in a few milliseconds.
+  KpkBitbase();
+
+  bool is_win(size_t idx) const { return (wins_[idx / 64] >> (idx % 64)) & 1; }
+
+ private:
+  std::array<uint64_t, kpk_size / 64> wins_;
+};
+
+KpkBitbase::KpkBitbase() : wins_() {
+  std::vector<uint8_t> results(kpk_size);
+  bool white_to_move = false;
+  int white_king = 0;
+  int black_king = 0;
+  int pawn = 0;
+  // Each pass only looks at the positions still unknown, which are a
+  // fraction of them after the first and fewer with every pass.
+  std::vector<uint32_t> unknowns;
+  for (size_t idx = 0; idx < kpk_size; ++idx) {
+    decode_kpk_index(idx, &white_to_move, &white_king, &black_king, &pawn);
+    results[idx] =
+        initial_kpk_result(white_to_move, white_king, black_king, pawn);
+    if (results[idx] == unknown) {
+      unknowns.push_back(static_cast<uint32_t>(idx));
+    }
+  }
+  while (true) {
+    size_t num_unknowns = 0;
+    for (const uint32_t idx : unknowns) {
+      decode_kpk_index(idx, &white_to_move, &white_king, &black_king, &pawn);
+      results[idx] = classify_kpk(results, white_to_move, white_king,
+                                  black_king, pawn);
+      if (results[idx] == unknown) {
+        unknowns[num_unknowns++] = idx;
+      }
+    }
+    if (num_unknowns == unknowns.size()) {
+      break;
+    }
+    unknowns.resize(num_unknowns);
+  }
+  // Whatever is still unknown can't be forced to a win.
+  for (size_t idx = 0; idx < kpk_size; ++idx) {
+    if (results[idx] == win) {
+      wins_[idx / 64] |= uint64_t{1} << (idx % 64);
+    }
+  }
+}
+
+const KpkBitbase& get_kpk_bitbase() {
+  static const KpkBitbase kpk_bitbase;
+  return kpk_bitbase;
+}
+
+int evaluate_draw(const Board& /*board*/, Color /*strong_side*/) { return 0; }
+
+// A lone king against at least a rook, or two minor pieces but two knights:
+// drive the king to the edge and bring the other king up.
+int evaluate_kxk(const Board& board, Color strong_side) {
+  const Color weak_side = flip_color(strong_side);
+  if (!is_strong_to_move(board, strong_side) &&
+      !board.is_king_attacked(weak_side) && board.legal_moves().size() == 0) {
+    return 0;
+  }
+  const int strong_king = king_square(board, strong_side);
+  const int weak_king = king_square(board, weak_side);
+  int res = known_win + push_to_edge(weak_king) +
+            push_close(strong_king, weak_king);
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    res += piece_value(static_cast<Piece>(piece)) *
+           popcount(board.pieces(strong_side, static_cast<Piece>(piece)));
+  }
+  return res;
+}
+
+// The king can only be mated in the two corners of the bishop's color.
+int evaluate_kbnk(const Board& board, Color strong_side) {
+  const int strong_king = king_square(board, strong_side);
+  const int weak_king = king_square(board, flip_color(strong_side));
+  const int bishop = square_idx(board.pieces(strong_side, Piece::bishop));
+  // Mirroring the king across the files turns the light corners into dark
+  // ones.
+  const int corner_king = is_dark_square(bishop) ? weak_king : weak_king ^ 7;
+  return known_win + push_close(strong_king, weak_king) +
+         100 * push_to_dark_corner(corner_king);
+}
+
+int evaluate_kpk(const Board& board, Color strong_side) {
+  int strong_king =
+      relative_square(strong_side, king_square(board, strong_side));
+  int weak_king =
+      relative_square(strong_side, king_square(board, flip_color(strong_side)));
+  int pawn = relative_square(
+      strong_side, square_idx(board.pieces(strong_side, Piece::pawn)));
+  if (file_of(pawn) > 3) {
+    strong_king ^= 7;
+    weak_king ^= 7;
+    pawn ^= 7;
+  }
+  if (!get_kpk_bitbase().is_win(kpk_index(is_strong_to_move(board, strong_side),
+                                          strong_king, weak_king, pawn))) {
+    return 0;
+  }
+  return known_win + piece_value(Piece::pawn) + 10 * rank_of(pawn);
+}
+
+// A rook against a pawn is won unless the pawn is far advanced and its king
+// near, in which case a draw or even a loss is possible. The terms are those of
+// Stockfish.
+int evaluate_krkp(const Board& board, Color strong_side) {
+  const Color weak_side = flip_color(strong_side);
+  const int strong_king =
+      relative_square(strong_side, king_square(board, strong_side));
+  const int weak_king =
+      relative_square(strong_side, king_square(board, weak_side));
+  const int rook = relative_square(
+      strong_side, square_idx(board.pieces(strong_side, Piece::rook)));
+  const int pawn = relative_square(
+      strong_side, square_idx(board.pieces(weak_side, Piece::pawn)));
+  // The pawn runs down the board.
+  const int queening = pawn % 8;
+  const int stop = pawn - 8;
+  const int weak_to_move = is_strong_to_move(board, strong_side) ? 0 : 1;
+  const int rook_value = piece_value(Piece::rook);
+  if (file_of(strong_king) == file_of(pawn) &&
+      rank_of(strong_king) < rank_of(pawn)) {
+    // The king is in front of the pawn.
+    return rook_value - distance(strong_king, pawn);
+  }
+  if (distance(weak_king, pawn) >= 3 + weak_to_move &&
+      distance(weak_king, rook) >= 3) {
+    return rook_value - distance(strong_king, pawn);
+  }
+  if (rank_of(weak_king) <= 2 && distance(weak_king, pawn) == 1 &&
+      rank_of(strong_king) >= 3 &&
+      distance(strong_king, pawn) > 3 - weak_to_move) {
+    return 80 - 8 * distance(strong_king, pawn);
+  }
+  return 200 - 8 * (distance(strong_king, stop) - distance(weak_king, stop) -
+                    distance(pawn, queening));
+}
+
+// A queen wins against a pawn, but for a rook or bishop pawn on the seventh
+// rank supported by its king, which often draws by stalemate.
+int evaluate_kqkp(const Board& board, Color strong_side) {
+  const Color weak_side = flip_color(strong_side);
+  const int strong_king = king_square(board, strong_side);
+  const int weak_king = king_square(board, weak_side);
+  const int pawn = relative_square(
+      strong_side, square_idx(board.pieces(weak_side, Piece::pawn)));
+  int res = push_close(strong_king, weak_king);
+  const int file = file_of(pawn);
+  if (rank_of(pawn) != 1 ||
+      distance(relative_square(strong_side, weak_king), pawn) != 1 ||
+      (file != 0 && file != 2 && file != 5 && file != 7)) {
+    res += piece_value(Piece::queen) - piece_value(Piece::pawn);
+  }
+  return res;
+}
+
+// A rook against a minor piece is a draw most of the time.
+int scale_krk_minor(const Board& /*board*/, Color /*strong_side*/) {
+  return normal_scale / 4;
+}
+
+// Rook pawns with a bishop that doesn't control the promotion square can't get
+// past a king on that square.
+int scale_kbpsk(const Board& board, Color strong_side) {
+  const Bitboard pawns = board.pieces(strong_side, Piece::pawn);
+  const Bitboard file = pawns & a_file_mask ? a_file_mask : h_file_mask;
+  if (pawns & ~file) {
+    return normal_scale;
+  }
+  const int queening =
+      relative_square(strong_side, file == a_file_mask ? 63 : 56);
+  const int bishop = square_idx(board.pieces(strong_side, Piece::bishop));
+  const int weak_king = king_square(board, flip_color(strong_side));
+  if (is_dark_square(bishop) != is_dark_square(queening) &&
+      distance(weak_king, queening) <= 1) {
+    return 0;
+  }
+  return normal_scale;
+}
+
+// Open addressing on the low bits of the material key. Empty slots have
+// neither an evaluator nor a scale function.
+constexpr size_t endgame_table_size = 64;
+typedef std::array<Endgame, endgame_table_size> EndgameTable;
+
+void add_endgame(const Endgame& endgame, EndgameTable* table) {
+  for (size_t idx = endgame.material_key_ % endgame_table_size;;
+       idx = (idx + 1) % endgame_table_size) {
+    Endgame& entry = (*table)[idx];
+    if (!entry.evaluate_ && !entry.scale_) {
+      entry = endgame;
+      return;
+    }
+    ABSL_RAW_CHECK(entry.material_key_ != endgame.material_key_,
+                   "Endgame added twice.");
+  }
+}
+
+// Adds the endgame of `code` (see `material_key_of`) for both colors, with
+// white as the strong side in `code`.
+void add_endgame(absl::string_view code, EndgameEvaluator evaluate,
+                 ScaleFunction scale, EndgameTable* table) {
+  const size_t split = code.find('v');
+  const std::string flipped =
+      absl::StrCat(code.substr(split + 1), "v", code.substr(0, split));
+  add_endgame({material_key_of(code), Color::white, evaluate, scale}, table);
+  if (flipped != code) {
+    add_endgame({material_key_of(flipped), Color::black, evaluate, scale},
+                table);
+  }
+}
+
+EndgameTable* build_endgame_table() {
+  EndgameTable* table = new EndgameTable();
+  for (Endgame& entry : *table) {
+    entry = {0, Color::white, nullptr, nullptr};
+  }
+  for (absl::string_view code : {"KvK", "KNvK", "KBvK", "KNNvK"}) {
+    add_endgame(code, &evaluate_draw, nullptr, table);
+  }
+  add_endgame("KPvK", &evaluate_kpk, nullptr, table);
+  add_endgame("KBNvK", &evaluate_kbnk, nullptr, table);
+  add_endgame("KRvKP", &evaluate_krkp, nullptr, table);
+  add_endgame("KQvKP", &evaluate_kqkp, nullptr, table);
+  add_endgame("KRvKB", nullptr, &scale_krk_minor, table);
+  add_endgame("KRvKN", nullptr, &scale_krk_minor, table);
+  for (absl::string_view code : {"KBPvK", "KBPPvK", "KBPPPvK"}) {
+    add_endgame(code, nullptr, &scale_kbpsk, table);
+  }
+  return table;
+}
+
+const EndgameTable& get_endgame_table() {
+  const static EndgameTable& endgame_table = *build_endgame_table();
+  return endgame_table;
+}
+
+bool has_mating_material(const Board& board, Color side) {
+  const Bitboard bishops = board.pieces(side, Piece::bishop);
+  const Bitboard minors = bishops | board.pieces(side, Piece::knight);
+  return board.pieces(side, Piece::rook) || board.pieces(side, Piece::queen) ||
+         (bishops && popcount(minors) >= 2) || popcount(minors) >= 3;
+}
+
+constexpr std::array<Endgame, num_colors> kxk_endgames = {
+    {{0, Color::white, &evaluate_kxk, nullptr},
+     {0, Color::black, &evaluate_kxk, nullptr}}};
+}  // namespace.
+
+const Endgame* find_endgame(const Board& board) {
+  const EndgameTable& table = get_endgame_table();
+  for (size_t idx = board.material_key_ % endgame_table_size;;
+       idx = (idx + 1) % endgame_table_size) {
+    const Endgame& entry = table[idx];
+    if (!entry.evaluate_ && !entry.scale_) {
+      break;
+    }
+    if (entry.material_key_ == board.material_key_) {
+      return &entry;
+    }
+  }
+  for (Color side : {Color::white, Color::black}) {
+    if (popcount(board.friends(flip_color(side))) == 1 &&
+        has_mating_material(board, side)) {
+      return &kxk_endgames[static_cast<size_t>(side)];
+    }
+  }
+  return nullptr;
+}
+
+bool is_insufficient_material(const Board& board) {
+  static const std::array<uint64_t, 5> keys = {
+      {material_key_of("KvK"), material_key_of("KNvK"),
+       material_key_of("KvKN"), material_key_of("KBvK"),
+       material_key_of("KvKB")}};
+  return std::find(keys.begin(), keys.end(), board.material_key_) !=
+         keys.end();
+}
+
+uint64_t material_key_of(absl::string_view code) {
+  // In the order of Piece.
+  constexpr absl::string_view piece_chars = "PRNBQK";
+  std::array<std::array<int, num_piece_types>, num_colors> counts = {};
+  size_t color = 0;
+  for (char c : code) {
+    if (c == 'v') {
+      ++color;
+      continue;
+    }
+    const size_t piece = piece_chars.find(c);
+    ABSL_RAW_CHECK(color < num_colors && piece != absl::string_view::npos,
+                   "Invalid endgame code.");
+    ++counts[color][piece];
+  }
+  uint64_t res = 0;
+  for (Color side : {Color::white, Color::black}) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      for (int idx = 0; idx < counts[static_cast<size_t>(side)][piece]; ++idx) {
+        res ^= zobrist_piece_key(side, static_cast<Piece>(piece), idx);
+      }
+    }
+  }
+  return res;
+}
@@ -0,0 +1,51 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "board.h"
+
+// Endgames that the general evaluation gets wrong, recognized by the material
+// key of the board (see `compute_material_key`), so that finding out whether
+// a position is one of them costs one lookup. An endgame either has an
+// evaluator of its own, which replaces the general evaluation (KPK from a
+// bitbase, KBNK, KRKP, ...), or a scale function, which says how much of the
+// advantage of the general evaluation is real (a rook against a minor piece,
+// a rook pawn with the wrong bishop).
+
+// Scores a position that is won, but not by a known number of moves, well
+// away from the mate scores and from any score the general evaluation gives.
+constexpr int known_win = 10000;
+// The scale that keeps the general evaluation as it is.
+constexpr int normal_scale = 64;
+
+// Returns the evaluation of `board` in centipawns for `strong_side`.
+typedef int (*EndgameEvaluator)(const Board& board, Color strong_side);
+// Returns the factor, from 0 to `normal_scale`, by which the general
+// evaluation of `board` is scaled when `strong_side` is ahead.
+typedef int (*ScaleFunction)(const Board& board, Color strong_side);
+
+struct Endgame {
+  uint64_t material_key_;
+  // The side the endgame is about, usually the one with more material.
+  Color strong_side_;
+  // Exactly one of the two is not null.
+  EndgameEvaluator evaluate_;
+  ScaleFunction scale_;
+};
+
+// Returns the endgame of `board`, or null if its material has no evaluation
+// or scaling of its own. Besides the table, this covers a lone king against
+// enough material to mate, which is too many material keys to list.
+const Endgame* find_endgame(const Board& board);
+
+// Returns true if neither side has the material to mate: bare kings, or a
+// lone knight or bishop, found from the material key of `board`.
+bool is_insufficient_material(const Board& board);
+
+// Returns the material key of the positions with the pieces in `code`, such as
+// "KBNvK": white's pieces, a 'v', and black's pieces, in upper case.
+uint64_t material_key_of(absl::string_view code);
+
+#endif
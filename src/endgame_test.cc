@@ -0,0 +1,109 @@
+#include "endgame.h"
+
+#include "board.h"
+#include "eval.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Returns the evaluation of `fen` from white's point of view.
+int white_score(const std::string& fen) {
+  const Board board(fen);
+  return board.is_whites_move_ ? evaluate(board) : -evaluate(board);
+}
+}  // namespace.
+
+TEST(Endgame, MaterialKeyOfMatchesTheBoard) {
+  EXPECT_EQ(material_key_of("KBNvK"),
+            Board("8/8/8/4k3/8/8/8/2BNK3 w - - 0 1").material_key_);
+  EXPECT_EQ(material_key_of("KvKBN"),
+            Board("2bnk3/8/8/8/8/8/8/4K3 w - - 0 1").material_key_);
+  EXPECT_NE(material_key_of("KBNvK"), material_key_of("KvKBN"));
+}
+
+TEST(Endgame, FindsEndgamesByMaterial) {
+  EXPECT_EQ(find_endgame(Board()), nullptr);
+  const Endgame* kbnk = find_endgame(Board("8/8/8/4k3/8/8/8/2BNK3 w - - 0 1"));
+  ASSERT_NE(kbnk, nullptr);
+  EXPECT_EQ(kbnk->strong_side_, Color::white);
+  const Endgame* kkbn = find_endgame(Board("2bnk3/8/8/8/8/8/8/4K3 w - - 0 1"));
+  ASSERT_NE(kkbn, nullptr);
+  EXPECT_EQ(kkbn->strong_side_, Color::black);
+  // A lone king against a rook isn't in the table but is found anyway.
+  const Endgame* krk = find_endgame(Board("8/8/8/4k3/8/8/8/4K2r w - - 0 1"));
+  ASSERT_NE(krk, nullptr);
+  EXPECT_EQ(krk->strong_side_, Color::black);
+  // Two knights can't force mate, but the pawn gives them a chance.
+  EXPECT_EQ(find_endgame(Board("8/8/8/4k3/4p3/8/8/3NK2N w - - 0 1")), nullptr);
+}
+
+TEST(Endgame, InsufficientMaterialIsADraw) {
+  EXPECT_EQ(white_score("8/8/8/4k3/8/8/8/4K3 w - - 0 1"), 0);
+  EXPECT_EQ(white_score("8/8/8/4k3/8/8/8/3NK3 b - - 0 1"), 0);
+  EXPECT_EQ(white_score("8/8/3b4/4k3/8/8/8/4K3 w - - 0 1"), 0);
+  EXPECT_EQ(white_score("8/8/8/4k3/8/8/8/2N1K1N1 w - - 0 1"), 0);
+}
+
+TEST(Endgame, FindsInsufficientMaterial) {
+  EXPECT_TRUE(is_insufficient_material(Board("8/8/8/4k3/8/8/8/4K3 w - - 0 1")));
+  EXPECT_TRUE(
+      is_insufficient_material(Board("8/8/8/4k3/8/8/8/3NK3 b - - 0 1")));
+  EXPECT_TRUE(
+      is_insufficient_material(Board("8/8/3b4/4k3/8/8/8/4K3 w - - 0 1")));
+  EXPECT_FALSE(
+      is_insufficient_material(Board("8/8/8/4k3/8/8/8/2N1K1N1 w - - 0 1")));
+  EXPECT_FALSE(
+      is_insufficient_material(Board("8/8/3b4/4k3/8/8/8/3BK3 w - - 0 1")));
+  EXPECT_FALSE(
+      is_insufficient_material(Board("8/8/8/4k3/8/8/4P3/4K3 w - - 0 1")));
+  EXPECT_FALSE(is_insufficient_material(Board()));
+}
+
+TEST(Endgame, KpkBitbase) {
+  // The king in front of its pawn on the sixth rank.
+  EXPECT_GT(white_score("4k3/8/4K3/4P3/8/8/8/8 w - - 0 1"), known_win);
+  EXPECT_GT(white_score("4k3/8/4K3/4P3/8/8/8/8 b - - 0 1"), known_win);
+  // The same for black, and mirrored to the h-file side.
+  EXPECT_LT(white_score("8/8/8/8/3p4/3k4/8/3K4 b - - 0 1"), -known_win);
+  // Outside the square of the pawn.
+  EXPECT_GT(white_score("7k/8/8/8/P7/8/8/K7 b - - 0 1"), known_win);
+  // Stalemate.
+  EXPECT_EQ(white_score("4k3/4P3/4K3/8/8/8/8/8 b - - 0 1"), 0);
+  // The defending king reaches the corner of a rook pawn.
+  EXPECT_EQ(white_score("k7/8/8/8/8/8/P7/7K w - - 0 1"), 0);
+  // The defending king holds the opposition.
+  EXPECT_EQ(white_score("4k3/8/8/4K3/4P3/8/8/8 b - - 0 1"), 0);
+}
+
+TEST(Endgame, KbnkDrivesTheKingToTheBishopsCorner) {
+  // e3 and h8 are dark squares.
+  const int dark_corner = white_score("7k/8/8/8/3KN3/4B3/8/8 w - - 0 1");
+  const int light_corner = white_score("k7/8/8/8/3KN3/4B3/8/8 w - - 0 1");
+  EXPECT_GT(light_corner, known_win);
+  EXPECT_GT(dark_corner, light_corner);
+}
+
+TEST(Endgame, Kxk) {
+  EXPECT_GT(white_score("8/8/8/4k3/8/8/8/R3K3 w - - 0 1"), known_win);
+  // On the edge.
+  EXPECT_GT(white_score("4k3/8/4K3/8/8/8/8/R7 w - - 0 1"),
+            white_score("8/8/8/4k3/8/8/8/R3K3 w - - 0 1"));
+  // Stalemate.
+  EXPECT_EQ(white_score("k7/2Q5/1K6/8/8/8/8/8 b - - 0 1"), 0);
+}
+
+TEST(Endgame, Krkp) {
+  // The king in front of the pawn wins.
+  EXPECT_GT(white_score("R7/8/8/8/5k2/4p3/8/4K3 w - - 0 1"), 400);
+  // The pawn is about to promote and the attacking king far away.
+  EXPECT_LT(white_score("R6K/8/8/8/8/8/3kp3/8 w - - 0 1"), 100);
+}
+
+TEST(Endgame, ScalesDrawishEndgames) {
+  // A rook against a bishop.
+  const int krkb = white_score("4k3/8/8/8/8/8/2b5/R3K3 w - - 0 1");
+  EXPECT_GT(krkb, 0);
+  EXPECT_LT(krkb, 100);
+  // A rook pawn with a bishop of the wrong color.
+  EXPECT_EQ(white_score("k7/8/8/8/P7/8/8/2B1K3 w - - 0 1"), 0);
+  EXPECT_GT(white_score("k7/8/8/8/P7/8/8/1B2K3 w - - 0 1"), 300);
+}
@@ -0,0 +1,196 @@
+#include "eval.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "endgame.h"
+#include "nnue.h"
+#include "pawns.h"
+
+namespace {
+// The mobility of each Piece is the weight of a square times the squares it
+// can move to (see `AttackInfo::mobility_`) less the usual number of them, so
+// that a piece with average mobility keeps its material value.
+constexpr std::array<TaperedScore, num_piece_types> mobility_weights = {
+    {{0, 0}, {2, 4}, {4, 4}, {5, 5}, {1, 2}, {0, 0}}};
+constexpr std::array<int, num_piece_types> average_mobility = {0, 7, 4, 6,
+                                                               13, 0};
+// Per square of the enemy king's zone a kind of piece attacks, indexed by
+// Piece. Only in the middlegame, as kings come out in the endgame.
+constexpr std::array<int, num_piece_types> king_attack_weights = {0, 10, 8,
+                                                                  8, 12, 0};
+// Per piece of the side attacked.
+constexpr TaperedScore pawn_threat = {30, 25};
+constexpr TaperedScore minor_threat_on_major = {25, 20};
+constexpr TaperedScore rook_threat_on_queen = {25, 20};
+constexpr TaperedScore hanging_piece = {15, 10};
+
+// The attack terms of `side`, counted positive.
+TaperedScore side_attack_score(const Board& board, const AttackInfo& info,
+                               Color side) {
+  const size_t color = static_cast<size_t>(side);
+  const size_t enemy = 1 - color;
+  const Color enemy_side = flip_color(side);
+  const auto& attacks = info.by_piece_[color];
+  TaperedScore res = {0, 0};
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    const int count = popcount(board.pieces(side, static_cast<Piece>(piece)));
+    const int extra =
+        info.mobility_[color][piece] - count * average_mobility[piece];
+    res += {mobility_weights[piece].mg_ * extra,
+            mobility_weights[piece].eg_ * extra};
+    res.mg_ += king_attack_weights[piece] *
+               popcount(attacks[piece] & info.king_zone_[enemy]);
+  }
+  const auto add = [&res](TaperedScore weight, Bitboard targets) {
+    const int count = popcount(targets);
+    res += {weight.mg_ * count, weight.eg_ * count};
+  };
+  const Bitboard majors = board.pieces(enemy_side, Piece::rook) |
+                          board.pieces(enemy_side, Piece::queen);
+  const Bitboard pieces = board.enemies(side) &
+                          ~board.pieces(enemy_side, Piece::pawn) &
+                          ~board.pieces(enemy_side, Piece::king);
+  add(pawn_threat, attacks[static_cast<size_t>(Piece::pawn)] & pieces);
+  add(minor_threat_on_major,
+      (attacks[static_cast<size_t>(Piece::knight)] |
+       attacks[static_cast<size_t>(Piece::bishop)]) &
+          majors);
+  add(rook_threat_on_queen, attacks[static_cast<size_t>(Piece::rook)] &
+                                board.pieces(enemy_side, Piece::queen));
+  add(hanging_piece, info.all_[color] & pieces & ~info.all_[enemy]);
+  return res;
+}
+
+// Blends `score` by the phase of `board`, scales it down for `endgame` if
+// there is one, and returns it for the side to move.
+int blend(const Board& board, TaperedScore score, const Endgame* endgame) {
+  const int phase = game_phase(board);
+  int res = (score.mg_ * phase + score.eg_ * (max_phase - phase)) / max_phase;
+  if (endgame && (res > 0) == (endgame->strong_side_ == Color::white)) {
+    res = res * endgame->scale_(board, endgame->strong_side_) / normal_scale;
+  }
+  return board.is_whites_move_ ? res : -res;
+}
+
+// Returns the score of the evaluator of `endgame` for the side to move.
+int evaluate_endgame(const Board& board, const Endgame& endgame) {
+  const int res = endgame.evaluate_(board, endgame.strong_side_);
+  return board.is_whites_move_ == (endgame.strong_side_ == Color::white)
+             ? res
+             : -res;
+}
+}  // namespace.
+
+TaperedScore compute_psqt(const Board& board) {
+  TaperedScore res = {0, 0};
+  for (Color color : {Color::white, Color::black}) {
+    for (size_t piece_idx = 0; piece_idx < num_piece_types; ++piece_idx) {
+      const Piece piece = static_cast<Piece>(piece_idx);
+      for (Bitboard sq : bitboard_split(board.pieces(color, piece))) {
+        res += psqt_score(color, piece, square_idx(sq));
+      }
+    }
+  }
+  return res;
+}
+
+int game_phase(const Board& board) {
+  const int phase =
+      popcount(board.pieces(Piece::knight) | board.pieces(Piece::bishop)) +
+      2 * popcount(board.pieces(Piece::rook)) +
+      4 * popcount(board.pieces(Piece::queen));
+  return std::min(phase, max_phase);
+}
+
+TaperedScore evaluate_attacks(const Board& board, const AttackInfo& info) {
+  TaperedScore res = side_attack_score(board, info, Color::white);
+  res -= side_attack_score(board, info, Color::black);
+  return res;
+}
+
+int evaluate(const Board& board, PawnTable* pawn_table) {
+  const Endgame* endgame = find_endgame(board);
+  if (endgame && endgame->evaluate_) {
+    return evaluate_endgame(board, *endgame);
+  }
+  return evaluate(board, AttackInfo(board), pawn_table);
+}
+
+int evaluate(const Board& board, const AttackInfo& info,
+             PawnTable* pawn_table) {
+  const Endgame* endgame = find_endgame(board);
+  if (endgame && endgame->evaluate_) {
+    return evaluate_endgame(board, *endgame);
+  }
+  TaperedScore score = board.psqt_;
+  score += pawn_table ? pawn_table->probe(board).score_
+                      : evaluate_pawns(board).score_;
+  score += evaluate_attacks(board, info);
+  return blend(board, score, endgame);
+}
+
+int evaluate(const Board& board, PawnTable* pawn_table, int alpha, int beta,
+             bool* is_exact) {
+  *is_exact = true;
+  const Endgame* endgame = find_endgame(board);
+  if (endgame && endgame->evaluate_) {
+    return evaluate_endgame(board, *endgame);
+  }
+  TaperedScore score = board.psqt_;
+  score += pawn_table ? pawn_table->probe(board).score_
+                      : evaluate_pawns(board).score_;
+  const int cheap = blend(board, score, endgame);
+  if (cheap - lazy_eval_margin >= beta || cheap + lazy_eval_margin <= alpha) {
+    *is_exact = false;
+    return cheap;
+  }
+  score += evaluate_attacks(board, AttackInfo(board));
+  return blend(board, score, endgame);
+}
+
+int evaluate(const Board& board, AccumulatorStack* accumulators) {
+  const Endgame* endgame = find_endgame(board);
+  if (endgame && endgame->evaluate_) {
+    return evaluate_endgame(board, *endgame);
+  }
+  return nnue_output(accumulators->network(), accumulators->top(board),
+                     board.is_whites_move_ ? Color::white : Color::black);
+}
+
+EvalTable::EvalTable(size_t num_entries)
+    : entries_(num_entries), num_probes_(0), num_hits_(0) {
+  ABSL_RAW_CHECK(num_entries > 0 && (num_entries & (num_entries - 1)) == 0,
+                 "The number of eval table entries must be a power of two.");
+  clear();
+}
+
+absl::optional<int> EvalTable::probe(uint64_t key) {
+  ++num_probes_;
+  const Entry& entry = entries_[key & (entries_.size() - 1)];
+  if (entry.key_ != key || key == 0) {
+    return absl::nullopt;
+  }
+  ++num_hits_;
+  return entry.score_;
+}
+
+void EvalTable::store(uint64_t key, int score) {
+  entries_[key & (entries_.size() - 1)] = {key, score};
+}
+
+void EvalTable::prefetch(uint64_t key) const {
+  __builtin_prefetch(&entries_[key & (entries_.size() - 1)]);
+}
+
+void EvalTable::clear() {
+  for (Entry& entry : entries_) {
+    entry = {0, 0};
+  }
+  num_probes_ = 0;
+  num_hits_ = 0;
+}
@@ -0,0 +1,290 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "memory_accounting.h"
+#include "nnue.h"
+#include "pawns.h"
+
+// A tapered evaluation of material and piece-square tables. Every piece is
+// worth a middlegame and an endgame value that depend on its square, and the
+// two sums are blended by the game phase, which goes from `max_phase` with
+// every minor piece, rook and queen on the board down to 0 with only kings and
+// pawns left. The values are those of PeSTO (Ronald Friederich), which were
+// tuned for exactly this evaluation.
+//
+// The sums are kept in `Board::psqt_` by the do_*_move methods, the same way
+// as the Zobrist key, so that evaluating a leaf takes a few popcounts for the
+// phase and one blend rather than a scan over the pieces. The pawn structure
+// terms (see pawns.h) come from a cache. Mobility, king attacks and threats
+// come from the attacks of the pieces (see `AttackInfo`), which the legal move
+// generator can take over. Endgames that this gets wrong have an evaluation or
+// a scale of their own (see endgame.h).
+
+// The phase of the starting position. A knight or bishop counts 1, a rook 2
+// and a queen 4.
+constexpr int max_phase = 24;
+
+namespace eval_internal {
+// Indexed by Piece. The king is always on the board, so its material is 0.
+constexpr std::array<int, num_piece_types> middlegame_values = {
+    82, 477, 337, 365, 1025, 0};
+constexpr std::array<int, num_piece_types> endgame_values = {
+    94, 512, 281, 297, 936, 0};
+
+// The piece-square tables of each Piece for white, laid out like a diagram:
+// a8 first and h1 last.
+typedef std::array<std::array<int, 64>, num_piece_types> Tables;
+constexpr Tables middlegame_tables = {{
+    // Pawn
+    {{
+           0,    0,    0,    0,    0,    0,    0,    0,
+          98,  134,   61,   95,   68,  126,   34,  -11,
+          -6,    7,   26,   31,   65,   56,   25,  -20,
+         -14,   13,    6,   21,   23,   12,   17,  -23,
+         -27,   -2,   -5,   12,   17,    6,   10,  -25,
+         -26,   -4,   -4,  -10,    3,    3,   33,  -12,
+         -35,   -1,  -20,  -23,  -15,   24,   38,  -22,
+           0,    0,    0,    0,    0,    0,    0,    0,
+    }},
+    // Rook
+    {{
+          32,   42,   32,   51,   63,    9,   31,   43,
+          27,   32,   58,   62,   80,   67,   26,   44,
+          -5,   19,   26,   36,   17,   45,   61,   16,
+         -24,  -11,    7,   26,   24,   35,   -8,  -20,
+         -36,  -26,  -12,   -1,    9,   -7,    6,  -23,
+         -45,  -25,  -16,  -17,    3,    0,   -5,  -33,
+         -44,  -16,  -20,   -9,   -1,   11,   -6,  -71,
+         -19,  -13,    1,   17,   16,    7,  -37,  -26,
+    }},
+    // Knight
+    {{
+        -167,  -89,  -34,  -49,   61,  -97,  -15, -107,
+         -73,  -41,   72,   36,   23,   62,    7,  -17,
+         -47,   60,   37,   65,   84,  129,   73,   44,
+          -9,   17,   19,   53,   37,   69,   18,   22,
+         -13,    4,   16,   13,   28,   19,   21,   -8,
+         -23,   -9,   12,   10,   19,   17,   25,  -16,
+         -29,  -53,  -12,   -3,   -1,   18,  -14,  -19,
+        -105,  -21,  -58,  -33,  -17,  -28,  -19,  -23,
+    }},
+    // Bishop
+    {{
+         -29,    4,  -82,  -37,  -25,  -42,    7,   -8,
+         -26,   16,  -18,  -13,   30,   59,   18,  -47,
+         -16,   37,   43,   40,   35,   50,   37,   -2,
+          -4,    5,   19,   50,   37,   37,    7,   -2,
+          -6,   13,   13,   26,   34,   12,   10,    4,
+           0,   15,   15,   15,   14,   27,   18,   10,
+           4,   15,   16,    0,    7,   21,   33,    1,
+         -33,   -3,  -14,  -21,  -13,  -12,  -39,  -21,
+    }},
+    // Queen
+    {{
+         -28,    0,   29,   12,   59,   44,   43,   45,
+         -24,  -39,   -5,    1,  -16,   57,   28,   54,
+         -13,  -17,    7,    8,   29,   56,   47,   57,
+         -27,  -27,  -16,  -16,   -1,   17,   -2,    1,
+          -9,  -26,   -9,  -10,   -2,   -4,    3,   -3,
+         -14,    2,  -11,   -2,   -5,    2,   14,    5,
+         -35,   -8,   11,    2,    8,   15,   -3,    1,
+          -1,  -18,   -9,   10,  -15,  -25,  -31,  -50,
+    }},
+    // King
+    {{
+         -65,   23,   16,  -15,  -56,  -34,    2,   13,
+          29,   -1,  -20,   -7,   -8,   -4,  -38,  -29,
+          -9,   24,    2,  -16,  -20,    6,   22,  -22,
+         -17,  -20,  -12,  -27,  -30,  -25,  -14,  -36,
+         -49,   -1,  -27,  -39,  -46,  -44,  -33,  -51,
+         -14,  -14,  -22,  -46,  -44,  -30,  -15,  -27,
+           1,    7,   -8,  -64,  -43,  -16,    9,    8,
+         -15,   36,   12,  -54,    8,  -28,   24,   14,
+    }},
+}};
+constexpr Tables endgame_tables = {{
+    // Pawn
+    {{
+           0,    0,    0,    0,    0,    0,    0,    0,
+         178,  173,  158,  134,  147,  132,  165,  187,
+          94,  100,   85,   67,   56,   53,   82,   84,
+          32,   24,   13,    5,   -2,    4,   17,   17,
+          13,    9,   -3,   -7,   -7,   -8,    3,   -1,
+           4,    7,   -6,    1,    0,   -5,   -1,   -8,
+          13,    8,    8,   10,   13,    0,    2,   -7,
+           0,    0,    0,    0,    0,    0,    0,    0,
+    }},
+    // Rook
+    {{
+          13,   10,   18,   15,   12,   12,    8,    5,
+          11,   13,   13,   11,   -3,    3,    8,    3,
+           7,    7,    7,    5,    4,   -3,   -5,   -3,
+           4,    3,   13,    1,    2,    1,   -1,    2,
+           3,    5,    8,    4,   -5,   -6,   -8,  -11,
+          -4,    0,   -5,   -1,   -7,  -12,   -8,  -16,
+          -6,   -6,    0,    2,   -9,   -9,  -11,   -3,
+          -9,    2,    3,   -1,   -5,  -13,    4,  -20,
+    }},
+    // Knight
+    {{
+         -58,  -38,  -13,  -28,  -31,  -27,  -63,  -99,
+         -25,   -8,  -25,   -2,   -9,  -25,  -24,  -52,
+         -24,  -20,   10,    9,   -1,   -9,  -19,  -41,
+         -17,    3,   22,   22,   22,   11,    8,  -18,
+         -18,   -6,   16,   25,   16,   17,    4,  -18,
+         -23,   -3,   -1,   15,   10,   -3,  -20,  -22,
+         -42,  -20,  -10,   -5,   -2,  -20,  -23,  -44,
+         -29,  -51,  -23,  -15,  -22,  -18,  -50,  -64,
+    }},
+    // Bishop
+    {{
+         -14,  -21,  -11,   -8,   -7,   -9,  -17,  -24,
+          -8,   -4,    7,  -12,   -3,  -13,   -4,  -14,
+           2,   -8,    0,   -1,   -2,    6,    0,    4,
+          -3,    9,   12,    9,   14,   10,    3,    2,
+          -6,    3,   13,   19,    7,   10,   -3,   -9,
+         -12,   -3,    8,   10,   13,    3,   -7,  -15,
+         -14,  -18,   -7,   -1,    4,   -9,  -15,  -27,
+         -23,   -9,  -23,   -5,   -9,  -16,   -5,  -17,
+    }},
+    // Queen
+    {{
+          -9,   22,   22,   27,   27,   19,   10,   20,
+         -17,   20,   32,   41,   58,   25,   30,    0,
+         -20,    6,    9,   49,   47,   35,   19,    9,
+           3,   22,   24,   45,   57,   40,   57,   36,
+         -18,   28,   19,   47,   31,   34,   39,   23,
+         -16,  -27,   15,    6,    9,   17,   10,    5,
+         -22,  -23,  -30,  -16,  -16,  -23,  -36,  -32,
+         -33,  -28,  -22,  -43,   -5,  -32,  -20,  -41,
+    }},
+    // King
+    {{
+         -74,  -35,  -18,  -18,  -11,   15,    4,  -17,
+         -12,   17,   14,   17,   17,   38,   23,   11,
+          10,   17,   23,   15,   20,   45,   44,   13,
+          -8,   22,   24,   27,   26,   33,   26,    3,
+         -18,   -4,   21,   24,   27,   23,    9,  -11,
+         -19,   -3,   11,   21,   23,   16,    7,   -9,
+         -27,  -11,    4,   13,   14,    4,   -5,  -17,
+         -53,  -34,  -21,  -11,  -28,  -14,  -24,  -43,
+    }},
+}};
+
+// Indexed by [2 * piece + color][square index], like the Zobrist keys.
+typedef std::array<std::array<TaperedScore, 64>, 2 * num_piece_types>
+    PsqtScores;
+
+constexpr PsqtScores make_psqt_scores() {
+  PsqtScores res = {};
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    for (size_t sq_idx = 0; sq_idx < 64; ++sq_idx) {
+      // Square indices run from h1 to a8, the tables from a8 to h1, and black
+      // reads them upside down.
+      const size_t file = 7 - sq_idx % 8;
+      const size_t rank = sq_idx / 8;
+      const size_t white_idx = (7 - rank) * 8 + file;
+      const size_t black_idx = rank * 8 + file;
+      res[2 * piece][sq_idx] = {
+          middlegame_values[piece] + middlegame_tables[piece][white_idx],
+          endgame_values[piece] + endgame_tables[piece][white_idx]};
+      res[2 * piece + 1][sq_idx] = {
+          -middlegame_values[piece] - middlegame_tables[piece][black_idx],
+          -endgame_values[piece] - endgame_tables[piece][black_idx]};
+    }
+  }
+  return res;
+}
+
+constexpr PsqtScores psqt_scores = make_psqt_scores();
+}  // namespace eval_internal
+
+// The material plus piece-square value of `piece` of `color` on the square
+// with index `sq_idx`, from white's point of view, so negative for black.
+constexpr TaperedScore psqt_score(Color color, Piece piece, int sq_idx) {
+  return eval_internal::psqt_scores[2 * static_cast<size_t>(piece) +
+                                    static_cast<size_t>(color)]
+                                   [static_cast<size_t>(sq_idx)];
+}
+
+// Computes `Board::psqt_` from scratch.
+TaperedScore compute_psqt(const Board& board);
+
+// Returns the game phase of `board`, at most `max_phase` even with promoted
+// pieces on the board.
+int game_phase(const Board& board);
+
+// The terms that come from the attacks of `info`, the attacks of `board`, from
+// white's point of view: the mobility of the knights, bishops, rooks and
+// queens, the attacks on the squares around the enemy king, and threats on
+// pieces attacked by pawns or by cheaper pieces or attacked and undefended.
+TaperedScore evaluate_attacks(const Board& board, const AttackInfo& info);
+
+// Returns the static evaluation of `board` in centipawns for the side to move:
+// the piece-square sums plus the pawn structure, which is looked up in
+// `pawn_table` if it isn't null, and the attack terms, unless the endgame has
+// an evaluator of its own.
+int evaluate(const Board& board, PawnTable* pawn_table = nullptr);
+// Same, with the attacks of `board` already computed in `info`.
+int evaluate(const Board& board, const AttackInfo& info,
+             PawnTable* pawn_table);
+
+// The most the attack terms are taken to move the evaluation. They stay
+// under 130 centipawns in 99% of the positions of random playouts.
+constexpr int lazy_eval_margin = 150;
+// Same as `evaluate(board, pawn_table)`, except that when the score without
+// the attack terms is `lazy_eval_margin` or more below `alpha` or above
+// `beta`, that score is returned and `*is_exact` set to false: the attack
+// terms take most of the time, and they wouldn't bring the score into the
+// window. Such a score is only good as a bound for the window it was asked
+// with, so it shouldn't be cached.
+int evaluate(const Board& board, PawnTable* pawn_table, int alpha, int beta,
+             bool* is_exact);
+// Same, with the output of the network of `accumulators` in place of the
+// piece-square sums and the pawn structure. `board` must be the position at
+// the top of `accumulators`, whose accumulator is only brought up to date if
+// the network is needed.
+int evaluate(const Board& board, AccumulatorStack* accumulators);
+
+// A cache of static evaluations keyed by the Zobrist key, for the positions
+// that transpositions and re-searches evaluate again. It is direct-mapped: a
+// store replaces whatever the slot of its key held. Each searcher owns one, so
+// it needs no locking.
+class EvalTable {
+ public:
+  static constexpr size_t default_num_entries = size_t{1} << 14;
+
+  // `num_entries` must be a power of two.
+  explicit EvalTable(size_t num_entries = default_num_entries);
+
+  // Returns the evaluation stored for `key`, or nullopt.
+  absl::optional<int> probe(uint64_t key);
+  void store(uint64_t key, int score);
+  // Starts loading the slot of `key` into the cache.
+  void prefetch(uint64_t key) const;
+  void clear();
+
+  uint64_t num_probes() const { return num_probes_; }
+  uint64_t num_hits() const { return num_hits_; }
+
+ private:
+  struct Entry {
+    uint64_t key_;
+    int score_;
+  };
+
+  // Empty entries have key 0 and no position is taken to have that key, the
+  // same bet the transposition table makes on its verification bits.
+  TaggedVector<Entry, MemoryTag::eval_tables> entries_;
+  uint64_t num_probes_;
+  uint64_t num_hits_;
+};
+
+#endif
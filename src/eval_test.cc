@@ -0,0 +1,173 @@
+#include "eval.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Returns `fen` with the colors swapped and the board turned upside down, which
+// the evaluation must not tell apart from `fen` from the side to move's point
+// of view. Only the piece placement and the side to move are kept.
+std::string mirror_fen(const std::string& fen) {
+  const size_t pieces_end = fen.find(' ');
+  std::string pieces = fen.substr(0, pieces_end);
+  std::vector<std::string> ranks;
+  size_t begin = 0;
+  while (begin <= pieces.size()) {
+    const size_t end = std::min(pieces.find('/', begin), pieces.size());
+    ranks.push_back(pieces.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  std::reverse(ranks.begin(), ranks.end());
+  std::string res;
+  for (const std::string& rank : ranks) {
+    if (!res.empty()) {
+      res += '/';
+    }
+    for (char c : rank) {
+      res += std::isupper(c) ? static_cast<char>(std::tolower(c))
+                             : static_cast<char>(std::toupper(c));
+    }
+  }
+  return res + (fen[pieces_end + 1] == 'w' ? " b - - 0 1" : " w - - 0 1");
+}
+
+// Checks the incremental sums against a fresh computation at every node of the
+// tree below `board`.
+void expect_psqt_matches(Board* board, int depth) {
+  EXPECT_EQ(board->psqt_, compute_psqt(*board));
+  if (depth == 0) {
+    return;
+  }
+  UndoInfo undo;
+  for (Move move : board->legal_moves()) {
+    board->do_move(move, &undo);
+    expect_psqt_matches(board, depth - 1);
+    board->undo_move(move, undo);
+  }
+}
+}  // namespace.
+
+TEST(Evaluate, StartPositionIsEven) {
+  EXPECT_EQ(evaluate(Board()), 0);
+  EXPECT_EQ(game_phase(Board()), max_phase);
+}
+
+TEST(Evaluate, MirroredPositionsScoreTheSame) {
+  for (const std::string& fen :
+       {std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w - - 0 1"),
+        std::string("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - 0 1"),
+        std::string("4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1")}) {
+    EXPECT_EQ(evaluate(Board(fen)), evaluate(Board(mirror_fen(fen)))) << fen;
+  }
+}
+
+TEST(Evaluate, CountsMaterialForTheSideToMove) {
+  const Board white_to_move("4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1");
+  EXPECT_LT(evaluate(white_to_move), -300);
+  EXPECT_EQ(evaluate(Board("4k3/8/8/3q4/8/8/8/3RK3 b - - 0 1")),
+            -evaluate(white_to_move));
+}
+
+TEST(Evaluate, TapersToTheEndgame) {
+  // Only pawns, so the endgame values alone count, and they like the pawn
+  // about to promote much more than the middlegame tables do. A single pawn
+  // would be looked up in the KPK bitbase instead (see endgame.h).
+  const Board board("4k3/1P6/8/8/8/8/P7/4K3 w - - 0 1");
+  EXPECT_EQ(game_phase(board), 0);
+  EXPECT_EQ(evaluate(board),
+            board.psqt_.eg_ + evaluate_pawns(board).score_.eg_);
+  EXPECT_GT(board.psqt_.eg_, board.psqt_.mg_);
+  // Promoted pieces don't push the phase past the start.
+  EXPECT_EQ(game_phase(Board("QQQQkQQQ/8/8/8/8/8/8/4K3 w - - 0 1")), max_phase);
+}
+
+TEST(Evaluate, PawnTableGivesTheSameScore) {
+  PawnTable pawn_table(16);
+  for (const std::string& fen :
+       {std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w - - 0 1"),
+        std::string("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - 0 1")}) {
+    const Board board(fen);
+    EXPECT_EQ(evaluate(board, &pawn_table), evaluate(board));
+    EXPECT_EQ(evaluate(board, &pawn_table), evaluate(board));
+  }
+  EXPECT_EQ(pawn_table.num_hits(), 2);
+}
+
+TEST(Evaluate, AttackInfoGivesTheSameScore) {
+  const Board board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w - - 0 1");
+  EXPECT_EQ(evaluate(board, AttackInfo(board), nullptr), evaluate(board));
+}
+
+TEST(Evaluate, LazyEvaluationStopsFarOutsideTheWindow) {
+  const Board board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w - - 0 1");
+  const int full = evaluate(board);
+  bool is_exact;
+  EXPECT_EQ(evaluate(board, nullptr, full - 1, full + 1, &is_exact), full);
+  EXPECT_TRUE(is_exact);
+  // A window far above or below the score gets the cheap part, which is on
+  // the same side of the window as the full score.
+  const int below = evaluate(board, nullptr, full + 1000, full + 1001,
+                             &is_exact);
+  EXPECT_FALSE(is_exact);
+  EXPECT_LE(below + lazy_eval_margin, full + 1000);
+  const int above = evaluate(board, nullptr, full - 1001, full - 1000,
+                             &is_exact);
+  EXPECT_FALSE(is_exact);
+  EXPECT_GE(above - lazy_eval_margin, full - 1000);
+  EXPECT_EQ(above, below);
+}
+
+TEST(EvaluateAttacks, RewardsMobilityAndThreats) {
+  // A knight in the center against one in the corner.
+  const Board centralized("4k3/8/8/8/3N4/8/8/4K3 w - - 0 1");
+  const Board cornered("4k3/8/8/8/8/8/8/N3K3 w - - 0 1");
+  EXPECT_EQ(AttackInfo(centralized).mobility_[0][static_cast<size_t>(
+                Piece::knight)],
+            8);
+  EXPECT_GT(evaluate_attacks(centralized, AttackInfo(centralized)).mg_,
+            evaluate_attacks(cornered, AttackInfo(cornered)).mg_);
+  // A pawn attacking a rook.
+  const Board threat("4k3/8/8/2r5/3P4/8/8/4K3 w - - 0 1");
+  const Board no_threat("4k3/8/8/r7/3P4/8/8/4K3 w - - 0 1");
+  EXPECT_GT(evaluate_attacks(threat, AttackInfo(threat)).eg_,
+            evaluate_attacks(no_threat, AttackInfo(no_threat)).eg_);
+}
+
+TEST(Evaluate, IncrementalSumsMatchFromScratch) {
+  // Castling, en passant, promotions and captures of every piece.
+  for (const std::string& fen :
+       {std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w KQkq - 0 1"),
+        std::string("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w "
+                    "kq - 0 1"),
+        std::string("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1")}) {
+    Board board(fen);
+    expect_psqt_matches(&board, 3);
+  }
+}
+
+TEST(EvalTable, CachesByKey) {
+  EvalTable eval_table(16);
+  const Board board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  EXPECT_FALSE(eval_table.probe(board.key_));
+  eval_table.store(board.key_, 42);
+  EXPECT_EQ(eval_table.probe(board.key_), 42);
+  // A key in the same slot replaces it.
+  eval_table.store(board.key_ + 16, 7);
+  EXPECT_FALSE(eval_table.probe(board.key_));
+  EXPECT_EQ(eval_table.num_probes(), 3);
+  EXPECT_EQ(eval_table.num_hits(), 1);
+  eval_table.clear();
+  EXPECT_FALSE(eval_table.probe(board.key_ + 16));
+  EXPECT_EQ(eval_table.num_hits(), 0);
+}
@@ -0,0 +1,209 @@
+#include "game_analysis.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+
+#include "absl/strings/str_cat.h"
+
+namespace {
+// PGN lines are wrapped before this many characters.
+constexpr size_t max_pgn_line = 80;
+
+MoveJudgement judge(int loss, const GameAnalysisOptions& options) {
+  if (loss >= options.blunder_loss_) {
+    return MoveJudgement::blunder;
+  }
+  if (loss >= options.mistake_loss_) {
+    return MoveJudgement::mistake;
+  }
+  if (loss >= options.inaccuracy_loss_) {
+    return MoveJudgement::inaccuracy;
+  }
+  return MoveJudgement::none;
+}
+
+// Returns `score` as a PGN comment shows it: in pawns with a sign, or "#n"
+// for a mate in n moves, negative when Black mates.
+std::string score_to_comment(int score) {
+  if (!is_mate_score(score)) {
+    const int centipawns = std::abs(score);
+    return absl::StrCat(score < 0 ? "-" : "+", centipawns / 100, ".",
+                        absl::Dec(centipawns % 100, absl::kZeroPad2));
+  }
+  const int plies = mate_score - std::abs(score);
+  const int moves = (plies + 1) / 2;
+  return absl::StrCat("#", score > 0 ? moves : -moves);
+}
+
+// Appends `token` to `*out`, starting a new line if the current one would
+// grow too long.
+void append_token(absl::string_view token, std::string* out) {
+  const size_t line_start = out->rfind('\n') + 1;
+  if (out->size() > line_start) {
+    if (out->size() - line_start + 1 + token.size() >= max_pgn_line) {
+      out->push_back('\n');
+    } else {
+      out->push_back(' ');
+    }
+  }
+  out->append(token.data(), token.size());
+}
+}  // namespace.
+
+GameAnalyzer::GameAnalyzer(const GameAnalysisOptions& options,
+                           const NnueNetwork* network)
+    : options_(options), table_(options.hash_mb_), searcher_(&table_) {
+  searcher_.set_network(network);
+}
+
+GameAnalysis GameAnalyzer::analyze(const PgnGame& game) {
+  GameAnalysis res = {{}, 0, nullptr, 0};
+  boards_.clear();
+  moves_.clear();
+  res.error_ = replay_game(game, [this](const Board& board, Move move) {
+    boards_.push_back(board);
+    moves_.push_back(move);
+  });
+  // The position after the last move read, which is searched too for the
+  // score of the last move.
+  Board last;
+  if (!moves_.empty()) {
+    last = boards_.back();
+    last.do_move(moves_.back());
+  } else if (const absl::optional<Board> start = game.start_position()) {
+    last = *start;
+  } else {
+    return res;
+  }
+  boards_.push_back(last);
+
+  history_.reset(boards_[0]);
+  history_.reserve(boards_.size());
+  for (size_t i = 1; i < boards_.size(); ++i) {
+    history_.push(boards_[i]);
+  }
+  table_.clear();
+  searcher_.clear();
+  table_.new_search();
+  const SearchLimits limits = {options_.max_depth_, options_.max_nodes_,
+                               nullptr, nullptr};
+  res.moves_.resize(moves_.size());
+  for (size_t i = boards_.size(); i-- > 0;) {
+    searcher_.set_game_history(history_);
+    const SearchResult searched =
+        searcher_.search_iterations(boards_[i], 1, limits, nullptr);
+    res.nodes_ += searched.nodes_;
+    if (i == moves_.size()) {
+      res.final_score_ = searched.score_;
+    } else {
+      MoveAnalysis& analysis = res.moves_[i];
+      analysis.move_ = moves_[i];
+      // Without a completed iteration, the move played stands for the best.
+      analysis.best_move_ = searched.best_move_.value_or(moves_[i]);
+      analysis.best_pv_ = searched.pv_;
+      analysis.best_score_ = searched.score_;
+    }
+    if (i > 0) {
+      res.moves_[i - 1].played_score_ = -searched.score_;
+      history_.pop();
+    }
+  }
+
+  for (MoveAnalysis& analysis : res.moves_) {
+    const auto capped = [](int score) {
+      return std::max(-judged_score_cap, std::min(score, judged_score_cap));
+    };
+    analysis.loss_ =
+        analysis.move_ == analysis.best_move_
+            ? 0
+            : std::max(0, capped(analysis.best_score_) -
+                              capped(analysis.played_score_));
+    analysis.judgement_ = judge(analysis.loss_, options_);
+  }
+  return res;
+}
+
+std::vector<GameAnalysis> analyze_games(const std::vector<PgnGame>& games,
+                                        const GameAnalysisOptions& options,
+                                        const NnueNetwork* network,
+                                        ThreadPool* pool) {
+  std::vector<GameAnalysis> res(games.size());
+  if (!pool) {
+    GameAnalyzer analyzer(options, network);
+    for (size_t i = 0; i < games.size(); ++i) {
+      res[i] = analyzer.analyze(games[i]);
+    }
+    return res;
+  }
+  // The longest games are submitted first, so that the last games to finish
+  // are short ones and the workers run out of work at about the same time.
+  std::vector<size_t> order(games.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&games](size_t a, size_t b) {
+    return games[a].movetext_.size() > games[b].movetext_.size();
+  });
+  // Made by each worker as it takes its first game, and only used by it.
+  std::vector<std::unique_ptr<GameAnalyzer>> analyzers(pool->num_threads());
+  for (size_t game_idx : order) {
+    pool->submit([&, game_idx] {
+      std::unique_ptr<GameAnalyzer>& analyzer =
+          analyzers[*pool->worker_index()];
+      if (!analyzer) {
+        analyzer = std::make_unique<GameAnalyzer>(options, network);
+      }
+      res[game_idx] = analyzer->analyze(games[game_idx]);
+    });
+  }
+  pool->wait();
+  return res;
+}
+
+void append_annotated_game(const PgnGame& game, const GameAnalysis& analysis,
+                           std::string* out) {
+  for (const PgnTag& tag : game.tags_) {
+    absl::StrAppend(out, "[", tag.name_, " \"", tag.value_, "\"]\n");
+  }
+  out->push_back('\n');
+  const absl::optional<Board> start = game.start_position();
+  if (analysis.error_ || !start) {
+    absl::StrAppend(out, game.movetext_, "\n\n");
+    return;
+  }
+  Board board = *start;
+  std::string token;
+  for (const MoveAnalysis& move : analysis.moves_) {
+    // Every move is after a comment but the first, so Black's moves are
+    // numbered too. A move is kept on the line of its number and NAG.
+    token = absl::StrCat(board.num_moves_,
+                         board.is_whites_move_ ? ". " : "... ");
+    append_san(board, move.move_, &token);
+    switch (move.judgement_) {
+      case MoveJudgement::none:
+        break;
+      case MoveJudgement::inaccuracy:
+        token.append(" $6");
+        break;
+      case MoveJudgement::mistake:
+        token.append(" $2");
+        break;
+      case MoveJudgement::blunder:
+        token.append(" $4");
+        break;
+    }
+    append_token(token, out);
+    const int white_score =
+        board.is_whites_move_ ? move.played_score_ : -move.played_score_;
+    token = absl::StrCat("{", score_to_comment(white_score));
+    if (move.judgement_ != MoveJudgement::none) {
+      absl::StrAppend(&token, "; best ");
+      append_san(board, move.best_move_, &token);
+    }
+    token.push_back('}');
+    append_token(token, out);
+    board.do_move(move.move_);
+  }
+  append_token(game.result_.empty() ? "*" : game.result_, out);
+  out->append("\n\n");
+}
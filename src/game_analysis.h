@@ -0,0 +1,113 @@
+#ifndef GAME_ANALYSIS_H
+#define GAME_ANALYSIS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "repetition.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// How deep the positions of a game are searched and how the moves are judged.
+struct GameAnalysisOptions {
+  // Each position is searched to this depth, at least 1 and less than
+  // `max_search_ply`, or until it has visited `max_nodes_` nodes if that
+  // comes first. No node limit if 0.
+  int max_depth_ = 12;
+  uint64_t max_nodes_ = 0;
+  size_t hash_mb_ = 16;
+  // How many centipawns worse than the best move a move must be to count as
+  // an inaccuracy, a mistake or a blunder.
+  int inaccuracy_loss_ = 50;
+  int mistake_loss_ = 100;
+  int blunder_loss_ = 200;
+};
+
+enum class MoveJudgement { none, inaccuracy, mistake, blunder };
+
+// Scores more than this far from 0, mates among them, are counted as this
+// much when judging a move, so that a move that keeps a won position won
+// isn't a blunder for taking longer to win.
+constexpr int judged_score_cap = 1000;
+
+// A move of a game, with the scores of the side that played it.
+struct MoveAnalysis {
+  Move move_;
+  // What the search found in the position before the move: its best move,
+  // which may be the one played, the principal variation it begins and its
+  // score.
+  Move best_move_;
+  std::vector<Move> best_pv_;
+  int best_score_;
+  // The score of the position after the move, that of its own search.
+  int played_score_;
+  // How many centipawns the move gave away against the best move, with the
+  // scores capped at `judged_score_cap`, and 0 if it is the best move.
+  int loss_;
+  MoveJudgement judgement_;
+};
+
+struct GameAnalysis {
+  // The moves up to the first that can't be read.
+  std::vector<MoveAnalysis> moves_;
+  // The score of the position after the last of them, for its side to move.
+  int final_score_;
+  // Null, or what is wrong with the game, as `replay_game` says.
+  const char* error_;
+  uint64_t nodes_;
+};
+
+// Analyses whole games for annotation. The positions of a game are searched
+// from the last one back to the first, with one table for the whole game and
+// one generation of it, so that the search of each position finds the
+// entries of the positions after it: the lines the game went on to play are
+// mostly in the table already, and the searches of the early positions cost
+// a fraction of what they would from an empty table.
+//
+// The table and the searcher are cleared at the start of every game, so a
+// game's analysis doesn't depend on the games before it, and the same game
+// and options always give the same analysis.
+class GameAnalyzer {
+ public:
+  // `network` isn't owned; the classical evaluation is used if it is null.
+  GameAnalyzer(const GameAnalysisOptions& options,
+               const NnueNetwork* network);
+  GameAnalyzer(const GameAnalyzer&) = delete;
+  GameAnalyzer& operator=(const GameAnalyzer&) = delete;
+
+  GameAnalysis analyze(const PgnGame& game);
+
+ private:
+  const GameAnalysisOptions options_;
+  TranspositionTable table_;
+  Searcher searcher_;
+  // The positions before each move and the moves of the game, kept from one
+  // game to the next so that they don't allocate.
+  std::vector<Board> boards_;
+  std::vector<Move> moves_;
+  KeyHistory history_;
+};
+
+// Analyses `games`, many at once on the workers of `pool`, or one after the
+// other on the calling thread if it is null. Each worker analyses whole games
+// with a `GameAnalyzer` of its own, and so a table of `hash_mb_` megabytes.
+// The analyses are in the order of the games.
+std::vector<GameAnalysis> analyze_games(const std::vector<PgnGame>& games,
+                                        const GameAnalysisOptions& options,
+                                        const NnueNetwork* network,
+                                        ThreadPool* pool);
+
+// Appends `game` to `out` as PGN, its moves annotated with `analysis`: each
+// with the score after it from White's side, in pawns or as "#n" for a mate
+// in n moves, and the inaccuracies, mistakes and blunders with the NAGs $6,
+// $2 and $4 and the best move. A game with an error is appended as it was.
+void append_annotated_game(const PgnGame& game, const GameAnalysis& analysis,
+                           std::string* out);
+
+#endif
@@ -0,0 +1,118 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "game_analysis.h"
+#include "mapped_file.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "thread_pool.h"
+
+// Usage: game_analysis [--threads <n>] [--depth <n>] [--nodes <n>]
+//                      [--hash <mb>] [--eval-file <path>] <pgn>
+//
+// Analyses the games of a PGN file (see game_analysis.h) and writes them to
+// stdout, annotated with the score after every move and the inaccuracies,
+// mistakes and blunders. Each position is searched to depth 12 or --depth,
+// stopping early at --nodes nodes. The games are analysed on --threads
+// threads, one per hardware thread by default, each with a table of 16 MB
+// or --hash megabytes, and with the classical evaluation or the network of
+// --eval-file.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--threads <n>] [--depth <n>] [--nodes <n>] [--hash <mb>]"
+               " [--eval-file <path>] <pgn>\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  size_t num_threads = 0;
+  GameAnalysisOptions options;
+  std::string eval_file;
+  int arg_idx = 1;
+  for (; arg_idx + 1 < argc && std::strncmp(argv[arg_idx], "--", 2) == 0;
+       arg_idx += 2) {
+    const char* const flag = argv[arg_idx];
+    const char* const value = argv[arg_idx + 1];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &num_threads);
+    } else if (std::strcmp(flag, "--depth") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.max_depth_) &&
+                 options.max_depth_ >= 1 &&
+                 options.max_depth_ < max_search_ply;
+    } else if (std::strcmp(flag, "--nodes") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.max_nodes_);
+    } else if (std::strcmp(flag, "--hash") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.hash_mb_) &&
+                 options.hash_mb_ >= 1;
+    } else if (std::strcmp(flag, "--eval-file") == 0) {
+      eval_file = value;
+      is_valid = true;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (arg_idx + 1 != argc) {
+    return usage(argv[0]);
+  }
+  const MappedFile pgn(argv[arg_idx]);
+  if (!pgn.data()) {
+    std::cerr << "Can't open " << argv[arg_idx] << '\n';
+    return 1;
+  }
+  NetworkPtr network;
+  if (!eval_file.empty()) {
+    std::string error;
+    network = load_network(eval_file, &error);
+    if (!network) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<PgnGame> games;
+  PgnReader reader(absl::string_view(pgn.data(), pgn.size()));
+  PgnGame game;
+  while (reader.next(&game)) {
+    games.push_back(game);
+  }
+  ThreadPool pool(num_threads);
+  const std::vector<GameAnalysis> analyses =
+      analyze_games(games, options, network.get(), &pool);
+
+  std::string out;
+  uint64_t num_nodes = 0;
+  uint64_t num_errors = 0;
+  uint64_t num_blunders = 0;
+  for (size_t i = 0; i < games.size(); ++i) {
+    append_annotated_game(games[i], analyses[i], &out);
+    num_nodes += analyses[i].nodes_;
+    num_errors += analyses[i].error_ != nullptr;
+    for (const MoveAnalysis& move : analyses[i].moves_) {
+      num_blunders += move.judgement_ == MoveJudgement::blunder;
+    }
+  }
+  std::cout << out;
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cerr << "Games: " << games.size() << '\n';
+  std::cerr << "Unreadable games: " << num_errors << '\n';
+  std::cerr << "Blunders: " << num_blunders << '\n';
+  std::cerr << "Nodes searched: " << num_nodes << '\n';
+  std::cerr << "Time: " << elapsed.count() << " s\n";
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include "game_analysis.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+#include "pgn.h"
+#include "search.h"
+#include "thread_pool.h"
+
+namespace {
+constexpr char scholars_mate[] =
+    "[Event \"Scholar's mate\"]\n"
+    "[Result \"1-0\"]\n"
+    "\n"
+    "1. e4 e5 2. Bc4 Nc6 3. Qh5 Nf6 4. Qxf7# 1-0\n"
+    "\n";
+
+std::vector<PgnGame> read_games(absl::string_view text) {
+  std::vector<PgnGame> games;
+  PgnReader reader(text);
+  PgnGame game;
+  while (reader.next(&game)) {
+    games.push_back(game);
+  }
+  return games;
+}
+
+GameAnalysisOptions shallow_options() {
+  GameAnalysisOptions options;
+  options.max_depth_ = 4;
+  options.hash_mb_ = 1;
+  return options;
+}
+}  // namespace.
+
+TEST(GameAnalyzer, FlagsTheMoveThatAllowsMate) {
+  const std::vector<PgnGame> games = read_games(scholars_mate);
+  ASSERT_EQ(games.size(), 1);
+  GameAnalyzer analyzer(shallow_options(), nullptr);
+  const GameAnalysis analysis = analyzer.analyze(games[0]);
+  EXPECT_EQ(analysis.error_, nullptr);
+  ASSERT_EQ(analysis.moves_.size(), 7);
+  EXPECT_GT(analysis.nodes_, 0);
+
+  // 3... Nf6 lets White mate.
+  const MoveAnalysis& nf6 = analysis.moves_[5];
+  EXPECT_EQ(nf6.judgement_, MoveJudgement::blunder);
+  EXPECT_FALSE(nf6.best_move_ == nf6.move_);
+  EXPECT_EQ(nf6.best_pv_[0], nf6.best_move_);
+  EXPECT_EQ(nf6.played_score_, -mate_score + 1);
+  EXPECT_GE(nf6.loss_, 200);
+
+  // 4. Qxf7# is the best move.
+  const MoveAnalysis& mate = analysis.moves_[6];
+  EXPECT_EQ(mate.best_move_, mate.move_);
+  EXPECT_EQ(mate.best_score_, mate_score - 1);
+  EXPECT_EQ(mate.played_score_, mate_score);
+  EXPECT_EQ(mate.loss_, 0);
+  EXPECT_EQ(mate.judgement_, MoveJudgement::none);
+  EXPECT_EQ(analysis.final_score_, -mate_score);
+}
+
+TEST(GameAnalyzer, StopsAtAnUnreadableMove) {
+  const std::vector<PgnGame> games =
+      read_games("[Event \"Illegal\"]\n\n1. e4 e5 2. Ke3 1-0\n\n");
+  ASSERT_EQ(games.size(), 1);
+  GameAnalyzer analyzer(shallow_options(), nullptr);
+  const GameAnalysis analysis = analyzer.analyze(games[0]);
+  EXPECT_NE(analysis.error_, nullptr);
+  EXPECT_EQ(analysis.moves_.size(), 2);
+
+  std::string out;
+  append_annotated_game(games[0], analysis, &out);
+  EXPECT_EQ(out, "[Event \"Illegal\"]\n\n1. e4 e5 2. Ke3 1-0\n\n");
+}
+
+TEST(AnalyzeGames, AnalysesInParallelAsInOrder) {
+  const std::string text =
+      std::string(scholars_mate) +
+      "[Event \"Queen's gambit\"]\n\n1. d4 d5 2. c4 e6 3. Nc3 Nf6 *\n\n" +
+      "[Event \"Empty\"]\n\n*\n\n" + scholars_mate;
+  const std::vector<PgnGame> games = read_games(text);
+  ASSERT_EQ(games.size(), 4);
+  const std::vector<GameAnalysis> in_order =
+      analyze_games(games, shallow_options(), nullptr, nullptr);
+  ThreadPool pool(2);
+  const std::vector<GameAnalysis> in_parallel =
+      analyze_games(games, shallow_options(), nullptr, &pool);
+  ASSERT_EQ(in_parallel.size(), games.size());
+  EXPECT_EQ(in_parallel[1].moves_.size(), 6);
+  EXPECT_TRUE(in_parallel[2].moves_.empty());
+  for (size_t i = 0; i < games.size(); ++i) {
+    EXPECT_EQ(in_parallel[i].nodes_, in_order[i].nodes_);
+    EXPECT_EQ(in_parallel[i].final_score_, in_order[i].final_score_);
+    ASSERT_EQ(in_parallel[i].moves_.size(), in_order[i].moves_.size());
+    for (size_t j = 0; j < in_order[i].moves_.size(); ++j) {
+      EXPECT_EQ(in_parallel[i].moves_[j].best_move_,
+                in_order[i].moves_[j].best_move_);
+      EXPECT_EQ(in_parallel[i].moves_[j].played_score_,
+                in_order[i].moves_[j].played_score_);
+    }
+  }
+  // The same game gets the same analysis, whatever came before it.
+  EXPECT_EQ(in_parallel[3].nodes_, in_parallel[0].nodes_);
+}
+
+TEST(AppendAnnotatedGame, MarksTheBlunder) {
+  const std::vector<PgnGame> games = read_games(scholars_mate);
+  ASSERT_EQ(games.size(), 1);
+  GameAnalyzer analyzer(shallow_options(), nullptr);
+  std::string out;
+  append_annotated_game(games[0], analyzer.analyze(games[0]), &out);
+  EXPECT_TRUE(absl::StartsWith(
+      out, "[Event \"Scholar's mate\"]\n[Result \"1-0\"]\n\n1. e4 {"))
+      << out;
+  EXPECT_TRUE(absl::StrContains(out, "3... Nf6 $4 {#1; best ")) << out;
+  EXPECT_TRUE(absl::StrContains(out, "4. Qxf7# {#0} 1-0\n\n")) << out;
+
+  // The annotated game reads back as the same moves.
+  const std::vector<PgnGame> annotated = read_games(out);
+  ASSERT_EQ(annotated.size(), 1);
+  std::vector<Move> moves;
+  EXPECT_EQ(replay_game(annotated[0],
+                        [&moves](const Board&, Move move) {
+                          moves.push_back(move);
+                        }),
+            nullptr);
+  EXPECT_EQ(moves.size(), 7);
+}
@@ -0,0 +1,540 @@
+#include "game_archive.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "bulk_io.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+namespace {
+constexpr char magic[8] = {'P', 'G', 'G', 'A', 'M', 'E', 'S', '1'};
+
+// How central each square is, 0 on the edge to 3 in the centre.
+constexpr std::array<int, 64> make_centrality() {
+  std::array<int, 64> res = {};
+  for (int idx = 0; idx < 64; ++idx) {
+    const int file = idx % 8;
+    const int rank = idx / 8;
+    const int file_distance = file < 4 ? 3 - file : file - 4;
+    const int rank_distance = rank < 4 ? 3 - rank : rank - 4;
+    res[static_cast<size_t>(idx)] = 3 - std::max(file_distance, rank_distance);
+  }
+  return res;
+}
+
+constexpr std::array<int, 64> centrality = make_centrality();
+
+// How much each Piece gains from moving to the centre.
+constexpr std::array<int, num_piece_types> centrality_weights = {2, 1, 4, 2,
+                                                                 1, 0};
+
+// Scores `move`, the likely moves higher. This is part of the format: any
+// change to it makes the archives written before decode wrong.
+int move_score(const Board& board, Move move, Bitboard pawn_attacked) {
+  const size_t src = move.src_idx_;
+  const size_t dst = move.dst_idx_;
+  const Piece moving = move.piece_moving_;
+  int res = centrality_weights[static_cast<size_t>(moving)] *
+            (centrality[dst] - centrality[src]);
+  Piece victim = board.mailbox_[dst];
+  if (move.move_type_ == MoveType::en_passant) {
+    victim = Piece::pawn;
+  }
+  if (victim != Piece::none) {
+    res += 10000 + 16 * see_value(victim) -
+           (moving == Piece::king ? 1000 : see_value(moving)) / 16;
+  } else if (move.dst_square() & pawn_attacked) {
+    res -= see_value(moving);
+  }
+  switch (move.move_type_) {
+    case MoveType::promotion_to_queen:
+      res += 20000;
+      break;
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+      res -= 20000 + static_cast<int>(move.move_type_);
+      break;
+    case MoveType::castle_kingside:
+    case MoveType::castle_queenside:
+      res += 3000;
+      break;
+    default:
+      break;
+  }
+  return res;
+}
+
+// The probabilities of an LZMA style binary range coder: the chance of a 0
+// in units of 1 / 2048, moved a 32nd of the way towards each bit coded.
+constexpr int prob_bits = 11;
+constexpr uint32_t prob_one = uint32_t{1} << prob_bits;
+constexpr int adapt_shift = 5;
+constexpr uint32_t top = uint32_t{1} << 24;
+
+// A rank is coded as up to `num_rank_steps` decisions, "is it rank k?" for
+// k from 0, and the ranks past them in 8 more bits.
+constexpr size_t num_rank_steps = 16;
+
+struct RankModel {
+  std::array<uint16_t, num_rank_steps> is_rank_;
+  // A bit tree: the bits of the rest, high first, each with the probability
+  // of the node of the bits before it.
+  std::array<uint16_t, 256> rest_;
+
+  RankModel() {
+    is_rank_.fill(prob_one / 2);
+    rest_.fill(prob_one / 2);
+  }
+};
+
+class RangeEncoder {
+ public:
+  explicit RangeEncoder(std::string* out)
+      : out_(out), low_(0), range_(0xFFFFFFFF), cache_(0), cache_size_(1) {}
+
+  void encode(uint16_t* prob, unsigned bit) {
+    const uint32_t bound = (range_ >> prob_bits) * *prob;
+    if (!bit) {
+      range_ = bound;
+      *prob = static_cast<uint16_t>(*prob +
+                                    ((prob_one - *prob) >> adapt_shift));
+    } else {
+      low_ += bound;
+      range_ -= bound;
+      *prob = static_cast<uint16_t>(*prob - (*prob >> adapt_shift));
+    }
+    while (range_ < top) {
+      range_ <<= 8;
+      shift_low();
+    }
+  }
+
+  void flush() {
+    for (int i = 0; i < 5; ++i) {
+      shift_low();
+    }
+  }
+
+ private:
+  // Writes the top byte of `low_`, held back in `cache_` while a carry may
+  // still add to it.
+  void shift_low() {
+    if (static_cast<uint32_t>(low_) < 0xFF000000 || (low_ >> 32) != 0) {
+      const uint8_t carry = static_cast<uint8_t>(low_ >> 32);
+      uint8_t byte = cache_;
+      do {
+        out_->push_back(static_cast<char>(static_cast<uint8_t>(byte + carry)));
+        byte = 0xFF;
+      } while (--cache_size_ != 0);
+      cache_ = static_cast<uint8_t>(low_ >> 24);
+    }
+    ++cache_size_;
+    low_ = (low_ & 0x00FFFFFF) << 8;
+  }
+
+  std::string* const out_;
+  uint64_t low_;
+  uint32_t range_;
+  uint8_t cache_;
+  uint64_t cache_size_;
+};
+
+class RangeDecoder {
+ public:
+  // Past its end, `data` reads as zeros.
+  explicit RangeDecoder(absl::string_view data)
+      : data_(data), pos_(0), code_(0), range_(0xFFFFFFFF) {
+    for (int i = 0; i < 5; ++i) {
+      code_ = (code_ << 8) | next_byte();
+    }
+  }
+
+  unsigned decode(uint16_t* prob) {
+    const uint32_t bound = (range_ >> prob_bits) * *prob;
+    unsigned bit;
+    if (code_ < bound) {
+      range_ = bound;
+      *prob = static_cast<uint16_t>(*prob +
+                                    ((prob_one - *prob) >> adapt_shift));
+      bit = 0;
+    } else {
+      code_ -= bound;
+      range_ -= bound;
+      *prob = static_cast<uint16_t>(*prob - (*prob >> adapt_shift));
+      bit = 1;
+    }
+    while (range_ < top) {
+      range_ <<= 8;
+      code_ = (code_ << 8) | next_byte();
+    }
+    return bit;
+  }
+
+ private:
+  uint32_t next_byte() {
+    return pos_ < data_.size() ? static_cast<uint8_t>(data_[pos_++]) : 0;
+  }
+
+  const absl::string_view data_;
+  size_t pos_;
+  uint32_t code_;
+  uint32_t range_;
+};
+
+void encode_rank(size_t rank, size_t num_moves, RankModel* model,
+                 RangeEncoder* encoder) {
+  // The last rank is known once the others have been ruled out.
+  size_t step = 0;
+  for (; step < num_rank_steps && step + 1 < num_moves; ++step) {
+    const unsigned is_rank = rank == step;
+    encoder->encode(&model->is_rank_[step], is_rank);
+    if (is_rank) {
+      return;
+    }
+  }
+  if (step + 1 >= num_moves) {
+    return;
+  }
+  const size_t rest = rank - num_rank_steps;
+  size_t node = 1;
+  for (int bit_idx = 7; bit_idx >= 0; --bit_idx) {
+    const unsigned bit = (rest >> bit_idx) & 1;
+    encoder->encode(&model->rest_[node], bit);
+    node = 2 * node + bit;
+  }
+}
+
+size_t decode_rank(size_t num_moves, RankModel* model,
+                   RangeDecoder* decoder) {
+  size_t step = 0;
+  for (; step < num_rank_steps && step + 1 < num_moves; ++step) {
+    if (decoder->decode(&model->is_rank_[step])) {
+      return step;
+    }
+  }
+  if (step + 1 >= num_moves) {
+    return step;
+  }
+  size_t node = 1;
+  for (int bit_idx = 7; bit_idx >= 0; --bit_idx) {
+    node = 2 * node + decoder->decode(&model->rest_[node]);
+  }
+  return num_rank_steps + (node - 256);
+}
+
+int8_t result_code(absl::string_view result) {
+  if (result == "1-0") {
+    return 1;
+  }
+  if (result == "0-1") {
+    return -1;
+  }
+  return result == "1/2-1/2" ? 0 : 2;
+}
+
+// Reads a little endian `T` at `*pos` of `data` and moves past it.
+template <typename T>
+T read_value(const char* data, size_t* pos) {
+  T res;
+  std::memcpy(&res, data + *pos, sizeof(res));
+  *pos += sizeof(res);
+  return res;
+}
+}  // namespace.
+
+void rank_legal_moves(const Board& board, MoveList* moves) {
+  const Color enemy = board.is_whites_move_ ? Color::black : Color::white;
+  const std::array<Bitboard, 64>& enemy_pawn_attacks =
+      enemy == Color::white ? white_pawn_attacks : black_pawn_attacks;
+  Bitboard pawn_attacked = 0;
+  for (Bitboard sq : bitboard_split(
+           board.pieces_[static_cast<size_t>(enemy)]
+                        [static_cast<size_t>(Piece::pawn)])) {
+    pawn_attacked |= enemy_pawn_attacks[static_cast<size_t>(square_idx(sq))];
+  }
+  // The score above the squares, the lower squares first among equal
+  // scores.
+  std::array<int64_t, max_moves> keys;
+  const size_t num_moves = moves->size();
+  for (size_t i = 0; i < num_moves; ++i) {
+    const Move move = (*moves)[i];
+    keys[i] = static_cast<int64_t>(move_score(board, move, pawn_attacked)) *
+                  65536 +
+              (65535 - (move.src_idx_ * 64 + move.dst_idx_)) * 16 +
+              static_cast<int64_t>(move.move_type_);
+  }
+  // Insertion sort: most positions have a few dozen moves.
+  for (size_t i = 1; i < num_moves; ++i) {
+    const int64_t key = keys[i];
+    const Move move = (*moves)[i];
+    size_t j = i;
+    for (; j > 0 && keys[j - 1] < key; --j) {
+      keys[j] = keys[j - 1];
+      (*moves)[j] = (*moves)[j - 1];
+    }
+    keys[j] = key;
+    (*moves)[j] = move;
+  }
+}
+
+size_t GameArchive::header_bytes() const {
+  return records_.size() * sizeof(GameRecord) +
+         blocks_.size() * sizeof(Block) + tags_.size();
+}
+
+std::vector<PgnTag> GameArchive::tags(size_t game_idx) const {
+  const size_t end = game_idx + 1 < records_.size()
+                         ? records_[game_idx + 1].tags_offset_
+                         : tags_.size();
+  absl::string_view text(tags_.data() + records_[game_idx].tags_offset_,
+                         end - records_[game_idx].tags_offset_);
+  std::vector<PgnTag> res;
+  while (!text.empty()) {
+    const size_t name_end = text.find('\0');
+    const size_t value_end = name_end == absl::string_view::npos
+                                 ? name_end
+                                 : text.find('\0', name_end + 1);
+    if (value_end == absl::string_view::npos) {
+      break;
+    }
+    res.push_back({text.substr(0, name_end),
+                   text.substr(name_end + 1, value_end - name_end - 1)});
+    text.remove_prefix(value_end + 1);
+  }
+  return res;
+}
+
+bool GameArchive::decode_block(size_t block_idx,
+                               const ArchiveGameFn& fn) const {
+  const Block& block = blocks_[block_idx];
+  const bool is_last = block_idx + 1 == blocks_.size();
+  const size_t end_offset =
+      is_last ? moves_.size() : blocks_[block_idx + 1].offset_;
+  const size_t end_game =
+      is_last ? records_.size() : blocks_[block_idx + 1].first_game_;
+  RangeDecoder decoder(absl::string_view(moves_.data() + block.offset_,
+                                         end_offset - block.offset_));
+  RankModel model;
+  std::vector<Move> game_moves;
+  PgnGame game;
+  MoveList moves;
+  for (size_t game_idx = block.first_game_; game_idx < end_game; ++game_idx) {
+    game.tags_ = tags(game_idx);
+    const absl::optional<Board> start = game.start_position();
+    if (!start) {
+      return false;
+    }
+    Board board = *start;
+    game_moves.clear();
+    for (size_t ply = 0; ply < records_[game_idx].num_plies_; ++ply) {
+      moves = board.legal_moves();
+      if (moves.empty()) {
+        return false;
+      }
+      rank_legal_moves(board, &moves);
+      const size_t rank = decode_rank(moves.size(), &model, &decoder);
+      if (rank >= moves.size()) {
+        return false;
+      }
+      game_moves.push_back(moves[rank]);
+      board.do_move(moves[rank]);
+    }
+    fn(game_idx, *start, game_moves.data(), game_moves.size());
+  }
+  return true;
+}
+
+size_t GameArchive::find_block(size_t game_idx) const {
+  const auto block = std::upper_bound(
+      blocks_.begin(), blocks_.end(), game_idx,
+      [](size_t idx, const Block& b) { return idx < b.first_game_; });
+  return static_cast<size_t>(block - blocks_.begin() - 1);
+}
+
+bool GameArchive::decode_game(size_t game_idx, Board* start,
+                              std::vector<Move>* moves) const {
+  bool is_found = false;
+  const bool is_valid = decode_block(
+      find_block(game_idx),
+      [&](size_t idx, const Board& game_start, const Move* game_moves,
+          size_t num_moves) {
+        if (idx == game_idx) {
+          *start = game_start;
+          moves->assign(game_moves, game_moves + num_moves);
+          is_found = true;
+        }
+      });
+  return is_valid && is_found;
+}
+
+bool GameArchive::save(const std::string& path) const {
+  BulkFileWriter out(path, false);
+  const uint64_t sizes[5] = {records_.size(), blocks_.size(), moves_.size(),
+                             tags_.size(), num_moves_};
+  out.write(magic, sizeof(magic));
+  out.write(sizes, sizeof(sizes));
+  out.write(records_.data(), records_.size() * sizeof(GameRecord));
+  out.write(blocks_.data(), blocks_.size() * sizeof(Block));
+  out.write(moves_.data(), moves_.size());
+  out.write(tags_.data(), tags_.size());
+  return out.close();
+}
+
+std::unique_ptr<GameArchive> GameArchive::load(const std::string& path,
+                                               std::string* error) {
+  const MappedFile file(path);
+  if (!file.data()) {
+    *error = absl::StrCat("can't read ", path);
+    return nullptr;
+  }
+  const size_t header_size = sizeof(magic) + 5 * sizeof(uint64_t);
+  if (file.size() < header_size ||
+      std::memcmp(file.data(), magic, sizeof(magic)) != 0) {
+    *error = absl::StrCat(path, " is not a game archive");
+    return nullptr;
+  }
+  size_t pos = sizeof(magic);
+  const uint64_t num_games = read_value<uint64_t>(file.data(), &pos);
+  const uint64_t num_blocks = read_value<uint64_t>(file.data(), &pos);
+  const uint64_t move_bytes = read_value<uint64_t>(file.data(), &pos);
+  const uint64_t tag_bytes = read_value<uint64_t>(file.data(), &pos);
+  auto res = std::make_unique<GameArchive>();
+  res->num_moves_ = read_value<uint64_t>(file.data(), &pos);
+  const size_t rest = file.size() - header_size;
+  if (num_games > rest / sizeof(GameRecord) ||
+      num_blocks > rest / sizeof(Block) ||
+      num_games * sizeof(GameRecord) + num_blocks * sizeof(Block) +
+              move_bytes + tag_bytes != rest) {
+    *error = absl::StrCat(path, " is cut short");
+    return nullptr;
+  }
+  res->records_.resize(num_games);
+  std::memcpy(res->records_.data(), file.data() + pos,
+              num_games * sizeof(GameRecord));
+  pos += num_games * sizeof(GameRecord);
+  res->blocks_.resize(num_blocks);
+  std::memcpy(res->blocks_.data(), file.data() + pos,
+              num_blocks * sizeof(Block));
+  pos += num_blocks * sizeof(Block);
+  res->moves_.assign(file.data() + pos, move_bytes);
+  pos += move_bytes;
+  res->tags_.assign(file.data() + pos, tag_bytes);
+
+  // The offsets only go up and stay inside what they index.
+  for (size_t i = 0; i < num_games; ++i) {
+    const uint64_t offset = res->records_[i].tags_offset_;
+    if (offset > tag_bytes ||
+        (i > 0 && offset < res->records_[i - 1].tags_offset_)) {
+      *error = absl::StrCat(path, " has corrupt game records");
+      return nullptr;
+    }
+  }
+  for (size_t i = 0; i < num_blocks; ++i) {
+    const Block& block = res->blocks_[i];
+    if (block.offset_ > move_bytes || block.first_game_ > num_games ||
+        (i == 0 && block.first_game_ != 0) ||
+        (i > 0 && (block.offset_ < res->blocks_[i - 1].offset_ ||
+                   block.first_game_ < res->blocks_[i - 1].first_game_))) {
+      *error = absl::StrCat(path, " has a corrupt block index");
+      return nullptr;
+    }
+  }
+  if (num_games > 0 && num_blocks == 0) {
+    *error = absl::StrCat(path, " has a corrupt block index");
+    return nullptr;
+  }
+  return res;
+}
+
+class GameArchiveBuilder::Encoder {
+ public:
+  explicit Encoder(std::string* out) : encoder_(out) {}
+
+  void encode(size_t rank, size_t num_moves) {
+    encode_rank(rank, num_moves, &model_, &encoder_);
+  }
+  void flush() { encoder_.flush(); }
+
+ private:
+  RangeEncoder encoder_;
+  RankModel model_;
+};
+
+GameArchiveBuilder::GameArchiveBuilder(size_t games_per_block)
+    : games_per_block_(std::max<size_t>(games_per_block, 1)),
+      archive_(new GameArchive),
+      block_games_(0) {}
+
+GameArchiveBuilder::~GameArchiveBuilder() = default;
+
+const char* GameArchiveBuilder::add_game(const PgnGame& game) {
+  ranks_.clear();
+  num_legal_.clear();
+  const char* error =
+      replay_game(game, [this](const Board& board, Move move) {
+        MoveList moves = board.legal_moves();
+        rank_legal_moves(board, &moves);
+        const size_t rank = static_cast<size_t>(
+            std::find(moves.begin(), moves.end(), move) - moves.begin());
+        ranks_.push_back(static_cast<uint8_t>(rank));
+        num_legal_.push_back(static_cast<uint8_t>(moves.size()));
+      });
+  if (error) {
+    return error;
+  }
+  if (ranks_.size() > 65535) {
+    return "The game is longer than an archive holds.";
+  }
+
+  if (block_games_ == 0) {
+    archive_->blocks_.push_back(
+        {archive_->moves_.size(),
+         static_cast<uint32_t>(archive_->records_.size())});
+    encoder_.reset(new Encoder(&archive_->moves_));
+  }
+  GameArchive::GameRecord record = {};
+  record.tags_offset_ = archive_->tags_.size();
+  record.num_plies_ = static_cast<uint16_t>(ranks_.size());
+  record.result_ = result_code(game.result_);
+  archive_->records_.push_back(record);
+  for (const PgnTag& tag : game.tags_) {
+    absl::StrAppend(&archive_->tags_, tag.name_, absl::string_view("\0", 1),
+                    tag.value_, absl::string_view("\0", 1));
+  }
+  for (size_t i = 0; i < ranks_.size(); ++i) {
+    encoder_->encode(ranks_[i], num_legal_[i]);
+  }
+  archive_->num_moves_ += ranks_.size();
+  if (++block_games_ == games_per_block_) {
+    finish_block();
+  }
+  return nullptr;
+}
+
+void GameArchiveBuilder::finish_block() {
+  if (encoder_) {
+    encoder_->flush();
+    encoder_.reset();
+  }
+  block_games_ = 0;
+}
+
+std::unique_ptr<GameArchive> GameArchiveBuilder::finish() {
+  finish_block();
+  std::unique_ptr<GameArchive> res = std::move(archive_);
+  archive_.reset(new GameArchive);
+  return res;
+}
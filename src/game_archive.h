@@ -0,0 +1,136 @@
+#ifndef GAME_ARCHIVE_H
+#define GAME_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "board.h"
+#include "pgn.h"
+
+// A compact archive of games, small enough for billions of moves to be held
+// in memory while an opening explorer is rebuilt from them.
+//
+// A move is stored as its rank among the legal moves of its position, in an
+// order that puts the likely moves first: promotions to a queen, captures of
+// the most valuable pieces, castling, moves to the centre, and last the
+// moves that put a piece where an enemy pawn takes it. Played moves are
+// mostly near the front, so the ranks are mostly small, and an adaptive
+// binary range coder (as in LZMA) takes them to a few bits each: a rank is a
+// run of "is it this one?" decisions, each with an adaptive probability of
+// its own, and a position with one legal move costs nothing. The order is
+// part of the format and depends on nothing but the position, ties broken by
+// the squares of the moves, so it doesn't change with the move generator or
+// the evaluation.
+//
+// The coder's probabilities adapt over a block of games and start over with
+// the next block, so a block is decoded on its own, say on a thread of its
+// own. Each game also has a record of its number of plies, its result and
+// where its tags are, in a separate table.
+//
+// Games start at the start position or at that of their FEN tag. Decoding
+// generates the legal moves of every position into a `MoveList`, so it
+// allocates nothing per move.
+
+// Sorts the legal moves of `board` in the order of the archive format.
+void rank_legal_moves(const Board& board, MoveList* moves);
+
+// Called with the index of a game in the archive, its start position and its
+// moves.
+typedef std::function<void(size_t game_idx, const Board& start,
+                           const Move* moves, size_t num_moves)>
+    ArchiveGameFn;
+
+class GameArchive {
+ public:
+  struct GameRecord {
+    // Where its tags start in the tag table.
+    uint64_t tags_offset_;
+    uint16_t num_plies_;
+    // 1 if white won, -1 if black did, 0 for a draw and 2 if unknown.
+    int8_t result_;
+  };
+  struct Block {
+    // Where its bytes start among the moves'.
+    uint64_t offset_;
+    uint32_t first_game_;
+  };
+
+  GameArchive() = default;
+  GameArchive(const GameArchive&) = delete;
+  GameArchive& operator=(const GameArchive&) = delete;
+
+  size_t num_games() const { return records_.size(); }
+  uint64_t num_moves() const { return num_moves_; }
+  size_t num_blocks() const { return blocks_.size(); }
+  const GameRecord& record(size_t game_idx) const {
+    return records_[game_idx];
+  }
+  // The sizes of the moves, and of the records and the tags.
+  size_t move_bytes() const { return moves_.size(); }
+  size_t header_bytes() const;
+
+  // Returns the block of game `game_idx`.
+  size_t find_block(size_t game_idx) const;
+  // Returns the tags of a game, views into the archive.
+  std::vector<PgnTag> tags(size_t game_idx) const;
+
+  // Calls `fn` with each game of block `block_idx` in order. Returns false,
+  // after the games before, if a game doesn't decode.
+  bool decode_block(size_t block_idx, const ArchiveGameFn& fn) const;
+  // Decodes one game, with the games before it in its block. Returns false
+  // if it doesn't decode.
+  bool decode_game(size_t game_idx, Board* start,
+                   std::vector<Move>* moves) const;
+
+  // Writes the archive to `path`, or reads it back whole. Returns false, or
+  // null with `*error` set, if that fails.
+  bool save(const std::string& path) const;
+  static std::unique_ptr<GameArchive> load(const std::string& path,
+                                           std::string* error);
+
+ private:
+  friend class GameArchiveBuilder;
+
+  std::vector<GameRecord> records_;
+  std::vector<Block> blocks_;
+  std::string moves_;
+  // The tags of every game, each name and value followed by a 0 byte.
+  std::string tags_;
+  uint64_t num_moves_ = 0;
+};
+
+// Adds games to an archive one after the other.
+class GameArchiveBuilder {
+ public:
+  explicit GameArchiveBuilder(size_t games_per_block = 256);
+  GameArchiveBuilder(const GameArchiveBuilder&) = delete;
+  GameArchiveBuilder& operator=(const GameArchiveBuilder&) = delete;
+  ~GameArchiveBuilder();
+
+  // Adds `game`, or returns what is wrong with it, as `replay_game` says, and
+  // adds nothing. Games of more than 65535 plies are refused too.
+  const char* add_game(const PgnGame& game);
+  // Finishes the last block and returns the archive. The builder is empty
+  // afterwards.
+  std::unique_ptr<GameArchive> finish();
+
+ private:
+  class Encoder;
+
+  void finish_block();
+
+  const size_t games_per_block_;
+  std::unique_ptr<GameArchive> archive_;
+  std::unique_ptr<Encoder> encoder_;
+  size_t block_games_;
+  // The ranks of the game being added, kept so that they don't allocate.
+  std::vector<uint8_t> ranks_;
+  std::vector<uint8_t> num_legal_;
+};
+
+#endif
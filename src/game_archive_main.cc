@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "game_archive.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+// Usage: game_archive <pgn> <out>
+//
+// Writes the games of a PGN file to <out> as a game archive (see
+// game_archive.h), skipping those that don't replay, and prints how small
+// the moves came out and how long decoding them all takes.
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <pgn> <out>\n";
+    return 1;
+  }
+  const MappedFile file(argv[1]);
+  if (!file.data()) {
+    std::cerr << "Can't read " << argv[1] << '\n';
+    return 1;
+  }
+  GameArchiveBuilder builder;
+  PgnReader reader(absl::string_view(file.data(), file.size()));
+  PgnGame game;
+  uint64_t num_skipped = 0;
+  while (reader.next(&game)) {
+    if (const char* const error = builder.add_game(game)) {
+      std::cerr << "Skipped a game: " << error << '\n';
+      ++num_skipped;
+    }
+  }
+  const std::unique_ptr<GameArchive> archive = builder.finish();
+  if (!archive->save(argv[2])) {
+    std::cerr << "Can't write " << argv[2] << '\n';
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t num_decoded = 0;
+  for (size_t i = 0; i < archive->num_blocks(); ++i) {
+    archive->decode_block(
+        i, [&](size_t, const Board&, const Move*, size_t num_moves) {
+          num_decoded += num_moves;
+        });
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const uint64_t num_moves = archive->num_moves();
+  std::cout << archive->num_games() << " games (" << num_skipped
+            << " skipped), " << num_moves << " moves in "
+            << archive->move_bytes() << " bytes, "
+            << (num_moves ? 8.0 * archive->move_bytes() / num_moves : 0.0)
+            << " bits per move, and " << archive->header_bytes()
+            << " bytes of records and tags\n"
+            << num_decoded << " moves decoded in " << elapsed.count()
+            << " s\n";
+  return 0;
+}
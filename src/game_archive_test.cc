@@ -0,0 +1,179 @@
+#include "game_archive.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "perft.h"
+#include "pgn.h"
+
+namespace {
+constexpr char games_text[] =
+    "[Event \"Scholar's mate\"]\n[Site \"?\"]\n\n"
+    "1. e4 e5 2. Bc4 Nc6 3. Qh5 Nf6 4. Qxf7# 1-0\n\n"
+    "[Event \"Promotions\"]\n"
+    "[FEN \"4k3/1P6/8/8/8/8/2p5/4K2R w K - 0 1\"]\n\n"
+    "1. O-O c1=N 2. b8=R+ Kd7 3. Rb7+ Kc6 *\n\n"
+    "[Event \"Queen's gambit declined\"]\n\n"
+    "1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7 5. e3 O-O 6. Nf3 h6 7. Bh4 b6\n"
+    "1/2-1/2\n\n";
+
+// Games of moves picked all over the move lists, so that their ranks are
+// anything but small, from the positions of the perft suite.
+std::string random_games_text(size_t num_games) {
+  std::string res;
+  for (size_t i = 0; i < num_games; ++i) {
+    const std::string fen = perft_suite[i % perft_suite.size()].fen_;
+    Board board(fen);
+    absl::StrAppend(&res, "[Game \"", i, "\"]\n[FEN \"", fen, "\"]\n\n");
+    for (size_t ply = 0; ply < 80; ++ply) {
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      const Move move = moves[(i * 7 + ply * 13) % moves.size()];
+      append_san(board, move, &res);
+      res += ' ';
+      board.do_move(move);
+    }
+    res += "0-1\n\n";
+  }
+  return res;
+}
+
+std::vector<PgnGame> read_games(absl::string_view text) {
+  std::vector<PgnGame> games;
+  PgnReader reader(text);
+  PgnGame game;
+  while (reader.next(&game)) {
+    games.push_back(game);
+  }
+  return games;
+}
+
+// The moves of `game` as replayed from its PGN.
+std::vector<Move> game_moves(const PgnGame& game) {
+  std::vector<Move> res;
+  EXPECT_EQ(replay_game(game,
+                        [&](const Board&, Move move) { res.push_back(move); }),
+            nullptr);
+  return res;
+}
+
+// Checks that `archive` has `games`, as they are in the PGN.
+void expect_games(const GameArchive& archive,
+                  const std::vector<PgnGame>& games) {
+  ASSERT_EQ(archive.num_games(), games.size());
+  size_t num_decoded = 0;
+  for (size_t block_idx = 0; block_idx < archive.num_blocks(); ++block_idx) {
+    ASSERT_TRUE(archive.decode_block(
+        block_idx, [&](size_t game_idx, const Board& start, const Move* moves,
+                       size_t num_moves) {
+          SCOPED_TRACE(game_idx);
+          ASSERT_EQ(game_idx, num_decoded);
+          ++num_decoded;
+          EXPECT_EQ(start, *games[game_idx].start_position());
+          EXPECT_EQ(std::vector<Move>(moves, moves + num_moves),
+                    game_moves(games[game_idx]));
+          EXPECT_EQ(archive.record(game_idx).num_plies_, num_moves);
+          const std::vector<PgnTag> tags = archive.tags(game_idx);
+          ASSERT_EQ(tags.size(), games[game_idx].tags_.size());
+          for (size_t i = 0; i < tags.size(); ++i) {
+            EXPECT_EQ(tags[i].name_, games[game_idx].tags_[i].name_);
+            EXPECT_EQ(tags[i].value_, games[game_idx].tags_[i].value_);
+          }
+        }));
+  }
+  EXPECT_EQ(num_decoded, games.size());
+}
+}  // namespace.
+
+TEST(RankLegalMoves, SortsTheLegalMovesLikelyFirst) {
+  // White's queen takes the undefended queen, or a pawn.
+  const Board board("4k3/8/8/3q4/8/5p2/8/3QK3 w - - 0 1");
+  MoveList moves = board.legal_moves();
+  MoveList ranked = moves;
+  rank_legal_moves(board, &ranked);
+  EXPECT_EQ(ranked[0].to_uci_str(), "d1d5");
+  EXPECT_EQ(ranked[1].to_uci_str(), "d1f3");
+  // The same moves, in an order that doesn't depend on theirs.
+  std::reverse(moves.begin(), moves.end());
+  rank_legal_moves(board, &moves);
+  EXPECT_EQ(moves, ranked);
+}
+
+TEST(GameArchive, DecodesTheGames) {
+  const std::string random_text = random_games_text(20);
+  std::vector<PgnGame> games = read_games(games_text);
+  const std::vector<PgnGame> random_games = read_games(random_text);
+  games.insert(games.end(), random_games.begin(), random_games.end());
+  for (size_t games_per_block : {1, 4, 256}) {
+    SCOPED_TRACE(games_per_block);
+    GameArchiveBuilder builder(games_per_block);
+    size_t num_moves = 0;
+    for (const PgnGame& game : games) {
+      ASSERT_EQ(builder.add_game(game), nullptr);
+      num_moves += game_moves(game).size();
+    }
+    const std::unique_ptr<GameArchive> archive = builder.finish();
+    EXPECT_EQ(archive->num_blocks(),
+              (games.size() + games_per_block - 1) / games_per_block);
+    EXPECT_EQ(archive->num_moves(), num_moves);
+    EXPECT_EQ(archive->record(0).result_, 1);
+    EXPECT_EQ(archive->record(1).result_, 2);
+    EXPECT_EQ(archive->record(2).result_, 0);
+    expect_games(*archive, games);
+
+    Board start;
+    std::vector<Move> moves;
+    ASSERT_TRUE(archive->decode_game(5, &start, &moves));
+    EXPECT_EQ(start, *games[5].start_position());
+    EXPECT_EQ(moves, game_moves(games[5]));
+  }
+}
+
+TEST(GameArchive, AddsNothingOfAGameThatDoesntReplay) {
+  const std::vector<PgnGame> games = read_games(
+      "[Event \"Illegal\"]\n\n1. e4 e5 2. Ke3 *\n\n" + std::string(games_text));
+  GameArchiveBuilder builder;
+  EXPECT_NE(builder.add_game(games[0]), nullptr);
+  for (size_t i = 1; i < games.size(); ++i) {
+    ASSERT_EQ(builder.add_game(games[i]), nullptr);
+  }
+  expect_games(*builder.finish(),
+               std::vector<PgnGame>(games.begin() + 1, games.end()));
+}
+
+TEST(GameArchive, SavesAndLoads) {
+  const std::string path = testing::TempDir() + "game_archive_test.bin";
+  const std::string random_text = random_games_text(10);
+  const std::vector<PgnGame> games = read_games(random_text);
+  GameArchiveBuilder builder(3);
+  for (const PgnGame& game : games) {
+    ASSERT_EQ(builder.add_game(game), nullptr);
+  }
+  ASSERT_TRUE(builder.finish()->save(path));
+  std::string error;
+  const std::unique_ptr<GameArchive> archive = GameArchive::load(path, &error);
+  ASSERT_NE(archive, nullptr) << error;
+  expect_games(*archive, games);
+
+  std::ifstream in(path, std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  for (size_t size : {size_t{0}, size_t{20}, data.size() - 1}) {
+    SCOPED_TRACE(size);
+    std::ofstream(path, std::ios::binary | std::ios::trunc)
+        .write(data.data(), static_cast<std::streamsize>(size));
+    EXPECT_EQ(GameArchive::load(path, &error), nullptr);
+    EXPECT_FALSE(error.empty());
+  }
+}
@@ -0,0 +1,353 @@
+#include "game_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "bitboard.h"
+#include "board.h"
+#include "debug_check.h"
+#include "endgame.h"
+#include "packed_position.h"
+
+namespace {
+// A move is stored as src | dst << 6 | promotion << 12, with the square
+// indices of `Move` and the Piece promoted to, or 0 (a pawn) for none.
+uint32_t move_code(Move move) {
+  uint32_t promotion = 0;
+  switch (move.move_type_) {
+    case MoveType::promotion_to_rook:
+    case MoveType::promotion_to_bishop:
+    case MoveType::promotion_to_knight:
+    case MoveType::promotion_to_queen:
+      promotion = static_cast<uint32_t>(promotion_piece(move.move_type_));
+      break;
+    default:
+      break;
+  }
+  return move.src_idx_ | uint32_t{move.dst_idx_} << 6 | promotion << 12;
+}
+
+// Appends `value` in 7 bits a byte, the lowest first, with the top bit set
+// on every byte but the last.
+template <typename F>
+void write_varint(uint32_t value, F&& write_byte) {
+  while (value >= 0x80) {
+    write_byte(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  write_byte(static_cast<uint8_t>(value));
+}
+
+// Reads a varint of at most 5 bytes with `read_byte`, which returns nullopt
+// at the end of the input.
+template <typename F>
+absl::optional<uint32_t> read_varint(F&& read_byte) {
+  uint32_t res = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    const absl::optional<uint8_t> byte = read_byte();
+    if (!byte) {
+      return absl::nullopt;
+    }
+    res |= static_cast<uint32_t>(*byte & 0x7f) << shift;
+    if (!(*byte & 0x80)) {
+      return res;
+    }
+  }
+  return absl::nullopt;
+}
+
+// Returns the legal move of `board` with `code`, or nullopt.
+absl::optional<Move> move_of_code(const Board& board, uint32_t code) {
+  const Piece promotion =
+      code >> 12 ? static_cast<Piece>(code >> 12) : Piece::none;
+  return board.legal_move(lsb_bitboard << (code & 63),
+                          lsb_bitboard << (code >> 6 & 63), promotion);
+}
+}  // namespace.
+
+GameStore::GameId GameStore::create(const Board& start) {
+  DEBUG_CHECK(start.position_error() == nullptr && !start.is_chess960_,
+              "A game must start at a legal standard chess position.");
+  const GameId id = games_.allocate();
+  Game& game = games_[id];
+  game.start_ = pack_position(start, 0, 0);
+  game.current_ = game.start_;
+  game.first_move_chunk_ = SlabPool<MoveChunk>::none;
+  game.last_move_chunk_ = SlabPool<MoveChunk>::none;
+  game.first_key_chunk_ = SlabPool<KeyChunk>::none;
+  game.last_key_chunk_ = SlabPool<KeyChunk>::none;
+  game.num_plies_ = 0;
+  game.last_move_chunk_size_ = 0;
+  game.last_key_chunk_size_ = 0;
+  game.legal_moves_ = SlabPool<CachedMoves>::none;
+  append_key(&game, start.key_);
+  return id;
+}
+
+void GameStore::erase(GameId id) {
+  Game& game = games_[id];
+  for (uint32_t chunk = game.first_move_chunk_;
+       chunk != SlabPool<MoveChunk>::none;) {
+    const uint32_t next = move_chunks_[chunk].next_;
+    move_chunks_.free(chunk);
+    chunk = next;
+  }
+  free_keys(&game);
+  free_legal_moves(&game);
+  games_.free(id);
+}
+
+absl::optional<Move> GameStore::apply_move(GameId id, Bitboard src_square,
+                                           Bitboard dst_square,
+                                           Piece promotion) {
+  Game& game = games_[id];
+  Board board = unpack_position(game.current_);
+  const absl::optional<Move> move =
+      board.legal_move(src_square, dst_square, promotion);
+  if (!move) {
+    return absl::nullopt;
+  }
+  board.do_move(*move);
+  game.current_ = pack_position(board, 0, 0);
+  ++game.num_plies_;
+  free_legal_moves(&game);
+  write_varint(move_code(*move),
+               [this, &game](uint8_t byte) { append_move_byte(&game, byte); });
+  // No position from before a capture or pawn move can come back.
+  if (board.fifty_move_clock_ == 0) {
+    free_keys(&game);
+  }
+  append_key(&game, board.key_);
+  return move;
+}
+
+Board GameStore::board(GameId id) const {
+  return unpack_position(games_[id].current_);
+}
+
+Board GameStore::start_board(GameId id) const {
+  return unpack_position(games_[id].start_);
+}
+
+uint32_t GameStore::num_plies(GameId id) const {
+  return games_[id].num_plies_;
+}
+
+std::vector<Move> GameStore::moves(GameId id) const {
+  const Game& game = games_[id];
+  std::vector<Move> res;
+  res.reserve(game.num_plies_);
+  Board board = unpack_position(game.start_);
+  uint32_t chunk = game.first_move_chunk_;
+  size_t pos = 0;
+  const auto read_byte = [this, &game, &chunk,
+                          &pos]() -> absl::optional<uint8_t> {
+    const size_t size = chunk == game.last_move_chunk_
+                            ? game.last_move_chunk_size_
+                            : MoveChunk::capacity;
+    if (pos == size) {
+      if (chunk == game.last_move_chunk_) {
+        return absl::nullopt;
+      }
+      chunk = move_chunks_[chunk].next_;
+      pos = 0;
+    }
+    return move_chunks_[chunk].bytes_[pos++];
+  };
+  for (uint32_t ply = 0; ply < game.num_plies_; ++ply) {
+    const absl::optional<uint32_t> code = read_varint(read_byte);
+    DEBUG_CHECK(code, "The moves of a game end early.");
+    const absl::optional<Move> move = move_of_code(board, *code);
+    DEBUG_CHECK(move, "A game has an illegal move.");
+    res.push_back(*move);
+    board.do_move(*move);
+  }
+  return res;
+}
+
+int GameStore::repetition_count(GameId id) const {
+  const Game& game = games_[id];
+  const uint64_t key = key_chunks_[game.last_key_chunk_]
+                           .keys_[game.last_key_chunk_size_ - 1u];
+  int res = 0;
+  for (uint32_t chunk = game.first_key_chunk_;
+       chunk != SlabPool<KeyChunk>::none; chunk = key_chunks_[chunk].next_) {
+    const size_t size = chunk == game.last_key_chunk_
+                            ? game.last_key_chunk_size_
+                            : KeyChunk::capacity;
+    for (size_t i = 0; i < size; ++i) {
+      res += key_chunks_[chunk].keys_[i] == key ? 1 : 0;
+    }
+  }
+  return res;
+}
+
+GameStore::Status GameStore::status(GameId id) const {
+  const Game& game = games_[id];
+  const Board board = unpack_position(game.current_);
+  const bool is_cached = game.legal_moves_ != SlabPool<CachedMoves>::none;
+  const bool has_move =
+      is_cached ? legal_moves_[game.legal_moves_].moves_.num_moves_ != 0
+                : board.has_any_legal_move();
+  if (!has_move) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    const bool is_check = is_cached
+                              ? legal_moves_[game.legal_moves_].moves_.is_check_
+                              : board.is_king_attacked(side);
+    return is_check ? Status::checkmate : Status::stalemate;
+  }
+  if (is_insufficient_material(board)) {
+    return Status::insufficient_material;
+  }
+  if (board.fifty_move_clock_ >= 100) {
+    return Status::fifty_moves;
+  }
+  return repetition_count(id) >= 3 ? Status::threefold_repetition
+                                   : Status::ongoing;
+}
+
+const GameStore::LegalMoves& GameStore::legal_moves(GameId id) {
+  Game& game = games_[id];
+  if (game.legal_moves_ != SlabPool<CachedMoves>::none) {
+    return legal_moves_[game.legal_moves_].moves_;
+  }
+  game.legal_moves_ = legal_moves_.allocate();
+  LegalMoves& res = legal_moves_[game.legal_moves_].moves_;
+  const Board board = unpack_position(game.current_);
+  const MoveList moves = board.legal_moves();
+  res.origins_ = 0;
+  res.destinations_.fill(0);
+  res.num_moves_ = 0;
+  for (Move move : moves) {
+    res.origins_ |= move.src_square();
+    res.codes_[res.num_moves_++] = static_cast<uint16_t>(move_code(move));
+  }
+  for (Move move : moves) {
+    res.destinations_[popcount(res.origins_ & (move.src_square() - 1))] |=
+        move.dst_square();
+  }
+  res.is_check_ = board.check_info().checkers_ != 0;
+  return res;
+}
+
+std::string GameStore::snapshot(GameId id) const {
+  const Game& game = games_[id];
+  std::string res(reinterpret_cast<const char*>(&game.start_),
+                  sizeof(game.start_));
+  write_varint(game.num_plies_, [&res](uint8_t byte) {
+    res.push_back(static_cast<char>(byte));
+  });
+  for (uint32_t chunk = game.first_move_chunk_;
+       chunk != SlabPool<MoveChunk>::none;
+       chunk = move_chunks_[chunk].next_) {
+    const size_t size = chunk == game.last_move_chunk_
+                            ? game.last_move_chunk_size_
+                            : MoveChunk::capacity;
+    res.append(reinterpret_cast<const char*>(move_chunks_[chunk].bytes_.data()),
+               size);
+  }
+  return res;
+}
+
+absl::optional<GameStore::GameId> GameStore::restore(
+    absl::string_view snapshot, std::string* error) {
+  PackedPosition start;
+  if (snapshot.size() < sizeof(start)) {
+    *error = "The snapshot has no start position.";
+    return absl::nullopt;
+  }
+  std::memcpy(&start, snapshot.data(), sizeof(start));
+  const Board start_board = unpack_position(start);
+  if (const char* position_error = start_board.position_error()) {
+    *error = position_error;
+    return absl::nullopt;
+  }
+  size_t pos = sizeof(start);
+  const auto read_byte = [snapshot, &pos]() -> absl::optional<uint8_t> {
+    if (pos == snapshot.size()) {
+      return absl::nullopt;
+    }
+    return static_cast<uint8_t>(snapshot[pos++]);
+  };
+  const absl::optional<uint32_t> num_plies = read_varint(read_byte);
+  if (!num_plies) {
+    *error = "The snapshot has no number of moves.";
+    return absl::nullopt;
+  }
+  const GameId id = create(start_board);
+  for (uint32_t ply = 0; ply < *num_plies; ++ply) {
+    const absl::optional<uint32_t> code = read_varint(read_byte);
+    const absl::optional<Move> move =
+        code ? move_of_code(board(id), *code) : absl::nullopt;
+    if (!move) {
+      *error = code ? "The snapshot has an illegal move."
+                    : "The snapshot ends before its last move.";
+      erase(id);
+      return absl::nullopt;
+    }
+    apply_move(id, move->src_square(), move->dst_square(),
+               *code >> 12 ? static_cast<Piece>(*code >> 12) : Piece::none);
+  }
+  if (pos != snapshot.size()) {
+    *error = "The snapshot goes on after its last move.";
+    erase(id);
+    return absl::nullopt;
+  }
+  return id;
+}
+
+void GameStore::append_move_byte(Game* game, uint8_t byte) {
+  if (game->last_move_chunk_ == SlabPool<MoveChunk>::none ||
+      game->last_move_chunk_size_ == MoveChunk::capacity) {
+    const uint32_t chunk = move_chunks_.allocate();
+    if (game->last_move_chunk_ == SlabPool<MoveChunk>::none) {
+      game->first_move_chunk_ = chunk;
+    } else {
+      move_chunks_[game->last_move_chunk_].next_ = chunk;
+    }
+    game->last_move_chunk_ = chunk;
+    game->last_move_chunk_size_ = 0;
+  }
+  move_chunks_[game->last_move_chunk_].bytes_[game->last_move_chunk_size_++] =
+      byte;
+}
+
+void GameStore::append_key(Game* game, uint64_t key) {
+  if (game->last_key_chunk_ == SlabPool<KeyChunk>::none ||
+      game->last_key_chunk_size_ == KeyChunk::capacity) {
+    const uint32_t chunk = key_chunks_.allocate();
+    if (game->last_key_chunk_ == SlabPool<KeyChunk>::none) {
+      game->first_key_chunk_ = chunk;
+    } else {
+      key_chunks_[game->last_key_chunk_].next_ = chunk;
+    }
+    game->last_key_chunk_ = chunk;
+    game->last_key_chunk_size_ = 0;
+  }
+  key_chunks_[game->last_key_chunk_].keys_[game->last_key_chunk_size_++] =
+      key;
+}
+
+void GameStore::free_keys(Game* game) {
+  for (uint32_t chunk = game->first_key_chunk_;
+       chunk != SlabPool<KeyChunk>::none;) {
+    const uint32_t next = key_chunks_[chunk].next_;
+    key_chunks_.free(chunk);
+    chunk = next;
+  }
+  game->first_key_chunk_ = SlabPool<KeyChunk>::none;
+  game->last_key_chunk_ = SlabPool<KeyChunk>::none;
+  game->last_key_chunk_size_ = 0;
+}
+
+void GameStore::free_legal_moves(Game* game) {
+  if (game->legal_moves_ != SlabPool<CachedMoves>::none) {
+    legal_moves_.free(game->legal_moves_);
+    game->legal_moves_ = SlabPool<CachedMoves>::none;
+  }
+}
@@ -0,0 +1,242 @@
+#ifndef GAME_STORE_H
+#define GAME_STORE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+
+// Fixed-size items carved out of slabs of `slab_size` at a time and handed
+// out by index, with the freed ones kept on a free list for the next
+// allocation, so that a pool of many small, short-lived items grows to its
+// peak once and then stops allocating. An index stays valid while the pool
+// grows, as the slabs never move. The items link the free list through their
+// `next_` member, a uint32_t.
+template <typename T>
+class SlabPool {
+ public:
+  static constexpr uint32_t none = ~uint32_t{0};
+  static constexpr size_t slab_size = 1024;
+
+  SlabPool() : free_head_(none), num_items_(0), num_used_(0) {}
+  SlabPool(const SlabPool&) = delete;
+  SlabPool& operator=(const SlabPool&) = delete;
+
+  // Returns the index of an item with `next_` set to `none` and the rest as
+  // it was left.
+  uint32_t allocate() {
+    uint32_t idx = free_head_;
+    if (idx != none) {
+      free_head_ = (*this)[idx].next_;
+    } else {
+      if (num_items_ % slab_size == 0) {
+        slabs_.emplace_back(new T[slab_size]);
+      }
+      idx = static_cast<uint32_t>(num_items_++);
+    }
+    ++num_used_;
+    (*this)[idx].next_ = none;
+    return idx;
+  }
+  void free(uint32_t idx) {
+    (*this)[idx].next_ = free_head_;
+    free_head_ = idx;
+    --num_used_;
+  }
+
+  T& operator[](uint32_t idx) {
+    return slabs_[idx / slab_size][idx % slab_size];
+  }
+  const T& operator[](uint32_t idx) const {
+    return slabs_[idx / slab_size][idx % slab_size];
+  }
+
+  // The items in use, and the bytes of all the slabs.
+  size_t size() const { return num_used_; }
+  size_t memory_bytes() const { return slabs_.size() * slab_size * sizeof(T); }
+
+ private:
+  std::vector<std::unique_ptr<T[]>> slabs_;
+  uint32_t free_head_;
+  // The items carved out of the slabs so far, used or free.
+  size_t num_items_;
+  size_t num_used_;
+};
+
+// The state of many live games at once, for a server that holds hundreds of
+// thousands of them in one process and has to keep their memory and cache
+// misses down. A game has a fixed record of about a hundred bytes:
+//
+//  - Its start and current positions as packed positions (see
+//    packed_position.h), 32 bytes each instead of a Board's 240.
+//  - The head and tail of a chain of 64-byte chunks with its moves, each the
+//    varint of its squares and promotion piece, 2 bytes for most moves.
+//  - The head and tail of a chain of chunks with the keys of the positions
+//    since the last capture or pawn move, which are all that can repeat. The
+//    chain is given back as soon as such a move makes them useless.
+//
+// Records and chunks come from slab pools, so 500k games take a few thousand
+// allocations, and the chunks of finished games go to the games that start
+// after them. Applying a move unpacks the current position, checks the move
+// with `Board::legal_move`, does it and packs the result, and appends to the
+// tails of the chains: constant time however long the game is.
+//
+// The legal moves of a game's current position are generated when first asked
+// for and kept until its next move, so that highlighting, premoves and every
+// spectator of the game share one generation.
+//
+// A snapshot of a game is its start position and moves as bytes, which
+// `restore` replays into a game of this or another store, e.g. to move games
+// between servers.
+//
+// Games are standard chess, as packed positions don't keep Chess960 rook
+// files. A store isn't thread safe: a server shards its games over one store
+// per thread.
+class GameStore {
+ public:
+  typedef uint32_t GameId;
+
+  // Whether a game is over after its last move, and why.
+  enum class Status {
+    ongoing,
+    checkmate,
+    stalemate,
+    insufficient_material,
+    fifty_moves,
+    threefold_repetition
+  };
+
+  // The legal moves of a position in the forms web clients ask for them.
+  struct LegalMoves {
+    // The squares of the side to move's pieces that have a legal move, and
+    // the squares each of them can move to, in the order of the squares from
+    // h1 on.
+    Bitboard origins_;
+    std::array<Bitboard, 16> destinations_;
+    // The moves as src | dst << 6 | promotion << 12 of their square indices
+    // and the Piece promoted to, 0 for other moves: the codes of snapshots.
+    std::array<uint16_t, max_moves> codes_;
+    uint16_t num_moves_;
+    bool is_check_;
+
+    // The squares the piece on `src_square` can move to.
+    Bitboard destinations(Bitboard src_square) const {
+      return origins_ & src_square
+                 ? destinations_[popcount(origins_ & (src_square - 1))]
+                 : 0;
+    }
+  };
+
+  GameStore() = default;
+  GameStore(const GameStore&) = delete;
+  GameStore& operator=(const GameStore&) = delete;
+
+  // Starts a game at `start`, which must be a legal position.
+  GameId create(const Board& start);
+  // Ends the game `id` and frees its memory for other games. The id may be
+  // given to a later game.
+  void erase(GameId id);
+
+  // Does the legal move of the game's side to move from `src_square` to
+  // `dst_square`, promoting to `promotion` unless it is Piece::none, and
+  // returns it, or returns nullopt and leaves the game as it was if there is
+  // no such move.
+  absl::optional<Move> apply_move(GameId id, Bitboard src_square,
+                                  Bitboard dst_square,
+                                  Piece promotion = Piece::none);
+
+  // The current and start positions of the game.
+  Board board(GameId id) const;
+  Board start_board(GameId id) const;
+  // The number of moves of the game, each side's counted.
+  uint32_t num_plies(GameId id) const;
+  // The moves of the game, replayed from its start position.
+  std::vector<Move> moves(GameId id) const;
+  // The number of times the current position has occurred since the last
+  // capture or pawn move, itself included, so 3 for a threefold repetition.
+  int repetition_count(GameId id) const;
+  // Returns the status of the game, the first that applies in the order of
+  // `Status` after `ongoing`, so that a mate on the hundredth ply still
+  // counts. Checked after every move, so it takes the cached legal moves if
+  // there are any and otherwise stops at the first legal move, and the draws
+  // come from the material key and the repetition keys.
+  Status status(GameId id) const;
+  // The legal moves of the current position, generated on the first call
+  // after each move. The reference is good until the game's next move or its
+  // end.
+  const LegalMoves& legal_moves(GameId id);
+
+  // Returns the game as bytes: its packed start position, the varint of its
+  // number of moves and their varints.
+  std::string snapshot(GameId id) const;
+  // Starts a game from a `snapshot`, or returns nullopt with what is wrong in
+  // `*error` if it isn't one of a legal game.
+  absl::optional<GameId> restore(absl::string_view snapshot,
+                                 std::string* error);
+
+  size_t num_games() const { return games_.size(); }
+  // The bytes of the slabs of records, chunks and legal moves, used or free.
+  size_t memory_bytes() const {
+    return games_.memory_bytes() + move_chunks_.memory_bytes() +
+           key_chunks_.memory_bytes() + legal_moves_.memory_bytes();
+  }
+
+ private:
+  struct Game {
+    PackedPosition start_;
+    PackedPosition current_;
+    uint32_t first_move_chunk_;
+    uint32_t last_move_chunk_;
+    uint32_t first_key_chunk_;
+    uint32_t last_key_chunk_;
+    uint32_t num_plies_;
+    // The bytes of moves and the keys in the last chunk of each chain.
+    uint16_t last_move_chunk_size_;
+    uint16_t last_key_chunk_size_;
+    // The legal moves of the current position, or none before they are
+    // asked for.
+    uint32_t legal_moves_;
+    // The free list link while the record isn't in use.
+    uint32_t next_;
+  };
+
+  struct MoveChunk {
+    static constexpr size_t capacity = 60;
+    uint32_t next_;
+    std::array<uint8_t, capacity> bytes_;
+  };
+
+  struct KeyChunk {
+    static constexpr size_t capacity = 7;
+    uint32_t next_;
+    std::array<uint64_t, capacity> keys_;
+  };
+
+  struct CachedMoves {
+    LegalMoves moves_;
+    uint32_t next_;
+  };
+
+  static_assert(sizeof(MoveChunk) == 64 && sizeof(KeyChunk) == 64,
+                "A chunk should take a cache line.");
+
+  void append_move_byte(Game* game, uint8_t byte);
+  void append_key(Game* game, uint64_t key);
+  void free_keys(Game* game);
+  void free_legal_moves(Game* game);
+
+  SlabPool<Game> games_;
+  SlabPool<MoveChunk> move_chunks_;
+  SlabPool<KeyChunk> key_chunks_;
+  SlabPool<CachedMoves> legal_moves_;
+};
+
+#endif
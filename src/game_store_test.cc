@@ -0,0 +1,222 @@
+#include "game_store.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Plays the moves in UCI notation `moves` in the game `id`, and on `board`
+// if given.
+void play(const std::vector<std::string>& moves, GameStore::GameId id,
+          GameStore* store, Board* board = nullptr) {
+  for (const std::string& str : moves) {
+    const absl::optional<Move> move = parse_uci_move(store->board(id), str);
+    ASSERT_TRUE(move) << str;
+    const absl::optional<Move> applied = store->apply_move(
+        id, move->src_square(), move->dst_square(),
+        str.size() == 5 ? promotion_piece(move->move_type_) : Piece::none);
+    ASSERT_TRUE(applied) << str;
+    EXPECT_EQ(*move, *applied);
+    if (board) {
+      board->do_move(*move);
+    }
+  }
+}
+
+const std::vector<std::string> game_moves = {
+    "e2e4", "d7d5", "e4d5", "g8f6", "d2d4", "f6d5", "g1f3", "c8g4",
+    "f1e2", "e7e6", "e1g1", "f8e7", "c2c4", "d5b6", "b1c3", "e8g8",
+    "c1e3", "b8c6", "d4d5", "e6d5", "c4d5", "c6b4", "a2a3", "b4d5",
+    "c3d5", "b6d5", "d1d5", "d8d5", "f1d1", "d5d1", "a1d1", "g4f3"};
+}  // namespace.
+
+TEST(GameStore, FollowsTheBoard) {
+  GameStore store;
+  const Board start;
+  const GameStore::GameId id = store.create(start);
+  Board board = start;
+  play(game_moves, id, &store, &board);
+  EXPECT_EQ(store.board(id).to_fen(), board.to_fen());
+  EXPECT_EQ(store.start_board(id).to_fen(), start.to_fen());
+  EXPECT_EQ(store.num_plies(id), game_moves.size());
+  const std::vector<Move> moves = store.moves(id);
+  ASSERT_EQ(moves.size(), game_moves.size());
+  for (size_t i = 0; i < moves.size(); ++i) {
+    EXPECT_EQ(moves[i].to_uci_str(), game_moves[i]);
+  }
+}
+
+TEST(GameStore, PromotesToThePieceAsked) {
+  GameStore store;
+  const GameStore::GameId id =
+      store.create(Board("8/1P6/8/8/8/8/6k1/4K3 w - - 0 1"));
+  play({"b7b8n", "g2g3", "b8d7"}, id, &store);
+  EXPECT_EQ(store.board(id).to_fen(), "8/3N4/8/8/8/6k1/8/4K3 b - - 2 2");
+  // A promotion needs its piece.
+  const GameStore::GameId other =
+      store.create(Board("8/1P6/8/8/8/8/6k1/4K3 w - - 0 1"));
+  EXPECT_FALSE(store.apply_move(other, str_to_square("b7"),
+                                str_to_square("b8")));
+}
+
+TEST(GameStore, RejectsIllegalMoves) {
+  GameStore store;
+  const GameStore::GameId id = store.create(Board());
+  play({"e2e4", "e7e5"}, id, &store);
+  const std::string fen = store.board(id).to_fen();
+  EXPECT_FALSE(store.apply_move(id, str_to_square("e4"), str_to_square("e5")));
+  EXPECT_FALSE(store.apply_move(id, str_to_square("e8"), str_to_square("e7")));
+  EXPECT_FALSE(store.apply_move(id, str_to_square("a3"), str_to_square("a4")));
+  EXPECT_EQ(store.board(id).to_fen(), fen);
+  EXPECT_EQ(store.num_plies(id), 2u);
+  EXPECT_EQ(store.moves(id).size(), 2u);
+}
+
+TEST(GameStore, CountsRepetitions) {
+  GameStore store;
+  const GameStore::GameId id = store.create(Board());
+  EXPECT_EQ(store.repetition_count(id), 1);
+  play({"g1f3", "g8f6", "f3g1", "f6g8"}, id, &store);
+  EXPECT_EQ(store.repetition_count(id), 2);
+  play({"g1f3"}, id, &store);
+  EXPECT_EQ(store.repetition_count(id), 2);
+  play({"g8f6", "f3g1", "f6g8"}, id, &store);
+  EXPECT_EQ(store.repetition_count(id), 3);
+  // Nothing from before a pawn move can repeat.
+  play({"e2e4", "g8f6"}, id, &store);
+  EXPECT_EQ(store.repetition_count(id), 1);
+  play({"g1f3", "f6g8", "f3g1", "g8f6"}, id, &store);
+  EXPECT_EQ(store.repetition_count(id), 2);
+}
+
+TEST(GameStore, ReusesErasedGames) {
+  GameStore store;
+  std::vector<GameStore::GameId> ids;
+  for (int i = 0; i < 3000; ++i) {
+    ids.push_back(store.create(Board()));
+    play(game_moves, ids.back(), &store);
+  }
+  EXPECT_EQ(store.num_games(), 3000u);
+  const size_t memory_bytes = store.memory_bytes();
+  for (GameStore::GameId id : ids) {
+    store.erase(id);
+  }
+  EXPECT_EQ(store.num_games(), 0u);
+  for (int i = 0; i < 3000; ++i) {
+    const GameStore::GameId id = store.create(Board());
+    play(game_moves, id, &store);
+    EXPECT_EQ(store.num_plies(id), game_moves.size());
+  }
+  EXPECT_EQ(store.memory_bytes(), memory_bytes);
+  // A record, two chunks of moves and one of keys, as the capture of the last
+  // move dropped the others: far less than the Boards alone would take.
+  EXPECT_LT(memory_bytes / 3000, 320u);
+}
+
+TEST(GameStore, RestoresSnapshots) {
+  GameStore store;
+  const GameStore::GameId id = store.create(Board());
+  play(game_moves, id, &store);
+  const std::string snapshot = store.snapshot(id);
+  std::string error;
+  GameStore other;
+  const absl::optional<GameStore::GameId> restored =
+      other.restore(snapshot, &error);
+  ASSERT_TRUE(restored) << error;
+  EXPECT_EQ(other.board(*restored).to_fen(), store.board(id).to_fen());
+  EXPECT_EQ(other.moves(*restored), store.moves(id));
+  EXPECT_EQ(other.snapshot(*restored), snapshot);
+  EXPECT_EQ(other.num_games(), 1u);
+
+  EXPECT_FALSE(other.restore(snapshot.substr(0, 20), &error));
+  EXPECT_FALSE(other.restore(snapshot.substr(0, snapshot.size() - 1), &error));
+  EXPECT_FALSE(other.restore(snapshot + '\0', &error));
+  // The first move changed to e2f4.
+  std::string illegal = snapshot;
+  illegal[sizeof(PackedPosition) + 1] ^= 0x40;
+  EXPECT_FALSE(other.restore(illegal, &error));
+  EXPECT_EQ(other.num_games(), 1u);
+}
+
+TEST(GameStore, CachesLegalMoves) {
+  GameStore store;
+  const GameStore::GameId id = store.create(Board());
+  play({"e2e4", "f7f6", "d2d4"}, id, &store);
+  const GameStore::LegalMoves* moves = &store.legal_moves(id);
+  EXPECT_EQ(&store.legal_moves(id), moves);
+  const Board board = store.board(id);
+  const MoveList expected = board.legal_moves();
+  ASSERT_EQ(moves->num_moves_, expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    const Move move = expected[i];
+    EXPECT_EQ(moves->codes_[i],
+              move.src_idx_ | move.dst_idx_ << 6) << move.to_uci_str();
+    EXPECT_TRUE(moves->destinations(move.src_square()) & move.dst_square())
+        << move.to_uci_str();
+  }
+  EXPECT_EQ(moves->destinations(str_to_square("g8")), str_to_square("h6"));
+  EXPECT_EQ(moves->destinations(str_to_square("e4")), 0u);
+  EXPECT_EQ(moves->destinations(str_to_square("d8")), 0u);
+  EXPECT_FALSE(moves->is_check_);
+
+  // A move drops the moves of the position before.
+  play({"g7g5", "d1h5"}, id, &store);
+  const GameStore::LegalMoves& mated = store.legal_moves(id);
+  EXPECT_TRUE(mated.is_check_);
+  EXPECT_EQ(mated.num_moves_, 0u);
+  EXPECT_EQ(mated.origins_, 0u);
+  EXPECT_EQ(mated.destinations(str_to_square("e8")), 0u);
+}
+
+TEST(GameStore, CachesPromotionsOncePerPiece) {
+  GameStore store;
+  const GameStore::GameId id =
+      store.create(Board("8/1P6/8/8/8/8/6k1/4K3 w - - 0 1"));
+  const GameStore::LegalMoves& moves = store.legal_moves(id);
+  EXPECT_EQ(moves.destinations(str_to_square("b7")), str_to_square("b8"));
+  int num_promotions = 0;
+  for (size_t i = 0; i < moves.num_moves_; ++i) {
+    num_promotions += moves.codes_[i] >> 12 ? 1 : 0;
+  }
+  EXPECT_EQ(num_promotions, 4);
+}
+
+TEST(GameStore, FindsTheEndOfTheGame) {
+  GameStore store;
+  const GameStore::GameId mate = store.create(Board());
+  play({"f2f3", "e7e5", "g2g4"}, mate, &store);
+  EXPECT_EQ(store.status(mate), GameStore::Status::ongoing);
+  play({"d8h4"}, mate, &store);
+  EXPECT_EQ(store.status(mate), GameStore::Status::checkmate);
+  store.legal_moves(mate);
+  EXPECT_EQ(store.status(mate), GameStore::Status::checkmate);
+
+  const GameStore::GameId stalemate =
+      store.create(Board("7k/8/6K1/8/8/8/8/5Q2 w - - 0 1"));
+  play({"f1f7"}, stalemate, &store);
+  EXPECT_EQ(store.status(stalemate), GameStore::Status::stalemate);
+
+  const GameStore::GameId bare_kings =
+      store.create(Board("8/8/8/4k3/8/8/3p4/4K3 w - - 0 1"));
+  play({"e1d2"}, bare_kings, &store);
+  EXPECT_EQ(store.status(bare_kings),
+            GameStore::Status::insufficient_material);
+
+  const GameStore::GameId fifty_moves =
+      store.create(Board("8/8/8/4k3/8/8/3R4/4K3 w - - 98 80"));
+  play({"d2d1"}, fifty_moves, &store);
+  EXPECT_EQ(store.status(fifty_moves), GameStore::Status::ongoing);
+  play({"e5e4"}, fifty_moves, &store);
+  EXPECT_EQ(store.status(fifty_moves), GameStore::Status::fifty_moves);
+
+  const GameStore::GameId repetition = store.create(Board());
+  play({"g1f3", "g8f6", "f3g1", "f6g8", "g1f3", "g8f6", "f3g1"}, repetition,
+       &store);
+  EXPECT_EQ(store.status(repetition), GameStore::Status::ongoing);
+  play({"f6g8"}, repetition, &store);
+  EXPECT_EQ(store.status(repetition),
+            GameStore::Status::threefold_repetition);
+}
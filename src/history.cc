@@ -0,0 +1,68 @@
+#include "history.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include "absl/types/optional.h"
+#include "board.h"
+
+MoveHistory::MoveHistory()
+    : continuations_(num_colors * num_piece_types * 64) {
+  clear();
+}
+
+void MoveHistory::clear() {
+  for (auto& by_src : butterfly_) {
+    for (auto& by_dst : by_src) {
+      by_dst.fill(0);
+    }
+  }
+  for (auto& by_dst : capture_) {
+    for (auto& by_victim : by_dst) {
+      by_victim.fill(0);
+    }
+  }
+  for (auto& by_piece : countermoves_) {
+    for (auto& by_dst : by_piece) {
+      by_dst.fill(absl::nullopt);
+    }
+  }
+  for (PieceToHistory& continuation : continuations_) {
+    for (auto& by_dst : continuation) {
+      by_dst.fill(0);
+    }
+  }
+}
+
+void MoveHistory::update(int16_t* score, int bonus) {
+  bonus = std::max(-max_score, std::min(bonus, max_score));
+  // The bonus shrinks as the score nears the bound on its side, so the score
+  // can't leave [-max_score, max_score].
+  *score = static_cast<int16_t>(*score + bonus -
+                                *score * std::abs(bonus) / max_score);
+}
+
+void MoveHistory::update_quiet(Color side, Move move, int bonus) {
+  update(&butterfly_[static_cast<size_t>(side)][move.src_idx_][move.dst_idx_],
+         bonus);
+}
+
+void MoveHistory::update_capture(const Board& board, Move move, int bonus) {
+  update(&capture_[static_cast<size_t>(move.piece_moving_)][move.dst_idx_]
+                  [static_cast<size_t>(captured_piece(board, move))],
+         bonus);
+}
+
+void MoveHistory::update_continuation(PieceToHistory* continuation,
+                                      Move move, int bonus) {
+  update(&(*continuation)[static_cast<size_t>(move.piece_moving_)]
+                         [move.dst_idx_],
+         bonus);
+}
+
+void MoveHistory::set_countermove(Color side, Move previous, Move move) {
+  countermoves_[static_cast<size_t>(side)]
+               [static_cast<size_t>(previous.piece_moving_)]
+               [previous.dst_idx_] = move;
+}
@@ -0,0 +1,122 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "memory_accounting.h"
+
+// The scores of the quiet moves following one earlier move, by piece and
+// destination square. A node reads a few of these, so each is kept small and
+// contiguous: 768 bytes, with the squares of a piece next to each other.
+using PieceToHistory = std::array<std::array<int16_t, 64>, num_piece_types>;
+
+// How many plies up the moves are that a node's continuation histories
+// follow.
+constexpr std::array<int, 3> continuation_plies = {1, 2, 4};
+
+// The continuation histories of a node, in the order of
+// `continuation_plies`, each null if there is no such move.
+using ContinuationHistories =
+    std::array<const PieceToHistory*, continuation_plies.size()>;
+
+// What a search has learned about moves so far, for ordering the moves that
+// the MovePicker can't otherwise tell apart:
+//
+//  - The butterfly history scores quiet moves by side, source and destination
+//    square.
+//  - The capture history scores captures and promotions by piece moving,
+//    destination square and piece captured.
+//  - The countermoves are the quiet moves that last refuted a move, by the
+//    side, piece and destination square of the move refuted.
+//  - The continuation histories score quiet moves by their piece and
+//    destination square following an earlier move of the line, by the side,
+//    piece and destination square of that move. A search reads the ones of
+//    the moves 1, 2 and 4 plies up (see `continuation_plies`).
+//
+// Scores move towards a bonus on every update and are kept within
+// [-max_score, max_score], so that old results fade as new ones come in
+// rather than saturating. Each searcher keeps its own history, so nothing here
+// is shared between threads.
+class MoveHistory {
+ public:
+  static constexpr int max_score = 1 << 14;
+
+  MoveHistory();
+
+  void clear();
+
+  int quiet_score(Color side, Move move) const {
+    return butterfly_[static_cast<size_t>(side)][move.src_idx_][move.dst_idx_];
+  }
+  // `move` must be pseudolegal on `board`.
+  int capture_score(const Board& board, Move move) const {
+    return capture_[static_cast<size_t>(move.piece_moving_)][move.dst_idx_]
+                   [static_cast<size_t>(captured_piece(board, move))];
+  }
+  // Returns the quiet move that last refuted `previous`, which was made by
+  // `side`.
+  absl::optional<Move> countermove(Color side, Move previous) const {
+    return countermoves_[static_cast<size_t>(side)]
+                        [static_cast<size_t>(previous.piece_moving_)]
+                        [previous.dst_idx_];
+  }
+
+  // Returns the continuation history of the moves that follow `previous`,
+  // which was made by `side`.
+  PieceToHistory* continuation(Color side, Move previous) {
+    return &continuations_[continuation_idx(side, previous)];
+  }
+  const PieceToHistory* continuation(Color side, Move previous) const {
+    return &continuations_[continuation_idx(side, previous)];
+  }
+  static int continuation_score(const PieceToHistory& continuation,
+                                Move move) {
+    return continuation[static_cast<size_t>(move.piece_moving_)]
+                       [move.dst_idx_];
+  }
+
+  // Adds `bonus`, which is negative for moves that failed, to the score of
+  // `move`.
+  void update_quiet(Color side, Move move, int bonus);
+  void update_capture(const Board& board, Move move, int bonus);
+  static void update_continuation(PieceToHistory* continuation, Move move,
+                                  int bonus);
+  void set_countermove(Color side, Move previous, Move move);
+
+ private:
+  // Returns the piece `move` captures, or Piece::none.
+  static Piece captured_piece(const Board& board, Move move) {
+    return move.move_type_ == MoveType::en_passant
+               ? Piece::pawn
+               : board.mailbox_[move.dst_idx_];
+  }
+
+  static size_t continuation_idx(Color side, Move previous) {
+    return (static_cast<size_t>(side) * num_piece_types +
+            static_cast<size_t>(previous.piece_moving_)) *
+               64 +
+           previous.dst_idx_;
+  }
+
+  static void update(int16_t* score, int bonus);
+
+  std::array<std::array<std::array<int16_t, 64>, 64>, num_colors> butterfly_;
+  // Indexed by Piece::none as well, for promotions that capture nothing.
+  std::array<std::array<std::array<int16_t, num_piece_types + 1>, 64>,
+             num_piece_types>
+      capture_;
+  std::array<std::array<std::array<absl::optional<Move>, 64>, num_piece_types>,
+             num_colors>
+      countermoves_;
+  // One PieceToHistory per side, piece and destination square of the earlier
+  // move, 576 KiB in all, in one block allocated with the history so that a
+  // searcher stays small enough for the stack.
+  TaggedVector<PieceToHistory, MemoryTag::histories> continuations_;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "history.h"
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+TEST(MoveHistory, QuietScoresBySideAndSquares) {
+  MoveHistory history;
+  const Move move(str_to_square("g1"), str_to_square("f3"), Piece::knight,
+                  MoveType::simple);
+  EXPECT_EQ(history.quiet_score(Color::white, move), 0);
+  history.update_quiet(Color::white, move, 100);
+  EXPECT_EQ(history.quiet_score(Color::white, move), 100);
+  EXPECT_EQ(history.quiet_score(Color::black, move), 0);
+  history.update_quiet(Color::white, move, -300);
+  EXPECT_LT(history.quiet_score(Color::white, move), 0);
+  history.clear();
+  EXPECT_EQ(history.quiet_score(Color::white, move), 0);
+}
+
+TEST(MoveHistory, ScoresStayInBounds) {
+  MoveHistory history;
+  const Move move(str_to_square("e2"), str_to_square("e4"), Piece::pawn,
+                  MoveType::two_step_pawn);
+  int last = 0;
+  for (int i = 0; i < 1000; ++i) {
+    history.update_quiet(Color::white, move, 4000);
+    const int score = history.quiet_score(Color::white, move);
+    EXPECT_GE(score, last);
+    EXPECT_LE(score, MoveHistory::max_score);
+    last = score;
+  }
+  // Near the bound a bonus barely moves the score, but a malus of the same
+  // size still does.
+  EXPECT_GT(last, MoveHistory::max_score * 9 / 10);
+  history.update_quiet(Color::white, move, -4000);
+  EXPECT_LT(history.quiet_score(Color::white, move),
+            last - MoveHistory::max_score / 8);
+  for (int i = 0; i < 1000; ++i) {
+    history.update_quiet(Color::white, move, -MoveHistory::max_score * 2);
+    EXPECT_GE(history.quiet_score(Color::white, move),
+              -MoveHistory::max_score);
+  }
+}
+
+TEST(MoveHistory, CaptureScoresByVictim) {
+  const Board board("4k3/8/8/3q1n2/4P3/8/8/4K3 w - - 0 1");
+  MoveHistory history;
+  const Move takes_queen(str_to_square("e4"), str_to_square("d5"), Piece::pawn,
+                         MoveType::capture);
+  const Move takes_knight(str_to_square("e4"), str_to_square("f5"),
+                          Piece::pawn, MoveType::capture);
+  history.update_capture(board, takes_queen, 200);
+  EXPECT_EQ(history.capture_score(board, takes_queen), 200);
+  EXPECT_EQ(history.capture_score(board, takes_knight), 0);
+  // The same capture of a different piece scores separately.
+  const Board other("4k3/8/8/3r1n2/4P3/8/8/4K3 w - - 0 1");
+  EXPECT_EQ(history.capture_score(other, takes_queen), 0);
+}
+
+TEST(MoveHistory, Countermoves) {
+  MoveHistory history;
+  const Move previous(str_to_square("e7"), str_to_square("e5"), Piece::pawn,
+                      MoveType::two_step_pawn);
+  const Move reply(str_to_square("g1"), str_to_square("f3"), Piece::knight,
+                   MoveType::simple);
+  EXPECT_EQ(history.countermove(Color::black, previous), absl::nullopt);
+  history.set_countermove(Color::black, previous, reply);
+  EXPECT_EQ(history.countermove(Color::black, previous), reply);
+  EXPECT_EQ(history.countermove(Color::white, previous), absl::nullopt);
+}
+
+TEST(MoveHistory, ContinuationsByPreviousMove) {
+  MoveHistory history;
+  const Move previous(str_to_square("e7"), str_to_square("e5"), Piece::pawn,
+                      MoveType::two_step_pawn);
+  const Move other(str_to_square("d7"), str_to_square("d5"), Piece::pawn,
+                   MoveType::two_step_pawn);
+  const Move reply(str_to_square("g1"), str_to_square("f3"), Piece::knight,
+                   MoveType::simple);
+  // The same piece to the same square from elsewhere scores the same.
+  const Move same_target(str_to_square("e1"), str_to_square("f3"),
+                         Piece::knight, MoveType::simple);
+  PieceToHistory* continuation = history.continuation(Color::black, previous);
+  MoveHistory::update_continuation(continuation, reply, 100);
+  EXPECT_EQ(MoveHistory::continuation_score(*continuation, reply), 100);
+  EXPECT_EQ(MoveHistory::continuation_score(*continuation, same_target), 100);
+  EXPECT_EQ(MoveHistory::continuation_score(
+                *history.continuation(Color::white, previous), reply),
+            0);
+  EXPECT_EQ(MoveHistory::continuation_score(
+                *history.continuation(Color::black, other), reply),
+            0);
+  history.clear();
+  EXPECT_EQ(MoveHistory::continuation_score(*continuation, reply), 0);
+}
@@ -0,0 +1,220 @@
+#include "inference_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "absl/base/internal/raw_logging.h"
+#include "bitboard.h"
+#include "board.h"
+#include "board_batch.h"
+#include "debug_check.h"
+#include "mcts.h"
+
+namespace {
+// Sets the squares of `bitboard` in `plane` to 1 and the others to 0.
+void fill_plane(Bitboard bitboard, float* plane) {
+  for (size_t idx = 0; idx < 64; ++idx) {
+    plane[idx] = static_cast<float>((bitboard >> idx) & 1);
+  }
+}
+
+size_t castling_plane(size_t right) {
+  return 2 * num_piece_types + 1 + right;
+}
+
+constexpr size_t side_to_move_plane = 2 * num_piece_types;
+constexpr size_t en_passant_plane = 2 * num_piece_types + 5;
+constexpr size_t fifty_move_plane = 2 * num_piece_types + 6;
+}  // namespace.
+
+void encode_inference_inputs(BoardBatchSlice positions, float* inputs) {
+  const auto plane = [inputs](size_t position_idx, size_t plane_idx) {
+    return inputs + position_idx * inference_input_size + plane_idx * 64;
+  };
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      const Bitboard* const column = positions.pieces(
+          static_cast<Color>(color), static_cast<Piece>(piece));
+      for (size_t i = 0; i < positions.size(); ++i) {
+        fill_plane(column[i], plane(i, color * num_piece_types + piece));
+      }
+    }
+  }
+  const uint8_t* const flags = positions.flags();
+  for (size_t i = 0; i < positions.size(); ++i) {
+    std::fill_n(plane(i, side_to_move_plane), 64,
+                static_cast<float>(flags[i] & 1));
+    for (size_t right = 0; right < 4; ++right) {
+      std::fill_n(plane(i, castling_plane(right)), 64,
+                  static_cast<float>((flags[i] >> (1 + right)) & 1));
+    }
+  }
+  const uint8_t* const en_passant_idxs = positions.en_passant_idxs();
+  for (size_t i = 0; i < positions.size(); ++i) {
+    fill_plane(en_passant_idxs[i] < 64 ? lsb_bitboard << en_passant_idxs[i]
+                                       : Bitboard{0},
+               plane(i, en_passant_plane));
+  }
+  const uint8_t* const fifty_move_clocks = positions.fifty_move_clocks();
+  for (size_t i = 0; i < positions.size(); ++i) {
+    std::fill_n(plane(i, fifty_move_plane), 64,
+                static_cast<float>(fifty_move_clocks[i]) / 100.0f);
+  }
+}
+
+InferenceQueue::Batch::Batch(size_t capacity) : positions_(capacity) {
+  requests_.reserve(capacity);
+}
+
+InferenceQueue::InferenceQueue(InferenceBackend* backend,
+                               size_t max_batch_size,
+                               std::chrono::microseconds max_wait)
+    : backend_(backend),
+      max_batch_size_(max_batch_size),
+      max_wait_(max_wait),
+      inputs_(max_batch_size * inference_input_size),
+      values_(max_batch_size),
+      policy_logits_(max_batch_size * inference_policy_size),
+      collecting_(std::make_unique<Batch>(max_batch_size)),
+      running_(std::make_unique<Batch>(max_batch_size)),
+      stopping_(false),
+      num_batches_(0),
+      num_positions_(0) {
+  ABSL_RAW_CHECK(max_batch_size > 0, "A batch must hold a position.");
+  dispatcher_ = std::thread([this] { dispatch(); });
+}
+
+InferenceQueue::~InferenceQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  pending_.notify_one();
+  dispatcher_.join();
+}
+
+float InferenceQueue::evaluate(const Board& board, const MoveList& moves,
+                               float* priors) {
+  float value = 0.0f;
+  bool done = false;
+  std::unique_lock<std::mutex> lock(mutex_);
+  add(board, Request{&moves, priors, &value, nullptr, &done}, &lock);
+  done_.wait(lock, [&done] { return done; });
+  return value;
+}
+
+void InferenceQueue::submit(const Board& board, const MoveList& moves,
+                            float* priors, float* value,
+                            std::function<void()> on_done) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  add(board, Request{&moves, priors, value, std::move(on_done), nullptr},
+      &lock);
+}
+
+void InferenceQueue::add(const Board& board, Request request,
+                         std::unique_lock<std::mutex>* lock) {
+  DEBUG_CHECK(!request.moves_->empty(),
+              "Only positions with moves are evaluated.");
+  // A full batch is taken by the dispatcher once it is done with the other.
+  done_.wait(*lock, [this] {
+    return collecting_->requests_.size() < max_batch_size_;
+  });
+  if (collecting_->requests_.empty()) {
+    collecting_->start_ = std::chrono::steady_clock::now();
+  }
+  collecting_->positions_.push_back(board);
+  collecting_->requests_.push_back(std::move(request));
+  if (collecting_->requests_.size() == 1 ||
+      collecting_->requests_.size() == max_batch_size_) {
+    pending_.notify_one();
+  }
+}
+
+MctsEvaluator InferenceQueue::evaluator() {
+  return [this](const Board& board, const MoveList& moves, float* priors) {
+    return evaluate(board, moves, priors);
+  };
+}
+
+uint64_t InferenceQueue::num_batches() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_batches_;
+}
+
+uint64_t InferenceQueue::num_positions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_positions_;
+}
+
+void InferenceQueue::dispatch() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    pending_.wait(lock, [this] {
+      return stopping_ || !collecting_->requests_.empty();
+    });
+    if (collecting_->requests_.empty()) {
+      return;
+    }
+    pending_.wait_until(lock, collecting_->start_ + max_wait_, [this] {
+      return stopping_ || collecting_->requests_.size() == max_batch_size_;
+    });
+    std::swap(collecting_, running_);
+    // Threads waiting for room can go on with the empty batch.
+    done_.notify_all();
+    lock.unlock();
+    run(running_.get());
+    for (const Request& request : running_->requests_) {
+      if (request.on_done_) {
+        request.on_done_();
+      }
+    }
+    lock.lock();
+    for (const Request& request : running_->requests_) {
+      if (request.done_) {
+        *request.done_ = true;
+      }
+    }
+    ++num_batches_;
+    num_positions_ += running_->requests_.size();
+    running_->requests_.clear();
+    running_->positions_.clear();
+    done_.notify_all();
+  }
+}
+
+void InferenceQueue::run(Batch* batch) {
+  const BoardBatchSlice positions = batch->positions_;
+  encode_inference_inputs(positions, inputs_.data());
+  backend_->run(InferenceBatch{positions, inputs_.data(), values_.data(),
+                               policy_logits_.data()});
+  for (size_t i = 0; i < positions.size(); ++i) {
+    Request* const request = &batch->requests_[i];
+    *request->value_ = std::max(-1.0f, std::min(values_[i], 1.0f));
+    const float* const logits =
+        policy_logits_.data() + i * inference_policy_size;
+    const MoveList& moves = *request->moves_;
+    float max_logit = -std::numeric_limits<float>::infinity();
+    for (Move move : moves) {
+      max_logit =
+          std::max(max_logit, logits[move.src_idx_ * 64 + move.dst_idx_]);
+    }
+    float total = 0.0f;
+    for (size_t j = 0; j < moves.size(); ++j) {
+      const Move move = moves[j];
+      request->priors_[j] =
+          std::exp(logits[move.src_idx_ * 64 + move.dst_idx_] - max_logit);
+      total += request->priors_[j];
+    }
+    for (size_t j = 0; j < moves.size(); ++j) {
+      request->priors_[j] /= total;
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#ifndef INFERENCE_QUEUE_H
+#define INFERENCE_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "board_batch.h"
+#include "mcts.h"
+
+// The input planes of a policy and value network, 64 floats each, one per
+// square in `square_idx` order: a plane per color and piece type, white's
+// first in Piece order, then one that is all ones with black to move, one per
+// castling right in CastlingRights bit order, one with the en passant square
+// set and one holding the fifty move clock divided by 100 on every square.
+constexpr size_t inference_num_planes = 2 * num_piece_types + 7;
+constexpr size_t inference_input_size = inference_num_planes * 64;
+// The policy has a logit per source and destination square, at index
+// `src_idx_ * 64 + dst_idx_`; promotions to any piece share theirs.
+constexpr size_t inference_policy_size = 64 * 64;
+
+// Writes the input planes of each position of `positions` to
+// `inputs[i * inference_input_size, (i + 1) * inference_input_size)`,
+// reading the columns of the batch directly, one plane of every position
+// after another.
+void encode_inference_inputs(BoardBatchSlice positions, float* inputs);
+
+// Where a backend finds the positions of a batch and puts its results.
+struct InferenceBatch {
+  // The positions, and their planes as `encode_inference_inputs` writes
+  // them.
+  BoardBatchSlice positions_;
+  const float* inputs_;
+  // Per position, the value for the side to move in [-1, 1], and
+  // `inference_policy_size` policy logits.
+  float* values_;
+  float* policy_logits_;
+};
+
+// Runs a network on a batch of positions, on the CPU or a device. Called from
+// the dispatching thread of an InferenceQueue only, one batch at a time.
+class InferenceBackend {
+ public:
+  virtual ~InferenceBackend() = default;
+  virtual void run(const InferenceBatch& batch) = 0;
+};
+
+// Gathers the positions that search threads want evaluated into batches for
+// an InferenceBackend, which runs far faster on a batch than on as many
+// single positions. A thread calling `evaluate` adds its position to the
+// batch being collected and sleeps. A dispatching thread hands the batch to
+// the backend once it is full, or `max_wait` after its first position came
+// in, and wakes the threads waiting on it when its results are in.
+//
+// The positions go straight into the columns of a BoardBatch, which the
+// inputs are encoded from. There are two batches, so that threads keep
+// adding positions to one while the backend runs the other.
+class InferenceQueue {
+ public:
+  // `backend` isn't owned.
+  InferenceQueue(InferenceBackend* backend, size_t max_batch_size,
+                 std::chrono::microseconds max_wait);
+  InferenceQueue(const InferenceQueue&) = delete;
+  InferenceQueue& operator=(const InferenceQueue&) = delete;
+  // Runs the batch still being collected, if any, first.
+  ~InferenceQueue();
+
+  // Returns the value of `board` for the side to move and sets `priors[i]`
+  // to the softmax of the policy logits of `moves[i]` over `moves`, its
+  // legal moves, at least one. Blocks until the batch holding `board` has
+  // been run. Any number of threads may call it at once.
+  float evaluate(const Board& board, const MoveList& moves, float* priors);
+  // The same without blocking: adds `board` to a batch and returns, unless
+  // both batches are full, and calls `on_done` once `*value` and `priors` are
+  // set. `moves` and the outputs must live until then. `on_done` is called on
+  // the dispatching thread, so it should only hand the work on, as the
+  // coroutines of mcts_coroutines.h resume on a thread pool.
+  void submit(const Board& board, const MoveList& moves, float* priors,
+              float* value, std::function<void()> on_done);
+  // Returns an evaluator for MctsSearcher that calls `evaluate`. The queue
+  // must outlive the searcher using it.
+  MctsEvaluator evaluator();
+
+  // The batches run so far and the positions in them.
+  uint64_t num_batches() const;
+  uint64_t num_positions() const;
+
+ private:
+  // A position waiting in a batch, and where its results go.
+  struct Request {
+    const MoveList* moves_;
+    float* priors_;
+    float* value_;
+    // Set by `submit`. For `evaluate`, whose thread waits for `*done_`, it is
+    // null.
+    std::function<void()> on_done_;
+    bool* done_;
+  };
+
+  struct Batch {
+    explicit Batch(size_t capacity);
+
+    BoardBatch positions_;
+    std::vector<Request> requests_;
+    // When the first request came in.
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  // Adds `request` for `board` to the batch being collected, once it has
+  // room.
+  void add(const Board& board, Request request,
+           std::unique_lock<std::mutex>* lock);
+  // The loop of the dispatching thread.
+  void dispatch();
+  // Runs `batch`, outside the lock, and sets the results of its requests.
+  void run(Batch* batch);
+
+  InferenceBackend* const backend_;
+  const size_t max_batch_size_;
+  const std::chrono::microseconds max_wait_;
+  // The inputs and outputs of the batch being run.
+  std::vector<float> inputs_;
+  std::vector<float> values_;
+  std::vector<float> policy_logits_;
+
+  mutable std::mutex mutex_;
+  // Signalled when a batch gets its first request or fills up, and on
+  // shutdown.
+  std::condition_variable pending_;
+  // Signalled when a batch has been run.
+  std::condition_variable done_;
+  // The batch requests are added to, and the one being run.
+  std::unique_ptr<Batch> collecting_;
+  std::unique_ptr<Batch> running_;
+  bool stopping_;
+  uint64_t num_batches_;
+  uint64_t num_positions_;
+  std::thread dispatcher_;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "inference_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "board_batch.h"
+#include "gtest/gtest.h"
+#include "mcts.h"
+#include "thread_pool.h"
+
+namespace {
+// Values a position by whose move it is, from the inputs, and favours moves
+// to higher squares.
+class FakeBackend : public InferenceBackend {
+ public:
+  void run(const InferenceBatch& batch) override {
+    for (size_t i = 0; i < batch.positions_.size(); ++i) {
+      const float black_to_move =
+          batch.inputs_[i * inference_input_size + 2 * num_piece_types * 64];
+      batch.values_[i] = black_to_move > 0.0f ? -0.5f : 0.5f;
+      for (size_t j = 0; j < inference_policy_size; ++j) {
+        batch.policy_logits_[i * inference_policy_size + j] =
+            static_cast<float>(j % 64) / 8.0f;
+      }
+    }
+    batch_sizes_.push_back(batch.positions_.size());
+  }
+
+  std::vector<size_t> batch_sizes_;
+};
+}  // namespace.
+
+TEST(EncodeInferenceInputs, EncodesEachPlane) {
+  BoardBatch batch(2);
+  batch.push_back(Board());
+  batch.push_back(Board("4k3/8/8/3pP3/8/8/8/4K2R w K d6 0 1"));
+  std::vector<float> inputs(2 * inference_input_size);
+  encode_inference_inputs(batch, inputs.data());
+  const auto at = [&inputs](size_t position, size_t plane, const char* square) {
+    return inputs[position * inference_input_size + plane * 64 +
+                  square_idx(str_to_square(square))];
+  };
+  const size_t white_pawns = static_cast<size_t>(Piece::pawn);
+  const size_t black_king = num_piece_types + static_cast<size_t>(Piece::king);
+  EXPECT_EQ(at(0, white_pawns, "e2"), 1.0f);
+  EXPECT_EQ(at(0, white_pawns, "e4"), 0.0f);
+  EXPECT_EQ(at(0, black_king, "e8"), 1.0f);
+  EXPECT_EQ(at(1, white_pawns, "e5"), 1.0f);
+  // Side to move, castling rights, en passant.
+  EXPECT_EQ(at(0, 2 * num_piece_types, "a1"), 0.0f);
+  EXPECT_EQ(at(0, 2 * num_piece_types + 1, "h8"), 1.0f);
+  EXPECT_EQ(at(1, 2 * num_piece_types + 1, "h8") +
+                at(1, 2 * num_piece_types + 2, "h8") +
+                at(1, 2 * num_piece_types + 3, "h8") +
+                at(1, 2 * num_piece_types + 4, "h8"),
+            1.0f);
+  EXPECT_EQ(at(1, 2 * num_piece_types + 5, "d6"), 1.0f);
+  EXPECT_EQ(at(0, 2 * num_piece_types + 5, "d6"), 0.0f);
+}
+
+TEST(InferenceQueue, EvaluatesSinglePosition) {
+  FakeBackend backend;
+  InferenceQueue queue(&backend, 8, std::chrono::microseconds(100));
+  const Board board("4k3/8/8/8/8/8/8/R3K3 b - - 0 1");
+  const MoveList moves = board.legal_moves();
+  std::vector<float> priors(moves.size());
+  EXPECT_EQ(queue.evaluate(board, moves, priors.data()), -0.5f);
+  float total = 0.0f;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    total += priors[i];
+    for (size_t j = 0; j < moves.size(); ++j) {
+      if (moves[i].dst_idx_ > moves[j].dst_idx_) {
+        EXPECT_GT(priors[i], priors[j]);
+      }
+    }
+  }
+  EXPECT_NEAR(total, 1.0f, 1e-5f);
+  EXPECT_EQ(queue.num_batches(), 1);
+  EXPECT_EQ(queue.num_positions(), 1);
+}
+
+TEST(InferenceQueue, BatchesPositionsOfManyThreads) {
+  FakeBackend backend;
+  constexpr size_t num_threads = 4;
+  {
+    // Long enough that the batch only goes when it is full.
+    InferenceQueue queue(&backend, num_threads, std::chrono::seconds(60));
+    std::vector<std::thread> threads;
+    std::atomic<int> num_correct(0);
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&queue, &num_correct] {
+        const Board board;
+        const MoveList moves = board.legal_moves();
+        std::vector<float> priors(moves.size());
+        if (queue.evaluate(board, moves, priors.data()) == 0.5f) {
+          ++num_correct;
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(num_correct, num_threads);
+    EXPECT_EQ(queue.num_batches(), 1);
+  }
+  EXPECT_EQ(backend.batch_sizes_, std::vector<size_t>{num_threads});
+}
+
+TEST(InferenceQueue, EvaluatesForMcts) {
+  FakeBackend backend;
+  InferenceQueue queue(&backend, 4, std::chrono::microseconds(200));
+  ThreadPool pool(3);
+  MctsSearcher searcher(&pool);
+  searcher.set_evaluator(queue.evaluator());
+  const MctsResult res = searcher.search(Board(), MctsLimits{200, 0, nullptr});
+  ASSERT_TRUE(res.best_move_.has_value());
+  EXPECT_GE(res.playouts_, 200);
+  EXPECT_GE(queue.num_positions(), queue.num_batches());
+  EXPECT_LE(queue.num_positions(), res.num_nodes_);
+}
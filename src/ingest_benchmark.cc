@@ -0,0 +1,236 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "benchmark/benchmark.h"
+#include "board.h"
+#include "packed_position.h"
+#include "pgn.h"
+#include "random_positions.h"
+#include "thread_pool.h"
+
+// Throughput of reading and writing positions in the formats batch jobs take
+// them in, which often bounds those jobs more than the search does: FEN
+// parsing and writing, PGN replay and packed binary positions. Each benchmark
+// reports the positions it handled per second as items, over a synthetic
+// corpus from random_positions.h, so that ingest regressions show apart from
+// engine speed.
+//
+//   ingest_benchmark --benchmark_filter=Fen
+
+namespace {
+constexpr size_t num_corpus_positions = 1000;
+constexpr size_t num_corpus_games = 100;
+constexpr int max_game_plies = 160;
+
+// Playouts and random material alike, as random_positions.h draws them.
+const std::vector<Board>& corpus_boards() {
+  static const std::vector<Board> res = [] {
+    std::vector<Board> boards;
+    std::mt19937_64 rng(1);
+    while (boards.size() < num_corpus_positions) {
+      boards.push_back(random_playout_position(10, 120, &rng));
+      boards.push_back(random_material_position(&rng));
+    }
+    return boards;
+  }();
+  return res;
+}
+
+const std::vector<std::string>& corpus_fens() {
+  static const std::vector<std::string> res = [] {
+    std::vector<std::string> fens;
+    for (const Board& board : corpus_boards()) {
+      fens.push_back(board.to_fen());
+    }
+    return fens;
+  }();
+  return res;
+}
+
+const std::vector<PackedPosition>& corpus_packed() {
+  static const std::vector<PackedPosition> res = [] {
+    std::vector<PackedPosition> packed;
+    for (const Board& board : corpus_boards()) {
+      packed.push_back(pack_position(board, 0, 0));
+    }
+    return packed;
+  }();
+  return res;
+}
+
+// Random games from the start position, in PGN with SAN moves, and the
+// number of positions they pass through.
+struct PgnCorpus {
+  std::string text_;
+  int64_t num_positions_;
+};
+
+const PgnCorpus& corpus_pgn() {
+  static const PgnCorpus res = [] {
+    PgnCorpus corpus = {"", 0};
+    std::mt19937_64 rng(1);
+    for (size_t game = 0; game < num_corpus_games; ++game) {
+      absl::StrAppend(&corpus.text_, "[Event \"Random game ", game + 1,
+                      "\"]\n[Result \"*\"]\n\n");
+      Board board;
+      for (int ply = 0; ply < max_game_plies; ++ply) {
+        const MoveList moves = board.legal_moves();
+        if (moves.empty()) {
+          break;
+        }
+        const Move move = moves[std::uniform_int_distribution<size_t>(
+            0, moves.size() - 1)(rng)];
+        if (ply % 2 == 0) {
+          absl::StrAppend(&corpus.text_, ply / 2 + 1, ". ");
+        }
+        append_san(board, move, &corpus.text_);
+        corpus.text_ += ply % 16 == 15 ? '\n' : ' ';
+        board.do_move(move);
+        ++corpus.num_positions_;
+      }
+      corpus.text_ += "*\n\n";
+    }
+    return corpus;
+  }();
+  return res;
+}
+
+int64_t num_corpus_items() {
+  return static_cast<int64_t>(corpus_boards().size());
+}
+
+// The constructor, which aborts on a bad FEN.
+void BM_FenConstructor(benchmark::State& state) {
+  for (auto _ : state) {
+    for (const std::string& fen : corpus_fens()) {
+      benchmark::DoNotOptimize(Board(fen));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_FenConstructor);
+
+// The single pass parser for bulk input, which reports bad FENs.
+void BM_ParseFen(benchmark::State& state) {
+  for (auto _ : state) {
+    for (const std::string& fen : corpus_fens()) {
+      benchmark::DoNotOptimize(parse_fen(fen));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_ParseFen);
+
+// Into one board, as a loop over a file would.
+void BM_SetFen(benchmark::State& state) {
+  Board board;
+  for (auto _ : state) {
+    for (const std::string& fen : corpus_fens()) {
+      benchmark::DoNotOptimize(board.set_fen(fen));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_SetFen);
+
+void BM_WriteFen(benchmark::State& state) {
+  std::array<char, Board::max_fen_size> buf;
+  for (auto _ : state) {
+    for (const Board& board : corpus_boards()) {
+      benchmark::DoNotOptimize(board.to_fen(buf.data()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_WriteFen);
+
+// Reads the games and plays their moves, so an item is a position of a game.
+void BM_PgnReplay(benchmark::State& state) {
+  const PgnCorpus& corpus = corpus_pgn();
+  for (auto _ : state) {
+    PgnReader reader(corpus.text_);
+    PgnGame game;
+    while (reader.next(&game)) {
+      benchmark::DoNotOptimize(replay_game(
+          game, [](const Board& board, Move move) {
+            benchmark::DoNotOptimize(board.key_);
+            benchmark::DoNotOptimize(move);
+          }));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * corpus.num_positions_);
+}
+BENCHMARK(BM_PgnReplay);
+
+// The same on as many workers as the argument says, each reading whole
+// pieces of the text (see `read_games_parallel`).
+void BM_PgnReplayParallel(benchmark::State& state) {
+  const PgnCorpus& corpus = corpus_pgn();
+  ThreadPool pool(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    read_games_parallel(corpus.text_, &pool,
+                        [](size_t, const PgnGame& game, std::string*) {
+                          benchmark::DoNotOptimize(replay_game(
+                              game, [](const Board& board, Move move) {
+                                benchmark::DoNotOptimize(board.key_);
+                                benchmark::DoNotOptimize(move);
+                              }));
+                        });
+  }
+  state.SetItemsProcessed(state.iterations() * corpus.num_positions_);
+}
+BENCHMARK(BM_PgnReplayParallel)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+void BM_PackPosition(benchmark::State& state) {
+  for (auto _ : state) {
+    for (const Board& board : corpus_boards()) {
+      benchmark::DoNotOptimize(pack_position(board, 0, 0));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_PackPosition);
+
+void BM_UnpackPosition(benchmark::State& state) {
+  for (auto _ : state) {
+    for (const PackedPosition& packed : corpus_packed()) {
+      benchmark::DoNotOptimize(unpack_position(packed));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_UnpackPosition);
+
+// The bulk versions, over the whole corpus at once.
+void BM_PackPositions(benchmark::State& state) {
+  const std::vector<Board>& boards = corpus_boards();
+  const std::vector<int> zeros(boards.size(), 0);
+  std::vector<PackedPosition> packed(boards.size());
+  for (auto _ : state) {
+    pack_positions(boards.data(), zeros.data(), zeros.data(), boards.size(),
+                   packed.data());
+    benchmark::DoNotOptimize(packed.data());
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_PackPositions);
+
+void BM_UnpackPositions(benchmark::State& state) {
+  const std::vector<PackedPosition>& packed = corpus_packed();
+  std::vector<Board> boards(packed.size());
+  for (auto _ : state) {
+    unpack_positions(packed.data(), packed.size(), boards.data());
+    benchmark::DoNotOptimize(boards.data());
+  }
+  state.SetItemsProcessed(state.iterations() * num_corpus_items());
+}
+BENCHMARK(BM_UnpackPositions);
+}  // namespace.
+
+BENCHMARK_MAIN();
@@ -0,0 +1,197 @@
+#include "instrumentation.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+const char* const counter_names[num_counters] = {
+    "nodes",
+    "quiescence_nodes",
+    "tt_probes",
+    "tt_hits",
+    "capture_generations",
+    "quiet_generations",
+    "evasion_generations",
+    "illegal_moves",
+    "moves_made",
+    "moves_unmade",
+};
+const char* const phase_names[num_phases] = {"move_generation", "evaluation",
+                                             "search"};
+
+// The counts of one thread. Only that thread writes them, with a relaxed load
+// and store rather than an atomic add, so that counting costs no more than a
+// plain increment, while `collect_counters` may read them at any time.
+struct alignas(64) ThreadCounters {
+  std::array<std::atomic<uint64_t>, num_counters> counts_;
+  std::array<std::atomic<uint64_t>, num_cutoff_buckets> cutoffs_;
+  std::array<std::atomic<uint64_t>, num_phases> phase_ticks_;
+  std::array<std::atomic<uint64_t>, num_phases> phase_calls_;
+
+  ThreadCounters();
+  ~ThreadCounters();
+};
+
+void increase(std::atomic<uint64_t>* value, uint64_t n) {
+  value->store(value->load(std::memory_order_relaxed) + n,
+               std::memory_order_relaxed);
+}
+
+template <size_t size>
+void add_to(const std::array<std::atomic<uint64_t>, size>& values,
+            std::array<uint64_t, size>* res) {
+  for (size_t i = 0; i < size; ++i) {
+    (*res)[i] += values[i].load(std::memory_order_relaxed);
+  }
+}
+
+template <size_t size>
+void subtract(const std::array<uint64_t, size>& values,
+              std::array<uint64_t, size>* res) {
+  for (size_t i = 0; i < size; ++i) {
+    (*res)[i] -= values[i];
+  }
+}
+
+void add_snapshot(const ThreadCounters& counters, CounterSnapshot* res) {
+  add_to(counters.counts_, &res->counts_);
+  add_to(counters.cutoffs_, &res->cutoffs_);
+  add_to(counters.phase_ticks_, &res->phase_ticks_);
+  add_to(counters.phase_calls_, &res->phase_calls_);
+}
+
+// The counters of the running threads, and the counts of those that have
+// exited and of the last reset.
+struct Registry {
+  std::mutex mutex_;
+  std::vector<const ThreadCounters*> threads_;
+  CounterSnapshot exited_ = {};
+  CounterSnapshot reset_ = {};
+};
+
+// Never destroyed, since threads may exit after static destruction.
+Registry& registry() {
+  static Registry* const res = new Registry();
+  return *res;
+}
+
+template <size_t size>
+void clear(std::array<std::atomic<uint64_t>, size>* values) {
+  for (std::atomic<uint64_t>& value : *values) {
+    value.store(0, std::memory_order_relaxed);
+  }
+}
+
+ThreadCounters::ThreadCounters() {
+  clear(&counts_);
+  clear(&cutoffs_);
+  clear(&phase_ticks_);
+  clear(&phase_calls_);
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex_);
+  reg.threads_.push_back(this);
+}
+
+ThreadCounters::~ThreadCounters() {
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex_);
+  add_snapshot(*this, &reg.exited_);
+  for (size_t i = 0; i < reg.threads_.size(); ++i) {
+    if (reg.threads_[i] == this) {
+      reg.threads_[i] = reg.threads_.back();
+      reg.threads_.pop_back();
+      break;
+    }
+  }
+}
+
+ThreadCounters& thread_counters() {
+  thread_local ThreadCounters counters;
+  return counters;
+}
+
+// Adds up every thread's counts, with the registry locked.
+CounterSnapshot total_counts(const Registry& reg) {
+  CounterSnapshot res = reg.exited_;
+  for (const ThreadCounters* counters : reg.threads_) {
+    add_snapshot(*counters, &res);
+  }
+  return res;
+}
+}  // namespace.
+
+void add_count(Counter counter, uint64_t n) {
+  increase(&thread_counters().counts_[static_cast<size_t>(counter)], n);
+}
+
+void add_cutoff(size_t move_idx) {
+  increase(&thread_counters()
+                .cutoffs_[move_idx < num_cutoff_buckets
+                              ? move_idx
+                              : num_cutoff_buckets - 1],
+           1);
+}
+
+void add_phase_time(Phase phase, uint64_t ticks) {
+  ThreadCounters& counters = thread_counters();
+  increase(&counters.phase_ticks_[static_cast<size_t>(phase)], ticks);
+  increase(&counters.phase_calls_[static_cast<size_t>(phase)], 1);
+}
+
+uint64_t instrumentation_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
+
+CounterSnapshot collect_counters() {
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex_);
+  CounterSnapshot res = total_counts(reg);
+  subtract(reg.reset_.counts_, &res.counts_);
+  subtract(reg.reset_.cutoffs_, &res.cutoffs_);
+  subtract(reg.reset_.phase_ticks_, &res.phase_ticks_);
+  subtract(reg.reset_.phase_calls_, &res.phase_calls_);
+  return res;
+}
+
+void reset_counters() {
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex_);
+  reg.reset_ = total_counts(reg);
+}
+
+std::string counters_to_str(const CounterSnapshot& snapshot) {
+  std::string res;
+  for (size_t i = 0; i < num_counters; ++i) {
+    absl::StrAppend(&res, counter_names[i], " ", snapshot.counts_[i], "\n");
+  }
+  for (size_t i = 0; i < num_cutoff_buckets; ++i) {
+    absl::StrAppend(&res, "cutoffs_at_move_", i + 1,
+                    i + 1 == num_cutoff_buckets ? "_or_later " : " ",
+                    snapshot.cutoffs_[i], "\n");
+  }
+  for (size_t i = 0; i < num_phases; ++i) {
+    absl::StrAppend(&res, phase_names[i], "_ticks ", snapshot.phase_ticks_[i],
+                    "\n", phase_names[i], "_calls ", snapshot.phase_calls_[i],
+                    "\n");
+  }
+  return res;
+}
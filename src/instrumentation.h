@@ -0,0 +1,109 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Counters of what the search does most, and timers of the phases it spends
+// its time in, for telling where the time goes without a profiler. Whether
+// the search is instrumented is picked at compile time with
+// PAWN_GRABBER_INSTRUMENT, like the checks of debug_check.h:
+//
+//   0: The INSTRUMENT_* macros compile to nothing. This is the default.
+//   1: They count and time.
+//
+// Every thread counts into storage of its own, so counting is a load and a
+// store to memory no other thread writes, and the counts of all threads are
+// only added up when `collect_counters` asks for them. The functions behind
+// the macros are always compiled, so they can be tested and can't go stale.
+
+enum class Counter {
+  // Positions visited by the search, and how many of them were in the
+  // quiescence search.
+  nodes,
+  quiescence_nodes,
+  tt_probes,
+  tt_hits,
+  // Calls of the generators, per move picker stage.
+  capture_generations,
+  quiet_generations,
+  evasion_generations,
+  // Generated moves that turned out illegal.
+  illegal_moves,
+  moves_made,
+  moves_unmade,
+};
+constexpr size_t num_counters = 10;
+
+enum class Phase { move_generation, evaluation, search };
+constexpr size_t num_phases = 3;
+
+// Beta cutoffs are counted by the index of the move that made them among the
+// moves searched, with the last bucket for that index and all later ones.
+constexpr size_t num_cutoff_buckets = 8;
+
+struct CounterSnapshot {
+  std::array<uint64_t, num_counters> counts_;
+  std::array<uint64_t, num_cutoff_buckets> cutoffs_;
+  // Time stamp counter ticks spent in each phase, and how often it was
+  // entered. Phases nest, the search around the others, and each counts the
+  // ticks of the phases inside it.
+  std::array<uint64_t, num_phases> phase_ticks_;
+  std::array<uint64_t, num_phases> phase_calls_;
+
+  uint64_t count(Counter counter) const {
+    return counts_[static_cast<size_t>(counter)];
+  }
+};
+
+// Adds to a counter of the calling thread.
+void add_count(Counter counter, uint64_t n);
+// Counts a beta cutoff by the `move_idx`th move searched, from 0.
+void add_cutoff(size_t move_idx);
+void add_phase_time(Phase phase, uint64_t ticks);
+// The time stamp counter, or nanoseconds where there is none.
+uint64_t instrumentation_ticks();
+
+// Adds up the counts of every thread, those that have exited included, since
+// the last `reset_counters`.
+CounterSnapshot collect_counters();
+// Starts counting from 0 again. The threads' own counts are never written by
+// another thread, so this only remembers what to subtract.
+void reset_counters();
+// One "name value" line per counter, cutoff bucket and phase.
+std::string counters_to_str(const CounterSnapshot& snapshot);
+
+// Adds the time from its construction to its destruction to `phase`.
+class ScopedPhaseTimer {
+ public:
+  explicit ScopedPhaseTimer(Phase phase)
+      : phase_(phase), start_(instrumentation_ticks()) {}
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+  ~ScopedPhaseTimer() {
+    add_phase_time(phase_, instrumentation_ticks() - start_);
+  }
+
+ private:
+  const Phase phase_;
+  const uint64_t start_;
+};
+
+#ifndef PAWN_GRABBER_INSTRUMENT
+#define PAWN_GRABBER_INSTRUMENT 0
+#endif
+
+#if PAWN_GRABBER_INSTRUMENT
+#define INSTRUMENT_COUNT(counter) add_count(Counter::counter, 1)
+#define INSTRUMENT_CUTOFF(move_idx) add_cutoff(move_idx)
+#define INSTRUMENT_PHASE(phase) \
+  const ScopedPhaseTimer instrument_phase_##phase(Phase::phase)
+#else
+#define INSTRUMENT_COUNT(counter) static_cast<void>(0)
+#define INSTRUMENT_CUTOFF(move_idx) static_cast<void>(sizeof(move_idx))
+#define INSTRUMENT_PHASE(phase) static_cast<void>(0)
+#endif
+
+#endif
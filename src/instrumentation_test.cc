@@ -0,0 +1,65 @@
+#include "instrumentation.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// The functions behind the macros are compiled whatever
+// PAWN_GRABBER_INSTRUMENT is, so they are tested directly.
+
+TEST(Instrumentation, AddsUpTheCountsOfExitedThreads) {
+  reset_counters();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([] {
+      for (int j = 0; j < 1000; ++j) {
+        add_count(Counter::nodes, 1);
+      }
+      add_count(Counter::tt_hits, 5);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  add_count(Counter::nodes, 1);
+  const CounterSnapshot snapshot = collect_counters();
+  EXPECT_EQ(snapshot.count(Counter::nodes), 4001);
+  EXPECT_EQ(snapshot.count(Counter::tt_hits), 20);
+  EXPECT_EQ(snapshot.count(Counter::tt_probes), 0);
+}
+
+TEST(Instrumentation, ResetStartsFromZero) {
+  add_count(Counter::moves_made, 3);
+  add_cutoff(0);
+  reset_counters();
+  EXPECT_EQ(collect_counters().count(Counter::moves_made), 0);
+  add_count(Counter::moves_made, 2);
+  add_cutoff(1);
+  // Indices past the buckets go to the last one.
+  add_cutoff(100);
+  const CounterSnapshot snapshot = collect_counters();
+  EXPECT_EQ(snapshot.count(Counter::moves_made), 2);
+  EXPECT_EQ(snapshot.cutoffs_[0], 0);
+  EXPECT_EQ(snapshot.cutoffs_[1], 1);
+  EXPECT_EQ(snapshot.cutoffs_[num_cutoff_buckets - 1], 1);
+}
+
+TEST(Instrumentation, TimesPhases) {
+  reset_counters();
+  {
+    const ScopedPhaseTimer timer(Phase::evaluation);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const CounterSnapshot snapshot = collect_counters();
+  const size_t evaluation = static_cast<size_t>(Phase::evaluation);
+  EXPECT_EQ(snapshot.phase_calls_[evaluation], 1);
+  EXPECT_GT(snapshot.phase_ticks_[evaluation], 0);
+  EXPECT_EQ(snapshot.phase_calls_[static_cast<size_t>(Phase::search)], 0);
+  const std::string str = counters_to_str(snapshot);
+  EXPECT_NE(str.find("\nevaluation_calls 1\n"), std::string::npos);
+  EXPECT_EQ(str.find("nodes 0\n"), 0);
+}
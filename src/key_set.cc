@@ -0,0 +1,172 @@
+#include "key_set.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+// Each hash picks one of the 512 bits of a block.
+constexpr int bloom_hash_bits = 9;
+constexpr size_t bits_per_bloom_block = size_t{1} << bloom_hash_bits;
+// As many hashes as fit in the 64 bits of one multiply.
+constexpr int max_bloom_hashes = 64 / bloom_hash_bits;
+
+// Maps `bits` onto [0, size) by the high half of the 128-bit product, like the
+// transposition table, so that `size` needn't be a power of two.
+size_t scale(uint64_t bits, size_t size) {
+  return static_cast<size_t>((static_cast<unsigned __int128>(bits) * size) >>
+                             64);
+}
+}  // namespace.
+
+KeySet::KeySet(size_t capacity, size_t bloom_bits_per_key)
+    : has_zero_(false), num_bloom_blocks_(0), num_bloom_hashes_(0) {
+  // 8 slots for every 7 keys, rounded up to a multiple of 8 per shard.
+  const size_t num_slots = capacity + capacity / 7 + 1;
+  slots_per_shard_ = (num_slots / num_shards + 8) / 8 * 8;
+  slots_.reset(new std::atomic<uint64_t>[slots_per_shard_ * num_shards]);
+  for (size_t i = 0; i < slots_per_shard_ * num_shards; ++i) {
+    slots_[i].store(0, std::memory_order_relaxed);
+  }
+  counts_.reset(new ShardCounts[num_shards]);
+  for (size_t i = 0; i < num_shards; ++i) {
+    counts_[i].size_.store(0, std::memory_order_relaxed);
+    counts_[i].num_dropped_.store(0, std::memory_order_relaxed);
+  }
+  if (bloom_bits_per_key > 0) {
+    num_bloom_blocks_ = std::max<size_t>(
+        capacity * bloom_bits_per_key / bits_per_bloom_block, 1);
+    // k = ln(2) bits per key is the number of hashes with the fewest false
+    // positives.
+    num_bloom_hashes_ = std::min(
+        std::max(static_cast<int>(std::lround(
+                     0.69 * static_cast<double>(bloom_bits_per_key))),
+                 1),
+        max_bloom_hashes);
+    bloom_blocks_.reset(new BloomBlock[num_bloom_blocks_]);
+    for (size_t i = 0; i < num_bloom_blocks_; ++i) {
+      for (std::atomic<uint64_t>& word : bloom_blocks_[i].words_) {
+        word.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+std::atomic<uint64_t>* KeySet::shard_slots(uint64_t key) const {
+  return &slots_[(key >> (64 - shard_bits)) * slots_per_shard_];
+}
+
+size_t KeySet::home_idx(uint64_t key) const {
+  return scale(key << shard_bits, slots_per_shard_);
+}
+
+KeySet::BloomBlock& KeySet::bloom_block(uint64_t key) const {
+  return bloom_blocks_[scale(key, num_bloom_blocks_)];
+}
+
+bool KeySet::bloom_may_contain(uint64_t key) const {
+  const BloomBlock& block = bloom_block(key);
+  // The bits within the block come from the high bits of a second hash of the
+  // key, since the block took the high bits of the key itself.
+  uint64_t hash = key * 0x9E3779B97F4A7C15;
+  for (int i = 0; i < num_bloom_hashes_; ++i, hash <<= bloom_hash_bits) {
+    const size_t bit = hash >> (64 - bloom_hash_bits);
+    if (!(block.words_[bit / 64].load(std::memory_order_relaxed) &
+          (uint64_t{1} << (bit % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void KeySet::bloom_add(uint64_t key) {
+  BloomBlock& block = bloom_block(key);
+  uint64_t hash = key * 0x9E3779B97F4A7C15;
+  for (int i = 0; i < num_bloom_hashes_; ++i, hash <<= bloom_hash_bits) {
+    const size_t bit = hash >> (64 - bloom_hash_bits);
+    const uint64_t mask = uint64_t{1} << (bit % 64);
+    // Bits already set are left alone, so that keys seen before don't keep
+    // writing to shared cache lines.
+    std::atomic<uint64_t>& word = block.words_[bit / 64];
+    if (!(word.load(std::memory_order_relaxed) & mask)) {
+      word.fetch_or(mask, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool KeySet::insert(uint64_t key) {
+  ShardCounts& counts = counts_[key >> (64 - shard_bits)];
+  if (bloom_blocks_) {
+    bloom_add(key);
+  }
+  if (key == 0) {
+    const bool is_new = !has_zero_.exchange(true, std::memory_order_relaxed);
+    if (is_new) {
+      counts.size_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return is_new;
+  }
+  std::atomic<uint64_t>* const slots = shard_slots(key);
+  size_t idx = home_idx(key);
+  for (size_t i = 0; i < slots_per_shard_; ++i) {
+    uint64_t stored = slots[idx].load(std::memory_order_relaxed);
+    if (stored == 0 && slots[idx].compare_exchange_strong(
+                           stored, key, std::memory_order_relaxed)) {
+      counts.size_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    // A failed swap leaves what another thread stored in `stored`, which may
+    // be the same key.
+    if (stored == key) {
+      return false;
+    }
+    idx = idx + 1 == slots_per_shard_ ? 0 : idx + 1;
+  }
+  counts.num_dropped_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool KeySet::contains(uint64_t key) const {
+  if (bloom_blocks_ && !bloom_may_contain(key)) {
+    return false;
+  }
+  if (key == 0) {
+    return has_zero_.load(std::memory_order_relaxed);
+  }
+  const std::atomic<uint64_t>* const slots = shard_slots(key);
+  size_t idx = home_idx(key);
+  for (size_t i = 0; i < slots_per_shard_; ++i) {
+    const uint64_t stored = slots[idx].load(std::memory_order_relaxed);
+    if (stored == key) {
+      return true;
+    }
+    if (stored == 0) {
+      return false;
+    }
+    idx = idx + 1 == slots_per_shard_ ? 0 : idx + 1;
+  }
+  return false;
+}
+
+size_t KeySet::size() const {
+  size_t res = 0;
+  for (size_t i = 0; i < num_shards; ++i) {
+    res += counts_[i].size_.load(std::memory_order_relaxed);
+  }
+  return res;
+}
+
+size_t KeySet::num_dropped() const {
+  size_t res = 0;
+  for (size_t i = 0; i < num_shards; ++i) {
+    res += counts_[i].num_dropped_.load(std::memory_order_relaxed);
+  }
+  return res;
+}
+
+size_t KeySet::memory_bytes() const {
+  return slots_per_shard_ * num_shards * sizeof(uint64_t) +
+         num_bloom_blocks_ * sizeof(BloomBlock);
+}
@@ -0,0 +1,83 @@
+#ifndef KEY_SET_H
+#define KEY_SET_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// A set of 64-bit keys, such as the Zobrist keys of positions, that any
+// number of threads add to at once without locks. It drops the positions
+// already seen from a stream of them, between replaying games (see replay.h)
+// and writing the positions out (see packed_position.h):
+//
+//   if (seen.insert(board.key_)) {
+//     out.push_back(pack_position(board, score, result));
+//   }
+//
+// The table is open addressed with linear probing and sized up front for a
+// number of keys, so an insert never allocates. Each slot is an atomic key,
+// with 0 meaning empty, claimed by a compare and swap. With slots for 8/7 of
+// the keys the set costs a little over 9 bytes a key when full.
+//
+// The table is split into shards by the top bits of the key. A probe wraps
+// around inside its shard, and each shard counts its own keys on its own
+// cache line, so threads don't all increment one counter.
+//
+// A blocked Bloom filter, with the bits of each key in one cache line, can
+// sit in front of the table for sets that are mostly asked about keys they
+// don't hold. It only speeds up `contains`: an insert has to probe the table
+// anyway to claim a slot.
+class KeySet {
+ public:
+  // Room for `capacity` keys. With `bloom_bits_per_key` > 0 a Bloom filter of
+  // that many bits per key of capacity comes first, at about 1% false
+  // positives for 10 bits.
+  explicit KeySet(size_t capacity, size_t bloom_bits_per_key = 0);
+  KeySet(const KeySet&) = delete;
+  KeySet& operator=(const KeySet&) = delete;
+
+  // Adds `key` and returns true if it wasn't in the set. If the shard of the
+  // key is full, which sizing the set for the keys it gets avoids, the key
+  // isn't stored but true is returned anyway, so that a stream going through
+  // the set keeps rather than loses it, and `num_dropped` counts it.
+  bool insert(uint64_t key);
+  bool contains(uint64_t key) const;
+
+  // The number of keys stored. Exact once the inserting threads are done.
+  size_t size() const;
+  size_t num_dropped() const;
+  // The memory taken by the table and the filter.
+  size_t memory_bytes() const;
+
+  static constexpr int shard_bits = 6;
+  static constexpr size_t num_shards = size_t{1} << shard_bits;
+
+ private:
+  struct alignas(64) ShardCounts {
+    std::atomic<size_t> size_;
+    std::atomic<size_t> num_dropped_;
+  };
+  struct alignas(64) BloomBlock {
+    std::array<std::atomic<uint64_t>, 8> words_;
+  };
+
+  // The first slot of the shard of `key` and where in it the probe starts.
+  std::atomic<uint64_t>* shard_slots(uint64_t key) const;
+  size_t home_idx(uint64_t key) const;
+  BloomBlock& bloom_block(uint64_t key) const;
+  bool bloom_may_contain(uint64_t key) const;
+  void bloom_add(uint64_t key);
+
+  size_t slots_per_shard_;
+  std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+  std::unique_ptr<ShardCounts[]> counts_;
+  // Key 0 marks empty slots, so it is kept here.
+  std::atomic<bool> has_zero_;
+  size_t num_bloom_blocks_;
+  int num_bloom_hashes_;
+  std::unique_ptr<BloomBlock[]> bloom_blocks_;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "key_set.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "replay.h"
+
+namespace {
+// Keys spread like Zobrist keys.
+uint64_t test_key(uint64_t i) { return (i + 1) * 0x9E3779B97F4A7C15; }
+}  // namespace.
+
+TEST(KeySet, InsertsEachKeyOnce) {
+  KeySet set(1000);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(set.insert(test_key(i)));
+  }
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(set.insert(test_key(i)));
+    EXPECT_TRUE(set.contains(test_key(i)));
+    EXPECT_FALSE(set.contains(test_key(i + 1000)));
+  }
+  EXPECT_TRUE(set.insert(0));
+  EXPECT_FALSE(set.insert(0));
+  EXPECT_TRUE(set.contains(0));
+  EXPECT_EQ(set.size(), 1001);
+  EXPECT_EQ(set.num_dropped(), 0);
+  // Near 8 bytes a key.
+  EXPECT_LT(set.memory_bytes(), 1000 * 10 + 64 * 64);
+}
+
+TEST(KeySet, BloomFilterAnswersTheSame) {
+  KeySet set(10000, 10);
+  for (uint64_t i = 0; i < 10000; i += 2) {
+    set.insert(test_key(i));
+  }
+  for (uint64_t i = 0; i < 10000; ++i) {
+    EXPECT_EQ(set.contains(test_key(i)), i % 2 == 0);
+  }
+}
+
+TEST(KeySet, CountsKeysThatDontFit) {
+  KeySet set(0);
+  uint64_t num_inserted = 0;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    num_inserted += set.insert(test_key(i));
+  }
+  EXPECT_EQ(num_inserted, 10000);
+  EXPECT_EQ(set.size() + set.num_dropped(), 10000);
+  EXPECT_GT(set.num_dropped(), 0);
+}
+
+TEST(KeySet, InsertsFromManyThreads) {
+  constexpr uint64_t num_keys = 100000;
+  KeySet set(num_keys);
+  std::atomic<uint64_t> num_new(0);
+  std::vector<std::thread> threads;
+  for (int thread_idx = 0; thread_idx < 4; ++thread_idx) {
+    threads.emplace_back([&set, &num_new, thread_idx]() {
+      // Every thread inserts every key, in a different order.
+      for (uint64_t i = 0; i < num_keys; ++i) {
+        const uint64_t key =
+            test_key((i * (2 * static_cast<uint64_t>(thread_idx) + 1)) %
+                     num_keys);
+        num_new.fetch_add(set.insert(key) ? 1 : 0);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_new.load(), num_keys);
+  EXPECT_EQ(set.size(), num_keys);
+}
+
+TEST(KeySet, DropsRepeatedPositionsOfGames) {
+  // The second game starts from the start position of the first, and goes
+  // back to it and to 1. Nf3 by moving the knights back and forth.
+  const char* const games[][6] = {
+      {"e2e4", "e7e5", "g1f3", "b8c6", "f1b5", "a7a6"},
+      {"g1f3", "b8c6", "f3g1", "c6b8", "g1f3", "b8c6"},
+  };
+  KeySet seen(100);
+  std::vector<PackedPosition> packed;
+  for (const auto& game : games) {
+    Board board;
+    std::vector<Move> moves;
+    for (const char* uci : game) {
+      const absl::optional<Move> move = parse_uci_move(board, uci);
+      ASSERT_TRUE(move);
+      moves.push_back(*move);
+      board.do_move(*move);
+    }
+    board = Board();
+    replay_moves(&board, moves.data(), moves.size(),
+                 [&](const Board& before, Move) {
+                   if (seen.insert(before.key_)) {
+                     packed.push_back(pack_position(before, 0, 0));
+                   }
+                 });
+  }
+  // Six from the first game, then the positions after 1. Nf3, 1... Nc6 and
+  // 2. Ng1. The keys leave out the clocks, so 2... Nb8 is the start again.
+  EXPECT_EQ(packed.size(), 9);
+  EXPECT_EQ(seen.size(), 9);
+}
@@ -0,0 +1,39 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+#include "memory_accounting.h"
+
+MappedFile::MappedFile(const std::string& path, MemoryTag tag)
+    : fd_(open(path.c_str(), O_RDONLY)),
+      tag_(tag),
+      data_(nullptr),
+      size_(0) {
+  struct stat st;
+  if (fd_ < 0 || fstat(fd_, &st) != 0 || st.st_size <= 0) {
+    return;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_PRIVATE, fd_, 0);
+  if (data != MAP_FAILED) {
+    data_ = static_cast<const char*>(data);
+    size_ = static_cast<size_t>(st.st_size);
+    add_memory(tag_, static_cast<int64_t>(size_));
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+    add_memory(tag_, -static_cast<int64_t>(size_));
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include "memory_accounting.h"
+
+// A file mapped read-only into memory, unmapped and closed when the object
+// goes. Reads go through the page cache, so only the pages that are touched
+// are ever read from disk. The whole mapping is counted against `tag`, see
+// memory_accounting.h, though only the pages touched take memory.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path,
+                      MemoryTag tag = MemoryTag::mapped_files);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  // Null if the file couldn't be mapped.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const int fd_;
+  const MemoryTag tag_;
+  const char* data_;
+  size_t size_;
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include "match.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "board.h"
+#include "endgame.h"
+#include "repetition.h"
+#include "search.h"
+#include "time_manager.h"
+#include "transposition_table.h"
+
+namespace {
+// The result of a game from white's side.
+constexpr int white_win = 1;
+constexpr int black_win = -1;
+constexpr int draw = 0;
+
+// The searchers of a worker, one per engine, each with its own table.
+struct Players {
+  std::array<std::unique_ptr<TranspositionTable>, 2> tables_;
+  std::array<std::unique_ptr<Searcher>, 2> searchers_;
+};
+
+struct GameResult {
+  int result_;
+  bool adjudicated_;
+  bool time_loss_;
+};
+
+double rounded(double value) { return std::round(value * 100) / 100; }
+
+// The expected score per game of an engine `elo` Elo stronger.
+double expected_score(double elo) {
+  return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+// Plays a game from `opening` with `white` the engine of white, 0 or 1.
+GameResult play_game(const MatchOptions& options, const Board& opening,
+                     size_t white, Players* players) {
+  for (size_t i = 0; i < 2; ++i) {
+    players->tables_[i]->clear();
+    players->searchers_[i]->clear();
+  }
+  Board board = opening;
+  KeyHistory history;
+  history.reset(board);
+  std::array<int64_t, 2> clocks = {options.engines_[0].time_ms_,
+                                   options.engines_[1].time_ms_};
+  GameResult res = {draw, false, false};
+  // The side the last searches agree is ahead, and how many agree.
+  int resign_side = draw;
+  int resign_count = 0;
+  int draw_count = 0;
+  for (int ply = 0; ply < options.max_plies_; ++ply) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    if (!board.has_any_legal_move()) {
+      if (board.is_king_attacked(side)) {
+        res.result_ = side == Color::white ? black_win : white_win;
+      }
+      break;
+    }
+    if (board.fifty_move_clock_ >= 100 || history.is_repetition(0) ||
+        is_insufficient_material(board)) {
+      break;
+    }
+
+    const size_t engine_idx = side == Color::white ? white : 1 - white;
+    const EngineConfig& engine = options.engines_[engine_idx];
+    Searcher& searcher = *players->searchers_[engine_idx];
+    searcher.set_game_history(history);
+    SearchResult result;
+    if (engine.nodes_per_move_ > 0) {
+      result = searcher.search_iterations(
+          board, 1,
+          {max_search_ply - 1, engine.nodes_per_move_, nullptr, nullptr},
+          nullptr);
+      if (!result.best_move_) {
+        // Too few nodes to complete even the first iteration.
+        result = searcher.search_iterations(
+            board, 1, {1, 0, nullptr, nullptr}, nullptr);
+      }
+    } else {
+      const size_t side_idx = static_cast<size_t>(side);
+      TimeControl time_control = {};
+      time_control.time_left_[side_idx] = clocks[engine_idx];
+      time_control.time_left_[1 - side_idx] = clocks[1 - engine_idx];
+      time_control.increment_[side_idx] = engine.increment_ms_;
+      time_control.increment_[1 - side_idx] =
+          options.engines_[1 - engine_idx].increment_ms_;
+      // The first iteration always completes, whatever the clock says.
+      TimeManager time_manager(time_control, side);
+      result = searcher.search_iterations(
+          board, 1, {max_search_ply - 1, 0, nullptr, &time_manager}, nullptr);
+      clocks[engine_idx] -= time_manager.elapsed();
+      if (clocks[engine_idx] < 0) {
+        res.result_ = side == Color::white ? black_win : white_win;
+        res.time_loss_ = true;
+        break;
+      }
+      clocks[engine_idx] += engine.increment_ms_;
+    }
+
+    const int white_score =
+        side == Color::white ? result.score_ : -result.score_;
+    const int ahead = white_score >= options.resign_score_    ? white_win
+                      : white_score <= -options.resign_score_ ? black_win
+                                                              : draw;
+    resign_count = ahead == draw          ? 0
+                   : ahead == resign_side ? resign_count + 1
+                                          : 1;
+    resign_side = ahead;
+    if (options.resign_plies_ > 0 && resign_count >= options.resign_plies_) {
+      res.result_ = ahead;
+      res.adjudicated_ = true;
+      break;
+    }
+    draw_count = ply >= options.draw_min_ply_ &&
+                         std::abs(white_score) <= options.draw_score_
+                     ? draw_count + 1
+                     : 0;
+    if (options.draw_plies_ > 0 && draw_count >= options.draw_plies_) {
+      res.adjudicated_ = true;
+      break;
+    }
+
+    board.do_move(*result.best_move_);
+    history.push(board);
+  }
+  return res;
+}
+}  // namespace.
+
+MatchStats play_match(const MatchOptions& options,
+                      const MatchCallback& on_pair) {
+  const size_t num_threads =
+      options.num_threads_ > 0
+          ? options.num_threads_
+          : std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::atomic<size_t> next_pair(0);
+  std::atomic<bool> stop(false);
+  std::mutex mutex;
+  MatchStats stats;
+
+  const auto run = [&]() {
+    Players players;
+    for (size_t i = 0; i < 2; ++i) {
+      const EngineConfig& engine = options.engines_[i];
+      players.tables_[i] =
+          std::make_unique<TranspositionTable>(engine.hash_mb_);
+      players.searchers_[i] =
+          std::make_unique<Searcher>(players.tables_[i].get());
+      players.searchers_[i]->set_network(engine.network_);
+    }
+    size_t pair_idx = 0;
+    while (!stop.load(std::memory_order_relaxed) &&
+           (pair_idx = next_pair.fetch_add(1)) < options.num_pairs_) {
+      const Board opening =
+          options.openings_.empty()
+              ? Board()
+              : options.openings_[pair_idx % options.openings_.size()];
+      // The first engine plays white, then black.
+      std::array<GameResult, 2> games;
+      size_t half_points = 0;
+      for (size_t white = 0; white < 2; ++white) {
+        games[white] = play_game(options, opening, white, &players);
+        const int first_result =
+            white == 0 ? games[white].result_ : -games[white].result_;
+        half_points += static_cast<size_t>(first_result + 1);
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const GameResult& game : games) {
+        stats.time_losses_ += game.time_loss_;
+        stats.adjudicated_ += game.adjudicated_;
+      }
+      const int first_results[] = {games[0].result_, -games[1].result_};
+      for (int result : first_results) {
+        if (result == white_win) {
+          ++stats.wins_;
+        } else if (result == black_win) {
+          ++stats.losses_;
+        } else {
+          ++stats.draws_;
+        }
+      }
+      ++stats.pairs_[half_points];
+      stats.llr_ = sprt_llr(stats.pairs_, options.bounds_);
+      // Pairs that were being played when the test ended still count, but
+      // don't change its result.
+      if (stats.sprt_ == SprtResult::running) {
+        stats.sprt_ = sprt_result(stats.llr_, options.bounds_);
+        if (options.sprt_ && stats.sprt_ != SprtResult::running) {
+          stop.store(true, std::memory_order_relaxed);
+        }
+      }
+      if (on_pair) {
+        on_pair(stats);
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return stats;
+}
+
+double sprt_llr(const std::array<uint64_t, 5>& pairs,
+                const SprtBounds& bounds) {
+  // The score per game of each kind of pair.
+  constexpr std::array<double, 5> pair_scores = {0, 0.25, 0.5, 0.75, 1};
+  // Added to the count of every kind, so that pairs that all scored the same
+  // still have some variance.
+  constexpr double prior_count = 1e-3;
+  double num_pairs = 0;
+  double score = 0;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    const double count = static_cast<double>(pairs[i]) + prior_count;
+    num_pairs += count;
+    score += count * pair_scores[i];
+  }
+  score /= num_pairs;
+  double variance = 0;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    const double count = static_cast<double>(pairs[i]) + prior_count;
+    variance += count * (pair_scores[i] - score) * (pair_scores[i] - score);
+  }
+  variance /= num_pairs;
+  const double score0 = expected_score(bounds.elo0_);
+  const double score1 = expected_score(bounds.elo1_);
+  return num_pairs * (score1 - score0) * (2 * score - score0 - score1) /
+         (2 * variance);
+}
+
+SprtResult sprt_result(double llr, const SprtBounds& bounds) {
+  if (llr >= std::log((1 - bounds.beta_) / bounds.alpha_)) {
+    return SprtResult::h1_accepted;
+  }
+  if (llr <= std::log(bounds.beta_ / (1 - bounds.alpha_))) {
+    return SprtResult::h0_accepted;
+  }
+  return SprtResult::running;
+}
+
+double elo_difference(const std::array<uint64_t, 5>& pairs) {
+  double num_pairs = 0;
+  double score = 0;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    num_pairs += static_cast<double>(pairs[i]);
+    score += static_cast<double>(pairs[i]) * static_cast<double>(i) / 4;
+  }
+  if (num_pairs == 0) {
+    return 0;
+  }
+  score /= num_pairs;
+  return -400 * std::log10(1 / score - 1);
+}
+
+std::string match_stats_to_str(const MatchStats& stats,
+                               const SprtBounds& bounds) {
+  uint64_t num_pairs = 0;
+  for (uint64_t count : stats.pairs_) {
+    num_pairs += count;
+  }
+  std::string res = absl::StrCat(
+      "+", stats.wins_, " =", stats.draws_, " -", stats.losses_, ", ",
+      num_pairs, " pairs, Elo ", rounded(elo_difference(stats.pairs_)),
+      ", LLR ", rounded(stats.llr_), " (",
+      rounded(std::log(bounds.beta_ / (1 - bounds.alpha_))), ", ",
+      rounded(std::log((1 - bounds.beta_) / bounds.alpha_)), ")");
+  if (stats.sprt_ == SprtResult::h0_accepted) {
+    absl::StrAppend(&res, ", H0 accepted");
+  } else if (stats.sprt_ == SprtResult::h1_accepted) {
+    absl::StrAppend(&res, ", H1 accepted");
+  }
+  return res;
+}
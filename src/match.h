@@ -0,0 +1,116 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "nnue.h"
+
+// Matches between two engine configurations in one process, for gating
+// changes on their strength: many games at once, one pair of games per
+// worker thread at a time, with the searchers called directly rather than
+// over UCI, so that even very fast time controls measure the engines and not
+// the protocol. Each opening is played twice, once with either engine as
+// white, and the pairs are scored together (pentanomial statistics), which
+// cancels most of the bias of the openings. A sequential probability ratio
+// test on the pairs ends the match as soon as it is decided.
+
+// One side of a match.
+struct EngineConfig {
+  // Evaluates with this network, which isn't owned, or the classical
+  // evaluation if it is null.
+  const NnueNetwork* network_ = nullptr;
+  size_t hash_mb_ = 16;
+  // Searches this many nodes a move if not 0, with no clock, so that the
+  // games don't depend on the speed of the machine. Otherwise plays on a
+  // clock of `time_ms_` plus `increment_ms_` a move.
+  uint64_t nodes_per_move_ = 0;
+  int64_t time_ms_ = 1000;
+  int64_t increment_ms_ = 10;
+};
+
+// A sequential probability ratio test of H0: the first engine is
+// `elo0_` Elo stronger than the second, against H1: it is `elo1_` stronger.
+struct SprtBounds {
+  double elo0_ = 0;
+  double elo1_ = 5;
+  // The chances of accepting H1 when H0 holds, and H0 when H1 holds.
+  double alpha_ = 0.05;
+  double beta_ = 0.05;
+};
+
+struct MatchOptions {
+  std::array<EngineConfig, 2> engines_;
+  // The most pairs of games played, fewer if the test ends the match.
+  size_t num_pairs_ = 100;
+  // The pairs played at once, one per hardware thread if 0. On a clock,
+  // more than there are hardware threads take time from each other's games.
+  size_t num_threads_ = 0;
+  // The pairs start at these positions in turn, or at the starting position
+  // if there are none.
+  std::vector<Board> openings_;
+  // Stops the match once the test accepts either hypothesis.
+  bool sprt_ = true;
+  SprtBounds bounds_;
+
+  // A game is adjudicated as won once `resign_plies_` consecutive searches,
+  // of both engines, agree that one side is ahead by at least
+  // `resign_score_`, and as drawn once, after `draw_min_ply_` plies, the
+  // scores of `draw_plies_` consecutive searches are within `draw_score_` of
+  // 0. 0 plies turns either rule off.
+  int resign_score_ = 1000;
+  int resign_plies_ = 6;
+  int draw_score_ = 10;
+  int draw_plies_ = 10;
+  int draw_min_ply_ = 80;
+  // Games that last this many plies are drawn.
+  int max_plies_ = 400;
+};
+
+// Where a sequential probability ratio test stands.
+enum class SprtResult { running, h0_accepted, h1_accepted };
+
+// The results of a match, from the first engine's side.
+struct MatchStats {
+  uint64_t wins_ = 0;
+  uint64_t draws_ = 0;
+  uint64_t losses_ = 0;
+  // The number of pairs by the first engine's points over both games: 0,
+  // 1/2, 1, 3/2 and 2.
+  std::array<uint64_t, 5> pairs_ = {};
+  // The games lost by either engine running out of time.
+  uint64_t time_losses_ = 0;
+  uint64_t adjudicated_ = 0;
+  // The log-likelihood ratio of the test, and the result it gives.
+  double llr_ = 0;
+  SprtResult sprt_ = SprtResult::running;
+};
+
+// Called with the results so far after each pair of games, one pair at a
+// time.
+using MatchCallback = std::function<void(const MatchStats& stats)>;
+
+// Plays the match of `options` and returns its results.
+MatchStats play_match(const MatchOptions& options,
+                      const MatchCallback& on_pair = nullptr);
+
+// The log-likelihood ratio of H1 against H0 of `bounds` given the counts of
+// pairs, by the normal approximation of the pair scores.
+double sprt_llr(const std::array<uint64_t, 5>& pairs,
+                const SprtBounds& bounds);
+// The result of the test once the ratio is `llr`.
+SprtResult sprt_result(double llr, const SprtBounds& bounds);
+// The Elo difference the pairs measure, from the first engine's side, which
+// is infinite if one engine scored every point.
+double elo_difference(const std::array<uint64_t, 5>& pairs);
+
+// A line such as "+12 =30 -10, 26 pairs, Elo 13.4, LLR 1.02 (-2.94, 2.94)".
+std::string match_stats_to_str(const MatchStats& stats,
+                               const SprtBounds& bounds);
+
+#endif
@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "match.h"
+#include "nnue.h"
+#include "selfplay.h"
+
+// Usage: match [--pairs <n>] [--threads <n>] [--openings <epd>]
+//              [--tc <ms>+<inc>] [--nodes <n>] [--hash <mb>]
+//              [--eval-file1 <network>] [--eval-file2 <network>]
+//              [--nodes1 <n>] [--nodes2 <n>] [--elo0 <elo>] [--elo1 <elo>]
+//              [--alpha <p>] [--beta <p>] [--no-sprt]
+//
+// Plays a match between two engine configurations (see match.h), 100 pairs
+// of games by default, one pair at a time per hardware thread, and prints
+// the results every 10 pairs and at the end. The pairs start at the
+// positions of the --openings file in turn, or at the starting position.
+// Both engines play on a clock of --tc milliseconds plus an increment, 1000+10
+// by default, or search --nodes nodes a move; --nodes1, --nodes2 and
+// --eval-file1, --eval-file2 set those of one engine only, the classical
+// evaluation being the default. The match stops once the SPRT of --elo0
+// against --elo1, 0 and 5 by default, with the error rates --alpha and
+// --beta, 0.05 by default, is decided, unless --no-sprt plays every pair.
+// Exits with 0 if H1 was accepted, 1 on error, and 2 otherwise.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--pairs <n>] [--threads <n>] [--openings <epd>]"
+               " [--tc <ms>+<inc>] [--nodes <n>] [--hash <mb>]"
+               " [--eval-file1 <network>] [--eval-file2 <network>]"
+               " [--nodes1 <n>] [--nodes2 <n>] [--elo0 <elo>] [--elo1 <elo>]"
+               " [--alpha <p>] [--beta <p>] [--no-sprt]\n";
+  return 1;
+}
+
+// Parses a time control such as "1000+10" into `*engine`.
+bool parse_time_control(absl::string_view str, EngineConfig* engine) {
+  const std::vector<absl::string_view> parts = absl::StrSplit(str, '+');
+  return parts.size() == 2 && absl::SimpleAtoi(parts[0], &engine->time_ms_) &&
+         engine->time_ms_ > 0 &&
+         absl::SimpleAtoi(parts[1], &engine->increment_ms_) &&
+         engine->increment_ms_ >= 0;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  MatchOptions options;
+  const char* openings_path = nullptr;
+  const char* eval_files[2] = {nullptr, nullptr};
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const char* const flag = argv[arg_idx];
+    if (std::strcmp(flag, "--no-sprt") == 0) {
+      options.sprt_ = false;
+      continue;
+    }
+    if (arg_idx + 1 == argc) {
+      return usage(argv[0]);
+    }
+    const char* const value = argv[++arg_idx];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--pairs") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.num_pairs_);
+    } else if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.num_threads_);
+    } else if (std::strcmp(flag, "--openings") == 0) {
+      openings_path = value;
+      is_valid = true;
+    } else if (std::strcmp(flag, "--tc") == 0) {
+      is_valid = parse_time_control(value, &options.engines_[0]) &&
+                 parse_time_control(value, &options.engines_[1]);
+    } else if (std::strcmp(flag, "--nodes") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.engines_[0].nodes_per_move_);
+      options.engines_[1].nodes_per_move_ = options.engines_[0].nodes_per_move_;
+    } else if (std::strcmp(flag, "--nodes1") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.engines_[0].nodes_per_move_);
+    } else if (std::strcmp(flag, "--nodes2") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.engines_[1].nodes_per_move_);
+    } else if (std::strcmp(flag, "--hash") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.engines_[0].hash_mb_) &&
+                 options.engines_[0].hash_mb_ > 0;
+      options.engines_[1].hash_mb_ = options.engines_[0].hash_mb_;
+    } else if (std::strcmp(flag, "--eval-file1") == 0) {
+      eval_files[0] = value;
+      is_valid = true;
+    } else if (std::strcmp(flag, "--eval-file2") == 0) {
+      eval_files[1] = value;
+      is_valid = true;
+    } else if (std::strcmp(flag, "--elo0") == 0) {
+      is_valid = absl::SimpleAtod(value, &options.bounds_.elo0_);
+    } else if (std::strcmp(flag, "--elo1") == 0) {
+      is_valid = absl::SimpleAtod(value, &options.bounds_.elo1_);
+    } else if (std::strcmp(flag, "--alpha") == 0) {
+      is_valid = absl::SimpleAtod(value, &options.bounds_.alpha_) &&
+                 options.bounds_.alpha_ > 0 && options.bounds_.alpha_ < 1;
+    } else if (std::strcmp(flag, "--beta") == 0) {
+      is_valid = absl::SimpleAtod(value, &options.bounds_.beta_) &&
+                 options.bounds_.beta_ > 0 && options.bounds_.beta_ < 1;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (options.bounds_.elo1_ <= options.bounds_.elo0_) {
+    return usage(argv[0]);
+  }
+
+  std::string error;
+  if (openings_path &&
+      !read_openings(openings_path, &options.openings_, &error)) {
+    std::cerr << error << '\n';
+    return 1;
+  }
+  NetworkPtr networks[2];
+  for (size_t i = 0; i < 2; ++i) {
+    if (eval_files[i]) {
+      networks[i] = load_network(eval_files[i], &error);
+      if (!networks[i]) {
+        std::cerr << error << '\n';
+        return 1;
+      }
+      options.engines_[i].network_ = networks[i].get();
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t num_pairs = 0;
+  const MatchStats stats =
+      play_match(options, [&options, &num_pairs](const MatchStats& so_far) {
+        if (++num_pairs % 10 == 0) {
+          std::cout << match_stats_to_str(so_far, options.bounds_) << std::endl;
+        }
+      });
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << match_stats_to_str(stats, options.bounds_) << '\n'
+            << "Pentanomial " << stats.pairs_[0] << " " << stats.pairs_[1]
+            << " " << stats.pairs_[2] << " " << stats.pairs_[3] << " "
+            << stats.pairs_[4] << ", " << stats.time_losses_
+            << " time losses, " << stats.adjudicated_ << " adjudicated, "
+            << 2 * num_pairs << " games in " << elapsed.count() << " s\n";
+  return stats.sprt_ == SprtResult::h1_accepted ? 0 : 2;
+}
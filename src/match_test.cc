@@ -0,0 +1,105 @@
+#include "match.h"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/match.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+TEST(PlayMatch, PlaysPairsOfGames) {
+  MatchOptions options;
+  options.num_pairs_ = 4;
+  options.num_threads_ = 2;
+  for (EngineConfig& engine : options.engines_) {
+    engine.nodes_per_move_ = 300;
+    engine.hash_mb_ = 1;
+  }
+  options.openings_ = {
+      Board(),
+      Board("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+            "0 1")};
+  options.sprt_ = false;
+  options.max_plies_ = 60;
+  size_t num_calls = 0;
+  const MatchStats stats = play_match(
+      options, [&num_calls](const MatchStats&) { ++num_calls; });
+  EXPECT_EQ(num_calls, 4);
+  EXPECT_EQ(stats.wins_ + stats.draws_ + stats.losses_, 8);
+  // The same engine on both sides, with the same nodes and cleared tables,
+  // plays the same game with either color, so each pair scores 1.
+  EXPECT_EQ(stats.pairs_, (std::array<uint64_t, 5>{0, 0, 4, 0, 0}));
+  EXPECT_EQ(stats.wins_, stats.losses_);
+  EXPECT_EQ(stats.time_losses_, 0);
+}
+
+TEST(PlayMatch, PlaysOnAClock) {
+  MatchOptions options;
+  options.num_pairs_ = 1;
+  options.num_threads_ = 1;
+  for (EngineConfig& engine : options.engines_) {
+    engine.time_ms_ = 200;
+    engine.increment_ms_ = 5;
+    engine.hash_mb_ = 1;
+  }
+  options.max_plies_ = 20;
+  const MatchStats stats = play_match(options);
+  EXPECT_EQ(stats.wins_ + stats.draws_ + stats.losses_, 2);
+}
+
+TEST(PlayMatch, StopsOnceTheTestIsDecided) {
+  MatchOptions options;
+  options.num_pairs_ = 50;
+  options.num_threads_ = 2;
+  options.engines_[0].nodes_per_move_ = 2000;
+  // Too few for even the first iteration, so a depth 1 search.
+  options.engines_[1].nodes_per_move_ = 1;
+  for (EngineConfig& engine : options.engines_) {
+    engine.hash_mb_ = 1;
+  }
+  const MatchStats stats = play_match(options);
+  EXPECT_EQ(stats.sprt_, SprtResult::h1_accepted);
+  EXPECT_GT(stats.llr_, std::log(0.95 / 0.05));
+  EXPECT_LT(stats.wins_ + stats.draws_ + stats.losses_, 100);
+  EXPECT_GT(stats.wins_, stats.losses_);
+}
+
+TEST(Sprt, WeighsThePairs) {
+  const SprtBounds bounds;
+  // Even.
+  EXPECT_NEAR(elo_difference({1, 2, 10, 2, 1}), 0, 1e-9);
+  EXPECT_LT(sprt_llr({1, 2, 10, 2, 1}, bounds), 0);
+  EXPECT_NEAR(elo_difference({0, 0, 1, 1, 0}), -400 * std::log10(0.6), 1e-9);
+  EXPECT_TRUE(std::isinf(elo_difference({0, 0, 0, 0, 3})));
+  EXPECT_EQ(elo_difference({}), 0);
+
+  // Scores between those of H0 and H1 weigh less the closer they are to the
+  // middle, and more pairs weigh more.
+  const double llr = sprt_llr({10, 40, 100, 45, 10}, bounds);
+  EXPECT_GT(llr, 0);
+  EXPECT_GT(sprt_llr({20, 80, 200, 90, 20}, bounds), llr);
+  EXPECT_LT(sprt_llr({10, 45, 100, 40, 10}, bounds), 0);
+
+  EXPECT_EQ(sprt_result(0, bounds), SprtResult::running);
+  EXPECT_EQ(sprt_result(2.95, bounds), SprtResult::h1_accepted);
+  EXPECT_EQ(sprt_result(-2.95, bounds), SprtResult::h0_accepted);
+  EXPECT_EQ(sprt_result(2.9, bounds), SprtResult::running);
+}
+
+TEST(Sprt, FormatsTheStats) {
+  MatchStats stats;
+  stats.wins_ = 3;
+  stats.draws_ = 4;
+  stats.losses_ = 1;
+  stats.pairs_ = {0, 1, 1, 2, 0};
+  stats.llr_ = 0.5;
+  const std::string str = match_stats_to_str(stats, SprtBounds());
+  EXPECT_TRUE(absl::StartsWith(str, "+3 =4 -1, 4 pairs, Elo ")) << str;
+  EXPECT_TRUE(absl::EndsWith(str, ", LLR 0.5 (-2.94, 2.94)")) << str;
+  stats.sprt_ = SprtResult::h1_accepted;
+  EXPECT_TRUE(absl::EndsWith(match_stats_to_str(stats, SprtBounds()),
+                             "H1 accepted"));
+}
@@ -0,0 +1,178 @@
+#include "mate_solver.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "board.h"
+
+namespace {
+// A proof or disproof number too large to reach: that of a position that is
+// disproven or proven, respectively.
+constexpr uint32_t infinite_number = 1u << 30;
+
+uint32_t add_numbers(uint32_t lhs, uint32_t rhs) {
+  return std::min(lhs + rhs, infinite_number);
+}
+
+// Returns the key of `board` with `moves_left` moves for the attacker, as the
+// table stores it: a position can be won with more moves and lost with fewer.
+uint64_t table_key(const Board& board, int moves_left) {
+  return board.key_ ^
+         (static_cast<uint64_t>(moves_left) * 0x9E3779B97F4A7C15ULL);
+}
+
+// Appends the positions after the moves the search tries from `board` to
+// `*children`: the checks for the attacker, or the evasions for the
+// defender, who is always in check.
+void generate_children(const Board& board, bool attacking,
+                       std::vector<Board>* children) {
+  children->clear();
+  if (attacking) {
+    const CheckInfo info = board.check_info();
+    for (Move move : board.legal_moves()) {
+      if (board.gives_check(move, info)) {
+        children->push_back(board);
+        children->back().do_move(move);
+      }
+    }
+    return;
+  }
+  for (Move move : board.legal_evasions()) {
+    children->push_back(board);
+    children->back().do_move(move);
+  }
+}
+}  // namespace.
+
+MateSolver::MateSolver(uint64_t max_nodes)
+    : max_nodes_(max_nodes), nodes_(0), stopped_(false) {}
+
+MateSolver::Result MateSolver::solve(const Board& board, int moves) {
+  ABSL_RAW_CHECK(moves >= 1, "A mate takes at least one move.");
+  table_.clear();
+  nodes_ = 0;
+  return solve_position(board, true, moves);
+}
+
+MateSolver::Result MateSolver::find_mating_moves(
+    const Board& board, int moves, std::vector<Move>* mating_moves) {
+  ABSL_RAW_CHECK(moves >= 1, "A mate takes at least one move.");
+  table_.clear();
+  nodes_ = 0;
+  mating_moves->clear();
+  bool is_settled = true;
+  const CheckInfo info = board.check_info();
+  for (Move move : board.legal_moves()) {
+    if (!board.gives_check(move, info)) {
+      continue;
+    }
+    Board child(board);
+    child.do_move(move);
+    // The table is kept, so the moves share what the others proved.
+    const Result result = solve_position(child, false, moves - 1);
+    if (result == Result::mate) {
+      mating_moves->push_back(move);
+    } else if (result == Result::unknown) {
+      is_settled = false;
+    }
+  }
+  return !is_settled ? Result::unknown
+         : mating_moves->empty() ? Result::no_mate
+                                 : Result::mate;
+}
+
+MateSolver::Result MateSolver::solve_position(const Board& board,
+                                              bool attacking, int moves_left) {
+  stopped_ = false;
+  children_.resize(2 * static_cast<size_t>(moves_left) + 2);
+  search(board, attacking, moves_left, 0, infinite_number, infinite_number);
+  const Numbers numbers = lookup(board, moves_left);
+  return numbers.proof_ == 0      ? Result::mate
+         : numbers.disproof_ == 0 ? Result::no_mate
+                                  : Result::unknown;
+}
+
+MateSolver::Numbers MateSolver::lookup(const Board& board,
+                                       int moves_left) const {
+  const auto it = table_.find(table_key(board, moves_left));
+  return it == table_.end() ? Numbers{1, 1} : it->second;
+}
+
+void MateSolver::store(const Board& board, int moves_left, Numbers numbers) {
+  table_[table_key(board, moves_left)] = numbers;
+}
+
+void MateSolver::search(const Board& board, bool attacking, int moves_left,
+                        int ply, uint32_t proof_threshold,
+                        uint32_t disproof_threshold) {
+  ++nodes_;
+  if (max_nodes_ && nodes_ >= max_nodes_) {
+    stopped_ = true;
+  }
+  constexpr Numbers proven = {0, infinite_number};
+  constexpr Numbers disproven = {infinite_number, 0};
+  if (attacking && moves_left == 0) {
+    store(board, moves_left, disproven);
+    return;
+  }
+  std::vector<Board>& children = children_[static_cast<size_t>(ply)];
+  generate_children(board, attacking, &children);
+  if (children.empty()) {
+    // Out of checks, or mated.
+    store(board, moves_left, attacking ? disproven : proven);
+    return;
+  }
+  if (!attacking && moves_left == 0) {
+    store(board, moves_left, disproven);
+    return;
+  }
+  // The attacker needs one child proven, the defender one disproven. Seen
+  // from the side to move, its own number is the least of the children's
+  // and the other is their sum.
+  const int child_moves_left = attacking ? moves_left - 1 : moves_left;
+  while (true) {
+    uint32_t least = infinite_number;
+    uint32_t second_least = infinite_number;
+    uint32_t sum = 0;
+    size_t best_idx = 0;
+    // The number of the best child that is summed.
+    uint32_t best_summed = 0;
+    for (size_t i = 0; i < children.size(); ++i) {
+      const Numbers numbers = lookup(children[i], child_moves_left);
+      const uint32_t own = attacking ? numbers.proof_ : numbers.disproof_;
+      const uint32_t other = attacking ? numbers.disproof_ : numbers.proof_;
+      sum = add_numbers(sum, other);
+      if (own < least) {
+        second_least = least;
+        least = own;
+        best_idx = i;
+        best_summed = other;
+      } else if (own < second_least) {
+        second_least = own;
+      }
+    }
+    const Numbers numbers =
+        attacking ? Numbers{least, sum} : Numbers{sum, least};
+    const uint32_t own_threshold =
+        attacking ? proof_threshold : disproof_threshold;
+    const uint32_t other_threshold =
+        attacking ? disproof_threshold : proof_threshold;
+    if (stopped_ || least >= own_threshold || sum >= other_threshold) {
+      store(board, moves_left, numbers);
+      return;
+    }
+    // The best child is searched until it is no longer the best, or until
+    // the sum would reach this node's threshold.
+    const uint32_t child_own_threshold =
+        std::min(own_threshold, add_numbers(second_least, 1));
+    const uint32_t child_other_threshold = static_cast<uint32_t>(
+        std::min<uint64_t>(infinite_number, uint64_t{other_threshold} - sum +
+                                                best_summed));
+    search(children[best_idx], !attacking, child_moves_left, ply + 1,
+           attacking ? child_own_threshold : child_other_threshold,
+           attacking ? child_other_threshold : child_own_threshold);
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef MATE_SOLVER_H
+#define MATE_SOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "board.h"
+
+// Proves or disproves that the side to move mates in at most a given number
+// of moves by checking on every move, the kind of forced mate puzzles are
+// made of, with a depth-first proof-number search (df-pn) rather than
+// alpha-beta.
+//
+// The attacker only plays checks, found with `Board::gives_check`, so the
+// defender is always in check and only has the moves of
+// `Board::legal_evasions`, and the tree is narrow on both sides. Each node
+// keeps a proof number, how many more positions at least have to be mates for
+// it to be won, and a disproof number, how many have to hold for it not to
+// be. The search always goes into the child that most cheaply changes the
+// node's numbers, with thresholds that send it back up as soon as a sibling
+// becomes cheaper, so that it expands the positions of the shortest proof or
+// refutation first and stops the moment it has one, where alpha-beta would
+// search every move of the side to move to the full depth. The numbers are
+// kept in a table by key and number of moves left, which also merges
+// transpositions.
+//
+// Mates that need a quiet move of the attacker are not found: the search
+// answers whether there is a mate by checks.
+class MateSolver {
+ public:
+  enum class Result { mate, no_mate, unknown };
+
+  // Gives up, with `Result::unknown`, once a call has searched `max_nodes`
+  // positions, unless it is 0.
+  explicit MateSolver(uint64_t max_nodes = 0);
+
+  // Returns whether the side to move of `board` mates in at most `moves`
+  // moves by checks.
+  Result solve(const Board& board, int moves);
+  // Sets `*mating_moves` to the first moves of the mates of `solve`, in move
+  // generation order. A puzzle has a unique solution if there is exactly one.
+  // Returns `Result::unknown` if that couldn't be settled for every move, and
+  // whether there is a mate otherwise.
+  Result find_mating_moves(const Board& board, int moves,
+                           std::vector<Move>* mating_moves);
+
+  // The positions searched by the last call.
+  uint64_t nodes() const { return nodes_; }
+
+ private:
+  struct Numbers {
+    uint32_t proof_;
+    uint32_t disproof_;
+  };
+
+  // Searches `board`, where the attacker is to move if `attacking`, until its
+  // proof number reaches `proof_threshold` or its disproof number reaches
+  // `disproof_threshold`, and stores its numbers. `moves_left` is the number
+  // of moves the attacker has left, the one to play included.
+  void search(const Board& board, bool attacking, int moves_left, int ply,
+              uint32_t proof_threshold, uint32_t disproof_threshold);
+  // Returns the numbers stored for the position, or those of a position not
+  // searched yet.
+  Numbers lookup(const Board& board, int moves_left) const;
+  void store(const Board& board, int moves_left, Numbers numbers);
+  // Clears the table and counters, and searches the attacker's `board` to
+  // the end.
+  Result solve_position(const Board& board, bool attacking, int moves_left);
+
+  const uint64_t max_nodes_;
+  uint64_t nodes_;
+  bool stopped_;
+  absl::flat_hash_map<uint64_t, Numbers> table_;
+  // The children of the node at each ply, kept from one node to the next so
+  // that the search doesn't allocate once it has reached its depth.
+  std::vector<std::vector<Board>> children_;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "mate_solver.h"
+
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Returns true if the side to move of `board` mates in at most `moves` moves
+// by checks, searching every line to the end.
+bool has_checking_mate(const Board& board, int moves) {
+  const CheckInfo info = board.check_info();
+  for (Move move : board.legal_moves()) {
+    if (!board.gives_check(move, info)) {
+      continue;
+    }
+    Board child(board);
+    child.do_move(move);
+    const MoveList evasions = child.legal_evasions();
+    bool is_mate = true;
+    for (Move evasion : evasions) {
+      Board grandchild(child);
+      grandchild.do_move(evasion);
+      if (moves == 1 || !has_checking_mate(grandchild, moves - 1)) {
+        is_mate = false;
+        break;
+      }
+    }
+    if (is_mate) {
+      return true;
+    }
+  }
+  return false;
+}
+
+MateSolver::Result expected_result(const Board& board, int moves) {
+  return has_checking_mate(board, moves) ? MateSolver::Result::mate
+                                         : MateSolver::Result::no_mate;
+}
+}  // namespace.
+
+TEST(MateSolver, FindsMateInOne) {
+  const Board board("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1");
+  MateSolver solver;
+  EXPECT_EQ(solver.solve(board, 1), MateSolver::Result::mate);
+  std::vector<Move> moves;
+  EXPECT_EQ(solver.find_mating_moves(board, 1, &moves),
+            MateSolver::Result::mate);
+  ASSERT_EQ(moves.size(), 1);
+  EXPECT_EQ(moves[0].to_uci_str(), "a1a8");
+}
+
+TEST(MateSolver, FindsSmotheredMate) {
+  // 1. Nf7+ Kg8 2. Nh6+ Kh8 3. Qg8+ Rxg8 4. Nf7#.
+  const Board board("r6k/6pp/8/6N1/2Q5/8/8/7K w - - 0 1");
+  MateSolver solver;
+  EXPECT_EQ(solver.solve(board, 3), MateSolver::Result::no_mate);
+  EXPECT_EQ(solver.solve(board, 4), MateSolver::Result::mate);
+  // Far fewer nodes than a search to the mate takes.
+  EXPECT_LT(solver.nodes(), 1000);
+  std::vector<Move> moves;
+  EXPECT_EQ(solver.find_mating_moves(board, 4, &moves),
+            MateSolver::Result::mate);
+  ASSERT_EQ(moves.size(), 1);
+  EXPECT_EQ(moves[0].to_uci_str(), "g5f7");
+}
+
+TEST(MateSolver, MatchesExhaustiveSearch) {
+  const char* const fens[] = {
+      "r6k/6pp/8/6N1/2Q5/8/8/7K w - - 0 1",
+      "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 0 1",
+      "6k1/5ppp/8/8/8/8/5PPP/3rR1K1 b - - 0 1",
+      "2r3k1/5ppp/8/8/8/8/1Q3PPP/6K1 w - - 0 1",
+      "7k/5Q2/6K1/8/8/8/8/8 w - - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  };
+  MateSolver solver;
+  for (const char* fen : fens) {
+    const Board board(fen);
+    for (int moves = 1; moves <= 3; ++moves) {
+      EXPECT_EQ(solver.solve(board, moves), expected_result(board, moves))
+          << fen << " in " << moves;
+    }
+  }
+}
+
+TEST(MateSolver, ListsEveryMatingMove) {
+  // Either rook mates on the back rank.
+  const Board board("6k1/5ppp/8/8/8/8/1R6/R5K1 w - - 0 1");
+  MateSolver solver;
+  std::vector<Move> moves;
+  EXPECT_EQ(solver.find_mating_moves(board, 1, &moves),
+            MateSolver::Result::mate);
+  EXPECT_EQ(moves.size(), 2);
+  // No checks, no mate.
+  EXPECT_EQ(solver.find_mating_moves(Board("7k/8/8/8/8/8/7P/K7 w - - 0 1"), 3,
+                                     &moves),
+            MateSolver::Result::no_mate);
+  EXPECT_TRUE(moves.empty());
+}
+
+TEST(MateSolver, GivesUpAtTheNodeLimit) {
+  MateSolver solver(10);
+  EXPECT_EQ(solver.solve(Board("r6k/6pp/8/6N1/2Q5/8/8/7K w - - 0 1"), 4),
+            MateSolver::Result::unknown);
+  EXPECT_LE(solver.nodes(), 10);
+}
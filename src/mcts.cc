@@ -0,0 +1,474 @@
+#include "mcts.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/types/optional.h"
+#include "arena.h"
+#include "board.h"
+#include "eval.h"
+#include "repetition.h"
+
+namespace {
+static_assert(sizeof(MctsNode) <= 48, "A node should stay small.");
+static_assert(sizeof(MctsEdge) == 6, "An edge should stay small.");
+
+// The arenas allocate the tree in blocks of this many bytes.
+constexpr size_t arena_block_size = size_t{1} << 20;
+
+// The scores `mcts_value` maps to a value of about +-0.76, where the slope
+// has fallen to half.
+constexpr float value_scale = 600.0f;
+
+constexpr float max_prior = 65535.0f;
+
+void add(std::atomic<double>* sum, double value) {
+  double old = sum->load(std::memory_order_relaxed);
+  while (!sum->compare_exchange_weak(old, old + value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+Color side_to_move(const Board& board) {
+  return board.is_whites_move_ ? Color::white : Color::black;
+}
+
+// Returns the piece `move` captures on `board`, or Piece::none.
+Piece captured_piece(const Board& board, Move move) {
+  if (move.move_type_ == MoveType::en_passant) {
+    return Piece::pawn;
+  }
+  return board.mailbox_[move.dst_idx_];
+}
+
+// Returns the average value of the playouts through `node` for the side that
+// moved into it, with the playouts in flight counted as losses, or nullopt
+// if none went through it.
+absl::optional<float> average_value(const MctsNode& node) {
+  const uint32_t in_flight = node.in_flight_.load(std::memory_order_relaxed);
+  const uint32_t visits =
+      node.visits_.load(std::memory_order_relaxed) + in_flight;
+  if (visits == 0) {
+    return absl::nullopt;
+  }
+  return static_cast<float>(
+      (node.value_sum_.load(std::memory_order_relaxed) - in_flight) / visits);
+}
+
+// Returns the child of `node` with the most visits, or null.
+const MctsNode* most_visited_child(const MctsNode& node) {
+  const MctsNode* best = nullptr;
+  for (const MctsNode* child =
+           node.first_child_.load(std::memory_order_acquire);
+       child; child = child->next_sibling_) {
+    if (child->visits_.load(std::memory_order_relaxed) > 0 &&
+        (!best || child->visits_.load(std::memory_order_relaxed) >
+                      best->visits_.load(std::memory_order_relaxed))) {
+      best = child;
+    }
+  }
+  return best;
+}
+}  // namespace.
+
+float mcts_value(int score) {
+  return std::tanh(static_cast<float>(score) / value_scale);
+}
+
+int mcts_score(float value) {
+  return static_cast<int>(
+      std::lround(value_scale * std::atanh(std::max(
+                                    -0.999f, std::min(value, 0.999f)))));
+}
+
+float heuristic_mcts_evaluation(const Board& board, const MoveList& moves,
+                                float* priors) {
+  const CheckInfo info = board.check_info();
+  float total = 0.0f;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    const Move move = moves[i];
+    // In pawns of material, more or less.
+    float gain = 0.0f;
+    const Piece victim = captured_piece(board, move);
+    if (victim != Piece::none) {
+      gain += board.see_ge(move, 0) ? 0.5f * see_value(victim) /
+                                          see_value(Piece::pawn)
+                                    : -1.0f;
+    }
+    if (move.move_type_ == MoveType::promotion_to_queen) {
+      gain += 2.0f;
+    }
+    if (board.gives_check(move, info)) {
+      gain += 0.5f;
+    }
+    priors[i] = std::exp(gain);
+    total += priors[i];
+  }
+  for (size_t i = 0; i < moves.size(); ++i) {
+    priors[i] /= total;
+  }
+  return mcts_value(evaluate(board));
+}
+
+MctsSearcher::MctsSearcher(ThreadPool* pool)
+    : pool_(pool),
+      evaluator_(heuristic_mcts_evaluation),
+      current_arenas_(0),
+      root_(nullptr),
+      num_nodes_(0),
+      playouts_(0),
+      stopped_(false) {
+  const size_t num_threads = pool ? pool->num_threads() + 1 : 1;
+  for (std::vector<std::unique_ptr<Arena>>& arenas : arenas_) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      arenas.push_back(std::make_unique<Arena>(arena_block_size));
+    }
+  }
+}
+
+void MctsSearcher::clear() {
+  for (std::vector<std::unique_ptr<Arena>>& arenas : arenas_) {
+    for (const std::unique_ptr<Arena>& arena : arenas) {
+      arena->reset();
+    }
+  }
+  root_ = nullptr;
+  num_nodes_.store(0, std::memory_order_relaxed);
+}
+
+MctsResult MctsSearcher::search(const Board& board, const MctsLimits& limits) {
+  begin_search(board, limits);
+  const std::vector<std::unique_ptr<Arena>>& arenas = arenas_[current_arenas_];
+  for (size_t i = 1; i < arenas.size(); ++i) {
+    Arena* arena = arenas[i].get();
+    pool_->submit([this, &limits, arena] { run_playouts(limits, arena); });
+  }
+  run_playouts(limits, arenas[0].get());
+  stopped_.store(true, std::memory_order_relaxed);
+  if (pool_) {
+    pool_->wait();
+  }
+  return end_search();
+}
+
+void MctsSearcher::begin_search(const Board& board, const MctsLimits& limits) {
+  ABSL_RAW_CHECK(limits.max_playouts_ || limits.max_nodes_ || limits.stop_,
+                 "An MCTS search needs a limit.");
+  if (root_ && !(root_board_ == board)) {
+    if (MctsNode* subtree = find_subtree(board)) {
+      reroot(subtree, board);
+    } else {
+      clear();
+    }
+  }
+  if (!root_) {
+    root_ = new_node(0, arenas_[current_arenas_][0].get());
+    root_board_ = board;
+    num_nodes_.store(1, std::memory_order_relaxed);
+  }
+  if (game_history_.empty() || game_history_.top_key() != board.key_) {
+    game_history_.reset(board);
+  }
+  playouts_.store(0, std::memory_order_relaxed);
+  stopped_.store(false, std::memory_order_relaxed);
+}
+
+bool MctsSearcher::limit_reached(const MctsLimits& limits) const {
+  return stopped_.load(std::memory_order_relaxed) ||
+         (limits.stop_ && limits.stop_->load(std::memory_order_relaxed)) ||
+         (limits.max_playouts_ && playouts_.load(std::memory_order_relaxed) >=
+                                      limits.max_playouts_) ||
+         (limits.max_nodes_ &&
+          num_nodes_.load(std::memory_order_relaxed) >= limits.max_nodes_);
+}
+
+MctsSearcher::Playout MctsSearcher::new_playout() const {
+  Playout playout;
+  playout.history_ = game_history_;
+  playout.history_.reserve(game_history_.size() + max_ply);
+  playout.path_.reserve(max_ply + 1);
+  return playout;
+}
+
+MctsSearcher::PlayoutStep MctsSearcher::start_playout(Playout* playout,
+                                                      Arena* arena) {
+  Board* const board = &playout->board_;
+  KeyHistory* const history = &playout->history_;
+  std::vector<MctsNode*>* const path = &playout->path_;
+  *board = root_board_;
+  while (history->size() > game_history_.size()) {
+    history->pop();
+  }
+  path->clear();
+  MctsNode* node = root_;
+  path->push_back(node);
+  for (int ply = 0;; ++ply) {
+    if (ply >= max_ply || (ply > 0 && (board->fifty_move_clock_ >= 100 ||
+                                       history->is_repetition(ply)))) {
+      backup(playout, 0.0f);
+      return PlayoutStep::done;
+    }
+    MctsNode::State state = node->state_.load(std::memory_order_acquire);
+    if (state == MctsNode::State::leaf &&
+        node->state_.compare_exchange_strong(state,
+                                             MctsNode::State::expanding,
+                                             std::memory_order_acquire)) {
+      playout->moves_ = board->legal_moves();
+      if (!playout->moves_.empty()) {
+        return PlayoutStep::needs_evaluation;
+      }
+      const bool mated = board->is_king_attacked(side_to_move(*board));
+      node->state_.store(
+          mated ? MctsNode::State::mated : MctsNode::State::stalemated,
+          std::memory_order_release);
+      backup(playout, mated ? -1.0f : 0.0f);
+      return PlayoutStep::done;
+    }
+    if (state == MctsNode::State::expanding) {
+      for (size_t i = 1; i < path->size(); ++i) {
+        (*path)[i]->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+      }
+      return PlayoutStep::collided;
+    }
+    if (state != MctsNode::State::expanded) {
+      backup(playout, state == MctsNode::State::mated ? -1.0f : 0.0f);
+      return PlayoutStep::done;
+    }
+    const size_t edge_idx = select_edge(*node);
+    MctsNode* next = child(node, edge_idx, arena);
+    next->in_flight_.fetch_add(1, std::memory_order_relaxed);
+    board->do_move(node->edges_[edge_idx].move_);
+    history->push(*board);
+    path->push_back(next);
+    node = next;
+  }
+}
+
+void MctsSearcher::finish_playout(Playout* playout, float value,
+                                  const float* priors, Arena* arena) {
+  MctsNode* const node = playout->path_.back();
+  const MoveList& moves = playout->moves_;
+  MctsEdge* const edges = arena->allocate_array<MctsEdge>(moves.size());
+  for (size_t i = 0; i < moves.size(); ++i) {
+    edges[i].move_ = moves[i];
+    edges[i].prior_ = static_cast<uint16_t>(
+        std::lround(std::max(0.0f, std::min(priors[i], 1.0f)) * max_prior));
+  }
+  node->edges_ = edges;
+  node->num_edges_ = static_cast<uint8_t>(moves.size());
+  node->state_.store(MctsNode::State::expanded, std::memory_order_release);
+  backup(playout, value);
+}
+
+MctsResult MctsSearcher::end_search() {
+  stopped_.store(true, std::memory_order_relaxed);
+  return result(playouts_.load(std::memory_order_relaxed));
+}
+
+Arena* MctsSearcher::arena(size_t idx) const {
+  return arenas_[current_arenas_][idx].get();
+}
+
+void MctsSearcher::run_playouts(const MctsLimits& limits, Arena* arena) {
+  Playout playout = new_playout();
+  std::array<float, max_moves> priors;
+  while (!limit_reached(limits)) {
+    if (start_playout(&playout, arena) == PlayoutStep::needs_evaluation) {
+      const float value =
+          evaluator_(playout.board_, playout.moves_, priors.data());
+      finish_playout(&playout, value, priors.data(), arena);
+    }
+  }
+}
+
+void MctsSearcher::backup(Playout* playout, float value) {
+  // `value` is for the side to move at the leaf, and each node keeps the
+  // values for the side that moved into it.
+  const std::vector<MctsNode*>& path = playout->path_;
+  for (size_t i = path.size(); i-- > 0;) {
+    MctsNode* visited = path[i];
+    value = -value;
+    add(&visited->value_sum_, value);
+    visited->visits_.fetch_add(1, std::memory_order_relaxed);
+    if (i > 0) {
+      visited->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  playouts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t MctsSearcher::select_edge(const MctsNode& node) const {
+  std::array<const MctsNode*, max_moves> children = {};
+  for (const MctsNode* child =
+           node.first_child_.load(std::memory_order_acquire);
+       child; child = child->next_sibling_) {
+    children[child->edge_idx_] = child;
+  }
+  // The node's own average is for the side that moved into it.
+  const float parent_value = -average_value(node).value_or(0.0f);
+  const float first_play_value = parent_value - first_play_reduction;
+  const float exploration =
+      c_puct * std::sqrt(static_cast<float>(
+                   std::max<uint32_t>(1, node.visits_.load(
+                                             std::memory_order_relaxed))));
+  size_t best = 0;
+  float best_score = -std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < node.num_edges_; ++i) {
+    const MctsNode* child = children[i];
+    uint32_t visits = 0;
+    float value = first_play_value;
+    if (child) {
+      visits = child->visits_.load(std::memory_order_relaxed) +
+               child->in_flight_.load(std::memory_order_relaxed);
+      value = average_value(*child).value_or(first_play_value);
+    }
+    const float score = value + exploration * node.edges_[i].prior_ /
+                                    max_prior / (1.0f + visits);
+    if (score > best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+MctsNode* MctsSearcher::child(MctsNode* node, size_t edge_idx, Arena* arena) {
+  MctsNode* head = node->first_child_.load(std::memory_order_acquire);
+  MctsNode* added = nullptr;
+  while (true) {
+    for (MctsNode* child = head; child; child = child->next_sibling_) {
+      if (child->edge_idx_ == edge_idx) {
+        // Another thread added it first. The node made here stays unused in
+        // the arena until the tree is freed.
+        return child;
+      }
+    }
+    if (!added) {
+      added = new_node(edge_idx, arena);
+    }
+    added->next_sibling_ = head;
+    if (node->first_child_.compare_exchange_weak(head, added,
+                                                 std::memory_order_release,
+                                                 std::memory_order_acquire)) {
+      num_nodes_.fetch_add(1, std::memory_order_relaxed);
+      return added;
+    }
+  }
+}
+
+MctsNode* MctsSearcher::new_node(size_t edge_idx, Arena* arena) {
+  MctsNode* const node =
+      new (arena->allocate(sizeof(MctsNode), alignof(MctsNode))) MctsNode;
+  node->first_child_.store(nullptr, std::memory_order_relaxed);
+  node->next_sibling_ = nullptr;
+  node->edges_ = nullptr;
+  node->value_sum_.store(0.0, std::memory_order_relaxed);
+  node->visits_.store(0, std::memory_order_relaxed);
+  node->in_flight_.store(0, std::memory_order_relaxed);
+  node->edge_idx_ = static_cast<uint8_t>(edge_idx);
+  node->num_edges_ = 0;
+  node->state_.store(MctsNode::State::leaf, std::memory_order_relaxed);
+  return node;
+}
+
+MctsNode* MctsSearcher::find_subtree(const Board& board) const {
+  for (MctsNode* child = root_->first_child_.load(std::memory_order_relaxed);
+       child; child = child->next_sibling_) {
+    Board after_move = root_board_;
+    after_move.do_move(root_->edges_[child->edge_idx_].move_);
+    if (after_move == board) {
+      return child;
+    }
+    for (MctsNode* grandchild =
+             child->first_child_.load(std::memory_order_relaxed);
+         grandchild; grandchild = grandchild->next_sibling_) {
+      Board after_reply = after_move;
+      after_reply.do_move(child->edges_[grandchild->edge_idx_].move_);
+      if (after_reply == board) {
+        return grandchild;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void MctsSearcher::reroot(MctsNode* node, const Board& board) {
+  const size_t spare = 1 - current_arenas_;
+  Arena* const arena = arenas_[spare][0].get();
+  arena->reset();
+  // Copies the nodes depth first, each with its statistics and edges and
+  // its children in the same order.
+  size_t num_nodes = 0;
+  std::vector<std::pair<const MctsNode*, MctsNode*>> stack;
+  MctsNode* const new_root = new_node(0, arena);
+  stack.emplace_back(node, new_root);
+  while (!stack.empty()) {
+    const MctsNode* const from = stack.back().first;
+    MctsNode* const to = stack.back().second;
+    stack.pop_back();
+    ++num_nodes;
+    to->value_sum_.store(from->value_sum_.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+    to->visits_.store(from->visits_.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    to->num_edges_ = from->num_edges_;
+    to->state_.store(from->state_.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    if (from->edges_) {
+      to->edges_ = arena->allocate_array<MctsEdge>(from->num_edges_);
+      std::copy(from->edges_, from->edges_ + from->num_edges_, to->edges_);
+    }
+    MctsNode* last = nullptr;
+    for (const MctsNode* child =
+             from->first_child_.load(std::memory_order_relaxed);
+         child; child = child->next_sibling_) {
+      MctsNode* const copy = new_node(child->edge_idx_, arena);
+      if (last) {
+        last->next_sibling_ = copy;
+      } else {
+        to->first_child_.store(copy, std::memory_order_relaxed);
+      }
+      last = copy;
+      stack.emplace_back(child, copy);
+    }
+  }
+  for (const std::unique_ptr<Arena>& old : arenas_[current_arenas_]) {
+    old->reset();
+  }
+  current_arenas_ = spare;
+  root_ = new_root;
+  root_board_ = board;
+  num_nodes_.store(num_nodes, std::memory_order_relaxed);
+}
+
+MctsResult MctsSearcher::result(uint64_t playouts) const {
+  MctsResult res;
+  res.value_ = 0.0f;
+  res.playouts_ = playouts;
+  res.root_visits_ = root_->visits_.load(std::memory_order_relaxed);
+  res.num_nodes_ = num_nodes_.load(std::memory_order_relaxed);
+  res.memory_bytes_ = 0;
+  for (const std::unique_ptr<Arena>& arena : arenas_[current_arenas_]) {
+    res.memory_bytes_ += arena->bytes_used();
+  }
+  const MctsNode* node = root_;
+  while (const MctsNode* best = most_visited_child(*node)) {
+    res.pv_.push_back(node->edges_[best->edge_idx_].move_);
+    node = best;
+  }
+  if (!res.pv_.empty()) {
+    res.best_move_ = res.pv_[0];
+    res.value_ = *average_value(*most_visited_child(*root_));
+  }
+  res.score_ = mcts_score(res.value_);
+  return res;
+}
@@ -0,0 +1,219 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "arena.h"
+#include "board.h"
+#include "repetition.h"
+#include "thread_pool.h"
+
+// Returns the value of `board` for the side to move, in [-1, 1], and sets
+// `priors[i]` to the prior probability of `moves[i]`, where `moves` are the
+// legal moves of `board`, at least one. The priors sum to 1. Called from
+// every thread of a search at once.
+typedef std::function<float(const Board& board, const MoveList& moves,
+                            float* priors)>
+    MctsEvaluator;
+
+// The evaluator used without a policy network: the static evaluation, see
+// `mcts_value`, and priors that favour captures that win material by SEE,
+// queen promotions and checks.
+float heuristic_mcts_evaluation(const Board& board, const MoveList& moves,
+                                float* priors);
+
+// Maps a score in centipawns onto a value in (-1, 1), and back.
+float mcts_value(int score);
+int mcts_score(float value);
+
+// An edge of the tree: a legal move and its prior, quantized to 16 bits.
+struct MctsEdge {
+  Move move_;
+  uint16_t prior_;
+};
+
+// A node of the tree, the position after the move of edge `edge_idx_` of its
+// parent. The children are allocated the first time a playout takes their
+// edge, and linked into a list, so that the many moves no playout takes cost
+// an edge only. The statistics count playouts still on their way back up
+// (virtual loss, see MctsSearcher) as losses in flight.
+struct MctsNode {
+  enum class State : uint8_t {
+    // The position hasn't been evaluated.
+    leaf,
+    // A playout is evaluating the position and adding its edges.
+    expanding,
+    expanded,
+    // The side to move has no legal move.
+    mated,
+    stalemated
+  };
+
+  std::atomic<MctsNode*> first_child_;
+  MctsNode* next_sibling_;
+  // `num_edges_` edges, null until the node is expanded.
+  MctsEdge* edges_;
+  // The sum of the values of the playouts through the node, for the side
+  // that moved into it.
+  std::atomic<double> value_sum_;
+  std::atomic<uint32_t> visits_;
+  std::atomic<uint16_t> in_flight_;
+  uint8_t edge_idx_;
+  uint8_t num_edges_;
+  std::atomic<State> state_;
+};
+
+// What ends an MctsSearcher search. Each limit that is 0 or null is off, but
+// at least one of them has to be on.
+struct MctsLimits {
+  // The playouts of this search, not counting those of a reused subtree.
+  uint64_t max_playouts_;
+  // The nodes in the tree, reused ones included, which bounds its memory.
+  size_t max_nodes_;
+  // The search stops soon after `*stop_` is set.
+  const std::atomic<bool>* stop_;
+};
+
+struct MctsResult {
+  // The most visited root move, nullopt without legal moves.
+  absl::optional<Move> best_move_;
+  // The value of `best_move_` for the side to move, and the same as a score.
+  float value_;
+  int score_;
+  // The most visited line from the root.
+  std::vector<Move> pv_;
+  // The playouts of this search, and the visits of the root, which counts
+  // those of the reused subtree too.
+  uint64_t playouts_;
+  uint64_t root_visits_;
+  size_t num_nodes_;
+  // The bytes of the arenas the tree takes.
+  size_t memory_bytes_;
+};
+
+// A Monte Carlo tree search with PUCT selection, as in AlphaZero: playouts
+// walk down from the root, at each node taking the edge with the best sum
+// of its average value and an exploration term that grows with its prior and
+// shrinks with its visits, until they reach a position the tree hasn't
+// evaluated. They evaluate it, add its legal moves as edges, and add the
+// value to every node on the way back up. Mates and stalemates are scored
+// when found, draws by repetition or the fifty move rule on every visit, as
+// a node's line to the root changes when the tree is reused.
+//
+// The tree lives in arenas (see arena.h), one per thread, so that threads
+// allocate nodes without locking and the tree is freed all at once. A node
+// takes 48 bytes and an edge 6, so that trees of hundreds of millions of
+// nodes fit in memory. The threads of the pool search the same tree with
+// the calling thread. A playout marks the nodes of its line as in flight,
+// each counting as a loss until the playout is backed up (virtual loss), so
+// that the other threads take other lines. A playout that reaches a node
+// another thread is expanding gives up and starts again.
+//
+// The tree is kept between searches. A search of a position one or two plies
+// after the last root, the move played and the reply, keeps the subtree
+// under it: the subtree is copied into the spare set of arenas, which then
+// take over, so that the rest of the old tree is freed.
+class MctsSearcher {
+ public:
+  // The exploration constant of PUCT, and what a move no playout took yet
+  // is taken to score below its parent's value (first play urgency).
+  static constexpr float c_puct = 1.5f;
+  static constexpr float first_play_reduction = 0.2f;
+  // Playouts stop this deep, scoring the position as a draw.
+  static constexpr int max_ply = 256;
+
+  // `pool` may be null, for a search on the calling thread alone. It isn't
+  // owned, and it must not change its number of threads.
+  explicit MctsSearcher(ThreadPool* pool);
+  MctsSearcher(const MctsSearcher&) = delete;
+  MctsSearcher& operator=(const MctsSearcher&) = delete;
+
+  // The evaluator is `heuristic_mcts_evaluation` unless set otherwise.
+  void set_evaluator(MctsEvaluator evaluator) {
+    evaluator_ = std::move(evaluator);
+  }
+  // Gives the searches the positions of the game before the position they
+  // search, for finding repetitions of them, see
+  // `Searcher::set_game_history`.
+  void set_game_history(const KeyHistory& history) { game_history_ = history; }
+
+  MctsResult search(const Board& board, const MctsLimits& limits);
+  // Drops the tree.
+  void clear();
+
+  // A search in steps, for callers that evaluate the leaves themselves, such
+  // as the coroutines of mcts_coroutines.h. `begin_search` sets up the root
+  // as `search` does. Each playout then calls `start_playout` and, if that
+  // returns `needs_evaluation`, `finish_playout` with the evaluation of
+  // `board_`, whose legal moves are `moves_`, while the other playouts go on.
+  // Until `limit_reached`, after which `end_search` returns the result.
+  // Playouts may run on many threads at once, each with a Playout of its own
+  // and an arena no other thread allocates from at the same time.
+  struct Playout {
+    Board board_;
+    KeyHistory history_;
+    std::vector<MctsNode*> path_;
+    MoveList moves_;
+  };
+  enum class PlayoutStep {
+    // The playout was backed up.
+    done,
+    // It ran into a node another thread is expanding and was dropped.
+    collided,
+    // Its leaf waits for `finish_playout`.
+    needs_evaluation
+  };
+  void begin_search(const Board& board, const MctsLimits& limits);
+  bool limit_reached(const MctsLimits& limits) const;
+  Playout new_playout() const;
+  PlayoutStep start_playout(Playout* playout, Arena* arena);
+  void finish_playout(Playout* playout, float value, const float* priors,
+                      Arena* arena);
+  MctsResult end_search();
+  // The arenas of the tree: 0 is for the calling thread, and worker `i` of
+  // the pool has arena `i + 1`.
+  size_t num_arenas() const { return arenas_[current_arenas_].size(); }
+  Arena* arena(size_t idx) const;
+
+ private:
+  // Runs playouts on the calling thread, allocating from `arena`, until a
+  // limit is reached.
+  void run_playouts(const MctsLimits& limits, Arena* arena);
+  // Adds `value`, for the side to move at the end of `playout`, to the nodes
+  // of its path.
+  void backup(Playout* playout, float value);
+  // Returns the index of the edge of `node` that PUCT picks.
+  size_t select_edge(const MctsNode& node) const;
+  // Returns the child of `node` for edge `edge_idx`, adding it if it isn't
+  // there.
+  MctsNode* child(MctsNode* node, size_t edge_idx, Arena* arena);
+  MctsNode* new_node(size_t edge_idx, Arena* arena);
+  // Makes `node`, which is `board`, the root, keeping its subtree.
+  void reroot(MctsNode* node, const Board& board);
+  // Returns the child of the root that is `board`, or of one of those
+  // children, or null.
+  MctsNode* find_subtree(const Board& board) const;
+  MctsResult result(uint64_t playouts) const;
+
+  ThreadPool* const pool_;
+  MctsEvaluator evaluator_;
+  KeyHistory game_history_;
+  // Two sets of arenas, one per thread each: the current one holds the tree,
+  // the other is where the subtree kept for the next search is copied.
+  std::vector<std::unique_ptr<Arena>> arenas_[2];
+  size_t current_arenas_;
+  MctsNode* root_;
+  Board root_board_;
+  std::atomic<size_t> num_nodes_;
+  std::atomic<uint64_t> playouts_;
+  std::atomic<bool> stopped_;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "mcts_coroutines.h"
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/types/optional.h"
+#include "arena.h"
+#include "board.h"
+#include "debug_check.h"
+#include "inference_queue.h"
+#include "mcts.h"
+#include "thread_pool.h"
+
+namespace {
+// A coroutine that starts when called and frees its frame when it returns.
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// What the playouts of one search share.
+class Driver {
+ public:
+  Driver(MctsSearcher* searcher, const MctsLimits& limits,
+         InferenceQueue* queue, ThreadPool* pool, size_t num_in_flight)
+      : searcher_(searcher),
+        limits_(limits),
+        queue_(queue),
+        pool_(pool),
+        finished_(static_cast<std::ptrdiff_t>(num_in_flight)),
+        num_expanded_(0) {}
+
+  // Suspends the playout until `queue_` has evaluated its leaf, and returns
+  // the value.
+  class LeafEvaluation {
+   public:
+    LeafEvaluation(Driver* driver, MctsSearcher::Playout* playout,
+                   float* priors)
+        : driver_(driver), playout_(playout), priors_(priors), value_(0) {}
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      // The playout may be resumed before this returns, so nothing here is
+      // touched after the submit.
+      Driver* const driver = driver_;
+      driver->queue_->submit(playout_->board_, playout_->moves_, priors_,
+                             &value_,
+                             [driver, handle] { driver->resume(handle); });
+    }
+    float await_resume() const { return value_; }
+
+   private:
+    Driver* driver_;
+    MctsSearcher::Playout* playout_;
+    float* priors_;
+    float value_;
+  };
+
+  // Suspends a playout that collided until a leaf has been expanded since
+  // `num_expanded`, which it read before it started.
+  class Park {
+   public:
+    Park(Driver* driver, uint64_t num_expanded)
+        : driver_(driver), num_expanded_(num_expanded) {}
+
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      std::lock_guard<std::mutex> lock(driver_->mutex_);
+      if (driver_->num_expanded_.load(std::memory_order_relaxed) !=
+          num_expanded_) {
+        return false;
+      }
+      driver_->parked_.push_back(handle);
+      return true;
+    }
+    void await_resume() const {}
+
+   private:
+    Driver* driver_;
+    uint64_t num_expanded_;
+  };
+
+  // Runs playouts until a limit is reached. Called on a worker of `pool_`,
+  // on which it is always resumed.
+  DetachedTask run_playouts() {
+    MctsSearcher::Playout playout = searcher_->new_playout();
+    std::array<float, max_moves> priors;
+    while (!searcher_->limit_reached(limits_)) {
+      const uint64_t num_expanded =
+          num_expanded_.load(std::memory_order_acquire);
+      const MctsSearcher::PlayoutStep step =
+          searcher_->start_playout(&playout, arena());
+      if (step == MctsSearcher::PlayoutStep::collided) {
+        co_await Park(this, num_expanded);
+      } else if (step == MctsSearcher::PlayoutStep::needs_evaluation) {
+        const float value =
+            co_await LeafEvaluation(this, &playout, priors.data());
+        searcher_->finish_playout(&playout, value, priors.data(), arena());
+        wake_parked();
+      }
+    }
+    finished_.count_down();
+  }
+
+  void wait() { finished_.wait(); }
+
+ private:
+  // The arena of the calling worker.
+  Arena* arena() const {
+    const absl::optional<size_t> worker = pool_->worker_index();
+    DEBUG_CHECK(worker.has_value(), "Playouts run on the pool.");
+    return searcher_->arena(*worker + 1);
+  }
+
+  void resume(std::coroutine_handle<> handle) {
+    pool_->submit([handle] { handle.resume(); });
+  }
+
+  void wake_parked() {
+    std::vector<std::coroutine_handle<>> parked;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_expanded_.fetch_add(1, std::memory_order_release);
+      parked.swap(parked_);
+    }
+    for (std::coroutine_handle<> handle : parked) {
+      resume(handle);
+    }
+  }
+
+  MctsSearcher* const searcher_;
+  const MctsLimits limits_;
+  InferenceQueue* const queue_;
+  ThreadPool* const pool_;
+  // Counts the playouts still running down to zero.
+  std::latch finished_;
+  std::mutex mutex_;
+  std::atomic<uint64_t> num_expanded_;
+  std::vector<std::coroutine_handle<>> parked_;
+};
+}  // namespace.
+
+MctsResult coroutine_mcts_search(MctsSearcher* searcher, const Board& board,
+                                 const MctsLimits& limits,
+                                 InferenceQueue* queue, ThreadPool* pool,
+                                 size_t num_in_flight) {
+  ABSL_RAW_CHECK(pool->num_threads() < searcher->num_arenas(),
+                 "Each worker needs an arena of the searcher.");
+  ABSL_RAW_CHECK(num_in_flight > 0, "A search needs a playout.");
+  searcher->begin_search(board, limits);
+  Driver driver(searcher, limits, queue, pool, num_in_flight);
+  for (size_t i = 0; i < num_in_flight; ++i) {
+    pool->submit([&driver] { driver.run_playouts(); });
+  }
+  // Suspended playouts aren't tasks of the pool, so waiting for it isn't
+  // enough; it is still needed for the tasks that counted down last.
+  driver.wait();
+  pool->wait();
+  return searcher->end_search();
+}
@@ -0,0 +1,31 @@
+#ifndef MCTS_COROUTINES_H
+#define MCTS_COROUTINES_H
+
+#include <cstddef>
+
+#include "board.h"
+#include "inference_queue.h"
+#include "mcts.h"
+#include "thread_pool.h"
+
+// The one part of the tree that needs C++20, built with
+// PAWN_GRABBER_COROUTINES.
+//
+// Searches as `searcher->search(board, limits)` does, but with
+// `num_in_flight` playouts under way at once, each a coroutine, on the
+// workers of `pool`. A playout that reaches a leaf hands it to `queue` and
+// suspends, and the worker goes on with another playout; the completion
+// handler of the batch resumes it on the pool. Thousands of playouts can so
+// wait on a batch for a device without a thread each. A playout that runs
+// into a leaf another one is waiting on is parked until a leaf has been
+// expanded.
+//
+// The workers allocate from the arenas of `searcher`, so `pool` must have no
+// more workers than the pool `searcher` was made with. Must not be called
+// from a task of `pool`.
+MctsResult coroutine_mcts_search(MctsSearcher* searcher, const Board& board,
+                                 const MctsLimits& limits,
+                                 InferenceQueue* queue, ThreadPool* pool,
+                                 size_t num_in_flight);
+
+#endif
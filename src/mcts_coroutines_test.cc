@@ -0,0 +1,71 @@
+#include "mcts_coroutines.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "inference_queue.h"
+#include "mcts.h"
+#include "thread_pool.h"
+
+namespace {
+// Values every position as even, with a policy that favours moves to higher
+// squares.
+class FakeBackend : public InferenceBackend {
+ public:
+  void run(const InferenceBatch& batch) override {
+    for (size_t i = 0; i < batch.positions_.size(); ++i) {
+      batch.values_[i] = 0.0f;
+      for (size_t j = 0; j < inference_policy_size; ++j) {
+        batch.policy_logits_[i * inference_policy_size + j] =
+            static_cast<float>(j % 64) / 64.0f;
+      }
+    }
+    max_batch_size_ = std::max(max_batch_size_, batch.positions_.size());
+  }
+
+  size_t max_batch_size_ = 0;
+};
+
+bool is_legal_move(const Board& board, Move move) {
+  const MoveList moves = board.legal_moves();
+  return std::find(moves.begin(), moves.end(), move) != moves.end();
+}
+}  // namespace.
+
+TEST(CoroutineMctsSearch, BatchesPlayoutsOfFewThreads) {
+  FakeBackend backend;
+  InferenceQueue queue(&backend, 32, std::chrono::milliseconds(1));
+  ThreadPool pool(2);
+  MctsSearcher searcher(&pool);
+  Board board;
+  const MctsResult res = coroutine_mcts_search(
+      &searcher, board, MctsLimits{1000, 0, nullptr}, &queue, &pool, 64);
+  ASSERT_TRUE(res.best_move_.has_value());
+  EXPECT_TRUE(is_legal_move(board, *res.best_move_));
+  EXPECT_GE(res.playouts_, 1000);
+  EXPECT_EQ(res.root_visits_, res.playouts_);
+  // Far more leaves wait at once than there are threads.
+  EXPECT_GT(backend.max_batch_size_, pool.num_threads() + 1);
+
+  // The tree carries over as with `search`.
+  board.do_move(*res.best_move_);
+  const MctsResult next = coroutine_mcts_search(
+      &searcher, board, MctsLimits{200, 0, nullptr}, &queue, &pool, 64);
+  EXPECT_GT(next.root_visits_, next.playouts_);
+}
+
+TEST(CoroutineMctsSearch, FindsMateInOne) {
+  FakeBackend backend;
+  InferenceQueue queue(&backend, 8, std::chrono::milliseconds(1));
+  ThreadPool pool(1);
+  MctsSearcher searcher(&pool);
+  const MctsResult res = coroutine_mcts_search(
+      &searcher, Board("k7/8/1K6/8/8/8/8/7R w - - 0 1"),
+      MctsLimits{500, 0, nullptr}, &queue, &pool, 16);
+  ASSERT_TRUE(res.best_move_.has_value());
+  EXPECT_EQ(*res.best_move_, Move(str_to_square("h1"), str_to_square("h8"),
+                                  Piece::rook, MoveType::simple));
+}
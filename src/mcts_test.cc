@@ -0,0 +1,119 @@
+#include "mcts.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "thread_pool.h"
+
+namespace {
+bool is_legal_line(Board board, const std::vector<Move>& line) {
+  for (Move move : line) {
+    const MoveList moves = board.legal_moves();
+    if (std::find(moves.begin(), moves.end(), move) == moves.end()) {
+      return false;
+    }
+    board.do_move(move);
+  }
+  return true;
+}
+
+MctsLimits playouts(uint64_t max_playouts) {
+  return MctsLimits{max_playouts, 0, nullptr};
+}
+}  // namespace.
+
+TEST(MctsSearcher, FindsMateInOne) {
+  MctsSearcher searcher(nullptr);
+  const MctsResult res =
+      searcher.search(Board("k7/8/1K6/8/8/8/8/7R w - - 0 1"), playouts(400));
+  ASSERT_TRUE(res.best_move_.has_value());
+  EXPECT_EQ(*res.best_move_, Move(str_to_square("h1"), str_to_square("h8"),
+                                  Piece::rook, MoveType::simple));
+  EXPECT_GT(res.value_, 0.9f);
+  EXPECT_EQ(res.playouts_, 400);
+  EXPECT_EQ(res.root_visits_, 400);
+}
+
+TEST(MctsSearcher, TakesHangingQueen) {
+  MctsSearcher searcher(nullptr);
+  const MctsResult res = searcher.search(
+      Board("4k3/p7/8/3q4/8/8/P7/3RK3 w - - 0 1"), playouts(400));
+  ASSERT_TRUE(res.best_move_.has_value());
+  EXPECT_EQ(*res.best_move_, Move(str_to_square("d1"), str_to_square("d5"),
+                                  Piece::rook, MoveType::capture));
+  EXPECT_GT(res.score_, 0);
+}
+
+TEST(MctsSearcher, ReturnsLegalPrincipalVariation) {
+  MctsSearcher searcher(nullptr);
+  const Board board;
+  const MctsResult res = searcher.search(board, playouts(1000));
+  ASSERT_FALSE(res.pv_.empty());
+  EXPECT_EQ(res.pv_[0], *res.best_move_);
+  EXPECT_TRUE(is_legal_line(board, res.pv_));
+  EXPECT_GT(res.num_nodes_, 1);
+  EXPECT_LE(res.num_nodes_, 1001);
+  EXPECT_GE(res.memory_bytes_, res.num_nodes_ * sizeof(MctsNode));
+}
+
+TEST(MctsSearcher, HasNoMoveWhenMated) {
+  MctsSearcher searcher(nullptr);
+  const MctsResult res =
+      searcher.search(Board("R6k/6pp/8/8/8/8/8/6K1 b - - 0 1"), playouts(10));
+  EXPECT_FALSE(res.best_move_.has_value());
+  EXPECT_TRUE(res.pv_.empty());
+  EXPECT_EQ(res.root_visits_, 10);
+}
+
+TEST(MctsSearcher, ReusesSubtreeAfterMoveAndReply) {
+  MctsSearcher searcher(nullptr);
+  Board board;
+  const MctsResult first = searcher.search(board, playouts(2000));
+  ASSERT_GE(first.pv_.size(), 2);
+  board.do_move(first.pv_[0]);
+  board.do_move(first.pv_[1]);
+  const MctsResult second = searcher.search(board, playouts(100));
+  EXPECT_EQ(second.playouts_, 100);
+  EXPECT_GT(second.root_visits_, 100);
+  EXPECT_TRUE(is_legal_line(board, second.pv_));
+
+  // An unrelated position starts a new tree.
+  const MctsResult third = searcher.search(
+      Board("4k3/p7/8/3q4/8/8/P7/3RK3 w - - 0 1"), playouts(100));
+  EXPECT_EQ(third.root_visits_, 100);
+}
+
+TEST(MctsSearcher, StopsAtNodeLimit) {
+  MctsSearcher searcher(nullptr);
+  const MctsResult res = searcher.search(Board(), MctsLimits{0, 500, nullptr});
+  EXPECT_EQ(res.num_nodes_, 500);
+}
+
+TEST(MctsSearcher, StopsWhenAsked) {
+  MctsSearcher searcher(nullptr);
+  const std::atomic<bool> stop(true);
+  const MctsResult res = searcher.search(Board(), MctsLimits{0, 0, &stop});
+  EXPECT_EQ(res.playouts_, 0);
+  EXPECT_FALSE(res.best_move_.has_value());
+}
+
+TEST(MctsSearcher, SearchesWithThreads) {
+  ThreadPool pool(3);
+  MctsSearcher searcher(&pool);
+  Board board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  const MctsResult res = searcher.search(board, playouts(3000));
+  EXPECT_GE(res.playouts_, 3000);
+  // Every playout, none of them in flight any more, visited the root once.
+  EXPECT_EQ(res.root_visits_, res.playouts_);
+  EXPECT_TRUE(is_legal_line(board, res.pv_));
+
+  board.do_move(res.pv_[0]);
+  const MctsResult next = searcher.search(board, playouts(1000));
+  EXPECT_GT(next.root_visits_, next.playouts_);
+}
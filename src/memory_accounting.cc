@@ -0,0 +1,162 @@
+#include "memory_accounting.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+
+namespace {
+const char* const memory_tag_names[num_memory_tags] = {
+    "transposition_table", "pawn_tables", "eval_tables",
+    "histories",           "accumulators", "network",
+    "tablebases",          "book",         "mapped_files",
+};
+
+// The bytes one thread counted. Only that thread writes them, while
+// `collect_memory` may read them at any time.
+struct alignas(64) ThreadMemory {
+  uint64_t id_;
+  std::array<std::atomic<int64_t>, num_memory_tags> bytes_;
+};
+
+// The memory of the running threads, and the bytes of those that have exited.
+struct Registry {
+  std::mutex mutex_;
+  std::vector<const ThreadMemory*> threads_;
+  std::array<int64_t, num_memory_tags> exited_ = {};
+  uint64_t next_id_ = 0;
+};
+
+// Never destroyed, since threads may exit after static destruction.
+Registry& registry() {
+  static Registry* const res = new Registry();
+  return *res;
+}
+
+// The calling thread's memory, made by its first count and folded into the
+// registry's when it exits.
+thread_local ThreadMemory* current_thread_memory = nullptr;
+// Set once the thread's memory is folded, for what its thread-local and
+// static objects still free after that.
+thread_local bool thread_memory_folded = false;
+
+struct ThreadMemoryFolder {
+  ~ThreadMemoryFolder() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex_);
+    ThreadMemory* const memory = current_thread_memory;
+    for (size_t i = 0; i < num_memory_tags; ++i) {
+      reg.exited_[i] += memory->bytes_[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < reg.threads_.size(); ++i) {
+      if (reg.threads_[i] == memory) {
+        reg.threads_[i] = reg.threads_.back();
+        reg.threads_.pop_back();
+        break;
+      }
+    }
+    delete memory;
+    current_thread_memory = nullptr;
+    thread_memory_folded = true;
+  }
+};
+
+// Null once the calling thread's memory is folded.
+ThreadMemory* thread_memory() {
+  if (!current_thread_memory && !thread_memory_folded) {
+    ThreadMemory* const memory = new ThreadMemory();
+    for (std::atomic<int64_t>& bytes : memory->bytes_) {
+      bytes.store(0, std::memory_order_relaxed);
+    }
+    {
+      Registry& reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex_);
+      memory->id_ = reg.next_id_++;
+      reg.threads_.push_back(memory);
+    }
+    current_thread_memory = memory;
+    thread_local ThreadMemoryFolder folder;
+  }
+  return current_thread_memory;
+}
+}  // namespace.
+
+const char* memory_tag_name(MemoryTag tag) {
+  return memory_tag_names[static_cast<size_t>(tag)];
+}
+
+void add_memory(MemoryTag tag, int64_t bytes) {
+  const size_t idx = static_cast<size_t>(tag);
+  if (ThreadMemory* const memory = thread_memory()) {
+    memory->bytes_[idx].store(
+        memory->bytes_[idx].load(std::memory_order_relaxed) + bytes,
+        std::memory_order_relaxed);
+    return;
+  }
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex_);
+  reg.exited_[idx] += bytes;
+}
+
+int64_t MemorySnapshot::total() const {
+  int64_t res = 0;
+  for (int64_t bytes : bytes_) {
+    res += bytes;
+  }
+  return res;
+}
+
+MemorySnapshot collect_memory() {
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex_);
+  MemorySnapshot res = {reg.exited_, {}};
+  for (const ThreadMemory* memory : reg.threads_) {
+    MemorySnapshot::Thread thread = {memory->id_, {}};
+    for (size_t i = 0; i < num_memory_tags; ++i) {
+      thread.bytes_[i] = memory->bytes_[i].load(std::memory_order_relaxed);
+      res.bytes_[i] += thread.bytes_[i];
+    }
+    res.threads_.push_back(thread);
+  }
+  std::sort(res.threads_.begin(), res.threads_.end(),
+            [](const MemorySnapshot::Thread& a,
+               const MemorySnapshot::Thread& b) { return a.id_ < b.id_; });
+  return res;
+}
+
+uint64_t resident_bytes() {
+  // The second field of statm is the resident set, in pages.
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0;
+  uint64_t resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+std::string memory_to_str(const MemorySnapshot& snapshot) {
+  std::string res;
+  for (size_t i = 0; i < num_memory_tags; ++i) {
+    absl::StrAppend(&res, memory_tag_names[i], " ", snapshot.bytes_[i], "\n");
+  }
+  absl::StrAppend(&res, "total ", snapshot.total(), "\nresident ",
+                  resident_bytes(), "\n");
+  for (const MemorySnapshot::Thread& thread : snapshot.threads_) {
+    int64_t total = 0;
+    for (int64_t bytes : thread.bytes_) {
+      total += bytes;
+    }
+    absl::StrAppend(&res, "thread_", thread.id_, " ", total, "\n");
+  }
+  return res;
+}
@@ -0,0 +1,109 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where the memory of a process goes, by subsystem and by thread, for sizing
+// the memory limits of the machines and containers it runs in. Every large
+// allocation is counted: the tables held in containers through
+// `TaggedAllocator`, and memory mapped or allocated otherwise with
+// `add_memory` where it is mapped and unmapped. Small and short-lived
+// allocations aren't, so the totals fall somewhat short of the resident set.
+//
+// Like the counters of instrumentation.h, every thread counts into storage of
+// its own with a relaxed load and store, and the counts of all threads are
+// only added up when `collect_memory` asks for them. A thread counts what it
+// allocates and what it frees, so one that frees what another allocated
+// counts less than nothing; the totals of each subsystem are exact.
+
+enum class MemoryTag {
+  transposition_table,
+  pawn_tables,
+  eval_tables,
+  // The continuation histories of the searchers.
+  histories,
+  // The accumulator stacks and caches of the neural evaluation.
+  accumulators,
+  network,
+  // The files and caches of the tablebases.
+  tablebases,
+  book,
+  // Files mapped by anything else.
+  mapped_files,
+};
+constexpr size_t num_memory_tags = 9;
+
+// "transposition_table", "pawn_tables" and so on.
+const char* memory_tag_name(MemoryTag tag);
+
+// Counts `bytes` more of `tag` against the calling thread, or fewer if it is
+// negative.
+void add_memory(MemoryTag tag, int64_t bytes);
+
+struct MemorySnapshot {
+  struct Thread {
+    // The threads are numbered in the order they first counted memory.
+    uint64_t id_;
+    std::array<int64_t, num_memory_tags> bytes_;
+  };
+
+  // The bytes of each tag, of every thread, those that have exited included.
+  std::array<int64_t, num_memory_tags> bytes_;
+  // The running threads that have counted memory.
+  std::vector<Thread> threads_;
+
+  int64_t bytes(MemoryTag tag) const {
+    return bytes_[static_cast<size_t>(tag)];
+  }
+  int64_t total() const;
+};
+
+MemorySnapshot collect_memory();
+// The resident set size of the process, or 0 where the system doesn't say.
+uint64_t resident_bytes();
+// One "name bytes" line per tag, then the total and the resident set, then
+// one "thread_<id> bytes" line per thread with the bytes it counted.
+std::string memory_to_str(const MemorySnapshot& snapshot);
+
+// A std::allocator that counts what it allocates against `tag`.
+template <typename T, MemoryTag tag>
+struct TaggedAllocator {
+  using value_type = T;
+  template <typename U>
+  struct rebind {
+    using other = TaggedAllocator<U, tag>;
+  };
+
+  TaggedAllocator() = default;
+  template <typename U>
+  TaggedAllocator(const TaggedAllocator<U, tag>&) {}
+
+  T* allocate(size_t n) {
+    T* const res = std::allocator<T>().allocate(n);
+    add_memory(tag, static_cast<int64_t>(n * sizeof(T)));
+    return res;
+  }
+  void deallocate(T* ptr, size_t n) {
+    add_memory(tag, -static_cast<int64_t>(n * sizeof(T)));
+    std::allocator<T>().deallocate(ptr, n);
+  }
+
+  template <typename U>
+  bool operator==(const TaggedAllocator<U, tag>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const TaggedAllocator<U, tag>&) const {
+    return false;
+  }
+};
+
+template <typename T, MemoryTag tag>
+using TaggedVector = std::vector<T, TaggedAllocator<T, tag>>;
+
+#endif
@@ -0,0 +1,96 @@
+#include "memory_accounting.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "eval.h"
+#include "gtest/gtest.h"
+#include "pawns.h"
+#include "transposition_table.h"
+
+namespace {
+// The bytes of `tag` counted since `before`.
+int64_t counted_since(const MemorySnapshot& before, MemoryTag tag) {
+  return collect_memory().bytes(tag) - before.bytes(tag);
+}
+}  // namespace.
+
+TEST(MemoryAccounting, AddsUpTheThreads) {
+  const MemorySnapshot before = collect_memory();
+  // What a thread allocates stays counted after it exits, until it is freed
+  // wherever that is.
+  std::vector<std::unique_ptr<TaggedVector<char, MemoryTag::book>>> vectors;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    vectors.emplace_back(new TaggedVector<char, MemoryTag::book>());
+    threads.emplace_back([vector = vectors.back().get()] {
+      vector->resize(1000);
+      add_memory(MemoryTag::mapped_files, 10);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counted_since(before, MemoryTag::book), 4000);
+  EXPECT_EQ(counted_since(before, MemoryTag::mapped_files), 40);
+  vectors.clear();
+  EXPECT_EQ(counted_since(before, MemoryTag::book), 0);
+  add_memory(MemoryTag::mapped_files, -40);
+  EXPECT_EQ(counted_since(before, MemoryTag::mapped_files), 0);
+
+  // The running threads are listed with their own counts.
+  const MemorySnapshot after = collect_memory();
+  ASSERT_FALSE(after.threads_.empty());
+  const uint64_t id = after.threads_.back().id_;
+  std::thread thread([] { add_memory(MemoryTag::network, 123); });
+  thread.join();
+  add_memory(MemoryTag::network, -123);
+  bool found = false;
+  for (const MemorySnapshot::Thread& running : collect_memory().threads_) {
+    EXPECT_LE(running.id_, id);
+    found = found || running.id_ == id;
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(MemoryAccounting, CountsTheTables) {
+  const MemorySnapshot before = collect_memory();
+  {
+    TranspositionTable table(4);
+    PawnTable pawns;
+    EvalTable evals;
+    EXPECT_EQ(counted_since(before, MemoryTag::transposition_table),
+              int64_t{4} << 20);
+    EXPECT_EQ(counted_since(before, MemoryTag::pawn_tables),
+              static_cast<int64_t>(PawnTable::default_num_entries *
+                                   sizeof(PawnEntry)));
+    EXPECT_GE(counted_since(before, MemoryTag::eval_tables),
+              static_cast<int64_t>(EvalTable::default_num_entries * 12));
+    table.resize(2);
+    EXPECT_EQ(counted_since(before, MemoryTag::transposition_table),
+              int64_t{2} << 20);
+
+    // Against the calling thread.
+    const MemorySnapshot snapshot = collect_memory();
+    const size_t tt_idx = static_cast<size_t>(MemoryTag::transposition_table);
+    bool found = false;
+    for (const MemorySnapshot::Thread& thread : snapshot.threads_) {
+      found = found || thread.bytes_[tt_idx] >= int64_t{2} << 20;
+    }
+    EXPECT_TRUE(found);
+    const std::string str = memory_to_str(snapshot);
+    EXPECT_TRUE(absl::StartsWith(str, "transposition_table "));
+    EXPECT_TRUE(absl::StrContains(str, "\nresident "));
+    EXPECT_TRUE(absl::StrContains(str, "\nthread_"));
+  }
+  for (size_t i = 0; i < num_memory_tags; ++i) {
+    EXPECT_EQ(counted_since(before, static_cast<MemoryTag>(i)), 0)
+        << memory_tag_name(static_cast<MemoryTag>(i));
+  }
+  EXPECT_GT(resident_bytes(), 0);
+}
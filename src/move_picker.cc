@@ -0,0 +1,246 @@
+#include "move_picker.h"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "attacks.h"
+#include "instrumentation.h"
+
+namespace {
+// Material values in pawns, indexed by Piece. Only used to order captures, so
+// the king's value only matters as an attacker, where it should come last.
+constexpr std::array<int, num_piece_types> piece_values = {1, 5, 3, 3, 9, 10};
+
+// The number of quiet moves picked by selection before the rest are sorted.
+constexpr size_t num_selected_quiets = 3;
+
+constexpr int piece_value(Piece piece) {
+  return piece_values[static_cast<size_t>(piece)];
+}
+
+bool is_promotion(MoveType move_type) {
+  return move_type == MoveType::promotion_to_rook ||
+         move_type == MoveType::promotion_to_bishop ||
+         move_type == MoveType::promotion_to_knight ||
+         move_type == MoveType::promotion_to_queen;
+}
+
+// Returns true if `move` is generated by `Board::append_pseudolegal_captures`
+// rather than by `Board::append_pseudolegal_quiet_moves` on `board`.
+bool is_capture_stage_move(const Board& board, Move move) {
+  return move.move_type_ == MoveType::capture ||
+         move.move_type_ == MoveType::en_passant ||
+         move.move_type_ == MoveType::promotion_to_queen ||
+         (is_promotion(move.move_type_) &&
+          (move.dst_square() & board.all_pieces()));
+}
+}  // namespace.
+
+MovePicker::MovePicker(const Board& board)
+    : MovePicker(board, absl::nullopt, {}, absl::nullopt, nullptr, {},
+                 false) {}
+
+MovePicker::MovePicker(
+    const Board& board, absl::optional<Move> tt_move,
+    const std::array<absl::optional<Move>, num_killers>& killers)
+    : MovePicker(board, tt_move, killers, absl::nullopt, nullptr, {}, false) {}
+
+MovePicker::MovePicker(
+    const Board& board, absl::optional<Move> tt_move,
+    const std::array<absl::optional<Move>, num_killers>& killers,
+    absl::optional<Move> countermove, const MoveHistory* history,
+    const ContinuationHistories& continuations)
+    : MovePicker(board, tt_move, killers, countermove, history, continuations,
+                 false) {}
+
+MovePicker::MovePicker(
+    const Board& board, absl::optional<Move> tt_move,
+    const std::array<absl::optional<Move>, num_killers>& killers,
+    absl::optional<Move> countermove, const MoveHistory* history,
+    const ContinuationHistories& continuations, bool captures_only)
+    : board_(board),
+      side_(board.is_whites_move_ ? Color::white : Color::black),
+      tt_move_(tt_move),
+      killers_(killers),
+      countermove_(countermove),
+      history_(history),
+      continuations_(continuations),
+      captures_only_(captures_only),
+      stage_(captures_only ? Stage::init_captures : Stage::tt_move),
+      num_moves_(0),
+      idx_(0) {}
+
+MovePicker MovePicker::for_quiescence(const Board& board,
+                                      const MoveHistory* history) {
+  return MovePicker(board, absl::nullopt, {}, absl::nullopt, history, {},
+                    true);
+}
+
+absl::optional<Move> MovePicker::next() {
+  while (true) {
+    switch (stage_) {
+      case Stage::tt_move:
+        stage_ = Stage::init_captures;
+        if (tt_move_ && board_.is_move_pseudolegal(*tt_move_)) {
+          return tt_move_;
+        }
+        break;
+      case Stage::init_captures: {
+        INSTRUMENT_COUNT(capture_generations);
+        INSTRUMENT_PHASE(move_generation);
+        board_.append_pseudolegal_captures(side_, &generated_);
+        score_captures();
+        idx_ = 0;
+        stage_ = Stage::good_captures;
+        break;
+      }
+      case Stage::good_captures:
+        while (idx_ < num_moves_) {
+          const Move move = pick_best();
+          if (is_tt_move(move)) {
+            continue;
+          }
+          if (is_bad_capture(move)) {
+            bad_captures_.push_back(move);
+            continue;
+          }
+          return move;
+        }
+        idx_ = 0;
+        stage_ = captures_only_ ? Stage::done : Stage::killers;
+        break;
+      case Stage::killers:
+        while (idx_ < num_killers) {
+          const absl::optional<Move> killer = killers_[idx_++];
+          // The second killer is skipped if it repeats the first.
+          const bool is_repeat = idx_ == 2 && killers_[0] == killer;
+          if (killer && !is_repeat && is_refutation_candidate(*killer)) {
+            return killer;
+          }
+        }
+        stage_ = Stage::countermove;
+        break;
+      case Stage::countermove:
+        stage_ = Stage::init_quiets;
+        if (countermove_ && !is_killer(*countermove_) &&
+            is_refutation_candidate(*countermove_)) {
+          return countermove_;
+        }
+        break;
+      case Stage::init_quiets: {
+        INSTRUMENT_COUNT(quiet_generations);
+        INSTRUMENT_PHASE(move_generation);
+        generated_.clear();
+        board_.append_pseudolegal_quiet_moves(side_, &generated_);
+        score_quiets();
+        idx_ = 0;
+        stage_ = Stage::quiets;
+        break;
+      }
+      case Stage::quiets:
+        while (idx_ < num_moves_) {
+          if (history_ && idx_ == num_selected_quiets) {
+            sort_rest();
+          }
+          const Move move = history_ && idx_ < num_selected_quiets
+                                ? pick_best()
+                                : moves_[idx_++].move_;
+          if (!is_tt_move(move) && !is_killer(move) && !is_countermove(move)) {
+            return move;
+          }
+        }
+        idx_ = 0;
+        stage_ = Stage::bad_captures;
+        break;
+      case Stage::bad_captures:
+        if (idx_ < bad_captures_.size()) {
+          return bad_captures_[idx_++];
+        }
+        stage_ = Stage::done;
+        break;
+      case Stage::done:
+        return absl::nullopt;
+    }
+  }
+}
+
+void MovePicker::score_captures() {
+  num_moves_ = generated_.size();
+  for (size_t i = 0; i < num_moves_; ++i) {
+    const Move move = generated_[i];
+    const Piece victim = board_.mailbox_[move.dst_idx_];
+    int gain = victim == Piece::none ? 0 : piece_value(victim);
+    if (move.move_type_ == MoveType::en_passant) {
+      gain = piece_value(Piece::pawn);
+    } else if (is_promotion(move.move_type_)) {
+      gain += piece_value(promotion_piece(move.move_type_)) -
+              piece_value(Piece::pawn);
+    }
+    // Any difference in gain outweighs any difference in attacker value, and
+    // that outweighs any difference in history.
+    int score = 16 * gain - piece_value(move.piece_moving_);
+    if (history_) {
+      score = score * (2 * MoveHistory::max_score + 1) +
+              history_->capture_score(board_, move);
+    }
+    moves_[i] = {move, score};
+  }
+}
+
+void MovePicker::score_quiets() {
+  num_moves_ = generated_.size();
+  for (size_t i = 0; i < num_moves_; ++i) {
+    const Move move = generated_[i];
+    int score = 0;
+    if (history_) {
+      score = history_->quiet_score(side_, move);
+      for (const PieceToHistory* continuation : continuations_) {
+        if (continuation) {
+          score += MoveHistory::continuation_score(*continuation, move);
+        }
+      }
+    }
+    moves_[i] = {move, score};
+  }
+}
+
+Move MovePicker::pick_best() {
+  size_t best = idx_;
+  for (size_t i = idx_ + 1; i < num_moves_; ++i) {
+    if (moves_[i].score_ > moves_[best].score_) {
+      best = i;
+    }
+  }
+  std::swap(moves_[idx_], moves_[best]);
+  return moves_[idx_++].move_;
+}
+
+void MovePicker::sort_rest() {
+  for (size_t i = idx_ + 1; i < num_moves_; ++i) {
+    const ScoredMove scored = moves_[i];
+    size_t j = i;
+    for (; j > idx_ && moves_[j - 1].score_ < scored.score_; --j) {
+      moves_[j] = moves_[j - 1];
+    }
+    moves_[j] = scored;
+  }
+}
+
+bool MovePicker::is_bad_capture(Move capture) const {
+  return !board_.see_ge(capture, 0);
+}
+
+bool MovePicker::is_refutation_candidate(Move move) const {
+  return !is_tt_move(move) && !is_capture_stage_move(board_, move) &&
+         board_.is_move_pseudolegal(move);
+}
+
+bool MovePicker::is_killer(Move move) const {
+  for (const absl::optional<Move>& killer : killers_) {
+    if (killer && *killer == move) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,124 @@
+#ifndef MOVE_PICKER_H
+#define MOVE_PICKER_H
+
+#include <array>
+#include <cstddef>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "history.h"
+
+// The number of killer moves, quiet moves that caused a cutoff at the same ply
+// elsewhere in the tree, a searcher keeps per ply.
+constexpr size_t num_killers = 2;
+
+// A generated move and the score the picker orders it by, side by side so
+// that picking the best move walks a single array.
+struct ScoredMove {
+  Move move_;
+  int score_;
+};
+
+// Hands out the pseudolegal moves of the side to move one at a time, in the
+// order an alpha-beta search wants to try them:
+//
+//   1. The hash table move, if it is pseudolegal here.
+//   2. Captures and queen promotions that don't lose material, most valuable
+//      victim first and least valuable attacker first among those (MVV-LVA).
+//      The capture history breaks ties.
+//   3. The killer moves, if they are quiet and pseudolegal here.
+//   4. The countermove of the previous move, on the same terms.
+//   5. The other quiet moves, underpromotions included, best history score
+//      first, or in generation order without a history. The score is the
+//      butterfly history plus the continuation histories given. The first
+//      few are selected one at a time; a node that gets past them rarely
+//      cuts off, so the rest are sorted at once.
+//   6. The captures put off in 2., in the same order.
+//
+// Each stage is generated only when the one before it runs out, so a search
+// that cuts off on an early move never generates the quiet moves. No move is
+// returned twice. The moves are pseudolegal, except that castling is checked,
+// so the caller still has to check that its own king isn't left in check.
+//
+// The picker keeps a reference to `board`, which must not change while moves
+// are being picked.
+class MovePicker {
+ public:
+  explicit MovePicker(const Board& board);
+  MovePicker(const Board& board, absl::optional<Move> tt_move,
+             const std::array<absl::optional<Move>, num_killers>& killers);
+  // `history` and the non-null `continuations`, if `history` is not null,
+  // must outlive the picker.
+  MovePicker(const Board& board, absl::optional<Move> tt_move,
+             const std::array<absl::optional<Move>, num_killers>& killers,
+             absl::optional<Move> countermove, const MoveHistory* history,
+             const ContinuationHistories& continuations = {});
+
+  // Returns a picker for quiescence search, which only hands out the captures
+  // of stage 2.
+  static MovePicker for_quiescence(const Board& board,
+                                   const MoveHistory* history = nullptr);
+
+  // Returns the next move, or nullopt once all moves have been returned.
+  absl::optional<Move> next();
+
+ private:
+  enum class Stage {
+    tt_move,
+    init_captures,
+    good_captures,
+    killers,
+    countermove,
+    init_quiets,
+    quiets,
+    bad_captures,
+    done
+  };
+
+  MovePicker(const Board& board, absl::optional<Move> tt_move,
+             const std::array<absl::optional<Move>, num_killers>& killers,
+             absl::optional<Move> countermove, const MoveHistory* history,
+             const ContinuationHistories& continuations, bool captures_only);
+
+  // Puts the captures in `generated_` into `moves_`, scored for MVV-LVA
+  // ordering.
+  void score_captures();
+  // Puts the quiet moves in `generated_` into `moves_`, scored by their
+  // history.
+  void score_quiets();
+  // Moves the highest scored of the moves from `idx_` on to `idx_` and
+  // returns it.
+  Move pick_best();
+  // Sorts the moves from `idx_` on, highest score first and in the order
+  // they were generated among equal scores.
+  void sort_rest();
+  // Returns true if `move` qualifies for the killer and countermove stages.
+  bool is_refutation_candidate(Move move) const;
+  // Returns true if `capture` loses material according to the static exchange
+  // evaluation.
+  bool is_bad_capture(Move capture) const;
+  bool is_tt_move(Move move) const { return tt_move_ && *tt_move_ == move; }
+  bool is_killer(Move move) const;
+  bool is_countermove(Move move) const {
+    return countermove_ && *countermove_ == move;
+  }
+
+  const Board& board_;
+  const Color side_;
+  const absl::optional<Move> tt_move_;
+  const std::array<absl::optional<Move>, num_killers> killers_;
+  const absl::optional<Move> countermove_;
+  const MoveHistory* const history_;
+  const ContinuationHistories continuations_;
+  const bool captures_only_;
+  Stage stage_;
+  // The moves of the current stage as generated, then with their scores,
+  // and the next one to look at.
+  MoveList generated_;
+  std::array<ScoredMove, max_moves> moves_;
+  size_t num_moves_;
+  size_t idx_;
+  MoveList bad_captures_;
+};
+
+#endif
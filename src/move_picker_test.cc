@@ -0,0 +1,235 @@
+#include "move_picker.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+const std::string kiwipete_fen =
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+std::vector<Move> all_picked_moves(MovePicker* picker) {
+  std::vector<Move> res;
+  while (absl::optional<Move> move = picker->next()) {
+    res.push_back(*move);
+  }
+  return res;
+}
+
+bool move_less(const Move& lhs, const Move& rhs) {
+  return lhs.to_uci_str() < rhs.to_uci_str();
+}
+
+std::vector<Move> sorted_pseudolegal_moves(const Board& board) {
+  MoveList moves =
+      board.pseudolegal_moves(board.is_whites_move_ ? Color::white
+                                                    : Color::black);
+  board.castling_moves(&moves);
+  std::vector<Move> res(moves.begin(), moves.end());
+  std::sort(res.begin(), res.end(), move_less);
+  return res;
+}
+}  // namespace.
+
+TEST(MovePicker, PicksEveryPseudolegalMoveOnce) {
+  for (const std::string& fen :
+       {kiwipete_fen, std::string("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"),
+        std::string("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w "
+                    "kq - 0 1"),
+        std::string("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 "
+                    "8")}) {
+    const Board board(fen);
+    MovePicker picker(board);
+    std::vector<Move> picked = all_picked_moves(&picker);
+    std::sort(picked.begin(), picked.end(), move_less);
+    EXPECT_EQ(picked, sorted_pseudolegal_moves(board)) << fen;
+    EXPECT_EQ(picker.next(), absl::nullopt);
+  }
+}
+
+TEST(MovePicker, TtMoveComesFirst) {
+  const Board board(kiwipete_fen);
+  const Move tt_move(str_to_square("a2"), str_to_square("a3"), Piece::pawn,
+                     MoveType::simple);
+  MovePicker picker(board, tt_move, {});
+  const std::vector<Move> picked = all_picked_moves(&picker);
+  ASSERT_FALSE(picked.empty());
+  EXPECT_EQ(picked[0], tt_move);
+  EXPECT_EQ(std::count(picked.begin(), picked.end(), tt_move), 1);
+  EXPECT_EQ(picked.size(), sorted_pseudolegal_moves(board).size());
+}
+
+TEST(MovePicker, IgnoresTtMoveThatIsNotPseudolegal) {
+  const Board board(kiwipete_fen);
+  // The pawn on a2 can't capture on b3, which is empty.
+  const Move tt_move(str_to_square("a2"), str_to_square("b3"), Piece::pawn,
+                     MoveType::capture);
+  MovePicker picker(board, tt_move, {});
+  const std::vector<Move> picked = all_picked_moves(&picker);
+  EXPECT_EQ(std::count(picked.begin(), picked.end(), tt_move), 0);
+  EXPECT_EQ(picked.size(), sorted_pseudolegal_moves(board).size());
+}
+
+TEST(MovePicker, CapturesMostValuableVictimFirst) {
+  // The pawn on e4 can take the queen on d5 and the knight on f5, and the
+  // rook on a5 can take the queen as well.
+  const Board board("4k3/8/8/R2qPn2/4P3/8/8/4K3 w - - 0 1");
+  MovePicker picker(board);
+  EXPECT_EQ(picker.next(), Move(str_to_square("e4"), str_to_square("d5"),
+                                Piece::pawn, MoveType::capture));
+  EXPECT_EQ(picker.next(), Move(str_to_square("a5"), str_to_square("d5"),
+                                Piece::rook, MoveType::capture));
+  EXPECT_EQ(picker.next(), Move(str_to_square("e4"), str_to_square("f5"),
+                                Piece::pawn, MoveType::capture));
+}
+
+TEST(MovePicker, KillersComeAfterCapturesAndBeforeQuiets) {
+  const Board board("4k3/8/8/3p4/4P3/8/8/R3K3 w - - 0 1");
+  const Move killer(str_to_square("a1"), str_to_square("a7"), Piece::rook,
+                    MoveType::simple);
+  // Not pseudolegal here, so it is skipped.
+  const Move stale_killer(str_to_square("b1"), str_to_square("b7"),
+                          Piece::rook, MoveType::simple);
+  MovePicker picker(board, absl::nullopt, {stale_killer, killer});
+  EXPECT_EQ(picker.next(), Move(str_to_square("e4"), str_to_square("d5"),
+                                Piece::pawn, MoveType::capture));
+  EXPECT_EQ(picker.next(), killer);
+  const std::vector<Move> rest = all_picked_moves(&picker);
+  EXPECT_EQ(std::count(rest.begin(), rest.end(), killer), 0);
+  EXPECT_EQ(rest.size() + 2, sorted_pseudolegal_moves(board).size());
+}
+
+TEST(MovePicker, BadCapturesComeLast) {
+  // Taking the pawn on d6 with the queen loses the queen to the pawn on c7.
+  const Board board("4k3/2p5/3p4/8/8/3Q4/8/4K3 w - - 0 1");
+  MovePicker picker(board);
+  const std::vector<Move> picked = all_picked_moves(&picker);
+  ASSERT_FALSE(picked.empty());
+  EXPECT_EQ(picked.back(), Move(str_to_square("d3"), str_to_square("d6"),
+                                Piece::queen, MoveType::capture));
+}
+
+TEST(MovePicker, QuiescencePicksOnlyGoodCaptures) {
+  // Taking the pawn on d6 loses the queen for two pawns, even with the rook
+  // behind her.
+  const Board board("4k3/2p5/3p4/8/8/3Q4/8/3RK3 w - - 0 1");
+  MovePicker picker = MovePicker::for_quiescence(board);
+  EXPECT_EQ(all_picked_moves(&picker), std::vector<Move>());
+  const Board kiwipete(kiwipete_fen);
+  MovePicker kiwipete_picker = MovePicker::for_quiescence(kiwipete);
+  const std::vector<Move> picked = all_picked_moves(&kiwipete_picker);
+  ASSERT_FALSE(picked.empty());
+  for (Move move : picked) {
+    EXPECT_TRUE(move.move_type_ == MoveType::capture ||
+                move.move_type_ == MoveType::en_passant ||
+                move.move_type_ == MoveType::promotion_to_queen)
+        << move.to_uci_str();
+    EXPECT_TRUE(kiwipete.see_ge(move, 0)) << move.to_uci_str();
+  }
+}
+
+TEST(MovePicker, CountermoveComesAfterKillers) {
+  const Board board("4k3/8/8/3p4/4P3/8/8/R3K3 w - - 0 1");
+  const Move killer(str_to_square("a1"), str_to_square("a7"), Piece::rook,
+                    MoveType::simple);
+  const Move countermove(str_to_square("e1"), str_to_square("f2"),
+                         Piece::king, MoveType::simple);
+  MoveHistory history;
+  MovePicker picker(board, absl::nullopt, {killer, absl::nullopt},
+                    countermove, &history);
+  EXPECT_EQ(picker.next(), Move(str_to_square("e4"), str_to_square("d5"),
+                                Piece::pawn, MoveType::capture));
+  EXPECT_EQ(picker.next(), killer);
+  EXPECT_EQ(picker.next(), countermove);
+  const std::vector<Move> rest = all_picked_moves(&picker);
+  EXPECT_EQ(std::count(rest.begin(), rest.end(), countermove), 0);
+  EXPECT_EQ(rest.size() + 3, sorted_pseudolegal_moves(board).size());
+}
+
+TEST(MovePicker, QuietsBestHistoryFirst) {
+  const Board board(kiwipete_fen);
+  const Move good(str_to_square("a2"), str_to_square("a3"), Piece::pawn,
+                  MoveType::simple);
+  const Move bad(str_to_square("e1"), str_to_square("d1"), Piece::king,
+                 MoveType::simple);
+  const Move second(str_to_square("b2"), str_to_square("b3"), Piece::pawn,
+                    MoveType::simple);
+  MoveHistory history;
+  history.update_quiet(Color::white, good, 500);
+  history.update_quiet(Color::white, second, 200);
+  history.update_quiet(Color::white, bad, -500);
+  MovePicker picker(board, absl::nullopt, {}, absl::nullopt, &history);
+  std::vector<Move> picked = all_picked_moves(&picker);
+  const auto first_quiet = std::find(picked.begin(), picked.end(), good);
+  ASSERT_NE(first_quiet, picked.end());
+  for (auto it = picked.begin(); it != first_quiet; ++it) {
+    EXPECT_TRUE(it->move_type_ == MoveType::capture) << it->to_uci_str();
+  }
+  EXPECT_EQ(*(first_quiet + 1), second);
+  const auto last_quiet = std::find(picked.begin(), picked.end(), bad);
+  ASSERT_NE(last_quiet, picked.end());
+  // Only the bad captures come after the worst quiet move.
+  for (auto it = last_quiet + 1; it != picked.end(); ++it) {
+    EXPECT_TRUE(it->move_type_ == MoveType::capture) << it->to_uci_str();
+  }
+  std::sort(picked.begin(), picked.end(), move_less);
+  EXPECT_EQ(picked, sorted_pseudolegal_moves(board));
+}
+
+TEST(MovePicker, ContinuationHistoriesAddToTheQuietScore) {
+  const Board board(kiwipete_fen);
+  const Move previous(str_to_square("a6"), str_to_square("b7"), Piece::bishop,
+                      MoveType::simple);
+  const Move butterfly_best(str_to_square("a2"), str_to_square("a3"),
+                            Piece::pawn, MoveType::simple);
+  const Move continuation_best(str_to_square("b2"), str_to_square("b3"),
+                               Piece::pawn, MoveType::simple);
+  MoveHistory history;
+  history.update_quiet(Color::white, butterfly_best, 300);
+  history.update_quiet(Color::white, continuation_best, 200);
+  PieceToHistory* continuation = history.continuation(Color::black, previous);
+  MoveHistory::update_continuation(continuation, continuation_best, 200);
+  const auto first_quiet = [](MovePicker* picker) {
+    for (Move move : all_picked_moves(picker)) {
+      if (move.move_type_ != MoveType::capture) {
+        return move;
+      }
+    }
+    return Move();
+  };
+  MovePicker without(board, absl::nullopt, {}, absl::nullopt, &history);
+  EXPECT_EQ(first_quiet(&without), butterfly_best);
+  MovePicker with(board, absl::nullopt, {}, absl::nullopt, &history,
+                  {continuation, nullptr, nullptr});
+  EXPECT_EQ(first_quiet(&with), continuation_best);
+}
+
+TEST(MovePicker, QuietsInHistoryOrderPastTheFirstFew) {
+  const Board board(kiwipete_fen);
+  MoveHistory history;
+  MoveList quiets;
+  board.append_pseudolegal_quiet_moves(Color::white, &quiets);
+  ASSERT_GT(quiets.size(), 20);
+  // Scores in no particular order, with ties.
+  for (size_t i = 0; i < quiets.size(); ++i) {
+    history.update_quiet(Color::white, quiets[i],
+                         static_cast<int>((i * 7) % 11) * 40 - 200);
+  }
+  MovePicker picker(board, absl::nullopt, {}, absl::nullopt, &history);
+  std::vector<Move> picked_quiets;
+  for (Move move : all_picked_moves(&picker)) {
+    if (std::find(quiets.begin(), quiets.end(), move) != quiets.end()) {
+      picked_quiets.push_back(move);
+    }
+  }
+  ASSERT_EQ(picked_quiets.size(), quiets.size());
+  for (size_t i = 1; i < picked_quiets.size(); ++i) {
+    EXPECT_GE(history.quiet_score(Color::white, picked_quiets[i - 1]),
+              history.quiet_score(Color::white, picked_quiets[i]))
+        << i;
+  }
+}
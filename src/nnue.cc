@@ -0,0 +1,409 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "board.h"
+#include "mapped_file.h"
+#include "memory_accounting.h"
+#include "nnue_kernels.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "Network files are read by copying their bytes.");
+
+namespace {
+constexpr uint32_t network_magic = 0x45554E4E;  // "NNUE"
+constexpr uint32_t network_version = 1;
+constexpr uint32_t mapped_network_version = 2;
+constexpr uint32_t network_architecture =
+    static_cast<uint32_t>(nnue_num_features ^ (nnue_l1_size << 16) ^
+                          (nnue_l2_size << 24) ^ (nnue_l3_size << 8));
+constexpr size_t header_size = 3 * sizeof(uint32_t);
+// Mapped files add the size of NnueNetwork to the header, and pad it so that
+// the network is as aligned as in memory: the file is mapped at the start of
+// a page.
+constexpr size_t mapped_header_size = 64;
+static_assert(alignof(NnueNetwork) <= mapped_header_size,
+              "The network after the header must be aligned.");
+
+// The members of NnueNetwork in file order, as (offset, size) pairs.
+struct Member {
+  size_t offset_;
+  size_t size_;
+};
+
+#define NETWORK_MEMBER(name) \
+  Member { offsetof(NnueNetwork, name), sizeof(NnueNetwork::name) }
+const std::array<Member, 8> network_members = {
+    {NETWORK_MEMBER(feature_biases_), NETWORK_MEMBER(feature_weights_),
+     NETWORK_MEMBER(l1_biases_), NETWORK_MEMBER(l1_weights_),
+     NETWORK_MEMBER(l2_biases_), NETWORK_MEMBER(l2_weights_),
+     NETWORK_MEMBER(output_bias_), NETWORK_MEMBER(output_weights_)}};
+#undef NETWORK_MEMBER
+
+size_t network_file_size() {
+  size_t res = header_size;
+  for (const Member& member : network_members) {
+    res += member.size_;
+  }
+  return res;
+}
+
+// The index in `l1_weights_` of the weight of input `i` for output `j`.
+constexpr size_t l1_weight_idx(size_t i, size_t j) {
+  return sparse_weight_idx(i, j, nnue_l2_size);
+}
+
+const int16_t* feature_column(const NnueNetwork& network, size_t feature) {
+  return network.feature_weights_.data() + feature * nnue_l1_size;
+}
+
+// Returns true if the move that changed `dirty` moved the king of
+// `perspective`.
+bool moves_king(const DirtyPieces& dirty, Color perspective) {
+  for (size_t i = 0; i < dirty.size_; ++i) {
+    if (dirty.pieces_[i].piece_ == Piece::king &&
+        dirty.pieces_[i].color_ == perspective) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Clips the outputs of a dense layer back to the [0, 127] of the inputs.
+template <size_t size>
+void scale_and_clip(const std::array<int32_t, size>& in,
+                    std::array<uint8_t, size>* out) {
+  for (size_t i = 0; i < size; ++i) {
+    (*out)[i] = static_cast<uint8_t>(
+        std::min(std::max(in[i] >> nnue_weight_shift, 0), 127));
+  }
+}
+}  // namespace.
+
+size_t nnue_feature(Color perspective, int king_idx, Color color, Piece piece,
+                    int sq_idx) {
+  // Black sees the board upside down, with its own pieces first.
+  const int flip = perspective == Color::white ? 0 : 56;
+  const size_t piece_idx =
+      (color == perspective ? 0 : 5) + static_cast<size_t>(piece);
+  return (static_cast<size_t>(king_idx ^ flip) * 10 + piece_idx) * 64 +
+         static_cast<size_t>(sq_idx ^ flip);
+}
+
+void refresh_accumulator(const NnueNetwork& network, const Board& board,
+                         Color perspective, NnueAccumulator* accumulator) {
+  const int king_idx = square_idx(board.pieces(perspective, Piece::king));
+  // 30 pieces besides the kings at most.
+  std::array<const int16_t*, 32> added;
+  size_t num_added = 0;
+  for (Color color : {Color::white, Color::black}) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      if (static_cast<Piece>(piece) == Piece::king) {
+        continue;
+      }
+      for (Bitboard sq :
+           bitboard_split(board.pieces(color, static_cast<Piece>(piece)))) {
+        added[num_added++] = feature_column(
+            network, nnue_feature(perspective, king_idx, color,
+                                  static_cast<Piece>(piece), square_idx(sq)));
+      }
+    }
+  }
+  nnue_kernels().update_accumulator(
+      network.feature_biases_.data(),
+      accumulator->values_[static_cast<size_t>(perspective)].data(),
+      nnue_l1_size, added.data(), num_added, nullptr, 0);
+}
+
+void update_accumulator(const NnueNetwork& network, Color perspective,
+                        int king_idx, const DirtyPieces& dirty,
+                        const NnueAccumulator& previous,
+                        NnueAccumulator* accumulator) {
+  std::array<const int16_t*, 3> added;
+  std::array<const int16_t*, 3> removed;
+  size_t num_added = 0;
+  size_t num_removed = 0;
+  for (size_t i = 0; i < dirty.size_; ++i) {
+    const DirtyPiece& piece = dirty.pieces_[i];
+    if (piece.piece_ == Piece::king) {
+      continue;
+    }
+    if (piece.from_idx_ >= 0) {
+      removed[num_removed++] = feature_column(
+          network, nnue_feature(perspective, king_idx, piece.color_,
+                                piece.piece_, piece.from_idx_));
+    }
+    if (piece.to_idx_ >= 0) {
+      added[num_added++] = feature_column(
+          network, nnue_feature(perspective, king_idx, piece.color_,
+                                piece.piece_, piece.to_idx_));
+    }
+  }
+  const size_t side = static_cast<size_t>(perspective);
+  nnue_kernels().update_accumulator(
+      previous.values_[side].data(), accumulator->values_[side].data(),
+      nnue_l1_size, added.data(), num_added, removed.data(), num_removed);
+}
+
+void update_accumulator(const NnueNetwork& network, const Board& board,
+                        const DirtyPieces& dirty,
+                        const NnueAccumulator& previous,
+                        NnueAccumulator* accumulator) {
+  for (Color perspective : {Color::white, Color::black}) {
+    if (moves_king(dirty, perspective)) {
+      refresh_accumulator(network, board, perspective, accumulator);
+    } else {
+      update_accumulator(network, perspective,
+                         square_idx(board.pieces(perspective, Piece::king)),
+                         dirty, previous, accumulator);
+    }
+  }
+}
+
+int nnue_output(const NnueNetwork& network, const NnueAccumulator& accumulator,
+                Color side_to_move) {
+  const NnueKernels& kernels = nnue_kernels();
+  alignas(64) std::array<uint8_t, 2 * nnue_l1_size> input;
+  kernels.clipped_relu(
+      accumulator.values_[static_cast<size_t>(side_to_move)].data(),
+      input.data(), nnue_l1_size);
+  kernels.clipped_relu(
+      accumulator.values_[static_cast<size_t>(flip_color(side_to_move))]
+          .data(),
+      input.data() + nnue_l1_size, nnue_l1_size);
+  alignas(64) std::array<int32_t, nnue_l2_size> l1_out;
+  kernels.sparse_affine(input.data(), input.size(),
+                        network.l1_weights_.data(), network.l1_biases_.data(),
+                        l1_out.data(), l1_out.size());
+  alignas(64) std::array<uint8_t, nnue_l2_size> l2_in;
+  scale_and_clip(l1_out, &l2_in);
+  alignas(64) std::array<int32_t, nnue_l3_size> l2_out;
+  kernels.affine(l2_in.data(), l2_in.size(), network.l2_weights_.data(),
+                 network.l2_biases_.data(), l2_out.data(), l2_out.size());
+  alignas(64) std::array<uint8_t, nnue_l3_size> output_in;
+  scale_and_clip(l2_out, &output_in);
+  int32_t output;
+  kernels.affine(output_in.data(), output_in.size(),
+                 network.output_weights_.data(), network.output_bias_.data(),
+                 &output, 1);
+  return output / nnue_output_scale;
+}
+
+void AccumulatorCache::reset(const NnueNetwork& network) {
+  entries_.resize(num_colors);
+  for (std::array<Entry, 64>& entries : entries_) {
+    for (Entry& entry : entries) {
+      entry.values_ = network.feature_biases_;
+      entry.pieces_ = {};
+    }
+  }
+}
+
+void AccumulatorCache::refresh(const NnueNetwork& network, const Board& board,
+                               Color perspective,
+                               NnueAccumulator* accumulator) {
+  const int king_idx = square_idx(board.pieces(perspective, Piece::king));
+  Entry& entry =
+      entries_[static_cast<size_t>(perspective)][static_cast<size_t>(king_idx)];
+  // Every piece but the kings may have changed, 30 on and 30 off at most.
+  std::array<const int16_t*, 32> added;
+  std::array<const int16_t*, 32> removed;
+  size_t num_added = 0;
+  size_t num_removed = 0;
+  for (Color color : {Color::white, Color::black}) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      if (static_cast<Piece>(piece) == Piece::king) {
+        continue;
+      }
+      const Bitboard now = board.pieces(color, static_cast<Piece>(piece));
+      Bitboard& cached = entry.pieces_[static_cast<size_t>(color)][piece];
+      for (Bitboard sq : bitboard_split(now & ~cached)) {
+        added[num_added++] = feature_column(
+            network, nnue_feature(perspective, king_idx, color,
+                                  static_cast<Piece>(piece), square_idx(sq)));
+      }
+      for (Bitboard sq : bitboard_split(cached & ~now)) {
+        removed[num_removed++] = feature_column(
+            network, nnue_feature(perspective, king_idx, color,
+                                  static_cast<Piece>(piece), square_idx(sq)));
+      }
+      cached = now;
+    }
+  }
+  nnue_kernels().update_accumulator(entry.values_.data(), entry.values_.data(),
+                                    nnue_l1_size, added.data(), num_added,
+                                    removed.data(), num_removed);
+  accumulator->values_[static_cast<size_t>(perspective)] = entry.values_;
+}
+
+void AccumulatorStack::reset(const NnueNetwork& network, const Board& board) {
+  entries_.resize(capacity_);
+  if (network_ != &network) {
+    network_ = &network;
+    cache_.reset(network);
+  }
+  size_ = 1;
+  for (Color perspective : {Color::white, Color::black}) {
+    cache_.refresh(network, board, perspective, &entries_[0].accumulator_);
+  }
+  entries_[0].computed_ = {{true, true}};
+}
+
+void AccumulatorStack::push(const DirtyPieces& dirty) {
+  Entry& entry = entries_[size_++];
+  entry.dirty_ = dirty;
+  entry.computed_ = {{false, false}};
+}
+
+const NnueAccumulator& AccumulatorStack::top(const Board& board) {
+  for (Color perspective : {Color::white, Color::black}) {
+    if (!entries_[size_ - 1].computed_[static_cast<size_t>(perspective)]) {
+      update(board, perspective);
+    }
+  }
+  return entries_[size_ - 1].accumulator_;
+}
+
+void AccumulatorStack::update(const Board& board, Color perspective) {
+  const size_t side = static_cast<size_t>(perspective);
+  // Find the last computed accumulator. The root's always is.
+  size_t last = size_ - 1;
+  bool king_moved = false;
+  while (!entries_[last].computed_[side]) {
+    king_moved |= moves_king(entries_[last].dirty_, perspective);
+    --last;
+  }
+  Entry& top = entries_[size_ - 1];
+  if (king_moved) {
+    cache_.refresh(*network_, board, perspective, &top.accumulator_);
+    top.computed_[side] = true;
+    return;
+  }
+  // The king hasn't moved, so it stands where it stands now all along.
+  const int king_idx = square_idx(board.pieces(perspective, Piece::king));
+  for (size_t i = last + 1; i < size_; ++i) {
+    update_accumulator(*network_, perspective, king_idx, entries_[i].dirty_,
+                       entries_[i - 1].accumulator_,
+                       &entries_[i].accumulator_);
+    entries_[i].computed_[side] = true;
+  }
+}
+
+void NetworkDeleter::operator()(const NnueNetwork* network) const {
+  if (file_) {
+    delete file_;
+  } else {
+    delete network;
+    add_memory(MemoryTag::network, -static_cast<int64_t>(sizeof(NnueNetwork)));
+  }
+}
+
+NetworkPtr load_network(const std::string& path, std::string* error) {
+  std::unique_ptr<MappedFile> file(
+      new MappedFile(path, MemoryTag::network));
+  if (!file->data()) {
+    *error = absl::StrCat("can't read ", path);
+    return nullptr;
+  }
+  std::array<uint32_t, 4> header;
+  if (file->size() < header_size) {
+    *error = absl::StrCat(path, " is not a network file");
+    return nullptr;
+  }
+  std::memcpy(header.data(), file->data(), header_size);
+  if (header[0] != network_magic) {
+    *error = absl::StrCat(path, " is not a network file");
+    return nullptr;
+  }
+  if (header[1] == mapped_network_version &&
+      header[2] == network_architecture &&
+      file->size() == mapped_header_size + sizeof(NnueNetwork)) {
+    std::memcpy(header.data(), file->data(), sizeof(header));
+    if (header[3] == sizeof(NnueNetwork)) {
+      const NnueNetwork* network = reinterpret_cast<const NnueNetwork*>(
+          file->data() + mapped_header_size);
+      return NetworkPtr(network, NetworkDeleter{file.release()});
+    }
+  }
+  if (header[1] != network_version || header[2] != network_architecture ||
+      file->size() != network_file_size()) {
+    *error = absl::StrCat(path, " has a different network architecture");
+    return nullptr;
+  }
+  std::unique_ptr<NnueNetwork> res(new NnueNetwork);
+  add_memory(MemoryTag::network, static_cast<int64_t>(sizeof(NnueNetwork)));
+  const char* data = file->data() + header_size;
+  for (const Member& member : network_members) {
+    std::memcpy(reinterpret_cast<char*>(res.get()) + member.offset_, data,
+                member.size_);
+    data += member.size_;
+  }
+  const std::array<int8_t, nnue_l2_size * 2 * nnue_l1_size> rows =
+      res->l1_weights_;
+  for (size_t j = 0; j < nnue_l2_size; ++j) {
+    for (size_t i = 0; i < 2 * nnue_l1_size; ++i) {
+      res->l1_weights_[l1_weight_idx(i, j)] = rows[j * 2 * nnue_l1_size + i];
+    }
+  }
+  return NetworkPtr(res.release());
+}
+
+NetworkPtr copy_network(const NnueNetwork& network) {
+  NetworkPtr res(new NnueNetwork(network));
+  add_memory(MemoryTag::network, static_cast<int64_t>(sizeof(NnueNetwork)));
+  return res;
+}
+
+bool save_network(const NnueNetwork& network, const std::string& path) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  const std::array<uint32_t, 3> header = {
+      {network_magic, network_version, network_architecture}};
+  out.write(reinterpret_cast<const char*>(header.data()), header_size);
+  std::array<int8_t, nnue_l2_size * 2 * nnue_l1_size> rows;
+  for (size_t j = 0; j < nnue_l2_size; ++j) {
+    for (size_t i = 0; i < 2 * nnue_l1_size; ++i) {
+      rows[j * 2 * nnue_l1_size + i] = network.l1_weights_[l1_weight_idx(i, j)];
+    }
+  }
+  for (const Member& member : network_members) {
+    const char* data =
+        member.offset_ == offsetof(NnueNetwork, l1_weights_)
+            ? reinterpret_cast<const char*>(rows.data())
+            : reinterpret_cast<const char*>(&network) + member.offset_;
+    out.write(data, static_cast<std::streamsize>(member.size_));
+  }
+  out.close();
+  return static_cast<bool>(out);
+}
+
+bool save_mapped_network(const NnueNetwork& network, const std::string& path) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  std::array<uint32_t, mapped_header_size / sizeof(uint32_t)> header = {
+      {network_magic, mapped_network_version, network_architecture,
+       static_cast<uint32_t>(sizeof(NnueNetwork))}};
+  out.write(reinterpret_cast<const char*>(header.data()), mapped_header_size);
+  // The members at their offsets, with zeros rather than whatever the
+  // padding between them holds.
+  const std::vector<char> zeros(mapped_header_size);
+  size_t offset = 0;
+  for (const Member& member : network_members) {
+    out.write(zeros.data(), static_cast<std::streamsize>(member.offset_ -
+                                                         offset));
+    out.write(reinterpret_cast<const char*>(&network) + member.offset_,
+              static_cast<std::streamsize>(member.size_));
+    offset = member.offset_ + member.size_;
+  }
+  out.write(zeros.data(),
+            static_cast<std::streamsize>(sizeof(NnueNetwork) - offset));
+  out.close();
+  return static_cast<bool>(out);
+}
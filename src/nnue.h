@@ -0,0 +1,207 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "memory_accounting.h"
+
+class MappedFile;
+
+// An efficiently updatable neural network evaluation (NNUE), with the
+// architecture of the first Stockfish networks, HalfKP 2x256-32-32-1:
+//
+//  - Each side has its own view of the position, its perspective, whose input
+//    features are (own king square, piece, square) for every piece but the
+//    kings, with black's squares mirrored so that both sides see themselves
+//    play up the board. That makes 64 * 10 * 64 features, of which at most 30
+//    are set.
+//  - The first layer adds up the 16-bit weight columns of the set features of
+//    each perspective into 256 values, the accumulator. A move sets and clears
+//    at most three features, so the accumulator of a position is that of the
+//    position before plus and minus a few columns. Only a king move changes
+//    every feature of its side, whose half then comes from a cache.
+//  - The two halves, side to move first, are clipped to [0, 127] into 512
+//    bytes, which go through two 8-bit dense layers of 32 with the same
+//    clipping, and a last one down to the score.
+//
+// The inner loops are in nnue_kernels.h. Networks are read from files in the
+// format of `save_network`, or of `save_mapped_network`, which is used in
+// place.
+
+constexpr size_t nnue_num_features = 64 * 10 * 64;
+constexpr size_t nnue_l1_size = 256;
+constexpr size_t nnue_l2_size = 32;
+constexpr size_t nnue_l3_size = 32;
+// The dense layers' weights are fixed point with this many fraction bits.
+constexpr int nnue_weight_shift = 6;
+// The output divided by this is the score in centipawns.
+constexpr int nnue_output_scale = 16;
+
+// The weights and biases of a network, about 20 MB, almost all of it the
+// first layer. The dense layers' weights are stored row by row: the weights of
+// the first output, then of the second, and so on. The first dense layer's are
+// the exception, in memory, where they are in the order of `sparse_affine`
+// (see nnue_kernels.h), which skips the inputs that are 0, most of them. The
+// files have them row by row like the others.
+struct NnueNetwork {
+  alignas(64) std::array<int16_t, nnue_l1_size> feature_biases_;
+  alignas(64) std::array<int16_t, nnue_num_features * nnue_l1_size>
+      feature_weights_;
+  alignas(64) std::array<int32_t, nnue_l2_size> l1_biases_;
+  alignas(64) std::array<int8_t, nnue_l2_size * 2 * nnue_l1_size> l1_weights_;
+  alignas(64) std::array<int32_t, nnue_l3_size> l2_biases_;
+  alignas(64) std::array<int8_t, nnue_l3_size * nnue_l2_size> l2_weights_;
+  alignas(64) std::array<int32_t, 1> output_bias_;
+  alignas(64) std::array<int8_t, nnue_l3_size> output_weights_;
+};
+
+// The first layer's output for both perspectives, indexed by Color.
+struct NnueAccumulator {
+  alignas(64) std::array<std::array<int16_t, nnue_l1_size>, num_colors>
+      values_;
+};
+
+// Returns the index of the feature of `piece` of `color` on the square with
+// index `sq_idx`, as seen from `perspective` with its king on `king_idx`.
+// `piece` must not be the king.
+size_t nnue_feature(Color perspective, int king_idx, Color color, Piece piece,
+                    int sq_idx);
+
+// Computes the half of `perspective` of the accumulator of `board` from
+// scratch.
+void refresh_accumulator(const NnueNetwork& network, const Board& board,
+                         Color perspective, NnueAccumulator* accumulator);
+// Computes the half of `perspective`, whose king is on `king_idx`, of the
+// accumulator of a position from `previous`, that of the position before the
+// move that changed `dirty`. That move must not be a move of the king of
+// `perspective`.
+void update_accumulator(const NnueNetwork& network, Color perspective,
+                        int king_idx, const DirtyPieces& dirty,
+                        const NnueAccumulator& previous,
+                        NnueAccumulator* accumulator);
+// Computes the accumulator of `board` from `previous`, that of the position
+// before the move that changed `dirty`.
+void update_accumulator(const NnueNetwork& network, const Board& board,
+                        const DirtyPieces& dirty,
+                        const NnueAccumulator& previous,
+                        NnueAccumulator* accumulator);
+
+// Returns the output of the network in centipawns for `side_to_move`, given
+// the accumulator of the position.
+int nnue_output(const NnueNetwork& network, const NnueAccumulator& accumulator,
+                Color side_to_move);
+
+// The accumulator halves last computed for each king square of each
+// perspective, with the pieces they were computed for ("Finny tables"). After
+// a king move, the half of its side is the cached one of the new king square
+// plus and minus the pieces that changed since, which after a few king moves
+// back and forth is a handful rather than every piece on the board.
+class AccumulatorCache {
+ public:
+  // Empties the cache for `network`: every entry is the biases, with no
+  // pieces.
+  void reset(const NnueNetwork& network);
+  // Sets the half of `perspective` of `accumulator` to that of `board`, from
+  // the entry of its king square, which is brought up to date first.
+  void refresh(const NnueNetwork& network, const Board& board,
+               Color perspective, NnueAccumulator* accumulator);
+
+ private:
+  struct Entry {
+    alignas(64) std::array<int16_t, nnue_l1_size> values_;
+    std::array<std::array<Bitboard, num_piece_types>, num_colors> pieces_;
+  };
+  // Indexed by perspective, then by king square. Allocated by the first
+  // `reset`.
+  TaggedVector<std::array<Entry, 64>, MemoryTag::accumulators> entries_;
+};
+
+// The accumulators along the line of play of a search, one per ply from the
+// root, so that taking a move back costs nothing. Pushing a move only records
+// the pieces it changed; the accumulators are brought up to date when `top`
+// asks for one, from the last ply whose accumulator was computed. Nodes that
+// are never evaluated, because the table or a pruning cut them off, never pay
+// for theirs. A perspective whose king moved since is taken from the cache
+// instead.
+class AccumulatorStack {
+ public:
+  // `capacity` is the number of positions on the longest line: the root and
+  // one per move.
+  explicit AccumulatorStack(size_t capacity)
+      : capacity_(capacity), network_(nullptr), size_(0) {}
+
+  // Starts the stack at `board`, with the accumulator of `network`.
+  void reset(const NnueNetwork& network, const Board& board);
+  // Adds the position after the move that changed `dirty` on the one at the
+  // top.
+  void push(const DirtyPieces& dirty);
+  // Adds the position after a null move, which changes no piece.
+  void push_null() { push(DirtyPieces{0, {}}); }
+  void pop() { --size_; }
+  // Returns the accumulator of `board`, the position at the top.
+  const NnueAccumulator& top(const Board& board);
+  const NnueNetwork& network() const { return *network_; }
+
+ private:
+  struct Entry {
+    NnueAccumulator accumulator_;
+    // The pieces the move to this position changed.
+    DirtyPieces dirty_;
+    // Whether each half of the accumulator is up to date, indexed by Color.
+    std::array<bool, num_colors> computed_;
+  };
+
+  // Brings the half of `perspective` of the top up to date.
+  void update(const Board& board, Color perspective);
+
+  size_t capacity_;
+  const NnueNetwork* network_;
+  // Allocated by the first `reset`, so that a stack that is never used costs
+  // nothing.
+  TaggedVector<Entry, MemoryTag::accumulators> entries_;
+  size_t size_;
+  AccumulatorCache cache_;
+};
+
+// Frees a network from `load_network`: deletes it from the heap, or unmaps
+// the file it is in.
+struct NetworkDeleter {
+  // Null for a network on the heap.
+  MappedFile* file_ = nullptr;
+
+  void operator()(const NnueNetwork* network) const;
+};
+using NetworkPtr = std::unique_ptr<const NnueNetwork, NetworkDeleter>;
+
+// Reads a network file written by `save_network` or `save_mapped_network`.
+// The file is mapped into memory rather than read through a buffer. A network
+// in the format of `save_network` is copied onto the heap, reordering the
+// first dense layer's weights. One in the mapped format is used where it is,
+// mapped read-only, so that it costs nothing to load and every process that
+// loads it shares the same pages of the page cache. Returns null, and says
+// why in `*error`, if the file can't be read or isn't a network of this
+// architecture.
+NetworkPtr load_network(const std::string& path, std::string* error);
+// Copies `network` onto the heap. The pages of the copy are allocated where
+// the calling thread touches them first, which `run_on_numa_node` (see
+// numa.h) makes the node of the threads that will read them.
+NetworkPtr copy_network(const NnueNetwork& network);
+// Writes `network` to `path`: a 12-byte header of the magic "NNUE", the
+// format version and the sizes of the layers mixed into one word, each 32
+// bits, followed by the members of NnueNetwork in order, packed and little
+// endian. Returns false if the file can't be written.
+bool save_network(const NnueNetwork& network, const std::string& path);
+// Writes `network` to `path` as it is in memory, aligned and in the order of
+// the kernels, after a 64-byte header of the magic, the version, the sizes of
+// the layers and the size of NnueNetwork, each 32 bits, and zeros. Only
+// builds that lay NnueNetwork out the same read it, which the size stands in
+// for. Returns false if the file can't be written.
+bool save_mapped_network(const NnueNetwork& network, const std::string& path);
+
+#endif
@@ -0,0 +1,586 @@
+#include "nnue_kernels.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PAWN_GRABBER_X86_KERNELS 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define PAWN_GRABBER_NEON_KERNELS 1
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define PAWN_GRABBER_WASM_KERNELS 1
+#endif
+
+namespace {
+void update_accumulator_scalar(const int16_t* src, int16_t* dst, size_t size,
+                               const int16_t* const* added, size_t num_added,
+                               const int16_t* const* removed,
+                               size_t num_removed) {
+  for (size_t i = 0; i < size; ++i) {
+    int16_t value = src[i];
+    for (size_t j = 0; j < num_added; ++j) {
+      value = static_cast<int16_t>(value + added[j][i]);
+    }
+    for (size_t j = 0; j < num_removed; ++j) {
+      value = static_cast<int16_t>(value - removed[j][i]);
+    }
+    dst[i] = value;
+  }
+}
+
+void clipped_relu_scalar(const int16_t* in, uint8_t* out, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = static_cast<uint8_t>(std::min<int16_t>(
+        std::max<int16_t>(in[i], 0), 127));
+  }
+}
+
+void affine_scalar(const uint8_t* in, size_t num_inputs, const int8_t* weights,
+                   const int32_t* biases, int32_t* out, size_t num_outputs) {
+  for (size_t j = 0; j < num_outputs; ++j) {
+    const int8_t* row = weights + j * num_inputs;
+    int32_t sum = biases[j];
+    for (size_t i = 0; i < num_inputs; ++i) {
+      sum += in[i] * row[i];
+    }
+    out[j] = sum;
+  }
+}
+
+void sparse_affine_scalar(const uint8_t* in, size_t num_inputs,
+                          const int8_t* weights, const int32_t* biases,
+                          int32_t* out, size_t num_outputs) {
+  std::copy(biases, biases + num_outputs, out);
+  for (size_t i = 0; i < num_inputs; i += 4) {
+    uint32_t group;
+    std::memcpy(&group, in + i, sizeof(group));
+    if (!group) {
+      continue;
+    }
+    const int8_t* w = weights + i * num_outputs;
+    for (size_t j = 0; j < num_outputs; ++j) {
+      for (size_t k = 0; k < 4; ++k) {
+        out[j] += in[i + k] * w[j * 4 + k];
+      }
+    }
+  }
+}
+
+constexpr NnueKernels scalar_kernels = {
+    SimdLevel::scalar, &update_accumulator_scalar, &clipped_relu_scalar,
+    &affine_scalar, &sparse_affine_scalar};
+
+#if defined(PAWN_GRABBER_X86_KERNELS) || \
+    defined(PAWN_GRABBER_NEON_KERNELS) || defined(PAWN_GRABBER_WASM_KERNELS)
+constexpr std::array<std::array<uint16_t, 8>, 256> make_set_bit_indices() {
+  std::array<std::array<uint16_t, 8>, 256> res = {};
+  for (size_t mask = 0; mask < res.size(); ++mask) {
+    size_t num_set = 0;
+    for (uint16_t bit = 0; bit < 8; ++bit) {
+      if (mask >> bit & 1) {
+        res[mask][num_set++] = bit;
+      }
+    }
+  }
+  return res;
+}
+
+// The indices of the set bits of each byte, lowest first, for the lists of
+// nonzero input groups: the indices of the groups of 8 at a time are those
+// of their mask plus the index of the first.
+constexpr std::array<std::array<uint16_t, 8>, 256> set_bit_indices =
+    make_set_bit_indices();
+
+// The indices of the nonzero groups of 4 inputs may be written up to 8 past
+// the last.
+using GroupIndices = std::array<uint16_t, nnue_max_sparse_inputs / 4 + 8>;
+
+int32_t read_group(const uint8_t* in, size_t group) {
+  int32_t res;
+  std::memcpy(&res, in + 4 * group, sizeof(res));
+  return res;
+}
+#endif
+
+#ifdef PAWN_GRABBER_X86_KERNELS
+// The AVX2 and AVX-512 functions are compiled for their instruction sets
+// alone, and only called once `__builtin_cpu_supports` has said the CPU has
+// them.
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX512_VNNI_TARGET \
+  __attribute__((target("avx2,avx512f,avx512bw,avx512vl,avx512vnni")))
+
+AVX2_TARGET void update_accumulator_avx2(const int16_t* src, int16_t* dst,
+                                         size_t size,
+                                         const int16_t* const* added,
+                                         size_t num_added,
+                                         const int16_t* const* removed,
+                                         size_t num_removed) {
+  for (size_t i = 0; i < size; i += 16) {
+    __m256i value =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    for (size_t j = 0; j < num_added; ++j) {
+      value = _mm256_add_epi16(
+          value,
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(added[j] + i)));
+    }
+    for (size_t j = 0; j < num_removed; ++j) {
+      value = _mm256_sub_epi16(
+          value, _mm256_loadu_si256(
+                     reinterpret_cast<const __m256i*>(removed[j] + i)));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+  }
+}
+
+AVX2_TARGET void clipped_relu_avx2(const int16_t* in, uint8_t* out,
+                                   size_t size) {
+  const __m256i max_value = _mm256_set1_epi8(127);
+  for (size_t i = 0; i < size; i += 32) {
+    const __m256i low =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    const __m256i high =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16));
+    // The pack works within 128-bit lanes, so the 64-bit quarters come out in
+    // the order 0, 2, 1, 3.
+    const __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(low, high), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                        _mm256_min_epu8(packed, max_value));
+  }
+}
+
+AVX2_TARGET int32_t horizontal_sum_avx2(__m256i sum) {
+  __m128i res = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                              _mm256_extracti128_si256(sum, 1));
+  res = _mm_add_epi32(res, _mm_shuffle_epi32(res, 0x4E));
+  res = _mm_add_epi32(res, _mm_shuffle_epi32(res, 0xB1));
+  return _mm_cvtsi128_si32(res);
+}
+
+AVX2_TARGET void affine_avx2(const uint8_t* in, size_t num_inputs,
+                             const int8_t* weights, const int32_t* biases,
+                             int32_t* out, size_t num_outputs) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  for (size_t j = 0; j < num_outputs; ++j) {
+    const int8_t* row = weights + j * num_inputs;
+    __m256i sum = _mm256_setzero_si256();
+    for (size_t i = 0; i < num_inputs; i += 32) {
+      const __m256i x =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+      const __m256i w =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+      // Pairs of u8 * s8 products into 16 bits, then pairs of those into 32.
+      sum = _mm256_add_epi32(
+          sum, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+    }
+    out[j] = biases[j] + horizontal_sum_avx2(sum);
+  }
+}
+
+AVX512_VNNI_TARGET void affine_avx512_vnni(const uint8_t* in,
+                                           size_t num_inputs,
+                                           const int8_t* weights,
+                                           const int32_t* biases, int32_t* out,
+                                           size_t num_outputs) {
+  for (size_t j = 0; j < num_outputs; ++j) {
+    const int8_t* row = weights + j * num_inputs;
+    __m512i wide_sum = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 64 <= num_inputs; i += 64) {
+      wide_sum = _mm512_dpbusd_epi32(
+          wide_sum, _mm512_loadu_si512(in + i), _mm512_loadu_si512(row + i));
+    }
+    __m256i sum = _mm256_add_epi32(_mm512_castsi512_si256(wide_sum),
+                                   _mm512_extracti64x4_epi64(wide_sum, 1));
+    if (i < num_inputs) {
+      sum = _mm256_dpbusd_epi32(
+          sum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)));
+    }
+    out[j] = biases[j] + horizontal_sum_avx2(sum);
+  }
+}
+
+// Sets `indices` to those of the nonzero groups of 4 inputs, and returns the
+// number of them.
+AVX2_TARGET size_t find_nonzero_groups_avx2(const uint8_t* in,
+                                            size_t num_inputs,
+                                            GroupIndices* indices) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m128i step = _mm_set1_epi16(8);
+  __m128i first = _mm_setzero_si128();
+  size_t res = 0;
+  for (size_t i = 0; i < num_inputs; i += 32) {
+    // The inputs are at most 127, so a nonzero group is a positive 32-bit
+    // integer.
+    const __m256i groups =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    const unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(groups, zero))));
+    const __m128i set = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(set_bit_indices[mask].data()));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices->data() + res),
+                     _mm_add_epi16(first, set));
+    res += static_cast<size_t>(__builtin_popcount(mask));
+    first = _mm_add_epi16(first, step);
+  }
+  return res;
+}
+
+AVX2_TARGET void sparse_affine_avx2(const uint8_t* in, size_t num_inputs,
+                                    const int8_t* weights,
+                                    const int32_t* biases, int32_t* out,
+                                    size_t num_outputs) {
+  GroupIndices indices;
+  const size_t num_groups = find_nonzero_groups_avx2(in, num_inputs, &indices);
+  const __m256i ones = _mm256_set1_epi16(1);
+  for (size_t j = 0; j < num_outputs; j += 32) {
+    // A plain array, as the vector types lose their attributes in a template
+    // argument.
+    __m256i sums[4];
+    for (size_t r = 0; r < 4; ++r) {
+      sums[r] = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(biases + j + 8 * r));
+    }
+    for (size_t n = 0; n < num_groups; ++n) {
+      const size_t group = indices[n];
+      const __m256i x = _mm256_set1_epi32(read_group(in, group));
+      const int8_t* w = weights + (group * num_outputs + j) * 4;
+      for (size_t r = 0; r < 4; ++r) {
+        const __m256i wr =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + 32 * r));
+        sums[r] = _mm256_add_epi32(
+            sums[r], _mm256_madd_epi16(_mm256_maddubs_epi16(x, wr), ones));
+      }
+    }
+    for (size_t r = 0; r < 4; ++r) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j + 8 * r),
+                          sums[r]);
+    }
+  }
+}
+
+AVX512_VNNI_TARGET void sparse_affine_avx512_vnni(
+    const uint8_t* in, size_t num_inputs, const int8_t* weights,
+    const int32_t* biases, int32_t* out, size_t num_outputs) {
+  GroupIndices indices;
+  const size_t num_groups = find_nonzero_groups_avx2(in, num_inputs, &indices);
+  for (size_t j = 0; j < num_outputs; j += 32) {
+    __m512i low = _mm512_loadu_si512(biases + j);
+    __m512i high = _mm512_loadu_si512(biases + j + 16);
+    for (size_t n = 0; n < num_groups; ++n) {
+      const size_t group = indices[n];
+      const __m512i x = _mm512_set1_epi32(read_group(in, group));
+      const int8_t* w = weights + (group * num_outputs + j) * 4;
+      low = _mm512_dpbusd_epi32(low, x, _mm512_loadu_si512(w));
+      high = _mm512_dpbusd_epi32(high, x, _mm512_loadu_si512(w + 64));
+    }
+    _mm512_storeu_si512(out + j, low);
+    _mm512_storeu_si512(out + j + 16, high);
+  }
+}
+
+constexpr NnueKernels avx2_kernels = {
+    SimdLevel::avx2, &update_accumulator_avx2, &clipped_relu_avx2,
+    &affine_avx2, &sparse_affine_avx2};
+// VNNI only speeds up the dense layers.
+constexpr NnueKernels avx512_vnni_kernels = {
+    SimdLevel::avx512_vnni, &update_accumulator_avx2, &clipped_relu_avx2,
+    &affine_avx512_vnni, &sparse_affine_avx512_vnni};
+
+bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+bool has_avx512_vnni() {
+  return has_avx2() && __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512vl") &&
+         __builtin_cpu_supports("avx512vnni");
+}
+#endif
+
+#ifdef PAWN_GRABBER_NEON_KERNELS
+void update_accumulator_neon(const int16_t* src, int16_t* dst, size_t size,
+                             const int16_t* const* added, size_t num_added,
+                             const int16_t* const* removed,
+                             size_t num_removed) {
+  for (size_t i = 0; i < size; i += 8) {
+    int16x8_t value = vld1q_s16(src + i);
+    for (size_t j = 0; j < num_added; ++j) {
+      value = vaddq_s16(value, vld1q_s16(added[j] + i));
+    }
+    for (size_t j = 0; j < num_removed; ++j) {
+      value = vsubq_s16(value, vld1q_s16(removed[j] + i));
+    }
+    vst1q_s16(dst + i, value);
+  }
+}
+
+void clipped_relu_neon(const int16_t* in, uint8_t* out, size_t size) {
+  const uint8x16_t max_value = vdupq_n_u8(127);
+  for (size_t i = 0; i < size; i += 16) {
+    const uint8x16_t packed = vcombine_u8(vqmovun_s16(vld1q_s16(in + i)),
+                                          vqmovun_s16(vld1q_s16(in + i + 8)));
+    vst1q_u8(out + i, vminq_u8(packed, max_value));
+  }
+}
+
+void affine_neon(const uint8_t* in, size_t num_inputs, const int8_t* weights,
+                 const int32_t* biases, int32_t* out, size_t num_outputs) {
+  for (size_t j = 0; j < num_outputs; ++j) {
+    const int8_t* row = weights + j * num_inputs;
+    int32x4_t sum = vdupq_n_s32(0);
+    for (size_t i = 0; i < num_inputs; i += 16) {
+      // The inputs are at most 127, so they read the same as signed bytes.
+      const int8x16_t x = vreinterpretq_s8_u8(vld1q_u8(in + i));
+      const int8x16_t w = vld1q_s8(row + i);
+      int16x8_t products = vmull_s8(vget_low_s8(x), vget_low_s8(w));
+      products = vmlal_high_s8(products, x, w);
+      sum = vpadalq_s16(sum, products);
+    }
+    out[j] = biases[j] + vaddvq_s32(sum);
+  }
+}
+
+size_t find_nonzero_groups_neon(const uint8_t* in, size_t num_inputs,
+                                GroupIndices* indices) {
+  const uint32x4_t bits = {1, 2, 4, 8};
+  const uint16x4_t step = vdup_n_u16(4);
+  uint16x4_t first = vdup_n_u16(0);
+  size_t res = 0;
+  for (size_t i = 0; i < num_inputs; i += 16) {
+    const uint32x4_t groups = vreinterpretq_u32_u8(vld1q_u8(in + i));
+    const unsigned mask =
+        vaddvq_u32(vandq_u32(vtstq_u32(groups, groups), bits));
+    vst1_u16(indices->data() + res,
+             vadd_u16(first, vld1_u16(set_bit_indices[mask].data())));
+    res += static_cast<size_t>(__builtin_popcount(mask));
+    first = vadd_u16(first, step);
+  }
+  return res;
+}
+
+void sparse_affine_neon(const uint8_t* in, size_t num_inputs,
+                        const int8_t* weights, const int32_t* biases,
+                        int32_t* out, size_t num_outputs) {
+  GroupIndices indices;
+  const size_t num_groups = find_nonzero_groups_neon(in, num_inputs, &indices);
+  for (size_t j = 0; j < num_outputs; j += 32) {
+    int32x4_t sums[8];
+    for (size_t r = 0; r < 8; ++r) {
+      sums[r] = vld1q_s32(biases + j + 4 * r);
+    }
+    for (size_t n = 0; n < num_groups; ++n) {
+      const size_t group = indices[n];
+      // The inputs are at most 127, so they read the same as signed bytes.
+      const int8x16_t x =
+          vreinterpretq_s8_s32(vdupq_n_s32(read_group(in, group)));
+      const int8_t* w = weights + (group * num_outputs + j) * 4;
+      for (size_t r = 0; r < 8; ++r) {
+        const int8x16_t wr = vld1q_s8(w + 16 * r);
+#ifdef __ARM_FEATURE_DOTPROD
+        sums[r] = vdotq_s32(sums[r], x, wr);
+#else
+        // The products of the first two outputs, then of the next two, in
+        // pairs into 16 bits and the pairs of those into 32.
+        const int16x8_t low = vmull_s8(vget_low_s8(x), vget_low_s8(wr));
+        const int16x8_t high = vmull_high_s8(x, wr);
+        sums[r] = vpadalq_s16(sums[r], vpaddq_s16(low, high));
+#endif
+      }
+    }
+    for (size_t r = 0; r < 8; ++r) {
+      vst1q_s32(out + j + 4 * r, sums[r]);
+    }
+  }
+}
+
+constexpr NnueKernels neon_kernels = {
+    SimdLevel::neon, &update_accumulator_neon, &clipped_relu_neon,
+    &affine_neon, &sparse_affine_neon};
+#endif
+
+#ifdef PAWN_GRABBER_WASM_KERNELS
+// SIMD128 has no byte dot products, so the bytes are widened to 16 bits and
+// multiplied in pairs into 32.
+void update_accumulator_wasm(const int16_t* src, int16_t* dst, size_t size,
+                             const int16_t* const* added, size_t num_added,
+                             const int16_t* const* removed,
+                             size_t num_removed) {
+  for (size_t i = 0; i < size; i += 8) {
+    v128_t value = wasm_v128_load(src + i);
+    for (size_t j = 0; j < num_added; ++j) {
+      value = wasm_i16x8_add(value, wasm_v128_load(added[j] + i));
+    }
+    for (size_t j = 0; j < num_removed; ++j) {
+      value = wasm_i16x8_sub(value, wasm_v128_load(removed[j] + i));
+    }
+    wasm_v128_store(dst + i, value);
+  }
+}
+
+void clipped_relu_wasm(const int16_t* in, uint8_t* out, size_t size) {
+  const v128_t max_value = wasm_u8x16_splat(127);
+  for (size_t i = 0; i < size; i += 16) {
+    const v128_t packed = wasm_u8x16_narrow_i16x8(wasm_v128_load(in + i),
+                                                  wasm_v128_load(in + i + 8));
+    wasm_v128_store(out + i, wasm_u8x16_min(packed, max_value));
+  }
+}
+
+void affine_wasm(const uint8_t* in, size_t num_inputs, const int8_t* weights,
+                 const int32_t* biases, int32_t* out, size_t num_outputs) {
+  for (size_t j = 0; j < num_outputs; ++j) {
+    const int8_t* row = weights + j * num_inputs;
+    v128_t sum = wasm_i32x4_splat(0);
+    for (size_t i = 0; i < num_inputs; i += 16) {
+      // The inputs are at most 127, so they read the same as signed bytes.
+      const v128_t x = wasm_v128_load(in + i);
+      const v128_t w = wasm_v128_load(row + i);
+      sum = wasm_i32x4_add(
+          sum, wasm_i32x4_dot_i16x8(wasm_i16x8_extend_low_i8x16(x),
+                                    wasm_i16x8_extend_low_i8x16(w)));
+      sum = wasm_i32x4_add(
+          sum, wasm_i32x4_dot_i16x8(wasm_i16x8_extend_high_i8x16(x),
+                                    wasm_i16x8_extend_high_i8x16(w)));
+    }
+    out[j] = biases[j] + wasm_i32x4_extract_lane(sum, 0) +
+             wasm_i32x4_extract_lane(sum, 1) +
+             wasm_i32x4_extract_lane(sum, 2) +
+             wasm_i32x4_extract_lane(sum, 3);
+  }
+}
+
+size_t find_nonzero_groups_wasm(const uint8_t* in, size_t num_inputs,
+                                GroupIndices* indices) {
+  const v128_t zero = wasm_i32x4_splat(0);
+  const v128_t step = wasm_i16x8_splat(4);
+  v128_t first = wasm_i16x8_splat(0);
+  size_t res = 0;
+  for (size_t i = 0; i < num_inputs; i += 16) {
+    const unsigned mask = wasm_i32x4_bitmask(
+        wasm_i32x4_ne(wasm_v128_load(in + i), zero));
+    // Only the first 4 indices of the mask, in the low 64 bits.
+    wasm_v128_store64_lane(
+        indices->data() + res,
+        wasm_i16x8_add(first,
+                       wasm_v128_load64_zero(set_bit_indices[mask].data())),
+        0);
+    res += static_cast<size_t>(__builtin_popcount(mask));
+    first = wasm_i16x8_add(first, step);
+  }
+  return res;
+}
+
+void sparse_affine_wasm(const uint8_t* in, size_t num_inputs,
+                        const int8_t* weights, const int32_t* biases,
+                        int32_t* out, size_t num_outputs) {
+  GroupIndices indices;
+  const size_t num_groups = find_nonzero_groups_wasm(in, num_inputs, &indices);
+  for (size_t j = 0; j < num_outputs; j += 32) {
+    // The sums of the first two outputs of each 4, then of the next two, in
+    // pairs of halves of the sum of each output, put together at the end.
+    v128_t low[8];
+    v128_t high[8];
+    for (size_t r = 0; r < 8; ++r) {
+      low[r] = wasm_i32x4_splat(0);
+      high[r] = wasm_i32x4_splat(0);
+    }
+    for (size_t n = 0; n < num_groups; ++n) {
+      const size_t group = indices[n];
+      // The inputs are at most 127, so they read the same as signed bytes.
+      const v128_t x = wasm_i16x8_extend_low_i8x16(
+          wasm_i32x4_splat(read_group(in, group)));
+      const int8_t* w = weights + (group * num_outputs + j) * 4;
+      for (size_t r = 0; r < 8; ++r) {
+        const v128_t wr = wasm_v128_load(w + 16 * r);
+        low[r] = wasm_i32x4_add(
+            low[r],
+            wasm_i32x4_dot_i16x8(x, wasm_i16x8_extend_low_i8x16(wr)));
+        high[r] = wasm_i32x4_add(
+            high[r],
+            wasm_i32x4_dot_i16x8(x, wasm_i16x8_extend_high_i8x16(wr)));
+      }
+    }
+    for (size_t r = 0; r < 8; ++r) {
+      const v128_t sums = wasm_i32x4_add(
+          wasm_i32x4_shuffle(low[r], high[r], 0, 2, 4, 6),
+          wasm_i32x4_shuffle(low[r], high[r], 1, 3, 5, 7));
+      wasm_v128_store(out + j + 4 * r,
+                      wasm_i32x4_add(sums, wasm_v128_load(biases + j + 4 * r)));
+    }
+  }
+}
+
+constexpr NnueKernels wasm_kernels = {
+    SimdLevel::wasm_simd128, &update_accumulator_wasm, &clipped_relu_wasm,
+    &affine_wasm, &sparse_affine_wasm};
+#endif
+}  // namespace.
+
+const NnueKernels* nnue_kernels_for(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::scalar:
+      return &scalar_kernels;
+    case SimdLevel::avx2:
+#ifdef PAWN_GRABBER_X86_KERNELS
+      return has_avx2() ? &avx2_kernels : nullptr;
+#else
+      return nullptr;
+#endif
+    case SimdLevel::avx512_vnni:
+#ifdef PAWN_GRABBER_X86_KERNELS
+      return has_avx512_vnni() ? &avx512_vnni_kernels : nullptr;
+#else
+      return nullptr;
+#endif
+    case SimdLevel::neon:
+#ifdef PAWN_GRABBER_NEON_KERNELS
+      return &neon_kernels;
+#else
+      return nullptr;
+#endif
+    case SimdLevel::wasm_simd128:
+#ifdef PAWN_GRABBER_WASM_KERNELS
+      return &wasm_kernels;
+#else
+      return nullptr;
+#endif
+  }
+  return nullptr;
+}
+
+const NnueKernels& nnue_kernels() {
+  const static NnueKernels& kernels = [] () -> const NnueKernels& {
+    for (SimdLevel level : {SimdLevel::avx512_vnni, SimdLevel::avx2,
+                            SimdLevel::neon, SimdLevel::wasm_simd128}) {
+      if (const NnueKernels* candidate = nnue_kernels_for(level)) {
+        return *candidate;
+      }
+    }
+    return scalar_kernels;
+  }();
+  return kernels;
+}
+
+const char* simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::scalar:
+      return "scalar";
+    case SimdLevel::avx2:
+      return "avx2";
+    case SimdLevel::avx512_vnni:
+      return "avx512_vnni";
+    case SimdLevel::neon:
+      return "neon";
+    case SimdLevel::wasm_simd128:
+      return "wasm_simd128";
+  }
+  return "";
+}
@@ -0,0 +1,72 @@
+#ifndef NNUE_KERNELS_H
+#define NNUE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// The inner loops of the neural evaluation (see nnue.h), written once in
+// plain C++ and again with the vector instructions of the machines we run on.
+// Which versions exist depends on the target: x86-64 builds have AVX2 and
+// AVX-512 VNNI versions, compiled for those instruction sets function by
+// function so that the rest of the program still runs on any x86-64, and
+// AArch64 builds have NEON, which every AArch64 core has, and WebAssembly
+// builds with SIMD128 enabled have that, which a browser either runs or
+// refuses the whole module. The best version the CPU supports is picked once,
+// at the first call of `nnue_kernels`.
+//
+// Every version computes exactly the same numbers: the inputs of the dense
+// layers are clipped to [0, 127], so no product or pairwise sum saturates.
+//
+// Sizes must be multiples of 32. The vectors are loaded unaligned, which costs
+// nothing extra on the aligned buffers of the evaluator.
+
+// The most inputs of `sparse_affine`.
+constexpr size_t nnue_max_sparse_inputs = 1024;
+
+// The index in the weights of `sparse_affine` of the weight of input `i` for
+// output `j`: the inputs are taken 4 at a time, and each group of 4 has its
+// weights for every output in turn, 4 for the first output, then the second,
+// and so on.
+constexpr size_t sparse_weight_idx(size_t i, size_t j, size_t num_outputs) {
+  return (i / 4 * num_outputs + j) * 4 + i % 4;
+}
+
+enum class SimdLevel { scalar, avx2, avx512_vnni, neon, wasm_simd128 };
+
+struct NnueKernels {
+  SimdLevel level_;
+  // `dst = src + sum of added - sum of removed`, all vectors of `size` 16-bit
+  // values. `dst` may be `src`.
+  void (*update_accumulator)(const int16_t* src, int16_t* dst, size_t size,
+                             const int16_t* const* added, size_t num_added,
+                             const int16_t* const* removed,
+                             size_t num_removed);
+  // `out[i] = clamp(in[i], 0, 127)` for `size` values.
+  void (*clipped_relu)(const int16_t* in, uint8_t* out, size_t size);
+  // `out[j] = biases[j] + sum over i of in[i] * weights[j * num_inputs + i]`
+  // for `num_outputs` outputs. The inputs must be at most 127.
+  void (*affine)(const uint8_t* in, size_t num_inputs, const int8_t* weights,
+                 const int32_t* biases, int32_t* out, size_t num_outputs);
+  // The same sums with the weights in the order of `sparse_weight_idx`, for
+  // inputs that are mostly 0, as those of the first dense layer are. The
+  // inputs are looked at 4 bytes at a time, the nonzero groups gathered into
+  // a list of their indices, 8 at a time from the mask of a vector compare
+  // and a table of the indices of each mask, and only their weights are
+  // multiplied, each group's 4 inputs by the 4 weights of many outputs at
+  // once. At most `nnue_max_sparse_inputs` inputs.
+  void (*sparse_affine)(const uint8_t* in, size_t num_inputs,
+                        const int8_t* weights, const int32_t* biases,
+                        int32_t* out, size_t num_outputs);
+};
+
+// Returns the kernels of the best level the CPU supports.
+const NnueKernels& nnue_kernels();
+
+// Returns the kernels of `level`, or null if this build or this CPU doesn't
+// have them. For tests and benchmarks.
+const NnueKernels* nnue_kernels_for(SimdLevel level);
+
+// "scalar", "avx2", "avx512_vnni", "neon" or "wasm_simd128".
+const char* simd_level_name(SimdLevel level);
+
+#endif
@@ -0,0 +1,376 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+#include "eval.h"
+#include "gtest/gtest.h"
+#include "nnue_kernels.h"
+#include "numa.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+namespace {
+// Returns a network with small random weights, which says nothing about chess
+// but exercises every layer.
+std::unique_ptr<NnueNetwork> random_network() {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> small(-32, 32);
+  std::unique_ptr<NnueNetwork> res(new NnueNetwork);
+  for (int16_t& w : res->feature_biases_) {
+    w = static_cast<int16_t>(small(rng) + 32);
+  }
+  for (int16_t& w : res->feature_weights_) {
+    w = static_cast<int16_t>(small(rng));
+  }
+  for (int32_t& w : res->l1_biases_) {
+    w = small(rng) * 64;
+  }
+  for (int8_t& w : res->l1_weights_) {
+    w = static_cast<int8_t>(small(rng));
+  }
+  for (int32_t& w : res->l2_biases_) {
+    w = small(rng) * 64;
+  }
+  for (int8_t& w : res->l2_weights_) {
+    w = static_cast<int8_t>(small(rng));
+  }
+  res->output_bias_[0] = small(rng) * 16;
+  for (int8_t& w : res->output_weights_) {
+    w = static_cast<int8_t>(small(rng));
+  }
+  return res;
+}
+
+const NnueNetwork& test_network() {
+  static const NnueNetwork& network = *random_network().release();
+  return network;
+}
+
+NnueAccumulator fresh_accumulator(const Board& board) {
+  NnueAccumulator res;
+  for (Color perspective : {Color::white, Color::black}) {
+    refresh_accumulator(test_network(), board, perspective, &res);
+  }
+  return res;
+}
+
+// Walks every line of `depth` plies, checking that the incremental
+// accumulators match those computed from scratch.
+void expect_incremental_matches(Board* board,
+                                const NnueAccumulator& accumulator,
+                                int depth) {
+  EXPECT_EQ(accumulator.values_, fresh_accumulator(*board).values_)
+      << board->to_pretty_str();
+  if (depth == 0) {
+    return;
+  }
+  UndoInfo undo;
+  for (Move move : board->legal_moves()) {
+    const DirtyPieces dirty = board->dirty_pieces(move);
+    board->do_move(move, &undo);
+    NnueAccumulator next;
+    update_accumulator(test_network(), *board, dirty, accumulator, &next);
+    expect_incremental_matches(board, next, depth - 1);
+    board->undo_move(move, undo);
+  }
+}
+}  // namespace.
+
+TEST(Nnue, FeaturesAreMirroredForBlack) {
+  EXPECT_EQ(nnue_feature(Color::white, 3, Color::white, Piece::pawn, 11),
+            nnue_feature(Color::black, 3 ^ 56, Color::black, Piece::pawn,
+                         11 ^ 56));
+  EXPECT_NE(nnue_feature(Color::white, 3, Color::white, Piece::pawn, 11),
+            nnue_feature(Color::white, 3, Color::black, Piece::pawn, 11));
+  EXPECT_LT(nnue_feature(Color::black, 63, Color::white, Piece::queen, 63),
+            nnue_num_features);
+}
+
+TEST(Nnue, IncrementalAccumulatorMatchesFromScratch) {
+  // Castling, en passant, promotions with and without captures.
+  const std::vector<std::string> fens = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3"};
+  for (const std::string& fen : fens) {
+    Board board(fen);
+    expect_incremental_matches(&board, fresh_accumulator(board), 2);
+  }
+}
+
+TEST(Nnue, KernelsMatchScalar) {
+  const NnueKernels& scalar = *nnue_kernels_for(SimdLevel::scalar);
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> wide(-1000, 1000);
+  std::uniform_int_distribution<int> byte(-128, 127);
+  std::vector<int16_t> acc(256);
+  std::vector<int16_t> column_a(256);
+  std::vector<int16_t> column_b(256);
+  for (size_t i = 0; i < acc.size(); ++i) {
+    acc[i] = static_cast<int16_t>(wide(rng));
+    column_a[i] = static_cast<int16_t>(wide(rng));
+    column_b[i] = static_cast<int16_t>(wide(rng));
+  }
+  std::vector<uint8_t> in(512);
+  std::vector<int8_t> weights(32 * 512);
+  std::vector<int32_t> biases(32);
+  for (uint8_t& x : in) {
+    x = static_cast<uint8_t>(byte(rng) & 127);
+  }
+  for (int8_t& w : weights) {
+    w = static_cast<int8_t>(byte(rng));
+  }
+  for (int32_t& b : biases) {
+    b = wide(rng);
+  }
+  const int16_t* added[] = {column_a.data()};
+  const int16_t* removed[] = {column_b.data()};
+
+  std::vector<int16_t> expected_acc(256);
+  scalar.update_accumulator(acc.data(), expected_acc.data(), acc.size(), added,
+                            1, removed, 1);
+  std::vector<uint8_t> expected_relu(256);
+  scalar.clipped_relu(expected_acc.data(), expected_relu.data(), 256);
+  std::vector<int32_t> expected_affine(32);
+  scalar.affine(in.data(), in.size(), weights.data(), biases.data(),
+                expected_affine.data(), 32);
+  std::vector<int32_t> expected_small(32);
+  scalar.affine(in.data(), 32, weights.data(), biases.data(),
+                expected_small.data(), 32);
+  // The same weights in the order of `sparse_affine`, and inputs with most
+  // groups of 4 zero, as after the first layer.
+  std::vector<int8_t> sparse_weights(weights.size());
+  for (size_t j = 0; j < 32; ++j) {
+    for (size_t i = 0; i < in.size(); ++i) {
+      sparse_weights[sparse_weight_idx(i, j, 32)] = weights[j * in.size() + i];
+    }
+  }
+  std::vector<uint8_t> sparse_in(in.size());
+  for (size_t i = 0; i < in.size(); i += 4) {
+    if (i % 28 == 0 || i % 36 == 0) {
+      std::copy(in.begin() + static_cast<ptrdiff_t>(i),
+                in.begin() + static_cast<ptrdiff_t>(i + 4),
+                sparse_in.begin() + static_cast<ptrdiff_t>(i));
+    }
+  }
+  sparse_in.back() = 1;
+  std::vector<int32_t> expected_sparse(32);
+  scalar.affine(sparse_in.data(), sparse_in.size(), weights.data(),
+                biases.data(), expected_sparse.data(), 32);
+
+  for (SimdLevel level :
+       {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512_vnni,
+        SimdLevel::neon, SimdLevel::wasm_simd128}) {
+    const NnueKernels* kernels = nnue_kernels_for(level);
+    if (!kernels) {
+      continue;
+    }
+    SCOPED_TRACE(simd_level_name(level));
+    std::vector<int16_t> res_acc(256);
+    kernels->update_accumulator(acc.data(), res_acc.data(), acc.size(), added,
+                                1, removed, 1);
+    EXPECT_EQ(res_acc, expected_acc);
+    std::vector<uint8_t> res_relu(256);
+    kernels->clipped_relu(res_acc.data(), res_relu.data(), 256);
+    EXPECT_EQ(res_relu, expected_relu);
+    std::vector<int32_t> res_affine(32);
+    kernels->affine(in.data(), in.size(), weights.data(), biases.data(),
+                    res_affine.data(), 32);
+    EXPECT_EQ(res_affine, expected_affine);
+    kernels->affine(in.data(), 32, weights.data(), biases.data(),
+                    res_affine.data(), 32);
+    EXPECT_EQ(res_affine, expected_small);
+    kernels->sparse_affine(in.data(), in.size(), sparse_weights.data(),
+                           biases.data(), res_affine.data(), 32);
+    EXPECT_EQ(res_affine, expected_affine);
+    kernels->sparse_affine(sparse_in.data(), sparse_in.size(),
+                           sparse_weights.data(), biases.data(),
+                           res_affine.data(), 32);
+    EXPECT_EQ(res_affine, expected_sparse);
+  }
+}
+
+TEST(Nnue, SavedNetworkLoadsBack) {
+  const std::string path = testing::TempDir() + "nnue_test.nnue";
+  ASSERT_TRUE(save_network(test_network(), path));
+  std::string error;
+  const NetworkPtr loaded = load_network(path, &error);
+  ASSERT_NE(loaded, nullptr) << error;
+  EXPECT_EQ(loaded.get_deleter().file_, nullptr);
+  const Board board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  const NnueAccumulator accumulator = fresh_accumulator(board);
+  EXPECT_EQ(nnue_output(*loaded, accumulator, Color::white),
+            nnue_output(test_network(), accumulator, Color::white));
+  EXPECT_EQ(loaded->output_weights_, test_network().output_weights_);
+  EXPECT_EQ(loaded->l1_weights_, test_network().l1_weights_);
+  // The file has the first dense layer's weights row by row.
+  std::ifstream file(path, std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(
+      12 + sizeof(NnueNetwork::feature_biases_) +
+      sizeof(NnueNetwork::feature_weights_) +
+      sizeof(NnueNetwork::l1_biases_) + 2 * nnue_l1_size * 3 + 5));
+  EXPECT_EQ(static_cast<int8_t>(file.get()),
+            test_network().l1_weights_[sparse_weight_idx(5, 3, nnue_l2_size)]);
+  std::remove(path.c_str());
+}
+
+TEST(Nnue, MappedNetworkIsUsedInPlace) {
+  const std::string path = testing::TempDir() + "nnue_test_mapped.nnue";
+  ASSERT_TRUE(save_mapped_network(test_network(), path));
+  const Board board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::string error;
+  {
+    const NetworkPtr loaded = load_network(path, &error);
+    ASSERT_NE(loaded, nullptr) << error;
+    EXPECT_NE(loaded.get_deleter().file_, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(loaded.get()) % 64, 0);
+    EXPECT_EQ(loaded->l1_weights_, test_network().l1_weights_);
+    EXPECT_EQ(loaded->feature_weights_, test_network().feature_weights_);
+    NnueAccumulator accumulator;
+    for (Color perspective : {Color::white, Color::black}) {
+      refresh_accumulator(*loaded, board, perspective, &accumulator);
+    }
+    EXPECT_EQ(nnue_output(*loaded, accumulator, Color::white),
+              nnue_output(test_network(), fresh_accumulator(board),
+                          Color::white));
+  }
+
+  // Cut short, as by a build of another layout.
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      .write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 64));
+  EXPECT_EQ(load_network(path, &error), nullptr);
+  EXPECT_FALSE(error.empty());
+  std::remove(path.c_str());
+}
+
+TEST(Nnue, RejectsOtherFiles) {
+  std::string error;
+  EXPECT_EQ(load_network(testing::TempDir() + "no_such_file.nnue", &error),
+            nullptr);
+  EXPECT_FALSE(error.empty());
+  const std::string path = testing::TempDir() + "not_a_network.nnue";
+  std::ofstream(path) << "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR";
+  error.clear();
+  EXPECT_EQ(load_network(path, &error), nullptr);
+  EXPECT_FALSE(error.empty());
+  std::remove(path.c_str());
+}
+
+TEST(Nnue, SearchesWithTheNetwork) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  searcher.set_network(&test_network());
+  // The mate doesn't depend on the evaluation.
+  const SearchResult res =
+      searcher.search(Board("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1"), 3);
+  EXPECT_EQ(res.score_, mate_score - 1);
+}
+
+TEST(Nnue, CopiesOntoANode) {
+  NetworkPtr copy;
+  run_on_numa_node(0, [&copy] { copy = copy_network(test_network()); });
+  ASSERT_NE(copy, nullptr);
+  EXPECT_EQ(std::memcmp(copy.get(), &test_network(), sizeof(NnueNetwork)), 0);
+
+  // The helpers find their copies, on machines of several nodes.
+  ThreadPool pool(2, {{}, true});
+  TranspositionTable table(1);
+  ParallelSearcher searcher(&pool, &table);
+  searcher.set_network(&test_network());
+  searcher.set_network_replication(true);
+  const SearchResult res = searcher.search(
+      Board("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1"), {3, 0, nullptr, nullptr});
+  EXPECT_EQ(res.score_, mate_score - 1);
+}
+
+TEST(Nnue, CachedRefreshMatchesFromScratch) {
+  AccumulatorCache cache;
+  cache.reset(test_network());
+  // The second and third boards share the white king square with the first,
+  // so their white halves are the cached one plus and minus a few pieces.
+  for (const std::string& fen :
+       {std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w KQkq - 0 1"),
+        std::string("r3k2r/p1ppqpb1/bn2pnp1/3P4/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "b KQkq - 0 1"),
+        std::string("4k3/8/8/8/8/8/8/4K3 w - - 0 1"),
+        std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w KQkq - 0 1")}) {
+    const Board board(fen);
+    NnueAccumulator accumulator;
+    for (Color perspective : {Color::white, Color::black}) {
+      cache.refresh(test_network(), board, perspective, &accumulator);
+    }
+    EXPECT_EQ(accumulator.values_, fresh_accumulator(board).values_) << fen;
+  }
+}
+
+TEST(Nnue, LazyStackMatchesFromScratch) {
+  // Long walks of the kings, with positions evaluated only now and then.
+  std::mt19937 rng(7);
+  AccumulatorStack stack(256);
+  for (const std::string& fen :
+       {std::string("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"),
+        std::string("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w KQkq - 0 1")}) {
+    Board board(fen);
+    stack.reset(test_network(), board);
+    std::vector<std::pair<Move, UndoInfo>> line;
+    for (int ply = 0; ply < 200; ++ply) {
+      const MoveList moves = board.legal_moves();
+      // Go back now and then, and whenever the game is over.
+      if (moves.empty() || (!line.empty() && rng() % 4 == 0)) {
+        if (line.empty()) {
+          break;
+        }
+        board.undo_move(line.back().first, line.back().second);
+        line.pop_back();
+        stack.pop();
+      } else {
+        const Move move = moves[rng() % moves.size()];
+        stack.push(board.dirty_pieces(move));
+        line.emplace_back(move, UndoInfo());
+        board.do_move(move, &line.back().second);
+      }
+      if (rng() % 3 == 0) {
+        EXPECT_EQ(stack.top(board).values_, fresh_accumulator(board).values_)
+            << board.to_pretty_str();
+      }
+    }
+  }
+}
+
+TEST(Nnue, EndgameEvaluatorsTakePrecedence) {
+  AccumulatorStack stack(1);
+  const Board draw("8/8/8/4k3/8/8/8/3NK3 w - - 0 1");
+  stack.reset(test_network(), draw);
+  EXPECT_EQ(evaluate(draw, &stack), 0);
+  const Board board("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b "
+                    "KQkq - 3 3");
+  stack.reset(test_network(), board);
+  EXPECT_EQ(evaluate(board, &stack),
+            nnue_output(test_network(), fresh_accumulator(board),
+                        Color::black));
+}
@@ -0,0 +1,97 @@
+#include "numa.h"
+
+#include <sched.h>
+
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+
+namespace {
+std::vector<std::vector<int>> read_numa_nodes() {
+  std::vector<std::vector<int>> res;
+  for (int node = 0;; ++node) {
+    std::ifstream in(absl::StrCat("/sys/devices/system/node/node", node,
+                                  "/cpulist"));
+    std::string list;
+    if (!in || !std::getline(in, list)) {
+      break;
+    }
+    res.push_back(parse_cpu_list(list));
+  }
+  if (res.empty()) {
+    res.emplace_back();
+  }
+  return res;
+}
+}  // namespace.
+
+const std::vector<std::vector<int>>& numa_nodes() {
+  static const std::vector<std::vector<int>> nodes = read_numa_nodes();
+  return nodes;
+}
+
+std::vector<int> parse_cpu_list(absl::string_view list) {
+  std::vector<int> res;
+  list = absl::StripAsciiWhitespace(list);
+  if (list.empty()) {
+    return res;
+  }
+  for (absl::string_view range : absl::StrSplit(list, ',')) {
+    const std::vector<absl::string_view> ends = absl::StrSplit(range, '-');
+    int first;
+    int last;
+    if (ends.size() > 2 || !absl::SimpleAtoi(ends[0], &first) ||
+        !absl::SimpleAtoi(ends.back(), &last) || first < 0 || last < first) {
+      return {};
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      res.push_back(cpu);
+    }
+  }
+  return res;
+}
+
+bool bind_to_cpus(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  // A pid of 0 is the calling thread.
+  return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+bool bind_to_numa_node(size_t node) {
+  return bind_to_cpus(numa_nodes()[node % numa_nodes().size()]);
+}
+
+size_t numa_node_of_cpu(int cpu) {
+  const std::vector<std::vector<int>>& nodes = numa_nodes();
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    for (int node_cpu : nodes[node]) {
+      if (node_cpu == cpu) {
+        return node;
+      }
+    }
+  }
+  return 0;
+}
+
+void run_on_numa_node(size_t node, const std::function<void()>& fn) {
+  std::thread thread([node, &fn] {
+    bind_to_numa_node(node);
+    fn();
+  });
+  thread.join();
+}
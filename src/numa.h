@@ -0,0 +1,37 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+// The CPUs of each NUMA node of the machine, as Linux lists them under
+// /sys/devices/system/node, read once. A machine that lists no nodes, or that
+// isn't Linux, has a single node with no CPUs listed.
+const std::vector<std::vector<int>>& numa_nodes();
+
+// Parses a Linux CPU list such as "0-3,8,10-11" and returns its CPUs, or
+// nothing if the list is malformed.
+std::vector<int> parse_cpu_list(absl::string_view list);
+
+// Restricts the calling thread to `cpus`. Returns false, leaving the thread as
+// it was, if none of them can be used or the system refuses.
+bool bind_to_cpus(const std::vector<int>& cpus);
+
+// Restricts the calling thread to the CPUs of NUMA node `node` modulo the
+// number of nodes, so that the memory it touches first is allocated on that
+// node. Returns false, leaving the thread as it was, if the node has no CPUs
+// listed or the system refuses.
+bool bind_to_numa_node(size_t node);
+
+// The NUMA node that lists `cpu` among its CPUs, or 0 if none does.
+size_t numa_node_of_cpu(int cpu);
+
+// Runs `fn` on a new thread bound to NUMA node `node`, as `bind_to_numa_node`
+// binds it, and waits for it to return. What `fn` allocates and touches first
+// is then allocated on that node, if the binding succeeded.
+void run_on_numa_node(size_t node, const std::function<void()>& fn);
+
+#endif
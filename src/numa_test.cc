@@ -0,0 +1,43 @@
+#include "numa.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(ParseCpuList, ParsesRangesAndSingleCpus) {
+  EXPECT_EQ(parse_cpu_list("0-3,8,10-11\n"),
+            std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(parse_cpu_list("5"), std::vector<int>({5}));
+  EXPECT_TRUE(parse_cpu_list("").empty());
+  EXPECT_TRUE(parse_cpu_list("3-1").empty());
+  EXPECT_TRUE(parse_cpu_list("1-2-3").empty());
+  EXPECT_TRUE(parse_cpu_list("a").empty());
+}
+
+TEST(NumaNodes, HasAtLeastOneNode) {
+  ASSERT_FALSE(numa_nodes().empty());
+  // Binding to a node with CPUs only fails if the system refuses.
+  if (!numa_nodes()[0].empty()) {
+    EXPECT_TRUE(bind_to_numa_node(numa_nodes().size()));
+  }
+}
+
+TEST(NumaNodes, RunsOnTheNode) {
+  const std::vector<std::vector<int>>& nodes = numa_nodes();
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    for (int cpu : nodes[node]) {
+      EXPECT_EQ(numa_node_of_cpu(cpu), node);
+    }
+    int cpu = -1;
+    run_on_numa_node(node, [&cpu] { cpu = sched_getcpu(); });
+    ASSERT_GE(cpu, 0);
+    if (!nodes[node].empty()) {
+      EXPECT_NE(std::find(nodes[node].begin(), nodes[node].end(), cpu),
+                nodes[node].end());
+    }
+  }
+}
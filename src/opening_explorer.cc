@@ -0,0 +1,130 @@
+#include "opening_explorer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "position_db.h"
+
+OpeningExplorer::OpeningExplorer(const PositionDb* db,
+                                 const ExplorerOptions& options)
+    : db_(db),
+      shard_capacity_(std::max<size_t>(options.cache_positions_ / num_shards,
+                                       1)),
+      num_prefix_hits_(0),
+      num_cache_hits_(0),
+      num_lookups_(0) {
+  add_prefix(options);
+}
+
+ExplorerResult OpeningExplorer::look_up(const Board& board) const {
+  const MoveList moves = board.legal_moves();
+  // The keys of the positions after the moves, with the index of each move,
+  // sorted for `find_sorted`.
+  std::array<std::pair<uint64_t, size_t>, max_moves> children;
+  std::array<uint64_t, max_moves> keys;
+  std::array<absl::optional<PositionStats>, max_moves> stats;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    Board child = board;
+    child.do_move(moves[i]);
+    children[i] = {child.key_, i};
+  }
+  std::sort(children.begin(), children.begin() + moves.size());
+  for (size_t i = 0; i < moves.size(); ++i) {
+    keys[i] = children[i].first;
+  }
+  db_->find_sorted(keys.data(), moves.size(), stats.data());
+
+  // The moves found, by the index of the move.
+  std::array<std::pair<size_t, PositionStats>, max_moves> found;
+  size_t num_found = 0;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    if (stats[i]) {
+      found[num_found++] = {children[i].second, *stats[i]};
+    }
+  }
+  std::sort(found.begin(), found.begin() + num_found,
+            [](const std::pair<size_t, PositionStats>& lhs,
+               const std::pair<size_t, PositionStats>& rhs) {
+              return lhs.second.games_ != rhs.second.games_
+                         ? lhs.second.games_ > rhs.second.games_
+                         : lhs.first < rhs.first;
+            });
+  ExplorerResult res;
+  res.stats_ = db_->find(board.key_);
+  res.moves_.reserve(num_found);
+  for (size_t i = 0; i < num_found; ++i) {
+    res.moves_.push_back({moves[found[i].first], found[i].second});
+  }
+  return res;
+}
+
+void OpeningExplorer::add_prefix(const ExplorerOptions& options) {
+  // Breadth first, so that the shallowest positions are kept if there are
+  // too many.
+  std::vector<Board> level = {Board()};
+  std::vector<Board> next_level;
+  for (int ply = 0; ply <= options.prefix_plies_ && !level.empty(); ++ply) {
+    next_level.clear();
+    for (const Board& board : level) {
+      if (prefix_.size() == options.max_prefix_positions_) {
+        return;
+      }
+      if (prefix_.contains(board.key_)) {
+        continue;
+      }
+      const ExplorerResult& result =
+          prefix_.emplace(board.key_, look_up(board)).first->second;
+      if (ply == options.prefix_plies_) {
+        continue;
+      }
+      for (const ExplorerMove& move : result.moves_) {
+        if (move.stats_.games_ >= options.prefix_min_games_) {
+          next_level.push_back(board);
+          next_level.back().do_move(move.move_);
+        }
+      }
+    }
+    std::swap(level, next_level);
+  }
+}
+
+ExplorerResult OpeningExplorer::explore(const Board& board) {
+  const auto prefix = prefix_.find(board.key_);
+  if (prefix != prefix_.end()) {
+    ++num_prefix_hits_;
+    return prefix->second;
+  }
+  Shard& shard = shards_[board.key_ >> (64 - shard_bits)];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    const auto found = shard.index_.find(board.key_);
+    if (found != shard.index_.end()) {
+      shard.positions_.splice(shard.positions_.begin(), shard.positions_,
+                              found->second);
+      ++num_cache_hits_;
+      return found->second->second;
+    }
+  }
+  // Looked up without the lock, so that the other positions of the shard
+  // aren't held up. Two threads may look a position up at once, and then
+  // only the first result is cached.
+  ExplorerResult res = look_up(board);
+  ++num_lookups_;
+  std::lock_guard<std::mutex> lock(shard.mutex_);
+  if (!shard.index_.contains(board.key_)) {
+    shard.positions_.emplace_front(board.key_, res);
+    shard.index_.emplace(board.key_, shard.positions_.begin());
+    if (shard.positions_.size() > shard_capacity_) {
+      shard.index_.erase(shard.positions_.back().first);
+      shard.positions_.pop_back();
+    }
+  }
+  return res;
+}
@@ -0,0 +1,107 @@
+#ifndef OPENING_EXPLORER_H
+#define OPENING_EXPLORER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "position_db.h"
+
+struct ExplorerMove {
+  Move move_;
+  // The stats of the position after the move, which count every game that
+  // reached it, by this move or by a transposition.
+  PositionStats stats_;
+};
+
+struct ExplorerResult {
+  // The stats of the position, or nullopt if it isn't in the database.
+  absl::optional<PositionStats> stats_;
+  // The legal moves to positions in the database, those of the most games
+  // first, ties in the order of the move generator.
+  std::vector<ExplorerMove> moves_;
+};
+
+struct ExplorerOptions {
+  // The positions kept in the cache of recent queries, over all its shards.
+  size_t cache_positions_ = size_t{1} << 16;
+  // The positions up to `prefix_plies_` plies from the start position that
+  // at least `prefix_min_games_` games reached, up to
+  // `max_prefix_positions_` of the shallowest of them, are looked up when the
+  // explorer is created and kept for good.
+  int prefix_plies_ = 12;
+  uint32_t prefix_min_games_ = 10;
+  size_t max_prefix_positions_ = size_t{1} << 18;
+};
+
+// The queries of an opening explorer: given a position, the stats of the
+// positions after each of its legal moves, from a position database (see
+// position_db.h).
+//
+// A query generates the legal moves, makes each on a copy of the board for
+// the key of the position after it, sorts the keys and looks them all up in
+// one pass over the database's pages (`PositionDb::find_sorted`), so that
+// the children of a position, whose keys are spread over the whole file, cost
+// one search of the page index each rather than a search from the start.
+//
+// Most queries are of the first plies of the openings, which the explorer
+// looks up once when it is created, down from the start position, and keeps
+// in a table that is only ever read, with no lock. Other positions go through
+// a cache of the most recently queried ones, split into shards by the top
+// bits of the key, each with a lock and a list of its positions in the order
+// they were last queried, so that queries on many threads mostly take
+// different locks. A query is the same whichever of these it comes from.
+//
+// The explorer is thread safe. The database isn't owned and must outlive it.
+class OpeningExplorer {
+ public:
+  OpeningExplorer(const PositionDb* db, const ExplorerOptions& options);
+  OpeningExplorer(const OpeningExplorer&) = delete;
+  OpeningExplorer& operator=(const OpeningExplorer&) = delete;
+
+  ExplorerResult explore(const Board& board);
+
+  // The number of positions looked up when the explorer was created.
+  size_t num_prefix_positions() const { return prefix_.size(); }
+  // How the queries so far were served.
+  uint64_t num_prefix_hits() const { return num_prefix_hits_; }
+  uint64_t num_cache_hits() const { return num_cache_hits_; }
+  uint64_t num_lookups() const { return num_lookups_; }
+
+  static constexpr int shard_bits = 4;
+  static constexpr size_t num_shards = size_t{1} << shard_bits;
+
+ private:
+  struct alignas(64) Shard {
+    std::mutex mutex_;
+    // The most recently queried first.
+    std::list<std::pair<uint64_t, ExplorerResult>> positions_;
+    absl::flat_hash_map<
+        uint64_t, std::list<std::pair<uint64_t, ExplorerResult>>::iterator>
+        index_;
+  };
+
+  // Looks `board` up in the database.
+  ExplorerResult look_up(const Board& board) const;
+  void add_prefix(const ExplorerOptions& options);
+
+  const PositionDb* const db_;
+  const size_t shard_capacity_;
+  // The positions of the first plies, keyed by Zobrist key.
+  absl::flat_hash_map<uint64_t, ExplorerResult> prefix_;
+  std::array<Shard, num_shards> shards_;
+  std::atomic<uint64_t> num_prefix_hits_;
+  std::atomic<uint64_t> num_cache_hits_;
+  std::atomic<uint64_t> num_lookups_;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "opening_explorer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "opening_tree.h"
+#include "position_db.h"
+
+namespace {
+// Games of five openings, two of which transpose after 1. d4 d5 2. Nf3 Nf6
+// and 1. Nf3 d5 2. d4 Nf6.
+std::string test_games() {
+  const char* const games[] = {
+      "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 1-0",
+      "1. e4 c5 2. Nf3 d6 3. d4 cxd4 0-1",
+      "1. d4 d5 2. Nf3 Nf6 3. c4 e6 1/2-1/2",
+      "1. Nf3 d5 2. d4 Nf6 3. Bf4 e6 1-0",
+      "1. e4 e5 2. Bc4 Nf6 3. d3 c6 0-1",
+  };
+  std::string res;
+  for (int i = 0; i < 20; ++i) {
+    res += "[Event \"Test\"]\n\n";
+    res += games[i % 5];
+    res += "\n\n";
+  }
+  return res;
+}
+
+Move uci_move(const Board& board, const char* uci) {
+  const absl::optional<Move> move = parse_uci_move(board, uci);
+  EXPECT_TRUE(move) << uci;
+  return *move;
+}
+
+Board play(const std::vector<const char*>& moves) {
+  Board board;
+  for (const char* move : moves) {
+    board.do_move(uci_move(board, move));
+  }
+  return board;
+}
+
+// Checks `result` against looking each move up in `db`.
+void expect_result(const PositionDb& db, const Board& board,
+                   const ExplorerResult& result) {
+  const absl::optional<PositionStats> stats = db.find(board.key_);
+  ASSERT_EQ(result.stats_.has_value(), stats.has_value());
+  if (stats) {
+    EXPECT_EQ(result.stats_->games_, stats->games_);
+  }
+  size_t num_found = 0;
+  for (Move move : board.legal_moves()) {
+    Board child = board;
+    child.do_move(move);
+    num_found += db.find(child.key_).has_value();
+  }
+  ASSERT_EQ(result.moves_.size(), num_found);
+  for (size_t i = 0; i < result.moves_.size(); ++i) {
+    Board child = board;
+    child.do_move(result.moves_[i].move_);
+    const absl::optional<PositionStats> child_stats = db.find(child.key_);
+    ASSERT_TRUE(child_stats);
+    EXPECT_EQ(result.moves_[i].stats_.games_, child_stats->games_);
+    EXPECT_EQ(result.moves_[i].stats_.white_wins_, child_stats->white_wins_);
+    if (i > 0) {
+      EXPECT_GE(result.moves_[i - 1].stats_.games_,
+                result.moves_[i].stats_.games_);
+    }
+  }
+}
+
+std::string write_test_db() {
+  const std::string path = testing::TempDir() + "opening_explorer_test";
+  EXPECT_TRUE(build_opening_tree(test_games(), 20, 1).write_db(path));
+  return path;
+}
+}  // namespace.
+
+TEST(OpeningExplorer, ReturnsTheStatsOfTheMoves) {
+  const PositionDb db(write_test_db());
+  ASSERT_TRUE(db.is_open());
+  for (int prefix_plies : {0, 3, 20}) {
+    SCOPED_TRACE(prefix_plies);
+    ExplorerOptions options;
+    options.prefix_plies_ = prefix_plies;
+    options.prefix_min_games_ = 1;
+    OpeningExplorer explorer(&db, options);
+
+    const Board start;
+    const ExplorerResult result = explorer.explore(start);
+    expect_result(db, start, result);
+    ASSERT_EQ(result.moves_.size(), 3);
+    EXPECT_EQ(result.moves_[0].move_, uci_move(start, "e2e4"));
+    EXPECT_EQ(result.moves_[0].stats_.games_, 12);
+    // Ties in the order of the move generator.
+    EXPECT_EQ(result.moves_[1].stats_.games_, 4);
+    EXPECT_EQ(result.moves_[2].stats_.games_, 4);
+
+    // 2... Nf6 counts the games of 1. Nf3 d5 2. d4 Nf6 too.
+    const Board board = play({"d2d4", "d7d5", "g1f3"});
+    const ExplorerResult transposed = explorer.explore(board);
+    expect_result(db, board, transposed);
+    ASSERT_EQ(transposed.moves_.size(), 1);
+    EXPECT_EQ(transposed.moves_[0].move_, uci_move(board, "g8f6"));
+    EXPECT_EQ(transposed.moves_[0].stats_.games_, 8);
+
+    for (const Board& other :
+         {play({"e2e4", "e7e5"}), play({"e2e4", "c7c5", "g1f3", "d7d6"}),
+          play({"a2a3"})}) {
+      expect_result(db, other, explorer.explore(other));
+    }
+  }
+}
+
+TEST(OpeningExplorer, ServesThePrefixAndCachesTheRest) {
+  const PositionDb db(write_test_db());
+  ExplorerOptions options;
+  options.prefix_plies_ = 2;
+  options.prefix_min_games_ = 8;
+  OpeningExplorer explorer(&db, options);
+  // The start, 1. e4 and 1. e4 e5, the other moves having too few games.
+  EXPECT_EQ(explorer.num_prefix_positions(), 3);
+
+  explorer.explore(play({"e2e4", "e7e5"}));
+  EXPECT_EQ(explorer.num_prefix_hits(), 1);
+  EXPECT_EQ(explorer.num_lookups(), 0);
+  const Board deep = play({"e2e4", "e7e5", "g1f3"});
+  const ExplorerResult first = explorer.explore(deep);
+  EXPECT_EQ(explorer.num_lookups(), 1);
+  const ExplorerResult second = explorer.explore(deep);
+  EXPECT_EQ(explorer.num_lookups(), 1);
+  EXPECT_EQ(explorer.num_cache_hits(), 1);
+  ASSERT_EQ(second.moves_.size(), first.moves_.size());
+  EXPECT_EQ(second.moves_[0].move_, first.moves_[0].move_);
+}
+
+TEST(OpeningExplorer, EvictsTheLeastRecentlyQueried) {
+  const PositionDb db(write_test_db());
+  ExplorerOptions options;
+  options.prefix_plies_ = 0;
+  options.max_prefix_positions_ = 0;
+  // A position a shard.
+  options.cache_positions_ = OpeningExplorer::num_shards;
+  OpeningExplorer explorer(&db, options);
+
+  const Board first;
+  explorer.explore(first);
+  explorer.explore(first);
+  EXPECT_EQ(explorer.num_cache_hits(), 1);
+  // Positions until one shares the shard of the first.
+  const auto shard = [](const Board& board) {
+    return board.key_ >> (64 - OpeningExplorer::shard_bits);
+  };
+  bool is_evicted = false;
+  for (Move move : first.legal_moves()) {
+    Board board = first;
+    board.do_move(move);
+    for (Move reply : board.legal_moves()) {
+      Board child = board;
+      child.do_move(reply);
+      explorer.explore(child);
+      is_evicted = shard(child) == shard(first);
+      if (is_evicted) {
+        break;
+      }
+    }
+    if (is_evicted) {
+      break;
+    }
+  }
+  ASSERT_TRUE(is_evicted);
+  const uint64_t num_lookups = explorer.num_lookups();
+  explorer.explore(first);
+  EXPECT_EQ(explorer.num_lookups(), num_lookups + 1);
+}
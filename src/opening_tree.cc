@@ -0,0 +1,244 @@
+#include "opening_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "book.h"
+#include "pgn.h"
+#include "position_db.h"
+#include "thread_pool.h"
+
+namespace {
+// Returns the result of a game from its result token, or nullopt if it has
+// none.
+absl::optional<int> game_result(absl::string_view result) {
+  if (result == "1-0") {
+    return 1;
+  }
+  if (result == "0-1") {
+    return -1;
+  }
+  if (result == "1/2-1/2") {
+    return 0;
+  }
+  return absl::nullopt;
+}
+
+OpeningResults& results_of(OpeningMoves* moves, Move move) {
+  for (OpeningMove& opening_move : *moves) {
+    if (opening_move.move_ == move) {
+      return opening_move.results_;
+    }
+  }
+  moves->push_back({move, {}});
+  return moves->back().results_;
+}
+
+size_t thread_count(size_t num_threads) {
+  return num_threads > 0
+             ? num_threads
+             : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+}  // namespace.
+
+void OpeningResults::add(int result) {
+  ++games_;
+  white_wins_ += result > 0;
+  draws_ += result == 0;
+  black_wins_ += result < 0;
+}
+
+void OpeningResults::add(const OpeningResults& other) {
+  games_ += other.games_;
+  white_wins_ += other.white_wins_;
+  draws_ += other.draws_;
+  black_wins_ += other.black_wins_;
+}
+
+size_t OpeningTree::size() const {
+  size_t res = 0;
+  for (const Shard& shard : shards_) {
+    res += shard.size();
+  }
+  return res;
+}
+
+const OpeningMoves* OpeningTree::find(uint64_t key) const {
+  if (shards_.empty()) {
+    return nullptr;
+  }
+  const Shard& shard = shards_[shard_idx(key)];
+  const auto found = shard.find(key);
+  return found == shard.end() ? nullptr : &found->second;
+}
+
+bool OpeningTree::write_db(const std::string& path) const {
+  PositionDbWriter writer(path);
+  std::vector<uint64_t> keys;
+  std::vector<MoveCount> moves;
+  for (const Shard& shard : shards_) {
+    keys.clear();
+    for (const auto& position : shard) {
+      keys.push_back(position.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (uint64_t key : keys) {
+      OpeningResults results = {};
+      moves.clear();
+      for (const OpeningMove& move : shard.find(key)->second) {
+        results.add(move.results_);
+        moves.push_back({move.move_, move.results_.games_});
+      }
+      PositionStats stats = {};
+      stats.games_ = results.games_;
+      stats.white_wins_ = results.white_wins_;
+      stats.draws_ = results.draws_;
+      stats.black_wins_ = results.black_wins_;
+      set_top_moves(&moves, &stats);
+      writer.write(key, stats);
+    }
+  }
+  return writer.close();
+}
+
+bool OpeningTree::write_book(const std::string& path,
+                             const BookOptions& options) const {
+  BookBuilder builder(path, options.memory_bytes_);
+  // The positions are found by playing the moves of the tree from the start
+  // position, depth first, as the tree only has their keys.
+  absl::flat_hash_set<uint64_t> visited;
+  std::vector<Board> stack = {Board()};
+  std::vector<std::pair<Move, uint64_t>> weights;
+  while (!stack.empty()) {
+    const Board board = stack.back();
+    stack.pop_back();
+    const OpeningMoves* const moves = find(board.key_);
+    if (!moves || !visited.insert(board.key_).second) {
+      continue;
+    }
+    weights.clear();
+    uint64_t max_weight = 0;
+    for (const OpeningMove& move : *moves) {
+      const OpeningResults& results = move.results_;
+      const uint64_t wins =
+          board.is_whites_move_ ? results.white_wins_ : results.black_wins_;
+      const uint64_t points = 2 * wins + results.draws_;
+      if (results.games_ == 0 || results.games_ < options.min_games_ ||
+          static_cast<double>(points) <
+              2 * options.min_score_ * results.games_) {
+        continue;
+      }
+      weights.emplace_back(move.move_, points);
+      max_weight = std::max(max_weight, points);
+      stack.push_back(board);
+      stack.back().do_move(move.move_);
+    }
+    for (const auto& weight : weights) {
+      // Scaled by 65535 / max_weight and rounded up, so that no move with
+      // points ends up with a weight of 0.
+      const uint64_t scaled =
+          max_weight <= 65535
+              ? weight.second
+              : (weight.second * 65535 + max_weight - 1) / max_weight;
+      builder.add(board, weight.first, static_cast<int>(scaled));
+    }
+  }
+  return builder.finish();
+}
+
+OpeningTreeBuilder::OpeningTreeBuilder(size_t num_workers, int max_plies)
+    : max_plies_(max_plies), workers_(std::max<size_t>(num_workers, 1)) {
+  for (Worker& worker : workers_) {
+    worker.shards_.resize(OpeningTree::num_shards);
+  }
+}
+
+const char* OpeningTreeBuilder::add_game(size_t worker_idx,
+                                         const PgnGame& game) {
+  const absl::optional<int> result = game_result(game.result_);
+  if (!result) {
+    return nullptr;
+  }
+  const char* error = nullptr;
+  absl::optional<Board> board = game.start_position(&error);
+  if (!board) {
+    return error;
+  }
+  std::vector<OpeningTree::Shard>& shards = workers_[worker_idx].shards_;
+  absl::string_view movetext = game.movetext_;
+  absl::string_view san;
+  for (int ply = 0; ply < max_plies_ && next_san(&movetext, &san); ++ply) {
+    const absl::optional<Move> move = parse_san(*board, san);
+    if (!move) {
+      return "PGN invalid: A move isn't legal or is ambiguous.";
+    }
+    results_of(&shards[OpeningTree::shard_idx(board->key_)][board->key_],
+               *move)
+        .add(*result);
+    board->do_move(*move);
+  }
+  return nullptr;
+}
+
+OpeningTree OpeningTreeBuilder::finish(size_t num_threads) {
+  // Each task merges one shard of every worker into the first worker's, so
+  // tasks never touch the same map.
+  {
+    ThreadPool pool(std::min(thread_count(num_threads),
+                             OpeningTree::num_shards));
+    for (size_t shard_idx = 0; shard_idx < OpeningTree::num_shards;
+         ++shard_idx) {
+      pool.submit([this, shard_idx]() {
+        OpeningTree::Shard& merged = workers_[0].shards_[shard_idx];
+        for (size_t worker_idx = 1; worker_idx < workers_.size();
+             ++worker_idx) {
+          OpeningTree::Shard& shard = workers_[worker_idx].shards_[shard_idx];
+          for (const auto& position : shard) {
+            OpeningMoves& moves = merged[position.first];
+            for (const OpeningMove& move : position.second) {
+              results_of(&moves, move.move_).add(move.results_);
+            }
+          }
+          OpeningTree::Shard().swap(shard);
+        }
+      });
+    }
+    pool.wait();
+  }
+  OpeningTree res;
+  res.shards_ = std::move(workers_[0].shards_);
+  workers_[0].shards_.resize(OpeningTree::num_shards);
+  return res;
+}
+
+OpeningTree build_opening_tree(absl::string_view text, int max_plies,
+                               size_t num_threads, uint64_t* num_errors) {
+  num_threads = thread_count(num_threads);
+  OpeningTreeBuilder builder(num_threads, max_plies);
+  std::atomic<uint64_t> errors(0);
+  {
+    ThreadPool pool(num_threads);
+    read_games_parallel(
+        text, &pool,
+        [&builder, &errors](size_t worker_idx, const PgnGame& game,
+                            std::string*) {
+          if (builder.add_game(worker_idx, game)) {
+            errors.fetch_add(1, std::memory_order_relaxed);
+          }
+        });
+  }
+  if (num_errors) {
+    *num_errors = errors.load();
+  }
+  return builder.finish(num_threads);
+}
@@ -0,0 +1,117 @@
+#ifndef OPENING_TREE_H
+#define OPENING_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+#include "board.h"
+#include "pgn.h"
+
+// The opening tree of a collection of games: for every position reached in
+// the first plies of the games, keyed by Zobrist key, the moves played from
+// it and how the games went on with each.
+//
+// It is built on many threads at once without locks. Every worker adds games
+// to maps of its own, split into shards by the top bits of the key, and at the
+// end the shards are merged, each shard of all workers on one thread. Sharding
+// by the top bits also keeps the shards in key order, which is the order the
+// position database (see position_db.h) is written in.
+
+struct OpeningResults {
+  uint32_t games_;
+  uint32_t white_wins_;
+  uint32_t draws_;
+  uint32_t black_wins_;
+
+  // Adds a game with `result`: 1 if white won, -1 if black did, 0 for a draw.
+  void add(int result);
+  void add(const OpeningResults& other);
+};
+
+struct OpeningMove {
+  Move move_;
+  OpeningResults results_;
+};
+
+// Most positions past the first few plies were only ever left by one or two
+// moves, which then need no allocation.
+using OpeningMoves = absl::InlinedVector<OpeningMove, 4>;
+
+// Which moves of a tree go into an opening book, and how much memory the
+// book takes to build.
+struct BookOptions {
+  // The moves played in fewer games are left out.
+  uint32_t min_games_ = 1;
+  // The moves that scored less for the side that played them, a win counting
+  // 1 and a draw 1/2 a game, are left out.
+  double min_score_ = 0;
+  size_t memory_bytes_ = size_t{256} << 20;
+};
+
+class OpeningTree {
+ public:
+  static constexpr int shard_bits = 6;
+  static constexpr size_t num_shards = size_t{1} << shard_bits;
+  using Shard = absl::flat_hash_map<uint64_t, OpeningMoves>;
+
+  static size_t shard_idx(uint64_t key) { return key >> (64 - shard_bits); }
+
+  // The number of positions.
+  size_t size() const;
+  // Returns the moves played from the position with `key`, in the order they
+  // were first seen, or null if it isn't in the tree.
+  const OpeningMoves* find(uint64_t key) const;
+  // Writes the tree as a position database at `path`. Returns false if a file
+  // couldn't be written.
+  bool write_db(const std::string& path) const;
+  // Writes the moves of the positions reached from the start position as a
+  // Polyglot book at `path` (see book.h), each weighted by the points it
+  // scored for the side that played it, 2 a win and 1 a draw, scaled down
+  // with the other moves of its position if that is more than a weight holds.
+  // Returns false if a file couldn't be written.
+  bool write_book(const std::string& path, const BookOptions& options) const;
+
+ private:
+  friend class OpeningTreeBuilder;
+
+  std::vector<Shard> shards_;
+};
+
+class OpeningTreeBuilder {
+ public:
+  // Takes games from `num_workers` threads, each only ever adding as one
+  // worker, and keeps their first `max_plies` moves.
+  OpeningTreeBuilder(size_t num_workers, int max_plies);
+
+  // Adds `game` on the thread of worker `worker_idx`. Games without a result
+  // add nothing, since they have nothing to count. Returns null, or what is
+  // wrong with the game if it can't be read, after adding the moves before
+  // the error.
+  const char* add_game(size_t worker_idx, const PgnGame& game);
+  // Merges what the workers added on `num_threads` threads, 0 for one per
+  // hardware thread, and returns the tree. The builder is left empty.
+  OpeningTree finish(size_t num_threads);
+
+ private:
+  // Aligned so that workers on neighbouring threads don't share a cache line.
+  struct alignas(64) Worker {
+    std::vector<OpeningTree::Shard> shards_;
+  };
+
+  int max_plies_;
+  std::vector<Worker> workers_;
+};
+
+// Builds the tree of the first `max_plies` moves of every game of the PGN
+// `text` on `num_threads` threads, 0 for one per hardware thread. Games that
+// can't be read are counted in `*num_errors` unless it is null.
+OpeningTree build_opening_tree(absl::string_view text, int max_plies,
+                               size_t num_threads,
+                               uint64_t* num_errors = nullptr);
+
+#endif
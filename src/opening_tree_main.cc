@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "mapped_file.h"
+#include "opening_tree.h"
+
+// Usage: opening_tree [--threads <n>] [--plies <n>] [--book <path>]
+//                     [--min-games <n>] [--min-score <score>] <pgn> <db>
+//
+// Builds the opening tree of the games of a PGN file, the first 30 plies of
+// each or as many as --plies says, and writes it as the position database
+// <db>.keys and <db>.stats (see position_db.h). The games are read on
+// --threads threads, one per hardware thread by default. With --book, the
+// tree is also written as a Polyglot book, of the moves played in at least
+// --min-games games that scored at least --min-score, from 0 to 1, for the
+// side that played them.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--threads <n>] [--plies <n>] [--book <path>]"
+               " [--min-games <n>] [--min-score <score>] <pgn> <db>\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  int arg_idx = 1;
+  int num_threads = 0;
+  int max_plies = 30;
+  std::string book_path;
+  BookOptions book_options;
+  for (; arg_idx < argc && std::strncmp(argv[arg_idx], "--", 2) == 0;
+       ++arg_idx) {
+    if (std::strcmp(argv[arg_idx], "--threads") == 0 && arg_idx + 1 < argc &&
+        absl::SimpleAtoi(argv[arg_idx + 1], &num_threads) &&
+        num_threads >= 0) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--plies") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtoi(argv[arg_idx + 1], &max_plies) &&
+               max_plies > 0) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--book") == 0 &&
+               arg_idx + 1 < argc) {
+      book_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--min-games") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtoi(argv[arg_idx + 1], &book_options.min_games_)) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--min-score") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtod(argv[arg_idx + 1], &book_options.min_score_)) {
+      ++arg_idx;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (arg_idx + 2 != argc) {
+    return usage(argv[0]);
+  }
+  const MappedFile pgn(argv[arg_idx]);
+  if (!pgn.data()) {
+    std::cerr << "Can't open " << argv[arg_idx] << '\n';
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t num_errors = 0;
+  const OpeningTree tree = build_opening_tree(
+      absl::string_view(pgn.data(), pgn.size()), max_plies,
+      static_cast<size_t>(num_threads), &num_errors);
+  if (!tree.write_db(argv[arg_idx + 1])) {
+    std::cerr << "Can't write " << argv[arg_idx + 1] << '\n';
+    return 1;
+  }
+  if (!book_path.empty() && !tree.write_book(book_path, book_options)) {
+    std::cerr << "Can't write " << book_path << '\n';
+    return 1;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "Positions: " << tree.size() << '\n';
+  std::cout << "Unreadable games: " << num_errors << '\n';
+  std::cout << "Time: " << elapsed.count() << " s\n";
+  return 0;
+}
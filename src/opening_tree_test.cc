@@ -0,0 +1,130 @@
+#include "opening_tree.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "book.h"
+#include "gtest/gtest.h"
+#include "position_db.h"
+
+namespace {
+// 30 games of three openings, a third each, so that every thread of a build
+// gets some of each.
+std::string test_games() {
+  const char* const games[] = {
+      "1. e4 e5 2. Nf3 Nc6 3. Bb5 1-0",
+      "1. e4 c5 2. Nf3 d6 0-1",
+      "1. d4 d5 2. c4 1/2-1/2",
+  };
+  std::string res;
+  for (int i = 0; i < 30; ++i) {
+    res += "[Event \"Test\"]\n\n";
+    res += games[i % 3];
+    res += "\n\n";
+  }
+  // Neither counted nor an error.
+  res += "[Event \"Unfinished\"]\n\n1. e4 e5 *\n\n";
+  res += "[Event \"Illegal\"]\n\n1. e4 e5 2. Ke3 1-0\n\n";
+  return res;
+}
+
+Move uci_move(const Board& board, const char* uci) {
+  const absl::optional<Move> move = parse_uci_move(board, uci);
+  EXPECT_TRUE(move) << uci;
+  return *move;
+}
+}  // namespace.
+
+TEST(OpeningTree, CountsMovesAndResults) {
+  for (size_t num_threads : {1, 4}) {
+    uint64_t num_errors = 0;
+    const OpeningTree tree =
+        build_opening_tree(test_games(), 3, num_threads, &num_errors);
+    EXPECT_EQ(num_errors, 1);
+
+    Board board;
+    const OpeningMoves* moves = tree.find(board.key_);
+    ASSERT_NE(moves, nullptr);
+    ASSERT_EQ(moves->size(), 2);
+    for (const OpeningMove& move : *moves) {
+      if (move.move_ == uci_move(board, "e2e4")) {
+        // The illegal game is counted up to its error.
+        EXPECT_EQ(move.results_.games_, 21);
+        EXPECT_EQ(move.results_.white_wins_, 11);
+        EXPECT_EQ(move.results_.black_wins_, 10);
+      } else {
+        EXPECT_EQ(move.move_, uci_move(board, "d2d4"));
+        EXPECT_EQ(move.results_.games_, 10);
+        EXPECT_EQ(move.results_.draws_, 10);
+      }
+    }
+
+    // Only the first three plies are kept.
+    board.do_move(uci_move(board, "d2d4"));
+    board.do_move(uci_move(board, "d7d5"));
+    moves = tree.find(board.key_);
+    ASSERT_NE(moves, nullptr);
+    ASSERT_EQ(moves->size(), 1);
+    EXPECT_EQ((*moves)[0].move_, uci_move(board, "c2c4"));
+    board.do_move(uci_move(board, "c2c4"));
+    EXPECT_EQ(tree.find(board.key_), nullptr);
+    // The start, 1. e4, 1. e4 e5, 1. e4 c5, 1. d4 and 1. d4 d5.
+    EXPECT_EQ(tree.size(), 6);
+  }
+}
+
+TEST(OpeningTree, WritesPositionDb) {
+  const OpeningTree tree = build_opening_tree(test_games(), 10, 2);
+  const std::string path = testing::TempDir() + "opening_tree_test";
+  ASSERT_TRUE(tree.write_db(path));
+  const PositionDb db(path);
+  ASSERT_TRUE(db.is_open());
+  EXPECT_EQ(db.size(), tree.size());
+
+  Board board;
+  const absl::optional<PositionStats> stats = db.find(board.key_);
+  ASSERT_TRUE(stats);
+  EXPECT_EQ(stats->games_, 31);
+  EXPECT_EQ(stats->white_wins_, 11);
+  EXPECT_EQ(stats->draws_, 10);
+  EXPECT_EQ(stats->black_wins_, 10);
+  EXPECT_EQ(stats->top_moves_[0].move_, uci_move(board, "e2e4"));
+  EXPECT_EQ(stats->top_moves_[0].count_, 21);
+  EXPECT_EQ(stats->top_moves_[1].move_, uci_move(board, "d2d4"));
+  EXPECT_EQ(stats->top_moves_[1].count_, 10);
+  EXPECT_EQ(stats->top_moves_[2].count_, 0);
+}
+
+TEST(OpeningTree, WritesPolyglotBook) {
+  const OpeningTree tree = build_opening_tree(test_games(), 10, 2);
+  const std::string path = testing::TempDir() + "opening_tree_test.bin";
+  ASSERT_TRUE(tree.write_book(path, BookOptions()));
+  Board board;
+  {
+    const OpeningBook book(path);
+    const std::vector<OpeningBook::Entry> moves = book.moves(board);
+    ASSERT_EQ(moves.size(), 2);
+    // 11 of the 21 games of 1. e4 won, and the 10 of 1. d4 drawn.
+    EXPECT_EQ(moves[0].move_, uci_move(board, "e2e4"));
+    EXPECT_EQ(moves[0].weight_, 22);
+    EXPECT_EQ(moves[1].move_, uci_move(board, "d2d4"));
+    EXPECT_EQ(moves[1].weight_, 10);
+  }
+
+  BookOptions options;
+  options.min_games_ = 11;
+  options.min_score_ = 0.5;
+  ASSERT_TRUE(tree.write_book(path, options));
+  const OpeningBook book(path);
+  const std::vector<OpeningBook::Entry> moves = book.moves(board);
+  ASSERT_EQ(moves.size(), 1);
+  EXPECT_EQ(moves[0].move_, uci_move(board, "e2e4"));
+  // 1... e5 lost all of its 11 games and 1... c5 has 10.
+  board.do_move(moves[0].move_);
+  EXPECT_TRUE(book.moves(board).empty());
+  EXPECT_EQ(book.size(), 1);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,98 @@
+#include "packed_position.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "bitboard.h"
+#include "board.h"
+#include "debug_check.h"
+
+namespace {
+constexpr uint8_t no_en_passant_idx = 64;
+constexpr uint8_t black_nibble = 8;
+
+template <typename T>
+T clamp_to(int value) {
+  return static_cast<T>(std::min<int>(
+      std::max<int>(value, std::numeric_limits<T>::min()),
+      std::numeric_limits<T>::max()));
+}
+}  // namespace.
+
+PackedPosition pack_position(const Board& board, int score, int result) {
+  DEBUG_CHECK(popcount(board.occupancy_) <= 32, "Too many pieces to pack.");
+  PackedPosition res = {};
+  res.occupancy_ = board.occupancy_;
+  size_t nibble_idx = 0;
+  for (Bitboard sq : bitboard_split(board.occupancy_)) {
+    const int sq_idx = square_idx(sq);
+    const unsigned nibble =
+        static_cast<unsigned>(board.mailbox_[static_cast<size_t>(sq_idx)]) |
+        static_cast<unsigned>((board.black_occupancy_ >> sq_idx) & 1) << 3;
+    res.pieces_[nibble_idx / 2] |=
+        static_cast<uint8_t>(nibble << (4 * (nibble_idx % 2)));
+    ++nibble_idx;
+  }
+  res.flags_ = static_cast<uint8_t>((board.is_whites_move_ ? 0 : 1) |
+                                    board.castling_rights_ << 1);
+  res.en_passant_idx_ =
+      board.en_passant_square_
+          ? static_cast<uint8_t>(square_idx(board.en_passant_square_))
+          : no_en_passant_idx;
+  res.fifty_move_clock_ = clamp_to<uint8_t>(board.fifty_move_clock_);
+  res.result_ = clamp_to<int8_t>(result);
+  res.num_moves_ = clamp_to<uint16_t>(board.num_moves_);
+  res.score_ = clamp_to<int16_t>(score);
+  return res;
+}
+
+Board unpack_position(const PackedPosition& packed) {
+  Board res;
+  // The bitboard of each nibble value, so that each piece is one or and one
+  // store whatever it is.
+  std::array<Bitboard, 16> nibble_squares = {};
+  res.mailbox_.fill(Piece::none);
+  size_t nibble_idx = 0;
+  for (Bitboard sq : bitboard_split(packed.occupancy_)) {
+    const unsigned nibble =
+        (packed.pieces_[nibble_idx / 2] >> (4 * (nibble_idx % 2))) & 0xF;
+    DEBUG_CHECK((nibble & 7) < num_piece_types, "Not a packed piece.");
+    nibble_squares[nibble] |= sq;
+    res.mailbox_[static_cast<size_t>(square_idx(sq))] =
+        static_cast<Piece>(nibble & 7);
+    ++nibble_idx;
+  }
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    res.pieces_[static_cast<size_t>(Color::white)][piece] =
+        nibble_squares[piece];
+    res.pieces_[static_cast<size_t>(Color::black)][piece] =
+        nibble_squares[piece | black_nibble];
+  }
+  res.init_occupancy();
+  res.is_whites_move_ = !(packed.flags_ & 1);
+  res.castling_rights_ = static_cast<uint8_t>((packed.flags_ >> 1) & 0xF);
+  res.en_passant_square_ = packed.en_passant_idx_ < no_en_passant_idx
+                               ? lsb_bitboard << packed.en_passant_idx_
+                               : 0;
+  res.fifty_move_clock_ = packed.fifty_move_clock_;
+  res.num_moves_ = packed.num_moves_;
+  res.init_state();
+  return res;
+}
+
+void pack_positions(const Board* boards, const int* scores, const int* results,
+                    size_t num_positions, PackedPosition* packed) {
+  for (size_t i = 0; i < num_positions; ++i) {
+    packed[i] = pack_position(boards[i], scores[i], results[i]);
+  }
+}
+
+void unpack_positions(const PackedPosition* packed, size_t num_positions,
+                      Board* boards) {
+  for (size_t i = 0; i < num_positions; ++i) {
+    boards[i] = unpack_position(packed[i]);
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef PACKED_POSITION_H
+#define PACKED_POSITION_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "board.h"
+
+// A position of training data in 32 bytes, an eighth of its FEN or less: the
+// occupied squares, a nibble per occupied square for its piece, and the rest
+// of the state packed into the bytes left over, with a score and the result
+// of the game it comes from. The nibbles are in the order of the square
+// indices, so decoding walks the occupancy bits and the nibbles together with
+// no branch on the piece, and files of packed positions can be read straight
+// into arrays of them. The fields are little endian, like the hosts the
+// engine runs on.
+struct PackedPosition {
+  Bitboard occupancy_;
+  // Two nibbles a byte, the lower one first. A nibble is the Piece of the
+  // square, plus 8 for black.
+  std::array<uint8_t, 16> pieces_;
+  // Bit 0 is set with black to move, bits 1 to 4 are the CastlingRights.
+  uint8_t flags_;
+  // The square index of the en passant square, or 64 for none.
+  uint8_t en_passant_idx_;
+  // Capped at 255.
+  uint8_t fifty_move_clock_;
+  // 1 if white won the game, -1 if black did and 0 for a draw.
+  int8_t result_;
+  // Capped at 65535.
+  uint16_t num_moves_;
+  // From the side to move's point of view.
+  int16_t score_;
+};
+
+static_assert(sizeof(PackedPosition) == 32,
+              "A packed position should take 32 bytes.");
+static_assert(std::is_trivially_copyable<PackedPosition>::value,
+              "Packed positions are read and written as bytes.");
+
+// Returns `board` packed with its `score` and the `result` of its game. The
+// board must have at most 32 pieces, as legal positions do. The score is
+// clamped to 16 bits.
+PackedPosition pack_position(const Board& board, int score, int result);
+// Returns the board of `packed`, with its keys and sums computed.
+Board unpack_position(const PackedPosition& packed);
+
+// The same for `num_positions` positions at once, which keeps the tables the
+// loops use in cache and lets the loops of neighbouring positions overlap.
+void pack_positions(const Board* boards, const int* scores, const int* results,
+                    size_t num_positions, PackedPosition* packed);
+void unpack_positions(const PackedPosition* packed, size_t num_positions,
+                      Board* boards);
+
+#endif
@@ -0,0 +1,61 @@
+#include "packed_position.h"
+
+#include <cstring>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+const char* const fens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b Kq - 17 40",
+    "8/8/8/8/8/8/8/k6K w - - 99 300",
+};
+}  // namespace.
+
+TEST(PackedPosition, RoundTrips) {
+  for (const char* fen : fens) {
+    const Board board(fen);
+    const PackedPosition packed = pack_position(board, -123, -1);
+    EXPECT_EQ(packed.score_, -123);
+    EXPECT_EQ(packed.result_, -1);
+    const Board unpacked = unpack_position(packed);
+    EXPECT_EQ(unpacked, board) << fen;
+    EXPECT_EQ(unpacked.to_fen(), fen);
+    EXPECT_TRUE(unpacked.has_consistent_state()) << fen;
+  }
+}
+
+TEST(PackedPosition, ClampsWhatDoesNotFit) {
+  Board board(fens[0]);
+  board.fifty_move_clock_ = 1000;
+  board.num_moves_ = 100000;
+  const PackedPosition packed = pack_position(board, 40000, 1);
+  EXPECT_EQ(packed.fifty_move_clock_, 255);
+  EXPECT_EQ(packed.num_moves_, 65535);
+  EXPECT_EQ(packed.score_, 32767);
+  EXPECT_EQ(pack_position(board, -40000, 0).score_, -32768);
+}
+
+TEST(PackedPosition, PacksBatches) {
+  std::vector<Board> boards;
+  std::vector<int> scores;
+  std::vector<int> results;
+  for (const char* fen : fens) {
+    boards.emplace_back(fen);
+    scores.push_back(static_cast<int>(scores.size()) * 10);
+    results.push_back(0);
+  }
+  std::vector<PackedPosition> packed(boards.size());
+  pack_positions(boards.data(), scores.data(), results.data(), boards.size(),
+                 packed.data());
+  for (size_t i = 0; i < boards.size(); ++i) {
+    const PackedPosition one = pack_position(boards[i], scores[i], 0);
+    EXPECT_EQ(std::memcmp(&packed[i], &one, sizeof(one)), 0);
+  }
+  std::vector<Board> unpacked(boards.size());
+  unpack_positions(packed.data(), packed.size(), unpacked.data());
+  EXPECT_EQ(unpacked, boards);
+}
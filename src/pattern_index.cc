@@ -0,0 +1,300 @@
+#include "pattern_index.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "bitboard.h"
+#include "board.h"
+#include "bulk_io.h"
+#include "game_archive.h"
+#include "mapped_file.h"
+
+namespace {
+constexpr char magic[8] = {'P', 'G', 'P', 'A', 'T', 'T', 'R', 'N'};
+constexpr size_t block_positions = 64;
+constexpr size_t num_features = num_colors * num_piece_types * 64;
+// The letters of the pieces, in the order of Piece.
+constexpr char piece_letters[] = "prnbqk";
+
+// The two signature bits of a piece of a color on a square, feature
+// (color * num_piece_types + piece) * 64 + square index.
+struct FeatureBits {
+  std::array<uint8_t, 2> bits_;
+};
+
+constexpr std::array<FeatureBits, num_features> make_feature_bits() {
+  std::array<FeatureBits, num_features> res = {};
+  for (size_t feature = 0; feature < num_features; ++feature) {
+    const uint64_t hash = (feature + 1) * 0x9E3779B97F4A7C15;
+    const auto first = static_cast<uint8_t>(hash >> 56);
+    auto second = static_cast<uint8_t>(hash >> 48);
+    if (second == first) {
+      second = static_cast<uint8_t>(second ^ 1);
+    }
+    res[feature].bits_ = {first, second};
+  }
+  return res;
+}
+
+constexpr std::array<FeatureBits, num_features> feature_bits =
+    make_feature_bits();
+static_assert(PatternIndex::signature_bits == 256,
+              "Feature bits are bytes.");
+
+constexpr size_t feature(size_t color, size_t piece, Bitboard square) {
+  return (color * num_piece_types + piece) * 64 +
+         static_cast<size_t>(square_idx(square));
+}
+}  // namespace.
+
+bool matches_pattern(const Board& board, const PositionPattern& pattern) {
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      const Bitboard have = board.pieces_[color][piece];
+      const Bitboard want = pattern.pieces_[color][piece];
+      if ((have & want) != want ||
+          (pattern.is_exact_[color][piece] && have != want)) {
+        return false;
+      }
+    }
+  }
+  return (board.all_pieces() & pattern.empty_) == 0;
+}
+
+bool parse_pattern(absl::string_view text, PositionPattern* pattern) {
+  *pattern = PositionPattern();
+  for (absl::string_view word : absl::StrSplit(text, ' ', absl::SkipEmpty())) {
+    const bool is_exact = word[0] == '=';
+    const bool is_empty = word[0] == '-';
+    if (word.size() != (is_exact ? 2 : 3)) {
+      return false;
+    }
+    if (!is_exact) {
+      const absl::string_view name = word.substr(1);
+      if (name[0] < 'a' || name[0] > 'h' || name[1] < '1' || name[1] > '8') {
+        return false;
+      }
+      if (is_empty) {
+        pattern->empty_ |= str_to_square(name);
+        continue;
+      }
+    }
+    const char letter = word[is_exact ? 1 : 0];
+    const char lower = static_cast<char>(letter | 0x20);
+    const char* const found = std::strchr(piece_letters, lower);
+    if (!found || !*found) {
+      return false;
+    }
+    const size_t color = letter == lower ? 1 : 0;
+    const auto piece = static_cast<size_t>(found - piece_letters);
+    if (is_exact) {
+      pattern->is_exact_[color][piece] = true;
+    } else {
+      pattern->pieces_[color][piece] |= str_to_square(word.substr(1));
+    }
+  }
+  return true;
+}
+
+PatternIndex::PatternIndex() : first_positions_{0}, num_positions_(0) {}
+
+std::unique_ptr<PatternIndex> PatternIndex::build(const GameArchive& archive) {
+  std::unique_ptr<PatternIndex> res(new PatternIndex);
+  res->first_positions_.reserve(archive.num_games() + 1);
+  res->slices_.reserve((archive.num_moves() + archive.num_games()) /
+                           block_positions * signature_bits +
+                       signature_bits);
+  for (size_t i = 0; i < archive.num_blocks(); ++i) {
+    const bool is_valid = archive.decode_block(
+        i, [&](size_t, const Board& start, const Move* moves,
+               size_t num_moves) {
+          Board board = start;
+          res->add_position(board);
+          for (size_t ply = 0; ply < num_moves; ++ply) {
+            board.do_move(moves[ply]);
+            res->add_position(board);
+          }
+          res->first_positions_.push_back(res->num_positions_);
+        });
+    if (!is_valid) {
+      return nullptr;
+    }
+  }
+  return res;
+}
+
+void PatternIndex::add_position(const Board& board) {
+  if (num_positions_ % block_positions == 0) {
+    slices_.resize(slices_.size() + signature_bits);
+  }
+  uint64_t* const slices = &slices_[slices_.size() - signature_bits];
+  const uint64_t position_bit = uint64_t{1}
+                                << (num_positions_ % block_positions);
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      for (Bitboard sq : bitboard_split(board.pieces_[color][piece])) {
+        for (uint8_t bit : feature_bits[feature(color, piece, sq)].bits_) {
+          slices[bit] |= position_bit;
+        }
+      }
+    }
+  }
+  ++num_positions_;
+}
+
+size_t PatternIndex::find_game(uint64_t position_idx) const {
+  return static_cast<size_t>(std::upper_bound(first_positions_.begin(),
+                                              first_positions_.end(),
+                                              position_idx) -
+                             first_positions_.begin() - 1);
+}
+
+void PatternIndex::find_candidates(const PositionPattern& pattern,
+                                   std::vector<uint64_t>* candidates) const {
+  // The bits of the signature the pattern sets, each once.
+  std::array<bool, signature_bits> is_set = {};
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      for (Bitboard sq : bitboard_split(pattern.pieces_[color][piece])) {
+        for (uint8_t bit : feature_bits[feature(color, piece, sq)].bits_) {
+          is_set[bit] = true;
+        }
+      }
+    }
+  }
+  std::vector<size_t> bits;
+  for (size_t bit = 0; bit < signature_bits; ++bit) {
+    if (is_set[bit]) {
+      bits.push_back(bit);
+    }
+  }
+
+  candidates->clear();
+  const size_t num_blocks = slices_.size() / signature_bits;
+  for (size_t block = 0; block < num_blocks; ++block) {
+    const size_t block_size = static_cast<size_t>(std::min<uint64_t>(
+        num_positions_ - block * block_positions, block_positions));
+    uint64_t positions = block_size == block_positions
+                             ? ~uint64_t{0}
+                             : (uint64_t{1} << block_size) - 1;
+    const uint64_t* const slices = &slices_[block * signature_bits];
+    for (size_t i = 0; i < bits.size() && positions; ++i) {
+      positions &= slices[bits[i]];
+    }
+    for (Bitboard position : bitboard_split(positions)) {
+      candidates->push_back(block * block_positions +
+                            static_cast<uint64_t>(square_idx(position)));
+    }
+  }
+}
+
+bool PatternIndex::search(const GameArchive& archive,
+                          const PositionPattern& pattern,
+                          const PatternMatchFn& fn,
+                          uint64_t* num_candidates) const {
+  std::vector<uint64_t> candidates;
+  find_candidates(pattern, &candidates);
+  if (num_candidates) {
+    *num_candidates = candidates.size();
+  }
+  if (archive.num_games() != num_games()) {
+    return false;
+  }
+  // The candidates of a block of the archive are checked as its games are
+  // decoded, from where the decoding of the last one stopped.
+  size_t next = 0;
+  while (next < candidates.size()) {
+    const size_t first_next = next;
+    const bool is_valid = archive.decode_block(
+        archive.find_block(find_game(candidates[next])),
+        [&](size_t game_idx, const Board& start, const Move* moves,
+            size_t num_moves) {
+          const uint64_t first = first_positions_[game_idx];
+          const uint64_t end = first_positions_[game_idx + 1];
+          if (next == candidates.size() || candidates[next] >= end ||
+              end - first != num_moves + 1) {
+            return;
+          }
+          Board board = start;
+          size_t ply = 0;
+          for (; next < candidates.size() && candidates[next] < end; ++next) {
+            const auto target = static_cast<size_t>(candidates[next] - first);
+            for (; ply < target; ++ply) {
+              board.do_move(moves[ply]);
+            }
+            if (matches_pattern(board, pattern)) {
+              fn(game_idx, ply, board);
+            }
+          }
+        });
+    if (!is_valid || next == first_next) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PatternIndex::save(const std::string& path) const {
+  BulkFileWriter out(path, false);
+  const uint64_t sizes[2] = {first_positions_.size(), num_positions_};
+  out.write(magic, sizeof(magic));
+  out.write(sizes, sizeof(sizes));
+  out.write(first_positions_.data(),
+            first_positions_.size() * sizeof(uint64_t));
+  out.write(slices_.data(), slices_.size() * sizeof(uint64_t));
+  return out.close();
+}
+
+std::unique_ptr<PatternIndex> PatternIndex::load(const std::string& path,
+                                                 std::string* error) {
+  const MappedFile file(path);
+  if (!file.data()) {
+    *error = absl::StrCat("can't read ", path);
+    return nullptr;
+  }
+  const size_t header_size = sizeof(magic) + 2 * sizeof(uint64_t);
+  if (file.size() < header_size ||
+      std::memcmp(file.data(), magic, sizeof(magic)) != 0) {
+    *error = absl::StrCat(path, " is not a pattern index");
+    return nullptr;
+  }
+  uint64_t num_games_plus_one;
+  uint64_t num_positions;
+  std::memcpy(&num_games_plus_one, file.data() + sizeof(magic), 8);
+  std::memcpy(&num_positions, file.data() + sizeof(magic) + 8, 8);
+  const size_t num_words = (file.size() - header_size) / sizeof(uint64_t);
+  const uint64_t num_slices =
+      (num_positions + block_positions - 1) / block_positions *
+      signature_bits;
+  if (num_games_plus_one == 0 || num_games_plus_one > num_words ||
+      num_slices != num_words - num_games_plus_one ||
+      (file.size() - header_size) % sizeof(uint64_t) != 0) {
+    *error = absl::StrCat(path, " is cut short");
+    return nullptr;
+  }
+  std::unique_ptr<PatternIndex> res(new PatternIndex);
+  res->num_positions_ = num_positions;
+  res->first_positions_.resize(num_games_plus_one);
+  std::memcpy(res->first_positions_.data(), file.data() + header_size,
+              num_games_plus_one * sizeof(uint64_t));
+  res->slices_.resize(num_slices);
+  std::memcpy(res->slices_.data(),
+              file.data() + header_size + num_games_plus_one * 8,
+              num_slices * sizeof(uint64_t));
+  const std::vector<uint64_t>& first = res->first_positions_;
+  if (first.front() != 0 || first.back() != num_positions ||
+      !std::is_sorted(first.begin(), first.end())) {
+    *error = absl::StrCat(path, " has corrupt game offsets");
+    return nullptr;
+  }
+  return res;
+}
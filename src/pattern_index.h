@@ -0,0 +1,107 @@
+#ifndef PATTERN_INDEX_H
+#define PATTERN_INDEX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "bitboard.h"
+#include "board.h"
+#include "game_archive.h"
+
+// What a position must have, such as a white bishop on g7 and the black king
+// on h8, or a pawn structure.
+struct PositionPattern {
+  // The squares each piece of each color must be on, at least.
+  std::array<std::array<Bitboard, num_piece_types>, num_colors> pieces_ = {};
+  // The pieces that must be on exactly the squares of `pieces_`, such as the
+  // pawns of a pawn structure.
+  std::array<std::array<bool, num_piece_types>, num_colors> is_exact_ = {};
+  // Squares that must be empty.
+  Bitboard empty_ = 0;
+};
+
+// Returns whether `board` has `pattern`.
+bool matches_pattern(const Board& board, const PositionPattern& pattern);
+
+// Reads a pattern of words separated by spaces: a piece letter and a square,
+// such as "Bg7" or "kh8", white's pieces in upper case and black's in lower
+// case, "-e4" for a square that must be empty, and "=P" for pieces that must
+// be on the squares given and no others. Returns false if a word isn't one of
+// these.
+bool parse_pattern(absl::string_view text, PositionPattern* pattern);
+
+// Called with the position `ply` plies into game `game_idx` of an archive,
+// which has the pattern searched for.
+typedef std::function<void(size_t game_idx, size_t ply, const Board& board)>
+    PatternMatchFn;
+
+// An index of the positions of the games of an archive (see game_archive.h)
+// to search for patterns without replaying every game.
+//
+// Each position has a signature of `signature_bits` bits, a Bloom filter of
+// the pieces on their squares: every piece of a color on a square sets the
+// same two bits, picked by a hash. The signatures are stored bit-sliced, in
+// blocks of 64 positions in the order of the games: a block has a 64 bit
+// word for each bit of the signature, with a bit set for each position of
+// the block that has it. A pattern sets bits of a signature too, those of its
+// pieces, and the positions of a block that may have it are the AND of the
+// words of these bits, a few loads for 64 positions. Only those are then
+// replayed and checked on the board. On self-play games the candidates that
+// didn't match were under 0.5% of the positions for most single pieces, up
+// to 10% for some, and fewer the more pieces the pattern has. The index
+// takes `signature_bits / 8` bytes a position.
+class PatternIndex {
+ public:
+  static constexpr size_t signature_bits = 256;
+
+  PatternIndex(const PatternIndex&) = delete;
+  PatternIndex& operator=(const PatternIndex&) = delete;
+
+  // Indexes the positions of the games of `archive`, from the start position
+  // of each to its end. Returns null if a game doesn't decode.
+  static std::unique_ptr<PatternIndex> build(const GameArchive& archive);
+
+  uint64_t num_positions() const { return num_positions_; }
+  size_t num_games() const { return first_positions_.size() - 1; }
+
+  // Sets `*candidates` to the positions that may have `pattern`, counted
+  // over the games in order, in order.
+  void find_candidates(const PositionPattern& pattern,
+                       std::vector<uint64_t>* candidates) const;
+  // Calls `fn` for the positions of `archive`, the archive the index was
+  // built from, that have `pattern`, in order, decoding only the blocks of
+  // the archive with candidates. Returns false if a game doesn't decode or doesn't match
+  // the index. If `num_candidates` isn't null, it is set to the number of
+  // positions checked.
+  bool search(const GameArchive& archive, const PositionPattern& pattern,
+              const PatternMatchFn& fn,
+              uint64_t* num_candidates = nullptr) const;
+
+  // Writes the index to `path`, or reads it back whole. Returns false, or
+  // null with `*error` set, if that fails.
+  bool save(const std::string& path) const;
+  static std::unique_ptr<PatternIndex> load(const std::string& path,
+                                            std::string* error);
+
+ private:
+  PatternIndex();
+
+  void add_position(const Board& board);
+  // Returns the game of position `position_idx`.
+  size_t find_game(uint64_t position_idx) const;
+
+  // The index of the first position of each game, and the number of
+  // positions last.
+  std::vector<uint64_t> first_positions_;
+  uint64_t num_positions_;
+  // `signature_bits` words for each block of 64 positions.
+  std::vector<uint64_t> slices_;
+};
+
+#endif
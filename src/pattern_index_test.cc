@@ -0,0 +1,152 @@
+#include "pattern_index.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "board.h"
+#include "game_archive.h"
+#include "gtest/gtest.h"
+#include "perft.h"
+#include "pgn.h"
+
+namespace {
+// An archive of games of moves picked all over the move lists, from the
+// positions of the perft suite and the start position.
+std::unique_ptr<GameArchive> test_archive(size_t num_games) {
+  std::string text;
+  for (size_t i = 0; i < num_games; ++i) {
+    const std::string fen = i % 2 ? perft_suite[i % perft_suite.size()].fen_
+                                  : Board().to_fen();
+    Board board(fen);
+    absl::StrAppend(&text, "[FEN \"", fen, "\"]\n\n");
+    for (size_t ply = 0; ply < 60; ++ply) {
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      const Move move = moves[(i * 7 + ply * 13) % moves.size()];
+      append_san(board, move, &text);
+      text += ' ';
+      board.do_move(move);
+    }
+    text += "*\n\n";
+  }
+  GameArchiveBuilder builder(16);
+  PgnReader reader(text);
+  PgnGame game;
+  while (reader.next(&game)) {
+    EXPECT_EQ(builder.add_game(game), nullptr);
+  }
+  return builder.finish();
+}
+
+// The positions of `archive` with `pattern`, found by replaying every game.
+std::vector<std::pair<size_t, size_t>> replay_matches(
+    const GameArchive& archive, const PositionPattern& pattern) {
+  std::vector<std::pair<size_t, size_t>> res;
+  for (size_t i = 0; i < archive.num_blocks(); ++i) {
+    archive.decode_block(i, [&](size_t game_idx, const Board& start,
+                                const Move* moves, size_t num_moves) {
+      Board board = start;
+      for (size_t ply = 0;; ++ply) {
+        if (matches_pattern(board, pattern)) {
+          res.emplace_back(game_idx, ply);
+        }
+        if (ply == num_moves) {
+          break;
+        }
+        board.do_move(moves[ply]);
+      }
+    });
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(PositionPattern, ParsesAndMatches) {
+  PositionPattern pattern;
+  ASSERT_TRUE(parse_pattern("Bg7  kh8 -f6", &pattern));
+  EXPECT_EQ(pattern.pieces_[0][static_cast<size_t>(Piece::bishop)],
+            str_to_square("g7"));
+  EXPECT_EQ(pattern.pieces_[1][static_cast<size_t>(Piece::king)],
+            str_to_square("h8"));
+  EXPECT_EQ(pattern.empty_, str_to_square("f6"));
+  EXPECT_TRUE(matches_pattern(Board("7k/6B1/8/8/8/8/8/K7 w - - 0 1"),
+                              pattern));
+  EXPECT_FALSE(matches_pattern(Board("7k/6B1/5N2/8/8/8/8/K7 w - - 0 1"),
+                               pattern));
+  EXPECT_FALSE(matches_pattern(Board("6k1/6B1/8/8/8/8/8/K7 w - - 0 1"),
+                               pattern));
+
+  ASSERT_TRUE(parse_pattern("Pd4 =P", &pattern));
+  EXPECT_TRUE(matches_pattern(Board("7k/8/8/8/3P4/8/8/K7 w - - 0 1"),
+                              pattern));
+  EXPECT_FALSE(matches_pattern(Board("7k/8/8/8/3P4/8/P7/K7 w - - 0 1"),
+                               pattern));
+
+  for (const char* text : {"Bg9", "Xg7", "B", "=X", "-e", "Bg7x"}) {
+    SCOPED_TRACE(text);
+    EXPECT_FALSE(parse_pattern(text, &pattern));
+  }
+}
+
+TEST(PatternIndex, FindsThePositionsReplayingFinds) {
+  const std::unique_ptr<GameArchive> archive = test_archive(60);
+  const std::unique_ptr<PatternIndex> index = PatternIndex::build(*archive);
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(index->num_games(), archive->num_games());
+  EXPECT_EQ(index->num_positions(),
+            archive->num_moves() + archive->num_games());
+  for (const char* text :
+       {"Ke1", "Ke1 ke8 Ra1", "Nf3 nf6", "Pd4 pd5 -e4", "Pa2 =P", "Qh8", ""}) {
+    SCOPED_TRACE(text);
+    PositionPattern pattern;
+    ASSERT_TRUE(parse_pattern(text, &pattern));
+    std::vector<std::pair<size_t, size_t>> matches;
+    uint64_t num_candidates;
+    ASSERT_TRUE(index->search(
+        *archive, pattern,
+        [&](size_t game_idx, size_t ply, const Board& board) {
+          EXPECT_TRUE(matches_pattern(board, pattern));
+          matches.emplace_back(game_idx, ply);
+        },
+        &num_candidates));
+    EXPECT_EQ(matches, replay_matches(*archive, pattern));
+    EXPECT_GE(num_candidates, matches.size());
+  }
+}
+
+TEST(PatternIndex, SavesAndLoads) {
+  const std::string path = testing::TempDir() + "pattern_index_test.bin";
+  const std::unique_ptr<GameArchive> archive = test_archive(10);
+  const std::unique_ptr<PatternIndex> index = PatternIndex::build(*archive);
+  ASSERT_TRUE(index->save(path));
+  std::string error;
+  const std::unique_ptr<PatternIndex> loaded = PatternIndex::load(path, &error);
+  ASSERT_NE(loaded, nullptr) << error;
+  PositionPattern pattern;
+  ASSERT_TRUE(parse_pattern("Nf3", &pattern));
+  std::vector<uint64_t> candidates;
+  std::vector<uint64_t> loaded_candidates;
+  index->find_candidates(pattern, &candidates);
+  loaded->find_candidates(pattern, &loaded_candidates);
+  EXPECT_FALSE(candidates.empty());
+  EXPECT_EQ(candidates, loaded_candidates);
+
+  std::ifstream in(path, std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  for (size_t size : {size_t{0}, size_t{20}, data.size() - 8}) {
+    SCOPED_TRACE(size);
+    std::ofstream(path, std::ios::binary | std::ios::trunc)
+        .write(data.data(), static_cast<std::streamsize>(size));
+    EXPECT_EQ(PatternIndex::load(path, &error), nullptr);
+  }
+}
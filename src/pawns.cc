@@ -0,0 +1,148 @@
+#include "pawns.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/internal/raw_logging.h"
+#include "board.h"
+
+namespace {
+// Indexed by the rank of the passed pawn counted from its own side, 0 to 7.
+constexpr std::array<TaperedScore, 8> passed_pawn_bonus = {{{0, 0},
+                                                            {0, 10},
+                                                            {5, 15},
+                                                            {10, 25},
+                                                            {20, 45},
+                                                            {35, 75},
+                                                            {60, 120},
+                                                            {0, 0}}};
+// Per pawn.
+constexpr TaperedScore doubled_pawn_penalty = {10, 25};
+constexpr TaperedScore isolated_pawn_penalty = {8, 15};
+constexpr TaperedScore backward_pawn_penalty = {6, 10};
+
+// Returns `bb` with every square moved one rank towards the enemy of `side`.
+Bitboard push(Color side, Bitboard bb) {
+  return side == Color::white ? bb << 8 : bb >> 8;
+}
+
+// Returns the squares of `bb` and every square in front of them, as seen by
+// `side`.
+Bitboard forward_fill(Color side, Bitboard bb) {
+  if (side == Color::white) {
+    bb |= bb << 8;
+    bb |= bb << 16;
+    bb |= bb << 32;
+  } else {
+    bb |= bb >> 8;
+    bb |= bb >> 16;
+    bb |= bb >> 32;
+  }
+  return bb;
+}
+
+Bitboard pawn_attacks(Color side, Bitboard pawns) {
+  const Bitboard pushed = push(side, pawns);
+  return ((pushed >> 1) & ~a_file_mask) | ((pushed << 1) & ~h_file_mask);
+}
+
+// Returns the files of `bb` as full files.
+Bitboard file_fill(Bitboard bb) {
+  return forward_fill(Color::white, bb) | forward_fill(Color::black, bb);
+}
+
+Bitboard adjacent_files(Bitboard files) {
+  return ((files >> 1) & ~a_file_mask) | ((files << 1) & ~h_file_mask);
+}
+
+int relative_rank(Color side, Bitboard sq) {
+  return side == Color::white ? rank_idx(sq) : 7 - rank_idx(sq);
+}
+}  // namespace.
+
+PawnEntry evaluate_pawns(const Board& board) {
+  PawnEntry res = {board.pawn_key_, {0, 0}, {}, {}};
+  std::array<Bitboard, num_colors> front_spans;
+  for (Color side : {Color::white, Color::black}) {
+    const Bitboard pawns = board.pieces(side, Piece::pawn);
+    const size_t side_idx = static_cast<size_t>(side);
+    front_spans[side_idx] = forward_fill(side, push(side, pawns));
+    res.attack_spans_[side_idx] =
+        pawn_attacks(side, forward_fill(side, pawns));
+  }
+  for (Color side : {Color::white, Color::black}) {
+    const Color enemy = flip_color(side);
+    const size_t side_idx = static_cast<size_t>(side);
+    const size_t enemy_idx = static_cast<size_t>(enemy);
+    const Bitboard pawns = board.pieces(side, Piece::pawn);
+    const Bitboard enemy_pawns = board.pieces(enemy, Piece::pawn);
+    TaperedScore score = {0, 0};
+    for (Bitboard sq : bitboard_split(pawns)) {
+      const Bitboard stop = push(side, sq);
+      // A pawn with another of its own in front of it is doubled, so each
+      // extra pawn on a file counts once, and only the front one can be
+      // passed.
+      const bool doubled = (forward_fill(side, stop) & pawns) != 0;
+      const bool passed =
+          !doubled &&
+          !(sq & (front_spans[enemy_idx] | res.attack_spans_[enemy_idx]));
+      const bool isolated = !(adjacent_files(file_fill(sq)) & pawns);
+      // No pawn can come up to defend the square in front of it, and an enemy
+      // pawn already guards that square.
+      const bool backward = !isolated && !passed &&
+                            !(stop & res.attack_spans_[side_idx]) &&
+                            (stop & pawn_attacks(enemy, enemy_pawns)) != 0;
+      if (passed) {
+        res.passed_[side_idx] |= sq;
+        score += passed_pawn_bonus[static_cast<size_t>(
+            relative_rank(side, sq))];
+      }
+      if (doubled) {
+        score -= doubled_pawn_penalty;
+      }
+      if (isolated) {
+        score -= isolated_pawn_penalty;
+      }
+      if (backward) {
+        score -= backward_pawn_penalty;
+      }
+    }
+    if (side == Color::white) {
+      res.score_ += score;
+    } else {
+      res.score_ -= score;
+    }
+  }
+  return res;
+}
+
+PawnTable::PawnTable(size_t num_entries)
+    : entries_(num_entries), num_probes_(0), num_hits_(0) {
+  ABSL_RAW_CHECK(num_entries > 0 && (num_entries & (num_entries - 1)) == 0,
+                 "The number of pawn table entries must be a power of two.");
+  clear();
+}
+
+const PawnEntry& PawnTable::probe(const Board& board) {
+  ++num_probes_;
+  PawnEntry& entry = entries_[board.pawn_key_ & (entries_.size() - 1)];
+  if (entry.key_ == board.pawn_key_) {
+    ++num_hits_;
+  } else {
+    entry = evaluate_pawns(board);
+  }
+  return entry;
+}
+
+void PawnTable::prefetch(uint64_t pawn_key) const {
+  __builtin_prefetch(&entries_[pawn_key & (entries_.size() - 1)]);
+}
+
+void PawnTable::clear() {
+  for (PawnEntry& entry : entries_) {
+    entry = {0, {0, 0}, {}, {}};
+  }
+  num_probes_ = 0;
+  num_hits_ = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+#include "memory_accounting.h"
+
+// The pawn structure part of the evaluation, which only depends on where the
+// pawns are: passed, doubled, isolated and backward pawns. Along with the
+// score it keeps bitboards that other evaluation terms can use.
+struct PawnEntry {
+  // `Board::pawn_key_` of the structure.
+  uint64_t key_;
+  // From white's point of view, like `Board::psqt_`.
+  TaperedScore score_;
+  // Indexed by Color.
+  std::array<Bitboard, num_colors> passed_;
+  // The squares the pawns of each color attack now or could attack after
+  // advancing, indexed by Color. A piece outside the enemy's span can never be
+  // chased away by a pawn.
+  std::array<Bitboard, num_colors> attack_spans_;
+};
+
+// Evaluates the pawn structure of `board` from scratch.
+PawnEntry evaluate_pawns(const Board& board);
+
+// A cache of `evaluate_pawns` keyed by the pawn key. The pawns change far less
+// often than the other pieces, so most probes hit and the pawn structure costs
+// next to nothing. Each searcher owns one, so it needs no locking.
+class PawnTable {
+ public:
+  static constexpr size_t default_num_entries = size_t{1} << 14;
+
+  // `num_entries` must be a power of two.
+  explicit PawnTable(size_t num_entries = default_num_entries);
+
+  // Returns the pawn structure of `board`, evaluating and storing it if it
+  // isn't in the table.
+  const PawnEntry& probe(const Board& board);
+  // Starts loading the entry of `pawn_key` into the cache.
+  void prefetch(uint64_t pawn_key) const;
+  void clear();
+
+  uint64_t num_probes() const { return num_probes_; }
+  uint64_t num_hits() const { return num_hits_; }
+
+ private:
+  // Empty entries have key 0 and score nothing, which is right for the only
+  // structure with key 0, the one without pawns.
+  TaggedVector<PawnEntry, MemoryTag::pawn_tables> entries_;
+  uint64_t num_probes_;
+  uint64_t num_hits_;
+};
+
+#endif
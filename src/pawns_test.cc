@@ -0,0 +1,74 @@
+#include "pawns.h"
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+TEST(EvaluatePawns, NoPawnsScoreNothing) {
+  const PawnEntry entry =
+      evaluate_pawns(Board("4k3/8/8/8/8/8/8/4K3 w - - 0 1"));
+  EXPECT_EQ(entry.key_, 0);
+  EXPECT_EQ(entry.score_, (TaperedScore{0, 0}));
+  EXPECT_EQ(entry.passed_[0] | entry.passed_[1], 0);
+  EXPECT_EQ(evaluate_pawns(Board()).score_, (TaperedScore{0, 0}));
+}
+
+TEST(EvaluatePawns, FindsPassedPawns) {
+  // The d5 pawn has no black pawn in front or on the files next to it, the e4
+  // pawn faces the pawn on f6, and the a7 pawn is passed for black.
+  const PawnEntry entry =
+      evaluate_pawns(Board("4k3/8/p4p2/3P4/4P3/8/8/4K3 w - - 0 1"));
+  EXPECT_EQ(entry.passed_[static_cast<size_t>(Color::white)],
+            str_to_square("d5"));
+  EXPECT_EQ(entry.passed_[static_cast<size_t>(Color::black)],
+            str_to_square("a6"));
+  // Further up the board is worth more.
+  const Board far("4k3/3P4/8/8/8/8/8/4K3 w - - 0 1");
+  const Board near("4k3/8/8/8/3P4/8/8/4K3 w - - 0 1");
+  EXPECT_GT(evaluate_pawns(far).score_.eg_, evaluate_pawns(near).score_.eg_);
+}
+
+TEST(EvaluatePawns, PenalizesWeakPawns) {
+  const TaperedScore connected =
+      evaluate_pawns(Board("4k3/pp6/8/8/8/8/PP6/4K3 w - - 0 1")).score_;
+  EXPECT_EQ(connected, (TaperedScore{0, 0}));
+  // Doubled and isolated on the a-file.
+  const TaperedScore doubled =
+      evaluate_pawns(Board("4k3/pp6/8/8/8/P7/P7/4K3 w - - 0 1")).score_;
+  EXPECT_LT(doubled.mg_, 0);
+  EXPECT_LT(doubled.eg_, 0);
+  // The d3 pawn can't be defended by the pawns ahead of it on c4 and e4, and
+  // the pawn on c5 guards its way forward.
+  const TaperedScore backward =
+      evaluate_pawns(Board("4k3/8/8/2p5/2P1P3/3P4/8/4K3 w - - 0 1")).score_;
+  const TaperedScore supported =
+      evaluate_pawns(Board("4k3/8/8/2p5/2P1P3/8/3P4/4K3 w - - 0 1")).score_;
+  EXPECT_LT(backward.mg_, supported.mg_);
+}
+
+TEST(EvaluatePawns, AttackSpansReachForward) {
+  const PawnEntry entry =
+      evaluate_pawns(Board("4k3/8/8/8/8/8/3P4/4K3 w - - 0 1"));
+  const Bitboard span = entry.attack_spans_[static_cast<size_t>(Color::white)];
+  EXPECT_TRUE(span & str_to_square("c3"));
+  EXPECT_TRUE(span & str_to_square("e8"));
+  EXPECT_FALSE(span & str_to_square("d3"));
+  EXPECT_FALSE(span & str_to_square("c2"));
+}
+
+TEST(PawnTable, CachesByPawnKey) {
+  PawnTable pawn_table(64);
+  const Board board("4k3/8/p4p2/3P4/4P3/8/8/4K3 w - - 0 1");
+  const PawnEntry fresh = evaluate_pawns(board);
+  EXPECT_EQ(pawn_table.probe(board).score_, fresh.score_);
+  EXPECT_EQ(pawn_table.num_hits(), 0);
+  // Other pieces and the side to move don't change the pawn structure.
+  const PawnEntry& cached =
+      pawn_table.probe(Board("3qk3/8/p4p2/3P4/4P3/8/8/R3K3 b - - 0 1"));
+  EXPECT_EQ(pawn_table.num_hits(), 1);
+  EXPECT_EQ(cached.score_, fresh.score_);
+  EXPECT_EQ(cached.passed_, fresh.passed_);
+  EXPECT_EQ(pawn_table.num_probes(), 2);
+  pawn_table.clear();
+  pawn_table.probe(board);
+  EXPECT_EQ(pawn_table.num_hits(), 0);
+}
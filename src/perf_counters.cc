@@ -0,0 +1,174 @@
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+
+namespace {
+const char* const perf_event_names[num_perf_events] = {
+    "instructions", "cycles",     "branch_misses",
+    "l1d_misses",   "llc_misses", "dtlb_misses",
+};
+
+// `value` to two decimals.
+double rounded(double value) { return std::round(value * 100) / 100; }
+
+#ifdef __linux__
+// The type and config of perf_event_attr for each event.
+struct EventConfig {
+  uint32_t type_;
+  uint64_t config_;
+};
+
+constexpr uint64_t cache_read_misses(uint64_t cache) {
+  return cache | (uint64_t{PERF_COUNT_HW_CACHE_OP_READ} << 8) |
+         (uint64_t{PERF_COUNT_HW_CACHE_RESULT_MISS} << 16);
+}
+
+const EventConfig event_configs[num_perf_events] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, cache_read_misses(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, cache_read_misses(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, cache_read_misses(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+int open_counter(const EventConfig& config) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type_;
+  attr.config = config.config_;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+  // The calling thread, on any CPU.
+  return static_cast<int>(
+      syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+}  // namespace.
+
+const char* perf_event_name(PerfEvent event) {
+  return perf_event_names[static_cast<size_t>(event)];
+}
+
+PerfCounters::PerfCounters() {
+  for (size_t i = 0; i < num_perf_events; ++i) {
+#ifdef __linux__
+    fds_[i] = open_counter(event_configs[i]);
+#else
+    fds_[i] = -1;
+#endif
+  }
+  start();
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+bool PerfCounters::available() const {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerfCounters::start() {
+  for (size_t i = 0; i < num_perf_events; ++i) {
+    if (!read_counter(i, &start_[i])) {
+      start_[i] = {0, 0, 0};
+    }
+  }
+}
+
+PerfCounts PerfCounters::read() const {
+  PerfCounts res;
+  for (size_t i = 0; i < num_perf_events; ++i) {
+    Reading reading;
+    if (!read_counter(i, &reading)) {
+      continue;
+    }
+    const uint64_t value = reading.value_ - start_[i].value_;
+    const uint64_t enabled = reading.time_enabled_ - start_[i].time_enabled_;
+    const uint64_t running = reading.time_running_ - start_[i].time_running_;
+    if (running == 0) {
+      // Never scheduled on the CPU's counters since the start.
+      res.counts_[i] = enabled == 0 ? absl::optional<uint64_t>(0)
+                                    : absl::nullopt;
+    } else if (running == enabled) {
+      res.counts_[i] = value;
+    } else {
+      res.counts_[i] = static_cast<uint64_t>(
+          static_cast<double>(value) * static_cast<double>(enabled) /
+          static_cast<double>(running));
+    }
+  }
+  return res;
+}
+
+bool PerfCounters::read_counter(size_t event_idx, Reading* reading) const {
+#ifdef __linux__
+  const int fd = fds_[event_idx];
+  uint64_t values[3];
+  if (fd < 0 || ::read(fd, values, sizeof(values)) !=
+                    static_cast<ssize_t>(sizeof(values))) {
+    return false;
+  }
+  *reading = {values[0], values[1], values[2]};
+  return true;
+#else
+  static_cast<void>(event_idx);
+  static_cast<void>(reading);
+  return false;
+#endif
+}
+
+std::string perf_counts_to_str(const PerfCounts& counts, uint64_t num_items,
+                               const std::string& per) {
+  std::string res;
+  const double items = static_cast<double>(num_items > 0 ? num_items : 1);
+  for (size_t i = 0; i < num_perf_events; ++i) {
+    absl::StrAppend(&res, i > 0 ? ", " : "", perf_event_names[i], " ");
+    if (counts.counts_[i]) {
+      absl::StrAppend(&res, rounded(static_cast<double>(*counts.counts_[i]) /
+                                    items),
+                      "/", per);
+    } else {
+      absl::StrAppend(&res, "n/a");
+    }
+  }
+  const absl::optional<uint64_t> instructions =
+      counts.count(PerfEvent::instructions);
+  const absl::optional<uint64_t> cycles = counts.count(PerfEvent::cycles);
+  if (instructions && cycles && *cycles > 0) {
+    absl::StrAppend(&res, ", IPC ",
+                    rounded(static_cast<double>(*instructions) /
+                            static_cast<double>(*cycles)));
+  }
+  return res;
+}
@@ -0,0 +1,87 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/types/optional.h"
+
+// Hardware event counts, read through Linux's perf_event_open, for telling
+// why one version of the move generator is faster than another: whether it
+// runs fewer instructions, mispredicts fewer branches or misses the caches and
+// the TLB less. Only what runs in user space is counted, which is all an
+// unprivileged process may count under the default perf_event_paranoid.
+// Events that the kernel or the CPU doesn't offer are unavailable rather than
+// errors, and so are all of them off Linux or where the system call is
+// forbidden, as in many containers.
+
+enum class PerfEvent {
+  instructions,
+  cycles,
+  branch_misses,
+  // Reads that missed the first level data cache, and the last level cache.
+  l1d_misses,
+  llc_misses,
+  // Reads that missed the data TLB.
+  dtlb_misses,
+};
+constexpr size_t num_perf_events = 6;
+
+// "instructions", "cycles", "branch_misses" and so on.
+const char* perf_event_name(PerfEvent event);
+
+struct PerfCounts {
+  // Indexed by PerfEvent, nullopt for the events that weren't counted.
+  std::array<absl::optional<uint64_t>, num_perf_events> counts_;
+
+  absl::optional<uint64_t> count(PerfEvent event) const {
+    return counts_[static_cast<size_t>(event)];
+  }
+};
+
+// One counter per event, of the calling thread and of the threads it starts
+// after the counters are made. The counts of those threads are only added in
+// once they have exited, so a pool that should be counted is started and
+// joined between `start` and `read`. The kernel takes turns between the
+// events when the CPU has too few counters for all of them, and the counts
+// are then scaled up from the time each was counted.
+class PerfCounters {
+ public:
+  // Opens the counters and starts them.
+  PerfCounters();
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+  ~PerfCounters();
+
+  // Whether any event is counted.
+  bool available() const;
+  // Counts from here.
+  void start();
+  // The counts since the last `start`, or since the counters were made.
+  PerfCounts read() const;
+
+ private:
+  // What the kernel reads for one counter.
+  struct Reading {
+    uint64_t value_;
+    uint64_t time_enabled_;
+    uint64_t time_running_;
+  };
+
+  bool read_counter(size_t event_idx, Reading* reading) const;
+
+  // Indexed by PerfEvent, -1 for the events that couldn't be opened.
+  std::array<int, num_perf_events> fds_;
+  std::array<Reading, num_perf_events> start_;
+};
+
+// The counts divided by `num_items`, with the unit `per` ("node", "move"),
+// as one line: "instructions 612.3/node, cycles 201.7/node, ...", with "n/a"
+// for the events that weren't counted, and the instructions per cycle when
+// both are known.
+std::string perf_counts_to_str(const PerfCounts& counts, uint64_t num_items,
+                               const std::string& per);
+
+#endif
@@ -0,0 +1,60 @@
+#include "perf_counters.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "absl/strings/match.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Runs a loop of `n` iterations that the compiler can't drop.
+void spin(uint64_t n) {
+  volatile uint64_t sum = 0;
+  for (uint64_t i = 0; i < n; ++i) {
+    sum = sum + i;
+  }
+}
+}  // namespace.
+
+TEST(PerfCounters, CountsTheWorkDone) {
+  PerfCounters counters;
+  if (!counters.available()) {
+    // Off Linux, or where perf_event_open is forbidden.
+    for (size_t i = 0; i < num_perf_events; ++i) {
+      EXPECT_FALSE(counters.read().counts_[i]);
+    }
+    return;
+  }
+  spin(1000000);
+  const absl::optional<uint64_t> instructions =
+      counters.read().count(PerfEvent::instructions);
+  if (!instructions) {
+    return;
+  }
+  // A few instructions per iteration, and nothing of the spin before.
+  EXPECT_GE(*instructions, 1000000u);
+  counters.start();
+  EXPECT_LT(*counters.read().count(PerfEvent::instructions), 1000000u);
+
+  // A thread started after the counters counts, once it has exited.
+  counters.start();
+  std::thread thread([] { spin(10000000); });
+  thread.join();
+  EXPECT_GE(*counters.read().count(PerfEvent::instructions), 10000000u);
+}
+
+TEST(PerfCounters, FormatsPerItem) {
+  PerfCounts counts;
+  counts.counts_[static_cast<size_t>(PerfEvent::instructions)] = 3000;
+  counts.counts_[static_cast<size_t>(PerfEvent::cycles)] = 1000;
+  counts.counts_[static_cast<size_t>(PerfEvent::branch_misses)] = 5;
+  const std::string str = perf_counts_to_str(counts, 100, "node");
+  EXPECT_TRUE(absl::StartsWith(
+      str, "instructions 30/node, cycles 10/node, branch_misses 0.05/node, "
+           "l1d_misses n/a"))
+      << str;
+  EXPECT_TRUE(absl::EndsWith(str, "dtlb_misses n/a, IPC 3")) << str;
+  EXPECT_EQ(perf_event_name(PerfEvent::llc_misses), std::string("llc_misses"));
+}
@@ -1,8 +1,464 @@
-#include <iostream>
+#include "perft.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "bitboard.h"
 #include "board.h"
+#include "board_batch.h"
+#include "debug_check.h"
+#include "thread_pool.h"
+#include "zobrist.h"
+
+namespace {
+// Tasks are split off this many plies below the root, which gives some hundreds
+// to a few thousand tasks in typical positions: enough to keep every worker
+// busy while the rest of the tree is split unevenly.
+const int split_plies = 2;
+
+// The files of `PerftTable::save` hold Zobrist keys, so the version goes up
+// whenever the keys of zobrist.h change.
+constexpr uint64_t perft_table_magic = 0x3154465245505750;  // "PWPERFT1"
+
+// Appends every position `plies` plies below `board` to `res`.
+template <typename MovePolicy>
+void collect_positions(Board* board, int plies, std::vector<Board>* res) {
+  if (plies == 0) {
+    res->push_back(*board);
+    return;
+  }
+  for (Move move : board->legal_moves()) {
+    MovePolicy::visit(board, move, [plies, res](Board* child) {
+      collect_positions<MovePolicy>(child, plies - 1, res);
+    });
+  }
+}
+
+// What `count_tree` counts: the leaves, given the position they are moves of,
+// and the root of a tree of depth 0. A counter is a value that adds up with
+// `+=`, which for the plain node count compiles to the integer addition of a
+// hand-written perft.
+struct NodeCounter {
+  uint64_t nodes_;
+
+  static NodeCounter root() { return {1}; }
+  // Every legal move is a leaf, so there is no need to do them, or even to
+  // store them.
+  static NodeCounter leaves(const Board& board) {
+    return {board.num_legal_moves()};
+  }
+  NodeCounter& operator+=(NodeCounter other) {
+    nodes_ += other.nodes_;
+    return *this;
+  }
+};
+
+struct StatsCounter {
+  PerftStats stats_;
+
+  static StatsCounter root() { return {{1, 0, 0, 0, 0, 0, 0, 0, 0}}; }
+  static StatsCounter leaves(const Board& board) {
+    const MoveList moves = board.legal_moves();
+    PerftStats res = {moves.size(), 0, 0, 0, 0, 0, 0, 0, 0};
+    const CheckInfo info = board.check_info();
+    const Bitboard own_pieces =
+        board.is_whites_move_ ? board.white_pieces() : board.black_pieces();
+    for (Move move : moves) {
+      switch (move.move_type_) {
+        case MoveType::en_passant:
+          ++res.en_passants_;
+          ++res.captures_;
+          break;
+        case MoveType::capture:
+          ++res.captures_;
+          break;
+        case MoveType::castle_kingside:
+        case MoveType::castle_queenside:
+          ++res.castles_;
+          break;
+        case MoveType::promotion_to_rook:
+        case MoveType::promotion_to_bishop:
+        case MoveType::promotion_to_knight:
+        case MoveType::promotion_to_queen:
+          ++res.promotions_;
+          if (board.mailbox_[move.dst_idx_] != Piece::none) {
+            ++res.captures_;
+          }
+          break;
+        default:
+          break;
+      }
+      if (!board.gives_check(move, info)) {
+        continue;
+      }
+      ++res.checks_;
+      Board child(board);
+      child.do_move(move);
+      // Only the moving piece leaves its square, so a checker that stood on
+      // an own square before the move was uncovered by it.
+      const Bitboard checkers = child.check_info().checkers_;
+      if (popcount(checkers) > 1) {
+        ++res.double_checks_;
+      } else if (checkers & own_pieces) {
+        ++res.discovered_checks_;
+      }
+      if (child.legal_evasions().empty()) {
+        ++res.checkmates_;
+      }
+    }
+    return {res};
+  }
+  StatsCounter& operator+=(const StatsCounter& other) {
+    stats_ += other.stats_;
+    return *this;
+  }
+};
+
+// Counts the tree `depth` plies below `board` with `Counter`.
+template <typename MovePolicy, typename Counter>
+Counter count_tree(Board* board, int depth) {
+  if (depth == 0) {
+    return Counter::root();
+  }
+  if (depth == 1) {
+    return Counter::leaves(*board);
+  }
+  const MoveList moves = board->legal_moves();
+  Counter res = {};
+  for (Move move : moves) {
+    MovePolicy::visit(board, move, [depth, &res](Board* child) {
+      res += count_tree<MovePolicy, Counter>(child, depth - 1);
+    });
+  }
+  return res;
+}
+
+// Adds the leaves `depth` plies below the positions of `frontier` to
+// `*nodes`, with `(*plies)[ply]` the batch of the ply after the frontier's.
+void count_frontier(BoardBatchSlice frontier, int depth, size_t ply,
+                    std::vector<BoardBatch>* plies,
+                    std::vector<uint16_t>* counts, uint64_t* nodes) {
+  if (depth == 1) {
+    count_legal_moves(frontier, counts->data());
+    for (size_t i = 0; i < frontier.size(); ++i) {
+      *nodes += (*counts)[i];
+    }
+    return;
+  }
+  BoardBatch& next = (*plies)[ply];
+  next.clear();
+  for (size_t i = 0; i < frontier.size(); ++i) {
+    const Board board = frontier.board(i);
+    for (Move move : board.legal_moves()) {
+      if (next.full()) {
+        count_frontier(next, depth - 1, ply + 1, plies, counts, nodes);
+        next.clear();
+      }
+      Board child(board);
+      child.do_move(move);
+      next.push_back(child);
+    }
+  }
+  count_frontier(next, depth - 1, ply + 1, plies, counts, nodes);
+}
+}  // namespace.
+
+PerftStats& PerftStats::operator+=(const PerftStats& other) {
+  nodes_ += other.nodes_;
+  captures_ += other.captures_;
+  en_passants_ += other.en_passants_;
+  castles_ += other.castles_;
+  promotions_ += other.promotions_;
+  checks_ += other.checks_;
+  discovered_checks_ += other.discovered_checks_;
+  double_checks_ += other.double_checks_;
+  checkmates_ += other.checkmates_;
+  return *this;
+}
+
+bool operator==(const PerftStats& lhs, const PerftStats& rhs) {
+  return lhs.nodes_ == rhs.nodes_ && lhs.captures_ == rhs.captures_ &&
+         lhs.en_passants_ == rhs.en_passants_ &&
+         lhs.castles_ == rhs.castles_ && lhs.promotions_ == rhs.promotions_ &&
+         lhs.checks_ == rhs.checks_ &&
+         lhs.discovered_checks_ == rhs.discovered_checks_ &&
+         lhs.double_checks_ == rhs.double_checks_ &&
+         lhs.checkmates_ == rhs.checkmates_;
+}
+
+template <typename MovePolicy>
+uint64_t perft(Board* board, int depth) {
+  return count_tree<MovePolicy, NodeCounter>(board, depth).nodes_;
+}
+
+template <typename MovePolicy>
+PerftStats perft_stats(Board* board, int depth) {
+  return count_tree<MovePolicy, StatsCounter>(board, depth).stats_;
+}
+
+template <typename MovePolicy>
+std::vector<std::pair<Move, uint64_t>> divide(Board* board, int depth) {
+  ABSL_RAW_CHECK(depth >= 1, "divide needs a depth of at least 1.");
+  std::vector<std::pair<Move, uint64_t>> res;
+  for (Move move : board->legal_moves()) {
+    MovePolicy::visit(board, move, [depth, move, &res](Board* child) {
+      res.emplace_back(move, perft<MovePolicy>(child, depth - 1));
+    });
+  }
+  return res;
+}
+
+PerftTable::PerftTable(size_t size_in_bytes) {
+  size_t num_entries = 1;
+  while (num_entries * 2 * sizeof(Entry) <= size_in_bytes) {
+    num_entries *= 2;
+  }
+  entries_.reset(new Entry[num_entries]);
+  for (size_t i = 0; i < num_entries; ++i) {
+    entries_[i].check_.store(0, std::memory_order_relaxed);
+    entries_[i].data_.store(0, std::memory_order_relaxed);
+  }
+  mask_ = num_entries - 1;
+}
+
+PerftTable::Entry& PerftTable::entry(uint64_t key, int depth) const {
+  // Mix the depth in so that the counts of one position at different depths
+  // don't all compete for one slot.
+  const uint64_t slot_key =
+      key ^ (static_cast<uint64_t>(depth) * 0x9E3779B97F4A7C15ULL);
+  return entries_[static_cast<size_t>(slot_key) & mask_];
+}
+
+bool PerftTable::probe(uint64_t key, int depth, uint64_t* nodes) const {
+  const Entry& e = entry(key, depth);
+  const uint64_t data = e.data_.load(std::memory_order_relaxed);
+  const uint64_t check = e.check_.load(std::memory_order_relaxed);
+  if ((check ^ data) != key || (data & 0xFF) != static_cast<uint64_t>(depth)) {
+    return false;
+  }
+  *nodes = data >> 8;
+  return true;
+}
+
+void PerftTable::store(uint64_t key, int depth, uint64_t nodes) {
+  DEBUG_CHECK(0 <= depth && depth < 256 && nodes < (uint64_t{1} << 56),
+              "Perft count doesn't fit in a table entry.");
+  Entry& e = entry(key, depth);
+  const uint64_t data = (nodes << 8) | static_cast<uint64_t>(depth);
+  e.check_.store(key ^ data, std::memory_order_relaxed);
+  e.data_.store(data, std::memory_order_relaxed);
+}
+
+bool PerftTable::save(const std::string& path, std::string* error) const {
+  const std::string temp_path = path + ".tmp";
+  std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    *error = absl::StrCat("Can't write ", temp_path);
+    return false;
+  }
+  uint64_t num_counts = 0;
+  for (size_t i = 0; i <= mask_; ++i) {
+    num_counts += entries_[i].data_.load(std::memory_order_relaxed) != 0;
+  }
+  const uint64_t header[] = {perft_table_magic, num_counts};
+  bool is_written = std::fwrite(header, sizeof(header), 1, file) == 1;
+  for (size_t i = 0; i <= mask_ && is_written; ++i) {
+    const uint64_t data = entries_[i].data_.load(std::memory_order_relaxed);
+    const uint64_t key_and_data[] = {
+        entries_[i].check_.load(std::memory_order_relaxed) ^ data, data};
+    is_written = data == 0 || std::fwrite(key_and_data, sizeof(key_and_data),
+                                          1, file) == 1;
+  }
+  if (std::fclose(file) != 0 || !is_written ||
+      std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    *error = absl::StrCat("Can't write ", path);
+    return false;
+  }
+  return true;
+}
+
+bool PerftTable::load(const std::string& path, std::string* error) {
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    *error = absl::StrCat("Can't read ", path);
+    return false;
+  }
+  uint64_t header[2] = {};
+  bool is_valid = std::fread(header, sizeof(header), 1, file) == 1 &&
+                  header[0] == perft_table_magic;
+  for (uint64_t i = 0; i < header[1] && is_valid; ++i) {
+    uint64_t key_and_data[2] = {};
+    is_valid = std::fread(key_and_data, sizeof(key_and_data), 1, file) == 1;
+    if (is_valid) {
+      store(key_and_data[0], static_cast<int>(key_and_data[1] & 0xFF),
+            key_and_data[1] >> 8);
+    }
+  }
+  is_valid = is_valid && std::fgetc(file) == EOF;
+  std::fclose(file);
+  if (!is_valid) {
+    *error = absl::StrCat(path, " isn't a perft table of this version");
+    return false;
+  }
+  return true;
+}
+
+void PerftTable::verify_sample(double fraction, uint64_t seed) {
+  // 2^64 doesn't fit, so every count but one in 2^64 for a fraction of 1.
+  verify_threshold_ =
+      fraction <= 0   ? 0
+      : fraction >= 1 ? ~uint64_t{0}
+                      : static_cast<uint64_t>(fraction * 0x1p64);
+  verify_seed_ = seed;
+}
+
+uint64_t PerftTable::sample_value(uint64_t key, int depth) const {
+  uint64_t state =
+      key ^ verify_seed_ ^ (static_cast<uint64_t>(depth) << 56);
+  return splitmix64(&state);
+}
+
+void PerftTable::add_verification(bool matched) {
+  num_verified_.fetch_add(1, std::memory_order_relaxed);
+  num_mismatches_.fetch_add(!matched, std::memory_order_relaxed);
+}
+
+template <typename MovePolicy>
+uint64_t hashed_perft(Board* board, int depth, PerftTable* table) {
+  if (depth <= 1) {
+    return perft<MovePolicy>(board, depth);
+  }
+  const uint64_t key = board->key_;
+  uint64_t cached = 0;
+  const bool is_cached = table->probe(key, depth, &cached);
+  if (is_cached && !table->should_split(cached)) {
+    if (!table->should_verify(key, depth)) {
+      return cached;
+    }
+    const uint64_t nodes = perft<MovePolicy>(board, depth);
+    table->add_verification(nodes == cached);
+    if (nodes != cached) {
+      table->store(key, depth, nodes);
+    }
+    return nodes;
+  }
+  uint64_t res = 0;
+  for (Move move : board->legal_moves()) {
+    MovePolicy::visit(board, move, [depth, table, &res](Board* child) {
+      res += hashed_perft<MovePolicy>(child, depth - 1, table);
+    });
+  }
+  if (is_cached) {
+    table->add_verification(res == cached);
+  }
+  if (!is_cached || res != cached) {
+    table->store(key, depth, res);
+  }
+  return res;
+}
+
+template <typename MovePolicy>
+uint64_t parallel_perft(const Board& board, int depth, ThreadPool* pool,
+                        PerftTable* table) {
+  // The last ply is bulk counted, so splitting needs at least one more.
+  const int plies = std::min(split_plies, depth - 1);
+  Board root(board);
+  if (plies <= 0) {
+    return table ? hashed_perft<MovePolicy>(&root, depth, table)
+                 : perft<MovePolicy>(&root, depth);
+  }
+  std::vector<Board> positions;
+  collect_positions<MovePolicy>(&root, plies, &positions);
+
+  std::atomic<uint64_t> res(0);
+  for (const Board& position : positions) {
+    pool->submit([&res, &position, depth, plies, table] {
+      Board copy(position);
+      const uint64_t nodes =
+          table ? hashed_perft<MovePolicy>(&copy, depth - plies, table)
+                : perft<MovePolicy>(&copy, depth - plies);
+      res.fetch_add(nodes, std::memory_order_relaxed);
+    });
+  }
+  pool->wait();
+  return res.load();
+}
+
+uint64_t batch_perft(const Board& board, int depth, size_t batch_size) {
+  ABSL_RAW_CHECK(batch_size > 0, "Batches need room for a position.");
+  if (depth == 0) {
+    return 1;
+  }
+  std::vector<BoardBatch> plies;
+  for (int ply = 0; ply < depth; ++ply) {
+    plies.emplace_back(batch_size);
+  }
+  std::vector<uint16_t> counts(batch_size);
+  uint64_t res = 0;
+  plies[0].push_back(board);
+  count_frontier(plies[0], depth, 1, &plies, &counts, &res);
+  return res;
+}
+
+std::vector<PerftTask> split_perft(const Board& board, int plies) {
+  Board root(board);
+  std::vector<Board> positions;
+  collect_positions<MakeUnmake>(&root, plies, &positions);
+  std::vector<PerftTask> res;
+  absl::flat_hash_map<uint64_t, size_t> task_idx;
+  for (const Board& position : positions) {
+    const auto inserted = task_idx.emplace(position.key_, res.size());
+    if (inserted.second) {
+      res.push_back({position, 1});
+    } else {
+      ++res[inserted.first->second].multiplicity_;
+    }
+  }
+  return res;
+}
+
+template uint64_t perft<MakeUnmake>(Board*, int);
+template uint64_t perft<CopyMake>(Board*, int);
+template PerftStats perft_stats<MakeUnmake>(Board*, int);
+template PerftStats perft_stats<CopyMake>(Board*, int);
+template std::vector<std::pair<Move, uint64_t>> divide<MakeUnmake>(Board*,
+                                                                   int);
+template std::vector<std::pair<Move, uint64_t>> divide<CopyMake>(Board*, int);
+template uint64_t hashed_perft<MakeUnmake>(Board*, int, PerftTable*);
+template uint64_t hashed_perft<CopyMake>(Board*, int, PerftTable*);
+template uint64_t parallel_perft<MakeUnmake>(const Board&, int, ThreadPool*,
+                                             PerftTable*);
+template uint64_t parallel_perft<CopyMake>(const Board&, int, ThreadPool*,
+                                           PerftTable*);
 
-int main() {
-  std::cout << "hello" << '\n';
-  // std::cout << return_one() << '\n';
-}
\ No newline at end of file
+const std::array<PerftSuitePosition, 6> perft_suite = {{
+    {"start",
+     "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+     {20, 400, 8902, 197281, 4865609, 119060324}},
+    {"kiwipete",
+     "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     {48, 2039, 97862, 4085603, 193690690, 8031647685}},
+    {"position3",
+     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+     {14, 191, 2812, 43238, 674624, 11030083}},
+    {"position4",
+     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+     {6, 264, 9467, 422333, 15833292, 706045033}},
+    {"position5",
+     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     {44, 1486, 62379, 2103487, 89941194, 3048196529}},
+    {"position6",
+     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+     {46, 2079, 89890, 3894594, 164075551, 6923051137}},
+}};
@@ -0,0 +1,214 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+#include "thread_pool.h"
+
+// Perft counts the leaf nodes of the legal move tree to a fixed depth. The
+// counts are known for many positions, which makes it the standard test of a
+// move generator, and the node rate is its standard benchmark.
+//
+// Every walk of the tree takes a `MovePolicy`, `MakeUnmake` or `CopyMake`
+// (see board.h), which picks at compile time how moves are taken back, so
+// that the two can be benchmarked against each other on the same counts.
+
+// Returns the number of leaf nodes `depth` plies below `board`. The board is
+// left as it was. The last ply is bulk counted: at depth 1 the legal moves are
+// counted rather than done, which relies on `legal_moves` generating no
+// illegal moves.
+template <typename MovePolicy = MakeUnmake>
+uint64_t perft(Board* board, int depth);
+
+// The leaves of a perft broken down by the last move, as the reference perft
+// tables give them, so that a wrong count can be traced to the kind of move
+// the generator gets wrong. As in the tables, a capture by promotion counts
+// as a capture and a promotion, and a double check as a check and a double
+// check but not a discovered check.
+struct PerftStats {
+  uint64_t nodes_;
+  uint64_t captures_;
+  uint64_t en_passants_;
+  uint64_t castles_;
+  uint64_t promotions_;
+  uint64_t checks_;
+  // Checks by a piece that didn't move, and by no other.
+  uint64_t discovered_checks_;
+  uint64_t double_checks_;
+  uint64_t checkmates_;
+
+  PerftStats& operator+=(const PerftStats& other);
+};
+
+bool operator==(const PerftStats& lhs, const PerftStats& rhs);
+
+// Returns the statistics of the leaves `depth` plies below `board`. Counting
+// and plain `perft` are one walk of the tree with the counting as a template
+// parameter, so `perft` keeps its bulk counted last ply; here the last ply
+// looks at every move, finding checks with `Board::gives_check` and doing
+// only the checking moves, to tell what kind of check they give and whether
+// they mate. At depth 0 there is one node and nothing else.
+template <typename MovePolicy = MakeUnmake>
+PerftStats perft_stats(Board* board, int depth);
+
+// Returns the perft count below every legal move of `board`, in move
+// generation order. The counts sum to `perft(board, depth)`. `depth` must be at
+// least 1.
+template <typename MovePolicy = MakeUnmake>
+std::vector<std::pair<Move, uint64_t>> divide(Board* board, int depth);
+
+// A fixed-size table of perft counts keyed by Zobrist key and depth, shared by
+// all threads without locks. Each entry stores the key XORed with the data, so
+// an entry torn by two threads writing at once fails verification and is a
+// miss rather than a wrong count. Entries are 16 bytes, four to a cache line,
+// and are always replaced.
+//
+// The counts of a table can be saved to a file and loaded into another table,
+// of any size, in a later run, so that the subtrees of positions that are
+// counted again and again, such as those of a nightly check of the suite,
+// are counted once. A count loaded from a file is only as right as the move
+// generator that counted it, so a table can also be made to check a sample
+// of the counts it is asked for (see `verify_sample`).
+class PerftTable {
+ public:
+  // Uses the largest power of two number of entries that fits in
+  // `size_in_bytes`, and at least one.
+  explicit PerftTable(size_t size_in_bytes);
+
+  // Sets `*nodes` and returns true if the count of the position with `key` at
+  // `depth` is in the table.
+  bool probe(uint64_t key, int depth, uint64_t* nodes) const;
+  void store(uint64_t key, int depth, uint64_t nodes);
+  size_t num_entries() const { return mask_ + 1; }
+
+  // Writes the counts in the table to the file at `path`, 16 bytes a count,
+  // through a temporary file renamed over it, so that a run killed while
+  // saving leaves the old file. Returns false with what went wrong in
+  // `*error`. The table must not be stored to meanwhile.
+  bool save(const std::string& path, std::string* error) const;
+  // Stores the counts of a file `save` wrote, which then replace those of
+  // their entries as any store does: a smaller table than the one saved
+  // keeps only some of them. Returns false with what went wrong in `*error`.
+  bool load(const std::string& path, std::string* error);
+
+  // Makes `hashed_perft` recount, without the table, the subtree of about
+  // `fraction` of the counts it finds in it, picked by their key, depth and
+  // `seed`, and trust the others. A count too big to recount at once, of
+  // more than `max_recount_nodes`, is instead checked against the sum of its
+  // children, each of them found and sampled in turn, so that a run whose
+  // root is in the table still samples many subtrees. A count that differs
+  // is replaced and counted in `num_mismatches`. A fraction f of the counts
+  // costs about f of the time of the run without the table.
+  void verify_sample(double fraction, uint64_t seed);
+  static constexpr uint64_t max_recount_nodes = uint64_t{1} << 20;
+  // Whether `hashed_perft` should check the count `nodes` it found for `key`
+  // at `depth` by its children, or recount it, and reports how that went.
+  bool should_split(uint64_t nodes) const {
+    return verify_threshold_ != 0 && nodes > max_recount_nodes;
+  }
+  bool should_verify(uint64_t key, int depth) const {
+    return verify_threshold_ != 0 &&
+           sample_value(key, depth) < verify_threshold_;
+  }
+  void add_verification(bool matched);
+  uint64_t num_verified() const { return num_verified_.load(); }
+  uint64_t num_mismatches() const { return num_mismatches_.load(); }
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check_;
+    // The node count in the high 56 bits, the depth in the low 8.
+    std::atomic<uint64_t> data_;
+  };
+  static_assert(sizeof(Entry) == 16, "Four entries should fill a cache line.");
+
+  Entry& entry(uint64_t key, int depth) const;
+  uint64_t sample_value(uint64_t key, int depth) const;
+
+  std::unique_ptr<Entry[]> entries_;
+  size_t mask_;
+  // A count is verified if its sample value is below this, so never if it
+  // is 0.
+  uint64_t verify_threshold_ = 0;
+  uint64_t verify_seed_ = 0;
+  std::atomic<uint64_t> num_verified_{0};
+  std::atomic<uint64_t> num_mismatches_{0};
+};
+
+// Returns `perft(board, depth)`, looking up and storing subtree counts in
+// `table`.
+template <typename MovePolicy = MakeUnmake>
+uint64_t hashed_perft(Board* board, int depth, PerftTable* table);
+
+// Returns `perft(board, depth)`, computed on `pool`. The tree is split into a
+// task per position a couple of plies below the root, and each task counts its
+// subtree on its own copy of the board. If `table` isn't null the tasks share
+// it as in `hashed_perft`.
+template <typename MovePolicy = MakeUnmake>
+uint64_t parallel_perft(const Board& board, int depth, ThreadPool* pool,
+                        PerftTable* table = nullptr);
+
+// Returns `perft(board, depth)` walked breadth first through `BoardBatch`es
+// of `batch_size` positions, one per ply: the children of the positions of a
+// ply go into the batch of the next ply, and the last ply is counted batch by
+// batch with `count_legal_moves` (see board_batch.h). A batch that fills up
+// is counted down to the leaves at once and cleared, so that memory stays at
+// a batch per ply. This is the shape of a perft on an accelerator, the host
+// feeding it frontiers of positions and adding up the counts; on the CPU it
+// is slower than `perft`, as every position goes through the batch format.
+uint64_t batch_perft(const Board& board, int depth, size_t batch_size);
+
+// A position some plies below the root of a perft, and the number of move
+// sequences that lead to it.
+struct PerftTask {
+  Board board_;
+  uint64_t multiplicity_;
+};
+
+// Returns the positions `plies` plies below `board`, one task per Zobrist key
+// in the order they are first reached, so that transpositions are counted
+// once. The sum of `multiplicity_ * perft(board_, depth - plies)` over the
+// tasks is `perft(board, depth)`. The tasks are independent and in a fixed
+// order, so that they can be counted anywhere, in any order, and a count that
+// is lost only costs its task: this is how a perft too deep for one machine
+// is spread over several (see `perft --split`).
+std::vector<PerftTask> split_perft(const Board& board, int plies);
+
+// The walks are defined, for both policies, in perft.cc.
+extern template uint64_t perft<MakeUnmake>(Board*, int);
+extern template uint64_t perft<CopyMake>(Board*, int);
+extern template PerftStats perft_stats<MakeUnmake>(Board*, int);
+extern template PerftStats perft_stats<CopyMake>(Board*, int);
+extern template std::vector<std::pair<Move, uint64_t>> divide<MakeUnmake>(
+    Board*, int);
+extern template std::vector<std::pair<Move, uint64_t>> divide<CopyMake>(
+    Board*, int);
+extern template uint64_t hashed_perft<MakeUnmake>(Board*, int, PerftTable*);
+extern template uint64_t hashed_perft<CopyMake>(Board*, int, PerftTable*);
+extern template uint64_t parallel_perft<MakeUnmake>(const Board&, int,
+                                                    ThreadPool*, PerftTable*);
+extern template uint64_t parallel_perft<CopyMake>(const Board&, int,
+                                                  ThreadPool*, PerftTable*);
+
+// A position of the standard perft suite, with its known counts.
+struct PerftSuitePosition {
+  const char* name_;
+  const char* fen_;
+  // The count at depth 1, 2 and so on.
+  std::array<uint64_t, 6> counts_;
+};
+
+// The start position, Kiwipete and positions 3 to 6 of the chessprogramming
+// wiki, which between them cover castling, en passant, promotions, pins and
+// checks.
+extern const std::array<PerftSuitePosition, 6> perft_suite;
+
+#endif
@@ -0,0 +1,789 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "numa.h"
+#include "perf_counters.h"
+#include "perft.h"
+#include "positions.h"
+#include "thread_pool.h"
+
+// Usage: perft [--divide] [--threads <n>] [--cpus <list>] [--hash <mb>]
+//              [--hash-file <file>] [--verify-sample <fraction>]
+//              [--copy-make] [--counters] <depth> [fen]
+//        perft --stats [--copy-make] <depth> [fen]
+//        perft --batch <positions> <depth> [fen]
+//        perft --epd <file> [--threads <n>] [--hash <mb>] [--copy-make]
+//              <depth>
+//        perft --suite [--baseline <file>] [--save-baseline <file>]
+//              [--threads <n>] [--cpus <list>] [--hash <mb>] [--copy-make]
+//              [--counters] <depth>
+//        perft --split <plies> <depth> [fen]
+//        perft --work <file> --results <file> [--shard <i>/<n>]
+//              [--threads <n>] [--cpus <list>] [--hash <mb>] [--copy-make]
+//        perft --sum <work file> <results file>...
+//
+// Prints the perft node count of the position, the start position when no FEN
+// is given, with the elapsed time and the node rate. With --divide the count
+// under every root move is printed first, in the format most engines use, so
+// that a wrong count can be narrowed down by diffing against another engine.
+// With --threads the count is split over n threads, or one per hardware thread
+// for n = 0, which --cpus pins to the CPUs of a Linux CPU list such as 0-3,8
+// in turn. With --hash subtree counts are cached in a table of that many
+// megabytes, shared by all threads. --divide always runs on one thread without
+// the table. --hash-file loads the table from that file, if it exists, and
+// saves it there at the end of a run that succeeded, so that the next run
+// finds the counts of this one (see `PerftTable`). --verify-sample recounts
+// about that fraction of the counts found in the table, such as 0.01,
+// picked at random for each run (see `PerftTable::verify_sample`), and the
+// exit status tells whether they all matched; a run with a wrong count
+// doesn't save the table. With --copy-make the tree is walked by copying the
+// board for every move rather than doing and undoing moves on one board (see
+// `MovePolicy` in perft.h), to compare the node rates of the two. --stats
+// breaks the count down by the last move as the reference tables do, captures,
+// en passant, castles, promotions, checks and mates (see `PerftStats`), on one
+// thread without the table. --batch walks the tree breadth first through
+// batches of that many positions (see `batch_perft`), also on one thread.
+//
+// With --counters the position is counted to every depth up to the one
+// given, and each depth is printed with its time and the hardware events it
+// took per node (see perf_counters.h): instructions, cycles, branch misses,
+// cache and TLB misses, for judging a change to the layout of Board or Move
+// by more than its time. With --suite every position is printed with its
+// events. The threads are started and joined for each count, so that their
+// events are counted with those of the calling thread. The --hash table is
+// kept from one depth to the next.
+//
+// With --epd the count is taken for every position of an EPD or FEN file,
+// possibly compressed (see positions.h), and printed a line per position in
+// the order of the file. The positions are spread over the threads, each
+// counted on one. A position with a "D<depth> <count>" operation, the format
+// of the usual perft suites, is checked against it, and the exit status tells
+// whether every count matched.
+//
+// With --suite the positions of the standard suite (see perft.h) are counted
+// to the depth, or to the deepest known count, and checked, with the time and
+// node rate of each and of them all. The exit status is non-zero if a count is
+// wrong, or if the node rate of them all is under 90% of that stored in the
+// --baseline file, the slack being for timing noise. --save-baseline stores
+// the node rate of a run whose counts are right, for later runs at the same
+// depth and threads to compare with.
+//
+// --split, --work and --sum spread a deep perft over machines through files
+// (see `split_perft` in perft.h). --split writes the distinct positions
+// <plies> below the position to stdout, a line per task of the remaining
+// depth, the multiplicity and the FEN. --work counts the tasks of a work file,
+// only those whose line number modulo <n> is <i> with --shard, so that several
+// workers can share one file, and appends a line of the line number and its
+// nodes, the multiplicity included, to the --results file as each task ends.
+// Tasks already in the results file are skipped, so a worker that stopped or
+// crashed is restarted with the same command and only loses the task it was
+// counting. --sum adds up the results files of all workers, and its exit
+// status tells whether every task of the work file was counted, once or with
+// the same count each time.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--divide] [--threads <n>] [--cpus <list>] [--hash <mb>]"
+               " [--hash-file <file>] [--verify-sample <fraction>]"
+               " [--copy-make] [--counters] <depth> [fen]\n"
+            << "       " << argv0 << " --stats [--copy-make] <depth> [fen]\n"
+            << "       " << argv0 << " --batch <positions> <depth> [fen]\n"
+            << "       " << argv0
+            << " --epd <file> [--threads <n>] [--hash <mb>] [--copy-make]"
+               " <depth>\n"
+            << "       " << argv0
+            << " --suite [--baseline <file>] [--save-baseline <file>]"
+               " [--threads <n>] [--cpus <list>] [--hash <mb>] [--copy-make]"
+               " [--counters] <depth>\n"
+            << "       " << argv0 << " --split <plies> <depth> [fen]\n"
+            << "       " << argv0
+            << " --work <file> --results <file> [--shard <i>/<n>]"
+               " [--threads <n>] [--cpus <list>] [--hash <mb>] [--copy-make]\n"
+            << "       " << argv0 << " --sum <work file> <results file>...\n";
+  return 1;
+}
+
+uint64_t nodes_per_second(uint64_t nodes, double seconds) {
+  return static_cast<uint64_t>(
+      seconds > 0 ? static_cast<double>(nodes) / seconds : 0);
+}
+
+// Counts `board` to `depth` on `pool`, or on this thread without one.
+template <typename MovePolicy>
+uint64_t count_nodes(Board* board, int depth, ThreadPool* pool,
+                     PerftTable* table) {
+  if (pool) {
+    return parallel_perft<MovePolicy>(*board, depth, pool, table);
+  }
+  return table ? hashed_perft<MovePolicy>(board, depth, table)
+               : perft<MovePolicy>(board, depth);
+}
+
+// Ends a run that returned `status` with `table`: reports the counts it
+// verified, and saves it to `hash_path` if there is one and the run and its
+// counts were right. Returns the exit status.
+int finish_with_table(const PerftTable* table, const char* hash_path,
+                      int status) {
+  if (!table) {
+    return status;
+  }
+  if (table->num_verified() > 0) {
+    std::cout << "Verified: " << table->num_verified() << " counts, "
+              << table->num_mismatches() << " wrong\n";
+  }
+  if (table->num_mismatches() > 0) {
+    status = 1;
+  }
+  std::string error;
+  if (status == 0 && hash_path && !table->save(hash_path, &error)) {
+    std::cerr << error << '\n';
+    return 1;
+  }
+  return status;
+}
+
+// Parses `shard`, "<i>/<n>" with i < n, into `*shard_idx` and `*num_shards`.
+bool parse_shard(absl::string_view shard, size_t* shard_idx,
+                 size_t* num_shards) {
+  const std::pair<absl::string_view, absl::string_view> fields =
+      absl::StrSplit(shard, absl::MaxSplits('/', 1));
+  return absl::SimpleAtoi(fields.first, shard_idx) &&
+         absl::SimpleAtoi(fields.second, num_shards) &&
+         *shard_idx < *num_shards;
+}
+
+// Returns the count of the "D<depth> <count>" operation of `operations`, or
+// -1 if there is none.
+int64_t expected_count(absl::string_view operations, int depth) {
+  const std::string prefix = absl::StrCat("D", depth, " ");
+  for (absl::string_view operation :
+       absl::StrSplit(operations, ';', absl::SkipWhitespace())) {
+    operation = absl::StripAsciiWhitespace(operation);
+    int64_t count = 0;
+    if (absl::ConsumePrefix(&operation, prefix) &&
+        absl::SimpleAtoi(operation, &count)) {
+      return count;
+    }
+  }
+  return -1;
+}
+
+// Same, with `num_threads` threads started and joined for the count, and the
+// hardware events of all of them in `*counts` and the seconds it took in
+// `*seconds`. Opening the counters isn't timed.
+template <typename MovePolicy>
+uint64_t count_nodes_with_events(Board* board, int depth, int num_threads,
+                                 const ThreadAffinity& affinity,
+                                 PerftTable* table, PerfCounts* counts,
+                                 double* seconds) {
+  PerfCounters counters;
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<ThreadPool> pool;
+  if (num_threads != 1) {
+    pool = std::make_unique<ThreadPool>(static_cast<size_t>(num_threads),
+                                        affinity);
+  }
+  const uint64_t res =
+      count_nodes<MovePolicy>(board, depth, pool.get(), table);
+  pool.reset();
+  *counts = counters.read();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  *seconds = elapsed.count();
+  return res;
+}
+
+template <typename MovePolicy>
+int run_suite(int depth, int num_threads, const ThreadAffinity& affinity,
+              PerftTable* table, bool count_events, const char* baseline_path,
+              const char* save_baseline_path) {
+  std::unique_ptr<ThreadPool> pool;
+  if (num_threads != 1 && !count_events) {
+    pool = std::make_unique<ThreadPool>(static_cast<size_t>(num_threads),
+                                        affinity);
+  }
+  uint64_t total_nodes = 0;
+  double total_seconds = 0;
+  bool counts_match = true;
+  for (const PerftSuitePosition& position : perft_suite) {
+    const int position_depth =
+        std::min(depth, static_cast<int>(position.counts_.size()));
+    Board board(position.fen_);
+    PerfCounts counts;
+    double seconds = 0;
+    uint64_t nodes = 0;
+    if (count_events) {
+      nodes = count_nodes_with_events<MovePolicy>(&board, position_depth,
+                                                  num_threads, affinity, table,
+                                                  &counts, &seconds);
+    } else {
+      const auto start = std::chrono::steady_clock::now();
+      nodes = count_nodes<MovePolicy>(&board, position_depth, pool.get(),
+                                      table);
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      seconds = elapsed.count();
+    }
+    total_nodes += nodes;
+    total_seconds += seconds;
+    const uint64_t expected =
+        position_depth > 0 ? position.counts_[position_depth - 1] : 1;
+    counts_match = counts_match && nodes == expected;
+    std::cout << position.name_ << " depth " << position_depth << ": "
+              << nodes;
+    if (nodes != expected) {
+      std::cout << " expected " << expected;
+    }
+    std::cout << ", " << seconds << " s, "
+              << nodes_per_second(nodes, seconds) << " nodes/second\n";
+    if (count_events) {
+      std::cout << "  " << perf_counts_to_str(counts, nodes, "node") << '\n';
+    }
+  }
+  const uint64_t total_rate = nodes_per_second(total_nodes, total_seconds);
+  std::cout << "\nNodes: " << total_nodes << '\n';
+  std::cout << "Time: " << total_seconds << " s\n";
+  std::cout << "Nodes/second: " << total_rate << '\n';
+  std::cout << "Counts: " << (counts_match ? "ok" : "WRONG") << '\n';
+
+  bool is_fast_enough = true;
+  if (baseline_path) {
+    std::ifstream baseline_file(baseline_path);
+    uint64_t baseline = 0;
+    if (!(baseline_file >> baseline)) {
+      std::cerr << "Can't read a baseline from " << baseline_path << '\n';
+      return 1;
+    }
+    is_fast_enough = total_rate * 10 >= baseline * 9;
+    std::cout << "Baseline: " << baseline << " nodes/second, "
+              << (is_fast_enough ? "ok" : "TOO SLOW") << '\n';
+  }
+  if (save_baseline_path && counts_match) {
+    std::ofstream save_file(save_baseline_path);
+    if (!(save_file << total_rate << '\n')) {
+      std::cerr << "Can't write " << save_baseline_path << '\n';
+      return 1;
+    }
+  }
+  return counts_match && is_fast_enough ? 0 : 1;
+}
+
+// Counts `board` to every depth from 1 to `depth`, with the time and the
+// hardware events of each.
+template <typename MovePolicy>
+int run_depths(Board* board, int depth, int num_threads,
+               const ThreadAffinity& affinity, PerftTable* table) {
+  for (int d = 1; d <= depth; ++d) {
+    PerfCounts counts;
+    double seconds = 0;
+    const uint64_t nodes = count_nodes_with_events<MovePolicy>(
+        board, d, num_threads, affinity, table, &counts, &seconds);
+    std::cout << "Depth " << d << ": " << nodes << ", " << seconds
+              << " s, " << nodes_per_second(nodes, seconds)
+              << " nodes/second\n  "
+              << perf_counts_to_str(counts, nodes, "node") << '\n';
+  }
+  return 0;
+}
+
+template <typename MovePolicy>
+int run_epd(const std::string& path, int depth, int num_threads,
+            PerftTable* table) {
+  ChunkReader reader(path);
+  if (!reader.is_open()) {
+    std::cerr << "Can't open " << path << '\n';
+    return 1;
+  }
+  std::atomic<uint64_t> total_nodes(0);
+  std::atomic<uint64_t> num_failures(0);
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t num_positions = process_lines(
+      &reader, static_cast<size_t>(num_threads), 4096,
+      [&](size_t, absl::string_view line, std::string* out) {
+        absl::string_view operations;
+        const char* error = nullptr;
+        absl::optional<Board> board = parse_epd(line, &operations, &error);
+        if (!board) {
+          absl::StrAppend(out, error, "\n");
+          num_failures.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        const uint64_t nodes =
+            table ? hashed_perft<MovePolicy>(&*board, depth, table)
+                  : perft<MovePolicy>(&*board, depth);
+        total_nodes.fetch_add(nodes, std::memory_order_relaxed);
+        absl::StrAppend(out, nodes);
+        const int64_t expected = expected_count(operations, depth);
+        if (expected >= 0 && static_cast<uint64_t>(expected) == nodes) {
+          absl::StrAppend(out, " ok");
+        } else if (expected >= 0) {
+          absl::StrAppend(out, " expected ", expected);
+          num_failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        absl::StrAppend(out, "\n");
+      },
+      [](absl::string_view output) { std::cout << output; });
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (!reader.close()) {
+    std::cerr << "Can't read all of " << path << '\n';
+    return 1;
+  }
+
+  std::cout << "\nPositions: " << num_positions << '\n';
+  std::cout << "Failures: " << num_failures.load() << '\n';
+  std::cout << "Nodes: " << total_nodes.load() << '\n';
+  std::cout << "Time: " << elapsed.count() << " s\n";
+  return num_failures.load() == 0 ? 0 : 1;
+}
+
+// Returns the contents of the file at `path`, or nullopt if it can't be read.
+absl::optional<std::string> read_file(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return absl::nullopt;
+  }
+  std::ostringstream res;
+  res << file.rdbuf();
+  return res.str();
+}
+
+// A line of a work file.
+struct WorkTask {
+  // The depth left to count below the position.
+  int depth_;
+  uint64_t multiplicity_;
+  Board board_;
+};
+
+// Appends the tasks of the work file at `path` to `*tasks`, or returns false
+// with what is wrong in `*error`.
+bool read_work(const std::string& path, std::vector<WorkTask>* tasks,
+               std::string* error) {
+  const absl::optional<std::string> contents = read_file(path);
+  if (!contents) {
+    *error = absl::StrCat("Can't read ", path);
+    return false;
+  }
+  for (absl::string_view line :
+       absl::StrSplit(*contents, '\n', absl::SkipEmpty())) {
+    const std::vector<absl::string_view> fields =
+        absl::StrSplit(line, absl::MaxSplits(' ', 2));
+    WorkTask task;
+    absl::optional<Board> board;
+    if (fields.size() != 3 || !absl::SimpleAtoi(fields[0], &task.depth_) ||
+        task.depth_ < 0 || !absl::SimpleAtoi(fields[1], &task.multiplicity_) ||
+        !(board = parse_fen(fields[2]))) {
+      *error = absl::StrCat("Malformed task in ", path, ": ", line);
+      return false;
+    }
+    task.board_ = *board;
+    tasks->push_back(task);
+  }
+  return true;
+}
+
+// Adds the "<task> <nodes>" lines of `contents`, those of a results file, to
+// `*results`. Only complete lines count, since a worker that was killed may
+// have left one cut short at the end. Returns false, with what is wrong in
+// `*error`, for a malformed line or a task with two different counts.
+bool add_results(absl::string_view contents,
+                 absl::flat_hash_map<uint64_t, uint64_t>* results,
+                 std::string* error) {
+  contents = contents.substr(0, contents.rfind('\n') + 1);
+  for (absl::string_view line :
+       absl::StrSplit(contents, '\n', absl::SkipEmpty())) {
+    const std::pair<absl::string_view, absl::string_view> fields =
+        absl::StrSplit(line, absl::MaxSplits(' ', 1));
+    uint64_t task = 0;
+    uint64_t nodes = 0;
+    if (!absl::SimpleAtoi(fields.first, &task) ||
+        !absl::SimpleAtoi(fields.second, &nodes)) {
+      *error = absl::StrCat("Malformed result: ", line);
+      return false;
+    }
+    const auto inserted = results->emplace(task, nodes);
+    if (!inserted.second && inserted.first->second != nodes) {
+      *error = absl::StrCat("Task ", task, " has two different counts");
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes the tasks of counting `board` to `depth` split `plies` below it.
+int run_split(const Board& board, int plies, int depth) {
+  const std::vector<PerftTask> tasks = split_perft(board, plies);
+  std::string line;
+  for (const PerftTask& task : tasks) {
+    line = absl::StrCat(depth - plies, " ", task.multiplicity_, " ");
+    task.board_.append_fen(&line);
+    std::cout << line << '\n';
+  }
+  std::cerr << tasks.size() << " tasks\n";
+  return std::cout.flush() ? 0 : 1;
+}
+
+template <typename MovePolicy>
+int run_work(const std::string& work_path, const std::string& results_path,
+             size_t shard_idx, size_t num_shards, int num_threads,
+             const ThreadAffinity& affinity, PerftTable* table) {
+  std::vector<WorkTask> tasks;
+  std::string error;
+  if (!read_work(work_path, &tasks, &error)) {
+    std::cerr << error << '\n';
+    return 1;
+  }
+  absl::flat_hash_map<uint64_t, uint64_t> done;
+  if (const absl::optional<std::string> contents = read_file(results_path)) {
+    if (!add_results(*contents, &done, &error)) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+    // Drops a line cut short, so that the next result starts a line.
+    const size_t complete_size = contents->rfind('\n') + 1;
+    if (complete_size != contents->size() &&
+        !(std::ofstream(results_path, std::ios::binary | std::ios::trunc)
+          << contents->substr(0, complete_size))) {
+      std::cerr << "Can't write " << results_path << '\n';
+      return 1;
+    }
+  }
+  std::ofstream results(results_path, std::ios::binary | std::ios::app);
+  if (!results) {
+    std::cerr << "Can't write " << results_path << '\n';
+    return 1;
+  }
+  std::unique_ptr<ThreadPool> pool;
+  if (num_threads != 1) {
+    pool = std::make_unique<ThreadPool>(static_cast<size_t>(num_threads),
+                                        affinity);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t total_nodes = 0;
+  size_t num_counted = 0;
+  size_t num_skipped = 0;
+  for (size_t i = shard_idx; i < tasks.size(); i += num_shards) {
+    if (done.count(i)) {
+      ++num_skipped;
+      continue;
+    }
+    const uint64_t nodes =
+        tasks[i].multiplicity_ *
+        count_nodes<MovePolicy>(&tasks[i].board_, tasks[i].depth_, pool.get(),
+                                table);
+    // Flushed at once, as the checkpoint of this task.
+    results << i << ' ' << nodes << '\n' << std::flush;
+    if (!results) {
+      std::cerr << "Can't write " << results_path << '\n';
+      return 1;
+    }
+    total_nodes += nodes;
+    ++num_counted;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "Tasks: " << num_counted << " counted, " << num_skipped
+            << " done before\n";
+  std::cout << "Nodes: " << total_nodes << '\n';
+  std::cout << "Time: " << elapsed.count() << " s\n";
+  std::cout << "Nodes/second: "
+            << nodes_per_second(total_nodes, elapsed.count()) << '\n';
+  return 0;
+}
+
+int run_sum(const std::string& work_path,
+            const std::vector<std::string>& results_paths) {
+  std::vector<WorkTask> tasks;
+  std::string error;
+  if (!read_work(work_path, &tasks, &error)) {
+    std::cerr << error << '\n';
+    return 1;
+  }
+  absl::flat_hash_map<uint64_t, uint64_t> results;
+  for (const std::string& path : results_paths) {
+    const absl::optional<std::string> contents = read_file(path);
+    if (!contents) {
+      std::cerr << "Can't read " << path << '\n';
+      return 1;
+    }
+    if (!add_results(*contents, &results, &error)) {
+      std::cerr << path << ": " << error << '\n';
+      return 1;
+    }
+  }
+  uint64_t total_nodes = 0;
+  size_t num_missing = 0;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    const auto it = results.find(i);
+    if (it == results.end()) {
+      ++num_missing;
+    } else {
+      total_nodes += it->second;
+    }
+  }
+  if (results.size() + num_missing != tasks.size()) {
+    std::cerr << "Results of tasks the work file doesn't have\n";
+    return 1;
+  }
+  std::cout << "Tasks: " << tasks.size() << ", " << num_missing
+            << " missing\n";
+  std::cout << "Nodes: " << total_nodes
+            << (num_missing ? " (incomplete)" : "") << '\n';
+  return num_missing == 0 ? 0 : 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  int arg_idx = 1;
+  bool divide_mode = false;
+  bool stats_mode = false;
+  size_t batch_size = 0;
+  const char* epd_path = nullptr;
+  bool suite_mode = false;
+  const char* baseline_path = nullptr;
+  const char* save_baseline_path = nullptr;
+  int num_threads = 1;
+  int hash_mb = 0;
+  const char* hash_path = nullptr;
+  double verify_fraction = 0;
+  bool copy_make = false;
+  bool count_events = false;
+  ThreadAffinity affinity;
+  int split_plies = -1;
+  const char* work_path = nullptr;
+  const char* results_path = nullptr;
+  size_t shard_idx = 0;
+  size_t num_shards = 1;
+  bool sum_mode = false;
+  for (; arg_idx < argc && std::strncmp(argv[arg_idx], "--", 2) == 0;
+       ++arg_idx) {
+    if (std::strcmp(argv[arg_idx], "--divide") == 0) {
+      divide_mode = true;
+    } else if (std::strcmp(argv[arg_idx], "--stats") == 0) {
+      stats_mode = true;
+    } else if (std::strcmp(argv[arg_idx], "--batch") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtoi(argv[arg_idx + 1], &batch_size) &&
+               batch_size > 0) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--epd") == 0 &&
+               arg_idx + 1 < argc) {
+      epd_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--suite") == 0) {
+      suite_mode = true;
+    } else if (std::strcmp(argv[arg_idx], "--copy-make") == 0) {
+      copy_make = true;
+    } else if (std::strcmp(argv[arg_idx], "--counters") == 0) {
+      count_events = true;
+    } else if (std::strcmp(argv[arg_idx], "--split") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtoi(argv[arg_idx + 1], &split_plies) &&
+               split_plies >= 0) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--work") == 0 &&
+               arg_idx + 1 < argc) {
+      work_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--results") == 0 &&
+               arg_idx + 1 < argc) {
+      results_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--shard") == 0 &&
+               arg_idx + 1 < argc &&
+               parse_shard(argv[arg_idx + 1], &shard_idx, &num_shards)) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--sum") == 0) {
+      sum_mode = true;
+    } else if (std::strcmp(argv[arg_idx], "--cpus") == 0 &&
+               arg_idx + 1 < argc &&
+               !(affinity.cpus_ = parse_cpu_list(argv[arg_idx + 1])).empty()) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--baseline") == 0 &&
+               arg_idx + 1 < argc) {
+      baseline_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--save-baseline") == 0 &&
+               arg_idx + 1 < argc) {
+      save_baseline_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--threads") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtoi(argv[arg_idx + 1], &num_threads) &&
+               num_threads >= 0) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--hash") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtoi(argv[arg_idx + 1], &hash_mb) && hash_mb > 0) {
+      ++arg_idx;
+    } else if (std::strcmp(argv[arg_idx], "--hash-file") == 0 &&
+               arg_idx + 1 < argc) {
+      hash_path = argv[++arg_idx];
+    } else if (std::strcmp(argv[arg_idx], "--verify-sample") == 0 &&
+               arg_idx + 1 < argc &&
+               absl::SimpleAtod(argv[arg_idx + 1], &verify_fraction) &&
+               verify_fraction > 0 && verify_fraction <= 1) {
+      ++arg_idx;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  const bool split_mode = split_plies >= 0;
+  if (divide_mode + stats_mode + (batch_size > 0) + (epd_path != nullptr) +
+              suite_mode + split_mode + (work_path != nullptr) + sum_mode >
+          1 ||
+      (results_path != nullptr) != (work_path != nullptr) ||
+      (num_shards > 1 && !work_path) ||
+      (count_events && (divide_mode || stats_mode || batch_size > 0 ||
+                        epd_path || split_mode || work_path || sum_mode)) ||
+      ((hash_path || verify_fraction > 0) &&
+       (hash_mb == 0 || divide_mode || stats_mode || batch_size > 0 ||
+        split_mode || sum_mode))) {
+    return usage(argv[0]);
+  }
+  if (sum_mode) {
+    if (argc - arg_idx < 2) {
+      return usage(argv[0]);
+    }
+    return run_sum(argv[arg_idx],
+                   std::vector<std::string>(argv + arg_idx + 1, argv + argc));
+  }
+  std::unique_ptr<PerftTable> table;
+  if (hash_mb > 0) {
+    table = std::make_unique<PerftTable>(static_cast<size_t>(hash_mb) << 20);
+    std::string error;
+    if (hash_path && std::ifstream(hash_path).is_open() &&
+        !table->load(hash_path, &error)) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+    table->verify_sample(verify_fraction, std::random_device()());
+  }
+  if (work_path) {
+    if (arg_idx != argc) {
+      return usage(argv[0]);
+    }
+    return finish_with_table(
+        table.get(), hash_path,
+        copy_make ? run_work<CopyMake>(work_path, results_path, shard_idx,
+                                       num_shards, num_threads, affinity,
+                                       table.get())
+                  : run_work<MakeUnmake>(work_path, results_path, shard_idx,
+                                         num_shards, num_threads, affinity,
+                                         table.get()));
+  }
+  int depth = 0;
+  if (arg_idx >= argc || !absl::SimpleAtoi(argv[arg_idx], &depth) ||
+      depth < 0 || (divide_mode && depth < 1) ||
+      ((epd_path || suite_mode) &&
+       (divide_mode || arg_idx + 1 != argc)) ||
+      (epd_path && (suite_mode || !affinity.cpus_.empty())) ||
+      ((baseline_path || save_baseline_path) && !suite_mode) ||
+      split_plies > depth) {
+    return usage(argv[0]);
+  }
+  ++arg_idx;
+  if (epd_path) {
+    return finish_with_table(
+        table.get(), hash_path,
+        copy_make
+            ? run_epd<CopyMake>(epd_path, depth, num_threads, table.get())
+            : run_epd<MakeUnmake>(epd_path, depth, num_threads, table.get()));
+  }
+  if (suite_mode) {
+    return finish_with_table(
+        table.get(), hash_path,
+        copy_make ? run_suite<CopyMake>(depth, num_threads, affinity,
+                                        table.get(), count_events,
+                                        baseline_path, save_baseline_path)
+                  : run_suite<MakeUnmake>(depth, num_threads, affinity,
+                                          table.get(), count_events,
+                                          baseline_path, save_baseline_path));
+  }
+  // The FEN is usually passed as one quoted argument, but its six fields may
+  // also come as separate arguments.
+  std::string fen;
+  for (; arg_idx < argc; ++arg_idx) {
+    if (!fen.empty()) {
+      fen += ' ';
+    }
+    fen += argv[arg_idx];
+  }
+  Board board = fen.empty() ? Board() : Board(fen);
+  if (split_mode) {
+    return run_split(board, split_plies, depth);
+  }
+  if (count_events) {
+    return finish_with_table(
+        table.get(), hash_path,
+        copy_make ? run_depths<CopyMake>(&board, depth, num_threads,
+                                         affinity, table.get())
+                  : run_depths<MakeUnmake>(&board, depth, num_threads,
+                                           affinity, table.get()));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t nodes = 0;
+  if (divide_mode) {
+    for (const auto& move_and_nodes : copy_make
+                                          ? divide<CopyMake>(&board, depth)
+                                          : divide<MakeUnmake>(&board, depth)) {
+      std::cout << move_and_nodes.first.to_uci_str() << ": "
+                << move_and_nodes.second << '\n';
+      nodes += move_and_nodes.second;
+    }
+    std::cout << '\n';
+  } else if (stats_mode) {
+    const PerftStats stats = copy_make ? perft_stats<CopyMake>(&board, depth)
+                                       : perft_stats<MakeUnmake>(&board, depth);
+    std::cout << "Captures: " << stats.captures_ << '\n'
+              << "En passant: " << stats.en_passants_ << '\n'
+              << "Castles: " << stats.castles_ << '\n'
+              << "Promotions: " << stats.promotions_ << '\n'
+              << "Checks: " << stats.checks_ << '\n'
+              << "Discovered checks: " << stats.discovered_checks_ << '\n'
+              << "Double checks: " << stats.double_checks_ << '\n'
+              << "Checkmates: " << stats.checkmates_ << "\n\n";
+    nodes = stats.nodes_;
+  } else if (batch_size > 0) {
+    nodes = batch_perft(board, depth, batch_size);
+  } else {
+    std::unique_ptr<ThreadPool> pool;
+    if (num_threads != 1) {
+      pool = std::make_unique<ThreadPool>(static_cast<size_t>(num_threads),
+                                          affinity);
+    }
+    nodes = copy_make
+                ? count_nodes<CopyMake>(&board, depth, pool.get(), table.get())
+                : count_nodes<MakeUnmake>(&board, depth, pool.get(),
+                                          table.get());
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "Nodes: " << nodes << '\n';
+  std::cout << "Time: " << elapsed.count() << " s\n";
+  std::cout << "Nodes/second: " << nodes_per_second(nodes, elapsed.count())
+            << '\n';
+  return finish_with_table(table.get(), hash_path, 0);
+}
@@ -0,0 +1,296 @@
+#include "perft.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "thread_pool.h"
+#include "gtest/gtest.h"
+
+TEST(Perft, StartPosition) {
+  Board board = Board();
+  EXPECT_EQ(perft(&board, 0), 1);
+  EXPECT_EQ(perft(&board, 1), 20);
+  EXPECT_EQ(perft(&board, 2), 400);
+  EXPECT_EQ(perft(&board, 3), 8902);
+  EXPECT_EQ(board, Board());
+}
+
+TEST(Perft, Kiwipete) {
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  EXPECT_EQ(perft(&board, 1), 48);
+  EXPECT_EQ(perft(&board, 2), 2039);
+  EXPECT_EQ(perft(&board, 3), 97862);
+}
+
+TEST(Perft, Chess960) {
+  // Positions from the Chess960 perft results collected by Reinhard
+  // Scharnagl, with castling rights in Shredder-FEN.
+  Board board(
+      "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9");
+  EXPECT_EQ(perft(&board, 1), 21);
+  EXPECT_EQ(perft(&board, 2), 528);
+  EXPECT_EQ(perft(&board, 3), 12189);
+  EXPECT_EQ(perft(&board, 4), 326672);
+  board = Board(
+      "2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9");
+  EXPECT_EQ(perft(&board, 1), 21);
+  EXPECT_EQ(perft(&board, 2), 807);
+  EXPECT_EQ(perft(&board, 3), 18002);
+}
+
+TEST(PerftSuite, MatchesKnownCounts) {
+  // The deeper counts are left to `perft --suite`.
+  for (const PerftSuitePosition& position : perft_suite) {
+    Board board(position.fen_);
+    for (int depth = 1; depth <= 3; ++depth) {
+      EXPECT_EQ(perft(&board, depth), position.counts_[depth - 1])
+          << position.name_ << " depth " << depth;
+    }
+  }
+}
+
+TEST(PerftSuite, CopyMakeMatchesKnownCounts) {
+  for (const PerftSuitePosition& position : perft_suite) {
+    Board board(position.fen_);
+    const Board original = board;
+    for (int depth = 1; depth <= 3; ++depth) {
+      EXPECT_EQ(perft<CopyMake>(&board, depth), position.counts_[depth - 1])
+          << position.name_ << " depth " << depth;
+    }
+    EXPECT_EQ(board, original);
+  }
+  ThreadPool pool(2);
+  PerftTable table(1 << 16);
+  Board board = Board();
+  EXPECT_EQ(hashed_perft<CopyMake>(&board, 4, &table), 197281);
+  EXPECT_EQ(parallel_perft<CopyMake>(board, 4, &pool), 197281);
+  EXPECT_EQ(divide<CopyMake>(&board, 2).size(), 20);
+}
+
+TEST(Divide, SumsToPerft) {
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  uint64_t total = 0;
+  const auto counts = divide(&board, 3);
+  EXPECT_EQ(counts.size(), 48);
+  for (const auto& move_and_nodes : counts) {
+    total += move_and_nodes.second;
+  }
+  EXPECT_EQ(total, 97862);
+}
+
+TEST(Divide, StartPositionDepthOne) {
+  Board board = Board();
+  for (const auto& move_and_nodes : divide(&board, 1)) {
+    EXPECT_EQ(move_and_nodes.second, 1);
+  }
+}
+
+TEST(Perft, BulkCountingMatchesFullRecursion) {
+  // number_of_moves does every move down to depth 0.
+  const std::vector<std::string> fens = {
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"};
+  for (const std::string& fen : fens) {
+    Board board = Board(fen);
+    for (int depth = 0; depth <= 3; ++depth) {
+      EXPECT_EQ(perft(&board, depth),
+                static_cast<uint64_t>(number_of_moves(board, depth)));
+    }
+  }
+}
+
+TEST(ParallelPerft, MatchesPerft) {
+  ThreadPool pool(4);
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  for (int depth = 0; depth <= 4; ++depth) {
+    EXPECT_EQ(parallel_perft(board, depth, &pool), perft(&board, depth));
+  }
+}
+
+TEST(PerftTable, ProbeAndStore) {
+  PerftTable table(1 << 16);
+  EXPECT_EQ(table.num_entries(), 4096);
+  uint64_t nodes = 0;
+  EXPECT_FALSE(table.probe(0x1234, 3, &nodes));
+  table.store(0x1234, 3, 97862);
+  EXPECT_TRUE(table.probe(0x1234, 3, &nodes));
+  EXPECT_EQ(nodes, 97862);
+  // Neither another depth nor another key matches the entry.
+  EXPECT_FALSE(table.probe(0x1234, 4, &nodes));
+  EXPECT_FALSE(table.probe(0x1234 + table.num_entries(), 3, &nodes));
+}
+
+TEST(HashedPerft, MatchesPerft) {
+  PerftTable table(1 << 20);
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  for (int depth = 0; depth <= 4; ++depth) {
+    EXPECT_EQ(hashed_perft(&board, depth, &table), perft(&board, depth));
+  }
+  // A second run is answered from the table.
+  EXPECT_EQ(hashed_perft(&board, 4, &table), 4085603);
+}
+
+TEST(HashedPerft, TinyTableStillCorrect) {
+  // With one entry nearly every store overwrites another count.
+  PerftTable table(0);
+  EXPECT_EQ(table.num_entries(), 1);
+  Board board = Board();
+  EXPECT_EQ(hashed_perft(&board, 4, &table), 197281);
+}
+
+TEST(PerftTable, SaveAndLoad) {
+  const std::string path = testing::TempDir() + "perft_table_test";
+  Board board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  PerftTable table(1 << 20);
+  EXPECT_EQ(hashed_perft(&board, 4, &table), 4085603);
+  std::string error;
+  ASSERT_TRUE(table.save(path, &error)) << error;
+
+  // A smaller table keeps some of the counts, and the rest are counted again.
+  for (size_t size : {size_t{1} << 20, size_t{1} << 12}) {
+    PerftTable loaded(size);
+    ASSERT_TRUE(loaded.load(path, &error)) << error;
+    if (size == size_t{1} << 20) {
+      uint64_t nodes = 0;
+      EXPECT_TRUE(loaded.probe(board.key_, 4, &nodes));
+    }
+    EXPECT_EQ(hashed_perft(&board, 4, &loaded), 4085603);
+  }
+
+  EXPECT_FALSE(table.load(path + ".missing", &error));
+  std::FILE* file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  std::fputc('X', file);
+  std::fclose(file);
+  EXPECT_FALSE(table.load(path, &error));
+  std::remove(path.c_str());
+}
+
+TEST(PerftTable, VerifiesASample) {
+  Board board = Board();
+  PerftTable table(1 << 20);
+  // A wrong count, as a broken move generator would have saved it.
+  table.store(board.key_, 4, 197280);
+  EXPECT_EQ(hashed_perft(&board, 4, &table), 197280);
+  EXPECT_EQ(table.num_verified(), 0);
+
+  // With every count verified, the wrong one is found and replaced.
+  table.verify_sample(1, 1);
+  EXPECT_EQ(hashed_perft(&board, 4, &table), 197281);
+  EXPECT_EQ(table.num_verified(), 1);
+  EXPECT_EQ(table.num_mismatches(), 1);
+  EXPECT_EQ(hashed_perft(&board, 4, &table), 197281);
+  EXPECT_EQ(table.num_verified(), 2);
+  EXPECT_EQ(table.num_mismatches(), 1);
+
+  // About the fraction asked for of the counts are verified.
+  Board kiwipete = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  PerftTable sampled(1 << 20);
+  hashed_perft(&kiwipete, 4, &sampled);
+  sampled.verify_sample(0.25, 7);
+  for (Move move : kiwipete.legal_moves()) {
+    Board child = kiwipete;
+    child.do_move(move);
+    hashed_perft(&child, 3, &sampled);
+  }
+  EXPECT_GT(sampled.num_verified(), 0);
+  EXPECT_LT(sampled.num_verified(), kiwipete.num_legal_moves());
+  EXPECT_EQ(sampled.num_mismatches(), 0);
+
+  // A root too big to recount is checked by its children, and so on down,
+  // so even a run answered from the table samples many subtrees.
+  PerftTable deep(1 << 22);
+  EXPECT_EQ(hashed_perft(&board, 5, &deep), 4865609);
+  deep.store(board.key_, 5, 4865610);
+  deep.verify_sample(0.25, 7);
+  EXPECT_EQ(hashed_perft(&board, 5, &deep), 4865609);
+  EXPECT_GT(deep.num_verified(), 2);
+  EXPECT_EQ(deep.num_mismatches(), 1);
+}
+
+TEST(ParallelPerft, SharedTable) {
+  ThreadPool pool(4);
+  PerftTable table(1 << 20);
+  Board board = Board();
+  EXPECT_EQ(parallel_perft(board, 5, &pool, &table), 4865609);
+}
+
+TEST(SplitPerft, TasksSumToPerft) {
+  for (const PerftSuitePosition& position : perft_suite) {
+    const Board board(position.fen_);
+    for (int plies = 0; plies <= 3; ++plies) {
+      uint64_t total = 0;
+      uint64_t num_paths = 0;
+      for (PerftTask& task : split_perft(board, plies)) {
+        total += task.multiplicity_ * perft(&task.board_, 4 - plies);
+        num_paths += task.multiplicity_;
+      }
+      EXPECT_EQ(total, position.counts_[3])
+          << position.name_ << " split " << plies;
+      EXPECT_EQ(num_paths, plies == 0 ? 1 : position.counts_[plies - 1]);
+    }
+  }
+}
+
+TEST(SplitPerft, MergesTranspositions) {
+  const std::vector<PerftTask> tasks = split_perft(Board(), 3);
+  EXPECT_LT(tasks.size(), 8902);
+  // 1. Nf3 Nf6 2. Nc3 and 1. Nc3 Nf6 2. Nf3.
+  Board board;
+  for (const char* move : {"g1f3", "g8f6", "b1c3"}) {
+    board.do_move(*parse_uci_move(board, move));
+  }
+  const auto it =
+      std::find_if(tasks.begin(), tasks.end(), [&](const PerftTask& task) {
+        return task.board_.key_ == board.key_;
+      });
+  ASSERT_NE(it, tasks.end());
+  EXPECT_EQ(it->multiplicity_, 2);
+}
+
+TEST(PerftStats, MatchesReferenceTables) {
+  // The tables of the chessprogramming wiki.
+  Board board = Board();
+  EXPECT_EQ(perft_stats(&board, 0), PerftStats({1, 0, 0, 0, 0, 0, 0, 0, 0}));
+  EXPECT_EQ(perft_stats(&board, 4),
+            PerftStats({197281, 1576, 0, 0, 0, 469, 0, 0, 8}));
+  board = Board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  EXPECT_EQ(perft_stats(&board, 2),
+            PerftStats({2039, 351, 1, 91, 0, 3, 0, 0, 0}));
+  EXPECT_EQ(perft_stats<CopyMake>(&board, 3),
+            PerftStats({97862, 17102, 45, 3162, 0, 993, 0, 0, 1}));
+  board = Board("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1");
+  EXPECT_EQ(perft_stats(&board, 5),
+            PerftStats({674624, 52051, 1165, 0, 0, 52950, 1292, 3, 0}));
+  board = Board(
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+  // The table of this one has no discovered checks, and c5xb6 uncovers the
+  // bishop on b4 after 1. c5 Ke7 and 1. c5 Kf8.
+  EXPECT_EQ(perft_stats(&board, 3),
+            PerftStats({9467, 1021, 4, 0, 120, 38, 2, 0, 22}));
+}
+
+TEST(BatchPerft, MatchesKnownCounts) {
+  for (const PerftSuitePosition& position : perft_suite) {
+    const Board board(position.fen_);
+    EXPECT_EQ(batch_perft(board, 0, 1), 1);
+    // Batches too small for a ply are counted as they fill up.
+    for (size_t batch_size : {1, 7, 4096}) {
+      EXPECT_EQ(batch_perft(board, 3, batch_size), position.counts_[2])
+          << position.name_ << " batches of " << batch_size;
+    }
+  }
+}
@@ -0,0 +1,587 @@
+#include "pgn.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "attacks.h"
+#include "bitboard.h"
+#include "board.h"
+
+namespace {
+// How many pieces `read_games_parallel` cuts a text into per worker.
+constexpr size_t pieces_per_worker = 16;
+
+// What `next_token` found.
+enum class Token { move, result, end };
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool ends_token(char c) {
+  return is_space(c) || c == '.' || c == '{' || c == '}' || c == '(' ||
+         c == ')' || c == ';' || c == '[' || c == '$';
+}
+
+bool is_digits(absl::string_view token) {
+  for (char c : token) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_annotation(absl::string_view token) {
+  for (char c : token) {
+    if (c != '!' && c != '?') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the end of the line that `pos` is on, or of `text`.
+size_t line_end(absl::string_view text, size_t pos) {
+  const size_t end = text.find('\n', pos);
+  return end == absl::string_view::npos ? text.size() : end;
+}
+
+// Returns the start of the first game at or after `pos`, or the size of
+// `text` if there is none.
+size_t next_game_start(absl::string_view text, size_t pos) {
+  size_t begin = pos;
+  if (pos > 0 && text[pos - 1] != '\n') {
+    begin = line_end(text, pos) + 1;
+  }
+  // Whether the line before `begin` is a tag.
+  bool follows_tag = false;
+  if (begin >= 2 && begin <= text.size()) {
+    const size_t prev_newline = text.rfind('\n', begin - 2);
+    follows_tag =
+        text[prev_newline == absl::string_view::npos ? 0 : prev_newline + 1] ==
+        '[';
+  }
+  while (begin < text.size()) {
+    const bool is_tag = text[begin] == '[';
+    if (is_tag && !follows_tag) {
+      return begin;
+    }
+    follows_tag = is_tag;
+    begin = line_end(text, begin) + 1;
+  }
+  return text.size();
+}
+
+// Moves `*text` past its next move or result, which goes to `*token`,
+// skipping everything else. Stops at the start of a tag, which must be the
+// next game's.
+Token next_token(absl::string_view* text, absl::string_view* token) {
+  const absl::string_view s = *text;
+  size_t pos = 0;
+  // How deep in variations `pos` is. Their moves are skipped.
+  int depth = 0;
+  while (pos < s.size()) {
+    const char c = s[pos];
+    if (is_space(c) || c == '.' || c == '}') {
+      ++pos;
+    } else if (c == '{') {
+      const size_t end = s.find('}', pos);
+      pos = end == absl::string_view::npos ? s.size() : end + 1;
+    } else if (c == ';' || (c == '%' && (pos == 0 || s[pos - 1] == '\n'))) {
+      pos = line_end(s, pos);
+    } else if (c == '(') {
+      ++depth;
+      ++pos;
+    } else if (c == ')') {
+      depth -= depth > 0;
+      ++pos;
+    } else if (c == '$') {
+      // A numeric annotation glyph.
+      for (++pos; pos < s.size() && s[pos] >= '0' && s[pos] <= '9'; ++pos) {
+      }
+    } else if (c == '[') {
+      break;
+    } else {
+      size_t end = pos + 1;
+      while (end < s.size() && !ends_token(s[end])) {
+        ++end;
+      }
+      const absl::string_view found = s.substr(pos, end - pos);
+      pos = end;
+      // Move numbers are all digits, followed by dots.
+      if (depth > 0 || is_digits(found) || is_annotation(found)) {
+        continue;
+      }
+      *token = found;
+      *text = s.substr(pos);
+      return found == "1-0" || found == "0-1" || found == "1/2-1/2" ||
+                     found == "*"
+                 ? Token::result
+                 : Token::move;
+    }
+  }
+  *text = s.substr(pos);
+  return Token::end;
+}
+
+Bitboard piece_attacks(Piece piece, int sq_idx, Bitboard occupancy) {
+  switch (piece) {
+    case Piece::knight:
+      return knight_attacks[static_cast<size_t>(sq_idx)];
+    case Piece::bishop:
+      return bishop_attacks(sq_idx, occupancy);
+    case Piece::rook:
+      return rook_attacks(sq_idx, occupancy);
+    case Piece::queen:
+      return queen_attacks(sq_idx, occupancy);
+    case Piece::king:
+      return king_attacks[static_cast<size_t>(sq_idx)];
+    case Piece::pawn:
+    case Piece::none:
+      break;
+  }
+  return 0;
+}
+
+absl::optional<Piece> san_piece(char c) {
+  switch (c) {
+    case 'N':
+      return Piece::knight;
+    case 'B':
+      return Piece::bishop;
+    case 'R':
+      return Piece::rook;
+    case 'Q':
+      return Piece::queen;
+    case 'K':
+      return Piece::king;
+    default:
+      return absl::nullopt;
+  }
+}
+
+absl::optional<MoveType> promotion_type(char c) {
+  switch (c) {
+    case 'N':
+    case 'n':
+      return MoveType::promotion_to_knight;
+    case 'B':
+    case 'b':
+      return MoveType::promotion_to_bishop;
+    case 'R':
+    case 'r':
+      return MoveType::promotion_to_rook;
+    case 'Q':
+    case 'q':
+      return MoveType::promotion_to_queen;
+    default:
+      return absl::nullopt;
+  }
+}
+}  // namespace.
+
+absl::optional<Move> parse_san(const Board& board, absl::string_view san) {
+  while (!san.empty() && (san.back() == '+' || san.back() == '#' ||
+                          san.back() == '!' || san.back() == '?')) {
+    san.remove_suffix(1);
+  }
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  if (san == "O-O" || san == "0-0") {
+    return board.is_castle_kingside_legal()
+               ? absl::make_optional(
+                     board.castling_path(side, MoveType::castle_kingside)
+                         .king_move_)
+               : absl::nullopt;
+  }
+  if (san == "O-O-O" || san == "0-0-0") {
+    return board.is_castle_queenside_legal()
+               ? absl::make_optional(
+                     board.castling_path(side, MoveType::castle_queenside)
+                         .king_move_)
+               : absl::nullopt;
+  }
+
+  // The destination square is the last thing but a promotion, so a letter
+  // after it is one.
+  absl::optional<MoveType> promotion;
+  if (san.size() > 2 && !(san.back() >= '1' && san.back() <= '8')) {
+    promotion = promotion_type(san.back());
+    if (!promotion) {
+      return absl::nullopt;
+    }
+    san.remove_suffix(1);
+    if (san.back() == '=') {
+      san.remove_suffix(1);
+    }
+  }
+  if (san.size() < 2) {
+    return absl::nullopt;
+  }
+  const int dst_file = san[san.size() - 2] - 'a';
+  const int dst_rank = san[san.size() - 1] - '1';
+  if (dst_file < 0 || dst_file > 7 || dst_rank < 0 || dst_rank > 7) {
+    return absl::nullopt;
+  }
+  san.remove_suffix(2);
+  const Bitboard dst_square = coordinates_to_square(dst_file, dst_rank);
+  const int dst_idx = square_idx(dst_square);
+  Piece piece = Piece::pawn;
+  if (!san.empty() && san_piece(san.front())) {
+    piece = *san_piece(san.front());
+    san.remove_prefix(1);
+  }
+  bool is_capture = false;
+  if (!san.empty() && (san.back() == 'x' || san.back() == ':')) {
+    is_capture = true;
+    san.remove_suffix(1);
+  }
+  // What is left tells apart pieces of the kind that can reach the square.
+  Bitboard src_mask = ~Bitboard{0};
+  if (san.size() > 2) {
+    return absl::nullopt;
+  }
+  for (char c : san) {
+    if (c >= 'a' && c <= 'h') {
+      src_mask &= file_mask(c - 'a');
+    } else if (c >= '1' && c <= '8') {
+      src_mask &= rank_mask(c - '1');
+    } else {
+      return absl::nullopt;
+    }
+  }
+  if (dst_square & board.friends(side)) {
+    return absl::nullopt;
+  }
+
+  Bitboard src_squares = 0;
+  MoveType move_type = MoveType::simple;
+  const Bitboard own_pieces = board.pieces(side, piece);
+  if (piece == Piece::pawn) {
+    const bool is_white = side == Color::white;
+    if (static_cast<bool>(dst_square & (is_white ? eighth_rank_mask
+                                                 : first_rank_mask)) !=
+        promotion.has_value()) {
+      return absl::nullopt;
+    }
+    // A pawn move with a source file is a capture, even without the "x".
+    if (is_capture || src_mask != ~Bitboard{0}) {
+      // The squares a pawn of `side` attacks `dst_square` from are those a
+      // pawn of the other color attacks from it.
+      src_squares = (is_white ? black_pawn_attacks
+                              : white_pawn_attacks)[static_cast<size_t>(
+                        dst_idx)] &
+                    own_pieces;
+      if (dst_square == board.en_passant_square_) {
+        move_type = MoveType::en_passant;
+      } else if (dst_square & board.enemies(side)) {
+        move_type = MoveType::capture;
+      } else {
+        return absl::nullopt;
+      }
+    } else {
+      if (dst_square & board.all_pieces()) {
+        return absl::nullopt;
+      }
+      const Bitboard one_back =
+          is_white ? south_of(dst_square) : north_of(dst_square);
+      if (one_back & own_pieces) {
+        src_squares = one_back;
+      } else if (!(one_back & board.all_pieces()) &&
+                 (dst_square & (is_white ? rank_mask(3) : rank_mask(4)))) {
+        src_squares =
+            (is_white ? south_of(one_back) : north_of(one_back)) & own_pieces;
+        move_type = MoveType::two_step_pawn;
+      }
+    }
+    if (promotion) {
+      move_type = *promotion;
+    }
+  } else {
+    if (promotion) {
+      return absl::nullopt;
+    }
+    src_squares = piece_attacks(piece, dst_idx, board.all_pieces()) &
+                  own_pieces;
+    move_type = dst_square & board.enemies(side) ? MoveType::capture
+                                                 : MoveType::simple;
+  }
+  src_squares &= src_mask;
+
+  // Every candidate is pseudolegal, so only pins and checks are left to rule
+  // out.
+  absl::optional<Move> res;
+  if (!src_squares) {
+    return res;
+  }
+  const CheckInfo info = board.check_info();
+  for (Bitboard src_square : bitboard_split(src_squares)) {
+    const Move move(src_square, dst_square, piece, move_type);
+    if (board.is_legal(move, info)) {
+      if (res) {
+        return absl::nullopt;
+      }
+      res = move;
+    }
+  }
+  return res;
+}
+
+size_t to_san(const Board& board, Move move, char* buf) {
+  constexpr char piece_chars[] = "PRNBQK";
+  char* pos = buf;
+  const auto write_file = [&pos](int sq_idx) {
+    *pos++ = static_cast<char>('a' + 7 - sq_idx % 8);
+  };
+  const auto write_rank = [&pos](int sq_idx) {
+    *pos++ = static_cast<char>('1' + sq_idx / 8);
+  };
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  const CheckInfo info = board.check_info();
+  if (move.move_type_ == MoveType::castle_kingside ||
+      move.move_type_ == MoveType::castle_queenside) {
+    for (const char c : move.move_type_ == MoveType::castle_kingside
+                            ? absl::string_view("O-O")
+                            : absl::string_view("O-O-O")) {
+      *pos++ = c;
+    }
+  } else {
+    const bool is_capture = move.move_type_ == MoveType::en_passant ||
+                            (move.dst_square() & board.enemies(side));
+    if (move.piece_moving_ == Piece::pawn) {
+      if (is_capture) {
+        write_file(move.src_idx_);
+      }
+    } else {
+      *pos++ = piece_chars[static_cast<size_t>(move.piece_moving_)];
+      // The other pieces of the kind that could legally go to the square.
+      Bitboard others = piece_attacks(move.piece_moving_, move.dst_idx_,
+                                      board.all_pieces()) &
+                        board.pieces(side, move.piece_moving_) &
+                        ~move.src_square();
+      for (Bitboard other : bitboard_split(others)) {
+        if (!board.is_legal(
+                Move(other, move.dst_square(), move.piece_moving_,
+                     move.move_type_),
+                info)) {
+          others &= ~other;
+        }
+      }
+      if (others) {
+        const Bitboard src_file = file_mask(7 - move.src_idx_ % 8);
+        const Bitboard src_rank = rank_mask(move.src_idx_ / 8);
+        if (!(others & src_file)) {
+          write_file(move.src_idx_);
+        } else if (!(others & src_rank)) {
+          write_rank(move.src_idx_);
+        } else {
+          write_file(move.src_idx_);
+          write_rank(move.src_idx_);
+        }
+      }
+    }
+    if (is_capture) {
+      *pos++ = 'x';
+    }
+    write_file(move.dst_idx_);
+    write_rank(move.dst_idx_);
+    if (move.piece_moving_ == Piece::pawn &&
+        (move.dst_square() & (first_rank_mask | eighth_rank_mask))) {
+      *pos++ = '=';
+      *pos++ = piece_chars[static_cast<size_t>(
+          promotion_piece(move.move_type_))];
+    }
+  }
+  if (board.gives_check(move, info)) {
+    Board after = board;
+    after.do_move(move);
+    *pos++ = after.has_any_legal_move() ? '+' : '#';
+  }
+  *pos = '\0';
+  return static_cast<size_t>(pos - buf);
+}
+
+void append_san(const Board& board, Move move, std::string* out) {
+  char buf[max_san_size];
+  out->append(buf, to_san(board, move, buf));
+}
+
+absl::optional<absl::string_view> PgnGame::tag(absl::string_view name) const {
+  for (const PgnTag& tag : tags_) {
+    if (tag.name_ == name) {
+      return tag.value_;
+    }
+  }
+  return absl::nullopt;
+}
+
+absl::optional<Board> PgnGame::start_position(const char** error) const {
+  const absl::optional<absl::string_view> fen = tag("FEN");
+  return fen ? parse_fen(*fen, error) : absl::make_optional(Board());
+}
+
+bool PgnReader::next(PgnGame* game) {
+  game->tags_.clear();
+  const absl::string_view s = text_;
+  size_t pos = 0;
+  while (pos < s.size()) {
+    const char c = s[pos];
+    if (is_space(c)) {
+      ++pos;
+      continue;
+    }
+    if (c == '%' && (pos == 0 || s[pos - 1] == '\n')) {
+      pos = line_end(s, pos);
+      continue;
+    }
+    if (c != '[') {
+      break;
+    }
+    // [Name "value"], on one line.
+    for (++pos; pos < s.size() && (s[pos] == ' ' || s[pos] == '\t'); ++pos) {
+    }
+    const size_t name_begin = pos;
+    while (pos < s.size() && !is_space(s[pos]) && s[pos] != '"' &&
+           s[pos] != ']') {
+      ++pos;
+    }
+    PgnTag tag = {s.substr(name_begin, pos - name_begin), {}};
+    while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t')) {
+      ++pos;
+    }
+    if (pos < s.size() && s[pos] == '"') {
+      const size_t value_begin = ++pos;
+      while (pos < s.size() && s[pos] != '"' && s[pos] != '\n') {
+        pos += s[pos] == '\\' && pos + 1 < s.size() ? 2 : 1;
+      }
+      tag.value_ = s.substr(value_begin, pos - value_begin);
+    }
+    while (pos < s.size() && s[pos] != ']' && s[pos] != '\n') {
+      ++pos;
+    }
+    pos += pos < s.size() && s[pos] == ']';
+    if (!tag.name_.empty()) {
+      game->tags_.push_back(tag);
+    }
+  }
+  if (pos >= s.size() && game->tags_.empty()) {
+    text_ = s.substr(s.size());
+    return false;
+  }
+
+  absl::string_view rest = s.substr(pos);
+  const char* const movetext_begin = rest.data();
+  absl::string_view token;
+  game->result_ = absl::string_view();
+  while (true) {
+    const Token found = next_token(&rest, &token);
+    if (found == Token::result) {
+      game->result_ = token;
+    }
+    if (found != Token::move) {
+      break;
+    }
+  }
+  game->movetext_ = absl::string_view(
+      movetext_begin, static_cast<size_t>(rest.data() - movetext_begin));
+  text_ = rest;
+  return true;
+}
+
+std::vector<absl::string_view> split_pgn(absl::string_view text,
+                                         size_t num_parts) {
+  std::vector<absl::string_view> res;
+  const size_t part_size = text.size() / std::max<size_t>(num_parts, 1) + 1;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    const size_t end =
+        begin + part_size >= text.size()
+            ? text.size()
+            : next_game_start(text, begin + part_size);
+    res.push_back(text.substr(begin, end - begin));
+    begin = end;
+  }
+  return res;
+}
+
+uint64_t read_games_parallel(absl::string_view text, ThreadPool* pool,
+                             const PgnGameFn& fn, const PgnOutputFn& output) {
+  if (!pool) {
+    PgnReader reader(text);
+    PgnGame game;
+    std::string out;
+    uint64_t num_games = 0;
+    while (reader.next(&game)) {
+      fn(0, game, &out);
+      ++num_games;
+    }
+    if (output && !out.empty()) {
+      output(out);
+    }
+    return num_games;
+  }
+
+  const size_t num_workers = pool->num_threads();
+  // Many more pieces than workers, so that they finish together however the
+  // games are spread.
+  const std::vector<absl::string_view> pieces =
+      split_pgn(text, num_workers * pieces_per_worker);
+  // The output of the pieces read but not passed on yet.
+  struct PieceOutput {
+    std::string text_;
+    bool is_read_;
+  };
+  std::vector<PieceOutput> outputs(output ? pieces.size() : 0,
+                                   PieceOutput{"", false});
+  std::mutex output_mutex;
+  size_t next_output = 0;
+  std::atomic<size_t> next_piece(0);
+  std::atomic<uint64_t> num_games(0);
+  // One task per worker, each taking the next piece until there are none,
+  // so that the pieces are read about in order and the output of few has to
+  // wait for that of the pieces before.
+  for (size_t task_idx = 0; task_idx < num_workers; ++task_idx) {
+    pool->submit([&] {
+      const size_t worker_idx = *pool->worker_index();
+      PgnGame worker_game;
+      std::string piece_out;
+      for (size_t piece_idx = next_piece.fetch_add(1);
+           piece_idx < pieces.size(); piece_idx = next_piece.fetch_add(1)) {
+        PgnReader reader(pieces[piece_idx]);
+        while (reader.next(&worker_game)) {
+          fn(worker_idx, worker_game, &piece_out);
+          num_games.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (!output) {
+          piece_out.clear();
+          continue;
+        }
+        std::lock_guard<std::mutex> lock(output_mutex);
+        outputs[piece_idx].text_ = std::move(piece_out);
+        outputs[piece_idx].is_read_ = true;
+        piece_out.clear();
+        for (; next_output < pieces.size() && outputs[next_output].is_read_;
+             ++next_output) {
+          if (!outputs[next_output].text_.empty()) {
+            output(outputs[next_output].text_);
+          }
+          std::string().swap(outputs[next_output].text_);
+        }
+      }
+    });
+  }
+  pool->wait();
+  return num_games.load();
+}
+
+bool next_san(absl::string_view* movetext, absl::string_view* san) {
+  return next_token(movetext, san) == Token::move;
+}
@@ -0,0 +1,137 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "thread_pool.h"
+
+// Games in PGN, read from text that is usually a mapped file (see
+// mapped_file.h). Tags, movetext and moves are views into the text, so
+// reading a game allocates nothing once the tag list has grown, and a SAN
+// move is found from the pieces that can reach its destination rather than
+// by generating the legal moves and writing them out to compare.
+
+// Returns the legal move of the side to move written `san` in standard
+// algebraic notation, such as "Nbd7", "exd8=Q+" or "O-O", or nullopt if
+// there is none or `san` is ambiguous. Check and annotation marks are
+// ignored, and castling may be written with zeros.
+absl::optional<Move> parse_san(const Board& board, absl::string_view san);
+
+// The most characters `to_san` writes, its null terminator included, as in
+// "Qa1xb2+" or "exd8=Q#".
+constexpr size_t max_san_size = 8;
+
+// Writes `move`, a legal move of `board`, in SAN to `buf`, which must have
+// room for `max_san_size` characters, null terminates it and returns its
+// length. The source file, rank or both are given when another piece of the
+// same kind can go to the same square, and "+" or "#" when the move checks or
+// mates.
+size_t to_san(const Board& board, Move move, char* buf);
+// Appends `move` in SAN to `out` without a temporary string.
+void append_san(const Board& board, Move move, std::string* out);
+
+struct PgnTag {
+  absl::string_view name_;
+  // Without its quotes, with any backslash escapes left in.
+  absl::string_view value_;
+};
+
+struct PgnGame {
+  std::vector<PgnTag> tags_;
+  // Everything after the tags up to the end of the result, or up to the
+  // next game if the result is missing.
+  absl::string_view movetext_;
+  // "1-0", "0-1", "1/2-1/2" or "*", or empty if missing.
+  absl::string_view result_;
+
+  // Returns the value of the tag `name`, or nullopt if the game hasn't one.
+  absl::optional<absl::string_view> tag(absl::string_view name) const;
+  // Returns the position the game starts from: that of its FEN tag, or the
+  // start position. Fails like `parse_fen`.
+  absl::optional<Board> start_position(const char** error = nullptr) const;
+};
+
+// Reads the games of a PGN text one by one. The text must outlive the reader
+// and the games it reads.
+class PgnReader {
+ public:
+  explicit PgnReader(absl::string_view text) : text_(text) {}
+
+  // Sets `*game` to the next game and returns true, or returns false if there
+  // are no games left. Reusing `game` reuses its tag list.
+  bool next(PgnGame* game);
+
+ private:
+  absl::string_view text_;
+};
+
+// Splits `text` into about `num_parts` pieces of whole games, for reading
+// them on several threads. A game starts at a line beginning with '[' that
+// follows one that doesn't, so the pieces are cut where the tags of a game
+// start.
+std::vector<absl::string_view> split_pgn(absl::string_view text,
+                                         size_t num_parts);
+
+// Called by `read_games_parallel` for every game, on the worker `worker_idx`,
+// with a string the call may append the game's output to.
+typedef std::function<void(size_t worker_idx, const PgnGame& game,
+                           std::string* out)>
+    PgnGameFn;
+// Called by `read_games_parallel` with the output of the games, in order.
+typedef std::function<void(absl::string_view out)> PgnOutputFn;
+
+// Reads the games of `text` on the workers of `pool`, or on the calling
+// thread as worker 0 if it is null, and calls `fn` for each, so that the
+// parsing and whatever `fn` does with the games, such as replaying them,
+// scale with the workers. `text` is cut by `split_pgn` into many more pieces
+// than workers, which each worker takes in turn in the order of the text and
+// reads whole with a reader of its own. `fn` is called from several workers
+// at once, but for the games of a worker one after the other.
+//
+// If `output` isn't null, it is called with what `fn` appended for the games
+// of each piece as soon as the output of the pieces before it has been
+// passed on, so that the output of a large file comes out in the order of
+// its games while the pieces after are still read, and only the pieces in
+// flight are held in memory. The calls come from one worker at a time.
+// Returns the number of games read.
+uint64_t read_games_parallel(absl::string_view text, ThreadPool* pool,
+                             const PgnGameFn& fn,
+                             const PgnOutputFn& output = nullptr);
+
+// Moves `*movetext` past its next SAN move and sets `*san` to it, skipping
+// move numbers, comments, variations, NAGs and annotation marks. Returns
+// false at the result or the end of the movetext.
+bool next_san(absl::string_view* movetext, absl::string_view* san);
+
+// Plays the moves of `game` from its start position, calling
+// `fn(board, move)` with the position before each move. Returns null, or
+// what is wrong with the game if its start position or a move can't be read,
+// after calling `fn` for the moves before it.
+template <typename Fn>
+const char* replay_game(const PgnGame& game, Fn fn) {
+  const char* error = nullptr;
+  absl::optional<Board> board = game.start_position(&error);
+  if (!board) {
+    return error;
+  }
+  absl::string_view movetext = game.movetext_;
+  absl::string_view san;
+  while (next_san(&movetext, &san)) {
+    const absl::optional<Move> move = parse_san(*board, san);
+    if (!move) {
+      return "PGN invalid: A move isn't legal or is ambiguous.";
+    }
+    fn(static_cast<const Board&>(*board), *move);
+    board->do_move(*move);
+  }
+  return nullptr;
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "pgn.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "thread_pool.h"
+
+namespace {
+// Returns the UCI string of `san` in `fen`, or "none".
+std::string san_to_uci(const char* fen, absl::string_view san) {
+  const absl::optional<Move> move = parse_san(Board(fen), san);
+  return move ? move->to_uci_str() : "none";
+}
+
+constexpr char start_fen[] =
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+}  // namespace.
+
+TEST(ParseSan, ReadsPieceAndPawnMoves) {
+  EXPECT_EQ(san_to_uci(start_fen, "e4"), "e2e4");
+  EXPECT_EQ(san_to_uci(start_fen, "e3"), "e2e3");
+  EXPECT_EQ(san_to_uci(start_fen, "Nf3"), "g1f3");
+  EXPECT_EQ(san_to_uci(start_fen, "Nf3+!?"), "g1f3");
+  EXPECT_EQ(san_to_uci(start_fen, "e5"), "none");
+  EXPECT_EQ(san_to_uci(start_fen, "Nd4"), "none");
+  EXPECT_EQ(san_to_uci(start_fen, "Ke2"), "none");
+  EXPECT_EQ(san_to_uci(start_fen, "e9"), "none");
+  EXPECT_EQ(san_to_uci(start_fen, ""), "none");
+  const Board board(start_fen);
+  const absl::optional<Move> move = parse_san(board, "e4");
+  ASSERT_TRUE(move);
+  EXPECT_EQ(move->move_type_, MoveType::two_step_pawn);
+}
+
+TEST(ParseSan, ReadsCaptures) {
+  const char* fen =
+      "rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2";
+  EXPECT_EQ(san_to_uci(fen, "exd5"), "e4d5");
+  EXPECT_EQ(san_to_uci(fen, "ed5"), "e4d5");
+  EXPECT_EQ(san_to_uci(fen, "Bb5+"), "f1b5");
+  // En passant.
+  EXPECT_EQ(san_to_uci(
+                "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+                "exf6"),
+            "e5f6");
+  EXPECT_EQ(san_to_uci(
+                "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+                "exd6"),
+            "none");
+}
+
+TEST(ParseSan, Disambiguates) {
+  const char* fen = "4k3/8/8/8/8/8/8/RN2KN1R w - - 0 1";
+  EXPECT_EQ(san_to_uci(fen, "Nd2"), "none");
+  EXPECT_EQ(san_to_uci(fen, "Nbd2"), "b1d2");
+  EXPECT_EQ(san_to_uci(fen, "Nfd2"), "f1d2");
+  EXPECT_EQ(san_to_uci(fen, "Nf1d2"), "f1d2");
+  EXPECT_EQ(san_to_uci(fen, "Rg1"), "h1g1");
+  EXPECT_EQ(san_to_uci("4k3/8/8/8/R7/8/8/R3K3 w - - 0 1", "R1a3"), "a1a3");
+  EXPECT_EQ(san_to_uci("4k3/8/8/8/R7/8/8/R3K3 w - - 0 1", "R4a3"), "a4a3");
+  EXPECT_EQ(san_to_uci("4k3/8/8/8/8/5N2/8/1N5K w - - 0 1", "Nd2"), "none");
+  // The knight on f3 is pinned, so "Nd2" is the other one's.
+  EXPECT_EQ(san_to_uci("4k3/8/2b5/8/8/5N2/8/1N5K w - - 0 1", "Nd2"), "b1d2");
+}
+
+TEST(ParseSan, ReadsCastlingAndPromotions) {
+  const char* fen = "r3k2r/1P6/8/8/8/8/8/R3K2R w KQkq - 0 1";
+  EXPECT_EQ(san_to_uci(fen, "O-O"), "e1g1");
+  EXPECT_EQ(san_to_uci(fen, "0-0-0"), "e1c1");
+  EXPECT_EQ(san_to_uci(fen, "b8=Q"), "b7b8q");
+  EXPECT_EQ(san_to_uci(fen, "b8N+"), "b7b8n");
+  EXPECT_EQ(san_to_uci(fen, "bxa8=R"), "b7a8r");
+  EXPECT_EQ(san_to_uci(fen, "b8"), "none");
+  EXPECT_EQ(san_to_uci(fen, "b8=K"), "none");
+  EXPECT_EQ(san_to_uci("r3k2r/8/8/8/8/8/8/R3K2R b - - 0 1", "O-O"), "none");
+}
+
+TEST(ToSan, WritesMoves) {
+  const auto san = [](const char* fen, const char* uci) {
+    const Board board(fen);
+    char buf[max_san_size];
+    const size_t size = to_san(board, *parse_uci_move(board, uci), buf);
+    EXPECT_EQ(buf[size], '\0');
+    return std::string(buf, size);
+  };
+  EXPECT_EQ(san(start_fen, "e2e4"), "e4");
+  EXPECT_EQ(san(start_fen, "g1f3"), "Nf3");
+  EXPECT_EQ(san("4k3/8/8/8/8/8/8/RN2KN1R w - - 0 1", "b1d2"), "Nbd2");
+  EXPECT_EQ(san("4k3/8/8/8/R7/8/8/R3K3 w - - 0 1", "a1a3"), "R1a3");
+  EXPECT_EQ(san("4k3/8/8/8/Q1Q5/8/Q7/4K3 w - - 0 1", "a4b3"), "Qa4b3");
+  // The other knight is pinned.
+  EXPECT_EQ(san("4k3/8/2b5/8/8/5N2/8/1N5K w - - 0 1", "b1d2"), "Nd2");
+  EXPECT_EQ(san("r3k2r/1P6/8/8/8/8/8/R3K2R w KQkq - 0 1", "b7a8q"),
+            "bxa8=Q+");
+  EXPECT_EQ(san("r3k2r/1P6/8/8/8/8/8/R3K2R w KQkq - 0 1", "e1c1"), "O-O-O");
+  EXPECT_EQ(san("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 "
+                "3",
+                "e5f6"),
+            "exf6");
+  EXPECT_EQ(san("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", "a1a8"), "Ra8#");
+}
+
+TEST(ToSan, RoundTripsThroughParseSan) {
+  for (const char* fen : {
+           start_fen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+       }) {
+    const Board board(fen);
+    std::string out;
+    for (Move move : board.legal_moves()) {
+      out.clear();
+      append_san(board, move, &out);
+      EXPECT_EQ(parse_san(board, out), move) << fen << " " << out;
+    }
+  }
+}
+
+TEST(PgnReader, ReadsGames) {
+  const std::string text =
+      "[Event \"Test \\\"one\\\"\"]\n"
+      "[Result \"1-0\"]\n"
+      "\n"
+      "1. e4 {A comment (with parens) 2. d4} e5 2. Nf3 (2. f4 exf4 (2... d5))\n"
+      "2... Nc6 $1 3. Bb5 a6?! ; a line comment 4. Ba4\n"
+      "4. Bxc6 dxc6 1-0\n"
+      "\n"
+      "% An escaped line.\n"
+      "[Event \"Two\"]\n"
+      "[FEN \"4k3/8/8/8/8/8/8/R3K3 w Q - 0 1\"]\n"
+      "\n"
+      "1. O-O-O Kf7 *\n"
+      "[Event \"No result\"]\n"
+      "1. d4\n";
+  PgnReader reader(text);
+  PgnGame game;
+
+  ASSERT_TRUE(reader.next(&game));
+  ASSERT_EQ(game.tags_.size(), 2);
+  EXPECT_EQ(game.tags_[0].name_, "Event");
+  EXPECT_EQ(game.tags_[0].value_, "Test \\\"one\\\"");
+  EXPECT_EQ(game.tag("Result"), absl::string_view("1-0"));
+  EXPECT_FALSE(game.tag("FEN"));
+  EXPECT_EQ(game.result_, "1-0");
+  std::vector<std::string> moves;
+  EXPECT_EQ(replay_game(game,
+                        [&moves](const Board&, Move move) {
+                          moves.push_back(move.to_uci_str());
+                        }),
+            nullptr);
+  EXPECT_EQ(moves, (std::vector<std::string>{"e2e4", "e7e5", "g1f3", "b8c6",
+                                             "f1b5", "a7a6", "b5c6",
+                                             "d7c6"}));
+
+  ASSERT_TRUE(reader.next(&game));
+  EXPECT_EQ(game.tag("Event"), absl::string_view("Two"));
+  EXPECT_EQ(game.result_, "*");
+  moves.clear();
+  Board last;
+  EXPECT_EQ(replay_game(game,
+                        [&](const Board& board, Move move) {
+                          moves.push_back(move.to_uci_str());
+                          last = board;
+                          last.do_move(move);
+                        }),
+            nullptr);
+  EXPECT_EQ(moves, (std::vector<std::string>{"e1c1", "e8f7"}));
+  EXPECT_EQ(last.to_fen(), "8/5k2/8/8/8/8/8/2KR4 w - - 2 2");
+
+  ASSERT_TRUE(reader.next(&game));
+  EXPECT_EQ(game.result_, "");
+  EXPECT_EQ(replay_game(game, [](const Board&, Move) {}), nullptr);
+  EXPECT_FALSE(reader.next(&game));
+}
+
+TEST(PgnReader, ReportsIllegalMoves) {
+  PgnReader reader("1. e4 e5 2. Ke3 *");
+  PgnGame game;
+  ASSERT_TRUE(reader.next(&game));
+  int num_moves = 0;
+  EXPECT_NE(replay_game(game, [&num_moves](const Board&, Move) { ++num_moves; }),
+            nullptr);
+  EXPECT_EQ(num_moves, 2);
+}
+
+TEST(SplitPgn, CutsAtGameStarts) {
+  std::string text;
+  for (int i = 0; i < 20; ++i) {
+    text +=
+        "[Event \"Game\"]\n"
+        "[Result \"1/2-1/2\"]\n"
+        "\n"
+        "1. e4 e5 2. Nf3 Nc6 1/2-1/2\n"
+        "\n";
+  }
+  for (size_t num_parts : {1, 3, 7, 20, 1000}) {
+    const std::vector<absl::string_view> pieces = split_pgn(text, num_parts);
+    EXPECT_LE(pieces.size(), std::min<size_t>(num_parts, 20));
+    std::string joined;
+    int num_games = 0;
+    for (absl::string_view piece : pieces) {
+      EXPECT_EQ(piece.substr(0, 7), "[Event ");
+      joined.append(piece.data(), piece.size());
+      PgnReader reader(piece);
+      PgnGame game;
+      while (reader.next(&game)) {
+        EXPECT_EQ(game.result_, "1/2-1/2");
+        ++num_games;
+      }
+    }
+    EXPECT_EQ(joined, text);
+    EXPECT_EQ(num_games, 20);
+  }
+  EXPECT_TRUE(split_pgn("", 4).empty());
+}
+
+TEST(ReadGamesParallel, KeepsTheOutputInOrder) {
+  std::string text;
+  std::string expected;
+  for (int i = 0; i < 200; ++i) {
+    absl::StrAppend(&text, "[Event \"Game ", i,
+                    "\"]\n[Result \"*\"]\n\n1. e4 e5 2. Nf3 *\n\n");
+    absl::StrAppend(&expected, "Game ", i, ",3\n");
+  }
+  // Writes the event of each game and its number of moves.
+  const PgnGameFn fn = [](size_t, const PgnGame& game, std::string* out) {
+    int num_moves = 0;
+    EXPECT_EQ(replay_game(game, [&num_moves](const Board&, Move) {
+                ++num_moves;
+              }),
+              nullptr);
+    absl::StrAppend(out, *game.tag("Event"), ",", num_moves, "\n");
+  };
+  for (size_t num_threads : {1, 3}) {
+    ThreadPool pool(num_threads);
+    std::string out;
+    EXPECT_EQ(read_games_parallel(text, &pool, fn,
+                                  [&out](absl::string_view piece_out) {
+                                    out.append(piece_out.data(),
+                                               piece_out.size());
+                                  }),
+              200);
+    EXPECT_EQ(out, expected);
+  }
+  std::string out;
+  EXPECT_EQ(read_games_parallel(text, nullptr, fn,
+                                [&out](absl::string_view piece_out) {
+                                  out.append(piece_out.data(),
+                                             piece_out.size());
+                                }),
+            200);
+  EXPECT_EQ(out, expected);
+  EXPECT_EQ(read_games_parallel("", nullptr, fn), 0);
+}
+
+TEST(ReadGamesParallel, PassesTheWorkerIndex) {
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text += "[Event \"Game\"]\n\n1. d4 d5 *\n\n";
+  }
+  ThreadPool pool(4);
+  std::vector<uint64_t> games_per_worker(pool.num_threads(), 0);
+  EXPECT_EQ(read_games_parallel(text, &pool,
+                                [&](size_t worker_idx, const PgnGame&,
+                                    std::string*) {
+                                  ++games_per_worker[worker_idx];
+                                }),
+            100);
+  uint64_t num_games = 0;
+  for (uint64_t n : games_per_worker) {
+    num_games += n;
+  }
+  EXPECT_EQ(num_games, 100);
+}
@@ -0,0 +1,185 @@
+#include "playout_check.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+
+#include "absl/strings/str_cat.h"
+#include "board.h"
+#include "eval.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "zobrist.h"
+
+namespace {
+// Returns `moves` sorted, for comparing lists generated in different orders.
+MoveList sorted(MoveList moves) {
+  const auto fields = [](Move move) {
+    return std::make_tuple(move.src_idx_, move.dst_idx_,
+                           static_cast<int>(move.move_type_),
+                           static_cast<int>(move.piece_moving_));
+  };
+  std::sort(moves.begin(), moves.end(),
+            [&fields](Move a, Move b) { return fields(a) < fields(b); });
+  return moves;
+}
+
+std::string moves_to_str(const MoveList& moves) {
+  std::string res;
+  for (Move move : moves) {
+    absl::StrAppend(&res, res.empty() ? "" : " ", move.to_uci_str());
+  }
+  return res;
+}
+
+// Returns a mismatch of the two move lists, which may be in any order, or the
+// empty string.
+std::string compare_moves(const char* what, const MoveList& moves,
+                          const MoveList& expected) {
+  const MoveList sorted_moves = sorted(moves);
+  const MoveList sorted_expected = sorted(expected);
+  if (sorted_moves == sorted_expected) {
+    return std::string();
+  }
+  return absl::StrCat(what, " gives [", moves_to_str(sorted_moves),
+                      "], expected [", moves_to_str(sorted_expected), "]");
+}
+
+// Checks the board after `move`, done on `board`, and taking it back.
+std::string check_move(const Board& board, Move move, const CheckInfo& info) {
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  const std::string uci = move.to_uci_str();
+  Board child = board;
+  UndoInfo undo;
+  child.do_move(move, &undo);
+  if (board.gives_check(move, info) !=
+      child.is_king_attacked(flip_color(side))) {
+    return absl::StrCat("gives_check is wrong for ", uci);
+  }
+  if (child.key_ != compute_zobrist_key(child)) {
+    return absl::StrCat("key_ is wrong after ", uci);
+  }
+  if (child.pawn_key_ != compute_pawn_key(child)) {
+    return absl::StrCat("pawn_key_ is wrong after ", uci);
+  }
+  if (child.material_key_ != compute_material_key(child)) {
+    return absl::StrCat("material_key_ is wrong after ", uci);
+  }
+  if (!(child.psqt_ == compute_psqt(child))) {
+    return absl::StrCat("psqt_ is wrong after ", uci);
+  }
+  if (!child.has_consistent_state()) {
+    return absl::StrCat("the state is inconsistent after ", uci);
+  }
+  Board without_undo = board;
+  without_undo.do_move(move);
+  if (!(without_undo == child)) {
+    return absl::StrCat("the do_moves disagree on ", uci);
+  }
+  child.undo_move(move, undo);
+  if (!(child == board)) {
+    return absl::StrCat("undo_move doesn't restore the board after ", uci);
+  }
+  return std::string();
+}
+}  // namespace.
+
+std::string check_position(const Board& board) {
+  const Color side = board.is_whites_move_ ? Color::white : Color::black;
+  MoveList castling;
+  board.castling_moves(&castling);
+  MoveList pseudolegal = board.pseudolegal_moves(side);
+  MoveList reference_legal;
+  for (Move move : pseudolegal) {
+    if (board.is_pseudolegal_move_legal(move)) {
+      reference_legal.push_back(move);
+    }
+  }
+  for (Move move : castling) {
+    pseudolegal.push_back(move);
+    reference_legal.push_back(move);
+  }
+
+  std::string res =
+      compare_moves("legal_moves", board.legal_moves(), reference_legal);
+  if (res.empty() && board.is_king_attacked(side)) {
+    res = compare_moves("legal_evasions", board.legal_evasions(),
+                        reference_legal);
+  }
+  if (res.empty()) {
+    MoveList split;
+    board.append_pseudolegal_captures(side, &split);
+    board.append_pseudolegal_quiet_moves(side, &split);
+    res = compare_moves("captures and quiet moves", split, pseudolegal);
+  }
+  if (!res.empty()) {
+    return res;
+  }
+
+  const CheckInfo info = board.check_info();
+  for (Move move : pseudolegal) {
+    if (!board.is_move_pseudolegal(move)) {
+      return absl::StrCat("is_move_pseudolegal rejects ", move.to_uci_str());
+    }
+    const bool is_legal = board.is_pseudolegal_move_legal(move);
+    if (board.is_legal(move, info) != is_legal) {
+      return absl::StrCat("is_legal is wrong for ", move.to_uci_str());
+    }
+    if (is_legal) {
+      res = check_move(board, move, info);
+      if (!res.empty()) {
+        return res;
+      }
+    }
+  }
+  return std::string();
+}
+
+std::string check_playout(const Board& start, const uint8_t* choices,
+                          size_t num_choices, const NnueNetwork* network,
+                          size_t* num_positions) {
+  Board board = start;
+  PawnTable pawn_table;
+  AccumulatorStack accumulators(num_choices + 1);
+  if (network) {
+    accumulators.reset(*network, board);
+  }
+  std::string moves;
+  for (size_t ply = 0;; ++ply) {
+    std::string res = check_position(board);
+    if (res.empty()) {
+      if (network) {
+        AccumulatorStack fresh(1);
+        fresh.reset(*network, board);
+        if (evaluate(board, &accumulators) != evaluate(board, &fresh)) {
+          res = "the evaluation with the kept accumulators is wrong";
+        }
+      } else if (evaluate(board, &pawn_table) != evaluate(board)) {
+        res = "the evaluation with the kept pawn table is wrong";
+      }
+    }
+    if (num_positions) {
+      ++*num_positions;
+    }
+    if (!res.empty()) {
+      return absl::StrCat(res, "\n  in ", board.to_fen(),
+                          "\n  reached from ", start.to_fen(), " by",
+                          moves.empty() ? " no moves" : moves);
+    }
+    if (ply == num_choices) {
+      return std::string();
+    }
+    const MoveList legal_moves = board.legal_moves();
+    if (legal_moves.empty()) {
+      return std::string();
+    }
+    const Move move = legal_moves[choices[ply] % legal_moves.size()];
+    if (network) {
+      accumulators.push(board.dirty_pieces(move));
+    }
+    board.do_move(move);
+    absl::StrAppend(&moves, " ", move.to_uci_str());
+  }
+}
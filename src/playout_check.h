@@ -0,0 +1,44 @@
+#ifndef PLAYOUT_CHECK_H
+#define PLAYOUT_CHECK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "board.h"
+#include "nnue.h"
+
+// Differential checks of the fast move generation and the incrementally kept
+// state against the slow, simple code they replaced, which serves as the
+// oracle: generating the pseudolegal moves and keeping those after which
+// `is_pseudolegal_move_legal` finds the king safe, and computing keys and
+// evaluations from scratch. Random games (see playout_check_main.cc) run them
+// at every ply, so that a rewrite of the generator or of `do_move` can be
+// trusted once they stop finding anything.
+
+// Returns what the fast paths get wrong at `board`, or the empty string:
+//
+//  - `legal_moves`, and `legal_evasions` in check, against the reference
+//    legal moves, castling included.
+//  - `append_pseudolegal_captures` and `append_pseudolegal_quiet_moves`
+//    together against `pseudolegal_moves` and castling.
+//  - `is_move_pseudolegal`, `is_legal` and `gives_check` of every generated
+//    move against doing it.
+//  - The keys and `psqt_` after every legal move against computing them,
+//    the rest of `has_consistent_state`, both `do_move`s against each other,
+//    and `undo_move` against the board before.
+std::string check_position(const Board& board);
+
+// Plays a game from `start`, whose moves `choices` picks: each byte is the
+// index of a legal move, modulo their number. Every position is checked with
+// `check_position`, and the evaluation kept along the game against one from
+// scratch: with a pawn table kept from move to move, or with `network`, if it
+// isn't null, with accumulators kept from move to move. The game ends with
+// the choices or when there are no legal moves. Returns the first mismatch,
+// with the position and the moves that reached it, or the empty string. Adds
+// the positions checked to `*num_positions` if it isn't null.
+std::string check_playout(const Board& start, const uint8_t* choices,
+                          size_t num_choices, const NnueNetwork* network,
+                          size_t* num_positions = nullptr);
+
+#endif
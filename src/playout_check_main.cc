@@ -0,0 +1,122 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "board.h"
+#include "nnue.h"
+#include "perft.h"
+#include "playout_check.h"
+
+// Usage: playout_check [--games <n>] [--plies <n>] [--seed <n>]
+//                      [--eval-file <network>]
+//
+// Plays random games, 1000 of up to 200 plies by default, from the positions
+// of the perft suite in turn, and checks every position with `check_playout`.
+// Prints the first mismatch and exits with 1, or prints the number of
+// positions checked. With --eval-file the accumulators of that network are
+// checked, otherwise the classical evaluation.
+//
+// Built with PAWN_GRABBER_LIBFUZZER, the same checks run under libFuzzer
+// instead: the first byte of an input picks the perft suite position and the
+// rest the moves, and a mismatch aborts.
+
+#ifdef PAWN_GRABBER_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  static const std::vector<Board> starts = [] {
+    std::vector<Board> res;
+    for (const PerftSuitePosition& position : perft_suite) {
+      res.emplace_back(position.fen_);
+    }
+    return res;
+  }();
+  const std::string mismatch = check_playout(starts[data[0] % starts.size()],
+                                             data + 1, size - 1, nullptr);
+  if (!mismatch.empty()) {
+    std::cerr << mismatch << '\n';
+    std::abort();
+  }
+  return 0;
+}
+
+#else
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--games <n>] [--plies <n>] [--seed <n>]"
+               " [--eval-file <network>]\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  int num_games = 1000;
+  int max_plies = 200;
+  uint64_t seed = 1;
+  const char* eval_file = nullptr;
+  for (int arg_idx = 1; arg_idx < argc; arg_idx += 2) {
+    if (arg_idx + 1 == argc) {
+      return usage(argv[0]);
+    }
+    const char* const flag = argv[arg_idx];
+    const char* const value = argv[arg_idx + 1];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--games") == 0) {
+      is_valid = absl::SimpleAtoi(value, &num_games) && num_games > 0;
+    } else if (std::strcmp(flag, "--plies") == 0) {
+      is_valid = absl::SimpleAtoi(value, &max_plies) && max_plies >= 0;
+    } else if (std::strcmp(flag, "--seed") == 0) {
+      is_valid = absl::SimpleAtoi(value, &seed);
+    } else if (std::strcmp(flag, "--eval-file") == 0) {
+      eval_file = value;
+      is_valid = true;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  NetworkPtr network;
+  if (eval_file) {
+    std::string error;
+    network = load_network(eval_file, &error);
+    if (!network) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+  }
+
+  std::mt19937_64 rng(seed);
+  std::vector<uint8_t> choices(static_cast<size_t>(max_plies));
+  size_t num_positions = 0;
+  for (int game_idx = 0; game_idx < num_games; ++game_idx) {
+    for (uint8_t& choice : choices) {
+      choice = static_cast<uint8_t>(rng());
+    }
+    const PerftSuitePosition& start =
+        perft_suite[static_cast<size_t>(game_idx) % perft_suite.size()];
+    const std::string mismatch =
+        check_playout(Board(start.fen_), choices.data(), choices.size(),
+                      network.get(), &num_positions);
+    if (!mismatch.empty()) {
+      std::cout << "Game " << game_idx + 1 << " from " << start.name_ << ": "
+                << mismatch << '\n';
+      return 1;
+    }
+  }
+  std::cout << num_games << " games, " << num_positions
+            << " positions checked, no mismatches\n";
+  return 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "playout_check.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "nnue.h"
+#include "perft.h"
+
+namespace {
+std::vector<uint8_t> random_choices(size_t num_choices, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<uint8_t> res(num_choices);
+  for (uint8_t& choice : res) {
+    choice = static_cast<uint8_t>(rng());
+  }
+  return res;
+}
+
+// A network with random weights, which only has to make the accumulators
+// matter.
+std::unique_ptr<NnueNetwork> random_network() {
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<int> small(-32, 32);
+  std::unique_ptr<NnueNetwork> res(new NnueNetwork);
+  for (int16_t& w : res->feature_biases_) {
+    w = static_cast<int16_t>(small(rng) + 32);
+  }
+  for (int16_t& w : res->feature_weights_) {
+    w = static_cast<int16_t>(small(rng));
+  }
+  res->l1_biases_.fill(0);
+  for (int8_t& w : res->l1_weights_) {
+    w = static_cast<int8_t>(small(rng));
+  }
+  res->l2_biases_.fill(0);
+  for (int8_t& w : res->l2_weights_) {
+    w = static_cast<int8_t>(small(rng));
+  }
+  res->output_bias_[0] = 0;
+  for (int8_t& w : res->output_weights_) {
+    w = static_cast<int8_t>(small(rng));
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(CheckPlayout, FindsNothingInRandomGames) {
+  size_t num_positions = 0;
+  for (uint64_t seed = 0; seed < 12; ++seed) {
+    const std::vector<uint8_t> choices = random_choices(120, seed);
+    const Board start(perft_suite[seed % perft_suite.size()].fen_);
+    EXPECT_EQ(check_playout(start, choices.data(), choices.size(), nullptr,
+                            &num_positions),
+              "");
+  }
+  EXPECT_GT(num_positions, 600);
+}
+
+TEST(CheckPlayout, ChecksTheAccumulators) {
+  const std::unique_ptr<NnueNetwork> network = random_network();
+  for (uint64_t seed = 0; seed < 3; ++seed) {
+    const std::vector<uint8_t> choices = random_choices(80, seed);
+    const Board start(perft_suite[seed].fen_);
+    EXPECT_EQ(check_playout(start, choices.data(), choices.size(),
+                            network.get()),
+              "");
+  }
+}
+
+TEST(CheckPlayout, StopsAtTheEndOfTheGame) {
+  // Fool's mate: 1. f3 e5 2. g4 Qh4#, then no legal moves.
+  Board board;
+  std::vector<uint8_t> choices;
+  for (const char* uci : {"f2f3", "e7e5", "g2g4", "d8h4"}) {
+    const MoveList moves = board.legal_moves();
+    for (size_t i = 0; i < moves.size(); ++i) {
+      if (moves[i].to_uci_str() == uci) {
+        choices.push_back(static_cast<uint8_t>(i));
+        board.do_move(moves[i]);
+      }
+    }
+  }
+  ASSERT_EQ(choices.size(), 4);
+  choices.push_back(0);
+  size_t num_positions = 0;
+  EXPECT_EQ(check_playout(Board(), choices.data(), choices.size(), nullptr,
+                          &num_positions),
+            "");
+  EXPECT_EQ(num_positions, 5);
+}
+
+TEST(CheckPosition, FindsAWrongKey) {
+  Board board;
+  EXPECT_EQ(check_position(board), "");
+  board.key_ ^= 1;
+  // The moves carry the wrong key on, and undoing one restores it.
+  EXPECT_TRUE(absl::StartsWith(check_position(board), "key_ is wrong after "));
+}
@@ -0,0 +1,257 @@
+#include "position_blocks.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "mapped_file.h"
+#include "packed_position.h"
+
+// Set by the build where it finds zstd.
+#ifndef PAWN_GRABBER_HAVE_ZSTD
+#define PAWN_GRABBER_HAVE_ZSTD 0
+#endif
+
+#if PAWN_GRABBER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+constexpr char magic[8] = {'P', 'G', 'B', 'L', 'O', 'C', 'K', 'S'};
+constexpr uint32_t format_version = 1;
+constexpr size_t header_size = 16;
+// The number of blocks and the magic.
+constexpr size_t trailer_size = 16;
+// More positions than a block of the file has, which saves a corrupt entry
+// from allocating gigabytes.
+constexpr size_t max_block_positions = size_t{1} << 20;
+
+#if PAWN_GRABBER_HAVE_ZSTD
+// Transposes `num_positions` positions to byte planes, and back.
+void to_planes(const PackedPosition* positions, size_t num_positions,
+               uint8_t* planes) {
+  const auto* const bytes = reinterpret_cast<const uint8_t*>(positions);
+  for (size_t i = 0; i < num_positions; ++i) {
+    for (size_t j = 0; j < sizeof(PackedPosition); ++j) {
+      planes[j * num_positions + i] = bytes[i * sizeof(PackedPosition) + j];
+    }
+  }
+}
+
+void from_planes(const uint8_t* planes, size_t num_positions,
+                 PackedPosition* positions) {
+  auto* const bytes = reinterpret_cast<uint8_t*>(positions);
+  for (size_t i = 0; i < num_positions; ++i) {
+    for (size_t j = 0; j < sizeof(PackedPosition); ++j) {
+      bytes[i * sizeof(PackedPosition) + j] = planes[j * num_positions + i];
+    }
+  }
+}
+#endif
+}  // namespace.
+
+bool has_block_codec(BlockCodec codec) {
+  return codec == BlockCodec::none ||
+         (codec == BlockCodec::zstd && PAWN_GRABBER_HAVE_ZSTD);
+}
+
+bool is_position_block_file(const char* data, size_t size) {
+  return size >= header_size && std::memcmp(data, magic, sizeof(magic)) == 0;
+}
+
+PositionBlockWriter::PositionBlockWriter(const std::string& path,
+                                         const PositionBlockOptions& options)
+    : options_(options),
+      out_(path, false),
+      is_closed_(false),
+      offset_(header_size) {
+  block_.reserve(block_size());
+  char header[header_size];
+  const uint32_t codec = static_cast<uint32_t>(options_.codec_);
+  std::memcpy(header, magic, sizeof(magic));
+  std::memcpy(header + 8, &format_version, 4);
+  std::memcpy(header + 12, &codec, 4);
+  out_.write(header, sizeof(header));
+}
+
+PositionBlockWriter::~PositionBlockWriter() { close(); }
+
+bool PositionBlockWriter::is_open() const {
+  return out_.is_open() && has_block_codec(options_.codec_);
+}
+
+void PositionBlockWriter::write(const PackedPosition* positions,
+                                size_t num_positions) {
+  while (num_positions > 0) {
+    const size_t n = std::min(num_positions, block_size() - block_.size());
+    block_.insert(block_.end(), positions, positions + n);
+    positions += n;
+    num_positions -= n;
+    if (block_.size() == block_size()) {
+      flush_block();
+    }
+  }
+}
+
+void PositionBlockWriter::flush_block() {
+  const size_t num_bytes = block_.size() * sizeof(PackedPosition);
+  const void* data = block_.data();
+  size_t size = num_bytes;
+#if PAWN_GRABBER_HAVE_ZSTD
+  if (options_.codec_ == BlockCodec::zstd) {
+    planes_.resize(num_bytes);
+    to_planes(block_.data(), block_.size(), planes_.data());
+    compressed_.resize(ZSTD_compressBound(num_bytes));
+    size = ZSTD_compress(compressed_.data(), compressed_.size(),
+                         planes_.data(), num_bytes,
+                         options_.compression_level_);
+    // Can't fail with a buffer of the bound's size.
+    data = compressed_.data();
+  }
+#endif
+  out_.write(data, size);
+  index_.push_back({offset_, static_cast<uint32_t>(size),
+                    static_cast<uint32_t>(block_.size())});
+  offset_ += size;
+  block_.clear();
+}
+
+size_t PositionBlockWriter::block_size() const {
+  return std::min(std::max<size_t>(options_.positions_per_block_, 1),
+                  max_block_positions);
+}
+
+bool PositionBlockWriter::close() {
+  const bool has_codec = has_block_codec(options_.codec_);
+  if (!is_closed_ && has_codec) {
+    if (!block_.empty()) {
+      flush_block();
+    }
+    out_.write(index_.data(), index_.size() * sizeof(PositionBlockEntry));
+    const uint64_t num_blocks = index_.size();
+    out_.write(&num_blocks, sizeof(num_blocks));
+    out_.write(magic, sizeof(magic));
+  }
+  is_closed_ = true;
+  return out_.close() && has_codec;
+}
+
+std::unique_ptr<PositionBlockReader> PositionBlockReader::open(
+    std::unique_ptr<MappedFile> file, std::string* error) {
+  const char* const data = file->data();
+  const size_t size = file->size();
+  if (!data || !is_position_block_file(data, size) ||
+      size < header_size + trailer_size ||
+      std::memcmp(data + size - sizeof(magic), magic, sizeof(magic)) != 0) {
+    *error = "not a position block file, or cut short";
+    return nullptr;
+  }
+  uint32_t version;
+  uint32_t codec;
+  uint64_t num_blocks;
+  std::memcpy(&version, data + 8, 4);
+  std::memcpy(&codec, data + 12, 4);
+  std::memcpy(&num_blocks, data + size - trailer_size, 8);
+  if (version != format_version) {
+    *error = absl::StrCat("position block format version ", version,
+                          " isn't supported");
+    return nullptr;
+  }
+  if (!has_block_codec(static_cast<BlockCodec>(codec))) {
+    *error = absl::StrCat("position block codec ", codec,
+                          " isn't in this build");
+    return nullptr;
+  }
+  const size_t max_blocks =
+      (size - header_size - trailer_size) / sizeof(PositionBlockEntry);
+  if (num_blocks > max_blocks) {
+    *error = "the position block index is cut short";
+    return nullptr;
+  }
+  const size_t index_offset = size - trailer_size -
+                              num_blocks * sizeof(PositionBlockEntry);
+  std::vector<PositionBlockEntry> index(num_blocks);
+  std::memcpy(index.data(), data + index_offset,
+              num_blocks * sizeof(PositionBlockEntry));
+  for (const PositionBlockEntry& entry : index) {
+    if (entry.offset_ < header_size || entry.offset_ > index_offset ||
+        entry.size_ > index_offset - entry.offset_ ||
+        entry.num_positions_ > max_block_positions) {
+      *error = "a position block index entry is corrupt";
+      return nullptr;
+    }
+  }
+  return std::unique_ptr<PositionBlockReader>(new PositionBlockReader(
+      std::move(file), static_cast<BlockCodec>(codec), std::move(index)));
+}
+
+std::unique_ptr<PositionBlockReader> PositionBlockReader::open(
+    const std::string& path, std::string* error) {
+  auto file = std::make_unique<MappedFile>(path);
+  if (!file->data()) {
+    *error = absl::StrCat("can't read ", path);
+    return nullptr;
+  }
+  return open(std::move(file), error);
+}
+
+PositionBlockReader::PositionBlockReader(std::unique_ptr<MappedFile> file,
+                                         BlockCodec codec,
+                                         std::vector<PositionBlockEntry> index)
+    : file_(std::move(file)), codec_(codec), index_(std::move(index)) {
+  first_positions_.reserve(index_.size() + 1);
+  first_positions_.push_back(0);
+  for (const PositionBlockEntry& entry : index_) {
+    first_positions_.push_back(first_positions_.back() +
+                               entry.num_positions_);
+  }
+}
+
+size_t PositionBlockReader::find_block(uint64_t position_idx,
+                                       size_t* idx_in_block) const {
+  const size_t block_idx = static_cast<size_t>(
+      std::upper_bound(first_positions_.begin(), first_positions_.end(),
+                       position_idx) -
+      first_positions_.begin() - 1);
+  *idx_in_block = static_cast<size_t>(position_idx -
+                                      first_positions_[block_idx]);
+  return block_idx;
+}
+
+bool PositionBlockReader::read_block(
+    size_t block_idx, std::vector<PackedPosition>* positions) const {
+  const PositionBlockEntry& entry = index_[block_idx];
+  const char* const data = file_->data() + entry.offset_;
+  const size_t num_bytes = entry.num_positions_ * sizeof(PackedPosition);
+  positions->resize(entry.num_positions_);
+  bool is_valid = false;
+  if (codec_ == BlockCodec::none) {
+    is_valid = entry.size_ == num_bytes;
+    if (is_valid) {
+      std::memcpy(positions->data(), data, num_bytes);
+    }
+  }
+#if PAWN_GRABBER_HAVE_ZSTD
+  if (codec_ == BlockCodec::zstd) {
+    // The planes, kept from one block to the next.
+    thread_local std::vector<uint8_t> planes;
+    planes.resize(num_bytes);
+    const size_t res =
+        ZSTD_decompress(planes.data(), num_bytes, data, entry.size_);
+    is_valid = !ZSTD_isError(res) && res == num_bytes;
+    if (is_valid) {
+      from_planes(planes.data(), entry.num_positions_, positions->data());
+    }
+  }
+#endif
+  if (!is_valid) {
+    positions->clear();
+  }
+  return is_valid;
+}
@@ -0,0 +1,140 @@
+#ifndef POSITION_BLOCKS_H
+#define POSITION_BLOCKS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bulk_io.h"
+#include "mapped_file.h"
+#include "packed_position.h"
+
+// A container of packed positions (see packed_position.h) for training
+// corpora: blocks of a few thousand positions, each compressed on its own,
+// followed by an index of where each block is and how many positions it
+// holds. A reader samples a block anywhere in the file, or a worker each
+// decompresses blocks of their own, without reading the rest of the file.
+//
+// The file is a 16-byte header, the magic "PGBLOCKS", the format version and
+// the codec, then the blocks, then an index entry of 16 bytes per block, its
+// offset, its compressed size and its number of positions, and last the
+// number of blocks and the magic again. All of it is little endian, like
+// packed positions.
+//
+// Before a block is compressed its positions are transposed to byte planes,
+// the first byte of every position, then the second and so on, which puts
+// the occupancy bytes of neighbouring positions, their clocks and their
+// scores next to each other. zstd then leaves the blocks of self-play games
+// about a quarter smaller, at some 3.5 times smaller than the positions.
+
+enum class BlockCodec : uint32_t {
+  // Stored as the positions are, for builds without zstd.
+  none = 0,
+  zstd = 1
+};
+
+// True if this build can read and write blocks of `codec`.
+bool has_block_codec(BlockCodec codec);
+
+struct PositionBlockOptions {
+  // At most 1 << 20.
+  size_t positions_per_block_ = 4096;
+  // zstd where the build has it, or none.
+  BlockCodec codec_ = has_block_codec(BlockCodec::zstd) ? BlockCodec::zstd
+                                                        : BlockCodec::none;
+  int compression_level_ = 3;
+};
+
+// An entry of the index, as it is in the file.
+struct PositionBlockEntry {
+  // From the start of the file.
+  uint64_t offset_;
+  uint32_t size_;
+  uint32_t num_positions_;
+};
+
+static_assert(sizeof(PositionBlockEntry) == 16,
+              "Index entries are read and written as bytes.");
+
+// Returns true if `data` starts as a block container does, to tell one from
+// a plain file of packed positions.
+bool is_position_block_file(const char* data, size_t size);
+
+// Writes positions as they come, a block at a time once a block's worth has
+// been written, through a `BulkFileWriter`.
+class PositionBlockWriter {
+ public:
+  // Creates the file, or empties it.
+  PositionBlockWriter(const std::string& path,
+                      const PositionBlockOptions& options = {});
+  PositionBlockWriter(const PositionBlockWriter&) = delete;
+  PositionBlockWriter& operator=(const PositionBlockWriter&) = delete;
+  // Closes the file if `close` wasn't called.
+  ~PositionBlockWriter();
+
+  // False if the file couldn't be created or the codec isn't in this build.
+  bool is_open() const;
+  void write(const PackedPosition* positions, size_t num_positions);
+  // Writes the last block and the index, and closes the file. Returns false
+  // if a write failed.
+  bool close();
+
+ private:
+  size_t block_size() const;
+  void flush_block();
+
+  const PositionBlockOptions options_;
+  BulkFileWriter out_;
+  bool is_closed_;
+  uint64_t offset_;
+  std::vector<PackedPosition> block_;
+  std::vector<PositionBlockEntry> index_;
+  // Kept from one block to the next so that they don't allocate.
+  std::vector<uint8_t> planes_;
+  std::vector<uint8_t> compressed_;
+};
+
+// Reads a container through a mapping of it. Blocks are decompressed by
+// `read_block`, which any number of threads call at once.
+class PositionBlockReader {
+ public:
+  // Returns null and sets `*error` if `file` isn't a container this build
+  // reads.
+  static std::unique_ptr<PositionBlockReader> open(
+      std::unique_ptr<MappedFile> file, std::string* error);
+  static std::unique_ptr<PositionBlockReader> open(const std::string& path,
+                                                   std::string* error);
+  PositionBlockReader(const PositionBlockReader&) = delete;
+  PositionBlockReader& operator=(const PositionBlockReader&) = delete;
+
+  BlockCodec codec() const { return codec_; }
+  size_t num_blocks() const { return index_.size(); }
+  uint64_t num_positions() const { return first_positions_.back(); }
+  size_t num_block_positions(size_t block_idx) const {
+    return index_[block_idx].num_positions_;
+  }
+  // Returns the block of the `position_idx`th position of the file and sets
+  // `*idx_in_block` to its index in the block.
+  size_t find_block(uint64_t position_idx, size_t* idx_in_block) const;
+
+  // Replaces `*positions` with those of the block. Returns false, leaving
+  // `*positions` empty, if the block doesn't decompress to them. Reusing
+  // `positions` keeps its capacity.
+  bool read_block(size_t block_idx,
+                  std::vector<PackedPosition>* positions) const;
+
+ private:
+  PositionBlockReader(std::unique_ptr<MappedFile> file, BlockCodec codec,
+                      std::vector<PositionBlockEntry> index);
+
+  const std::unique_ptr<MappedFile> file_;
+  const BlockCodec codec_;
+  const std::vector<PositionBlockEntry> index_;
+  // The index of the first position of each block, and the number of
+  // positions last.
+  std::vector<uint64_t> first_positions_;
+};
+
+#endif
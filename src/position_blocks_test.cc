@@ -0,0 +1,136 @@
+#include "position_blocks.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+
+namespace {
+// Positions that differ, with the index of each as its score.
+std::vector<PackedPosition> test_positions(size_t num_positions) {
+  std::vector<PackedPosition> res;
+  Board board;
+  for (size_t i = 0; i < num_positions; ++i) {
+    const MoveList moves = board.legal_moves();
+    if (moves.empty() || i % 50 == 0) {
+      board = Board();
+    } else {
+      board.do_move(moves[i % moves.size()]);
+    }
+    res.push_back(pack_position(board, static_cast<int>(i), 0));
+  }
+  return res;
+}
+
+bool same_positions(const PackedPosition* a, const PackedPosition* b,
+                    size_t num_positions) {
+  return std::memcmp(a, b, num_positions * sizeof(PackedPosition)) == 0;
+}
+}  // namespace.
+
+TEST(PositionBlocks, ReadsBackEveryBlock) {
+  const std::string path = testing::TempDir() + "position_blocks_test.bin";
+  const std::vector<PackedPosition> positions = test_positions(1000);
+  for (BlockCodec codec : {BlockCodec::none, BlockCodec::zstd}) {
+    if (!has_block_codec(codec)) {
+      continue;
+    }
+    SCOPED_TRACE(static_cast<int>(codec));
+    PositionBlockOptions options;
+    options.positions_per_block_ = 300;
+    options.codec_ = codec;
+    PositionBlockWriter writer(path, options);
+    ASSERT_TRUE(writer.is_open());
+    // In pieces that don't line up with the blocks.
+    writer.write(positions.data(), 450);
+    writer.write(positions.data() + 450, 550);
+    ASSERT_TRUE(writer.close());
+
+    std::string error;
+    const auto reader = PositionBlockReader::open(path, &error);
+    ASSERT_NE(reader, nullptr) << error;
+    EXPECT_EQ(reader->codec(), codec);
+    ASSERT_EQ(reader->num_blocks(), 4u);
+    EXPECT_EQ(reader->num_positions(), 1000u);
+    EXPECT_EQ(reader->num_block_positions(3), 100u);
+    // The blocks in any order.
+    std::vector<PackedPosition> block;
+    for (size_t block_idx : {2, 0, 3, 1}) {
+      ASSERT_TRUE(reader->read_block(block_idx, &block));
+      ASSERT_EQ(block.size(), reader->num_block_positions(block_idx));
+      EXPECT_TRUE(same_positions(block.data(),
+                                 positions.data() + 300 * block_idx,
+                                 block.size()));
+    }
+  }
+}
+
+TEST(PositionBlocks, FindsTheBlockOfAPosition) {
+  const std::string path = testing::TempDir() + "position_blocks_test.bin";
+  const std::vector<PackedPosition> positions = test_positions(250);
+  PositionBlockOptions options;
+  options.positions_per_block_ = 100;
+  PositionBlockWriter writer(path, options);
+  writer.write(positions.data(), positions.size());
+  ASSERT_TRUE(writer.close());
+  std::string error;
+  const auto reader = PositionBlockReader::open(path, &error);
+  ASSERT_NE(reader, nullptr) << error;
+  size_t idx_in_block = 0;
+  EXPECT_EQ(reader->find_block(0, &idx_in_block), 0u);
+  EXPECT_EQ(idx_in_block, 0u);
+  EXPECT_EQ(reader->find_block(99, &idx_in_block), 0u);
+  EXPECT_EQ(idx_in_block, 99u);
+  EXPECT_EQ(reader->find_block(100, &idx_in_block), 1u);
+  EXPECT_EQ(idx_in_block, 0u);
+  EXPECT_EQ(reader->find_block(249, &idx_in_block), 2u);
+  EXPECT_EQ(idx_in_block, 49u);
+  std::vector<PackedPosition> block;
+  ASSERT_TRUE(reader->read_block(2, &block));
+  EXPECT_EQ(block[49].score_, 249);
+}
+
+TEST(PositionBlocks, ReadsEmptyFiles) {
+  const std::string path = testing::TempDir() + "position_blocks_test.bin";
+  ASSERT_TRUE(PositionBlockWriter(path).close());
+  std::string error;
+  const auto reader = PositionBlockReader::open(path, &error);
+  ASSERT_NE(reader, nullptr) << error;
+  EXPECT_EQ(reader->num_blocks(), 0u);
+  EXPECT_EQ(reader->num_positions(), 0u);
+}
+
+TEST(PositionBlocks, RejectsBadFiles) {
+  const std::string path = testing::TempDir() + "position_blocks_test.bin";
+  std::string error;
+  EXPECT_EQ(PositionBlockReader::open(testing::TempDir() + "no_such_file",
+                                      &error),
+            nullptr);
+  EXPECT_NE(error.find("can't read"), std::string::npos);
+
+  const std::vector<PackedPosition> positions = test_positions(100);
+  PositionBlockWriter writer(path);
+  writer.write(positions.data(), positions.size());
+  ASSERT_TRUE(writer.close());
+  std::ifstream in(path, std::ios::binary);
+  const std::string contents((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+  EXPECT_TRUE(is_position_block_file(contents.data(), contents.size()));
+
+  // Cut short.
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      << contents.substr(0, contents.size() - 1);
+  EXPECT_EQ(PositionBlockReader::open(path, &error), nullptr);
+  // A block past the index.
+  std::string corrupt = contents;
+  corrupt[corrupt.size() - 32] = '\xff';
+  corrupt[corrupt.size() - 31] = '\xff';
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << corrupt;
+  EXPECT_EQ(PositionBlockReader::open(path, &error), nullptr);
+  EXPECT_NE(error.find("corrupt"), std::string::npos);
+}
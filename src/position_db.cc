@@ -0,0 +1,300 @@
+#include "position_db.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "mapped_file.h"
+#include "run_reader.h"
+
+namespace {
+// The files hold Zobrist keys, so the version goes up whenever the keys of
+// zobrist.h change.
+constexpr uint64_t keys_magic = 0x3242445346475750;  // "PWGFSDB2"
+constexpr size_t page_size = 4096;
+constexpr size_t keys_per_page = page_size / sizeof(uint64_t);
+// The header fills the first page so that the keys start on a page.
+constexpr size_t header_size = page_size;
+}  // namespace.
+
+void set_top_moves(std::vector<MoveCount>* moves, PositionStats* stats) {
+  std::sort(moves->begin(), moves->end(),
+            [](const MoveCount& lhs, const MoveCount& rhs) {
+              if (lhs.count_ != rhs.count_) {
+                return lhs.count_ > rhs.count_;
+              }
+              return std::make_pair(lhs.move_.src_idx_, lhs.move_.dst_idx_) <
+                     std::make_pair(rhs.move_.src_idx_, rhs.move_.dst_idx_);
+            });
+  for (size_t i = 0; i < stats->top_moves_.size() && i < moves->size(); ++i) {
+    stats->top_moves_[i] = (*moves)[i];
+  }
+}
+
+KeyedRecordsWriter::KeyedRecordsWriter(const std::string& path,
+                                       const std::string& records_path)
+    : keys_file_(std::fopen((path + ".keys").c_str(), "wb")),
+      records_file_(std::fopen(records_path.c_str(), "wb")),
+      num_keys_(0),
+      is_written_(keys_file_ && records_file_) {
+  // The header is written last, when the number of keys is known.
+  const std::vector<char> header(header_size);
+  if (is_written_) {
+    is_written_ = std::fwrite(header.data(), 1, header.size(), keys_file_) ==
+                  header.size();
+  }
+}
+
+KeyedRecordsWriter::~KeyedRecordsWriter() { close(); }
+
+void KeyedRecordsWriter::write(uint64_t key, const void* record,
+                               size_t record_size) {
+  if (num_keys_ % keys_per_page == 0) {
+    first_keys_.push_back(key);
+  }
+  ++num_keys_;
+  if (is_written_) {
+    is_written_ = std::fwrite(&key, sizeof(key), 1, keys_file_) == 1 &&
+                  std::fwrite(record, record_size, 1, records_file_) == 1;
+  }
+}
+
+bool KeyedRecordsWriter::close() {
+  if (is_written_ && keys_file_) {
+    const uint64_t header_fields[] = {keys_magic, num_keys_,
+                                      first_keys_.size()};
+    is_written_ =
+        std::fwrite(first_keys_.data(), sizeof(uint64_t), first_keys_.size(),
+                    keys_file_) == first_keys_.size() &&
+        std::fseek(keys_file_, 0, SEEK_SET) == 0 &&
+        std::fwrite(header_fields, sizeof(header_fields), 1, keys_file_) == 1;
+  }
+  if (keys_file_ && std::fclose(keys_file_) != 0) {
+    is_written_ = false;
+  }
+  if (records_file_ && std::fclose(records_file_) != 0) {
+    is_written_ = false;
+  }
+  keys_file_ = nullptr;
+  records_file_ = nullptr;
+  return is_written_;
+}
+
+KeyedRecords::KeyedRecords(const std::string& path,
+                           const std::string& records_path,
+                           size_t record_size)
+    : keys_file_(new MappedFile(path + ".keys")),
+      records_file_(new MappedFile(records_path)),
+      record_size_(record_size),
+      keys_(nullptr),
+      first_keys_(nullptr),
+      num_keys_(0),
+      num_pages_(0) {
+  if (!keys_file_->data() || !records_file_->data() ||
+      keys_file_->size() < header_size) {
+    return;
+  }
+  uint64_t header_fields[3];
+  std::memcpy(header_fields, keys_file_->data(), sizeof(header_fields));
+  const uint64_t num_keys = header_fields[1];
+  const uint64_t num_pages = header_fields[2];
+  if (header_fields[0] != keys_magic ||
+      num_pages != (num_keys + keys_per_page - 1) / keys_per_page ||
+      keys_file_->size() !=
+          header_size + (num_keys + num_pages) * sizeof(uint64_t) ||
+      records_file_->size() != num_keys * record_size) {
+    return;
+  }
+  // The mapping is page aligned, so the keys are aligned too.
+  keys_ = reinterpret_cast<const uint64_t*>(keys_file_->data() + header_size);
+  first_keys_ = keys_ + num_keys;
+  num_keys_ = num_keys;
+  num_pages_ = num_pages;
+}
+
+const char* KeyedRecords::find(uint64_t key) const {
+  if (!keys_) {
+    return nullptr;
+  }
+  // The last page of keys that starts at or before `key`.
+  const uint64_t* const page = std::upper_bound(
+      first_keys_, first_keys_ + num_pages_, key);
+  if (page == first_keys_) {
+    return nullptr;
+  }
+  const size_t page_idx = static_cast<size_t>(page - first_keys_) - 1;
+  const uint64_t* const begin = keys_ + page_idx * keys_per_page;
+  const uint64_t* const end =
+      keys_ + std::min(num_keys_, (page_idx + 1) * keys_per_page);
+  const uint64_t* const found = std::lower_bound(begin, end, key);
+  if (found == end || *found != key) {
+    return nullptr;
+  }
+  return record(static_cast<size_t>(found - keys_));
+}
+
+void KeyedRecords::find_sorted(const uint64_t* keys, size_t num_keys,
+                               const char** records) const {
+  const uint64_t* page = first_keys_;
+  const uint64_t* found = keys_;
+  for (size_t i = 0; i < num_keys; ++i) {
+    const uint64_t key = keys[i];
+    records[i] = nullptr;
+    if (!keys_) {
+      continue;
+    }
+    page = std::upper_bound(page, first_keys_ + num_pages_, key);
+    if (page == first_keys_) {
+      continue;
+    }
+    const size_t page_idx = static_cast<size_t>(page - first_keys_) - 1;
+    const uint64_t* const end =
+        keys_ + std::min(num_keys_, (page_idx + 1) * keys_per_page);
+    found = std::lower_bound(
+        std::max(found, keys_ + page_idx * keys_per_page), end, key);
+    if (found != end && *found == key) {
+      records[i] = record(static_cast<size_t>(found - keys_));
+    }
+    // The next key may be on this page too.
+    --page;
+  }
+}
+
+PositionDbBuilder::PositionDbBuilder(const std::string& path,
+                                     size_t memory_bytes)
+    : path_(path),
+      max_entries_(std::max<size_t>(memory_bytes / sizeof(Entry), 1)),
+      has_failed_(false) {
+  entries_.reserve(max_entries_);
+}
+
+PositionDbBuilder::~PositionDbBuilder() {
+  for (const std::string& run_path : run_paths_) {
+    std::remove(run_path.c_str());
+  }
+}
+
+void PositionDbBuilder::add(uint64_t key, Move move, int result) {
+  entries_.push_back({key, move, result});
+  if (entries_.size() == max_entries_ && !write_run()) {
+    has_failed_ = true;
+  }
+}
+
+bool PositionDbBuilder::write_run() {
+  std::sort(entries_.begin(), entries_.end(),
+            [](const Entry& lhs, const Entry& rhs) {
+              return lhs.key_ < rhs.key_;
+            });
+  run_paths_.push_back(absl::StrCat(path_, ".run", run_paths_.size()));
+  std::FILE* file = std::fopen(run_paths_.back().c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  const bool is_written = std::fwrite(entries_.data(), sizeof(Entry),
+                                      entries_.size(),
+                                      file) == entries_.size();
+  entries_.clear();
+  return std::fclose(file) == 0 && is_written;
+}
+
+bool PositionDbBuilder::finish() {
+  if (!entries_.empty() && !write_run()) {
+    has_failed_ = true;
+  }
+  PositionDbWriter writer(path_);
+
+  // A k-way merge of the runs, through a heap of the first key of each.
+  std::vector<std::unique_ptr<RunReader<Entry>>> runs;
+  using HeapItem = std::pair<uint64_t, size_t>;
+  std::priority_queue<HeapItem, std::vector<HeapItem>,
+                      std::greater<HeapItem>>
+      heap;
+  for (const std::string& run_path : run_paths_) {
+    runs.push_back(std::make_unique<RunReader<Entry>>(run_path));
+    if (!runs.back()->empty()) {
+      heap.push({runs.back()->front().key_, runs.size() - 1});
+    }
+  }
+  std::vector<MoveCount> moves;
+  PositionStats stats = {};
+  uint64_t key = 0;
+  while (!heap.empty()) {
+    const size_t run_idx = heap.top().second;
+    heap.pop();
+    RunReader<Entry>& run = *runs[run_idx];
+    const Entry entry = run.front();
+    run.pop();
+    if (!run.empty()) {
+      heap.push({run.front().key_, run_idx});
+    }
+    if (stats.games_ == 0 || entry.key_ != key) {
+      if (stats.games_ != 0) {
+        set_top_moves(&moves, &stats);
+        writer.write(key, stats);
+      }
+      key = entry.key_;
+      stats = {};
+      moves.clear();
+    }
+    ++stats.games_;
+    stats.white_wins_ += entry.result_ > 0;
+    stats.draws_ += entry.result_ == 0;
+    stats.black_wins_ += entry.result_ < 0;
+    auto move_count = std::find_if(
+        moves.begin(), moves.end(),
+        [&entry](const MoveCount& count) { return count.move_ == entry.move_; });
+    if (move_count == moves.end()) {
+      moves.push_back({entry.move_, 1});
+    } else {
+      ++move_count->count_;
+    }
+  }
+  if (stats.games_ != 0) {
+    set_top_moves(&moves, &stats);
+    writer.write(key, stats);
+  }
+  const bool is_written = writer.close() && !has_failed_;
+
+  runs.clear();
+  for (const std::string& run_path : run_paths_) {
+    std::remove(run_path.c_str());
+  }
+  run_paths_.clear();
+  return is_written;
+}
+
+absl::optional<PositionStats> PositionDb::find(uint64_t key) const {
+  const char* const record = records_.find(key);
+  if (!record) {
+    return absl::nullopt;
+  }
+  PositionStats res;
+  std::memcpy(&res, record, sizeof(res));
+  return res;
+}
+
+void PositionDb::find_sorted(const uint64_t* keys, size_t num_keys,
+                             absl::optional<PositionStats>* stats) const {
+  std::vector<const char*> records(num_keys);
+  records_.find_sorted(keys, num_keys, records.data());
+  for (size_t i = 0; i < num_keys; ++i) {
+    stats[i] = absl::nullopt;
+    if (records[i]) {
+      PositionStats res;
+      std::memcpy(&res, records[i], sizeof(res));
+      stats[i] = res;
+    }
+  }
+}
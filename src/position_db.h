@@ -0,0 +1,192 @@
+#ifndef POSITION_DB_H
+#define POSITION_DB_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "mapped_file.h"
+
+// A database of positions keyed by Zobrist key, with how often each was
+// reached, how those games ended and the moves most played from it, for an
+// opening explorer. It is two files, both mapped into memory when read:
+//
+// - <path>.keys holds a page of header, then the keys sorted, 512 to a page,
+//   then the first key of every page of keys. The first keys are a 512th of
+//   the file, so they stay in memory, and a lookup binary searches them and
+//   then a single page of keys.
+// - <path>.stats holds a PositionStats record for each key, in the same
+//   order, so the record is one more page.
+//
+// The files are built by sorting what the games add on disk, in runs that fit
+// in memory, then merging the runs, so the database can be bigger than memory.
+//
+// The layout doesn't depend on what the records hold: KeyedRecordsWriter and
+// KeyedRecords write and read it for records of any fixed size, which other
+// stores keyed by position use too (see analysis_cache.h).
+
+struct MoveCount {
+  Move move_;
+  uint32_t count_;
+};
+
+struct PositionStats {
+  // The number of games that reached the position and went on from it.
+  uint32_t games_;
+  uint32_t white_wins_;
+  uint32_t draws_;
+  uint32_t black_wins_;
+  // The moves most played from the position, most played first. Unused slots
+  // have a count of 0.
+  std::array<MoveCount, 4> top_moves_;
+};
+
+static_assert(sizeof(PositionStats) == 48, "PositionStats layout changed.");
+static_assert(std::is_trivially_copyable<PositionStats>::value,
+              "PositionStats are read and written as bytes.");
+
+// Sorts `*moves` with the most played first, ties in a fixed order, and puts
+// the first of them in `stats->top_moves_`.
+void set_top_moves(std::vector<MoveCount>* moves, PositionStats* stats);
+
+// Writes <path>.keys and the records of the keys to `records_path`, given in
+// increasing order of key.
+class KeyedRecordsWriter {
+ public:
+  KeyedRecordsWriter(const std::string& path, const std::string& records_path);
+  KeyedRecordsWriter(const KeyedRecordsWriter&) = delete;
+  KeyedRecordsWriter& operator=(const KeyedRecordsWriter&) = delete;
+  ~KeyedRecordsWriter();
+
+  // The records of a database all have the same size.
+  void write(uint64_t key, const void* record, size_t record_size);
+  // Writes the index of pages and the header. Returns false if a file
+  // couldn't be written.
+  bool close();
+
+ private:
+  std::FILE* keys_file_;
+  std::FILE* records_file_;
+  std::vector<uint64_t> first_keys_;
+  uint64_t num_keys_;
+  bool is_written_;
+};
+
+// Looks up the records of keys in the files of a KeyedRecordsWriter, mapped
+// into memory. Any number of threads may look up at once.
+class KeyedRecords {
+ public:
+  // Maps <path>.keys and `records_path`, whose records are `record_size`
+  // bytes. `is_open` tells whether that worked.
+  KeyedRecords(const std::string& path, const std::string& records_path,
+               size_t record_size);
+
+  bool is_open() const { return keys_ != nullptr; }
+  size_t size() const { return num_keys_; }
+  // The key and the record at `idx`, in increasing order of key.
+  uint64_t key(size_t idx) const { return keys_[idx]; }
+  const char* record(size_t idx) const {
+    return records_file_->data() + idx * record_size_;
+  }
+  // Returns the record of `key`, or null if it has none.
+  const char* find(uint64_t key) const;
+  // Looks up `num_keys` keys sorted in increasing order, setting
+  // `records[i]` to what `find(keys[i])` returns. Each search starts where
+  // the one before stopped, so keys close together share their pages.
+  void find_sorted(const uint64_t* keys, size_t num_keys,
+                   const char** records) const;
+
+ private:
+  std::unique_ptr<MappedFile> keys_file_;
+  std::unique_ptr<MappedFile> records_file_;
+  size_t record_size_;
+  const uint64_t* keys_;
+  const uint64_t* first_keys_;
+  size_t num_keys_;
+  size_t num_pages_;
+};
+
+// Writes the database files from the stats of every position, given in
+// increasing order of key, for callers that have them already.
+class PositionDbWriter {
+ public:
+  explicit PositionDbWriter(const std::string& path)
+      : writer_(path, path + ".stats") {}
+
+  void write(uint64_t key, const PositionStats& stats) {
+    writer_.write(key, &stats, sizeof(stats));
+  }
+  // Writes the index of pages and the header. Returns false if a file
+  // couldn't be written.
+  bool close() { return writer_.close(); }
+
+ private:
+  KeyedRecordsWriter writer_;
+};
+
+// Collects the positions of games and writes the database.
+class PositionDbBuilder {
+ public:
+  // Keeps up to `memory_bytes` of positions in memory before sorting them
+  // into a run file next to `path`.
+  PositionDbBuilder(const std::string& path, size_t memory_bytes);
+  PositionDbBuilder(const PositionDbBuilder&) = delete;
+  PositionDbBuilder& operator=(const PositionDbBuilder&) = delete;
+  // Removes any run files left.
+  ~PositionDbBuilder();
+
+  // Adds that a game with `result` (1 if white won, -1 if black did, 0 for a
+  // draw) reached the position with `key` and went on with `move`.
+  void add(uint64_t key, Move move, int result);
+  // Merges the runs into the database files. Returns false if a file
+  // couldn't be written.
+  bool finish();
+
+ private:
+  struct Entry {
+    uint64_t key_;
+    Move move_;
+    int32_t result_;
+  };
+
+  bool write_run();
+
+  std::string path_;
+  size_t max_entries_;
+  std::vector<Entry> entries_;
+  std::vector<std::string> run_paths_;
+  bool has_failed_;
+};
+
+// Looks up positions in a database.
+class PositionDb {
+ public:
+  // Maps the files of the database at `path`. `is_open` tells whether that
+  // worked.
+  explicit PositionDb(const std::string& path)
+      : records_(path, path + ".stats", sizeof(PositionStats)) {}
+
+  bool is_open() const { return records_.is_open(); }
+  // The number of positions.
+  size_t size() const { return records_.size(); }
+  // Returns the stats of the position with `key`, or nullopt if it isn't in
+  // the database.
+  absl::optional<PositionStats> find(uint64_t key) const;
+  // Looks up `num_keys` keys sorted in increasing order, setting `stats[i]`
+  // to what `find(keys[i])` returns. Each search starts where the one before
+  // stopped, so keys close together share their pages.
+  void find_sorted(const uint64_t* keys, size_t num_keys,
+                   absl::optional<PositionStats>* stats) const;
+
+ private:
+  KeyedRecords records_;
+};
+
+#endif
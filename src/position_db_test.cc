@@ -0,0 +1,86 @@
+#include "position_db.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+Move move_of(const char* src, const char* dst) {
+  return Move(str_to_square(src), str_to_square(dst), Piece::pawn,
+              MoveType::simple);
+}
+}  // namespace.
+
+TEST(PositionDb, FindsWhatWasAdded) {
+  const std::string path = testing::TempDir() + "position_db_test";
+  {
+    // Small enough to sort several runs.
+    PositionDbBuilder builder(path, 1000);
+    for (uint64_t i = 0; i < 5000; ++i) {
+      // Keys spread like Zobrist keys.
+      const uint64_t key = (i + 1) * 0x9E3779B97F4A7C15;
+      builder.add(key, move_of("e2", "e4"), 1);
+      if (i % 2 == 0) {
+        builder.add(key, move_of("d2", "d4"), 0);
+        builder.add(key, move_of("d2", "d4"), -1);
+      }
+    }
+    ASSERT_TRUE(builder.finish());
+  }
+  const PositionDb db(path);
+  ASSERT_TRUE(db.is_open());
+  EXPECT_EQ(db.size(), 5000);
+  for (uint64_t i = 0; i < 5000; ++i) {
+    const absl::optional<PositionStats> stats =
+        db.find((i + 1) * 0x9E3779B97F4A7C15);
+    ASSERT_TRUE(stats);
+    if (i % 2 == 0) {
+      EXPECT_EQ(stats->games_, 3);
+      EXPECT_EQ(stats->white_wins_, 1);
+      EXPECT_EQ(stats->draws_, 1);
+      EXPECT_EQ(stats->black_wins_, 1);
+      EXPECT_EQ(stats->top_moves_[0].move_, move_of("d2", "d4"));
+      EXPECT_EQ(stats->top_moves_[0].count_, 2);
+      EXPECT_EQ(stats->top_moves_[1].move_, move_of("e2", "e4"));
+      EXPECT_EQ(stats->top_moves_[1].count_, 1);
+    } else {
+      EXPECT_EQ(stats->games_, 1);
+      EXPECT_EQ(stats->white_wins_, 1);
+      EXPECT_EQ(stats->top_moves_[0].move_, move_of("e2", "e4"));
+      EXPECT_EQ(stats->top_moves_[1].count_, 0);
+    }
+  }
+  EXPECT_FALSE(db.find(0));
+  EXPECT_FALSE(db.find(12345));
+  EXPECT_FALSE(db.find(~uint64_t{0}));
+
+  // Every third key and the key after it, which isn't there, at once.
+  std::vector<uint64_t> keys = {0, ~uint64_t{0}};
+  for (uint64_t i = 0; i < 5000; i += 3) {
+    keys.push_back((i + 1) * 0x9E3779B97F4A7C15);
+    keys.push_back((i + 1) * 0x9E3779B97F4A7C15 + 1);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<absl::optional<PositionStats>> found(keys.size());
+  db.find_sorted(keys.data(), keys.size(), found.data());
+  size_t num_found = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const absl::optional<PositionStats> stats = db.find(keys[i]);
+    ASSERT_EQ(found[i].has_value(), stats.has_value()) << i;
+    if (stats) {
+      EXPECT_EQ(found[i]->games_, stats->games_);
+      ++num_found;
+    }
+  }
+  EXPECT_EQ(num_found, 1667);
+}
+
+TEST(PositionDb, FailsOnMissingFiles) {
+  EXPECT_FALSE(PositionDb("/no/such/db").is_open());
+}
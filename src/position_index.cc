@@ -0,0 +1,306 @@
+#include "position_index.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "debug_check.h"
+#include "endgame.h"
+
+namespace {
+// The squares a group of pieces other than pawns chooses from, those the
+// kings leave, and those pawns choose from, ranks 2 to 7.
+constexpr int num_piece_squares = 62;
+constexpr int num_pawn_squares = 48;
+
+// binomials[n][k] is n choose k.
+constexpr std::array<std::array<uint64_t, max_indexed_pieces>, 65>
+make_binomials() {
+  std::array<std::array<uint64_t, max_indexed_pieces>, 65> res = {};
+  for (size_t n = 0; n < res.size(); ++n) {
+    res[n][0] = 1;
+    for (size_t k = 1; k < max_indexed_pieces && k <= n; ++k) {
+      res[n][k] = res[n - 1][k - 1] + (k < n ? res[n - 1][k] : 0);
+    }
+  }
+  return res;
+}
+
+constexpr std::array<std::array<uint64_t, max_indexed_pieces>, 65> binomials =
+    make_binomials();
+
+uint64_t binomial(int n, int k) {
+  return binomials[static_cast<size_t>(n)][static_cast<size_t>(k)];
+}
+
+int file_of(int idx) { return 7 - idx % 8; }
+int rank_of(int idx) { return idx / 8; }
+int transpose(int idx) { return file_of(idx) * 8 + 7 - rank_of(idx); }
+bool is_on_diagonal(int idx) { return rank_of(idx) == file_of(idx); }
+
+// The places of the two kings, numbered in square order.
+class KingPlaces {
+ public:
+  explicit KingPlaces(bool has_pawns) {
+    codes_.fill(-1);
+    for (int white = 0; white < 64; ++white) {
+      if (file_of(white) >= 4 ||
+          (!has_pawns && rank_of(white) > file_of(white))) {
+        continue;
+      }
+      for (int black = 0; black < 64; ++black) {
+        if (black == white ||
+            king_attacks[static_cast<size_t>(white)] & lsb_bitboard << black ||
+            (!has_pawns && is_on_diagonal(white) &&
+             rank_of(black) > file_of(black))) {
+          continue;
+        }
+        codes_[static_cast<size_t>(white * 64 + black)] =
+            static_cast<int>(places_.size());
+        places_.emplace_back(white, black);
+      }
+    }
+  }
+
+  int code(int white, int black) const {
+    return codes_[static_cast<size_t>(white * 64 + black)];
+  }
+  const std::pair<int, int>& place(uint64_t code) const {
+    return places_[static_cast<size_t>(code)];
+  }
+  uint64_t size() const { return places_.size(); }
+
+ private:
+  std::array<int, 64 * 64> codes_;
+  std::vector<std::pair<int, int>> places_;
+};
+
+const KingPlaces& king_places(bool has_pawns) {
+  static const KingPlaces without_pawns(false);
+  static const KingPlaces with_pawns(true);
+  return has_pawns ? with_pawns : without_pawns;
+}
+
+int num_squares(Piece piece) {
+  return piece == Piece::pawn ? num_pawn_squares : num_piece_squares;
+}
+
+// Returns the number of `sq` among the squares a group of `piece` chooses
+// from, with the kings on `kings`.
+int square_code(Piece piece, int sq, const std::array<int, 2>& kings) {
+  if (piece == Piece::pawn) {
+    return sq - 8;
+  }
+  return sq - (kings[0] < sq ? 1 : 0) - (kings[1] < sq ? 1 : 0);
+}
+
+// The inverse of `square_code`, where `kings` must be sorted.
+int square_of_code(Piece piece, int code,
+                   const std::array<int, 2>& sorted_kings) {
+  if (piece == Piece::pawn) {
+    return code + 8;
+  }
+  for (int king : sorted_kings) {
+    if (code >= king) {
+      ++code;
+    }
+  }
+  return code;
+}
+}  // namespace.
+
+absl::optional<PositionIndexer> PositionIndexer::create(
+    absl::string_view material, std::string* error) {
+  const size_t split = material.find('v');
+  if (split == absl::string_view::npos) {
+    *error = absl::StrCat("bad material ", material);
+    return absl::nullopt;
+  }
+  const std::array<absl::string_view, num_colors> sides = {
+      {material.substr(0, split), material.substr(split + 1)}};
+  for (absl::string_view side : sides) {
+    if (side.empty() || side[0] != 'K' ||
+        side.find_first_not_of("QRBNP", 1) != absl::string_view::npos) {
+      *error = absl::StrCat("bad material ", material);
+      return absl::nullopt;
+    }
+  }
+  if (material.size() - 1 > max_indexed_pieces) {
+    *error = absl::StrCat(material, " has more than ", max_indexed_pieces,
+                          " pieces");
+    return absl::nullopt;
+  }
+  PositionIndexer res;
+  res.material_ = std::string(material);
+  res.material_key_ = material_key_of(material);
+  res.flipped_material_key_ =
+      material_key_of(absl::StrCat(sides[1], "v", sides[0]));
+  res.num_groups_ = 0;
+  res.num_pieces_ = 2;
+  res.has_pawns_ = material.find('P') != absl::string_view::npos;
+  res.size_ = king_places(res.has_pawns_).size() * 2;
+  constexpr absl::string_view piece_chars = "QRBNP";
+  constexpr std::array<Piece, 5> pieces = {
+      {Piece::queen, Piece::rook, Piece::bishop, Piece::knight, Piece::pawn}};
+  for (Color color : {Color::white, Color::black}) {
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      const int count = static_cast<int>(std::count(
+          sides[static_cast<size_t>(color)].begin(),
+          sides[static_cast<size_t>(color)].end(), piece_chars[i]));
+      if (count) {
+        res.groups_[static_cast<size_t>(res.num_groups_++)] = {
+            color, pieces[i], count};
+        res.num_pieces_ += count;
+        res.size_ *= binomial(num_squares(pieces[i]), count);
+      }
+    }
+  }
+  return res;
+}
+
+uint64_t PositionIndexer::index(const Board& board) const {
+  const bool flip = board.material_key_ != material_key_;
+  DEBUG_CHECK(board.material_key_ == (flip ? flipped_material_key_
+                                           : material_key_),
+              "The board doesn't have the material of the indexer.");
+  const int flip_ranks = flip ? 56 : 0;
+  Squares squares = {};
+  size_t i = 0;
+  for (Color color : {Color::white, Color::black}) {
+    squares[i++] =
+        square_idx(board.pieces(flip ? flip_color(color) : color,
+                                Piece::king)) ^
+        flip_ranks;
+  }
+  for (int group_idx = 0; group_idx < num_groups_; ++group_idx) {
+    const Group& group = groups_[static_cast<size_t>(group_idx)];
+    for (Bitboard sq : bitboard_split(board.pieces(
+             flip ? flip_color(group.color_) : group.color_, group.piece_))) {
+      squares[i++] = square_idx(sq) ^ flip_ranks;
+    }
+  }
+  const bool white_to_move = board.is_whites_move_ != flip;
+  const int white_king = squares[0];
+  const int mirror = (file_of(white_king) >= 4 ? 7 : 0) |
+                     (!has_pawns_ && rank_of(white_king) >= 4 ? 56 : 0);
+  for (int& sq : squares) {
+    sq ^= mirror;
+  }
+  if (has_pawns_) {
+    return index_of_squares(squares, white_to_move);
+  }
+  Squares transposed = squares;
+  for (int& sq : transposed) {
+    sq = transpose(sq);
+  }
+  if (is_on_diagonal(squares[0]) && is_on_diagonal(squares[1])) {
+    return std::min(index_of_squares(squares, white_to_move),
+                    index_of_squares(transposed, white_to_move));
+  }
+  const bool is_transposed =
+      rank_of(squares[0]) > file_of(squares[0]) ||
+      (is_on_diagonal(squares[0]) && rank_of(squares[1]) > file_of(squares[1]));
+  return index_of_squares(is_transposed ? transposed : squares, white_to_move);
+}
+
+uint64_t PositionIndexer::index_of_squares(const Squares& squares,
+                                           bool white_to_move) const {
+  const std::array<int, 2> kings = {{squares[0], squares[1]}};
+  uint64_t res =
+      static_cast<uint64_t>(king_places(has_pawns_).code(kings[0], kings[1]));
+  size_t i = 2;
+  for (int group_idx = 0; group_idx < num_groups_; ++group_idx) {
+    const Group& group = groups_[static_cast<size_t>(group_idx)];
+    std::array<int, max_indexed_pieces> codes = {};
+    for (int j = 0; j < group.count_; ++j) {
+      codes[static_cast<size_t>(j)] =
+          square_code(group.piece_, squares[i++], kings);
+    }
+    std::sort(codes.begin(), codes.begin() + group.count_);
+    uint64_t combination = 0;
+    for (int j = 0; j < group.count_; ++j) {
+      combination += binomial(codes[static_cast<size_t>(j)], j + 1);
+    }
+    res = res * binomial(num_squares(group.piece_), group.count_) +
+          combination;
+  }
+  return res * 2 + (white_to_move ? 0 : 1);
+}
+
+absl::optional<Board> PositionIndexer::unindex(uint64_t idx) const {
+  if (idx >= size_) {
+    return absl::nullopt;
+  }
+  uint64_t left = idx;
+  const bool white_to_move = left % 2 == 0;
+  left /= 2;
+  // The square codes of each group, taken off the end of the index.
+  std::array<std::array<int, max_indexed_pieces>, max_indexed_pieces> codes =
+      {};
+  for (int group_idx = num_groups_ - 1; group_idx >= 0; --group_idx) {
+    const Group& group = groups_[static_cast<size_t>(group_idx)];
+    const int n = num_squares(group.piece_);
+    const uint64_t num_combinations = binomial(n, group.count_);
+    uint64_t combination = left % num_combinations;
+    left /= num_combinations;
+    int code = n;
+    for (int j = group.count_ - 1; j >= 0; --j) {
+      do {
+        --code;
+      } while (binomial(code, j + 1) > combination);
+      combination -= binomial(code, j + 1);
+      codes[static_cast<size_t>(group_idx)][static_cast<size_t>(j)] = code;
+    }
+  }
+  const std::pair<int, int>& kings = king_places(has_pawns_).place(left);
+  const std::array<int, 2> sorted_kings = {
+      {std::min(kings.first, kings.second),
+       std::max(kings.first, kings.second)}};
+  Board res;
+  res.zero_all_bitboards();
+  *res.piece_bitboard(Color::white, Piece::king) = lsb_bitboard << kings.first;
+  *res.piece_bitboard(Color::black, Piece::king) = lsb_bitboard
+                                                   << kings.second;
+  Bitboard occupancy =
+      lsb_bitboard << kings.first | lsb_bitboard << kings.second;
+  for (int group_idx = 0; group_idx < num_groups_; ++group_idx) {
+    const Group& group = groups_[static_cast<size_t>(group_idx)];
+    for (int j = 0; j < group.count_; ++j) {
+      const Bitboard sq =
+          lsb_bitboard
+          << square_of_code(
+                 group.piece_,
+                 codes[static_cast<size_t>(group_idx)][static_cast<size_t>(j)],
+                 sorted_kings);
+      if (occupancy & sq) {
+        return absl::nullopt;
+      }
+      occupancy |= sq;
+      *res.piece_bitboard(group.color_, group.piece_) |= sq;
+    }
+  }
+  res.init_mailbox();
+  res.init_occupancy();
+  res.en_passant_square_ = 0;
+  res.castling_rights_ = no_castling;
+  res.fifty_move_clock_ = 0;
+  res.num_moves_ = 1;
+  res.is_whites_move_ = white_to_move;
+  res.init_state();
+  // Of a position and its mirror image only the lower index counts.
+  if (!has_pawns_ && is_on_diagonal(kings.first) &&
+      is_on_diagonal(kings.second) && index(res) != idx) {
+    return absl::nullopt;
+  }
+  return res;
+}
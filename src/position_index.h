@@ -0,0 +1,82 @@
+#ifndef POSITION_INDEX_H
+#define POSITION_INDEX_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+
+// Dense indices of the positions of one material, for tables with a record
+// per position such as tablebases, bitbases and endgame statistics, which
+// then look a position up at an array offset. They are 4 to 8 times smaller
+// than giving every piece its 64 squares, and smaller still than a hash.
+//
+// The board is first mirrored so that the white king is on files a to d, and
+// without pawns also on the triangle a1-d1-d4, with the black king on or
+// below the diagonal a1-h8 if the white king is on it. The two kings then take
+// one of 462 places without pawns and 1806 with pawns, on different squares
+// that don't touch. Each group of identical other pieces takes a combination
+// of the 62 squares the kings leave, or of the 48 squares pawns stand on, in
+// the combinatorial number system, so that identical pieces in another order
+// give the same index. The side to move is the lowest bit. Castling rights,
+// the en passant square and the clocks are left out.
+//
+// Some indices have no position: those where two groups share a square, and
+// without pawns, when both kings are on the diagonal, the higher of the
+// indices of a position and of its mirror image in the diagonal.
+
+constexpr int max_indexed_pieces = 7;
+
+class PositionIndexer {
+ public:
+  // Returns the indexer of `material`, such as "KRPvKR": white's pieces, a
+  // 'v' and black's, each side starting with its king, with up to
+  // `max_indexed_pieces` pieces in all. Returns nullopt with what is wrong in
+  // `*error` if it isn't.
+  static absl::optional<PositionIndexer> create(absl::string_view material,
+                                                std::string* error);
+
+  const std::string& material() const { return material_; }
+  // The number of indices.
+  uint64_t size() const { return size_; }
+
+  // Returns the index of `board`, which must have the material of the
+  // indexer with either color. With the colors swapped the board is mirrored
+  // from top to bottom and the side to move swapped too.
+  uint64_t index(const Board& board) const;
+  // Returns the position of `idx`, with the colors of `material()`, or
+  // nullopt if it has none. The position may still be illegal, with the side
+  // not to move in check.
+  absl::optional<Board> unindex(uint64_t idx) const;
+
+ private:
+  // Identical pieces other than the kings.
+  struct Group {
+    Color color_;
+    Piece piece_;
+    int count_;
+  };
+  // The squares of the pieces: the white king, the black king, then the
+  // groups in order.
+  typedef std::array<int, max_indexed_pieces> Squares;
+
+  PositionIndexer() = default;
+
+  // Returns the index of `squares`, which must be mirrored as the index has
+  // them.
+  uint64_t index_of_squares(const Squares& squares, bool white_to_move) const;
+
+  std::string material_;
+  uint64_t material_key_;
+  uint64_t flipped_material_key_;
+  std::array<Group, max_indexed_pieces - 2> groups_;
+  int num_groups_;
+  int num_pieces_;
+  bool has_pawns_;
+  uint64_t size_;
+};
+
+#endif
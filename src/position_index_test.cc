@@ -0,0 +1,106 @@
+#include "position_index.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+PositionIndexer indexer_of(const std::string& material) {
+  std::string error;
+  const absl::optional<PositionIndexer> res =
+      PositionIndexer::create(material, &error);
+  EXPECT_TRUE(res) << error;
+  return *res;
+}
+
+// Returns `board` with each square mirrored by `f`.
+template <typename F>
+Board mirrored(const Board& board, F f) {
+  Board res = board;
+  res.zero_all_bitboards();
+  for (Color color : {Color::white, Color::black}) {
+    for (Piece piece : {Piece::pawn, Piece::rook, Piece::knight, Piece::bishop,
+                        Piece::queen, Piece::king}) {
+      for (Bitboard sq : bitboard_split(board.pieces(color, piece))) {
+        *res.piece_bitboard(color, piece) |= lsb_bitboard
+                                             << f(square_idx(sq));
+      }
+    }
+  }
+  res.init_mailbox();
+  res.init_occupancy();
+  return res;
+}
+}  // namespace.
+
+TEST(PositionIndexer, RejectsBadMaterials) {
+  std::string error;
+  for (const char* material : {"KQK", "QvK", "KvQ", "KQRBNvKRBN", "KXvK"}) {
+    EXPECT_EQ(PositionIndexer::create(material, &error), absl::nullopt)
+        << material;
+  }
+}
+
+TEST(PositionIndexer, Sizes) {
+  EXPECT_EQ(indexer_of("KvK").size(), 462u * 2);
+  EXPECT_EQ(indexer_of("KPvK").size(), 1806u * 48 * 2);
+  // Two rooks take a pair of the 62 squares the kings leave.
+  EXPECT_EQ(indexer_of("KRRvK").size(), 462u * 62 * 61 / 2 * 2);
+  EXPECT_EQ(indexer_of("KRPvKR").size(), 1806u * 62 * 48 * 62 * 2);
+}
+
+TEST(PositionIndexer, UnindexesTheIndex) {
+  for (const char* material : {"KQvK", "KRRvK", "KPvK", "KBNvKP"}) {
+    const PositionIndexer indexer = indexer_of(material);
+    uint64_t num_positions = 0;
+    // Spread over the whole range.
+    const uint64_t step = indexer.size() / 200000 + 1;
+    for (uint64_t idx = 0; idx < indexer.size(); idx += step) {
+      const absl::optional<Board> board = indexer.unindex(idx);
+      if (board) {
+        ++num_positions;
+        EXPECT_TRUE(board->has_consistent_state());
+        ASSERT_EQ(indexer.index(*board), idx) << material << " " << idx;
+      }
+    }
+    // Few indices have no position.
+    EXPECT_GT(num_positions * 10, indexer.size() / step * 9) << material;
+  }
+  EXPECT_EQ(indexer_of("KQvK").unindex(indexer_of("KQvK").size()),
+            absl::nullopt);
+}
+
+TEST(PositionIndexer, MirroredPositionsShareAnIndex) {
+  const PositionIndexer pawnless = indexer_of("KRRvKN");
+  const Board board("8/1n6/8/3k4/8/6R1/2R5/7K b - - 0 1");
+  const uint64_t idx = pawnless.index(board);
+  EXPECT_EQ(pawnless.index(mirrored(board, [](int sq) { return sq ^ 7; })),
+            idx);
+  EXPECT_EQ(pawnless.index(mirrored(board, [](int sq) { return sq ^ 56; })),
+            idx);
+  EXPECT_EQ(pawnless.index(mirrored(board,
+                                    [](int sq) {
+                                      return (7 - sq % 8) * 8 + 7 - sq / 8;
+                                    })),
+            idx);
+  const PositionIndexer with_pawns = indexer_of("KPvK");
+  EXPECT_EQ(with_pawns.index(Board("8/8/8/3k4/8/8/6P1/7K w - - 0 1")),
+            with_pawns.index(Board("8/8/8/4k3/8/8/1P6/K7 w - - 0 1")));
+  EXPECT_NE(with_pawns.index(Board("8/8/8/3k4/8/8/6P1/7K w - - 0 1")),
+            with_pawns.index(Board("7K/6P1/8/8/3k4/8/8/8 w - - 0 1")));
+}
+
+TEST(PositionIndexer, SwapsColors) {
+  const PositionIndexer indexer = indexer_of("KRvK");
+  EXPECT_EQ(indexer.index(Board("8/8/8/4k3/8/8/8/R3K3 w - - 0 1")),
+            indexer.index(Board("r3k3/8/8/8/4K3/8/8/8 b - - 0 1")));
+  const absl::optional<Board> board =
+      indexer.unindex(indexer.index(Board("r3k3/8/8/8/4K3/8/8/8 b - - 0 1")));
+  ASSERT_TRUE(board);
+  EXPECT_TRUE(board->pieces(Color::white, Piece::rook));
+  EXPECT_TRUE(board->is_whites_move_);
+}
@@ -0,0 +1,76 @@
+#include "position_labeler.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+
+#include "board.h"
+#include "nnue.h"
+#include "packed_position.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+namespace {
+// Packed positions are unpacked this many at a time, into a buffer on the
+// stack.
+constexpr size_t unpack_block_size = 32;
+}  // namespace.
+
+// The quiescence search doesn't use the table, which a searcher can't do
+// without, so it is as small as a table gets.
+struct PositionLabeler::Worker {
+  explicit Worker(const NnueNetwork* network) : table_(1), searcher_(&table_) {
+    searcher_.set_network(network);
+  }
+
+  TranspositionTable table_;
+  Searcher searcher_;
+};
+
+PositionLabeler::PositionLabeler(ThreadPool* pool, const NnueNetwork* network)
+    : pool_(pool) {
+  const size_t num_workers = (pool ? pool->num_threads() : 0) + 1;
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers_.push_back(std::make_unique<Worker>(network));
+  }
+}
+
+PositionLabeler::~PositionLabeler() = default;
+
+void PositionLabeler::label_block(const PackedPosition* positions,
+                                  size_t num_positions, PositionLabel label,
+                                  Worker* worker, int* scores) {
+  std::array<Board, unpack_block_size> boards;
+  for (size_t start = 0; start < num_positions; start += unpack_block_size) {
+    const size_t size = std::min(unpack_block_size, num_positions - start);
+    unpack_positions(positions + start, size, boards.data());
+    for (size_t i = 0; i < size; ++i) {
+      scores[start + i] =
+          label == PositionLabel::static_eval
+              ? worker->searcher_.evaluate_position(boards[i])
+              : worker->searcher_.quiescence_score(boards[i]);
+    }
+  }
+}
+
+void PositionLabeler::label(const PackedPosition* positions,
+                            size_t num_positions, PositionLabel label,
+                            int* scores) {
+  if (!pool_ || num_positions <= position_labeler_block_size) {
+    label_block(positions, num_positions, label, workers_.back().get(),
+                scores);
+    return;
+  }
+  for (size_t start = 0; start < num_positions;
+       start += position_labeler_block_size) {
+    const size_t size =
+        std::min(position_labeler_block_size, num_positions - start);
+    pool_->submit([this, positions, label, scores, start, size] {
+      label_block(positions + start, size, label,
+                  workers_[*pool_->worker_index()].get(), scores + start);
+    });
+  }
+  pool_->wait();
+}
@@ -0,0 +1,76 @@
+#ifndef POSITION_LABELER_H
+#define POSITION_LABELER_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "nnue.h"
+#include "packed_position.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// What a position is labeled with, from the side to move's point of view.
+enum class PositionLabel {
+  // The static evaluation.
+  static_eval,
+  // The score of a quiescence search with a full window, which plays out the
+  // captures and evasions, so that a position in the middle of an exchange
+  // isn't labeled with the material of one side of it.
+  quiescence,
+};
+
+// The number of positions in each task.
+constexpr size_t position_labeler_block_size = 1024;
+
+// Labels training positions in bulk with scores that need no search beyond
+// the quiescence search, for pipelines that score billions of positions.
+//
+// Everything a position would otherwise set up is made once, with the
+// labeler: a Searcher for each worker of the pool and one for the calling
+// thread, each with its own small table, its cached evaluations and pawn
+// structures and, with a network, its accumulator stack and refresh cache.
+// A call splits the positions into blocks that the workers take, and each
+// worker unpacks its block a few positions at a time onto the stack and
+// labels them one after the other with the searcher of its own, so that a
+// position costs its evaluation or quiescence search and nothing else: no
+// thread is started, no table cleared and nothing allocated. What a searcher
+// caches carries over from one position and one call to the next, which
+// pays off on the many positions of training data that come from the same
+// games.
+//
+// A position's label doesn't depend on the positions labeled before it, nor
+// on which worker labels it.
+class PositionLabeler {
+ public:
+  // `pool` may be null, for labeling on the calling thread alone. Neither it
+  // nor `network` is owned. The positions are evaluated by `network`, or
+  // by the classical evaluation if it is null. The pool must not change its
+  // number of threads.
+  PositionLabeler(ThreadPool* pool, const NnueNetwork* network);
+  PositionLabeler(const PositionLabeler&) = delete;
+  PositionLabeler& operator=(const PositionLabeler&) = delete;
+  ~PositionLabeler();
+
+  // Sets `scores[i]` to the `label` of `positions[i]` for each of the
+  // `num_positions` positions, and returns once they are all done. Must not
+  // be called from a task of the pool, nor from two threads at once.
+  void label(const PackedPosition* positions, size_t num_positions,
+             PositionLabel label, int* scores);
+
+ private:
+  struct Worker;
+
+  // Labels the positions of one block with `worker`.
+  static void label_block(const PackedPosition* positions,
+                          size_t num_positions, PositionLabel label,
+                          Worker* worker, int* scores);
+
+  ThreadPool* const pool_;
+  // One for each worker of the pool, by its index, then one for the calling
+  // thread.
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "position_labeler.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "board.h"
+#include "eval.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "pawns.h"
+#include "perft.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+namespace {
+// The positions of games of moves picked all over the move lists, from the
+// positions of the perft suite, with many captures to play out.
+std::vector<PackedPosition> test_positions(size_t num_positions) {
+  std::vector<PackedPosition> res;
+  for (size_t i = 0; res.size() < num_positions; ++i) {
+    Board board(perft_suite[i % perft_suite.size()].fen_);
+    for (size_t ply = 0; ply < 40 && res.size() < num_positions; ++ply) {
+      res.push_back(pack_position(board, 0, 0));
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[(i * 7 + ply * 13) % moves.size()]);
+    }
+  }
+  return res;
+}
+
+// The label of `position` by a searcher made for it alone.
+int fresh_label(const PackedPosition& position, PositionLabel label) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const Board board = unpack_position(position);
+  return label == PositionLabel::static_eval
+             ? searcher.evaluate_position(board)
+             : searcher.quiescence_score(board);
+}
+}  // namespace.
+
+TEST(PositionLabeler, LabelsAsAFreshSearcherWould) {
+  const std::vector<PackedPosition> positions = test_positions(3000);
+  ThreadPool pool(3);
+  for (PositionLabel label :
+       {PositionLabel::static_eval, PositionLabel::quiescence}) {
+    SCOPED_TRACE(static_cast<int>(label));
+    std::vector<int> expected(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      expected[i] = fresh_label(positions[i], label);
+    }
+    for (ThreadPool* labeler_pool : {static_cast<ThreadPool*>(nullptr),
+                                     &pool}) {
+      PositionLabeler labeler(labeler_pool, nullptr);
+      // Twice, the second time with what the first cached.
+      for (int pass = 0; pass < 2; ++pass) {
+        SCOPED_TRACE(pass);
+        std::vector<int> scores(positions.size(), -1);
+        labeler.label(positions.data(), positions.size(), label,
+                      scores.data());
+        EXPECT_EQ(scores, expected);
+      }
+    }
+  }
+}
+
+TEST(PositionLabeler, PlaysOutCapturesAndMates) {
+  const std::vector<PackedPosition> positions = {
+      // White's queen is attacked by the pawn, and goes.
+      pack_position(Board("4k3/8/8/3p4/4Q3/8/8/4K3 b - - 0 1"), 0, 0),
+      // Mated.
+      pack_position(
+          Board("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - "
+                "1 3"),
+          0, 0),
+  };
+  PositionLabeler labeler(nullptr, nullptr);
+  int static_evals[2];
+  int scores[2];
+  labeler.label(positions.data(), 2, PositionLabel::static_eval,
+                static_evals);
+  labeler.label(positions.data(), 2, PositionLabel::quiescence, scores);
+  PawnTable pawn_table;
+  EXPECT_EQ(static_evals[0],
+            evaluate(unpack_position(positions[0]), &pawn_table));
+  EXPECT_LT(static_evals[0], -500);
+  EXPECT_GT(scores[0], static_evals[0] + 500);
+  EXPECT_EQ(scores[1], -mate_score);
+}
@@ -0,0 +1,262 @@
+#include "positions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "bounded_queue.h"
+#include "bulk_io.h"
+
+namespace {
+// Returns `path` quoted for the shell.
+std::string shell_quote(const std::string& path) {
+  std::string res = "'";
+  for (char c : path) {
+    if (c == '\'') {
+      res += "'\\''";
+    } else {
+      res += c;
+    }
+  }
+  return res + "'";
+}
+
+// Waits by spinning at first, then by sleeping, so that a wait for a long
+// piece of work doesn't take a core from the workers.
+class Backoff {
+ public:
+  void pause() {
+    if (num_pauses_ < 64) {
+      ++num_pauses_;
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+  void reset() { num_pauses_ = 0; }
+
+ private:
+  int num_pauses_ = 0;
+};
+
+struct Chunk {
+  std::string input_;
+  std::string output_;
+  std::atomic<bool> is_done_;
+};
+
+// Returns the end of the whitespace separated field of `line` that starts at
+// or after `pos`, and sets `*begin` to its start.
+size_t next_field(absl::string_view line, size_t pos, size_t* begin) {
+  while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) {
+    ++pos;
+  }
+  *begin = pos;
+  while (pos < line.size() && line[pos] != ' ' && line[pos] != '\t') {
+    ++pos;
+  }
+  return pos;
+}
+}  // namespace.
+
+ChunkReader::ChunkReader(const std::string& path)
+    : file_(nullptr), is_pipe_(false) {
+  if (path == "-") {
+    file_ = stdin;
+  } else if (absl::EndsWith(path, ".gz") || absl::EndsWith(path, ".zst")) {
+    // Opening the pipe succeeds even if the file doesn't exist, so check.
+    if (std::FILE* file = std::fopen(path.c_str(), "rb")) {
+      std::fclose(file);
+      const std::string command =
+          (absl::EndsWith(path, ".gz") ? "gzip -dc " : "zstd -dcq ") +
+          shell_quote(path);
+      file_ = popen(command.c_str(), "r");
+      is_pipe_ = true;
+    }
+  } else {
+    bulk_.reset(new BulkFileReader(path));
+    if (!bulk_->is_open()) {
+      bulk_.reset();
+    }
+  }
+}
+
+ChunkReader::~ChunkReader() { close(); }
+
+bool ChunkReader::close() {
+  bool is_ok = !bulk_ || !bulk_->failed();
+  bulk_.reset();
+  if (file_) {
+    is_ok = is_ok && !std::ferror(file_);
+    if (is_pipe_) {
+      // The exit status of the decompressor.
+      is_ok = pclose(file_) == 0 && is_ok;
+    } else if (file_ != stdin) {
+      is_ok = std::fclose(file_) == 0 && is_ok;
+    }
+    file_ = nullptr;
+  }
+  return is_ok;
+}
+
+bool ChunkReader::read(size_t size, std::string* chunk) {
+  chunk->assign(partial_line_);
+  partial_line_.clear();
+  if (!is_open()) {
+    return false;
+  }
+  size = std::max<size_t>(size, 1);
+  while (true) {
+    const size_t old_size = chunk->size();
+    chunk->resize(old_size + size);
+    const size_t num_read = read_bytes(&(*chunk)[old_size], size);
+    chunk->resize(old_size + num_read);
+    if (num_read < size) {
+      // The end of the file, or an error, which ends it too and which
+      // `close` reports.
+      return !chunk->empty();
+    }
+    const size_t last_newline = chunk->rfind('\n');
+    if (last_newline != std::string::npos && last_newline >= old_size) {
+      partial_line_.assign(*chunk, last_newline + 1, std::string::npos);
+      chunk->resize(last_newline + 1);
+      return true;
+    }
+    // A line longer than `size`: read on to its end.
+  }
+}
+
+size_t ChunkReader::read_bytes(char* data, size_t size) {
+  if (file_) {
+    return std::fread(data, 1, size, file_);
+  }
+  size_t num_read = 0;
+  while (num_read < size) {
+    if (block_.empty() && !bulk_->next(&block_)) {
+      break;
+    }
+    const size_t n = std::min(size - num_read, block_.size());
+    std::memcpy(data + num_read, block_.data(), n);
+    block_.remove_prefix(n);
+    num_read += n;
+  }
+  return num_read;
+}
+
+absl::optional<Board> parse_epd(absl::string_view line,
+                                absl::string_view* operations,
+                                const char** error) {
+  size_t begin = 0;
+  size_t end = 0;
+  for (int i = 0; i < 4; ++i) {
+    end = next_field(line, end, &begin);
+  }
+  // Up to two integers after the position are its clocks.
+  for (int i = 0; i < 2; ++i) {
+    const size_t field_end = next_field(line, end, &begin);
+    int clock = 0;
+    if (begin == field_end ||
+        !absl::SimpleAtoi(line.substr(begin, field_end - begin), &clock)) {
+      break;
+    }
+    end = field_end;
+  }
+  if (operations) {
+    next_field(line, end, &begin);
+    *operations = line.substr(begin);
+  }
+  return parse_fen(line.substr(0, end), error);
+}
+
+uint64_t process_lines(ChunkReader* reader, size_t num_threads,
+                       size_t chunk_size, const LineWork& work,
+                       const std::function<void(absl::string_view)>& write) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Enough chunks in flight that the workers needn't wait for the writer
+  // while it waits for the slowest chunk.
+  const size_t num_chunks = 4 * num_threads;
+  std::unique_ptr<Chunk[]> chunks(new Chunk[num_chunks]);
+  BoundedQueue<Chunk*> queue(num_chunks);
+  std::atomic<bool> is_read(false);
+  std::atomic<uint64_t> num_lines(0);
+
+  std::vector<std::thread> workers;
+  for (size_t worker_idx = 0; worker_idx < num_threads; ++worker_idx) {
+    workers.emplace_back([&, worker_idx] {
+      Backoff backoff;
+      while (true) {
+        Chunk* chunk = nullptr;
+        if (!queue.try_pop(&chunk)) {
+          // Everything was pushed before `is_read` was set, so a pop after
+          // seeing it set finds whatever is left.
+          if (!is_read.load(std::memory_order_acquire)) {
+            backoff.pause();
+            continue;
+          }
+          if (!queue.try_pop(&chunk)) {
+            return;
+          }
+        }
+        backoff.reset();
+        uint64_t chunk_lines = 0;
+        for_each_line(chunk->input_, [&](absl::string_view line) {
+          work(worker_idx, line, &chunk->output_);
+          ++chunk_lines;
+        });
+        num_lines.fetch_add(chunk_lines, std::memory_order_relaxed);
+        chunk->is_done_.store(true, std::memory_order_release);
+      }
+    });
+  }
+
+  // Chunk `seq` goes in slot `seq % num_chunks`, once the output of the chunk
+  // before it in that slot has been written, so the output is in order and
+  // the queue can't overflow.
+  const auto write_chunk = [&write](const Chunk& chunk) {
+    Backoff backoff;
+    while (!chunk.is_done_.load(std::memory_order_acquire)) {
+      backoff.pause();
+    }
+    write(chunk.output_);
+  };
+  size_t seq = 0;
+  for (;; ++seq) {
+    Chunk& chunk = chunks[seq % num_chunks];
+    if (seq >= num_chunks) {
+      write_chunk(chunk);
+    }
+    if (!reader->read(chunk_size, &chunk.input_)) {
+      break;
+    }
+    chunk.output_.clear();
+    chunk.is_done_.store(false, std::memory_order_relaxed);
+    Chunk* chunk_ptr = &chunk;
+    while (!queue.try_push(std::move(chunk_ptr))) {
+      std::this_thread::yield();
+    }
+  }
+  is_read.store(true, std::memory_order_release);
+  for (size_t rest = seq >= num_chunks ? seq - num_chunks + 1 : 0; rest < seq;
+       ++rest) {
+    write_chunk(chunks[rest % num_chunks]);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  return num_lines.load();
+}
@@ -0,0 +1,103 @@
+#ifndef POSITIONS_H
+#define POSITIONS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "bulk_io.h"
+
+// Positions in bulk: EPD and FEN files with a position per line, millions of
+// lines long, read in big chunks of whole lines and worked on in parallel. The
+// lines are views into the chunks and are never copied one by one. A chunk is
+// the unit of work, handed to the workers through a lock-free queue, and what
+// the workers make of the chunks is written out in the order of the file.
+
+// Reads a file in chunks that end at line ends. Files ending in .gz or .zst
+// are decompressed by reading them through gzip or zstd, and "-" is the
+// standard input. Other files are read ahead a few blocks at a time (see
+// bulk_io.h).
+class ChunkReader {
+ public:
+  explicit ChunkReader(const std::string& path);
+  ChunkReader(const ChunkReader&) = delete;
+  ChunkReader& operator=(const ChunkReader&) = delete;
+  ~ChunkReader();
+
+  bool is_open() const { return file_ != nullptr || bulk_ != nullptr; }
+  // Replaces `*chunk` with the next whole lines of the file, about `size`
+  // bytes of them, or more if a single line is longer. Returns false if the
+  // file has nothing left. The last line needn't end with a newline. Reusing
+  // `chunk` keeps its capacity, so reading doesn't allocate once it has grown.
+  bool read(size_t size, std::string* chunk);
+  // Closes the file and returns true if it was read without an error. `read`
+  // can't tell a failed read, or a decompressor that stopped on a corrupt or
+  // truncated archive, from the end of a shorter file, so a caller that read
+  // to the end checks here that it has the whole of it. The destructor
+  // closes a file that is still open without reporting.
+  bool close();
+
+ private:
+  // Reads up to `size` bytes to `data`, fewer only at the end of the file, and
+  // returns how many.
+  size_t read_bytes(char* data, size_t size);
+
+  std::FILE* file_;
+  bool is_pipe_;
+  std::unique_ptr<BulkFileReader> bulk_;
+  // What is left of the last block `bulk_` returned.
+  absl::string_view block_;
+  // The start of the line that the last chunk read stopped in.
+  std::string partial_line_;
+};
+
+// Calls `fn` with each line of `chunk`, without its "\n" or "\r\n". Blank
+// lines are skipped.
+template <typename Fn>
+void for_each_line(absl::string_view chunk, Fn fn) {
+  while (!chunk.empty()) {
+    size_t end = chunk.find('\n');
+    if (end == absl::string_view::npos) {
+      end = chunk.size();
+    }
+    absl::string_view line = chunk.substr(0, end);
+    chunk.remove_prefix(end == chunk.size() ? end : end + 1);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (!line.empty()) {
+      fn(line);
+    }
+  }
+}
+
+// Returns the position of an EPD or FEN line: the four fields of a FEN's
+// position, the clocks if they follow, then any EPD operations, such as
+// "bm e4; id \"1\";", which go to `*operations` unless it is null. Fails like
+// `parse_fen`.
+absl::optional<Board> parse_epd(absl::string_view line,
+                                absl::string_view* operations = nullptr,
+                                const char** error = nullptr);
+
+// Work on one line, on the worker numbered `worker_idx`: it appends what it
+// makes of `line` to `out`. Work runs on many threads at once, and can keep
+// state per worker, such as a searcher, by its index.
+using LineWork = std::function<void(size_t worker_idx, absl::string_view line,
+                                    std::string* out)>;
+
+// Runs `work` on every line of `reader` with `num_threads` workers, 0 for one
+// per hardware thread, in chunks of about `chunk_size` bytes. The calling
+// thread reads the chunks and passes the output of each to `write`, in the
+// order of the file. At most a few chunks per worker are in memory at once.
+// Returns the number of lines.
+uint64_t process_lines(ChunkReader* reader, size_t num_threads,
+                       size_t chunk_size, const LineWork& work,
+                       const std::function<void(absl::string_view)>& write);
+
+#endif
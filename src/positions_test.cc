@@ -0,0 +1,160 @@
+#include "positions.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+std::string write_file(const std::string& name, const std::string& contents) {
+  const std::string path = testing::TempDir() + name;
+  std::ofstream(path, std::ios::binary) << contents;
+  return path;
+}
+
+std::vector<std::string> lines_of(absl::string_view chunk) {
+  std::vector<std::string> res;
+  for_each_line(chunk, [&res](absl::string_view line) {
+    res.emplace_back(line);
+  });
+  return res;
+}
+}  // namespace.
+
+TEST(ChunkReader, ReadsWholeLines) {
+  ChunkReader reader(write_file("positions_test_lines", "ab\ncdef\ng\n\nhij"));
+  ASSERT_TRUE(reader.is_open());
+  std::string chunk;
+  ASSERT_TRUE(reader.read(4, &chunk));
+  EXPECT_EQ(chunk, "ab\n");
+  // A line longer than the chunk size comes whole.
+  ASSERT_TRUE(reader.read(2, &chunk));
+  EXPECT_EQ(chunk, "cdef\n");
+  ASSERT_TRUE(reader.read(4, &chunk));
+  EXPECT_EQ(chunk, "g\n\n");
+  ASSERT_TRUE(reader.read(4, &chunk));
+  EXPECT_EQ(chunk, "hij");
+  EXPECT_FALSE(reader.read(4, &chunk));
+  EXPECT_TRUE(reader.close());
+  EXPECT_FALSE(reader.is_open());
+}
+
+TEST(ChunkReader, FailsOnMissingFiles) {
+  EXPECT_FALSE(ChunkReader("/no/such/file").is_open());
+  EXPECT_FALSE(ChunkReader("/no/such/file.gz").is_open());
+}
+
+TEST(ChunkReader, Decompresses) {
+  const std::string path = write_file("positions_test_gzip", "a\nb\n");
+  if (std::system(("gzip -f " + path).c_str()) != 0) {
+    GTEST_SKIP() << "No gzip.";
+  }
+  ChunkReader reader(path + ".gz");
+  std::string chunk;
+  ASSERT_TRUE(reader.read(1 << 16, &chunk));
+  EXPECT_EQ(chunk, "a\nb\n");
+  EXPECT_FALSE(reader.read(1 << 16, &chunk));
+  EXPECT_TRUE(reader.close());
+}
+
+TEST(ChunkReader, ReportsTruncatedArchives) {
+  std::string contents;
+  for (int i = 0; i < 10000; ++i) {
+    absl::StrAppend(&contents, i, "\n");
+  }
+  const std::string path = write_file("positions_test_truncated", contents);
+  if (std::system(("gzip -f " + path).c_str()) != 0) {
+    GTEST_SKIP() << "No gzip.";
+  }
+  std::ifstream archive(path + ".gz", std::ios::binary);
+  const std::string compressed((std::istreambuf_iterator<char>(archive)),
+                               std::istreambuf_iterator<char>());
+  write_file("positions_test_truncated.gz",
+             compressed.substr(0, compressed.size() / 2));
+  // What comes out before the cut looks like a shorter file, and only
+  // closing tells it apart.
+  ChunkReader reader(path + ".gz");
+  std::string chunk;
+  size_t size = 0;
+  while (reader.read(1 << 16, &chunk)) {
+    size += chunk.size();
+  }
+  EXPECT_LT(size, contents.size());
+  EXPECT_FALSE(reader.close());
+}
+
+TEST(ForEachLine, SplitsLines) {
+  EXPECT_EQ(lines_of("a\r\nbc\n\n d\n"),
+            (std::vector<std::string>{"a", "bc", " d"}));
+  EXPECT_EQ(lines_of("a"), std::vector<std::string>{"a"});
+  EXPECT_TRUE(lines_of("").empty());
+}
+
+TEST(ParseEpd, ReadsOperations) {
+  absl::string_view operations;
+  const absl::optional<Board> board = parse_epd(
+      "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 bm e5; id "
+      "\"1\";",
+      &operations);
+  ASSERT_TRUE(board);
+  EXPECT_EQ(board->en_passant_square_, str_to_square("e3"));
+  EXPECT_EQ(operations, "bm e5; id \"1\";");
+}
+
+TEST(ParseEpd, ReadsClocks) {
+  absl::string_view operations;
+  const absl::optional<Board> board =
+      parse_epd("4k3/8/8/8/8/8/8/4K3 w - - 7 30 ;D1 5", &operations);
+  ASSERT_TRUE(board);
+  EXPECT_EQ(board->fifty_move_clock_, 7);
+  EXPECT_EQ(board->num_moves_, 30);
+  EXPECT_EQ(operations, ";D1 5");
+  EXPECT_TRUE(parse_epd("4k3/8/8/8/8/8/8/4K3 w - -"));
+  EXPECT_FALSE(parse_epd("4k3/8/8/8/8/8/8/4K3 w"));
+}
+
+TEST(ProcessLines, KeepsTheOrderOfTheFile) {
+  std::string contents;
+  for (int i = 0; i < 5000; ++i) {
+    absl::StrAppend(&contents, i, "\n");
+  }
+  ChunkReader reader(write_file("positions_test_numbers", contents));
+  std::string output;
+  const uint64_t num_lines = process_lines(
+      &reader, 4, 64,
+      [](size_t, absl::string_view line, std::string* out) {
+        absl::StrAppend(out, line, "\n");
+      },
+      [&output](absl::string_view chunk_output) {
+        absl::StrAppend(&output, chunk_output);
+      });
+  EXPECT_EQ(num_lines, 5000);
+  EXPECT_EQ(output, contents);
+}
+
+TEST(ProcessLines, WorksOnPositions) {
+  ChunkReader reader(write_file(
+      "positions_test_epd",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - ;D1 20\n"
+      "4k3/8/8/8/8/8/8/4K3 w - - 0 1\n"
+      "not a position\n"));
+  std::string output;
+  process_lines(
+      &reader, 2, 1 << 16,
+      [](size_t, absl::string_view line, std::string* out) {
+        const absl::optional<Board> board = parse_epd(line);
+        absl::StrAppend(out, board ? board->legal_moves().size() : 0, " ");
+      },
+      [&output](absl::string_view chunk_output) {
+        absl::StrAppend(&output, chunk_output);
+      });
+  EXPECT_EQ(output, "20 5 0 ");
+}
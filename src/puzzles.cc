@@ -0,0 +1,192 @@
+#include "puzzles.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace {
+// Returns true if `move` takes back on the square where `last_move`
+// captured, which finishes an exchange rather than solving a puzzle.
+bool is_recapture(Move move, Move last_move) {
+  return last_move.move_type_ == MoveType::capture &&
+         move.move_type_ == MoveType::capture &&
+         move.dst_idx_ == last_move.dst_idx_;
+}
+}  // namespace.
+
+void PuzzleStats::add(const PuzzleStats& other) {
+  positions_ += other.positions_;
+  candidates_ += other.candidates_;
+  puzzles_ += other.puzzles_;
+  filter_nodes_ += other.filter_nodes_;
+  confirm_nodes_ += other.confirm_nodes_;
+}
+
+PuzzleExtractor::PuzzleExtractor(const PuzzleOptions& options,
+                                 const NnueNetwork* network)
+    : options_(options),
+      table_(options.hash_mb_),
+      searcher_(&table_),
+      mate_solver_(options.mate_solver_nodes_) {
+  searcher_.set_network(network);
+  searcher_.set_multi_pv(2);
+}
+
+const char* PuzzleExtractor::extract(const PgnGame& game, size_t game_idx,
+                                     std::vector<Puzzle>* puzzles) {
+  boards_.clear();
+  moves_.clear();
+  const char* const error =
+      replay_game(game, [this](const Board& board, Move move) {
+        boards_.push_back(board);
+        moves_.push_back(move);
+      });
+  if (moves_.empty()) {
+    return error;
+  }
+  // The position after the last move read may be a puzzle too.
+  boards_.push_back(boards_.back());
+  boards_.back().do_move(moves_.back());
+
+  table_.new_search();
+  history_.reset(boards_[0]);
+  history_.reserve(boards_.size());
+  const SearchLimits filter_limits = {options_.filter_depth_, 0, nullptr,
+                                      nullptr};
+  int last_score = 0;
+  // No position is a candidate before this ply, so that the positions of
+  // the solution of a puzzle aren't puzzles again.
+  size_t next_candidate_ply = 0;
+  for (size_t ply = 0; ply < boards_.size(); ++ply) {
+    const Board& board = boards_[ply];
+    if (ply > 0) {
+      history_.push(board);
+    }
+    ++stats_.positions_;
+    searcher_.set_game_history(history_);
+    const SearchResult filtered =
+        searcher_.search_iterations(board, 1, filter_limits, nullptr);
+    stats_.filter_nodes_ += filtered.nodes_;
+    // The score of the side to move before the last move.
+    const int score_before = -last_score;
+    last_score = filtered.score_;
+    if (ply == 0 || ply < next_candidate_ply || !filtered.best_move_ ||
+        filtered.lines_.size() < 2 ||
+        filtered.score_ < options_.min_advantage_ ||
+        filtered.lines_[1].score_ >= options_.min_winning_score_ ||
+        score_before >= options_.min_advantage_ ||
+        is_recapture(*filtered.best_move_, moves_[ply - 1]) ||
+        (filtered.score_ - score_before < options_.min_swing_ &&
+         !has_winning_capture(board, moves_[ply - 1]))) {
+      continue;
+    }
+    ++stats_.candidates_;
+    Puzzle puzzle;
+    if (confirm(board, &puzzle)) {
+      ++stats_.puzzles_;
+      puzzle.game_idx_ = game_idx;
+      puzzle.ply_ = ply;
+      next_candidate_ply = ply + puzzle.solution_.size();
+      puzzles->push_back(std::move(puzzle));
+    }
+  }
+  return error;
+}
+
+bool PuzzleExtractor::has_winning_capture(const Board& board,
+                                          Move last_move) const {
+  for (Move move : board.legal_moves()) {
+    if (move.move_type_ == MoveType::capture &&
+        move.dst_idx_ != last_move.dst_idx_ &&
+        board.see_ge(move, options_.min_see_gain_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PuzzleExtractor::confirm(const Board& board, Puzzle* puzzle) {
+  // A mate by checks settles it without a deep search, unless there are two.
+  const MateSolver::Result mate = mate_solver_.find_mating_moves(
+      board, options_.mate_moves_, &mating_moves_);
+  stats_.confirm_nodes_ += mate_solver_.nodes();
+  if (mate == MateSolver::Result::mate && mating_moves_.size() > 1) {
+    return false;
+  }
+  const bool is_mate =
+      mate == MateSolver::Result::mate && mating_moves_.size() == 1;
+  // The search of the two best moves gives the solution of a mate too.
+  searcher_.set_game_history(history_);
+  const SearchResult res = searcher_.search_iterations(
+      board, 1, {options_.confirm_depth_, 0, nullptr, nullptr}, nullptr);
+  stats_.confirm_nodes_ += res.nodes_;
+  if (!res.best_move_) {
+    return false;
+  }
+  if (is_mate) {
+    // A quiet move that mates as well would make the solution ambiguous.
+    if (!(*res.best_move_ == mating_moves_[0]) || !is_mate_score(res.score_)) {
+      return false;
+    }
+  } else if (res.lines_.size() < 2 ||
+             res.score_ < options_.min_winning_score_ ||
+             res.lines_[1].score_ >= options_.min_winning_score_ ||
+             res.score_ - res.lines_[1].score_ < options_.min_margin_) {
+    return false;
+  }
+  puzzle->board_ = board;
+  puzzle->score_ = res.score_;
+  // The solution ends with a move of the side to move.
+  size_t num_plies = std::min(res.pv_.size(), options_.max_solution_plies_);
+  if (num_plies % 2 == 0) {
+    --num_plies;
+  }
+  puzzle->solution_.assign(res.pv_.begin(), res.pv_.begin() + num_plies);
+  return true;
+}
+
+std::vector<Puzzle> extract_puzzles(const std::vector<PgnGame>& games,
+                                    const PuzzleOptions& options,
+                                    const NnueNetwork* network,
+                                    ThreadPool* pool, PuzzleStats* stats) {
+  std::vector<Puzzle> res;
+  if (!pool) {
+    PuzzleExtractor extractor(options, network);
+    for (size_t i = 0; i < games.size(); ++i) {
+      extractor.extract(games[i], i, &res);
+    }
+    if (stats) {
+      stats->add(extractor.stats());
+    }
+    return res;
+  }
+  // Made by each worker as it takes its first game, and only used by it.
+  std::vector<std::unique_ptr<PuzzleExtractor>> extractors(
+      pool->num_threads());
+  std::vector<std::vector<Puzzle>> game_puzzles(games.size());
+  for (size_t i = 0; i < games.size(); ++i) {
+    pool->submit([&, i] {
+      std::unique_ptr<PuzzleExtractor>& extractor =
+          extractors[*pool->worker_index()];
+      if (!extractor) {
+        extractor = std::make_unique<PuzzleExtractor>(options, network);
+      }
+      extractor->extract(games[i], i, &game_puzzles[i]);
+    });
+  }
+  pool->wait();
+  for (std::vector<Puzzle>& puzzles : game_puzzles) {
+    for (Puzzle& puzzle : puzzles) {
+      res.push_back(std::move(puzzle));
+    }
+  }
+  if (stats) {
+    for (const std::unique_ptr<PuzzleExtractor>& extractor : extractors) {
+      if (extractor) {
+        stats->add(extractor->stats());
+      }
+    }
+  }
+  return res;
+}
@@ -0,0 +1,125 @@
+#ifndef PUZZLES_H
+#define PUZZLES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+#include "mate_solver.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "repetition.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+// What makes a position of a game a puzzle, and how hard the extraction
+// looks for one.
+struct PuzzleOptions {
+  // The filter: the two best moves of every position are searched to
+  // `filter_depth_`. A position is a candidate if the last move took the
+  // side to move from under `min_advantage_` centipawns to `min_advantage_`
+  // or more, by `min_swing_` or more or by leaving it a capture that wins
+  // `min_see_gain_` or more (see `Board::see`), and if no move but the best
+  // wins by `min_winning_score_` and the best doesn't just take back on the
+  // square of the last move's capture.
+  int filter_depth_ = 2;
+  int min_advantage_ = 200;
+  int min_swing_ = 200;
+  int min_see_gain_ = 300;
+  // The confirmation of a candidate: a mate by checks in up to `mate_moves_`
+  // moves, searched for with the mate solver up to `mate_solver_nodes_`
+  // nodes, must be the only one. Otherwise the two best moves are searched
+  // to `confirm_depth_`, and the best must win by `min_winning_score_` or
+  // more, where the second doesn't and is `min_margin_` or more worse.
+  int mate_moves_ = 4;
+  uint64_t mate_solver_nodes_ = 100000;
+  int confirm_depth_ = 10;
+  int min_winning_score_ = 300;
+  int min_margin_ = 200;
+  // The most moves of a solution, both sides' counted.
+  size_t max_solution_plies_ = 7;
+  size_t hash_mb_ = 16;
+};
+
+struct Puzzle {
+  // The index of the game among those the puzzles were extracted from, and
+  // the ply of the position in it.
+  size_t game_idx_;
+  size_t ply_;
+  Board board_;
+  // The moves of the side to move and the replies, ending with a move of the
+  // side to move: the principal variation of the confirmation, or the mate.
+  std::vector<Move> solution_;
+  // For the side to move, from the confirmation.
+  int score_;
+};
+
+// How many positions each stage let through, and what it cost.
+struct PuzzleStats {
+  uint64_t positions_ = 0;
+  // The positions the filter let through, and those confirmed.
+  uint64_t candidates_ = 0;
+  uint64_t puzzles_ = 0;
+  uint64_t filter_nodes_ = 0;
+  uint64_t confirm_nodes_ = 0;
+
+  void add(const PuzzleStats& other);
+};
+
+// Extracts tactical puzzles from games: positions where the side to move has
+// one move that wins, and only one.
+//
+// Deep searches are far too slow to run on every position of millions of
+// games, so the positions go through two stages. A cheap filter, a search of
+// a few plies and a static exchange evaluation of the captures, passes on
+// the positions right after what looks like a mistake, about one in two
+// hundred even in games of weak play. Only those are
+// confirmed, by the mate solver and a deep search of the two best moves for
+// a unique solution. The searches of a game share one generation of the
+// table, so the confirmation finds the filter's entries.
+class PuzzleExtractor {
+ public:
+  // `network` isn't owned; the classical evaluation is used if it is null.
+  PuzzleExtractor(const PuzzleOptions& options, const NnueNetwork* network);
+  PuzzleExtractor(const PuzzleExtractor&) = delete;
+  PuzzleExtractor& operator=(const PuzzleExtractor&) = delete;
+
+  // Appends the puzzles of `game`, the `game_idx`th, to `*puzzles` in the
+  // order of the game. Returns null, or what is wrong with the game, as
+  // `replay_game` says, after extracting the puzzles of the moves before.
+  const char* extract(const PgnGame& game, size_t game_idx,
+                      std::vector<Puzzle>* puzzles);
+  // Added up over the games extracted from so far.
+  const PuzzleStats& stats() const { return stats_; }
+
+ private:
+  // Returns true if the side to move of `board` can win material by a
+  // capture other than on the destination square of `last_move`.
+  bool has_winning_capture(const Board& board, Move last_move) const;
+  // Confirms a candidate and sets `*puzzle` to it, except for its indices.
+  bool confirm(const Board& board, Puzzle* puzzle);
+
+  const PuzzleOptions options_;
+  TranspositionTable table_;
+  Searcher searcher_;
+  MateSolver mate_solver_;
+  PuzzleStats stats_;
+  // Kept from one game to the next so that they don't allocate.
+  std::vector<Board> boards_;
+  std::vector<Move> moves_;
+  std::vector<Move> mating_moves_;
+  KeyHistory history_;
+};
+
+// Extracts the puzzles of `games`, many at once on the workers of `pool`, or
+// one after the other on the calling thread if it is null, each worker with a
+// `PuzzleExtractor` of its own. The puzzles are in the order of the games.
+// Adds the counts of the stages to `*stats` if it isn't null.
+std::vector<Puzzle> extract_puzzles(const std::vector<PgnGame>& games,
+                                    const PuzzleOptions& options,
+                                    const NnueNetwork* network,
+                                    ThreadPool* pool, PuzzleStats* stats);
+
+#endif
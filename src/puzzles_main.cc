@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "mapped_file.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "puzzles.h"
+#include "search.h"
+#include "thread_pool.h"
+
+// Usage: puzzles [--threads <n>] [--depth <n>] [--hash <mb>]
+//                [--eval-file <path>] <pgn>
+//
+// Extracts the tactical puzzles of the games of a PGN file (see puzzles.h)
+// and writes them to stdout, one per line as
+//
+//   <fen>,<solution>,<score>,<game>,<ply>
+//
+// with the solution in UCI moves separated by spaces, the score as UCI
+// gives it, "cp <n>" or "mate <n>", and the game and ply counted from 0.
+// The candidates are confirmed by searches to depth 10 or --depth. The games
+// are read on --threads threads, one per hardware thread by default, each
+// with a table of 16 MB or --hash megabytes, and with the classical
+// evaluation or the network of --eval-file. How many positions each stage
+// let through goes to stderr.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--threads <n>] [--depth <n>] [--hash <mb>]"
+               " [--eval-file <path>] <pgn>\n";
+  return 1;
+}
+
+// Appends `score` as the UCI `score` argument.
+void append_score(int score, std::string* out) {
+  if (!is_mate_score(score)) {
+    absl::StrAppend(out, "cp ", score);
+    return;
+  }
+  const int moves = (mate_score - std::abs(score) + 1) / 2;
+  absl::StrAppend(out, "mate ", score > 0 ? moves : -moves);
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  size_t num_threads = 0;
+  PuzzleOptions options;
+  std::string eval_file;
+  int arg_idx = 1;
+  for (; arg_idx + 1 < argc && std::strncmp(argv[arg_idx], "--", 2) == 0;
+       arg_idx += 2) {
+    const char* const flag = argv[arg_idx];
+    const char* const value = argv[arg_idx + 1];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &num_threads);
+    } else if (std::strcmp(flag, "--depth") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.confirm_depth_) &&
+                 options.confirm_depth_ >= 1 &&
+                 options.confirm_depth_ < max_search_ply;
+    } else if (std::strcmp(flag, "--hash") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.hash_mb_) &&
+                 options.hash_mb_ >= 1;
+    } else if (std::strcmp(flag, "--eval-file") == 0) {
+      eval_file = value;
+      is_valid = true;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (arg_idx + 1 != argc) {
+    return usage(argv[0]);
+  }
+  const MappedFile pgn(argv[arg_idx]);
+  if (!pgn.data()) {
+    std::cerr << "Can't open " << argv[arg_idx] << '\n';
+    return 1;
+  }
+  NetworkPtr network;
+  if (!eval_file.empty()) {
+    std::string error;
+    network = load_network(eval_file, &error);
+    if (!network) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<PgnGame> games;
+  PgnReader reader(absl::string_view(pgn.data(), pgn.size()));
+  PgnGame game;
+  while (reader.next(&game)) {
+    games.push_back(game);
+  }
+  ThreadPool pool(num_threads);
+  PuzzleStats stats;
+  const std::vector<Puzzle> puzzles =
+      extract_puzzles(games, options, network.get(), &pool, &stats);
+
+  std::string out;
+  for (const Puzzle& puzzle : puzzles) {
+    puzzle.board_.append_fen(&out);
+    out.push_back(',');
+    for (size_t i = 0; i < puzzle.solution_.size(); ++i) {
+      if (i > 0) {
+        out.push_back(' ');
+      }
+      puzzle.solution_[i].append_uci(&out);
+    }
+    out.push_back(',');
+    append_score(puzzle.score_, &out);
+    absl::StrAppend(&out, ",", puzzle.game_idx_, ",", puzzle.ply_, "\n");
+  }
+  std::cout << out;
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cerr << "Games: " << games.size() << '\n';
+  std::cerr << "Positions: " << stats.positions_ << '\n';
+  std::cerr << "Candidates: " << stats.candidates_ << '\n';
+  std::cerr << "Puzzles: " << stats.puzzles_ << '\n';
+  std::cerr << "Filter nodes: " << stats.filter_nodes_ << '\n';
+  std::cerr << "Confirmation nodes: " << stats.confirm_nodes_ << '\n';
+  std::cerr << "Time: " << elapsed.count() << " s\n";
+  return 0;
+}
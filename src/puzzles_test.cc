@@ -0,0 +1,100 @@
+#include "puzzles.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "gtest/gtest.h"
+#include "pgn.h"
+#include "search.h"
+#include "thread_pool.h"
+
+namespace {
+constexpr char games_text[] =
+    "[Event \"Scholar's mate\"]\n\n"
+    "1. e4 e5 2. Bc4 Nc6 3. Qh5 Nf6 4. Qxf7# 1-0\n\n"
+    "[Event \"Blackburne Shilling\"]\n\n"
+    "1. e4 e5 2. Nf3 Nc6 3. Bc4 Nd4 4. Nxe5 Qg5 5. Nxf7 Qxg2 6. Rf1 Qxe4+\n"
+    "7. Be2 Nf3# 0-1\n\n"
+    "[Event \"Queen's gambit declined\"]\n\n"
+    "1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7 5. e3 O-O 6. Nf3 h6 7. Bh4 b6\n"
+    "1/2-1/2\n\n";
+
+std::vector<PgnGame> read_games(absl::string_view text) {
+  std::vector<PgnGame> games;
+  PgnReader reader(text);
+  PgnGame game;
+  while (reader.next(&game)) {
+    games.push_back(game);
+  }
+  return games;
+}
+
+PuzzleOptions shallow_options() {
+  PuzzleOptions options;
+  options.confirm_depth_ = 6;
+  options.hash_mb_ = 1;
+  return options;
+}
+
+bool is_puzzle(const Puzzle& puzzle, size_t game_idx, size_t ply,
+               const char* first_move) {
+  return puzzle.game_idx_ == game_idx && puzzle.ply_ == ply &&
+         !puzzle.solution_.empty() &&
+         puzzle.solution_[0].to_uci_str() == first_move &&
+         puzzle.solution_.size() % 2 == 1;
+}
+}  // namespace.
+
+TEST(PuzzleExtractor, FindsMatesAndWinningMoves) {
+  const std::vector<PgnGame> games = read_games(games_text);
+  ASSERT_EQ(games.size(), 3);
+  PuzzleExtractor extractor(shallow_options(), nullptr);
+  std::vector<Puzzle> puzzles;
+  for (size_t i = 0; i < games.size(); ++i) {
+    EXPECT_EQ(extractor.extract(games[i], i, &puzzles), nullptr);
+  }
+  ASSERT_EQ(puzzles.size(), 2);
+  // After 3... Nf6, 4. Qxf7#.
+  EXPECT_TRUE(is_puzzle(puzzles[0], 0, 6, "h5f7"));
+  EXPECT_EQ(puzzles[0].solution_.size(), 1);
+  EXPECT_EQ(puzzles[0].score_, mate_score - 1);
+  EXPECT_EQ(puzzles[0].board_.to_fen(),
+            "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - "
+            "4 4");
+  // After 5. Nxf7, 5... Qxg2 wins the rook.
+  EXPECT_TRUE(is_puzzle(puzzles[1], 1, 9, "g5g2"));
+  EXPECT_GE(puzzles[1].score_, 300);
+
+  const PuzzleStats& stats = extractor.stats();
+  EXPECT_EQ(stats.positions_, 8 + 15 + 15);
+  EXPECT_EQ(stats.puzzles_, 2);
+  EXPECT_GE(stats.candidates_, stats.puzzles_);
+  EXPECT_LT(stats.candidates_, 6);
+  EXPECT_GT(stats.filter_nodes_, 0);
+  EXPECT_GT(stats.confirm_nodes_, 0);
+}
+
+TEST(PuzzleExtractor, KeepsThePuzzlesBeforeAnUnreadableMove) {
+  const std::vector<PgnGame> games = read_games(
+      "[Event \"Illegal\"]\n\n1. e4 e5 2. Bc4 Nc6 3. Qh5 Nf6 4. Ke3 1-0\n\n");
+  ASSERT_EQ(games.size(), 1);
+  PuzzleExtractor extractor(shallow_options(), nullptr);
+  std::vector<Puzzle> puzzles;
+  EXPECT_NE(extractor.extract(games[0], 0, &puzzles), nullptr);
+  ASSERT_EQ(puzzles.size(), 1);
+  EXPECT_TRUE(is_puzzle(puzzles[0], 0, 6, "h5f7"));
+}
+
+TEST(ExtractPuzzles, ExtractsInParallelInTheOrderOfTheGames) {
+  const std::vector<PgnGame> games = read_games(games_text);
+  ThreadPool pool(2);
+  PuzzleStats stats;
+  const std::vector<Puzzle> puzzles =
+      extract_puzzles(games, shallow_options(), nullptr, &pool, &stats);
+  ASSERT_EQ(puzzles.size(), 2);
+  EXPECT_TRUE(is_puzzle(puzzles[0], 0, 6, "h5f7"));
+  EXPECT_TRUE(is_puzzle(puzzles[1], 1, 9, "g5g2"));
+  EXPECT_EQ(stats.positions_, 8 + 15 + 15);
+  EXPECT_EQ(stats.puzzles_, 2);
+}
@@ -0,0 +1,94 @@
+#include "random_positions.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include "absl/base/internal/raw_logging.h"
+#include "bitboard.h"
+#include "board.h"
+
+namespace {
+constexpr const char* start_fen =
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// The pieces of a side in the starting position, but the king.
+constexpr std::array<Piece, 15> start_pieces = {
+    {Piece::queen, Piece::rook, Piece::rook, Piece::bishop, Piece::bishop,
+     Piece::knight, Piece::knight, Piece::pawn, Piece::pawn, Piece::pawn,
+     Piece::pawn, Piece::pawn, Piece::pawn, Piece::pawn, Piece::pawn}};
+
+// Returns a random square of `squares`, which must not be empty.
+Bitboard random_square(Bitboard squares, std::mt19937_64* rng) {
+  int idx = static_cast<int>((*rng)() % static_cast<uint64_t>(popcount(
+                                            squares)));
+  for (; idx > 0; --idx) {
+    squares &= squares - 1;
+  }
+  return squares & (~squares + 1);
+}
+}  // namespace.
+
+Board random_playout_position(int min_plies, int max_plies,
+                              std::mt19937_64* rng) {
+  ABSL_RAW_CHECK(0 <= min_plies && min_plies <= max_plies,
+                 "Bad range of plies.");
+  const Board start(start_fen);
+  while (true) {
+    const int plies =
+        min_plies + static_cast<int>((*rng)() % static_cast<uint64_t>(
+                                                    max_plies - min_plies + 1));
+    Board res = start;
+    int ply = 0;
+    for (; ply < plies; ++ply) {
+      const MoveList moves = res.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      res.do_move(moves[(*rng)() % moves.size()]);
+    }
+    if (ply == plies) {
+      return res;
+    }
+  }
+}
+
+Board random_material_position(std::mt19937_64* rng) {
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  while (true) {
+    Board res;
+    res.zero_all_bitboards();
+    Bitboard empty = ~Bitboard{0};
+    const double kept = chance(*rng);
+    for (Color color : {Color::white, Color::black}) {
+      const Bitboard king = random_square(empty, rng);
+      *res.piece_bitboard(color, Piece::king) |= king;
+      empty ^= king;
+      for (Piece piece : start_pieces) {
+        if (chance(*rng) >= kept) {
+          continue;
+        }
+        const Bitboard squares =
+            piece == Piece::pawn
+                ? empty & ~(first_rank_mask | eighth_rank_mask)
+                : empty;
+        const Bitboard sq = random_square(squares, rng);
+        *res.piece_bitboard(color, piece) |= sq;
+        empty ^= sq;
+      }
+    }
+    res.init_mailbox();
+    res.init_occupancy();
+    res.en_passant_square_ = 0;
+    res.castling_rights_ = no_castling;
+    res.fifty_move_clock_ = 0;
+    res.num_moves_ = 1;
+    res.is_whites_move_ = (*rng)() % 2 == 0;
+    if (res.position_error()) {
+      continue;
+    }
+    res.init_state();
+    return res;
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef RANDOM_POSITIONS_H
+#define RANDOM_POSITIONS_H
+
+#include <random>
+
+#include "board.h"
+
+// Random legal positions for benchmark and fuzz corpora, which should look
+// like the games the engine plays, middlegames and endgames as much as
+// openings, rather than like the few positions of the tests. There are two
+// ways of drawing them:
+//
+//  - Playouts: random legal moves from the starting position, each move of a
+//    position equally likely, for a number of plies drawn between two bounds.
+//  - Material: each piece of the starting position but the kings is kept with
+//    a chance drawn anew for every position, so that full boards and bare
+//    endgames are as likely, and the pieces kept go on random empty squares,
+//    the pawns on ranks 2 to 7. Positions are drawn again until
+//    `Board::position_error` finds nothing wrong with them. They have no
+//    castling rights or en passant square.
+//
+// Both take their random numbers from `rng`, so a seed gives the same
+// positions again.
+
+// Returns the position after a random playout of `min_plies` to `max_plies`
+// plies. A game that ends before is played again.
+Board random_playout_position(int min_plies, int max_plies,
+                              std::mt19937_64* rng);
+
+// Returns a position of random material on random squares, either side to
+// move.
+Board random_material_position(std::mt19937_64* rng);
+
+#endif
@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "absl/strings/numbers.h"
+#include "board.h"
+#include "packed_position.h"
+#include "random_positions.h"
+
+// Usage: random_positions [--count <n>] [--seed <n>] [--material]
+//                         [--min-plies <n>] [--max-plies <n>]
+//                         [--packed <out>]
+//
+// Writes random legal positions (see random_positions.h), 1000 by default,
+// as FEN lines to the standard output, or with --packed as packed positions
+// (see packed_position.h) with no score or result to <out>. The positions
+// come from random playouts of 10 to 120 plies, or as many as --min-plies and
+// --max-plies say, or with --material from random material on random squares.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--count <n>] [--seed <n>] [--material] [--min-plies <n>]"
+               " [--max-plies <n>] [--packed <out>]\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  uint64_t count = 1000;
+  uint64_t seed = 1;
+  bool is_material = false;
+  int min_plies = 10;
+  int max_plies = 120;
+  const char* packed_path = nullptr;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const char* const flag = argv[arg_idx];
+    if (std::strcmp(flag, "--material") == 0) {
+      is_material = true;
+      continue;
+    }
+    if (arg_idx + 1 == argc) {
+      return usage(argv[0]);
+    }
+    const char* const value = argv[++arg_idx];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--count") == 0) {
+      is_valid = absl::SimpleAtoi(value, &count);
+    } else if (std::strcmp(flag, "--seed") == 0) {
+      is_valid = absl::SimpleAtoi(value, &seed);
+    } else if (std::strcmp(flag, "--min-plies") == 0) {
+      is_valid = absl::SimpleAtoi(value, &min_plies) && min_plies >= 0;
+    } else if (std::strcmp(flag, "--max-plies") == 0) {
+      is_valid = absl::SimpleAtoi(value, &max_plies) && max_plies >= 0;
+    } else if (std::strcmp(flag, "--packed") == 0) {
+      packed_path = value;
+      is_valid = true;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (min_plies > max_plies) {
+    return usage(argv[0]);
+  }
+  std::ofstream packed_out;
+  if (packed_path) {
+    packed_out.open(packed_path, std::ios::binary);
+    if (!packed_out) {
+      std::cerr << "Can't write " << packed_path << '\n';
+      return 1;
+    }
+  }
+
+  std::mt19937_64 rng(seed);
+  std::string fen;
+  for (uint64_t i = 0; i < count; ++i) {
+    const Board board = is_material
+                            ? random_material_position(&rng)
+                            : random_playout_position(min_plies, max_plies,
+                                                      &rng);
+    if (packed_path) {
+      const PackedPosition packed = pack_position(board, 0, 0);
+      packed_out.write(reinterpret_cast<const char*>(&packed),
+                       sizeof(packed));
+    } else {
+      fen.clear();
+      board.append_fen(&fen);
+      fen.push_back('\n');
+      std::cout << fen;
+    }
+  }
+  if (packed_path) {
+    packed_out.close();
+    if (!packed_out) {
+      std::cerr << "Can't write " << packed_path << '\n';
+      return 1;
+    }
+  }
+  return 0;
+}
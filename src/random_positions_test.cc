@@ -0,0 +1,46 @@
+#include "random_positions.h"
+
+#include <random>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+TEST(RandomPositions, PlayoutsAreLegal) {
+  std::mt19937_64 rng(1);
+  for (int i = 0; i < 200; ++i) {
+    const Board board = random_playout_position(20, 40, &rng);
+    EXPECT_EQ(board.position_error(), nullptr) << board.to_fen();
+    EXPECT_TRUE(board.has_consistent_state()) << board.to_fen();
+    EXPECT_FALSE(board.legal_moves().empty()) << board.to_fen();
+    // 20 to 40 plies from the first move.
+    EXPECT_GE(board.num_moves_, 11);
+    EXPECT_LE(board.num_moves_, 21);
+  }
+}
+
+TEST(RandomPositions, MaterialPositionsAreLegal) {
+  std::mt19937_64 rng(1);
+  int num_endgames = 0;
+  int num_full_boards = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const Board board = random_material_position(&rng);
+    EXPECT_EQ(board.position_error(), nullptr) << board.to_fen();
+    EXPECT_TRUE(board.has_consistent_state()) << board.to_fen();
+    const int num_pieces = popcount(board.all_pieces());
+    num_endgames += num_pieces <= 6;
+    num_full_boards += num_pieces >= 26;
+  }
+  EXPECT_GT(num_endgames, 50);
+  EXPECT_GT(num_full_boards, 50);
+}
+
+TEST(RandomPositions, SeedsRepeat) {
+  std::mt19937_64 rng_1(7);
+  std::mt19937_64 rng_2(7);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(random_playout_position(0, 100, &rng_1),
+              random_playout_position(0, 100, &rng_2));
+    EXPECT_EQ(random_material_position(&rng_1),
+              random_material_position(&rng_2));
+  }
+}
@@ -0,0 +1,172 @@
+#include "repetition.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "absl/base/internal/raw_logging.h"
+#include "attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "zobrist.h"
+
+namespace {
+// The key differences of the reversible moves are stored by cuckoo hashing:
+// each key is in one of two slots, so a lookup reads at most two.
+constexpr size_t cuckoo_size = 8192;
+// The number of moves of a piece other than a pawn between two squares of an
+// empty board, for both colors.
+constexpr size_t num_reversible_moves = 3668;
+
+constexpr size_t cuckoo_h1(uint64_t key) { return key & (cuckoo_size - 1); }
+constexpr size_t cuckoo_h2(uint64_t key) {
+  return (key >> 16) & (cuckoo_size - 1);
+}
+
+struct CuckooTable {
+  // 0 in an empty slot.
+  std::array<uint64_t, cuckoo_size> keys_;
+  // The square indices of the move of each slot, in either order.
+  std::array<std::pair<int, int>, cuckoo_size> squares_;
+};
+
+Bitboard empty_board_attacks(Piece piece, int sq_idx) {
+  switch (piece) {
+    case Piece::knight:
+      return knight_attacks[static_cast<size_t>(sq_idx)];
+    case Piece::bishop:
+      return slow_bishop_attacks(sq_idx, 0);
+    case Piece::rook:
+      return slow_rook_attacks(sq_idx, 0);
+    case Piece::queen:
+      return slow_bishop_attacks(sq_idx, 0) | slow_rook_attacks(sq_idx, 0);
+    case Piece::king:
+      return king_attacks[static_cast<size_t>(sq_idx)];
+    default:
+      return 0;
+  }
+}
+
+CuckooTable make_cuckoo_table() {
+  CuckooTable res = {};
+  size_t num_moves = 0;
+  for (Color color : {Color::white, Color::black}) {
+    for (Piece piece : {Piece::knight, Piece::bishop, Piece::rook,
+                        Piece::queen, Piece::king}) {
+      for (int a = 0; a < 64; ++a) {
+        for (int b = a + 1; b < 64; ++b) {
+          if (!(empty_board_attacks(piece, a) & (lsb_bitboard << b))) {
+            continue;
+          }
+          uint64_t key = zobrist_piece_key(color, piece, a) ^
+                         zobrist_piece_key(color, piece, b) ^
+                         zobrist_keys.black_to_move_;
+          std::pair<int, int> squares(a, b);
+          // Evict whatever is in the slot to its other slot, until a slot
+          // is free.
+          size_t idx = cuckoo_h1(key);
+          while (true) {
+            std::swap(res.keys_[idx], key);
+            std::swap(res.squares_[idx], squares);
+            if (key == 0) {
+              break;
+            }
+            idx = idx == cuckoo_h1(key) ? cuckoo_h2(key) : cuckoo_h1(key);
+          }
+          ++num_moves;
+        }
+      }
+    }
+  }
+  ABSL_RAW_CHECK(num_moves == num_reversible_moves,
+                 "Wrong number of reversible moves.");
+  return res;
+}
+
+const CuckooTable& cuckoo_table() {
+  static const CuckooTable table = make_cuckoo_table();
+  return table;
+}
+}  // namespace.
+
+void KeyHistory::reset(const Board& board) {
+  entries_.clear();
+  entries_.push_back({board.key_, 0, 0});
+}
+
+void KeyHistory::push(const Board& board) {
+  Entry entry = {board.key_,
+                 std::min(board.fifty_move_clock_, entries_.back().window_ + 1),
+                 0};
+  // The new entry goes at index `size`. A position can first repeat four
+  // plies later.
+  const size_t size = entries_.size();
+  for (int back = 4; back <= entry.window_; back += 2) {
+    const Entry& earlier = entries_[size - static_cast<size_t>(back)];
+    if (earlier.key_ == entry.key_) {
+      entry.repetition_ = earlier.repetition_ ? -back : back;
+      break;
+    }
+  }
+  entries_.push_back(entry);
+}
+
+void KeyHistory::push_null(const Board& board) {
+  entries_.push_back({board.key_, 0, 0});
+}
+
+bool KeyHistory::is_repetition(int ply) const {
+  const int repetition = entries_.back().repetition_;
+  return repetition != 0 && repetition < ply;
+}
+
+bool KeyHistory::has_repeated() const {
+  const size_t last_idx = entries_.size() - 1;
+  for (int back = 0; back <= entries_.back().window_; ++back) {
+    if (entries_[last_idx - static_cast<size_t>(back)].repetition_ != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool KeyHistory::has_game_cycle(const Board& board, int ply) const {
+  const Entry& last = entries_.back();
+  const CuckooTable& table = cuckoo_table();
+  const size_t last_idx = entries_.size() - 1;
+  // A move of the side to move leads to a position an odd number of plies
+  // back, the nearest being three.
+  for (int back = 3; back <= last.window_; back += 2) {
+    const Entry& earlier = entries_[last_idx - static_cast<size_t>(back)];
+    const uint64_t move_key = last.key_ ^ earlier.key_;
+    size_t idx = cuckoo_h1(move_key);
+    if (table.keys_[idx] != move_key) {
+      idx = cuckoo_h2(move_key);
+      if (table.keys_[idx] != move_key) {
+        continue;
+      }
+    }
+    const int a = table.squares_[idx].first;
+    const int b = table.squares_[idx].second;
+    if (between_squares(a, b) & board.occupancy_) {
+      continue;
+    }
+    if (back < ply) {
+      return true;
+    }
+    // Before the root, the move has to be one the side to move can make,
+    // rather than the one that led here, and the position it goes back to has
+    // to have occurred twice already.
+    const Bitboard from =
+        board.occupancy_ & (lsb_bitboard << a) ? lsb_bitboard << a
+                                               : lsb_bitboard << b;
+    const Bitboard own = board.is_whites_move_ ? board.white_occupancy_
+                                               : board.black_occupancy_;
+    if ((from & own) && earlier.repetition_ != 0) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,63 @@
+#ifndef REPETITION_H
+#define REPETITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+
+// The keys of the positions of a game and of the line a search is on, one per
+// ply, for finding repetitions. Only the positions since the last capture,
+// pawn move or null move can repeat, so every lookup goes back at most that
+// far, however long the game is. Each searcher keeps its own.
+class KeyHistory {
+ public:
+  // Starts the history at `board`, with nothing before it.
+  void reset(const Board& board);
+  // Makes room for `num_plies` more positions, so that pushing them doesn't
+  // allocate.
+  void reserve(size_t num_plies) {
+    entries_.reserve(entries_.size() + num_plies);
+  }
+  // Adds `board`, the position after a move from the last one.
+  void push(const Board& board);
+  // Adds `board`, the position after a null move. No position repeats one
+  // from before a null move.
+  void push_null(const Board& board);
+  void pop() { entries_.pop_back(); }
+
+  bool empty() const { return entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+  // The key of the last position.
+  uint64_t top_key() const { return entries_.back().key_; }
+
+  // Returns true if the last position is a draw by repetition for a search
+  // whose root is `ply` plies back: it repeats a position after the root, or
+  // it is the third occurrence of a position.
+  bool is_repetition(int ply) const;
+  // Returns true if any position since the last irreversible or null move
+  // repeats an earlier one.
+  bool has_repeated() const;
+  // Returns true if the side to move of `board`, the last position, has a
+  // move to a position that `is_repetition` would call a draw, so that the
+  // search can take the draw as a lower bound. Finds those moves with a table
+  // of the key differences of every reversible move, rather than generating
+  // them.
+  bool has_game_cycle(const Board& board, int ply) const;
+
+ private:
+  struct Entry {
+    uint64_t key_;
+    // How many plies back a position can repeat this one: the plies since the
+    // last irreversible or null move.
+    int window_;
+    // How many plies back this position occurred last, negated if that was a
+    // repetition too, or 0 if it is new.
+    int repetition_;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+#endif
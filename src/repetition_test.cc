@@ -0,0 +1,132 @@
+#include "repetition.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+// Does the move in UCI notation `move` on `board` and adds the position to
+// `history`.
+void play(const std::string& move, Board* board, KeyHistory* history) {
+  for (Move legal_move : board->legal_moves()) {
+    if (legal_move.to_uci_str() == move) {
+      board->do_move(legal_move);
+      history->push(*board);
+      return;
+    }
+  }
+  FAIL() << "Illegal move " << move;
+}
+
+void play(const std::vector<std::string>& moves, Board* board,
+          KeyHistory* history) {
+  for (const std::string& move : moves) {
+    play(move, board, history);
+  }
+}
+}  // namespace.
+
+TEST(KeyHistory, FindsRepetitions) {
+  Board board;
+  KeyHistory history;
+  history.reset(board);
+  play({"g1f3", "g8f6", "f3g1"}, &board, &history);
+  EXPECT_FALSE(history.has_repeated());
+  play("f6g8", &board, &history);
+  EXPECT_TRUE(history.has_repeated());
+  // The start position again: a draw within a search from before it, but
+  // only its second occurrence otherwise.
+  EXPECT_TRUE(history.is_repetition(5));
+  EXPECT_FALSE(history.is_repetition(4));
+  EXPECT_FALSE(history.is_repetition(0));
+  play({"g1f3", "g8f6", "f3g1", "f6g8"}, &board, &history);
+  EXPECT_TRUE(history.is_repetition(0));
+  play("e2e4", &board, &history);
+  EXPECT_FALSE(history.is_repetition(9));
+  EXPECT_FALSE(history.has_repeated());
+  EXPECT_EQ(history.size(), 10);
+}
+
+TEST(KeyHistory, IrreversibleAndNullMovesEndTheWindow) {
+  Board board;
+  KeyHistory history;
+  history.reset(board);
+  play({"g1f3", "g8f6", "f3g1", "f6g8", "e2e4", "g8f6", "g1f3", "f6g8",
+        "f3g1"},
+       &board, &history);
+  // The knights are back, but a pawn has moved since the start.
+  EXPECT_FALSE(history.is_repetition(100));
+
+  // The white king goes around a triangle after a pass, which isn't a move.
+  board = Board("4k3/8/8/8/8/8/8/4K3 b - - 0 1");
+  history.reset(board);
+  UndoInfo undo;
+  board.do_null_move(&undo);
+  history.push_null(board);
+  play({"e1d1", "e8d8", "d1d2", "d8e8", "d2e1"}, &board, &history);
+  EXPECT_EQ(board.key_, Board("4k3/8/8/8/8/8/8/4K3 b - - 0 1").key_);
+  EXPECT_FALSE(history.is_repetition(100));
+}
+
+TEST(KeyHistory, FindsMovesBackToDrawnPositions) {
+  Board board;
+  KeyHistory history;
+  history.reset(board);
+  play({"g1f3", "g8f6", "f3g1"}, &board, &history);
+  // Ng8 goes back to the start position, which a search from before it
+  // would score as a draw.
+  EXPECT_TRUE(history.has_game_cycle(board, 4));
+  EXPECT_FALSE(history.has_game_cycle(board, 0));
+  play({"f6g8", "g1f3", "g8f6", "f3g1"}, &board, &history);
+  EXPECT_TRUE(history.has_game_cycle(board, 0));
+
+  // The bishop can't go back through the knight, which left and came back.
+  board = Board("4k3/8/8/8/8/8/1N6/B3K3 w - - 0 1");
+  history.reset(board);
+  play({"b2d1", "e8d8", "a1c3", "d8e8", "d1b2"}, &board, &history);
+  EXPECT_FALSE(history.has_game_cycle(board, 10));
+}
+
+TEST(KeyHistory, GameCyclesMatchMoveGeneration) {
+  // Random walks of pieces other than pawns, checking that whenever a legal
+  // move leads back to a position within the window, the cycle is found.
+  std::mt19937 rng(11);
+  for (const std::string& fen :
+       {std::string("r3k2r/8/2n2b2/8/8/2N2B2/8/R3K2R w - - 0 1"),
+        std::string("4k3/3q4/8/8/2N5/8/5Q2/4K3 w - - 0 1")}) {
+    Board board(fen);
+    KeyHistory history;
+    history.reset(board);
+    std::vector<uint64_t> keys = {board.key_};
+    for (int ply = 0; ply < 60; ++ply) {
+      bool goes_back = false;
+      for (Move move : board.legal_moves()) {
+        Board after = board;
+        after.do_move(move);
+        for (size_t back = 3; back <= keys.size() - 1; back += 2) {
+          goes_back |= after.key_ == keys[keys.size() - 1 - back];
+        }
+      }
+      if (goes_back) {
+        EXPECT_TRUE(history.has_game_cycle(board, 100))
+            << board.to_pretty_str();
+      }
+      std::vector<Move> quiet_moves;
+      for (Move move : board.legal_moves()) {
+        if (move.move_type_ == MoveType::simple &&
+            move.piece_moving_ != Piece::pawn) {
+          quiet_moves.push_back(move);
+        }
+      }
+      if (quiet_moves.empty()) {
+        break;
+      }
+      board.do_move(quiet_moves[rng() % quiet_moves.size()]);
+      history.push(board);
+      keys.push_back(board.key_);
+    }
+  }
+}
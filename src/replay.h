@@ -0,0 +1,29 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>
+
+#include "board.h"
+
+// Plays the moves of a game that are already decoded, say from a database or
+// from training data, and calls `fn(before, move)` with the position before
+// each move, for extracting positions, keys or packed records from games.
+// Each move is checked with one pseudolegality and legality test, without
+// generating the moves of the position. Stops at the first move that isn't
+// legal and returns the number of moves played, so the game was replayed in
+// full if that is `num_moves`. `board` is left after the last move played.
+template <typename Fn>
+size_t replay_moves(Board* board, const Move* moves, size_t num_moves, Fn fn) {
+  for (size_t i = 0; i < num_moves; ++i) {
+    const Move move = moves[i];
+    if (!board->is_move_pseudolegal(move) ||
+        !board->is_legal(move, board->check_info())) {
+      return i;
+    }
+    fn(static_cast<const Board&>(*board), move);
+    board->do_move(move);
+  }
+  return num_moves;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include "replay.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+
+namespace {
+// 1. e4 d5 2. exd5 Qxd5 3. Nc3 Qa5 4. d4 c6 5. Bd2 Bf5 6. Qf3 Nd7 7. O-O-O
+std::vector<Move> scandinavian_moves() {
+  Board board;
+  std::vector<Move> res;
+  for (const char* uci : {"e2e4", "d7d5", "e4d5", "d8d5", "b1c3", "d5a5",
+                          "d2d4", "c7c6", "c1d2", "c8f5", "d1f3", "b8d7",
+                          "e1c1"}) {
+    const absl::optional<Move> move = parse_uci_move(board, uci);
+    EXPECT_TRUE(move) << uci;
+    res.push_back(*move);
+    board.do_move(*move);
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(ReplayMoves, CallsBackWithEachPosition) {
+  const std::vector<Move> moves = scandinavian_moves();
+  Board board;
+  std::vector<uint64_t> keys;
+  std::vector<PackedPosition> packed;
+  const size_t num_played =
+      replay_moves(&board, moves.data(), moves.size(),
+                   [&](const Board& before, Move move) {
+                     keys.push_back(before.key_);
+                     packed.push_back(pack_position(before, 0, 1));
+                     EXPECT_EQ(before.mailbox_[move.src_idx_],
+                               move.piece_moving_);
+                   });
+  EXPECT_EQ(num_played, moves.size());
+  ASSERT_EQ(keys.size(), moves.size());
+  Board expected;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    EXPECT_EQ(keys[i], expected.key_);
+    EXPECT_EQ(unpack_position(packed[i]), expected);
+    expected.do_move(moves[i]);
+  }
+  EXPECT_EQ(board, expected);
+}
+
+TEST(ReplayMoves, StopsAtIllegalMove) {
+  std::vector<Move> moves = scandinavian_moves();
+  // After 1. e4 d5, the pawn on e4 can't go on to e6.
+  moves[2] = Move(str_to_square("e4"), str_to_square("e6"), Piece::pawn,
+                  MoveType::two_step_pawn);
+  Board board;
+  int num_calls = 0;
+  EXPECT_EQ(replay_moves(&board, moves.data(), moves.size(),
+                         [&](const Board&, Move) { ++num_calls; }),
+            2);
+  EXPECT_EQ(num_calls, 2);
+  EXPECT_EQ(board.to_fen(),
+            "rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2");
+}
+
+TEST(ReplayMoves, RejectsMovesLeavingTheKingInCheck) {
+  // The rook on a1 checks along the first rank, so the king can't go to d1.
+  Board board("4k3/8/8/8/8/8/8/r3K3 w - - 0 1");
+  const Move moves[] = {Move(str_to_square("e1"), str_to_square("d1"),
+                             Piece::king, MoveType::simple)};
+  EXPECT_EQ(replay_moves(&board, moves, 1, [](const Board&, Move) {}), 0);
+}
@@ -0,0 +1,47 @@
+#ifndef RUN_READER_H
+#define RUN_READER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Reads the entries of a run file, sorted entries that a builder spilled to
+// disk for an external sort, a block at a time, for the merge of the runs.
+template <typename Entry>
+class RunReader {
+ public:
+  explicit RunReader(const std::string& path)
+      : file_(std::fopen(path.c_str(), "rb")), buf_(4096), pos_(0), size_(0) {
+    refill();
+  }
+  RunReader(const RunReader&) = delete;
+  RunReader& operator=(const RunReader&) = delete;
+  ~RunReader() {
+    if (file_) {
+      std::fclose(file_);
+    }
+  }
+
+  bool empty() const { return pos_ == size_; }
+  const Entry& front() const { return buf_[pos_]; }
+  void pop() {
+    if (++pos_ == size_) {
+      refill();
+    }
+  }
+
+ private:
+  void refill() {
+    pos_ = 0;
+    size_ = file_ ? std::fread(buf_.data(), sizeof(Entry), buf_.size(), file_)
+                  : 0;
+  }
+
+  std::FILE* file_;
+  std::vector<Entry> buf_;
+  size_t pos_;
+  size_t size_;
+};
+
+#endif
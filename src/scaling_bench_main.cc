@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "bench.h"
+#include "board.h"
+#include "search.h"
+
+// Usage: scaling_bench [--depth <n>] [--threads <n>] [--smp lazy|abdada]
+//                      [--hash <mb>] [--positions <n>] [--json]
+//
+// Searches the positions of the UCI `bench` command, or the first n of them
+// with --positions, to depth 12 or --depth with 1, 2, 4 and so on threads up
+// to --threads, one per hardware thread by default, and prints how the node
+// rate and the time to depth scale and how many more nodes the threads
+// search than one thread does (see `measure_thread_scaling`). The table is
+// 64 MB or --hash megabytes and is cleared before every position. --smp
+// picks Lazy SMP, the default, or ABDADA. With --json the results are
+// printed as one JSON object instead of a table, for scripts.
+
+namespace {
+// Returns `value` rounded to two decimals.
+std::string hundredths(double value) {
+  const int64_t rounded = std::llround(value * 100);
+  return absl::StrCat(rounded < 0 ? "-" : "", std::abs(rounded) / 100, ".",
+                      absl::Dec(std::abs(rounded) % 100, absl::kZeroPad2));
+}
+
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--depth <n>] [--threads <n>] [--smp lazy|abdada]"
+               " [--hash <mb>] [--positions <n>] [--json]\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  ThreadScalingOptions options = {12, {}, SmpMode::lazy, 64};
+  size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  size_t num_positions = num_bench_fens;
+  bool is_json = false;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const char* const flag = argv[arg_idx];
+    if (std::strcmp(flag, "--json") == 0) {
+      is_json = true;
+      continue;
+    }
+    if (arg_idx + 1 == argc) {
+      return usage(argv[0]);
+    }
+    const char* const value = argv[++arg_idx];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--depth") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.depth_) &&
+                 options.depth_ >= 1 && options.depth_ < max_search_ply;
+    } else if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &max_threads) && max_threads >= 1;
+    } else if (std::strcmp(flag, "--smp") == 0) {
+      is_valid = std::strcmp(value, "lazy") == 0 ||
+                 std::strcmp(value, "abdada") == 0;
+      options.smp_mode_ = std::strcmp(value, "abdada") == 0 ? SmpMode::abdada
+                                                            : SmpMode::lazy;
+    } else if (std::strcmp(flag, "--hash") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.hash_mb_) &&
+                 options.hash_mb_ >= 1;
+    } else if (std::strcmp(flag, "--positions") == 0) {
+      is_valid = absl::SimpleAtoi(value, &num_positions) &&
+                 num_positions >= 1 && num_positions <= num_bench_fens;
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  options.thread_counts_ = doubling_thread_counts(max_threads);
+  std::vector<Board> positions;
+  for (size_t i = 0; i < num_positions; ++i) {
+    positions.emplace_back(bench_fens[i]);
+  }
+
+  const std::vector<ThreadScalingRun> runs = measure_thread_scaling(
+      positions, options, [is_json](const ThreadScalingRun& run) {
+        if (!is_json) {
+          std::cout << absl::StrCat(
+                           "Threads ", run.num_threads_, ": ", run.nodes_,
+                           " nodes, ", run.time_us_ / 1000, " ms, ",
+                           run.nodes_per_second_, " nps, nps x",
+                           hundredths(run.nps_scaling_), ", time to depth x",
+                           hundredths(run.time_to_depth_speedup_),
+                           ", node overhead ",
+                           hundredths(100 * run.node_overhead_), "%\n")
+                    << std::flush;
+        }
+      });
+  if (is_json) {
+    std::cout << thread_scaling_to_json(options, runs) << '\n';
+  }
+  return 0;
+}
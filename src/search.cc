@@ -0,0 +1,1122 @@
+#include "search.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/strings/str_cat.h"
+#include "arena.h"
+#include "board.h"
+#include "eval.h"
+#include "instrumentation.h"
+#include "move_picker.h"
+#include "nnue.h"
+#include "numa.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+namespace {
+// Selective search parameters, in plies and centipawns.
+constexpr int reverse_futility_max_depth = 6;
+constexpr int reverse_futility_margin = 120;
+constexpr int null_move_min_depth = 3;
+constexpr int futility_max_depth = 3;
+constexpr int futility_margin = 150;
+constexpr int late_move_max_depth = 4;
+constexpr int reduction_min_depth = 3;
+constexpr int reduction_min_moves = 3;
+// Singular extensions are tried from this depth on, with a table entry at
+// most `singular_depth_slack` plies shallower, and the other moves have to
+// stay `singular_margin` times the depth below the table's score.
+constexpr int singular_min_depth = 8;
+constexpr int singular_depth_slack = 3;
+constexpr int singular_margin = 2;
+// Internal iterative reductions are done from this depth on.
+constexpr int iir_min_depth = 4;
+// ProbCut is tried from this depth on, with a search this much shallower, for
+// captures that would beat beta by the margin.
+constexpr int probcut_min_depth = 5;
+constexpr int probcut_reduction = 4;
+constexpr int probcut_margin = 200;
+// ABDADA defers moves from this depth on: shallower searches take less time
+// than looking the positions up saves.
+constexpr int abdada_min_depth = 4;
+
+// Aspiration windows start this far either side of the last score, from this
+// depth on.
+constexpr int aspiration_delta = 25;
+constexpr int aspiration_min_depth = 4;
+
+// The number of quiet moves searched at `depth` after which late move pruning
+// skips the rest.
+size_t late_move_count(int depth) {
+  return static_cast<size_t>(3 + depth * depth);
+}
+
+// Returns how many plies late move reductions take off the `move_number`th
+// move searched at `depth`. Both logarithms grow slowly, so deep searches
+// reduce late moves by a few plies at most.
+int late_move_reduction(int depth, int move_number) {
+  static const std::array<std::array<int, 64>, max_search_ply> reductions =
+      [] {
+        std::array<std::array<int, 64>, max_search_ply> res = {};
+        for (size_t d = 1; d < res.size(); ++d) {
+          for (size_t m = 1; m < res[d].size(); ++m) {
+            res[d][m] = static_cast<int>(
+                0.75 + std::log(static_cast<double>(d)) *
+                           std::log(static_cast<double>(m)) / 2.25);
+          }
+        }
+        return res;
+      }();
+  return reductions[static_cast<size_t>(std::min(depth, max_search_ply - 1))]
+                   [static_cast<size_t>(std::min(move_number, 63))];
+}
+
+// Returns true if `side` has a piece other than pawns and the king.
+bool has_non_pawn_material(const Board& board, Color side) {
+  return (board.pieces(side, Piece::rook) | board.pieces(side, Piece::knight) |
+          board.pieces(side, Piece::bishop) |
+          board.pieces(side, Piece::queen)) != 0;
+}
+
+// The most a single cutoff adds to a history score.
+constexpr int max_history_bonus = 1024;
+
+// A capture in quiescence search is skipped if even winning this much on top
+// of the captured piece wouldn't bring the score up to alpha.
+constexpr int delta_margin = 200;
+
+// How many nodes a searcher visits between looks at its stop flag and the
+// clock. A few hundred nodes take well under a millisecond even with the
+// network, so a cancelled search frees its cores about that fast, and a
+// relaxed load every few hundred nodes costs nothing measurable.
+constexpr uint64_t stop_check_interval = 256;
+
+// Returns true if `move` neither captures nor promotes, which makes it a
+// candidate killer move.
+bool is_quiet(Move move) {
+  return move.move_type_ == MoveType::simple ||
+         move.move_type_ == MoveType::two_step_pawn ||
+         move.move_type_ == MoveType::castle_kingside ||
+         move.move_type_ == MoveType::castle_queenside;
+}
+
+// Returns the material `move` wins on `board` if it isn't recaptured.
+int material_gain(const Board& board, Move move) {
+  if (move.move_type_ == MoveType::en_passant) {
+    return see_value(Piece::pawn);
+  }
+  const Piece victim = board.mailbox_[move.dst_idx_];
+  int res = victim == Piece::none ? 0 : see_value(victim);
+  if (!is_quiet(move) && move.move_type_ != MoveType::capture) {
+    res += see_value(promotion_piece(move.move_type_)) -
+           see_value(Piece::pawn);
+  }
+  return res;
+}
+
+// The lowest score, as a win, that counts plies from the root: the mate and
+// tablebase win scores.
+constexpr int min_win_score = tablebase_win_score - max_search_ply;
+
+// Mate and tablebase win scores count plies from the root, but the table
+// stores them as plies from the position, so that they stay right wherever
+// the position is found.
+int score_to_table(int score, int ply) {
+  if (score >= min_win_score) {
+    return score + ply;
+  }
+  if (score <= -min_win_score) {
+    return score - ply;
+  }
+  return score;
+}
+
+int score_from_table(int score, int ply) {
+  if (score >= min_win_score) {
+    return score - ply;
+  }
+  if (score <= -min_win_score) {
+    return score + ply;
+  }
+  return score;
+}
+
+// Sets the counts of `res` to those of `counters`.
+void read_counters(const SearchCounters& counters, SearchResult* res) {
+  res->nodes_ = counters.nodes_.load(std::memory_order_relaxed);
+  res->selective_depth_ =
+      counters.selective_depth_.load(std::memory_order_relaxed);
+  res->tablebase_hits_ =
+      counters.tablebase_hits_.load(std::memory_order_relaxed);
+}
+
+// Tablebase probes in the search add this to the depth of what they store,
+// as they are exact whatever the depth.
+constexpr int tablebase_depth_bonus = 6;
+}  // namespace.
+
+Searcher::Searcher(TranspositionTable* table)
+    : table_(table),
+      stop_(nullptr),
+      max_nodes_(0),
+      stopped_(false),
+      time_manager_(nullptr),
+      frames_(),
+      network_(nullptr),
+      accumulators_(max_search_ply + 1),
+      pv_length_(),
+      multi_pv_(1),
+      tablebases_(nullptr),
+      probe_tablebases_(false),
+      tablebase_hits_(0),
+      trace_buffer_(nullptr),
+      searching_(nullptr) {}
+
+SearchingSet::SearchingSet()
+    : slots_(std::make_unique<std::atomic<uint64_t>[]>(num_slots)) {
+  for (size_t i = 0; i < num_slots; ++i) {
+    slots_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Searcher::set_network(const NnueNetwork* network) {
+  network_ = network;
+  // The cached evaluations are those of the previous evaluation.
+  eval_table_.clear();
+}
+
+SearcherStats Searcher::stats() const {
+  return {eval_table_.num_probes(), eval_table_.num_hits(),
+          pawn_table_.num_probes(), pawn_table_.num_hits(), tablebase_hits_};
+}
+
+void Searcher::clear() {
+  history_.clear();
+  pawn_table_.clear();
+  eval_table_.clear();
+  tablebase_hits_ = 0;
+}
+
+void Searcher::set_multi_pv(size_t num_lines) {
+  ABSL_RAW_CHECK(num_lines >= 1, "A search needs at least one line.");
+  multi_pv_ = num_lines;
+}
+
+SearchResult Searcher::search(const Board& board, int max_depth,
+                              const IterationCallback& on_iteration) {
+  table_->new_search();
+  return search_iterations(board, 1, {max_depth, 0, nullptr, nullptr},
+                           on_iteration);
+}
+
+SearchResult Searcher::search_iterations(
+    const Board& board, int first_depth, const SearchLimits& limits,
+    const IterationCallback& on_iteration) {
+  ABSL_RAW_CHECK(first_depth >= 1 && limits.max_depth_ < max_search_ply,
+                 "The search depth is out of range.");
+  stop_ = limits.stop_;
+  max_nodes_ = limits.max_nodes_;
+  time_manager_ = nullptr;
+  TimeManager* const time_manager = limits.time_manager_;
+  stopped_ = false;
+  board_ = board;
+  if (network_) {
+    accumulators_.reset(*network_, board_);
+  }
+  counters_.clear();
+  key_history_ = game_history_;
+  if (key_history_.empty() || key_history_.top_key() != board_.key_) {
+    key_history_.reset(board_);
+  }
+  key_history_.reserve(max_search_ply);
+  for (Frame& frame : frames_) {
+    frame.killers_ = {};
+  }
+  prev_pv_.clear();
+  std::vector<Move> first_pv;
+  first_pv.swap(first_pv_);
+  // If the tablebases have the root, only the moves that keep its result are
+  // searched, and probing the positions after them would only say that they
+  // keep it.
+  const MoveList legal_moves = board_.legal_moves();
+  tablebase_excluded_moves_.clear();
+  probe_tablebases_ = tablebases_ != nullptr;
+  if (is_in_tablebases()) {
+    if (const absl::optional<MoveList> best_moves =
+            tablebases_->best_root_moves(board_, key_history_)) {
+      for (Move move : legal_moves) {
+        if (std::find(best_moves->begin(), best_moves->end(), move) ==
+            best_moves->end()) {
+          tablebase_excluded_moves_.push_back(move);
+        }
+      }
+      probe_tablebases_ = false;
+    }
+  }
+  // Without legal moves there is still the one line, which finds the mate or
+  // stalemate.
+  const size_t num_lines = std::max<size_t>(
+      1, std::min(multi_pv_,
+                  legal_moves.size() - tablebase_excluded_moves_.size()));
+  SearchResult res = {absl::nullopt, 0, 0, {}, 0, 0, 0, {}};
+  // The lines of an iteration keep their principal variations in the arena of
+  // the thread until the iteration is complete, and are then copied into the
+  // vectors of `res`, which keep their capacity from one iteration to the
+  // next, so that iterations don't allocate once the lines stop growing.
+  struct IterationLine {
+    int score_;
+    const Move* pv_;
+    size_t pv_length_;
+  };
+  Arena& arena = thread_arena();
+  for (int depth = first_depth; depth <= limits.max_depth_; ++depth) {
+    const TraceSpan span(trace_buffer_, "iteration", "depth", depth);
+    const ArenaScope scope(&arena);
+    ArenaVector<IterationLine> lines{ArenaAllocator<IterationLine>(&arena)};
+    lines.reserve(num_lines);
+    excluded_root_moves_ = tablebase_excluded_moves_;
+    for (size_t i = 0; i < num_lines; ++i) {
+      if (i < res.lines_.size()) {
+        prev_pv_ = res.lines_[i].pv_;
+      } else if (i == 0) {
+        prev_pv_ = first_pv;
+      } else {
+        prev_pv_.clear();
+      }
+      const int score = search_root(
+          depth, i < res.lines_.size() ? res.lines_[i].score_ : res.score_);
+      if (stopped_) {
+        break;
+      }
+      const size_t pv_length = static_cast<size_t>(pv_length_[0]);
+      Move* const pv = arena.allocate_array<Move>(pv_length);
+      std::uninitialized_copy(pv_[0].begin(), pv_[0].begin() + pv_length, pv);
+      lines.push_back({score, pv, pv_length});
+      if (pv_length == 0) {
+        break;
+      }
+      excluded_root_moves_.push_back(pv[0]);
+    }
+    if (stopped_) {
+      break;
+    }
+    // A later line may still come out better than an earlier one, when the
+    // earlier one's search didn't see as far.
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const IterationLine& a, const IterationLine& b) {
+                       return a.score_ > b.score_;
+                     });
+    res.lines_.resize(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+      res.lines_[i].score_ = lines[i].score_;
+      res.lines_[i].pv_.assign(lines[i].pv_,
+                               lines[i].pv_ + lines[i].pv_length_);
+    }
+    res.score_ = lines[0].score_;
+    res.depth_ = depth;
+    res.pv_ = res.lines_[0].pv_;
+    res.best_move_ =
+        res.pv_.empty() ? absl::nullopt : absl::optional<Move>(res.pv_[0]);
+    read_counters(counters_, &res);
+    if (on_iteration) {
+      on_iteration(res);
+    }
+    if (!res.best_move_) {
+      // Mate or stalemate at the root, deeper iterations won't change that.
+      break;
+    }
+    if (time_manager) {
+      time_manager->on_iteration(res.best_move_, res.score_);
+      if (time_manager->should_stop_iterating()) {
+        break;
+      }
+      time_manager_ = time_manager;
+    }
+  }
+  read_counters(counters_, &res);
+  return res;
+}
+
+int Searcher::evaluate_position(const Board& board) {
+  set_label_root(board);
+  return static_evaluation();
+}
+
+int Searcher::quiescence_score(const Board& board) {
+  set_label_root(board);
+  return quiescence(0, -infinite_score, infinite_score);
+}
+
+void Searcher::set_label_root(const Board& board) {
+  stop_ = nullptr;
+  max_nodes_ = 0;
+  stopped_ = false;
+  time_manager_ = nullptr;
+  board_ = board;
+  if (network_) {
+    accumulators_.reset(*network_, board_);
+  }
+  key_history_.reset(board_);
+}
+
+int Searcher::search_root(int depth, int previous_score) {
+  if (depth < aspiration_min_depth || is_mate_score(previous_score)) {
+    return negamax(depth, 0, -infinite_score, infinite_score, true);
+  }
+  // Aspiration windows: the score usually stays close to the last
+  // iteration's, and a narrow window cuts more. A score outside the window is
+  // only a bound, so the window widens on that side until the score fits.
+  int delta = aspiration_delta;
+  int alpha = std::max(previous_score - delta, -infinite_score);
+  int beta = std::min(previous_score + delta, infinite_score);
+  while (true) {
+    const int score = negamax(depth, 0, alpha, beta, true);
+    if (stopped_) {
+      return 0;
+    }
+    if (score <= alpha && alpha > -infinite_score) {
+      alpha = std::max(score - delta, -infinite_score);
+    } else if (score >= beta && beta < infinite_score) {
+      beta = std::min(score + delta, infinite_score);
+    } else {
+      return score;
+    }
+    delta *= 2;
+  }
+}
+
+int Searcher::negamax(int depth, int ply, int alpha, int beta, bool on_pv) {
+  pv_length_[static_cast<size_t>(ply)] = ply;
+  if (ply > 0) {
+    if (board_.fifty_move_clock_ >= 100 || key_history_.is_repetition(ply)) {
+      return 0;
+    }
+    // If the side to move can go back to a drawn position, the draw is a
+    // lower bound.
+    if (alpha < 0 && key_history_.has_game_cycle(board_, ply)) {
+      alpha = 0;
+      if (alpha >= beta) {
+        return alpha;
+      }
+    }
+  }
+  const CheckInfo info = board_.check_info();
+  const bool in_check = info.checkers_ != 0;
+  if (in_check) {
+    ++depth;
+  }
+  if (depth <= 0) {
+    return quiescence(ply, alpha, beta);
+  }
+  if (is_stopping(ply)) {
+    return 0;
+  }
+  if (ply >= max_search_ply - 1) {
+    return static_evaluation();
+  }
+
+  const size_t ply_idx = static_cast<size_t>(ply);
+  Frame& frame = frames_[ply_idx];
+  // The search of a singular extension leaves out the table move, so the
+  // table's result for the position isn't its result.
+  const absl::optional<Move> excluded = frame.excluded_;
+  const uint64_t key = board_.key_;
+  TtEntry tt_entry;
+  const bool tt_hit = table_->probe(key, &tt_entry);
+  INSTRUMENT_COUNT(tt_probes);
+  if (tt_hit) {
+    INSTRUMENT_COUNT(tt_hits);
+  }
+  // Only null window searches prune or take cutoffs from the table, so that
+  // the principal variation is searched in full.
+  const bool is_pv_node = beta - alpha > 1;
+  if (tt_hit && !is_pv_node && !excluded && tt_entry.depth_ >= depth) {
+    const int tt_score = score_from_table(tt_entry.score_, ply);
+    if (tt_entry.bound_ == Bound::exact ||
+        (tt_entry.bound_ == Bound::lower && tt_score >= beta) ||
+        (tt_entry.bound_ == Bound::upper && tt_score <= alpha)) {
+      return tt_score;
+    }
+  }
+
+  // The tables only have positions without castling rights, and are only
+  // probed after a capture or pawn move, where the position is new.
+  if (ply > 0 && !excluded && board_.fifty_move_clock_ == 0 &&
+      probe_tablebases_ && is_in_tablebases()) {
+    if (const absl::optional<Wdl> wdl = tablebases_->probe_wdl(board_)) {
+      ++tablebase_hits_;
+      counters_.add_tablebase_hit();
+      // The fifty move rule spoils cursed wins and blessed losses, which
+      // score a little above and below a draw.
+      const int score = *wdl == Wdl::win    ? tablebase_win_score - ply
+                        : *wdl == Wdl::loss ? -tablebase_win_score + ply
+                                            : 2 * static_cast<int>(*wdl);
+      const Bound bound = *wdl == Wdl::win    ? Bound::lower
+                          : *wdl == Wdl::loss ? Bound::upper
+                                              : Bound::exact;
+      if (bound == Bound::exact || (bound == Bound::lower && score >= beta) ||
+          (bound == Bound::upper && score <= alpha)) {
+        table_->store(key,
+                      std::min(depth + tablebase_depth_bonus,
+                               max_search_ply - 1),
+                      bound, score_to_table(score, ply), absl::nullopt);
+        return score;
+      }
+    }
+  }
+
+  const Color side = board_.is_whites_move_ ? Color::white : Color::black;
+  // The pruning below is only done off the principal variation and out of
+  // check.
+  const bool can_prune = !is_pv_node && !in_check;
+  // A table entry that can't cut off still spares the evaluation.
+  const int static_eval = in_check                   ? -infinite_score
+                          : tt_hit && tt_entry.eval_ ? *tt_entry.eval_
+                                                     : static_evaluation();
+  UndoInfo undo;
+  if (can_prune && !is_mate_score(beta)) {
+    // Reverse futility pruning: this far above beta, a shallow search is
+    // taken to stay above it.
+    if (depth <= reverse_futility_max_depth &&
+        static_eval - reverse_futility_margin * depth >= beta) {
+      return static_eval;
+    }
+    // Null move pruning: if passing still fails high on a reduced search, a
+    // real move would too. Passing is never this good when every move hurts,
+    // which is common with only pawns left, and two passes in a row prove
+    // nothing.
+    const bool after_null_move = ply > 0 && !frames_[ply_idx - 1].move_;
+    if (depth >= null_move_min_depth && static_eval >= beta &&
+        !after_null_move && has_non_pawn_material(board_, side)) {
+      const int reduction =
+          3 + depth / 6 + std::min((static_eval - beta) / 200, 3);
+      frame.move_ = absl::nullopt;
+      frame.continuation_ = nullptr;
+      do_null_move(&undo);
+      const int score =
+          -negamax(depth - 1 - reduction, ply + 1, -beta, -beta + 1, false);
+      undo_null_move(undo);
+      if (stopped_) {
+        return 0;
+      }
+      if (score >= beta) {
+        // An unproven mate from a pass isn't worth passing on.
+        return is_mate_score(score) ? beta : score;
+      }
+    }
+
+    // ProbCut: a good capture that beats beta by a margin on a much
+    // shallower search is taken to beat beta on the full one. Quiescence
+    // search weeds out most captures before the shallow search is paid for.
+    // A table entry deep enough to have looked already, and below the
+    // raised beta, says that it won't work.
+    const int probcut_beta = beta + probcut_margin;
+    if (depth >= probcut_min_depth && !excluded &&
+        !is_mate_score(probcut_beta) &&
+        !(tt_hit && tt_entry.depth_ >= depth - probcut_reduction + 1 &&
+          score_from_table(tt_entry.score_, ply) < probcut_beta)) {
+      MovePicker picker = MovePicker::for_quiescence(board_, &history_);
+      while (const absl::optional<Move> move = picker.next()) {
+        if (!board_.see_ge(*move, probcut_beta - static_eval) ||
+            !board_.is_legal(*move, info)) {
+          continue;
+        }
+        frame.move_ = *move;
+        frame.continuation_ = history_.continuation(side, *move);
+        do_move(*move, &undo);
+        int score = -quiescence(ply + 1, -probcut_beta, -probcut_beta + 1);
+        if (score >= probcut_beta && !stopped_) {
+          score = -negamax(depth - probcut_reduction, ply + 1, -probcut_beta,
+                           -probcut_beta + 1, false);
+        }
+        undo_move(*move, undo);
+        if (stopped_) {
+          return 0;
+        }
+        if (score >= probcut_beta) {
+          table_->store(key, depth - probcut_reduction + 1, Bound::lower,
+                        score_to_table(score, ply), *move, static_eval);
+          return score;
+        }
+      }
+    }
+  }
+
+  const absl::optional<Move> pv_move =
+      on_pv && ply_idx < prev_pv_.size()
+          ? absl::optional<Move>(prev_pv_[ply_idx])
+          : absl::nullopt;
+  const absl::optional<Move> first_move =
+      pv_move ? pv_move : tt_hit ? tt_entry.move_ : absl::nullopt;
+  if (!first_move && depth >= iir_min_depth) {
+    --depth;
+  }
+
+  // Singular extensions: the table move is extended if every other move
+  // fails low on a shallower search below the table's score. If even that
+  // lowered bound is at least beta, several moves beat beta and the node is
+  // cut off (multi-cut).
+  absl::optional<Move> singular_move;
+  if (ply > 0 && !excluded && tt_hit && tt_entry.move_ &&
+      depth >= singular_min_depth &&
+      tt_entry.depth_ >= depth - singular_depth_slack &&
+      tt_entry.bound_ != Bound::upper && ply < max_search_ply / 2) {
+    const int tt_score = score_from_table(tt_entry.score_, ply);
+    if (!is_mate_score(tt_score)) {
+      const int singular_beta = tt_score - singular_margin * depth;
+      frame.excluded_ = tt_entry.move_;
+      const int score = negamax((depth - 1) / 2, ply, singular_beta - 1,
+                                singular_beta, false);
+      frame.excluded_ = absl::nullopt;
+      if (stopped_) {
+        return 0;
+      }
+      if (score < singular_beta) {
+        singular_move = tt_entry.move_;
+      } else if (singular_beta >= beta) {
+        return singular_beta;
+      }
+    }
+  }
+
+  const absl::optional<Move> previous =
+      ply > 0 ? frames_[ply_idx - 1].move_ : absl::nullopt;
+  const absl::optional<Move> countermove =
+      previous ? history_.countermove(flip_color(side), *previous)
+               : absl::nullopt;
+  MovePicker picker(board_, first_move, frame.killers_, countermove,
+                    &history_, continuations(ply));
+  const int original_alpha = alpha;
+  int best = -infinite_score;
+  absl::optional<Move> best_move;
+  int num_legal_moves = 0;
+  int num_searched = 0;
+  frame.quiets_tried_.clear();
+  frame.captures_tried_.clear();
+  frame.deferred_.clear();
+  // The moves deferred by ABDADA come last, and aren't deferred again.
+  size_t num_deferred_taken = 0;
+  const auto next_move = [&picker, &frame,
+                          &num_deferred_taken]() -> absl::optional<Move> {
+    if (const absl::optional<Move> move = picker.next()) {
+      return move;
+    }
+    if (num_deferred_taken < frame.deferred_.size()) {
+      return frame.deferred_[num_deferred_taken++];
+    }
+    return absl::nullopt;
+  };
+  const bool can_defer = searching_ && ply > 0 && depth >= abdada_min_depth;
+  while (const absl::optional<Move> move = next_move()) {
+    if (ply == 0 && std::find(excluded_root_moves_.begin(),
+                              excluded_root_moves_.end(),
+                              *move) != excluded_root_moves_.end()) {
+      continue;
+    }
+    if (move == excluded) {
+      continue;
+    }
+    if (!board_.is_legal(*move, info)) {
+      INSTRUMENT_COUNT(illegal_moves);
+      continue;
+    }
+    ++num_legal_moves;
+    const bool quiet = is_quiet(*move);
+    const bool checks = board_.gives_check(*move, info);
+    if (can_prune && quiet && !checks && num_searched > 0 &&
+        best > -mate_score + max_search_ply) {
+      // Late move pruning: quiet moves this late in the order rarely matter
+      // this close to the leaves.
+      if (depth <= late_move_max_depth &&
+          frame.quiets_tried_.size() >= late_move_count(depth)) {
+        continue;
+      }
+      // Futility pruning: a quiet move isn't going to make up this much.
+      const int futility_score = static_eval + futility_margin * depth;
+      if (depth <= futility_max_depth && futility_score <= alpha) {
+        best = std::max(best, futility_score);
+        continue;
+      }
+    }
+
+    // Late move reductions: quiet moves after the first few are searched
+    // shallower. Every root move gets a full depth search.
+    int reduction = 0;
+    if (ply > 0 && depth >= reduction_min_depth &&
+        num_searched >= reduction_min_moves && quiet && !in_check && !checks) {
+      reduction = late_move_reduction(depth, num_searched) -
+                  (is_pv_node ? 1 : 0) -
+                  history_.quiet_score(side, *move) /
+                      (MoveHistory::max_score / 2);
+      reduction = std::max(0, std::min(reduction, depth - 2));
+    }
+    frame.move_ = *move;
+    frame.continuation_ = history_.continuation(side, *move);
+    do_move(*move, &undo);
+    // ABDADA: a move to a position another thread is searching waits until
+    // the rest are done, by when its result is likely in the table.
+    if (can_defer) {
+      if (num_deferred_taken == 0 && num_searched > 0 &&
+          searching_->contains(board_.key_)) {
+        undo_move(*move, undo);
+        frame.deferred_.push_back(*move);
+        --num_legal_moves;
+        continue;
+      }
+      searching_->insert(board_.key_);
+    }
+    ++num_searched;
+    const int new_depth = depth - 1 + (move == singular_move ? 1 : 0);
+    const bool child_on_pv = on_pv && pv_move == move;
+    int score = 0;
+    if (num_searched == 1) {
+      score = -negamax(new_depth, ply + 1, -beta, -alpha, child_on_pv);
+    } else {
+      // Principal variation search: the first move is expected to be best,
+      // so the others only have to be shown worse with a null window, which
+      // is searched again in full if the move beats alpha after all.
+      score = -negamax(new_depth - reduction, ply + 1, -alpha - 1, -alpha,
+                       false);
+      if (score > alpha && reduction > 0 && !stopped_) {
+        score = -negamax(new_depth, ply + 1, -alpha - 1, -alpha, false);
+      }
+      if (score > alpha && score < beta && !stopped_) {
+        score = -negamax(new_depth, ply + 1, -beta, -alpha, child_on_pv);
+      }
+    }
+    if (can_defer) {
+      searching_->erase(board_.key_);
+    }
+    undo_move(*move, undo);
+    if (stopped_) {
+      return 0;
+    }
+    if (score > best) {
+      best = score;
+      if (score > alpha) {
+        alpha = score;
+        best_move = move;
+        update_pv(ply, *move);
+        if (score >= beta) {
+          INSTRUMENT_CUTOFF(static_cast<size_t>(num_searched - 1));
+          update_history(ply, depth, *move);
+          break;
+        }
+      }
+    }
+    if (quiet) {
+      frame.quiets_tried_.push_back(*move);
+    } else {
+      frame.captures_tried_.push_back(*move);
+    }
+  }
+  if (num_legal_moves == 0) {
+    // Without the excluded move there may be no other, which says nothing
+    // about mate.
+    if (excluded) {
+      return alpha;
+    }
+    return in_check ? -mate_score + ply : 0;
+  }
+  if (excluded) {
+    return best;
+  }
+  const Bound bound = best >= beta             ? Bound::lower
+                      : best > original_alpha ? Bound::exact
+                                              : Bound::upper;
+  table_->store(key, depth, bound, score_to_table(best, ply), best_move,
+                in_check ? absl::nullopt : absl::optional<int>(static_eval));
+  return best;
+}
+
+int Searcher::quiescence(int ply, int alpha, int beta) {
+  pv_length_[static_cast<size_t>(ply)] = ply;
+  INSTRUMENT_COUNT(quiescence_nodes);
+  if (is_stopping(ply)) {
+    return 0;
+  }
+  if (ply >= max_search_ply - 1) {
+    return static_evaluation();
+  }
+  const CheckInfo info = board_.check_info();
+  UndoInfo undo;
+  if (info.checkers_) {
+    // Standing pat isn't an option in check, so every evasion is searched,
+    // which also finds the mates.
+    INSTRUMENT_COUNT(evasion_generations);
+    const MoveList evasions = board_.legal_evasions();
+    if (evasions.empty()) {
+      return -mate_score + ply;
+    }
+    int best = -infinite_score;
+    for (Move move : evasions) {
+      do_move(move, &undo);
+      const int score = -quiescence(ply + 1, -beta, -alpha);
+      undo_move(move, undo);
+      if (stopped_) {
+        return 0;
+      }
+      if (score > best) {
+        best = score;
+        if (score > alpha) {
+          alpha = score;
+          update_pv(ply, move);
+          if (score >= beta) {
+            break;
+          }
+        }
+      }
+    }
+    return best;
+  }
+
+  // Otherwise the side to move can stop capturing, so the evaluation is a
+  // lower bound.
+  const int stand_pat = static_evaluation(alpha, beta);
+  if (stand_pat >= beta) {
+    return stand_pat;
+  }
+  alpha = std::max(alpha, stand_pat);
+  int best = stand_pat;
+  // The picker only hands out captures and promotions that don't lose
+  // material by SEE, so the rest are pruned already.
+  MovePicker picker = MovePicker::for_quiescence(board_, &history_);
+  while (const absl::optional<Move> move = picker.next()) {
+    // Delta pruning. The bound the skipped move could reach keeps the result
+    // an upper bound when every move is skipped.
+    const int optimistic_score =
+        stand_pat + material_gain(board_, *move) + delta_margin;
+    if (optimistic_score <= alpha) {
+      best = std::max(best, optimistic_score);
+      continue;
+    }
+    if (!board_.is_legal(*move, info)) {
+      INSTRUMENT_COUNT(illegal_moves);
+      continue;
+    }
+    do_move(*move, &undo);
+    const int score = -quiescence(ply + 1, -beta, -alpha);
+    undo_move(*move, undo);
+    if (stopped_) {
+      return 0;
+    }
+    if (score > best) {
+      best = score;
+      if (score > alpha) {
+        alpha = score;
+        update_pv(ply, *move);
+        if (score >= beta) {
+          break;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+bool Searcher::is_in_tablebases() const {
+  return tablebases_ && !board_.castling_rights_ &&
+         popcount(board_.occupancy_) <= tablebases_->max_pieces();
+}
+
+int Searcher::static_evaluation() {
+  if (const absl::optional<int> cached = eval_table_.probe(board_.key_)) {
+    return *cached;
+  }
+  INSTRUMENT_PHASE(evaluation);
+  const int score = network_ ? evaluate(board_, &accumulators_)
+                             : evaluate(board_, &pawn_table_);
+  eval_table_.store(board_.key_, score);
+  return score;
+}
+
+int Searcher::static_evaluation(int alpha, int beta) {
+  if (network_) {
+    return static_evaluation();
+  }
+  if (const absl::optional<int> cached = eval_table_.probe(board_.key_)) {
+    return *cached;
+  }
+  INSTRUMENT_PHASE(evaluation);
+  bool is_exact;
+  const int score = evaluate(board_, &pawn_table_, alpha, beta, &is_exact);
+  if (is_exact) {
+    eval_table_.store(board_.key_, score);
+  }
+  return score;
+}
+
+void Searcher::do_move(Move move, UndoInfo* undo) {
+  INSTRUMENT_COUNT(moves_made);
+  const uint64_t pawn_key = board_.pawn_key_;
+  if (network_) {
+    DirtyPieces dirty;
+    board_.do_move(move, undo, &dirty);
+    accumulators_.push(dirty);
+  } else {
+    board_.do_move(move, undo);
+  }
+  table_->prefetch(board_.key_);
+  eval_table_.prefetch(board_.key_);
+  if (!network_ && board_.pawn_key_ != pawn_key) {
+    pawn_table_.prefetch(board_.pawn_key_);
+  }
+  key_history_.push(board_);
+}
+
+void Searcher::undo_move(Move move, const UndoInfo& undo) {
+  INSTRUMENT_COUNT(moves_unmade);
+  board_.undo_move(move, undo);
+  key_history_.pop();
+  if (network_) {
+    accumulators_.pop();
+  }
+}
+
+void Searcher::do_null_move(UndoInfo* undo) {
+  board_.do_null_move(undo);
+  table_->prefetch(board_.key_);
+  eval_table_.prefetch(board_.key_);
+  key_history_.push_null(board_);
+  if (network_) {
+    accumulators_.push_null();
+  }
+}
+
+void Searcher::undo_null_move(const UndoInfo& undo) {
+  board_.undo_null_move(undo);
+  key_history_.pop();
+  if (network_) {
+    accumulators_.pop();
+  }
+}
+
+bool Searcher::is_stopping(int ply) {
+  const uint64_t nodes = counters_.add_node(ply);
+  INSTRUMENT_COUNT(nodes);
+  if (max_nodes_ && nodes >= max_nodes_) {
+    stopped_ = true;
+  }
+  if (nodes % stop_check_interval == 0 &&
+      ((stop_ && stop_->load(std::memory_order_relaxed)) ||
+       (time_manager_ && time_manager_->is_hard_limit_reached()))) {
+    stopped_ = true;
+  }
+  return stopped_;
+}
+
+void Searcher::update_pv(int ply, Move move) {
+  const size_t ply_idx = static_cast<size_t>(ply);
+  const int child_length = pv_length_[ply_idx + 1];
+  pv_[ply_idx][ply_idx] = move;
+  for (size_t i = ply_idx + 1; i < static_cast<size_t>(child_length); ++i) {
+    pv_[ply_idx][i] = pv_[ply_idx + 1][i];
+  }
+  pv_length_[ply_idx] = child_length;
+}
+
+ContinuationHistories Searcher::continuations(int ply) const {
+  ContinuationHistories res = {};
+  for (size_t i = 0; i < continuation_plies.size(); ++i) {
+    if (ply >= continuation_plies[i]) {
+      res[i] = frames_[static_cast<size_t>(ply - continuation_plies[i])]
+                   .continuation_;
+    }
+  }
+  return res;
+}
+
+void Searcher::update_history(int ply, int depth, Move best) {
+  const Frame& frame = frames_[static_cast<size_t>(ply)];
+  const Color side = board_.is_whites_move_ ? Color::white : Color::black;
+  // Deeper cutoffs save more work, so they count for more.
+  const int bonus = std::min(depth * depth, max_history_bonus);
+  if (is_quiet(best)) {
+    store_killer(ply, best);
+    const absl::optional<Move> previous =
+        ply > 0 ? frames_[static_cast<size_t>(ply) - 1].move_ : absl::nullopt;
+    if (previous) {
+      history_.set_countermove(flip_color(side), *previous, best);
+    }
+    history_.update_quiet(side, best, bonus);
+    for (Move move : frame.quiets_tried_) {
+      history_.update_quiet(side, move, -bonus);
+    }
+    for (size_t i = 0; i < continuation_plies.size(); ++i) {
+      if (ply < continuation_plies[i]) {
+        break;
+      }
+      PieceToHistory* continuation =
+          frames_[static_cast<size_t>(ply - continuation_plies[i])]
+              .continuation_;
+      if (!continuation) {
+        continue;
+      }
+      MoveHistory::update_continuation(continuation, best, bonus);
+      for (Move move : frame.quiets_tried_) {
+        MoveHistory::update_continuation(continuation, move, -bonus);
+      }
+    }
+  } else {
+    history_.update_capture(board_, best, bonus);
+  }
+  for (Move move : frame.captures_tried_) {
+    history_.update_capture(board_, move, -bonus);
+  }
+}
+
+void Searcher::store_killer(int ply, Move move) {
+  std::array<absl::optional<Move>, num_killers>& killers =
+      frames_[static_cast<size_t>(ply)].killers_;
+  if (!(killers[0] && *killers[0] == move)) {
+    killers[1] = killers[0];
+    killers[0] = move;
+  }
+}
+
+ParallelSearcher::ParallelSearcher(ThreadPool* pool, TranspositionTable* table)
+    : pool_(pool),
+      table_(table),
+      smp_mode_(SmpMode::lazy),
+      network_(nullptr),
+      replicate_network_(false) {
+  const size_t num_helpers = pool ? pool->num_threads() : 0;
+  for (size_t i = 0; i <= num_helpers; ++i) {
+    searchers_.push_back(std::make_unique<Searcher>(table));
+  }
+}
+
+SearchResult ParallelSearcher::search(
+    const Board& board, const SearchLimits& limits,
+    const Searcher::IterationCallback& on_iteration) {
+  INSTRUMENT_PHASE(search);
+  const TraceSpan span(searchers_[0]->trace_buffer(), "search");
+  table_->new_search();
+  std::atomic<bool> stop(false);
+  for (size_t i = 1; i < searchers_.size(); ++i) {
+    Searcher* helper = searchers_[i].get();
+    // Before the helper starts, so that the first iteration of the calling
+    // thread doesn't count what the helper did in the last search.
+    helper->clear_counters();
+    const int first_depth =
+        smp_mode_ == SmpMode::lazy && i % 2 == 1 ? 2 : 1;
+    pool_->submit([this, &board, &stop, helper, first_depth] {
+      const TraceSpan helper_span(helper->trace_buffer(), "helper search",
+                                  "first depth", first_depth);
+      // Any worker may take the task, so the copy is picked here.
+      if (!network_copies_.empty()) {
+        helper->set_network_copy(
+            network_copies_[pool_->numa_node(*pool_->worker_index())].get());
+      }
+      helper->search_iterations(board, first_depth,
+                                {max_search_ply - 1, 0, &stop, nullptr},
+                                nullptr);
+    });
+  }
+  Searcher::IterationCallback report_iteration;
+  if (on_iteration) {
+    report_iteration = [this, &on_iteration](const SearchResult& res) {
+      SearchResult total = res;
+      add_up_counters(&total);
+      on_iteration(total);
+    };
+  }
+  SearchResult res =
+      searchers_[0]->search_iterations(board, 1, limits, report_iteration);
+  stop.store(true, std::memory_order_relaxed);
+  if (pool_) {
+    pool_->wait();
+  }
+  add_up_counters(&res);
+  return res;
+}
+
+void ParallelSearcher::set_smp_mode(SmpMode mode) {
+  smp_mode_ = mode;
+  // Alone, a searcher would only find its own line in the set.
+  const bool share = mode == SmpMode::abdada && searchers_.size() > 1;
+  for (const std::unique_ptr<Searcher>& searcher : searchers_) {
+    searcher->set_searching_set(share ? &searching_ : nullptr);
+  }
+}
+
+void ParallelSearcher::add_up_counters(SearchResult* res) const {
+  res->nodes_ = 0;
+  res->selective_depth_ = 0;
+  res->tablebase_hits_ = 0;
+  for (const std::unique_ptr<Searcher>& searcher : searchers_) {
+    const SearchCounters& counters = searcher->counters();
+    res->nodes_ += counters.nodes_.load(std::memory_order_relaxed);
+    res->selective_depth_ =
+        std::max(res->selective_depth_,
+                 counters.selective_depth_.load(std::memory_order_relaxed));
+    res->tablebase_hits_ +=
+        counters.tablebase_hits_.load(std::memory_order_relaxed);
+  }
+}
+
+void ParallelSearcher::set_game_history(const KeyHistory& history) {
+  for (const std::unique_ptr<Searcher>& searcher : searchers_) {
+    searcher->set_game_history(history);
+  }
+}
+
+void ParallelSearcher::set_network(const NnueNetwork* network) {
+  network_ = network;
+  for (const std::unique_ptr<Searcher>& searcher : searchers_) {
+    searcher->set_network(network);
+  }
+  network_copies_.clear();
+  if (!network || !replicate_network_ || !pool_ ||
+      numa_nodes().size() <= 1) {
+    return;
+  }
+  for (size_t i = 0; i < pool_->num_threads(); ++i) {
+    const size_t node = pool_->numa_node(i);
+    if (node >= network_copies_.size()) {
+      network_copies_.resize(node + 1);
+    }
+    if (!network_copies_[node]) {
+      run_on_numa_node(node, [this, network, node] {
+        network_copies_[node] = copy_network(*network);
+      });
+    }
+  }
+}
+
+void ParallelSearcher::set_network_replication(bool replicate) {
+  replicate_network_ = replicate;
+  set_network(network_);
+}
+
+void ParallelSearcher::set_tablebases(const Tablebases* tablebases) {
+  for (const std::unique_ptr<Searcher>& searcher : searchers_) {
+    searcher->set_tablebases(tablebases);
+  }
+}
+
+void ParallelSearcher::set_tracer(Tracer* tracer) {
+  for (size_t i = 0; i < searchers_.size(); ++i) {
+    searchers_[i]->set_trace_buffer(
+        tracer ? tracer->new_buffer(i == 0 ? std::string("search")
+                                           : absl::StrCat("helper ", i))
+               : nullptr);
+  }
+}
+
+SearchResult parallel_search(const Board& board, const SearchLimits& limits,
+                             ThreadPool* pool, TranspositionTable* table,
+                             const Searcher::IterationCallback& on_iteration) {
+  return ParallelSearcher(pool, table).search(board, limits, on_iteration);
+}
@@ -0,0 +1,495 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "eval.h"
+#include "history.h"
+#include "move_picker.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "repetition.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+#include "time_manager.h"
+#include "trace.h"
+#include "transposition_table.h"
+
+// Scores are in centipawns from the point of view of the side to move. Being
+// mated `n` plies from the root scores `-mate_score + n`, so that the search
+// prefers quicker mates and slower losses.
+constexpr int mate_score = 30000;
+constexpr int infinite_score = mate_score + 1;
+// The deepest ply from the root the search goes, quiescence search included.
+constexpr int max_search_ply = 64;
+
+// A position that the tablebases say is won scores this less its ply, below
+// every mate score and above every evaluation.
+constexpr int tablebase_win_score = mate_score - 2 * max_search_ply;
+
+// Returns true if `score` says that one side mates the other.
+constexpr bool is_mate_score(int score) {
+  return score >= mate_score - max_search_ply ||
+         score <= -mate_score + max_search_ply;
+}
+
+// One of the principal variations of a multi-PV search.
+struct SearchLine {
+  int score_;
+  std::vector<Move> pv_;
+};
+
+struct SearchResult {
+  // The best move at the root, or nullopt if the side to move has no legal
+  // moves.
+  absl::optional<Move> best_move_;
+  int score_;
+  // The depth of the last completed iteration.
+  int depth_;
+  // The principal variation, starting with `best_move_`.
+  std::vector<Move> pv_;
+  // The number of positions visited by all iterations so far, quiescence
+  // search included.
+  uint64_t nodes_;
+  // The deepest ply from the root that the iterations so far visited.
+  int selective_depth_;
+  // The positions whose result the iterations so far took from the
+  // tablebases.
+  uint64_t tablebase_hits_;
+  // Every principal variation searched, best first, starting with `score_`
+  // and `pv_`. There is only one unless the searcher looks for several.
+  std::vector<SearchLine> lines_;
+};
+
+// How often the caches of a searcher found what they were asked for, counted
+// since the searcher was made.
+struct SearcherStats {
+  uint64_t eval_probes_;
+  uint64_t eval_hits_;
+  uint64_t pawn_probes_;
+  uint64_t pawn_hits_;
+  uint64_t tablebase_hits_;
+};
+
+// What a searcher has counted of the search it is running, or of its last one,
+// for other threads to read as it goes. Only one thread at a time writes the
+// counters, the searcher's while it searches, with relaxed loads and stores,
+// which cost what plain ones do where an atomic increment would lock the bus.
+// The counters have a cache line of their own, so that a thread reading them
+// doesn't take the lines of the searcher's other members away from it, nor one
+// searcher's counters those of another.
+struct alignas(64) SearchCounters {
+  std::atomic<uint64_t> nodes_;
+  std::atomic<int> selective_depth_;
+  std::atomic<uint64_t> tablebase_hits_;
+
+  SearchCounters() { clear(); }
+
+  // For the one thread that writes them.
+  void clear() {
+    nodes_.store(0, std::memory_order_relaxed);
+    selective_depth_.store(0, std::memory_order_relaxed);
+    tablebase_hits_.store(0, std::memory_order_relaxed);
+  }
+  // Counts a node at `ply` and returns the number of nodes.
+  uint64_t add_node(int ply) {
+    const uint64_t nodes = nodes_.load(std::memory_order_relaxed) + 1;
+    nodes_.store(nodes, std::memory_order_relaxed);
+    if (ply > selective_depth_.load(std::memory_order_relaxed)) {
+      selective_depth_.store(ply, std::memory_order_relaxed);
+    }
+    return nodes;
+  }
+  void add_tablebase_hit() {
+    tablebase_hits_.store(
+        tablebase_hits_.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+};
+
+// The positions that the threads of a parallel search are searching, for
+// ABDADA (see ParallelSearcher), which any number of threads mark and look up
+// without locks. Each key has one slot, by its low bits, holding the key: a
+// thread marks a position by storing its key, and clears it only if the slot
+// still holds it. Two positions in one slot, or two threads in one position,
+// can make a position look unsearched while it is searched, which only costs
+// the work ABDADA would have saved.
+class SearchingSet {
+ public:
+  static constexpr size_t num_slots = size_t{1} << 15;
+
+  SearchingSet();
+  SearchingSet(const SearchingSet&) = delete;
+  SearchingSet& operator=(const SearchingSet&) = delete;
+
+  void insert(uint64_t key) {
+    slot(key).store(key, std::memory_order_relaxed);
+  }
+  void erase(uint64_t key) {
+    slot(key).compare_exchange_strong(key, 0, std::memory_order_relaxed);
+  }
+  bool contains(uint64_t key) const {
+    return slot(key).load(std::memory_order_relaxed) == key;
+  }
+
+ private:
+  std::atomic<uint64_t>& slot(uint64_t key) const {
+    return slots_[key & (num_slots - 1)];
+  }
+
+  std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+};
+
+// What ends a search, besides running out of moves.
+struct SearchLimits {
+  // At least 1 and less than `max_search_ply`.
+  int max_depth_;
+  // The search stops once it has visited this many nodes, unless it is 0.
+  uint64_t max_nodes_;
+  // If not null, the search stops soon after `*stop_` is set.
+  const std::atomic<bool>* stop_;
+  // If not null, no iteration starts after its soft limit, and once an
+  // iteration is complete the search also stops at its hard limit.
+  TimeManager* time_manager_;
+};
+
+// A fixed depth negamax alpha-beta search with iterative deepening:
+//
+//  - Each iteration searches one ply deeper than the last, trying the
+//    principal variation of the previous iteration first, in a window around
+//    its score that widens when the score falls outside (aspiration windows).
+//  - After the first move of a node, the others are searched with a null
+//    window, and again with the full window only if they beat alpha
+//    (principal variation search).
+//  - The moves come from a MovePicker, with two killer moves per ply, a
+//    countermove and the searcher's MoveHistory, which every cutoff updates.
+//    They are checked with `Board::is_legal` before they are done, so nothing
+//    is generated twice and no board is copied. The continuation histories
+//    of the moves 1, 2 and 4 plies up are found through the frames of those
+//    plies.
+//  - At the leaves a quiescence search plays out captures and promotions, so
+//    that the evaluation isn't taken in the middle of an exchange. The side
+//    to move may stand pat on the evaluation, captures that lose material by
+//    SEE are never searched, and captures that couldn't bring the score up
+//    to alpha even with a margin are skipped (delta pruning). It searches all
+//    evasions when in check.
+//  - Results are stored in a transposition table, whose best move is tried
+//    first and whose bounds cut off the search off the principal variation.
+//  - Null window searches are selective: reverse futility and null move
+//    pruning cut nodes far above beta, as does ProbCut when a good capture
+//    beats beta by a margin on a much shallower search, futility and late
+//    move pruning skip quiet moves that can't matter near the leaves, and
+//    late move reductions search late quiet moves shallower. None of it
+//    applies in check, and checking moves are never pruned or reduced.
+//  - A side in check is given one more ply. So is the table move when a
+//    shallower search without it, in a window below the table's score,
+//    fails low: every other move is clearly worse, so the line is forced
+//    (singular extensions). A node that has no table move is searched one
+//    ply shallower, as a deep search without a good first move costs much
+//    and is soon searched again with the move the table then has (internal
+//    iterative reductions).
+//  - For several principal variations (MultiPV), every iteration searches the
+//    root once per line, each time without the root moves of the lines found
+//    before it. The lines share the table, killers and history, so the later
+//    ones cost much less than separate searches would.
+//  - Repetitions within the search, threefold repetitions and the fifty move
+//    rule score as draws. A side that has a move back to a drawn position
+//    gets at least the draw, which the key history finds without generating
+//    moves.
+//  - With a network (see nnue.h), positions are evaluated by it. Every move
+//    done on the board records what it changed on a stack of accumulators,
+//    which are only computed for the positions that get evaluated.
+//  - Static evaluations are cached by key, in a small table of the searcher's
+//    own, and stored with the results in the transposition table, so that an
+//    entry whose bound doesn't cut off still spares the evaluation.
+//  - With tablebases (see tablebase.h), a root they cover is only searched
+//    with the moves that keep its result, and the search doesn't probe them
+//    further. Otherwise positions they cover after a capture or pawn move
+//    take their result, as a bound if it doesn't cut the search off.
+//
+// The board is walked with do/undo, and the principal variations are kept in
+// a fixed triangular table, so the search doesn't allocate apart from the
+// vectors of the results.
+class Searcher {
+ public:
+  // The searcher uses `table` without owning it, so that one table can be
+  // kept between searches and shared by searchers.
+  explicit Searcher(TranspositionTable* table);
+
+  // Called with the result of every completed iteration.
+  typedef std::function<void(const SearchResult&)> IterationCallback;
+
+  // Makes the following searches use `table` instead, so that a searcher can
+  // serve searches of several tables in turn.
+  void set_table(TranspositionTable* table) { table_ = table; }
+
+  // Makes the searches look for the best `num_lines` root moves, each with
+  // its score and principal variation, rather than the best one only. Fewer
+  // are found when there are fewer legal moves.
+  void set_multi_pv(size_t num_lines);
+  // Makes the searches evaluate with `network`, which isn't owned, or with
+  // the classical evaluation if it is null. Endgames with an evaluation of
+  // their own (see endgame.h) keep it either way.
+  void set_network(const NnueNetwork* network);
+  // Same, for a copy of the network already set, such as one on the NUMA
+  // node the searcher runs on. The evaluations cached with the network are
+  // kept, since the copy gives the same.
+  void set_network_copy(const NnueNetwork* network) { network_ = network; }
+  // Makes the searches probe `tablebases`, which aren't owned, or none if it
+  // is null.
+  void set_tablebases(const Tablebases* tablebases) {
+    tablebases_ = tablebases;
+  }
+  // Gives the searches the positions of the game before the position they
+  // search, for finding repetitions of them. The history is copied, and is
+  // only used by searches of the position it ends with.
+  void set_game_history(const KeyHistory& history) { game_history_ = history; }
+  // Makes the next search start its first iteration from `pv`, such as the
+  // principal variation of an earlier search of the same position, rather
+  // than from the table alone. Moves that aren't legal are searched as any
+  // table move would be, after checking them.
+  void set_first_pv(std::vector<Move> pv) { first_pv_ = std::move(pv); }
+  // Makes the searches record their iterations into `buffer`, which isn't
+  // owned, or record nothing if it is null.
+  void set_trace_buffer(TraceBuffer* buffer) { trace_buffer_ = buffer; }
+  // Makes the searches share `searching` with the other searchers of an
+  // ABDADA search, or search alone if it is null. Not owned.
+  void set_searching_set(SearchingSet* searching) { searching_ = searching; }
+  TraceBuffer* trace_buffer() const { return trace_buffer_; }
+  SearcherStats stats() const;
+  // The counts of the search in progress, or of the last one, which any
+  // thread may read.
+  const SearchCounters& counters() const { return counters_; }
+  // Sets the counts to 0 before the searcher's thread starts a search, which
+  // does the same.
+  void clear_counters() { counters_.clear(); }
+  // Forgets what the searches so far learned, the move history and the
+  // cached evaluations, as if the searcher were new. With its table cleared
+  // too, a search with a node limit and no other limit then visits the same
+  // nodes and returns the same result every time.
+  void clear();
+
+  // Searches `board` with iterative deepening up to `max_depth` plies, which
+  // must be at least 1 and less than `max_search_ply`.
+  SearchResult search(const Board& board, int max_depth,
+                      const IterationCallback& on_iteration = nullptr);
+  // Like `search`, but starts at `first_depth`, stops at `limits` and leaves
+  // the table's generation alone, so that several searchers can take part in
+  // one search. A search that stops early returns the last completed
+  // iteration, and an empty result if none completed.
+  SearchResult search_iterations(const Board& board, int first_depth,
+                                 const SearchLimits& limits,
+                                 const IterationCallback& on_iteration);
+
+  // Return the static evaluation of `board`, and the score of a quiescence
+  // search of it with a full window, for labeling positions in bulk (see
+  // position_labeler.h). Neither touches the table, the killers or the game
+  // history, and they set up nothing but the board, its key history and,
+  // with a network, its accumulator, so that a searcher can label any
+  // number of positions one after the other. The cached evaluations carry
+  // over from one position to the next.
+  int evaluate_position(const Board& board);
+  int quiescence_score(const Board& board);
+
+ private:
+  // Makes `board` the root for `evaluate_position` and `quiescence_score`.
+  void set_label_root(const Board& board);
+  // Searches the root to `depth` and returns its score.
+  int search_root(int depth, int previous_score);
+  // `on_pv` is true on the principal variation of the previous iteration, whose
+  // moves are tried first.
+  int negamax(int depth, int ply, int alpha, int beta, bool on_pv);
+  int quiescence(int ply, int alpha, int beta);
+  // Returns true if the tablebases have `board_`'s material, and the
+  // position could be in them.
+  bool is_in_tablebases() const;
+  // Returns the static evaluation of `board_`.
+  int static_evaluation();
+  // Same, but without the network the evaluation may stop at its cheap part
+  // when that is far outside (alpha, beta) (see `lazy_eval_margin`), for the
+  // stand pat of the quiescence search. Such scores aren't cached.
+  int static_evaluation(int alpha, int beta);
+  // Do and take back moves on `board_`, keeping the accumulators of the
+  // network in step. Doing a move prefetches what the child will probe in
+  // the tables, so that the loads overlap the work before the probes.
+  void do_move(Move move, UndoInfo* undo);
+  void undo_move(Move move, const UndoInfo& undo);
+  void do_null_move(UndoInfo* undo);
+  void undo_null_move(const UndoInfo& undo);
+  // Counts a node at `ply` and returns true if the search is to stop.
+  bool is_stopping(int ply);
+  // Makes `move` the first move of the principal variation at `ply`, followed
+  // by the one at `ply + 1`.
+  void update_pv(int ply, Move move);
+  // Returns the continuation histories of the node at `ply`.
+  ContinuationHistories continuations(int ply) const;
+  // Rewards `best`, which caused a cutoff at `ply`, and penalizes the moves
+  // tried before it.
+  void update_history(int ply, int depth, Move best);
+  void store_killer(int ply, Move move);
+
+  TranspositionTable* table_;
+  const std::atomic<bool>* stop_;
+  uint64_t max_nodes_;
+  // Set once a limit is reached, after which the search unwinds.
+  bool stopped_;
+  // Only set once an iteration is complete, so that there is always a move.
+  const TimeManager* time_manager_;
+  Board board_;
+  KeyHistory game_history_;
+  // The game history followed by the positions from the root to the current
+  // one.
+  KeyHistory key_history_;
+  // What the search keeps for each ply of the current line. The frames are
+  // one array indexed by ply, allocated with the searcher, so that no node
+  // allocates and a node finds the data of the plies above it next to its
+  // own.
+  struct Frame {
+    // The move being searched, nullopt for a null move.
+    absl::optional<Move> move_;
+    // The continuation history of the moves that follow `move_`, null for a
+    // null move.
+    PieceToHistory* continuation_;
+    // The move that the singular extension search of this node leaves out.
+    absl::optional<Move> excluded_;
+    std::array<absl::optional<Move>, num_killers> killers_;
+    // The moves tried before the current one, which lose history score on a
+    // cutoff.
+    MoveList quiets_tried_;
+    MoveList captures_tried_;
+    // The moves put off because another thread was searching them, see
+    // ParallelSearcher.
+    MoveList deferred_;
+  };
+  std::array<Frame, max_search_ply> frames_;
+  // Kept from one search to the next, unlike the killers.
+  MoveHistory history_;
+  PawnTable pawn_table_;
+  EvalTable eval_table_;
+  const NnueNetwork* network_;
+  // The accumulators of the positions from the root to the current one, only
+  // used with a network.
+  AccumulatorStack accumulators_;
+  // pv_[ply] holds the principal variation from `ply` on in
+  // pv_[ply][ply, pv_length_[ply]).
+  std::array<std::array<Move, max_search_ply>, max_search_ply> pv_;
+  std::array<int, max_search_ply> pv_length_;
+  // The principal variation of the previous iteration, for the current line.
+  std::vector<Move> prev_pv_;
+  // The principal variation the next search starts from, if not empty.
+  std::vector<Move> first_pv_;
+  size_t multi_pv_;
+  // The first moves of the lines already found in this iteration, which the
+  // root skips, after the moves that lose the tablebase result.
+  MoveList excluded_root_moves_;
+  const Tablebases* tablebases_;
+  // The root moves that lose the tablebase result of the root, if it has one.
+  MoveList tablebase_excluded_moves_;
+  // False once the tablebases have ranked the root moves.
+  bool probe_tablebases_;
+  uint64_t tablebase_hits_;
+  TraceBuffer* trace_buffer_;
+  SearchingSet* searching_;
+  SearchCounters counters_;
+};
+
+// How the threads of a ParallelSearcher share the work.
+enum class SmpMode { lazy, abdada };
+
+// Searches as `Searcher::search_iterations` does from depth 1, with the
+// workers of a thread pool helping (Lazy SMP). Every worker runs its own
+// iterative deepening on its own board, killers and stack, and the searchers
+// share nothing but the table: the helpers' results speed the calling thread's
+// search up through the table. Half the helpers search one ply deeper than
+// the calling thread each iteration, so that the threads spread over more of
+// the tree. The limits apply to the calling thread, with the node limit
+// counting its nodes only, and the helpers stop as soon as it does.
+//
+// In SmpMode::abdada the threads instead all search the same iterations and
+// keep out of each other's way (ABDADA, "alpha-beta distribution with a
+// hash table"). A thread marks the positions it searches in a SearchingSet
+// shared by the searchers, and after the first move of a node, which is
+// always searched first as in Young Brothers Wait, it puts off the moves to
+// positions another thread is searching until the node's other moves are
+// done. By then the other thread has usually stored the result in the table.
+// The threads spread over the siblings of the same nodes, rather than over
+// depths, which makes the time to a given depth scale more evenly with
+// threads.
+//
+// The searchers are kept from one search to the next, so that their move
+// histories carry over between the moves of a game, as the table does.
+class ParallelSearcher {
+ public:
+  // `pool` may be null, for a search on the calling thread alone. Neither is
+  // owned, and the pool must not change its number of threads.
+  ParallelSearcher(ThreadPool* pool, TranspositionTable* table);
+
+  // The result is that of the calling thread, except for the counts, which
+  // are those of all threads: the nodes and tablebase hits added up and the
+  // deepest selective depth. `on_iteration` is only called from the calling
+  // thread, with the counts of all threads so far, which it reads from their
+  // counters without stopping them.
+  SearchResult search(
+      const Board& board, const SearchLimits& limits,
+      const Searcher::IterationCallback& on_iteration = nullptr);
+  // Sets the number of lines of the calling thread's searcher, see
+  // `Searcher::set_multi_pv`. The helpers only look for the best move, which
+  // fills the table for every line.
+  void set_multi_pv(size_t num_lines) {
+    searchers_[0]->set_multi_pv(num_lines);
+  }
+  // Lazy SMP unless set otherwise.
+  void set_smp_mode(SmpMode mode);
+  // Sets the network of every searcher, see `Searcher::set_network`. With
+  // replication, each helper evaluates with a copy of it on the NUMA node of
+  // the worker that runs it.
+  void set_network(const NnueNetwork* network);
+  // Whether the network is copied onto every NUMA node the workers of the
+  // pool are bound to (see ThreadAffinity), so that the helpers on one socket
+  // don't read the weights from the memory of another. Off by default. It
+  // only makes copies on a machine of several nodes, and costs the size of
+  // the network per node.
+  void set_network_replication(bool replicate);
+  // Sets the tablebases of every searcher, see `Searcher::set_tablebases`.
+  void set_tablebases(const Tablebases* tablebases);
+  // Sets the game history of every searcher, see
+  // `Searcher::set_game_history`.
+  void set_game_history(const KeyHistory& history);
+  // Makes every searcher trace into a buffer of its own from `tracer`, which
+  // isn't owned, or stop tracing if it is null.
+  void set_tracer(Tracer* tracer);
+
+ private:
+  // Sets the counts of `res` to those of all threads.
+  void add_up_counters(SearchResult* res) const;
+
+  ThreadPool* const pool_;
+  TranspositionTable* const table_;
+  SmpMode smp_mode_;
+  SearchingSet searching_;
+  const NnueNetwork* network_;
+  bool replicate_network_;
+  // The copies of `network_` indexed by NUMA node, empty without
+  // replication. The calling thread's searcher uses `network_` itself.
+  std::vector<NetworkPtr> network_copies_;
+  // The calling thread's searcher, then one per worker. Searchers are big, so
+  // they live on the heap rather than on a stack.
+  std::vector<std::unique_ptr<Searcher>> searchers_;
+};
+
+// Searches `board` with a new ParallelSearcher.
+SearchResult parallel_search(
+    const Board& board, const SearchLimits& limits, ThreadPool* pool,
+    TranspositionTable* table,
+    const Searcher::IterationCallback& on_iteration = nullptr);
+
+#endif
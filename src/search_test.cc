@@ -0,0 +1,402 @@
+#include "search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "endgame.h"
+#include "gtest/gtest.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+namespace {
+const std::string kiwipete_fen =
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+bool is_legal_move(const Board& board, Move move) {
+  const MoveList moves = board.legal_moves();
+  return std::find(moves.begin(), moves.end(), move) != moves.end();
+}
+}  // namespace.
+
+TEST(Searcher, FindsMateInOne) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res =
+      searcher.search(Board("k7/8/1K6/8/8/8/8/7R w - - 0 1"), 2);
+  EXPECT_EQ(res.best_move_, Move(str_to_square("h1"), str_to_square("h8"),
+                                 Piece::rook, MoveType::simple));
+  EXPECT_EQ(res.score_, mate_score - 1);
+  EXPECT_TRUE(is_mate_score(res.score_));
+}
+
+TEST(Searcher, FindsMateInTwo) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res =
+      searcher.search(Board("k7/8/2K5/8/8/8/8/7R w - - 0 1"), 3);
+  EXPECT_EQ(res.score_, mate_score - 3);
+  ASSERT_EQ(res.pv_.size(), 3);
+  EXPECT_EQ(res.pv_[2], Move(str_to_square("h1"), str_to_square("h8"),
+                             Piece::rook, MoveType::simple));
+}
+
+TEST(Searcher, WidensAspirationWindowForMate) {
+  // The mate in three (Kc6 Ka8 Kb6 Kb8 Rh8) only shows at depth 5, after four
+  // iterations that score the known win of a rook against a lone king (see
+  // endgame.h), far outside the window.
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  std::vector<int> scores;
+  const SearchResult res = searcher.search(
+      Board("1k6/8/8/2K5/8/8/8/7R w - - 0 1"), 7,
+      [&scores](const SearchResult& iteration) {
+        scores.push_back(iteration.score_);
+      });
+  EXPECT_EQ(res.score_, mate_score - 5);
+  EXPECT_EQ(res.pv_.size(), 5);
+  ASSERT_EQ(scores.size(), 7);
+  EXPECT_FALSE(is_mate_score(scores[3]));
+  EXPECT_GT(scores[3], known_win);
+  EXPECT_EQ(scores[4], mate_score - 5);
+}
+
+TEST(Searcher, WinsHangingQueen) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res =
+      searcher.search(Board("4k3/p7/8/3q4/8/8/P7/3RK3 w - - 0 1"), 2);
+  EXPECT_EQ(res.best_move_, Move(str_to_square("d1"), str_to_square("d5"),
+                                 Piece::rook, MoveType::capture));
+  // Up a rook, give or take the squares the pieces stand on.
+  EXPECT_NEAR(res.score_, see_value(Piece::rook), 100);
+}
+
+TEST(Searcher, QuiescenceSeesRecaptures) {
+  // Taking the pawn on d6 with the queen loses her to the pawn on c7, which
+  // a single ply can't see.
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res =
+      searcher.search(Board("4k3/2p5/3p4/8/8/3Q4/8/4K3 w - - 0 1"), 1);
+  EXPECT_FALSE(res.best_move_ == Move(str_to_square("d3"), str_to_square("d6"),
+                                      Piece::queen, MoveType::capture));
+  EXPECT_NEAR(res.score_, see_value(Piece::queen) - 2 * see_value(Piece::pawn),
+              100);
+}
+
+TEST(Searcher, QuiescenceFindsExchangesWhenFarBehind) {
+  // Black is far behind whatever it does, but Rxd2 Kxd2 still trades the rook
+  // for a queen, which every pruning has to leave alone.
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res =
+      searcher.search(Board("4k3/p7/8/3r4/8/8/P2Q4/Q3K3 b - - 0 1"), 1);
+  EXPECT_NEAR(res.score_, -see_value(Piece::queen), 100);
+}
+
+TEST(Searcher, NoBestMoveWithoutLegalMoves) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult stalemate =
+      searcher.search(Board("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1"), 3);
+  EXPECT_EQ(stalemate.best_move_, absl::nullopt);
+  EXPECT_EQ(stalemate.score_, 0);
+  EXPECT_TRUE(stalemate.pv_.empty());
+  const SearchResult mate =
+      searcher.search(Board("7k/6Q1/6K1/8/8/8/8/8 b - - 0 1"), 3);
+  EXPECT_EQ(mate.best_move_, absl::nullopt);
+  EXPECT_EQ(mate.score_, -mate_score);
+}
+
+TEST(Searcher, PrincipalVariationIsLegal) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res = searcher.search(Board(kiwipete_fen), 4);
+  ASSERT_FALSE(res.pv_.empty());
+  EXPECT_EQ(res.best_move_, res.pv_[0]);
+  Board board(kiwipete_fen);
+  for (Move move : res.pv_) {
+    ASSERT_TRUE(is_legal_move(board, move)) << move.to_uci_str();
+    board.do_move(move);
+  }
+}
+
+TEST(Searcher, DeepPrincipalVariationIsLegal) {
+  // Deep enough for singular extensions, whose searches leave out the table
+  // move and mustn't leave their results in the table.
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res = searcher.search(Board(kiwipete_fen), 9);
+  ASSERT_FALSE(res.pv_.empty());
+  Board board(kiwipete_fen);
+  for (Move move : res.pv_) {
+    ASSERT_TRUE(is_legal_move(board, move)) << move.to_uci_str();
+    board.do_move(move);
+  }
+}
+
+TEST(Searcher, ReportsEveryIteration) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  std::vector<SearchResult> iterations;
+  const SearchResult res = searcher.search(
+      Board(), 3,
+      [&iterations](const SearchResult& iteration) {
+        iterations.push_back(iteration);
+      });
+  ASSERT_EQ(iterations.size(), 3);
+  for (size_t i = 0; i < iterations.size(); ++i) {
+    EXPECT_EQ(iterations[i].depth_, static_cast<int>(i) + 1);
+    EXPECT_TRUE(iterations[i].best_move_);
+    EXPECT_GT(iterations[i].nodes_, 0);
+    if (i > 0) {
+      EXPECT_GT(iterations[i].nodes_, iterations[i - 1].nodes_);
+    }
+  }
+  EXPECT_EQ(res.depth_, 3);
+  EXPECT_EQ(res.nodes_, iterations.back().nodes_);
+}
+
+TEST(Searcher, TableCarriesOverBetweenSearches) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult first = searcher.search(Board(kiwipete_fen), 5);
+  EXPECT_GT(table.hashfull(), 0);
+  const SearchResult second = searcher.search(Board(kiwipete_fen), 5);
+  EXPECT_EQ(second.best_move_, first.best_move_);
+  EXPECT_LT(second.nodes_, first.nodes_);
+}
+
+TEST(Searcher, ClearedSearchesRepeatTheirResults) {
+  const SearchLimits limits = {max_search_ply - 1, 20000, nullptr, nullptr};
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  // The node counts of the iterations, which any difference in the table or
+  // the move history changes.
+  std::vector<uint64_t> first_nodes;
+  std::vector<uint64_t> second_nodes;
+  table.new_search();
+  const SearchResult first = searcher.search_iterations(
+      Board(kiwipete_fen), 1, limits, [&](const SearchResult& iteration) {
+        first_nodes.push_back(iteration.nodes_);
+      });
+  searcher.search(Board(), 5);
+  table.clear();
+  searcher.clear();
+  table.new_search();
+  const SearchResult second = searcher.search_iterations(
+      Board(kiwipete_fen), 1, limits, [&](const SearchResult& iteration) {
+        second_nodes.push_back(iteration.nodes_);
+      });
+  EXPECT_EQ(second_nodes, first_nodes);
+  EXPECT_EQ(second.nodes_, first.nodes_);
+  EXPECT_EQ(second.score_, first.score_);
+  EXPECT_EQ(second.pv_, first.pv_);
+}
+
+TEST(Searcher, CachesEvaluations) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  searcher.search(Board(kiwipete_fen), 4);
+  const SearcherStats stats = searcher.stats();
+  EXPECT_GT(stats.eval_probes_, 0);
+  EXPECT_GT(stats.eval_hits_, 0);
+  EXPECT_LT(stats.eval_hits_, stats.eval_probes_);
+  // Only the evaluations the cache missed probe the pawn table.
+  EXPECT_EQ(stats.pawn_probes_, stats.eval_probes_ - stats.eval_hits_);
+}
+
+TEST(Searcher, TakesThreefoldRepetitionsOfTheGame) {
+  // White is a queen down, but the knight going back to g1 repeats the
+  // position after it a third time.
+  Board board("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNB1KBNR w KQkq - 0 1");
+  KeyHistory history;
+  history.reset(board);
+  const std::vector<std::string> moves = {"g1f3", "g8f6", "f3g1", "f6g8"};
+  for (size_t i = 0; i < 10; ++i) {
+    for (Move move : board.legal_moves()) {
+      if (move.to_uci_str() == moves[i % moves.size()]) {
+        board.do_move(move);
+        history.push(board);
+        break;
+      }
+    }
+  }
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  EXPECT_LT(searcher.search(board, 4).score_, -500);
+  searcher.set_game_history(history);
+  const SearchResult res = searcher.search(board, 4);
+  EXPECT_EQ(res.score_, 0);
+  EXPECT_EQ(res.best_move_->to_uci_str(), "f3g1");
+}
+
+TEST(Searcher, StopsWhenFlagIsSet) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const std::atomic<bool> stop(true);
+  const SearchResult res =
+      searcher.search_iterations(Board(kiwipete_fen), 1,
+                                 {10, 0, &stop, nullptr}, nullptr);
+  // The flag is only looked at every so many nodes, which the first couple
+  // of iterations may not reach.
+  EXPECT_LT(res.depth_, 4);
+}
+
+TEST(ParallelSearch, FindsMateInTwo) {
+  ThreadPool pool(3);
+  TranspositionTable table(1);
+  const SearchResult res =
+      parallel_search(Board("k7/8/2K5/8/8/8/8/7R w - - 0 1"),
+                      {3, 0, nullptr, nullptr}, &pool, &table);
+  EXPECT_EQ(res.score_, mate_score - 3);
+  EXPECT_EQ(res.depth_, 3);
+}
+
+TEST(ParallelSearch, PrincipalVariationIsLegal) {
+  ThreadPool pool(3);
+  TranspositionTable table(16);
+  int num_iterations = 0;
+  const SearchResult res =
+      parallel_search(Board(kiwipete_fen), {5, 0, nullptr, nullptr}, &pool,
+                      &table, [&num_iterations](const SearchResult&) {
+                        ++num_iterations;
+                      });
+  EXPECT_EQ(num_iterations, 5);
+  EXPECT_EQ(res.depth_, 5);
+  ASSERT_FALSE(res.pv_.empty());
+  Board board(kiwipete_fen);
+  for (Move move : res.pv_) {
+    ASSERT_TRUE(is_legal_move(board, move)) << move.to_uci_str();
+    board.do_move(move);
+  }
+}
+
+TEST(ParallelSearch, AbdadaPrincipalVariationIsLegal) {
+  ThreadPool pool(3);
+  TranspositionTable table(16);
+  ParallelSearcher searcher(&pool, &table);
+  searcher.set_smp_mode(SmpMode::abdada);
+  const SearchResult res =
+      searcher.search(Board(kiwipete_fen), {7, 0, nullptr, nullptr});
+  EXPECT_EQ(res.depth_, 7);
+  ASSERT_FALSE(res.pv_.empty());
+  Board board(kiwipete_fen);
+  for (Move move : res.pv_) {
+    ASSERT_TRUE(is_legal_move(board, move)) << move.to_uci_str();
+    board.do_move(move);
+  }
+}
+
+TEST(SearchingSet, InsertsAndErases) {
+  SearchingSet searching;
+  EXPECT_FALSE(searching.contains(42));
+  searching.insert(42);
+  EXPECT_TRUE(searching.contains(42));
+  // A key in the same slot takes it over, and erasing the other one leaves
+  // it alone.
+  const uint64_t same_slot = 42 + SearchingSet::num_slots;
+  searching.insert(same_slot);
+  EXPECT_FALSE(searching.contains(42));
+  searching.erase(42);
+  EXPECT_TRUE(searching.contains(same_slot));
+  searching.erase(same_slot);
+  EXPECT_FALSE(searching.contains(same_slot));
+}
+
+TEST(Searcher, StopsAtTimeLimit) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  TimeControl time_control = {};
+  time_control.move_time_ = 50;
+  TimeManager time_manager(time_control, Color::white);
+  const SearchResult res = searcher.search_iterations(
+      Board(kiwipete_fen), 1, {max_search_ply - 1, 0, nullptr, &time_manager},
+      nullptr);
+  EXPECT_TRUE(res.best_move_);
+  EXPECT_GE(res.depth_, 1);
+  EXPECT_LT(res.depth_, max_search_ply - 1);
+  // Generous, for loaded test machines.
+  EXPECT_LT(time_manager.elapsed(), 1000);
+}
+
+TEST(Searcher, StopsAtNodeLimit) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res = searcher.search_iterations(
+      Board(kiwipete_fen), 1, {max_search_ply - 1, 5000, nullptr, nullptr},
+      nullptr);
+  EXPECT_EQ(res.nodes_, 5000);
+  EXPECT_TRUE(res.best_move_);
+}
+
+TEST(Searcher, CountsTheSelectiveDepth) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  const SearchResult res = searcher.search(Board(kiwipete_fen), 4);
+  // The quiescence search goes on after the last ply of the iterations.
+  EXPECT_GT(res.selective_depth_, res.depth_);
+  EXPECT_LT(res.selective_depth_, max_search_ply);
+  EXPECT_EQ(res.tablebase_hits_, 0);
+  EXPECT_EQ(searcher.counters().nodes_.load(), res.nodes_);
+}
+
+TEST(ParallelSearch, CountsTheNodesOfAllThreads) {
+  ThreadPool pool(2);
+  TranspositionTable table(1);
+  std::vector<uint64_t> iteration_nodes;
+  const SearchResult res = parallel_search(
+      Board(kiwipete_fen), {max_search_ply - 1, 20000, nullptr, nullptr},
+      &pool, &table, [&iteration_nodes](const SearchResult& iteration) {
+        iteration_nodes.push_back(iteration.nodes_);
+      });
+  // The node limit stops the calling thread at exactly its limit, and the
+  // helpers have searched some more by then.
+  EXPECT_GT(res.nodes_, 20000);
+  ASSERT_FALSE(iteration_nodes.empty());
+  EXPECT_TRUE(std::is_sorted(iteration_nodes.begin(), iteration_nodes.end()));
+  EXPECT_GE(res.nodes_, iteration_nodes.back());
+  EXPECT_GT(res.selective_depth_, res.depth_);
+}
+
+TEST(Searcher, FindsSeveralLines) {
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  searcher.set_multi_pv(3);
+  const SearchResult res = searcher.search(Board(kiwipete_fen), 4);
+  ASSERT_EQ(res.lines_.size(), 3);
+  EXPECT_EQ(res.lines_[0].score_, res.score_);
+  EXPECT_EQ(res.lines_[0].pv_, res.pv_);
+  for (size_t i = 0; i < res.lines_.size(); ++i) {
+    ASSERT_FALSE(res.lines_[i].pv_.empty());
+    if (i > 0) {
+      EXPECT_LE(res.lines_[i].score_, res.lines_[i - 1].score_);
+    }
+    for (size_t j = 0; j < i; ++j) {
+      EXPECT_FALSE(res.lines_[i].pv_[0] == res.lines_[j].pv_[0]);
+    }
+    Board board(kiwipete_fen);
+    for (Move move : res.lines_[i].pv_) {
+      ASSERT_TRUE(is_legal_move(board, move)) << move.to_uci_str();
+      board.do_move(move);
+    }
+  }
+}
+
+TEST(Searcher, FindsNoMoreLinesThanLegalMoves) {
+  // The king in the corner only has two moves.
+  TranspositionTable table(1);
+  Searcher searcher(&table);
+  searcher.set_multi_pv(5);
+  const SearchResult res =
+      searcher.search(Board("7k/8/5K2/8/8/8/8/R7 b - - 0 1"), 3);
+  EXPECT_EQ(res.lines_.size(), 2);
+  const SearchResult mate =
+      searcher.search(Board("7k/6Q1/6K1/8/8/8/8/8 b - - 0 1"), 3);
+  ASSERT_EQ(mate.lines_.size(), 1);
+  EXPECT_EQ(mate.lines_[0].score_, -mate_score);
+}
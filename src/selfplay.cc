@@ -0,0 +1,224 @@
+#include "selfplay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "endgame.h"
+#include "packed_position.h"
+#include "positions.h"
+#include "repetition.h"
+#include "search.h"
+#include "transposition_table.h"
+
+namespace {
+// 1 if white won, -1 if black did and 0 for a draw, as `PackedPosition`
+// stores results.
+constexpr int white_win = 1;
+constexpr int black_win = -1;
+constexpr int draw = 0;
+
+// One worker's searcher, with its own table unless the table is shared.
+struct Player {
+  std::unique_ptr<TranspositionTable> own_table_;
+  std::unique_ptr<Searcher> searcher_;
+  std::mt19937_64 rng_;
+};
+
+// Returns the start of a game: a random opening, then random moves.
+Board random_start(const SelfPlayOptions& options, std::mt19937_64* rng) {
+  while (true) {
+    Board res = options.openings_.empty()
+                    ? Board()
+                    : options.openings_[(*rng)() % options.openings_.size()];
+    int ply = 0;
+    for (; ply < options.random_plies_; ++ply) {
+      const MoveList moves = res.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      res.do_move(moves[(*rng)() % moves.size()]);
+    }
+    if (ply == options.random_plies_ && !res.legal_moves().empty()) {
+      return res;
+    }
+  }
+}
+
+// Plays a game with `player` and appends its positions to `*positions`.
+// Returns the result, and sets `*adjudicated` if it was adjudicated.
+int play_game(const SelfPlayOptions& options, Player* player,
+              std::vector<PackedPosition>* positions, bool* adjudicated) {
+  Board board = random_start(options, &player->rng_);
+  KeyHistory history;
+  history.reset(board);
+  const size_t first_position = positions->size();
+  // The side the last searches agree is ahead, and how many agree.
+  int resign_side = draw;
+  int resign_count = 0;
+  int draw_count = 0;
+  int res = draw;
+  *adjudicated = false;
+  for (int ply = 0; ply < options.max_plies_; ++ply) {
+    const Color side = board.is_whites_move_ ? Color::white : Color::black;
+    if (!board.has_any_legal_move()) {
+      if (board.is_king_attacked(side)) {
+        res = side == Color::white ? black_win : white_win;
+      }
+      break;
+    }
+    if (board.fifty_move_clock_ >= 100 || history.is_repetition(0) ||
+        is_insufficient_material(board)) {
+      break;
+    }
+
+    player->searcher_->set_game_history(history);
+    SearchResult result = player->searcher_->search_iterations(
+        board, 1,
+        {max_search_ply - 1, options.nodes_per_move_, nullptr, nullptr},
+        nullptr);
+    if (!result.best_move_) {
+      // Too few nodes to complete even the first iteration.
+      result = player->searcher_->search_iterations(
+          board, 1, {1, 0, nullptr, nullptr}, nullptr);
+    }
+    positions->push_back(pack_position(board, result.score_, draw));
+
+    const int white_score =
+        side == Color::white ? result.score_ : -result.score_;
+    const int ahead = white_score >= options.resign_score_    ? white_win
+                      : white_score <= -options.resign_score_ ? black_win
+                                                              : draw;
+    resign_count = ahead == draw          ? 0
+                   : ahead == resign_side ? resign_count + 1
+                                          : 1;
+    resign_side = ahead;
+    if (options.resign_plies_ > 0 && resign_count >= options.resign_plies_) {
+      res = ahead;
+      *adjudicated = true;
+      break;
+    }
+    draw_count = ply >= options.draw_min_ply_ &&
+                         std::abs(white_score) <= options.draw_score_
+                     ? draw_count + 1
+                     : 0;
+    if (options.draw_plies_ > 0 && draw_count >= options.draw_plies_) {
+      *adjudicated = true;
+      break;
+    }
+
+    board.do_move(*result.best_move_);
+    history.push(board);
+  }
+  for (size_t i = first_position; i < positions->size(); ++i) {
+    (*positions)[i].result_ = static_cast<int8_t>(res);
+  }
+  return res;
+}
+}  // namespace.
+
+SelfPlayStats play_games(const SelfPlayOptions& options,
+                         const GameWriter& write) {
+  const size_t num_threads =
+      options.num_threads_ > 0
+          ? options.num_threads_
+          : std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::unique_ptr<TranspositionTable> shared_table;
+  if (options.shared_table_) {
+    shared_table = std::make_unique<TranspositionTable>(options.hash_mb_);
+  }
+  std::atomic<size_t> next_game(0);
+  std::mutex mutex;
+  SelfPlayStats stats;
+
+  const auto run = [&](size_t thread_idx) {
+    Player player;
+    if (!shared_table) {
+      player.own_table_ =
+          std::make_unique<TranspositionTable>(options.hash_mb_);
+    }
+    player.searcher_ = std::make_unique<Searcher>(
+        shared_table ? shared_table.get() : player.own_table_.get());
+    player.searcher_->set_network(options.network_);
+    player.rng_.seed(options.seed_ + thread_idx);
+    std::vector<PackedPosition> positions;
+    while (next_game.fetch_add(1) < options.num_games_) {
+      if (player.own_table_) {
+        player.own_table_->clear();
+      }
+      positions.clear();
+      bool adjudicated = false;
+      const int result = play_game(options, &player, &positions, &adjudicated);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      write(positions.data(), positions.size());
+      ++stats.num_games_;
+      stats.num_positions_ += positions.size();
+      if (result == white_win) {
+        ++stats.white_wins_;
+      } else if (result == black_win) {
+        ++stats.black_wins_;
+      } else {
+        ++stats.draws_;
+      }
+      if (adjudicated) {
+        ++stats.adjudicated_;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(run, i);
+  }
+  run(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return stats;
+}
+
+bool read_openings(const std::string& path, std::vector<Board>* openings,
+                   std::string* error) {
+  ChunkReader reader(path);
+  if (!reader.is_open()) {
+    *error = absl::StrCat("can't read ", path);
+    return false;
+  }
+  std::string chunk;
+  while (reader.read(1 << 20, &chunk)) {
+    bool is_valid = true;
+    for_each_line(chunk, [&](absl::string_view line) {
+      if (!is_valid) {
+        return;
+      }
+      const char* line_error = nullptr;
+      absl::optional<Board> board = parse_epd(line, nullptr, &line_error);
+      if (board) {
+        openings->push_back(*board);
+      } else {
+        *error = absl::StrCat(line_error, ": ", line);
+        is_valid = false;
+      }
+    });
+    if (!is_valid) {
+      return false;
+    }
+  }
+  if (!reader.close()) {
+    *error = absl::StrCat("can't read all of ", path);
+    return false;
+  }
+  return true;
+}
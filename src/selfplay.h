@@ -0,0 +1,81 @@
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "nnue.h"
+#include "packed_position.h"
+
+// Self-play games for training data, many at once in one process: each worker
+// thread plays one game after another, with a searcher of its own that
+// searches a fixed number of nodes per move, so that the games don't depend
+// on the speed of the machine. A game starts at a random opening, followed by
+// a few random moves so that no two games are alike, and ends by the rules or
+// by adjudication. Every searched position is kept with the search's score,
+// and once the game is over the positions get its result and are passed on
+// packed, a whole game at a time.
+
+struct SelfPlayOptions {
+  size_t num_games_ = 100;
+  // The number of games played at once, one per hardware thread if 0.
+  size_t num_threads_ = 0;
+  uint64_t nodes_per_move_ = 5000;
+  size_t hash_mb_ = 16;
+  // Shares one table of `hash_mb_` between all games, rather than giving
+  // each worker a table of its own that is cleared before each game.
+  bool shared_table_ = false;
+  // Evaluates with this network, which isn't owned, or the classical
+  // evaluation if it is null.
+  const NnueNetwork* network_ = nullptr;
+
+  // The games start at random positions of these, or at the starting
+  // position if there are none, followed by `random_plies_` random moves.
+  std::vector<Board> openings_;
+  int random_plies_ = 8;
+  uint64_t seed_ = 1;
+
+  // A game is adjudicated as won once the scores of `resign_plies_`
+  // consecutive searches, of both sides, agree that one side is ahead by at
+  // least `resign_score_`.
+  int resign_score_ = 1000;
+  int resign_plies_ = 6;
+  // A game is adjudicated as drawn once, after `draw_min_ply_` plies, the
+  // scores of `draw_plies_` consecutive searches are within `draw_score_` of
+  // 0. 0 plies turns either rule off.
+  int draw_score_ = 10;
+  int draw_plies_ = 10;
+  int draw_min_ply_ = 80;
+  // Games that last this many plies are drawn.
+  int max_plies_ = 400;
+};
+
+struct SelfPlayStats {
+  uint64_t num_games_ = 0;
+  uint64_t num_positions_ = 0;
+  uint64_t white_wins_ = 0;
+  uint64_t black_wins_ = 0;
+  uint64_t draws_ = 0;
+  uint64_t adjudicated_ = 0;
+};
+
+// Called with the positions of each game once it is over, one game at a
+// time.
+using GameWriter =
+    std::function<void(const PackedPosition* positions, size_t num_positions)>;
+
+// Plays `options.num_games_` games and passes each to `write`.
+SelfPlayStats play_games(const SelfPlayOptions& options,
+                         const GameWriter& write);
+
+// Reads the positions of an EPD or FEN file, one per line, into `*openings`.
+// Returns false, with the line that is wrong in `*error`, if the file can't
+// be read or has a line that isn't a position.
+bool read_openings(const std::string& path, std::vector<Board>* openings,
+                   std::string* error);
+
+#endif
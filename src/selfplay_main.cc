@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/strings/numbers.h"
+#include "bulk_io.h"
+#include "nnue.h"
+#include "packed_position.h"
+#include "selfplay.h"
+
+// Usage: selfplay [--games <n>] [--threads <n>] [--nodes <n>] [--hash <mb>]
+//                 [--shared-hash] [--openings <epd>] [--random-plies <n>]
+//                 [--eval-file <network>] [--seed <n>] <out>
+//
+// Plays self-play games (see selfplay.h), 100 of 5000 nodes a move by
+// default, one at a time per hardware thread, and appends their positions to
+// <out> as packed positions (see packed_position.h). Each thread has a table
+// of --hash megabytes, 16 by default, unless --shared-hash makes them share
+// one. The games start at random positions of the --openings file, or at the
+// starting position, followed by 8 random moves or as many as --random-plies
+// says.
+
+namespace {
+int usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--games <n>] [--threads <n>] [--nodes <n>] [--hash <mb>]"
+               " [--shared-hash] [--openings <epd>] [--random-plies <n>]"
+               " [--eval-file <network>] [--seed <n>] <out>\n";
+  return 1;
+}
+}  // namespace.
+
+int main(int argc, char** argv) {
+  SelfPlayOptions options;
+  const char* openings_path = nullptr;
+  const char* eval_file = nullptr;
+  int arg_idx = 1;
+  for (; arg_idx < argc && std::strncmp(argv[arg_idx], "--", 2) == 0;
+       ++arg_idx) {
+    const char* const flag = argv[arg_idx];
+    if (std::strcmp(flag, "--shared-hash") == 0) {
+      options.shared_table_ = true;
+      continue;
+    }
+    if (arg_idx + 1 == argc) {
+      return usage(argv[0]);
+    }
+    const char* const value = argv[++arg_idx];
+    bool is_valid = false;
+    if (std::strcmp(flag, "--games") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.num_games_);
+    } else if (std::strcmp(flag, "--threads") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.num_threads_);
+    } else if (std::strcmp(flag, "--nodes") == 0) {
+      is_valid =
+          absl::SimpleAtoi(value, &options.nodes_per_move_) &&
+          options.nodes_per_move_ > 0;
+    } else if (std::strcmp(flag, "--hash") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.hash_mb_);
+    } else if (std::strcmp(flag, "--openings") == 0) {
+      openings_path = value;
+      is_valid = true;
+    } else if (std::strcmp(flag, "--random-plies") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.random_plies_) &&
+                 options.random_plies_ >= 0;
+    } else if (std::strcmp(flag, "--eval-file") == 0) {
+      eval_file = value;
+      is_valid = true;
+    } else if (std::strcmp(flag, "--seed") == 0) {
+      is_valid = absl::SimpleAtoi(value, &options.seed_);
+    }
+    if (!is_valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (arg_idx + 1 != argc) {
+    return usage(argv[0]);
+  }
+
+  std::string error;
+  if (openings_path &&
+      !read_openings(openings_path, &options.openings_, &error)) {
+    std::cerr << error << '\n';
+    return 1;
+  }
+  NetworkPtr network;
+  if (eval_file) {
+    network = load_network(eval_file, &error);
+    if (!network) {
+      std::cerr << error << '\n';
+      return 1;
+    }
+    options.network_ = network.get();
+  }
+  BulkFileWriter out(argv[arg_idx], true);
+  if (!out.is_open()) {
+    std::cerr << "Can't write " << argv[arg_idx] << '\n';
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const SelfPlayStats stats = play_games(
+      options, [&out](const PackedPosition* positions, size_t num_positions) {
+        out.write(positions, num_positions * sizeof(PackedPosition));
+      });
+  if (!out.close()) {
+    std::cerr << "Can't write " << argv[arg_idx] << '\n';
+    return 1;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << stats.num_games_ << " games, +" << stats.white_wins_ << " -"
+            << stats.black_wins_ << " =" << stats.draws_ << ", "
+            << stats.adjudicated_ << " adjudicated\n"
+            << stats.num_positions_ << " positions in " << elapsed.count()
+            << " s, "
+            << static_cast<uint64_t>(stats.num_positions_ / elapsed.count())
+            << " positions/s\n";
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "selfplay.h"
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+
+namespace {
+// The positions of each game that `play_games` writes.
+struct Games {
+  std::vector<std::vector<PackedPosition>> games_;
+
+  GameWriter writer() {
+    return [this](const PackedPosition* positions, size_t num_positions) {
+      games_.emplace_back(positions, positions + num_positions);
+    };
+  }
+};
+}  // namespace.
+
+TEST(PlayGames, PlaysGamesOfLegalPositions) {
+  for (bool shared_table : {false, true}) {
+    SelfPlayOptions options;
+    options.num_games_ = 6;
+    options.num_threads_ = 3;
+    options.nodes_per_move_ = 300;
+    options.hash_mb_ = 1;
+    options.shared_table_ = shared_table;
+    options.max_plies_ = 60;
+    Games games;
+    const SelfPlayStats stats = play_games(options, games.writer());
+    EXPECT_EQ(stats.num_games_, 6);
+    EXPECT_EQ(stats.white_wins_ + stats.black_wins_ + stats.draws_, 6);
+    ASSERT_EQ(games.games_.size(), 6);
+    size_t num_positions = 0;
+    for (const std::vector<PackedPosition>& game : games.games_) {
+      ASSERT_FALSE(game.empty());
+      num_positions += game.size();
+      EXPECT_LE(game.size(), 60);
+      Board board = unpack_position(game.front());
+      // Random moves from the starting position.
+      EXPECT_EQ(board.num_moves_, 5);
+      for (const PackedPosition& position : game) {
+        EXPECT_EQ(position.result_, game.front().result_);
+        EXPECT_TRUE(unpack_position(position).has_consistent_state());
+      }
+    }
+    EXPECT_EQ(stats.num_positions_, num_positions);
+  }
+}
+
+TEST(PlayGames, AdjudicatesAndEndsGamesByTheRules) {
+  SelfPlayOptions options;
+  options.num_games_ = 2;
+  options.num_threads_ = 1;
+  options.nodes_per_move_ = 2000;
+  options.hash_mb_ = 1;
+  options.random_plies_ = 0;
+  options.resign_plies_ = 4;
+  options.openings_ = {Board("4k3/8/8/8/8/8/8/3QK3 b - - 0 1")};
+  Games games;
+  SelfPlayStats stats = play_games(options, games.writer());
+  EXPECT_EQ(stats.white_wins_, 2);
+  EXPECT_EQ(stats.adjudicated_, 2);
+  ASSERT_EQ(games.games_.size(), 2);
+  EXPECT_EQ(games.games_[0].size(), 4);
+  EXPECT_EQ(games.games_[0].back().result_, 1);
+  // From the side to move's point of view.
+  EXPECT_LE(games.games_[0].front().score_, -options.resign_score_);
+
+  // Two kings are drawn before any search.
+  options.openings_ = {Board("4k3/8/8/8/8/8/8/4K3 w - - 0 1")};
+  games.games_.clear();
+  stats = play_games(options, games.writer());
+  EXPECT_EQ(stats.draws_, 2);
+  EXPECT_EQ(stats.adjudicated_, 0);
+  EXPECT_EQ(stats.num_positions_, 0);
+
+  // Mate in one is played out.
+  options.openings_ = {Board("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1")};
+  options.resign_plies_ = 0;
+  games.games_.clear();
+  stats = play_games(options, games.writer());
+  EXPECT_EQ(stats.white_wins_, 2);
+  EXPECT_EQ(stats.adjudicated_, 0);
+  EXPECT_EQ(stats.num_positions_, 2);
+}
+
+TEST(ReadOpenings, ReadsEpdLines) {
+  const std::string path = testing::TempDir() + "selfplay_test.epd";
+  std::ofstream(path)
+      << "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - id \"e4\";\n"
+      << "\n"
+      << "4k3/8/8/8/8/8/8/4K3 w - - 0 1\n";
+  std::vector<Board> openings;
+  std::string error;
+  ASSERT_TRUE(read_openings(path, &openings, &error)) << error;
+  ASSERT_EQ(openings.size(), 2);
+  EXPECT_FALSE(openings[0].is_whites_move_);
+
+  std::ofstream(path) << "4k3/8/8/8/8/8/8/4K3 w - - 0 1\nnot a position\n";
+  openings.clear();
+  EXPECT_FALSE(read_openings(path, &openings, &error));
+  EXPECT_NE(error.find("not a position"), std::string::npos);
+  EXPECT_FALSE(read_openings(testing::TempDir() + "no_such_file.epd",
+                             &openings, &error));
+}
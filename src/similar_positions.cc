@@ -0,0 +1,206 @@
+#include "similar_positions.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+
+namespace {
+// In the nibbles of packed positions, black's pieces are 8 higher.
+constexpr unsigned black_nibble = 8;
+
+constexpr size_t num_piece_features = num_colors * num_piece_types * 64;
+// The files of each color's pawns come after the pieces on their squares.
+constexpr size_t num_features = num_piece_features + num_colors * 8;
+
+constexpr std::array<uint64_t, num_features> make_feature_hashes() {
+  std::array<uint64_t, num_features> res = {};
+  // SplitMix64.
+  uint64_t state = 0;
+  for (uint64_t& hash : res) {
+    state += 0x9E3779B97F4A7C15;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    hash = z ^ (z >> 31);
+  }
+  return res;
+}
+
+constexpr std::array<uint64_t, num_features> feature_hashes =
+    make_feature_hashes();
+
+// Adds the bits of `hash` to `counts`.
+void count_bits(uint64_t hash, std::array<int, 64>* counts) {
+  for (size_t bit = 0; bit < 64; ++bit) {
+    (*counts)[bit] += static_cast<int>((hash >> bit) & 1);
+  }
+}
+}  // namespace.
+
+PieceBitboards piece_bitboards(const Board& board) {
+  PieceBitboards res;
+  for (size_t color = 0; color < num_colors; ++color) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      res[color * num_piece_types + piece] = board.pieces_[color][piece];
+    }
+  }
+  return res;
+}
+
+PieceBitboards piece_bitboards(const PackedPosition& packed) {
+  std::array<Bitboard, 16> nibble_squares = {};
+  size_t nibble_idx = 0;
+  for (Bitboard sq : bitboard_split(packed.occupancy_)) {
+    const unsigned nibble =
+        (packed.pieces_[nibble_idx / 2] >> (4 * (nibble_idx % 2))) & 0xF;
+    nibble_squares[nibble] |= sq;
+    ++nibble_idx;
+  }
+  PieceBitboards res;
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    res[piece] = nibble_squares[piece];
+    res[num_piece_types + piece] = nibble_squares[piece | black_nibble];
+  }
+  return res;
+}
+
+int bitboard_distance(const PieceBitboards& lhs, const PieceBitboards& rhs) {
+  int res = 0;
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    res += popcount(lhs[i] ^ rhs[i]);
+  }
+  return res;
+}
+
+uint64_t position_sketch(const PieceBitboards& bitboards) {
+  std::array<int, 64> counts = {};
+  int num_features_set = 0;
+  for (size_t i = 0; i < bitboards.size(); ++i) {
+    for (Bitboard sq : bitboard_split(bitboards[i])) {
+      count_bits(feature_hashes[i * 64 + static_cast<size_t>(square_idx(sq))],
+                 &counts);
+      ++num_features_set;
+    }
+  }
+  for (size_t color = 0; color < num_colors; ++color) {
+    Bitboard pawns = bitboards[color * num_piece_types +
+                               static_cast<size_t>(Piece::pawn)];
+    // Folds the ranks onto the first, whose square indices are the files
+    // from h to a.
+    pawns |= pawns >> 32;
+    pawns |= pawns >> 16;
+    pawns |= pawns >> 8;
+    for (Bitboard sq : bitboard_split(pawns & 0xFF)) {
+      count_bits(feature_hashes[num_piece_features + color * 8 +
+                                static_cast<size_t>(square_idx(sq))],
+                 &counts);
+      ++num_features_set;
+    }
+  }
+  uint64_t res = 0;
+  for (size_t bit = 0; bit < 64; ++bit) {
+    if (2 * counts[bit] > num_features_set) {
+      res |= uint64_t{1} << bit;
+    }
+  }
+  return res;
+}
+
+SimilarPositionIndex::SimilarPositionIndex(const PackedPosition* positions,
+                                           size_t num_positions)
+    : positions_(positions), num_positions_(num_positions) {
+  ABSL_RAW_CHECK(num_positions < (uint64_t{1} << 32),
+                 "Too many positions for an index.");
+  std::vector<uint64_t> sketches(num_positions);
+  for (size_t i = 0; i < num_positions; ++i) {
+    sketches[i] = position_sketch(piece_bitboards(positions[i]));
+  }
+  // A counting sort of the positions by the value of each band.
+  for (int band = 0; band < num_bands; ++band) {
+    std::vector<uint32_t>& offsets = offsets_[static_cast<size_t>(band)];
+    std::vector<uint32_t>& bucket = buckets_[static_cast<size_t>(band)];
+    offsets.assign(num_band_values + 1, 0);
+    for (uint64_t sketch : sketches) {
+      ++offsets[((sketch >> (band * band_bits)) & (num_band_values - 1)) + 1];
+    }
+    for (size_t value = 0; value < num_band_values; ++value) {
+      offsets[value + 1] += offsets[value];
+    }
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    bucket.resize(num_positions);
+    for (size_t i = 0; i < num_positions; ++i) {
+      const uint64_t value =
+          (sketches[i] >> (band * band_bits)) & (num_band_values - 1);
+      bucket[next[value]++] = static_cast<uint32_t>(i);
+    }
+  }
+}
+
+void SimilarPositionIndex::add_bucket(int band, uint64_t value,
+                                      size_t max_candidates,
+                                      std::vector<uint32_t>* candidates) const {
+  const std::vector<uint32_t>& offsets = offsets_[static_cast<size_t>(band)];
+  const std::vector<uint32_t>& bucket = buckets_[static_cast<size_t>(band)];
+  const size_t size = offsets[value + 1] - offsets[value];
+  const size_t num_added =
+      std::min(size, max_candidates - std::min(max_candidates,
+                                               candidates->size()));
+  candidates->insert(candidates->end(), bucket.begin() + offsets[value],
+                     bucket.begin() + offsets[value] +
+                         static_cast<ptrdiff_t>(num_added));
+}
+
+std::vector<SimilarPosition> SimilarPositionIndex::find(
+    const Board& board, size_t max_results, size_t max_candidates) const {
+  const PieceBitboards bitboards = piece_bitboards(board);
+  const uint64_t sketch = position_sketch(bitboards);
+  std::vector<uint32_t> candidates;
+  const auto dedup = [&candidates] {
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+  };
+  for (int band = 0; band < num_bands; ++band) {
+    add_bucket(band, (sketch >> (band * band_bits)) & (num_band_values - 1),
+               max_candidates, &candidates);
+  }
+  dedup();
+  // Multi-probe: the values one bit off.
+  if (candidates.size() < max_results) {
+    for (int band = 0; band < num_bands; ++band) {
+      const uint64_t value =
+          (sketch >> (band * band_bits)) & (num_band_values - 1);
+      for (int bit = 0; bit < band_bits; ++bit) {
+        add_bucket(band, value ^ (uint64_t{1} << bit), max_candidates,
+                   &candidates);
+      }
+    }
+    dedup();
+  }
+
+  std::vector<SimilarPosition> res;
+  res.reserve(candidates.size());
+  for (uint32_t idx : candidates) {
+    res.push_back(
+        {idx, bitboard_distance(bitboards, piece_bitboards(positions_[idx]))});
+  }
+  const auto nearer = [](const SimilarPosition& lhs,
+                         const SimilarPosition& rhs) {
+    return lhs.distance_ != rhs.distance_ ? lhs.distance_ < rhs.distance_
+                                          : lhs.position_idx_ <
+                                                rhs.position_idx_;
+  };
+  const size_t num_results = std::min(max_results, res.size());
+  std::partial_sort(res.begin(),
+                    res.begin() + static_cast<ptrdiff_t>(num_results),
+                    res.end(), nearer);
+  res.resize(num_results);
+  return res;
+}
@@ -0,0 +1,88 @@
+#ifndef SIMILAR_POSITIONS_H
+#define SIMILAR_POSITIONS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bitboard.h"
+#include "board.h"
+#include "packed_position.h"
+
+// The bitboards of the pieces of a position, white's in the order of Piece
+// and then black's.
+typedef std::array<Bitboard, num_colors * num_piece_types> PieceBitboards;
+
+PieceBitboards piece_bitboards(const Board& board);
+PieceBitboards piece_bitboards(const PackedPosition& packed);
+
+// The number of pieces that differ between two positions, counting a piece
+// on a square in one and not the other: the popcount of the XORs of their
+// bitboards. A piece that moved counts twice.
+int bitboard_distance(const PieceBitboards& lhs, const PieceBitboards& rhs);
+
+// A 64 bit SimHash of a position, so that positions a small distance apart
+// mostly have sketches a few bits apart. Each piece on its square, and each
+// pawn on its file for the pawn structure, adds or takes one from each of 64
+// counters, by the bits of a hash of its own, and the sketch has the bits of
+// the counters above 0.
+uint64_t position_sketch(const PieceBitboards& bitboards);
+
+struct SimilarPosition {
+  // The index of the position among those of the index.
+  uint64_t position_idx_;
+  int distance_;
+};
+
+// Finds the positions of a set of packed positions nearest a given one, such
+// as those of a database of games, for a "similar positions" feature, by
+// locality-sensitive hashing.
+//
+// The sketch of each position is cut into `num_bands` bands of `band_bits`
+// bits, and each band is a table from its value to the positions with it, as
+// an array of the positions sorted by the value and the offset of each value.
+// A query looks up the bands of its sketch, and if they find too few
+// positions, the values one bit off too, and ranks the positions found by
+// `bitboard_distance`. Positions with sketches that share a band are likely
+// near and near positions likely share a band, so a query reads a few
+// buckets rather than every position. The tables take 16 bytes a position,
+// and the positions, which aren't copied, must outlive the index.
+//
+// The positions are those of packed_position.h, say read from a file of
+// them, so a result's index finds the position and, by its Zobrist key, its
+// statistics in a position database (see position_db.h).
+class SimilarPositionIndex {
+ public:
+  static constexpr int num_bands = 4;
+  static constexpr int band_bits = 16;
+
+  SimilarPositionIndex(const PackedPosition* positions, size_t num_positions);
+  SimilarPositionIndex(const SimilarPositionIndex&) = delete;
+  SimilarPositionIndex& operator=(const SimilarPositionIndex&) = delete;
+
+  size_t size() const { return num_positions_; }
+
+  // Returns up to `max_results` of the positions nearest `board`, nearest
+  // first and ties in the order of the positions, out of at most
+  // `max_candidates` the tables find.
+  std::vector<SimilarPosition> find(const Board& board, size_t max_results,
+                                    size_t max_candidates = 4096) const;
+
+ private:
+  static constexpr size_t num_band_values = size_t{1} << band_bits;
+
+  // Adds the positions of the value `value` of band `band` to `*candidates`,
+  // up to `max_candidates` in all.
+  void add_bucket(int band, uint64_t value, size_t max_candidates,
+                  std::vector<uint32_t>* candidates) const;
+
+  const PackedPosition* const positions_;
+  const size_t num_positions_;
+  // For each band, where the positions of each of its values start among its
+  // positions, and the number of positions last.
+  std::array<std::vector<uint32_t>, num_bands> offsets_;
+  std::array<std::vector<uint32_t>, num_bands> buckets_;
+};
+
+#endif
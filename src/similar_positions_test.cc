@@ -0,0 +1,103 @@
+#include "similar_positions.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bitboard.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "packed_position.h"
+#include "perft.h"
+
+namespace {
+// The positions of games of moves picked all over the move lists, from the
+// positions of the perft suite.
+std::vector<PackedPosition> test_positions(size_t num_positions) {
+  std::vector<PackedPosition> res;
+  for (size_t i = 0; res.size() < num_positions; ++i) {
+    Board board(perft_suite[i % perft_suite.size()].fen_);
+    for (size_t ply = 0; ply < 60 && res.size() < num_positions; ++ply) {
+      res.push_back(pack_position(board, 0, 0));
+      const MoveList moves = board.legal_moves();
+      if (moves.empty()) {
+        break;
+      }
+      board.do_move(moves[(i * 7 + ply * 13) % moves.size()]);
+    }
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(SimilarPositions, MeasuresDistances) {
+  Board board;
+  const PieceBitboards start = piece_bitboards(board);
+  EXPECT_EQ(piece_bitboards(pack_position(board, 0, 0)), start);
+  EXPECT_EQ(bitboard_distance(start, start), 0);
+  board.do_move(*board.legal_move(str_to_square("g1"), str_to_square("f3")));
+  EXPECT_EQ(bitboard_distance(start, piece_bitboards(board)), 2);
+  board.do_move(*board.legal_move(str_to_square("d7"), str_to_square("d5")));
+  EXPECT_EQ(bitboard_distance(start, piece_bitboards(board)), 4);
+  EXPECT_EQ(bitboard_distance(piece_bitboards(board), start), 4);
+}
+
+TEST(SimilarPositions, SketchesNearPositionsNear) {
+  // One move apart, the sketches differ in far fewer than the 32 bits of
+  // unrelated positions.
+  const std::vector<PackedPosition> positions = test_positions(600);
+  int num_bits = 0;
+  int num_pairs = 0;
+  for (size_t i = 0; i + 1 < positions.size(); ++i) {
+    const PieceBitboards lhs = piece_bitboards(positions[i]);
+    const PieceBitboards rhs = piece_bitboards(positions[i + 1]);
+    if (bitboard_distance(lhs, rhs) <= 3) {
+      num_bits += popcount(position_sketch(lhs) ^ position_sketch(rhs));
+      ++num_pairs;
+    }
+  }
+  ASSERT_GT(num_pairs, 100);
+  EXPECT_LT(num_bits, 12 * num_pairs);
+}
+
+TEST(SimilarPositionIndex, FindsTheNearestPositions) {
+  const std::vector<PackedPosition> positions = test_positions(3000);
+  const SimilarPositionIndex index(positions.data(), positions.size());
+  EXPECT_EQ(index.size(), positions.size());
+  size_t num_queries = 0;
+  size_t num_nearest_found = 0;
+  for (size_t i = 0; i < positions.size(); i += 7) {
+    SCOPED_TRACE(i);
+    const Board board = unpack_position(positions[i]);
+    const PieceBitboards bitboards = piece_bitboards(board);
+    const std::vector<SimilarPosition> found = index.find(board, 10);
+    ASSERT_FALSE(found.empty());
+    EXPECT_EQ(found[0].distance_, 0);
+    for (size_t j = 0; j < found.size(); ++j) {
+      const PackedPosition& position =
+          positions[static_cast<size_t>(found[j].position_idx_)];
+      EXPECT_EQ(found[j].distance_,
+                bitboard_distance(bitboards, piece_bitboards(position)));
+      if (j > 0) {
+        EXPECT_LE(found[j - 1].distance_, found[j].distance_);
+      }
+    }
+    // The nearest of the other positions, by comparing with all of them.
+    int nearest = 1000;
+    for (const PackedPosition& position : positions) {
+      const int distance =
+          bitboard_distance(bitboards, piece_bitboards(position));
+      if (distance > 0) {
+        nearest = std::min(nearest, distance);
+      }
+    }
+    ++num_queries;
+    num_nearest_found +=
+        std::any_of(found.begin(), found.end(),
+                    [&](const SimilarPosition& position) {
+                      return position.distance_ == nearest;
+                    });
+  }
+  EXPECT_GT(num_nearest_found, num_queries * 8 / 10);
+}
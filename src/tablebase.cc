@@ -0,0 +1,1329 @@
+#include "tablebase.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "bitboard.h"
+#include "board.h"
+#include "endgame.h"
+#include "mapped_file.h"
+#include "memory_accounting.h"
+#include "repetition.h"
+
+namespace {
+constexpr int max_tb_pieces = Tablebases::max_supported_pieces;
+
+// The tables number the squares from a1 = 0 to h8 = 63, a1 to h1 first, so
+// their files are mirrored from those of `square_idx`.
+constexpr int tb_square(int sq_idx) { return sq_idx ^ 7; }
+constexpr int tb_file(int sq) { return sq & 7; }
+constexpr int tb_rank(int sq) { return sq >> 3; }
+// Positive above the a1-h8 diagonal, negative below it and 0 on it.
+constexpr int off_diagonal(int sq) { return tb_rank(sq) - tb_file(sq); }
+
+// The tables' codes of the pieces, indexed by Piece: 1 to 6 for the white
+// pawn, knight, bishop, rook, queen and king, plus 8 for black.
+constexpr std::array<int, num_piece_types> tb_piece_codes = {1, 4, 2, 3, 5, 6};
+constexpr int tb_black = 8;
+
+// The bits of the first byte of each compressed table.
+enum TableFlags : uint8_t {
+  // The side to move of a DTZ table, 1 for black.
+  stm_flag = 1,
+  // DTZ values go through a map of the values that occur.
+  mapped_flag = 2,
+  // DTZ values of wins and losses are in plies rather than moves.
+  win_plies_flag = 4,
+  loss_plies_flag = 8,
+  // The DTZ map has 16-bit values.
+  wide_flag = 16,
+  // Every position has the same value.
+  single_value_flag = 128
+};
+
+constexpr std::array<uint8_t, 4> wdl_magic = {0xD7, 0x66, 0x0C, 0xA5};
+constexpr std::array<uint8_t, 4> dtz_magic = {0x71, 0xE8, 0x23, 0x5D};
+
+// One more than the most plies a DTZ can be.
+constexpr int max_dtz = 1 << 18;
+
+uint16_t read_le16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+uint32_t read_le32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+         static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint32_t read_be32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+         static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+}
+
+uint64_t read_be64(const uint8_t* p) {
+  return static_cast<uint64_t>(read_be32(p)) << 32 | read_be32(p + 4);
+}
+
+// The tables that turn the squares of the pieces into an index.
+struct Encoding {
+  Encoding();
+
+  // Numbers the squares below the a1-h8 diagonal 0 to 27.
+  std::array<int, 64> map_b1h1h7_;
+  // Numbers the squares of the a1-d1-d4 triangle 0 to 9, those on the
+  // diagonal last.
+  std::array<int, 64> map_a1d1d4_;
+  // Numbers the 462 placements of two kings that don't touch, the first in
+  // the a1-d1-d4 triangle (by its `map_a1d1d4_`) and the second not above
+  // the diagonal if the first is on it.
+  std::array<std::array<int, 64>, 10> map_kk_;
+  // binomial_[k][n] is the number of ways to pick k of n things.
+  std::array<std::array<uint64_t, 64>, max_tb_pieces> binomial_;
+  // Numbers the squares from a2 to h7 by how near the edge and how low they
+  // are, from 47 down: the leading pawn is the one with the highest number.
+  std::array<int, 64> map_pawns_;
+  // The index of the leading pawns, by their number and the square of the
+  // leading one, and the number of indices for each file of the leading one.
+  std::array<std::array<uint64_t, 64>, 6> lead_pawn_idx_;
+  std::array<std::array<uint64_t, 4>, 6> lead_pawns_size_;
+};
+
+Encoding::Encoding()
+    : map_b1h1h7_(),
+      map_a1d1d4_(),
+      map_kk_(),
+      binomial_(),
+      map_pawns_(),
+      lead_pawn_idx_(),
+      lead_pawns_size_() {
+  int code = 0;
+  for (int sq = 0; sq < 64; ++sq) {
+    if (off_diagonal(sq) < 0) {
+      map_b1h1h7_[static_cast<size_t>(sq)] = code++;
+    }
+  }
+
+  code = 0;
+  std::vector<int> diagonal;
+  for (int sq = 0; sq <= 27; ++sq) {
+    if (tb_file(sq) > 3) {
+      continue;
+    }
+    if (off_diagonal(sq) < 0) {
+      map_a1d1d4_[static_cast<size_t>(sq)] = code++;
+    } else if (off_diagonal(sq) == 0) {
+      diagonal.push_back(sq);
+    }
+  }
+  for (int sq : diagonal) {
+    map_a1d1d4_[static_cast<size_t>(sq)] = code++;
+  }
+
+  code = 0;
+  std::vector<std::pair<int, int>> both_on_diagonal;
+  for (int idx = 0; idx < 10; ++idx) {
+    for (int s1 = 0; s1 <= 27; ++s1) {
+      // b1 is numbered 0, like every square off the triangle.
+      if (tb_file(s1) > 3 || off_diagonal(s1) > 0 ||
+          map_a1d1d4_[static_cast<size_t>(s1)] != idx || (!idx && s1 != 1)) {
+        continue;
+      }
+      for (int s2 = 0; s2 < 64; ++s2) {
+        if (std::abs(tb_file(s1) - tb_file(s2)) <= 1 &&
+            std::abs(tb_rank(s1) - tb_rank(s2)) <= 1) {
+          continue;
+        }
+        if (!off_diagonal(s1) && off_diagonal(s2) > 0) {
+          continue;
+        }
+        if (!off_diagonal(s1) && !off_diagonal(s2)) {
+          both_on_diagonal.emplace_back(idx, s2);
+        } else {
+          map_kk_[static_cast<size_t>(idx)][static_cast<size_t>(s2)] = code++;
+        }
+      }
+    }
+  }
+  for (const std::pair<int, int>& kings : both_on_diagonal) {
+    map_kk_[static_cast<size_t>(kings.first)]
+           [static_cast<size_t>(kings.second)] = code++;
+  }
+
+  binomial_[0][0] = 1;
+  for (size_t n = 1; n < 64; ++n) {
+    for (size_t k = 0; k < binomial_.size() && k <= n; ++k) {
+      binomial_[k][n] = (k > 0 ? binomial_[k - 1][n - 1] : 0) +
+                        (k < n ? binomial_[k][n - 1] : 0);
+    }
+  }
+
+  int available_squares = 47;
+  for (size_t num_lead_pawns = 1; num_lead_pawns <= 5; ++num_lead_pawns) {
+    for (int file = 0; file < 4; ++file) {
+      uint64_t idx = 0;
+      for (int rank = 1; rank < 7; ++rank) {
+        const int sq = rank * 8 + file;
+        if (num_lead_pawns == 1) {
+          map_pawns_[static_cast<size_t>(sq)] = available_squares--;
+          map_pawns_[static_cast<size_t>(sq ^ 7)] = available_squares--;
+        }
+        lead_pawn_idx_[num_lead_pawns][static_cast<size_t>(sq)] = idx;
+        idx += binomial_[num_lead_pawns - 1]
+                        [static_cast<size_t>(map_pawns_[static_cast<size_t>(sq)])];
+      }
+      lead_pawns_size_[num_lead_pawns][static_cast<size_t>(file)] = idx;
+    }
+  }
+}
+
+const Encoding& encoding() {
+  static const Encoding res;
+  return res;
+}
+
+// The compressed values of one side to move and one file of the leading pawn
+// of a table, and how to index them.
+struct PairsData {
+  uint8_t flags_;
+  // The lengths in bits of the shortest and longest Huffman codes, or the
+  // value of every position with `single_value_flag`.
+  int min_sym_len_;
+  int max_sym_len_;
+  size_t block_size_;
+  // There is an entry in the sparse index every `span_` values.
+  uint64_t span_;
+  uint32_t num_blocks_;
+  size_t block_length_size_;
+  size_t sparse_index_size_;
+  // The lowest symbol of each code length, little endian 16-bit words.
+  const uint8_t* lowest_sym_;
+  // The two symbols each symbol stands for, 12 bits each, in 3 bytes.
+  const uint8_t* btree_;
+  // The number of values in each block minus one, little endian 16-bit
+  // words.
+  const uint8_t* block_length_;
+  // A 32-bit block and a 16-bit offset into it every `span_` values, minus
+  // half a span, little endian.
+  const uint8_t* sparse_index_;
+  const uint8_t* data_;
+  // base64_[l] is the lowest code of length `min_sym_len_ + l` padded to 64
+  // bits, so that longer codes are lower.
+  std::vector<uint64_t> base64_;
+  // The number of values each symbol stands for, minus one.
+  std::vector<uint8_t> symlen_;
+  // The tables' piece codes in the order they are indexed in.
+  std::array<int, max_tb_pieces> pieces_;
+  // The pieces come in groups of the same piece, or the leading group, whose
+  // lengths end with 0, and whose indices are weighted by `group_idx_`.
+  std::array<int, max_tb_pieces + 1> group_len_;
+  std::array<uint64_t, max_tb_pieces + 1> group_idx_;
+  // Where the DTZ map of each result starts in the map, plus one.
+  std::array<uint16_t, 4> map_idx_;
+};
+
+int left_symbol(const PairsData& d, int sym) {
+  const uint8_t* lr = d.btree_ + 3 * sym;
+  return (lr[1] & 0xF) << 8 | lr[0];
+}
+
+int right_symbol(const PairsData& d, int sym) {
+  const uint8_t* lr = d.btree_ + 3 * sym;
+  return lr[2] << 4 | lr[1] >> 4;
+}
+
+// Finds the block of the value at `idx`, and the value's offset in it.
+void find_block(const PairsData& d, uint64_t idx, uint32_t* block,
+                int* offset) {
+  // The sparse index points close to the value, and the block lengths lead
+  // the rest of the way.
+  const size_t k = static_cast<size_t>(idx / d.span_);
+  *block = read_le32(d.sparse_index_ + 6 * k);
+  *offset = read_le16(d.sparse_index_ + 6 * k + 4);
+  *offset += static_cast<int>(idx % d.span_) - static_cast<int>(d.span_ / 2);
+  while (*offset < 0) {
+    *offset += read_le16(d.block_length_ + 2 * --*block) + 1;
+  }
+  while (*offset > read_le16(d.block_length_ + 2 * *block)) {
+    *offset -= read_le16(d.block_length_ + 2 * (*block)++) + 1;
+  }
+}
+
+// Reads the Huffman codes of `block` one symbol at a time, calling `fn` with
+// each until it returns false.
+template <typename Fn>
+void read_symbols(const PairsData& d, uint32_t block, Fn fn) {
+  const uint8_t* ptr = d.data_ + static_cast<uint64_t>(block) * d.block_size_;
+  uint64_t buf64 = read_be64(ptr);
+  ptr += 8;
+  int buf64_size = 64;
+  while (true) {
+    size_t len = 0;
+    while (buf64 < d.base64_[len]) {
+      ++len;
+    }
+    const size_t shift = 64 - len - static_cast<size_t>(d.min_sym_len_);
+    int sym = static_cast<int>((buf64 - d.base64_[len]) >> shift);
+    sym += read_le16(d.lowest_sym_ + 2 * len);
+    if (!fn(sym)) {
+      return;
+    }
+    const int bits = static_cast<int>(len) + d.min_sym_len_;
+    buf64 <<= bits;
+    buf64_size -= bits;
+    if (buf64_size <= 32) {
+      buf64_size += 32;
+      buf64 |= static_cast<uint64_t>(read_be32(ptr)) << (64 - buf64_size);
+      ptr += 4;
+    }
+  }
+}
+
+// Returns the value at `offset` in `block`.
+int decompress_value(const PairsData& d, uint32_t block, int offset) {
+  // Walk the codes of the block until the symbol that covers the value.
+  int sym = 0;
+  read_symbols(d, block, [&d, &offset, &sym](int next) {
+    sym = next;
+    if (offset < d.symlen_[static_cast<size_t>(sym)] + 1) {
+      return false;
+    }
+    offset -= d.symlen_[static_cast<size_t>(sym)] + 1;
+    return true;
+  });
+
+  // Then expand the symbol into its pair down to the single value.
+  while (d.symlen_[static_cast<size_t>(sym)]) {
+    const int left = left_symbol(d, sym);
+    if (offset < d.symlen_[static_cast<size_t>(left)] + 1) {
+      sym = left;
+    } else {
+      offset -= d.symlen_[static_cast<size_t>(left)] + 1;
+      sym = right_symbol(d, sym);
+    }
+  }
+  return left_symbol(d, sym);
+}
+
+// The values of a block, counted with the tablebases as the cache keeps them.
+using BlockValues = TaggedVector<uint8_t, MemoryTag::tablebases>;
+
+// Appends the values `sym` stands for to `values`.
+void expand_symbol(const PairsData& d, int sym, BlockValues* values) {
+  if (!d.symlen_[static_cast<size_t>(sym)]) {
+    values->push_back(static_cast<uint8_t>(left_symbol(d, sym)));
+    return;
+  }
+  expand_symbol(d, left_symbol(d, sym), values);
+  expand_symbol(d, right_symbol(d, sym), values);
+}
+
+// Sets `values` to all those of `block`, which must fit in a byte.
+void decompress_block(const PairsData& d, uint32_t block,
+                      BlockValues* values) {
+  const size_t num_values = read_le16(d.block_length_ + 2 * block) + size_t{1};
+  values->clear();
+  values->reserve(num_values + 256);
+  read_symbols(d, block, [&d, num_values, values](int sym) {
+    expand_symbol(d, sym, values);
+    return values->size() < num_values;
+  });
+  values->resize(num_values);
+}
+
+// Returns the value at `idx`.
+int decompress_pairs(const PairsData& d, uint64_t idx) {
+  if (d.flags_ & single_value_flag) {
+    return d.min_sym_len_;
+  }
+  uint32_t block;
+  int offset;
+  find_block(d, idx, &block, &offset);
+  return decompress_value(d, block, offset);
+}
+
+// Sets the number of values of `sym` and the symbols it is made of.
+uint8_t set_symlen(PairsData* d, int sym, std::vector<bool>* visited) {
+  (*visited)[static_cast<size_t>(sym)] = true;
+  const int right = right_symbol(*d, sym);
+  if (right == 0xFFF) {
+    return 0;
+  }
+  const int left = left_symbol(*d, sym);
+  for (int child : {left, right}) {
+    if (!(*visited)[static_cast<size_t>(child)]) {
+      d->symlen_[static_cast<size_t>(child)] = set_symlen(d, child, visited);
+    }
+  }
+  return static_cast<uint8_t>(d->symlen_[static_cast<size_t>(left)] +
+                              d->symlen_[static_cast<size_t>(right)] + 1);
+}
+
+// Reads the sizes and the Huffman codes, and returns what follows them.
+const uint8_t* set_sizes(PairsData* d, const uint8_t* data) {
+  d->flags_ = *data++;
+  if (d->flags_ & single_value_flag) {
+    d->num_blocks_ = 0;
+    d->span_ = 1;
+    d->block_length_size_ = 0;
+    d->sparse_index_size_ = 0;
+    d->min_sym_len_ = *data++;
+    return data;
+  }
+  size_t num_groups = 0;
+  while (d->group_len_[num_groups]) {
+    ++num_groups;
+  }
+  const uint64_t table_size = d->group_idx_[num_groups];
+  d->block_size_ = size_t{1} << *data++;
+  d->span_ = uint64_t{1} << *data++;
+  d->sparse_index_size_ =
+      static_cast<size_t>((table_size + d->span_ - 1) / d->span_);
+  const uint8_t padding = *data++;
+  d->num_blocks_ = read_le32(data);
+  data += 4;
+  // Padded so that the sparse index never points past the end.
+  d->block_length_size_ = d->num_blocks_ + padding;
+  d->max_sym_len_ = *data++;
+  d->min_sym_len_ = *data++;
+  d->lowest_sym_ = data;
+  const size_t num_lengths =
+      static_cast<size_t>(d->max_sym_len_ - d->min_sym_len_ + 1);
+  d->base64_.assign(num_lengths, 0);
+  // The canonical code gives longer codes lower values, so the lowest code
+  // of each length is half the next shorter one's, plus the symbols between.
+  for (size_t i = num_lengths - 1; i-- > 0;) {
+    d->base64_[i] = (d->base64_[i + 1] + read_le16(d->lowest_sym_ + 2 * i) -
+                     read_le16(d->lowest_sym_ + 2 * (i + 1))) /
+                    2;
+  }
+  for (size_t i = 0; i < num_lengths; ++i) {
+    d->base64_[i] <<= 64 - i - static_cast<size_t>(d->min_sym_len_);
+  }
+  data += 2 * num_lengths;
+  d->symlen_.assign(read_le16(data), 0);
+  data += 2;
+  d->btree_ = data;
+  std::vector<bool> visited(d->symlen_.size());
+  for (size_t sym = 0; sym < d->symlen_.size(); ++sym) {
+    if (!visited[sym]) {
+      d->symlen_[sym] = set_symlen(d, static_cast<int>(sym), &visited);
+    }
+  }
+  return data + 3 * d->symlen_.size() + (d->symlen_.size() & 1);
+}
+}  // namespace.
+
+struct Tablebases::TableFile {
+  std::string path_;
+  std::mutex mutex_;
+  // 0 until the first probe maps the file, then 1, or -1 if that failed.
+  std::atomic<int> state_;
+  std::unique_ptr<MappedFile> file_;
+  // Indexed by side to move, then by the file of the leading pawn.
+  std::array<std::array<PairsData, 4>, 2> pairs_;
+  // The DTZ maps.
+  const uint8_t* map_;
+};
+
+struct Tablebases::Table {
+  // Such as "KRPvKP", the stronger side first.
+  std::string name_;
+  // The material key with the stronger side white, then black.
+  uint64_t key_;
+  uint64_t key2_;
+  int num_pieces_;
+  bool has_pawns_;
+  // Whether any piece but the kings is the only one of its kind and color.
+  bool has_unique_pieces_;
+  // The pawns of the leading color, the one with fewer pawns (but some),
+  // then of the other.
+  std::array<int, 2> pawn_count_;
+  // Indexed by is_dtz. The DTZ file may be missing.
+  std::array<TableFile, 2> files_;
+
+  int num_sides(bool is_dtz) const {
+    return !is_dtz && key_ != key2_ ? 2 : 1;
+  }
+  const PairsData& pairs(bool is_dtz, int stm, int file) const {
+    return files_[is_dtz].pairs_[static_cast<size_t>(stm % num_sides(is_dtz))]
+                                [static_cast<size_t>(has_pawns_ ? file : 0)];
+  }
+};
+
+struct Tablebases::Cache {
+  explicit Cache(size_t bytes);
+  ~Cache();
+
+  // Returns the value at `idx` of `d`, decompressing its block on a miss.
+  int value(const PairsData& d, uint64_t idx);
+  absl::optional<Wdl> find(uint64_t key);
+  void add(uint64_t key, Wdl wdl);
+
+  int64_t results_bytes() const {
+    return static_cast<int64_t>((results_mask_ + 1) * sizeof(uint64_t));
+  }
+
+  static constexpr size_t num_shards = 16;
+  // What a block takes besides its values, in its list node and index.
+  static constexpr size_t block_overhead = 64;
+
+  using BlockKey = std::pair<const PairsData*, uint32_t>;
+  using BlockList =
+      std::list<std::pair<BlockKey, BlockValues>,
+                TaggedAllocator<std::pair<BlockKey, BlockValues>,
+                                MemoryTag::tablebases>>;
+  struct alignas(64) Shard {
+    std::mutex mutex_;
+    // The most recently used first.
+    BlockList blocks_;
+    absl::flat_hash_map<
+        BlockKey, BlockList::iterator, absl::Hash<BlockKey>,
+        std::equal_to<BlockKey>,
+        TaggedAllocator<std::pair<const BlockKey, BlockList::iterator>,
+                        MemoryTag::tablebases>>
+        index_;
+    size_t bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+  };
+
+  std::array<Shard, num_shards> shards_;
+  const size_t shard_bytes_;
+  // The key of a result with its low 3 bits set to the result plus 3, so
+  // that no entry is 0, or 0 if empty. The entries are indexed by at least
+  // those 3 bits of the key, so the rest tell it apart.
+  const size_t results_mask_;
+  std::unique_ptr<std::atomic<uint64_t>[]> results_;
+  std::atomic<uint64_t> probe_hits_;
+  std::atomic<uint64_t> probe_misses_;
+};
+
+namespace {
+size_t num_results(size_t cache_bytes) {
+  size_t res = 8;
+  while (res * 2 * sizeof(uint64_t) <= cache_bytes / 8) {
+    res *= 2;
+  }
+  return res;
+}
+}  // namespace.
+
+Tablebases::Cache::Cache(size_t bytes)
+    : shard_bytes_((bytes - bytes / 8) / num_shards),
+      results_mask_(num_results(bytes) - 1),
+      results_(new std::atomic<uint64_t>[results_mask_ + 1]),
+      probe_hits_(0),
+      probe_misses_(0) {
+  for (size_t i = 0; i <= results_mask_; ++i) {
+    results_[i].store(0, std::memory_order_relaxed);
+  }
+  add_memory(MemoryTag::tablebases, results_bytes());
+}
+
+Tablebases::Cache::~Cache() {
+  add_memory(MemoryTag::tablebases, -results_bytes());
+}
+
+int Tablebases::Cache::value(const PairsData& d, uint64_t idx) {
+  uint32_t block;
+  int offset;
+  find_block(d, idx, &block, &offset);
+  const BlockKey key(&d, block);
+  Shard& shard = shards_[absl::Hash<BlockKey>()(key) % num_shards];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    const auto found = shard.index_.find(key);
+    if (found != shard.index_.end()) {
+      shard.blocks_.splice(shard.blocks_.begin(), shard.blocks_,
+                           found->second);
+      ++shard.hits_;
+      return found->second->second[static_cast<size_t>(offset)];
+    }
+  }
+  // Decompressed without the lock, so that the other blocks of the shard
+  // aren't held up. Two threads may decompress a block at once, and then
+  // only the first is kept.
+  BlockValues values;
+  decompress_block(d, block, &values);
+  const int res = values[static_cast<size_t>(offset)];
+  std::lock_guard<std::mutex> lock(shard.mutex_);
+  ++shard.misses_;
+  if (!shard.index_.contains(key)) {
+    shard.bytes_ += values.size() + block_overhead;
+    shard.blocks_.emplace_front(key, std::move(values));
+    shard.index_.emplace(key, shard.blocks_.begin());
+    while (shard.bytes_ > shard_bytes_) {
+      shard.bytes_ -= shard.blocks_.back().second.size() + block_overhead;
+      shard.index_.erase(shard.blocks_.back().first);
+      shard.blocks_.pop_back();
+    }
+  }
+  return res;
+}
+
+absl::optional<Wdl> Tablebases::Cache::find(uint64_t key) {
+  const uint64_t entry =
+      results_[key & results_mask_].load(std::memory_order_relaxed);
+  if (!(entry & 7) || (entry ^ key) >> 3) {
+    probe_misses_.fetch_add(1, std::memory_order_relaxed);
+    return absl::nullopt;
+  }
+  probe_hits_.fetch_add(1, std::memory_order_relaxed);
+  return static_cast<Wdl>(static_cast<int>(entry & 7) - 3);
+}
+
+void Tablebases::Cache::add(uint64_t key, Wdl wdl) {
+  results_[key & results_mask_].store(
+      (key & ~uint64_t{7}) | static_cast<uint64_t>(static_cast<int>(wdl) + 3),
+      std::memory_order_relaxed);
+}
+
+namespace {
+// Splits the pieces of `d` into groups and sets the weight of each group in
+// the index. `file` is that of the leading pawn.
+void set_groups(PairsData* d, const std::array<int, 2>& order, int file,
+                int num_pieces, bool has_pawns, bool has_unique_pieces,
+                const std::array<int, 2>& pawn_count) {
+  const Encoding& enc = encoding();
+  // The kings and the leading pieces, or the leading pawns, come first.
+  int first_len = has_pawns ? 0 : has_unique_pieces ? 3 : 2;
+  size_t n = 0;
+  d->group_len_[n] = 1;
+  for (size_t i = 1; i < static_cast<size_t>(num_pieces); ++i) {
+    if (--first_len > 0 || d->pieces_[i] == d->pieces_[i - 1]) {
+      ++d->group_len_[n];
+    } else {
+      d->group_len_[++n] = 1;
+    }
+  }
+  d->group_len_[++n] = 0;
+
+  // The groups are weighted in a per table order, with the leading group at
+  // `order[0]` and the other color's pawns, if any, at `order[1]`.
+  const bool both_have_pawns = has_pawns && pawn_count[1];
+  size_t next = both_have_pawns ? 2 : 1;
+  int free_squares =
+      64 - d->group_len_[0] - (both_have_pawns ? d->group_len_[1] : 0);
+  uint64_t idx = 1;
+  for (int k = 0; next < n || k == order[0] || k == order[1]; ++k) {
+    if (k == order[0]) {
+      d->group_idx_[0] = idx;
+      idx *= has_pawns
+                 ? enc.lead_pawns_size_[static_cast<size_t>(d->group_len_[0])]
+                                       [static_cast<size_t>(file)]
+                 : has_unique_pieces ? 31332 : 462;
+    } else if (k == order[1]) {
+      d->group_idx_[1] = idx;
+      idx *= enc.binomial_[static_cast<size_t>(d->group_len_[1])]
+                          [static_cast<size_t>(48 - d->group_len_[0])];
+    } else {
+      d->group_idx_[next] = idx;
+      idx *= enc.binomial_[static_cast<size_t>(d->group_len_[next])]
+                          [static_cast<size_t>(free_squares)];
+      free_squares -= d->group_len_[next++];
+    }
+  }
+  d->group_idx_[n] = idx;
+}
+
+// Returns the number of plies of the DTZ before a zeroing move that keeps
+// `wdl`.
+int dtz_before_zeroing(Wdl wdl) {
+  switch (wdl) {
+    case Wdl::win:
+      return 1;
+    case Wdl::cursed_win:
+      return 101;
+    case Wdl::blessed_loss:
+      return -101;
+    case Wdl::loss:
+      return -1;
+    default:
+      return 0;
+  }
+}
+
+int sign(int x) { return (x > 0) - (x < 0); }
+
+bool is_capture(const Board& board, Move move) {
+  return (move.dst_square() & board.occupancy_) ||
+         move.move_type_ == MoveType::en_passant;
+}
+
+bool is_zeroing(const Board& board, Move move) {
+  return move.piece_moving_ == Piece::pawn || is_capture(board, move);
+}
+
+bool is_mated(const Board& board) {
+  return board.legal_moves().empty() &&
+         board.is_king_attacked(board.is_whites_move_ ? Color::white
+                                                      : Color::black);
+}
+
+bool file_exists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Appends to `sides` every set of up to `max_len` pieces besides the king,
+// strongest first, that starts with `prefix` and goes on with pieces no
+// stronger than those of `pieces`.
+void add_sides(const std::string& prefix, absl::string_view pieces,
+               size_t max_len, std::vector<std::string>* sides) {
+  sides->push_back(prefix);
+  if (prefix.size() == max_len) {
+    return;
+  }
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    add_sides(prefix + pieces[i], pieces.substr(i), max_len, sides);
+  }
+}
+}  // namespace.
+
+Tablebases::Tablebases(const std::string& paths, size_t cache_bytes)
+    : num_files_(0),
+      max_pieces_(0),
+      cache_(cache_bytes ? new Cache(cache_bytes) : nullptr) {
+  const std::vector<std::string> dirs =
+      absl::StrSplit(paths, ':', absl::SkipEmpty());
+  if (dirs.empty()) {
+    return;
+  }
+  const auto find = [&dirs](const std::string& name) -> std::string {
+    for (const std::string& dir : dirs) {
+      const std::string path = dir + "/" + name;
+      if (file_exists(path)) {
+        return path;
+      }
+    }
+    return "";
+  };
+
+  // The files are named after the stronger side first, which is looked for
+  // both ways rather than worked out.
+  std::vector<std::string> sides;
+  add_sides("", "QRBNP", static_cast<size_t>(max_tb_pieces - 2), &sides);
+  for (size_t i = 0; i < sides.size(); ++i) {
+    for (size_t j = i; j < sides.size(); ++j) {
+      const size_t num_pieces = sides[i].size() + sides[j].size();
+      if (num_pieces == 0 || num_pieces > static_cast<size_t>(max_tb_pieces - 2)) {
+        continue;
+      }
+      std::string name = "K" + sides[i] + "vK" + sides[j];
+      std::string wdl_path = find(name + ".rtbw");
+      if (wdl_path.empty() && i != j) {
+        name = "K" + sides[j] + "vK" + sides[i];
+        wdl_path = find(name + ".rtbw");
+      }
+      if (wdl_path.empty()) {
+        continue;
+      }
+      std::unique_ptr<Table> table(new Table);
+      table->name_ = name;
+      const size_t v = name.find('v');
+      table->key_ = material_key_of(name);
+      table->key2_ = material_key_of(name.substr(v + 1) + "v" +
+                                     name.substr(0, v));
+      table->num_pieces_ = static_cast<int>(name.size()) - 1;
+      const int white_pawns = static_cast<int>(
+          std::count(name.begin(), name.begin() + static_cast<long>(v), 'P'));
+      const int black_pawns = static_cast<int>(
+          std::count(name.begin() + static_cast<long>(v), name.end(), 'P'));
+      table->has_pawns_ = white_pawns + black_pawns > 0;
+      table->has_unique_pieces_ = false;
+      for (const std::string& side : {sides[i], sides[j]}) {
+        for (char piece : side) {
+          table->has_unique_pieces_ |=
+              std::count(side.begin(), side.end(), piece) == 1;
+        }
+      }
+      // With pawns on both sides, the side with fewer leads.
+      const bool white_leads =
+          !black_pawns || (white_pawns && black_pawns >= white_pawns);
+      table->pawn_count_ = {white_leads ? white_pawns : black_pawns,
+                            white_leads ? black_pawns : white_pawns};
+      table->files_[0].path_ = wdl_path;
+      table->files_[1].path_ = find(name + ".rtbz");
+      for (TableFile& file : table->files_) {
+        file.state_ = file.path_.empty() ? -1 : 0;
+        num_files_ += !file.path_.empty();
+      }
+      max_pieces_ = std::max(max_pieces_, table->num_pieces_);
+      tables_.push_back(std::move(table));
+    }
+  }
+
+  size_t num_slots = 16;
+  while (num_slots < 4 * tables_.size()) {
+    num_slots *= 2;
+  }
+  slots_.assign(num_slots, nullptr);
+  for (const std::unique_ptr<Table>& table : tables_) {
+    for (uint64_t key : {table->key_, table->key2_}) {
+      size_t idx = key & (num_slots - 1);
+      while (slots_[idx] && slots_[idx] != table.get()) {
+        idx = (idx + 1) & (num_slots - 1);
+      }
+      slots_[idx] = table.get();
+    }
+  }
+}
+
+Tablebases::~Tablebases() {}
+
+const Tablebases::Table* Tablebases::find_table(uint64_t material_key) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+  const size_t mask = slots_.size() - 1;
+  for (size_t idx = material_key & mask; slots_[idx];
+       idx = (idx + 1) & mask) {
+    if (slots_[idx]->key_ == material_key ||
+        slots_[idx]->key2_ == material_key) {
+      return slots_[idx];
+    }
+  }
+  return nullptr;
+}
+
+bool Tablebases::map_file(const Table& table, bool is_dtz) const {
+  TableFile& file = const_cast<Table&>(table).files_[is_dtz];
+  const int state = file.state_.load(std::memory_order_acquire);
+  if (state != 0) {
+    return state > 0;
+  }
+  std::lock_guard<std::mutex> lock(file.mutex_);
+  if (file.state_.load(std::memory_order_relaxed) != 0) {
+    return file.state_.load(std::memory_order_relaxed) > 0;
+  }
+  file.state_.store(-1, std::memory_order_relaxed);
+  file.file_.reset(new MappedFile(file.path_, MemoryTag::tablebases));
+  // The tables end with a 16-byte checksum after 64-byte aligned data.
+  const std::array<uint8_t, 4>& magic = is_dtz ? dtz_magic : wdl_magic;
+  const uint8_t* const begin =
+      reinterpret_cast<const uint8_t*>(file.file_->data());
+  if (!begin || file.file_->size() < 5 || file.file_->size() % 64 != 16 ||
+      !std::equal(magic.begin(), magic.end(), begin)) {
+    file.file_.reset();
+    return false;
+  }
+
+  const uint8_t* data = begin + 4;
+  constexpr uint8_t split_flag = 1;
+  constexpr uint8_t has_pawns_flag = 2;
+  if (static_cast<bool>(*data & has_pawns_flag) != table.has_pawns_ ||
+      (!is_dtz &&
+       static_cast<bool>(*data & split_flag) != (table.key_ != table.key2_))) {
+    file.file_.reset();
+    return false;
+  }
+  ++data;
+  const size_t num_sides = static_cast<size_t>(table.num_sides(is_dtz));
+  const int num_files = table.has_pawns_ ? 4 : 1;
+  const bool both_have_pawns = table.has_pawns_ && table.pawn_count_[1];
+  for (int f = 0; f < num_files; ++f) {
+    const size_t fi = static_cast<size_t>(f);
+    for (size_t side = 0; side < num_sides; ++side) {
+      file.pairs_[side][fi] = PairsData();
+    }
+    const std::array<std::array<int, 2>, 2> order = {
+        {{*data & 0xF, both_have_pawns ? data[1] & 0xF : 0xF},
+         {*data >> 4, both_have_pawns ? data[1] >> 4 : 0xF}}};
+    data += 1 + both_have_pawns;
+    for (size_t k = 0; k < static_cast<size_t>(table.num_pieces_);
+         ++k, ++data) {
+      for (size_t side = 0; side < num_sides; ++side) {
+        file.pairs_[side][fi].pieces_[k] = side ? *data >> 4 : *data & 0xF;
+      }
+    }
+    for (size_t side = 0; side < num_sides; ++side) {
+      set_groups(&file.pairs_[side][fi], order[side], f, table.num_pieces_,
+                 table.has_pawns_, table.has_unique_pieces_,
+                 table.pawn_count_);
+    }
+  }
+  data += (data - begin) & 1;
+  for (size_t f = 0; f < static_cast<size_t>(num_files); ++f) {
+    for (size_t side = 0; side < num_sides; ++side) {
+      data = set_sizes(&file.pairs_[side][f], data);
+    }
+  }
+
+  if (is_dtz) {
+    // The maps of the DTZ values, by result: win, loss, cursed win and
+    // blessed loss.
+    file.map_ = data;
+    for (size_t f = 0; f < static_cast<size_t>(num_files); ++f) {
+      PairsData& d = file.pairs_[0][f];
+      if (!(d.flags_ & mapped_flag)) {
+        continue;
+      }
+      if (d.flags_ & wide_flag) {
+        data += (data - begin) & 1;
+        for (size_t i = 0; i < 4; ++i) {
+          d.map_idx_[i] = static_cast<uint16_t>((data - file.map_) / 2 + 1);
+          data += 2 * read_le16(data) + 2;
+        }
+      } else {
+        for (size_t i = 0; i < 4; ++i) {
+          d.map_idx_[i] = static_cast<uint16_t>(data - file.map_ + 1);
+          data += *data + 1;
+        }
+      }
+    }
+    data += (data - begin) & 1;
+  }
+
+  for (size_t f = 0; f < static_cast<size_t>(num_files); ++f) {
+    for (size_t side = 0; side < num_sides; ++side) {
+      PairsData& d = file.pairs_[side][f];
+      d.sparse_index_ = data;
+      data += 6 * d.sparse_index_size_;
+    }
+  }
+  for (size_t f = 0; f < static_cast<size_t>(num_files); ++f) {
+    for (size_t side = 0; side < num_sides; ++side) {
+      PairsData& d = file.pairs_[side][f];
+      d.block_length_ = data;
+      data += 2 * d.block_length_size_;
+    }
+  }
+  for (size_t f = 0; f < static_cast<size_t>(num_files); ++f) {
+    for (size_t side = 0; side < num_sides; ++side) {
+      PairsData& d = file.pairs_[side][f];
+      data = begin + ((data - begin + 0x3F) & ~0x3F);
+      d.data_ = data;
+      data += static_cast<size_t>(d.num_blocks_) * d.block_size_;
+    }
+  }
+  if (data > begin + file.file_->size()) {
+    file.file_.reset();
+    return false;
+  }
+  file.state_.store(1, std::memory_order_release);
+  return true;
+}
+
+int Tablebases::probe_table(const Board& board, bool is_dtz, Wdl wdl,
+                            ProbeState* state) const {
+  if (popcount(board.occupancy_) == 2) {
+    return static_cast<int>(Wdl::draw);
+  }
+  const Table* table = find_table(board.material_key_);
+  if (!table || !map_file(*table, is_dtz)) {
+    *state = ProbeState::fail;
+    return 0;
+  }
+  const Encoding& enc = encoding();
+
+  // The tables have the stronger side white, and only white to move when
+  // both sides have the same pieces. Otherwise the colors and ranks are
+  // flipped.
+  const bool black_to_move = !board.is_whites_move_;
+  const bool flip = (table->key_ == table->key2_ && black_to_move) ||
+                    board.material_key_ != table->key_;
+  const int flip_color = flip ? tb_black : 0;
+  const int flip_squares = flip ? 56 : 0;
+  const int stm = flip != black_to_move;
+
+  std::array<int, max_tb_pieces> squares;
+  std::array<int, max_tb_pieces> pieces;
+  size_t size = 0;
+  size_t num_lead_pawns = 0;
+  Bitboard lead_pawns = 0;
+  int file = 0;
+  const auto pawn_order = [&enc](int a, int b) {
+    return enc.map_pawns_[static_cast<size_t>(a)] <
+           enc.map_pawns_[static_cast<size_t>(b)];
+  };
+  if (table->has_pawns_) {
+    // The pawns of the leading color come first, the one nearest the edge
+    // and lowest in front, which picks the table of its file.
+    const int code = table->pairs(is_dtz, 0, 0).pieces_[0] ^ flip_color;
+    lead_pawns = board.pieces(code & tb_black ? Color::black : Color::white,
+                              Piece::pawn);
+    for (Bitboard square : bitboard_split(lead_pawns)) {
+      squares[size++] = tb_square(square_idx(square)) ^ flip_squares;
+    }
+    num_lead_pawns = size;
+    std::swap(squares[0], *std::max_element(squares.begin(),
+                                            squares.begin() + size,
+                                            pawn_order));
+    file = std::min(tb_file(squares[0]), 7 - tb_file(squares[0]));
+  }
+  if (is_dtz) {
+    // DTZ tables have one side to move, the other is found by a search.
+    const PairsData& d = table->pairs(true, stm, file);
+    if ((d.flags_ & stm_flag) != stm &&
+        !(table->key_ == table->key2_ && !table->has_pawns_)) {
+      *state = ProbeState::change_side_to_move;
+      return 0;
+    }
+  }
+  for (Bitboard square : bitboard_split(board.occupancy_ & ~lead_pawns)) {
+    const int sq_idx = square_idx(square);
+    const int color = square & board.black_occupancy_ ? tb_black : 0;
+    const Piece piece = board.mailbox_[static_cast<size_t>(sq_idx)];
+    squares[size] = tb_square(sq_idx) ^ flip_squares;
+    pieces[size++] =
+        (tb_piece_codes[static_cast<size_t>(piece)] | color) ^ flip_color;
+  }
+  const PairsData& d = table->pairs(is_dtz, stm, file);
+
+  // Put the pieces in the order of the table.
+  for (size_t i = num_lead_pawns; i + 1 < size; ++i) {
+    for (size_t j = i + 1; j < size; ++j) {
+      if (d.pieces_[i] == pieces[j]) {
+        std::swap(pieces[i], pieces[j]);
+        std::swap(squares[i], squares[j]);
+        break;
+      }
+    }
+  }
+  // Mirror the files to bring the leading piece to files a to d.
+  if (tb_file(squares[0]) > 3) {
+    for (size_t i = 0; i < size; ++i) {
+      squares[i] ^= 7;
+    }
+  }
+
+  uint64_t idx;
+  if (table->has_pawns_) {
+    idx = enc.lead_pawn_idx_[num_lead_pawns][static_cast<size_t>(squares[0])];
+    std::stable_sort(squares.begin() + 1, squares.begin() + num_lead_pawns,
+                     pawn_order);
+    for (size_t i = 1; i < num_lead_pawns; ++i) {
+      idx += enc.binomial_[i][static_cast<size_t>(
+          enc.map_pawns_[static_cast<size_t>(squares[i])])];
+    }
+  } else {
+    // Without pawns the ranks can be mirrored too, and the board around the
+    // a1-h8 diagonal, bringing the leading piece to the a1-d1-d4 triangle and
+    // the first of its group off the diagonal below it.
+    if (tb_rank(squares[0]) > 3) {
+      for (size_t i = 0; i < size; ++i) {
+        squares[i] ^= 56;
+      }
+    }
+    for (size_t i = 0; i < static_cast<size_t>(d.group_len_[0]); ++i) {
+      if (!off_diagonal(squares[i])) {
+        continue;
+      }
+      if (off_diagonal(squares[i]) > 0) {
+        for (size_t j = i; j < size; ++j) {
+          squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+        }
+      }
+      break;
+    }
+    const size_t s0 = static_cast<size_t>(squares[0]);
+    if (table->has_unique_pieces_) {
+      // The kings and a unique piece: the first below the diagonal, or on
+      // it with the next below, and so on.
+      const int adjust1 = squares[1] > squares[0];
+      const int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+      if (off_diagonal(squares[0])) {
+        idx = static_cast<uint64_t>(
+            (enc.map_a1d1d4_[s0] * 63 + (squares[1] - adjust1)) * 62 +
+            squares[2] - adjust2);
+      } else if (off_diagonal(squares[1])) {
+        idx = static_cast<uint64_t>(
+            (6 * 63 + tb_rank(squares[0]) * 28 +
+             enc.map_b1h1h7_[static_cast<size_t>(squares[1])]) *
+                62 +
+            squares[2] - adjust2);
+      } else if (off_diagonal(squares[2])) {
+        idx = static_cast<uint64_t>(
+            6 * 63 * 62 + 4 * 28 * 62 + tb_rank(squares[0]) * 7 * 28 +
+            (tb_rank(squares[1]) - adjust1) * 28 +
+            enc.map_b1h1h7_[static_cast<size_t>(squares[2])]);
+      } else {
+        idx = static_cast<uint64_t>(
+            6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 +
+            tb_rank(squares[0]) * 7 * 6 + (tb_rank(squares[1]) - adjust1) * 6 +
+            (tb_rank(squares[2]) - adjust2));
+      }
+    } else {
+      idx = static_cast<uint64_t>(
+          enc.map_kk_[static_cast<size_t>(enc.map_a1d1d4_[s0])]
+                     [static_cast<size_t>(squares[1])]);
+    }
+  }
+
+  // The other groups, each the index of its squares among those left free
+  // by the groups before.
+  idx *= d.group_idx_[0];
+  size_t group_begin = static_cast<size_t>(d.group_len_[0]);
+  bool other_pawns = table->has_pawns_ && table->pawn_count_[1];
+  for (size_t next = 1; d.group_len_[next]; ++next) {
+    const size_t group_end =
+        group_begin + static_cast<size_t>(d.group_len_[next]);
+    std::stable_sort(squares.begin() + group_begin,
+                     squares.begin() + group_end);
+    uint64_t n = 0;
+    for (size_t i = group_begin; i < group_end; ++i) {
+      const int below = static_cast<int>(
+          std::count_if(squares.begin(), squares.begin() + group_begin,
+                        [&squares, i](int sq) { return squares[i] > sq; }));
+      n += enc.binomial_[i - group_begin + 1][static_cast<size_t>(
+          squares[i] - below - (other_pawns ? 8 : 0))];
+    }
+    other_pawns = false;
+    idx += n * d.group_idx_[next];
+    group_begin = group_end;
+  }
+
+  // Single values aren't worth caching, and DTZ values may not fit in a
+  // byte.
+  int value = cache_ && !is_dtz && !(d.flags_ & single_value_flag)
+                  ? cache_->value(d, idx)
+                  : decompress_pairs(d, idx);
+  if (!is_dtz) {
+    return value - 2;
+  }
+  // The DTZ maps are by result, in the order win, loss, cursed win and
+  // blessed loss.
+  constexpr std::array<size_t, 5> map_order = {1, 3, 0, 2, 0};
+  const TableFile& dtz_file = table->files_[1];
+  if (d.flags_ & mapped_flag) {
+    const size_t map_idx =
+        d.map_idx_[map_order[static_cast<size_t>(static_cast<int>(wdl) + 2)]] +
+        static_cast<size_t>(value);
+    value = d.flags_ & wide_flag ? read_le16(dtz_file.map_ + 2 * map_idx)
+                                 : dtz_file.map_[map_idx];
+  }
+  if ((wdl == Wdl::win && !(d.flags_ & win_plies_flag)) ||
+      (wdl == Wdl::loss && !(d.flags_ & loss_plies_flag)) ||
+      wdl == Wdl::cursed_win || wdl == Wdl::blessed_loss) {
+    value *= 2;
+  }
+  return value + 1;
+}
+
+Wdl Tablebases::search(const Board& board, bool check_zeroing_moves,
+                       ProbeState* state) const {
+  // The tables may not have the right value when a capture is best, or
+  // without en passant, so the captures are searched first. Probing DTZ
+  // searches the pawn moves too.
+  Wdl best = Wdl::loss;
+  const MoveList moves = board.legal_moves();
+  size_t num_searched = 0;
+  for (Move move : moves) {
+    if (!is_capture(board, move) &&
+        (!check_zeroing_moves || move.piece_moving_ != Piece::pawn)) {
+      continue;
+    }
+    ++num_searched;
+    Board after = board;
+    after.do_move(move);
+    const Wdl value =
+        static_cast<Wdl>(-static_cast<int>(search(after, false, state)));
+    if (*state == ProbeState::fail) {
+      return Wdl::draw;
+    }
+    if (value > best) {
+      best = value;
+      if (value == Wdl::win) {
+        *state = ProbeState::zeroing_best_move;
+        return value;
+      }
+    }
+  }
+  // With every move searched, the table's value could be wrong.
+  const bool all_searched = num_searched && num_searched == moves.size();
+  Wdl value = best;
+  if (!all_searched) {
+    value = static_cast<Wdl>(probe_table(board, false, Wdl::draw, state));
+    if (*state == ProbeState::fail) {
+      return Wdl::draw;
+    }
+  }
+  // A best zeroing move may have a "don't care" value in the DTZ table.
+  if (best >= value) {
+    *state = best > Wdl::draw || all_searched ? ProbeState::zeroing_best_move
+                                              : ProbeState::ok;
+    return best;
+  }
+  *state = ProbeState::ok;
+  return value;
+}
+
+absl::optional<Wdl> Tablebases::probe_wdl(const Board& board) const {
+  if (cache_) {
+    if (const absl::optional<Wdl> cached = cache_->find(board.key_)) {
+      return cached;
+    }
+  }
+  ProbeState state = ProbeState::ok;
+  const Wdl res = search(board, false, &state);
+  if (state == ProbeState::fail) {
+    return absl::nullopt;
+  }
+  if (cache_) {
+    cache_->add(board.key_, res);
+  }
+  return res;
+}
+
+int Tablebases::probe_dtz(const Board& board, ProbeState* state) const {
+  *state = ProbeState::ok;
+  const Wdl wdl = search(board, true, state);
+  if (*state == ProbeState::fail || wdl == Wdl::draw) {
+    return 0;
+  }
+  if (*state == ProbeState::zeroing_best_move) {
+    return dtz_before_zeroing(wdl);
+  }
+  int dtz = probe_table(board, true, wdl, state);
+  if (*state == ProbeState::fail) {
+    return 0;
+  }
+  if (*state != ProbeState::change_side_to_move) {
+    const bool is_cursed = wdl == Wdl::cursed_win || wdl == Wdl::blessed_loss;
+    return (dtz + (is_cursed ? 100 : 0)) * sign(static_cast<int>(wdl));
+  }
+  // The table is of the other side to move: the best move has the DTZ after
+  // it plus one.
+  int min_dtz = 0xFFFF;
+  for (Move move : board.legal_moves()) {
+    const bool zeroing = is_zeroing(board, move);
+    Board after = board;
+    after.do_move(move);
+    // Zeroing moves take the DTZ from before the move, with the sign of the
+    // result after it.
+    dtz = zeroing ? -dtz_before_zeroing(search(after, false, state))
+                  : -probe_dtz(after, state);
+    if (dtz == 1 && is_mated(after)) {
+      min_dtz = 1;
+    }
+    if (!zeroing) {
+      dtz += sign(dtz);
+    }
+    if (dtz < min_dtz && sign(dtz) == sign(static_cast<int>(wdl))) {
+      min_dtz = dtz;
+    }
+    if (*state == ProbeState::fail) {
+      return 0;
+    }
+  }
+  // Mated.
+  return min_dtz == 0xFFFF ? -1 : min_dtz;
+}
+
+absl::optional<int> Tablebases::probe_dtz(const Board& board) const {
+  ProbeState state;
+  const int res = probe_dtz(board, &state);
+  if (state == ProbeState::fail) {
+    return absl::nullopt;
+  }
+  return res;
+}
+
+absl::optional<MoveList> Tablebases::best_root_moves(
+    const Board& board, const KeyHistory& history) const {
+  const MoveList moves = board.legal_moves();
+  if (moves.empty()) {
+    return absl::nullopt;
+  }
+  const int fifty_move_clock = board.fifty_move_clock_;
+  const bool has_repeated = history.has_repeated();
+  KeyHistory line = history;
+  std::array<int, max_moves> ranks;
+  bool by_dtz = true;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    Board after = board;
+    after.do_move(moves[i]);
+    line.push(after);
+    ProbeState state = ProbeState::ok;
+    int dtz;
+    if (after.fifty_move_clock_ == 0) {
+      const absl::optional<Wdl> wdl = probe_wdl(after);
+      state = wdl ? ProbeState::ok : ProbeState::fail;
+      dtz = wdl ? dtz_before_zeroing(
+                      static_cast<Wdl>(-static_cast<int>(*wdl)))
+                : 0;
+    } else if (line.is_repetition(1) || after.fifty_move_clock_ >= 100) {
+      dtz = 0;
+    } else {
+      dtz = -probe_dtz(after, &state);
+      dtz += sign(dtz);
+    }
+    if (dtz == 2 && is_mated(after)) {
+      dtz = 1;
+    }
+    line.pop();
+    if (state == ProbeState::fail) {
+      by_dtz = false;
+      break;
+    }
+    // Wins within the fifty moves rank the same, the others rank by how close
+    // they come. Losses rank the same unless the fifty move rule is in sight.
+    ranks[i] = dtz > 0 ? (dtz + fifty_move_clock <= 99 && !has_repeated
+                              ? max_dtz
+                              : max_dtz / 2 - (dtz + fifty_move_clock))
+               : dtz < 0 ? (-dtz * 2 + fifty_move_clock < 100
+                                ? -max_dtz
+                                : -max_dtz / 2 + (-dtz + fifty_move_clock))
+                         : 0;
+  }
+  if (!by_dtz) {
+    // Without the DTZ tables, by the result alone.
+    for (size_t i = 0; i < moves.size(); ++i) {
+      Board after = board;
+      after.do_move(moves[i]);
+      line.push(after);
+      const bool is_draw =
+          line.is_repetition(1) || after.fifty_move_clock_ >= 100;
+      line.pop();
+      const absl::optional<Wdl> wdl =
+          is_draw ? absl::optional<Wdl>(Wdl::draw) : probe_wdl(after);
+      if (!wdl) {
+        return absl::nullopt;
+      }
+      ranks[i] = -static_cast<int>(*wdl);
+    }
+  }
+  const int best = *std::max_element(ranks.begin(),
+                                     ranks.begin() + moves.size());
+  MoveList res;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    if (ranks[i] == best) {
+      res.push_back(moves[i]);
+    }
+  }
+  return res;
+}
+
+TablebaseCacheStats Tablebases::cache_stats() const {
+  TablebaseCacheStats res = {0, 0, 0, 0};
+  if (!cache_) {
+    return res;
+  }
+  for (Cache::Shard& shard : cache_->shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    res.block_hits_ += shard.hits_;
+    res.block_misses_ += shard.misses_;
+  }
+  res.probe_hits_ = cache_->probe_hits_.load(std::memory_order_relaxed);
+  res.probe_misses_ = cache_->probe_misses_.load(std::memory_order_relaxed);
+  return res;
+}
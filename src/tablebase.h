@@ -0,0 +1,132 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "repetition.h"
+
+// Probing of Syzygy endgame tablebases of up to seven pieces.
+//
+//  - WDL tables (.rtbw) give the result of a position with best play, for
+//    both sides to move: a win, a draw or a loss, and whether the fifty move
+//    rule turns the win or loss into a draw (a cursed win or a blessed loss).
+//  - DTZ tables (.rtbz) give the number of plies to the next capture or pawn
+//    move, the move that zeroes the fifty move clock, on the fastest way to
+//    keep the result, for one side to move only.
+//
+// A position is turned into an index from the squares of its pieces, after
+// mirroring it so that the side with more material is white and the first
+// piece is in a corner triangle of the board. The values of consecutive
+// indices are stored in compressed blocks, each of which is a stream of
+// canonical Huffman codes of symbols that stand for runs of values, built by
+// pairing the most frequent adjacent symbols over and over (recursive
+// pairing). The tables don't know about en passant or don't care about
+// positions where a capture is best, so the probes look at the captures
+// themselves.
+//
+// The constructor only looks at which files exist. A file is mapped into
+// memory the first time a position of its table is probed, and only the pages
+// of the blocks that the probes decompress are ever read from disk. Probing is
+// thread-safe, and without a cache only allocates when it maps a file.
+//
+// Probes in a search come back to the same few endgames, and so to the same
+// blocks, which on a slow disk cost a read and otherwise a walk over the
+// codes each time. A cache can keep the WDL blocks decompressed, a byte a
+// value, in shards by the hash of the block, each with a lock and a list of
+// its blocks in the order they were last used. The results of `probe_wdl`
+// are kept too, by the Zobrist key of the position, in a table of one word an
+// entry that is read and written without a lock.
+
+// A result, from the side to move's point of view.
+enum class Wdl : int {
+  loss = -2,
+  blessed_loss = -1,
+  draw = 0,
+  cursed_win = 1,
+  win = 2
+};
+
+// How often the cache had what a probe needed.
+struct TablebaseCacheStats {
+  uint64_t block_hits_;
+  uint64_t block_misses_;
+  uint64_t probe_hits_;
+  uint64_t probe_misses_;
+};
+
+class Tablebases {
+ public:
+  static constexpr int max_supported_pieces = 7;
+
+  // Looks for tables in `paths`, directories separated by ':'. An empty
+  // string finds none. The cache takes up to about `cache_bytes`, an eighth
+  // for the results and the rest for the blocks, and 0 turns it off.
+  explicit Tablebases(const std::string& paths, size_t cache_bytes = 0);
+  Tablebases(const Tablebases&) = delete;
+  Tablebases& operator=(const Tablebases&) = delete;
+  ~Tablebases();
+
+  // The number of WDL and DTZ files found.
+  size_t num_files() const { return num_files_; }
+  // The most pieces, kings included, of a position with a WDL table, or 0.
+  int max_pieces() const { return max_pieces_; }
+
+  // The probes need a position without castling rights and with at most
+  // `max_pieces()` pieces. They return nullopt if a table they need is
+  // missing or can't be read.
+
+  // Returns the result of `board`.
+  absl::optional<Wdl> probe_wdl(const Board& board) const;
+  // Returns the plies to the next zeroing move on the way to the result of
+  // `board`, positive for a win and negative for a loss, 0 for a draw. A
+  // cursed win or blessed loss is 100 plies further. The count may be one ply
+  // too high, as the tables round some of it to moves.
+  absl::optional<int> probe_dtz(const Board& board) const;
+  // Returns the legal moves of `board` that keep the best result: the wins
+  // that the fifty move rule can't spoil, else those that come closest, else
+  // the draws, and the losses that hold out longest. `history` ends with
+  // `board`, and tells whether the game repeated since the last zeroing move,
+  // which makes the winning side hurry. Ranks the moves by DTZ, or by WDL
+  // without DTZ tables.
+  absl::optional<MoveList> best_root_moves(const Board& board,
+                                           const KeyHistory& history) const;
+
+  // All zeros without a cache.
+  TablebaseCacheStats cache_stats() const;
+
+ private:
+  struct Table;
+  struct TableFile;
+  struct Cache;
+  enum class ProbeState { ok, fail, change_side_to_move, zeroing_best_move };
+
+  const Table* find_table(uint64_t material_key) const;
+  // Maps and parses the file on the first call.
+  bool map_file(const Table& table, bool is_dtz) const;
+  // Looks up `board` in the WDL or DTZ table of its material. `wdl` is the
+  // result of the position when probing DTZ.
+  int probe_table(const Board& board, bool is_dtz, Wdl wdl,
+                  ProbeState* state) const;
+  // Returns the result of `board`, searching the captures first, and all
+  // zeroing moves for `check_zeroing_moves`.
+  Wdl search(const Board& board, bool check_zeroing_moves,
+             ProbeState* state) const;
+  int probe_dtz(const Board& board, ProbeState* state) const;
+
+  std::vector<std::unique_ptr<Table>> tables_;
+  // Open addressing by material key; each table is in it twice, once with
+  // each color as the stronger side.
+  std::vector<const Table*> slots_;
+  size_t num_files_;
+  int max_pieces_;
+  // Null without a cache.
+  std::unique_ptr<Cache> cache_;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "tablebase.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+#include "repetition.h"
+
+namespace {
+// Writes a KQvK table in which every position has the same value: 4 (a win)
+// with white to move and 0 (a loss) with black to move for the WDL table, and
+// 4 (a DTZ of 9 plies) for the DTZ table, which has white to move only.
+void write_kqvk_tables(const std::string& dir) {
+  for (bool is_dtz : {false, true}) {
+    std::vector<uint8_t> data(80);
+    const std::vector<uint8_t> header =
+        is_dtz ? std::vector<uint8_t>{0x71, 0xE8, 0x23, 0x5D,
+                                      // Split, without pawns.
+                                      0x01,
+                                      // The order of the groups.
+                                      0x00,
+                                      // The white king, the black king and
+                                      // the white queen.
+                                      0x06, 0x0E, 0x05,
+                                      // Padding, then a single value.
+                                      0x00, 0x80, 0x04}
+               : std::vector<uint8_t>{0xD7, 0x66, 0x0C, 0xA5, 0x01, 0x00,
+                                      0x66, 0xEE, 0x55, 0x00, 0x80, 0x04,
+                                      0x80, 0x00};
+    std::copy(header.begin(), header.end(), data.begin());
+    std::ofstream(dir + (is_dtz ? "/KQvK.rtbz" : "/KQvK.rtbw"),
+                  std::ios::binary)
+        .write(reinterpret_cast<const char*>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+  }
+}
+
+// Writes a KQvK WDL table of blocks of Huffman codes in which, with white to
+// move, the position of every third index is a draw and the others are wins.
+// Black to move is a loss.
+void write_compressed_kqvk_table(const std::string& dir) {
+  constexpr size_t table_size = 31332;
+  constexpr size_t block_values = 128;
+  constexpr size_t num_blocks =
+      (table_size + block_values - 1) / block_values;
+  constexpr size_t span = 1024;
+  std::vector<uint8_t> data = {
+      0xD7, 0x66, 0x0C, 0xA5, 0x01, 0x00, 0x66, 0xEE, 0x55, 0x00,
+      // Blocks of 32 bytes, a sparse index entry every 1024 values, no
+      // padding and the number of blocks.
+      0x00, 0x05, 0x0A, 0x00, static_cast<uint8_t>(num_blocks), 0x00, 0x00,
+      0x00,
+      // Codes of one bit, of symbols from 0: symbol 0 is a win and 1 a draw.
+      0x01, 0x01, 0x00, 0x00, 0x02, 0x00, 0x04, 0xF0, 0xFF, 0x02, 0xF0, 0xFF,
+      // Black to move.
+      0x80, 0x00};
+  const auto add_le = [&data](size_t value, size_t num_bytes) {
+    for (size_t i = 0; i < num_bytes; ++i) {
+      data.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  };
+  // The block and offset of the middle value of each span.
+  for (size_t idx = span / 2; idx < table_size + span / 2; idx += span) {
+    add_le(idx / block_values, 4);
+    add_le(idx % block_values, 2);
+  }
+  for (size_t block = 0; block < num_blocks; ++block) {
+    add_le(std::min(table_size - block * block_values, block_values) - 1, 2);
+  }
+  data.resize((data.size() + 63) / 64 * 64);
+  for (size_t idx = 0; idx < num_blocks * block_values; ++idx) {
+    if (idx % block_values == 0) {
+      data.resize(data.size() + 32);
+    }
+    if (idx % 3 == 0) {
+      data[data.size() - 32 + idx % block_values / 8] |=
+          static_cast<uint8_t>(0x80 >> (idx % 8));
+    }
+  }
+  data.resize((data.size() + 63) / 64 * 64 + 16);
+  std::ofstream(dir + "/KQvK.rtbw", std::ios::binary)
+      .write(reinterpret_cast<const char*>(data.data()),
+             static_cast<std::streamsize>(data.size()));
+}
+
+std::string table_dir() {
+  const std::string dir = testing::TempDir() + "tablebase_test";
+  mkdir(dir.c_str(), 0755);
+  write_kqvk_tables(dir);
+  return dir;
+}
+
+bool contains(const MoveList& moves, const std::string& move) {
+  for (Move m : moves) {
+    if (m.to_uci_str() == move) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace.
+
+TEST(Tablebases, FindsNothingWithoutPaths) {
+  const Tablebases tablebases("");
+  EXPECT_EQ(tablebases.num_files(), 0);
+  EXPECT_EQ(tablebases.max_pieces(), 0);
+  EXPECT_FALSE(tablebases.probe_wdl(Board("4k3/8/8/8/8/8/8/3QK3 w - - 0 1")));
+}
+
+TEST(Tablebases, ProbesWdl) {
+  const Tablebases tablebases("/no/such/dir:" + table_dir());
+  EXPECT_EQ(tablebases.num_files(), 2);
+  EXPECT_EQ(tablebases.max_pieces(), 3);
+  EXPECT_EQ(tablebases.probe_wdl(Board("4k3/8/8/8/8/8/8/3QK3 w - - 0 1")),
+            Wdl::win);
+  EXPECT_EQ(tablebases.probe_wdl(Board("4k3/8/8/8/8/8/8/3QK3 b - - 0 1")),
+            Wdl::loss);
+  // The same table with the colors swapped.
+  EXPECT_EQ(tablebases.probe_wdl(Board("3qk3/8/8/8/8/8/8/4K3 b - - 0 1")),
+            Wdl::win);
+  EXPECT_EQ(tablebases.probe_wdl(Board("3qk3/8/8/8/8/8/8/4K3 w - - 0 1")),
+            Wdl::loss);
+  // Taking the queen draws, whatever the table says.
+  EXPECT_EQ(tablebases.probe_wdl(Board("7K/8/8/8/8/8/5Qk1/8 b - - 0 1")),
+            Wdl::draw);
+  EXPECT_FALSE(tablebases.probe_wdl(Board("4k3/8/8/8/8/8/8/3RK3 w - - 0 1")));
+}
+
+TEST(Tablebases, ProbesDtz) {
+  const Tablebases tablebases(table_dir());
+  EXPECT_EQ(tablebases.probe_dtz(Board("4k3/8/8/8/8/8/8/3QK3 w - - 0 1")), 9);
+  // The table has white to move only, so black's moves are looked at.
+  EXPECT_EQ(tablebases.probe_dtz(Board("4k3/8/8/8/8/8/8/3QK3 b - - 0 1")),
+            -10);
+  EXPECT_EQ(tablebases.probe_dtz(Board("7K/8/8/8/8/8/5Qk1/8 b - - 0 1")), 0);
+}
+
+TEST(Tablebases, KeepsTheWinAtTheRoot) {
+  const Tablebases tablebases(table_dir());
+  const Board board("4k3/8/8/8/8/8/8/3QK3 w - - 0 1");
+  KeyHistory history;
+  history.reset(board);
+  const absl::optional<MoveList> moves =
+      tablebases.best_root_moves(board, history);
+  ASSERT_TRUE(moves);
+  EXPECT_LT(moves->size(), board.legal_moves().size());
+  EXPECT_TRUE(contains(*moves, "d1d4"));
+  // The queen would hang.
+  EXPECT_FALSE(contains(*moves, "d1d8"));
+  EXPECT_FALSE(contains(*moves, "d1d7"));
+}
+
+TEST(Tablebases, CachesBlocksAndResults) {
+  const std::string dir = testing::TempDir() + "tablebase_test_compressed";
+  mkdir(dir.c_str(), 0755);
+  write_compressed_kqvk_table(dir);
+  const Tablebases uncached(dir);
+  const Tablebases cached(dir, 1 << 20);
+  EXPECT_EQ(uncached.cache_stats().block_misses_, 0);
+
+  // The white king and queen anywhere off the lines to the black king on h8,
+  // with white to move.
+  std::vector<Board> boards;
+  const auto is_off_lines = [](int file, int rank) {
+    return file != 7 && rank != 7 && file != rank;
+  };
+  for (int king = 0; king < 64; ++king) {
+    for (int queen = 0; queen < 64; ++queen) {
+      if (king == queen || !is_off_lines(king % 8, king / 8) ||
+          !is_off_lines(queen % 8, queen / 8)) {
+        continue;
+      }
+      std::string squares(64, '1');
+      squares[static_cast<size_t>(king)] = 'K';
+      squares[static_cast<size_t>(queen)] = 'Q';
+      std::string fen = "7k";
+      for (int rank = 6; rank >= 0; --rank) {
+        fen += "/" + squares.substr(static_cast<size_t>(rank * 8), 8);
+      }
+      boards.emplace_back(fen + " w - - 0 1");
+    }
+  }
+  size_t num_draws = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const Board& board : boards) {
+      const absl::optional<Wdl> wdl = uncached.probe_wdl(board);
+      ASSERT_TRUE(wdl);
+      EXPECT_EQ(cached.probe_wdl(board), wdl) << board.to_fen();
+      num_draws += pass == 0 && *wdl == Wdl::draw;
+    }
+    // Each probe that misses the results reads a block, there being no
+    // captures to search.
+    const TablebaseCacheStats stats = cached.cache_stats();
+    EXPECT_EQ(stats.probe_hits_ + stats.probe_misses_,
+              (pass + 1) * boards.size());
+    EXPECT_EQ(stats.block_hits_ + stats.block_misses_, stats.probe_misses_);
+    // More positions than blocks.
+    EXPECT_LE(stats.block_misses_, 245);
+    if (pass == 0) {
+      EXPECT_EQ(stats.probe_hits_, 0);
+    } else {
+      // Some results share an entry.
+      EXPECT_GT(stats.probe_hits_, boards.size() * 3 / 4);
+    }
+  }
+  EXPECT_GT(num_draws, boards.size() / 5);
+  EXPECT_LT(num_draws, boards.size() / 2);
+  EXPECT_EQ(cached.probe_wdl(Board("7k/8/8/8/8/8/8/K2Q4 b - - 0 1")),
+            Wdl::loss);
+}
@@ -0,0 +1,143 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "absl/types/optional.h"
+#include "numa.h"
+
+namespace {
+// The pool and the worker index of the calling thread, if it is a worker.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+}  // namespace.
+
+ThreadPool::ThreadPool(size_t num_threads, const ThreadAffinity& affinity)
+    : queued_(0), pending_(0), next_worker_(0), stop_(false) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const size_t num_nodes = numa_nodes().size();
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+    if (!affinity.cpus_.empty()) {
+      numa_nodes_.push_back(
+          numa_node_of_cpu(affinity.cpus_[i % affinity.cpus_.size()]));
+    } else if (affinity.numa_nodes_) {
+      numa_nodes_.push_back(i % num_nodes);
+    } else {
+      numa_nodes_.push_back(0);
+    }
+  }
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back([this, i, affinity] {
+      if (!affinity.cpus_.empty()) {
+        bind_to_cpus({affinity.cpus_[i % affinity.cpus_.size()]});
+      } else if (affinity.numa_nodes_ && numa_nodes().size() > 1) {
+        bind_to_numa_node(i);
+      }
+      run(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_available_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+absl::optional<size_t> ThreadPool::worker_index() const {
+  if (current_pool != this) {
+    return absl::nullopt;
+  }
+  return current_worker;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  size_t target;
+  if (current_pool == this) {
+    target = current_worker;
+  } else {
+    std::lock_guard<std::mutex> lock(mutex_);
+    target = next_worker_;
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+  }
+  // Count the task before it becomes visible, so that the worker that takes
+  // it never sees the counters go below zero.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+    ++pending_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(workers_[target]->mutex_);
+    workers_[target]->tasks_.push_back(std::move(task));
+  }
+  work_available_.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  all_done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::take_task(size_t self, std::function<void()>* task) {
+  {
+    Worker& own = *workers_[self];
+    std::lock_guard<std::mutex> lock(own.mutex_);
+    if (!own.tasks_.empty()) {
+      *task = std::move(own.tasks_.back());
+      own.tasks_.pop_back();
+      return true;
+    }
+  }
+  for (size_t offset = 1; offset < workers_.size(); ++offset) {
+    Worker& victim = *workers_[(self + offset) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex_);
+    if (!victim.tasks_.empty()) {
+      *task = std::move(victim.tasks_.front());
+      victim.tasks_.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(size_t self) {
+  current_pool = this;
+  current_worker = self;
+  std::function<void()> task;
+  while (true) {
+    if (take_task(self, &task)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --queued_;
+      }
+      task();
+      task = nullptr;
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) {
+        all_done_.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_available_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/types/optional.h"
+
+// Where the workers of a pool may run. By default anywhere, as the system
+// schedules them.
+struct ThreadAffinity {
+  // Worker `i` is pinned to CPU `cpus_[i % cpus_.size()]`, so that it never
+  // migrates and finds its caches as it left them between tasks.
+  std::vector<int> cpus_;
+  // Without `cpus_`, on a machine of more than one NUMA node, worker `i` only
+  // runs on the CPUs of node `i` modulo the number of nodes, so that the
+  // memory it touches first stays near it.
+  bool numa_nodes_ = false;
+};
+
+// A fixed set of worker threads with one task deque each. A worker takes its
+// newest task first and, when its own deque is empty, steals the oldest task of
+// another worker, so that big subtrees spread out while each worker stays on
+// recently pushed, cache-warm work. Tasks may submit more tasks. Idle workers
+// sleep on a condition variable, and a pool is meant to be kept and reused,
+// by parallel perft and the search alike, rather than started per job.
+class ThreadPool {
+ public:
+  // Starts `num_threads` workers; 0 means one per hardware thread. A worker
+  // that can't be bound as `affinity` says runs anywhere.
+  explicit ThreadPool(size_t num_threads,
+                      const ThreadAffinity& affinity = {});
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  // Waits for all submitted tasks and joins the workers.
+  ~ThreadPool();
+
+  // Queues `task`. From inside a task it goes to the calling worker's deque,
+  // from outside the pool the workers take turns.
+  void submit(std::function<void()> task);
+  // Blocks until every submitted task, including tasks submitted by tasks, has
+  // finished. Must not be called from inside a task.
+  void wait();
+  size_t num_threads() const { return threads_.size(); }
+  // The index of the calling thread among the workers, or nullopt if it isn't
+  // a worker of this pool, for tasks that keep per-worker state.
+  absl::optional<size_t> worker_index() const;
+  // The NUMA node worker `worker` was bound to, as `ThreadAffinity` placed
+  // it: that of its CPU, or its node in turn. 0 for workers that run
+  // anywhere, and on a machine of one node.
+  size_t numa_node(size_t worker) const { return numa_nodes_[worker]; }
+
+ private:
+  struct Worker {
+    std::mutex mutex_;
+    std::deque<std::function<void()>> tasks_;
+  };
+
+  // Takes a task from worker `self`'s deque, or steals one.
+  bool take_task(size_t self, std::function<void()>* task);
+  void run(size_t self);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  // Indexed by worker.
+  std::vector<size_t> numa_nodes_;
+  // Guards the counters below and the two condition variables.
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable all_done_;
+  // Tasks submitted but not yet taken by a worker.
+  size_t queued_;
+  // Tasks submitted but not yet finished.
+  size_t pending_;
+  size_t next_worker_;
+  bool stop_;
+};
+
+#endif
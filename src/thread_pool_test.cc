@@ -0,0 +1,90 @@
+#include "thread_pool.h"
+
+#include <sched.h>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+#include "absl/types/optional.h"
+#include "gtest/gtest.h"
+#include "numa.h"
+
+TEST(ThreadPool, RunsEveryTask) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  std::atomic<int> count(0);
+  for (int i = 0; i < 1000; ++i) {
+    pool.submit([&count] { count.fetch_add(1); });
+  }
+  pool.wait();
+  EXPECT_EQ(count.load(), 1000);
+}
+
+TEST(ThreadPool, TasksSubmitTasks) {
+  ThreadPool pool(3);
+  std::atomic<int> leaves(0);
+  // Each task fans out into ten more, three levels deep.
+  std::function<void(int)> fan_out = [&](int level) {
+    if (level == 0) {
+      leaves.fetch_add(1);
+      return;
+    }
+    for (int i = 0; i < 10; ++i) {
+      pool.submit([&fan_out, level] { fan_out(level - 1); });
+    }
+  };
+  pool.submit([&fan_out] { fan_out(3); });
+  pool.wait();
+  EXPECT_EQ(leaves.load(), 1000);
+}
+
+TEST(ThreadPool, ReusableAfterWait) {
+  ThreadPool pool(2);
+  std::atomic<int> count(0);
+  for (int round = 0; round < 3; ++round) {
+    pool.submit([&count] { count.fetch_add(1); });
+    pool.wait();
+    EXPECT_EQ(count.load(), round + 1);
+  }
+}
+
+TEST(ThreadPool, KnowsItsWorkers) {
+  ThreadPool pool(3);
+  ThreadPool other(1);
+  EXPECT_FALSE(pool.worker_index().has_value());
+  std::atomic<int> num_valid(0);
+  for (int i = 0; i < 100; ++i) {
+    pool.submit([&pool, &other, &num_valid] {
+      const absl::optional<size_t> idx = pool.worker_index();
+      if (idx && *idx < pool.num_threads() && !other.worker_index()) {
+        num_valid.fetch_add(1);
+      }
+    });
+  }
+  pool.wait();
+  EXPECT_EQ(num_valid.load(), 100);
+}
+
+TEST(ThreadPool, DefaultsToHardwareThreads) {
+  ThreadPool pool(0);
+  EXPECT_GE(pool.num_threads(), size_t{1});
+}
+
+TEST(ThreadPool, PinsWorkersToCpus) {
+  // A CPU this process may run on.
+  const int cpu = sched_getcpu();
+  ASSERT_GE(cpu, 0);
+  ThreadPool pool(2, {{cpu}, false});
+  std::atomic<int> num_elsewhere(0);
+  for (int i = 0; i < 100; ++i) {
+    pool.submit([&num_elsewhere, cpu] {
+      if (sched_getcpu() != cpu) {
+        num_elsewhere.fetch_add(1);
+      }
+    });
+  }
+  pool.wait();
+  EXPECT_EQ(num_elsewhere.load(), 0);
+  EXPECT_EQ(pool.numa_node(1), numa_node_of_cpu(cpu));
+}
@@ -0,0 +1,93 @@
+#include "time_manager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "absl/types/optional.h"
+#include "board.h"
+
+namespace {
+// The moves the remaining time is spread over without a `movestogo`, and the
+// most it is spread over with one.
+constexpr int default_moves_to_go = 30;
+constexpr int max_moves_to_go = 50;
+}  // namespace.
+
+TimeManager::TimeManager(const TimeControl& time_control, Color side,
+                         bool pondering)
+    : start_(Clock::now().time_since_epoch().count()),
+      pondering_(pondering),
+      is_limited_(true),
+      soft_limit_(0),
+      hard_limit_(0),
+      num_iterations_(0),
+      num_stable_iterations_(0),
+      score_(0) {
+  const size_t side_idx = static_cast<size_t>(side);
+  const int64_t time_left = time_control.time_left_[side_idx];
+  if (time_control.move_time_ > 0) {
+    soft_limit_ = hard_limit_ =
+        std::max<int64_t>(1, time_control.move_time_ - move_overhead);
+  } else if (time_left > 0) {
+    const int64_t available = std::max<int64_t>(1, time_left - move_overhead);
+    const int moves_to_go = time_control.moves_to_go_ > 0
+                                ? std::min(time_control.moves_to_go_,
+                                           max_moves_to_go)
+                                : default_moves_to_go;
+    // Most of the increment comes back after the move, so most of it can
+    // be spent on it. Never plan on more than half of what is left, or stop
+    // later than a few times the plan.
+    soft_limit_ =
+        std::min(available / moves_to_go +
+                     time_control.increment_[side_idx] * 3 / 4,
+                 available / 2);
+    hard_limit_ = std::min(soft_limit_ * 4, available * 4 / 5);
+    soft_limit_ = std::max<int64_t>(1, std::min(soft_limit_, hard_limit_));
+    hard_limit_ = std::max(hard_limit_, soft_limit_);
+  } else {
+    is_limited_ = false;
+  }
+  adjusted_soft_limit_ = soft_limit_;
+}
+
+void TimeManager::on_iteration(absl::optional<Move> best_move, int score) {
+  if (num_iterations_ > 0) {
+    num_stable_iterations_ =
+        best_move == best_move_ ? num_stable_iterations_ + 1 : 0;
+  }
+  // In percent of the soft limit.
+  int scale = 100;
+  if (num_iterations_ > 0 && num_stable_iterations_ == 0) {
+    scale = 130;
+  } else if (num_stable_iterations_ >= 4) {
+    scale = 60;
+  } else if (num_stable_iterations_ >= 2) {
+    scale = 80;
+  }
+  // A falling score means trouble, which is worth more time to get out of.
+  const int score_drop = num_iterations_ > 0 ? score_ - score : 0;
+  if (score_drop > 100) {
+    scale *= 2;
+  } else if (score_drop > 30) {
+    scale = scale * 3 / 2;
+  }
+  adjusted_soft_limit_ = std::min(hard_limit_, soft_limit_ * scale / 100);
+  best_move_ = best_move;
+  score_ = score;
+  ++num_iterations_;
+}
+
+void TimeManager::ponderhit() {
+  start_.store(Clock::now().time_since_epoch().count(),
+               std::memory_order_relaxed);
+  pondering_.store(false, std::memory_order_release);
+}
+
+int64_t TimeManager::elapsed() const {
+  const Clock::time_point start(
+      Clock::duration(start_.load(std::memory_order_relaxed)));
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                               start)
+      .count();
+}
@@ -0,0 +1,92 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "absl/types/optional.h"
+#include "board.h"
+
+// The clock situation of a search as a UCI `go` command gives it. All times
+// are in milliseconds, and 0 means not given.
+struct TimeControl {
+  std::array<int64_t, num_colors> time_left_;
+  std::array<int64_t, num_colors> increment_;
+  // The moves until the next time control.
+  int moves_to_go_;
+  // A fixed time for this move, which overrides the rest.
+  int64_t move_time_;
+};
+
+// Decides how long a search may run. From the time control it allots:
+//
+//  - a soft limit, after which no new iteration is started, and which moves
+//    with the search: it shrinks while the best move stays the same over
+//    iterations, and grows when the best move changes or the score drops;
+//  - a hard limit, at which an iteration is abandoned.
+//
+// Both are measured from the construction of the manager, or from the
+// ponderhit when it starts out pondering: while pondering neither limit
+// applies, since it is the opponent's clock that runs. A fixed move time is a
+// hard limit, and both limits leave a margin for the time it takes to send
+// the move.
+class TimeManager {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // How much of the clock is kept back for the latency of sending a move.
+  static constexpr int64_t move_overhead = 10;
+
+  // `side` is the side to move.
+  TimeManager(const TimeControl& time_control, Color side,
+              bool pondering = false);
+  TimeManager(const TimeManager&) = delete;
+  TimeManager& operator=(const TimeManager&) = delete;
+
+  // Ends pondering: the opponent played the expected move, so our clock runs
+  // and the limits apply from now on. May be called from another thread than
+  // the search's.
+  void ponderhit();
+
+  // Returns false if the time control sets no limit, as with `go infinite`.
+  bool is_limited() const { return is_limited_; }
+  int64_t soft_limit() const { return soft_limit_; }
+  int64_t hard_limit() const { return hard_limit_; }
+  // The soft limit scaled by how the iterations went so far.
+  int64_t adjusted_soft_limit() const { return adjusted_soft_limit_; }
+
+  // Takes in the result of a completed iteration.
+  void on_iteration(absl::optional<Move> best_move, int score);
+  // Returns true if the search shouldn't start another iteration.
+  bool should_stop_iterating() const {
+    return is_limited_ && !pondering_.load(std::memory_order_acquire) &&
+           elapsed() >= adjusted_soft_limit_;
+  }
+  // Returns true if the search should abandon its iteration. Reads the clock,
+  // so the search only asks every so many nodes.
+  bool is_hard_limit_reached() const {
+    return is_limited_ && !pondering_.load(std::memory_order_acquire) &&
+           elapsed() >= hard_limit_;
+  }
+  // The milliseconds since the manager was constructed, or since the
+  // ponderhit.
+  int64_t elapsed() const;
+
+ private:
+  // The start as a time since the clock's epoch, which can be atomic.
+  std::atomic<Clock::rep> start_;
+  std::atomic<bool> pondering_;
+  bool is_limited_;
+  int64_t soft_limit_;
+  int64_t hard_limit_;
+  int64_t adjusted_soft_limit_;
+  int num_iterations_;
+  // The number of iterations in a row that kept the best move.
+  int num_stable_iterations_;
+  absl::optional<Move> best_move_;
+  int score_;
+};
+
+#endif
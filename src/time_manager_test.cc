@@ -0,0 +1,110 @@
+#include "time_manager.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+TimeControl clock_time(int64_t time_left, int64_t increment,
+                       int moves_to_go = 0) {
+  TimeControl res = {};
+  res.time_left_[static_cast<size_t>(Color::white)] = time_left;
+  res.increment_[static_cast<size_t>(Color::white)] = increment;
+  res.moves_to_go_ = moves_to_go;
+  return res;
+}
+
+const Move e2e4(str_to_square("e2"), str_to_square("e4"), Piece::pawn,
+                MoveType::two_step_pawn);
+const Move d2d4(str_to_square("d2"), str_to_square("d4"), Piece::pawn,
+                MoveType::two_step_pawn);
+}  // namespace.
+
+TEST(TimeManager, Unlimited) {
+  const TimeManager time_manager(TimeControl{}, Color::white);
+  EXPECT_FALSE(time_manager.is_limited());
+  EXPECT_FALSE(time_manager.should_stop_iterating());
+  EXPECT_FALSE(time_manager.is_hard_limit_reached());
+}
+
+TEST(TimeManager, MoveTime) {
+  TimeControl time_control = {};
+  time_control.move_time_ = 1000;
+  // A move time overrides the clock.
+  time_control.time_left_ = {5, 5};
+  const TimeManager time_manager(time_control, Color::white);
+  EXPECT_TRUE(time_manager.is_limited());
+  EXPECT_EQ(time_manager.hard_limit(), 1000 - TimeManager::move_overhead);
+  EXPECT_EQ(time_manager.soft_limit(), time_manager.hard_limit());
+}
+
+TEST(TimeManager, SpreadsClockOverMoves) {
+  const TimeManager sudden_death(clock_time(60000, 0), Color::white);
+  EXPECT_GT(sudden_death.soft_limit(), 1000);
+  EXPECT_LT(sudden_death.soft_limit(), 3000);
+  EXPECT_GT(sudden_death.hard_limit(), sudden_death.soft_limit());
+  EXPECT_LT(sudden_death.hard_limit(), 60000 / 2);
+
+  // The increment is mostly spent, and few moves to go leave more per move.
+  const TimeManager with_increment(clock_time(60000, 1000), Color::white);
+  EXPECT_GT(with_increment.soft_limit(), sudden_death.soft_limit() + 500);
+  const TimeManager few_moves(clock_time(60000, 0, 5), Color::white);
+  EXPECT_GT(few_moves.soft_limit(), 10000);
+
+  // The other side's clock doesn't matter.
+  const TimeManager black(clock_time(60000, 0), Color::black);
+  EXPECT_FALSE(black.is_limited());
+}
+
+TEST(TimeManager, NeverPlansOnMoreThanIsLeft) {
+  for (int64_t time_left : {1, 5, 20, 100, 1000}) {
+    const TimeManager time_manager(clock_time(time_left, 5000, 1),
+                                   Color::white);
+    EXPECT_GE(time_manager.soft_limit(), 1);
+    EXPECT_LE(time_manager.soft_limit(), time_manager.hard_limit());
+    EXPECT_LE(time_manager.hard_limit(),
+              std::max<int64_t>(1, time_left - TimeManager::move_overhead));
+  }
+}
+
+TEST(TimeManager, StableBestMoveStopsEarly) {
+  TimeManager time_manager(clock_time(60000, 0), Color::white);
+  for (int i = 0; i < 6; ++i) {
+    time_manager.on_iteration(e2e4, 20);
+  }
+  EXPECT_LT(time_manager.adjusted_soft_limit(), time_manager.soft_limit());
+  // A new best move takes more time.
+  time_manager.on_iteration(d2d4, 20);
+  EXPECT_GT(time_manager.adjusted_soft_limit(), time_manager.soft_limit());
+}
+
+TEST(TimeManager, ScoreDropExtends) {
+  TimeManager time_manager(clock_time(60000, 0), Color::white);
+  time_manager.on_iteration(e2e4, 50);
+  time_manager.on_iteration(e2e4, 50);
+  time_manager.on_iteration(e2e4, 50);
+  const int64_t stable = time_manager.adjusted_soft_limit();
+  time_manager.on_iteration(e2e4, -150);
+  EXPECT_GT(time_manager.adjusted_soft_limit(), stable);
+  EXPECT_LE(time_manager.adjusted_soft_limit(), time_manager.hard_limit());
+}
+
+TEST(TimeManager, NoLimitsWhilePondering) {
+  TimeControl time_control = {};
+  time_control.move_time_ = TimeManager::move_overhead + 1;
+  TimeManager time_manager(time_control, Color::white, true);
+  while (time_manager.elapsed() < 100) {
+  }
+  EXPECT_FALSE(time_manager.should_stop_iterating());
+  EXPECT_FALSE(time_manager.is_hard_limit_reached());
+  // The clock starts over at the ponderhit.
+  time_manager.ponderhit();
+  EXPECT_LT(time_manager.elapsed(), 100);
+  while (time_manager.elapsed() < 2) {
+  }
+  EXPECT_TRUE(time_manager.should_stop_iterating());
+  EXPECT_TRUE(time_manager.is_hard_limit_reached());
+}
@@ -0,0 +1,156 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+
+namespace {
+// How long the flushing thread sleeps between drains. A buffer of the
+// default size holds far more events than a search records in this time.
+constexpr auto flush_interval = std::chrono::milliseconds(20);
+
+// Returns `ns` as microseconds, the unit of the trace format.
+std::string ns_to_us(uint64_t ns) {
+  return absl::StrCat(ns / 1000, ".", absl::Dec(ns % 1000, absl::kZeroPad3));
+}
+}  // namespace.
+
+TraceBuffer::TraceBuffer(std::string thread_name, size_t capacity,
+                         std::chrono::steady_clock::time_point start)
+    : thread_name_(std::move(thread_name)),
+      mask_(capacity - 1),
+      events_(new TraceEvent[capacity]),
+      start_(start),
+      head_(0),
+      tail_(0),
+      num_dropped_(0) {}
+
+void TraceBuffer::record(const char* name, uint64_t start_ns,
+                         const char* arg_name, int64_t arg) {
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) > mask_) {
+    num_dropped_.store(num_dropped_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+    return;
+  }
+  events_[head & mask_] = {name, arg_name, arg, start_ns, now_ns() - start_ns};
+  // Publishes the event to `drain`.
+  head_.store(head + 1, std::memory_order_release);
+}
+
+void TraceBuffer::drain(std::vector<TraceEvent>* events) {
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  for (; tail < head; ++tail) {
+    events->push_back(events_[tail & mask_]);
+  }
+  // Hands the slots back to `record`.
+  tail_.store(tail, std::memory_order_release);
+}
+
+Tracer::Tracer(const std::string& path, size_t buffer_events)
+    : start_(std::chrono::steady_clock::now()),
+      file_(path, std::ios::trunc),
+      buffer_events_(std::max<size_t>(buffer_events, 1)),
+      num_named_(0),
+      num_events_(0),
+      closing_(false) {
+  if (!file_) {
+    return;
+  }
+  file_ << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":"
+           "{\"name\":\"pawn_grabber\"}}";
+  flusher_ = std::thread(&Tracer::run_flusher, this);
+}
+
+Tracer::~Tracer() { close(); }
+
+TraceBuffer* Tracer::new_buffer(const std::string& thread_name) {
+  if (!is_open()) {
+    return nullptr;
+  }
+  size_t capacity = 1;
+  while (capacity < buffer_events_) {
+    capacity *= 2;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffers_.emplace_back(new TraceBuffer(thread_name, capacity, start_));
+  return buffers_.back().get();
+}
+
+bool Tracer::close() {
+  if (!is_open()) {
+    return static_cast<bool>(file_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+  }
+  close_requested_.notify_all();
+  flusher_.join();
+  file_ << "\n]}\n";
+  file_.close();
+  return static_cast<bool>(file_);
+}
+
+uint64_t Tracer::num_events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_events_;
+}
+
+uint64_t Tracer::num_dropped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t res = 0;
+  for (const std::unique_ptr<TraceBuffer>& buffer : buffers_) {
+    res += buffer->num_dropped_.load(std::memory_order_relaxed);
+  }
+  return res;
+}
+
+void Tracer::run_flusher() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    close_requested_.wait_for(lock, flush_interval,
+                              [this] { return closing_; });
+    flush();
+    if (closing_) {
+      return;
+    }
+  }
+}
+
+void Tracer::flush() {
+  // The thread ids are the buffers' indices.
+  for (; num_named_ < buffers_.size(); ++num_named_) {
+    file_ << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+          << num_named_ << ",\"args\":{\"name\":\""
+          << buffers_[num_named_]->thread_name_ << "\"}}";
+  }
+  std::vector<TraceEvent> events;
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    events.clear();
+    buffers_[i]->drain(&events);
+    for (const TraceEvent& event : events) {
+      file_ << ",\n{\"name\":\"" << event.name_
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << i
+            << ",\"ts\":" << ns_to_us(event.start_ns_)
+            << ",\"dur\":" << ns_to_us(event.duration_ns_);
+      if (event.arg_name_) {
+        file_ << ",\"args\":{\"" << event.arg_name_ << "\":" << event.arg_
+              << "}";
+      }
+      file_ << "}";
+    }
+    num_events_ += events.size();
+  }
+  file_.flush();
+}
@@ -0,0 +1,155 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Traces of what the engine spends its time on, for the Chrome trace viewer
+// or Perfetto (the JSON trace event format). Every thread that records gets a
+// TraceBuffer of its own, a ring that only it writes and that a thread of the
+// Tracer drains into the file every few milliseconds, so that recording an
+// event is a few stores and never waits for a lock or for the file. A full
+// buffer drops its events and counts them.
+//
+// Events are spans with a name and at most one number, both of which must be
+// string literals, since the strings are only written out later:
+//
+//   { TraceSpan span(buffer, "iteration", "depth", depth); ... }
+//
+// A span with a null buffer records nothing, so code that may trace takes a
+// buffer that is null when it doesn't.
+
+struct TraceEvent {
+  const char* name_;
+  // Null without an argument.
+  const char* arg_name_;
+  int64_t arg_;
+  // Nanoseconds since the tracer was made.
+  uint64_t start_ns_;
+  uint64_t duration_ns_;
+};
+
+class TraceBuffer {
+ public:
+  TraceBuffer(const TraceBuffer&) = delete;
+  TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+  // Nanoseconds since the tracer was made.
+  uint64_t now_ns() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count());
+  }
+  // Records the span from `start_ns` to now. Only ever called by one thread
+  // at a time.
+  void record(const char* name, uint64_t start_ns, const char* arg_name,
+              int64_t arg);
+
+ private:
+  friend class Tracer;
+
+  // `capacity` must be a power of two.
+  TraceBuffer(std::string thread_name, size_t capacity,
+              std::chrono::steady_clock::time_point start);
+  // Appends the events recorded since the last call to `*events`. Only ever
+  // called by the flushing thread.
+  void drain(std::vector<TraceEvent>* events);
+
+  const std::string thread_name_;
+  const size_t mask_;
+  const std::unique_ptr<TraceEvent[]> events_;
+  const std::chrono::steady_clock::time_point start_;
+  // The events recorded and drained so far. Each is written by one thread
+  // only, so they sit on cache lines of their own.
+  alignas(64) std::atomic<uint64_t> head_;
+  alignas(64) std::atomic<uint64_t> tail_;
+  std::atomic<uint64_t> num_dropped_;
+};
+
+// Writes a trace file. The events of a buffer come out in the order they
+// ended, and those of different buffers interleave, which the viewers sort.
+class Tracer {
+ public:
+  static constexpr size_t default_buffer_events = size_t{1} << 14;
+
+  // Starts a trace in `path`. Nothing is traced if it can't be written, see
+  // `is_open`. `buffer_events` is rounded up to a power of two.
+  explicit Tracer(const std::string& path,
+                  size_t buffer_events = default_buffer_events);
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+  // Closes the trace.
+  ~Tracer();
+
+  bool is_open() const { return flusher_.joinable(); }
+  // Returns a new buffer for one thread, shown as `thread_name`, which the
+  // tracer owns. Returns null if the trace isn't open.
+  TraceBuffer* new_buffer(const std::string& thread_name);
+  // Writes the events left in the buffers and ends the file, after which
+  // nothing more is written. Returns false if any write failed. The buffers
+  // must no longer be recorded to.
+  bool close();
+  // The events written so far, and those that found their buffer full.
+  uint64_t num_events() const;
+  uint64_t num_dropped() const;
+
+ private:
+  void run_flusher();
+  // Drains every buffer into the file, with `mutex_` held.
+  void flush();
+
+  const std::chrono::steady_clock::time_point start_;
+  std::ofstream file_;
+  const size_t buffer_events_;
+  // Guards everything below it.
+  mutable std::mutex mutex_;
+  std::condition_variable close_requested_;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+  // The buffers whose thread names are in the file.
+  size_t num_named_;
+  uint64_t num_events_;
+  bool closing_;
+  // Left unstarted if the file couldn't be opened.
+  std::thread flusher_;
+};
+
+// Records the span of its own lifetime into `buffer`, if it isn't null.
+class TraceSpan {
+ public:
+  TraceSpan(TraceBuffer* buffer, const char* name,
+            const char* arg_name = nullptr, int64_t arg = 0)
+      : buffer_(buffer),
+        name_(name),
+        arg_name_(arg_name),
+        arg_(arg),
+        start_ns_(buffer ? buffer->now_ns() : 0) {}
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+  ~TraceSpan() {
+    if (buffer_) {
+      buffer_->record(name_, start_ns_, arg_name_, arg_);
+    }
+  }
+
+  // Replaces the argument, for results only known at the end of the span.
+  void set_arg(int64_t arg) { arg_ = arg; }
+
+ private:
+  TraceBuffer* const buffer_;
+  const char* const name_;
+  const char* const arg_name_;
+  int64_t arg_;
+  const uint64_t start_ns_;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "trace.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+std::string read_file(const std::string& path) {
+  std::ifstream file(path);
+  std::stringstream res;
+  res << file.rdbuf();
+  return res.str();
+}
+
+size_t count_of(const std::string& text, const std::string& part) {
+  size_t res = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos;
+       pos = text.find(part, pos + 1)) {
+    ++res;
+  }
+  return res;
+}
+}  // namespace.
+
+TEST(Tracer, WritesTheSpansOfEveryThread) {
+  const std::string path = testing::TempDir() + "trace_test.json";
+  Tracer tracer(path);
+  ASSERT_TRUE(tracer.is_open());
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; ++i) {
+    TraceBuffer* buffer = tracer.new_buffer("worker");
+    threads.emplace_back([buffer] {
+      for (int depth = 1; depth <= 100; ++depth) {
+        const TraceSpan span(buffer, "iteration", "depth", depth);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  {
+    // A null buffer records nothing.
+    const TraceSpan span(nullptr, "ignored");
+  }
+  EXPECT_TRUE(tracer.close());
+  EXPECT_EQ(tracer.num_events(), 300);
+  EXPECT_EQ(tracer.num_dropped(), 0);
+  const std::string trace = read_file(path);
+  EXPECT_EQ(trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+  EXPECT_EQ(count_of(trace, "\"name\":\"iteration\",\"ph\":\"X\""), 300);
+  EXPECT_EQ(count_of(trace, "\"args\":{\"depth\":100}"), 3);
+  EXPECT_EQ(count_of(trace, "\"tid\":2,\"args\":{\"name\":\"worker\"}"), 1);
+  EXPECT_EQ(count_of(trace, "ignored"), 0);
+  std::remove(path.c_str());
+}
+
+TEST(Tracer, DropsEventsThatDontFit) {
+  const std::string path = testing::TempDir() + "trace_test_full.json";
+  Tracer tracer(path, 5);
+  TraceBuffer* buffer = tracer.new_buffer("main");
+  // The buffer holds 8 events, far fewer than are recorded before the
+  // flushing thread first wakes up.
+  for (int i = 0; i < 1000; ++i) {
+    const TraceSpan span(buffer, "span");
+  }
+  EXPECT_TRUE(tracer.close());
+  EXPECT_GT(tracer.num_dropped(), 0);
+  EXPECT_EQ(tracer.num_events() + tracer.num_dropped(), 1000);
+  std::remove(path.c_str());
+}
+
+TEST(Tracer, IsClosedWithoutAFile) {
+  Tracer tracer("/no/such/dir/trace.json");
+  EXPECT_FALSE(tracer.is_open());
+  EXPECT_EQ(tracer.new_buffer("main"), nullptr);
+  EXPECT_FALSE(tracer.close());
+}
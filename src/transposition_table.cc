@@ -0,0 +1,497 @@
+#include "transposition_table.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/internal/raw_logging.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "debug_check.h"
+#include "memory_accounting.h"
+#include "numa.h"
+
+namespace {
+constexpr int key_shift = 0;
+constexpr int score_shift = 16;
+constexpr int depth_shift = 32;
+constexpr int bound_shift = 38;
+constexpr int generation_shift = 40;
+constexpr int move_shift = 45;
+
+constexpr uint64_t key_mask = 0xFFFF;
+constexpr uint64_t depth_mask = 0x3F;
+constexpr uint64_t bound_mask = 0x3;
+constexpr uint64_t generation_mask = 0x1F;
+
+// The generation wraps around after this many searches.
+constexpr int num_generations = 32;
+
+// Moves pack into 19 bits: 6 for each square index, 3 for the piece and 4 for
+// the move type. No move has the same source and destination, so 0 is free to
+// mean no move.
+uint64_t pack_move(absl::optional<Move> move) {
+  if (!move) {
+    return 0;
+  }
+  return uint64_t{move->src_idx_} | (uint64_t{move->dst_idx_} << 6) |
+         (static_cast<uint64_t>(move->piece_moving_) << 12) |
+         (static_cast<uint64_t>(move->move_type_) << 15);
+}
+
+absl::optional<Move> unpack_move(uint64_t bits) {
+  if (bits == 0) {
+    return absl::nullopt;
+  }
+  Move move;
+  move.src_idx_ = static_cast<uint8_t>(bits & 0x3F);
+  move.dst_idx_ = static_cast<uint8_t>((bits >> 6) & 0x3F);
+  move.piece_moving_ = static_cast<Piece>((bits >> 12) & 0x7);
+  move.move_type_ = static_cast<MoveType>((bits >> 15) & 0xF);
+  return move;
+}
+
+uint64_t key_bits(uint64_t key) { return key & key_mask; }
+
+// The evaluation word: the evaluation in the low half, with no_eval for none,
+// and the second 16 bits of the key in the high half.
+constexpr int eval_key_shift = 16;
+constexpr uint32_t eval_mask = 0xFFFF;
+constexpr int16_t no_eval = std::numeric_limits<int16_t>::min();
+
+uint32_t eval_key_bits(uint64_t key) {
+  return static_cast<uint32_t>(key >> 16) & eval_mask;
+}
+
+constexpr size_t huge_page_size = size_t{2} << 20;
+constexpr size_t gigantic_page_size = size_t{1} << 30;
+
+// Each thread clearing the table clears at least this many bytes, since
+// starting a thread costs about as much as clearing a few megabytes.
+constexpr size_t min_bytes_per_clearing_thread = size_t{16} << 20;
+
+size_t round_up(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+void* map_anonymous(size_t size, int flags) {
+  void* const res = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return res == MAP_FAILED ? nullptr : res;
+}
+
+// Maps at least `*size` bytes of zeroes and sets `*size` to what was mapped
+// and `*page_size` to the size of its pages.
+void* map_table(size_t* size, size_t* page_size) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+  // Reserved huge pages need vm.nr_hugepages or its like, which few systems
+  // set, so mapping them fails more often than not. 1 GB pages are only used
+  // for whole gigabytes, to waste at most part of one 2 MB page.
+  for (size_t pages : {gigantic_page_size, huge_page_size}) {
+    if (*size < pages || (pages == gigantic_page_size && *size % pages != 0)) {
+      continue;
+    }
+    const size_t rounded = round_up(*size, pages);
+    void* const res = map_anonymous(
+        rounded, MAP_HUGETLB | (__builtin_ctzll(pages) << MAP_HUGE_SHIFT));
+    if (res) {
+      *size = rounded;
+      *page_size = pages;
+      return res;
+    }
+  }
+#endif
+  *size = round_up(*size, huge_page_size);
+  *page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  void* const res = map_anonymous(*size, 0);
+#ifdef MADV_HUGEPAGE
+  if (res) {
+    // Only a hint, which systems with transparent huge pages disabled ignore.
+    madvise(res, *size, MADV_HUGEPAGE);
+  }
+#endif
+  return res;
+}
+
+// The buckets of a table file start after a page of header, so that they
+// stay aligned to cache lines and pages.
+constexpr size_t file_header_size = 4096;
+constexpr char file_magic[8] = {'P', 'G', 'T', 'T', 'A', 'B', 'L', 'E'};
+// Changes with the layout of an entry.
+constexpr uint32_t file_version = 1;
+
+Bound entry_bound(uint64_t data) {
+  return static_cast<Bound>((data >> bound_shift) & bound_mask);
+}
+
+int entry_depth(uint64_t data) {
+  return static_cast<int>((data >> depth_shift) & depth_mask);
+}
+
+int entry_generation(uint64_t data) {
+  return static_cast<int>((data >> generation_shift) & generation_mask);
+}
+
+// An entry is worth its depth, less 8 plies for every search since it was
+// stored.
+int entry_worth(uint64_t data, int generation) {
+  const int age =
+      (generation - entry_generation(data) + num_generations) %
+      num_generations;
+  return entry_depth(data) - 8 * age;
+}
+}  // namespace.
+
+struct TranspositionTable::FileHeader {
+  char magic_[8];
+  uint32_t version_;
+  uint32_t bucket_size_;
+  uint32_t entries_per_bucket_;
+  uint32_t generation_;
+  uint64_t num_buckets_;
+};
+
+void TranspositionTable::Unmapper::operator()(Bucket* buckets) const {
+  munmap(reinterpret_cast<char*>(buckets) - offset_, size_);
+  add_memory(MemoryTag::transposition_table, -static_cast<int64_t>(size_));
+}
+
+TranspositionTable::TranspositionTable(size_t size_in_mb)
+    : buckets_(nullptr, Unmapper{0, 0}),
+      file_header_(nullptr),
+      shared_(false),
+      num_buckets_(0),
+      page_size_(0),
+      generation_(0) {
+  resize(size_in_mb);
+}
+
+TranspositionTable::~TranspositionTable() { flush(); }
+
+void TranspositionTable::resize(size_t size_in_mb) {
+  // Unmaps the old table first, so that both never take memory at once.
+  flush();
+  buckets_.reset();
+  file_header_ = nullptr;
+  shared_ = false;
+  num_buckets_ = std::max<size_t>(1, (size_in_mb << 20) / sizeof(Bucket));
+  size_t size = num_buckets_ * sizeof(Bucket);
+  Bucket* const buckets = static_cast<Bucket*>(map_table(&size, &page_size_));
+  ABSL_RAW_CHECK(buckets != nullptr, "Can't map the transposition table.");
+  add_memory(MemoryTag::transposition_table, static_cast<int64_t>(size));
+  buckets_ =
+      std::unique_ptr<Bucket[], Unmapper>(buckets, Unmapper{size, 0});
+  // The mapping is zeroes already, but clearing it is what touches its pages
+  // first and so places them.
+  clear();
+}
+
+TranspositionTable::FileStatus TranspositionTable::open_file(
+    const std::string& path, size_t size_in_mb) {
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return FileStatus::failed;
+  }
+  return map_file(fd, size_in_mb, false);
+}
+
+TranspositionTable::FileStatus TranspositionTable::attach_shared(
+    const std::string& name, size_t size_in_mb) {
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return FileStatus::failed;
+  }
+  return map_file(fd, size_in_mb, true);
+}
+
+TranspositionTable::FileStatus TranspositionTable::map_file(
+    int fd, size_t size_in_mb, bool shared) {
+  static_assert(sizeof(FileHeader) <= file_header_size,
+                "The header should fit before the buckets.");
+  const size_t num_buckets =
+      std::max<size_t>(1, (size_in_mb << 20) / sizeof(Bucket));
+  const size_t size = file_header_size + num_buckets * sizeof(Bucket);
+  // A file of another size can't hold this table, so it is emptied, which
+  // leaves it all zeroes, the same as a cleared table with no header. A
+  // shared object of another size is in use by other processes, which
+  // would fault on pages cut off under them, so it is left alone.
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return FileStatus::failed;
+  }
+  const size_t old_size = static_cast<size_t>(st.st_size);
+  const bool same_size = old_size == size;
+  if (!same_size &&
+      ((shared && old_size != 0) || (!shared && ftruncate(fd, 0) != 0) ||
+       ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+    close(fd);
+    return FileStatus::failed;
+  }
+  void* const base =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return FileStatus::failed;
+  }
+  flush();
+  add_memory(MemoryTag::transposition_table, static_cast<int64_t>(size));
+  buckets_ = std::unique_ptr<Bucket[], Unmapper>(
+      reinterpret_cast<Bucket*>(static_cast<char*>(base) + file_header_size),
+      Unmapper{size, file_header_size});
+  file_header_ = static_cast<FileHeader*>(base);
+  shared_ = shared;
+  num_buckets_ = num_buckets;
+  page_size_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  FileHeader* const header = file_header_;
+  if (same_size &&
+      std::memcmp(header->magic_, file_magic, sizeof(file_magic)) == 0 &&
+      header->version_ == file_version &&
+      header->bucket_size_ == sizeof(Bucket) &&
+      header->entries_per_bucket_ == entries_per_bucket &&
+      header->num_buckets_ == num_buckets &&
+      header->generation_ < num_generations) {
+    generation_ = static_cast<uint8_t>(header->generation_);
+    return FileStatus::resumed;
+  }
+  // The header goes in last, so that a table cut short by a crash doesn't
+  // pass for a valid one.
+  std::memset(header, 0, sizeof(FileHeader));
+  if (same_size) {
+    clear();
+  } else {
+    generation_ = 0;
+  }
+  std::memcpy(header->magic_, file_magic, sizeof(file_magic));
+  header->version_ = file_version;
+  header->bucket_size_ = sizeof(Bucket);
+  header->entries_per_bucket_ = entries_per_bucket;
+  header->num_buckets_ = num_buckets;
+  flush();
+  return FileStatus::created;
+}
+
+void TranspositionTable::flush(bool wait) {
+  if (!file_header_) {
+    return;
+  }
+  file_header_->generation_ = generation_;
+  msync(file_header_, buckets_.get_deleter().size_,
+        wait ? MS_SYNC : MS_ASYNC);
+}
+
+void TranspositionTable::clear() {
+  const auto clear_range = [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      for (std::atomic<uint64_t>& entry : buckets_[i].entries_) {
+        entry.store(0, std::memory_order_relaxed);
+      }
+      for (std::atomic<uint32_t>& eval : buckets_[i].evals_) {
+        eval.store(0, std::memory_order_relaxed);
+      }
+    }
+  };
+  const size_t num_threads = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()),
+      num_buckets_ * sizeof(Bucket) / min_bytes_per_clearing_thread);
+  if (num_threads <= 1) {
+    clear_range(0, num_buckets_);
+  } else {
+    // Thread `i` clears the `i`th slice, on NUMA node `i` modulo the number
+    // of nodes, which interleaves the slices over the nodes. Pages the
+    // threads touch first, after a resize, are allocated where they run.
+    const bool bind = numa_nodes().size() > 1;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&clear_range, this, i, num_threads, bind] {
+        if (bind) {
+          bind_to_numa_node(i);
+        }
+        clear_range(num_buckets_ * i / num_threads,
+                    num_buckets_ * (i + 1) / num_threads);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+  generation_ = 0;
+}
+
+void TranspositionTable::new_search() {
+  if (shared_) {
+    return;
+  }
+  generation_ = static_cast<uint8_t>((generation_ + 1) % num_generations);
+}
+
+TranspositionTable::Bucket& TranspositionTable::bucket(uint64_t key) const {
+  // Maps the key onto [0, num_buckets_) by the high half of the 128-bit
+  // product, which doesn't need a power of two and leaves the low bits of the
+  // key for verification.
+  const unsigned __int128 product =
+      static_cast<unsigned __int128>(key) * num_buckets_;
+  return buckets_[static_cast<size_t>(product >> 64)];
+}
+
+bool TranspositionTable::probe(uint64_t key, TtEntry* entry) const {
+  const Bucket& b = bucket(key);
+  for (size_t i = 0; i < entries_per_bucket; ++i) {
+    const uint64_t data = b.entries_[i].load(std::memory_order_relaxed);
+    if (((data >> key_shift) & key_mask) != key_bits(key) ||
+        entry_bound(data) == Bound::none) {
+      continue;
+    }
+    entry->move_ = unpack_move(data >> move_shift);
+    entry->score_ = static_cast<int16_t>((data >> score_shift) & 0xFFFF);
+    entry->depth_ = entry_depth(data);
+    entry->bound_ = entry_bound(data);
+    const uint32_t eval = b.evals_[i].load(std::memory_order_relaxed);
+    const int16_t eval_score = static_cast<int16_t>(eval & eval_mask);
+    entry->eval_ = eval >> eval_key_shift == eval_key_bits(key) &&
+                           eval_score != no_eval
+                       ? absl::optional<int>(eval_score)
+                       : absl::nullopt;
+    return true;
+  }
+  return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, Bound bound, int score,
+                               absl::optional<Move> move,
+                               absl::optional<int> eval) {
+  DEBUG_CHECK(depth >= 0 && bound != Bound::none &&
+                  score >= std::numeric_limits<int16_t>::min() &&
+                  score <= std::numeric_limits<int16_t>::max() &&
+                  (!eval || (*eval > no_eval &&
+                             *eval <= std::numeric_limits<int16_t>::max())),
+              "Search result doesn't fit in a table entry.");
+  Bucket& b = bucket(key);
+  size_t victim = 0;
+  uint64_t victim_data = 0;
+  int victim_worth = std::numeric_limits<int>::max();
+  for (size_t i = 0; i < entries_per_bucket; ++i) {
+    const uint64_t data = b.entries_[i].load(std::memory_order_relaxed);
+    if (entry_bound(data) == Bound::none ||
+        ((data >> key_shift) & key_mask) == key_bits(key)) {
+      victim = i;
+      victim_data = data;
+      break;
+    }
+    const int worth = entry_worth(data, generation_);
+    if (worth < victim_worth) {
+      victim = i;
+      victim_data = data;
+      victim_worth = worth;
+    }
+  }
+  const bool same_position =
+      entry_bound(victim_data) != Bound::none &&
+      ((victim_data >> key_shift) & key_mask) == key_bits(key);
+  uint64_t move_bits = pack_move(move);
+  if (!move_bits && same_position) {
+    move_bits = victim_data >> move_shift;
+  }
+  const uint64_t data =
+      (key_bits(key) << key_shift) |
+      (static_cast<uint64_t>(static_cast<uint16_t>(score)) << score_shift) |
+      (static_cast<uint64_t>(std::min(depth, max_depth)) << depth_shift) |
+      (static_cast<uint64_t>(bound) << bound_shift) |
+      (uint64_t{generation_} << generation_shift) | (move_bits << move_shift);
+  b.entries_[victim].store(data, std::memory_order_relaxed);
+  if (eval) {
+    b.evals_[victim].store(
+        (eval_key_bits(key) << eval_key_shift) |
+            static_cast<uint16_t>(*eval),
+        std::memory_order_relaxed);
+  } else if (!same_position) {
+    b.evals_[victim].store(static_cast<uint16_t>(no_eval),
+                           std::memory_order_relaxed);
+  }
+}
+
+void TranspositionTable::collect_entries(
+    size_t first_bucket, size_t num_buckets, int min_depth,
+    std::vector<TtRawEntry>* entries) const {
+  const size_t end = std::min(num_buckets_, first_bucket + num_buckets);
+  for (size_t i = first_bucket; i < end; ++i) {
+    for (size_t j = 0; j < entries_per_bucket; ++j) {
+      const uint64_t data =
+          buckets_[i].entries_[j].load(std::memory_order_relaxed);
+      if (entry_bound(data) != Bound::none &&
+          entry_generation(data) == generation_ &&
+          entry_depth(data) >= min_depth) {
+        entries->push_back(
+            {i, data, buckets_[i].evals_[j].load(std::memory_order_relaxed)});
+      }
+    }
+  }
+}
+
+void TranspositionTable::merge_entry(const TtRawEntry& entry) {
+  if (entry.bucket_ >= num_buckets_ ||
+      entry_bound(entry.data_) == Bound::none) {
+    return;
+  }
+  Bucket& b = buckets_[entry.bucket_];
+  const int depth = entry_depth(entry.data_);
+  size_t victim = entries_per_bucket;
+  int victim_worth = depth;
+  for (size_t i = 0; i < entries_per_bucket; ++i) {
+    const uint64_t data = b.entries_[i].load(std::memory_order_relaxed);
+    if (entry_bound(data) == Bound::none) {
+      victim = i;
+      break;
+    }
+    if (((data >> key_shift) & key_mask) ==
+        ((entry.data_ >> key_shift) & key_mask)) {
+      victim = entry_depth(data) < depth ? i : entries_per_bucket;
+      break;
+    }
+    const int worth = entry_worth(data, generation_);
+    if (worth < victim_worth) {
+      victim = i;
+      victim_worth = worth;
+    }
+  }
+  if (victim == entries_per_bucket) {
+    return;
+  }
+  const uint64_t data =
+      (entry.data_ & ~(generation_mask << generation_shift)) |
+      (uint64_t{generation_} << generation_shift);
+  b.entries_[victim].store(data, std::memory_order_relaxed);
+  b.evals_[victim].store(entry.eval_, std::memory_order_relaxed);
+}
+
+void TranspositionTable::prefetch(uint64_t key) const {
+  __builtin_prefetch(&bucket(key));
+}
+
+int TranspositionTable::hashfull() const {
+  const size_t num_sampled =
+      std::min<size_t>(num_buckets_, 1000 / entries_per_bucket);
+  int num_used = 0;
+  for (size_t i = 0; i < num_sampled; ++i) {
+    for (const std::atomic<uint64_t>& e : buckets_[i].entries_) {
+      const uint64_t data = e.load(std::memory_order_relaxed);
+      if (entry_bound(data) != Bound::none &&
+          entry_generation(data) == generation_) {
+        ++num_used;
+      }
+    }
+  }
+  return static_cast<int>(1000 * static_cast<size_t>(num_used) /
+                          (num_sampled * entries_per_bucket));
+}
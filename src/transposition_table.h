@@ -0,0 +1,206 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+
+// What a stored score says about the true score of its position.
+enum class Bound : uint8_t {
+  // Only used for empty entries.
+  none,
+  // The search failed low: the true score is at most the stored one.
+  upper,
+  // The search failed high: the true score is at least the stored one.
+  lower,
+  exact
+};
+
+// A search result as read back from the table.
+struct TtEntry {
+  absl::optional<Move> move_;
+  int score_;
+  int depth_;
+  Bound bound_;
+  // The static evaluation of the position, if it was stored.
+  absl::optional<int> eval_;
+};
+
+// An entry as the table holds it, with the index of its bucket, for copying
+// entries between tables of the same number of buckets, such as those of the
+// nodes of a cluster (see cluster.h).
+struct TtRawEntry {
+  uint64_t bucket_;
+  uint64_t data_;
+  uint32_t eval_;
+};
+
+// The search's table of earlier results, keyed by Zobrist key, which one or
+// more searches can share without locks.
+//
+// The search result of an entry packs into a single 64-bit word, which is read
+// and written atomically, so a probe never sees half of one store and half of
+// another:
+//
+//   bits  0-15  the low 16 bits of the key, to verify a hit
+//   bits 16-31  the score
+//   bits 32-37  the depth, 0 to 63
+//   bits 38-39  the bound
+//   bits 40-44  the generation of the search that stored it
+//   bits 45-63  the best move, or 0 for none
+//
+// Next to it, a 32-bit word holds the static evaluation in its low 16 bits and
+// bits 16-31 of the key in its high 16 bits. A node that can't use the stored
+// bound still gets its evaluation from the table this way, which cut nodes,
+// the most common kind, mostly need. The two words are stored separately, so
+// the evaluation is only taken when the key bits of both match: an evaluation
+// of another position, from a store that raced with the probe, reads as none.
+//
+// Five entries make a bucket, which is aligned to a 64 byte cache line, and a
+// key's bucket is picked by the high bits of the key, so that any number of
+// buckets can be used and the verification bits are independent of the index.
+//
+// The buckets are mapped straight from the system, on the largest pages it
+// has reserved (1 GB, then 2 MB) and otherwise on pages it is asked to back
+// with transparent huge pages, so that probes all over gigabytes of table miss
+// the TLB far less often than on 4 KB pages. Large tables are cleared by many
+// threads, spread over the NUMA nodes, so that the pages, which land on the
+// node of the thread that touches them first, spread over the nodes too.
+//
+// A table can also be kept in a file, mapped shared, so that a long analysis
+// survives the engine stopping: the file starts with a header, which records
+// the layout of the buckets and the generation, and reopening a file of the
+// same size and layout takes up its entries where they were left. The entries
+// need no more care than the race of two stores does, since every probe
+// verifies its key bits, so the file stays usable after a crash too.
+//
+// The same goes for a POSIX shared memory object, which the engine processes
+// of one host can all attach to, so that processes analysing related
+// positions, such as the moves of one game, use each other's entries. Their
+// stores race no worse than those of threads. The processes can't agree on
+// when a search starts, so a shared table has no generations, and entries
+// are replaced by depth alone.
+//
+// A store replaces the entry of the same position if the bucket has one, an
+// empty entry otherwise, and otherwise the entry that is worth the least,
+// where deeper entries are worth more and entries lose worth with every search
+// since they were stored.
+class TranspositionTable {
+ public:
+  // The deepest depth an entry can record; deeper stores are clamped.
+  static constexpr int max_depth = 63;
+
+  // Uses as many buckets as fit in `size_in_mb` megabytes, and at least one.
+  explicit TranspositionTable(size_t size_in_mb);
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
+  // Records the generation in the file, if any.
+  ~TranspositionTable();
+
+  // Reallocates the table with the new size, in memory, which clears it.
+  void resize(size_t size_in_mb);
+
+  enum class FileStatus {
+    // The file couldn't be opened or mapped, and the table is unchanged.
+    failed,
+    // The file had no table of this size and layout, and now has an empty
+    // one.
+    created,
+    // The table is the one left in the file.
+    resumed
+  };
+  // Replaces the table with one of `size_in_mb` megabytes in the file at
+  // `path`, which is created or resized as needed.
+  FileStatus open_file(const std::string& path, size_t size_in_mb);
+  // Replaces the table with the one in the POSIX shared memory object
+  // `name`, such as "/pawn_grabber", attaching to it as it is if another
+  // process made it with `size_in_mb` and making it otherwise. Fails if it
+  // has another size, which would pull the memory from under the processes
+  // using it. The object outlives the processes, until it is unlinked.
+  FileStatus attach_shared(const std::string& name, size_t size_in_mb);
+  // Writes the generation to the header and has the system write the table
+  // back to the file, waiting until it has if `wait`. The system writes it
+  // back on its own too, so this only bounds what a crash loses.
+  void flush(bool wait = false);
+  // In a file or a shared memory object.
+  bool is_file_backed() const { return file_header_ != nullptr; }
+  bool is_shared() const { return shared_; }
+
+  // Empties every entry.
+  void clear();
+  // Starts a new generation, except in a shared table. Called once per
+  // search, so that entries left from earlier searches are the first to be
+  // replaced.
+  void new_search();
+
+  // Sets `*entry` and returns true if the position with `key` is in the table.
+  bool probe(uint64_t key, TtEntry* entry) const;
+  // Stores a search result. `depth` must not be negative, and `score` and
+  // `eval` must fit in 16 bits. With no `move` or `eval` the one stored
+  // earlier for the same position, if any, is kept.
+  void store(uint64_t key, int depth, Bound bound, int score,
+             absl::optional<Move> move,
+             absl::optional<int> eval = absl::nullopt);
+  // Appends the entries of the buckets [first_bucket, first_bucket +
+  // num_buckets) that the current search stored at `min_depth` or deeper to
+  // `entries`.
+  void collect_entries(size_t first_bucket, size_t num_buckets, int min_depth,
+                       std::vector<TtRawEntry>* entries) const;
+  // Stores `entry`, from a table with as many buckets, as a store of the
+  // current search, unless its bucket has the same position at least as
+  // deep or nothing that is worth less. Ignores entries that aren't valid
+  // for this table.
+  void merge_entry(const TtRawEntry& entry);
+  // Starts loading the bucket of `key` into the cache, so that a probe soon
+  // after doesn't wait on memory.
+  void prefetch(uint64_t key) const;
+
+  // Returns how full the table is in permille, counting the entries of the
+  // current search among the first thousand.
+  int hashfull() const;
+  size_t num_buckets() const { return num_buckets_; }
+  // The size of the reserved huge pages the table is on, or of the system's
+  // base pages, which may or may not be backed by transparent huge pages.
+  size_t page_size() const { return page_size_; }
+
+  static constexpr size_t entries_per_bucket = 5;
+
+ private:
+  struct alignas(64) Bucket {
+    std::array<std::atomic<uint64_t>, entries_per_bucket> entries_;
+    std::array<std::atomic<uint32_t>, entries_per_bucket> evals_;
+  };
+  static_assert(sizeof(Bucket) == 64, "A bucket should fill a cache line.");
+
+  // Unmaps the `size_` bytes mapped from `offset_` bytes before the buckets,
+  // where the header of a file is.
+  struct Unmapper {
+    size_t size_;
+    size_t offset_;
+    void operator()(Bucket* buckets) const;
+  };
+
+  // The start of a table file, in the file's first page.
+  struct FileHeader;
+
+  // Maps a table of `size_in_mb` megabytes from `fd`, which it closes.
+  FileStatus map_file(int fd, size_t size_in_mb, bool shared);
+  Bucket& bucket(uint64_t key) const;
+
+  std::unique_ptr<Bucket[], Unmapper> buckets_;
+  // Null unless the table is in a file.
+  FileHeader* file_header_;
+  bool shared_;
+  size_t num_buckets_;
+  size_t page_size_;
+  uint8_t generation_;
+};
+
+#endif
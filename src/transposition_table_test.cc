@@ -0,0 +1,281 @@
+#include "transposition_table.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "board.h"
+#include "gtest/gtest.h"
+
+namespace {
+const Move e2e4(str_to_square("e2"), str_to_square("e4"), Piece::pawn,
+                MoveType::two_step_pawn);
+const Move promotion(str_to_square("b7"), str_to_square("a8"), Piece::pawn,
+                     MoveType::promotion_to_knight);
+
+// Returns distinct keys with distinct verification bits.
+uint64_t key_in_same_bucket(uint64_t key, int i) {
+  return key + static_cast<uint64_t>(i) * 0x10001;
+}
+}  // namespace.
+
+TEST(TranspositionTable, ProbeAndStore) {
+  TranspositionTable table(1);
+  TtEntry entry;
+  EXPECT_FALSE(table.probe(0x123456789ABCDEF0, &entry));
+  table.store(0x123456789ABCDEF0, 7, Bound::lower, -1234, e2e4);
+  ASSERT_TRUE(table.probe(0x123456789ABCDEF0, &entry));
+  EXPECT_EQ(entry.move_, e2e4);
+  EXPECT_EQ(entry.score_, -1234);
+  EXPECT_EQ(entry.depth_, 7);
+  EXPECT_EQ(entry.bound_, Bound::lower);
+  EXPECT_FALSE(table.probe(0x123456789ABCDEF1, &entry));
+
+  table.store(0xFEDCBA9876543210, 63, Bound::exact, 29999, promotion);
+  ASSERT_TRUE(table.probe(0xFEDCBA9876543210, &entry));
+  EXPECT_EQ(entry.move_, promotion);
+  EXPECT_EQ(entry.score_, 29999);
+  EXPECT_EQ(entry.depth_, 63);
+  EXPECT_EQ(entry.bound_, Bound::exact);
+}
+
+TEST(TranspositionTable, KeepsMoveWhenStoredWithout) {
+  TranspositionTable table(1);
+  table.store(42, 3, Bound::lower, 50, e2e4);
+  table.store(42, 4, Bound::upper, 10, absl::nullopt);
+  TtEntry entry;
+  ASSERT_TRUE(table.probe(42, &entry));
+  EXPECT_EQ(entry.move_, e2e4);
+  EXPECT_EQ(entry.depth_, 4);
+  EXPECT_EQ(entry.bound_, Bound::upper);
+  table.store(43, 2, Bound::exact, 0, absl::nullopt);
+  ASSERT_TRUE(table.probe(43, &entry));
+  EXPECT_EQ(entry.move_, absl::nullopt);
+}
+
+TEST(TranspositionTable, ReplacesShallowestThenOldest) {
+  // With a single bucket every key competes for the same entries.
+  TranspositionTable table(0);
+  ASSERT_EQ(table.num_buckets(), 1);
+  constexpr int n = TranspositionTable::entries_per_bucket;
+  const uint64_t key = 0x8000000000000000;
+  for (int i = 0; i < n; ++i) {
+    table.store(key_in_same_bucket(key, i), 10 + i, Bound::exact, i,
+                absl::nullopt);
+  }
+  TtEntry entry;
+  table.store(key_in_same_bucket(key, n), 20, Bound::exact, n, absl::nullopt);
+  EXPECT_FALSE(table.probe(key_in_same_bucket(key, 0), &entry));
+  for (int i = 1; i <= n; ++i) {
+    EXPECT_TRUE(table.probe(key_in_same_bucket(key, i), &entry)) << i;
+  }
+
+  // An entry from the last search is worth 8 plies less, so the depth 20 one
+  // goes before the depth 13 ones of this search, even for a depth 1 store.
+  table.new_search();
+  for (int i = n + 1; i < 2 * n; ++i) {
+    table.store(key_in_same_bucket(key, i), 13, Bound::exact, i,
+                absl::nullopt);
+  }
+  EXPECT_TRUE(table.probe(key_in_same_bucket(key, n), &entry));
+  for (int i = n + 1; i < 2 * n; ++i) {
+    EXPECT_TRUE(table.probe(key_in_same_bucket(key, i), &entry)) << i;
+  }
+  table.store(key_in_same_bucket(key, 2 * n), 1, Bound::exact, 0,
+              absl::nullopt);
+  EXPECT_FALSE(table.probe(key_in_same_bucket(key, n), &entry));
+}
+
+TEST(TranspositionTable, StoresTheEvaluation) {
+  TranspositionTable table(1);
+  TtEntry entry;
+  table.store(42, 3, Bound::lower, 50, e2e4);
+  ASSERT_TRUE(table.probe(42, &entry));
+  EXPECT_EQ(entry.eval_, absl::nullopt);
+  table.store(42, 4, Bound::upper, 10, absl::nullopt, -321);
+  ASSERT_TRUE(table.probe(42, &entry));
+  EXPECT_EQ(entry.eval_, -321);
+  // A store without one keeps it, unless the entry goes to another position.
+  table.store(42, 5, Bound::exact, 20, e2e4);
+  ASSERT_TRUE(table.probe(42, &entry));
+  EXPECT_EQ(entry.eval_, -321);
+  // Same verification bits in the search result, but a different position.
+  table.store(42 + (uint64_t{1} << 16), 5, Bound::exact, 20, e2e4);
+  ASSERT_TRUE(table.probe(42 + (uint64_t{1} << 16), &entry));
+  EXPECT_EQ(entry.eval_, absl::nullopt);
+}
+
+TEST(TranspositionTable, ClampsDepth) {
+  TranspositionTable table(1);
+  table.store(7, 100, Bound::exact, 0, absl::nullopt);
+  TtEntry entry;
+  ASSERT_TRUE(table.probe(7, &entry));
+  EXPECT_EQ(entry.depth_, TranspositionTable::max_depth);
+}
+
+TEST(TranspositionTable, Hashfull) {
+  TranspositionTable table(1);
+  EXPECT_EQ(table.hashfull(), 0);
+  for (uint64_t i = 0;
+       i < TranspositionTable::entries_per_bucket * table.num_buckets() / 2;
+       ++i) {
+    table.store(i * 0x9E3779B97F4A7C15, 1, Bound::exact, 0, absl::nullopt);
+  }
+  EXPECT_GT(table.hashfull(), 300);
+  EXPECT_LT(table.hashfull(), 700);
+  // Entries of earlier searches don't count.
+  table.new_search();
+  EXPECT_EQ(table.hashfull(), 0);
+  table.clear();
+  EXPECT_EQ(table.hashfull(), 0);
+}
+
+TEST(TranspositionTable, SizeInMegabytes) {
+  TranspositionTable table(1);
+  EXPECT_EQ(table.num_buckets(), (1 << 20) / 64);
+  table.resize(3);
+  EXPECT_EQ(table.num_buckets(), 3 * (1 << 20) / 64);
+  EXPECT_GE(table.page_size(), 4096);
+}
+
+TEST(TranspositionTable, ClearsLargeTables) {
+  // Large enough to be cleared by several threads on machines that have them.
+  TranspositionTable table(64);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    table.store(i * 0x9E3779B97F4A7C15, 1, Bound::exact, 0, e2e4);
+  }
+  TtEntry entry;
+  EXPECT_TRUE(table.probe(0x9E3779B97F4A7C15, &entry));
+  table.clear();
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(table.probe(i * 0x9E3779B97F4A7C15, &entry));
+  }
+}
+
+TEST(TranspositionTable, ResumesFromAFile) {
+  const std::string path = testing::TempDir() + "resumes_test.tt";
+  std::remove(path.c_str());
+  {
+    TranspositionTable table(1);
+    EXPECT_EQ(table.open_file(path, 2),
+              TranspositionTable::FileStatus::created);
+    EXPECT_TRUE(table.is_file_backed());
+    EXPECT_EQ(table.num_buckets(), 2 * (1 << 20) / 64);
+    table.new_search();
+    table.store(1234, 12, Bound::lower, -50, e2e4, 17);
+    table.flush(true);
+  }
+  TranspositionTable table(1);
+  EXPECT_EQ(table.open_file(path, 2),
+              TranspositionTable::FileStatus::resumed);
+  TtEntry entry;
+  ASSERT_TRUE(table.probe(1234, &entry));
+  EXPECT_EQ(entry.move_, e2e4);
+  EXPECT_EQ(entry.score_, -50);
+  EXPECT_EQ(entry.depth_, 12);
+  EXPECT_EQ(entry.bound_, Bound::lower);
+  EXPECT_EQ(entry.eval_, 17);
+  // The generation carried over, so the entry counts as this search's.
+  EXPECT_GT(table.hashfull(), 0);
+  table.resize(1);
+  EXPECT_FALSE(table.is_file_backed());
+  EXPECT_FALSE(table.probe(1234, &entry));
+  std::remove(path.c_str());
+}
+
+TEST(TranspositionTable, StartsOverOnAnotherFile) {
+  const std::string path = testing::TempDir() + "starts_over_test.tt";
+  std::remove(path.c_str());
+  {
+    TranspositionTable table(1);
+    EXPECT_EQ(table.open_file(path, 1),
+              TranspositionTable::FileStatus::created);
+    table.store(1234, 12, Bound::exact, 0, e2e4);
+  }
+  TranspositionTable table(1);
+  TtEntry entry;
+  // Another size.
+  EXPECT_EQ(table.open_file(path, 2),
+              TranspositionTable::FileStatus::created);
+  EXPECT_FALSE(table.probe(1234, &entry));
+  table.store(1234, 12, Bound::exact, 0, e2e4);
+  table.flush(true);
+  // The same size without a header.
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file << "garbage!";
+  }
+  EXPECT_EQ(table.open_file(path, 2),
+              TranspositionTable::FileStatus::created);
+  EXPECT_FALSE(table.probe(1234, &entry));
+  // Nowhere to write.
+  EXPECT_EQ(table.open_file(testing::TempDir() + "no_such_dir/test.tt", 1),
+            TranspositionTable::FileStatus::failed);
+  EXPECT_TRUE(table.is_file_backed());
+  std::remove(path.c_str());
+}
+
+TEST(TranspositionTable, SharesMemoryBetweenTables) {
+  // As two processes would.
+  const std::string name =
+      "/transposition_table_test_" + std::to_string(getpid());
+  TranspositionTable first(1);
+  EXPECT_EQ(first.attach_shared(name, 1),
+            TranspositionTable::FileStatus::created);
+  EXPECT_TRUE(first.is_shared());
+  TranspositionTable second(1);
+  EXPECT_EQ(second.attach_shared(name, 1),
+            TranspositionTable::FileStatus::resumed);
+  first.store(1234, 12, Bound::exact, 30, e2e4);
+  TtEntry entry;
+  ASSERT_TRUE(second.probe(1234, &entry));
+  EXPECT_EQ(entry.move_, e2e4);
+  EXPECT_EQ(entry.score_, 30);
+  // Entries don't age, since the tables don't search in step.
+  second.new_search();
+  EXPECT_GT(second.hashfull(), 0);
+  // Resizing would pull the memory from under the first table.
+  TranspositionTable third(1);
+  EXPECT_EQ(third.attach_shared(name, 2),
+            TranspositionTable::FileStatus::failed);
+  EXPECT_FALSE(third.is_file_backed());
+  shm_unlink(name.c_str());
+}
+
+TEST(TranspositionTable, CopiesDeepEntries) {
+  TranspositionTable from(1);
+  TranspositionTable to(1);
+  from.new_search();
+  from.store(1234, 12, Bound::lower, -50, e2e4, 17);
+  from.store(5678, 3, Bound::exact, 10, e2e4);
+  std::vector<TtRawEntry> entries;
+  from.collect_entries(0, from.num_buckets(), 8, &entries);
+  ASSERT_EQ(entries.size(), 1);
+  for (int i = 0; i < 3; ++i) {
+    to.new_search();
+  }
+  // Shallower entries of the same position make way; deeper ones don't.
+  to.store(1234, 4, Bound::upper, 0, promotion);
+  to.merge_entry(entries[0]);
+  TtEntry entry;
+  ASSERT_TRUE(to.probe(1234, &entry));
+  EXPECT_EQ(entry.move_, e2e4);
+  EXPECT_EQ(entry.depth_, 12);
+  EXPECT_EQ(entry.eval_, 17);
+  to.store(1234, 20, Bound::exact, 5, promotion);
+  to.merge_entry(entries[0]);
+  ASSERT_TRUE(to.probe(1234, &entry));
+  EXPECT_EQ(entry.depth_, 20);
+  // Merged entries count as the current search's.
+  entries.clear();
+  to.collect_entries(0, to.num_buckets(), 0, &entries);
+  EXPECT_EQ(entries.size(), 1);
+  // A bucket beyond the table's is ignored.
+  to.merge_entry({to.num_buckets(), entries[0].data_, entries[0].eval_});
+}
@@ -0,0 +1,774 @@
+#include "uci.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/types/optional.h"
+#include "bench.h"
+#include "cluster.h"
+#include "instrumentation.h"
+#include "memory_accounting.h"
+#include "nnue.h"
+#include "nnue_kernels.h"
+#include "numa.h"
+
+namespace {
+// `bench` measures the stop latency on this many of its positions, stopping
+// each search after this long.
+constexpr size_t num_stop_latency_positions = 4;
+constexpr std::chrono::milliseconds stop_latency_search_time{20};
+// A long search has the table file of `HashFile` written back this often.
+constexpr std::chrono::seconds hash_file_flush_interval{60};
+// How long `ClusterWorkers` waits for the workers to connect.
+constexpr std::chrono::seconds cluster_connect_timeout{60};
+
+// Returns `score` as the UCI `score` argument: centipawns, or the number of
+// moves to mate, negative when the side to move is the one mated.
+std::string score_to_str(int score) {
+  if (!is_mate_score(score)) {
+    return absl::StrCat("cp ", score);
+  }
+  const int plies = mate_score - std::abs(score);
+  const int moves = (plies + 1) / 2;
+  return absl::StrCat("mate ", score > 0 ? moves : -moves);
+}
+
+// Parses the argument after `args[*idx]` into `*value`, moving `*idx` past
+// it. Leaves `*value` alone if it is missing or not a number.
+template <typename T>
+void parse_number(const std::vector<absl::string_view>& args, size_t* idx,
+                  T* value) {
+  if (*idx + 1 >= args.size()) {
+    return;
+  }
+  T parsed;
+  if (absl::SimpleAtoi(args[++*idx], &parsed)) {
+    *value = parsed;
+  }
+}
+}  // namespace.
+
+UciEngine::UciEngine(std::ostream* out)
+    : out_(out),
+      table_(new TranspositionTable(default_hash_mb)),
+      hash_mb_(default_hash_mb),
+      searcher_(new ParallelSearcher(nullptr, table_.get())),
+      syzygy_cache_mb_(default_syzygy_cache_mb),
+      trace_buffer_(nullptr),
+      multi_pv_(1),
+      smp_mode_(SmpMode::lazy),
+      numa_bind_(false),
+      numa_replicate_(false),
+      chess960_(false),
+      cluster_port_(0),
+      stop_(false),
+      wait_for_stop_(false) {}
+
+UciEngine::~UciEngine() {
+  stop_search();
+  wait_for_table();
+}
+
+bool UciEngine::handle_command(absl::string_view line) {
+  const std::vector<absl::string_view> args =
+      absl::StrSplit(line, absl::ByAnyChar(" \t\r"), absl::SkipEmpty());
+  if (args.empty()) {
+    return true;
+  }
+  const absl::string_view command = args[0];
+  if (command == "uci") {
+    write_line("id name pawn_grabber");
+    write_line("id author the pawn_grabber authors");
+    write_line(absl::StrCat("option name Hash type spin default ",
+                            default_hash_mb, " min 1 max ", max_hash_mb));
+    write_line("option name HashFile type string default <empty>");
+    write_line("option name SharedHash type string default <empty>");
+    write_line("option name ClusterPort type spin default 0 min 0 max 65535");
+    write_line(absl::StrCat(
+        "option name ClusterWorkers type spin default 0 min 0 max ",
+        max_cluster_workers));
+    write_line(absl::StrCat(
+        "option name Threads type spin default 1 min 1 max ", max_threads));
+    write_line(absl::StrCat(
+        "option name MultiPV type spin default 1 min 1 max ", max_multi_pv));
+    write_line(
+        "option name SmpMode type combo default Lazy var Lazy var ABDADA");
+    write_line("option name NumaBind type check default false");
+    write_line("option name NumaReplicate type check default false");
+    write_line("option name CpuList type string default <empty>");
+    write_line("option name Ponder type check default false");
+    write_line("option name UCI_Chess960 type check default false");
+    write_line("option name EvalFile type string default <empty>");
+    write_line("option name SyzygyPath type string default <empty>");
+    write_line(absl::StrCat("option name SyzygyCache type spin default ",
+                            default_syzygy_cache_mb, " min 0 max ",
+                            max_syzygy_cache_mb));
+    write_line("option name BookFile type string default <empty>");
+    write_line("option name TraceFile type string default <empty>");
+    write_line("uciok");
+  } else if (command == "isready") {
+    wait_for_table();
+    write_line("readyok");
+  } else if (command == "setoption") {
+    set_option(args);
+  } else if (command == "ucinewgame") {
+    stop_search();
+    wait_for_table();
+    if (!table_->is_file_backed()) {
+      table_thread_ = std::thread([this] { table_->clear(); });
+    }
+    reset_searcher();
+    position_ = Board();
+    game_start_ = position_;
+    game_moves_.clear();
+    game_history_.reset(position_);
+  } else if (command == "position") {
+    set_position(args);
+  } else if (command == "go") {
+    go(args);
+  } else if (command == "stop") {
+    stop_search();
+  } else if (command == "ponderhit") {
+    ponderhit();
+  } else if (command == "bench") {
+    bench(args);
+  } else if (command == "counters") {
+    write_counters(args);
+  } else if (command == "memory") {
+    write_memory();
+  } else if (command == "quit") {
+    stop_search();
+    wait_for_table();
+    table_->flush(true);
+    return false;
+  }
+  return true;
+}
+
+void UciEngine::wait_for_search() {
+  if (search_thread_.joinable()) {
+    search_thread_.join();
+  }
+}
+
+void UciEngine::wait_for_table() {
+  if (table_thread_.joinable()) {
+    table_thread_.join();
+  }
+}
+
+void UciEngine::set_option(const std::vector<absl::string_view>& args) {
+  // setoption name <name> value <value>, where no name has spaces and only
+  // the values of HashFile, EvalFile, SyzygyPath, BookFile and TraceFile
+  // may.
+  if (args.size() < 5 || args[1] != "name" || args[3] != "value") {
+    return;
+  }
+  if (args[2] == "HashFile") {
+    stop_search();
+    wait_for_table();
+    table_thread_ = std::thread(
+        [this, path = absl::StrJoin(args.begin() + 4, args.end(), " ")] {
+          set_hash_file(path);
+        });
+    return;
+  }
+  if (args[2] == "SharedHash") {
+    stop_search();
+    wait_for_table();
+    table_thread_ = std::thread([this, name = std::string(args[4])] {
+      set_shared_hash(name);
+    });
+    return;
+  }
+  if (args[2] == "EvalFile") {
+    stop_search();
+    set_eval_file(absl::StrJoin(args.begin() + 4, args.end(), " "));
+    return;
+  }
+  if (args[2] == "SyzygyPath") {
+    stop_search();
+    // The table thread may be tracing into the same buffer.
+    wait_for_table();
+    set_syzygy_path(absl::StrJoin(args.begin() + 4, args.end(), " "));
+    return;
+  }
+  if (args[2] == "BookFile") {
+    stop_search();
+    set_book_file(absl::StrJoin(args.begin() + 4, args.end(), " "));
+    return;
+  }
+  if (args[2] == "TraceFile") {
+    stop_search();
+    wait_for_table();
+    set_trace_file(absl::StrJoin(args.begin() + 4, args.end(), " "));
+    return;
+  }
+  if (args[2] == "CpuList") {
+    stop_search();
+    set_cpu_list(args[4]);
+    return;
+  }
+  if (args[2] == "NumaBind") {
+    stop_search();
+    numa_bind_ = args[4] == "true";
+    set_threads(pool_ ? pool_->num_threads() + 1 : 1);
+    return;
+  }
+  if (args[2] == "NumaReplicate") {
+    stop_search();
+    numa_replicate_ = args[4] == "true";
+    searcher_->set_network_replication(numa_replicate_);
+    return;
+  }
+  if (args[2] == "SmpMode") {
+    stop_search();
+    smp_mode_ = args[4] == "ABDADA" ? SmpMode::abdada : SmpMode::lazy;
+    searcher_->set_smp_mode(smp_mode_);
+    return;
+  }
+  if (args[2] == "UCI_Chess960") {
+    chess960_ = args[4] == "true";
+    return;
+  }
+  size_t value;
+  if (!absl::SimpleAtoi(args[4], &value)) {
+    return;
+  }
+  if (args[2] == "Hash") {
+    stop_search();
+    hash_mb_ = std::min(std::max<size_t>(value, 1), max_hash_mb);
+    wait_for_table();
+    table_thread_ = std::thread([this] {
+      if (cluster_) {
+        // The workers' tables no longer have the size of this one.
+        cluster_.reset();
+        write_line("info string cluster closed, set ClusterWorkers again");
+      }
+      const TraceSpan span(trace_buffer_, "table resize", "mb",
+                           static_cast<int64_t>(hash_mb_));
+      if (!hash_file_.empty()) {
+        set_hash_file(hash_file_);
+      } else if (!shared_hash_.empty()) {
+        set_shared_hash(shared_hash_);
+      } else {
+        table_->resize(hash_mb_);
+      }
+    });
+  } else if (args[2] == "SyzygyCache") {
+    stop_search();
+    wait_for_table();
+    syzygy_cache_mb_ = std::min(value, max_syzygy_cache_mb);
+    if (tablebases_) {
+      set_syzygy_path(syzygy_path_);
+    }
+  } else if (args[2] == "ClusterPort") {
+    cluster_port_ = static_cast<uint16_t>(std::min<size_t>(value, 65535));
+  } else if (args[2] == "ClusterWorkers") {
+    stop_search();
+    wait_for_table();
+    table_thread_ = std::thread(
+        [this, num_workers = std::min(value, max_cluster_workers)] {
+          set_cluster(num_workers);
+        });
+  } else if (args[2] == "Threads") {
+    stop_search();
+    set_threads(std::min(std::max<size_t>(value, 1), max_threads));
+  } else if (args[2] == "MultiPV") {
+    stop_search();
+    multi_pv_ = std::min(std::max<size_t>(value, 1), max_multi_pv);
+    searcher_->set_multi_pv(multi_pv_);
+  }
+}
+
+void UciEngine::set_cpu_list(absl::string_view list) {
+  cpus_.clear();
+  if (list != "<empty>") {
+    cpus_ = parse_cpu_list(list);
+    if (cpus_.empty()) {
+      write_line(absl::StrCat("info string can't parse CPU list ", list));
+    }
+  }
+  set_threads(pool_ ? pool_->num_threads() + 1 : 1);
+}
+
+void UciEngine::set_threads(size_t num_threads) {
+  searcher_.reset();
+  pool_.reset(num_threads > 1
+                  ? new ThreadPool(num_threads - 1, {cpus_, numa_bind_})
+                  : nullptr);
+  reset_searcher();
+}
+
+void UciEngine::set_eval_file(const std::string& path) {
+  searcher_->set_network(nullptr);
+  network_.reset();
+  if (path.empty() || path == "<empty>") {
+    return;
+  }
+  std::string error;
+  network_ = load_network(path, &error);
+  if (!network_) {
+    write_line(absl::StrCat("info string ", error));
+    return;
+  }
+  searcher_->set_network(network_.get());
+  write_line(absl::StrCat("info string loaded ", path, " (",
+                          simd_level_name(nnue_kernels().level_), ")"));
+}
+
+void UciEngine::set_syzygy_path(const std::string& paths) {
+  searcher_->set_tablebases(nullptr);
+  tablebases_.reset();
+  syzygy_path_ = paths;
+  if (paths.empty() || paths == "<empty>") {
+    return;
+  }
+  {
+    TraceSpan span(trace_buffer_, "tablebase load", "files");
+    tablebases_.reset(new Tablebases(paths, syzygy_cache_mb_ << 20));
+    span.set_arg(static_cast<int64_t>(tablebases_->num_files()));
+  }
+  searcher_->set_tablebases(tablebases_.get());
+  write_line(absl::StrCat("info string found ", tablebases_->num_files(),
+                          " tablebase files"));
+}
+
+void UciEngine::set_book_file(const std::string& path) {
+  book_.reset();
+  if (path.empty() || path == "<empty>") {
+    return;
+  }
+  book_.reset(new OpeningBook(path));
+  if (!book_->is_open()) {
+    book_.reset();
+    write_line(absl::StrCat("info string can't open book ", path));
+    return;
+  }
+  write_line(absl::StrCat("info string book ", path, " has ", book_->size(),
+                          " entries"));
+}
+
+void UciEngine::set_hash_file(const std::string& path) {
+  if (path.empty() || path == "<empty>") {
+    if (!hash_file_.empty()) {
+      hash_file_.clear();
+      table_->resize(hash_mb_);
+    }
+    return;
+  }
+  switch (table_->open_file(path, hash_mb_)) {
+    case TranspositionTable::FileStatus::failed:
+      write_line(absl::StrCat("info string can't map hash file ", path));
+      return;
+    case TranspositionTable::FileStatus::created:
+      write_line(absl::StrCat("info string created hash file ", path));
+      break;
+    case TranspositionTable::FileStatus::resumed:
+      write_line(absl::StrCat("info string resumed hash file ", path,
+                              " at ", table_->hashfull(), " permille"));
+      break;
+  }
+  hash_file_ = path;
+  shared_hash_.clear();
+}
+
+void UciEngine::set_shared_hash(const std::string& name) {
+  if (name.empty() || name == "<empty>") {
+    if (!shared_hash_.empty()) {
+      shared_hash_.clear();
+      table_->resize(hash_mb_);
+    }
+    return;
+  }
+  hash_file_.clear();
+  switch (table_->attach_shared(name, hash_mb_)) {
+    case TranspositionTable::FileStatus::failed:
+      // Most likely made by another process with another `Hash`.
+      write_line(absl::StrCat("info string can't attach shared hash ", name,
+                              " of ", hash_mb_, " MB"));
+      shared_hash_.clear();
+      table_->resize(hash_mb_);
+      return;
+    case TranspositionTable::FileStatus::created:
+      write_line(absl::StrCat("info string created shared hash ", name));
+      break;
+    case TranspositionTable::FileStatus::resumed:
+      write_line(absl::StrCat("info string attached shared hash ", name));
+      break;
+  }
+  shared_hash_ = name;
+}
+
+void UciEngine::set_cluster(size_t num_workers) {
+  cluster_.reset();
+  if (num_workers == 0) {
+    return;
+  }
+  std::unique_ptr<ClusterNode> cluster(
+      new ClusterNode(table_.get(), ClusterOptions()));
+  write_line(absl::StrCat("info string waiting for ", num_workers,
+                          " cluster workers on port ", cluster_port_));
+  std::string error;
+  if (!cluster->coordinate(cluster_port_, num_workers,
+                           cluster_connect_timeout, &error)) {
+    write_line(absl::StrCat("info string ", error));
+    return;
+  }
+  cluster_ = std::move(cluster);
+  write_line(absl::StrCat("info string ", num_workers,
+                          " cluster workers connected"));
+}
+
+void UciEngine::set_trace_file(const std::string& path) {
+  searcher_->set_tracer(nullptr);
+  trace_buffer_ = nullptr;
+  if (tracer_) {
+    const bool written = tracer_->close();
+    write_line(absl::StrCat("info string trace has ", tracer_->num_events(),
+                            " events, ", tracer_->num_dropped(), " dropped",
+                            written ? "" : ", not all written"));
+    tracer_.reset();
+  }
+  if (path.empty() || path == "<empty>") {
+    return;
+  }
+  tracer_.reset(new Tracer(path));
+  if (!tracer_->is_open()) {
+    tracer_.reset();
+    write_line(absl::StrCat("info string can't write trace ", path));
+    return;
+  }
+  trace_buffer_ = tracer_->new_buffer("engine");
+  searcher_->set_tracer(tracer_.get());
+}
+
+void UciEngine::set_position(const std::vector<absl::string_view>& args) {
+  size_t idx = 1;
+  if (idx < args.size() && args[idx] == "startpos") {
+    // The start position is also one of Chess960, with the same rooks.
+    position_ = Board();
+    position_.is_chess960_ = chess960_;
+    ++idx;
+  } else if (idx < args.size() && args[idx] == "fen") {
+    const size_t fen_begin = ++idx;
+    while (idx < args.size() && args[idx] != "moves") {
+      ++idx;
+    }
+    const char* error = nullptr;
+    const absl::optional<Board> board = parse_fen(
+        absl::StrJoin(args.begin() + fen_begin, args.begin() + idx, " "),
+        &error, chess960_);
+    if (!board) {
+      write_line(absl::StrCat("info string ", error));
+      return;
+    }
+    position_ = *board;
+  } else {
+    return;
+  }
+  game_start_ = position_;
+  game_moves_.clear();
+  game_history_.reset(position_);
+  if (idx < args.size() && args[idx] == "moves") {
+    for (++idx; idx < args.size(); ++idx) {
+      const absl::optional<Move> move = parse_uci_move(position_, args[idx]);
+      if (!move) {
+        write_line(absl::StrCat("info string illegal move ", args[idx]));
+        return;
+      }
+      position_.do_move(*move);
+      game_moves_.push_back(*move);
+      game_history_.push(position_);
+    }
+  }
+}
+
+void UciEngine::go(const std::vector<absl::string_view>& args) {
+  stop_search();
+  // Before the clock starts, which the time spent clearing shouldn't count
+  // against.
+  wait_for_table();
+  const Color side = position_.is_whites_move_ ? Color::white : Color::black;
+  constexpr size_t white = static_cast<size_t>(Color::white);
+  constexpr size_t black = static_cast<size_t>(Color::black);
+  TimeControl time_control = {};
+  SearchLimits limits = {max_search_ply - 1, 0, &stop_, nullptr};
+  bool infinite = false;
+  bool ponder = false;
+  for (size_t idx = 1; idx < args.size(); ++idx) {
+    const absl::string_view arg = args[idx];
+    if (arg == "depth") {
+      parse_number(args, &idx, &limits.max_depth_);
+      limits.max_depth_ = std::min(std::max(limits.max_depth_, 1),
+                                   max_search_ply - 1);
+    } else if (arg == "nodes") {
+      parse_number(args, &idx, &limits.max_nodes_);
+    } else if (arg == "movetime") {
+      parse_number(args, &idx, &time_control.move_time_);
+    } else if (arg == "wtime") {
+      parse_number(args, &idx, &time_control.time_left_[white]);
+    } else if (arg == "btime") {
+      parse_number(args, &idx, &time_control.time_left_[black]);
+    } else if (arg == "winc") {
+      parse_number(args, &idx, &time_control.increment_[white]);
+    } else if (arg == "binc") {
+      parse_number(args, &idx, &time_control.increment_[black]);
+    } else if (arg == "movestogo") {
+      parse_number(args, &idx, &time_control.moves_to_go_);
+    } else if (arg == "infinite") {
+      infinite = true;
+    } else if (arg == "ponder") {
+      ponder = true;
+    }
+  }
+  // Polyglot books only know the castling moves of standard chess.
+  if (book_ && !position_.is_chess960_ && !infinite && !ponder) {
+    if (const absl::optional<Move> move =
+            book_->pick_move(position_, book_rng_())) {
+      write_line(absl::StrCat("bestmove ", move->to_uci_str()));
+      return;
+    }
+  }
+  time_manager_.reset(new TimeManager(time_control, side, ponder));
+  limits.time_manager_ = infinite ? nullptr : time_manager_.get();
+  searcher_->set_game_history(game_history_);
+  stop_ = false;
+  wait_for_stop_ = infinite || ponder;
+  search_thread_ = std::thread(
+      [this, board = position_, start = game_start_, moves = game_moves_,
+       limits] { run_search(board, start, moves, limits); });
+}
+
+void UciEngine::run_search(const Board& board, const Board& start,
+                           const std::vector<Move>& moves,
+                           const SearchLimits& limits) {
+  if (!cpus_.empty()) {
+    // The CPU after those of the helpers.
+    const size_t num_helpers = pool_ ? pool_->num_threads() : 0;
+    bind_to_cpus({cpus_[num_helpers % cpus_.size()]});
+  }
+  last_flush_ = std::chrono::steady_clock::now();
+  const Searcher::IterationCallback on_iteration =
+      [this](const SearchResult& res) {
+        for (size_t i = 0; i < res.lines_.size(); ++i) {
+          write_line(info_line(res, i));
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last_flush_ >= hash_file_flush_interval) {
+          table_->flush();
+          last_flush_ = now;
+        }
+      };
+  const SearchResult res =
+      cluster_ ? cluster_->search(searcher_.get(), start, moves, limits,
+                                  on_iteration)
+               : searcher_->search(board, limits, on_iteration);
+  table_->flush();
+  {
+    // The protocol doesn't allow `bestmove` before `stop` in infinite and
+    // ponder mode, even if the search ran out of depth.
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_requested_.wait(lock, [this] { return stop_ || !wait_for_stop_; });
+  }
+  absl::optional<Move> best_move = res.best_move_;
+  if (!best_move) {
+    // Stopped before the first iteration was complete.
+    const MoveList legal_moves = board.legal_moves();
+    if (legal_moves.size() > 0) {
+      best_move = legal_moves[0];
+    }
+  }
+  std::string line =
+      absl::StrCat("bestmove ", best_move ? best_move->to_uci_str() : "0000");
+  const absl::optional<Move> reply =
+      best_move ? ponder_move(board, *best_move, res) : absl::nullopt;
+  if (reply) {
+    absl::StrAppend(&line, " ponder ", reply->to_uci_str());
+  }
+  write_line(line);
+}
+
+void UciEngine::stop_search() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_requested_.notify_all();
+  wait_for_search();
+}
+
+void UciEngine::ponderhit() {
+  if (time_manager_) {
+    time_manager_->ponderhit();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wait_for_stop_ = false;
+  }
+  stop_requested_.notify_all();
+}
+
+void UciEngine::bench(const std::vector<absl::string_view>& args) {
+  stop_search();
+  int depth = default_bench_depth;
+  size_t num_threads = 1;
+  size_t idx = 0;
+  parse_number(args, &idx, &depth);
+  parse_number(args, &idx, &num_threads);
+  depth = std::min(std::max(depth, 1), max_search_ply - 1);
+  num_threads = std::min(std::max<size_t>(num_threads, 1), max_threads);
+  TranspositionTable table(default_hash_mb);
+  std::unique_ptr<ThreadPool> pool(
+      num_threads > 1 ? new ThreadPool(num_threads - 1, {cpus_, numa_bind_})
+                      : nullptr);
+  ParallelSearcher searcher(pool.get(), &table);
+  searcher.set_smp_mode(smp_mode_);
+  searcher.set_network_replication(numa_replicate_);
+  searcher.set_network(network_.get());
+  KeyHistory history;
+  uint64_t total_nodes = 0;
+  const size_t num_positions = num_bench_fens;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_positions; ++i) {
+    const Board board(bench_fens[i]);
+    history.reset(board);
+    searcher.set_game_history(history);
+    const SearchResult res =
+        searcher.search(board, {depth, 0, nullptr, nullptr});
+    total_nodes += res.nodes_;
+    write_line(absl::StrCat(
+        "Position ", i + 1, "/", num_positions, ": ", res.nodes_,
+        " nodes, bestmove ",
+        res.best_move_ ? res.best_move_->to_uci_str() : "0000"));
+  }
+  const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  // The stop latency: how long a search that has run for a while takes to
+  // return once its stop flag is set, which is what cancelling a search
+  // wastes. Not part of the node count, which a stopped search would spoil.
+  std::chrono::steady_clock::duration max_latency{0};
+  std::chrono::steady_clock::duration total_latency{0};
+  for (size_t i = 0; i < num_stop_latency_positions; ++i) {
+    const Board board(bench_fens[i]);
+    history.reset(board);
+    searcher.set_game_history(history);
+    std::atomic<bool> stop(false);
+    std::thread thread([&searcher, &board, &stop] {
+      searcher.search(board, {max_search_ply - 1, 0, &stop, nullptr});
+    });
+    std::this_thread::sleep_for(stop_latency_search_time);
+    const auto stop_time = std::chrono::steady_clock::now();
+    stop.store(true, std::memory_order_relaxed);
+    thread.join();
+    const auto latency = std::chrono::steady_clock::now() - stop_time;
+    max_latency = std::max(max_latency, latency);
+    total_latency += latency;
+  }
+  const auto to_us = [](std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+        .count();
+  };
+  write_line(absl::StrCat(
+      "Stop latency (us): max ", to_us(max_latency), ", mean ",
+      to_us(total_latency / num_stop_latency_positions)));
+  write_line(absl::StrCat("Nodes searched: ", total_nodes));
+  write_line(absl::StrCat("Time (ms): ", time));
+  write_line(absl::StrCat(
+      "Nodes/second: ",
+      total_nodes * 1000 / static_cast<uint64_t>(std::max<int64_t>(time, 1))));
+}
+
+void UciEngine::write_counters(const std::vector<absl::string_view>& args) {
+  if (!PAWN_GRABBER_INSTRUMENT) {
+    write_line(
+        "info string counters are compiled out, build with "
+        "PAWN_GRABBER_INSTRUMENT");
+    return;
+  }
+  if (args.size() > 1 && args[1] == "reset") {
+    reset_counters();
+    return;
+  }
+  for (absl::string_view line : absl::StrSplit(
+           counters_to_str(collect_counters()), '\n', absl::SkipEmpty())) {
+    write_line(absl::StrCat("info string ", line));
+  }
+}
+
+void UciEngine::write_memory() {
+  for (absl::string_view line : absl::StrSplit(
+           memory_to_str(collect_memory()), '\n', absl::SkipEmpty())) {
+    write_line(absl::StrCat("info string memory ", line));
+  }
+}
+
+void UciEngine::write_line(const std::string& line) {
+  std::lock_guard<std::mutex> lock(out_mutex_);
+  *out_ << line << std::endl;
+}
+
+std::string UciEngine::info_line(const SearchResult& res,
+                                 size_t line_idx) const {
+  const SearchLine& search_line = res.lines_[line_idx];
+  const int64_t time = time_manager_->elapsed();
+  const uint64_t nps = res.nodes_ * 1000 / static_cast<uint64_t>(
+                                               std::max<int64_t>(time, 1));
+  std::string line = absl::StrCat("info depth ", res.depth_);
+  if (multi_pv_ > 1) {
+    absl::StrAppend(&line, " multipv ", line_idx + 1);
+  }
+  absl::StrAppend(&line, " score ", score_to_str(search_line.score_),
+                  " seldepth ", res.selective_depth_, " nodes ", res.nodes_,
+                  " nps ", nps, " tbhits ", res.tablebase_hits_, " time ",
+                  time, " hashfull ", table_->hashfull(), " pv");
+  for (Move move : search_line.pv_) {
+    line += ' ';
+    move.append_uci(&line);
+  }
+  return line;
+}
+
+absl::optional<Move> UciEngine::ponder_move(const Board& board,
+                                            Move best_move,
+                                            const SearchResult& res) const {
+  if (res.pv_.size() >= 2 && res.pv_[0] == best_move) {
+    return res.pv_[1];
+  }
+  // The principal variation is cut short by a cutoff on the table, or by the
+  // search stopping, but the table often knows the reply anyway.
+  Board after = board;
+  after.do_move(best_move);
+  TtEntry entry;
+  if (!table_->probe(after.key_, &entry) || !entry.move_) {
+    return absl::nullopt;
+  }
+  const MoveList moves = after.legal_moves();
+  if (std::find(moves.begin(), moves.end(), *entry.move_) == moves.end()) {
+    return absl::nullopt;
+  }
+  return entry.move_;
+}
+
+void UciEngine::reset_searcher() {
+  searcher_.reset(new ParallelSearcher(pool_.get(), table_.get()));
+  searcher_->set_multi_pv(multi_pv_);
+  searcher_->set_smp_mode(smp_mode_);
+  searcher_->set_network_replication(numa_replicate_);
+  searcher_->set_network(network_.get());
+  searcher_->set_tablebases(tablebases_.get());
+  searcher_->set_tracer(tracer_.get());
+}
@@ -0,0 +1,258 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "board.h"
+#include "book.h"
+#include "cluster.h"
+#include "nnue.h"
+#include "repetition.h"
+#include "search.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+#include "time_manager.h"
+#include "trace.h"
+#include "transposition_table.h"
+
+// The engine side of the Universal Chess Interface. The caller reads the
+// commands, one per line, and hands them to `handle_command`, which answers on
+// `out`. `go` starts the search on a thread of its own and returns at once, so
+// that the caller keeps reading and `stop` or `ponderhit` take effect in the
+// middle of a search. The search reports every iteration with an `info` line
+// and ends with `bestmove`, written from the search thread; `stop`, `quit`,
+// `setoption` and a new `go` wait for it.
+//
+// With a book, `go` answers a position of the book with one of its moves at
+// once, without searching, except to ponder or search infinitely.
+//
+// `setoption name Hash`, `HashFile` and `ucinewgame` resize and clear the
+// table on a thread of their own and return at once, since zeroing gigabytes
+// takes seconds that a tournament manager would otherwise spend waiting
+// between games. `isready` answers `readyok` once the table is done, and
+// `go` waits for it too.
+//
+// Nothing is cleared between two searches but on `ucinewgame`: the table and
+// the move histories carry over from one move of the game to the next, and
+// from pondering to the search of the move actually played. So with one
+// thread, a search by `go nodes` right after `ucinewgame` and `position` gives
+// the same result every time.
+//
+// Supported: uci, debug (ignored), isready, setoption (Hash, HashFile,
+// SharedHash, ClusterPort, ClusterWorkers, Threads, SmpMode, NumaBind,
+// NumaReplicate, CpuList, MultiPV, Ponder, EvalFile, SyzygyPath,
+// SyzygyCache, BookFile, TraceFile),
+// ucinewgame, position (startpos or fen, with moves), go (depth, nodes,
+// movetime, wtime, btime, winc, binc, movestogo, infinite, ponder), stop,
+// ponderhit and quit. Unknown commands and arguments are ignored, as the
+// protocol asks.
+//
+// `SmpMode` is how several threads share a search (see ParallelSearcher):
+// Lazy, the default, or ABDADA.
+//
+// `SyzygyCache` is the MB of decompressed tablebase blocks and probe results
+// to keep (see tablebase.h), 0 for none. Setting it loads the tablebases of
+// `SyzygyPath` again.
+//
+// `NumaBind` binds the helper threads to the NUMA nodes of the machine in
+// turn (see thread_pool.h), which only matters on machines of several nodes.
+// `NumaReplicate` gives the helper threads of each NUMA node a copy of the
+// network on their node (see `ParallelSearcher::set_network_replication`).
+// `CpuList`, a Linux CPU list such as 0-3,8, pins the helper threads to its
+// CPUs in turn and the searching thread to the next, so that no thread
+// migrates between cores. The helper threads are kept from one search to the
+// next, and only replaced when one of these options or `Threads` changes.
+//
+// Besides the protocol, `bench [depth] [threads]` searches a fixed list of
+// positions to a fixed depth and prints the total node count and node rate.
+// With one thread, the default, the count only depends on the code and the
+// network, so it fingerprints a build, and the rate measures the host. With
+// more, in the mode of `SmpMode`, the time it takes measures how the time to
+// depth scales. It also prints the stop latency, the time searches
+// of the first few positions take to return once stopped.
+//
+// `HashFile` keeps the table in a file (see transposition_table.h) of the
+// size of `Hash`, so that an analysis stopped by `quit`, or by a crash, picks
+// up its table where it left off when the engine sets the same file again.
+// With a file, `ucinewgame` keeps the table too, and the table is written
+// back after every search and every minute of a long one.
+//
+// `SharedHash` names a POSIX shared memory object, such as /pawn_grabber,
+// for the table instead, which the engines of one host that set the same
+// name and `Hash` all search with, each using the others' entries. The
+// object stays until it is unlinked, as in /dev/shm on Linux.
+//
+// `ClusterWorkers` makes the engine the coordinator of a cluster (see
+// cluster.h): it waits for that many `cluster_worker` processes, with
+// tables of the size of `Hash`, to connect to `ClusterPort`, and `isready`
+// waits with it. The searches then run on every machine of the cluster,
+// sharing deep table entries, and the move is picked by the machines'
+// vote. Changing `Hash` closes the cluster.
+//
+// Setting `TraceFile` starts a trace (see trace.h) of the searches, their
+// iterations and helper threads, table resizes and tablebase loads, until it
+// is set again, which ends the file, so that a single request can be traced.
+//
+// `counters` writes the search counters of instrumentation.h as `info string`
+// lines, and `counters reset` starts them from 0. In builds without
+// PAWN_GRABBER_INSTRUMENT, it says they are compiled out.
+//
+// `memory` writes the bytes of each subsystem and thread as
+// memory_accounting.h counts them, and the resident set of the process, as
+// `info string` lines.
+class UciEngine {
+ public:
+  static constexpr size_t default_hash_mb = 16;
+  static constexpr size_t max_hash_mb = 65536;
+  static constexpr size_t default_syzygy_cache_mb = 16;
+  static constexpr size_t max_syzygy_cache_mb = 4096;
+  static constexpr size_t max_threads = 256;
+  static constexpr size_t max_multi_pv = 256;
+  static constexpr size_t max_cluster_workers = 256;
+  static constexpr int default_bench_depth = 12;
+
+  // `out` must outlive the engine.
+  explicit UciEngine(std::ostream* out);
+  UciEngine(const UciEngine&) = delete;
+  UciEngine& operator=(const UciEngine&) = delete;
+  // Stops the search, if any.
+  ~UciEngine();
+
+  // Handles one command line. Returns false once the command was `quit`.
+  bool handle_command(absl::string_view line);
+  // Blocks until the current search, if any, has written its `bestmove`. A
+  // search that waits for `stop` keeps waiting.
+  void wait_for_search();
+
+ private:
+  void set_option(const std::vector<absl::string_view>& args);
+  // Loads the network file at `path`, or goes back to the classical
+  // evaluation if `path` is empty or "<empty>".
+  void set_eval_file(const std::string& path);
+  // Looks for tablebases in `paths`, directories separated by ':', or drops
+  // them if `paths` is empty or "<empty>".
+  void set_syzygy_path(const std::string& paths);
+  // Opens the Polyglot book at `path`, or drops the book if `path` is empty
+  // or "<empty>".
+  void set_book_file(const std::string& path);
+  // Keeps the table in the file at `path`, or in memory again if `path` is
+  // empty or "<empty>". Runs on the table thread.
+  void set_hash_file(const std::string& path);
+  // Searches with the table in the shared memory object `name`, or in
+  // memory again if `name` is empty or "<empty>". Runs on the table thread.
+  void set_shared_hash(const std::string& name);
+  // Waits for `num_workers` workers to connect to `cluster_port_`, and
+  // searches with them from then on, or alone if it is 0 or they don't
+  // connect. Runs on the table thread.
+  void set_cluster(size_t num_workers);
+  // Ends the current trace, if any, and starts one in `path` unless it is
+  // empty or "<empty>".
+  void set_trace_file(const std::string& path);
+  // Pins the threads to the CPUs of `list`, or unpins them if it is
+  // "<empty>".
+  void set_cpu_list(absl::string_view list);
+  // Replaces the helper threads with `num_threads` - 1 new ones.
+  void set_threads(size_t num_threads);
+  void set_position(const std::vector<absl::string_view>& args);
+  void go(const std::vector<absl::string_view>& args);
+  // Runs on the search thread.
+  // `board` is the position after `moves` from `start`.
+  void run_search(const Board& board, const Board& start,
+                  const std::vector<Move>& moves, const SearchLimits& limits);
+  // Makes a running search stop and waits for its `bestmove`.
+  void stop_search();
+  // Waits for the table thread, if any, to finish resizing or clearing the
+  // table.
+  void wait_for_table();
+  void ponderhit();
+  // Runs `bench` on the calling thread. It uses a table, a searcher and
+  // helper threads of its own, without tablebases, whatever the options but
+  // `SmpMode`, `CpuList`, `NumaBind` and `NumaReplicate` are.
+  void bench(const std::vector<absl::string_view>& args);
+  void write_counters(const std::vector<absl::string_view>& args);
+  void write_memory();
+  // Writes `line` and a newline to `out_`, one thread at a time.
+  void write_line(const std::string& line);
+  // Returns the `info` line of `res.lines_[line_idx]`.
+  std::string info_line(const SearchResult& res, size_t line_idx) const;
+  // Replaces the searcher, and with it the move histories.
+  void reset_searcher();
+  // Returns the reply to `best_move` on `board` that the search expects,
+  // from the principal variation or else from the table.
+  absl::optional<Move> ponder_move(const Board& board, Move best_move,
+                                   const SearchResult& res) const;
+
+  std::ostream* const out_;
+  std::mutex out_mutex_;
+  Board position_;
+  // The positions of the game up to `position_`, for finding repetitions,
+  // and the position and moves it was set up with.
+  KeyHistory game_history_;
+  Board game_start_;
+  std::vector<Move> game_moves_;
+  std::unique_ptr<TranspositionTable> table_;
+  size_t hash_mb_;
+  // The file of `HashFile` and the object of `SharedHash`, empty without
+  // one. At most one is set.
+  std::string hash_file_;
+  std::string shared_hash_;
+  // When the search thread last had the table file written back.
+  std::chrono::steady_clock::time_point last_flush_;
+  // The helper threads, null with one thread.
+  std::unique_ptr<ThreadPool> pool_;
+  std::unique_ptr<ParallelSearcher> searcher_;
+  // The network of `EvalFile`, null for the classical evaluation.
+  NetworkPtr network_;
+  // The tablebases of `SyzygyPath`, null without any.
+  std::unique_ptr<Tablebases> tablebases_;
+  std::string syzygy_path_;
+  size_t syzygy_cache_mb_;
+  // The book of `BookFile`, null without one.
+  std::unique_ptr<OpeningBook> book_;
+  // The trace of `TraceFile`, null without one, and the buffer of the thread
+  // that handles the commands.
+  std::unique_ptr<Tracer> tracer_;
+  TraceBuffer* trace_buffer_;
+  // Picks the book moves.
+  std::mt19937_64 book_rng_;
+  size_t multi_pv_;
+  SmpMode smp_mode_;
+  bool numa_bind_;
+  bool numa_replicate_;
+  // Set by `UCI_Chess960`: positions are Chess960 ones, and castling moves
+  // are written as the king taking its own rook.
+  bool chess960_;
+  // The coordinator of `ClusterWorkers`, null without workers, on the port
+  // of `ClusterPort`.
+  std::unique_ptr<ClusterNode> cluster_;
+  uint16_t cluster_port_;
+  // The CPUs of `CpuList`, empty without one.
+  std::vector<int> cpus_;
+  std::thread search_thread_;
+  // Resizes or clears `table_`, which nothing else touches until it is
+  // joined.
+  std::thread table_thread_;
+  std::unique_ptr<TimeManager> time_manager_;
+  std::atomic<bool> stop_;
+  // Guards `wait_for_stop_`.
+  std::mutex mutex_;
+  std::condition_variable stop_requested_;
+  // Set for `go infinite` and `go ponder`, whose `bestmove` has to wait for
+  // `stop`, or for `ponderhit` when pondering.
+  bool wait_for_stop_;
+};
+
+#endif
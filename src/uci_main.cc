@@ -0,0 +1,37 @@
+#include <iostream>
+#include <string>
+
+#include "uci.h"
+
+// Usage: pawn_grabber [command]
+//
+// Speaks UCI on stdin and stdout, for a chess GUI or tournament manager. The
+// commands are read on the main thread while the engine searches on another,
+// so that `stop` and `ponderhit` are seen during a search.
+//
+// With arguments, they are run as one command and the engine exits without
+// reading stdin, as in `pawn_grabber bench 10`.
+
+int main(int argc, char** argv) {
+  UciEngine engine(&std::cout);
+  if (argc > 1) {
+    std::string command = argv[1];
+    for (int arg_idx = 2; arg_idx < argc; ++arg_idx) {
+      command += ' ';
+      command += argv[arg_idx];
+    }
+    engine.handle_command(command);
+    engine.wait_for_search();
+    engine.handle_command("quit");
+    return 0;
+  }
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (!engine.handle_command(line)) {
+      return 0;
+    }
+  }
+  // The GUI went away without `quit`.
+  engine.handle_command("quit");
+  return 0;
+}
@@ -0,0 +1,472 @@
+#include "uci.h"
+
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "board.h"
+#include "book.h"
+#include "cluster.h"
+#include "gtest/gtest.h"
+#include "instrumentation.h"
+#include "search.h"
+#include "transposition_table.h"
+
+namespace {
+// Returns the last line of `out`.
+std::string last_line(const std::ostringstream& out) {
+  std::string str = out.str();
+  if (!str.empty() && str.back() == '\n') {
+    str.pop_back();
+  }
+  return str.substr(str.rfind('\n') + 1);
+}
+}  // namespace.
+
+TEST(UciEngine, Handshake) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  EXPECT_TRUE(engine.handle_command("uci"));
+  EXPECT_TRUE(absl::StartsWith(out.str(), "id name pawn_grabber\n"));
+  EXPECT_TRUE(absl::StrContains(out.str(), "option name Hash type spin"));
+  EXPECT_EQ(last_line(out), "uciok");
+  EXPECT_TRUE(engine.handle_command("isready"));
+  EXPECT_EQ(last_line(out), "readyok");
+  EXPECT_TRUE(engine.handle_command("  "));
+  EXPECT_TRUE(engine.handle_command("xyzzy"));
+  EXPECT_FALSE(engine.handle_command("quit"));
+}
+
+TEST(UciEngine, FindsMateAfterMoves) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  // After Kb6 Kb8 the rook mates on the back rank.
+  engine.handle_command("position fen k7/8/8/2K5/8/8/8/7R w - - 0 1 "
+                        "moves c5b6 a8b8");
+  engine.handle_command("go depth 2");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StrContains(out.str(), "score mate 1"));
+  EXPECT_EQ(last_line(out), "bestmove h1h8");
+}
+
+TEST(UciEngine, ReportsIterations) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Hash value 1");
+  engine.handle_command("position startpos moves e2e4 e7e5");
+  engine.handle_command("go depth 3");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StrContains(out.str(), "info depth 1 score cp "));
+  EXPECT_TRUE(absl::StrContains(out.str(), "info depth 3 score cp "));
+  EXPECT_FALSE(absl::StrContains(out.str(), "info depth 4"));
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  EXPECT_TRUE(absl::StrContains(last_line(out), " ponder "));
+}
+
+TEST(UciEngine, RejectsIllegalMoves) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("position startpos moves e2e4 e2e4");
+  EXPECT_EQ(last_line(out), "info string illegal move e2e4");
+}
+
+TEST(UciEngine, RejectsInvalidFens) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("position fen 4k3/8/8/8/8/8/8/8 w - - 0 1");
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "info string "));
+  // The position is unchanged.
+  engine.handle_command("go depth 1");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+}
+
+TEST(UciEngine, Chess960CastlesOntoTheRook) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name UCI_Chess960 value true");
+  engine.handle_command(
+      "position startpos moves e2e4 e7e5 g1f3 b8c6 f1c4 g8f6 e1g1");
+  EXPECT_EQ(last_line(out), "info string illegal move e1g1");
+  engine.handle_command(
+      "position startpos moves e2e4 e7e5 g1f3 b8c6 f1c4 g8f6 e1h1");
+  engine.handle_command("position fen 4k3/8/8/8/8/8/8/5KR1 w G - 0 1 "
+                        "moves f1g1");
+  engine.handle_command("go depth 1");
+  engine.wait_for_search();
+  EXPECT_FALSE(absl::StrContains(out.str(), "illegal move e1h1"));
+  EXPECT_FALSE(absl::StrContains(out.str(), "illegal move f1g1"));
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+}
+
+TEST(UciEngine, InfiniteSearchWaitsForStop) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Threads value 2");
+  engine.handle_command("go infinite depth 1");
+  engine.handle_command("isready");
+  EXPECT_EQ(last_line(out), "readyok");
+  engine.handle_command("stop");
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  EXPECT_EQ(out.str().find("bestmove"), out.str().rfind("bestmove"));
+}
+
+TEST(UciEngine, ClearsTheTableBeforeTheNextSearch) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Hash value 64");
+  engine.handle_command("isready");
+  EXPECT_EQ(last_line(out), "readyok");
+  // The score and node count of the last iteration, which the entries of an
+  // earlier search would change.
+  std::string results[2];
+  for (std::string& result : results) {
+    engine.handle_command("ucinewgame");
+    engine.handle_command("position startpos moves e2e4");
+    engine.handle_command("go nodes 5000");
+    engine.wait_for_search();
+    const std::string str = out.str();
+    const size_t info = str.rfind("info depth ");
+    ASSERT_NE(info, std::string::npos);
+    result = str.substr(info, str.find(" nps ", info) - info);
+  }
+  EXPECT_EQ(results[0], results[1]);
+  engine.handle_command("ucinewgame");
+  engine.handle_command("isready");
+  EXPECT_EQ(last_line(out), "readyok");
+}
+
+TEST(UciEngine, SearchesWithBoundThreads) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Threads value 3");
+  engine.handle_command("setoption name NumaBind value true");
+  engine.handle_command("setoption name NumaReplicate value true");
+  engine.handle_command("go depth 4");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+
+  engine.handle_command("setoption name CpuList value 0");
+  engine.handle_command("go depth 4");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  engine.handle_command("setoption name CpuList value 0-");
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "info string can't parse"));
+}
+
+TEST(UciEngine, SearchesAndBenchesWithAbdada) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("uci");
+  EXPECT_TRUE(absl::StrContains(out.str(), "option name SmpMode type combo"));
+  engine.handle_command("setoption name SmpMode value ABDADA");
+  // Setting the threads replaces the searcher, which keeps the mode.
+  engine.handle_command("setoption name Threads value 3");
+  engine.handle_command("go depth 6");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  engine.handle_command("bench 4 3");
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "Nodes/second: "));
+}
+
+TEST(UciEngine, PonderhitEndsPonderSearch) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("go ponder depth 1 movetime 100000");
+  engine.handle_command("ponderhit");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+}
+
+TEST(UciEngine, StopsAtNodeLimit) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("go nodes 2000");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  EXPECT_FALSE(absl::StrContains(out.str(), "info depth 20 "));
+}
+
+TEST(UciEngine, NoMoveWhenMated) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("position fen 7k/6Q1/6K1/8/8/8/8/8 b - - 0 1");
+  engine.handle_command("go depth 3");
+  engine.wait_for_search();
+  EXPECT_EQ(last_line(out), "bestmove 0000");
+}
+
+TEST(UciEngine, PondersOnTheExpectedReply) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("position startpos");
+  engine.handle_command("go depth 4");
+  engine.wait_for_search();
+  const std::vector<std::string> words = absl::StrSplit(last_line(out), ' ');
+  ASSERT_EQ(words.size(), 4);
+  ASSERT_EQ(words[2], "ponder");
+  // The GUI plays both moves and has the engine think on the opponent's time,
+  // and the opponent plays the expected reply.
+  engine.handle_command(absl::StrCat("position startpos moves ", words[1], " ",
+                                     words[3]));
+  engine.handle_command("go ponder wtime 1000 btime 1000");
+  engine.handle_command("ponderhit");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+}
+
+TEST(UciEngine, ReportsEveryLine) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name MultiPV value 3");
+  engine.handle_command("go depth 2");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StrContains(out.str(), "info depth 2 multipv 1 score "));
+  EXPECT_TRUE(absl::StrContains(out.str(), "info depth 2 multipv 3 score "));
+  EXPECT_FALSE(absl::StrContains(out.str(), "multipv 4"));
+}
+
+TEST(UciEngine, LooksForTablebases) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name SyzygyPath value /no/such/dir");
+  EXPECT_EQ(last_line(out), "info string found 0 tablebase files");
+  // Which loads them again.
+  out.str("");
+  engine.handle_command("setoption name SyzygyCache value 0");
+  EXPECT_EQ(last_line(out), "info string found 0 tablebase files");
+  engine.handle_command("position fen 4k3/8/8/8/8/8/8/3QK3 w - - 0 1");
+  engine.handle_command("go depth 3");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+}
+
+TEST(UciEngine, PlaysBookMoves) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name BookFile value /no/such/book.bin");
+  EXPECT_EQ(last_line(out), "info string can't open book /no/such/book.bin");
+
+  // A book with 1. d4 as the only move from the start position.
+  const std::string path = testing::TempDir() + "uci_test_book.bin";
+  const uint64_t key = polyglot_key(Board());
+  char entry[16] = {};
+  for (int i = 0; i < 8; ++i) {
+    entry[i] = static_cast<char>(key >> (56 - 8 * i));
+  }
+  // d2d4, weight 1.
+  entry[8] = 0x02;
+  entry[9] = static_cast<char>(0xDB);
+  entry[11] = 1;
+  std::ofstream(path, std::ios::binary).write(entry, sizeof(entry));
+  engine.handle_command("setoption name BookFile value " + path);
+  EXPECT_EQ(last_line(out),
+            absl::StrCat("info string book ", path, " has 1 entries"));
+  engine.handle_command("position startpos");
+  engine.handle_command("go wtime 1000 btime 1000");
+  engine.wait_for_search();
+  EXPECT_EQ(last_line(out), "bestmove d2d4");
+  // Out of the book, the engine searches.
+  engine.handle_command("position startpos moves e2e4");
+  engine.handle_command("go depth 1");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StrContains(out.str(), "info depth 1"));
+  std::remove(path.c_str());
+}
+
+TEST(UciEngine, BenchIsDeterministic) {
+  std::string node_counts[2];
+  for (std::string& node_count : node_counts) {
+    std::ostringstream out;
+    UciEngine engine(&out);
+    // Options that change the search of a game don't change the bench.
+    engine.handle_command("setoption name Threads value 2");
+    engine.handle_command("setoption name Hash value 1");
+    EXPECT_TRUE(engine.handle_command("bench 3"));
+    EXPECT_TRUE(absl::StartsWith(last_line(out), "Nodes/second: "));
+    const std::vector<std::string> lines =
+        absl::StrSplit(out.str(), '\n', absl::SkipEmpty());
+    ASSERT_GE(lines.size(), 4);
+    node_count = lines[lines.size() - 3];
+    EXPECT_TRUE(absl::StartsWith(node_count, "Nodes searched: "));
+    EXPECT_TRUE(
+        absl::StartsWith(lines[lines.size() - 4], "Stop latency (us): max "));
+    EXPECT_TRUE(absl::StartsWith(out.str(), "Position 1/"));
+  }
+  EXPECT_EQ(node_counts[0], node_counts[1]);
+}
+
+TEST(UciEngine, TracesSearches) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  const std::string path = testing::TempDir() + "uci_test_trace.json";
+  engine.handle_command("setoption name TraceFile value " + path);
+  engine.handle_command("setoption name Hash value 2");
+  engine.handle_command("go depth 3");
+  engine.wait_for_search();
+  engine.handle_command("setoption name TraceFile value <empty>");
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "info string trace has "));
+  std::ifstream file(path);
+  std::stringstream trace;
+  trace << file.rdbuf();
+  EXPECT_TRUE(absl::StrContains(trace.str(), "\"name\":\"table resize\""));
+  EXPECT_TRUE(absl::StrContains(trace.str(), "\"name\":\"search\""));
+  EXPECT_TRUE(absl::StrContains(trace.str(), "{\"depth\":3}"));
+  std::remove(path.c_str());
+}
+
+TEST(UciEngine, WritesCounters) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  EXPECT_TRUE(engine.handle_command("counters reset"));
+  EXPECT_TRUE(engine.handle_command("counters"));
+  EXPECT_TRUE(absl::StartsWith(out.str(), "info string "));
+  if (PAWN_GRABBER_INSTRUMENT) {
+    EXPECT_TRUE(absl::StartsWith(out.str(), "info string nodes 0\n"));
+  }
+}
+
+TEST(UciEngine, WritesMemory) {
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Hash value 4");
+  engine.handle_command("isready");
+  EXPECT_TRUE(engine.handle_command("memory"));
+  EXPECT_TRUE(absl::StrContains(
+      out.str(), absl::StrCat("info string memory transposition_table ",
+                              size_t{4} << 20, "\n")));
+  EXPECT_TRUE(absl::StrContains(out.str(), "info string memory resident "));
+}
+
+TEST(UciEngine, ResumesTheHashFile) {
+  const std::string path = testing::TempDir() + "uci_test_hash.tt";
+  std::remove(path.c_str());
+  {
+    std::ostringstream out;
+    UciEngine engine(&out);
+    engine.handle_command("setoption name Hash value 2");
+    engine.handle_command("setoption name HashFile value " + path);
+    engine.handle_command("isready");
+    EXPECT_TRUE(absl::StrContains(out.str(),
+                                  "info string created hash file " + path));
+    engine.handle_command("go depth 8");
+    engine.wait_for_search();
+    // Keeps the table for the next game.
+    engine.handle_command("ucinewgame");
+    EXPECT_FALSE(engine.handle_command("quit"));
+  }
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Hash value 2");
+  engine.handle_command("setoption name HashFile value " + path);
+  engine.handle_command("isready");
+  const std::string resumed = "info string resumed hash file " + path;
+  EXPECT_TRUE(absl::StrContains(out.str(), resumed));
+  EXPECT_FALSE(absl::StrContains(out.str(), resumed + " at 0 permille"));
+  // Another size starts over, and no file goes back to memory.
+  engine.handle_command("setoption name Hash value 1");
+  engine.handle_command("isready");
+  EXPECT_TRUE(absl::StrContains(out.str(),
+                                "info string created hash file " + path));
+  engine.handle_command("setoption name HashFile value <empty>");
+  engine.handle_command("go depth 3");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  std::remove(path.c_str());
+}
+
+TEST(UciEngine, SharesTheHashBetweenEngines) {
+  const std::string name = "/uci_test_" + std::to_string(getpid());
+  std::ostringstream first_out;
+  UciEngine first(&first_out);
+  first.handle_command("setoption name Hash value 2");
+  first.handle_command("setoption name SharedHash value " + name);
+  first.handle_command("isready");
+  EXPECT_TRUE(absl::StrContains(first_out.str(),
+                                "info string created shared hash " + name));
+  std::ostringstream second_out;
+  UciEngine second(&second_out);
+  second.handle_command("setoption name Hash value 2");
+  second.handle_command("setoption name SharedHash value " + name);
+  second.handle_command("isready");
+  EXPECT_TRUE(absl::StrContains(second_out.str(),
+                                "info string attached shared hash " + name));
+  // The second engine finds the first one's entries.
+  first.handle_command("go depth 8");
+  first.wait_for_search();
+  second.handle_command("go depth 1");
+  second.wait_for_search();
+  const std::string str = second_out.str();
+  const size_t hashfull = str.rfind(" hashfull ");
+  ASSERT_NE(hashfull, std::string::npos);
+  EXPECT_NE(str.substr(hashfull, 12), " hashfull 0 ");
+  // Another size can't attach, and falls back on a table of its own.
+  std::ostringstream third_out;
+  UciEngine third(&third_out);
+  third.handle_command("setoption name SharedHash value " + name);
+  third.handle_command("isready");
+  EXPECT_TRUE(absl::StrContains(third_out.str(),
+                                "info string can't attach shared hash "));
+  third.handle_command("go depth 3");
+  third.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(third_out), "bestmove "));
+  shm_unlink(name.c_str());
+}
+
+TEST(UciEngine, SearchesWithClusterWorkers) {
+  // A port that was free a moment ago.
+  uint16_t port;
+  {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    socklen_t addr_size = sizeof(addr);
+    ASSERT_EQ(bind(fd, reinterpret_cast<const sockaddr*>(&addr),
+                   sizeof(addr)),
+              0);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_size);
+    port = ntohs(addr.sin_port);
+    close(fd);
+  }
+  std::ostringstream out;
+  UciEngine engine(&out);
+  engine.handle_command("setoption name Hash value 1");
+  engine.handle_command(absl::StrCat("setoption name ClusterPort value ",
+                                     port));
+  engine.handle_command("setoption name ClusterWorkers value 1");
+  TranspositionTable table(1);
+  ParallelSearcher searcher(nullptr, &table);
+  ClusterNode worker(&table, ClusterOptions());
+  std::string error;
+  // The engine listens on the table thread, maybe not yet.
+  for (int attempt = 0;
+       attempt < 100 && !worker.connect("localhost", port, &error);
+       ++attempt) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  std::thread serving([&] { worker.serve(&searcher); });
+  engine.handle_command("isready");
+  EXPECT_TRUE(absl::StrContains(out.str(),
+                                "info string 1 cluster workers connected"));
+  engine.handle_command("position startpos moves e2e4 e7e5");
+  engine.handle_command("go depth 6");
+  engine.wait_for_search();
+  EXPECT_TRUE(absl::StartsWith(last_line(out), "bestmove "));
+  // Closes the cluster, which ends the worker.
+  engine.handle_command("setoption name ClusterWorkers value 0");
+  engine.handle_command("isready");
+  serving.join();
+}
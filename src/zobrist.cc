@@ -0,0 +1,55 @@
+#include "zobrist.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.h"
+
+uint64_t compute_zobrist_key(const Board& board) {
+  uint64_t res = 0;
+  for (Color color : {Color::white, Color::black}) {
+    for (size_t piece_idx = 0; piece_idx < num_piece_types; ++piece_idx) {
+      const Piece piece = static_cast<Piece>(piece_idx);
+      for (Bitboard sq : bitboard_split(board.pieces(color, piece))) {
+        res ^= zobrist_piece_key(color, piece, square_idx(sq));
+      }
+    }
+  }
+  if (!board.is_whites_move_) {
+    res ^= zobrist_keys.black_to_move_;
+  }
+  return res ^ castling_and_en_passant_key(board);
+}
+
+uint64_t compute_pawn_key(const Board& board) {
+  uint64_t res = 0;
+  for (Color color : {Color::white, Color::black}) {
+    for (Bitboard sq : bitboard_split(board.pieces(color, Piece::pawn))) {
+      res ^= zobrist_piece_key(color, Piece::pawn, square_idx(sq));
+    }
+  }
+  return res;
+}
+
+uint64_t compute_material_key(const Board& board) {
+  uint64_t res = 0;
+  for (Color color : {Color::white, Color::black}) {
+    for (size_t piece = 0; piece < num_piece_types; ++piece) {
+      const int count =
+          popcount(board.pieces(color, static_cast<Piece>(piece)));
+      for (int idx = 0; idx < count; ++idx) {
+        res ^= zobrist_piece_key(color, static_cast<Piece>(piece), idx);
+      }
+    }
+  }
+  return res;
+}
+
+uint64_t castling_and_en_passant_key(const Board& board) {
+  uint64_t res = zobrist_castling_keys[board.castling_rights_];
+  if (board.en_passant_square_) {
+    res ^= zobrist_en_passant_key(board.en_passant_square_);
+  }
+  return res;
+}
@@ -0,0 +1,125 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.h"
+
+// Zobrist hashing gives every (color, piece, square) triple, the side to move,
+// every castling right and every en passant file a random 64 bit key. The key
+// of a position is the XOR of the keys of everything in it, so equal positions
+// get equal keys and a move changes the key by a few XORs.
+//
+// The keys of black are those of white on the mirrored square with their
+// halves swapped, and the black castling rights those of white the same way,
+// while the side to move and en passant keys have equal halves. A position
+// flipped to the other colors (see `Board::flipped`) then has its key with the
+// halves swapped, up to the side to move, so the key of the flipped position
+// is known from the key alone (see `flipped_zobrist_key`).
+
+// splitmix64, which is good enough to make the keys look independent and
+// simple enough to evaluate at compile time.
+constexpr uint64_t splitmix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+struct ZobristKeys {
+  // Indexed by [2 * piece + color][square index].
+  std::array<std::array<uint64_t, 64>, 12> pieces_;
+  uint64_t black_to_move_;
+  // Indexed by the bit of each CastlingRights flag: white kingside, white
+  // queenside, black kingside, black queenside.
+  std::array<uint64_t, 4> castling_;
+  // Indexed by `file_idx` of the en passant square.
+  std::array<uint64_t, 8> en_passant_file_;
+};
+
+constexpr uint64_t swap_key_halves(uint64_t key) {
+  return key << 32 | key >> 32;
+}
+
+// A key that `swap_key_halves` leaves as it is.
+constexpr uint64_t symmetric_key(uint64_t* state) {
+  const uint64_t half = splitmix64(state) >> 32;
+  return half << 32 | half;
+}
+
+constexpr ZobristKeys make_zobrist_keys() {
+  ZobristKeys keys = {};
+  uint64_t state = 0x70AB9A1C0FFEE123ULL;
+  for (size_t piece = 0; piece < num_piece_types; ++piece) {
+    for (size_t sq_idx = 0; sq_idx < 64; ++sq_idx) {
+      const uint64_t key = splitmix64(&state);
+      keys.pieces_[2 * piece][sq_idx] = key;
+      keys.pieces_[2 * piece + 1][sq_idx ^ 56] = swap_key_halves(key);
+    }
+  }
+  keys.black_to_move_ = symmetric_key(&state);
+  for (size_t idx = 0; idx < 2; ++idx) {
+    keys.castling_[idx] = splitmix64(&state);
+    keys.castling_[idx + 2] = swap_key_halves(keys.castling_[idx]);
+  }
+  for (uint64_t& key : keys.en_passant_file_) {
+    key = symmetric_key(&state);
+  }
+  return keys;
+}
+
+constexpr ZobristKeys zobrist_keys = make_zobrist_keys();
+
+constexpr uint64_t zobrist_piece_key(Color color, Piece piece, int sq_idx) {
+  return zobrist_keys.pieces_[2 * static_cast<size_t>(piece) +
+                              static_cast<size_t>(color)]
+                             [static_cast<size_t>(sq_idx)];
+}
+
+// The XOR of the keys of every set of castling rights, indexed by its
+// CastlingRights flags, so that a move that clears some rights changes the key
+// by a single XOR.
+constexpr std::array<uint64_t, 16> make_zobrist_castling_keys() {
+  std::array<uint64_t, 16> res = {};
+  for (size_t rights = 0; rights < res.size(); ++rights) {
+    for (size_t idx = 0; idx < zobrist_keys.castling_.size(); ++idx) {
+      if (rights & (size_t{1} << idx)) {
+        res[rights] ^= zobrist_keys.castling_[idx];
+      }
+    }
+  }
+  return res;
+}
+
+constexpr std::array<uint64_t, 16> zobrist_castling_keys =
+    make_zobrist_castling_keys();
+
+// The key of the en passant square `square`, which must be a square.
+constexpr uint64_t zobrist_en_passant_key(Bitboard square) {
+  return zobrist_keys.en_passant_file_[static_cast<size_t>(file_idx(square))];
+}
+
+// The key of the flipped position of a position with key `key`.
+constexpr uint64_t flipped_zobrist_key(uint64_t key) {
+  return swap_key_halves(key) ^ zobrist_keys.black_to_move_;
+}
+
+// Computes the key of `board` from scratch.
+uint64_t compute_zobrist_key(const Board& board);
+// Computes the key of the pawns of `board` alone, the XOR of the keys of both
+// colors' pawns, from scratch. It keys the pawn structure cache (see
+// pawns.h), and is 0 without pawns.
+uint64_t compute_pawn_key(const Board& board);
+// Computes the key of the material of `board`, which only depends on how many
+// pieces of each color and kind there are: the XOR over every (color, piece)
+// of the keys of that piece on the squares with index 0 to its count - 1. It
+// identifies the endgames that have an evaluation of their own (see
+// endgame.h).
+uint64_t compute_material_key(const Board& board);
+// Returns the part of the key that comes from the castling rights and the en
+// passant square.
+uint64_t castling_and_en_passant_key(const Board& board);
+
+#endif
@@ -0,0 +1,114 @@
+#include "zobrist.h"
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "gtest/gtest.h"
+
+TEST(Zobrist, KeysAreDistinct) {
+  std::set<uint64_t> keys;
+  for (const auto& piece_keys : zobrist_keys.pieces_) {
+    keys.insert(piece_keys.begin(), piece_keys.end());
+  }
+  keys.insert(zobrist_keys.black_to_move_);
+  keys.insert(zobrist_keys.castling_.begin(), zobrist_keys.castling_.end());
+  keys.insert(zobrist_keys.en_passant_file_.begin(),
+              zobrist_keys.en_passant_file_.end());
+  EXPECT_EQ(keys.size(), 12 * 64 + 1 + 4 + 8);
+}
+
+TEST(Zobrist, EqualPositionsHaveEqualKeys) {
+  const std::string fen =
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+  EXPECT_EQ(compute_zobrist_key(Board(fen)), compute_zobrist_key(Board(fen)));
+  // The clocks are not part of the key.
+  EXPECT_EQ(compute_zobrist_key(Board(fen)),
+            compute_zobrist_key(Board(
+                "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w "
+                "KQkq - 7 30")));
+}
+
+TEST(Zobrist, StateChangesTheKey) {
+  const uint64_t start = compute_zobrist_key(Board());
+  EXPECT_NE(start,
+            compute_zobrist_key(Board(
+                "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1")));
+  EXPECT_NE(start,
+            compute_zobrist_key(Board(
+                "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w Kkq - 0 1")));
+  const std::string pieces = "rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR";
+  EXPECT_NE(compute_zobrist_key(Board(pieces + " w KQkq d6 0 3")),
+            compute_zobrist_key(Board(pieces + " w KQkq - 0 3")));
+}
+
+TEST(Zobrist, TranspositionsHaveEqualKeys) {
+  // 1. Nf3 Nf6 2. Nc3 and 1. Nc3 Nf6 2. Nf3 reach the same position.
+  Board board_1 = Board();
+  board_1.do_move(Move(str_to_square("g1"), str_to_square("f3"), Piece::knight,
+                       MoveType::simple));
+  board_1.do_move(Move(str_to_square("g8"), str_to_square("f6"), Piece::knight,
+                       MoveType::simple));
+  board_1.do_move(Move(str_to_square("b1"), str_to_square("c3"), Piece::knight,
+                       MoveType::simple));
+  Board board_2 = Board();
+  board_2.do_move(Move(str_to_square("b1"), str_to_square("c3"), Piece::knight,
+                       MoveType::simple));
+  board_2.do_move(Move(str_to_square("g8"), str_to_square("f6"), Piece::knight,
+                       MoveType::simple));
+  board_2.do_move(Move(str_to_square("g1"), str_to_square("f3"), Piece::knight,
+                       MoveType::simple));
+  EXPECT_EQ(compute_zobrist_key(board_1), compute_zobrist_key(board_2));
+}
+
+namespace {
+// Checks the incremental key against a fresh computation at every node of the
+// tree below `board`.
+void expect_keys_match(Board* board, int depth) {
+  EXPECT_EQ(board->key_, compute_zobrist_key(*board));
+  EXPECT_EQ(board->pawn_key_, compute_pawn_key(*board));
+  EXPECT_EQ(board->material_key_, compute_material_key(*board));
+  if (depth == 0) {
+    return;
+  }
+  UndoInfo undo;
+  for (Move move : board->legal_moves()) {
+    board->do_move(move, &undo);
+    expect_keys_match(board, depth - 1);
+    board->undo_move(move, undo);
+  }
+}
+}  // namespace.
+
+TEST(Zobrist, PawnKeyOnlySeesPawns) {
+  EXPECT_EQ(compute_pawn_key(Board("4k3/8/8/8/8/8/8/R3K2R w KQ - 0 1")), 0);
+  EXPECT_EQ(compute_pawn_key(Board("4k3/4p3/8/8/8/8/3P4/R3K3 w Q - 0 1")),
+            compute_pawn_key(Board("3qk3/4p3/8/8/8/8/3P4/4K3 b - - 0 1")));
+  EXPECT_NE(compute_pawn_key(Board("4k3/4p3/8/8/8/8/3P4/4K3 w - - 0 1")),
+            compute_pawn_key(Board("4k3/3p4/8/8/8/8/4P3/4K3 w - - 0 1")));
+}
+
+TEST(Zobrist, MaterialKeyOnlySeesPieceCounts) {
+  EXPECT_EQ(compute_material_key(Board("4k3/8/8/8/8/8/8/R3K2R w KQ - 0 1")),
+            compute_material_key(Board("1R5k/8/8/8/8/8/8/K6R b - - 0 1")));
+  EXPECT_NE(compute_material_key(Board("4k3/8/8/8/8/8/8/R3K3 w - - 0 1")),
+            compute_material_key(Board("4k3/8/8/8/8/8/8/Q3K3 w - - 0 1")));
+  EXPECT_NE(compute_material_key(Board("4k3/8/8/8/8/8/8/R3K3 w - - 0 1")),
+            compute_material_key(Board("r3k3/8/8/8/8/8/8/4K3 w - - 0 1")));
+  EXPECT_NE(compute_material_key(Board("4k3/8/8/8/8/8/8/R3K3 w - - 0 1")),
+            compute_material_key(Board("4k3/8/8/8/8/8/8/R3K2R w - - 0 1")));
+}
+
+TEST(Zobrist, IncrementalKeyMatchesFromScratch) {
+  // Castling, en passant, promotions and captures of unmoved rooks.
+  const std::vector<std::string> fens = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"};
+  for (const std::string& fen : fens) {
+    Board board = Board(fen);
+    expect_keys_match(&board, 3);
+  }
+}